@@ -140,6 +140,7 @@ extern "C" {
   XX(EREMOTEIO, "remote I/O error")                                           \
   XX(ENOTTY, "inappropriate ioctl for device")                                \
   XX(EFTYPE, "inappropriate file type or format")                             \
+  XX(EALIGN, "misaligned buffer, offset or length for direct I/O")            \
 
 #define UV_HANDLE_TYPE_MAP(XX)                                                \
   XX(ASYNC, async)                                                            \
@@ -158,6 +159,9 @@ extern "C" {
   XX(TTY, tty)                                                                \
   XX(UDP, udp)                                                                \
   XX(SIGNAL, signal)                                                          \
+  XX(XDP, xdp)                                                                \
+  XX(IFACE_WATCH, iface_watch)                                                \
+  XX(SHM_CHANNEL, shm_channel)                                                \
 
 #define UV_REQ_TYPE_MAP(XX)                                                   \
   XX(REQ, req)                                                                \
@@ -169,6 +173,8 @@ extern "C" {
   XX(WORK, work)                                                              \
   XX(GETADDRINFO, getaddrinfo)                                                \
   XX(GETNAMEINFO, getnameinfo)                                                \
+  XX(SPLICE, splice)                                                          \
+  XX(CONNECT_HOST, connect_host)                                              \
 
 typedef enum {
 #define XX(code, _) UV_ ## code = UV__ ## code,
@@ -210,10 +216,14 @@ typedef struct uv_prepare_s uv_prepare_t;
 typedef struct uv_check_s uv_check_t;
 typedef struct uv_idle_s uv_idle_t;
 typedef struct uv_async_s uv_async_t;
+typedef struct uv_async_msg_s uv_async_msg_t;
 typedef struct uv_process_s uv_process_t;
 typedef struct uv_fs_event_s uv_fs_event_t;
 typedef struct uv_fs_poll_s uv_fs_poll_t;
 typedef struct uv_signal_s uv_signal_t;
+typedef struct uv_xdp_s uv_xdp_t;
+typedef struct uv_iface_watch_s uv_iface_watch_t;
+typedef struct uv_shm_channel_s uv_shm_channel_t;
 
 /* Request types. */
 typedef struct uv_req_s uv_req_t;
@@ -225,15 +235,64 @@ typedef struct uv_connect_s uv_connect_t;
 typedef struct uv_udp_send_s uv_udp_send_t;
 typedef struct uv_fs_s uv_fs_t;
 typedef struct uv_work_s uv_work_t;
+typedef struct uv_splice_s uv_splice_t;
+typedef struct uv_connect_host_s uv_connect_host_t;
 
 /* None of the above. */
 typedef struct uv_cpu_info_s uv_cpu_info_t;
 typedef struct uv_interface_address_s uv_interface_address_t;
 typedef struct uv_dirent_s uv_dirent_t;
+typedef struct uv_dir_s uv_dir_t;
 typedef struct uv_passwd_s uv_passwd_t;
+typedef struct uv_metrics_s uv_metrics_t;
+typedef struct uv_phase_histogram_s uv_phase_histogram_t;
+typedef struct uv_perf_counters_s uv_perf_counters_t;
+typedef struct uv_watchdog_info_s uv_watchdog_info_t;
+typedef struct uv_dispatch_info_s uv_dispatch_info_t;
+typedef struct uv_embed_info_s uv_embed_info_t;
+typedef struct uv_threadpool_s uv_threadpool_t;
+typedef struct uv_threadpool_stats_s uv_threadpool_stats_t;
+typedef struct uv_work_class_s uv_work_class_t;
+typedef struct uv_buf_pool_s uv_buf_pool_t;
+typedef struct uv_shared_buf_s uv_shared_buf_t;
+typedef struct uv_iobuf_s uv_iobuf_t;
+typedef struct uv_rusage_s uv_rusage_t;
+typedef struct uv_tcp_info_s uv_tcp_info_t;
+typedef struct uv_io_stats_s uv_io_stats_t;
+typedef struct uv_handle_info_s uv_handle_info_t;
+typedef struct uv_udp_recv_info_s uv_udp_recv_info_t;
+typedef struct uv_process_pool_s uv_process_pool_t;
+typedef struct uv_process_job_s uv_process_job_t;
+typedef struct uv_pipe_pool_s uv_pipe_pool_t;
+typedef struct uv_pipe_pool_req_s uv_pipe_pool_req_t;
+typedef struct uv_runtime_s uv_runtime_t;
+typedef struct uv_fs_log_s uv_fs_log_t;
+typedef struct uv_rate_limit_s uv_rate_limit_t;
 
 typedef enum {
-  UV_LOOP_BLOCK_SIGNAL
+  UV_LOOP_BLOCK_SIGNAL,
+  UV_LOOP_USE_IO_URING,
+  UV_LOOP_MAX_EVENTS,
+  UV_LOOP_SPIN,
+  UV_LOOP_PHASE_HISTOGRAMS,
+  UV_LOOP_TIMER_WHEEL,
+  UV_LOOP_READ_BUDGET,
+  UV_LOOP_FS_SYNC_COALESCE,
+  UV_LOOP_FS_CACHE,
+  UV_LOOP_FS_POLL_SHARED,
+  UV_LOOP_DNS_RESOLVER,
+  UV_LOOP_SIGNALFD,
+  UV_LOOP_ARENA,
+  UV_LOOP_SPARSE_WATCHERS,
+  UV_LOOP_POLL_BUDGET,
+  UV_LOOP_EDGE_TRIGGERED,
+  UV_LOOP_PERF_COUNTERS,
+  UV_LOOP_LAG_HISTOGRAM,
+  UV_LOOP_RECV_RING,
+  UV_LOOP_EMFILE_RESERVE,
+  UV_LOOP_FD_CACHE,
+  UV_LOOP_FSEVENTS_LATENCY,
+  UV_LOOP_USE_HUGEPAGES
 } uv_loop_option;
 
 typedef enum {
@@ -256,6 +315,26 @@ UV_EXTERN int uv_replace_allocator(uv_malloc_func malloc_func,
                                    uv_calloc_func calloc_func,
                                    uv_free_func free_func);
 
+/* 按用途统计libuv内部还没有释放的内存，所有loop合在一起 */
+typedef enum {
+  UV_MEM_STREAM_WRITE,    /* uv_write()的缓冲区数组 */
+  UV_MEM_UDP_SEND,        /* uv_udp_send()的缓冲区数组 */
+  UV_MEM_FS_BUFS,         /* uv_fs_read()/uv_fs_write()的缓冲区数组 */
+  UV_MEM_FS_PATH,         /* 异步fs请求复制的路径 */
+  UV_MEM_FS_SCANDIR,      /* uv_fs_scandir()的结果 */
+  UV_MEM_DNS,             /* uv_getaddrinfo()复制的参数 */
+  UV_MEM_WATCHERS,        /* loop按fd索引的watcher数组 */
+  UV_MEM_TAG_MAX
+} uv_mem_tag_t;
+
+typedef struct {
+  uint64_t bytes;         /* 还没有释放的字节数 */
+  uint64_t count;         /* 还没有释放的块数 */
+  uint64_t total;         /* 累计分配的次数 */
+} uv_mem_stats_t;
+
+UV_EXTERN int uv_mem_stats(uv_mem_tag_t tag, uv_mem_stats_t* stats);
+
 UV_EXTERN uv_loop_t* uv_default_loop(void);
 UV_EXTERN int uv_loop_init(uv_loop_t* loop);
 UV_EXTERN int uv_loop_close(uv_loop_t* loop);
@@ -273,9 +352,208 @@ UV_EXTERN uv_loop_t* uv_loop_new(void);
 UV_EXTERN void uv_loop_delete(uv_loop_t*);
 UV_EXTERN size_t uv_loop_size(void);
 UV_EXTERN int uv_loop_alive(const uv_loop_t* loop);
+/* uv_loop_configure(loop, UV_LOOP_ARENA)之后，loop为异步请求复制的小块内存
+ * （fs请求的路径、getaddrinfo的参数、udp发送的缓冲区数组）从loop私有的分级
+ * 内存池里分配，不再每次经过全局的分配器，uv_loop_close()时一起释放。
+ * fs请求的uv_fs_req_cleanup()要在loop线程里、uv_loop_close()之前调用。
+ *
+ * uv_loop_configure(loop, UV_LOOP_SPARSE_WATCHERS)之后，loop按fd散列保存io
+ * watcher，占用的内存只和loop上的fd数目有关，和fd的编号无关。适合进程里fd很多、
+ * 但每个loop只拥有其中少数几个的场景，代价是每次按fd查找多一次散列。打开以后
+ * 不能再关闭。
+ *
+ * uv_loop_configure(loop, UV_LOOP_POLL_BUDGET, usec)限制每轮循环分发io事件的
+ * 时间（微秒，0表示不限制）。用完以后剩下的就绪事件留到下一轮，先让定时器和
+ * pending队列运行；预算只在回调之间检查，单个回调本身不会被打断。目前只支持
+ * Linux的epoll后端。
+ *
+ * uv_loop_configure(loop, UV_LOOP_EDGE_TRIGGERED)之后，之后开始读的流以边缘触发
+ * 的方式注册：每次可读都一直读到EAGAIN，读取预算用完时再重新注册一次，不活跃的
+ * 连接不会再被重复报告。已经在读的流要等下一次uv_read_start()才生效。只支持
+ * Linux，打开以后不能再关闭。
+ *
+ * uv_loop_configure(loop, UV_LOOP_PERF_COUNTERS)用perf_event_open()为调用线程
+ * 打开指令数、cache miss和上下文切换三个计数器，之后uv_run()在每个阶段前后读一次，
+ * 结果见uv_loop_perf_counters()和uv_metrics_t。要在运行这个loop的线程里调用。
+ * 只统计用户态，硬件计数器打不开（比如虚拟机里）时只保留能打开的，一个都打不开时
+ * 返回perf_event_open()的错误。每个阶段多一次read()，只适合诊断时打开。只支持
+ * Linux，打开以后不能再关闭。
+ *
+ * uv_loop_configure(loop, UV_LOOP_LAG_HISTOGRAM)之后loop延迟（见uv_metrics_t的
+ * lag_*字段）的每个样本还会记进直方图，用uv_loop_lag_histogram()读出分位数。
+ *
+ * uv_loop_configure(loop, UV_LOOP_RECV_RING, nbufs, size)给loop准备nbufs个（2的
+ * 幂，不超过32768）size字节的接收缓冲区，供uv_read_start_ring()的流共用，只能
+ * 设置一次。打开了UV_LOOP_USE_IO_URING并且内核支持（6.0）时，这些缓冲区登记成
+ * io_uring的缓冲区环，流用multishot recv读，数据由内核直接放进缓冲区，不再经过
+ * alloc_cb和read()；否则还是按可读事件读，读到同一个缓冲区里。
+ *
+ * uv_loop_configure(loop, UV_LOOP_EMFILE_RESERVE, nfds, backoff_ms)让loop预先
+ * 打开nfds个（不超过64，默认1个）备用fd。accept()遇到EMFILE时先把它们全部
+ * 关掉腾出余量；backoff_ms为0时照旧把排队的连接accept()下来马上关掉，不为0
+ * 时改成停掉监听的watcher，用UV_EMFILE回调一次connection_cb，连接留在内核
+ * 的backlog里，backoff_ms毫秒后重新打开备用fd，打开不全说明fd还是不够，
+ * 继续等，全部打开以后才恢复监听。两个参数都是unsigned int。
+ *
+ * uv_loop_configure(loop, UV_LOOP_FSEVENTS_LATENCY, ms)设置macOS上
+ * FSEventStream合并事件的延迟（unsigned int，毫秒，默认50）。延迟越大，
+ * 频繁变化时回调越少、越晚。已经在监听时会重建一次事件流。只支持macOS。
+ *
+ * uv_loop_configure(loop, UV_LOOP_USE_HUGEPAGES)之后，超过2MB的watcher表
+ * （fd很多时的loop->watchers，或者散列表）和UV_LOOP_RECV_RING的缓冲区改用
+ * 大页：先试预留的大页（MAP_HUGETLB），没有就请求透明大页（MADV_HUGEPAGE），
+ * 都不行时是普通内存。已经分配的watcher表马上换过去，接收缓冲区环要在这之后
+ * 设置。打开以后不能再关闭。
+ */
 UV_EXTERN int uv_loop_configure(uv_loop_t* loop, uv_loop_option option, ...);
 UV_EXTERN int uv_loop_fork(uv_loop_t* loop);
 
+/* loop的运行统计，所有计数都是从uv_loop_init()开始累计的，调用方可以定期采样
+ * 再做差值。events、poll_count和idle_time目前只在Linux上统计，其他平台为0。
+ */
+struct uv_metrics_s {
+  /* uv_run()循环的迭代次数 */
+  uint64_t loop_count;
+  /* 轮询（epoll_pwait/io_uring_enter）返回的事件总数 */
+  uint64_t events;
+  /* 轮询的次数，events / poll_count即每次轮询返回的平均事件数 */
+  uint64_t poll_count;
+  /* 阻塞在轮询中的总时间，单位纳秒 */
+  uint64_t idle_time;
+  /* 执行过的pending回调总数 */
+  uint64_t pending_count;
+  /* 最近一次处理pending队列时队列的长度 */
+  uint64_t pending_queue_len;
+  /* 执行完关闭流程（uv__finish_close）的handle总数 */
+  uint64_t closing_count;
+  /* 打开了UV_LOOP_PERF_COUNTERS时uv_run()里的用户态指令数、cache miss和
+   * 上下文切换次数，即uv_loop_perf_counters()各阶段之和，否则为0
+   */
+  uint64_t instructions;
+  uint64_t cache_misses;
+  uint64_t context_switches;
+  /* loop延迟：每次轮询前记下最早的定时器计划的到期时间，下一次运行定时器时的
+   * 实际时间减去它就是一个样本，单位纳秒。只在有定时器到期时读一次时钟，不需要
+   * 额外的定时器。lag_sum / lag_count是平均延迟
+   */
+  uint64_t lag_count;
+  uint64_t lag_sum;
+  uint64_t lag_min;
+  uint64_t lag_max;
+  uint64_t reserved[2];
+};
+
+UV_EXTERN int uv_metrics_info(uv_loop_t* loop, uv_metrics_t* metrics);
+
+/* uv_run()每次迭代中各个阶段的耗时直方图。只有对loop调用过
+ * uv_loop_configure(loop, UV_LOOP_PHASE_HISTOGRAMS)才会统计，否则uv_run()
+ * 里不会多读一次时钟。UV_PHASE_POLL只统计uv__io_poll分发回调的时间，阻塞在
+ * 轮询里的时间（uv_metrics_t.idle_time）会被扣除。
+ */
+typedef enum {
+  UV_PHASE_TIMERS,
+  UV_PHASE_PENDING,
+  UV_PHASE_IDLE_PREPARE,
+  UV_PHASE_POLL,
+  UV_PHASE_CHECK,
+  UV_PHASE_CLOSING,
+  UV_PHASE_MAX
+} uv_run_phase;
+
+/* 桶按对数线性划分，每个2的幂区间再均分为8个子桶，相对误差不超过12.5%。
+ * 0-7ns各占一个桶，之后第i个桶的下界为(8 + i % 8) << (i / 8 - 1)纳秒，
+ * 超过2^36纳秒（约68秒）的样本全部落在最后一个桶里。
+ */
+#define UV_PHASE_HISTOGRAM_BUCKETS 272
+
+struct uv_phase_histogram_s {
+  /* 样本个数 */
+  uint64_t count;
+  /* 样本耗时总和，单位纳秒 */
+  uint64_t sum;
+  /* 最长的一次，单位纳秒 */
+  uint64_t max;
+  uint64_t buckets[UV_PHASE_HISTOGRAM_BUCKETS];
+};
+
+UV_EXTERN int uv_phase_histogram(const uv_loop_t* loop,
+                                 uv_run_phase phase,
+                                 uv_phase_histogram_t* hist);
+UV_EXTERN uint64_t uv_phase_histogram_percentile(
+    const uv_phase_histogram_t* hist,
+    double percentile);
+/* loop延迟的直方图，没有打开UV_LOOP_LAG_HISTOGRAM时返回UV_EINVAL */
+UV_EXTERN int uv_loop_lag_histogram(const uv_loop_t* loop,
+                                    uv_phase_histogram_t* hist);
+
+/* uv_perf_counters_t.available的位，对应的计数器打开了才有意义 */
+enum {
+  UV_PERF_INSTRUCTIONS = 1,
+  UV_PERF_CACHE_MISSES = 2,
+  UV_PERF_CONTEXT_SWITCHES = 4
+};
+
+/* 一个uv_run()阶段累计的硬件计数器，参见UV_LOOP_PERF_COUNTERS。
+ * UV_PHASE_POLL包括阻塞在轮询里的时间，其中的上下文切换大多是主动让出CPU
+ */
+struct uv_perf_counters_s {
+  unsigned int available;
+  /* 统计过的阶段执行次数 */
+  uint64_t count;
+  uint64_t instructions;
+  uint64_t cache_misses;
+  uint64_t context_switches;
+  uint64_t reserved[4];
+};
+
+/* 没有打开UV_LOOP_PERF_COUNTERS时返回UV_EINVAL，不是Linux时返回UV_ENOSYS */
+UV_EXTERN int uv_loop_perf_counters(const uv_loop_t* loop,
+                                    uv_run_phase phase,
+                                    uv_perf_counters_t* counters);
+
+/* 看门狗：loop派发的单个回调（uv__io_poll里的I/O watcher、async、定时器和线程
+ * 池的done回调）执行超过threshold毫秒时，在看门狗线程里调用一次uv_watchdog_cb。
+ * 回调运行在看门狗线程，这时loop线程还卡在那个回调里，所以不能调用任何操作这个
+ * loop的函数，包括uv_watchdog_stop()。
+ */
+struct uv_watchdog_info_s {
+  /* 回调所属的handle类型，线程池done回调为UV_UNKNOWN_HANDLE */
+  uv_handle_type type;
+  /* 回调所属的handle，不能确定时为NULL */
+  void* handle;
+  /* 正在执行的回调地址。定时器和async是用户回调，I/O watcher是libuv内部的派发
+   * 函数（如uv__stream_io），线程池是内部的done函数（如uv__fs_done）
+   */
+  void* cb;
+  /* 看门狗发现时回调至少已经执行的时间，单位纳秒 */
+  uint64_t elapsed;
+};
+
+typedef void (*uv_watchdog_cb)(uv_loop_t* loop, const uv_watchdog_info_t* info);
+
+UV_EXTERN int uv_watchdog_start(uv_loop_t* loop,
+                                uv_watchdog_cb cb,
+                                uint64_t threshold);
+UV_EXTERN int uv_watchdog_stop(uv_loop_t* loop);
+
+/* 给采样型profiler用：loop每派发一个回调（和看门狗是同样的那些）都会记下它，
+ * SIGPROF的信号处理函数里用uv_loop_running()找到当前线程正在运行的loop，再用
+ * uv_loop_dispatch_info()取出正在执行的回调，就能把CPU时间算到handle类型和
+ * 用户回调上。两个函数都是异步信号安全的，只应该在loop线程上调用。
+ * 回调里又派发了回调时记录的是最近开始的那一个。不在回调里时返回UV_ENOENT，
+ * 信号打断了记录的过程时返回UV_EAGAIN。
+ */
+struct uv_dispatch_info_s {
+  /* 含义同uv_watchdog_info_t */
+  uv_handle_type type;
+  void* handle;
+  void* cb;
+};
+
+UV_EXTERN uv_loop_t* uv_loop_running(void);
+UV_EXTERN int uv_loop_dispatch_info(const uv_loop_t* loop,
+                                    uv_dispatch_info_t* info);
+
 UV_EXTERN int uv_run(uv_loop_t*, uv_run_mode mode);
 UV_EXTERN void uv_stop(uv_loop_t*);
 
@@ -289,16 +567,64 @@ UV_EXTERN uint64_t uv_now(const uv_loop_t*);
 UV_EXTERN uv_os_fd_t uv_backend_fd(const uv_loop_t*);
 UV_EXTERN int uv_backend_timeout(const uv_loop_t*);
 
+/* 嵌入模式：宿主（GUI、游戏引擎）自己的事件循环替libuv等待，不需要辅助线程。
+ * 每次等待之前调用uv_embed_prepare()，它把还没提交的fd注册交给内核，然后告诉
+ * 宿主要在哪个fd上等什么事件、最多等多久（毫秒，-1为不限，0表示马上再调用）；
+ * 返回值和uv_run()一样，为0时loop已经没有事情了。fd就绪或者超时以后调用
+ * uv_run_ready()处理一轮，它不会阻塞。两次调用之间loop上的操作（包括在别的
+ * 线程里uv_async_send()）都会让fd变为可读。
+ */
+struct uv_embed_info_s {
+  uv_os_fd_t fd;
+  int events;
+  int timeout;
+};
+
+UV_EXTERN int uv_embed_prepare(uv_loop_t* loop, uv_embed_info_t* info);
+UV_EXTERN int uv_run_ready(uv_loop_t* loop);
+
 typedef void (*uv_alloc_cb)(uv_handle_t* handle,
                             size_t suggested_size,
                             uv_buf_t* buf);
 typedef void (*uv_read_cb)(uv_stream_t* stream,
                            ssize_t nread,
                            const uv_buf_t* buf);
+/* 进来时*nbufs是bufs数组的长度，回调里填好缓冲区并把*nbufs改成实际的个数 */
+typedef void (*uv_alloc_iov_cb)(uv_handle_t* handle,
+                                size_t suggested_size,
+                                uv_buf_t* bufs,
+                                unsigned int* nbufs);
+typedef void (*uv_read_iov_cb)(uv_stream_t* stream,
+                               ssize_t nread,
+                               const uv_buf_t bufs[],
+                               unsigned int nbufs);
+/* bufs[i].len是第i次读到的字节数，nread是它们的和，参见uv_read_start_batch() */
+typedef void (*uv_read_batch_cb)(uv_stream_t* stream,
+                                 ssize_t nread,
+                                 const uv_buf_t bufs[],
+                                 unsigned int nbufs);
+/* uv_read_start_iobuf()：buf是读到的数据，位于owner之内，nread < 0时owner
+ * 可能为NULL。要留着数据就对owner加引用（比如uv_iobuf_append()），回调返回
+ * 以后libuv放掉自己的引用
+ */
+typedef void (*uv_read_iobuf_cb)(uv_stream_t* stream,
+                                 ssize_t nread,
+                                 const uv_buf_t* buf,
+                                 uv_shared_buf_t* owner);
 typedef void (*uv_write_cb)(uv_write_t* req, int status);
+/* status[i]是reqs[i]的结果，参见uv_stream_set_write_batch_cb() */
+typedef void (*uv_write_batch_cb)(uv_stream_t* stream,
+                                  uv_write_t* reqs[],
+                                  const int status[],
+                                  unsigned int nreqs);
 typedef void (*uv_connect_cb)(uv_connect_t* req, int status);
+typedef void (*uv_connect_host_cb)(uv_connect_host_t* req, int status);
 typedef void (*uv_shutdown_cb)(uv_shutdown_t* req, int status);
+typedef void (*uv_splice_cb)(uv_splice_t* req, int status);
+typedef void (*uv_watermark_cb)(uv_stream_t* handle, int above);
+typedef void (*uv_stream_timeout_cb)(uv_stream_t* handle, int which);
 typedef void (*uv_connection_cb)(uv_stream_t* server, int status);
+typedef void (*uv_admission_cb)(uv_stream_t* server, int paused);
 typedef void (*uv_close_cb)(uv_handle_t* handle);
 typedef void (*uv_poll_cb)(uv_poll_t* handle, int status, int events);
 typedef void (*uv_timer_cb)(uv_timer_t* handle);
@@ -307,7 +633,22 @@ typedef void (*uv_prepare_cb)(uv_prepare_t* handle);
 typedef void (*uv_check_cb)(uv_check_t* handle);
 typedef void (*uv_idle_cb)(uv_idle_t* handle);
 typedef void (*uv_exit_cb)(uv_process_t*, int64_t exit_status, int term_signal);
+typedef void (*uv_exit_ex_cb)(uv_process_t*,
+                              int64_t exit_status,
+                              int term_signal,
+                              const uv_rusage_t* rusage);
+typedef void (*uv_process_job_cb)(uv_process_job_t* job,
+                                  int status,
+                                  const uv_buf_t* result);
+typedef void (*uv_process_pool_close_cb)(uv_process_pool_t* pool);
+typedef void (*uv_pipe_pool_cb)(uv_pipe_pool_req_t* req,
+                                int status,
+                                uv_pipe_t* pipe);
+typedef void (*uv_pipe_pool_close_cb)(uv_pipe_pool_t* pool);
+typedef void (*uv_fs_log_close_cb)(uv_fs_log_t* log, int status);
+typedef void (*uv_runtime_cb)(uv_loop_t* loop, void* arg);
 typedef void (*uv_walk_cb)(uv_handle_t* handle, void* arg);
+typedef void (*uv_handle_info_cb)(const uv_handle_info_t* info, void* arg);
 typedef void (*uv_fs_cb)(uv_fs_t* req);
 typedef void (*uv_work_cb)(uv_work_t* req);
 typedef void (*uv_after_work_cb)(uv_work_t* req, int status);
@@ -411,8 +752,10 @@ struct uv_shutdown_s {
   uv_loop_t* loop;                                                            \
   uv_handle_type type;                                                        \
   /* private */                                                               \
+  unsigned int flags;  /* 和type放在同一个8字节里，不单独占用对齐空隙 */       \
   uv_close_cb close_cb;                                                       \
   void* handle_queue[2];                                                      \
+  uint64_t activity_time;                                                     \
   UV_HANDLE_PRIVATE_FIELDS                                                    \
 
 /* The abstract base class of all handles. */
@@ -437,19 +780,190 @@ UV_EXTERN int uv_is_active(const uv_handle_t* handle);
 
 UV_EXTERN void uv_walk(uv_loop_t* loop, uv_walk_cb walk_cb, void* arg);
 
+/* fork之后子进程里调用，对loop上的每个handle（和uv_walk()一样跳过内部的）
+ * 调用一次cb，子进程不需要的handle可以在cb里uv_close()，它们的watcher不会再
+ * 注册到新的epoll/kqueue上。其余和uv_loop_fork()一样：继承下来的watcher在
+ * 之后的uv_run()里每轮重新注册一批，不会在第一轮里全部注册完。cb可以为NULL。
+ */
+UV_EXTERN int uv_loop_fork_ex(uv_loop_t* loop, uv_walk_cb cb, void* arg);
+
+/* uv_loop_dump_handles()传给回调的handle状态，info只在回调期间有效 */
+struct uv_handle_info_s {
+  uv_handle_t* handle;
+  uv_handle_type type;
+  /* libuv内部的UV_HANDLE_*标志位，不同版本之间不保证含义不变 */
+  unsigned int flags;
+  /* 没有fd或者已经在关闭时为-1 */
+  uv_os_fd_t fd;
+  int active;
+  int ref;
+  int closing;
+  /* 距离上一次有事件或者回调的时间，单位毫秒，按loop->time计算。
+   * 从来没有过的是从初始化开始算
+   */
+  uint64_t idle_time;
+  /* 流的write_queue_size，UDP的send_queue_size，其他handle为0 */
+  size_t write_queue_size;
+  uint64_t reserved[4];
+};
+
+/* 对loop上的每个handle（不包括libuv内部的）调用一次cb。不分配内存也不做
+ * 系统调用，可以在运行中的loop上定期调用，用来找出卡住或者泄漏的handle。
+ * 和uv_walk()一样，cb里可以关闭handle
+ */
+UV_EXTERN void uv_loop_dump_handles(uv_loop_t* loop,
+                                    uv_handle_info_cb cb,
+                                    void* arg);
+
 /* Helpers for ad hoc debugging, no API/ABI stability guaranteed. */
 UV_EXTERN void uv_print_all_handles(uv_loop_t* loop, /*FILE*/void* stream);
 UV_EXTERN void uv_print_active_handles(uv_loop_t* loop, /*FILE*/void* stream);
 
 UV_EXTERN void uv_close(uv_handle_t* handle, uv_close_cb close_cb);
+/* 一次关闭n个handle，每个都以close_cb关闭，回调在同一轮的关闭阶段里一起
+ * 调用。已经在关闭的handle跳过。TCP、pipe和UDP handle的fd随后就被关掉，
+ * 不再逐个从epoll里删除，由内核在fd关闭时清理；所以这些fd不能还有别的副本
+ * （比如dup()出来的或者子进程继承的），否则它们的事件会继续报告给loop。
+ */
+UV_EXTERN void uv_close_many(uv_handle_t* handles[],
+                             unsigned int n,
+                             uv_close_cb close_cb);
 
 UV_EXTERN int uv_send_buffer_size(uv_handle_t* handle, int* value);
 UV_EXTERN int uv_recv_buffer_size(uv_handle_t* handle, int* value);
+/* 让UDP和pipe（unix域socket）的收发缓冲区自己调整大小。先把缓冲区设成
+ * min_size，UDP收包时SO_RXQ_OVFL报告有丢包就把SO_RCVBUF翻倍，发送遇到
+ * EAGAIN就把SO_SNDBUF翻倍，最多到max_size；一段时间没有再涨过就逐步减半回
+ * min_size。大小是传给setsockopt()的值，受net.core.rmem_max/wmem_max限制。
+ * max_size为0时关闭，缓冲区保持当时的大小。
+ */
+UV_EXTERN int uv_socket_buffer_autotune(uv_handle_t* handle,
+                                        int min_size,
+                                        int max_size);
+
+/* TCP或UDP套接字最后收到的包是在哪个CPU上（SO_INCOMING_CPU）、由哪个NAPI
+ * 实例也就是网卡的哪个收包队列（SO_INCOMING_NAPI_ID）处理的，配合busy poll
+ * 可以让同一个队列的连接都由同一个线程处理。不知道时cpu为-1，napi_id为0
+ * （比如回环接口）；cpu和napi_id可以有一个是NULL。系统不支持时返回
+ * UV_ENOTSUP。
+ */
+UV_EXTERN int uv_socket_incoming(const uv_handle_t* handle,
+                                 int* cpu,
+                                 unsigned int* napi_id);
 
 UV_EXTERN int uv_fileno(const uv_handle_t* handle, uv_os_fd_t* fd);
 
 UV_EXTERN uv_buf_t uv_buf_init(char* base, size_t len);
 
+/* 读缓冲区池。所有缓冲区都是buf_size字节，还回来的放在空闲链表里，最多留
+ * max_free个，多出来的直接释放。不是线程安全的，只能在loop线程里使用。
+ * 用uv_read_start_pooled()和uv_udp_recv_start_pooled()代替alloc_cb，
+ * read_cb/recv_cb里用完buf之后（包括nread <= 0的时候）调用
+ * uv_buf_pool_release()还回去。还有缓冲区没有还回来时销毁返回UV_EBUSY。
+ *
+ * uv_buf_pool_init_ex()带上UV_BUF_POOL_HUGEPAGES时，缓冲区从2MB对齐的大页
+ * 映射里成批切出来（不够时退回透明大页或者普通页），几GB的池子也只占很少的
+ * TLB项。这样的缓冲区不能单独释放，还回来的全部留在空闲链表里，max_free不
+ * 起作用，uv_buf_pool_destroy()时一起解除映射。
+ */
+enum uv_buf_pool_flags {
+  UV_BUF_POOL_HUGEPAGES = 1
+};
+
+struct uv_buf_pool_s {
+  /* public */
+  void* data;
+  /* read-only */
+  size_t buf_size;
+  unsigned int max_free;
+  unsigned int nfree;
+  unsigned int nused;
+  /* private */
+  void* free_list;
+  unsigned int flags;
+  void* slabs;
+};
+
+UV_EXTERN int uv_buf_pool_init(uv_buf_pool_t* pool,
+                               size_t buf_size,
+                               unsigned int max_free);
+UV_EXTERN int uv_buf_pool_init_ex(uv_buf_pool_t* pool,
+                                  size_t buf_size,
+                                  unsigned int max_free,
+                                  unsigned int flags);
+UV_EXTERN int uv_buf_pool_destroy(uv_buf_pool_t* pool);
+UV_EXTERN uv_buf_t uv_buf_pool_get(uv_buf_pool_t* pool);
+UV_EXTERN void uv_buf_pool_release(uv_buf_pool_t* pool, char* base);
+
+typedef void (*uv_shared_buf_free_cb)(uv_shared_buf_t* buf);
+
+/* 带引用计数的缓冲区，同一份数据写给很多个流时不用复制，也不用自己跟踪
+ * 每个写请求的回调。初始化后引用计数为1，归调用者所有；uv_write_shared()
+ * 和uv_write_broadcast()在写请求完成之前各自持有一个引用。计数降到0时
+ * 调用free_cb。不是线程安全的，只能在loop线程里使用。
+ */
+struct uv_shared_buf_s {
+  /* public */
+  void* data;
+  /* read-only */
+  char* base;
+  size_t len;
+  unsigned int refcount;
+  /* private */
+  uv_shared_buf_free_cb free_cb;
+};
+
+UV_EXTERN void uv_shared_buf_init(uv_shared_buf_t* buf,
+                                  char* base,
+                                  size_t len,
+                                  uv_shared_buf_free_cb free_cb);
+UV_EXTERN void uv_shared_buf_ref(uv_shared_buf_t* buf);
+UV_EXTERN void uv_shared_buf_unref(uv_shared_buf_t* buf);
+
+/* 缓冲区链：按顺序排列的若干段，每一段是某个uv_shared_buf_t（owner）里的
+ * 一个切片，链对每一段的owner持有一个引用。bufs可以直接交给uv_write()这样
+ * 的函数；uv_write_iobuf()和uv_udp_send_iobuf()在请求完成之前自己再持有一份
+ * 引用，所以链可以在提交之后马上uv_iobuf_reset()。uv_read_start_iobuf()读到
+ * 的数据也是uv_shared_buf_t，一次分配可以不复制地从读一路走到解析和多个写。
+ * 前4段放在结构体里不用分配，所以链不能按值复制。只能在loop线程里使用。
+ */
+struct uv_iobuf_s {
+  /* public */
+  void* data;
+  /* read-only */
+  uv_buf_t* bufs;
+  uv_shared_buf_t** owners;
+  unsigned int nbufs;
+  size_t len;
+  /* private */
+  unsigned int capacity;
+  uv_buf_t bufsml[4];
+  uv_shared_buf_t* ownersml[4];
+};
+
+UV_EXTERN void uv_iobuf_init(uv_iobuf_t* iob);
+/* 在链尾加上owner里从base开始的len字节。和上一段属于同一个owner并且首尾
+ * 相接时合并成一段。owner为NULL时数据由调用者保证在用完之前有效
+ */
+UV_EXTERN int uv_iobuf_append(uv_iobuf_t* iob,
+                              uv_shared_buf_t* owner,
+                              char* base,
+                              size_t len);
+/* 把src从offset开始的len字节追加到dst，不复制数据 */
+UV_EXTERN int uv_iobuf_append_iobuf(uv_iobuf_t* dst,
+                                    const uv_iobuf_t* src,
+                                    size_t offset,
+                                    size_t len);
+/* 丢掉开头的n字节，整段丢掉时放掉对owner的引用 */
+UV_EXTERN void uv_iobuf_consume(uv_iobuf_t* iob, size_t n);
+/* 从offset开始最多复制len字节到dst，返回复制的字节数。用来解析跨段的消息头 */
+UV_EXTERN size_t uv_iobuf_copyout(const uv_iobuf_t* iob,
+                                  size_t offset,
+                                  char* dst,
+                                  size_t len);
+/* 放掉所有引用，链变成空的，可以继续使用 */
+UV_EXTERN void uv_iobuf_reset(uv_iobuf_t* iob);
+
 
 /*
  * The following functions are declared 'static inline' to ensure that they
@@ -512,6 +1026,31 @@ static INLINE uv_os_fd_t uv_convert_fd_to_handle(int fd) {
 #endif
 
 
+/* uv_io_stats()返回的单个流或UDP handle的I/O统计，从handle初始化开始累计，
+ * 调用方定期采样再做差值。编译libuv时定义了UV_DISABLE_IO_STATS就不统计，
+ * uv_io_stats()返回UV_ENOSYS
+ */
+struct uv_io_stats_s {
+  /* 读到和写出的字节数，UDP按报文的长度累计 */
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+  /* 读写系统调用的次数，recvmmsg()/sendmmsg()一次算一次 */
+  uint64_t read_syscalls;
+  uint64_t write_syscalls;
+  /* 其中返回EAGAIN的次数，UDP发送时的ENOBUFS也算在内 */
+  uint64_t read_eagain;
+  uint64_t write_eagain;
+  /* 没能立即写出、在写队列里等过的请求个数，以及它们从开始等待到数据交给
+   * 内核的总时间，单位纳秒。立即写完的请求不读时钟，不计入
+   */
+  uint64_t write_queued;
+  uint64_t write_queue_time;
+  uint64_t reserved[4];
+};
+
+/* handle必须是TCP、管道、TTY或者UDP handle，否则返回UV_EINVAL */
+UV_EXTERN int uv_io_stats(const uv_handle_t* handle, uv_io_stats_t* stats);
+
 #define UV_STREAM_FIELDS                                                      \
   /* number of bytes queued for writing */                                    \
   size_t write_queue_size;                                                    \
@@ -535,11 +1074,55 @@ struct uv_stream_s {
 UV_EXTERN size_t uv_stream_get_write_queue_size(const uv_stream_t* stream);
 
 UV_EXTERN int uv_listen(uv_stream_t* stream, int backlog, uv_connection_cb cb);
+/* 每次可读事件最多接受burst个连接，一次connection_cb里可以连续uv_accept()
+ * 直到返回UV_EAGAIN。每次只取一个的话会接着回调。默认为1。
+ * 用io_uring的loop上监听由内核的multishot accept完成，每个连接回调一次，
+ * 用户没取走时后来的连接排在队列里，burst不起作用。
+ */
+UV_EXTERN int uv_stream_set_accept_burst(uv_stream_t* server,
+                                         unsigned int burst);
+/* 准入控制：uv_accept()过还没关闭的连接达到max_connections个，或者本轮事件
+ * 处理到服务端时已经落后了max_lag毫秒，就暂停accept()，新连接留在内核的
+ * backlog里排队。连接关掉一些以后、或者过了max_lag毫秒以后自动恢复。
+ * 0表示不限制，两个都为0时关闭准入控制。cb可以为NULL，暂停和恢复时分别以
+ * paused为1和0调用。
+ */
+UV_EXTERN int uv_stream_set_admission(uv_stream_t* server,
+                                      unsigned int max_connections,
+                                      uint64_t max_lag,
+                                      uv_admission_cb cb);
 UV_EXTERN int uv_accept(uv_stream_t* server, uv_stream_t* client);
 
 UV_EXTERN int uv_read_start(uv_stream_t*,
                             uv_alloc_cb alloc_cb,
                             uv_read_cb read_cb);
+/* 分散读：alloc_iov_cb给出的多个缓冲区按顺序填满，nread是总的字节数 */
+UV_EXTERN int uv_read_start_iov(uv_stream_t*,
+                                uv_alloc_iov_cb alloc_iov_cb,
+                                uv_read_iov_cb read_iov_cb);
+UV_EXTERN int uv_read_start_pooled(uv_stream_t*,
+                                   uv_buf_pool_t* pool,
+                                   uv_read_cb read_cb);
+/* 缓冲区从pool里取，每个都是一个uv_shared_buf_t（头部占用缓冲区开头的一点
+ * 空间），引用计数降到0时自动还给pool，不用调用uv_buf_pool_release()
+ */
+UV_EXTERN int uv_read_start_iobuf(uv_stream_t*,
+                                  uv_buf_pool_t* pool,
+                                  uv_read_iobuf_cb read_cb);
+/* 缓冲区来自UV_LOOP_RECV_RING，空闲的连接不占缓冲区。read_cb里的buf属于loop，
+ * 只在回调里有效，回调返回以后马上被重用，不能释放也不能留着。loop没有设置
+ * UV_LOOP_RECV_RING时返回UV_EINVAL
+ */
+UV_EXTERN int uv_read_start_ring(uv_stream_t*, uv_read_cb read_cb);
+/* 一次可读事件里连续读到的数据攒起来（最多64次读）只回调一次read_batch_cb，
+ * 每次读还是用alloc_cb分配一个缓冲区，所以alloc_cb每次都要给出不同的缓冲区。
+ * 读到EAGAIN时没用上的缓冲区也放在bufs里，len为0，和其他缓冲区一样要释放。
+ * 出错或者EOF时先把攒着的数据回调一次，再以nread为错误码回调，bufs是没用上的
+ * 缓冲区（len为0，可能没有）。
+ */
+UV_EXTERN int uv_read_start_batch(uv_stream_t*,
+                                  uv_alloc_cb alloc_cb,
+                                  uv_read_batch_cb read_batch_cb);
 UV_EXTERN int uv_read_stop(uv_stream_t*);
 
 UV_EXTERN int uv_write(uv_write_t* req,
@@ -553,6 +1136,71 @@ UV_EXTERN int uv_write2(uv_write_t* req,
                         unsigned int nbufs,
                         uv_stream_t* send_handle,
                         uv_write_cb cb);
+/* 和uv_write2()一样，但一次带上nsend_handles个handle（最多253个），它们的fd
+ * 放在同一条消息里，对端一次读就全部收到，再用uv_pipe_pending_count()和
+ * uv_accept()逐个取出来。
+ */
+UV_EXTERN int uv_write2_handles(uv_write_t* req,
+                                uv_stream_t* handle,
+                                const uv_buf_t bufs[],
+                                unsigned int nbufs,
+                                uv_stream_t* send_handles[],
+                                unsigned int nsend_handles,
+                                uv_write_cb cb);
+/* 和uv_write()一样，但在Linux的TCP流上用sendmsg(MSG_ZEROCOPY)发送，省掉
+ * 一次拷贝。内核用完这些页之后才调用cb，在那之前bufs指向的内存不能
+ * 改写。内核不支持或者不是TCP时就是普通的uv_write()。只对很大的缓冲区划算。
+ *
+ * 写端是pipe(2)的uv_pipe_t（比如UV_KERNEL_PIPE）用vmsplice(SPLICE_F_GIFT)
+ * 把页直接挂进pipe。数据全部进了pipe就调用cb，但对端读走以前pipe还引用着
+ * 这些页，所以bufs交出去以后就不能再改写，只能释放。按页对齐的整页效果最好。
+ */
+UV_EXTERN int uv_write_zerocopy(uv_write_t* req,
+                                uv_stream_t* handle,
+                                const uv_buf_t bufs[],
+                                unsigned int nbufs,
+                                uv_write_cb cb);
+/* 把文件fd从offset开始的length字节写到流里。和uv_write()共用写队列，
+ * 按提交的顺序发送；在loop线程里用非阻塞的sendfile()，不占线程池。
+ * 文件不够length字节时cb收到UV_EOF。
+ */
+UV_EXTERN int uv_stream_sendfile(uv_write_t* req,
+                                 uv_stream_t* handle,
+                                 uv_os_fd_t fd,
+                                 int64_t offset,
+                                 size_t length,
+                                 uv_write_cb cb);
+/* 写一个uv_shared_buf_t，请求完成（cb调用之前）时释放持有的引用 */
+UV_EXTERN int uv_write_shared(uv_write_t* req,
+                              uv_stream_t* handle,
+                              uv_shared_buf_t* buf,
+                              uv_write_cb cb);
+/* 把buf写给streams里的每一个流，所有写请求在一次分配里，不用调用者提供
+ * uv_write_t。每个请求写完就释放自己的引用，调用者放掉自己的引用之后，
+ * 通过free_cb得知全部写完。返回成功排上队的流的个数，某个流写不了
+ * （比如已经关闭）时跳过它。
+ */
+UV_EXTERN int uv_write_broadcast(uv_stream_t* streams[],
+                                 unsigned int nstreams,
+                                 uv_shared_buf_t* buf);
+/* 写整个链，请求完成（cb调用之前）时放掉对各段owner的引用 */
+UV_EXTERN int uv_write_iobuf(uv_write_t* req,
+                             uv_stream_t* handle,
+                             const uv_iobuf_t* iob,
+                             uv_write_cb cb);
+/* 回调为NULL的uv_write()请求完成时不再一个一个地回调，而是在处理写完成的
+ * 时候（每轮循环最多一次）把这一批一起交给cb，一次最多64个，多了分几次。
+ * 有自己回调的请求照常回调。cb为NULL时恢复原来的行为。
+ */
+UV_EXTERN int uv_stream_set_write_batch_cb(uv_stream_t* handle,
+                                           uv_write_batch_cb cb);
+/* 不用uv_write_t也没有回调的写：先直接写，写不完的部分复制到内部分配的
+ * 请求里排队，调用返回以后bufs就可以重用。排队之后出的错不会报告，之后的
+ * 读写会遇到同样的错误。
+ */
+UV_EXTERN int uv_write_nocb(uv_stream_t* handle,
+                            const uv_buf_t bufs[],
+                            unsigned int nbufs);
 UV_EXTERN int uv_try_write(uv_stream_t* handle,
                            const uv_buf_t bufs[],
                            unsigned int nbufs);
@@ -571,6 +1219,127 @@ UV_EXTERN int uv_is_readable(const uv_stream_t* handle);
 UV_EXTERN int uv_is_writable(const uv_stream_t* handle);
 
 UV_EXTERN int uv_stream_set_blocking(uv_stream_t* handle, int blocking);
+/* 按最近读到的数据量调整传给alloc_cb的suggested_size，从min_size开始，在
+ * [min_size, max_size]之间变化：读满了就加倍（内核里积压得更多时直接按积压的
+ * 量），连续两次不到一半就减半。min_size为0表示关闭，恢复成固定的64KB。
+ */
+UV_EXTERN int uv_stream_set_read_size_hint(uv_stream_t* handle,
+                                           size_t min_size,
+                                           size_t max_size);
+/* 每次可读事件里这个流最多读reads次、bytes字节（0表示不限制），用完之后留到
+ * loop的下一轮迭代，预算小对其他流更公平，大则吞吐更高。reads为0表示改用
+ * loop的设置，参见UV_LOOP_READ_BUDGET，默认是32次、不限字节数。
+ */
+UV_EXTERN int uv_stream_set_read_budget(uv_stream_t* handle,
+                                        unsigned int reads,
+                                        size_t bytes);
+/* uv_stream_cork()之后uv_write()只排队，uv_stream_uncork()时把排着的请求
+ * 合并成尽量少的writev()写出去。不影响已经在等待可写的请求。
+ */
+/* write_queue_size超过high时调用cb(handle, 1)，之后降到low以下（含）时调用
+ * cb(handle, 0)，省得每次写完都去查write_queue_size。cb为NULL时关闭。
+ * 越过高水位的回调可能在uv_write()里直接调用。
+ */
+UV_EXTERN int uv_stream_set_write_watermarks(uv_stream_t* handle,
+                                             size_t low,
+                                             size_t high,
+                                             uv_watermark_cb cb);
+UV_EXTERN int uv_stream_cork(uv_stream_t* handle);
+UV_EXTERN int uv_stream_uncork(uv_stream_t* handle);
+
+/* uv_stream_set_timeouts()的回调里which的取值 */
+enum uv_stream_timeout_type {
+  UV_STREAM_TIMEOUT_IDLE,
+  UV_STREAM_TIMEOUT_READ,
+  UV_STREAM_TIMEOUT_WRITE
+};
+
+/* 流上的超时（毫秒），0表示不检查：idle毫秒内既没有读到也没有写出数据，
+ * 在读（uv_read_start()之后）但read毫秒内没有读到数据，或者有没写完的
+ * uv_write()但write毫秒内一个字节都没写出去，就调用cb(handle, which)，一般
+ * 在里面关闭流。超时之后这一种不再检查，直到又有了读写。
+ * 不占用户的uv_timer_t：loop按超时的长短把流分组，每组是按到期时间排好的
+ * 链表，读写时只是把流挪到链表尾，由一个内部定时器检查每组的表头。
+ * 三个都为0时取消。设置了超时的流不能uv_stream_detach()。
+ */
+UV_EXTERN int uv_stream_set_timeouts(uv_stream_t* handle,
+                                     uint64_t idle,
+                                     uint64_t read,
+                                     uint64_t write,
+                                     uv_stream_timeout_cb cb);
+
+/* 令牌桶限速器：每秒补充rate字节，桶里最多攒burst字节（为0时等于rate）。
+ * 同一个限速器可以挂在同一个loop的多个流和UDP handle上，它们共享这份带宽，
+ * 比如一个租户的所有连接。令牌用完时handle停止读或者写，排队等待补充，整个
+ * loop只用一个内部定时器，不调用用户的回调。读写之后按实际的字节数扣除，
+ * 报文和sendfile不会被拆开，令牌可能暂时扣成负数。
+ * 还挂在handle上的限速器不能uv_rate_limit_destroy()（返回UV_EBUSY）。
+ */
+struct uv_rate_limit_s {
+  /* public */
+  void* data;
+  /* read-only */
+  uv_loop_t* loop;
+  uint64_t rate;
+  uint64_t burst;
+  unsigned int nhandles;
+  /* private */
+  int64_t tokens;
+  uint64_t last;
+  void* wait_queue[2];
+  void* active_queue[2];
+};
+
+UV_EXTERN int uv_rate_limit_init(uv_loop_t* loop,
+                                 uv_rate_limit_t* rl,
+                                 uint64_t rate,
+                                 uint64_t burst);
+/* 修改速率，已经攒下的令牌保留（不超过新的burst） */
+UV_EXTERN int uv_rate_limit_set(uv_rate_limit_t* rl,
+                                uint64_t rate,
+                                uint64_t burst);
+UV_EXTERN int uv_rate_limit_destroy(uv_rate_limit_t* rl);
+
+/* 读和写分别挂上限速器，为NULL表示不限，两个都为NULL时取消。设了读限速器
+ * 的流uv_read_start_ring()时不走io_uring，所以io_uring的loop上正在读的流
+ * 不能新设读限速器（UV_EBUSY）。设置了限速器的流不能uv_stream_detach()。
+ */
+UV_EXTERN int uv_stream_set_rate_limit(uv_stream_t* handle,
+                                       uv_rate_limit_t* read,
+                                       uv_rate_limit_t* write);
+
+/* 把已连接的TCP或者pipe流从所在的loop上摘下来，再挂到同一个进程里的另一个
+ * loop上，读的状态和还没写完的uv_write()请求一起带过去，之后的回调都在新的
+ * loop上调用。uv_stream_detach()在原来loop的线程里调用，但不能在这个流自己
+ * 的回调里；uv_stream_attach()在新loop的线程里调用。两者之间流不属于任何
+ * loop，不能对它做任何操作。正在连接、关闭写端、转发、有零拷贝写还没确认、
+ * 在uv_read_start_ring()读，或者设置了uv_stream_set_timeouts()、
+ * uv_stream_set_rate_limit()的流返回UV_EBUSY。
+ */
+UV_EXTERN int uv_stream_detach(uv_stream_t* handle);
+UV_EXTERN int uv_stream_attach(uv_loop_t* loop, uv_stream_t* handle);
+
+/* 把src读到的数据原样转发给dst，直到src读到EOF并且数据都写进了dst，或者
+ * 出错，然后调用cb。Linux上经过一个内部的pipe用splice()搬运，数据不进
+ * 用户态；其他情况用一块内部缓冲区read()/write()。dst写不动时就不再从src读。
+ * 转发期间src不能uv_read_start()，dst不能uv_write()/uv_shutdown()，
+ * 会返回UV_EBUSY。关掉任意一端时cb收到UV_ECANCELED。
+ */
+UV_EXTERN int uv_stream_splice(uv_splice_t* req,
+                               uv_stream_t* src,
+                               uv_stream_t* dst,
+                               uv_splice_cb cb);
+
+/* uv_splice_t is a subclass of uv_req_t. */
+struct uv_splice_s {
+  UV_REQ_FIELDS
+  uv_stream_t* src;
+  uv_stream_t* dst;
+  uv_splice_cb cb;
+  /* 已经写进dst的字节数 */
+  uint64_t nbytes;
+  UV_SPLICE_PRIVATE_FIELDS
+};
 
 UV_EXTERN int uv_is_closing(const uv_handle_t* handle);
 
@@ -594,10 +1363,60 @@ UV_EXTERN int uv_tcp_keepalive(uv_tcp_t* handle,
                                int enable,
                                unsigned int delay);
 UV_EXTERN int uv_tcp_simultaneous_accepts(uv_tcp_t* handle, int enable);
+UV_EXTERN int uv_tcp_busy_poll(uv_tcp_t* handle, int usec);
+UV_EXTERN int uv_tcp_notsent_lowat(uv_tcp_t* handle, unsigned int bytes);
+UV_EXTERN int uv_tcp_defer_accept(uv_tcp_t* handle, unsigned int secs);
+UV_EXTERN int uv_tcp_fastopen(uv_tcp_t* handle, unsigned int qlen);
+UV_EXTERN int uv_tcp_fastopen_connect(uv_tcp_t* handle, int enable);
+/* 设置SO_LINGER {1, 0}后uv_close()：close()直接发送RST，连接不进入TIME_WAIT。
+ * 发送缓冲区里还没发出去的数据被丢弃，还在排队的写请求和uv_close()一样以
+ * UV_ECANCELED完成。已经调用过uv_shutdown()的handle返回UV_EINVAL。
+ */
+UV_EXTERN int uv_tcp_close_reset(uv_tcp_t* handle, uv_close_cb close_cb);
+
+typedef enum {
+  UV_TCP_KTLS_TX = 1,
+  UV_TCP_KTLS_RX = 2
+} uv_tcp_ktls_dir;
+
+/* 内核TLS（Linux）。crypto_info是<linux/tls.h>里的tls12_crypto_info_*，
+ * 原样交给setsockopt(SOL_TLS)。装上接收密钥以后，收到的不是应用数据的
+ * 记录（alert、TLS 1.3的NewSessionTicket等）会让read_cb得到UV_EIO。
+ * 其他平台返回UV_ENOTSUP。
+ */
+UV_EXTERN int uv_tcp_ktls(uv_tcp_t* handle,
+                          uv_tcp_ktls_dir dir,
+                          const void* crypto_info,
+                          size_t len);
+
+/* uv_tcp_get_info()返回的连接状态，取自Linux的TCP_INFO或darwin的
+ * TCP_CONNECTION_INFO，平台拿不到的字段为0
+ */
+struct uv_tcp_info_s {
+  /* 平滑后的RTT和RTT方差，单位微秒 */
+  uint32_t rtt;
+  uint32_t rttvar;
+  /* 拥塞窗口，单位字节 */
+  uint32_t snd_cwnd;
+  /* 发送方向的MSS，单位字节 */
+  uint32_t snd_mss;
+  /* 已发出但还没被确认的数据，单位字节 */
+  uint32_t unacked;
+  /* 连接建立以来重传的报文总数 */
+  uint32_t total_retrans;
+  uint32_t reserved[4];
+};
+
+UV_EXTERN int uv_tcp_get_info(const uv_tcp_t* handle, uv_tcp_info_t* info);
 
 enum uv_tcp_flags {
   /* Used with uv_tcp_bind, when an IPv6 address is used. */
-  UV_TCP_IPV6ONLY = 1
+  UV_TCP_IPV6ONLY = 1,
+  /* Used with uv_tcp_bind, set SO_REUSEPORT so that each loop can bind its
+   * own listen socket to the same address and let the kernel distribute
+   * incoming connections between them.
+   */
+  UV_TCP_REUSEPORT = 2
 };
 
 UV_EXTERN int uv_tcp_bind(uv_tcp_t* handle,
@@ -622,6 +1441,27 @@ struct uv_connect_s {
   UV_CONNECT_PRIVATE_FIELDS
 };
 
+/* 按Happy Eyeballs（RFC 8305）连接node:service。解析出来的地址按地址族
+ * 交替排列，每隔delay毫秒（0表示250ms）再发起下一个连接，前一个失败就马上
+ * 发起下一个，第一个连上的socket交给handle，其余的都取消掉。全部失败时cb
+ * 收到最后一个错误。handle必须还没有socket，连接期间关掉handle时cb收到
+ * UV_ECANCELED。
+ */
+UV_EXTERN int uv_tcp_connect_host(uv_connect_host_t* req,
+                                  uv_tcp_t* handle,
+                                  const char* node,
+                                  const char* service,
+                                  unsigned int delay,
+                                  uv_connect_host_cb cb);
+
+/* uv_connect_host_t is a subclass of uv_req_t. */
+struct uv_connect_host_s {
+  UV_REQ_FIELDS
+  uv_connect_host_cb cb;
+  uv_tcp_t* handle;
+  UV_CONNECT_HOST_PRIVATE_FIELDS
+};
+
 
 /*
  * UDP support.
@@ -643,16 +1483,86 @@ enum uv_udp_flags {
    * (provided they all set the flag) but only the last one to bind will receive
    * any traffic, in effect "stealing" the port from the previous listener.
    */
-  UV_UDP_REUSEADDR = 4
+  UV_UDP_REUSEADDR = 4,
+  /*
+   * Indicates that the message was received by recvmmsg, so the buffer
+   * provided to uv_udp_recv_cb is a slot of the buffer returned by alloc_cb
+   * and must not be freed. Used in uv_udp_recv_cb.
+   */
+  UV_UDP_MMSG_CHUNK = 8,
+  /*
+   * Indicates that the kernel coalesced several datagrams of the same flow
+   * into this one (see uv_udp_set_gro). uv_udp_get_gro_segment_size returns
+   * the size of each original datagram. Used in uv_udp_recv_cb.
+   */
+  UV_UDP_GRO = 16,
+  /*
+   * Used with uv_udp_init_ex: alloc_cb is asked for one large buffer that is
+   * split into slots and filled with a single recvmmsg call. Each datagram
+   * is passed to uv_udp_recv_cb with UV_UDP_MMSG_CHUNK set, followed by one
+   * call with nread == 0 and addr == NULL that hands back the whole buffer.
+   * Only has an effect on Linux.
+   */
+  UV_UDP_RECVMMSG = 256,
+  /*
+   * Used with uv_udp_bind, sets SO_REUSEPORT. On Linux every socket bound
+   * to the same address with this flag joins one group and the kernel load
+   * balances incoming datagrams across them, so each loop can own one.
+   */
+  UV_UDP_REUSEPORT = 512
 };
 
 typedef void (*uv_udp_send_cb)(uv_udp_send_t* req, int status);
+typedef void (*uv_udp_watermark_cb)(uv_udp_t* handle, int above);
 typedef void (*uv_udp_recv_cb)(uv_udp_t* handle,
                                ssize_t nread,
                                const uv_buf_t* buf,
                                const struct sockaddr* addr,
                                unsigned flags);
 
+/* uv_udp_recv_start_ex()要额外取的接收信息 */
+enum uv_udp_recv_info_flags {
+  /* 内核收到报文的时间（SO_TIMESTAMPNS） */
+  UV_UDP_RECV_TIMESTAMP = 1,
+  /* 报文的目的地址和收到报文的网卡（IP_PKTINFO/IPV6_RECVPKTINFO） */
+  UV_UDP_RECV_PKTINFO = 2,
+  /* IPv4的TOS或者IPv6的Traffic Class（IP_RECVTOS/IPV6_RECVTCLASS） */
+  UV_UDP_RECV_TOS = 4
+};
+
+/* uv_udp_recv_ex_cb拿到的接收信息，没有请求或者内核没给的字段为0，
+ * tos为-1
+ */
+struct uv_udp_recv_info_s {
+  /* 对端地址，和uv_udp_recv_cb的addr一样 */
+  const struct sockaddr* addr;
+  /* 报文的目的地址（端口为0），回复时作为uv_udp_send_from()的src就能
+   * 从同一个地址发出去
+   */
+  struct sockaddr_storage local;
+  /* 收到报文的网卡 */
+  unsigned int ifindex;
+  /* 内核收到报文的时间 */
+  uv_timespec_t timestamp;
+  int tos;
+  /* 见UV_UDP_GRO */
+  unsigned int gro_segment_size;
+};
+
+typedef void (*uv_udp_recv_ex_cb)(uv_udp_t* handle,
+                                  ssize_t nread,
+                                  const uv_buf_t* buf,
+                                  const uv_udp_recv_info_t* info,
+                                  unsigned flags);
+
+/* 参见uv_read_iobuf_cb。recvmmsg()一次收到的报文共用一个owner */
+typedef void (*uv_udp_recv_iobuf_cb)(uv_udp_t* handle,
+                                     ssize_t nread,
+                                     const uv_buf_t* buf,
+                                     uv_shared_buf_t* owner,
+                                     const struct sockaddr* addr,
+                                     unsigned flags);
+
 /* uv_udp_t is a subclass of uv_handle_t. */
 struct uv_udp_s {
   UV_HANDLE_FIELDS
@@ -701,23 +1611,183 @@ UV_EXTERN int uv_udp_set_multicast_interface(uv_udp_t* handle,
                                              const char* interface_addr);
 UV_EXTERN int uv_udp_set_broadcast(uv_udp_t* handle, int on);
 UV_EXTERN int uv_udp_set_ttl(uv_udp_t* handle, int ttl);
+UV_EXTERN int uv_udp_set_busy_poll(uv_udp_t* handle, int usec);
+UV_EXTERN int uv_udp_set_gro(uv_udp_t* handle, int on);
+/* 打开SO_TXTIME（Linux 4.19以上），之后uv_udp_send_txtime()可以给每个报文
+ * 指定发送时间，由fq或者etf qdisc按时间放行，不用为每个报文唤醒一次定时器。
+ * 时间用CLOCK_MONOTONIC，也就是uv_hrtime()的时钟；要求CLOCK_TAI的etf不支持。
+ * 出口没有配这样的qdisc时报文立即发出。
+ */
+UV_EXTERN int uv_udp_set_txtime(uv_udp_t* handle, int on);
+UV_EXTERN int uv_udp_set_incoming_cpu(uv_udp_t* handle, int cpu);
+UV_EXTERN int uv_udp_reuseport_steer_cpu(uv_udp_t* handle);
+UV_EXTERN unsigned int uv_udp_get_gro_segment_size(const uv_udp_t* handle);
 UV_EXTERN int uv_udp_send(uv_udp_send_t* req,
                           uv_udp_t* handle,
                           const uv_buf_t bufs[],
                           unsigned int nbufs,
                           const struct sockaddr* addr,
                           uv_udp_send_cb send_cb);
+/* 整个链作为一个报文发送，请求完成时放掉对各段owner的引用 */
+UV_EXTERN int uv_udp_send_iobuf(uv_udp_send_t* req,
+                                uv_udp_t* handle,
+                                const uv_iobuf_t* iob,
+                                const struct sockaddr* addr,
+                                uv_udp_send_cb send_cb);
+/* 和uv_udp_send()一样，但用src的地址作为源地址（IP_PKTINFO/IPV6_PKTINFO），
+ * src的端口被忽略，IPv6的sin6_scope_id用作出口网卡。多宿主的服务器用
+ * uv_udp_recv_info_t的local回复就能保证从对端发来的那个地址发出去。
+ */
+UV_EXTERN int uv_udp_send_from(uv_udp_send_t* req,
+                               uv_udp_t* handle,
+                               const uv_buf_t bufs[],
+                               unsigned int nbufs,
+                               const struct sockaddr* addr,
+                               const struct sockaddr* src,
+                               uv_udp_send_cb send_cb);
+/* 把bufs当成一个大报文交给内核，由内核（或网卡）按segment_size切成多个
+ * 报文发出去（Linux的UDP_SEGMENT），最后一个可以短一些。不支持时返回
+ * UV_ENOTSUP。
+ */
+UV_EXTERN int uv_udp_send_gso(uv_udp_send_t* req,
+                              uv_udp_t* handle,
+                              const uv_buf_t bufs[],
+                              unsigned int nbufs,
+                              const struct sockaddr* addr,
+                              unsigned int segment_size,
+                              uv_udp_send_cb send_cb);
+/* 和uv_udp_send()一样，但报文带上SCM_TXTIME，要在uv_hrtime()的txtime纳秒
+ * 时才发出去（参见uv_udp_set_txtime()）。没有打开SO_TXTIME时返回UV_EINVAL。
+ */
+UV_EXTERN int uv_udp_send_txtime(uv_udp_send_t* req,
+                                 uv_udp_t* handle,
+                                 const uv_buf_t bufs[],
+                                 unsigned int nbufs,
+                                 const struct sockaddr* addr,
+                                 uint64_t txtime,
+                                 uv_udp_send_cb send_cb);
+/* 和uv_udp_send_gso()一样（segment_size为0时不分段），但在Linux上用
+ * sendmsg(MSG_ZEROCOPY)发送，省掉把报文拷进内核的那一次拷贝。内核用完这些页
+ * 以后才调用send_cb，在那之前bufs指向的内存不能改写。内核不支持时就是普通的
+ * 发送。只对很大的报文划算，回环地址上内核仍然会拷贝。
+ */
+UV_EXTERN int uv_udp_send_zerocopy(uv_udp_send_t* req,
+                                   uv_udp_t* handle,
+                                   const uv_buf_t bufs[],
+                                   unsigned int nbufs,
+                                   const struct sockaddr* addr,
+                                   unsigned int segment_size,
+                                   uv_udp_send_cb send_cb);
+/* 把count个报文（bufs[i]用reqs[i]发送）一起排进写队列再发送，Linux上一次
+ * sendmmsg()最多发出去20个。返回排进队列的报文个数，一个都没排进去时
+ * 返回错误码。
+ */
+UV_EXTERN int uv_udp_send_batch(uv_udp_send_t reqs[],
+                                uv_udp_t* handle,
+                                const uv_buf_t bufs[],
+                                unsigned int count,
+                                const struct sockaddr* addr,
+                                uv_udp_send_cb send_cb);
 UV_EXTERN int uv_udp_try_send(uv_udp_t* handle,
                               const uv_buf_t bufs[],
                               unsigned int nbufs,
                               const struct sockaddr* addr);
+/* uv_udp_try_send()的批量版本：每个bufs[i]是一个报文，能立即发出去多少就
+ * 发多少。返回发出去的报文个数，一个都没发出去时返回错误码（写不动时是
+ * UV_EAGAIN）。
+ */
+UV_EXTERN int uv_udp_try_send_batch(uv_udp_t* handle,
+                                    const uv_buf_t bufs[],
+                                    unsigned int count,
+                                    const struct sockaddr* addr);
 UV_EXTERN int uv_udp_recv_start(uv_udp_t* handle,
                                 uv_alloc_cb alloc_cb,
                                 uv_udp_recv_cb recv_cb);
+UV_EXTERN int uv_udp_recv_start_pooled(uv_udp_t* handle,
+                                       uv_buf_pool_t* pool,
+                                       uv_udp_recv_cb recv_cb);
+/* 参见uv_read_start_iobuf() */
+UV_EXTERN int uv_udp_recv_start_iobuf(uv_udp_t* handle,
+                                      uv_buf_pool_t* pool,
+                                      uv_udp_recv_iobuf_cb recv_cb);
+/* 和uv_udp_recv_start()一样，只是回调还能拿到info_flags
+ * （enum uv_udp_recv_info_flags）要求的接收信息。平台不支持其中某一项时
+ * 返回UV_ENOTSUP。
+ */
+UV_EXTERN int uv_udp_recv_start_ex(uv_udp_t* handle,
+                                   uv_alloc_cb alloc_cb,
+                                   uv_udp_recv_ex_cb recv_cb,
+                                   unsigned int info_flags);
 UV_EXTERN int uv_udp_recv_stop(uv_udp_t* handle);
 UV_EXTERN size_t uv_udp_get_send_queue_size(const uv_udp_t* handle);
 UV_EXTERN size_t uv_udp_get_send_queue_count(const uv_udp_t* handle);
 
+/* 发送队列满了以后怎么处理新的uv_udp_send()，见uv_udp_set_send_queue_limit() */
+typedef enum {
+  /* uv_udp_send()返回UV_ENOBUFS，请求不入队 */
+  UV_UDP_QUEUE_FAIL,
+  /* 新请求不发送，在下一轮循环里以UV_ENOBUFS完成 */
+  UV_UDP_QUEUE_DROP_NEWEST,
+  /* 从队头开始丢弃还没发出去的请求直到放得下，被丢弃的以UV_ENOBUFS完成 */
+  UV_UDP_QUEUE_DROP_OLDEST
+} uv_udp_queue_policy;
+
+/* 限制发送队列（send_queue_size/send_queue_count）最多max_size字节、max_count
+ * 个请求，为0表示不限制。已经发出去、回调还没调用的请求也算在内，socket写不动
+ * 时的突发流量就不会无限占用内存。不影响已经排队的请求。
+ */
+UV_EXTERN int uv_udp_set_send_queue_limit(uv_udp_t* handle,
+                                          size_t max_size,
+                                          size_t max_count,
+                                          uv_udp_queue_policy policy);
+/* send_queue_size超过high时调用cb(handle, 1)，之后降到low以下（含）时调用
+ * cb(handle, 0)，参见uv_stream_set_write_watermarks()。cb为NULL时关闭。
+ */
+UV_EXTERN int uv_udp_set_send_watermarks(uv_udp_t* handle,
+                                         size_t low,
+                                         size_t high,
+                                         uv_udp_watermark_cb cb);
+/* 接收和发送分别挂上限速器，参见uv_stream_set_rate_limit()。uv_udp_try_send()
+ * 在没有令牌时返回UV_EAGAIN。
+ */
+UV_EXTERN int uv_udp_set_rate_limit(uv_udp_t* handle,
+                                    uv_rate_limit_t* recv,
+                                    uv_rate_limit_t* send);
+
+
+/*
+ * uv_xdp_t is a subclass of uv_handle_t.
+ *
+ * 实验性的AF_XDP socket（只在Linux上可用），网卡某个队列上被XDP程序重定向
+ * 过来的原始帧直接放在handle自己的UMEM里交给回调，不经过协议栈也不拷贝。
+ * libuv不加载XDP程序，需要用户自己把uv_fileno()拿到的fd放进XSKMAP。
+ */
+enum uv_xdp_flags {
+  /* 要求驱动零拷贝（XDP_ZEROCOPY），不支持时uv_xdp_bind()失败 */
+  UV_XDP_ZEROCOPY = 1,
+  /* 强制拷贝模式（XDP_COPY），所有网卡都支持 */
+  UV_XDP_COPY = 2
+};
+
+/* frame指向UMEM里的一帧，只在回调期间有效，回调返回后这一帧就交还给内核 */
+typedef void (*uv_xdp_recv_cb)(uv_xdp_t* handle, const uv_buf_t* frame);
+
+struct uv_xdp_s {
+  UV_HANDLE_FIELDS
+  UV_XDP_PRIVATE_FIELDS
+};
+
+UV_EXTERN int uv_xdp_init(uv_loop_t*, uv_xdp_t* handle);
+/* 创建AF_XDP socket和UMEM，绑定到网卡ifname的queue_id号接收队列。
+ * flags是enum uv_xdp_flags，0表示让内核自己选。
+ */
+UV_EXTERN int uv_xdp_bind(uv_xdp_t* handle,
+                          const char* ifname,
+                          unsigned int queue_id,
+                          unsigned int flags);
+UV_EXTERN int uv_xdp_recv_start(uv_xdp_t* handle, uv_xdp_recv_cb recv_cb);
+UV_EXTERN int uv_xdp_recv_stop(uv_xdp_t* handle);
+
 
 /*
  * uv_tty_t is a subclass of uv_stream_t.
@@ -743,6 +1813,16 @@ UV_EXTERN int uv_tty_init(uv_loop_t*, uv_tty_t*, uv_os_fd_t fd, int readable);
 UV_EXTERN int uv_tty_set_mode(uv_tty_t*, uv_tty_mode_t mode);
 UV_EXTERN int uv_tty_reset_mode(void);
 UV_EXTERN int uv_tty_get_winsize(uv_tty_t*, int* width, int* height);
+/* 缓冲输出：uv_write()先攒着，排队的数据到了size字节或者第一个请求等了
+ * timeout毫秒时用尽量少的writev()一起写出去。换模式和关闭handle时也会先写。
+ * size为0时关闭缓冲并把攒着的写出去。缓冲借用了uv_stream_cork()，打开时
+ * 不要再对这个handle调uv_stream_cork()/uv_stream_uncork()。
+ */
+UV_EXTERN int uv_tty_set_buffering(uv_tty_t*,
+                                   size_t size,
+                                   unsigned int timeout);
+/* 马上写出缓冲里的数据，写不完的等可写时再写 */
+UV_EXTERN int uv_tty_flush(uv_tty_t*);
 
 #ifdef __cplusplus
 extern "C++" {
@@ -769,7 +1849,26 @@ struct uv_pipe_s {
   UV_PIPE_PRIVATE_FIELDS
 };
 
+/*
+ * Flags used with uv_pipe_init_ex.
+ */
+enum uv_pipe_flags {
+  /* 和uv_pipe_init()的ipc参数一样 */
+  UV_PIPE_IPC = 1,
+  /*
+   * uv_pipe_bind()和uv_pipe_connect()创建SOCK_SEQPACKET的socket。每次
+   * read_cb正好是对端一次uv_write()的内容，不用自己分帧；缓冲区放不下
+   * 一整条消息时这条消息被丢掉，read_cb收到UV_EMSGSIZE。排队的多个写
+   * 请求用一次sendmmsg()发出去。空消息和EOF分不开，不要发。
+   * uv_pipe_open()和uv_accept()出来的pipe由fd的类型决定。
+   */
+  UV_PIPE_SEQPACKET = 2
+};
+
 UV_EXTERN int uv_pipe_init(uv_loop_t*, uv_pipe_t* handle, int ipc);
+UV_EXTERN int uv_pipe_init_ex(uv_loop_t*,
+                              uv_pipe_t* handle,
+                              unsigned int flags);
 UV_EXTERN int uv_pipe_open(uv_pipe_t*, uv_os_fd_t file);
 UV_EXTERN int uv_pipe_bind(uv_pipe_t* handle, const char* name);
 UV_EXTERN void uv_pipe_connect(uv_connect_t* req,
@@ -798,9 +1897,16 @@ enum uv_poll_event {
   UV_READABLE = 1,
   UV_WRITABLE = 2,
   UV_DISCONNECT = 4,
-  UV_PRIORITIZED = 8
+  UV_PRIORITIZED = 8,
+  UV_EDGE_TRIGGERED = 16
 };
 
+/* events里带上UV_EDGE_TRIGGERED时fd以边缘触发方式注册（Linux的EPOLLET）：就绪
+ * 状态变化时poll_cb只被调用一次，回调里必须一直读（写）到EAGAIN，否则剩下的数据
+ * 不会再报告，直到又有新数据到达或者重新调用uv_poll_start()。fd很多、大部分时间
+ * 都不活跃的时候可以省掉重复的唤醒。其他平台上返回UV_ENOSYS。
+ */
+
 UV_EXTERN int uv_poll_init(uv_loop_t* loop,
                            uv_poll_t* handle,
                            uv_os_sock_t socket);
@@ -808,6 +1914,11 @@ UV_EXTERN int uv_poll_start(uv_poll_t* handle, int events, uv_poll_cb cb);
 UV_EXTERN int uv_poll_stop(uv_poll_t* handle);
 
 
+/* prepare、check和idle句柄按priority从小到大运行，默认是0，同优先级的后启动的
+ * 先运行。uv_xxx_start_once()启动的句柄只运行一次，回调之前就已经停止，需要时
+ * 在回调或者别的地方再启动；没有启动的句柄不占用每轮循环的时间。句柄已经启动时
+ * uv_xxx_start()和uv_xxx_start_once()什么都不做。
+ */
 struct uv_prepare_s {
   UV_HANDLE_FIELDS
   UV_PREPARE_PRIVATE_FIELDS
@@ -815,6 +1926,8 @@ struct uv_prepare_s {
 
 UV_EXTERN int uv_prepare_init(uv_loop_t*, uv_prepare_t* prepare);
 UV_EXTERN int uv_prepare_start(uv_prepare_t* prepare, uv_prepare_cb cb);
+UV_EXTERN int uv_prepare_start_once(uv_prepare_t* prepare, uv_prepare_cb cb);
+UV_EXTERN int uv_prepare_set_priority(uv_prepare_t* prepare, int priority);
 UV_EXTERN int uv_prepare_stop(uv_prepare_t* prepare);
 
 
@@ -825,6 +1938,8 @@ struct uv_check_s {
 
 UV_EXTERN int uv_check_init(uv_loop_t*, uv_check_t* check);
 UV_EXTERN int uv_check_start(uv_check_t* check, uv_check_cb cb);
+UV_EXTERN int uv_check_start_once(uv_check_t* check, uv_check_cb cb);
+UV_EXTERN int uv_check_set_priority(uv_check_t* check, int priority);
 UV_EXTERN int uv_check_stop(uv_check_t* check);
 
 
@@ -835,6 +1950,8 @@ struct uv_idle_s {
 
 UV_EXTERN int uv_idle_init(uv_loop_t*, uv_idle_t* idle);
 UV_EXTERN int uv_idle_start(uv_idle_t* idle, uv_idle_cb cb);
+UV_EXTERN int uv_idle_start_once(uv_idle_t* idle, uv_idle_cb cb);
+UV_EXTERN int uv_idle_set_priority(uv_idle_t* idle, int priority);
 UV_EXTERN int uv_idle_stop(uv_idle_t* idle);
 
 
@@ -848,6 +1965,24 @@ UV_EXTERN int uv_async_init(uv_loop_t*,
                             uv_async_cb async_cb);
 UV_EXTERN int uv_async_send(uv_async_t* async);
 
+/* 随uv_async_send_data()传给loop线程的消息，内存由调用者管理，在
+ * uv_async_recv_data()取走之前不能释放或者重用。
+ */
+struct uv_async_msg_s {
+  void* data;
+  /* read-only */
+  uv_async_msg_t* next;
+};
+
+/* 把msg放进handle的无锁消息队列并唤醒loop，可以在任意线程调用。多次发送只
+ * 会合并成一次回调，回调里用uv_async_recv_data()一次取走所有消息。
+ */
+UV_EXTERN int uv_async_send_data(uv_async_t* async, uv_async_msg_t* msg);
+/* 取走目前为止收到的所有消息，按发送的先后用next串起来，没有消息时返回NULL。
+ * 只能在loop线程调用，handle关闭之后也可以用来取回剩下的消息。
+ */
+UV_EXTERN uv_async_msg_t* uv_async_recv_data(uv_async_t* async);
+
 
 /*
  * uv_timer_t is a subclass of uv_handle_t.
@@ -864,6 +1999,25 @@ UV_EXTERN int uv_timer_start(uv_timer_t* handle,
                              uv_timer_cb cb,
                              uint64_t timeout,
                              uint64_t repeat);
+/* 同uv_timer_start()，但允许定时器晚slack毫秒触发。超时时间会在
+ * [timeout, timeout + slack]里对齐到一个2的幂的边界上，slack相近的定时器就会落
+ * 在同一时刻，loop被唤醒的次数更少。slack对之后的uv_timer_again()同样有效。
+ */
+UV_EXTERN int uv_timer_start_ex(uv_timer_t* handle,
+                                uv_timer_cb cb,
+                                uint64_t timeout,
+                                uint64_t repeat,
+                                uint64_t slack);
+/* 同uv_timer_start()，但timeout_ns和repeat_ns以纳秒计。Linux上由loop的一个
+ * timerfd按绝对时间唤醒，macOS上注册成kqueue的EVFILT_TIMER（NOTE_NSECONDS），
+ * 不受轮询毫秒超时的限制；其他平台上向上取整成毫秒。
+ * 纳秒定时器上uv_timer_get_repeat()/uv_timer_set_repeat()也以纳秒计。
+ * 重复的纳秒定时器从上一次的截止时间开始算下一次，回调的延迟不会累积。
+ */
+UV_EXTERN int uv_timer_start_ns(uv_timer_t* handle,
+                                uv_timer_cb cb,
+                                uint64_t timeout_ns,
+                                uint64_t repeat_ns);
 UV_EXTERN int uv_timer_stop(uv_timer_t* handle);
 UV_EXTERN int uv_timer_again(uv_timer_t* handle);
 UV_EXTERN void uv_timer_set_repeat(uv_timer_t* handle, uint64_t repeat);
@@ -891,6 +2045,35 @@ UV_EXTERN int uv_getaddrinfo(uv_loop_t* loop,
                              const char* service,
                              const struct addrinfo* hints);
 UV_EXTERN void uv_freeaddrinfo(struct addrinfo* ai);
+/*
+ * uv_loop_configure(loop, UV_LOOP_DNS_RESOLVER, resolv_conf, hosts)让loop上的
+ * 异步uv_getaddrinfo()不再占用线程池：先查hosts文件，再用UDP（被截断或者
+ * options use-vc时用TCP）直接向resolv.conf里的nameserver查询，A和AAAA同时查。
+ * 两个路径为NULL时用/etc/resolv.conf和/etc/hosts，之后文件变了要重新配置；
+ * 有查询在进行时重新配置返回UV_EBUSY。支持nameserver、domain、search和
+ * options ndots/timeout/attempts/use-vc，nameserver可以写成"[addr]:port"
+ * 指定端口。数字地址、非数字的service、AI_NUMERICHOST/AI_V4MAPPED等flags和
+ * 同步调用仍然走getaddrinfo()。在loop里解析的请求uv_cancel()返回UV_EBUSY。
+ */
+/*
+ * 进程内所有loop共享的uv_getaddrinfo()结果缓存，ttl为0时关闭（默认）并清空。
+ * 成功的结果缓存ttl毫秒，名字不存在（UV_EAI_NONAME/UV_EAI_NODATA）缓存
+ * negative_ttl毫秒，临时错误不缓存。成功的结果过期后的stale毫秒内仍然直接
+ * 返回旧结果，同时在后台重新解析一次。最多max_entries项（0表示默认的4096），
+ * 满了淘汰最久没用到的。命中时不经过线程池，得到的addrinfo同样要用
+ * uv_freeaddrinfo()释放。
+ */
+UV_EXTERN int uv_getaddrinfo_cache_configure(unsigned int ttl,
+                                             unsigned int negative_ttl,
+                                             unsigned int stale,
+                                             unsigned int max_entries);
+/*
+ * 打开（enable非0）或关闭同一个loop上相同请求的合并，默认关闭。打开后
+ * node、service、hints都相同的异步请求在前一个还没解析完时不再占用线程池，
+ * 而是等它的结果，各自得到一份要用uv_freeaddrinfo()释放的复制品。等待中的
+ * 请求uv_cancel()返回UV_EBUSY。
+ */
+UV_EXTERN int uv_getaddrinfo_coalesce(int enable);
 
 
 /*
@@ -911,6 +2094,25 @@ UV_EXTERN int uv_getnameinfo(uv_loop_t* loop,
                              uv_getnameinfo_cb getnameinfo_cb,
                              const struct sockaddr* addr,
                              int flags);
+/*
+ * 进程内所有loop共享的uv_getnameinfo()结果缓存，按(地址, 端口, flags)查找，
+ * ttl为0时关闭（默认）并清空。成功的结果缓存ttl毫秒，最多max_entries项
+ * （0表示默认的4096），满了淘汰最久没用到的。命中时不经过线程池。
+ */
+UV_EXTERN int uv_getnameinfo_cache_configure(unsigned int ttl,
+                                             unsigned int max_entries);
+/*
+ * 一次反向解析nreqs个地址：reqs[i]对应addrs[i]，都用同一个回调和flags。
+ * 缓存没有命中的地址在一个工作线程里依次解析，只占一次线程池调度，解析完
+ * 按顺序对每个请求调用回调。有一个地址不是AF_INET/AF_INET6时返回UV_EINVAL，
+ * 这时一个请求都没有发起。批次里的请求不能单独取消，uv_cancel()返回UV_EBUSY。
+ */
+UV_EXTERN int uv_getnameinfo_batch(uv_loop_t* loop,
+                                   uv_getnameinfo_t reqs[],
+                                   const struct sockaddr* const addrs[],
+                                   unsigned int nreqs,
+                                   uv_getnameinfo_cb getnameinfo_cb,
+                                   int flags);
 
 
 /* uv_spawn() options. */
@@ -932,7 +2134,15 @@ typedef enum {
    * Open the child pipe handle in overlapped mode on Windows.
    * On Unix it is silently ignored.
    */
-  UV_OVERLAPPED_PIPE = 0x40
+  UV_OVERLAPPED_PIPE = 0x40,
+
+  /*
+   * 和UV_CREATE_PIPE一起用，创建单向的pipe(2)而不是socketpair，
+   * UV_READABLE_PIPE和UV_WRITABLE_PIPE只能选一个。Linux上往这种pipe里
+   * uv_write_zerocopy()用vmsplice()，不用拷贝。容量见
+   * uv_process_options_t的stdio_buffer_size。
+   */
+  UV_KERNEL_PIPE = 0x80
 } uv_stdio_flags;
 
 typedef struct uv_stdio_container_s {
@@ -1000,6 +2210,19 @@ typedef struct uv_process_options_s {
    */
   char* cpumask;
   size_t cpumask_size;
+  /*
+   * 不为NULL时代替exit_cb调用，多一个子进程自己的资源使用情况（回收时
+   * wait4()得到的，不包括它还没有回收的子进程），单位和uv_getrusage()一样。
+   * 不支持wait4()的平台上rusage为NULL。
+   */
+  uv_exit_ex_cb exit_ex_cb;
+  /*
+   * UV_CREATE_PIPE创建的通道的缓冲区大小（字节），0表示系统默认。
+   * UV_KERNEL_PIPE的pipe用F_SETPIPE_SZ设置（只有Linux，默认64KB，上限是
+   * /proc/sys/fs/pipe-max-size），socketpair设置两端的SO_SNDBUF和
+   * SO_RCVBUF。设置不了时保持系统给的大小，不会让uv_spawn()失败。
+   */
+  unsigned int stdio_buffer_size;
 } uv_process_options_t;
 
 /*
@@ -1068,6 +2291,186 @@ UV_EXTERN int uv_process_kill(uv_process_t*, int signum);
 UV_EXTERN int uv_kill(int pid, int signum);
 UV_EXTERN uv_pid_t uv_process_get_pid(const uv_process_t*);
 
+/*
+ * 常驻子进程池：用同一组uv_process_options_t预先启动nworkers个子进程，任务
+ * 经过IPC管道交给空闲的子进程，不再每个任务fork/exec一次。
+ *
+ * 子进程的fd 0是IPC管道（用libuv写的子进程可以uv_pipe_init(loop, pipe, 1)
+ * 再uv_pipe_open(pipe, 0)），fd 1和2继承父进程，options里的stdio和exit_cb
+ * 不使用。管道上任务和结果都是一帧：4字节网络字节序的长度，后面跟数据。
+ * 每个子进程同一时间只处理一个任务，读完一帧任务后回一帧结果。
+ *
+ * 处理过任务的子进程退出后会重新启动一个补上；还没处理完第一个任务就退出
+ * 的不再重启，以免程序本身有问题时不停地fork。
+ */
+struct uv_process_pool_s {
+  /* public */
+  void* data;
+  /* read-only */
+  uv_loop_t* loop;
+  unsigned int nworkers;
+  /* private */
+  void* impl;
+};
+
+/*
+ * 一个任务。回调之前bufs指向的数据要保持有效（和uv_write()一样）。
+ * status为0时result是子进程的应答，只在回调期间有效；UV_EPIPE表示子进程
+ * 没有应答就退出了，UV_ESRCH表示已经没有可用的子进程，UV_ECANCELED表示
+ * 进程池被关闭。
+ */
+struct uv_process_job_s {
+  /* public */
+  void* data;
+  /* read-only */
+  uv_process_pool_t* pool;
+  /* private */
+  uv_process_job_cb cb;
+  void* queue[2];
+  void* worker;
+  uv_buf_t* bufs;
+  unsigned int nbufs;
+  unsigned int flags;
+  unsigned char header[4];
+  char* result;
+  size_t result_len;
+  int status;
+  uv_write_t write_req;
+};
+
+/*
+ * options里的file、args、env和cwd在进程池关闭之前都要保持有效，
+ * 重启子进程时还会用到。返回错误时进程池不可用，也不需要关闭。
+ */
+UV_EXTERN int uv_process_pool_init(uv_loop_t* loop,
+                                   uv_process_pool_t* pool,
+                                   const uv_process_options_t* options,
+                                   unsigned int nworkers);
+UV_EXTERN int uv_process_pool_submit(uv_process_pool_t* pool,
+                                     uv_process_job_t* job,
+                                     const uv_buf_t bufs[],
+                                     unsigned int nbufs,
+                                     uv_process_job_cb cb);
+/*
+ * 还在排队的任务立即以UV_ECANCELED回调，正在执行的任务随子进程结束以
+ * UV_ECANCELED回调。子进程收到SIGTERM，全部退出后调用close_cb。
+ */
+UV_EXTERN void uv_process_pool_close(uv_process_pool_t* pool,
+                                     uv_process_pool_close_cb close_cb);
+
+
+/*
+ * 到同一个unix socket（Windows上是命名管道）的连接池：预先连好nwarm个
+ * 连接放着，uv_pipe_pool_acquire()直接拿一个已经连上的pipe，每次请求不用
+ * 再等connect()。拿走一个就在后台补连一个；没有空闲连接时请求排队，
+ * 同时多连一个给它。
+ *
+ * 空闲的连接不让loop保持运行，对端关掉的空闲连接会被发现并补上。
+ */
+struct uv_pipe_pool_s {
+  /* public */
+  void* data;
+  /* read-only */
+  uv_loop_t* loop;
+  unsigned int nwarm;
+  /* private */
+  void* impl;
+};
+
+/*
+ * 一次取连接的请求。status为0时pipe是连好的连接，用完要交给
+ * uv_pipe_pool_release()，不能自己关。连接失败时status是connect的错误，
+ * 关闭连接池时还在排队的请求得到UV_ECANCELED。回调总是异步的。
+ */
+struct uv_pipe_pool_req_s {
+  /* public */
+  void* data;
+  /* read-only */
+  uv_pipe_pool_t* pool;
+  /* private */
+  uv_pipe_pool_cb cb;
+  void* queue[2];
+};
+
+/* name在连接池关闭之前不用保持有效，会复制一份 */
+UV_EXTERN int uv_pipe_pool_init(uv_loop_t* loop,
+                                uv_pipe_pool_t* pool,
+                                const char* name,
+                                unsigned int nwarm);
+UV_EXTERN int uv_pipe_pool_acquire(uv_pipe_pool_t* pool,
+                                   uv_pipe_pool_req_t* req,
+                                   uv_pipe_pool_cb cb);
+/*
+ * 还回连接。reuse为0（比如协议出错了）或者空闲连接已经够nwarm个时关掉它，
+ * 否则停止读以后放回空闲列表。连接池关闭以后还回来的连接直接关掉。
+ */
+UV_EXTERN void uv_pipe_pool_release(uv_pipe_t* pipe, int reuse);
+/*
+ * 排队的请求以UV_ECANCELED回调，空闲和正在连的连接被关掉，都关完以后
+ * 调用close_cb。已经借出去的连接不受影响，之后照常还回来。
+ */
+UV_EXTERN void uv_pipe_pool_close(uv_pipe_pool_t* pool,
+                                  uv_pipe_pool_close_cb close_cb);
+
+
+/*
+ * 每个核一个loop的运行时：nloops个loop各自在一个线程里运行，每个loop有一个
+ * 无锁的收件箱，任何线程都可以用uv_runtime_post()把回调交给某个loop执行，
+ * 同一个发送方投递到同一个loop的回调按顺序执行。
+ */
+enum uv_runtime_flags {
+  /* 第i个loop的线程绑到第i % ncpus个CPU上 */
+  UV_RUNTIME_PIN_CPUS = 1,
+  /* uv_runtime_listen()收到的连接按SO_INCOMING_CPU转给第cpu % nloops个
+   * loop，nloops等于CPU个数并且设置了UV_RUNTIME_PIN_CPUS时连接就在处理
+   * 它的软中断的CPU上
+   */
+  UV_RUNTIME_ROUTE_CPU = 2,
+  /* 按SO_INCOMING_NAPI_ID转给第napi_id % nloops个loop，网卡同一个收包队列
+   * 的连接都在同一个loop里。没有NAPI ID时按UV_RUNTIME_ROUTE_CPU处理（如果
+   * 设置了），否则留在接受它的loop里
+   */
+  UV_RUNTIME_ROUTE_NAPI = 4
+};
+
+struct uv_runtime_s {
+  /* public */
+  void* data;
+  /* read-only */
+  unsigned int nloops;
+  /* private */
+  void* impl;
+};
+
+/* nloops为0表示每个CPU一个loop */
+UV_EXTERN int uv_runtime_init(uv_runtime_t* rt,
+                              unsigned int nloops,
+                              unsigned int flags);
+UV_EXTERN uv_loop_t* uv_runtime_loop(uv_runtime_t* rt, unsigned int id);
+/* 调用线程所在loop的编号，不是这个运行时的线程时返回UV_EINVAL */
+UV_EXTERN int uv_runtime_id(const uv_runtime_t* rt);
+/* cb在第id个loop的线程里执行。uv_runtime_destroy()开始以后返回UV_EINVAL */
+UV_EXTERN int uv_runtime_post(uv_runtime_t* rt,
+                              unsigned int id,
+                              uv_runtime_cb cb,
+                              void* arg);
+/*
+ * 在每个loop上各监听一个用SO_REUSEPORT绑定到addr的套接字，由内核把连接分给
+ * 各个loop；端口为0时都用第一个loop拿到的端口。cb在各自loop的线程里调用，
+ * server->data是data。有一个loop失败时已经开始的监听都会关闭。
+ * uv_runtime_listen()和uv_runtime_destroy()不能在运行时自己的线程里调用。
+ */
+UV_EXTERN int uv_runtime_listen(uv_runtime_t* rt,
+                                const struct sockaddr* addr,
+                                int backlog,
+                                uv_connection_cb cb,
+                                void* data);
+/*
+ * 已经投递的回调执行完以后关闭所有loop并等待线程退出。用户自己的handle应该
+ * 事先关闭（比如投递一个关闭它们的回调），还开着的会被直接关闭，不调用close_cb。
+ */
+UV_EXTERN int uv_runtime_destroy(uv_runtime_t* rt);
+
 
 /*
  * uv_work_t is a subclass of uv_req_t.
@@ -1084,6 +2487,200 @@ UV_EXTERN int uv_queue_work(uv_loop_t* loop,
                             uv_work_t* req,
                             uv_work_cb work_cb,
                             uv_after_work_cb after_work_cb);
+/* 一次提交多个请求，比逐个调用uv_queue_work()少很多加锁和唤醒线程的开销 */
+UV_EXTERN int uv_queue_work_batch(uv_loop_t* loop,
+                                  uv_work_t reqs[],
+                                  unsigned int nreqs,
+                                  uv_work_cb work_cb,
+                                  uv_after_work_cb after_work_cb);
+
+/* 任务类别的优先级。HIGH的任务排在已经提交的普通任务前面；NORMAL的和慢IO
+ * 任务一样，和普通任务一起排队；LOW的只在普通任务都被取走之后才执行。
+ * 也可以用其他整数，负数和正数分别与HIGH、LOW同一档，同一档里数值小的
+ * 类别先取。
+ */
+typedef enum {
+  UV_WORK_PRIORITY_HIGH = -1,
+  UV_WORK_PRIORITY_NORMAL = 0,
+  UV_WORK_PRIORITY_LOW = 1
+} uv_work_priority_t;
+
+/* 任务类别，属于某个线程池。同一类别的任务按提交顺序执行，同时执行的任务
+ * 不超过max_running个（0表示不限制），慢IO任务就是每个线程池内置的一个
+ * 上限为线程数一半的类别。
+ */
+struct uv_work_class_s {
+  /* public */
+  void* data;
+  /* read-only */
+  uv_threadpool_t* pool;
+  int priority;
+  unsigned int max_running;
+  /* private */
+  unsigned int running;
+  void* pending_wq[2];
+  void* class_queue[2];
+};
+
+/* 线程池。默认所有loop共用一个由UV_THREADPOOL_SIZE决定大小的线程池，
+ * 也可以用uv_threadpool_init()另外创建，每个线程池有自己的工作队列和线程，
+ * 再用uv_loop_set_threadpool()把loop绑定上去，或者用uv_queue_work_pool()
+ * 单独提交一个请求。fork之后子进程里只有默认线程池可以使用。
+ */
+struct uv_threadpool_s {
+  /* public */
+  void* data;
+  /* read-only */
+  const char* name;
+  unsigned int nthreads;
+  /* private */
+  uv_thread_t* threads;
+  unsigned int threads_size;
+  unsigned int nslots;
+  unsigned int min_threads;
+  unsigned int max_threads;
+  uint64_t spawn_after;
+  uint64_t idle_timeout;
+  uint64_t wq_busy_since;
+  uv_mutex_t mutex;
+  uv_cond_t cond;
+  unsigned int idle_threads;
+  unsigned int nstarting;
+  unsigned int nloops;
+  int stopping;
+  void* shards;
+  unsigned int nshards;
+  unsigned int next_shard;
+  unsigned int nqueued;
+  unsigned int nclassed;
+  void* classes[2];
+  uv_work_class_t slow_io;
+  char* cpumasks;
+  size_t cpumask_size;
+  unsigned int ncpumasks;
+  uv_mutex_t stats_mutex;
+  void* histograms;
+  uint64_t spin_time;
+  unsigned int max_spinners;
+  unsigned int nspinning;
+  void* workers[2];
+  unsigned int nquarantined;
+};
+
+UV_EXTERN int uv_threadpool_init(uv_threadpool_t* pool,
+                                 const char* name,
+                                 unsigned int size);
+UV_EXTERN int uv_threadpool_destroy(uv_threadpool_t* pool);
+/* 运行时调整线程个数，pool为NULL表示默认线程池。uv_threadpool_resize()把
+ * 线程个数固定为size；uv_threadpool_set_elastic()让线程个数在[min, max]
+ * 之间随负载变化，参见src/threadpool.c。nthreads是当前的线程个数。
+ */
+UV_EXTERN int uv_threadpool_resize(uv_threadpool_t* pool, unsigned int size);
+UV_EXTERN int uv_threadpool_set_elastic(uv_threadpool_t* pool,
+                                        unsigned int min,
+                                        unsigned int max,
+                                        uint64_t spawn_after_ms,
+                                        uint64_t idle_timeout_ms);
+/* 线程的CPU亲和性，pool为NULL表示默认线程池。cpumasks是nmasks个连在一起、
+ * 每个长mask_size（不小于uv_cpumask_size()）的掩码，第i个线程用第
+ * i % nmasks个，已有的线程马上生效；nmasks为0表示取消设置。
+ * uv_threadpool_set_numa_node()把所有线程绑到NUMA节点node的CPU上，只有
+ * Linux支持。也可以用环境变量UV_THREADPOOL_NUMA_NODE设置默认线程池。
+ */
+UV_EXTERN int uv_threadpool_set_affinity(uv_threadpool_t* pool,
+                                         const char* cpumasks,
+                                         size_t mask_size,
+                                         unsigned int nmasks);
+UV_EXTERN int uv_threadpool_set_numa_node(uv_threadpool_t* pool, int node);
+/* 线程没有任务时先自旋最多spin_us微秒再睡眠，突发的一批短任务就不用每个都
+ * 唤醒一次线程。同时自旋的线程不超过max_spinners个，也不超过CPU个数减一，
+ * 每个线程根据上次自旋有没有等到任务调整自旋的时间。spin_us为0表示不自旋，
+ * 这是默认设置。
+ */
+UV_EXTERN int uv_threadpool_set_spin(uv_threadpool_t* pool,
+                                     unsigned int spin_us,
+                                     unsigned int max_spinners);
+UV_EXTERN int uv_loop_set_threadpool(uv_loop_t* loop, uv_threadpool_t* pool);
+UV_EXTERN int uv_queue_work_pool(uv_loop_t* loop,
+                                 uv_threadpool_t* pool,
+                                 uv_work_t* req,
+                                 uv_work_cb work_cb,
+                                 uv_after_work_cb after_work_cb);
+/* 在pool（为NULL表示默认线程池）里创建一个任务类别。uv_queue_work_class()
+ * 把一个uv_work_t放进指定的类别。其他请求没有地方带上类别，用
+ * uv_loop_set_work_class()：之后这个loop提交的任务（文件操作、DNS解析和
+ * uv_queue_work()）都进入该类别，直到再次调用，cls为NULL表示恢复原样。类别
+ * 在提交时确定，所以可以只在提交某几个uv_fs_read()的前后设置和恢复，让它们
+ * 和同一个loop里的其他请求分属不同的类别。销毁类别之前要先把用到它的loop
+ * 改回来。
+ */
+UV_EXTERN int uv_work_class_init(uv_threadpool_t* pool,
+                                 uv_work_class_t* cls,
+                                 int priority,
+                                 unsigned int max_running);
+UV_EXTERN int uv_work_class_destroy(uv_work_class_t* cls);
+UV_EXTERN int uv_queue_work_class(uv_loop_t* loop,
+                                  uv_work_class_t* cls,
+                                  uv_work_t* req,
+                                  uv_work_cb work_cb,
+                                  uv_after_work_cb after_work_cb);
+UV_EXTERN int uv_loop_set_work_class(uv_loop_t* loop, uv_work_class_t* cls);
+/* 之后这个loop提交到线程池的uv_queue_work()和文件操作请求都带上截止时间：
+ * 提交之后timeout毫秒。线程按截止时间从早到晚取任务，没有截止时间的排在
+ * 后面；取出来时已经过了截止时间的不再执行，回调收到UV_ETIMEDOUT（uv_fs_t
+ * 是req->result）。timeout为0表示恢复成不带截止时间。走io_uring的文件操作
+ * 不受影响。
+ */
+UV_EXTERN int uv_loop_set_work_deadline(uv_loop_t* loop, uint64_t timeout);
+/* 和uv_loop_set_work_deadline()一样给之后提交的请求定一个时间，但是已经在
+ * 执行的请求到时间也不再等：回调马上收到UV_ETIMEDOUT，执行它的线程被隔离出
+ * 线程池，线程池补一个新线程，卡住的线程返回之后自己退出。卡住的线程还可能
+ * 写请求和它的缓冲区，所以超时的请求和缓冲区要等uv_threadpool_stats()的
+ * quarantined回到0才能释放或者重用；有隔离线程的线程池不能销毁。timeout为0
+ * 表示关闭，已经提交的请求不受影响。
+ */
+UV_EXTERN int uv_loop_set_work_timeout(uv_loop_t* loop, uint64_t timeout);
+
+/* 线程池任务的种类：CPU型（uv_queue_work()）、快IO型（大部分文件操作）和
+ * 慢IO型（DNS解析等）
+ */
+typedef enum {
+  UV_WORK_KIND_CPU,
+  UV_WORK_KIND_FAST_IO,
+  UV_WORK_KIND_SLOW_IO,
+  UV_WORK_KIND_MAX
+} uv_work_kind;
+
+/* 线程池当前的状态，用来判断线程个数够不够 */
+struct uv_threadpool_stats_s {
+  unsigned int nthreads;
+  /* 没有在睡眠的线程个数 */
+  unsigned int busy_threads;
+  /* 还在排队（包括被类别上限挡住）的任务个数，总数和按种类分的 */
+  unsigned int queued;
+  unsigned int queued_by_kind[UV_WORK_KIND_MAX];
+  /* 因为任务超时被隔离、还没有返回的线程个数 */
+  unsigned int quarantined;
+  uint64_t reserved[3];
+};
+
+/* pool为NULL表示默认线程池。uv_threadpool_stats()随时可以调用；
+ * uv_threadpool_enable_histograms()打开之后，每个任务提交、开始和结束时都会
+ * 读一次时钟，按种类统计排队和执行的耗时，uv_threadpool_histogram()取出来，
+ * wait_time和run_time都可以为NULL。uv_req_work_time()返回一个线程池请求
+ * 排队和执行的时间（纳秒），没打开统计时都是0，在done回调里调用才有意义。
+ */
+UV_EXTERN int uv_threadpool_stats(uv_threadpool_t* pool,
+                                  uv_threadpool_stats_t* stats);
+UV_EXTERN int uv_threadpool_enable_histograms(uv_threadpool_t* pool,
+                                              int enable);
+UV_EXTERN int uv_threadpool_histogram(uv_threadpool_t* pool,
+                                      uv_work_kind kind,
+                                      uv_phase_histogram_t* wait_time,
+                                      uv_phase_histogram_t* run_time);
+UV_EXTERN int uv_req_work_time(const uv_req_t* req,
+                               uint64_t* wait_ns,
+                               uint64_t* run_ns);
 
 UV_EXTERN int uv_cancel(uv_req_t* req);
 
@@ -1145,6 +2742,19 @@ UV_EXTERN char** uv_setup_args(int argc, char** argv);
 UV_EXTERN int uv_get_process_title(char* buffer, size_t size);
 UV_EXTERN int uv_set_process_title(const char* title);
 UV_EXTERN int uv_resident_set_memory(size_t* rss);
+
+/* 当前进程的内存占用，单位是字节。Linux上一次pread()读出所有数据，适合频繁
+ * 采样；其他平台只有rss，其余为0。
+ */
+typedef struct {
+  uint64_t rss;      /* 常驻内存 */
+  uint64_t vsize;    /* 虚拟地址空间 */
+  uint64_t shared;   /* 常驻内存里映射自文件、可以和其他进程共享的部分 */
+  uint64_t text;     /* 代码段 */
+  uint64_t data;     /* 数据段加上栈 */
+} uv_memory_stats_t;
+
+UV_EXTERN int uv_get_memory_stats(uv_memory_stats_t* stats);
 UV_EXTERN int uv_uptime(double* uptime);
 
 typedef struct {
@@ -1152,7 +2762,7 @@ typedef struct {
   long tv_usec;
 } uv_timeval_t;
 
-typedef struct {
+struct uv_rusage_s {
    uv_timeval_t ru_utime; /* user CPU time used */
    uv_timeval_t ru_stime; /* system CPU time used */
    uint64_t ru_maxrss;    /* maximum resident set size */
@@ -1169,7 +2779,7 @@ typedef struct {
    uint64_t ru_nsignals;  /* signals received */
    uint64_t ru_nvcsw;     /* voluntary context switches */
    uint64_t ru_nivcsw;    /* involuntary context switches */
-} uv_rusage_t;
+};
 
 UV_EXTERN int uv_getrusage(uv_rusage_t* rusage);
 
@@ -1192,6 +2802,10 @@ UV_EXTERN int uv_os_setpriority(uv_pid_t pid, int priority);
 
 UV_EXTERN int uv_cpu_info(uv_cpu_info_t** cpu_infos, int* count);
 UV_EXTERN void uv_free_cpu_info(uv_cpu_info_t* cpu_infos, int count);
+/* 只取每个CPU的时间，不分配内存也不读型号和频率，适合定期采样。*count传入
+ * times的项数，返回CPU的个数；不够时返回UV_ENOBUFS，*count是需要的项数。
+ */
+UV_EXTERN int uv_cpu_times(struct uv_cpu_times_s* times, int* count);
 UV_EXTERN int uv_cpumask_size(void);
 
 UV_EXTERN int uv_interface_addresses(uv_interface_address_t** addresses,
@@ -1199,6 +2813,86 @@ UV_EXTERN int uv_interface_addresses(uv_interface_address_t** addresses,
 UV_EXTERN void uv_free_interface_addresses(uv_interface_address_t* addresses,
                                            int count);
 
+/*
+ * uv_iface_watch_t is a subclass of uv_handle_t.
+ *
+ * 通过netlink（只在Linux上可用）接收网络接口和地址的变化，并在handle里维护一份
+ * 地址列表的副本，uv_iface_watch_addresses()直接从副本复制，不再枚举getifaddrs()。
+ */
+enum uv_iface_event {
+  UV_IFACE_ADDR_ADDED = 1,
+  UV_IFACE_ADDR_REMOVED = 2,
+  /* 接口的状态、名字或者MAC地址变了，address里只有name、phys_addr和
+   * is_internal有意义
+   */
+  UV_IFACE_LINK_CHANGED = 3,
+  /* 内核的消息队列溢出，丢失了一部分事件，副本已经重新读过，address为NULL */
+  UV_IFACE_RESYNC = 4
+};
+
+/* address只在回调期间有效。status不为0时event为0（UV_IFACE_RESYNC除外） */
+typedef void (*uv_iface_watch_cb)(uv_iface_watch_t* handle,
+                                  int event,
+                                  const uv_interface_address_t* address,
+                                  int status);
+
+struct uv_iface_watch_s {
+  UV_HANDLE_FIELDS
+  UV_IFACE_WATCH_PRIVATE_FIELDS
+};
+
+UV_EXTERN int uv_iface_watch_init(uv_loop_t* loop, uv_iface_watch_t* handle);
+UV_EXTERN int uv_iface_watch_start(uv_iface_watch_t* handle,
+                                   uv_iface_watch_cb cb);
+UV_EXTERN int uv_iface_watch_stop(uv_iface_watch_t* handle);
+/* 结果和uv_interface_addresses()的格式一样，用uv_free_interface_addresses()释放 */
+UV_EXTERN int uv_iface_watch_addresses(const uv_iface_watch_t* handle,
+                                       uv_interface_address_t** addresses,
+                                       int* count);
+
+/*
+ * uv_shm_channel_t is a subclass of uv_handle_t.
+ *
+ * 两个进程之间基于共享内存的消息通道，每个方向一个单生产者单消费者的环。
+ * 对端一直在读的时候收发都不用系统调用，只有对端睡着了才通过一对socket
+ * 叫醒它。一端用uv_shm_channel_create()创建，得到的peer用uv_write2()经
+ * 已有的IPC pipe发给另一个进程，那边uv_accept()出来以后交给
+ * uv_shm_channel_open()。
+ */
+
+/* msg指向环里的内存，只在回调期间有效。对端关掉以后status为UV_EOF */
+typedef void (*uv_shm_channel_cb)(uv_shm_channel_t* handle,
+                                  const uv_buf_t* msg,
+                                  int status);
+/* uv_shm_channel_try_send()返回过UV_EAGAIN以后，对端腾出了空间 */
+typedef void (*uv_shm_channel_writable_cb)(uv_shm_channel_t* handle);
+
+struct uv_shm_channel_s {
+  UV_HANDLE_FIELDS
+  UV_SHM_CHANNEL_PRIVATE_FIELDS
+};
+
+UV_EXTERN int uv_shm_channel_init(uv_loop_t* loop, uv_shm_channel_t* handle);
+/* size是每个方向的环的大小，向上取整到2的幂，最小4KB。peer是
+ * uv_pipe_init(loop, peer, 0)过、还没打开的pipe，成功后可以发给对端，
+ * 发完就可以关掉。
+ */
+UV_EXTERN int uv_shm_channel_create(uv_shm_channel_t* handle,
+                                    size_t size,
+                                    uv_pipe_t* peer);
+/* peer是从IPC pipe上uv_accept()出来的pipe，之后可以关掉 */
+UV_EXTERN int uv_shm_channel_open(uv_shm_channel_t* handle, uv_pipe_t* peer);
+UV_EXTERN int uv_shm_channel_start(uv_shm_channel_t* handle,
+                                   uv_shm_channel_cb cb,
+                                   uv_shm_channel_writable_cb writable_cb);
+UV_EXTERN int uv_shm_channel_stop(uv_shm_channel_t* handle);
+/* 把bufs拼成一条消息放进环里。环满了返回UV_EAGAIN，消息超过环的一半
+ * 返回UV_EMSGSIZE。
+ */
+UV_EXTERN int uv_shm_channel_try_send(uv_shm_channel_t* handle,
+                                      const uv_buf_t bufs[],
+                                      unsigned int nbufs);
+
 UV_EXTERN int uv_os_getenv(const char* name, char* buffer, size_t* size);
 UV_EXTERN int uv_os_setenv(const char* name, const char* value);
 UV_EXTERN int uv_os_unsetenv(const char* name);
@@ -1218,6 +2912,9 @@ typedef enum {
   UV_FS_LSTAT,
   UV_FS_FSTAT,
   UV_FS_FTRUNCATE,
+  UV_FS_FALLOCATE,
+  UV_FS_FADVISE,
+  UV_FS_READAHEAD,
   UV_FS_UTIME,
   UV_FS_FUTIME,
   UV_FS_ACCESS,
@@ -1238,9 +2935,32 @@ typedef enum {
   UV_FS_FCHOWN,
   UV_FS_LCHOWN,
   UV_FS_REALPATH,
-  UV_FS_COPYFILE
+  UV_FS_COPYFILE,
+  UV_FS_OPENDIR,
+  UV_FS_READDIR,
+  UV_FS_CLOSEDIR,
+  UV_FS_WALK,
+  UV_FS_STATX,
+  UV_FS_BATCH,
+  UV_FS_MMAP,
+  UV_FS_MUNMAP,
+  UV_FS_OPENAT,
+  UV_FS_STATAT,
+  UV_FS_UNLINKAT,
+  UV_FS_RENAMEAT
 } uv_fs_type;
 
+/* uv_fs_opendir()打开的目录。调用uv_fs_readdir()之前由用户设置dirents和
+ * nentries，每次最多读出nentries个目录项放在dirents里，不排序，也不包括
+ * "."和".."
+ */
+struct uv_dir_s {
+  uv_dirent_t* dirents;
+  size_t nentries;
+  void* reserved[4];
+  UV_DIR_PRIVATE_FIELDS
+};
+
 /* uv_fs_t is a subclass of uv_req_t. */
 struct uv_fs_s {
   UV_REQ_FIELDS
@@ -1271,6 +2991,18 @@ UV_EXTERN int uv_fs_open(uv_loop_t* loop,
                          int flags,
                          int mode,
                          uv_fs_cb cb);
+/*
+ * 下面几个*at函数的path相对目录fd dir（用uv_fs_open(O_DIRECTORY)打开）解析，
+ * path是绝对路径时忽略dir。反复操作同一个目录下的文件时内核不用每次从头
+ * 解析整条路径，目录被移走或改名后也还是原来那个目录。
+ */
+UV_EXTERN int uv_fs_openat(uv_loop_t* loop,
+                           uv_fs_t* req,
+                           uv_os_fd_t dir,
+                           const char* path,
+                           int flags,
+                           int mode,
+                           uv_fs_cb cb);
 UV_EXTERN int uv_fs_read(uv_loop_t* loop,
                          uv_fs_t* req,
                          uv_os_fd_t file,
@@ -1282,6 +3014,16 @@ UV_EXTERN int uv_fs_unlink(uv_loop_t* loop,
                            uv_fs_t* req,
                            const char* path,
                            uv_fs_cb cb);
+/* *at函数的flags：REMOVEDIR给uv_fs_unlinkat()用，表示删除的是空目录 */
+#define UV_FS_AT_SYMLINK_NOFOLLOW 0x0001
+#define UV_FS_AT_REMOVEDIR        0x0002
+
+UV_EXTERN int uv_fs_unlinkat(uv_loop_t* loop,
+                             uv_fs_t* req,
+                             uv_os_fd_t dir,
+                             const char* path,
+                             int flags,
+                             uv_fs_cb cb);
 UV_EXTERN int uv_fs_write(uv_loop_t* loop,
                           uv_fs_t* req,
                           uv_os_fd_t file,
@@ -1289,6 +3031,51 @@ UV_EXTERN int uv_fs_write(uv_loop_t* loop,
                           unsigned int nbufs,
                           int64_t offset,
                           uv_fs_cb cb);
+/*
+ * 把bufs登记给loop的io_uring（IORING_REGISTER_BUFFERS），页面在登记时锁定一次，
+ * 之后uv_fs_read_fixed()/uv_fs_write_fixed()读写这些缓冲区时不用每次都锁定。
+ * 再次调用替换原来的登记，nbufs为0时取消登记，调用时不能有进行中的固定读写。
+ * 锁定的内存受RLIMIT_MEMLOCK限制，超过时返回UV_ENOMEM。没有打开
+ * UV_LOOP_USE_IO_URING时返回UV_ENOSYS。fork之后要重新登记。
+ */
+UV_EXTERN int uv_fs_register_buffers(uv_loop_t* loop,
+                                     const uv_buf_t bufs[],
+                                     unsigned int nbufs);
+/*
+ * 把files登记成io_uring的固定文件（IORING_REGISTER_FILES），这些fd上走ring的
+ * 读写和fsync不用每次查fd表。uv_fs_close()会把fd从登记里去掉；不经过它关闭的
+ * 话要先重新登记。其余规则和uv_fs_register_buffers()相同。
+ */
+UV_EXTERN int uv_fs_register_files(uv_loop_t* loop,
+                                   const uv_os_fd_t files[],
+                                   unsigned int nfiles);
+/*
+ * 和uv_fs_read()/uv_fs_write()相同，只是只有一个缓冲区，并且它必须落在第index个
+ * 登记的缓冲区里（否则返回UV_EINVAL），走ring时用READ_FIXED/WRITE_FIXED。
+ * loop没有登记缓冲区时（包括不支持io_uring的平台）就是普通的读写。
+ */
+UV_EXTERN int uv_fs_read_fixed(uv_loop_t* loop,
+                               uv_fs_t* req,
+                               uv_os_fd_t file,
+                               const uv_buf_t* buf,
+                               unsigned int index,
+                               int64_t offset,
+                               uv_fs_cb cb);
+UV_EXTERN int uv_fs_write_fixed(uv_loop_t* loop,
+                                uv_fs_t* req,
+                                uv_os_fd_t file,
+                                const uv_buf_t* buf,
+                                unsigned int index,
+                                int64_t offset,
+                                uv_fs_cb cb);
+/*
+ * 分配适合UV_FS_O_DIRECT读写的缓冲区：地址和长度按file所在设备的逻辑块大小
+ * 对齐，len向上取整，实际长度在buf->len里。file为-1时按4096字节对齐。
+ * 用O_DIRECT打开的文件，读写时缓冲区、长度或偏移没对齐会返回UV_EALIGN。
+ * 必须用uv_buf_aligned_free()释放。
+ */
+UV_EXTERN int uv_buf_aligned_alloc(uv_os_fd_t file, size_t len, uv_buf_t* buf);
+UV_EXTERN void uv_buf_aligned_free(uv_buf_t* buf);
 /*
  * This flag can be used with uv_fs_copyfile() to return an error if the
  * destination already exists.
@@ -1307,12 +3094,27 @@ UV_EXTERN int uv_fs_write(uv_loop_t* loop,
  */
 #define UV_FS_COPYFILE_FICLONE_FORCE 0x0004
 
+/*
+ * 大文件分段用几个线程同时拷贝（macOS用系统的copyfile()，忽略这个标志）。
+ * 比一段（8MB）小的文件照常拷贝。进度仍然用uv_fs_copyfile_progress()查，
+ * 但各段不是按顺序完成的，拷贝完成之前目标文件里可能有还没写的空洞。
+ */
+#define UV_FS_COPYFILE_PARALLEL 0x0008
+
 UV_EXTERN int uv_fs_copyfile(uv_loop_t* loop,
                              uv_fs_t* req,
                              const char* path,
                              const char* new_path,
                              int flags,
                              uv_fs_cb cb);
+/*
+ * 查询uv_fs_copyfile()的进度，请求进行中可以在loop线程里随时调用（比如在
+ * 定时器里）。进度按块更新，copied是已经写到目标文件的字节数，total是源文件
+ * 大小；还没开始拷贝时两者都是0。
+ */
+UV_EXTERN int uv_fs_copyfile_progress(const uv_fs_t* req,
+                                      uint64_t* copied,
+                                      uint64_t* total);
 UV_EXTERN int uv_fs_mkdir(uv_loop_t* loop,
                           uv_fs_t* req,
                           const char* path,
@@ -1333,19 +3135,189 @@ UV_EXTERN int uv_fs_scandir(uv_loop_t* loop,
                             uv_fs_cb cb);
 UV_EXTERN int uv_fs_scandir_next(uv_fs_t* req,
                                  uv_dirent_t* ent);
+/* 成功时req->ptr是新的uv_dir_t */
+UV_EXTERN int uv_fs_opendir(uv_loop_t* loop,
+                            uv_fs_t* req,
+                            const char* path,
+                            uv_fs_cb cb);
+/* req->result是读出的目录项个数，0表示读完了。目录项的名字在
+ * uv_fs_req_cleanup()时释放
+ */
+UV_EXTERN int uv_fs_readdir(uv_loop_t* loop,
+                            uv_fs_t* req,
+                            uv_dir_t* dir,
+                            uv_fs_cb cb);
+UV_EXTERN int uv_fs_closedir(uv_loop_t* loop,
+                             uv_fs_t* req,
+                             uv_dir_t* dir,
+                             uv_fs_cb cb);
+
+enum uv_fs_walk_flags {
+  /* 每个目录项都lstat()一次，结果放在statbuf里 */
+  UV_FS_WALK_STAT = 1
+};
+
+typedef struct {
+  /* 起始目录加上各级子目录名组成的路径 */
+  const char* path;
+  uv_dirent_type_t type;
+  /* 没有指定UV_FS_WALK_STAT时为NULL */
+  const uv_stat_t* statbuf;
+} uv_fs_walk_entry_t;
+
+/* 每读出一批目录项调用一次，entries只在回调期间有效。某个子目录读不了时
+ * status是错误码，entries[0]是那个目录，遍历会继续下去。
+ */
+typedef void (*uv_fs_walk_cb)(uv_fs_t* req,
+                              int status,
+                              const uv_fs_walk_entry_t* entries,
+                              size_t nentries);
+
+/* 递归遍历path下的所有目录，最多concurrency（0表示4）个目录同时在线程池里
+ * 读，用的是慢IO类别。符号链接不跟进去。全部遍历完后调用cb，req->result
+ * 是目录项的总数，起始目录打不开时是错误码。
+ */
+UV_EXTERN int uv_fs_walk(uv_loop_t* loop,
+                         uv_fs_t* req,
+                         const char* path,
+                         unsigned int flags,
+                         unsigned int concurrency,
+                         uv_fs_walk_cb walk_cb,
+                         uv_fs_cb cb);
+
+/*
+ * 批量执行文件操作。uv_fs_batch()之后、uv_fs_batch_submit()之前在这个loop上
+ * 发起的异步fs请求（同步调用不受影响）都先攒起来，提交后在一个工作线程里
+ * 依次执行，只占一次线程池调度和一次完成通知。完成时先按发起顺序调用每个
+ * 请求自己的回调，最后调用cb，req->result是批次里的请求个数。
+ * 同一个loop上一次只能有一个批次在收集，否则返回UV_EBUSY。批次里的请求
+ * 不能单独取消，只能对整个批次调用uv_cancel()。
+ */
+UV_EXTERN int uv_fs_batch(uv_loop_t* loop, uv_fs_t* req, uv_fs_cb cb);
+UV_EXTERN int uv_fs_batch_submit(uv_loop_t* loop, uv_fs_t* req);
+
+/*
+ * 只追加的日志写入器。uv_fs_log_append()把数据复制进当前缓冲区就返回；
+ * 另一半缓冲区同时在线程池里用一次write()写出去，写完再交换，所以一批
+ * 不管攒了多少条都只占一次线程池调度和一次系统调用。同一时间只有一批在写，
+ * 数据按追加的顺序落盘。file通常以O_APPEND打开，写入器不负责关闭它。
+ */
+enum uv_fs_log_flags {
+  /* 每批写完后fdatasync()一次，相当于group commit */
+  UV_FS_LOG_FDATASYNC = 1
+};
+
+struct uv_fs_log_s {
+  /* public */
+  void* data;
+  /* read-only */
+  uv_loop_t* loop;
+  uint64_t nwrites;  /* 写出去的批数 */
+  uint64_t nbytes;
+  /* private */
+  void* impl;
+};
+
+/* size是每一半缓冲区的大小 */
+UV_EXTERN int uv_fs_log_init(uv_loop_t* loop,
+                             uv_fs_log_t* log,
+                             uv_os_fd_t file,
+                             size_t size,
+                             unsigned int flags);
+/*
+ * 当前缓冲区放不下时返回UV_ENOBUFS（说明磁盘跟不上，调用方决定丢掉还是
+ * 稍后重试），len比size还大时返回UV_E2BIG。之前有一批写失败了，之后都
+ * 返回那个错误。
+ */
+UV_EXTERN int uv_fs_log_append(uv_fs_log_t* log, const char* data, size_t len);
+/*
+ * 把剩下的数据写完（有UV_FS_LOG_FDATASYNC时再sync一次）后调用close_cb，
+ * status是第一个写错误，没有出错为0。
+ */
+UV_EXTERN void uv_fs_log_close(uv_fs_log_t* log, uv_fs_log_close_cb close_cb);
+/*
+ * uv_loop_configure(loop, UV_LOOP_FS_CACHE, ttl_ms)打开loop上的元数据缓存
+ * （仅Linux，其他平台返回UV_ENOSYS），ttl_ms为0时关闭并清空。之后绝对路径的
+ * 异步uv_fs_stat()/uv_fs_realpath()成功的结果会缓存ttl_ms毫秒，再次查询直接
+ * 在loop里完成，不经过线程池，回调仍然在下一轮循环里调用。父目录上的inotify
+ * 事件提到这个名字时缓存失效，事件在loop读到之前缓存的结果可能是旧的；
+ * 路径中间的目录和符号链接的目标变了只能等超时。同步调用不查缓存。
+ *
+ * uv_loop_configure(loop, UV_LOOP_FD_CACHE, max_fds)打开loop上的fd缓存（仅
+ * Linux），max_fds为0时关闭并关掉空闲的fd。之后绝对路径的只读异步
+ * uv_fs_open()（没有O_CREAT/O_TRUNC/O_EXCL）打开的fd，uv_fs_close()时不真的
+ * 关闭，文件偏移回到开头，留给下一次同样路径和flags的uv_fs_open()；这个fd
+ * 第一次uv_fs_fstat()的结果也记下来。命中时都在loop里完成，不经过线程池，
+ * 最多记max_fds个fd。父目录上的inotify事件提到这个名字时缓存失效，空闲的fd
+ * 关掉，用着的fd关闭时真正关掉。缓存的fd只能用uv_fs_close()在loop线程里关。
+ */
 UV_EXTERN int uv_fs_stat(uv_loop_t* loop,
                          uv_fs_t* req,
                          const char* path,
                          uv_fs_cb cb);
+
+/* uv_fs_statx()的字段mask，取值和Linux的STATX_*相同 */
+#define UV_FS_STATX_TYPE        0x0001
+#define UV_FS_STATX_MODE        0x0002
+#define UV_FS_STATX_NLINK       0x0004
+#define UV_FS_STATX_UID         0x0008
+#define UV_FS_STATX_GID         0x0010
+#define UV_FS_STATX_ATIME       0x0020
+#define UV_FS_STATX_MTIME       0x0040
+#define UV_FS_STATX_CTIME       0x0080
+#define UV_FS_STATX_INO         0x0100
+#define UV_FS_STATX_SIZE        0x0200
+#define UV_FS_STATX_BLOCKS      0x0400
+#define UV_FS_STATX_BASIC_STATS 0x07ff
+#define UV_FS_STATX_BTIME       0x0800
+#define UV_FS_STATX_ALL         0x0fff
+
+/* uv_fs_statx()的flags，取值和Linux的AT_*相同。DONT_SYNC让NFS、FUSE这类
+ * 文件系统直接用缓存的属性，不向服务端同步
+ */
+#define UV_FS_STATX_NOFOLLOW    0x0100
+#define UV_FS_STATX_DONT_SYNC   0x4000
+
+/*
+ * 只取mask里的字段，在NFS、FUSE上比uv_fs_stat()便宜。成功时req->result（同步
+ * 调用时也是返回值）是实际取到的字段（可能比mask多），结果在req->statbuf里，没取到的字段内容
+ * 不确定。不支持statx()的平台退回stat()，返回UV_FS_STATX_BASIC_STATS。
+ */
+UV_EXTERN int uv_fs_statx(uv_loop_t* loop,
+                          uv_fs_t* req,
+                          const char* path,
+                          unsigned int mask,
+                          int flags,
+                          uv_fs_cb cb);
 UV_EXTERN int uv_fs_fstat(uv_loop_t* loop,
                           uv_fs_t* req,
                           uv_os_fd_t file,
                           uv_fs_cb cb);
+/* flags可以是UV_FS_AT_SYMLINK_NOFOLLOW，这时相当于lstat() */
+UV_EXTERN int uv_fs_statat(uv_loop_t* loop,
+                           uv_fs_t* req,
+                           uv_os_fd_t dir,
+                           const char* path,
+                           int flags,
+                           uv_fs_cb cb);
 UV_EXTERN int uv_fs_rename(uv_loop_t* loop,
                            uv_fs_t* req,
                            const char* path,
                            const char* new_path,
                            uv_fs_cb cb);
+UV_EXTERN int uv_fs_renameat(uv_loop_t* loop,
+                             uv_fs_t* req,
+                             uv_os_fd_t dir,
+                             const char* path,
+                             uv_os_fd_t new_dir,
+                             const char* new_path,
+                             uv_fs_cb cb);
+/*
+ * uv_loop_configure(loop, UV_LOOP_FS_SYNC_COALESCE)之后，同一个fd上的异步
+ * fsync/fdatasync同一时间只执行一个：执行期间新来的请求排队，等它完成后
+ * 合并成一次sync（有fsync时用fsync），这些请求一起以同一个结果完成，
+ * 相当于group commit。排队中的请求不能取消。
+ */
 UV_EXTERN int uv_fs_fsync(uv_loop_t* loop,
                           uv_fs_t* req,
                           uv_os_fd_t file,
@@ -1359,6 +3331,75 @@ UV_EXTERN int uv_fs_ftruncate(uv_loop_t* loop,
                               uv_os_fd_t file,
                               int64_t offset,
                               uv_fs_cb cb);
+
+/* uv_fs_fallocate()的mode。默认预分配[offset, offset + len)并在需要时扩大
+ * 文件；KEEP_SIZE只分配空间不改文件大小；PUNCH_HOLE释放这一段的空间
+ * （隐含KEEP_SIZE，只有Linux支持）
+ */
+#define UV_FS_FALLOCATE_KEEP_SIZE  0x0001
+#define UV_FS_FALLOCATE_PUNCH_HOLE 0x0002
+
+typedef enum {
+  UV_FS_FADV_NORMAL,
+  UV_FS_FADV_SEQUENTIAL,
+  UV_FS_FADV_RANDOM,
+  UV_FS_FADV_WILLNEED,
+  UV_FS_FADV_DONTNEED,
+  UV_FS_FADV_NOREUSE
+} uv_fs_fadvise_advice;
+
+UV_EXTERN int uv_fs_fallocate(uv_loop_t* loop,
+                              uv_fs_t* req,
+                              uv_os_fd_t file,
+                              int mode,
+                              int64_t offset,
+                              int64_t len,
+                              uv_fs_cb cb);
+/* len为0表示到文件末尾 */
+UV_EXTERN int uv_fs_fadvise(uv_loop_t* loop,
+                            uv_fs_t* req,
+                            uv_os_fd_t file,
+                            int64_t offset,
+                            int64_t len,
+                            uv_fs_fadvise_advice advice,
+                            uv_fs_cb cb);
+/* 让内核提前把[offset, offset + len)读进page cache。没有readahead(2)的
+ * 平台用posix_fadvise(POSIX_FADV_WILLNEED)代替
+ */
+UV_EXTERN int uv_fs_readahead(uv_loop_t* loop,
+                              uv_fs_t* req,
+                              uv_os_fd_t file,
+                              int64_t offset,
+                              size_t len,
+                              uv_fs_cb cb);
+
+/* uv_fs_mmap()的flags */
+#define UV_FS_MMAP_WRITE    0x0001  /* 可写的MAP_SHARED映射，默认只读MAP_PRIVATE */
+#define UV_FS_MMAP_POPULATE 0x0002  /* 在线程池里预先把页面读进来 */
+
+/*
+ * 在线程池里映射文件的[offset, offset + len)，offset必须按页对齐，len为0
+ * 表示到文件末尾。advice是可选的madvise()提示（UV_FS_FADV_NOREUSE和
+ * DONTNEED当作NORMAL）。成功时映射地址在req->ptr里，req->result是映射的
+ * 长度；映射不随uv_fs_req_cleanup()释放，要用uv_fs_munmap()解除。
+ */
+UV_EXTERN int uv_fs_mmap(uv_loop_t* loop,
+                         uv_fs_t* req,
+                         uv_os_fd_t file,
+                         int64_t offset,
+                         size_t len,
+                         int flags,
+                         uv_fs_fadvise_advice advice,
+                         uv_fs_cb cb);
+UV_EXTERN int uv_fs_munmap(uv_loop_t* loop,
+                           uv_fs_t* req,
+                           void* addr,
+                           size_t len,
+                           uv_fs_cb cb);
+/* sendfile()不支持的组合（比如in_fd是pipe）退回到Linux上经过一个临时pipe
+ * 的splice()，其他平台上的pread()/write()。每次搬的字节数默认64KB，可以用
+ * 环境变量UV_SENDFILE_CHUNK_SIZE改
+ */
 UV_EXTERN int uv_fs_sendfile(uv_loop_t* loop,
                              uv_fs_t* req,
                              uv_os_fd_t out_fd,
@@ -1479,6 +3520,10 @@ struct uv_fs_event_s {
 
 /*
  * uv_fs_stat() based polling file watcher.
+ *
+ * uv_loop_configure(loop, UV_LOOP_FS_POLL_SHARED)之后新启动的handle按间隔
+ * 分组：同一间隔的handle共用一个定时器，每个周期在线程池里成批stat，
+ * 不再是每个handle一个定时器和一次uv_fs_stat()。已经启动的handle不受影响。
  */
 struct uv_fs_poll_s {
   UV_HANDLE_FIELDS
@@ -1496,7 +3541,15 @@ UV_EXTERN int uv_fs_poll_getpath(uv_fs_poll_t* handle,
                                  char* buffer,
                                  size_t* size);
 
-/* 信号handle */
+/* 信号handle
+ *
+ * Linux上uv_loop_configure(loop, UV_LOOP_SIGNALFD)之后，这个loop上启动的
+ * handle改用signalfd：信号在调用uv_signal_start()的线程（loop线程）里被屏蔽，
+ * 由epoll通知，不经过进程全局的锁和管道，也不安装信号处理函数。其它线程
+ * 要自己屏蔽这些信号（通常在创建线程之前），否则信号可能被它们按原来的
+ * 方式处理；同一个信号也只应由一个这样的loop监听。loop上已有启动的信号
+ * handle时返回UV_EBUSY，其它平台返回UV_ENOSYS。
+ */
 struct uv_signal_s {
   UV_HANDLE_FIELDS
   uv_signal_cb signal_cb;
@@ -1542,6 +3595,8 @@ enum uv_fs_event_flags {
    * By default, event watcher, when watching directory, is not registering
    * (is ignoring) changes in it's subdirectories.
    * This flag will override this behaviour on platforms that support it.
+   * Linux上会给每个子目录各加一个inotify watch，新建和移进来的子目录自动
+   * 补上，回调里的路径相对于监听的根目录，比如"a/b/file"。
    */
   UV_FS_EVENT_RECURSIVE = 4
 };
@@ -1556,6 +3611,14 @@ UV_EXTERN int uv_fs_event_stop(uv_fs_event_t* handle);
 UV_EXTERN int uv_fs_event_getpath(uv_fs_event_t* handle,
                                   char* buffer,
                                   size_t* size);
+/*
+ * 合并窗口（毫秒）：第一个事件到达后等window毫秒，这段时间里同一路径的事件
+ * 合并成一次回调，events是它们的并集，不同路径按第一次出现的顺序回调。
+ * 0表示关闭（默认），随时可以调用。目前只在Linux上实现，其他平台返回
+ * UV_ENOSYS。
+ */
+UV_EXTERN int uv_fs_event_set_coalesce(uv_fs_event_t* handle,
+                                       unsigned int window);
 
 UV_EXTERN int uv_ip4_addr(const char* ip, int port, struct sockaddr_in* addr);
 UV_EXTERN int uv_ip6_addr(const char* ip, int port, struct sockaddr_in6* addr);
@@ -1565,6 +3628,22 @@ UV_EXTERN int uv_ip6_name(const struct sockaddr_in6* src, char* dst, size_t size
 
 UV_EXTERN int uv_inet_ntop(int af, const void* src, char* dst, size_t size);
 UV_EXTERN int uv_inet_pton(int af, const char* src, void* dst);
+/* 一次转换n个地址。src是n个连续的in_addr或者in6_addr，第i个字符串写到
+ * dst + i * stride。stride小于16（AF_INET）或者46（AF_INET6）时返回UV_ENOSPC
+ */
+UV_EXTERN int uv_inet_ntop_batch(int af,
+                                 const void* src,
+                                 char* dst,
+                                 size_t stride,
+                                 unsigned int n);
+/* src[i]解析到dst里的第i个in_addr或者in6_addr，失败的那一项dst不变。
+ * status不为NULL时每一项的结果写到status[i]。返回成功的个数
+ */
+UV_EXTERN int uv_inet_pton_batch(int af,
+                                 const char* const src[],
+                                 void* dst,
+                                 int status[],
+                                 unsigned int n);
 
 #if defined(IF_NAMESIZE)
 # define UV_IF_NAMESIZE (IF_NAMESIZE + 1)
@@ -1591,6 +3670,12 @@ UV_EXTERN uint64_t uv_get_free_memory(void);
 UV_EXTERN uint64_t uv_get_total_memory(void);
 
 UV_EXTERN uint64_t uv_hrtime(void);
+/* uv_hrtime()和loop的时间改为直接读CPU的计数器（x86-64的TSC、ARM64的
+ * CNTVCT），不再经过clock_gettime()。打开时用CLOCK_MONOTONIC校准并检查计数器
+ * 是否稳定，不满足条件时返回UV_ENOTSUP；换算比例之后不再调整，不跟随NTP的
+ * 微调。需要在启动其他线程之前调用。
+ */
+UV_EXTERN int uv_hrtime_use_tsc(int enable);
 
 UV_EXTERN void uv_disable_stdio_inheritance(void);
 
@@ -1615,6 +3700,95 @@ UV_EXTERN void uv_rwlock_wrlock(uv_rwlock_t* rwlock);
 UV_EXTERN int uv_rwlock_trywrlock(uv_rwlock_t* rwlock);
 UV_EXTERN void uv_rwlock_wrunlock(uv_rwlock_t* rwlock);
 
+/* 读多写少的数据用的读偏向读写锁。读者按所在的CPU在不同的cache line上计数，
+ * 互相之间不碰同一个cache line；写者要等所有CPU上的读者退出，比uv_rwlock_t
+ * 慢得多。uv_brlock_rdlock()的返回值要原样传给uv_brlock_rdunlock()。
+ * trywrlock成功返回0，否则返回UV_EBUSY。
+ */
+typedef struct uv_brlock_s uv_brlock_t;
+
+struct uv_brlock_s {
+  /* private */
+  uv_rwlock_t rwlock;
+  int rbias;
+  unsigned int mask;
+  uint64_t inhibit_until;
+  void* slots;
+};
+
+UV_EXTERN int uv_brlock_init(uv_brlock_t* lock);
+UV_EXTERN void uv_brlock_destroy(uv_brlock_t* lock);
+UV_EXTERN int uv_brlock_rdlock(uv_brlock_t* lock);
+UV_EXTERN void uv_brlock_rdunlock(uv_brlock_t* lock, int token);
+UV_EXTERN void uv_brlock_wrlock(uv_brlock_t* lock);
+UV_EXTERN int uv_brlock_trywrlock(uv_brlock_t* lock);
+UV_EXTERN void uv_brlock_wrunlock(uv_brlock_t* lock);
+
+/* 给很短的临界区用的自旋锁，按请求的先后顺序拿到锁。不会睡眠，
+ * 临界区里不要做阻塞的操作。trylock成功返回0，否则返回UV_EBUSY。
+ */
+UV_EXTERN void uv_spinlock_init(uv_spinlock_t* spinlock);
+UV_EXTERN void uv_spinlock_lock(uv_spinlock_t* spinlock);
+UV_EXTERN int uv_spinlock_trylock(uv_spinlock_t* spinlock);
+UV_EXTERN void uv_spinlock_unlock(uv_spinlock_t* spinlock);
+
+/* 无锁队列。生产者放进去以后调用uv_async_send()，消费者在uv_async_t的回调里
+ * 取到空为止，这样就可以在线程之间传递消息而不需要加锁。
+ * 生产者和消费者用到的字段放在不同的cache line上，避免互相干扰。
+ */
+#define UV_CACHELINE_SIZE 64
+
+typedef struct uv_spsc_ring_s uv_spsc_ring_t;
+typedef struct uv_mpsc_node_s uv_mpsc_node_t;
+typedef struct uv_mpsc_queue_s uv_mpsc_queue_t;
+
+/* 固定容量的环形缓冲区，只能有一个生产者线程和一个消费者线程 */
+struct uv_spsc_ring_s {
+  void* data;
+  void** slots;
+  unsigned int mask;
+  char pad0[UV_CACHELINE_SIZE];
+  /* 消费者 */
+  unsigned int head;
+  unsigned int tail_cache;
+  char pad1[UV_CACHELINE_SIZE - 2 * sizeof(unsigned int)];
+  /* 生产者 */
+  unsigned int tail;
+  unsigned int head_cache;
+  char pad2[UV_CACHELINE_SIZE - 2 * sizeof(unsigned int)];
+};
+
+/* 侵入式链表队列的节点，嵌在用户自己的结构体里 */
+struct uv_mpsc_node_s {
+  uv_mpsc_node_t* next;
+};
+
+/* 任意多个生产者线程，一个消费者线程，没有容量限制 */
+struct uv_mpsc_queue_s {
+  void* data;
+  char pad0[UV_CACHELINE_SIZE - sizeof(void*)];
+  /* 生产者 */
+  uv_mpsc_node_t* head;
+  char pad1[UV_CACHELINE_SIZE - sizeof(void*)];
+  /* 消费者 */
+  uv_mpsc_node_t* tail;
+  uv_mpsc_node_t stub;
+  char pad2[UV_CACHELINE_SIZE - 2 * sizeof(void*)];
+};
+
+/* capacity向上取整到2的幂。push时满了、pop时空了返回UV_EAGAIN */
+UV_EXTERN int uv_spsc_ring_init(uv_spsc_ring_t* ring, unsigned int capacity);
+UV_EXTERN void uv_spsc_ring_destroy(uv_spsc_ring_t* ring);
+UV_EXTERN int uv_spsc_ring_push(uv_spsc_ring_t* ring, void* item);
+UV_EXTERN int uv_spsc_ring_pop(uv_spsc_ring_t* ring, void** item);
+
+/* pop只能在消费者线程调用。队列为空时返回NULL；某个生产者的push进行到一半时
+ * 也可能暂时返回NULL，它随后调用的uv_async_send()会再次唤醒消费者。
+ */
+UV_EXTERN void uv_mpsc_queue_init(uv_mpsc_queue_t* queue);
+UV_EXTERN void uv_mpsc_queue_push(uv_mpsc_queue_t* queue, uv_mpsc_node_t* node);
+UV_EXTERN uv_mpsc_node_t* uv_mpsc_queue_pop(uv_mpsc_queue_t* queue);
+
 UV_EXTERN int uv_sem_init(uv_sem_t* sem, unsigned int value);
 UV_EXTERN void uv_sem_destroy(uv_sem_t* sem);
 UV_EXTERN void uv_sem_post(uv_sem_t* sem);
@@ -1645,6 +3819,29 @@ UV_EXTERN void uv_key_set(uv_key_t* key, void* value);
 typedef void (*uv_thread_cb)(void* arg);
 
 UV_EXTERN int uv_thread_create(uv_thread_t* tid, uv_thread_cb entry, void* arg);
+
+typedef enum {
+  UV_THREAD_NO_FLAGS = 0x00,
+  UV_THREAD_HAS_STACK_SIZE = 0x01,
+  UV_THREAD_HAS_CPUMASK = 0x02
+} uv_thread_create_flags;
+
+/* 创建线程的选项，flags说明哪些字段有效。stack_size会向上对齐到页大小；
+ * cpumask的格式同uv_thread_setaffinity()，线程从一开始就只在这些CPU上运行
+ */
+struct uv_thread_options_s {
+  unsigned int flags;
+  size_t stack_size;
+  char* cpumask;
+  size_t cpumask_size;
+};
+
+typedef struct uv_thread_options_s uv_thread_options_t;
+
+UV_EXTERN int uv_thread_create_ex(uv_thread_t* tid,
+                                  const uv_thread_options_t* params,
+                                  uv_thread_cb entry,
+                                  void* arg);
 UV_EXTERN int uv_thread_setaffinity(uv_thread_t* tid,
                                     char* cpumask,
                                     char* oldmask,
@@ -1706,6 +3903,7 @@ UV_EXTERN void uv_loop_set_data(uv_loop_t*, void* data);
 #undef UV_GETADDRINFO_PRIVATE_FIELDS
 #undef UV_GETNAMEINFO_PRIVATE_FIELDS
 #undef UV_FS_REQ_PRIVATE_FIELDS
+#undef UV_DIR_PRIVATE_FIELDS
 #undef UV_WORK_PRIVATE_FIELDS
 #undef UV_FS_EVENT_PRIVATE_FIELDS
 #undef UV_SIGNAL_PRIVATE_FIELDS
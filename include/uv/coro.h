@@ -0,0 +1,401 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * 可选的C++20协程封装，只有头文件，不参与libuv本身的编译。
+ *
+ * 请求对象直接嵌在awaiter里，co_await的临时对象放在协程帧中，所以每次
+ * co_await都不分配内存。请求的回调（uv__fs_done()、uv__write_callbacks()等）
+ * 里直接resume协程，协程一直运行到下一个co_await或者结束，回调才返回。
+ *
+ *   uv::coro::task copy(uv_loop_t* loop, uv_stream_t* out, const char* path) {
+ *     ssize_t fd = co_await uv::coro::fs_open(loop, path, UV_FS_O_RDONLY, 0);
+ *     ...
+ *     int err = co_await uv::coro::write(out, &buf, 1);
+ *   }
+ *
+ * 提交请求失败（比如参数错误）时不挂起，co_await直接得到错误码。
+ * 协程必须在loop线程上运行。
+ */
+
+#ifndef UV_CORO_H_
+#define UV_CORO_H_
+
+#if !defined(__cplusplus) || __cplusplus < 202002L
+# error "uv/coro.h requires C++20"
+#endif
+
+#include <coroutine>
+#include <cstring>
+#include <exception>
+#include <memory>
+
+#include "../uv.h"
+
+namespace uv {
+namespace coro {
+
+/* 最简单的协程返回类型：立即开始执行，结束时自己销毁，不返回值。
+ * 协程里的异常会调用std::terminate()
+ */
+struct task {
+  struct promise_type {
+    task get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+
+/* 所有文件操作共用的部分。Derived::submit(cb)发起请求，Derived::result()
+ * 在resume以后取结果，之后调用uv_fs_req_cleanup()
+ */
+template <typename Derived>
+class fs_awaiter {
+ public:
+  fs_awaiter(const fs_awaiter&) = delete;
+  fs_awaiter& operator=(const fs_awaiter&) = delete;
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    int err;
+
+    handle_ = h;
+    req_.data = this;
+    err = static_cast<Derived*>(this)->submit(&fs_awaiter::on_done);
+    if (err == 0)
+      return true;
+
+    req_.result = err;
+    return false;
+  }
+
+  auto await_resume() noexcept {
+    auto r = static_cast<Derived*>(this)->result();
+    uv_fs_req_cleanup(&req_);
+    return r;
+  }
+
+ protected:
+  explicit fs_awaiter(uv_loop_t* loop) noexcept : loop_(loop) {
+    std::memset(&req_, 0, sizeof(req_));
+  }
+
+  ssize_t result() const noexcept { return req_.result; }
+
+  uv_loop_t* loop_;
+  uv_fs_t req_;
+
+ private:
+  static void on_done(uv_fs_t* req) {
+    static_cast<fs_awaiter*>(req->data)->handle_.resume();
+  }
+
+  std::coroutine_handle<> handle_;
+};
+
+
+/* 结果是req->result：文件描述符、读写的字节数，或者错误码 */
+class fs_open : public fs_awaiter<fs_open> {
+ public:
+  fs_open(uv_loop_t* loop, const char* path, int flags, int mode) noexcept
+      : fs_awaiter(loop), path_(path), flags_(flags), mode_(mode) {}
+
+ private:
+  friend class fs_awaiter<fs_open>;
+  int submit(uv_fs_cb cb) {
+    return uv_fs_open(loop_, &req_, path_, flags_, mode_, cb);
+  }
+
+  const char* path_;
+  int flags_;
+  int mode_;
+};
+
+
+class fs_close : public fs_awaiter<fs_close> {
+ public:
+  fs_close(uv_loop_t* loop, uv_os_fd_t file) noexcept
+      : fs_awaiter(loop), file_(file) {}
+
+ private:
+  friend class fs_awaiter<fs_close>;
+  int submit(uv_fs_cb cb) { return uv_fs_close(loop_, &req_, file_, cb); }
+
+  uv_os_fd_t file_;
+};
+
+
+/* bufs指向的数组在co_await的整个过程中都要有效 */
+class fs_read : public fs_awaiter<fs_read> {
+ public:
+  fs_read(uv_loop_t* loop,
+          uv_os_fd_t file,
+          const uv_buf_t bufs[],
+          unsigned int nbufs,
+          int64_t offset) noexcept
+      : fs_awaiter(loop),
+        file_(file),
+        bufs_(bufs),
+        nbufs_(nbufs),
+        offset_(offset) {}
+
+ private:
+  friend class fs_awaiter<fs_read>;
+  int submit(uv_fs_cb cb) {
+    return uv_fs_read(loop_, &req_, file_, bufs_, nbufs_, offset_, cb);
+  }
+
+  uv_os_fd_t file_;
+  const uv_buf_t* bufs_;
+  unsigned int nbufs_;
+  int64_t offset_;
+};
+
+
+class fs_write : public fs_awaiter<fs_write> {
+ public:
+  fs_write(uv_loop_t* loop,
+           uv_os_fd_t file,
+           const uv_buf_t bufs[],
+           unsigned int nbufs,
+           int64_t offset) noexcept
+      : fs_awaiter(loop),
+        file_(file),
+        bufs_(bufs),
+        nbufs_(nbufs),
+        offset_(offset) {}
+
+ private:
+  friend class fs_awaiter<fs_write>;
+  int submit(uv_fs_cb cb) {
+    return uv_fs_write(loop_, &req_, file_, bufs_, nbufs_, offset_, cb);
+  }
+
+  uv_os_fd_t file_;
+  const uv_buf_t* bufs_;
+  unsigned int nbufs_;
+  int64_t offset_;
+};
+
+
+class fs_fsync : public fs_awaiter<fs_fsync> {
+ public:
+  fs_fsync(uv_loop_t* loop, uv_os_fd_t file) noexcept
+      : fs_awaiter(loop), file_(file) {}
+
+ private:
+  friend class fs_awaiter<fs_fsync>;
+  int submit(uv_fs_cb cb) { return uv_fs_fsync(loop_, &req_, file_, cb); }
+
+  uv_os_fd_t file_;
+};
+
+
+class fs_unlink : public fs_awaiter<fs_unlink> {
+ public:
+  fs_unlink(uv_loop_t* loop, const char* path) noexcept
+      : fs_awaiter(loop), path_(path) {}
+
+ private:
+  friend class fs_awaiter<fs_unlink>;
+  int submit(uv_fs_cb cb) { return uv_fs_unlink(loop_, &req_, path_, cb); }
+
+  const char* path_;
+};
+
+
+struct stat_result {
+  int status;
+  uv_stat_t statbuf;
+};
+
+
+/* 结果是stat_result，status < 0时statbuf没有意义 */
+class fs_stat : public fs_awaiter<fs_stat> {
+ public:
+  fs_stat(uv_loop_t* loop, const char* path) noexcept
+      : fs_awaiter(loop), path_(path) {}
+
+ private:
+  friend class fs_awaiter<fs_stat>;
+  int submit(uv_fs_cb cb) { return uv_fs_stat(loop_, &req_, path_, cb); }
+
+  stat_result result() const noexcept {
+    stat_result r;
+    r.status = static_cast<int>(req_.result);
+    r.statbuf = req_.statbuf;
+    return r;
+  }
+
+  const char* path_;
+};
+
+
+/* 结果是写请求的状态。bufs数组本身uv_write()会复制，数据要保持有效 */
+class write {
+ public:
+  write(uv_stream_t* stream, const uv_buf_t bufs[], unsigned int nbufs) noexcept
+      : stream_(stream), bufs_(bufs), nbufs_(nbufs), status_(0) {}
+
+  write(const write&) = delete;
+  write& operator=(const write&) = delete;
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    handle_ = h;
+    req_.data = this;
+    status_ = uv_write(&req_, stream_, bufs_, nbufs_, &write::on_done);
+    return status_ == 0;
+  }
+
+  int await_resume() const noexcept { return status_; }
+
+ private:
+  static void on_done(uv_write_t* req, int status) {
+    write* self = static_cast<write*>(req->data);
+    self->status_ = status;
+    self->handle_.resume();
+  }
+
+  uv_write_t req_;
+  uv_stream_t* stream_;
+  const uv_buf_t* bufs_;
+  unsigned int nbufs_;
+  int status_;
+  std::coroutine_handle<> handle_;
+};
+
+
+/* 结果是连接的状态 */
+class tcp_connect {
+ public:
+  tcp_connect(uv_tcp_t* handle, const struct sockaddr* addr) noexcept
+      : handle_(handle), addr_(addr), status_(0) {}
+
+  tcp_connect(const tcp_connect&) = delete;
+  tcp_connect& operator=(const tcp_connect&) = delete;
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    coro_ = h;
+    req_.data = this;
+    status_ = uv_tcp_connect(&req_, handle_, addr_, &tcp_connect::on_done);
+    return status_ == 0;
+  }
+
+  int await_resume() const noexcept { return status_; }
+
+ private:
+  static void on_done(uv_connect_t* req, int status) {
+    tcp_connect* self = static_cast<tcp_connect*>(req->data);
+    self->status_ = status;
+    self->coro_.resume();
+  }
+
+  uv_connect_t req_;
+  uv_tcp_t* handle_;
+  const struct sockaddr* addr_;
+  int status_;
+  std::coroutine_handle<> coro_;
+};
+
+
+struct addrinfo_deleter {
+  void operator()(struct addrinfo* ai) const noexcept { uv_freeaddrinfo(ai); }
+};
+
+typedef std::unique_ptr<struct addrinfo, addrinfo_deleter> addrinfo_ptr;
+
+struct getaddrinfo_result {
+  int status;
+  addrinfo_ptr res;
+};
+
+
+/* 结果是getaddrinfo_result，res由unique_ptr负责释放 */
+class getaddrinfo {
+ public:
+  getaddrinfo(uv_loop_t* loop,
+              const char* node,
+              const char* service,
+              const struct addrinfo* hints) noexcept
+      : loop_(loop),
+        node_(node),
+        service_(service),
+        hints_(hints),
+        status_(0),
+        res_(nullptr) {}
+
+  getaddrinfo(const getaddrinfo&) = delete;
+  getaddrinfo& operator=(const getaddrinfo&) = delete;
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    coro_ = h;
+    req_.data = this;
+    status_ = uv_getaddrinfo(loop_,
+                             &req_,
+                             &getaddrinfo::on_done,
+                             node_,
+                             service_,
+                             hints_);
+    return status_ == 0;
+  }
+
+  getaddrinfo_result await_resume() noexcept {
+    getaddrinfo_result r;
+    r.status = status_;
+    r.res.reset(res_);
+    res_ = nullptr;
+    return r;
+  }
+
+ private:
+  static void on_done(uv_getaddrinfo_t* req,
+                      int status,
+                      struct addrinfo* res) {
+    getaddrinfo* self = static_cast<getaddrinfo*>(req->data);
+    self->status_ = status;
+    self->res_ = res;
+    self->coro_.resume();
+  }
+
+  uv_getaddrinfo_t req_;
+  uv_loop_t* loop_;
+  const char* node_;
+  const char* service_;
+  const struct addrinfo* hints_;
+  int status_;
+  struct addrinfo* res_;
+  std::coroutine_handle<> coro_;
+};
+
+}  // namespace coro
+}  // namespace uv
+
+#endif /* UV_CORO_H_ */
@@ -0,0 +1,425 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * 可选的C++封装，只有头文件，不参与libuv本身的编译。
+ *
+ * 句柄直接放在用户对象里：用户类继承timer<Owner>、tcp<Owner>等，句柄就是
+ * 这个基类唯一的成员。回调是成员函数指针模板参数，每个(类型, 成员函数)
+ * 生成一个无状态的跳板函数，跳板从句柄指针按固定偏移算出Owner*，不经过
+ * handle->data，编译器可以把成员函数内联进跳板。
+ *
+ *   class conn : public uv::cxx::tcp<conn>,
+ *                public uv::cxx::timer<conn> {
+ *     void on_alloc(size_t size, uv_buf_t* buf);
+ *     void on_read(ssize_t nread, const uv_buf_t* buf);
+ *     void on_idle();
+ *     ...
+ *     read_start<&conn::on_alloc, &conn::on_read>();
+ *     timer::start<&conn::on_idle>(30000, 0);
+ *   };
+ *
+ * 同一个类里要放多个同类句柄时用第二个模板参数区分，再各起一个别名，
+ * 通过别名调用，比如
+ *
+ *   typedef uv::cxx::timer<conn, struct read_tag> read_timer;
+ *   typedef uv::cxx::timer<conn, struct write_tag> write_timer;
+ *   read_timer::start<&conn::on_read_timeout>(5000, 0);
+ *
+ * 句柄的内存随对象走，对象要等close的回调之后才能销毁。
+ */
+
+#ifndef UV_CXX_H_
+#define UV_CXX_H_
+
+#if !defined(__cplusplus) || __cplusplus < 201103L
+# error "uv/cxx.h requires C++11"
+#endif
+
+#include "../uv.h"
+
+namespace uv {
+namespace cxx {
+
+/* Self是具体的封装类（比如timer<Owner, Tag>），它没有别的数据成员，是标准
+ * 布局的，所以句柄和Self的地址相同，再static_cast到Owner就是用户对象
+ */
+template <typename Self, typename Owner, typename Handle>
+class handle_base {
+ public:
+  typedef Handle handle_type;
+
+  Handle* get() noexcept { return &handle_; }
+  const Handle* get() const noexcept { return &handle_; }
+  uv_handle_t* raw() noexcept {
+    return reinterpret_cast<uv_handle_t*>(&handle_);
+  }
+  uv_loop_t* loop() const noexcept { return handle_.loop; }
+
+  bool is_active() const noexcept {
+    return uv_is_active(reinterpret_cast<const uv_handle_t*>(&handle_)) != 0;
+  }
+
+  bool is_closing() const noexcept {
+    return uv_is_closing(reinterpret_cast<const uv_handle_t*>(&handle_)) != 0;
+  }
+
+  void ref() noexcept { uv_ref(raw()); }
+  void unref() noexcept { uv_unref(raw()); }
+
+  void close() noexcept { uv_close(raw(), nullptr); }
+
+  /* 回调里可以delete this */
+  template <void (Owner::*M)()>
+  void close() noexcept {
+    uv_close(raw(), &close_thunk<M>);
+  }
+
+  static Owner* owner(Handle* h) noexcept {
+    return static_cast<Owner*>(
+        static_cast<Self*>(reinterpret_cast<handle_base*>(h)));
+  }
+
+  static Owner* owner(uv_handle_t* h) noexcept {
+    return owner(reinterpret_cast<Handle*>(h));
+  }
+
+ protected:
+  handle_base() noexcept {}
+
+ private:
+  handle_base(const handle_base&);
+  handle_base& operator=(const handle_base&);
+
+  template <void (Owner::*M)()>
+  static void close_thunk(uv_handle_t* h) {
+    (owner(h)->*M)();
+  }
+
+  Handle handle_;
+};
+
+
+template <typename Owner, typename Tag = void>
+class timer : public handle_base<timer<Owner, Tag>, Owner, uv_timer_t> {
+ public:
+  int init(uv_loop_t* loop) noexcept {
+    return uv_timer_init(loop, this->get());
+  }
+
+  template <void (Owner::*M)()>
+  int start(uint64_t timeout, uint64_t repeat) noexcept {
+    return uv_timer_start(this->get(), &thunk<M>, timeout, repeat);
+  }
+
+  int stop() noexcept { return uv_timer_stop(this->get()); }
+  int again() noexcept { return uv_timer_again(this->get()); }
+
+  void set_repeat(uint64_t repeat) noexcept {
+    uv_timer_set_repeat(this->get(), repeat);
+  }
+
+ private:
+  template <void (Owner::*M)()>
+  static void thunk(uv_timer_t* h) {
+    (timer::owner(h)->*M)();
+  }
+};
+
+
+/* idle、prepare和check的接口完全一样 */
+template <typename Owner,
+          typename Tag,
+          typename Handle,
+          int (*Init)(uv_loop_t*, Handle*),
+          int (*Start)(Handle*, void (*)(Handle*)),
+          int (*Stop)(Handle*)>
+class loop_watcher
+    : public handle_base<loop_watcher<Owner, Tag, Handle, Init, Start, Stop>,
+                         Owner,
+                         Handle> {
+ public:
+  int init(uv_loop_t* loop) noexcept { return Init(loop, this->get()); }
+
+  template <void (Owner::*M)()>
+  int start() noexcept {
+    return Start(this->get(), &thunk<M>);
+  }
+
+  int stop() noexcept { return Stop(this->get()); }
+
+ private:
+  template <void (Owner::*M)()>
+  static void thunk(Handle* h) {
+    (loop_watcher::owner(h)->*M)();
+  }
+};
+
+template <typename Owner, typename Tag = void>
+class idle : public loop_watcher<Owner, Tag, uv_idle_t,
+                                 uv_idle_init, uv_idle_start, uv_idle_stop> {
+};
+
+template <typename Owner, typename Tag = void>
+class prepare : public loop_watcher<Owner, Tag, uv_prepare_t, uv_prepare_init,
+                                    uv_prepare_start, uv_prepare_stop> {
+};
+
+template <typename Owner, typename Tag = void>
+class check : public loop_watcher<Owner, Tag, uv_check_t, uv_check_init,
+                                  uv_check_start, uv_check_stop> {
+};
+
+
+template <typename Owner, typename Tag = void>
+class async : public handle_base<async<Owner, Tag>, Owner, uv_async_t> {
+ public:
+  template <void (Owner::*M)()>
+  int init(uv_loop_t* loop) noexcept {
+    return uv_async_init(loop, this->get(), &thunk<M>);
+  }
+
+  /* 可以在任何线程调用 */
+  int send() noexcept { return uv_async_send(this->get()); }
+
+ private:
+  template <void (Owner::*M)()>
+  static void thunk(uv_async_t* h) {
+    (async::owner(h)->*M)();
+  }
+};
+
+
+template <typename Owner, typename Tag = void>
+class signal : public handle_base<signal<Owner, Tag>, Owner, uv_signal_t> {
+ public:
+  int init(uv_loop_t* loop) noexcept {
+    return uv_signal_init(loop, this->get());
+  }
+
+  template <void (Owner::*M)(int)>
+  int start(int signum) noexcept {
+    return uv_signal_start(this->get(), &thunk<M>, signum);
+  }
+
+  int stop() noexcept { return uv_signal_stop(this->get()); }
+
+ private:
+  template <void (Owner::*M)(int)>
+  static void thunk(uv_signal_t* h, int signum) {
+    (signal::owner(h)->*M)(signum);
+  }
+};
+
+
+/* tcp和pipe共用的流操作。写、shutdown和连接请求的回调从req->handle找到
+ * Owner，请求本身由调用者提供（通常也放在Owner或者它管理的对象里）
+ */
+template <typename Self, typename Owner, typename Handle>
+class stream_base : public handle_base<Self, Owner, Handle> {
+ public:
+  uv_stream_t* stream() noexcept {
+    return reinterpret_cast<uv_stream_t*>(this->get());
+  }
+
+  template <void (Owner::*Alloc)(size_t, uv_buf_t*),
+            void (Owner::*Read)(ssize_t, const uv_buf_t*)>
+  int read_start() noexcept {
+    return uv_read_start(stream(), &alloc_thunk<Alloc>, &read_thunk<Read>);
+  }
+
+  int read_stop() noexcept { return uv_read_stop(stream()); }
+
+  template <void (Owner::*M)(uv_write_t*, int)>
+  int write(uv_write_t* req,
+            const uv_buf_t bufs[],
+            unsigned int nbufs) noexcept {
+    return uv_write(req, stream(), bufs, nbufs, &write_thunk<M>);
+  }
+
+  int try_write(const uv_buf_t bufs[], unsigned int nbufs) noexcept {
+    return uv_try_write(stream(), bufs, nbufs);
+  }
+
+  template <void (Owner::*M)(uv_shutdown_t*, int)>
+  int shutdown(uv_shutdown_t* req) noexcept {
+    return uv_shutdown(req, stream(), &shutdown_thunk<M>);
+  }
+
+  template <void (Owner::*M)(int)>
+  int listen(int backlog) noexcept {
+    return uv_listen(stream(), backlog, &listen_thunk<M>);
+  }
+
+  template <typename S, typename O, typename H>
+  int accept(stream_base<S, O, H>& client) noexcept {
+    return uv_accept(stream(), client.stream());
+  }
+
+  size_t write_queue_size() const noexcept {
+    return this->get()->write_queue_size;
+  }
+
+ protected:
+  static Owner* owner(uv_stream_t* s) noexcept {
+    return stream_base::handle_base::owner(reinterpret_cast<Handle*>(s));
+  }
+
+  template <void (Owner::*M)(uv_connect_t*, int)>
+  static void connect_thunk(uv_connect_t* req, int status) {
+    (owner(req->handle)->*M)(req, status);
+  }
+
+ private:
+  template <void (Owner::*M)(size_t, uv_buf_t*)>
+  static void alloc_thunk(uv_handle_t* h, size_t size, uv_buf_t* buf) {
+    (stream_base::handle_base::owner(h)->*M)(size, buf);
+  }
+
+  template <void (Owner::*M)(ssize_t, const uv_buf_t*)>
+  static void read_thunk(uv_stream_t* s, ssize_t nread, const uv_buf_t* buf) {
+    (owner(s)->*M)(nread, buf);
+  }
+
+  template <void (Owner::*M)(uv_write_t*, int)>
+  static void write_thunk(uv_write_t* req, int status) {
+    (owner(req->handle)->*M)(req, status);
+  }
+
+  template <void (Owner::*M)(uv_shutdown_t*, int)>
+  static void shutdown_thunk(uv_shutdown_t* req, int status) {
+    (owner(req->handle)->*M)(req, status);
+  }
+
+  template <void (Owner::*M)(int)>
+  static void listen_thunk(uv_stream_t* s, int status) {
+    (owner(s)->*M)(status);
+  }
+};
+
+
+template <typename Owner, typename Tag = void>
+class tcp : public stream_base<tcp<Owner, Tag>, Owner, uv_tcp_t> {
+ public:
+  int init(uv_loop_t* loop) noexcept { return uv_tcp_init(loop, this->get()); }
+
+  int bind(const struct sockaddr* addr, unsigned int flags = 0) noexcept {
+    return uv_tcp_bind(this->get(), addr, flags);
+  }
+
+  int nodelay(bool enable) noexcept {
+    return uv_tcp_nodelay(this->get(), enable);
+  }
+
+  template <void (Owner::*M)(uv_connect_t*, int)>
+  int connect(uv_connect_t* req, const struct sockaddr* addr) noexcept {
+    return uv_tcp_connect(req,
+                          this->get(),
+                          addr,
+                          &tcp::template connect_thunk<M>);
+  }
+};
+
+
+template <typename Owner, typename Tag = void>
+class pipe : public stream_base<pipe<Owner, Tag>, Owner, uv_pipe_t> {
+ public:
+  int init(uv_loop_t* loop, bool ipc = false) noexcept {
+    return uv_pipe_init(loop, this->get(), ipc);
+  }
+
+  int open(uv_os_fd_t fd) noexcept { return uv_pipe_open(this->get(), fd); }
+
+  int bind(const char* name) noexcept {
+    return uv_pipe_bind(this->get(), name);
+  }
+
+  template <void (Owner::*M)(uv_connect_t*, int)>
+  void connect(uv_connect_t* req, const char* name) noexcept {
+    uv_pipe_connect(req, this->get(), name, &pipe::template connect_thunk<M>);
+  }
+};
+
+
+template <typename Owner, typename Tag = void>
+class udp : public handle_base<udp<Owner, Tag>, Owner, uv_udp_t> {
+ public:
+  int init(uv_loop_t* loop) noexcept { return uv_udp_init(loop, this->get()); }
+
+  int bind(const struct sockaddr* addr, unsigned int flags = 0) noexcept {
+    return uv_udp_bind(this->get(), addr, flags);
+  }
+
+  template <void (Owner::*Alloc)(size_t, uv_buf_t*),
+            void (Owner::*Recv)(ssize_t,
+                                const uv_buf_t*,
+                                const struct sockaddr*,
+                                unsigned)>
+  int recv_start() noexcept {
+    return uv_udp_recv_start(this->get(),
+                             &alloc_thunk<Alloc>,
+                             &recv_thunk<Recv>);
+  }
+
+  int recv_stop() noexcept { return uv_udp_recv_stop(this->get()); }
+
+  template <void (Owner::*M)(uv_udp_send_t*, int)>
+  int send(uv_udp_send_t* req,
+           const uv_buf_t bufs[],
+           unsigned int nbufs,
+           const struct sockaddr* addr) noexcept {
+    return uv_udp_send(req, this->get(), bufs, nbufs, addr, &send_thunk<M>);
+  }
+
+  int try_send(const uv_buf_t bufs[],
+               unsigned int nbufs,
+               const struct sockaddr* addr) noexcept {
+    return uv_udp_try_send(this->get(), bufs, nbufs, addr);
+  }
+
+ private:
+  template <void (Owner::*M)(size_t, uv_buf_t*)>
+  static void alloc_thunk(uv_handle_t* h, size_t size, uv_buf_t* buf) {
+    (udp::owner(h)->*M)(size, buf);
+  }
+
+  template <void (Owner::*M)(ssize_t,
+                             const uv_buf_t*,
+                             const struct sockaddr*,
+                             unsigned)>
+  static void recv_thunk(uv_udp_t* h,
+                         ssize_t nread,
+                         const uv_buf_t* buf,
+                         const struct sockaddr* addr,
+                         unsigned flags) {
+    (udp::owner(h)->*M)(nread, buf, addr, flags);
+  }
+
+  template <void (Owner::*M)(uv_udp_send_t*, int)>
+  static void send_thunk(uv_udp_send_t* req, int status) {
+    (udp::owner(req->handle)->*M)(req, status);
+  }
+};
+
+}  // namespace cxx
+}  // namespace uv
+
+#endif /* UV_CXX_H_ */
@@ -41,6 +41,14 @@
   uv_mutex_t cf_mutex;                                                        \
   uv_sem_t cf_sem;                                                            \
   void* cf_signals[2];                                                        \
+  void* select_state;                                                         \
+  unsigned int cf_latency;                                                    \
+  uint64_t hrtimer_armed;                                                     \
+  struct {                                                                    \
+    void* nodes;                                                              \
+    unsigned int nelts;                                                       \
+    unsigned int size;                                                        \
+  } hrtimer_heap;                                                             \
 
 #define UV_PLATFORM_FS_EVENT_FIELDS                                           \
   uv__io_t event_watcher;                                                     \
@@ -439,5 +439,8 @@
 # define UV__EFTYPE (-4028)
 #endif
 
+/* 没有对应的系统错误码，O_DIRECT的对齐检查用 */
+#define UV__EALIGN (-4027)
+
 
 #endif /* UV_ERRNO_H_ */
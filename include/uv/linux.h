@@ -22,13 +22,43 @@
 #ifndef UV_LINUX_H
 #define UV_LINUX_H
 
+#define UV_IO_PRIVATE_PLATFORM_FIELDS                                         \
+  unsigned int kevents;                                                       \
+  int kdeferred;                                                              \
+
+#define UV_PLATFORM_LOOP_HOT_FIELDS                                           \
+  void* iou;                                                                  \
+  void* epoll_events;                                                         \
+  unsigned int epoll_events_size;                                             \
+  unsigned int epoll_events_max;                                              \
+  unsigned int epoll_events_low;                                              \
+  uint64_t spin_budget;                                                       \
+  uint64_t poll_budget;                                                       \
+
 #define UV_PLATFORM_LOOP_FIELDS                                               \
   uv__io_t inotify_read_watcher;                                              \
   void* inotify_watchers;                                                     \
   int inotify_fd;                                                             \
+  void* fs_cache;                                                             \
+  unsigned int fs_cache_count;                                                \
+  int fs_cache_ttl;                                                           \
+  void* fs_cache_fds;                                                         \
+  unsigned int fs_cache_nfds;                                                 \
+  int fs_cache_max_fds;                                                       \
+  uv__io_t hrtimer_watcher;                                                   \
+  void* epoll_ctl_ring;                                                       \
+  uint64_t hrtimer_armed;                                                     \
+  struct {                                                                    \
+    void* nodes;                                                              \
+    unsigned int nelts;                                                       \
+    unsigned int size;                                                        \
+  } hrtimer_heap;                                                             \
 
 #define UV_PLATFORM_FS_EVENT_FIELDS                                           \
   void* watchers[2];                                                          \
   int wd;                                                                     \
+  unsigned int event_flags;                                                   \
+  void* subwatches[2];                                                        \
+  void* coalesce;                                                             \
 
 #endif /* UV_LINUX_H */
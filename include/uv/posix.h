@@ -22,7 +22,7 @@
 #ifndef UV_POSIX_H
 #define UV_POSIX_H
 
-#define UV_PLATFORM_LOOP_FIELDS                                               \
+#define UV_PLATFORM_LOOP_HOT_FIELDS                                           \
   struct pollfd* poll_fds;                                                    \
   size_t poll_fds_used;                                                       \
   size_t poll_fds_size;                                                       \
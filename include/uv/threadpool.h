@@ -36,8 +36,28 @@ struct uv__work {
   void (*done)(struct uv__work *w, int status);
   /* 该task绑定的loop */
   struct uv_loop_s* loop;
+  /* 执行该task的线程池 */
+  struct uv_threadpool_s* pool;
+  /* 任务所属的类别，普通任务为NULL */
+  struct uv_work_class_s* cls;
   /* 用于与其他task构建链表 */
   void* wq[2];
+  /* 执行完之后压到loop->wq_done上时用 */
+  struct uv__work* done_next;
+  /* 任务的种类，enum uv__work_kind */
+  int kind;
+  /* 打开了统计时，提交时记下当时的时间，开始执行时换成排队的时长 */
+  uint64_t wait_time;
+  /* 执行的时长 */
+  uint64_t run_time;
+  /* 截止时间（uv_hrtime()），过了还没开始执行的不再执行，0表示没有 */
+  uint64_t deadline;
+  /* uv_loop_set_work_timeout()设置的超时时间（uv_hrtime()），到了还没做完的
+   * 直接以UV_ETIMEDOUT结束，0表示没有
+   */
+  uint64_t timeout;
+  /* 用于挂到loop按超时时间排序的链表上 */
+  void* timeout_queue[2];
 };
 
 #endif /* UV_THREADPOOL_H_ */
@@ -24,6 +24,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <dirent.h>
 
@@ -116,6 +117,10 @@ struct uv__io_s {
 # define UV_PLATFORM_LOOP_FIELDS /* empty */
 #endif
 
+#ifndef UV_PLATFORM_LOOP_HOT_FIELDS
+# define UV_PLATFORM_LOOP_HOT_FIELDS /* empty */
+#endif
+
 #ifndef UV_PLATFORM_FS_EVENT_FIELDS
 # define UV_PLATFORM_FS_EVENT_FIELDS /* empty */
 #endif
@@ -144,6 +149,14 @@ typedef UV_PLATFORM_SEM_T uv_sem_t;
 typedef pthread_cond_t uv_cond_t;
 typedef pthread_key_t uv_key_t;/* thread local storage ,类比于gcc中的__thread修饰符 */
 
+#define UV_SPINLOCK_INITIALIZER { 0, 0 }
+
+/* ticket lock，见src/unix/spinlock.h */
+typedef struct {
+  int next;
+  int owner;
+} uv_spinlock_t;
+
 /* Note: guard clauses should match uv_barrier_init's in src/unix/thread.c. */
 #if defined(_AIX) || !defined(PTHREAD_BARRIER_SERIAL_THREAD)
 typedef struct {
@@ -210,37 +223,87 @@ typedef struct {
   char* errmsg;
 } uv_lib_t;
 
+/* uv_socket_buffer_autotune()的状态，见src/unix/core.c */
+typedef struct {
+  int min_size;
+  int max_size;   /* 为0时没有打开 */
+  int rcvbuf;
+  int sndbuf;
+  uint64_t last_grow;
+  uint32_t drops;  /* 上次看到的SO_RXQ_OVFL计数 */
+} uv__sockbuf_tune_t;
+
 #define UV_LOOP_PRIVATE_FIELDS                                                \
+  /* 以下是uv_run()每轮都会访问的字段，集中放在前面几个cache line里 */       \
   unsigned long flags;   /* loop标志，目前只有：UV_LOOP_BLOCK_SIGPROF */                                                              \
-  int backend_fd;     /* 后端fd，如linux下的epoll_create或者osx下的kqueue */                                                                 \
+  uint64_t time;       /*  */                                                                \
+  struct {                                                                    \
+    void* nodes;                                                              \
+    unsigned int nelts;                                                       \
+    unsigned int size;                                                        \
+  } timer_heap;     /* 4叉数组最小堆，参见src/timer.c */                                      \
+  void* timer_wheel;  /* 分层时间轮，为NULL时定时器放在timer_heap里 */                   \
   void* pending_queue[2];  /*  */                                                            \
   void* watcher_queue[2];  /* watcher队列， */                                                            \
   uv__io_t** watchers;     /*  */                                                            \
   unsigned int nwatchers;  /*   */                                                            \
   unsigned int nfds;    /*  */                                                               \
-  void* wq[2]; /*  */                                                               \
-  uv_mutex_t wq_mutex;   /*  */                                                              \
-  uv_async_t wq_async;   /*  */                                                              \
-  uv_rwlock_t cloexec_lock;   /*  */                                                         \
+  int backend_fd;     /* 后端fd，如linux下的epoll_create或者osx下的kqueue */                                                                 \
+  int async_busy;        /* 为1时loop正在执行回调，不会阻塞在轮询里 */             \
   uv_handle_t* closing_handles;  /*  */                                                      \
-  void* process_handles[2];   /*  */                                                         \
   void* prepare_handles[2];  /* 预备handles队列 */                                                          \
   void* check_handles[2];    /*  */                                                          \
   void* idle_handles[2];   /* 空闲handles队列 */                                                            \
+  void* async_pending;   /* 有通知待处理的uv_async_t组成的无锁栈 */                  \
+  void* wq_done;  /* 线程池里执行完的任务，无锁栈 */                              \
+  unsigned int wq_senders;  /* 正在往wq_done压栈的线程个数 */                      \
+  unsigned int read_budget;  /* 流每次可读事件最多读几次 */                   \
+  UV_PLATFORM_LOOP_HOT_FIELDS /* 轮询后端每轮用到的字段 */                      \
+  /* 以下是每个事件或者每次统计才访问的字段，metrics是热字段之后的第一个 */  \
+  uv_metrics_t metrics;    /* 运行统计，参见uv_metrics_info() */                            \
+  uint64_t lag_due;        /* 上次轮询前最早的定时器的到期时间，0表示没有 */            \
+  void* phase_histograms;  /* 各阶段耗时直方图，参见uv_phase_histogram() */                \
+  void* perf_counters;     /* 各阶段的硬件计数器，参见uv_loop_perf_counters() */      \
+  void* lag_histogram;     /* loop延迟直方图，参见uv_loop_lag_histogram() */           \
+  void* watchdog;          /* 慢回调看门狗，参见uv_watchdog_start() */                   \
+  size_t read_budget_bytes;  /* 流每次可读事件最多读多少字节，0表示不限制 */       \
+  void* recv_ring;         /* 共用的接收缓冲区，参见UV_LOOP_RECV_RING */            \
+  struct {                 /* 正在派发的回调，参见uv_loop_dispatch_info() */          \
+    volatile unsigned int seq;                                                \
+    volatile int depth;                                                       \
+    volatile int type;                                                        \
+    void* volatile handle;                                                    \
+    void* volatile cb;                                                        \
+  } dispatch;                                                                 \
+  /* 以下是只在初始化、信号、子进程、线程池等路径上访问的字段 */           \
+  uv_async_t wq_async;   /*  */                                                              \
+  struct uv_threadpool_s* threadpool;  /* 绑定的线程池，为NULL时用默认线程池 */      \
+  struct uv_work_class_s* work_class;  /* 提交的任务所属的类别 */              \
+  uint64_t work_deadline;  /* 提交的任务从现在起多少纳秒后过期，0表示不过期 */    \
+  void* work_timeouts;     /* 线程池任务的超时，参见uv_loop_set_work_timeout() */     \
+  void* stream_timeouts;   /* 流的超时，参见uv_stream_set_timeouts() */         \
+  void* rate_limits;       /* 限速器的唤醒定时器，参见uv_rate_limit_init() */ \
+  uv_rwlock_t cloexec_lock;   /*  */                                                         \
+  void* process_handles[2];   /*  */                                                         \
+  void* fork_queue[2];     /* fork之后还没有重新注册的watcher，参见uv_loop_fork() */ \
   void* async_handles[2];   /*  */                                                           \
   void (*async_unused)(void);  /* TODO(bnoordhuis) Remove in libuv v2. */     \
   uv__io_t async_io_watcher;    /*  */                                                       \
   int async_wfd;         /*  */                                                              \
-  struct {                                                                    \
-    void* min;                                                                \
-    unsigned int nelts;                                                       \
-  } timer_heap;     /*  */                                                                   \
   uint64_t timer_counter;  /*  */                                                            \
-  uint64_t time;       /*  */                                                                \
   int signal_pipefd[2];   /* 信号管道 */                                                             \
   uv__io_t signal_io_watcher;  /* 信号watcher */                                                        \
   uv_signal_t child_watcher;  /* 子进程watcher */                                                         \
   int emfile_fd;             /*  */                                                          \
+  void* emfile;              /* UV_LOOP_EMFILE_RESERVE，参见src/unix/stream.c */ \
+  void* write_bufs_free;     /* uv_write()缓冲区数组的空闲链表 */                 \
+  unsigned int write_bufs_nfree;                                              \
+  void* fs_batch;            /* 正在收集的uv_fs_batch()请求 */                    \
+  void* fs_sync_groups[2];   /* 正在执行fsync的fd，参见UV_LOOP_FS_SYNC_COALESCE */ \
+  void* fs_poll_groups;      /* 共享定时器的uv_fs_poll_t分组，参见src/fs-poll.c */ \
+  void* resolver;            /* UV_LOOP_DNS_RESOLVER，参见src/unix/resolver.c */ \
+  void* signalfd;            /* UV_LOOP_SIGNALFD，参见src/unix/signal.c */     \
+  void* arena;               /* UV_LOOP_ARENA，参见src/unix/arena.c */         \
   UV_PLATFORM_LOOP_FIELDS    /*  */                                                          \
 
 #define UV_REQ_TYPE_PRIVATE /* empty */
@@ -255,6 +318,16 @@ typedef struct {
   uv_buf_t* bufs;                                                             \
   unsigned int nbufs;                                                         \
   int error;                                                                  \
+  int zerocopy;                                                               \
+  unsigned int zerocopy_seq;                                                  \
+  int sendfile_fd;                                                            \
+  int64_t sendfile_off;                                                       \
+  uv_shared_buf_t* shared;                                                    \
+  uv_shared_buf_t** iobuf_owners;                                             \
+  unsigned int iobuf_nowners;                                                 \
+  uint64_t queued_time;                                                       \
+  uv_stream_t** send_handles;                                                 \
+  unsigned int nsend_handles;                                                 \
   uv_buf_t bufsml[4];                                                         \
 
 #define UV_CONNECT_PRIVATE_FIELDS                                             \
@@ -262,6 +335,17 @@ typedef struct {
 
 #define UV_SHUTDOWN_PRIVATE_FIELDS /* empty */
 
+#define UV_CONNECT_HOST_PRIVATE_FIELDS                                        \
+  void* he;                                                                   \
+
+#define UV_SPLICE_PRIVATE_FIELDS                                              \
+  int pipefd[2];                                                              \
+  char* buf;                                                                  \
+  size_t buf_size;                                                            \
+  size_t offset;                                                              \
+  size_t pending;                                                             \
+  int eof;                                                                    \
+
 #define UV_UDP_SEND_PRIVATE_FIELDS                                            \
   void* queue[2];                                                             \
   struct sockaddr_storage addr;                                               \
@@ -270,10 +354,18 @@ typedef struct {
   ssize_t status;                                                             \
   uv_udp_send_cb send_cb;                                                     \
   uv_buf_t bufsml[4];                                                         \
+  unsigned int gso_size;                                                      \
+  struct sockaddr_in6 src;                                                    \
+  uint64_t queued_time;                                                       \
+  int dropped;                                                                \
+  int zerocopy;                                                               \
+  unsigned int zerocopy_seq;                                                  \
+  uint64_t txtime;                                                            \
+  uv_shared_buf_t** iobuf_owners;                                             \
+  unsigned int iobuf_nowners;                                                 \
 
 #define UV_HANDLE_PRIVATE_FIELDS                                              \
   uv_handle_t* next_closing;                                                  \
-  unsigned int flags;                                                         \
 
 #define UV_STREAM_PRIVATE_FIELDS                                              \
   uv_connect_t *connect_req;                                                  \
@@ -285,19 +377,88 @@ typedef struct {
   int delayed_error;                                                          \
   int accepted_fd;                                                            \
   void* queued_fds;                                                           \
+  size_t read_hint;                                                           \
+  size_t read_hint_min;                                                       \
+  size_t read_hint_max;                                                       \
+  unsigned int read_hint_small;                                               \
+  uv_buf_pool_t* buf_pool;                                                    \
+  uv_read_iobuf_cb read_iobuf_cb;                                             \
+  uv_alloc_iov_cb alloc_iov_cb;                                               \
+  uv_read_iov_cb read_iov_cb;                                                 \
+  uv_read_batch_cb read_batch_cb;                                             \
+  void* read_batch;                                                           \
+  unsigned int read_budget;                                                   \
+  size_t read_budget_bytes;                                                   \
+  void* zerocopy_queue[2];                                                    \
+  unsigned int zerocopy_next;                                                 \
+  uv_splice_t* splice_src;                                                    \
+  uv_splice_t* splice_dst;                                                    \
+  size_t write_low_watermark;                                                 \
+  size_t write_high_watermark;                                                \
+  uv_watermark_cb write_watermark_cb;                                         \
+  uv_write_batch_cb write_batch_cb;                                           \
+  int write_above_high;                                                       \
+  unsigned int accept_burst;                                                  \
+  void* admission;                                                            \
+  void* admitted;                                                             \
+  void* admitted_member[2];                                                   \
+  void* emfile_member[2];                                                     \
+  uv_io_stats_t io_stats;                                                     \
+  void* timeouts;                                                             \
+  void* rate_limit;                                                           \
   UV_STREAM_PRIVATE_PLATFORM_FIELDS                                           \
 
 #define UV_TCP_PRIVATE_FIELDS /* empty */
 
 #define UV_UDP_PRIVATE_FIELDS                                                 \
   uv_alloc_cb alloc_cb;                                                       \
+  uv_buf_pool_t* buf_pool;                                                    \
+  uv_udp_recv_iobuf_cb recv_iobuf_cb;                                         \
+  uv_shared_buf_t* recv_iobuf_owner;                                          \
   uv_udp_recv_cb recv_cb;                                                     \
   uv__io_t io_watcher;                                                        \
   void* write_queue[2];                                                       \
   void* write_completed_queue[2];                                             \
+  unsigned int gro_segment_size;                                              \
+  uv_udp_recv_ex_cb recv_ex_cb;                                               \
+  const uv_udp_recv_info_t* recv_info;                                        \
+  unsigned int recv_info_flags;                                               \
+  uv_io_stats_t io_stats;                                                     \
+  size_t send_queue_max_size;                                                 \
+  size_t send_queue_max_count;                                                \
+  int send_queue_policy;                                                      \
+  size_t send_low_watermark;                                                  \
+  size_t send_high_watermark;                                                 \
+  uv_udp_watermark_cb send_watermark_cb;                                      \
+  int send_above_high;                                                        \
+  void* zerocopy_queue[2];                                                    \
+  unsigned int zerocopy_next;                                                 \
+  uv__sockbuf_tune_t sockbuf_tune;                                            \
+  void* rate_limit;                                                           \
+
+#define UV_XDP_PRIVATE_FIELDS                                                 \
+  uv_xdp_recv_cb recv_cb;                                                     \
+  uv__io_t io_watcher;                                                        \
+  void* xsk;                                                                  \
+
+#define UV_IFACE_WATCH_PRIVATE_FIELDS                                         \
+  uv_iface_watch_cb cb;                                                       \
+  uv__io_t io_watcher;                                                        \
+  void* state;                                                                \
+
+#define UV_SHM_CHANNEL_PRIVATE_FIELDS                                         \
+  uv_shm_channel_cb recv_cb;                                                  \
+  uv_shm_channel_writable_cb writable_cb;                                     \
+  uv__io_t io_watcher;                                                        \
+  void* map;                                                                  \
+  size_t map_size;                                                            \
+  void* tx;                                                                   \
+  void* rx;                                                                   \
+  int want_writable;                                                          \
 
 #define UV_PIPE_PRIVATE_FIELDS                                                \
-  const char* pipe_fname; /* strdup'ed */
+  const char* pipe_fname; /* strdup'ed */                                     \
+  uv__sockbuf_tune_t sockbuf_tune;
 
 #define UV_POLL_PRIVATE_FIELDS                                                \
   uv__io_t io_watcher;
@@ -305,26 +466,32 @@ typedef struct {
 #define UV_PREPARE_PRIVATE_FIELDS                                             \
   uv_prepare_cb prepare_cb;                                                   \
   void* queue[2];                                                             \
+  int priority;                                                               \
 
 #define UV_CHECK_PRIVATE_FIELDS                                               \
   uv_check_cb check_cb;                                                       \
   void* queue[2];                                                             \
+  int priority;                                                               \
 
 #define UV_IDLE_PRIVATE_FIELDS                                                \
   uv_idle_cb idle_cb;                                                         \
   void* queue[2];                                                             \
+  int priority;                                                               \
 
 #define UV_ASYNC_PRIVATE_FIELDS                                               \
   uv_async_cb async_cb;                                                       \
   void* queue[2];                                                             \
   int pending;                                                                \
+  void* pending_next;                                                         \
+  void* msgs;                                                                 \
 
 #define UV_TIMER_PRIVATE_FIELDS                                               \
   uv_timer_cb timer_cb;                                                       \
   void* heap_node[3];                                                         \
   uint64_t timeout;                                                           \
   uint64_t repeat;                                                            \
-  uint64_t start_id;
+  uint64_t start_id;                                                          \
+  uint64_t slack;
 
 #define UV_GETADDRINFO_PRIVATE_FIELDS                                         \
   struct uv__work work_req;                                                   \
@@ -347,6 +514,9 @@ typedef struct {
 #define UV_PROCESS_PRIVATE_FIELDS                                             \
   void* queue[2];                                                             \
   int status;                                                                 \
+  uv__io_t pidfd_watcher;  /* Linux上子进程的pidfd，fd为-1时走SIGCHLD */  \
+  uv_exit_ex_cb exit_ex_cb;                                                   \
+  struct rusage rusage;  /* 回收时wait4()得到的 */                            \
 
 #define UV_FS_PRIVATE_FIELDS                                                  \
   const char *new_path;                                                       \
@@ -363,13 +533,18 @@ typedef struct {
   double mtime;                                                               \
   struct uv__work work_req;                                                   \
   uv_buf_t bufsml[4];                                                         \
+  char pathsml[128];         /* 放得下的路径直接复制到这里，不用分配 */      \
+
+#define UV_DIR_PRIVATE_FIELDS                                                 \
+  DIR* dir;
 
 #define UV_WORK_PRIVATE_FIELDS                                                \
   struct uv__work work_req;
 
 #define UV_TTY_PRIVATE_FIELDS                                                 \
   struct termios orig_termios;                                                \
-  int mode;
+  int mode;                                                                   \
+  void* write_buffer;
 
 #define UV_SIGNAL_PRIVATE_FIELDS                                              \
   /* RB_ENTRY(uv_signal_s) tree_entry; */                                     \
@@ -381,7 +556,8 @@ typedef struct {
   } tree_entry;                                                               \
   /* Use two counters here so we don have to fiddle with atomics. */          \
   unsigned int caught_signals;                                                \
-  unsigned int dispatched_signals;
+  unsigned int dispatched_signals;                                            \
+  void* signalfd_queue[2];  /* UV_LOOP_SIGNALFD时按信号挂在loop上 */       \
 
 #define UV_FS_EVENT_PRIVATE_FIELDS                                            \
   uv_fs_event_cb cb;                                                          \
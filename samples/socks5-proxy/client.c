@@ -41,19 +41,21 @@
  * When the connection with upstream has been established, the client_ctx
  * moves into a state where incoming data from the client is sent upstream
  * and vice versa, incoming data from upstream is sent to the client.  In
- * other words, we're just piping data back and forth.  See conn_cycle()
- * for details.
+ * other words, we're just piping data back and forth.  That part is left
+ * to uv_stream_splice(), one request per direction, which on Linux moves
+ * the data through a kernel pipe without copying it into user space and
+ * stops reading by itself when the other side can't keep up.  While
+ * splicing, rdstate=busy means the splice out of that connection is still
+ * running and wrstate=busy that a shutdown is pending.  See do_proxy().
  *
- * An interesting deviation from libuv's I/O model is that reads are discrete
- * rather than continuous events.  In layman's terms, when a read operation
- * completes, the connection stops reading until further notice.
+ * An interesting deviation from libuv's I/O model is that reads during the
+ * handshake are discrete rather than continuous events.  In layman's terms,
+ * when a read operation completes, the connection stops reading until
+ * further notice.
  *
- * The rationale for this approach is that we have to wait until the data
- * has been sent out again before we can reuse the read buffer.
- *
- * It also pleasingly unifies with the request model that libuv uses for
- * writes and everything else; libuv may switch to a request model for
- * reads in the future.
+ * The read buffers come from a per-loop uv_buf_pool_t and go back to it as
+ * soon as the state machine has looked at them, so an idle connection does
+ * not hold on to one.
  */
 enum conn_state {
   c_busy,  /* Busy; waiting for incoming data or for a write to complete. */
@@ -93,7 +95,8 @@ static int do_proxy_start(client_ctx *cx);
 static int do_proxy(client_ctx *cx);
 static int do_kill(client_ctx *cx);
 static int do_almost_dead(client_ctx *cx);
-static int conn_cycle(const char *who, conn *a, conn *b);
+static int proxy_cycle(const char *who, conn *a, conn *b);
+static void proxy_timer_expire(uv_timer_t *handle);
 static void conn_timer_reset(conn *c);
 static void conn_timer_expire(uv_timer_t *handle);
 static void conn_getaddrinfo(conn *c, const char *hostname);
@@ -106,9 +109,12 @@ static void conn_read(conn *c);
 static void conn_read_done(uv_stream_t *handle,
                            ssize_t nread,
                            const uv_buf_t *buf);
-static void conn_alloc(uv_handle_t *handle, size_t size, uv_buf_t *buf);
 static void conn_write(conn *c, const void *data, unsigned int len);
 static void conn_write_done(uv_write_t *req, int status);
+static void conn_splice(conn *c, uv_splice_t *req, conn *dst);
+static void conn_splice_done(uv_splice_t *req, int status);
+static void conn_shutdown(conn *c);
+static void conn_shutdown_done(uv_shutdown_t *req, int status);
 static void conn_close(conn *c);
 static void conn_close_done(uv_handle_t *handle);
 
@@ -127,7 +133,8 @@ void client_finish_init(server_ctx *sx, client_ctx *cx) {
   incoming->rdstate = c_stop;
   incoming->wrstate = c_stop;
   incoming->idle_timeout = sx->idle_timeout;
-  CHECK(0 == uv_timer_init(sx->loop, &incoming->timer_handle));
+  incoming->rbuf = NULL;
+  CHECK(0 == uv_timer_init(cx->loop, &incoming->timer_handle));
 
   outgoing = &cx->outgoing;
   outgoing->client = cx;
@@ -135,8 +142,9 @@ void client_finish_init(server_ctx *sx, client_ctx *cx) {
   outgoing->rdstate = c_stop;
   outgoing->wrstate = c_stop;
   outgoing->idle_timeout = sx->idle_timeout;
-  CHECK(0 == uv_tcp_init(cx->sx->loop, &outgoing->handle.tcp));
-  CHECK(0 == uv_timer_init(cx->sx->loop, &outgoing->timer_handle));
+  outgoing->rbuf = NULL;
+  CHECK(0 == uv_tcp_init(cx->loop, &outgoing->handle.tcp));
+  CHECK(0 == uv_timer_init(cx->loop, &outgoing->timer_handle));
 
   /* Wait for the initial packet. */
   conn_read(incoming);
@@ -218,7 +226,7 @@ static int do_handshake(client_ctx *cx) {
     return do_kill(cx);
   }
 
-  data = (uint8_t *) incoming->t.buf;
+  data = (uint8_t *) incoming->rbuf;
   size = (size_t) incoming->result;
   err = s5_parse(parser, &data, &size);
   if (err == s5_ok) {
@@ -300,7 +308,7 @@ static int do_req_parse(client_ctx *cx) {
     return do_kill(cx);
   }
 
-  data = (uint8_t *) incoming->t.buf;
+  data = (uint8_t *) incoming->rbuf;
   size = (size_t) incoming->result;
   err = s5_parse(parser, &data, &size);
   if (err == s5_ok) {
@@ -443,7 +451,7 @@ static int do_req_connect(client_ctx *cx) {
   ASSERT(outgoing->wrstate == c_stop);
 
   /* Build and send the reply.  Not very pretty but gets the job done. */
-  buf = (uint8_t *) incoming->t.buf;
+  buf = incoming->t.reply;
   if (outgoing->result == 0) {
     /* The RFC mandates that the SOCKS server must include the local port
      * and address in the reply.  So that's what we do.
@@ -499,18 +507,42 @@ static int do_proxy_start(client_ctx *cx) {
     return do_kill(cx);
   }
 
-  conn_read(incoming);
-  conn_read(outgoing);
+  conn_splice(incoming, &cx->upstream_req, outgoing);
+  conn_splice(outgoing, &cx->downstream_req, incoming);
+
+  /* The splices don't tell us about progress, so instead of restarting the
+   * timers on every read and write, check every idle_timeout ms whether any
+   * data moved since the last check.
+   */
+  cx->nbytes = 0;
+  CHECK(0 == uv_timer_stop(&outgoing->timer_handle));
+  CHECK(0 == uv_timer_start(&incoming->timer_handle,
+                            proxy_timer_expire,
+                            incoming->idle_timeout,
+                            incoming->idle_timeout));
   return s_proxy;
 }
 
-/* Proxy incoming data back and forth. */
+/* One of the splices or shutdowns completed.  The session ends when both
+ * sides have sent EOF and it has been passed on, or on the first error.
+ */
 static int do_proxy(client_ctx *cx) {
-  if (conn_cycle("client", &cx->incoming, &cx->outgoing)) {
+  conn *incoming;
+  conn *outgoing;
+
+  incoming = &cx->incoming;
+  outgoing = &cx->outgoing;
+
+  if (proxy_cycle("client", incoming, outgoing)) {
+    return do_kill(cx);
+  }
+
+  if (proxy_cycle("upstream", outgoing, incoming)) {
     return do_kill(cx);
   }
 
-  if (conn_cycle("upstream", &cx->outgoing, &cx->incoming)) {
+  if (incoming->rdstate == c_stop && incoming->wrstate == c_stop &&
+      outgoing->rdstate == c_stop && outgoing->wrstate == c_stop) {
     return do_kill(cx);
   }
 
@@ -543,38 +575,53 @@ static int do_almost_dead(client_ctx *cx) {
   return cx->state + 1;  /* Another finalizer completed. */
 }
 
-static int conn_cycle(const char *who, conn *a, conn *b) {
-  if (a->result < 0) {
-    if (a->result != UV_EOF) {
+/* |a| is the source of one splice and |b| its destination. */
+static int proxy_cycle(const char *who, conn *a, conn *b) {
+  if (a->rdstate == c_done) {
+    a->rdstate = c_stop;
+    if (a->result < 0) {
       pr_err("%s error: %s", who, uv_strerror(a->result));
+      return -1;
     }
-    return -1;
-  }
-
-  if (b->result < 0) {
-    return -1;
-  }
 
-  if (a->wrstate == c_done) {
-    a->wrstate = c_stop;
+    /* |a| sent EOF and everything before it reached |b|.  Pass the
+     * half-close on, the other direction keeps going.
+     */
+    conn_shutdown(b);
   }
 
-  /* The logic is as follows: read when we don't write and write when we don't
-   * read.  That gives us back-pressure handling for free because if the peer
-   * sends data faster than we consume it, TCP congestion control kicks in.
-   */
-  if (a->wrstate == c_stop) {
-    if (b->rdstate == c_stop) {
-      conn_read(b);
-    } else if (b->rdstate == c_done) {
-      conn_write(a, b->t.buf, b->result);
-      b->rdstate = c_stop;  /* Triggers the call to conn_read() above. */
+  if (b->wrstate == c_done) {
+    b->wrstate = c_stop;
+    if (b->result < 0) {
+      pr_err("%s shutdown error: %s", who, uv_strerror(b->result));
+      return -1;
     }
   }
 
   return 0;
 }
 
+static void proxy_timer_expire(uv_timer_t *handle) {
+  client_ctx *cx;
+  uint64_t nbytes;
+  conn *c;
+
+  c = CONTAINER_OF(handle, conn, timer_handle);
+  cx = c->client;
+  nbytes = cx->upstream_req.nbytes + cx->downstream_req.nbytes;
+  if (nbytes != cx->nbytes) {
+    cx->nbytes = nbytes;
+    return;
+  }
+
+  /* Nothing moved for a whole period.  Report it as a failed splice out of
+   * the client; closing the handles cancels the real ones.
+   */
+  c->rdstate = c_done;
+  c->result = UV_ETIMEDOUT;
+  do_next(cx);
+}
+
 static void conn_timer_reset(conn *c) {
   CHECK(0 == uv_timer_start(&c->timer_handle,
                             conn_timer_expire,
@@ -597,7 +644,7 @@ static void conn_getaddrinfo(conn *c, const char *hostname) {
   hints.ai_family = AF_UNSPEC;
   hints.ai_socktype = SOCK_STREAM;
   hints.ai_protocol = IPPROTO_TCP;
-  CHECK(0 == uv_getaddrinfo(c->client->sx->loop,
+  CHECK(0 == uv_getaddrinfo(c->client->loop,
                             &c->t.addrinfo_req,
                             conn_getaddrinfo_done,
                             hostname,
@@ -654,7 +701,9 @@ static void conn_connect_done(uv_connect_t *req, int status) {
 
 static void conn_read(conn *c) {
   ASSERT(c->rdstate == c_stop);
-  CHECK(0 == uv_read_start(&c->handle.stream, conn_alloc, conn_read_done));
+  CHECK(0 == uv_read_start_pooled(&c->handle.stream,
+                                  c->client->pool,
+                                  conn_read_done));
   c->rdstate = c_busy;
   conn_timer_reset(c);
 }
@@ -662,25 +711,25 @@ static void conn_read(conn *c) {
 static void conn_read_done(uv_stream_t *handle,
                            ssize_t nread,
                            const uv_buf_t *buf) {
+  uv_buf_pool_t *pool;
   conn *c;
 
   c = CONTAINER_OF(handle, conn, handle);
-  ASSERT(c->t.buf == buf->base);
   ASSERT(c->rdstate == c_busy);
   c->rdstate = c_done;
   c->result = nread;
+  c->rbuf = buf->base;
+  pool = c->client->pool;
 
   uv_read_stop(&c->handle.stream);
   do_next(c->client);
-}
-
-static void conn_alloc(uv_handle_t *handle, size_t size, uv_buf_t *buf) {
-  conn *c;
 
-  c = CONTAINER_OF(handle, conn, handle);
-  ASSERT(c->rdstate == c_busy);
-  buf->base = c->t.buf;
-  buf->len = sizeof(c->t.buf);
+  /* The parser has consumed the data, the buffer can go back.  That's also
+   * the case when do_next() started closing the connection; the client_ctx
+   * isn't freed before the close callbacks run.
+   */
+  c->rbuf = NULL;
+  uv_buf_pool_release(pool, buf->base);
 }
 
 static void conn_write(conn *c, const void *data, unsigned int len) {
@@ -717,6 +766,51 @@ static void conn_write_done(uv_write_t *req, int status) {
   do_next(c->client);
 }
 
+static void conn_splice(conn *c, uv_splice_t *req, conn *dst) {
+  ASSERT(c->rdstate == c_stop);
+  CHECK(0 == uv_stream_splice(req,
+                              &c->handle.stream,
+                              &dst->handle.stream,
+                              conn_splice_done));
+  c->rdstate = c_busy;
+}
+
+static void conn_splice_done(uv_splice_t *req, int status) {
+  conn *c;
+
+  if (status == UV_ECANCELED) {
+    return;  /* Handle has been closed. */
+  }
+
+  c = CONTAINER_OF(req->src, conn, handle.stream);
+  ASSERT(c->rdstate == c_busy);
+  c->rdstate = c_done;
+  c->result = status;
+  do_next(c->client);
+}
+
+static void conn_shutdown(conn *c) {
+  ASSERT(c->wrstate == c_stop);
+  CHECK(0 == uv_shutdown(&c->shutdown_req,
+                         &c->handle.stream,
+                         conn_shutdown_done));
+  c->wrstate = c_busy;
+}
+
+static void conn_shutdown_done(uv_shutdown_t *req, int status) {
+  conn *c;
+
+  if (status == UV_ECANCELED) {
+    return;  /* Handle has been closed. */
+  }
+
+  c = CONTAINER_OF(req, conn, shutdown_req);
+  ASSERT(c->wrstate == c_busy);
+  c->wrstate = c_done;
+  c->result = status;
+  do_next(c->client);
+}
+
 static void conn_close(conn *c) {
   ASSERT(c->rdstate != c_dead);
   ASSERT(c->wrstate != c_dead);
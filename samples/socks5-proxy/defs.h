@@ -37,12 +37,16 @@ typedef struct {
   const char *bind_host;
   unsigned short bind_port;
   unsigned int idle_timeout;
+  unsigned int nloops;  /* 0 means one loop per CPU. */
+  int allow_loopback;
 } server_config;
 
+/* Shared by all loops, read-only once the server is running. */
 typedef struct {
   unsigned int idle_timeout;  /* Connection idle timeout in ms. */
-  uv_tcp_t tcp_handle;
-  uv_loop_t *loop;
+  int allow_loopback;
+  uv_runtime_t *runtime;
+  uv_buf_pool_t *pools;  /* Handshake read buffers, one pool per loop. */
 } server_ctx;
 
 typedef struct {
@@ -59,6 +63,8 @@ typedef struct {
   } handle;
   uv_timer_t timer_handle;  /* For detecting timeouts. */
   uv_write_t write_req;
+  uv_shutdown_t shutdown_req;
+  char *rbuf;  /* Pooled buffer of the last read, valid while rdstate=done. */
   /* We only need one of these at a time so make them share memory. */
   union {
     uv_getaddrinfo_t addrinfo_req;
@@ -67,16 +73,21 @@ typedef struct {
     struct sockaddr_in6 addr6;
     struct sockaddr_in addr4;
     struct sockaddr addr;
-    char buf[2048];  /* Scratch space. Used to read data into. */
+    uint8_t reply[22];  /* Scratch space for the CONNECT reply. */
   } t;
 } conn;
 
 typedef struct client_ctx {
   unsigned int state;
   server_ctx *sx;  /* Backlink to owning server context. */
+  uv_loop_t *loop;  /* The loop that accepted the connection. */
+  uv_buf_pool_t *pool;  /* That loop's read buffer pool. */
   s5_ctx parser;  /* The SOCKS protocol parser. */
   conn incoming;  /* Connection with the SOCKS client. */
   conn outgoing;  /* Connection with upstream. */
+  uv_splice_t upstream_req;  /* incoming -> outgoing */
+  uv_splice_t downstream_req;  /* outgoing -> incoming */
+  uint64_t nbytes;  /* Bytes proxied at the last idle check. */
 } client_ctx;
 
 /* server.c */
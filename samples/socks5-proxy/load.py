@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+
+# Copyright StrongLoop, Inc. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to
+# deal in the Software without restriction, including without limitation the
+# rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+# sell copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+
+"""End-to-end load generator for s5-proxy.
+
+Starts an echo server, then has a number of worker processes open SOCKS5
+CONNECT sessions through the proxy to it.  Every session sends --size bytes,
+half-closes, reads the echo back until EOF and checks it.  At the end it
+prints sessions per second and proxied bytes per second (both directions).
+
+Typical use:
+
+  $ ./build/Release/s5-proxy -l -t 4 &
+  $ ./load.py --duration 10 --workers 4 --connections 16 --size 1048576
+
+-l is needed because the proxy refuses loopback upstreams by default.  Use a
+small --size (say 64) to measure connection setup, a large one to measure
+throughput.  --target points the sessions at an existing echo server
+instead of the built-in one, which is useful when the built-in one turns out
+to be the bottleneck.
+"""
+
+import argparse
+import multiprocessing
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+
+CHUNK = 64 * 1024
+
+
+def echo_conn(sock):
+  buf = bytearray(CHUNK)
+  view = memoryview(buf)
+  with sock:
+    while True:
+      n = sock.recv_into(buf)
+      if n == 0:
+        break
+      sock.sendall(view[:n])
+    sock.shutdown(socket.SHUT_WR)
+
+
+def echo_server(sock):
+  while True:
+    conn, _ = sock.accept()
+    conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    threading.Thread(target=echo_conn, args=(conn,), daemon=True).start()
+
+
+def recv_exact(sock, n):
+  data = b''
+  while len(data) < n:
+    chunk = sock.recv(n - len(data))
+    if not chunk:
+      raise IOError('proxy closed the connection during the handshake')
+    data += chunk
+  return data
+
+
+def socks5_connect(proxy, target):
+  sock = socket.create_connection(proxy)
+  sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+  sock.sendall(b'\5\1\0')
+  if recv_exact(sock, 2) != b'\5\0':
+    raise IOError('proxy refused the auth method')
+
+  addr = socket.inet_aton(target[0])
+  sock.sendall(b'\5\1\0\1' + addr + struct.pack('!H', target[1]))
+  reply = recv_exact(sock, 10)
+  if reply[1] != 0:
+    raise IOError('proxy refused CONNECT, reply code %d' % reply[1])
+  return sock
+
+
+def session(proxy, target, payload):
+  sock = socks5_connect(proxy, target)
+  with sock:
+    writer = threading.Thread(target=send_all, args=(sock, payload))
+    writer.start()
+    received = 0
+    buf = bytearray(CHUNK)
+    while True:
+      n = sock.recv_into(buf)
+      if n == 0:
+        break
+      received += n
+    writer.join()
+  if received != len(payload):
+    raise IOError('sent %d bytes, got %d back' % (len(payload), received))
+  return received
+
+
+def send_all(sock, payload):
+  view = memoryview(payload)
+  for off in range(0, len(view), CHUNK):
+    sock.sendall(view[off:off + CHUNK])
+  sock.shutdown(socket.SHUT_WR)
+
+
+def worker(args, target, results):
+  payload = os.urandom(args.size)
+  deadline = time.monotonic() + args.duration
+  lock = threading.Lock()
+  stats = {'sessions': 0, 'bytes': 0, 'errors': 0}
+
+  def run():
+    while time.monotonic() < deadline:
+      try:
+        n = session((args.proxy_host, args.proxy_port), target, payload)
+      except (IOError, OSError) as e:
+        with lock:
+          stats['errors'] += 1
+          if stats['errors'] == 1:
+            print('error: %s' % e, file=sys.stderr)
+        continue
+      with lock:
+        stats['sessions'] += 1
+        stats['bytes'] += 2 * n
+
+  threads = [threading.Thread(target=run) for _ in range(args.connections)]
+  for t in threads:
+    t.start()
+  for t in threads:
+    t.join()
+  results.put(stats)
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+  parser.add_argument('--proxy-host', default='127.0.0.1')
+  parser.add_argument('--proxy-port', type=int, default=1080)
+  parser.add_argument('--target', metavar='HOST:PORT',
+                      help='echo server to use instead of the built-in one')
+  parser.add_argument('--duration', type=float, default=10,
+                      help='seconds to run (default: 10)')
+  parser.add_argument('--workers', type=int,
+                      default=max(1, multiprocessing.cpu_count() // 2),
+                      help='client processes (default: half the CPUs)')
+  parser.add_argument('--connections', type=int, default=8,
+                      help='concurrent sessions per worker (default: 8)')
+  parser.add_argument('--size', type=int, default=64 * 1024,
+                      help='bytes sent per session (default: 65536)')
+  args = parser.parse_args()
+
+  if args.target:
+    host, port = args.target.rsplit(':', 1)
+    target = (socket.gethostbyname(host), int(port))
+  else:
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('127.0.0.1', 0))
+    sock.listen(1024)
+    target = sock.getsockname()
+    threading.Thread(target=echo_server, args=(sock,), daemon=True).start()
+
+  results = multiprocessing.Queue()
+  procs = [multiprocessing.Process(target=worker, args=(args, target, results))
+           for _ in range(args.workers)]
+  start = time.monotonic()
+  for p in procs:
+    p.start()
+  totals = {'sessions': 0, 'bytes': 0, 'errors': 0}
+  for _ in procs:
+    for k, v in results.get().items():
+      totals[k] += v
+  for p in procs:
+    p.join()
+  elapsed = time.monotonic() - start
+
+  print('%d sessions in %.1fs: %.0f sessions/s, %.1f MB/s, %d errors' % (
+      totals['sessions'],
+      elapsed,
+      totals['sessions'] / elapsed,
+      totals['bytes'] / elapsed / 1e6,
+      totals['errors']))
+  return 1 if totals['errors'] else 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -31,6 +31,7 @@
 #define DEFAULT_BIND_HOST     "127.0.0.1"
 #define DEFAULT_BIND_PORT     1080
 #define DEFAULT_IDLE_TIMEOUT  (60 * 1000)
+#define DEFAULT_NLOOPS        0  /* One per CPU. */
 
 static void parse_opts(server_config *cf, int argc, char **argv);
 static void usage(void);
@@ -46,6 +47,7 @@ int main(int argc, char **argv) {
   config.bind_host = DEFAULT_BIND_HOST;
   config.bind_port = DEFAULT_BIND_PORT;
   config.idle_timeout = DEFAULT_IDLE_TIMEOUT;
+  config.nloops = DEFAULT_NLOOPS;
   parse_opts(&config, argc, argv);
 
   err = server_run(&config, uv_default_loop());
@@ -63,12 +65,16 @@ const char *_getprogname(void) {
 static void parse_opts(server_config *cf, int argc, char **argv) {
   int opt;
 
-  while (-1 != (opt = getopt(argc, argv, "b:hp:"))) {
+  while (-1 != (opt = getopt(argc, argv, "b:hlp:t:"))) {
     switch (opt) {
       case 'b':
         cf->bind_host = optarg;
         break;
 
+      case 'l':
+        cf->allow_loopback = 1;
+        break;
+
       case 'p':
         if (1 != sscanf(optarg, "%hu", &cf->bind_port)) {
           pr_err("bad port number: %s", optarg);
@@ -76,6 +82,13 @@ static void parse_opts(server_config *cf, int argc, char **argv) {
         }
         break;
 
+      case 't':
+        if (1 != sscanf(optarg, "%u", &cf->nloops)) {
+          pr_err("bad number of loops: %s", optarg);
+          usage();
+        }
+        break;
+
       default:
         usage();
     }
@@ -85,14 +98,18 @@ static void parse_opts(server_config *cf, int argc, char **argv) {
 static void usage(void) {
   printf("Usage:\n"
          "\n"
-         "  %s [-b <address>] [-h] [-p <port>]\n"
+         "  %s [-b <address>] [-h] [-l] [-p <port>] [-t <loops>]\n"
          "\n"
          "Options:\n"
          "\n"
          "  -b <hostname|address>  Bind to this address or hostname.\n"
          "                         Default: \"127.0.0.1\"\n"
          "  -h                     Show this help message.\n"
+         "  -l                     Allow connections to loopback addresses.\n"
+         "                         Needed by load.py, not for production use.\n"
          "  -p <port>              Bind to this port number.  Default: 1080\n"
+         "  -t <loops>             Number of event loops, each on its own\n"
+         "                         thread.  Default: 0 (one per CPU)\n"
          "",
          progname);
   exit(1);
@@ -21,6 +21,7 @@
 
 #include "defs.h"
 #include <netinet/in.h>  /* INET6_ADDRSTRLEN */
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -28,26 +29,63 @@
 # define INET6_ADDRSTRLEN 63
 #endif
 
+/* Handshake messages are a few hundred bytes at most.  After the handshake
+ * the data is spliced from one socket to the other and never read into user
+ * space, so the pools only see the first couple of reads of each connection.
+ */
+#define READ_BUFFER_SIZE  512
+#define READ_BUFFER_CACHE 64
+
+/* |loop| only resolves the bind address and waits for SIGINT/SIGTERM.  The
+ * connections are served by the runtime's loops, each of which listens on
+ * its own SO_REUSEPORT socket so the kernel spreads them out.
+ */
 typedef struct {
   uv_getaddrinfo_t getaddrinfo_req;
+  uv_signal_t sigint_handle;
+  uv_signal_t sigterm_handle;
+  uv_runtime_t runtime;
   server_config config;
-  server_ctx *servers;
+  server_ctx sx;
   uv_loop_t *loop;
 } server_state;
 
 static void do_bind(uv_getaddrinfo_t *req, int status, struct addrinfo *ai);
+static void do_stop(server_state *state);
+static void on_signal(uv_signal_t *handle, int signum);
 static void on_connection(uv_stream_t *server, int status);
 
 int server_run(const server_config *cf, uv_loop_t *loop) {
   struct addrinfo hints;
   server_state state;
+  unsigned int i;
   int err;
 
   memset(&state, 0, sizeof(state));
-  state.servers = NULL;
   state.config = *cf;
   state.loop = loop;
 
+  err = uv_runtime_init(&state.runtime, cf->nloops, 0);
+  if (err != 0) {
+    pr_err("uv_runtime_init: %s", uv_strerror(err));
+    return err;
+  }
+
+  state.sx.idle_timeout = cf->idle_timeout;
+  state.sx.allow_loopback = cf->allow_loopback;
+  state.sx.runtime = &state.runtime;
+  state.sx.pools = xmalloc(state.runtime.nloops * sizeof(state.sx.pools[0]));
+  for (i = 0; i < state.runtime.nloops; i++) {
+    CHECK(0 == uv_buf_pool_init(&state.sx.pools[i],
+                                READ_BUFFER_SIZE,
+                                READ_BUFFER_CACHE));
+  }
+
+  CHECK(0 == uv_signal_init(loop, &state.sigint_handle));
+  CHECK(0 == uv_signal_init(loop, &state.sigterm_handle));
+  CHECK(0 == uv_signal_start(&state.sigint_handle, on_signal, SIGINT));
+  CHECK(0 == uv_signal_start(&state.sigterm_handle, on_signal, SIGTERM));
+
   /* Resolve the address of the interface that we should bind to.
    * The getaddrinfo callback starts the server and everything else.
    */
@@ -64,7 +102,7 @@ int server_run(const server_config *cf, uv_loop_t *loop) {
                        &hints);
   if (err != 0) {
     pr_err("getaddrinfo: %s", uv_strerror(err));
-    return err;
+    do_stop(&state);
   }
 
   /* Start the event loop.  Control continues in do_bind(). */
@@ -72,10 +110,42 @@ int server_run(const server_config *cf, uv_loop_t *loop) {
     abort();
   }
 
-  /* Please Valgrind. */
+  /* Please Valgrind.  Connections that were still open when the runtime
+   * shut down were closed without running their close callbacks, so the
+   * pools may not get all of their buffers back.
+   */
   uv_loop_delete(loop);
-  free(state.servers);
-  return 0;
+  for (i = 0; i < state.runtime.nloops; i++) {
+    uv_buf_pool_destroy(&state.sx.pools[i]);
+  }
+  free(state.sx.pools);
+  return err;
+}
+
+/* Close the listen sockets and connections, stop the runtime's threads and
+ * let server_run() return.
+ */
+static void do_stop(server_state *state) {
+  if (uv_is_closing((uv_handle_t *) &state->sigint_handle)) {
+    return;
+  }
+
+  uv_close((uv_handle_t *) &state->sigint_handle, NULL);
+  uv_close((uv_handle_t *) &state->sigterm_handle, NULL);
+  CHECK(0 == uv_runtime_destroy(&state->runtime));
+}
+
+static void on_signal(uv_signal_t *handle, int signum) {
+  server_state *state;
+
+  if (signum == SIGINT) {
+    state = CONTAINER_OF(handle, server_state, sigint_handle);
+  } else {
+    state = CONTAINER_OF(handle, server_state, sigterm_handle);
+  }
+
+  pr_info("shutting down");
+  do_stop(state);
 }
 
 /* Bind a server to each address that getaddrinfo() reported. */
@@ -87,10 +157,6 @@ static void do_bind(uv_getaddrinfo_t *req, int status, struct addrinfo *addrs) {
   server_config *cf;
   struct addrinfo *ai;
   const void *addrv;
-  const char *what;
-  uv_loop_t *loop;
-  server_ctx *sx;
-  unsigned int n;
   int err;
   union {
     struct sockaddr addr;
@@ -99,12 +165,12 @@ static void do_bind(uv_getaddrinfo_t *req, int status, struct addrinfo *addrs) {
   } s;
 
   state = CONTAINER_OF(req, server_state, getaddrinfo_req);
-  loop = state->loop;
   cf = &state->config;
 
   if (status < 0) {
     pr_err("getaddrinfo(\"%s\"): %s", cf->bind_host, uv_strerror(status));
     uv_freeaddrinfo(addrs);
+    do_stop(state);
     return;
   }
 
@@ -121,13 +187,10 @@ static void do_bind(uv_getaddrinfo_t *req, int status, struct addrinfo *addrs) {
   if (ipv4_naddrs == 0 && ipv6_naddrs == 0) {
     pr_err("%s has no IPv4/6 addresses", cf->bind_host);
     uv_freeaddrinfo(addrs);
+    do_stop(state);
     return;
   }
 
-  state->servers =
-      xmalloc((ipv4_naddrs + ipv6_naddrs) * sizeof(state->servers[0]));
-
-  n = 0;
   for (ai = addrs; ai != NULL; ai = ai->ai_next) {
     if (ai->ai_family != AF_INET && ai->ai_family != AF_INET6) {
       continue;
@@ -149,46 +212,45 @@ static void do_bind(uv_getaddrinfo_t *req, int status, struct addrinfo *addrs) {
       UNREACHABLE();
     }
 
-    sx = state->servers + n;
-    sx->loop = loop;
-    sx->idle_timeout = state->config.idle_timeout;
-    CHECK(0 == uv_tcp_init(loop, &sx->tcp_handle));
-
-    what = "uv_tcp_bind";
-    err = uv_tcp_bind(&sx->tcp_handle, &s.addr, 0);
-    if (err == 0) {
-      what = "uv_listen";
-      err = uv_listen((uv_stream_t *) &sx->tcp_handle, 128, on_connection);
-    }
-
+    err = uv_runtime_listen(&state->runtime, &s.addr, 128, on_connection,
+                            &state->sx);
     if (err != 0) {
-      pr_err("%s(\"%s:%hu\"): %s",
-             what,
+      pr_err("uv_runtime_listen(\"%s:%hu\"): %s",
              addrbuf,
              cf->bind_port,
              uv_strerror(err));
-      while (n > 0) {
-        n -= 1;
-        uv_close((uv_handle_t *) (state->servers + n), NULL);
-      }
+      do_stop(state);
       break;
     }
 
-    pr_info("listening on %s:%hu", addrbuf, cf->bind_port);
-    n += 1;
+    pr_info("listening on %s:%hu with %u loops",
+            addrbuf,
+            cf->bind_port,
+            state->runtime.nloops);
   }
 
   uv_freeaddrinfo(addrs);
 }
 
+/* Runs on one of the runtime's loops. */
 static void on_connection(uv_stream_t *server, int status) {
   server_ctx *sx;
   client_ctx *cx;
+  int id;
+
+  if (status != 0) {
+    pr_warn("accept: %s", uv_strerror(status));
+    return;
+  }
+
+  sx = server->data;
+  id = uv_runtime_id(sx->runtime);
+  CHECK(id >= 0);
 
-  CHECK(status == 0);
-  sx = CONTAINER_OF(server, server_ctx, tcp_handle);
   cx = xmalloc(sizeof(*cx));
-  CHECK(0 == uv_tcp_init(sx->loop, &cx->incoming.handle.tcp));
+  cx->loop = server->loop;
+  cx->pool = &sx->pools[id];
+  CHECK(0 == uv_tcp_init(cx->loop, &cx->incoming.handle.tcp));
   CHECK(0 == uv_accept(server, &cx->incoming.handle.stream));
   client_finish_init(sx, cx);
 }
@@ -212,6 +274,10 @@ int can_access(const server_ctx *sx,
   uint32_t c;
   uint32_t d;
 
+  if (sx->allow_loopback) {
+    return 1;  /* Benchmark mode, see load.py. */
+  }
+
   /* TODO(bnoordhuis) Implement proper access checks.  For now, just reject
    * traffic to localhost.
    */
@@ -0,0 +1,207 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "uv-common.h"
+
+#include <assert.h>
+#include <string.h>
+
+struct uv__fs_log {
+  uv_fs_log_t* log;
+  uv_loop_t* loop;
+  uv_os_fd_t file;
+  unsigned int flags;
+  size_t size;
+  /* buf[cur]接收追加，另一半归正在写的批次所有，loop线程不碰它 */
+  char* buf[2];
+  size_t len[2];
+  unsigned int cur;
+  uv_work_t work;
+  int writing;
+  int write_err;  /* 工作线程填，after_work里读 */
+  int err;
+  int closing;
+  uv_fs_log_close_cb close_cb;
+};
+
+
+static void uv__fs_log_work(uv_work_t* work) {
+  struct uv__fs_log* p;
+  unsigned int n;
+  uv_buf_t buf;
+  uv_fs_t req;
+  int r;
+
+  p = container_of(work, struct uv__fs_log, work);
+  n = p->cur ^ 1;
+  r = 0;
+
+  if (p->len[n] > 0) {
+    buf = uv_buf_init(p->buf[n], p->len[n]);
+    r = uv_fs_write(NULL, &req, p->file, &buf, 1, -1, NULL);
+    uv_fs_req_cleanup(&req);
+    if (r >= 0 && (size_t) r != p->len[n])
+      r = UV_EIO;
+  }
+
+  if (r >= 0 && (p->flags & UV_FS_LOG_FDATASYNC)) {
+    r = uv_fs_fdatasync(NULL, &req, p->file, NULL);
+    uv_fs_req_cleanup(&req);
+  }
+
+  p->write_err = r < 0 ? r : 0;
+}
+
+
+static void uv__fs_log_after_work(uv_work_t* work, int status);
+
+
+static void uv__fs_log_start(struct uv__fs_log* p) {
+  int r;
+
+  assert(!p->writing);
+  p->cur ^= 1;
+  p->writing = 1;
+  r = uv_queue_work(p->loop, &p->work, uv__fs_log_work, uv__fs_log_after_work);
+  assert(r == 0);
+  (void) r;
+}
+
+
+static void uv__fs_log_after_work(uv_work_t* work, int status) {
+  struct uv__fs_log* p;
+  uv_fs_log_close_cb cb;
+  uv_fs_log_t* log;
+  unsigned int n;
+  int err;
+
+  p = container_of(work, struct uv__fs_log, work);
+  log = p->log;
+  n = p->cur ^ 1;
+  p->writing = 0;
+
+  if (p->write_err == 0) {
+    if (p->len[n] > 0) {
+      log->nwrites++;
+      log->nbytes += p->len[n];
+    }
+  } else if (p->err == 0) {
+    p->err = p->write_err;
+  }
+  p->len[n] = 0;
+
+  /* 出错以后不再写，关闭时剩下的数据丢掉 */
+  if (p->err == 0 && p->len[p->cur] > 0) {
+    uv__fs_log_start(p);
+    return;
+  }
+
+  if (!p->closing)
+    return;
+
+  /* close_cb里可能释放log，先把p释放掉 */
+  cb = p->close_cb;
+  err = p->err;
+  log->impl = NULL;
+  uv__free(p->buf[0]);
+  uv__free(p);
+
+  if (cb != NULL)
+    cb(log, err);
+}
+
+
+int uv_fs_log_init(uv_loop_t* loop,
+                   uv_fs_log_t* log,
+                   uv_os_fd_t file,
+                   size_t size,
+                   unsigned int flags) {
+  struct uv__fs_log* p;
+
+  if (size == 0 || size > SIZE_MAX / 2 || (flags & ~UV_FS_LOG_FDATASYNC))
+    return UV_EINVAL;
+
+  p = uv__calloc(1, sizeof(*p));
+  if (p == NULL)
+    return UV_ENOMEM;
+
+  /* 两半缓冲区一次分配 */
+  p->buf[0] = uv__malloc(size * 2);
+  if (p->buf[0] == NULL) {
+    uv__free(p);
+    return UV_ENOMEM;
+  }
+  p->buf[1] = p->buf[0] + size;
+
+  p->log = log;
+  p->loop = loop;
+  p->file = file;
+  p->flags = flags;
+  p->size = size;
+
+  log->loop = loop;
+  log->nwrites = 0;
+  log->nbytes = 0;
+  log->impl = p;
+  return 0;
+}
+
+
+int uv_fs_log_append(uv_fs_log_t* log, const char* data, size_t len) {
+  struct uv__fs_log* p;
+
+  p = log->impl;
+  if (p == NULL || p->closing)
+    return UV_EINVAL;
+
+  if (p->err != 0)
+    return p->err;
+
+  if (len > p->size)
+    return UV_E2BIG;
+
+  if (len > p->size - p->len[p->cur])
+    return UV_ENOBUFS;
+
+  memcpy(p->buf[p->cur] + p->len[p->cur], data, len);
+  p->len[p->cur] += len;
+
+  /* 没有在写的批次就马上开始写；否则等那一批写完再一起写 */
+  if (!p->writing)
+    uv__fs_log_start(p);
+
+  return 0;
+}
+
+
+void uv_fs_log_close(uv_fs_log_t* log, uv_fs_log_close_cb close_cb) {
+  struct uv__fs_log* p;
+
+  p = log->impl;
+  assert(p != NULL && !p->closing);
+  p->closing = 1;
+  p->close_cb = close_cb;
+
+  /* 空闲时也走一趟线程池，close_cb总是异步的，顺便做最后一次sync */
+  if (!p->writing)
+    uv__fs_log_start(p);
+}
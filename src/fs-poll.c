@@ -26,6 +26,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* 一次线程池任务最多stat多少个文件 */
+#define POLL_BATCH_SIZE 128
+
+struct poll_group;
+
 struct poll_ctx {
   uv_fs_poll_t* parent_handle; /* NULL if parent has been stopped or closed */
   int busy_polling;
@@ -36,13 +41,46 @@ struct poll_ctx {
   uv_timer_t timer_handle;
   uv_fs_t fs_req; /* TODO(bnoordhuis) mark fs_req internal */
   uv_stat_t statbuf;
+  /* 共享模式下不用timer_handle：第一次stat完成后加入group，由group的定时器
+   * 统一调度；in_batch表示fs_req正被线程池里的批次使用，这时ctx不能释放
+   */
+  int shared;
+  int in_batch;
+  struct poll_group* group;
+  QUEUE group_queue;
   char path[1]; /* variable length */
 };
 
+/* UV_LOOP_FS_POLL_SHARED模式下间隔相同的handle共用一个定时器 */
+struct poll_group {
+  uv_loop_t* loop;
+  unsigned int interval;
+  unsigned int pending;  /* 还没完成的批次 */
+  uint64_t start_time;
+  QUEUE handles;
+  QUEUE queue;
+  uv_timer_t timer_handle;
+};
+
+/* 一批一起在线程池里stat的handle */
+struct poll_batch {
+  struct uv__work work_req;
+  struct poll_group* group;
+  unsigned int nctx;
+  struct poll_ctx* ctx[1]; /* variable length */
+};
+
+struct poll_groups {
+  QUEUE groups;
+};
+
 static int statbuf_eq(const uv_stat_t* a, const uv_stat_t* b);
 static void poll_cb(uv_fs_t* req);
 static void timer_cb(uv_timer_t* timer);
 static void timer_close_cb(uv_handle_t* handle);
+static void shared_poll_cb(uv_fs_t* req);
+static void poll_group_timer_cb(uv_timer_t* timer);
+static void poll_group_maybe_close(struct poll_group* group);
 
 static uv_stat_t zero_statbuf;
 
@@ -79,6 +117,18 @@ int uv_fs_poll_start(uv_fs_poll_t* handle,
   ctx->parent_handle = handle;
   memcpy(ctx->path, path, len + 1);
 
+  if (loop->fs_poll_groups != NULL) {
+    ctx->shared = 1;
+    err = uv_fs_stat(loop, &ctx->fs_req, ctx->path, shared_poll_cb);
+    if (err < 0)
+      goto error;
+
+    handle->poll_ctx = ctx;
+    uv__handle_start(handle);
+
+    return 0;
+  }
+
   err = uv_timer_init(loop, &ctx->timer_handle);
   if (err < 0)
     goto error;
@@ -113,6 +163,19 @@ int uv_fs_poll_stop(uv_fs_poll_t* handle) {
   ctx->parent_handle = NULL;
   handle->poll_ctx = NULL;
 
+  /* 共享模式下退出group；第一次stat或者批次还没完成时由它们的回调释放ctx */
+  if (ctx->shared) {
+    if (ctx->group != NULL) {
+      QUEUE_REMOVE(&ctx->group_queue);
+      poll_group_maybe_close(ctx->group);
+      ctx->group = NULL;
+      if (!ctx->in_batch)
+        uv__free(ctx);
+    }
+    uv__handle_stop(handle);
+    return 0;
+  }
+
   /* Close the timer if it's active. If it's inactive, there's a stat request
    * in progress and poll_cb will take care of the cleanup.
    */
@@ -169,18 +232,9 @@ static void timer_cb(uv_timer_t* timer) {
 }
 
 
-static void poll_cb(uv_fs_t* req) {
+/* 比较这次stat的结果，有变化时调用用户回调 */
+static void poll_update(struct poll_ctx* ctx, uv_fs_t* req) {
   uv_stat_t* statbuf;
-  struct poll_ctx* ctx;
-  uint64_t interval;
-
-  ctx = container_of(req, struct poll_ctx, fs_req);
-
-  if (ctx->parent_handle == NULL) { /* handle has been stopped or closed */
-    uv_close((uv_handle_t*)&ctx->timer_handle, timer_close_cb);
-    uv_fs_req_cleanup(req);
-    return;
-  }
 
   if (req->result != 0) {
     if (ctx->busy_polling != req->result) {
@@ -190,7 +244,7 @@ static void poll_cb(uv_fs_t* req) {
                    &zero_statbuf);
       ctx->busy_polling = req->result;
     }
-    goto out;
+    return;
   }
 
   statbuf = &req->statbuf;
@@ -201,8 +255,22 @@ static void poll_cb(uv_fs_t* req) {
 
   ctx->statbuf = *statbuf;
   ctx->busy_polling = 1;
+}
+
+
+static void poll_cb(uv_fs_t* req) {
+  struct poll_ctx* ctx;
+  uint64_t interval;
+
+  ctx = container_of(req, struct poll_ctx, fs_req);
 
-out:
+  if (ctx->parent_handle == NULL) { /* handle has been stopped or closed */
+    uv_close((uv_handle_t*)&ctx->timer_handle, timer_close_cb);
+    uv_fs_req_cleanup(req);
+    return;
+  }
+
+  poll_update(ctx, req);
   uv_fs_req_cleanup(req);
 
   if (ctx->parent_handle == NULL) { /* handle has been stopped by callback */
@@ -224,6 +292,208 @@ static void timer_close_cb(uv_handle_t* handle) {
 }
 
 
+int uv__fs_poll_groups_enable(uv_loop_t* loop) {
+  struct poll_groups* groups;
+
+  if (loop->fs_poll_groups != NULL)
+    return 0;
+
+  groups = uv__malloc(sizeof(*groups));
+  if (groups == NULL)
+    return UV_ENOMEM;
+
+  QUEUE_INIT(&groups->groups);
+  loop->fs_poll_groups = groups;
+  return 0;
+}
+
+
+static void poll_group_close_cb(uv_handle_t* handle) {
+  uv__free(container_of(handle, struct poll_group, timer_handle));
+}
+
+
+static void poll_group_maybe_close(struct poll_group* group) {
+  if (group->pending != 0 || !QUEUE_EMPTY(&group->handles))
+    return;
+
+  /* 从loop上摘掉，之后新加入的handle会建一个新的group */
+  QUEUE_REMOVE(&group->queue);
+  uv_close((uv_handle_t*) &group->timer_handle, poll_group_close_cb);
+}
+
+
+static void poll_group_schedule(struct poll_group* group) {
+  uint64_t interval;
+
+  interval = group->interval;
+  interval -= (uv_now(group->loop) - group->start_time) % interval;
+
+  if (uv_timer_start(&group->timer_handle, poll_group_timer_cb, interval, 0))
+    abort();
+}
+
+
+static struct poll_group* poll_group_get(uv_loop_t* loop,
+                                         unsigned int interval) {
+  struct poll_groups* groups;
+  struct poll_group* group;
+  QUEUE* q;
+
+  groups = loop->fs_poll_groups;
+  QUEUE_FOREACH(q, &groups->groups) {
+    group = QUEUE_DATA(q, struct poll_group, queue);
+    if (group->interval == interval)
+      return group;
+  }
+
+  group = uv__malloc(sizeof(*group));
+  if (group == NULL)
+    return NULL;
+
+  if (uv_timer_init(loop, &group->timer_handle)) {
+    uv__free(group);
+    return NULL;
+  }
+
+  group->timer_handle.flags |= UV_HANDLE_INTERNAL;
+  uv__handle_unref(&group->timer_handle);
+
+  group->loop = loop;
+  group->interval = interval;
+  group->pending = 0;
+  group->start_time = uv_now(loop);
+  QUEUE_INIT(&group->handles);
+  QUEUE_INSERT_TAIL(&groups->groups, &group->queue);
+
+  return group;
+}
+
+
+static void poll_batch_work(struct uv__work* w) {
+  struct poll_batch* batch;
+  struct poll_ctx* ctx;
+  unsigned int i;
+
+  batch = container_of(w, struct poll_batch, work_req);
+  for (i = 0; i < batch->nctx; i++) {
+    ctx = batch->ctx[i];
+    uv_fs_stat(NULL, &ctx->fs_req, ctx->path, NULL);
+  }
+}
+
+
+static void poll_batch_done(struct uv__work* w, int status) {
+  struct poll_batch* batch;
+  struct poll_group* group;
+  struct poll_ctx* ctx;
+  unsigned int i;
+
+  batch = container_of(w, struct poll_batch, work_req);
+  group = batch->group;
+  uv__req_unregister(group->loop, batch);
+
+  /* 回调里停掉的handle（包括自己）in_batch还没清掉，uv_fs_poll_stop()不会
+   * 释放它们，留到这里释放
+   */
+  for (i = 0; i < batch->nctx; i++) {
+    ctx = batch->ctx[i];
+
+    if (ctx->parent_handle != NULL && status != UV_ECANCELED)
+      poll_update(ctx, &ctx->fs_req);
+
+    ctx->in_batch = 0;
+
+    if (status != UV_ECANCELED)
+      uv_fs_req_cleanup(&ctx->fs_req);
+
+    if (ctx->parent_handle == NULL)
+      uv__free(ctx);
+  }
+
+  uv__free(batch);
+
+  if (--group->pending != 0)
+    return;
+
+  if (QUEUE_EMPTY(&group->handles))
+    poll_group_maybe_close(group);
+  else
+    poll_group_schedule(group);
+}
+
+
+static void poll_group_timer_cb(uv_timer_t* timer) {
+  struct poll_group* group;
+  struct poll_batch* batch;
+  struct poll_ctx* ctx;
+  QUEUE* q;
+
+  group = container_of(timer, struct poll_group, timer_handle);
+  group->start_time = uv_now(group->loop);
+
+  batch = NULL;
+  QUEUE_FOREACH(q, &group->handles) {
+    ctx = QUEUE_DATA(q, struct poll_ctx, group_queue);
+
+    if (batch == NULL) {
+      batch = uv__malloc(sizeof(*batch) +
+                         (POLL_BATCH_SIZE - 1) * sizeof(batch->ctx[0]));
+      if (batch == NULL)
+        break;  /* 内存不够时剩下的等下一个周期 */
+      batch->group = group;
+      batch->nctx = 0;
+    }
+
+    ctx->in_batch = 1;
+    batch->ctx[batch->nctx++] = ctx;
+
+    if (batch->nctx == POLL_BATCH_SIZE || QUEUE_NEXT(q) == &group->handles) {
+      group->pending++;
+      uv__req_register(group->loop, batch);
+      uv__work_submit(group->loop,
+                      &batch->work_req,
+                      UV__WORK_FAST_IO,
+                      poll_batch_work,
+                      poll_batch_done);
+      batch = NULL;
+    }
+  }
+
+  if (group->pending == 0)
+    poll_group_schedule(group);
+}
+
+
+/* 共享模式下第一次stat的回调：记下初始状态，然后加入对应间隔的group */
+static void shared_poll_cb(uv_fs_t* req) {
+  struct poll_group* group;
+  struct poll_ctx* ctx;
+
+  ctx = container_of(req, struct poll_ctx, fs_req);
+
+  if (ctx->parent_handle != NULL)
+    poll_update(ctx, req);
+
+  uv_fs_req_cleanup(req);
+
+  if (ctx->parent_handle == NULL) { /* handle has been stopped or closed */
+    uv__free(ctx);
+    return;
+  }
+
+  group = poll_group_get(ctx->loop, ctx->interval);
+  if (group == NULL)
+    abort();
+
+  ctx->group = group;
+  QUEUE_INSERT_TAIL(&group->handles, &ctx->group_queue);
+
+  if (group->pending == 0 && !uv__is_active(&group->timer_handle))
+    poll_group_schedule(group);
+}
+
+
 static int statbuf_eq(const uv_stat_t* a, const uv_stat_t* b) {
   return a->st_ctim.tv_nsec == b->st_ctim.tv_nsec
       && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec
@@ -96,6 +96,38 @@ unsigned uv__utf8_decode1(const char** p, const char* pe) {
   return uv__utf8_decode1_slow(p, pe, a);
 }
 
+/* 一次检查 8 个字节的最高位，整段都是 ASCII 时返回非零。
+ * 用 memcpy 读入 uint64_t 避开未对齐访问，编译器会把它优化成普通的
+ * load；剩下不足 8 字节的尾巴逐字节检查。
+ */
+static int uv__idna_is_ascii(const char* s, const char* se) {
+  uint64_t w;
+
+  for (w = 0; se - s >= 8; s += 8) {
+    memcpy(&w, s, sizeof(w));
+    if (w & 0x8080808080808080ull)
+      return 0;
+  }
+
+  for (/* empty */; s < se; s++)
+    if ((unsigned char) *s > 127)
+      return 0;
+
+  return 1;
+}
+
+/* 纯 ASCII 直接原样拷贝，|de| 截断的语义与逐码点写入相同。 */
+static void uv__idna_copy(const char* s, const char* se, char** d, char* de) {
+  size_t n;
+
+  n = se - s;
+  if (n > (size_t) (de - *d))
+    n = de - *d;
+
+  memcpy(*d, s, n);
+  *d += n;
+}
+
 #define foreach_codepoint(c, p, pe) \
   for (; (void) (*p <= pe && (c = uv__utf8_decode1(p, pe))), *p <= pe;)
 
@@ -117,6 +149,12 @@ static int uv__idna_toascii_label(const char* s, const char* se,
   unsigned todo;
   int first;
 
+  /* 绝大多数标签不需要 punycode，跳过下面两次逐码点的扫描。 */
+  if (uv__idna_is_ascii(s, se)) {
+    uv__idna_copy(s, se, d, de);
+    return se - s;
+  }
+
   h = 0;
   ss = s;
   todo = 0;
@@ -256,6 +294,14 @@ long uv__idna_toascii(const char* s, const char* se, char* d, char* de) {
 
   ds = d;
 
+  /* 快速路径：整个域名都是 ASCII 时输出与输入逐字节相同，
+   * 不需要切分标签。
+   */
+  if (uv__idna_is_ascii(s, se)) {
+    uv__idna_copy(s, se, &d, de);
+    goto out;
+  }
+
   for (si = s; si < se; /* empty */) {
     st = si;
     c = uv__utf8_decode1(&si, se);
@@ -284,6 +330,7 @@ long uv__idna_toascii(const char* s, const char* se, char* d, char* de) {
       return rc;
   }
 
+out:
   if (d < de)
     *d++ = '\0';
 
@@ -15,7 +15,6 @@
  * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 
@@ -30,6 +29,9 @@ static int inet_ntop4(const unsigned char *src, char *dst, size_t size);
 static int inet_ntop6(const unsigned char *src, char *dst, size_t size);
 static int inet_pton4(const char *src, unsigned char *dst);
 static int inet_pton6(const char *src, unsigned char *dst);
+static int inet_pton6_zone(const char *src, unsigned char *dst);
+
+static const char hexdigits[] = "0123456789abcdef";
 
 
 int uv_inet_ntop(int af, const void* src, char* dst, size_t size) {
@@ -45,17 +47,75 @@ int uv_inet_ntop(int af, const void* src, char* dst, size_t size) {
 }
 
 
+/* 一次转换n个地址，省掉每个地址一次的分派 */
+int uv_inet_ntop_batch(int af,
+                       const void* src,
+                       char* dst,
+                       size_t stride,
+                       unsigned int n) {
+  const unsigned char* s;
+  unsigned int i;
+  int err;
+
+  s = src;
+  switch (af) {
+  case AF_INET:
+    if (stride < UV__INET_ADDRSTRLEN)
+      return UV_ENOSPC;
+    for (i = 0; i < n; i++)
+      inet_ntop4(s + i * sizeof(struct in_addr), dst + i * stride, stride);
+    return 0;
+  case AF_INET6:
+    if (stride < UV__INET6_ADDRSTRLEN)
+      return UV_ENOSPC;
+    for (i = 0; i < n; i++) {
+      err = inet_ntop6(s + i * sizeof(struct in6_addr),
+                       dst + i * stride,
+                       stride);
+      if (err != 0)
+        return err;
+    }
+    return 0;
+  default:
+    return UV_EAFNOSUPPORT;
+  }
+}
+
+
+/* 一个字节的十进制，不带前导0 */
+static char* uv__fmt_u8(char* p, unsigned int v) {
+  if (v >= 100) {
+    *p++ = '0' + v / 100;
+    v %= 100;
+    *p++ = '0' + v / 10;
+  } else if (v >= 10) {
+    *p++ = '0' + v / 10;
+  }
+  *p++ = '0' + v % 10;
+  return p;
+}
+
+
+/* 不用snprintf()，直接按位数写出每个字节 */
 static int inet_ntop4(const unsigned char *src, char *dst, size_t size) {
-  static const char fmt[] = "%u.%u.%u.%u";
   char tmp[UV__INET_ADDRSTRLEN];
-  int l;
+  char* p;
+  size_t l;
+
+  p = uv__fmt_u8(tmp, src[0]);
+  *p++ = '.';
+  p = uv__fmt_u8(p, src[1]);
+  *p++ = '.';
+  p = uv__fmt_u8(p, src[2]);
+  *p++ = '.';
+  p = uv__fmt_u8(p, src[3]);
+  *p = '\0';
 
-  l = snprintf(tmp, sizeof(tmp), fmt, src[0], src[1], src[2], src[3]);
-  if (l <= 0 || (size_t) l >= size) {
+  l = p - tmp;
+  if (l >= size) {
     return UV_ENOSPC;
   }
-  strncpy(dst, tmp, size);
-  dst[size - 1] = '\0';
+  memcpy(dst, tmp, l + 1);
   return 0;
 }
 
@@ -78,9 +138,8 @@ static int inet_ntop6(const unsigned char *src, char *dst, size_t size) {
    *  Copy the input (bytewise) array into a wordwise array.
    *  Find the longest run of 0x00's in src[] for :: shorthanding.
    */
-  memset(words, '\0', sizeof words);
-  for (i = 0; i < (int) sizeof(struct in6_addr); i++)
-    words[i / 2] |= (src[i] << ((1 - (i % 2)) << 3));
+  for (i = 0; i < (int) ARRAY_SIZE(words); i++)
+    words[i] = (src[2 * i] << 8) | src[2 * i + 1];
   best.base = -1;
   best.len = 0;
   cur.base = -1;
@@ -131,7 +190,14 @@ static int inet_ntop6(const unsigned char *src, char *dst, size_t size) {
       tp += strlen(tp);
       break;
     }
-    tp += sprintf(tp, "%x", words[i]);
+    /* 相当于sprintf(tp, "%x", words[i]) */
+    if (words[i] >= 0x1000)
+      *tp++ = hexdigits[words[i] >> 12];
+    if (words[i] >= 0x100)
+      *tp++ = hexdigits[(words[i] >> 8) & 15];
+    if (words[i] >= 0x10)
+      *tp++ = hexdigits[(words[i] >> 4) & 15];
+    *tp++ = hexdigits[words[i] & 15];
   }
   /* Was it a trailing run of 0x00's? */
   if (best.base != -1 && (best.base + best.len) == ARRAY_SIZE(words))
@@ -144,7 +210,7 @@ static int inet_ntop6(const unsigned char *src, char *dst, size_t size) {
   if ((size_t)(tp - tmp) > size) {
     return UV_ENOSPC;
   }
-  strcpy(dst, tmp);
+  memcpy(dst, tmp, tp - tmp);
   return 0;
 }
 
@@ -156,21 +222,8 @@ int uv_inet_pton(int af, const char* src, void* dst) {
   switch (af) {
   case AF_INET:
     return (inet_pton4(src, dst));
-  case AF_INET6: {
-    int len;
-    char tmp[UV__INET6_ADDRSTRLEN], *s, *p;
-    s = (char*) src;
-    p = strchr(src, '%');
-    if (p != NULL) {
-      s = tmp;
-      len = p - src;
-      if (len > UV__INET6_ADDRSTRLEN-1)
-        return UV_EINVAL;
-      memcpy(s, src, len);
-      s[len] = '\0';
-    }
-    return inet_pton6(s, dst);
-  }
+  case AF_INET6:
+    return (inet_pton6_zone(src, (unsigned char*) dst));
   default:
     return UV_EAFNOSUPPORT;
   }
@@ -178,51 +231,111 @@ int uv_inet_pton(int af, const char* src, void* dst) {
 }
 
 
+int uv_inet_pton_batch(int af,
+                       const char* const src[],
+                       void* dst,
+                       int status[],
+                       unsigned int n) {
+  unsigned char* d;
+  unsigned int i;
+  int nok;
+  int err;
+
+  if (af != AF_INET && af != AF_INET6)
+    return UV_EAFNOSUPPORT;
+
+  d = dst;
+  nok = 0;
+  for (i = 0; i < n; i++) {
+    if (src[i] == NULL)
+      err = UV_EINVAL;
+    else if (af == AF_INET)
+      err = inet_pton4(src[i], d + i * sizeof(struct in_addr));
+    else
+      err = inet_pton6_zone(src[i], d + i * sizeof(struct in6_addr));
+
+    if (err == 0)
+      nok++;
+    if (status != NULL)
+      status[i] = err;
+  }
+
+  return nok;
+}
+
+
+/* 去掉"%eth0"这样的zone再解析 */
+static int inet_pton6_zone(const char *src, unsigned char *dst) {
+  char tmp[UV__INET6_ADDRSTRLEN];
+  const char* p;
+  size_t len;
+
+  p = strchr(src, '%');
+  if (p == NULL)
+    return inet_pton6(src, dst);
+
+  len = p - src;
+  if (len > UV__INET6_ADDRSTRLEN - 1)
+    return UV_EINVAL;
+  memcpy(tmp, src, len);
+  tmp[len] = '\0';
+  return inet_pton6(tmp, dst);
+}
+
+
+/* 一遍扫过去，每个字符只比较一次范围，不再对每个字符strchr()一遍数字表 */
 static int inet_pton4(const char *src, unsigned char *dst) {
-  static const char digits[] = "0123456789";
-  int saw_digit, octets, ch;
-  unsigned char tmp[sizeof(struct in_addr)], *tp;
+  unsigned char tmp[sizeof(struct in_addr)];
+  unsigned int octets;
+  unsigned int val;
+  unsigned int ch;
 
-  saw_digit = 0;
   octets = 0;
-  *(tp = tmp) = 0;
-  while ((ch = *src++) != '\0') {
-    const char *pch;
-
-    if ((pch = strchr(digits, ch)) != NULL) {
-      unsigned int nw = *tp * 10 + (pch - digits);
+  for (;;) {
+    ch = (unsigned int) (unsigned char) *src - '0';
+    if (ch > 9)
+      return UV_EINVAL;
+    val = ch;
+    src++;
 
-      if (saw_digit && *tp == 0)
-        return UV_EINVAL;
-      if (nw > 255)
+    while ((ch = (unsigned int) (unsigned char) *src - '0') <= 9) {
+      if (val == 0)
+        return UV_EINVAL;  /* 不允许前导0 */
+      val = val * 10 + ch;
+      if (val > 255)
         return UV_EINVAL;
-      *tp = nw;
-      if (!saw_digit) {
-        if (++octets > 4)
-          return UV_EINVAL;
-        saw_digit = 1;
-      }
-    } else if (ch == '.' && saw_digit) {
-      if (octets == 4)
-        return UV_EINVAL;
-      *++tp = 0;
-      saw_digit = 0;
-    } else
+      src++;
+    }
+
+    tmp[octets++] = val;
+    if (*src == '\0')
+      break;
+    if (*src != '.' || octets == sizeof(tmp))
       return UV_EINVAL;
+    src++;
   }
-  if (octets < 4)
+
+  if (octets < sizeof(tmp))
     return UV_EINVAL;
-  memcpy(dst, tmp, sizeof(struct in_addr));
+  memcpy(dst, tmp, sizeof(tmp));
   return 0;
 }
 
 
+static int uv__hexval(int ch) {
+  if (ch >= '0' && ch <= '9')
+    return ch - '0';
+  ch |= 0x20;  /* 转成小写 */
+  if (ch >= 'a' && ch <= 'f')
+    return ch - 'a' + 10;
+  return -1;
+}
+
+
 static int inet_pton6(const char *src, unsigned char *dst) {
-  static const char xdigits_l[] = "0123456789abcdef",
-                    xdigits_u[] = "0123456789ABCDEF";
   unsigned char tmp[sizeof(struct in6_addr)], *tp, *endp, *colonp;
-  const char *xdigits, *curtok;
-  int ch, seen_xdigits;
+  const char *curtok;
+  int ch, seen_xdigits, xval;
   unsigned int val;
 
   memset((tp = tmp), '\0', sizeof tmp);
@@ -236,13 +349,10 @@ static int inet_pton6(const char *src, unsigned char *dst) {
   seen_xdigits = 0;
   val = 0;
   while ((ch = *src++) != '\0') {
-    const char *pch;
-
-    if ((pch = strchr((xdigits = xdigits_l), ch)) == NULL)
-      pch = strchr((xdigits = xdigits_u), ch);
-    if (pch != NULL) {
+    xval = uv__hexval(ch);
+    if (xval >= 0) {
       val <<= 4;
-      val |= (pch - xdigits);
+      val |= xval;
       if (++seen_xdigits > 4)
         return UV_EINVAL;
       continue;
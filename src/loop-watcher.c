@@ -22,19 +22,75 @@
 #include "uv.h"
 #include "uv-common.h"
 
+/* 同一种watcher按priority从小到大排在loop的队列里。插入时排在同优先级的最前面，
+ * 优先级全部相同时和以前一样是后启动的先运行。只调用一次的watcher运行前就从
+ * 队列里摘掉，所以每轮的开销只和启动着的watcher个数有关。
+ */
 #define UV_LOOP_WATCHER_DEFINE(name, type)                                    \
+  static void uv__##name##_insert(uv_##name##_t* handle) {                    \
+    uv_##name##_t* h;                                                         \
+    QUEUE* head;                                                              \
+    QUEUE* q;                                                                 \
+    head = &handle->loop->name##_handles;                                     \
+    QUEUE_FOREACH(q, head) {                                                  \
+      h = QUEUE_DATA(q, uv_##name##_t, queue);                                \
+      if (h->priority >= handle->priority)                                    \
+        break;                                                                \
+    }                                                                         \
+    /* 插在q前面，q是head时就是队尾 */                                        \
+    QUEUE_INSERT_TAIL(q, &handle->queue);                                     \
+  }                                                                           \
+                                                                              \
+  /* 运行过的watcher按原来的顺序放回去，从队尾找，通常一步就找到 */           \
+  static void uv__##name##_reinsert(uv_##name##_t* handle) {                  \
+    uv_##name##_t* h;                                                         \
+    QUEUE* head;                                                              \
+    QUEUE* q;                                                                 \
+    head = &handle->loop->name##_handles;                                     \
+    for (q = QUEUE_PREV(head); q != head; q = QUEUE_PREV(q)) {                \
+      h = QUEUE_DATA(q, uv_##name##_t, queue);                                \
+      if (h->priority <= handle->priority)                                    \
+        break;                                                                \
+    }                                                                         \
+    QUEUE_INSERT_HEAD(q, &handle->queue);                                     \
+  }                                                                           \
+                                                                              \
+  static int uv__##name##_start(uv_##name##_t* handle,                        \
+                                uv_##name##_cb cb,                            \
+                                int once) {                                   \
+    if (uv__is_active(handle)) return 0;                                      \
+    if (cb == NULL) return UV_EINVAL;                                         \
+    if (once)                                                                 \
+      handle->flags |= UV_HANDLE_ONE_SHOT;                                    \
+    else                                                                      \
+      handle->flags &= ~UV_HANDLE_ONE_SHOT;                                   \
+    uv__##name##_insert(handle);                                              \
+    handle->name##_cb = cb;                                                   \
+    uv__handle_start(handle);                                                 \
+    return 0;                                                                 \
+  }                                                                           \
+                                                                              \
   int uv_##name##_init(uv_loop_t* loop, uv_##name##_t* handle) {              \
     uv__handle_init(loop, (uv_handle_t*)handle, UV_##type);                   \
     handle->name##_cb = NULL;                                                 \
+    handle->priority = 0;                                                     \
     return 0;                                                                 \
   }                                                                           \
                                                                               \
   int uv_##name##_start(uv_##name##_t* handle, uv_##name##_cb cb) {           \
-    if (uv__is_active(handle)) return 0;                                      \
-    if (cb == NULL) return UV_EINVAL;                                         \
-    QUEUE_INSERT_HEAD(&handle->loop->name##_handles, &handle->queue);         \
-    handle->name##_cb = cb;                                                   \
-    uv__handle_start(handle);                                                 \
+    return uv__##name##_start(handle, cb, 0);                                 \
+  }                                                                           \
+                                                                              \
+  int uv_##name##_start_once(uv_##name##_t* handle, uv_##name##_cb cb) {      \
+    return uv__##name##_start(handle, cb, 1);                                 \
+  }                                                                           \
+                                                                              \
+  int uv_##name##_set_priority(uv_##name##_t* handle, int priority) {         \
+    handle->priority = priority;                                              \
+    if (uv__is_active(handle)) {                                              \
+      QUEUE_REMOVE(&handle->queue);                                           \
+      uv__##name##_insert(handle);                                            \
+    }                                                                         \
     return 0;                                                                 \
   }                                                                           \
                                                                               \
@@ -54,7 +110,14 @@
       q = QUEUE_HEAD(&queue);                                                 \
       h = QUEUE_DATA(q, uv_##name##_t, queue);                                \
       QUEUE_REMOVE(q);                                                        \
-      QUEUE_INSERT_TAIL(&loop->name##_handles, q);                            \
+      if (h->flags & UV_HANDLE_ONE_SHOT) {                                    \
+        /* 回调里可以重新启动，下一轮才会再运行 */                            \
+        QUEUE_INIT(q);                                                        \
+        uv__handle_stop(h);                                                   \
+      } else {                                                                \
+        uv__##name##_reinsert(h);                                             \
+      }                                                                       \
+      uv__handle_activity(h);                                                 \
       h->name##_cb(h);                                                        \
     }                                                                         \
   }                                                                           \
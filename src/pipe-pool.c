@@ -0,0 +1,425 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "uv-common.h"
+
+#include <assert.h>
+#include <string.h>
+
+enum {
+  UV__CONN_CONNECTING,
+  UV__CONN_IDLE,
+  UV__CONN_BUSY,    /* 借出去了 */
+  UV__CONN_CLOSING
+};
+
+struct uv__pipe_pool;
+
+struct uv__pipe_conn {
+  uv_pipe_t pipe;
+  uv_connect_t connect_req;
+  struct uv__pipe_pool* p;  /* 连接池关闭时借出去的连接和它脱钩，为NULL */
+  QUEUE member;             /* p->conns */
+  QUEUE idle;               /* p->idle */
+  int state;
+  char rbuf[16];            /* 空闲时读到的任何东西都说明连接不能再用 */
+};
+
+struct uv__pipe_pool {
+  uv_pipe_pool_t* pool;  /* 初始化失败后为NULL，handle都关完就释放 */
+  uv_loop_t* loop;
+  char* name;
+  /* 有空闲连接时请求也在下一轮才回调 */
+  uv_timer_t dispatch;
+  QUEUE conns;
+  QUEUE idle;
+  QUEUE waiting;
+  unsigned int nwarm;
+  unsigned int nidle;
+  unsigned int nconnecting;
+  unsigned int nwaiting;
+  unsigned int nhandles;
+  int closing;
+  uv_pipe_pool_close_cb close_cb;
+};
+
+
+static int uv__pipe_pool_refill(struct uv__pipe_pool* p);
+
+
+static void uv__pipe_pool_maybe_free(struct uv__pipe_pool* p) {
+  uv_pipe_pool_close_cb cb;
+  uv_pipe_pool_t* pool;
+
+  if (p->nhandles != 0)
+    return;
+
+  pool = p->pool;
+  cb = p->close_cb;
+  if (pool != NULL)
+    pool->impl = NULL;
+
+  /* close_cb里可能释放pool，先把p释放掉 */
+  uv__free(p->name);
+  uv__free(p);
+
+  if (pool != NULL && cb != NULL)
+    cb(pool);
+}
+
+
+static void uv__pipe_conn_close_cb(uv_handle_t* handle) {
+  struct uv__pipe_conn* conn;
+  struct uv__pipe_pool* p;
+
+  conn = container_of((uv_pipe_t*) handle, struct uv__pipe_conn, pipe);
+  p = conn->p;
+  uv__free(conn);
+
+  if (p != NULL) {
+    p->nhandles--;
+    if (p->closing)
+      uv__pipe_pool_maybe_free(p);
+  }
+}
+
+
+static void uv__pipe_conn_close(struct uv__pipe_conn* conn) {
+  struct uv__pipe_pool* p;
+
+  p = conn->p;
+  if (conn->state == UV__CONN_CLOSING)
+    return;
+
+  if (p != NULL) {
+    if (conn->state == UV__CONN_IDLE) {
+      QUEUE_REMOVE(&conn->idle);
+      p->nidle--;
+    }
+    QUEUE_REMOVE(&conn->member);
+  }
+
+  conn->state = UV__CONN_CLOSING;
+  uv_close((uv_handle_t*) &conn->pipe, uv__pipe_conn_close_cb);
+}
+
+
+static void uv__pipe_conn_alloc_cb(uv_handle_t* handle,
+                                   size_t suggested_size,
+                                   uv_buf_t* buf) {
+  struct uv__pipe_conn* conn;
+
+  conn = container_of((uv_pipe_t*) handle, struct uv__pipe_conn, pipe);
+  *buf = uv_buf_init(conn->rbuf, sizeof(conn->rbuf));
+}
+
+
+/* 空闲连接上对端关了、出错了或者发来了不该有的数据，关掉再补一个 */
+static void uv__pipe_conn_read_cb(uv_stream_t* stream,
+                                  ssize_t nread,
+                                  const uv_buf_t* buf) {
+  struct uv__pipe_conn* conn;
+  struct uv__pipe_pool* p;
+
+  if (nread == 0)
+    return;
+
+  conn = container_of((uv_pipe_t*) stream, struct uv__pipe_conn, pipe);
+  p = conn->p;
+  uv__pipe_conn_close(conn);
+  uv__pipe_pool_refill(p);
+}
+
+
+/* 还回来的连接放在前面先用，新连上的放在后面 */
+static void uv__pipe_conn_make_idle(struct uv__pipe_conn* conn, int front) {
+  struct uv__pipe_pool* p;
+
+  p = conn->p;
+  conn->state = UV__CONN_IDLE;
+  if (front)
+    QUEUE_INSERT_HEAD(&p->idle, &conn->idle);
+  else
+    QUEUE_INSERT_TAIL(&p->idle, &conn->idle);
+  p->nidle++;
+
+  uv_read_start((uv_stream_t*) &conn->pipe,
+                uv__pipe_conn_alloc_cb,
+                uv__pipe_conn_read_cb);
+  uv_unref((uv_handle_t*) &conn->pipe);
+}
+
+
+/* 把空闲连接按顺序交给排队的请求，只在回调里调用 */
+static void uv__pipe_pool_dispatch(struct uv__pipe_pool* p) {
+  struct uv__pipe_conn* conn;
+  uv_pipe_pool_req_t* req;
+  QUEUE* q;
+
+  while (!p->closing && p->nidle > 0 && !QUEUE_EMPTY(&p->waiting)) {
+    q = QUEUE_HEAD(&p->waiting);
+    QUEUE_REMOVE(q);
+    p->nwaiting--;
+    req = QUEUE_DATA(q, uv_pipe_pool_req_t, queue);
+
+    q = QUEUE_HEAD(&p->idle);
+    QUEUE_REMOVE(q);
+    p->nidle--;
+    conn = QUEUE_DATA(q, struct uv__pipe_conn, idle);
+
+    conn->state = UV__CONN_BUSY;
+    uv_read_stop((uv_stream_t*) &conn->pipe);
+    uv_ref((uv_handle_t*) &conn->pipe);
+
+    req->cb(req, 0, &conn->pipe);
+  }
+
+  uv__pipe_pool_refill(p);
+}
+
+
+static void uv__pipe_pool_dispatch_cb(uv_timer_t* handle) {
+  uv__pipe_pool_dispatch(container_of(handle, struct uv__pipe_pool, dispatch));
+}
+
+
+static void uv__pipe_conn_connect_cb(uv_connect_t* req, int status) {
+  struct uv__pipe_conn* conn;
+  uv_pipe_pool_req_t* waiter;
+  struct uv__pipe_pool* p;
+  QUEUE* q;
+
+  conn = container_of(req, struct uv__pipe_conn, connect_req);
+  p = conn->p;
+  p->nconnecting--;
+
+  /* 连接池关闭时已经关掉了 */
+  if (conn->state == UV__CONN_CLOSING)
+    return;
+
+  if (status == 0) {
+    uv__pipe_conn_make_idle(conn, 0);
+    uv__pipe_pool_dispatch(p);
+    return;
+  }
+
+  uv__pipe_conn_close(conn);
+
+  /* 连不上的时候不重试，把错误交给排在最前面的请求，免得它一直等下去 */
+  if (!QUEUE_EMPTY(&p->waiting)) {
+    q = QUEUE_HEAD(&p->waiting);
+    QUEUE_REMOVE(q);
+    p->nwaiting--;
+    waiter = QUEUE_DATA(q, uv_pipe_pool_req_t, queue);
+    waiter->cb(waiter, status, NULL);
+  }
+}
+
+
+static int uv__pipe_pool_connect(struct uv__pipe_pool* p) {
+  struct uv__pipe_conn* conn;
+
+  conn = uv__malloc(sizeof(*conn));
+  if (conn == NULL)
+    return UV_ENOMEM;
+
+  uv_pipe_init(p->loop, &conn->pipe, 0);
+  conn->p = p;
+  conn->state = UV__CONN_CONNECTING;
+  QUEUE_INSERT_TAIL(&p->conns, &conn->member);
+  p->nconnecting++;
+  p->nhandles++;
+
+  uv_pipe_connect(&conn->connect_req,
+                  &conn->pipe,
+                  p->name,
+                  uv__pipe_conn_connect_cb);
+  return 0;
+}
+
+
+/* 已经连上和正在连的连接加起来，要够nwarm个空闲的再加上排队的请求 */
+static int uv__pipe_pool_refill(struct uv__pipe_pool* p) {
+  int err;
+
+  while (!p->closing && p->nidle + p->nconnecting < p->nwarm + p->nwaiting) {
+    err = uv__pipe_pool_connect(p);
+    if (err)
+      return err;
+  }
+
+  return 0;
+}
+
+
+static void uv__pipe_pool_dispatch_close_cb(uv_handle_t* handle) {
+  struct uv__pipe_pool* p;
+
+  p = container_of((uv_timer_t*) handle, struct uv__pipe_pool, dispatch);
+  p->nhandles--;
+  uv__pipe_pool_maybe_free(p);
+}
+
+
+static void uv__pipe_pool_stop(struct uv__pipe_pool* p) {
+  uv_pipe_pool_req_t* req;
+  struct uv__pipe_conn* conn;
+  QUEUE* q;
+
+  p->closing = 1;
+
+  while (!QUEUE_EMPTY(&p->waiting)) {
+    q = QUEUE_HEAD(&p->waiting);
+    QUEUE_REMOVE(q);
+    p->nwaiting--;
+    req = QUEUE_DATA(q, uv_pipe_pool_req_t, queue);
+    req->cb(req, UV_ECANCELED, NULL);
+  }
+
+  while (!QUEUE_EMPTY(&p->conns)) {
+    q = QUEUE_HEAD(&p->conns);
+    conn = QUEUE_DATA(q, struct uv__pipe_conn, member);
+
+    if (conn->state == UV__CONN_BUSY) {
+      /* 借出去的连接还回来时直接关掉 */
+      QUEUE_REMOVE(q);
+      conn->p = NULL;
+      p->nhandles--;
+    } else {
+      uv__pipe_conn_close(conn);
+    }
+  }
+
+  uv_close((uv_handle_t*) &p->dispatch, uv__pipe_pool_dispatch_close_cb);
+}
+
+
+int uv_pipe_pool_init(uv_loop_t* loop,
+                      uv_pipe_pool_t* pool,
+                      const char* name,
+                      unsigned int nwarm) {
+  struct uv__pipe_pool* p;
+  int err;
+
+  if (name == NULL)
+    return UV_EINVAL;
+
+  p = uv__calloc(1, sizeof(*p));
+  if (p == NULL)
+    return UV_ENOMEM;
+
+  p->name = uv__strdup(name);
+  if (p->name == NULL) {
+    uv__free(p);
+    return UV_ENOMEM;
+  }
+
+  p->pool = pool;
+  p->loop = loop;
+  p->nwarm = nwarm;
+  QUEUE_INIT(&p->conns);
+  QUEUE_INIT(&p->idle);
+  QUEUE_INIT(&p->waiting);
+  uv_timer_init(loop, &p->dispatch);
+  p->nhandles = 1;
+
+  pool->loop = loop;
+  pool->nwarm = nwarm;
+  pool->impl = p;
+
+  err = uv__pipe_pool_refill(p);
+  if (err) {
+    /* 已经初始化的handle在后台关闭 */
+    p->pool = NULL;
+    pool->impl = NULL;
+    uv__pipe_pool_stop(p);
+    return err;
+  }
+
+  return 0;
+}
+
+
+int uv_pipe_pool_acquire(uv_pipe_pool_t* pool,
+                         uv_pipe_pool_req_t* req,
+                         uv_pipe_pool_cb cb) {
+  struct uv__pipe_pool* p;
+  int err;
+
+  p = pool->impl;
+  if (p == NULL || p->closing || cb == NULL)
+    return UV_EINVAL;
+
+  req->pool = pool;
+  req->cb = cb;
+  QUEUE_INSERT_TAIL(&p->waiting, &req->queue);
+  p->nwaiting++;
+
+  if (p->nidle > 0)
+    uv_timer_start(&p->dispatch, uv__pipe_pool_dispatch_cb, 0, 0);
+
+  err = uv__pipe_pool_refill(p);
+  if (err && p->nidle + p->nconnecting < p->nwaiting) {
+    QUEUE_REMOVE(&req->queue);
+    p->nwaiting--;
+    return err;
+  }
+
+  return 0;
+}
+
+
+void uv_pipe_pool_release(uv_pipe_t* pipe, int reuse) {
+  struct uv__pipe_conn* conn;
+  struct uv__pipe_pool* p;
+
+  conn = container_of(pipe, struct uv__pipe_conn, pipe);
+  assert(conn->state == UV__CONN_BUSY);
+  p = conn->p;
+
+  if (p == NULL ||
+      !reuse ||
+      (p->nidle >= p->nwarm && QUEUE_EMPTY(&p->waiting))) {
+    uv__pipe_conn_close(conn);
+    if (p != NULL)
+      uv__pipe_pool_refill(p);
+    return;
+  }
+
+  /* 用的人可能还在读 */
+  uv_read_stop((uv_stream_t*) pipe);
+  uv__pipe_conn_make_idle(conn, 1);
+
+  if (!QUEUE_EMPTY(&p->waiting))
+    uv_timer_start(&p->dispatch, uv__pipe_pool_dispatch_cb, 0, 0);
+}
+
+
+void uv_pipe_pool_close(uv_pipe_pool_t* pool, uv_pipe_pool_close_cb close_cb) {
+  struct uv__pipe_pool* p;
+
+  p = pool->impl;
+  assert(p != NULL && !p->closing);
+
+  p->close_cb = close_cb;
+  uv__pipe_pool_stop(p);
+}
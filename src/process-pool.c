@@ -0,0 +1,608 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "uv-common.h"
+
+#include <assert.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef SIGTERM
+# define SIGTERM 15
+#endif
+
+/* job->flags */
+enum {
+  UV__JOB_WRITING = 1,  /* write_req还没有回调 */
+  UV__JOB_DONE = 2      /* 已经有结果（应答或者错误） */
+};
+
+enum {
+  UV__WORKER_DEAD = 0,
+  UV__WORKER_RUNNING,
+  UV__WORKER_STOPPING
+};
+
+struct uv__pool;
+
+struct uv__pool_worker {
+  struct uv__pool* p;
+  uv_process_t process;
+  uv_pipe_t pipe;
+  uv_process_job_t* job;
+  int state;
+  int exited;
+  unsigned int handles;  /* 这个子进程还没关闭的handle（进程和管道） */
+  unsigned int jobs_done;
+  /* 正在读的应答帧 */
+  unsigned char header[4];
+  unsigned int header_len;
+  char* result;
+  size_t result_len;
+  size_t result_read;
+  char rbuf[4096];
+};
+
+struct uv__pool {
+  uv_process_pool_t* pool;  /* 初始化失败后为NULL，handle都关完就释放 */
+  uv_loop_t* loop;
+  uv_process_options_t options;
+  uv_stdio_container_t stdio[3];
+  /* 不启动的定时器，只用来保证关闭时总有一个handle的回调可以等 */
+  uv_timer_t sentinel;
+  QUEUE pending;
+  unsigned int nworkers;
+  unsigned int nlive;
+  unsigned int nhandles;
+  int closing;
+  uv_process_pool_close_cb close_cb;
+  struct uv__pool_worker workers[1];  /* variable length */
+};
+
+static int uv__pool_worker_start(struct uv__pool_worker* w);
+static void uv__pool_worker_stop(struct uv__pool_worker* w, int status);
+static void uv__pool_dispatch(struct uv__pool_worker* w,
+                              uv_process_job_t* job);
+
+
+/* 空闲的子进程从队列里取下一个任务 */
+static void uv__pool_next(struct uv__pool_worker* w) {
+  QUEUE* q;
+
+  if (w->state != UV__WORKER_RUNNING || w->job != NULL || w->p->closing)
+    return;
+
+  if (QUEUE_EMPTY(&w->p->pending))
+    return;
+
+  q = QUEUE_HEAD(&w->p->pending);
+  QUEUE_REMOVE(q);
+  uv__pool_dispatch(w, QUEUE_DATA(q, uv_process_job_t, queue));
+}
+
+
+static void uv__pool_maybe_free(struct uv__pool* p) {
+  uv_process_pool_t* pool;
+
+  if (p->nhandles != 0)
+    return;
+
+  pool = p->pool;
+  if (pool != NULL)
+    pool->impl = NULL;
+
+  /* close_cb里可能释放pool，先把p释放掉 */
+  if (pool != NULL && p->close_cb != NULL) {
+    uv_process_pool_close_cb cb = p->close_cb;
+    uv__free(p);
+    cb(pool);
+    return;
+  }
+
+  uv__free(p);
+}
+
+
+static void uv__pool_job_complete(uv_process_job_t* job) {
+  struct uv__pool_worker* w;
+  uv_buf_t buf;
+  char* result;
+
+  w = job->worker;
+  job->worker = NULL;
+  if (w->job == job) {
+    w->job = NULL;
+    if (w->state == UV__WORKER_RUNNING) {
+      /* 空闲的子进程不让loop保持运行 */
+      uv_unref((uv_handle_t*) &w->pipe);
+      uv_unref((uv_handle_t*) &w->process);
+    }
+  }
+
+  result = job->result;
+  buf = uv_buf_init(result, (unsigned int) job->result_len);
+  job->result = NULL;
+  job->result_len = 0;
+  job->flags = 0;
+
+  job->cb(job, job->status, job->status == 0 ? &buf : NULL);
+  uv__free(result);
+
+  /* 回调里可能已经提交了新任务或者关闭了进程池 */
+  uv__pool_next(w);
+}
+
+
+static void uv__pool_job_finish(uv_process_job_t* job,
+                                int status,
+                                char* result,
+                                size_t result_len) {
+  job->status = status;
+  job->result = result;
+  job->result_len = result_len;
+  job->flags |= UV__JOB_DONE;
+
+  /* 应答可能比write_req的回调先到 */
+  if (!(job->flags & UV__JOB_WRITING))
+    uv__pool_job_complete(job);
+}
+
+
+static void uv__pool_write_cb(uv_write_t* req, int status) {
+  uv_process_job_t* job;
+
+  job = container_of(req, uv_process_job_t, write_req);
+  job->flags &= ~UV__JOB_WRITING;
+
+  /* 写失败时管道的读端会随后报错，在那里结束这个任务 */
+  if (job->flags & UV__JOB_DONE)
+    uv__pool_job_complete(job);
+}
+
+
+static void uv__pool_dispatch(struct uv__pool_worker* w,
+                              uv_process_job_t* job) {
+  int err;
+
+  w->job = job;
+  job->worker = w;
+  job->flags = UV__JOB_WRITING;
+  uv_ref((uv_handle_t*) &w->pipe);
+  uv_ref((uv_handle_t*) &w->process);
+
+  err = uv_write(&job->write_req,
+                 (uv_stream_t*) &w->pipe,
+                 job->bufs,
+                 job->nbufs + 1,
+                 uv__pool_write_cb);
+
+  /* uv_write()已经复制了buf数组 */
+  uv__free(job->bufs);
+  job->bufs = NULL;
+
+  if (err) {
+    job->flags &= ~UV__JOB_WRITING;
+    uv__pool_worker_stop(w, err);
+  }
+}
+
+
+static void uv__pool_fail_pending(struct uv__pool* p, int status) {
+  uv_process_job_t* job;
+  QUEUE* q;
+
+  while (!QUEUE_EMPTY(&p->pending)) {
+    q = QUEUE_HEAD(&p->pending);
+    QUEUE_REMOVE(q);
+    job = QUEUE_DATA(q, uv_process_job_t, queue);
+    uv__free(job->bufs);
+    job->bufs = NULL;
+    job->cb(job, status, NULL);
+  }
+}
+
+
+static void uv__pool_handle_close_cb(uv_handle_t* handle) {
+  struct uv__pool_worker* w;
+  struct uv__pool* p;
+  int respawn;
+
+  w = handle->data;
+  p = w->p;
+  p->nhandles--;
+
+  if (--w->handles != 0)
+    return;
+
+  respawn = w->jobs_done > 0;
+  w->state = UV__WORKER_DEAD;
+  p->nlive--;
+
+  if (!p->closing && respawn && uv__pool_worker_start(w) == 0) {
+    uv__pool_next(w);
+    return;
+  }
+
+  if (p->closing) {
+    uv__pool_maybe_free(p);
+    return;
+  }
+
+  if (p->nlive == 0)
+    uv__pool_fail_pending(p, UV_ESRCH);
+}
+
+
+static void uv__pool_sentinel_close_cb(uv_handle_t* handle) {
+  struct uv__pool* p;
+
+  p = container_of((uv_timer_t*) handle, struct uv__pool, sentinel);
+  p->nhandles--;
+  uv__pool_maybe_free(p);
+}
+
+
+static void uv__pool_worker_stop(struct uv__pool_worker* w, int status) {
+  uv_process_job_t* job;
+
+  if (w->state != UV__WORKER_RUNNING)
+    return;
+
+  w->state = UV__WORKER_STOPPING;
+  uv__free(w->result);
+  w->result = NULL;
+
+  /* 退出的时候要等到exit_cb才能关进程handle，不能让loop先返回 */
+  uv_ref((uv_handle_t*) &w->process);
+
+  uv_close((uv_handle_t*) &w->pipe, uv__pool_handle_close_cb);
+  if (!w->exited)
+    uv_process_kill(&w->process, SIGTERM);
+
+  job = w->job;
+  if (job != NULL)
+    uv__pool_job_finish(job, status, NULL, 0);
+}
+
+
+static void uv__pool_exit_cb(uv_process_t* process,
+                             int64_t exit_status,
+                             int term_signal) {
+  struct uv__pool_worker* w;
+
+  w = process->data;
+  w->exited = 1;
+  uv__pool_worker_stop(w, UV_EPIPE);
+  uv_close((uv_handle_t*) process, uv__pool_handle_close_cb);
+}
+
+
+static void uv__pool_alloc_cb(uv_handle_t* handle,
+                              size_t suggested_size,
+                              uv_buf_t* buf) {
+  struct uv__pool_worker* w;
+  size_t left;
+
+  w = handle->data;
+
+  /* 大的应答直接读进结果缓冲区，省一次复制 */
+  if (w->result != NULL) {
+    left = w->result_len - w->result_read;
+    if (left >= sizeof(w->rbuf)) {
+      *buf = uv_buf_init(w->result + w->result_read, (unsigned int) left);
+      return;
+    }
+  }
+
+  *buf = uv_buf_init(w->rbuf, sizeof(w->rbuf));
+}
+
+
+/* 应答读完了，返回1；数据不对时返回负的错误码 */
+static int uv__pool_parse(struct uv__pool_worker* w,
+                          const char* data,
+                          size_t len) {
+  size_t n;
+
+  while (len > 0) {
+    if (w->job == NULL || (w->job->flags & UV__JOB_DONE))
+      return UV_EPROTO;  /* 没有任务时不应该有数据 */
+
+    if (w->header_len < sizeof(w->header)) {
+      n = sizeof(w->header) - w->header_len;
+      if (n > len)
+        n = len;
+      memcpy(w->header + w->header_len, data, n);
+      w->header_len += n;
+      data += n;
+      len -= n;
+
+      if (w->header_len < sizeof(w->header))
+        return 0;
+
+      w->result_len = ((size_t) w->header[0] << 24) |
+                      ((size_t) w->header[1] << 16) |
+                      ((size_t) w->header[2] << 8) |
+                      (size_t) w->header[3];
+      w->result_read = 0;
+      w->result = uv__malloc(w->result_len + 1);
+      if (w->result == NULL)
+        return UV_ENOMEM;
+    }
+
+    n = w->result_len - w->result_read;
+    if (n > len)
+      n = len;
+    memcpy(w->result + w->result_read, data, n);
+    w->result_read += n;
+    data += n;
+    len -= n;
+
+    if (w->result_read == w->result_len) {
+      if (len > 0)
+        return UV_EPROTO;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+static void uv__pool_read_cb(uv_stream_t* stream,
+                             ssize_t nread,
+                             const uv_buf_t* buf) {
+  struct uv__pool_worker* w;
+  char* result;
+  size_t result_len;
+  int r;
+
+  w = stream->data;
+
+  if (nread < 0) {
+    uv__pool_worker_stop(w, UV_EPIPE);
+    return;
+  }
+
+  if (nread == 0)
+    return;
+
+  if (buf->base == w->rbuf) {
+    r = uv__pool_parse(w, buf->base, nread);
+  } else {
+    w->result_read += nread;
+    r = w->result_read == w->result_len;
+  }
+
+  if (r < 0) {
+    uv__pool_worker_stop(w, r);
+    return;
+  }
+
+  if (r == 0)
+    return;
+
+  result = w->result;
+  result_len = w->result_len;
+  w->result = NULL;
+  w->header_len = 0;
+  w->jobs_done++;
+  uv__pool_job_finish(w->job, 0, result, result_len);
+}
+
+
+static int uv__pool_worker_start(struct uv__pool_worker* w) {
+  struct uv__pool* p;
+  int err;
+
+  p = w->p;
+  memset(&w->process, 0, sizeof(w->process));
+  w->job = NULL;
+  w->exited = 0;
+  w->jobs_done = 0;
+  w->header_len = 0;
+  w->result = NULL;
+
+  err = uv_pipe_init(p->loop, &w->pipe, 1);
+  if (err)
+    return err;
+
+  w->pipe.data = w;
+  w->process.data = w;
+  w->handles = 1;
+  p->nhandles++;
+  p->nlive++;
+  w->state = UV__WORKER_STOPPING;
+
+  p->stdio[0].data.stream = (uv_stream_t*) &w->pipe;
+  err = uv_spawn(p->loop, &w->process, &p->options);
+
+  /* 失败时进程handle也可能已经初始化，同样要关闭 */
+  if (w->process.type == UV_PROCESS) {
+    w->handles++;
+    p->nhandles++;
+  }
+
+  if (err) {
+    uv_close((uv_handle_t*) &w->pipe, uv__pool_handle_close_cb);
+    if (w->process.type == UV_PROCESS)
+      uv_close((uv_handle_t*) &w->process, uv__pool_handle_close_cb);
+    return err;
+  }
+
+  w->process.data = w;
+  w->state = UV__WORKER_RUNNING;
+
+  err = uv_read_start((uv_stream_t*) &w->pipe,
+                      uv__pool_alloc_cb,
+                      uv__pool_read_cb);
+  if (err) {
+    uv__pool_worker_stop(w, err);
+    return 0;
+  }
+
+  uv_unref((uv_handle_t*) &w->pipe);
+  uv_unref((uv_handle_t*) &w->process);
+  return 0;
+}
+
+
+int uv_process_pool_init(uv_loop_t* loop,
+                         uv_process_pool_t* pool,
+                         const uv_process_options_t* options,
+                         unsigned int nworkers) {
+  struct uv__pool* p;
+  unsigned int i;
+  int err;
+
+  if (nworkers == 0 || options->file == NULL)
+    return UV_EINVAL;
+
+  p = uv__calloc(1, sizeof(*p) + (nworkers - 1) * sizeof(p->workers[0]));
+  if (p == NULL)
+    return UV_ENOMEM;
+
+  err = uv_timer_init(loop, &p->sentinel);
+  if (err) {
+    uv__free(p);
+    return err;
+  }
+
+  p->pool = pool;
+  p->loop = loop;
+  p->nworkers = nworkers;
+  p->nhandles = 1;
+  QUEUE_INIT(&p->pending);
+
+  p->stdio[0].flags = UV_CREATE_PIPE | UV_READABLE_PIPE | UV_WRITABLE_PIPE;
+  p->stdio[1].flags = UV_INHERIT_FD;
+  p->stdio[1].data.file = 1;
+  p->stdio[2].flags = UV_INHERIT_FD;
+  p->stdio[2].data.file = 2;
+
+  p->options = *options;
+  p->options.exit_cb = uv__pool_exit_cb;
+  p->options.exit_ex_cb = NULL;
+  p->options.stdio = p->stdio;
+  p->options.stdio_count = 3;
+
+  pool->loop = loop;
+  pool->nworkers = nworkers;
+  pool->impl = p;
+
+  for (i = 0; i < nworkers; i++) {
+    p->workers[i].p = p;
+    err = uv__pool_worker_start(&p->workers[i]);
+    if (err)
+      break;
+  }
+
+  if (err) {
+    /* 已经启动的子进程在后台关闭，关完了释放p */
+    p->pool = NULL;
+    pool->impl = NULL;
+    p->closing = 1;
+    for (i = 0; i < nworkers; i++)
+      uv__pool_worker_stop(&p->workers[i], UV_ECANCELED);
+    uv_close((uv_handle_t*) &p->sentinel, uv__pool_sentinel_close_cb);
+    return err;
+  }
+
+  return 0;
+}
+
+
+int uv_process_pool_submit(uv_process_pool_t* pool,
+                           uv_process_job_t* job,
+                           const uv_buf_t bufs[],
+                           unsigned int nbufs,
+                           uv_process_job_cb cb) {
+  struct uv__pool* p;
+  unsigned int i;
+  uint64_t len;
+
+  p = pool->impl;
+  if (p == NULL || p->closing || cb == NULL)
+    return UV_EINVAL;
+
+  if (p->nlive == 0)
+    return UV_ESRCH;
+
+  len = 0;
+  for (i = 0; i < nbufs; i++)
+    len += bufs[i].len;
+  if (len > UINT32_MAX)
+    return UV_E2BIG;
+
+  job->bufs = uv__malloc((nbufs + 1) * sizeof(job->bufs[0]));
+  if (job->bufs == NULL)
+    return UV_ENOMEM;
+
+  job->header[0] = (unsigned char) (len >> 24);
+  job->header[1] = (unsigned char) (len >> 16);
+  job->header[2] = (unsigned char) (len >> 8);
+  job->header[3] = (unsigned char) len;
+  job->bufs[0] = uv_buf_init((char*) job->header, sizeof(job->header));
+  if (nbufs > 0)
+    memcpy(job->bufs + 1, bufs, nbufs * sizeof(bufs[0]));
+
+  job->pool = pool;
+  job->cb = cb;
+  job->nbufs = nbufs;
+  job->worker = NULL;
+  job->flags = 0;
+  job->result = NULL;
+  job->result_len = 0;
+  job->status = 0;
+
+  for (i = 0; i < p->nworkers; i++) {
+    if (p->workers[i].state == UV__WORKER_RUNNING &&
+        p->workers[i].job == NULL) {
+      QUEUE_INIT(&job->queue);
+      uv__pool_dispatch(&p->workers[i], job);
+      return 0;
+    }
+  }
+
+  QUEUE_INSERT_TAIL(&p->pending, &job->queue);
+  return 0;
+}
+
+
+void uv_process_pool_close(uv_process_pool_t* pool,
+                           uv_process_pool_close_cb close_cb) {
+  struct uv__pool* p;
+  unsigned int i;
+
+  p = pool->impl;
+  assert(p != NULL && !p->closing);
+
+  p->closing = 1;
+  p->close_cb = close_cb;
+  uv__pool_fail_pending(p, UV_ECANCELED);
+
+  for (i = 0; i < p->nworkers; i++)
+    uv__pool_worker_stop(&p->workers[i], UV_ECANCELED);
+
+  uv_close((uv_handle_t*) &p->sentinel, uv__pool_sentinel_close_cb);
+}
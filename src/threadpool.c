@@ -23,342 +23,1791 @@
 
 #if !defined(_WIN32)
 # include "unix/internal.h"
+# include "unix/atomic-ops.h"
 #endif
 
+#include <limits.h>
 #include <stdlib.h>
 
 #define MAX_THREADPOOL_SIZE 128
+/* 分片队列的最大个数 */
+#define MAX_THREADPOOL_SHARDS 16
+
+/* 每个线程池有自己的锁、条件变量和工作队列，uv_threadpool_t里各个私有字段
+ * 的含义如下：
+ *   cond：没有任务时线程池的线程会在该条件变量上睡眠
+ *   mutex：线程池内部锁，保护线程数组、慢IO队列和睡眠/唤醒
+ *   idle_threads：当前空闲（睡眠）线程的数目
+ *   shards：普通任务的队列被分成nshards片，每片有自己的锁。没有类别的任务
+ *           按next_shard轮流放进各片，同一个loop提交的任务也分散在各片上；
+ *           每个线程先取自己那一片，空了再去别的片上偷，这样提交和取任务
+ *           大多数时候只用到一片的锁，不会全部挤在一把锁上
+ *   next_shard：下一批没有类别的任务放进哪一片，用原子操作修改
+ *   nqueued：所有分片里任务的总数，用原子操作修改
+ *   classes：按优先级排好序的任务类别，由mutex保护。HIGH和LOW档的任务
+ *            放在类别自己的队列里；NORMAL档的任务（慢IO型任务属于内置的
+ *            slow_io类别）和普通任务一样放进分片，线程取到它时如果类别里
+ *            执行中的任务已经达到上限，就先放到类别的队列里，等该类别有
+ *            任务执行完再取出来
+ *   nclassed：所有类别的队列里任务的总数，在mutex下修改，可以不加锁读
+ *   spin_time：没有任务时线程先自旋多久（纳秒）再睡眠，nspinning是正在
+ *              自旋的线程个数，不超过max_spinners，都用原子操作读写
+ *   histograms：打开统计之后是按种类分的排队耗时和执行耗时两组直方图，
+ *               由stats_mutex保护，没打开时为NULL
+ *   workers：每个线程的struct uv__worker，由mutex保护。nquarantined是执行
+ *            超时的任务时被隔离出去、还没有返回的线程个数
+ *   nstarting：已经创建、还没有跑到工作循环的线程个数，由mutex保护
+ * 没有绑定线程池的loop和请求都用default_pool，它在第一次提交任务时才创建，
+ * 线程个数的上限由UV_THREADPOOL_SIZE决定，线程是任务积压时才一个个创建的。
+ */
+struct uv__threadpool_shard {
+  uv_mutex_t mutex;
+  QUEUE wq;
+  /* 不加锁读，只用来跳过空的分片 */
+  unsigned int count;
+};
+
+static uv_once_t once = UV_ONCE_INIT;/* pthread_once_t */
+static uv_threadpool_t default_pool;
+static uv_thread_t default_threads[4];/* 默认四个线程的线程池 */
+
+#define uv__pool_classes(pool) ((QUEUE*) &(pool)->classes)
+#define uv__class_pending_wq(cls) ((QUEUE*) &(cls)->pending_wq)
+
+/* 慢任务的数目不成超过线程池线程数的一般。线程是按需创建的，还没创建
+ * 出来的也算上
+ */
+static unsigned int slow_work_thread_threshold(const uv_threadpool_t* pool) {
+  if (pool->nthreads < pool->min_threads)
+    return (pool->min_threads + 1) / 2;
+  return (pool->nthreads + 1) / 2;
+}
+
+
+/* 类别里同时执行的任务的上限 */
+static unsigned int work_class_limit(const uv_threadpool_t* pool,
+                                     const uv_work_class_t* cls) {
+  if (cls == &pool->slow_io)
+    return slow_work_thread_threshold(pool);
+  if (cls->max_running == 0)
+    return UINT_MAX;
+  return cls->max_running;
+}
+
+
+
+static void uv__cancelled(struct uv__work* w) {
+  abort();
+}
+
+/* 过了截止时间没有执行的任务，和uv__cancelled一样只是个标志 */
+static void uv__timedout(struct uv__work* w) {
+  abort();
+}
+
+/* 每个线程在自己的栈上放一个，挂在pool->workers上，由mutex保护。只有执行
+ * 带超时的任务时才设置current，loop线程据此找到卡住的线程。被隔离的线程
+ * 已经不在threads数组和workers上，返回之后看到quarantined就直接退出
+ */
+struct uv__worker {
+  void* member[2];
+  uv_thread_t tid;
+  struct uv__work* current;
+  int quarantined;
+};
+
+/* uv_loop_set_work_timeout()的状态，只在loop线程上访问 */
+struct uv__work_timeouts {
+  uv_timer_t timer;
+  /* 还没有结束的带超时的任务，按超时时间从早到晚排 */
+  QUEUE wq;
+  /* 之后提交的任务的超时（纳秒），0表示不带超时 */
+  uint64_t timeout;
+};
+
+static int threadpool_spawn(uv_threadpool_t* pool);
+static void threadpool_stop(uv_threadpool_t* pool);
+
+
+/* 原子地给*ptr加上delta，返回原来的值。CAS同时是一个完整的内存屏障 */
+static unsigned int threadpool_add(unsigned int* ptr, int delta) {
+  unsigned int val;
+
+  do
+    val = *(volatile unsigned int*) ptr;
+  while ((unsigned int) cmpxchgi((int*) ptr,
+                                 (int) val,
+                                 (int) (val + delta)) != val);
+
+  return val;
+}
+
+
+/* 从第i片开始依次在n个分片里找一个任务，找不到返回NULL。取出来的节点会被
+ * QUEUE_INIT，uv_cancel()据此知道它已经在执行了
+ */
+static QUEUE* threadpool_take(uv_threadpool_t* pool,
+                              unsigned int i,
+                              unsigned int n) {
+  struct uv__threadpool_shard* shards;
+  struct uv__threadpool_shard* shard;
+  QUEUE* q;
+
+  shards = pool->shards;
+  for (; n > 0; n--, i++) {
+    shard = shards + i % pool->nshards;
+    if (ACCESS_ONCE(unsigned int, shard->count) == 0)
+      continue;
+
+    uv_mutex_lock(&shard->mutex);
+    if (QUEUE_EMPTY(&shard->wq)) {
+      uv_mutex_unlock(&shard->mutex);
+      continue;
+    }
+
+    q = QUEUE_HEAD(&shard->wq);
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);  /* Signal uv_cancel() that the work req is executing. */
+    shard->count--;
+    uv_mutex_unlock(&shard->mutex);
+
+    threadpool_add(&pool->nqueued, -1);
+    return q;
+  }
+
+  return NULL;
+}
+
+
+/* 按截止时间排队：返回wq里第一个截止时间比deadline晚或者没有截止时间的
+ * 任务，新任务插在它前面，截止时间相同的还是按提交的顺序。没有截止时间的
+ * 任务直接返回队头，也就是插到队尾，不用遍历
+ */
+static QUEUE* threadpool_deadline_pos(QUEUE* wq, uint64_t deadline) {
+  struct uv__work* w;
+  QUEUE* q;
+
+  if (deadline == 0)
+    return wq;
+
+  QUEUE_FOREACH(q, wq) {
+    w = QUEUE_DATA(q, struct uv__work, wq);
+    if (w->deadline == 0 || w->deadline > deadline)
+      return q;
+  }
+
+  return wq;
+}
+
+
+/* 线程的个数可以在运行时调整。threads[0, nthreads)是还在工作的线程，
+ * threads[nthreads, nslots)是已经退出、还没有被join的线程。线程个数超过
+ * max_threads时多出来的线程做完手上的任务就退出；设置了idle_timeout时，空闲
+ * 超过这么久的线程在个数多于min_threads时也会退出。以下函数都要持有
+ * pool->mutex。
+ */
+static void threadpool_reap(uv_threadpool_t* pool) {
+  while (pool->nslots > pool->nthreads)
+    if (uv_thread_join(pool->threads + --pool->nslots))
+      abort();
+}
+
+
+/* 当前线程在threads数组里的下标 */
+static unsigned int threadpool_self(uv_threadpool_t* pool) {
+  uv_thread_t self;
+  unsigned int i;
+
+  self = uv_thread_self();
+  for (i = 0; i < pool->nthreads; i++)
+    if (uv_thread_equal(pool->threads + i, &self))
+      break;
+
+  assert(i < pool->nthreads);
+  return i;
+}
+
+
+/* 当前线程退出前把自己换到threads[nthreads]上 */
+static void threadpool_retire(uv_threadpool_t* pool) {
+  uv_thread_t tmp;
+  unsigned int i;
+
+  i = threadpool_self(pool);
+  pool->nthreads--;
+  tmp = pool->threads[i];
+  pool->threads[i] = pool->threads[pool->nthreads];
+  pool->threads[pool->nthreads] = tmp;
+}
+
+
+/* 弹性模式下，队列持续非空超过spawn_after并且没有空闲线程时加一个线程，
+ * 之后重新计时，所以每个spawn_after最多加一个
+ */
+static void threadpool_maybe_grow(uv_threadpool_t* pool) {
+  uint64_t now;
+
+  if (pool->spawn_after == 0 ||
+      pool->idle_threads != 0 ||
+      pool->nthreads >= pool->max_threads ||
+      (ACCESS_ONCE(unsigned int, pool->nqueued) == 0 &&
+       pool->nclassed == 0))
+    return;
+
+  now = uv_hrtime();
+  if (now - pool->wq_busy_since < pool->spawn_after)
+    return;
+
+  pool->wq_busy_since = now;
+  threadpool_spawn(pool);
+}
+
+
+/* 提交任务之后调用。弹性模式之外线程是按需创建的：排队的任务比空闲的、
+ * 正在自旋的和刚创建还没跑起来的线程加起来还多时补上差额，最多到
+ * max_threads，不等新线程跑起来。被叫醒的线程在真正醒来之前还算在
+ * idle_threads里，所以按排队的总数算，不按这一次提交的个数算。
+ * 一个线程都没有还创建失败的话任务永远不会执行，只能abort。要持有mutex
+ */
+static void threadpool_grow(uv_threadpool_t* pool) {
+  unsigned int backlog;
+
+  if (pool->spawn_after != 0) {
+    threadpool_maybe_grow(pool);
+    return;
+  }
+
+  backlog = ACCESS_ONCE(unsigned int, pool->nqueued) + pool->nclassed;
+  while (backlog > pool->idle_threads +
+                   pool->nstarting +
+                   ACCESS_ONCE(unsigned int, pool->nspinning) &&
+         pool->nthreads < pool->max_threads &&
+         !pool->stopping) {
+    if (threadpool_spawn(pool)) {
+      if (pool->nthreads == 0)
+        abort();
+      break;
+    }
+  }
+}
+
+
+/* 在优先级[lo, hi]之间的类别里找第一个有任务等待并且没有达到上限的，
+ * 要持有mutex
+ */
+static uv_work_class_t* threadpool_ready_class(uv_threadpool_t* pool,
+                                               int lo,
+                                               int hi) {
+  uv_work_class_t* cls;
+  QUEUE* q;
+
+  QUEUE_FOREACH(q, uv__pool_classes(pool)) {
+    cls = QUEUE_DATA(q, uv_work_class_t, class_queue);
+    if (cls->priority < lo)
+      continue;
+    if (cls->priority > hi)
+      break;
+    if (!QUEUE_EMPTY(uv__class_pending_wq(cls)) &&
+        cls->running < work_class_limit(pool, cls))
+      return cls;
+  }
+
+  return NULL;
+}
+
+
+/* 从优先级[lo, hi]之间的类别队列里取一个任务。类别的队列都为空时不碰mutex */
+static QUEUE* threadpool_take_class(uv_threadpool_t* pool, int lo, int hi) {
+  uv_work_class_t* cls;
+  QUEUE* q;
+
+  if (ACCESS_ONCE(unsigned int, pool->nclassed) == 0)
+    return NULL;
+
+  q = NULL;
+  uv_mutex_lock(&pool->mutex);
+  cls = threadpool_ready_class(pool, lo, hi);
+  if (cls != NULL) {
+    q = QUEUE_HEAD(uv__class_pending_wq(cls));
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);  /* Signal uv_cancel() that the work req is executing. */
+    cls->running++;
+    pool->nclassed--;
+
+    /* 还有能执行的任务就再叫醒一个线程 */
+    if (pool->idle_threads > 0 &&
+        threadpool_ready_class(pool, INT_MIN, INT_MAX) != NULL)
+      uv_cond_signal(&pool->cond);
+  }
+  uv_mutex_unlock(&pool->mutex);
+
+  return q;
+}
+
+
+/* 从分片里取到一个有类别的任务，类别里执行中的任务没有达到上限时返回1，
+ * 否则把它放到类别的队列里返回0
+ */
+static int threadpool_start_class(uv_threadpool_t* pool,
+                                  uv_work_class_t* cls,
+                                  QUEUE* q) {
+  QUEUE* pos;
+  int start;
+
+  uv_mutex_lock(&pool->mutex);
+  start = cls->running < work_class_limit(pool, cls);
+  if (start) {
+    cls->running++;
+  } else {
+    /* QUEUE_INSERT_TAIL会多次求值第一个参数 */
+    pos = threadpool_deadline_pos(uv__class_pending_wq(cls),
+                                  QUEUE_DATA(q, struct uv__work, wq)->deadline);
+    QUEUE_INSERT_TAIL(pos, q);
+    pool->nclassed++;
+  }
+  uv_mutex_unlock(&pool->mutex);
+
+  return start;
+}
+
+
+/* 执行完的和被取消的任务都压到loop->wq_done这个无锁栈上，由uv__work_done()
+ * 一次全部取走。多个线程可以同时压栈，都不用等loop线程
+ */
+static void uv__work_push_done(uv_loop_t* loop, struct uv__work* w) {
+  void* head;
+
+  do {
+    head = *(void* volatile*) &loop->wq_done;
+    w->done_next = head;
+  } while ((void*) cmpxchgl((long*) &loop->wq_done,
+                            (long) head,
+                            (long) w) != head);
+}
+
+
+/* 没有任务的时候先自旋等一会儿，等到了任务返回1。*budget是这个线程本次最多
+ * 自旋的时间，等到了就加倍，没等到就减半，但不少于spin_time的1/16，这样
+ * 突发的任务来得密集时多等一些，长时间没有任务时很快就去睡眠
+ */
+static int threadpool_spin(uv_threadpool_t* pool, uint64_t* budget) {
+  uint64_t spin_time;
+  uint64_t deadline;
+  unsigned int i;
+  int found;
+
+  spin_time = ACCESS_ONCE(uint64_t, pool->spin_time);
+  if (spin_time == 0)
+    return 0;
+
+  if (threadpool_add(&pool->nspinning, 1) >= pool->max_spinners) {
+    threadpool_add(&pool->nspinning, -1);
+    return 0;
+  }
+
+  if (*budget == 0 || *budget > spin_time)
+    *budget = spin_time;
+
+  found = 0;
+  deadline = uv_hrtime() + *budget;
+  for (i = 1; !found; i++) {
+    found = ACCESS_ONCE(unsigned int, pool->nqueued) != 0 ||
+            ACCESS_ONCE(unsigned int, pool->nclassed) != 0;
+    /* 要退出的线程直接去睡眠的地方退出 */
+    if (ACCESS_ONCE(int, pool->stopping) ||
+        ACCESS_ONCE(unsigned int, pool->nthreads) > pool->max_threads)
+      break;
+    /* 读时钟比检查队列贵得多，隔一段检查一次 */
+    if (!found && i % 64 == 0 && uv_hrtime() >= deadline)
+      break;
+    cpu_relax();
+  }
+
+  threadpool_add(&pool->nspinning, -1);
+
+  if (found) {
+    *budget *= 2;
+    if (*budget > spin_time)
+      *budget = spin_time;
+  } else {
+    *budget /= 2;
+    if (*budget < spin_time / 16)
+      *budget = spin_time / 16;
+  }
+
+  return found;
+}
+
+
+/* 记下任务的执行时长，统计还打开着的话加到直方图里 */
+static void threadpool_record(uv_threadpool_t* pool,
+                              struct uv__work* w,
+                              uint64_t run_time) {
+  uv_phase_histogram_t* hist;
+
+  w->run_time = run_time;
+
+  uv_mutex_lock(&pool->stats_mutex);
+  hist = pool->histograms;
+  if (hist != NULL) {
+    uv__histogram_add(hist + w->kind, w->wait_time);
+    uv__histogram_add(hist + UV_WORK_KIND_MAX + w->kind, run_time);
+  }
+  uv_mutex_unlock(&pool->stats_mutex);
+}
+
+
+/* To avoid deadlock with uv_cancel() it's crucial that the worker
+ * never holds the global mutex and the loop-local mutex at the same time.
+ * 
+ * 线程池（每个线程）的工作函数
+ */
+static void worker(void* arg) {
+  struct uv__worker self;
+  uv_threadpool_t* pool;
+  uv_work_class_t* cls;
+  struct uv__work* w;
+  unsigned int home;
+  uv_loop_t* loop;
+  uint64_t budget;
+  uint64_t start;
+  QUEUE* q;
+  int timed_out;
+  int expired;
+  int timed;
+
+  pool = arg;
+  budget = 0;
+  self.tid = uv_thread_self();
+  self.current = NULL;
+  self.quarantined = 0;
+
+  /* 创建线程的一方不等线程跑起来，它持有mutex创建线程并记到threads里，
+   * 所以拿到mutex之后可以找到自己的下标，也可以把自己挂到workers上
+   */
+  uv_mutex_lock(&pool->mutex);
+  home = threadpool_self(pool);
+  QUEUE_INSERT_TAIL((QUEUE*) &pool->workers, (QUEUE*) &self.member);
+  pool->nstarting--;
+  uv_mutex_unlock(&pool->mutex);
+  arg = NULL;
+
+  /* 线程进入工作循环 */
+  for (;;) {
+    /* 先取HIGH档和之前被上限挡住的NORMAL档类别里的任务，再取自己那一片，
+     * 然后去别的片上偷，最后才是LOW档的类别。每一片都从头上取，所以同一片
+     * 里的任务按提交的顺序开始执行
+     */
+    q = threadpool_take_class(pool, INT_MIN, UV_WORK_PRIORITY_NORMAL);
+
+    if (q == NULL) {
+      q = threadpool_take(pool, home, pool->nshards);
+
+      if (q != NULL) {
+        cls = QUEUE_DATA(q, struct uv__work, wq)->cls;
+        if (cls != NULL && !threadpool_start_class(pool, cls, q))
+          continue;
+      }
+    }
+
+    if (q == NULL)
+      q = threadpool_take_class(pool, UV_WORK_PRIORITY_LOW, INT_MAX);
+
+    /* 睡眠之前先自旋一会儿，自旋的线程不算空闲，post()不会去唤醒它 */
+    if (q == NULL && threadpool_spin(pool, &budget))
+      continue;
+
+    if (q == NULL) {
+      uv_mutex_lock(&pool->mutex);
+
+      /* 线程池被缩小了或者要销毁了 */
+      if (pool->nthreads > pool->max_threads || pool->stopping)
+        break;
+
+      /* idle_threads加1之后再检查一次有没有任务，和post()里先放任务再看
+       * idle_threads配对，两边都是完整的内存屏障，所以不会丢失唤醒
+       */
+      threadpool_add(&pool->idle_threads, 1);
+      timed_out = 0;
+      if (ACCESS_ONCE(unsigned int, pool->nqueued) == 0 &&
+          threadpool_ready_class(pool, INT_MIN, INT_MAX) == NULL) {
+        /* 等待条件变量，线程个数多于min_threads时最多等idle_timeout */
+        if (pool->idle_timeout != 0 && pool->nthreads > pool->min_threads)
+          timed_out = uv_cond_timedwait(&pool->cond,
+                                        &pool->mutex,
+                                        pool->idle_timeout) == UV_ETIMEDOUT;
+        else
+          uv_cond_wait(&pool->cond, &pool->mutex);
+      }
+      /* 被唤醒之后，说明有任务被post到队列，因此空闲线程数需要减1 */
+      threadpool_add(&pool->idle_threads, -1);
+
+      /* 空闲太久的线程退出 */
+      if (timed_out &&
+          pool->nthreads > pool->min_threads &&
+          ACCESS_ONCE(unsigned int, pool->nqueued) == 0 &&
+          pool->nclassed == 0)
+        break;
+
+      uv_mutex_unlock(&pool->mutex);
+      continue;
+    }
+
+    /* 还原uv__work */
+    w = QUEUE_DATA(q, struct uv__work, wq);
+    cls = w->cls;
+    /* 打开了统计的话，提交时记下的时间换成排队的时长 */
+    start = 0;
+    if (w->wait_time != 0 || w->deadline != 0)
+      start = uv_hrtime();
+    /* 已经过了截止时间的不执行，和取消的任务一样排队和执行的时间都算作0 */
+    expired = w->deadline != 0 && start >= w->deadline;
+    if (expired) {
+      w->wait_time = 0;
+    } else {
+      if (w->wait_time != 0)
+        w->wait_time = start - w->wait_time;
+      else
+        start = 0;
+      /* 带超时的任务要让loop线程知道是哪个线程在执行 */
+      timed = w->timeout != 0;
+      if (timed) {
+        uv_mutex_lock(&pool->mutex);
+        self.current = w;
+        uv_mutex_unlock(&pool->mutex);
+      }
+      /* 执行这个task */
+      UV__PROBE2(work__start, pool, w);
+      w->work(w);
+      UV__PROBE2(work__end, pool, w);
+      /* 超时被隔离了的话，w已经交给loop结束了，随时可能被释放，类别的计数
+       * 也已经减过，什么都不要碰，直接退出
+       */
+      if (timed) {
+        uv_mutex_lock(&pool->mutex);
+        if (self.quarantined) {
+          pool->nquarantined--;
+          uv_mutex_unlock(&pool->mutex);
+          return;
+        }
+        self.current = NULL;
+        uv_mutex_unlock(&pool->mutex);
+      }
+      if (start != 0)
+        threadpool_record(pool, w, uv_hrtime() - start);
+    }
+
+    if (cls != NULL) {
+      /* 类别里执行中的任务个数要减一，被上限挡住的任务现在可以执行了，下一轮
+       * 循环由这个线程自己去取。要在通知loop之前做，done回调里就可以销毁
+       * 这个类别
+       */
+      uv_mutex_lock(&pool->mutex);
+      cls->running--;
+      uv_mutex_unlock(&pool->mutex);
+    }
+
+    /* 执行完的work会被设置为NULL,在uv_cancel中会使用这个标识  */
+    w->work = NULL;  /* Signal uv_cancel() that the work req is done
+                        executing. */
+    if (expired)
+      w->work = uv__timedout;
+    /* 将该已经执行完的task压到loop->wq_done上，并向loop发送异步通知。
+     * 压栈之后w随时可能被释放，所以先取出loop
+     */
+    loop = w->loop;
+    threadpool_add(&loop->wq_senders, 1);
+    uv__work_push_done(loop, w);
+    uv_async_send(&loop->wq_async);
+    threadpool_add(&loop->wq_senders, -1);
+
+    /* 线程池被缩小了，做完手上的任务就退出；弹性模式下看看上一个任务执行
+     * 的时候队列是不是一直在积压
+     */
+    if (ACCESS_ONCE(unsigned int, pool->nthreads) > pool->max_threads ||
+        pool->spawn_after != 0) {
+      uv_mutex_lock(&pool->mutex);
+      if (pool->nthreads > pool->max_threads)
+        break;
+      threadpool_maybe_grow(pool);
+      uv_mutex_unlock(&pool->mutex);
+    }
+  }
+
+  /* 退出时持有mutex。销毁时所有线程都会被join，不用换位置 */
+  QUEUE_REMOVE((QUEUE*) &self.member);
+  if (!pool->stopping)
+    threadpool_retire(pool);
+  /* 给条件变量发信号，让其他线程也看到stopping */
+  uv_cond_signal(&pool->cond);
+  uv_mutex_unlock(&pool->mutex);
+}
+
+/* 叫醒最多n个空闲线程，要持有mutex */
+static void threadpool_wake(uv_threadpool_t* pool, unsigned int n) {
+  if (n >= pool->idle_threads)
+    uv_cond_broadcast(&pool->cond);
+  else
+    while (n-- > 0)
+      uv_cond_signal(&pool->cond);
+}
+
+
+/* 将wq里的n个uv__work提交到工作队列，它们属于同一个loop和同一个类别。
+ * HIGH和LOW档类别的任务放到类别的队列里，其他的放进某一个分片
+ */
+static void post(uv_threadpool_t* pool, QUEUE* wq, unsigned int n) {
+  struct uv__threadpool_shard* shard;
+  uv_work_class_t* cls;
+  unsigned int limit;
+  unsigned int i;
+  uint64_t deadline;
+  QUEUE* pos;
+
+  cls = QUEUE_DATA(QUEUE_HEAD(wq), struct uv__work, wq)->cls;
+  /* 一起提交的任务截止时间都一样 */
+  deadline = QUEUE_DATA(QUEUE_HEAD(wq), struct uv__work, wq)->deadline;
+
+  if (cls != NULL && cls->priority != UV_WORK_PRIORITY_NORMAL) {
+    uv_mutex_lock(&pool->mutex);
+    if (pool->spawn_after != 0 &&
+        ACCESS_ONCE(unsigned int, pool->nqueued) == 0 &&
+        pool->nclassed == 0)
+      pool->wq_busy_since = uv_hrtime();
+    pos = threadpool_deadline_pos(uv__class_pending_wq(cls), deadline);
+    QUEUE_ADD(pos, wq);
+    pool->nclassed += n;
+    /* 没有超过上限就叫醒线程，最多叫醒上限允许的个数，不够的再创建 */
+    limit = work_class_limit(pool, cls);
+    limit = cls->running < limit ? limit - cls->running : 0;
+    if (n < limit)
+      limit = n;
+    if (pool->idle_threads > 0 && limit > 0)
+      threadpool_wake(pool, limit);
+    /* 被上限挡住的任务不用加线程 */
+    if (limit > 0)
+      threadpool_grow(pool);
+    else if (pool->idle_threads == 0)
+      threadpool_maybe_grow(pool);
+    uv_mutex_unlock(&pool->mutex);
+    return;
+  }
+
+  /* 没有类别的任务一批一批轮流放进各片，一个loop提交的任务也会分散到各片
+   * 的锁上，由各个线程分头取走，不同片上的任务不保证先后。有类别的任务
+   * 按类别固定放进一片，线程只从各片的头上取，同一类别的任务还是按提交的
+   * 顺序开始执行
+   */
+  if (cls != NULL)
+    i = ((unsigned int) ((uintptr_t) cls >> 4) * 2654435761u) >> 28;
+  else
+    i = threadpool_add(&pool->next_shard, 1);
+  shard = (struct uv__threadpool_shard*) pool->shards + i % pool->nshards;
+  uv_mutex_lock(&shard->mutex);
+  pos = threadpool_deadline_pos(&shard->wq, deadline);
+  QUEUE_ADD(pos, wq);
+  shard->count += n;
+  uv_mutex_unlock(&shard->mutex);
+
+  /* 弹性模式下记下队列从什么时候开始积压 */
+  if (threadpool_add(&pool->nqueued, n) == 0 && pool->spawn_after != 0)
+    pool->wq_busy_since = uv_hrtime();
+
+  /* 如果有空闲线程就叫醒n个，不够的话看看要不要加线程。
+   * 线程都在忙并且已经到了上限的时候不用碰mutex
+   */
+  if (ACCESS_ONCE(unsigned int, pool->idle_threads) > 0 ||
+      ACCESS_ONCE(unsigned int, pool->nthreads) < pool->max_threads ||
+      pool->spawn_after != 0) {
+    uv_mutex_lock(&pool->mutex);
+    if (pool->idle_threads > 0)
+      threadpool_wake(pool, n);
+    threadpool_grow(pool);
+    uv_mutex_unlock(&pool->mutex);
+  }
+}
+
+
+/* 再创建一个线程，线程数组不够时扩大一倍。不等新线程跑起来，它拿到
+ * mutex之前算在nstarting里。要持有mutex
+ */
+static int threadpool_spawn(uv_threadpool_t* pool) {
+  uv_thread_options_t options;
+  uv_thread_t* threads;
+  unsigned int size;
+  int err;
+
+  threadpool_reap(pool);
+
+  if (pool->nslots == pool->threads_size) {
+    size = pool->threads_size * 2;
+    if (size < ARRAY_SIZE(default_threads))
+      size = ARRAY_SIZE(default_threads);
+    if (size > MAX_THREADPOOL_SIZE)
+      size = MAX_THREADPOOL_SIZE;
+    if (size == pool->threads_size)
+      return UV_EINVAL;
+
+    /* default_threads是静态数组，不能realloc */
+    if (pool->threads == default_threads) {
+      threads = uv__malloc(size * sizeof(threads[0]));
+      if (threads != NULL)
+        memcpy(threads, default_threads, sizeof(default_threads));
+    } else {
+      threads = uv__realloc(pool->threads, size * sizeof(threads[0]));
+    }
+
+    if (threads == NULL)
+      return UV_ENOMEM;
+
+    pool->threads = threads;
+    pool->threads_size = size;
+  }
+
+  /* 设置了亲和性时，第i个线程用第i % ncpumasks个掩码 */
+  options.flags = UV_THREAD_NO_FLAGS;
+  if (pool->cpumasks != NULL) {
+    options.flags |= UV_THREAD_HAS_CPUMASK;
+    options.cpumask = pool->cpumasks +
+                      pool->nslots % pool->ncpumasks * pool->cpumask_size;
+    options.cpumask_size = pool->cpumask_size;
+  }
+
+  err = uv_thread_create_ex(pool->threads + pool->nslots,
+                            &options,
+                            worker,
+                            pool);
+  if (err == 0) {
+    pool->nslots++;
+    pool->nthreads++;
+    pool->nstarting++;
+  }
+
+  return err;
+}
+
+
+/* 初始化锁、条件变量和队列，线程个数的上限是size，先创建nstart个线程，
+ * 其余的按需创建。threads和threads_size已经设置好。分片的个数按size定，
+ * 之后不再改变
+ */
+static int threadpool_start(uv_threadpool_t* pool,
+                            unsigned int size,
+                            unsigned int nstart) {
+  struct uv__threadpool_shard* shards;
+  unsigned int nshards;
+  unsigned int i;
+  int err;
+
+  nshards = size;
+  if (nshards > MAX_THREADPOOL_SHARDS)
+    nshards = MAX_THREADPOOL_SHARDS;
+
+  shards = uv__malloc(nshards * sizeof(*shards));
+  if (shards == NULL)
+    return UV_ENOMEM;
+
+  for (i = 0; i < nshards; i++) {
+    err = uv_mutex_init(&shards[i].mutex);
+    if (err)
+      goto fail_shards;
+    QUEUE_INIT(&shards[i].wq);
+    shards[i].count = 0;
+  }
+
+  /* 条件变量初始化 */
+  err = uv_cond_init(&pool->cond);
+  if (err)
+    goto fail_shards;
+
+  /* 互斥锁初始化 */
+  err = uv_mutex_init(&pool->mutex);
+  if (err) {
+    uv_cond_destroy(&pool->cond);
+    goto fail_shards;
+  }
+
+  err = uv_mutex_init(&pool->stats_mutex);
+  if (err) {
+    uv_mutex_destroy(&pool->mutex);
+    uv_cond_destroy(&pool->cond);
+    goto fail_shards;
+  }
+
+  pool->shards = shards;
+  pool->nshards = nshards;
+  pool->next_shard = 0;
+  pool->nqueued = 0;
+  pool->stopping = 0;
+  pool->nthreads = 0;
+  pool->nslots = 0;
+  pool->min_threads = size;
+  pool->max_threads = size;
+  pool->spawn_after = 0;
+  pool->idle_timeout = 0;
+  pool->wq_busy_since = 0;
+  pool->idle_threads = 0;
+  pool->nstarting = 0;
+  pool->nloops = 0;
+  pool->histograms = NULL;
+  pool->spin_time = 0;
+  pool->max_spinners = 0;
+  pool->nspinning = 0;
+  QUEUE_INIT((QUEUE*) &pool->workers);
+  pool->nquarantined = 0;
+  /* 初始化慢IO型task工作队列 */
+  pool->nclassed = 0;
+  /* 初始化类别链表和内置的慢IO类别 */
+  QUEUE_INIT(uv__pool_classes(pool));
+  pool->slow_io.data = NULL;
+  pool->slow_io.pool = pool;
+  pool->slow_io.priority = UV_WORK_PRIORITY_NORMAL;
+  pool->slow_io.max_running = 0;
+  pool->slow_io.running = 0;
+  QUEUE_INIT(uv__class_pending_wq(&pool->slow_io));
+  QUEUE_INSERT_TAIL(uv__pool_classes(pool),
+                    (QUEUE*) &pool->slow_io.class_queue);
+
+  /* 创建线程，每个线程都传入线程池这个参数 */
+  uv_mutex_lock(&pool->mutex);
+  while (err == 0 && pool->nthreads < nstart)
+    err = threadpool_spawn(pool);
+  uv_mutex_unlock(&pool->mutex);
+
+  if (err == 0)
+    return 0;
+
+  threadpool_stop(pool);
+  return err;
+
+fail_shards:
+  while (i-- > 0)
+    uv_mutex_destroy(&shards[i].mutex);
+  uv__free(shards);
+  return err;
+}
+
+
+/* 让线程池的线程全部退出，销毁锁、条件变量和分片 */
+static void threadpool_stop(uv_threadpool_t* pool) {
+  struct uv__threadpool_shard* shards;
+  unsigned int i;
+
+  /* 不再加线程，叫醒所有线程让它们退出 */
+  uv_mutex_lock(&pool->mutex);
+  pool->spawn_after = 0;
+  pool->stopping = 1;
+  uv_cond_broadcast(&pool->cond);
+  uv_mutex_unlock(&pool->mutex);
+
+  /* 等待线程池的线程全部退出，包括已经退出还没有join的 http://man7.org/linux/man-pages/man3/pthread_join.3.html */
+  for (i = 0; i < pool->nslots; i++)
+    if (uv_thread_join(pool->threads + i))
+      abort();
+
+  pool->nthreads = 0;
+  pool->nslots = 0;
+
+  /* 销毁锁和条件变量 */
+  uv_mutex_destroy(&pool->mutex);
+  uv_mutex_destroy(&pool->stats_mutex);
+  uv_cond_destroy(&pool->cond);
+
+  uv__free(pool->histograms);
+  pool->histograms = NULL;
+
+  shards = pool->shards;
+  for (i = 0; i < pool->nshards; i++)
+    uv_mutex_destroy(&shards[i].mutex);
+  uv__free(shards);
+  pool->shards = NULL;
+  pool->nshards = 0;
+}
+
+
+#ifndef _WIN32
+/* 在mian退出或者执行exit后的清理函数 */
+UV_DESTRUCTOR(static void cleanup(void)) {
+  /* 被隔离的线程返回时还要用mutex，有的话就不清理了 */
+  if (default_pool.nslots == 0 || default_pool.nquarantined != 0)
+    return;
+
+  threadpool_stop(&default_pool);
+
+  /* 如果不是默认线程池，还要释放内存 */
+  if (default_pool.threads != default_threads)
+    uv__free(default_pool.threads);
+
+  uv__free(default_pool.cpumasks);
+  default_pool.cpumasks = NULL;
+
+  default_pool.threads = NULL;
+  default_pool.nthreads = 0;
+}
+#endif
+
+/* 把cpumasks复制一份作为线程池的亲和性设置，已有的线程马上生效，之后
+ * 创建的线程一开始就用它。nmasks为0表示不再设置，已有的线程保持不变
+ */
+static int threadpool_set_affinity(uv_threadpool_t* pool,
+                                   const char* cpumasks,
+                                   size_t mask_size,
+                                   unsigned int nmasks) {
+  unsigned int i;
+  char* masks;
+  int cpumasksize;
+  int err;
+
+  masks = NULL;
+  if (nmasks != 0) {
+    cpumasksize = uv_cpumask_size();
+    if (cpumasksize < 0)
+      return cpumasksize;
+    if (mask_size < (size_t) cpumasksize)
+      return UV_EINVAL;
+
+    masks = uv__malloc(nmasks * mask_size);
+    if (masks == NULL)
+      return UV_ENOMEM;
+    memcpy(masks, cpumasks, nmasks * mask_size);
+  }
+
+  err = 0;
+  uv_mutex_lock(&pool->mutex);
+  uv__free(pool->cpumasks);
+  pool->cpumasks = masks;
+  pool->cpumask_size = mask_size;
+  pool->ncpumasks = nmasks;
+
+  for (i = 0; masks != NULL && i < pool->nthreads && err == 0; i++)
+    err = uv_thread_setaffinity(pool->threads + i,
+                                masks + i % nmasks * mask_size,
+                                NULL,
+                                mask_size);
+  uv_mutex_unlock(&pool->mutex);
+
+  return err;
+}
+
+
+/* 把线程池的线程都绑到NUMA节点node的CPU上。内存按首次访问分配在本节点，
+ * 所以线程在工作函数里分配的缓冲区也会在本节点上
+ */
+static int threadpool_set_numa_node(uv_threadpool_t* pool, int node) {
+#if defined(__linux__)
+  char* mask;
+  int size;
+  int err;
+
+  size = uv_cpumask_size();
+  if (size < 0)
+    return size;
+
+  mask = uv__malloc(size);
+  if (mask == NULL)
+    return UV_ENOMEM;
+
+  err = uv__numa_node_cpumask(node, mask, size);
+  if (err == 0)
+    err = threadpool_set_affinity(pool, mask, size, 1);
+
+  uv__free(mask);
+  return err;
+#else
+  return UV_ENOTSUP;
+#endif
+}
+
+
+/* 默认线程池初始化 */
+static void init_threads(void) {
+  unsigned int nthreads;
+  const char* val;
+
+  /* 默认线程池大小 */
+  nthreads = ARRAY_SIZE(default_threads);
+  /* 环境变量设置的线程池大小 */
+  val = getenv("UV_THREADPOOL_SIZE");
+  if (val != NULL)
+    nthreads = atoi(val);
+  /* 至少要有一个线程 */
+  if (nthreads == 0)
+    nthreads = 1;
+  /* 最大为128 */
+  if (nthreads > MAX_THREADPOOL_SIZE)
+    nthreads = MAX_THREADPOOL_SIZE;
+
+  /* 指向线程数组 */
+  default_pool.threads = default_threads;
+  default_pool.threads_size = ARRAY_SIZE(default_threads);
+  /* 如果用户设置的线程池比默认的大 */
+  if (nthreads > ARRAY_SIZE(default_threads)) {
+    /* 则重新动态分配线程池数组 */
+    default_pool.threads = uv__malloc(nthreads * sizeof(default_threads[0]));
+    default_pool.threads_size = nthreads;
+    /* 分配失败就用默认的设置 */
+    if (default_pool.threads == NULL) {
+      nthreads = ARRAY_SIZE(default_threads);
+      default_pool.threads = default_threads;
+      default_pool.threads_size = nthreads;
+    }
+  }
+
+  /* 一个线程都不先创建，第一次提交任务时不用等所有线程跑起来 */
+  default_pool.name = "default";
+  if (threadpool_start(&default_pool, nthreads, 0))
+    abort();
+
+  /* UV_THREADPOOL_NUMA_NODE把默认线程池绑到一个NUMA节点上。fork之后子进程
+   * 沿用父进程的设置
+   */
+  val = getenv("UV_THREADPOOL_NUMA_NODE");
+  if (val != NULL && default_pool.cpumasks == NULL)
+    threadpool_set_numa_node(&default_pool, atoi(val));
+}
+
+
+#ifndef _WIN32
+/* 重置once变量，使其可以再次初始化 */
+static void reset_once(void) {
+  uv_once_t child_once = UV_ONCE_INIT;
+  memcpy(&once, &child_once, sizeof(child_once));
+}
+#endif
+
+/* 只初始化一次 */
+static void init_once(void) {
+#ifndef _WIN32
+  /* Re-initialize the threadpool after fork.
+   * Note that this discards the global mutex and condition as well
+   * as the work queue.
+   */
+  if (pthread_atfork(NULL, NULL, &reset_once))
+    abort();
+#endif
+  /* 线程池初始化 */
+  init_threads();
+}
+
+
+/* 创建一个有size个线程的线程池，name只用来标识它，会复制一份 */
+int uv_threadpool_init(uv_threadpool_t* pool,
+                       const char* name,
+                       unsigned int size) {
+  int err;
+
+  if (size == 0 || size > MAX_THREADPOOL_SIZE)
+    return UV_EINVAL;
+
+  pool->name = NULL;
+  if (name != NULL) {
+    pool->name = uv__strdup(name);
+    if (pool->name == NULL)
+      return UV_ENOMEM;
+  }
+
+  pool->threads = uv__malloc(size * sizeof(pool->threads[0]));
+  if (pool->threads == NULL) {
+    err = UV_ENOMEM;
+    goto fail;
+  }
+
+  pool->threads_size = size;
+  pool->cpumasks = NULL;
+  pool->cpumask_size = 0;
+  pool->ncpumasks = 0;
+  err = threadpool_start(pool, size, size);
+  if (err == 0)
+    return 0;
+
+  uv__free(pool->threads);
+
+fail:
+  uv__free((char*) pool->name);
+  pool->name = NULL;
+  pool->threads = NULL;
+  pool->nthreads = 0;
+  return err;
+}
+
+
+/* 销毁线程池。还有loop绑定在上面、还有没执行的任务或者还有没销毁的类别
+ * 时返回UV_EBUSY。
+ * 正在执行的任务会先执行完
+ */
+int uv_threadpool_destroy(uv_threadpool_t* pool) {
+  int busy;
+
+  uv_mutex_lock(&pool->mutex);
+  busy = pool->nloops != 0 ||
+         pool->nquarantined != 0 ||
+         ACCESS_ONCE(unsigned int, pool->nqueued) != 0 ||
+         pool->nclassed != 0 ||
+         QUEUE_NEXT(uv__pool_classes(pool)) !=
+             QUEUE_PREV(uv__pool_classes(pool));
+  uv_mutex_unlock(&pool->mutex);
+
+  if (busy)
+    return UV_EBUSY;
+
+  threadpool_stop(pool);
+
+  uv__free(pool->threads);
+  uv__free(pool->cpumasks);
+  uv__free((char*) pool->name);
+  pool->threads = NULL;
+  pool->name = NULL;
+  pool->nthreads = 0;
+
+  return 0;
+}
+
+
+/* 把线程池调整成固定的size个线程，并关掉弹性模式。变大时马上创建线程，
+ * 变小时多出来的线程做完手上的任务再退出。pool为NULL表示默认线程池
+ */
+int uv_threadpool_resize(uv_threadpool_t* pool, unsigned int size) {
+  return uv_threadpool_set_elastic(pool, size, size, 0, 0);
+}
+
+
+/* 让线程池的线程个数在[min, max]之间自动调整：队列持续非空超过
+ * spawn_after_ms毫秒并且没有空闲线程时加一个线程，空闲超过idle_timeout_ms
+ * 毫秒的线程在个数多于min时退出。两个时间为0时分别表示不自动增加和不自动
+ * 减少。现有的线程少于min时马上补齐
+ */
+int uv_threadpool_set_elastic(uv_threadpool_t* pool,
+                              unsigned int min,
+                              unsigned int max,
+                              uint64_t spawn_after_ms,
+                              uint64_t idle_timeout_ms) {
+  int err;
+
+  if (min == 0 || min > max || max > MAX_THREADPOOL_SIZE)
+    return UV_EINVAL;
+
+  if (pool == NULL) {
+    uv_once(&once, init_once);
+    pool = &default_pool;
+  }
+
+  uv_mutex_lock(&pool->mutex);
+  pool->min_threads = min;
+  pool->max_threads = max;
+  if (pool->spawn_after == 0 && spawn_after_ms != 0)
+    pool->wq_busy_since = uv_hrtime();
+  pool->spawn_after = spawn_after_ms * 1000000;
+  pool->idle_timeout = idle_timeout_ms * 1000000;
+
+  err = 0;
+  threadpool_reap(pool);
+  while (err == 0 && pool->nthreads < min)
+    err = threadpool_spawn(pool);
+
+  /* 叫醒空闲的线程，让多出来的退出，也让它们按新的idle_timeout等待 */
+  uv_cond_broadcast(&pool->cond);
+  uv_mutex_unlock(&pool->mutex);
+
+  return err;
+}
+
+
+/* 给pool（为NULL表示默认线程池）的线程设置CPU亲和性，cpumasks是nmasks个
+ * 连在一起、每个长mask_size的掩码，第i个线程用第i % nmasks个
+ */
+int uv_threadpool_set_affinity(uv_threadpool_t* pool,
+                               const char* cpumasks,
+                               size_t mask_size,
+                               unsigned int nmasks) {
+  if (pool == NULL) {
+    uv_once(&once, init_once);
+    pool = &default_pool;
+  }
+
+  return threadpool_set_affinity(pool, cpumasks, mask_size, nmasks);
+}
+
+
+int uv_threadpool_set_numa_node(uv_threadpool_t* pool, int node) {
+  if (pool == NULL) {
+    uv_once(&once, init_once);
+    pool = &default_pool;
+  }
+
+  return threadpool_set_numa_node(pool, node);
+}
+
+
+/* 设置线程没有任务时自旋的时间和同时自旋的线程个数上限，pool为NULL表示
+ * 默认线程池。正在睡眠的线程不受影响。自旋的线程会占住一个CPU，至少要给
+ * loop线程留一个，所以上限不超过CPU个数减一，单核的机器上不会自旋
+ */
+int uv_threadpool_set_spin(uv_threadpool_t* pool,
+                           unsigned int spin_us,
+                           unsigned int max_spinners) {
+  uv_cpu_info_t* cpus;
+  int ncpus;
+
+  if (spin_us != 0 && max_spinners == 0)
+    return UV_EINVAL;
+
+  if (spin_us != 0 && uv_cpu_info(&cpus, &ncpus) == 0) {
+    uv_free_cpu_info(cpus, ncpus);
+    if (ncpus > 0 && max_spinners > (unsigned int) ncpus - 1)
+      max_spinners = ncpus - 1;
+  }
+
+  if (pool == NULL) {
+    uv_once(&once, init_once);
+    pool = &default_pool;
+  }
+
+  uv_mutex_lock(&pool->mutex);
+  pool->max_spinners = max_spinners;
+  pool->spin_time = (uint64_t) spin_us * 1000;
+  uv_mutex_unlock(&pool->mutex);
+
+  return 0;
+}
+
+
+/* 把loop绑定到pool上，之后这个loop提交的任务（文件操作、DNS解析和
+ * uv_queue_work()）都在pool里执行。pool为NULL表示改回默认线程池。已经提交
+ * 的任务不受影响
+ */
+int uv_loop_set_threadpool(uv_loop_t* loop, uv_threadpool_t* pool) {
+  if (pool != NULL) {
+    uv_mutex_lock(&pool->mutex);
+    pool->nloops++;
+    uv_mutex_unlock(&pool->mutex);
+  }
+
+  if (loop->threadpool != NULL) {
+    uv_mutex_lock(&loop->threadpool->mutex);
+    loop->threadpool->nloops--;
+    uv_mutex_unlock(&loop->threadpool->mutex);
+  }
+
+  loop->threadpool = pool;
+  return 0;
+}
+
+
+/* 在pool里创建一个类别，按优先级插到类别链表里，同一优先级的排在后面 */
+int uv_work_class_init(uv_threadpool_t* pool,
+                       uv_work_class_t* cls,
+                       int priority,
+                       unsigned int max_running) {
+  uv_work_class_t* other;
+  QUEUE* q;
+
+  if (pool == NULL) {
+    uv_once(&once, init_once);
+    pool = &default_pool;
+  }
+
+  cls->pool = pool;
+  cls->priority = priority;
+  cls->max_running = max_running;
+  cls->running = 0;
+  QUEUE_INIT(uv__class_pending_wq(cls));
+
+  uv_mutex_lock(&pool->mutex);
+  QUEUE_FOREACH(q, uv__pool_classes(pool)) {
+    other = QUEUE_DATA(q, uv_work_class_t, class_queue);
+    if (other->priority > priority)
+      break;
+  }
+  /* 插到q的前面 */
+  QUEUE_INSERT_TAIL(q, (QUEUE*) &cls->class_queue);
+  uv_mutex_unlock(&pool->mutex);
+
+  return 0;
+}
+
+
+/* 销毁类别，还有任务在等待或者在执行时返回UV_EBUSY。NORMAL档的任务在分片
+ * 里排队时不会被发现，要等它们都执行完再销毁
+ */
+int uv_work_class_destroy(uv_work_class_t* cls) {
+  uv_threadpool_t* pool;
+  int busy;
+
+  pool = cls->pool;
+  if (cls == &pool->slow_io)
+    return UV_EINVAL;
+
+  uv_mutex_lock(&pool->mutex);
+  busy = cls->running != 0 || !QUEUE_EMPTY(uv__class_pending_wq(cls));
+  if (!busy)
+    QUEUE_REMOVE((QUEUE*) &cls->class_queue);
+  uv_mutex_unlock(&pool->mutex);
+
+  if (busy)
+    return UV_EBUSY;
+
+  cls->pool = NULL;
+  return 0;
+}
+
+
+/* 之后这个loop提交的任务都放到cls里，cls为NULL表示恢复成普通任务 */
+int uv_loop_set_work_class(uv_loop_t* loop, uv_work_class_t* cls) {
+  loop->work_class = cls;
+  return 0;
+}
+
+
+/* 之后这个loop提交的uv_queue_work()和文件操作在timeout毫秒后过期 */
+int uv_loop_set_work_deadline(uv_loop_t* loop, uint64_t timeout) {
+  if (timeout > UINT64_MAX / 1000000)
+    return UV_EINVAL;
+
+  loop->work_deadline = timeout * 1000000;
+  return 0;
+}
+
+
+/* 现在提交的任务的截止时间，loop没有设置时为0 */
+static uint64_t uv__loop_work_deadline(const uv_loop_t* loop) {
+  if (loop->work_deadline == 0)
+    return 0;
+  return uv_hrtime() + loop->work_deadline;
+}
+
+
+/* w还在排队的话把它从分片或者类别的队列里拿出来，返回1。要持有mutex和
+ * 所有分片的锁
+ */
+static int threadpool_unqueue(uv_threadpool_t* pool, struct uv__work* w) {
+  struct uv__threadpool_shard* shards;
+  struct uv__threadpool_shard* shard;
+  unsigned int i;
+  QUEUE* q;
+
+  if (QUEUE_EMPTY(&w->wq) || w->work == NULL)
+    return 0;
+
+  /* 不在类别的队列里就在某个分片里，要修正相应的计数 */
+  shards = pool->shards;
+  shard = NULL;
+  q = NULL;
+  if (w->cls != NULL)
+    QUEUE_FOREACH(q, uv__class_pending_wq(w->cls))
+      if (q == &w->wq)
+        break;
+
+  if (q == &w->wq) {
+    pool->nclassed--;
+  } else {
+    for (i = 0; i < pool->nshards && shard == NULL; i++)
+      QUEUE_FOREACH(q, &shards[i].wq)
+        if (q == &w->wq) {
+          shard = shards + i;
+          break;
+        }
+
+    assert(shard != NULL);
+    shard->count--;
+    threadpool_add(&pool->nqueued, -1);
+  }
+
+  QUEUE_REMOVE(&w->wq);
+  QUEUE_INIT(&w->wq);
+  return 1;
+}
+
+
+/* 把正在执行w的线程隔离出线程池：从threads数组和workers上拿掉，detach之后
+ * 不再被join，再补一个线程。要持有mutex。找不到时说明线程刚取出w还没有
+ * 开始执行，返回0
+ */
+static int threadpool_quarantine(uv_threadpool_t* pool, struct uv__work* w) {
+  struct uv__worker* worker;
+  unsigned int i;
+  QUEUE* q;
+
+  worker = NULL;
+  QUEUE_FOREACH(q, (QUEUE*) &pool->workers) {
+    worker = QUEUE_DATA(q, struct uv__worker, member);
+    if (worker->current == w)
+      break;
+  }
 
-static uv_once_t once = UV_ONCE_INIT;/* pthread_once_t */
-static uv_cond_t cond;/* 队列为空时线程池的线程会在该条件变量上睡眠 */
-static uv_mutex_t mutex;/* 线程池内部锁 */
-static unsigned int idle_threads;/* 当前空闲线程的数目 */
-static unsigned int slow_io_work_running;
-static unsigned int nthreads;
-static uv_thread_t* threads;
-static uv_thread_t default_threads[4];/* 默认四个线程的线程池 */
-static QUEUE exit_message;/* 线程池退出消息 */
-static QUEUE wq; /* 线程池线程全部会检查这个queue，一旦发现有任务就执行，但是只能有一个线程抢占到 */
-static QUEUE run_slow_work_message;
-static QUEUE slow_io_pending_wq;/* 慢IO型的任务都会放到这个队列 */
+  if (q == (QUEUE*) &pool->workers)
+    return 0;
 
-/* 慢任务的数目不成超过线程池线程数的一般 */
-static unsigned int slow_work_thread_threshold(void) {
-  return (nthreads + 1) / 2;
-}
+  for (i = 0; i < pool->nthreads; i++)
+    if (uv_thread_equal(pool->threads + i, &worker->tid))
+      break;
 
+  /* 最后一个活着的线程换到i上，最后一个等着join的换到它原来的位置上 */
+  assert(i < pool->nthreads);
+  pool->threads[i] = pool->threads[pool->nthreads - 1];
+  pool->threads[pool->nthreads - 1] = pool->threads[pool->nslots - 1];
+  pool->nthreads--;
+  pool->nslots--;
+  uv_thread_detach(&worker->tid);
 
-static void uv__cancelled(struct uv__work* w) {
-  abort();
+  QUEUE_REMOVE(q);
+  worker->current = NULL;
+  worker->quarantined = 1;
+  pool->nquarantined++;
+
+  /* 卡住的任务不再占类别的名额 */
+  if (w->cls != NULL)
+    w->cls->running--;
+
+  /* 补一个线程，失败了也只是少一个线程 */
+  if (!pool->stopping && pool->nthreads < pool->max_threads)
+    threadpool_spawn(pool);
+
+  return 1;
 }
 
 
-/* To avoid deadlock with uv_cancel() it's crucial that the worker
- * never holds the global mutex and the loop-local mutex at the same time.
- * 
- * 线程池（每个线程）的工作函数
+/* 超时的任务还在排队就拿出来，在执行就隔离执行它的线程，返回1，之后由
+ * 调用的一方以UV_ETIMEDOUT结束它。已经做完或者被取消了返回0；线程刚取出
+ * 它还没有开始执行时返回-1，稍后再试
  */
-static void worker(void* arg) {
-  struct uv__work* w;
-  QUEUE* q;
-  int is_slow_work;
+static int threadpool_expire(struct uv__work* w) {
+  struct uv__threadpool_shard* shards;
+  uv_threadpool_t* pool;
+  unsigned int i;
+  int r;
 
-  /* 参数是传进来的信号量 */
-  uv_sem_post((uv_sem_t*) arg);
-  arg = NULL;
+  pool = w->pool;
+  shards = pool->shards;
 
-  /* 因为是多线程访问，因此需要加锁同步，mutex为线程池内部锁 */
-  uv_mutex_lock(&mutex);
-  /* 线程进入工作循环 */
-  for (;;) {
-    /* `mutex` should always be locked at this point. */
-
-    /* 
-      当任务队列wq为空或者（wq只剩run_slow_work_message一个节点且正在执行的慢io任务数目已经超过阈值），
-      那么此时就循环等待。
-    */
-    while (QUEUE_EMPTY(&wq) ||
-           (QUEUE_HEAD(&wq) == &run_slow_work_message &&
-            QUEUE_NEXT(&run_slow_work_message) == &wq &&
-            slow_io_work_running >= slow_work_thread_threshold())) {
-      /* 空闲线程数加1 */
-      idle_threads += 1;
-      /* 等待条件变量 */
-      uv_cond_wait(&cond, &mutex);
-      /* 被唤醒之后，说明有任务被post到队列，因此空闲线程数需要减1 */
-      idle_threads -= 1;
-    }
+  uv_mutex_lock(&pool->mutex);
+  for (i = 0; i < pool->nshards; i++)
+    uv_mutex_lock(&shards[i].mutex);
 
-    /* 取出队列的头部节点（第一个task） */
-    q = QUEUE_HEAD(&wq);
-    /* 如果这是一个退出消息 */
-    if (q == &exit_message) {
-      /* 给条件变量发信号 */
-      uv_cond_signal(&cond);
-      /* 解锁 */
-      uv_mutex_unlock(&mutex);
-      /* 直接退出循环（也就是退出线程） */
-      break;
-    }
+  r = threadpool_unqueue(pool, w);
 
-    /* 从队列中移除这个task */
-    QUEUE_REMOVE(q);
-    QUEUE_INIT(q);  /* Signal uv_cancel() that the work req is executing. */
+  for (i = pool->nshards; i > 0; i--)
+    uv_mutex_unlock(&shards[i - 1].mutex);
 
-    is_slow_work = 0;
-    /* 如果这个Task是run_slow_work_message */
-    if (q == &run_slow_work_message) {
-      /* If we're at the slow I/O threshold, re-schedule until after all
-         other work in the queue is done. */
-      if (slow_io_work_running >= slow_work_thread_threshold()) {
-        /* 如果已处理慢io任务的数目超过阈值，就先不处理，将其加到wq中，开始处理下一个任务 */
-        QUEUE_INSERT_TAIL(&wq, q);
-        continue;
-      }
+  /* 不在队列里时，w->work被清掉或者换成了标志说明已经结束，否则有线程在
+   * 执行它
+   */
+  if (r == 0) {
+    if (w->work == NULL || w->work == uv__cancelled || w->work == uv__timedout)
+      r = 0;
+    else if (threadpool_quarantine(pool, w))
+      r = 1;
+    else
+      r = -1;
+  }
 
-      /* 
-         否则，慢IO没有超过阈值，可以执行慢IO任务，但是如果slow_io_pending_wq为空，则说明
-         这个慢IO任务已经被取消了。则开始下一次循环
-         */
-      if (QUEUE_EMPTY(&slow_io_pending_wq))
-        continue;
-
-      /* 标记这是一个慢IO任务 */
-      is_slow_work = 1;
-      /* 正在执行的慢IO任务数目 */
-      slow_io_work_running++;
-
-      /* 从slow_io_pending_wq中取出并删除这个任务 */
-      q = QUEUE_HEAD(&slow_io_pending_wq);
-      QUEUE_REMOVE(q);
-      QUEUE_INIT(q);
-
-      /* If there is more slow I/O work, schedule it to be run as well.
-         如果slow_io_pending_wq不为空，说明还有满IO任务待处理
-       */
-      if (!QUEUE_EMPTY(&slow_io_pending_wq)) {
-        /* 再向wq中拆入run_slow_work_message */
-        QUEUE_INSERT_TAIL(&wq, &run_slow_work_message);
-        /* 如果空闲线程大于0，就唤醒线程池 */
-        if (idle_threads > 0)
-          uv_cond_signal(&cond);
-      }
-    }
+  uv_mutex_unlock(&pool->mutex);
+  return r;
+}
 
-    /* wq访问结束，mutex可以解锁 */
-    uv_mutex_unlock(&mutex);
 
-    /* 还原uv__work */
-    w = QUEUE_DATA(q, struct uv__work, wq);
-    /* 执行这个task */
-    w->work(w);
+/* 到第一个超时的时候再检查，retry不为0时是有任务刚开始执行，1毫秒后再试 */
+static void uv__work_timeouts_arm(struct uv__work_timeouts* t,
+                                  uint64_t now,
+                                  int retry);
 
-    /* 对loop->wq_mutex上互斥锁，因为接下来会并发修改loop->wq */
-    uv_mutex_lock(&w->loop->wq_mutex);
-    /* 执行完的work会被设置为NULL,在uv_cancel中会使用这个标识  */
-    w->work = NULL;  /* Signal uv_cancel() that the work req is done
-                        executing. */
-    /* 将该已经执行完的task加入loop->wq，将来会被取出来执行done  */
-    QUEUE_INSERT_TAIL(&w->loop->wq, &w->wq);
-    /* 向loop发送异步通知  */
-    uv_async_send(&w->loop->wq_async);
-    /*  解锁 */
-    uv_mutex_unlock(&w->loop->wq_mutex);
-
-    /* Lock `mutex` since that is expected at the start of the next
-     * iteration. */
-    uv_mutex_lock(&mutex);
-    if (is_slow_work) {
-      /* 慢IO任务执行完之后slow_io_work_running要减一 */
-      slow_io_work_running--;
+
+static void uv__work_timeouts_cb(uv_timer_t* timer) {
+  struct uv__work_timeouts* t;
+  struct uv__work* w;
+  uv_loop_t* loop;
+  uint64_t now;
+  QUEUE* q;
+  int retry;
+  int r;
+
+  t = container_of(timer, struct uv__work_timeouts, timer);
+  loop = timer->loop;
+  now = uv_hrtime();
+  retry = 0;
+
+  while (!QUEUE_EMPTY(&t->wq)) {
+    q = QUEUE_HEAD(&t->wq);
+    w = QUEUE_DATA(q, struct uv__work, timeout_queue);
+    if (w->timeout > now)
+      break;
+
+    r = threadpool_expire(w);
+    if (r < 0) {
+      retry = 1;
+      break;
     }
+
+    QUEUE_REMOVE(q);
+    w->timeout = 0;
+    if (r == 0)
+      continue;
+
+    /* 和取消的任务一样压到loop->wq_done上，done回调收到UV_ETIMEDOUT */
+    w->work = uv__timedout;
+    w->wait_time = 0;
+    uv__work_push_done(loop, w);
+    uv_async_send(&loop->wq_async);
   }
+
+  uv__work_timeouts_arm(t, now, retry);
 }
 
-/* 将一个uv__work提交到工作队列
-uv__work_kind为任务类型：
-  UV__WORK_CPU,
-  UV__WORK_FAST_IO,
-  UV__WORK_SLOW_IO
- */
-static void post(QUEUE* q, enum uv__work_kind kind) {
-  /* 要操纵工作队列，必须加锁 */
-  uv_mutex_lock(&mutex);
-  /* 慢IO型任务 */
-  if (kind == UV__WORK_SLOW_IO) {
-    /* 将该类型的任务加入到一个单独的队列slow_io_pending_wq */
-    QUEUE_INSERT_TAIL(&slow_io_pending_wq, q);
-    /* run_slow_work_message不为空表示已经被加入了wq队列 */
-    if (!QUEUE_EMPTY(&run_slow_work_message)) {
-      /* Running slow I/O tasks is already scheduled => Nothing to do here.
-         The worker that runs said other task will schedule this one as well. */
-      uv_mutex_unlock(&mutex);
-      return;
-    }
-    /* 由于这正的慢IO任务已经被加入到slow_io_pending_wq，因此普通的wq中就加入run_slow_work_message，这
-    可以继续向下执行并唤醒线程池（也就是每执行一个慢IO任务，wq中就会加入一个run_slow_work_message） */
-    q = &run_slow_work_message;
+
+static void uv__work_timeouts_arm(struct uv__work_timeouts* t,
+                                  uint64_t now,
+                                  int retry) {
+  struct uv__work* w;
+  uint64_t timeout;
+
+  if (QUEUE_EMPTY(&t->wq)) {
+    uv_timer_stop(&t->timer);
+    return;
   }
 
-  /* 插入普通工作队列 */
-  QUEUE_INSERT_TAIL(&wq, q);
-  /* 如果有空闲线程就给条件变量发信号 */
-  if (idle_threads > 0)
-    uv_cond_signal(&cond);
-  
-  /* 解锁 */
-  uv_mutex_unlock(&mutex);
+  w = QUEUE_DATA(QUEUE_HEAD(&t->wq), struct uv__work, timeout_queue);
+  timeout = retry;
+  if (w->timeout > now)
+    timeout = (w->timeout - now + 999999) / 1000000;
+
+  uv_timer_start(&t->timer, uv__work_timeouts_cb, timeout, 0);
 }
 
 
-#ifndef _WIN32
-/* 在mian退出或者执行exit后的清理函数 */
-UV_DESTRUCTOR(static void cleanup(void)) {
-  unsigned int i;
+/* 给刚设置好的w带上loop的超时，截止时间不会晚于超时 */
+static void uv__work_timeout_add(uv_loop_t* loop, struct uv__work* w) {
+  struct uv__work_timeouts* t;
+  uint64_t now;
+  QUEUE* q;
 
-  if (nthreads == 0)
+  t = loop->work_timeouts;
+  if (t == NULL || t->timeout == 0)
     return;
 
-  /* 向工作队列提交一个退出消息 */
-  post(&exit_message, UV__WORK_CPU);
+  now = uv_hrtime();
+  w->timeout = now + t->timeout;
+  if (w->deadline == 0 || w->deadline > w->timeout)
+    w->deadline = w->timeout;
 
-  /* 等待线程池的线程全部退出 http://man7.org/linux/man-pages/man3/pthread_join.3.html */
-  for (i = 0; i < nthreads; i++)
-    if (uv_thread_join(threads + i))
-      abort();
+  /* 超时一样的时候新的总是排在最后，从尾部往前找 */
+  for (q = QUEUE_PREV(&t->wq); q != &t->wq; q = QUEUE_PREV(q))
+    if (QUEUE_DATA(q, struct uv__work, timeout_queue)->timeout <= w->timeout)
+      break;
 
-  /* 如果不是默认线程池，还要释放内存 */
-  if (threads != default_threads)
-    uv__free(threads);
+  /* 插到q的后面 */
+  QUEUE_INSERT_HEAD(q, (QUEUE*) &w->timeout_queue);
+  if (q == &t->wq)
+    uv__work_timeouts_arm(t, now, 0);
+}
 
-  /* 销毁锁和条件变量 */
-  uv_mutex_destroy(&mutex);
-  uv_cond_destroy(&cond);
 
-  threads = NULL;
-  nthreads = 0;
+/* 任务已经结束，从超时链表上拿掉 */
+static void uv__work_timeout_remove(uv_loop_t* loop, struct uv__work* w) {
+  struct uv__work_timeouts* t;
+
+  t = loop->work_timeouts;
+  QUEUE_REMOVE((QUEUE*) &w->timeout_queue);
+  w->timeout = 0;
+  if (QUEUE_EMPTY(&t->wq))
+    uv_timer_stop(&t->timer);
 }
-#endif
 
-/* 线程池初始化 */
-static void init_threads(void) {
-  unsigned int i;
-  const char* val;
-  uv_sem_t sem;
 
-  /* 默认线程池大小 */
-  nthreads = ARRAY_SIZE(default_threads);
-  /* 环境变量设置的线程池大小 */
-  val = getenv("UV_THREADPOOL_SIZE");
-  if (val != NULL)
-    nthreads = atoi(val);
-  /* 至少要有一个线程 */
-  if (nthreads == 0)
-    nthreads = 1;
-  /* 最大为128 */
-  if (nthreads > MAX_THREADPOOL_SIZE)
-    nthreads = MAX_THREADPOOL_SIZE;
+/* 之后这个loop提交的uv_queue_work()和文件操作在timeout毫秒后还没结束的
+ * 直接以UV_ETIMEDOUT结束。检查超时用的是loop内部的定时器，它不让loop保持
+ * 活跃，需要检查的时候总会有请求让loop活着
+ */
+int uv_loop_set_work_timeout(uv_loop_t* loop, uint64_t timeout) {
+  struct uv__work_timeouts* t;
 
-  /* 指向线程数组 */
-  threads = default_threads;
-  /* 如果用户设置的线程池比默认的大 */
-  if (nthreads > ARRAY_SIZE(default_threads)) {
-    /* 则重新动态分配线程池数组 */
-    threads = uv__malloc(nthreads * sizeof(threads[0]));
-    /* 分配失败就用默认的设置 */
-    if (threads == NULL) {
-      nthreads = ARRAY_SIZE(default_threads);
-      threads = default_threads;
-    }
+  if (timeout > UINT64_MAX / 1000000)
+    return UV_EINVAL;
+
+  t = loop->work_timeouts;
+  if (t == NULL) {
+    if (timeout == 0)
+      return 0;
+
+    t = uv__malloc(sizeof(*t));
+    if (t == NULL)
+      return UV_ENOMEM;
+
+    uv_timer_init(loop, &t->timer);
+    t->timer.flags |= UV_HANDLE_INTERNAL;
+    uv__handle_unref(&t->timer);
+    QUEUE_INIT(&t->wq);
+    loop->work_timeouts = t;
   }
 
-  /* 条件变量初始化 */
-  if (uv_cond_init(&cond))
-    abort();
+  t->timeout = timeout * 1000000;
+  return 0;
+}
 
-  /* 互斥锁初始化 */
-  if (uv_mutex_init(&mutex))
-    abort();
 
-  /* 初始化工作队列 */
-  QUEUE_INIT(&wq);
-  /* 初始化慢IO型task工作队列 */
-  QUEUE_INIT(&slow_io_pending_wq);
-  QUEUE_INIT(&run_slow_work_message);
+/* 关闭loop时还没有请求，定时器没有在跑，从handle链表上拿下来就可以释放 */
+void uv__work_timeouts_delete(uv_loop_t* loop) {
+  struct uv__work_timeouts* t;
 
-  /* 初始化信号量 */
-  if (uv_sem_init(&sem, 0))
-    abort();
-   
-  /* 创建线程，每个线程都传入信号量这个参数 */
-  for (i = 0; i < nthreads; i++)
-    if (uv_thread_create(threads + i, worker, &sem))
-      abort();
+  t = loop->work_timeouts;
+  if (t == NULL)
+    return;
+
+  uv_timer_stop(&t->timer);
+  QUEUE_REMOVE(&t->timer.handle_queue);
+  uv__free(t);
+  loop->work_timeouts = NULL;
+}
 
-  /* 等待所有线程都创建完成（确切的说是全部执行了worker函数） */
-  for (i = 0; i < nthreads; i++)
-    uv_sem_wait(&sem);
 
-  /* 销毁信号量 */
-  uv_sem_destroy(&sem);
+/* pool为NULL时返回默认线程池 */
+static uv_threadpool_t* threadpool_get(uv_threadpool_t* pool) {
+  if (pool == NULL) {
+    /* once这个变量如果还没初始化过，就会执行init_once，否则不会执行init_once */
+    uv_once(&once, init_once);
+    pool = &default_pool;
+  }
+
+  return pool;
 }
 
 
-#ifndef _WIN32
-/* 重置once变量，使其可以再次初始化 */
-static void reset_once(void) {
-  uv_once_t child_once = UV_ONCE_INIT;
-  memcpy(&once, &child_once, sizeof(child_once));
+/* loop提交的任务该去的线程池，类别决定了用哪个线程池 */
+static uv_threadpool_t* uv__loop_threadpool(const uv_loop_t* loop) {
+  if (loop->work_class != NULL)
+    return loop->work_class->pool;
+  return loop->threadpool;
 }
-#endif
 
-/* 只初始化一次 */
-static void init_once(void) {
-#ifndef _WIN32
-  /* Re-initialize the threadpool after fork.
-   * Note that this discards the global mutex and condition as well
-   * as the work queue.
-   */
-  if (pthread_atfork(NULL, NULL, &reset_once))
+
+/* loop->wq_async的eventfd在第一次提交任务时才创建，见uv_loop_init()。
+ * 通知不了loop的话任务永远完成不了，和uv_async_send()写失败一样只能abort
+ */
+static void uv__work_wakeup_init(uv_loop_t* loop) {
+#if !defined(_WIN32)
+  if (uv__async_start(loop))
     abort();
 #endif
-  /* 线程池初始化 */
-  init_threads();
 }
 
-/* 向线程池提交一个uv__work */
+
+/* 设置要提交到pool的uv__work。cls是同一个线程池里的类别时放到该类别里，
+ * 否则慢IO型任务放到慢IO类别里
+ */
+static void uv__work_init(uv_loop_t* loop,
+                          uv_threadpool_t* pool,
+                          uv_work_class_t* cls,
+                          struct uv__work* w,
+                          enum uv__work_kind kind,
+                          void (*work)(struct uv__work* w),
+                          void (*done)(struct uv__work* w, int status),
+                          uint64_t deadline) {
+  uv__work_wakeup_init(loop);
+
+  if (cls == NULL || cls->pool != pool)
+    cls = kind == UV__WORK_SLOW_IO ? &pool->slow_io : NULL;
+
+  w->loop = loop;
+  w->pool = pool;
+  w->cls = cls;
+  w->work = work;
+  w->done = done;
+  w->kind = kind;
+  w->wait_time = 0;
+  w->run_time = 0;
+  w->deadline = deadline;
+  w->timeout = 0;
+  if (ACCESS_ONCE(void*, pool->histograms) != NULL)
+    w->wait_time = uv_hrtime();
+  UV__PROBE3(work__submit, loop, w, (int) kind);
+}
+
+
+/* 把一个uv__work提交到pool的类别cls里，pool为NULL时用默认线程池。timed
+ * 不为0时带上loop设置的截止时间和超时
+ */
+static void uv__work_submit_pool(uv_loop_t* loop,
+                                 uv_threadpool_t* pool,
+                                 uv_work_class_t* cls,
+                                 struct uv__work* w,
+                                 enum uv__work_kind kind,
+                                 void (*work)(struct uv__work* w),
+                                 void (*done)(struct uv__work* w, int status),
+                                 int timed) {
+  QUEUE wq;
+
+  pool = threadpool_get(pool);
+  /* 设置uv__work */
+  uv__work_init(loop,
+                pool,
+                cls,
+                w,
+                kind,
+                work,
+                done,
+                timed ? uv__loop_work_deadline(loop) : 0);
+  if (timed)
+    uv__work_timeout_add(loop, w);
+  /* 提交到工作队列 */
+  QUEUE_INIT(&wq);
+  QUEUE_INSERT_TAIL(&wq, &w->wq);
+  post(pool, &wq, 1);
+}
+
+/* 向loop绑定的线程池提交一个uv__work */
 void uv__work_submit(uv_loop_t* loop,
                      struct uv__work* w,
                      enum uv__work_kind kind,
                      void (*work)(struct uv__work* w),
                      void (*done)(struct uv__work* w, int status)) {
-  /* once这个变量如果还没初始化过，就会执行init_once，否则不会执行init_once */                        
-  uv_once(&once, init_once);
-  /* 设置uv__work */
-  w->loop = loop;
-  w->work = work;
-  w->done = done;
-  /* 提交到工作队列 */
-  post(&w->wq, kind);
+  uv__work_submit_pool(loop,
+                       uv__loop_threadpool(loop),
+                       loop->work_class,
+                       w,
+                       kind,
+                       work,
+                       done,
+                       0);
+}
+
+
+void uv__work_submit_deadline(uv_loop_t* loop,
+                              struct uv__work* w,
+                              enum uv__work_kind kind,
+                              void (*work)(struct uv__work* w),
+                              void (*done)(struct uv__work* w, int status)) {
+  uv__work_submit_pool(loop,
+                       uv__loop_threadpool(loop),
+                       loop->work_class,
+                       w,
+                       kind,
+                       work,
+                       done,
+                       1);
 }
 
 /* 取消一个uv__work */
 static int uv__work_cancel(uv_loop_t* loop, uv_req_t* req, struct uv__work* w) {
+  struct uv__threadpool_shard* shards;
+  uv_threadpool_t* pool;
+  unsigned int i;
   int cancelled;
 
-  /* 要操作工作队列，需要加锁 */
-  uv_mutex_lock(&mutex);
-  uv_mutex_lock(&w->loop->wq_mutex);
+  pool = w->pool;
+  shards = pool->shards;
+
+  /* 要操作工作队列，需要加锁。任务可能在任何一个分片或者类别的队列里，
+   * 按顺序把锁都拿上，worker和post()同一时刻最多只拿一个分片的锁
+   */
+  uv_mutex_lock(&pool->mutex);
+  for (i = 0; i < pool->nshards; i++)
+    uv_mutex_lock(&shards[i].mutex);
 
-  /* 该uv__work是否已经被取消 */
-  cancelled = !QUEUE_EMPTY(&w->wq) && w->work != NULL;
-  /* 如果已经被取消了，则直接删除 */
-  if (cancelled)
-    QUEUE_REMOVE(&w->wq);
+  /* 该uv__work是否还在排队，还在的话直接删除 */
+  cancelled = threadpool_unqueue(pool, w);
 
   /* 解锁 */
-  uv_mutex_unlock(&w->loop->wq_mutex);
-  uv_mutex_unlock(&mutex);
+  for (i = pool->nshards; i > 0; i--)
+    uv_mutex_unlock(&shards[i - 1].mutex);
+  uv_mutex_unlock(&pool->mutex);
 
   /* 如果还没有被取消，则说明任务还处于忙的状态，此时不能取消 */
   if (!cancelled)
@@ -366,47 +1815,87 @@ static int uv__work_cancel(uv_loop_t* loop, uv_req_t* req, struct uv__work* w) {
 
   /* 将work函数设置为uv__cancelled（标志作用），理论上该work不会再被执行，否则会abort */
   w->work = uv__cancelled;
+  /* 没有执行过的任务排队和执行的时间都算作0 */
+  w->wait_time = 0;
 
-  uv_mutex_lock(&loop->wq_mutex);
-  /* 被取消的work也会被加入loop->wq,稍后会被取出来执行done回调 */
-  QUEUE_INSERT_TAIL(&loop->wq, &w->wq);
+  /* 被取消的work也会被压到loop->wq_done上,稍后会被取出来执行done回调 */
+  uv__work_push_done(loop, w);
   /* 发送异步事件 */
   uv_async_send(&loop->wq_async);
-  uv_mutex_unlock(&loop->wq_mutex);
 
   return 0;
 }
 
 
+/* 已经在loop线程上做完了的任务，不用进线程池，直接压到loop->wq_done上，
+ * done回调和线程池里完成的任务一样在uv__work_done()里调用
+ */
+void uv__work_complete(uv_loop_t* loop,
+                       struct uv__work* w,
+                       void (*done)(struct uv__work* w, int status)) {
+  uv__work_wakeup_init(loop);
+
+  w->loop = loop;
+  w->pool = NULL;
+  w->cls = NULL;
+  w->work = NULL;
+  w->done = done;
+  w->kind = UV__WORK_FAST_IO;
+  w->wait_time = 0;
+  w->run_time = 0;
+  w->deadline = 0;
+  w->timeout = 0;
+
+  uv__work_push_done(loop, w);
+  uv_async_send(&loop->wq_async);
+}
+
+
 /* 当一个task被执行完之后，异步事件最终会回调该函数，也就是说，每个task是在线程池中被
 执行，但是回调却是在loop线程中 */
 void uv__work_done(uv_async_t* handle) {
+  struct uv__work* list;
+  struct uv__work* next;
   struct uv__work* w;
   uv_loop_t* loop;
-  QUEUE* q;
-  QUEUE wq;
+  void* head;
   int err;
 
   /* 还原loop */
   loop = container_of(handle, uv_loop_t, wq_async);
-  /* loop->wq会被并发访问，先加锁 */
-  uv_mutex_lock(&loop->wq_mutex);
-  /* 已经执行完的或被取消的task都会被加入loop->wq，将loop->wq全部移动到wq */
-  QUEUE_MOVE(&loop->wq, &wq);
-  uv_mutex_unlock(&loop->wq_mutex);
-
-  /* 遍历wq */
-  while (!QUEUE_EMPTY(&wq)) {
-    /* 取出闭关删除头节点 */
-    q = QUEUE_HEAD(&wq);
-    QUEUE_REMOVE(q);
+  /* 已经执行完的或被取消的task都在loop->wq_done上，一次全部取走 */
+  do
+    head = *(void* volatile*) &loop->wq_done;
+  while (head != NULL &&
+         (void*) cmpxchgl((long*) &loop->wq_done,
+                          (long) head,
+                          0) != head);
+
+  /* 栈是后进先出的，反转一下，done回调按完成的先后执行 */
+  list = NULL;
+  for (w = head; w != NULL; w = next) {
+    next = w->done_next;
+    w->done_next = list;
+    list = w;
+  }
 
-    /* 还原uv__work结构 */
-    w = container_of(q, struct uv__work, wq);
+  /* 遍历list */
+  while (list != NULL) {
+    w = list;
+    list = w->done_next;
     /* 如果该work被取消 */
-    err = (w->work == uv__cancelled) ? UV_ECANCELED : 0;
+    err = 0;
+    if (w->work == uv__cancelled)
+      err = UV_ECANCELED;
+    else if (w->work == uv__timedout)
+      err = UV_ETIMEDOUT;
     /* 否则就执行其done函数 */
+    if (w->timeout != 0)
+      uv__work_timeout_remove(loop, w);
+    UV__PROBE3(work__done, loop, w, err);
+    uv__watchdog_enter(loop, UV_UNKNOWN_HANDLE, NULL, w->done);
     w->done(w, err);
+    uv__watchdog_leave(loop);
   }
 }
 
@@ -433,11 +1922,13 @@ static void uv__queue_done(struct uv__work* w, int err) {
   req->after_work_cb(req, err);
 }
 
-/* 讲一个用户请求添加到线程池队列 */
-int uv_queue_work(uv_loop_t* loop,
-                  uv_work_t* req,
-                  uv_work_cb work_cb,
-                  uv_after_work_cb after_work_cb) {
+/* 初始化一个uv_work_t并提交到pool的类别cls里 */
+static int uv__queue_work_req(uv_loop_t* loop,
+                              uv_threadpool_t* pool,
+                              uv_work_class_t* cls,
+                              uv_work_t* req,
+                              uv_work_cb work_cb,
+                              uv_after_work_cb after_work_cb) {
   if (work_cb == NULL)
     return UV_EINVAL;
 
@@ -448,11 +1939,103 @@ int uv_queue_work(uv_loop_t* loop,
   req->work_cb = work_cb;
   req->after_work_cb = after_work_cb;
   /* 提交给线程池,其中work函数为uv__queue_work，done函数为uv__queue_done */
-  uv__work_submit(loop,
-                  &req->work_req,
+  uv__work_submit_pool(loop,
+                       pool,
+                       cls,
+                       &req->work_req,
+                       UV__WORK_CPU,
+                       uv__queue_work,
+                       uv__queue_done,
+                       1);
+  return 0;
+}
+
+/* 讲一个用户请求添加到线程池队列 */
+int uv_queue_work(uv_loop_t* loop,
+                  uv_work_t* req,
+                  uv_work_cb work_cb,
+                  uv_after_work_cb after_work_cb) {
+  return uv_queue_work_pool(loop,
+                            uv__loop_threadpool(loop),
+                            req,
+                            work_cb,
+                            after_work_cb);
+}
+
+/* 同uv_queue_work()，但是在指定的线程池里执行，pool为NULL时用默认线程池 */
+int uv_queue_work_pool(uv_loop_t* loop,
+                       uv_threadpool_t* pool,
+                       uv_work_t* req,
+                       uv_work_cb work_cb,
+                       uv_after_work_cb after_work_cb) {
+  return uv__queue_work_req(loop,
+                            pool,
+                            loop->work_class,
+                            req,
+                            work_cb,
+                            after_work_cb);
+}
+
+/* 同uv_queue_work()，但是这个请求进入类别cls，在cls所属的线程池里执行，
+ * 不管loop设置的类别。cls为NULL时和uv_queue_work()一样
+ */
+int uv_queue_work_class(uv_loop_t* loop,
+                        uv_work_class_t* cls,
+                        uv_work_t* req,
+                        uv_work_cb work_cb,
+                        uv_after_work_cb after_work_cb) {
+  if (cls == NULL)
+    return uv_queue_work(loop, req, work_cb, after_work_cb);
+
+  return uv__queue_work_req(loop,
+                            cls->pool,
+                            cls,
+                            req,
+                            work_cb,
+                            after_work_cb);
+}
+
+/* 一次提交nreqs个请求，它们用同一组回调。所有请求只加一次锁，再按任务
+ * 个数叫醒空闲的线程
+ */
+int uv_queue_work_batch(uv_loop_t* loop,
+                        uv_work_t reqs[],
+                        unsigned int nreqs,
+                        uv_work_cb work_cb,
+                        uv_after_work_cb after_work_cb) {
+  uv_threadpool_t* pool;
+  uint64_t deadline;
+  unsigned int i;
+  QUEUE wq;
+
+  if (work_cb == NULL)
+    return UV_EINVAL;
+
+  if (nreqs == 0)
+    return 0;
+
+  pool = threadpool_get(uv__loop_threadpool(loop));
+  deadline = uv__loop_work_deadline(loop);
+  QUEUE_INIT(&wq);
+
+  for (i = 0; i < nreqs; i++) {
+    uv__req_init(loop, &reqs[i], UV_WORK);
+    reqs[i].loop = loop;
+    reqs[i].work_cb = work_cb;
+    reqs[i].after_work_cb = after_work_cb;
+    uv__work_init(loop,
+                  pool,
+                  loop->work_class,
+                  &reqs[i].work_req,
                   UV__WORK_CPU,
                   uv__queue_work,
-                  uv__queue_done);
+                  uv__queue_done,
+                  deadline);
+    uv__work_timeout_add(loop, &reqs[i].work_req);
+    QUEUE_INSERT_TAIL(&wq, &reqs[i].work_req.wq);
+  }
+
+  post(pool, &wq, nreqs);
   return 0;
 }
 
@@ -490,6 +2073,144 @@ int uv_cancel(uv_req_t* req) {
   default:
     return UV_EINVAL;
   }
+
+  /* 直接提交到了io_uring上，或者是缓存命中已经在loop线程上做完了，不在线程池里 */
+  if (wreq->pool == NULL)
+    return UV_EBUSY;
+
   /* 取消这个uv__work */
   return uv__work_cancel(loop, req, wreq);
 }
+
+
+/* 线程池当前的状态。要数清每种任务排队的个数，所以和uv_cancel()一样把锁都
+ * 拿上，不要频繁调用
+ */
+int uv_threadpool_stats(uv_threadpool_t* pool, uv_threadpool_stats_t* stats) {
+  struct uv__threadpool_shard* shards;
+  uv_work_class_t* cls;
+  unsigned int i;
+  QUEUE* q;
+  QUEUE* p;
+
+  pool = threadpool_get(pool);
+  shards = pool->shards;
+  memset(stats, 0, sizeof(*stats));
+
+  uv_mutex_lock(&pool->mutex);
+  for (i = 0; i < pool->nshards; i++)
+    uv_mutex_lock(&shards[i].mutex);
+
+  stats->nthreads = pool->nthreads;
+  stats->busy_threads = pool->nthreads - pool->idle_threads;
+  stats->quarantined = pool->nquarantined;
+
+  for (i = 0; i < pool->nshards; i++)
+    QUEUE_FOREACH(q, &shards[i].wq)
+      stats->queued_by_kind[QUEUE_DATA(q, struct uv__work, wq)->kind]++;
+
+  QUEUE_FOREACH(p, uv__pool_classes(pool)) {
+    cls = QUEUE_DATA(p, uv_work_class_t, class_queue);
+    QUEUE_FOREACH(q, uv__class_pending_wq(cls))
+      stats->queued_by_kind[QUEUE_DATA(q, struct uv__work, wq)->kind]++;
+  }
+
+  for (i = pool->nshards; i > 0; i--)
+    uv_mutex_unlock(&shards[i - 1].mutex);
+  uv_mutex_unlock(&pool->mutex);
+
+  for (i = 0; i < UV_WORK_KIND_MAX; i++)
+    stats->queued += stats->queued_by_kind[i];
+
+  return 0;
+}
+
+
+/* 打开或者关闭耗时统计，重复打开时保留已有的数据，关闭时丢掉 */
+int uv_threadpool_enable_histograms(uv_threadpool_t* pool, int enable) {
+  uv_phase_histogram_t* hist;
+  uv_phase_histogram_t* old;
+
+  pool = threadpool_get(pool);
+  hist = NULL;
+
+  if (enable) {
+    hist = uv__calloc(2 * UV_WORK_KIND_MAX, sizeof(*hist));
+    if (hist == NULL)
+      return UV_ENOMEM;
+  }
+
+  uv_mutex_lock(&pool->stats_mutex);
+  if (!enable || pool->histograms == NULL) {
+    old = pool->histograms;
+    pool->histograms = hist;
+    hist = old;
+  }
+  uv_mutex_unlock(&pool->stats_mutex);
+
+  uv__free(hist);
+  return 0;
+}
+
+
+/* 取出kind这种任务排队和执行的耗时直方图，没有打开统计时返回UV_EINVAL */
+int uv_threadpool_histogram(uv_threadpool_t* pool,
+                            uv_work_kind kind,
+                            uv_phase_histogram_t* wait_time,
+                            uv_phase_histogram_t* run_time) {
+  uv_phase_histogram_t* hist;
+  int err;
+
+  if ((unsigned int) kind >= UV_WORK_KIND_MAX)
+    return UV_EINVAL;
+
+  pool = threadpool_get(pool);
+  err = UV_EINVAL;
+
+  uv_mutex_lock(&pool->stats_mutex);
+  hist = pool->histograms;
+  if (hist != NULL) {
+    if (wait_time != NULL)
+      memcpy(wait_time, hist + kind, sizeof(*wait_time));
+    if (run_time != NULL)
+      memcpy(run_time, hist + UV_WORK_KIND_MAX + kind, sizeof(*run_time));
+    err = 0;
+  }
+  uv_mutex_unlock(&pool->stats_mutex);
+
+  return err;
+}
+
+
+/* 线程池请求排队和执行的时间，可以分清文件操作慢在排队还是慢在磁盘上 */
+int uv_req_work_time(const uv_req_t* req, uint64_t* wait_ns, uint64_t* run_ns) {
+  const struct uv__work* wreq;
+
+  switch (req->type) {
+  case UV_FS:
+    wreq = &((const uv_fs_t*) req)->work_req;
+    break;
+  case UV_GETADDRINFO:
+    wreq = &((const uv_getaddrinfo_t*) req)->work_req;
+    break;
+  case UV_GETNAMEINFO:
+    wreq = &((const uv_getnameinfo_t*) req)->work_req;
+    break;
+  case UV_WORK:
+    wreq = &((const uv_work_t*) req)->work_req;
+    break;
+  default:
+    return UV_EINVAL;
+  }
+
+  /* 还在排队的任务wait_time里是提交时的时间，不能当作时长 */
+  if (wreq->run_time == 0) {
+    *wait_ns = 0;
+    *run_ns = 0;
+    return 0;
+  }
+
+  *wait_ns = wreq->wait_time;
+  *run_ns = wreq->run_time;
+  return 0;
+}
@@ -20,21 +20,79 @@
 
 #include "uv.h"
 #include "uv-common.h"
-#include "heap-inl.h"
 
 #include <assert.h>
 #include <limits.h>
+#include <stdlib.h>
 
-/* 比较两个定时器，用于在定时器堆的插入操作中比较两个定时器的大小，如果ha超时时间比hb短，返回1，否则返回0 */
-static int timer_less_than(const struct heap_node* ha,
-                           const struct heap_node* hb) {
-  const uv_timer_t* a;
-  const uv_timer_t* b;
+/* 分层时间轮：4层，每层256个槽，第0层一个槽1毫秒，覆盖2^32毫秒（约49天），
+ * 更远的定时器放在overflow里。定时器放在哪一层由它的超时时间与wheel->time
+ * 最高的不同8位决定，所以低层的定时器总是比高层的先到期，同一个槽里按插入
+ * 顺序排列。插入、删除都是O(1)，时间越过某一层的边界时把上一层对应的槽搬到
+ * 下面几层（cascade）。
+ */
+#define UV__WHEEL_BITS 8
+#define UV__WHEEL_SIZE (1 << UV__WHEEL_BITS)
+#define UV__WHEEL_MASK (UV__WHEEL_SIZE - 1)
+#define UV__WHEEL_LEVELS 4
+/* 第level层一个槽覆盖的时间减1，用作掩码 */
+#define UV__WHEEL_SPAN(level)                                                 \
+  ((((uint64_t) 1) << ((level) * UV__WHEEL_BITS)) - 1)
+
+struct uv__timer_wheel {
+  /* 还没有处理完的那一毫秒，比它早的定时器都已经执行过了 */
+  uint64_t time;
+  /* 每层的定时器个数，最后一个是overflow */
+  unsigned int count[UV__WHEEL_LEVELS + 1];
+  QUEUE overflow;
+  QUEUE slots[UV__WHEEL_LEVELS][UV__WHEEL_SIZE];
+};
+
+/* 使用时间轮时heap_node[0..1]用作QUEUE，heap_node[2]记录所在的层 */
+#define uv__timer_queue(handle) ((QUEUE*) &(handle)->heap_node)
+#define uv__timer_level(handle) ((uintptr_t) (handle)->heap_node[2])
+#define uv__timer_set_level(handle, level)                                    \
+  ((handle)->heap_node[2] = (void*) (uintptr_t) (level))
+
+/* 定时器堆是一个连续数组上的4叉最小堆，loop->timer_heap.nodes[0]是最早到期的
+ * 定时器。比较只用到节点里的timeout和start_id，不用去读分散在各处的uv_timer_t，
+ * 一个节点的4个子节点也挨在一起。uv_timer_t的heap_node[0]记录它在数组里的下标，
+ * 删除时不用查找。
+ */
+#define UV__TIMER_HEAP_D 4
+#define UV__TIMER_HEAP_MIN_SIZE 16
+
+struct uv__timer_node {
+  uint64_t timeout;
+  uint64_t start_id;
+  uv_timer_t* handle;
+};
 
-  /* 根据堆节点还原uv_timer_t结构，典型contaner_of用法 */
-  a = container_of(ha, uv_timer_t, heap_node);
-  b = container_of(hb, uv_timer_t, heap_node);
+/* 和loop->timer_heap、loop->hrtimer_heap的布局一样 */
+struct uv__timer_heap {
+  struct uv__timer_node* nodes;
+  unsigned int nelts;
+  unsigned int size;
+};
 
+#define uv__timer_index(handle) ((uintptr_t) (handle)->heap_node[0])
+#define uv__timer_set_index(handle, i)                                        \
+  ((handle)->heap_node[0] = (void*) (uintptr_t) (i))
+
+/* 纳秒定时器放在单独的hrtimer_heap里，loop->timer_heap只放毫秒定时器 */
+#if defined(UV__HRTIMER)
+#define uv__timer_heap(handle)                                                \
+  ((handle)->flags & UV_HANDLE_TIMER_NS ?                                     \
+   (struct uv__timer_heap*) &(handle)->loop->hrtimer_heap :                   \
+   (struct uv__timer_heap*) &(handle)->loop->timer_heap)
+#else
+#define uv__timer_heap(handle)                                                \
+  ((struct uv__timer_heap*) &(handle)->loop->timer_heap)
+#endif
+
+/* 比较两个定时器节点，a比b先到期返回1，否则返回0 */
+static int timer_less_than(const struct uv__timer_node* a,
+                           const struct uv__timer_node* b) {
   /* 根据timeout大小比较 */
   if (a->timeout < b->timeout)
     return 1;
@@ -44,14 +102,336 @@ static int timer_less_than(const struct heap_node* ha,
   /* 
      如果timeout相同，就比较start_id
    */
-  if (a->start_id < b->start_id)
-    return 1;
-  if (b->start_id < a->start_id)
+  return a->start_id < b->start_id;
+}
+
+
+/* 把nodes[i]往上移到它该在的位置 */
+static void timer_heap_sift_up(struct uv__timer_node* nodes, unsigned int i) {
+  struct uv__timer_node node;
+  unsigned int parent;
+
+  node = nodes[i];
+  while (i > 0) {
+    parent = (i - 1) / UV__TIMER_HEAP_D;
+    if (!timer_less_than(&node, nodes + parent))
+      break;
+    nodes[i] = nodes[parent];
+    uv__timer_set_index(nodes[i].handle, i);
+    i = parent;
+  }
+
+  nodes[i] = node;
+  uv__timer_set_index(node.handle, i);
+}
+
+
+/* 把nodes[i]往下移到它该在的位置 */
+static void timer_heap_sift_down(struct uv__timer_node* nodes,
+                                 unsigned int nelts,
+                                 unsigned int i) {
+  struct uv__timer_node node;
+  unsigned int child;
+  unsigned int last;
+  unsigned int min;
+
+  node = nodes[i];
+  for (;;) {
+    child = i * UV__TIMER_HEAP_D + 1;
+    if (child >= nelts)
+      break;
+
+    last = child + UV__TIMER_HEAP_D;
+    if (last > nelts)
+      last = nelts;
+
+    /* 找出最小的子节点 */
+    for (min = child++; child < last; child++)
+      if (timer_less_than(nodes + child, nodes + min))
+        min = child;
+
+    if (!timer_less_than(nodes + min, &node))
+      break;
+
+    nodes[i] = nodes[min];
+    uv__timer_set_index(nodes[i].handle, i);
+    i = min;
+  }
+
+  nodes[i] = node;
+  uv__timer_set_index(node.handle, i);
+}
+
+
+static int timer_heap_insert(struct uv__timer_heap* heap, uv_timer_t* handle) {
+  struct uv__timer_node* nodes;
+  unsigned int size;
+  unsigned int i;
+
+  nodes = heap->nodes;
+
+  /* 数组满了就扩大一倍，只增不减，loop关闭时释放 */
+  if (heap->nelts == heap->size) {
+    size = heap->size * 2;
+    if (size < UV__TIMER_HEAP_MIN_SIZE)
+      size = UV__TIMER_HEAP_MIN_SIZE;
+
+    nodes = uv__realloc(nodes, size * sizeof(*nodes));
+    if (nodes == NULL)
+      return UV_ENOMEM;
+
+    heap->nodes = nodes;
+    heap->size = size;
+  }
+
+  i = heap->nelts++;
+  nodes[i].timeout = handle->timeout;
+  nodes[i].start_id = handle->start_id;
+  nodes[i].handle = handle;
+  timer_heap_sift_up(nodes, i);
+
+  return 0;
+}
+
+
+static void timer_heap_remove(struct uv__timer_heap* heap, uv_timer_t* handle) {
+  struct uv__timer_node* nodes;
+  unsigned int nelts;
+  unsigned int i;
+
+  nodes = heap->nodes;
+  nelts = --heap->nelts;
+  i = uv__timer_index(handle);
+  assert(i <= nelts);
+  assert(nodes[i].handle == handle);
+
+  /* 用最后一个节点填上空位，再根据它和父节点的大小往上或者往下调整 */
+  if (i == nelts)
+    return;
+
+  nodes[i] = nodes[nelts];
+  if (i > 0 &&
+      timer_less_than(nodes + i, nodes + (i - 1) / UV__TIMER_HEAP_D))
+    timer_heap_sift_up(nodes, i);
+  else
+    timer_heap_sift_down(nodes, nelts, i);
+}
+
+
+static void timer_wheel_insert(struct uv__timer_wheel* wheel,
+                               uv_timer_t* handle) {
+  uint64_t timeout;
+  uint64_t diff;
+  unsigned int level;
+  QUEUE* q;
+
+  /* 已经过期的放在当前槽里，下一次uv__run_timers()就会执行 */
+  timeout = handle->timeout;
+  if (timeout < wheel->time)
+    timeout = wheel->time;
+
+  diff = timeout ^ wheel->time;
+  for (level = 0; level < UV__WHEEL_LEVELS; level++) {
+    if ((diff >> ((level + 1) * UV__WHEEL_BITS)) == 0)
+      break;
+  }
+
+  if (level == UV__WHEEL_LEVELS)
+    q = &wheel->overflow;
+  else
+    q = &wheel->slots[level][(timeout >> (level * UV__WHEEL_BITS)) &
+                             UV__WHEEL_MASK];
+
+  uv__timer_set_level(handle, level);
+  wheel->count[level]++;
+  QUEUE_INSERT_TAIL(q, uv__timer_queue(handle));
+}
+
+
+static void timer_wheel_remove(struct uv__timer_wheel* wheel,
+                               uv_timer_t* handle) {
+  wheel->count[uv__timer_level(handle)]--;
+  QUEUE_REMOVE(uv__timer_queue(handle));
+}
+
+
+/* 把一个槽里的定时器按照新的wheel->time重新放一遍，顺序不变 */
+static void timer_wheel_cascade(struct uv__timer_wheel* wheel, QUEUE* slot) {
+  uv_timer_t* handle;
+  QUEUE queue;
+  QUEUE* q;
+
+  QUEUE_MOVE(slot, &queue);
+  while (!QUEUE_EMPTY(&queue)) {
+    q = QUEUE_HEAD(&queue);
+    handle = QUEUE_DATA(q, uv_timer_t, heap_node);
+    timer_wheel_remove(wheel, handle);
+    timer_wheel_insert(wheel, handle);
+  }
+}
+
+
+/* wheel->time刚走到新的位置，越过了哪几层的边界就从高到低搬对应的槽 */
+static void timer_wheel_advance(struct uv__timer_wheel* wheel, uint64_t time) {
+  int level;
+
+  wheel->time = time;
+
+  for (level = UV__WHEEL_LEVELS; level > 0; level--)
+    if ((time & UV__WHEEL_SPAN(level)) == 0)
+      break;
+
+  if (level == UV__WHEEL_LEVELS) {
+    timer_wheel_cascade(wheel, &wheel->overflow);
+    level--;
+  }
+
+  for (; level > 0; level--)
+    timer_wheel_cascade(wheel,
+                        &wheel->slots[level][(time >> (level * UV__WHEEL_BITS)) &
+                                             UV__WHEEL_MASK]);
+}
+
+
+static void timer_wheel_run(uv_loop_t* loop) {
+  struct uv__timer_wheel* wheel;
+  uv_timer_t* handle;
+  uint64_t next;
+  unsigned int level;
+  unsigned int i;
+  QUEUE* slot;
+
+  wheel = loop->timer_wheel;
+
+  for (;;) {
+    /* 执行当前这一毫秒到期的定时器，回调里新启动的同一毫秒的定时器也会执行 */
+    slot = &wheel->slots[0][wheel->time & UV__WHEEL_MASK];
+    while (!QUEUE_EMPTY(slot)) {
+      handle = QUEUE_DATA(QUEUE_HEAD(slot), uv_timer_t, heap_node);
+      uv_timer_stop(handle);
+      uv_timer_again(handle);
+      uv__handle_activity(handle);
+      uv__watchdog_enter(loop, UV_TIMER, handle, handle->timer_cb);
+      handle->timer_cb(handle);
+      uv__watchdog_leave(loop);
+    }
+
+    if (wheel->time >= loop->time)
+      break;
+
+    /* 直接跳到最低的非空层里下一个有定时器的槽，中间的空槽和更低的空层都不用
+     * 一毫秒一毫秒地走。当前槽刚刚执行完，一定是空的
+     */
+    for (level = 0; level < UV__WHEEL_LEVELS; level++)
+      if (wheel->count[level] != 0)
+        break;
+
+    if (level == UV__WHEEL_LEVELS) {
+      next = (wheel->time | UV__WHEEL_SPAN(level)) + 1;
+    } else {
+      i = ((wheel->time >> (level * UV__WHEEL_BITS)) & UV__WHEEL_MASK) + 1;
+      while (i < UV__WHEEL_SIZE && QUEUE_EMPTY(&wheel->slots[level][i]))
+        i++;
+      assert(i < UV__WHEEL_SIZE);
+      next = (wheel->time & ~UV__WHEEL_SPAN(level + 1)) |
+             ((uint64_t) i << (level * UV__WHEEL_BITS));
+    }
+
+    /* 到loop->time之前都不会碰到定时器，中间越过的都是空槽 */
+    if (next > loop->time) {
+      wheel->time = loop->time;
+      continue;
+    }
+
+    timer_wheel_advance(wheel, next);
+  }
+}
+
+
+static int timer_wheel_next_timeout(const uv_loop_t* loop) {
+  const struct uv__timer_wheel* wheel;
+  const uv_timer_t* handle;
+  const QUEUE* slot;
+  const QUEUE* q;
+  uint64_t timeout;
+  uint64_t diff;
+  unsigned int level;
+  unsigned int i;
+
+  wheel = loop->timer_wheel;
+  timeout = (uint64_t) -1;
+
+  for (level = 0; level <= UV__WHEEL_LEVELS; level++) {
+    if (wheel->count[level] == 0)
+      continue;
+
+    if (level == UV__WHEEL_LEVELS) {
+      slot = &wheel->overflow;
+    } else {
+      /* 第0层当前槽可能有刚到期的定时器，更高层的当前槽一定是空的 */
+      i = (wheel->time >> (level * UV__WHEEL_BITS)) & UV__WHEEL_MASK;
+      for (; i < UV__WHEEL_SIZE; i++)
+        if (!QUEUE_EMPTY(&wheel->slots[level][i]))
+          break;
+      assert(i < UV__WHEEL_SIZE);
+      slot = &wheel->slots[level][i];
+    }
+
+    /* 第0层一个槽里的超时时间都一样，高层的槽要取最小值 */
+    QUEUE_FOREACH(q, slot) {
+      handle = QUEUE_DATA(q, uv_timer_t, heap_node);
+      if (handle->timeout < timeout)
+        timeout = handle->timeout;
+      if (level == 0)
+        break;
+    }
+    break;
+  }
+
+  if (level > UV__WHEEL_LEVELS)
+    return -1; /* block indefinitely */
+
+  if (timeout <= loop->time)
+    return 0;
+
+  diff = timeout - loop->time;
+  if (diff > INT_MAX)
+    diff = INT_MAX;
+
+  return diff;
+}
+
+
+/* 打开时间轮，只能在loop还没有活动定时器的时候打开 */
+int uv__timer_wheel_enable(uv_loop_t* loop) {
+  struct uv__timer_wheel* wheel;
+  unsigned int level;
+  unsigned int i;
+
+  if (loop->timer_wheel != NULL)
     return 0;
 
+  if (loop->timer_heap.nelts != 0)
+    return UV_EBUSY;
+
+  wheel = uv__malloc(sizeof(*wheel));
+  if (wheel == NULL)
+    return UV_ENOMEM;
+
+  wheel->time = loop->time;
+  for (level = 0; level < UV__WHEEL_LEVELS; level++) {
+    wheel->count[level] = 0;
+    for (i = 0; i < UV__WHEEL_SIZE; i++)
+      QUEUE_INIT(&wheel->slots[level][i]);
+  }
+  wheel->count[UV__WHEEL_LEVELS] = 0;
+  QUEUE_INIT(&wheel->overflow);
+
+  loop->timer_wheel = wheel;
   return 0;
 }
 
+
 /* 初始化一个定时器handle */
 int uv_timer_init(uv_loop_t* loop, uv_timer_t* handle) {
   /* 一个handle的基础初始化，将loop绑定到handle，设置handle类型、标志，并加入
@@ -59,6 +439,7 @@ int uv_timer_init(uv_loop_t* loop, uv_timer_t* handle) {
   uv__handle_init(loop, (uv_handle_t*)handle, UV_TIMER);
   handle->timer_cb = NULL;
   handle->repeat = 0;
+  handle->slack = 0;
   return 0;
 }
 
@@ -67,7 +448,19 @@ int uv_timer_start(uv_timer_t* handle,
                    uv_timer_cb cb,
                    uint64_t timeout,
                    uint64_t repeat) {
+  return uv_timer_start_ex(handle, cb, timeout, repeat, 0);
+}
+
+/* 启动一个允许晚slack毫秒触发的定时器 */
+int uv_timer_start_ex(uv_timer_t* handle,
+                      uv_timer_cb cb,
+                      uint64_t timeout,
+                      uint64_t repeat,
+                      uint64_t slack) {
   uint64_t clamped_timeout;
+  uint64_t latest;
+  uint64_t align;
+  int err;
   /* 定时器回调不能为NULL */
   if (cb == NULL)
     return UV_EINVAL;
@@ -76,40 +469,122 @@ int uv_timer_start(uv_timer_t* handle,
   if (uv__is_active(handle))
     uv_timer_stop(handle);
 
+  handle->flags &= ~UV_HANDLE_TIMER_NS;
+
   /* 计算超时绝对时间，为当前时间loop->time加上timeout */
   clamped_timeout = handle->loop->time + timeout;
   /* TODO: */
   if (clamped_timeout < timeout)
     clamped_timeout = (uint64_t) -1;
 
+  /* 把超时时间推迟到[clamped_timeout, clamped_timeout + slack]里最后一个
+   * align的整数倍，align是不超过slack的最大的2的幂。align取自loop->time的
+   * 绝对刻度，所以slack相近的定时器会对齐到同一个时刻，一次唤醒一起执行
+   */
+  if (slack != 0) {
+    latest = clamped_timeout + slack;
+    if (latest < clamped_timeout)
+      latest = (uint64_t) -1;
+
+    for (align = 1; align <= slack / 2; align *= 2);
+    clamped_timeout = latest & ~(align - 1);
+  }
+
   /* 初始化定时器handle */
   handle->timer_cb = cb;
   handle->timeout = clamped_timeout;
   handle->repeat = repeat;
+  handle->slack = slack;
   /* 
      start_id作为定时器的二级索引，会在uv__timer_cmp()被使用，其值就是loop->timer_counter
   */
   handle->start_id = handle->loop->timer_counter++;
-  /* 将定时器handle中的heap_node插入定时器堆（小根堆）timer_heap */
-  heap_insert((struct heap*) &handle->loop->timer_heap,
-              (struct heap_node*) &handle->heap_node,
-              timer_less_than);
+  /* 将定时器插入定时器堆（小根堆）timer_heap，或者放进时间轮 */
+  if (handle->loop->timer_wheel != NULL) {
+    timer_wheel_insert(handle->loop->timer_wheel, handle);
+  } else {
+    err = timer_heap_insert(uv__timer_heap(handle), handle);
+    if (err)
+      return err;
+  }
   /* 激活定时器handle，也就是修改状态UV_HANDLE_ACTIVE，甚至会改变loop引用计数 */
   uv__handle_start(handle);
 
   return 0;
 }
 
+/* 启动一个纳秒精度的定时器，timeout_ns和repeat_ns都以纳秒计。它不走
+ * uv__next_timeout()算出的轮询超时（只有毫秒精度），而是放进单独的
+ * hrtimer_heap，由内核定时器唤醒loop：Linux上是loop的一个timerfd（按绝对
+ * 时间），macOS上是kqueue的EVFILT_TIMER（NOTE_NSECONDS）。其他平台上向上
+ * 取整成毫秒交给uv_timer_start()
+ */
+int uv_timer_start_ns(uv_timer_t* handle,
+                      uv_timer_cb cb,
+                      uint64_t timeout_ns,
+                      uint64_t repeat_ns) {
+#if defined(UV__HRTIMER)
+  struct uv__timer_heap* heap;
+  uint64_t clamped_timeout;
+  int err;
+
+  if (cb == NULL)
+    return UV_EINVAL;
+
+  if (uv__is_active(handle))
+    uv_timer_stop(handle);
+
+  /* timerfd在第一次用到时才创建，kqueue上不需要额外的fd */
+  err = uv__hrtimer_init(handle->loop);
+  if (err)
+    return err;
+
+  clamped_timeout = uv_hrtime() + timeout_ns;
+  if (clamped_timeout < timeout_ns)
+    clamped_timeout = (uint64_t) -1;
+
+  handle->flags |= UV_HANDLE_TIMER_NS;
+  handle->timer_cb = cb;
+  handle->timeout = clamped_timeout;
+  handle->repeat = repeat_ns;
+  handle->slack = 0;
+  handle->start_id = handle->loop->timer_counter++;
+
+  heap = uv__timer_heap(handle);
+  err = timer_heap_insert(heap, handle);
+  if (err) {
+    handle->flags &= ~UV_HANDLE_TIMER_NS;
+    return err;
+  }
+
+  uv__handle_start(handle);
+
+  /* 成为最早到期的纳秒定时器时才需要重新设置内核定时器 */
+  if (uv__timer_index(handle) == 0)
+    uv__hrtimer_arm(handle->loop, clamped_timeout);
+
+  return 0;
+#else
+  return uv_timer_start(handle,
+                        cb,
+                        (timeout_ns + 999999) / 1000000,
+                        (repeat_ns + 999999) / 1000000);
+#endif
+}
+
 /* 定制一个定时器 */
 int uv_timer_stop(uv_timer_t* handle) {
   /* 如果这个定时器handle不是激活的就直接退出 */
   if (!uv__is_active(handle))
     return 0;
 
-  /* 从定时器最小堆中删除这个定时器节点 */
-  heap_remove((struct heap*) &handle->loop->timer_heap,
-              (struct heap_node*) &handle->heap_node,
-              timer_less_than);
+  /* 从定时器最小堆（或者时间轮）中删除这个定时器节点。最早的纳秒定时器被
+   * 删掉时内核定时器不用改，到期时uv__run_hrtimers()会按新的堆顶重新设置
+   */
+  if (handle->loop->timer_wheel != NULL && !(handle->flags & UV_HANDLE_TIMER_NS))
+    timer_wheel_remove(handle->loop->timer_wheel, handle);
+  else
+    timer_heap_remove(uv__timer_heap(handle), handle);
   /* 将handle标记为非激活状态 */
   uv__handle_stop(handle);
 
@@ -122,8 +597,20 @@ int uv_timer_again(uv_timer_t* handle) {
   if (handle->timer_cb == NULL || handle->repeat == 0)
     return UV_EINVAL;
   
+#if defined(UV__HRTIMER)
+  if (handle->flags & UV_HANDLE_TIMER_NS)
+    return uv_timer_start_ns(handle,
+                             handle->timer_cb,
+                             handle->repeat,
+                             handle->repeat);
+#endif
+
   /* 启动定时器 */
-  uv_timer_start(handle, handle->timer_cb, handle->repeat, handle->repeat);
+  uv_timer_start_ex(handle,
+                    handle->timer_cb,
+                    handle->repeat,
+                    handle->repeat,
+                    handle->slack);
 
   return 0;
 }
@@ -140,23 +627,24 @@ uint64_t uv_timer_get_repeat(const uv_timer_t* handle) {
 
 /* 获取下一个超时时间（即能保证至少有一个定时器超时） */
 int uv__next_timeout(const uv_loop_t* loop) {
-  const struct heap_node* heap_node;
-  const uv_timer_t* handle;
+  const struct uv__timer_node* node;
   uint64_t diff;
 
-  /* 从小顶堆取出根节点 */
-  heap_node = heap_min((const struct heap*) &loop->timer_heap);
-  if (heap_node == NULL)
+  if (loop->timer_wheel != NULL)
+    return timer_wheel_next_timeout(loop);
+
+  /* 堆为空，无限阻塞 */
+  if (loop->timer_heap.nelts == 0)
     return -1; /* block indefinitely */
 
-  /* 根据堆节点还原uv_timer_t结构，典型contaner_of用法 */
-  handle = container_of(heap_node, uv_timer_t, heap_node);
+  /* 小顶堆的根节点就是最早到期的定时器 */
+  node = loop->timer_heap.nodes;
   /* 如果定时器超时时间小于当前时间，也就是已经超时，则直接返回0 */
-  if (handle->timeout <= loop->time)
+  if (node->timeout <= loop->time)
     return 0;
   
   /* 否则就返回超时时间和房钱时间的差值 */
-  diff = handle->timeout - loop->time;
+  diff = node->timeout - loop->time;
   /* 如果差值超过INT最大值，则修正为INT最大值 */
   if (diff > INT_MAX)
     diff = INT_MAX;
@@ -164,33 +652,129 @@ int uv__next_timeout(const uv_loop_t* loop) {
   return diff;
 }
 
+/* 最早的定时器的到期时间，没有定时器时返回0。时间轮只能算出相对loop->time
+ * 的超时，已经过期的定时器按loop->time算
+ */
+uint64_t uv__next_timer_due(const uv_loop_t* loop) {
+  const struct uv__timer_node* node;
+  int timeout;
+
+  if (loop->timer_wheel != NULL) {
+    timeout = timer_wheel_next_timeout(loop);
+    return timeout >= 0 ? loop->time + timeout : 0;
+  }
+
+  if (loop->timer_heap.nelts == 0)
+    return 0;
+
+  node = loop->timer_heap.nodes;
+  return node->timeout;
+}
+
 /* 运行定时器任务 */
 void uv__run_timers(uv_loop_t* loop) {
-  struct heap_node* heap_node;
+  struct uv__timer_node* node;
   uv_timer_t* handle;
-  
+
+  UV__PROBE1(timers__start, loop);
+
+#if defined(UV__HRTIMER)
+  /* loop因为别的原因醒来时顺便把到期的纳秒定时器也执行了 */
+  if (loop->hrtimer_heap.nelts != 0)
+    uv__run_hrtimers(loop);
+#endif
+
+  if (loop->timer_wheel != NULL) {
+    timer_wheel_run(loop);
+    UV__PROBE1(timers__done, loop);
+    return;
+  }
+
   /* 遍历所有定时器任务 */
   for (;;) {
-    /* 从最小堆中取出根节点 */
-    heap_node = heap_min((struct heap*) &loop->timer_heap);
     /* 堆为空，直接跳出循环 */
-    if (heap_node == NULL)
+    if (loop->timer_heap.nelts == 0)
       break;
 
-    /* 根据堆节点还原uv_timer_t结构，典型contaner_of用法 */
-    handle = container_of(heap_node, uv_timer_t, heap_node);
+    /* 从最小堆中取出根节点 */
+    node = loop->timer_heap.nodes;
     /* 如果定时器超时时间timeout大于当前时间loop->time，则定时器都没有超时 */
-    if (handle->timeout > loop->time)
+    if (node->timeout > loop->time)
       break;
 
+    handle = node->handle;
+
     /* 否则，先停止定时器 */
     uv_timer_stop(handle);
     /* 该定时器是否需要自动重复添加 */
     uv_timer_again(handle);
     /* 执行定时器回调 */
+    uv__handle_activity(handle);
+    uv__watchdog_enter(loop, UV_TIMER, handle, handle->timer_cb);
+    handle->timer_cb(handle);
+    uv__watchdog_leave(loop);
+  }
+
+  UV__PROBE1(timers__done, loop);
+}
+
+#if defined(UV__HRTIMER)
+/* 重复的纳秒定时器从上一次的截止时间往后排，回调来晚了误差也不会累积。
+ * 已经落后超过一个周期时截止时间取now，马上补执行一次，不一次补上错过的
+ * 所有周期。刚从堆里删掉，插入不会扩大数组，不会失败
+ */
+static void uv__hrtimer_again(uv_timer_t* handle, uint64_t now) {
+  uint64_t timeout;
+
+  timeout = handle->timeout + handle->repeat;
+  if (timeout < handle->timeout)
+    timeout = (uint64_t) -1;
+  if (timeout < now)
+    timeout = now;
+
+  handle->timeout = timeout;
+  handle->start_id = handle->loop->timer_counter++;
+  if (timer_heap_insert(uv__timer_heap(handle), handle))
+    abort();
+  uv__handle_start(handle);
+}
+
+
+/* 执行所有已经到期的纳秒定时器，然后让内核定时器在新的堆顶到期时唤醒loop。
+ * 时钟只读一次，回调里重新启动的定时器要等下一次才会执行
+ */
+void uv__run_hrtimers(uv_loop_t* loop) {
+  struct uv__timer_node* node;
+  uv_timer_t* handle;
+  uint64_t now;
+
+  now = uv_hrtime();
+
+  while (loop->hrtimer_heap.nelts != 0) {
+    node = loop->hrtimer_heap.nodes;
+    if (node->timeout > now)
+      break;
+
+    handle = node->handle;
+
+    uv_timer_stop(handle);
+    if (handle->repeat != 0)
+      uv__hrtimer_again(handle, now);
+    uv__handle_activity(handle);
+    uv__watchdog_enter(loop, UV_TIMER, handle, handle->timer_cb);
     handle->timer_cb(handle);
+    uv__watchdog_leave(loop);
+  }
+
+  /* 从来没有设置过时uv__hrtimer_arm(loop, 0)什么都不做 */
+  if (loop->hrtimer_heap.nelts != 0) {
+    node = loop->hrtimer_heap.nodes;
+    uv__hrtimer_arm(loop, node->timeout);
+  } else {
+    uv__hrtimer_arm(loop, 0);
   }
 }
+#endif
 
 /* 关闭一个定时器 */
 void uv__timer_close(uv_timer_t* handle) {
@@ -0,0 +1,385 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* loop私有的分级内存池，参见UV_LOOP_ARENA。
+ *
+ * 每块内存前面有一个头部，记着它属于哪一级；大于最大一级的、没有打开内存池的
+ * loop上的、以及不在loop线程里分配的（loop参数为NULL）都直接用uv__malloc()，
+ * 头部标成UV__ARENA_HEAP。所以不管内存池是什么时候打开的，uv__loop_free()
+ * 都知道一块内存应该还到哪里。
+ *
+ * 内存从64KB的大块里顺序切出来，释放的块按级别挂到空闲链表上，只在loop线程
+ * 里使用，不需要加锁。uv_loop_close()时把所有大块一起释放。
+ *
+ * 头部里还记着这块内存的用途和大小，用来按用途统计还没有释放的内存，
+ * 参见uv_mem_stats()。不需要内存池的地方用uv__malloc_tag()和uv__free_tag()。
+ *
+ * 几MB以上的表（比如打开了UV_LOOP_USE_HUGEPAGES的loop->watchers）可以
+ * 用uv__huge_malloc_tag()直接映射大页，头部标成UV__ARENA_MMAP，同样用
+ * uv__free_tag()释放。
+ */
+
+#include "uv.h"
+#include "internal.h"
+#include "atomic-ops.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define UV__ARENA_NCLASSES 8      /* 32、64、...、4096字节 */
+#define UV__ARENA_MIN_SHIFT 5
+#define UV__ARENA_CHUNK_SIZE 65536
+#define UV__ARENA_HEAP UV__ARENA_NCLASSES
+#define UV__ARENA_MMAP (UV__ARENA_NCLASSES + 1)
+
+union uv__arena_header {
+  struct {
+    unsigned int cls;
+    unsigned int tag;
+    size_t size;
+  } h;
+  void* next;                     /* 在空闲链表上时 */
+  double align0;
+  long long align1;
+  void* align2;
+};
+
+struct uv__arena_chunk {
+  struct uv__arena_chunk* next;
+  union uv__arena_header align;
+};
+
+struct uv__arena {
+  union uv__arena_header* free[UV__ARENA_NCLASSES];
+  struct uv__arena_chunk* chunks;
+  char* cur;
+  size_t left;
+};
+
+/* 所有loop共用，可能在任意线程里更新 */
+static struct {
+  long bytes;
+  long count;
+  long total;
+} uv__mem_counters[UV_MEM_TAG_MAX];
+
+
+/* bytes和count是变化量，count为正时算作新的分配 */
+void uv__mem_account(unsigned int tag, long bytes, int count) {
+  assert(tag < UV_MEM_TAG_MAX);
+  fetch_addl(&uv__mem_counters[tag].bytes, bytes);
+  if (count == 0)
+    return;
+  fetch_addl(&uv__mem_counters[tag].count, count);
+  if (count > 0)
+    fetch_addl(&uv__mem_counters[tag].total, count);
+}
+
+
+int uv_mem_stats(uv_mem_tag_t tag, uv_mem_stats_t* stats) {
+  if ((unsigned int) tag >= UV_MEM_TAG_MAX || stats == NULL)
+    return UV_EINVAL;
+
+  stats->bytes = ACCESS_ONCE(long, uv__mem_counters[tag].bytes);
+  stats->count = ACCESS_ONCE(long, uv__mem_counters[tag].count);
+  stats->total = ACCESS_ONCE(long, uv__mem_counters[tag].total);
+  return 0;
+}
+
+
+static uintptr_t uv__hugepage_round(uintptr_t size) {
+  return (size + UV__HUGEPAGE_SIZE - 1) & ~(uintptr_t) (UV__HUGEPAGE_SIZE - 1);
+}
+
+
+/* 映射*size字节（向上取整到2MB，实际大小写回*size）。先试预留的大页
+ * （MAP_HUGETLB，需要vm.nr_hugepages），没有再用普通页映射，按2MB对齐以后
+ * 用MADV_HUGEPAGE请求透明大页；都不支持时就是普通的匿名映射。失败返回NULL。
+ */
+void* uv__hugepage_map(size_t* size) {
+  uintptr_t addr;
+  uintptr_t aligned;
+  size_t len;
+  char* p;
+
+  if (*size == 0 || *size > (size_t) -1 - 2 * UV__HUGEPAGE_SIZE)
+    return NULL;
+
+  len = uv__hugepage_round(*size);
+
+#ifdef MAP_HUGETLB
+  p = mmap(NULL,
+           len,
+           PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+           -1,
+           0);
+  if (p != MAP_FAILED) {
+    *size = len;
+    return p;
+  }
+#endif
+
+  /* 多映射一个大页，裁掉首尾让起始地址按2MB对齐，透明大页才能覆盖整段 */
+  p = mmap(NULL,
+           len + UV__HUGEPAGE_SIZE,
+           PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS,
+           -1,
+           0);
+  if (p == MAP_FAILED)
+    return NULL;
+
+  addr = (uintptr_t) p;
+  aligned = uv__hugepage_round(addr);
+  if (aligned != addr)
+    munmap(p, aligned - addr);
+  if (aligned - addr != UV__HUGEPAGE_SIZE)
+    munmap((char*) aligned + len, UV__HUGEPAGE_SIZE - (aligned - addr));
+
+#ifdef MADV_HUGEPAGE
+  madvise((void*) aligned, len, MADV_HUGEPAGE);
+#endif
+
+  *size = len;
+  return (void*) aligned;
+}
+
+
+void uv__hugepage_unmap(void* p, size_t size) {
+  if (p != NULL)
+    munmap(p, size);
+}
+
+
+static size_t uv__arena_block_size(unsigned int cls) {
+  return sizeof(union uv__arena_header) +
+         ((size_t) 1 << (cls + UV__ARENA_MIN_SHIFT));
+}
+
+
+static union uv__arena_header* uv__arena_alloc(struct uv__arena* arena,
+                                               unsigned int cls) {
+  struct uv__arena_chunk* chunk;
+  union uv__arena_header* h;
+  size_t size;
+
+  h = arena->free[cls];
+  if (h != NULL) {
+    arena->free[cls] = h->next;
+    return h;
+  }
+
+  /* 当前大块剩下的不够就丢掉，换一个新的 */
+  size = uv__arena_block_size(cls);
+  if (arena->left < size) {
+    chunk = uv__malloc(UV__ARENA_CHUNK_SIZE);
+    if (chunk == NULL)
+      return NULL;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->cur = (char*) &chunk->align;
+    arena->left = UV__ARENA_CHUNK_SIZE - offsetof(struct uv__arena_chunk, align);
+  }
+
+  h = (union uv__arena_header*) arena->cur;
+  arena->cur += size;
+  arena->left -= size;
+  return h;
+}
+
+
+void* uv__loop_malloc(uv_loop_t* loop, unsigned int tag, size_t size) {
+  union uv__arena_header* h;
+  unsigned int cls;
+
+  cls = 0;
+  while (cls < UV__ARENA_NCLASSES &&
+         size > (size_t) 1 << (cls + UV__ARENA_MIN_SHIFT))
+    cls++;
+
+  if (loop == NULL || loop->arena == NULL)
+    cls = UV__ARENA_HEAP;
+
+  if (cls == UV__ARENA_HEAP) {
+    if (size > (size_t) -1 - sizeof(*h))
+      return NULL;
+    h = uv__malloc(sizeof(*h) + size);
+  } else {
+    h = uv__arena_alloc(loop->arena, cls);
+  }
+
+  if (h == NULL)
+    return NULL;
+
+  h->h.cls = cls;
+  h->h.tag = tag;
+  h->h.size = size;
+  uv__mem_account(tag, (long) size, 1);
+  return h + 1;
+}
+
+
+void uv__loop_free(uv_loop_t* loop, void* ptr) {
+  struct uv__arena* arena;
+  union uv__arena_header* h;
+  unsigned int cls;
+
+  if (ptr == NULL)
+    return;
+
+  h = (union uv__arena_header*) ptr - 1;
+  cls = h->h.cls;
+  uv__mem_account(h->h.tag, -(long) h->h.size, -1);
+
+  if (cls == UV__ARENA_HEAP) {
+    uv__free(h);
+    return;
+  }
+
+  if (cls == UV__ARENA_MMAP) {
+    uv__hugepage_unmap(h, uv__hugepage_round(sizeof(*h) + h->h.size));
+    return;
+  }
+
+  assert(cls < UV__ARENA_NCLASSES);
+  arena = loop->arena;
+  assert(arena != NULL);
+  h->next = arena->free[cls];
+  arena->free[cls] = h;
+}
+
+
+void* uv__malloc_tag(unsigned int tag, size_t size) {
+  return uv__loop_malloc(NULL, tag, size);
+}
+
+
+/* 不到一个大页的还是用uv__malloc_tag()，映射失败时也退回去 */
+void* uv__huge_malloc_tag(unsigned int tag, size_t size) {
+  union uv__arena_header* h;
+  size_t len;
+
+  if (size > (size_t) -1 - sizeof(*h) ||
+      sizeof(*h) + size < UV__HUGEPAGE_SIZE)
+    return uv__malloc_tag(tag, size);
+
+  len = sizeof(*h) + size;
+  h = uv__hugepage_map(&len);
+  if (h == NULL)
+    return uv__malloc_tag(tag, size);
+
+  h->h.cls = UV__ARENA_MMAP;
+  h->h.tag = tag;
+  h->h.size = size;
+  uv__mem_account(tag, (long) size, 1);
+  return h + 1;
+}
+
+
+/* 换到新分配的p上：复制内容，释放ptr */
+static void* uv__arena_move(void* p, void* ptr, size_t size) {
+  union uv__arena_header* h;
+
+  if (p == NULL || ptr == NULL)
+    return p;
+
+  h = (union uv__arena_header*) ptr - 1;
+  memcpy(p, ptr, h->h.size < size ? h->h.size : size);
+  uv__free_tag(ptr);
+  return p;
+}
+
+
+/* 和uv__realloc_tag()一样，但是新的大小够一个大页时换成大页映射 */
+void* uv__huge_realloc_tag(unsigned int tag, void* ptr, size_t size) {
+  if (size > (size_t) -1 - sizeof(union uv__arena_header) ||
+      sizeof(union uv__arena_header) + size < UV__HUGEPAGE_SIZE)
+    return uv__realloc_tag(tag, ptr, size);
+
+  return uv__arena_move(uv__huge_malloc_tag(tag, size), ptr, size);
+}
+
+
+/* ptr必须是uv__malloc_tag()、uv__huge_malloc_tag()或者它们的realloc分配的 */
+void* uv__realloc_tag(unsigned int tag, void* ptr, size_t size) {
+  union uv__arena_header* h;
+
+  if (ptr == NULL)
+    return uv__malloc_tag(tag, size);
+
+  if (size > (size_t) -1 - sizeof(*h))
+    return NULL;
+
+  h = (union uv__arena_header*) ptr - 1;
+  assert(h->h.tag == tag);
+
+  /* 大页映射不能原地扩展 */
+  if (h->h.cls == UV__ARENA_MMAP)
+    return uv__arena_move(uv__huge_malloc_tag(tag, size), ptr, size);
+
+  assert(h->h.cls == UV__ARENA_HEAP);
+  h = uv__realloc(h, sizeof(*h) + size);
+  if (h == NULL)
+    return NULL;
+
+  uv__mem_account(tag, (long) size - (long) h->h.size, 0);
+  h->h.size = size;
+  return h + 1;
+}
+
+
+void uv__free_tag(void* ptr) {
+  uv__loop_free(NULL, ptr);
+}
+
+
+int uv__arena_enable(uv_loop_t* loop) {
+  if (loop->arena != NULL)
+    return 0;
+
+  loop->arena = uv__calloc(1, sizeof(struct uv__arena));
+  if (loop->arena == NULL)
+    return UV_ENOMEM;
+
+  return 0;
+}
+
+
+void uv__arena_delete(uv_loop_t* loop) {
+  struct uv__arena_chunk* chunk;
+  struct uv__arena* arena;
+
+  arena = loop->arena;
+  if (arena == NULL)
+    return;
+
+  while (arena->chunks != NULL) {
+    chunk = arena->chunks;
+    arena->chunks = chunk->next;
+    uv__free(chunk);
+  }
+
+  uv__free(arena);
+  loop->arena = NULL;
+}
@@ -34,34 +34,125 @@
 #include <unistd.h>
 
 static void uv__async_send(uv_loop_t* loop);
-static int uv__async_start(uv_loop_t* loop);
 static int uv__async_eventfd(void);
 
 
-/* 初始化一个异步uv_async_t handle */
-int uv_async_init(uv_loop_t* loop, uv_async_t* handle, uv_async_cb async_cb) {
-  int err;
+/* kqueue上EVFILT_USER方式的唤醒没有fd，用loop标志记录是否已经启动 */
+static int uv__async_started(const uv_loop_t* loop) {
+  return loop->async_io_watcher.fd != -1 ||
+         (loop->flags & UV_LOOP_ASYNC_EVFILT_USER) != 0;
+}
 
-  /* 启动异步事件监听 */
-  err = uv__async_start(loop);
-  if (err)
-    return err;
 
+#if defined(UV__KQUEUE_EVFILT_USER)
+static int uv__async_evfilt_user(uv_loop_t* loop,
+                                 unsigned short flags,
+                                 unsigned int fflags) {
+  struct kevent ev;
+  int r;
+
+  EV_SET(&ev, UV__KQUEUE_EVFILT_USER_IDENT, EVFILT_USER, flags, fflags, 0, 0);
+
+  do
+    r = kevent(loop->backend_fd, &ev, 1, NULL, 0, NULL);
+  while (r == -1 && errno == EINTR);
+
+  if (r == -1)
+    return UV__ERR(errno);
+
+  return 0;
+}
+#endif
+
+
+/* loop->async_pending是一个无锁栈（Treiber stack），把pending从0改成1的线程
+ * 负责把handle压进去，loop线程一次把整个栈取走，所以uv__async_io()只需要处理
+ * 真正收到通知的handle，不用扫描loop->async_handles。handle在栈上时pending
+ * 一直是1，其他线程不会再压它，pending_next只在这期间有效。
+ */
+static void* uv__async_cas(void** ptr, void* oldval, void* newval) {
+  return (void*) cmpxchgl((long*) ptr, (long) oldval, (long) newval);
+}
+
+
+static void uv__async_push(uv_loop_t* loop, uv_async_t* handle) {
+  void* head;
+
+  do {
+    head = *(void* volatile*) &loop->async_pending;
+    handle->pending_next = head;
+  } while (uv__async_cas(&loop->async_pending, head, handle) != head);
+}
+
+
+/* 取走整个栈，返回按压栈先后排好的链表 */
+static uv_async_t* uv__async_take(uv_loop_t* loop) {
+  uv_async_t* list;
+  uv_async_t* next;
+  uv_async_t* h;
+  void* head;
+
+  do
+    head = *(void* volatile*) &loop->async_pending;
+  while (head != NULL &&
+         uv__async_cas(&loop->async_pending, head, NULL) != head);
+
+  /* 栈是后进先出的，反转一下，回调按uv_async_send()的先后执行 */
+  list = NULL;
+  for (h = head; h != NULL; h = next) {
+    next = h->pending_next;
+    h->pending_next = list;
+    list = h;
+  }
+
+  return list;
+}
+
+
+static void uv__async_handle_init(uv_loop_t* loop,
+                                  uv_async_t* handle,
+                                  uv_async_cb async_cb) {
   /* 初始化handle,绑定loop，设置类型等 */
   uv__handle_init(loop, (uv_handle_t*)handle, UV_ASYNC);
   /* 设置该handle的回调 */
   handle->async_cb = async_cb;
   /* handle悬挂标志，为1表示有异步事件需要处理 */
   handle->pending = 0;
+  /* uv_async_send_data()发来的消息，也是一个无锁栈 */
+  handle->msgs = NULL;
 
   /* 将该handle插入loop->async_handles队列，以便回调的时候可以找到 */
   QUEUE_INSERT_TAIL(&loop->async_handles, &handle->queue);
   /* 激活该handle */
   uv__handle_start(handle);
+}
+
+
+/* 初始化一个异步uv_async_t handle */
+int uv_async_init(uv_loop_t* loop, uv_async_t* handle, uv_async_cb async_cb) {
+  int err;
+
+  /* 启动异步事件监听 */
+  err = uv__async_start(loop);
+  if (err)
+    return err;
+
+  uv__async_handle_init(loop, handle, async_cb);
 
   return 0;
 }
 
+
+/* 和uv_async_init()一样，只是先不创建eventfd，第一次uv_async_send()之前由
+ * loop线程调用uv__async_start()。loop->wq_async用它，没有用过线程池的loop
+ * 不占fd
+ */
+void uv__async_init_lazy(uv_loop_t* loop,
+                         uv_async_t* handle,
+                         uv_async_cb async_cb) {
+  uv__async_handle_init(loop, handle, async_cb);
+}
+
 /* 发送异步通知 */
 int uv_async_send(uv_async_t* handle) {
   /* Do a cheap read first. 
@@ -70,34 +161,159 @@ int uv_async_send(uv_async_t* handle) {
   if (ACCESS_ONCE(int, handle->pending) != 0)
     return 0;
 
-  /* 原子比较并交换,将该handle的pending原子修改为1，表示有异步事件需要处理 */
-  if (cmpxchgi(&handle->pending, 0, 1) == 0)
-    uv__async_send(handle->loop);/* 向loop发送异步通知 */
+  /* 原子比较并交换,将该handle的pending原子修改为1，表示有异步事件需要处理，
+   * 成功的线程把handle压到loop->async_pending上，再向loop发送异步通知
+   */
+  if (cmpxchgi(&handle->pending, 0, 1) == 0) {
+    uv__async_push(handle->loop, handle);
+    /* loop正在执行回调时不用唤醒它，进入轮询之前它会自己检查async_pending。
+     * 压栈的CAS是一个完整的内存屏障，和uv__async_before_poll()里的配对
+     */
+    if (ACCESS_ONCE(int, handle->loop->async_busy) == 0)
+      uv__async_send(handle->loop);
+  }
 
   return 0;
 }
 
+/* 发送一条消息。消息要在pending从1改成0之前压进去，loop清0 pending之后才会
+ * 调用回调，所以回调里的uv_async_recv_data()一定能拿到它；清0之后压进去的
+ * 消息会再唤醒loop一次
+ */
+int uv_async_send_data(uv_async_t* handle, uv_async_msg_t* msg) {
+  void* head;
+
+  do {
+    head = *(void* volatile*) &handle->msgs;
+    msg->next = head;
+  } while (uv__async_cas(&handle->msgs, head, msg) != head);
+
+  return uv_async_send(handle);
+}
+
+/* 取走所有消息，反转成先发送的在前 */
+uv_async_msg_t* uv_async_recv_data(uv_async_t* handle) {
+  uv_async_msg_t* list;
+  uv_async_msg_t* next;
+  uv_async_msg_t* msg;
+  void* head;
+
+  do
+    head = *(void* volatile*) &handle->msgs;
+  while (head != NULL && uv__async_cas(&handle->msgs, head, NULL) != head);
+
+  list = NULL;
+  for (msg = head; msg != NULL; msg = next) {
+    next = msg->next;
+    msg->next = list;
+    list = msg;
+  }
+
+  return list;
+}
+
 /* 关闭一个异步handle */
 void uv__async_close(uv_async_t* handle) {
+  uv_async_t* list;
+  uv_async_t* next;
+  uv_async_t* h;
+
+  /* 还在async_pending上的话要拿下来，handle关闭之后内存就可能被释放。
+   * 其他handle按原来的顺序放回去
+   */
+  if (ACCESS_ONCE(int, handle->pending) != 0) {
+    list = uv__async_take(handle->loop);
+    for (h = list; h != NULL; h = h->pending_next)
+      if (h->pending_next == handle)
+        h->pending_next = handle->pending_next;
+    if (list == handle)
+      list = handle->pending_next;
+
+    /* 先压的在栈底，之后的uv__async_take()反转时顺序不变 */
+    for (h = list; h != NULL; h = next) {
+      next = h->pending_next;
+      uv__async_push(handle->loop, h);
+    }
+  }
+
   /* 将该handle从loop->async_handles队列移除 */
   QUEUE_REMOVE(&handle->queue);
   /* 失效该handle */
   uv__handle_stop(handle);
 }
 
+/* 执行收到通知的handle的回调 */
+static void uv__async_dispatch(uv_loop_t* loop) {
+  uv_async_t* next;
+  uv_async_t* h;
+
+  /* 只处理收到通知的handle。回调里关闭的handle会被uv__async_close()从
+   * async_pending上拿下来，但不会从这里取走的链表上拿走，所以回调之前就要
+   * 读出下一个，回调里关掉链表后面的handle由UV_HANDLE_CLOSING跳过
+   */
+  for (h = uv__async_take(loop); h != NULL; h = next) {
+    next = h->pending_next;
+
+    /* pending清0之后其他线程就可以再次把它压到async_pending上 */
+    if (cmpxchgi(&h->pending, 1, 0) == 0)
+      continue;
+
+    if (uv__is_closing(h))
+      continue;
+
+    /* uv_async_t是否设置回调函数 */
+    if (h->async_cb == NULL)
+      continue;
+
+    /* 回调uv_async_t的回调函数 */
+    uv__handle_activity(h);
+    /* 线程池的done回调各自由看门狗记录 */
+    if (h == &loop->wq_async)
+      uv__watchdog_enter_internal(loop, UV_ASYNC, h, h->async_cb);
+    else
+      uv__watchdog_enter(loop, UV_ASYNC, h, h->async_cb);
+    h->async_cb(h);
+    uv__watchdog_leave(loop);
+  }
+}
+
+/* loop即将阻塞在轮询里，之后的uv_async_send()都要写fd唤醒它。async_busy清0
+ * 之后再看一次async_pending，和uv_async_send()一起保证不会丢通知：要么发送方
+ * 看到async_busy为0去写fd，要么这里看到它压的handle。返回非0表示有通知没有
+ * 写fd，轮询不能阻塞
+ */
+int uv__async_before_poll(uv_loop_t* loop) {
+  cmpxchgi(&loop->async_busy, 1, 0);
+  return *(void* volatile*) &loop->async_pending != NULL;
+}
+
+/* 轮询返回了，执行那些因为loop正忙而没有写fd的通知 */
+void uv__async_after_poll(uv_loop_t* loop) {
+  loop->async_busy = 1;
+  if (*(void* volatile*) &loop->async_pending != NULL)
+    uv__async_dispatch(loop);
+}
+
+/* 退出uv_run()时loop可能由别人通过uv_backend_fd()来轮询，还没处理的通知要
+ * 补写一次fd
+ */
+void uv__async_leave(uv_loop_t* loop) {
+  if (uv__async_before_poll(loop))
+    uv__async_send(loop);
+}
+
 /* 异步事件回调 */
 static void uv__async_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
   char buf[1024];
   ssize_t r;
-  QUEUE queue;
-  QUEUE* q;
-  uv_async_t* h;
 
   /* watcher必须是loop->async_io_watcher */
   assert(w == &loop->async_io_watcher);
 
-  /* 将fd的内容读到buf，内容是什么没有关系 */
-  for (;;) {
+  /* 将fd的内容读到buf，内容是什么没有关系。EVFILT_USER方式没有fd，
+   * 事件是EV_CLEAR的，收到以后就已经复位了
+   */
+  while (w->fd != -1) {
     /* 从异步事件描述符读取 */
     r = read(w->fd, buf, sizeof(buf));
 
@@ -120,31 +336,7 @@ static void uv__async_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
     abort();
   }
 
-  /* 将loop->async_handles上的队列移动到queue */
-  QUEUE_MOVE(&loop->async_handles, &queue);
-  /* 遍历queue */
-  while (!QUEUE_EMPTY(&queue)) {
-    /* 取queue头结点 */
-    q = QUEUE_HEAD(&queue);
-    /* 还原uv_async_t结构 */
-    h = QUEUE_DATA(q, uv_async_t, queue);
-
-    /* 移除该节点 */
-    QUEUE_REMOVE(q);
-    /* 再次将该节点插入loop->async_handles */
-    QUEUE_INSERT_TAIL(&loop->async_handles, q);
-
-    /* 只有pending为1的handle才需要被处理，将uv_async_t->pending原子设置为0 */
-    if (cmpxchgi(&h->pending, 1, 0) == 0)
-      continue;
-
-    /* uv_async_t是否设置回调函数 */
-    if (h->async_cb == NULL)
-      continue;
-
-    /* 回调uv_async_t的回调函数 */
-    h->async_cb(h);
-  }
+  uv__async_dispatch(loop);
 }
 
 /* 向loop发送异步通知 */
@@ -154,6 +346,15 @@ static void uv__async_send(uv_loop_t* loop) {
   int fd;
   int r;
 
+#if defined(UV__KQUEUE_EVFILT_USER)
+  /* 触发loop的kqueue上的EVFILT_USER事件，不经过任何fd */
+  if (loop->flags & UV_LOOP_ASYNC_EVFILT_USER) {
+    if (uv__async_evfilt_user(loop, 0, NOTE_TRIGGER))
+      abort();
+    return;
+  }
+#endif
+
   buf = "";
   len = 1;
   /* 获取异步通知文件描述符，注意这里有两种情况
@@ -190,14 +391,26 @@ static void uv__async_send(uv_loop_t* loop) {
 }
 
 /* 启动异步事件监听 */
-static int uv__async_start(uv_loop_t* loop) {
+int uv__async_start(uv_loop_t* loop) {
   int pipefd[2];
   int err;
 
   /* 如果已经初始化过就直接返回  */
-  if (loop->async_io_watcher.fd != -1)
+  if (uv__async_started(loop))
     return 0;
 
+#if defined(UV__KQUEUE_EVFILT_USER)
+  /* 优先使用EVFILT_USER，不占fd，发送时也不用写管道、接收时不用读。
+   * 内核不支持的话退回到管道
+   */
+  if (uv__async_evfilt_user(loop, EV_ADD | EV_CLEAR, 0) == 0) {
+    uv__io_init(&loop->async_io_watcher, uv__async_io, -1);
+    loop->async_wfd = -1;
+    loop->flags |= UV_LOOP_ASYNC_EVFILT_USER;
+    return 0;
+  }
+#endif
+
   /* 创建eventfd */
   err = uv__async_eventfd();
   if (err >= 0) {
@@ -244,7 +457,7 @@ static int uv__async_start(uv_loop_t* loop) {
 /*  */
 int uv__async_fork(uv_loop_t* loop) {
   /*  */
-  if (loop->async_io_watcher.fd == -1) /* never started */
+  if (!uv__async_started(loop)) /* never started */
     return 0;
 
   /*  */
@@ -255,6 +468,15 @@ int uv__async_fork(uv_loop_t* loop) {
 
 /* 停止异步事件 */
 void uv__async_stop(uv_loop_t* loop) {
+#if defined(UV__KQUEUE_EVFILT_USER)
+  /* fork之后kqueue是新建的，上面没有这个事件，删除失败不要紧 */
+  if (loop->flags & UV_LOOP_ASYNC_EVFILT_USER) {
+    uv__async_evfilt_user(loop, EV_DELETE, 0);
+    loop->flags &= ~UV_LOOP_ASYNC_EVFILT_USER;
+    return;
+  }
+#endif
+
   /* 如果loop->async_io_watcher.fd无效直接退出 */
   if (loop->async_io_watcher.fd == -1)
     return;
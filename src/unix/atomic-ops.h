@@ -24,6 +24,13 @@
 
 UV_UNUSED(static int cmpxchgi(int* ptr, int oldval, int newval));
 UV_UNUSED(static long cmpxchgl(long* ptr, long oldval, long newval));
+UV_UNUSED(static int fetch_addi(int* ptr, int n));
+UV_UNUSED(static long fetch_addl(long* ptr, long n));
+UV_UNUSED(static int load_acquirei(int* ptr));
+UV_UNUSED(static void store_releasei(int* ptr, int val));
+UV_UNUSED(static void* load_acquirep(void** ptr));
+UV_UNUSED(static void store_releasep(void** ptr, void* val));
+UV_UNUSED(static void* xchgp(void** ptr, void* val));
 UV_UNUSED(static void cpu_relax(void));
 
 /* Prefer hand-rolled assembly over the gcc builtins because the latter also
@@ -91,6 +98,103 @@ UV_UNUSED(static long cmpxchgl(long* ptr, long oldval, long newval)) {
 #endif
 }
 
+/* 原子地把*ptr加上n，返回原来的值 */
+UV_UNUSED(static int fetch_addi(int* ptr, int n)) {
+#if defined(__i386__) || defined(__x86_64__)
+  __asm__ __volatile__ ("lock; xadd %0, %1;"
+                        : "+r" (n), "+m" (*(volatile int*) ptr)
+                        :
+                        : "memory");
+  return n;
+#elif (defined(_AIX) && defined(__xlC__)) || defined(__MVS__) || \
+      defined(__SUNPRO_C) || defined(__SUNPRO_CC)
+  int val;
+
+  do
+    val = *(volatile int*) ptr;
+  while (cmpxchgi(ptr, val, (int) ((unsigned int) val + n)) != val);
+
+  return val;
+#else
+  return __sync_fetch_and_add(ptr, n);
+#endif
+}
+
+UV_UNUSED(static long fetch_addl(long* ptr, long n)) {
+#if defined(__i386__) || defined(__x86_64__)
+  __asm__ __volatile__ ("lock; xadd %0, %1;"
+                        : "+r" (n), "+m" (*(volatile long*) ptr)
+                        :
+                        : "memory");
+  return n;
+#elif (defined(_AIX) && defined(__xlC__)) || defined(__MVS__) || \
+      defined(__SUNPRO_C) || defined(__SUNPRO_CC)
+  long val;
+
+  do
+    val = *(volatile long*) ptr;
+  while (cmpxchgl(ptr, val, (long) ((unsigned long) val + n)) != val);
+
+  return val;
+#else
+  return __sync_fetch_and_add(ptr, n);
+#endif
+}
+
+/* 带acquire/release语义的读写。没有__atomic内建函数的编译器用cmpxchg代替，
+ * 它是完整的内存屏障，比需要的更强。
+ */
+UV_UNUSED(static int load_acquirei(int* ptr)) {
+#if defined(__ATOMIC_ACQUIRE)
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#else
+  return cmpxchgi(ptr, 0, 0);
+#endif
+}
+
+UV_UNUSED(static void store_releasei(int* ptr, int val)) {
+#if defined(__ATOMIC_RELEASE)
+  __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+#else
+  int old;
+
+  do
+    old = *(volatile int*) ptr;
+  while (cmpxchgi(ptr, old, val) != old);
+#endif
+}
+
+UV_UNUSED(static void* load_acquirep(void** ptr)) {
+#if defined(__ATOMIC_ACQUIRE)
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#else
+  return (void*) cmpxchgl((long*) ptr, 0, 0);
+#endif
+}
+
+UV_UNUSED(static void store_releasep(void** ptr, void* val)) {
+#if defined(__ATOMIC_RELEASE)
+  __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+#else
+  xchgp(ptr, val);
+#endif
+}
+
+/* 原子地把*ptr换成val，返回原来的值，同时是完整的内存屏障 */
+UV_UNUSED(static void* xchgp(void** ptr, void* val)) {
+#if defined(__ATOMIC_SEQ_CST)
+  return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+#else
+  long old;
+
+  do
+    old = *(volatile long*) ptr;
+  while (cmpxchgl((long*) ptr, old, (long) val) != old);
+
+  return (void*) old;
+#endif
+}
+
 UV_UNUSED(static void cpu_relax(void)) {
 #if defined(__i386__) || defined(__x86_64__)
   __asm__ __volatile__ ("rep; nop");  /* a.k.a. PAUSE */
@@ -0,0 +1,153 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* 无锁的SPSC环形缓冲区和MPSC链表队列 */
+
+#include "uv.h"
+#include "internal.h"
+#include "atomic-ops.h"
+
+#include <limits.h>
+
+
+int uv_spsc_ring_init(uv_spsc_ring_t* ring, unsigned int capacity) {
+  unsigned int size;
+
+  if (capacity == 0 || capacity > UINT_MAX / 2 + 1)
+    return UV_EINVAL;
+
+  for (size = 1; size < capacity; size <<= 1);
+
+  ring->slots = uv__calloc(size, sizeof(*ring->slots));
+  if (ring->slots == NULL)
+    return UV_ENOMEM;
+
+  ring->mask = size - 1;
+  ring->head = 0;
+  ring->tail_cache = 0;
+  ring->tail = 0;
+  ring->head_cache = 0;
+
+  return 0;
+}
+
+
+void uv_spsc_ring_destroy(uv_spsc_ring_t* ring) {
+  uv__free(ring->slots);
+  ring->slots = NULL;
+}
+
+
+/* head和tail一直往上加，用的时候和mask相与，tail - head就是元素个数。
+ * 每一方先看自己缓存的对方下标，只有看起来满了或者空了才去读对方的cache line。
+ */
+int uv_spsc_ring_push(uv_spsc_ring_t* ring, void* item) {
+  unsigned int tail;
+
+  tail = ring->tail;
+  if (tail - ring->head_cache > ring->mask) {
+    ring->head_cache = load_acquirei((int*) &ring->head);
+    if (tail - ring->head_cache > ring->mask)
+      return UV_EAGAIN;
+  }
+
+  ring->slots[tail & ring->mask] = item;
+  store_releasei((int*) &ring->tail, tail + 1);
+
+  return 0;
+}
+
+
+int uv_spsc_ring_pop(uv_spsc_ring_t* ring, void** item) {
+  unsigned int head;
+
+  head = ring->head;
+  if (head == ring->tail_cache) {
+    ring->tail_cache = load_acquirei((int*) &ring->tail);
+    if (head == ring->tail_cache)
+      return UV_EAGAIN;
+  }
+
+  *item = ring->slots[head & ring->mask];
+  store_releasei((int*) &ring->head, head + 1);
+
+  return 0;
+}
+
+
+/* Dmitry Vyukov的无锁MPSC队列：生产者用一次原子交换把节点挂到head上，再把
+ * 前一个节点的next指向它；消费者从tail往后取。stub节点保证队列里永远至少有
+ * 一个节点，这样最后一个元素也能被取走。
+ */
+void uv_mpsc_queue_init(uv_mpsc_queue_t* queue) {
+  queue->stub.next = NULL;
+  queue->head = &queue->stub;
+  queue->tail = &queue->stub;
+}
+
+
+void uv_mpsc_queue_push(uv_mpsc_queue_t* queue, uv_mpsc_node_t* node) {
+  uv_mpsc_node_t* prev;
+
+  node->next = NULL;
+  prev = xchgp((void**) &queue->head, node);
+  /* 在这之前消费者从prev走不到node */
+  store_releasep((void**) &prev->next, node);
+}
+
+
+uv_mpsc_node_t* uv_mpsc_queue_pop(uv_mpsc_queue_t* queue) {
+  uv_mpsc_node_t* tail;
+  uv_mpsc_node_t* next;
+  uv_mpsc_node_t* head;
+
+  tail = queue->tail;
+  next = load_acquirep((void**) &tail->next);
+
+  /* 跳过stub */
+  if (tail == &queue->stub) {
+    if (next == NULL)
+      return NULL;
+    queue->tail = next;
+    tail = next;
+    next = load_acquirep((void**) &tail->next);
+  }
+
+  if (next != NULL) {
+    queue->tail = next;
+    return tail;
+  }
+
+  /* tail是最后一个节点，或者有生产者已经换了head但还没有挂上next */
+  head = load_acquirep((void**) &queue->head);
+  if (tail != head)
+    return NULL;
+
+  /* 把stub重新放回去，才能把tail取走 */
+  uv_mpsc_queue_push(queue, &queue->stub);
+  next = load_acquirep((void**) &tail->next);
+  if (next != NULL) {
+    queue->tail = next;
+    return tail;
+  }
+
+  return NULL;
+}
@@ -103,6 +103,59 @@ uint64_t uv_hrtime(void) {
   return uv__hrtime(UV_CLOCK_PRECISE);
 }
 
+
+#if !defined(__linux__)
+int uv_get_memory_stats(uv_memory_stats_t* stats) {
+  size_t rss;
+  int err;
+
+  err = uv_resident_set_memory(&rss);
+  if (err)
+    return err;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->rss = rss;
+  return 0;
+}
+
+
+int uv_cpu_times(struct uv_cpu_times_s* times, int* count) {
+  uv_cpu_info_t* cpus;
+  int ncpus;
+  int err;
+  int i;
+
+  if (*count < 0 || (*count > 0 && times == NULL))
+    return UV_EINVAL;
+
+  err = uv_cpu_info(&cpus, &ncpus);
+  if (err)
+    return err;
+
+  if (ncpus > *count) {
+    *count = ncpus;
+    uv_free_cpu_info(cpus, ncpus);
+    return UV_ENOBUFS;
+  }
+
+  for (i = 0; i < ncpus; i++)
+    times[i] = cpus[i].cpu_times;
+
+  *count = ncpus;
+  uv_free_cpu_info(cpus, ncpus);
+  return 0;
+}
+#endif
+
+
+int uv_hrtime_use_tsc(int enable) {
+#if defined(__linux__)
+  return uv__hrtime_use_tsc(enable);
+#else
+  return enable ? UV_ENOSYS : 0;
+#endif
+}
+
 /*  */
 void uv_close(uv_handle_t* handle, uv_close_cb close_cb) {
   /*  */
@@ -122,7 +175,7 @@ void uv_close(uv_handle_t* handle, uv_close_cb close_cb) {
 
   /*  */
   case UV_TTY:
-    uv__stream_close((uv_stream_t*)handle);
+    uv__tty_close((uv_tty_t*)handle);
     break;
 
   /*  */
@@ -135,6 +188,21 @@ void uv_close(uv_handle_t* handle, uv_close_cb close_cb) {
     uv__udp_close((uv_udp_t*)handle);
     break;
 
+  /*  */
+  case UV_XDP:
+    uv__xdp_close((uv_xdp_t*)handle);
+    break;
+
+  /*  */
+  case UV_IFACE_WATCH:
+    uv__iface_watch_close((uv_iface_watch_t*)handle);
+    break;
+
+  /*  */
+  case UV_SHM_CHANNEL:
+    uv__shm_channel_close((uv_shm_channel_t*)handle);
+    break;
+
   /*  */
   case UV_PREPARE:
     uv__prepare_close((uv_prepare_t*)handle);
@@ -194,6 +262,42 @@ void uv_close(uv_handle_t* handle, uv_close_cb close_cb) {
   uv__make_close_pending(handle);
 }
 
+/* uv_close()之后fd马上就被关掉的handle，标准输入输出的fd不会关 */
+static int uv__close_nodel(uv_handle_t* handle) {
+  switch (handle->type) {
+  case UV_NAMED_PIPE:
+  case UV_TCP:
+    return uv__stream_fd((uv_stream_t*) handle) > STDERR_FILENO;
+  case UV_UDP:
+    return ((uv_udp_t*) handle)->io_watcher.fd > STDERR_FILENO;
+  default:
+    return 0;
+  }
+}
+
+
+void uv_close_many(uv_handle_t* handles[],
+                   unsigned int n,
+                   uv_close_cb close_cb) {
+  uv_handle_t* handle;
+  unsigned int i;
+
+  for (i = 0; i < n; i++) {
+    handle = handles[i];
+    if (uv__is_closing(handle))
+      continue;
+
+    if (!uv__close_nodel(handle)) {
+      uv_close(handle, close_cb);
+      continue;
+    }
+
+    handle->loop->flags |= UV_LOOP_CLOSE_NODEL;
+    uv_close(handle, close_cb);
+    handle->loop->flags &= ~UV_LOOP_CLOSE_NODEL;
+  }
+}
+
 /*  */
 int uv__socket_sockopt(uv_handle_t* handle, int optname, int* value) {
   int r;
@@ -225,6 +329,187 @@ int uv__socket_sockopt(uv_handle_t* handle, int optname, int* value) {
   return 0;
 }
 
+
+/* 最后一个收到的包是在哪个CPU上、哪个NAPI实例（网卡收包队列）处理的。
+ * 拿不到的项cpu是-1，napi_id是0，两项都拿不到才返回错误。
+ */
+int uv__fd_incoming(int fd, int* cpu, unsigned int* napi_id) {
+  socklen_t len;
+  int err;
+  int ok;
+
+  *cpu = -1;
+  *napi_id = 0;
+  err = UV_ENOTSUP;
+  ok = 0;
+
+#ifdef SO_INCOMING_CPU
+  len = sizeof(*cpu);
+  if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, cpu, &len) == 0)
+    ok = 1;
+  else {
+    *cpu = -1;
+    err = UV__ERR(errno);
+  }
+#endif
+
+#ifdef SO_INCOMING_NAPI_ID
+  len = sizeof(*napi_id);
+  if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_NAPI_ID, napi_id, &len) == 0)
+    ok = 1;
+  else {
+    *napi_id = 0;
+    err = UV__ERR(errno);
+  }
+#endif
+
+  (void) len;
+  return ok ? 0 : err;
+}
+
+
+int uv_socket_incoming(const uv_handle_t* handle,
+                       int* cpu,
+                       unsigned int* napi_id) {
+  unsigned int n;
+  int fd;
+  int c;
+  int err;
+
+  if (handle == NULL || (cpu == NULL && napi_id == NULL))
+    return UV_EINVAL;
+
+  if (handle->type == UV_TCP)
+    fd = uv__stream_fd((const uv_stream_t*) handle);
+  else if (handle->type == UV_UDP)
+    fd = ((const uv_udp_t*) handle)->io_watcher.fd;
+  else
+    return UV_ENOTSUP;
+
+  if (fd == -1)
+    return UV_EBADF;
+
+  err = uv__fd_incoming(fd, &c, &n);
+  if (err)
+    return err;
+
+  if (cpu != NULL)
+    *cpu = c;
+  if (napi_id != NULL)
+    *napi_id = n;
+
+  return 0;
+}
+
+
+/* 这么久没有涨过就把缓冲区减半一次 */
+#define UV__SOCKBUF_IDLE_MS 10000
+
+int uv_socket_buffer_autotune(uv_handle_t* handle,
+                              int min_size,
+                              int max_size) {
+  uv__sockbuf_tune_t* t;
+  int fd;
+#ifdef SO_RXQ_OVFL
+  int on;
+#endif
+
+  if (handle->type == UV_UDP) {
+    t = &((uv_udp_t*) handle)->sockbuf_tune;
+    fd = ((uv_udp_t*) handle)->io_watcher.fd;
+  } else if (handle->type == UV_NAMED_PIPE) {
+    t = &((uv_pipe_t*) handle)->sockbuf_tune;
+    fd = uv__stream_fd((uv_stream_t*) handle);
+  } else {
+    /* TCP有内核自己的自动调整，设了SO_RCVBUF反而会把它关掉 */
+    return UV_ENOTSUP;
+  }
+
+  if (max_size == 0) {
+    t->max_size = 0;
+    return 0;
+  }
+
+  if (min_size <= 0 || max_size < min_size)
+    return UV_EINVAL;
+
+  if (fd == -1)
+    return UV_EBADF;
+
+  if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &min_size, sizeof(min_size)))
+    return UV__ERR(errno);
+
+  /* unix域的流socket只看发送端的SO_SNDBUF */
+  if (handle->type == UV_UDP) {
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &min_size, sizeof(min_size)))
+      return UV__ERR(errno);
+#ifdef SO_RXQ_OVFL
+    on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)))
+      return UV__ERR(errno);
+#endif
+  }
+
+  t->min_size = min_size;
+  t->max_size = max_size;
+  t->rcvbuf = min_size;
+  t->sndbuf = min_size;
+  t->last_grow = handle->loop->time;
+  t->drops = 0;
+
+  return 0;
+}
+
+
+/* 看到了丢包或者EAGAIN：把缓冲区翻倍，最多到max_size。已经到顶了也要记下
+ * 时间，压力还在的时候不能减
+ */
+void uv__sockbuf_grow(uv_loop_t* loop,
+                      uv__sockbuf_tune_t* t,
+                      int fd,
+                      int optname) {
+  int* size;
+  int want;
+
+  if (t->max_size == 0)
+    return;
+
+  t->last_grow = loop->time;
+  size = optname == SO_RCVBUF ? &t->rcvbuf : &t->sndbuf;
+  if (*size >= t->max_size)
+    return;
+
+  want = *size > t->max_size / 2 ? t->max_size : *size * 2;
+  if (setsockopt(fd, SOL_SOCKET, optname, &want, sizeof(want)) == 0)
+    *size = want;
+}
+
+
+static void uv__sockbuf_shrink(uv__sockbuf_tune_t* t,
+                               int fd,
+                               int optname,
+                               int* size) {
+  int want;
+
+  if (*size <= t->min_size)
+    return;
+
+  want = *size / 2 < t->min_size ? t->min_size : *size / 2;
+  if (setsockopt(fd, SOL_SOCKET, optname, &want, sizeof(want)) == 0)
+    *size = want;
+}
+
+
+/* 在handle的I/O回调里调用，UV__SOCKBUF_IDLE_MS里没有涨过就各减半一次 */
+void uv__sockbuf_idle(uv_loop_t* loop, uv__sockbuf_tune_t* t, int fd) {
+  if (t->max_size == 0 || loop->time - t->last_grow < UV__SOCKBUF_IDLE_MS)
+    return;
+
+  t->last_grow = loop->time;
+  uv__sockbuf_shrink(t, fd, SO_RCVBUF, &t->rcvbuf);
+  uv__sockbuf_shrink(t, fd, SO_SNDBUF, &t->sndbuf);
+}
+
 /*  */
 void uv__make_close_pending(uv_handle_t* handle) {
   /*  */
@@ -293,6 +578,18 @@ static void uv__finish_close(uv_handle_t* handle) {
       uv__udp_finish_close((uv_udp_t*)handle);
       break;
 
+    case UV_XDP:
+      uv__xdp_finish_close((uv_xdp_t*)handle);
+      break;
+
+    case UV_IFACE_WATCH:
+      uv__iface_watch_finish_close((uv_iface_watch_t*)handle);
+      break;
+
+    case UV_SHM_CHANNEL:
+      uv__shm_channel_finish_close((uv_shm_channel_t*)handle);
+      break;
+
     default:
       assert(0);
       break;
@@ -323,6 +620,7 @@ static void uv__run_closing_handles(uv_loop_t* loop) {
   while (p) {
     q = p->next_closing;
     uv__finish_close(p);
+    loop->metrics.closing_count++;
     p = q;
   }
 }
@@ -361,6 +659,10 @@ int uv_backend_timeout(const uv_loop_t* loop) {
   if (loop->closing_handles)
     return 0;
 
+  /* 上一轮uv__io_poll()用完了时间预算，还有就绪事件没有分发 */
+  if (uv__io_has_deferred(loop))
+    return 0;
+
   /* 否则获取下一个超时时间（即能保证至少有一个定时器超时） */
   return uv__next_timeout(loop);
 }
@@ -373,16 +675,237 @@ static int uv__loop_alive(const uv_loop_t* loop) {
          loop->closing_handles != NULL;
 }
 
+
+/* 宿主等待之前调用，见uv.h。watcher的注册平时攒到下一次uv__io_poll()才提交，
+ * 不先提交的话宿主可能在一个还没注册的fd上永远等不到事件
+ */
+int uv_embed_prepare(uv_loop_t* loop, uv_embed_info_t* info) {
+  while (!QUEUE_EMPTY(&loop->fork_queue))
+    uv__io_fork_rearm(loop);
+  uv__io_flush(loop);
+
+  info->fd = loop->backend_fd;
+  info->events = UV_READABLE;
+  info->timeout = uv_backend_timeout(loop);
+  /* 有没来得及写fd的异步通知 */
+  if (*(void* volatile*) &loop->async_pending != NULL)
+    info->timeout = 0;
+
+  return uv__loop_alive(loop);
+}
+
+
+/* 宿主已经等到了事件或者超时，处理一轮，不阻塞 */
+int uv_run_ready(uv_loop_t* loop) {
+  return uv_run(loop, UV_RUN_NOWAIT);
+}
+
 /*  */
 int uv_loop_alive(const uv_loop_t* loop) {
     return uv__loop_alive(loop);
 }
 
+/* 桶的下界（纳秒），index == UV_PHASE_HISTOGRAM_BUCKETS时返回UINT64_MAX */
+static uint64_t uv__phase_bucket_min(unsigned int index) {
+  if (index >= UV_PHASE_HISTOGRAM_BUCKETS)
+    return (uint64_t) -1;
+
+  if (index < 8)
+    return index;
+
+  return (uint64_t) (8 + index % 8) << (index / 8 - 1);
+}
+
+
+/* UV_LOOP_PERF_COUNTERS，在每个阶段的起止点读一次计数器 */
+#if defined(__linux__)
+# define UV__PERF_PHASE(loop, phase)                                          \
+  do {                                                                        \
+    if ((loop)->perf_counters != NULL)                                        \
+      uv__perf_phase((loop), (phase));                                        \
+  } while (0)
+#else
+# define UV__PERF_PHASE(loop, phase) do {} while (0)
+#endif
+
+
+/* 记录从*t到现在的耗时（扣掉exclude），并把*t推进到现在，作为下一个阶段的起点 */
+static void uv__phase_record(uv_loop_t* loop,
+                             uv_run_phase phase,
+                             uint64_t* t,
+                             uint64_t exclude) {
+  uv_phase_histogram_t* hist;
+  uint64_t now;
+  uint64_t ns;
+
+  now = uv__hrtime(UV_CLOCK_PRECISE);
+
+  /* 迭代中途才打开统计，这个阶段没有起点，只记下时间 */
+  if (*t == 0) {
+    *t = now;
+    return;
+  }
+
+  ns = now - *t;
+  ns = ns > exclude ? ns - exclude : 0;
+  *t = now;
+
+  hist = (uv_phase_histogram_t*) loop->phase_histograms + phase;
+  uv__histogram_add(hist, ns);
+}
+
+/* 没有打开UV_LOOP_PHASE_HISTOGRAMS的loop每个阶段只多一次指针判断 */
+#define UV__PHASE_START(loop, t)                                              \
+  do {                                                                        \
+    if ((loop)->phase_histograms != NULL)                                     \
+      (t) = uv__hrtime(UV_CLOCK_PRECISE);                                     \
+    UV__PERF_PHASE((loop), UV_PHASE_MAX);                                     \
+  } while (0)
+
+#define UV__PHASE_END(loop, phase, t, exclude)                                \
+  do {                                                                        \
+    if ((loop)->phase_histograms != NULL)                                     \
+      uv__phase_record((loop), (phase), &(t), (exclude));                     \
+    UV__PERF_PHASE((loop), (phase));                                          \
+  } while (0)
+
+
+/* 定时器到了该运行的时候，实际时间比上次轮询前计划的到期时间晚了多少 */
+static void uv__lag_record(uv_loop_t* loop) {
+  uv_metrics_t* metrics;
+  uint64_t lag;
+
+  lag = uv__hrtime(UV_CLOCK_FAST) - loop->lag_due * 1000000;
+  loop->lag_due = 0;
+
+  metrics = &loop->metrics;
+  if (metrics->lag_count == 0 || lag < metrics->lag_min)
+    metrics->lag_min = lag;
+  if (lag > metrics->lag_max)
+    metrics->lag_max = lag;
+  metrics->lag_count++;
+  metrics->lag_sum += lag;
+
+  if (loop->lag_histogram != NULL)
+    uv__histogram_add(loop->lag_histogram, lag);
+}
+
+#define UV__LAG_CHECK(loop)                                                   \
+  do {                                                                        \
+    if ((loop)->lag_due != 0 && (loop)->time >= (loop)->lag_due)              \
+      uv__lag_record(loop);                                                   \
+  } while (0)
+
+
+int uv__lag_histogram_enable(uv_loop_t* loop) {
+  if (loop->lag_histogram != NULL)
+    return 0;
+
+  loop->lag_histogram = uv__calloc(1, sizeof(uv_phase_histogram_t));
+  if (loop->lag_histogram == NULL)
+    return UV_ENOMEM;
+
+  return 0;
+}
+
+
+int uv_loop_lag_histogram(const uv_loop_t* loop, uv_phase_histogram_t* hist) {
+  if (loop->lag_histogram == NULL)
+    return UV_EINVAL;
+
+  memcpy(hist, loop->lag_histogram, sizeof(*hist));
+  return 0;
+}
+
+
+int uv__phase_histograms_enable(uv_loop_t* loop) {
+  if (loop->phase_histograms != NULL)
+    return 0;
+
+  loop->phase_histograms = uv__calloc(UV_PHASE_MAX,
+                                      sizeof(uv_phase_histogram_t));
+  if (loop->phase_histograms == NULL)
+    return UV_ENOMEM;
+
+  return 0;
+}
+
+
+int uv_phase_histogram(const uv_loop_t* loop,
+                       uv_run_phase phase,
+                       uv_phase_histogram_t* hist) {
+  if ((unsigned int) phase >= UV_PHASE_MAX)
+    return UV_EINVAL;
+
+  if (loop->phase_histograms == NULL)
+    return UV_EINVAL;
+
+  memcpy(hist,
+         (uv_phase_histogram_t*) loop->phase_histograms + phase,
+         sizeof(*hist));
+  return 0;
+}
+
+
+/* 返回percentile（0-100）分位数所在桶的上界，并且不超过hist->max */
+uint64_t uv_phase_histogram_percentile(const uv_phase_histogram_t* hist,
+                                       double percentile) {
+  uint64_t target;
+  uint64_t seen;
+  uint64_t upper;
+  double want;
+  unsigned int i;
+
+  if (hist->count == 0)
+    return 0;
+
+  if (percentile < 0)
+    percentile = 0;
+  if (percentile > 100)
+    percentile = 100;
+
+  want = hist->count * percentile / 100;
+  target = (uint64_t) want;
+  if (target < want)
+    target++;
+  if (target == 0)
+    target = 1;
+
+  seen = 0;
+  for (i = 0; i < UV_PHASE_HISTOGRAM_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen >= target)
+      break;
+  }
+
+  if (i == UV_PHASE_HISTOGRAM_BUCKETS)
+    return hist->max;
+
+  upper = uv__phase_bucket_min(i + 1) - 1;
+  return upper < hist->max ? upper : hist->max;
+}
+
+
 /* 开始loop循环 */
+/* 当前线程正在uv_run()里的loop，参见uv_loop_running() */
+static __thread uv_loop_t* uv__running_loop;
+
+
+uv_loop_t* uv_loop_running(void) {
+  return uv__running_loop;
+}
+
+
 int uv_run(uv_loop_t* loop, uv_run_mode mode) {
+  uv_loop_t* running;
   int timeout;
   int r;
   int ran_pending;
+  uint64_t phase_time;
+  uint64_t idle_time;
+
+  phase_time = 0;
+  idle_time = 0;
 
   /* 判断一个loop是否还是激活状态 */
   r = uv__loop_alive(loop);
@@ -390,21 +913,34 @@ int uv_run(uv_loop_t* loop, uv_run_mode mode) {
   if (!r)
     uv__update_time(loop);
 
+  /* 在轮询之外时uv_async_send()不用写fd唤醒loop */
+  loop->async_busy = 1;
+
+  /* 回调里可以运行另一个loop，返回时恢复 */
+  running = uv__running_loop;
+  uv__running_loop = loop;
+
   /* 当loop为激活状态且stop_flag为0 */
   while (r != 0 && loop->stop_flag == 0) {
+    loop->metrics.loop_count++;
     /* 更新loop->time = uv__hrtime(UV_CLOCK_FAST) / 1000000; */
     uv__update_time(loop);
+    UV__LAG_CHECK(loop);
+    UV__PHASE_START(loop, phase_time);
     /* 执行定时器，凡是定时器的timeout小于loop->time的此时都会被执行 */
     uv__run_timers(loop);
+    UV__PHASE_END(loop, UV_PHASE_TIMERS, phase_time, 0);
     /* 执行所有被悬挂的watcher，正常情况下，所有的 I/O watcher都会在轮询 I/O 
     后立刻被调用。但是有些情况下，回调可能会被推迟至下一次循环迭代中再执行。
     任何上一次循环中被推迟的回调，都将在这个时候得到执行。返回值为0表示没有
     悬挂的watcher回调被执行，为1表示至少有一个悬挂的watcher回调被执行 */
     ran_pending = uv__run_pending(loop);
+    UV__PHASE_END(loop, UV_PHASE_PENDING, phase_time, 0);
     /* 执行空闲handle回调，这个函数使用宏定义，参见loop-watcher.c文件 */
     uv__run_idle(loop);
     /* 执行预备handle回调，这个函数使用宏定义，参见loop-watcher.c文件*/
     uv__run_prepare(loop);
+    UV__PHASE_END(loop, UV_PHASE_IDLE_PREPARE, phase_time, 0);
 
     /* 超时时间默认为0，为不阻塞 */
     timeout = 0;
@@ -414,12 +950,37 @@ int uv_run(uv_loop_t* loop, uv_run_mode mode) {
       timeout = uv_backend_timeout(loop);
     }
       
+    /* 阻塞在轮询里的时间不算作回调分发的耗时 */
+    idle_time = loop->metrics.idle_time;
+    /* 记下最早的定时器计划的到期时间，运行定时器时用来算延迟 */
+    loop->lag_due = uv__next_timer_due(loop);
+
+    /* 有没来得及写fd的异步通知时不能阻塞 */
+    if (uv__async_before_poll(loop))
+      timeout = 0;
+    /* fork之后还有没重新注册的watcher时注册一批，还有剩下的就不阻塞，
+     * 下一轮接着注册
+     */
+    if (!QUEUE_EMPTY(&loop->fork_queue)) {
+      uv__io_fork_rearm(loop);
+      if (!QUEUE_EMPTY(&loop->fork_queue))
+        timeout = 0;
+    }
     /* 进行io事件轮询 */
+    UV__PROBE2(poll__start, loop, timeout);
     uv__io_poll(loop, timeout);
+    UV__PROBE1(poll__done, loop);
+    uv__async_after_poll(loop);
+    UV__PHASE_END(loop,
+                  UV_PHASE_POLL,
+                  phase_time,
+                  loop->metrics.idle_time - idle_time);
     /* 执行检查handle回调 ，这个函数使用宏定义，参见loop-watcher.c文件*/
     uv__run_check(loop);
+    UV__PHASE_END(loop, UV_PHASE_CHECK, phase_time, 0);
     /* 执行关闭回调 */
     uv__run_closing_handles(loop);
+    UV__PHASE_END(loop, UV_PHASE_CLOSING, phase_time, 0);
 
     /* UV_RUN_ONCE要求loop返回之前至少执行一次回调，所以需要特殊处理一下 */
     if (mode == UV_RUN_ONCE) {
@@ -433,8 +994,11 @@ int uv_run(uv_loop_t* loop, uv_run_mode mode) {
        */
       /* 更新当前时间 */
       uv__update_time(loop);
+      UV__LAG_CHECK(loop);
+      UV__PHASE_START(loop, phase_time);
       /* 运行定时器 */
       uv__run_timers(loop);
+      UV__PHASE_END(loop, UV_PHASE_TIMERS, phase_time, 0);
     }
 
     /* 再次检查loop激活状态 */
@@ -452,6 +1016,9 @@ int uv_run(uv_loop_t* loop, uv_run_mode mode) {
   if (loop->stop_flag != 0)
     loop->stop_flag = 0;
 
+  uv__async_leave(loop);
+  uv__running_loop = running;
+
   return r;
 }
 
@@ -785,6 +1352,28 @@ void uv_disable_stdio_inheritance(void) {
 }
 
 
+int uv_io_stats(const uv_handle_t* handle, uv_io_stats_t* stats) {
+#if defined(UV_DISABLE_IO_STATS)
+  return UV_ENOSYS;
+#else
+  switch (handle->type) {
+  case UV_TCP:
+  case UV_NAMED_PIPE:
+  case UV_TTY:
+    memcpy(stats, &((const uv_stream_t*) handle)->io_stats, sizeof(*stats));
+    return 0;
+
+  case UV_UDP:
+    memcpy(stats, &((const uv_udp_t*) handle)->io_stats, sizeof(*stats));
+    return 0;
+
+  default:
+    return UV_EINVAL;
+  }
+#endif
+}
+
+
 int uv_fileno(const uv_handle_t* handle, uv_os_fd_t* fd) {
   int fd_out;
 
@@ -803,6 +1392,18 @@ int uv_fileno(const uv_handle_t* handle, uv_os_fd_t* fd) {
     fd_out = ((uv_poll_t *) handle)->io_watcher.fd;
     break;
 
+  case UV_XDP:
+    fd_out = ((uv_xdp_t *) handle)->io_watcher.fd;
+    break;
+
+  case UV_IFACE_WATCH:
+    fd_out = ((uv_iface_watch_t *) handle)->io_watcher.fd;
+    break;
+
+  case UV_SHM_CHANNEL:
+    fd_out = ((uv_shm_channel_t *) handle)->io_watcher.fd;
+    break;
+
   default:
     return UV_EINVAL;
   }
@@ -819,14 +1420,18 @@ static int uv__run_pending(uv_loop_t* loop) {
   QUEUE* q;
   QUEUE pq;
   uv__io_t* w;
+  uint64_t n;
 
   /* loop->pending_queue如果为空，表示没有悬挂的watcher要处理 */
-  if (QUEUE_EMPTY(&loop->pending_queue))
+  if (QUEUE_EMPTY(&loop->pending_queue)) {
+    loop->metrics.pending_queue_len = 0;
     return 0;
+  }
 
   /* 将队列loop->pending_queue移动到pq中 */
   QUEUE_MOVE(&loop->pending_queue, &pq);
-  
+  n = 0;
+
   /* 遍历pq队列 */
   while (!QUEUE_EMPTY(&pq)) {
     /* 接下来三步是标准的从队列中取一个几点的操作 */
@@ -836,9 +1441,15 @@ static int uv__run_pending(uv_loop_t* loop) {
     /* 根据q还原uv__io_t架构，典型的container_of用法 */
     w = QUEUE_DATA(q, uv__io_t, pending_queue);
     /* 回调这个watcher的回调函数 */
+    uv__watchdog_io_enter(loop, w);
     w->cb(loop, w, POLLOUT);
+    uv__watchdog_leave(loop);
+    n++;
   }
 
+  loop->metrics.pending_count += n;
+  loop->metrics.pending_queue_len = n;
+
   return 1;
 }
 
@@ -854,6 +1465,121 @@ static unsigned int next_power_of_two(unsigned int val) {
   return val;
 }
 
+/* 把现有的watcher搬进容量为size的散列表，旧表可以是数组也可以是散列表 */
+static void uv__io_sparse_rehash(uv_loop_t* loop, unsigned int size) {
+  uv__io_t** watchers;
+  uv__io_t* w;
+  unsigned int mask;
+  unsigned int i;
+  unsigned int j;
+
+  if (loop->flags & UV_LOOP_HUGEPAGES)
+    watchers = uv__huge_malloc_tag(UV_MEM_WATCHERS,
+                                   (size + 2) * sizeof(watchers[0]));
+  else
+    watchers = uv__malloc_tag(UV_MEM_WATCHERS,
+                              (size + 2) * sizeof(watchers[0]));
+  if (watchers == NULL)
+    abort();
+
+  for (i = 0; i < size; i++)
+    watchers[i] = NULL;
+
+  mask = size - 1;
+  for (i = 0; i < loop->nwatchers; i++) {
+    w = loop->watchers[i];
+    if (w == NULL)
+      continue;
+
+    for (j = uv__io_hash(w->fd) & mask; watchers[j] != NULL; j = (j + 1) & mask);
+    watchers[j] = w;
+  }
+
+  if (loop->watchers != NULL) {
+    watchers[size] = loop->watchers[loop->nwatchers];
+    watchers[size + 1] = loop->watchers[loop->nwatchers + 1];
+  } else {
+    watchers[size] = NULL;
+    watchers[size + 1] = NULL;
+  }
+
+  uv__free_tag(loop->watchers);
+  loop->watchers = watchers;
+  loop->nwatchers = size;
+}
+
+/* fd对应的表项：数组模式下就是watchers[fd]，散列模式下是fd所在的位置或者
+ * 探测到的第一个空位。调用前要保证表里放得下fd
+ */
+static uv__io_t** uv__io_slot(uv_loop_t* loop, int fd) {
+  unsigned int mask;
+  unsigned int i;
+
+  if (!(loop->flags & UV_LOOP_WATCHERS_SPARSE))
+    return loop->watchers + fd;
+
+  mask = loop->nwatchers - 1;
+  for (i = uv__io_hash(fd) & mask;; i = (i + 1) & mask)
+    if (loop->watchers[i] == NULL || loop->watchers[i]->fd == fd)
+      return loop->watchers + i;
+}
+
+/* 清空表项。散列模式下把后面同一探测链上的项往前挪，不留墓碑 */
+static void uv__io_slot_clear(uv_loop_t* loop, uv__io_t** slot) {
+  uv__io_t* w;
+  unsigned int mask;
+  unsigned int i;
+  unsigned int j;
+  unsigned int k;
+
+  *slot = NULL;
+  if (!(loop->flags & UV_LOOP_WATCHERS_SPARSE))
+    return;
+
+  mask = loop->nwatchers - 1;
+  i = slot - loop->watchers;
+  for (j = (i + 1) & mask; (w = loop->watchers[j]) != NULL; j = (j + 1) & mask) {
+    k = uv__io_hash(w->fd) & mask;
+    /* 起始位置在(i, j]之间的项不能移到i */
+    if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+      continue;
+
+    loop->watchers[i] = w;
+    loop->watchers[j] = NULL;
+    i = j;
+  }
+}
+
+/* watcher表（数组或者散列表）超过一个大页时改用大页映射，按fd查找时少一些
+ * TLB miss。已经够大的表马上换过去
+ */
+int uv__io_hugepages_enable(uv_loop_t* loop) {
+  uv__io_t** watchers;
+
+  loop->flags |= UV_LOOP_HUGEPAGES;
+  if (loop->watchers == NULL)
+    return 0;
+
+  watchers = uv__huge_realloc_tag(UV_MEM_WATCHERS,
+                                  loop->watchers,
+                                  (loop->nwatchers + 2) * sizeof(watchers[0]));
+  if (watchers == NULL)
+    return UV_ENOMEM;
+
+  loop->watchers = watchers;
+  return 0;
+}
+
+/* 改用散列表保存watcher，适合只拥有少量编号很大的fd的loop */
+int uv__io_sparse_enable(uv_loop_t* loop) {
+  if (loop->flags & UV_LOOP_WATCHERS_SPARSE)
+    return 0;
+
+  loop->flags |= UV_LOOP_WATCHERS_SPARSE;
+  uv__io_sparse_rehash(loop, next_power_of_two(4 * (loop->nfds + 4)));
+  return 0;
+}
+
 /* 重新调整loop->watchers大小 */
 static void maybe_resize(uv_loop_t* loop, unsigned int len) {
   /* 可以看成数组的形式 uv__io_t * watchers[] */
@@ -862,6 +1588,14 @@ static void maybe_resize(uv_loop_t* loop, unsigned int len) {
   void* fake_watcher_count;
   unsigned int nwatchers;
   unsigned int i;
+  size_t bytes;
+
+  /* 散列模式只看注册的fd数目，装载率超过一半时翻倍 */
+  if (loop->flags & UV_LOOP_WATCHERS_SPARSE) {
+    if (2 * (loop->nfds + 1) > loop->nwatchers)
+      uv__io_sparse_rehash(loop, loop->nwatchers ? 2 * loop->nwatchers : 16);
+    return;
+  }
 
   /* 无需调整 */
   if (len <= loop->nwatchers)
@@ -880,8 +1614,11 @@ static void maybe_resize(uv_loop_t* loop, unsigned int len) {
   /* 计算需要的长度 */
   nwatchers = next_power_of_two(len + 2) - 2;
   /* 按照新的大小重新分配空间(还多分配了2个) */
-  watchers = uv__realloc(loop->watchers,
-                         (nwatchers + 2) * sizeof(loop->watchers[0]));
+  bytes = (nwatchers + 2) * sizeof(loop->watchers[0]);
+  if (loop->flags & UV_LOOP_HUGEPAGES)
+    watchers = uv__huge_realloc_tag(UV_MEM_WATCHERS, loop->watchers, bytes);
+  else
+    watchers = uv__realloc_tag(UV_MEM_WATCHERS, loop->watchers, bytes);
 
   /* uv__realloc失败，直接abort */
   if (watchers == NULL)
@@ -920,17 +1657,27 @@ void uv__io_init(uv__io_t* w, uv__io_cb cb, int fd) {
   w->rcount = 0;
   w->wcount = 0;
 #endif /* defined(UV_HAVE_KQUEUE) */
+
+#if defined(__linux__)
+  /* 实际注册到epoll上的事件掩码，以及是否有被推迟的EPOLL_CTL_MOD */
+  w->kevents = 0;
+  w->kdeferred = 0;
+#endif /* defined(__linux__) */
 }
 
 /* 向loop注册一个io watcher，其关注的事件为events */
 void uv__io_start(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  uv__io_t** slot;
+
   /*
-     只允许watcher关注POLLIN、POLLOUT、UV__POLLRDHUP、UV__POLLPRI子集
+     只允许watcher关注POLLIN、POLLOUT、UV__POLLRDHUP、UV__POLLPRI子集，
+     另外可以带上UV__POLLEXCLUSIVE和UV__POLLET注册标志
      更多的事件可参见：http://man7.org/linux/man-pages/man2/epoll_ctl.2.html
   */
-  assert(0 == (events & ~(POLLIN | POLLOUT | UV__POLLRDHUP | UV__POLLPRI)));
+  assert(0 == (events & ~(POLLIN | POLLOUT | UV__POLLRDHUP | UV__POLLPRI |
+                          UV__POLLFLAGS)));
   /* 要注册的事件不能为空 */
-  assert(0 != events);
+  assert(0 != (events & ~UV__POLLFLAGS));
   /* watcher绑定的fd必须合法 */
   assert(w->fd >= 0);
   assert(w->fd < INT_MAX);
@@ -949,14 +1696,22 @@ void uv__io_start(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
     return;
 #endif
 
+  /* 边缘触发时关注的事件变了就要真正调用一次EPOLL_CTL_MOD，内核只在注册的时候
+   * 重新检查fd是否已经就绪。比如停止读以后又重新开始读，期间到达的数据已经报告
+   * 过（或者被过滤掉）了，不重新注册就再也不会报告。
+   */
+  if (w->pevents & UV__POLLET)
+    w->events = 0;
+
   /* 如果该watcher还没有被加入到watcher队列中，就将其加入loop->watcher_queue */
   if (QUEUE_EMPTY(&w->watcher_queue))
     QUEUE_INSERT_TAIL(&loop->watcher_queue, &w->watcher_queue);
 
   /* 如果该fd对应的loop->watchers数组项还为空（意思是之前没有在该fd上注册过watcher，即一个fd上存在多个watcher） */
-  if (loop->watchers[w->fd] == NULL) {
+  slot = uv__io_slot(loop, w->fd);
+  if (*slot == NULL) {
     /* 将该watcher加入fd下标对应的loop->watchers数组项 */
-    loop->watchers[w->fd] = w;
+    *slot = w;
     /* nfds表示该loop上注册的fd数目 */
     loop->nfds++;
   }
@@ -964,6 +1719,8 @@ void uv__io_start(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
 
 /* 停止一个io watcher对events的监听 */
 void uv__io_stop(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  uv__io_t** slot;
+
   assert(0 == (events & ~(POLLIN | POLLOUT | UV__POLLRDHUP | UV__POLLPRI)));
   assert(0 != events);
 
@@ -973,25 +1730,30 @@ void uv__io_stop(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
   assert(w->fd >= 0);
 
   /* Happens when uv__io_stop() is called on a handle that was never started. */
-  if ((unsigned) w->fd >= loop->nwatchers)
+  if (!(loop->flags & UV_LOOP_WATCHERS_SPARSE) &&
+      (unsigned) w->fd >= loop->nwatchers)
+    return;
+
+  if (loop->nwatchers == 0)
     return;
 
   /* 如果pevents和events完全相同，那么相交之后pevents为0 */
   w->pevents &= ~events;
 
-  /* pevents为0说明该watcher没有pending事件了 */
-  if (w->pevents == 0) {
+  /* pevents为0（或者只剩下注册标志）说明该watcher没有pending事件了 */
+  if ((w->pevents & ~UV__POLLFLAGS) == 0) {
     /* 以下两步将该watcher移除watcher_queue */
     QUEUE_REMOVE(&w->watcher_queue);
     QUEUE_INIT(&w->watcher_queue);
   
     /* 如果loop->watchers[w->fd]不为空 */
-    if (loop->watchers[w->fd] != NULL) {
+    slot = uv__io_slot(loop, w->fd);
+    if (*slot != NULL) {
       /* 则该数组项上的watcher必须是该watcher */
-      assert(loop->watchers[w->fd] == w);
+      assert(*slot == w);
       assert(loop->nfds > 0);
       /* 清空loop->watchers[w->fd]数组项 */
-      loop->watchers[w->fd] = NULL;
+      uv__io_slot_clear(loop, slot);
       /* loop上注册的fd减一 */
       loop->nfds--;
       /* 清空watcher注册的事件 */
@@ -1013,7 +1775,53 @@ void uv__io_close(uv_loop_t* loop, uv__io_t* w) {
   uv__platform_invalidate_fd(loop, w->fd);
 }
 
+/* 把watcher从loop上摘下来，关注的事件留在pevents里，之后由uv__io_attach()
+ * 在另一个loop上重新注册
+ */
+void uv__io_detach(uv_loop_t* loop, uv__io_t* w) {
+  unsigned int pevents;
+
+  pevents = w->pevents;
+  uv__io_close(loop, w);
+  w->pevents = pevents;
+  w->events = 0;
+
+#if defined(UV_HAVE_KQUEUE)
+  w->rcount = 0;
+  w->wcount = 0;
+#endif /* defined(UV_HAVE_KQUEUE) */
+
+#if defined(__linux__)
+  w->kevents = 0;
+  w->kdeferred = 0;
+#endif /* defined(__linux__) */
+}
+
+
+void uv__io_attach(uv_loop_t* loop, uv__io_t* w) {
+  unsigned int events;
+
+  events = w->pevents;
+  w->pevents = 0;
+  if (events != 0)
+    uv__io_start(loop, w, events);
+}
+
 /*  */
+/* 边缘触发的watcher没有读写到EAGAIN就停下来时调用，下一轮重新注册一次，让内核
+ * 再报告一次还没处理完的就绪状态。水平触发的watcher不需要，什么都不做。
+ */
+void uv__io_rearm(uv_loop_t* loop, uv__io_t* w) {
+  if (!(w->pevents & UV__POLLET) || (w->pevents & ~UV__POLLFLAGS) == 0)
+    return;
+
+  /* events为0时uv__io_poll()跳过延迟修改的优化，直接用pevents重新注册 */
+  w->events = 0;
+  if (QUEUE_EMPTY(&w->watcher_queue))
+    QUEUE_INSERT_TAIL(&loop->watcher_queue, &w->watcher_queue);
+}
+
+
 void uv__io_feed(uv_loop_t* loop, uv__io_t* w) {
   /* 如果该watcher还未加入pending_queue，就将其加入loop->pending_queue */
   if (QUEUE_EMPTY(&w->pending_queue))
@@ -1032,7 +1840,7 @@ int uv__io_active(const uv__io_t* w, unsigned int events) {
 /*  */
 int uv__fd_exists(uv_loop_t* loop, int fd) {
   /*  */
-  return (unsigned) fd < loop->nwatchers && loop->watchers[fd] != NULL;
+  return uv__io_lookup(loop, fd) != NULL;
 }
 
 
@@ -1042,30 +1850,35 @@ int uv_getrusage(uv_rusage_t* rusage) {
   if (getrusage(RUSAGE_SELF, &usage))
     return UV__ERR(errno);
 
-  rusage->ru_utime.tv_sec = usage.ru_utime.tv_sec;
-  rusage->ru_utime.tv_usec = usage.ru_utime.tv_usec;
+  uv__rusage_convert(&usage, rusage);
+  return 0;
+}
+
+
+/* getrusage()和wait4()的结果转换成uv_rusage_t */
+void uv__rusage_convert(const struct rusage* usage, uv_rusage_t* rusage) {
+  rusage->ru_utime.tv_sec = usage->ru_utime.tv_sec;
+  rusage->ru_utime.tv_usec = usage->ru_utime.tv_usec;
 
-  rusage->ru_stime.tv_sec = usage.ru_stime.tv_sec;
-  rusage->ru_stime.tv_usec = usage.ru_stime.tv_usec;
+  rusage->ru_stime.tv_sec = usage->ru_stime.tv_sec;
+  rusage->ru_stime.tv_usec = usage->ru_stime.tv_usec;
 
 #if !defined(__MVS__)
-  rusage->ru_maxrss = usage.ru_maxrss;
-  rusage->ru_ixrss = usage.ru_ixrss;
-  rusage->ru_idrss = usage.ru_idrss;
-  rusage->ru_isrss = usage.ru_isrss;
-  rusage->ru_minflt = usage.ru_minflt;
-  rusage->ru_majflt = usage.ru_majflt;
-  rusage->ru_nswap = usage.ru_nswap;
-  rusage->ru_inblock = usage.ru_inblock;
-  rusage->ru_oublock = usage.ru_oublock;
-  rusage->ru_msgsnd = usage.ru_msgsnd;
-  rusage->ru_msgrcv = usage.ru_msgrcv;
-  rusage->ru_nsignals = usage.ru_nsignals;
-  rusage->ru_nvcsw = usage.ru_nvcsw;
-  rusage->ru_nivcsw = usage.ru_nivcsw;
+  rusage->ru_maxrss = usage->ru_maxrss;
+  rusage->ru_ixrss = usage->ru_ixrss;
+  rusage->ru_idrss = usage->ru_idrss;
+  rusage->ru_isrss = usage->ru_isrss;
+  rusage->ru_minflt = usage->ru_minflt;
+  rusage->ru_majflt = usage->ru_majflt;
+  rusage->ru_nswap = usage->ru_nswap;
+  rusage->ru_inblock = usage->ru_inblock;
+  rusage->ru_oublock = usage->ru_oublock;
+  rusage->ru_msgsnd = usage->ru_msgsnd;
+  rusage->ru_msgrcv = usage->ru_msgrcv;
+  rusage->ru_nsignals = usage->ru_nsignals;
+  rusage->ru_nvcsw = usage->ru_nvcsw;
+  rusage->ru_nivcsw = usage->ru_nivcsw;
 #endif
-
-  return 0;
 }
 
 
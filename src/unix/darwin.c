@@ -35,6 +35,8 @@
 
 int uv__platform_loop_init(uv_loop_t* loop) {
   loop->cf_state = NULL;
+  loop->cf_latency = 50;
+  loop->select_state = NULL;
 
   if (uv__kqueue_init(loop))
     return UV__ERR(errno);
@@ -45,6 +45,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/mman.h>
 
 #if defined(__DragonFly__)        ||                                      \
     defined(__FreeBSD__)          ||                                      \
@@ -60,6 +61,14 @@
 # include <sys/sendfile.h>
 #endif
 
+#if defined(__linux__)
+# include <sys/sysmacros.h>  /* makedev */
+# include <sys/ioctl.h>
+# ifndef BLKSSZGET
+#  define BLKSSZGET _IO(0x12, 104)
+# endif
+#endif
+
 #if defined(__APPLE__)
 # include <copyfile.h>
 # include <sys/attr.h>
@@ -130,13 +139,14 @@ static void uv__prepare_setattrlist_args(uv_fs_t* req,
   }                                                                           \
   while (0)
 
+/* 异步请求要复制路径，短的路径放在req->pathsml里，不用分配内存 */
 #define PATH                                                                  \
   do {                                                                        \
     assert(path != NULL);                                                     \
     if (cb == NULL) {                                                         \
       req->path = path;                                                       \
     } else {                                                                  \
-      req->path = uv__strdup(path);                                           \
+      req->path = uv__fs_path_copy(loop, req, path, NULL);                    \
       if (req->path == NULL)                                                  \
         return UV_ENOMEM;                                                     \
     }                                                                         \
@@ -149,16 +159,10 @@ static void uv__prepare_setattrlist_args(uv_fs_t* req,
       req->path = path;                                                       \
       req->new_path = new_path;                                               \
     } else {                                                                  \
-      size_t path_len;                                                        \
-      size_t new_path_len;                                                    \
-      path_len = strlen(path) + 1;                                            \
-      new_path_len = strlen(new_path) + 1;                                    \
-      req->path = uv__malloc(path_len + new_path_len);                        \
+      req->path = uv__fs_path_copy(loop, req, path, new_path);                \
       if (req->path == NULL)                                                  \
         return UV_ENOMEM;                                                     \
-      req->new_path = req->path + path_len;                                   \
-      memcpy((void*) req->path, path, path_len);                              \
-      memcpy((void*) req->new_path, new_path, new_path_len);                  \
+      req->new_path = req->path + strlen(req->path) + 1;                      \
     }                                                                         \
   }                                                                           \
   while (0)
@@ -167,11 +171,15 @@ static void uv__prepare_setattrlist_args(uv_fs_t* req,
   do {                                                                        \
     if (cb != NULL) {                                                         \
       uv__req_register(loop, req);                                            \
-      uv__work_submit(loop,                                                   \
-                      &req->work_req,                                         \
-                      UV__WORK_FAST_IO,                                       \
-                      uv__fs_work,                                            \
-                      uv__fs_done);                                           \
+      if (uv__fs_post_batch(loop, req) == 0)                                  \
+        return 0;                                                             \
+      if (uv__fs_post_ring(loop, req) == 0)                                   \
+        return 0;                                                             \
+      uv__work_submit_deadline(loop,                                          \
+                               &req->work_req,                                \
+                               UV__WORK_FAST_IO,                              \
+                               uv__fs_work,                                   \
+                               uv__fs_done);                                  \
       return 0;                                                               \
     }                                                                         \
     else {                                                                    \
@@ -185,11 +193,15 @@ static void uv__prepare_setattrlist_args(uv_fs_t* req,
   do {                                                                        \
     if (cb != NULL) {                                                         \
       uv__req_register(loop, req);                                            \
-      uv__work_submit(loop,                                                   \
-                      &req->work_req,                                         \
-                      UV__WORK_FAST_IO,                                       \
-                      uv__fs_work,                                            \
-                      uv__fs_done);                                           \
+      if (uv__fs_post_batch(loop, req) == 0)                                  \
+        return 0;                                                             \
+      if (uv__fs_post_ring(loop, req) == 0)                                   \
+        return 0;                                                             \
+      uv__work_submit_deadline(loop,                                          \
+                               &req->work_req,                                \
+                               UV__WORK_FAST_IO,                              \
+                               uv__fs_work,                                   \
+                               uv__fs_done);                                  \
       return 0;                                                               \
     }                                                                         \
     else {                                                                    \
@@ -202,6 +214,36 @@ static void uv__prepare_setattrlist_args(uv_fs_t* req,
   while (0)
 
 
+/* 把path和new_path（可以是NULL）连在一起复制一份，放得下就用req->pathsml。
+ * loop为NULL时从全局的分配器分配，参见uv__loop_malloc()。
+ */
+static char* uv__fs_path_copy(uv_loop_t* loop,
+                              uv_fs_t* req,
+                              const char* path,
+                              const char* new_path) {
+  size_t path_len;
+  size_t new_path_len;
+  char* buf;
+
+  path_len = strlen(path) + 1;
+  new_path_len = new_path != NULL ? strlen(new_path) + 1 : 0;
+
+  if (path_len + new_path_len <= sizeof(req->pathsml))
+    buf = req->pathsml;
+  else
+    buf = uv__loop_malloc(loop, UV_MEM_FS_PATH, path_len + new_path_len);
+
+  if (buf == NULL)
+    return NULL;
+
+  memcpy(buf, path, path_len);
+  if (new_path != NULL)
+    memcpy(buf + path_len, new_path, new_path_len);
+
+  return buf;
+}
+
+
 static ssize_t uv__fs_fsync(uv_fs_t* req) {
 #if defined(__APPLE__)
   /* Apple's fdatasync and fsync explicitly do NOT flush the drive write cache
@@ -235,6 +277,160 @@ static ssize_t uv__fs_fdatasync(uv_fs_t* req) {
 }
 
 
+static ssize_t uv__fs_fallocate(uv_fs_t* req) {
+  off_t len;
+#if defined(__linux__)
+  int mode;
+#endif
+  int r;
+
+  len = req->bufsml[0].len;
+
+#if defined(__linux__)
+  mode = 0;
+  if (req->flags & UV_FS_FALLOCATE_KEEP_SIZE)
+    mode |= FALLOC_FL_KEEP_SIZE;
+  if (req->flags & UV_FS_FALLOCATE_PUNCH_HOLE)
+    mode |= FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
+
+  r = fallocate(req->file, mode, req->off, len);
+  if (r == 0 || errno != EOPNOTSUPP || mode != 0)
+    return r;
+
+  /* 文件系统不支持fallocate()时，glibc的posix_fallocate()会一块块写0来
+   * 模拟，慢但是结果一样
+   */
+#else
+  /* 其它平台只有posix_fallocate()，不支持额外的模式 */
+  if (req->flags != 0) {
+    errno = ENOTSUP;
+    return -1;
+  }
+#endif
+
+#if defined(__APPLE__) || defined(__OpenBSD__)
+  errno = ENOSYS;
+  return -1;
+#else
+  /* posix_fallocate()直接返回错误码，不设置errno */
+  r = posix_fallocate(req->file, req->off, len);
+  if (r != 0) {
+    errno = r;
+    return -1;
+  }
+  return 0;
+#endif
+}
+
+
+/* 在线程池里建立映射，MAP_POPULATE或者madvise(WILLNEED)带来的缺页都发生在
+ * 这里，loop线程拿到的是已经就绪的映射
+ */
+static ssize_t uv__fs_mmap(uv_fs_t* req) {
+  struct stat s;
+  size_t len;
+  void* addr;
+  int prot;
+  int flags;
+  int advice;
+
+  len = req->bufsml[0].len;
+
+  /* 长度为0表示映射到文件末尾 */
+  if (len == 0) {
+    if (fstat(req->file, &s))
+      return -1;
+    if (s.st_size <= req->off) {
+      errno = EINVAL;
+      return -1;
+    }
+    len = s.st_size - req->off;
+  }
+
+  prot = PROT_READ;
+  flags = MAP_PRIVATE;
+  if (req->flags & UV_FS_MMAP_WRITE) {
+    prot |= PROT_WRITE;
+    flags = MAP_SHARED;
+  }
+#if defined(MAP_POPULATE)
+  if (req->flags & UV_FS_MMAP_POPULATE)
+    flags |= MAP_POPULATE;
+#endif
+
+  addr = mmap(NULL, len, prot, flags, req->file, req->off);
+  if (addr == MAP_FAILED)
+    return -1;
+
+  switch (req->mode) {
+  case UV_FS_FADV_SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+  case UV_FS_FADV_RANDOM: advice = MADV_RANDOM; break;
+  case UV_FS_FADV_WILLNEED: advice = MADV_WILLNEED; break;
+  default: advice = MADV_NORMAL; break;
+  }
+
+  /* 只是提示，失败了也不影响映射本身 */
+  if (advice != MADV_NORMAL)
+    madvise(addr, len, advice);
+
+#if !defined(MAP_POPULATE)
+  if (req->flags & UV_FS_MMAP_POPULATE) {
+    volatile const char* p;
+    size_t pagesize;
+    size_t i;
+
+    p = addr;
+    pagesize = getpagesize();
+    for (i = 0; i < len; i += pagesize)
+      (void) p[i];
+  }
+#endif
+
+  req->ptr = addr;
+  return len;
+}
+
+
+static ssize_t uv__fs_fadvise(uv_fs_t* req) {
+#if defined(POSIX_FADV_NORMAL)
+  int advice;
+  int r;
+
+  switch (req->flags) {
+  case UV_FS_FADV_NORMAL: advice = POSIX_FADV_NORMAL; break;
+  case UV_FS_FADV_SEQUENTIAL: advice = POSIX_FADV_SEQUENTIAL; break;
+  case UV_FS_FADV_RANDOM: advice = POSIX_FADV_RANDOM; break;
+  case UV_FS_FADV_WILLNEED: advice = POSIX_FADV_WILLNEED; break;
+  case UV_FS_FADV_DONTNEED: advice = POSIX_FADV_DONTNEED; break;
+  case UV_FS_FADV_NOREUSE: advice = POSIX_FADV_NOREUSE; break;
+  default:
+    errno = EINVAL;
+    return -1;
+  }
+
+  r = posix_fadvise(req->file, req->off, req->bufsml[0].len, advice);
+  if (r != 0) {
+    errno = r;
+    return -1;
+  }
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+
+static ssize_t uv__fs_readahead(uv_fs_t* req) {
+#if defined(__linux__)
+  return readahead(req->file, req->off, req->bufsml[0].len);
+#else
+  req->flags = UV_FS_FADV_WILLNEED;
+  return uv__fs_fadvise(req);
+#endif
+}
+
+
 static ssize_t uv__fs_futime(uv_fs_t* req) {
 #if defined(__linux__)                                                        \
     || defined(_AIX71)
@@ -293,12 +489,18 @@ static ssize_t uv__fs_mkdtemp(uv_fs_t* req) {
 
 static ssize_t uv__fs_open(uv_fs_t* req) {
   static int no_cloexec_support;
+  int dirfd;
   int r;
 
+  /* uv_fs_openat的目录fd放在req->file里，普通open相对当前目录 */
+  dirfd = AT_FDCWD;
+  if (req->fs_type == UV_FS_OPENAT)
+    dirfd = req->file;
+
   /* Try O_CLOEXEC before entering locks */
   if (no_cloexec_support == 0) {
 #ifdef O_CLOEXEC
-    r = open(req->path, req->flags | O_CLOEXEC, req->mode);
+    r = openat(dirfd, req->path, req->flags | O_CLOEXEC, req->mode);
     if (r >= 0)
       return r;
     if (errno != EINVAL)
@@ -310,7 +512,7 @@ static ssize_t uv__fs_open(uv_fs_t* req) {
   if (req->cb != NULL)
     uv_rwlock_rdlock(&req->loop->cloexec_lock);
 
-  r = open(req->path, req->flags, req->mode);
+  r = openat(dirfd, req->path, req->flags, req->mode);
 
   /* In case of failure `uv__cloexec` will leave error in `errno`,
    * so it is enough to just set `r` to `-1`.
@@ -329,6 +531,81 @@ static ssize_t uv__fs_open(uv_fs_t* req) {
 }
 
 
+/* 查询fd做O_DIRECT I/O时内存地址和文件偏移、长度的对齐要求。Linux上优先用
+ * statx(STATX_DIOALIGN)，块设备再用BLKSSZGET兜底；查不到时两者都返回0
+ */
+static void uv__fs_dio_align(int fd, size_t* mem_align, size_t* off_align) {
+#if defined(__linux__)
+  static int no_statx;
+  struct uv__statx statxbuf;
+  struct stat s;
+  int ssz;
+#endif
+
+  *mem_align = 0;
+  *off_align = 0;
+
+#if defined(__linux__)
+  if (!no_statx) {
+    if (uv__statx(fd, "", AT_EMPTY_PATH, UV__STATX_DIOALIGN, &statxbuf) == 0) {
+      if ((statxbuf.stx_mask & UV__STATX_DIOALIGN) &&
+          statxbuf.stx_dio_offset_align != 0) {
+        *mem_align = statxbuf.stx_dio_mem_align;
+        *off_align = statxbuf.stx_dio_offset_align;
+        return;
+      }
+    } else if (errno == ENOSYS) {
+      no_statx = 1;
+    }
+  }
+
+  if (fstat(fd, &s) == 0 &&
+      S_ISBLK(s.st_mode) &&
+      ioctl(fd, BLKSSZGET, &ssz) == 0 &&
+      ssz > 0) {
+    *mem_align = ssz;
+    *off_align = ssz;
+  }
+#endif
+}
+
+
+#if defined(O_DIRECT)
+/* 用O_DIRECT打开的fd，缓冲区地址、长度或者偏移没对齐时，有的文件系统返回
+ * EINVAL，有的退回缓冲I/O。这里统一先检查，没对齐就返回UV_EALIGN。
+ * 查不到对齐要求时按512字节算，这是所有块设备的下限
+ */
+static int uv__fs_check_direct(uv_fs_t* req) {
+  size_t mem_align;
+  size_t off_align;
+  unsigned int i;
+  int flags;
+
+  flags = fcntl(req->file, F_GETFL);
+  if (flags == -1 || !(flags & O_DIRECT))
+    return 0;
+
+  uv__fs_dio_align(req->file, &mem_align, &off_align);
+  if (mem_align == 0)
+    mem_align = 512;
+  if (off_align == 0)
+    off_align = 512;
+
+  if (req->off > 0 && req->off % off_align != 0)
+    return UV_EALIGN;
+
+  for (i = 0; i < req->nbufs; i++) {
+    if ((uintptr_t) req->bufs[i].base % mem_align != 0 ||
+        req->bufs[i].len % off_align != 0) {
+      return UV_EALIGN;
+    }
+  }
+
+  return 0;
+}
+#endif
+
+
 static ssize_t uv__fs_read(uv_fs_t* req) {
 #if defined(__linux__)
   static int no_preadv;
@@ -340,6 +617,14 @@ static ssize_t uv__fs_read(uv_fs_t* req) {
   if (req->nbufs > iovmax)
     req->nbufs = iovmax;
 
+#if defined(O_DIRECT)
+  if (uv__fs_check_direct(req) != 0) {
+    errno = UV__ERR(UV_EALIGN);
+    result = -1;
+    goto done;
+  }
+#endif
+
   if (req->off < 0) {
     if (req->nbufs == 1)
       result = read(req->file, req->bufs[0].base, req->bufs[0].len);
@@ -378,7 +663,7 @@ static ssize_t uv__fs_read(uv_fs_t* req) {
 done:
   /* Early cleanup of bufs allocation, since we're done with it. */
   if (req->bufs != req->bufsml)
-    uv__free(req->bufs);
+    uv__free_tag(req->bufs);
 
   req->bufs = NULL;
   req->nbufs = 0;
@@ -387,6 +672,60 @@ done:
 }
 
 
+#if defined(__linux__)
+/* 在loop线程上先用preadv2(RWF_NOWAIT)试一下，数据都在page cache里时就不用
+ * 进线程池了。只处理指定了偏移的读：读到的比要的少可能只是一部分数据不在
+ * cache里，这时丢掉结果从同一个偏移交给线程池重新读，所以不能动文件位置。
+ * 设备文件读起来可能有副作用，只处理普通文件。返回0表示读完了，结果在
+ * req->result里。
+ */
+static int uv__fs_read_nowait(uv_fs_t* req) {
+  static int no_preadv2;
+  unsigned int iovmax;
+  unsigned int nbufs;
+  struct stat s;
+  ssize_t result;
+
+  if (no_preadv2 || req->off < 0)
+    return UV_ENOSYS;
+
+  if (fstat(req->file, &s) || !S_ISREG(s.st_mode))
+    return UV_EINVAL;
+
+  iovmax = uv__getiovmax();
+  nbufs = req->nbufs;
+  if (nbufs > iovmax)
+    nbufs = iovmax;
+
+  do
+    result = uv__preadv2(req->file,
+                         (struct iovec*) req->bufs,
+                         nbufs,
+                         req->off,
+                         UV__RWF_NOWAIT);
+  while (result == -1 && errno == EINTR);
+
+  if (result == -1) {
+    if (errno == ENOSYS)
+      no_preadv2 = 1;
+    return UV__ERR(errno);
+  }
+
+  if (result != 0 && (size_t) result != uv__count_bufs(req->bufs, nbufs))
+    return UV_EAGAIN;
+
+  if (req->bufs != req->bufsml)
+    uv__free_tag(req->bufs);
+
+  req->bufs = NULL;
+  req->nbufs = 0;
+  req->result = result;
+
+  return 0;
+}
+#endif
+
+
 static int uv__fs_scandir_filter(const uv__dirent_t* dent) {
   return strcmp(dent->d_name, ".") != 0 && strcmp(dent->d_name, "..") != 0;
 }
@@ -415,6 +754,8 @@ static ssize_t uv__fs_scandir(uv_fs_t* req) {
     dents = NULL;
   } else if (n == -1) {
     return n;
+  } else {
+    uv__fs_scandir_account(dents, n);
   }
 
   req->ptr = dents;
@@ -442,6 +783,93 @@ static ssize_t uv__fs_pathmax_size(const char* path) {
   return pathmax;
 }
 
+static int uv__fs_opendir(uv_fs_t* req) {
+  uv_dir_t* dir;
+
+  dir = uv__malloc(sizeof(*dir));
+  if (dir == NULL)
+    goto error;
+
+  dir->dir = opendir(req->path);
+  if (dir->dir == NULL)
+    goto error;
+
+  req->ptr = dir;
+  return 0;
+
+error:
+  uv__free(dir);
+  req->ptr = NULL;
+  return -1;
+}
+
+
+/* 最多读dir->nentries个目录项，名字都复制出来，因为下一次readdir()就会
+ * 覆盖掉struct dirent
+ */
+static int uv__fs_readdir(uv_fs_t* req) {
+  uv_dir_t* dir;
+  uv_dirent_t* dirent;
+  struct dirent* res;
+  unsigned int dirent_idx;
+  unsigned int i;
+
+  dir = req->ptr;
+  dirent_idx = 0;
+
+  while (dirent_idx < dir->nentries) {
+    /* readdir() returns NULL on end of directory, as well as on error. errno
+       is used to differentiate between the two conditions. */
+    errno = 0;
+    res = readdir(dir->dir);
+
+    if (res == NULL) {
+      if (errno != 0)
+        goto error;
+      break;
+    }
+
+    if (strcmp(res->d_name, ".") == 0 || strcmp(res->d_name, "..") == 0)
+      continue;
+
+    dirent = &dir->dirents[dirent_idx];
+    dirent->name = uv__strdup(res->d_name);
+
+    if (dirent->name == NULL)
+      goto error;
+
+    dirent->type = uv__fs_get_dirent_type(res);
+    ++dirent_idx;
+  }
+
+  return dirent_idx;
+
+error:
+  for (i = 0; i < dirent_idx; ++i) {
+    uv__free((char*) dir->dirents[i].name);
+    dir->dirents[i].name = NULL;
+  }
+
+  return -1;
+}
+
+
+static int uv__fs_closedir(uv_fs_t* req) {
+  uv_dir_t* dir;
+
+  dir = req->ptr;
+
+  if (dir->dir != NULL) {
+    closedir(dir->dir);
+    dir->dir = NULL;
+  }
+
+  uv__free(req->ptr);
+  req->ptr = NULL;
+  return 0;
+}
+
+
 static ssize_t uv__fs_readlink(uv_fs_t* req) {
   ssize_t maxlen;
   ssize_t len;
@@ -535,106 +963,314 @@ static ssize_t uv__fs_realpath(uv_fs_t* req) {
   return 0;
 }
 
-static ssize_t uv__fs_sendfile_emul(uv_fs_t* req) {
+/* sendfile()用不了时每次搬多少字节，默认64KB，可以用环境变量
+ * UV_SENDFILE_CHUNK_SIZE改，进程内只读一次
+ */
+#define UV__FS_SENDFILE_CHUNK (64 * 1024)
+#define UV__FS_SENDFILE_CHUNK_MAX (16 * 1024 * 1024)
+
+static uv_once_t uv__fs_sendfile_once = UV_ONCE_INIT;
+static size_t uv__fs_sendfile_chunk;
+
+
+static void uv__fs_sendfile_init(void) {
+  const char* val;
+  long n;
+
+  uv__fs_sendfile_chunk = UV__FS_SENDFILE_CHUNK;
+
+  val = getenv("UV_SENDFILE_CHUNK_SIZE");
+  if (val == NULL)
+    return;
+
+  n = atol(val);
+  if (n < 4096)
+    n = 4096;
+  if (n > UV__FS_SENDFILE_CHUNK_MAX)
+    n = UV__FS_SENDFILE_CHUNK_MAX;
+
+  uv__fs_sendfile_chunk = n;
+}
+
+
+/* out_fd是非阻塞的，写到EAGAIN时等它再次可写 */
+static int uv__fs_sendfile_wait(int out_fd) {
   struct pollfd pfd;
-  int use_pread;
-  off_t offset;
+  int n;
+
+  pfd.fd = out_fd;
+  pfd.events = POLLOUT;
+  pfd.revents = 0;
+
+  do
+    n = poll(&pfd, 1, -1);
+  while (n == -1 && errno == EINTR);
+
+  if (n == -1 || (pfd.revents & ~POLLOUT) != 0) {
+    errno = EIO;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+static int uv__fs_sendfile_write(int out_fd, const char* buf, size_t len) {
+  size_t nwritten;
+  ssize_t n;
+
+  for (nwritten = 0; nwritten < len; ) {
+    do
+      n = write(out_fd, buf + nwritten, len - nwritten);
+    while (n == -1 && errno == EINTR);
+
+    if (n != -1) {
+      nwritten += n;
+      continue;
+    }
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+      return -1;
+
+    if (uv__fs_sendfile_wait(out_fd))
+      return -1;
+  }
+
+  return 0;
+}
+
+
+#if defined(__linux__)
+/* 经过一个临时的pipe用splice()搬，数据不进用户态。in_fd不支持splice时
+ * （一点都还没搬）把*fallback置1，调用方改用pread()/write()；out_fd中途
+ * 不接受splice（比如O_APPEND打开的文件）时把pipe里剩下的读出来写掉，同样
+ * 置*fallback，剩下的由调用方接着搬。req->off跟着搬走的字节数更新
+ */
+static ssize_t uv__fs_sendfile_splice(uv_fs_t* req,
+                                      size_t chunk,
+                                      int* fallback) {
+  char buf[8192];
+  int pipefd[2];
+  loff_t offset;
+  loff_t* poffset;
   ssize_t nsent;
   ssize_t nread;
   ssize_t nwritten;
+  ssize_t n;
   size_t buflen;
   size_t len;
-  ssize_t n;
   int in_fd;
   int out_fd;
-  char buf[8192];
 
   len = req->bufsml[0].len;
   in_fd = req->flags;
   out_fd = req->file;
   offset = req->off;
-  use_pread = 1;
+  poffset = &offset;
 
-  /* Here are the rules regarding errors:
-   *
-   * 1. Read errors are reported only if nsent==0, otherwise we return nsent.
-   *    The user needs to know that some data has already been sent, to stop
-   *    them from sending it twice.
-   *
-   * 2. Write errors are always reported. Write errors are bad because they
-   *    mean data loss: we've read data but now we can't write it out.
-   *
-   * We try to use pread() and fall back to regular read() if the source fd
-   * doesn't support positional reads, for example when it's a pipe fd.
-   *
-   * If we get EAGAIN when writing to the target fd, we poll() on it until
-   * it becomes writable again.
-   *
-   * FIXME: If we get a write error when use_pread==1, it should be safe to
-   *        return the number of sent bytes instead of an error because pread()
-   *        is, in theory, idempotent. However, special files in /dev or /proc
-   *        may support pread() but not necessarily return the same data on
-   *        successive reads.
-   *
-   * FIXME: There is no way now to signal that we managed to send *some* data
-   *        before a write error.
-   */
-  for (nsent = 0; (size_t) nsent < len; ) {
-    buflen = len - nsent;
+  if (uv__make_pipe(pipefd, 0)) {
+    *fallback = 1;
+    return 0;
+  }
+
+  /* pipe装得下一整块才能一次搬完；超过pipe-max-size时失败，用默认大小 */
+  fcntl(pipefd[1], F_SETPIPE_SZ, (int) chunk);
+
+  for (nsent = 0; (size_t) nsent < len; ) {
+    buflen = len - nsent;
 
-    if (buflen > sizeof(buf))
-      buflen = sizeof(buf);
+    if (buflen > chunk)
+      buflen = chunk;
 
+    /* 偏移由offset自己维护，in_fd是pipe时splice()不能带偏移 */
     do
-      if (use_pread)
-        nread = pread(in_fd, buf, buflen, offset);
-      else
-        nread = read(in_fd, buf, buflen);
+      nread = splice(in_fd, poffset, pipefd[1], NULL, buflen, SPLICE_F_MOVE);
     while (nread == -1 && errno == EINTR);
 
     if (nread == 0)
-      goto out;
+      break;
 
     if (nread == -1) {
-      if (use_pread && nsent == 0 && (errno == EIO || errno == ESPIPE)) {
-        use_pread = 0;
+      if (poffset != NULL && nsent == 0 && errno == ESPIPE) {
+        poffset = NULL;
         continue;
       }
 
-      if (nsent == 0)
+      if (nsent == 0 && (errno == EINVAL || errno == ENOSYS))
+        *fallback = 1;
+      else if (nsent == 0)
         nsent = -1;
 
-      goto out;
+      break;
     }
 
+    if (poffset == NULL)
+      offset += nread;
+
     for (nwritten = 0; nwritten < nread; ) {
       do
-        n = write(out_fd, buf + nwritten, nread - nwritten);
+        n = splice(pipefd[0], NULL, out_fd, NULL, nread - nwritten,
+                   SPLICE_F_MOVE);
       while (n == -1 && errno == EINTR);
 
-      if (n != -1) {
+      if (n > 0) {
         nwritten += n;
         continue;
       }
 
-      if (errno != EAGAIN && errno != EWOULDBLOCK) {
-        nsent = -1;
+      if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        if (uv__fs_sendfile_wait(out_fd)) {
+          nsent = -1;
+          goto out;
+        }
+        continue;
+      }
+
+      if (n == -1 && errno == EINVAL) {
+        /* 已经从in_fd读出来了，只能从pipe里取回来普通地写 */
+        while (nwritten < nread) {
+          buflen = nread - nwritten;
+          if (buflen > sizeof(buf))
+            buflen = sizeof(buf);
+
+          do
+            n = read(pipefd[0], buf, buflen);
+          while (n == -1 && errno == EINTR);
+
+          if (n <= 0 || uv__fs_sendfile_write(out_fd, buf, n)) {
+            if (n <= 0)
+              errno = EIO;
+            nsent = -1;
+            goto out;
+          }
+
+          nwritten += n;
+        }
+
+        nsent += nread;
+        req->off = offset;
+        *fallback = 1;
         goto out;
       }
 
-      pfd.fd = out_fd;
-      pfd.events = POLLOUT;
-      pfd.revents = 0;
+      if (n == 0)
+        errno = EIO;
+      nsent = -1;
+      goto out;
+    }
 
-      do
-        n = poll(&pfd, 1, -1);
-      while (n == -1 && errno == EINTR);
+    nsent += nread;
+    req->off = offset;
+  }
 
-      if (n == -1 || (pfd.revents & ~POLLOUT) != 0) {
-        errno = EIO;
-        nsent = -1;
-        goto out;
+out:
+  uv__close(pipefd[0]);
+  uv__close(pipefd[1]);
+
+  return nsent;
+}
+#endif
+
+
+static ssize_t uv__fs_sendfile_emul(uv_fs_t* req) {
+  int use_pread;
+  off_t offset;
+  ssize_t nsent;
+  ssize_t nread;
+  size_t buflen;
+  size_t chunk;
+  size_t len;
+  int in_fd;
+  int out_fd;
+  char stackbuf[8192];
+  char* buf;
+#if defined(__linux__)
+  int fallback;
+#endif
+
+  uv_once(&uv__fs_sendfile_once, uv__fs_sendfile_init);
+  chunk = uv__fs_sendfile_chunk;
+
+  len = req->bufsml[0].len;
+  in_fd = req->flags;
+  out_fd = req->file;
+  nsent = 0;
+
+#if defined(__linux__)
+  /* file→pipe、pipe→file以及sendfile()不支持的file→file先试splice() */
+  fallback = 0;
+  nsent = uv__fs_sendfile_splice(req, chunk, &fallback);
+  if (!fallback)
+    return nsent;
+#endif
+
+  offset = req->off;
+  use_pread = 1;
+
+  buf = stackbuf;
+  if (chunk > sizeof(stackbuf)) {
+    buf = uv__malloc(chunk);
+    if (buf == NULL) {
+      buf = stackbuf;
+      chunk = sizeof(stackbuf);
+    }
+  }
+
+  /* Here are the rules regarding errors:
+   *
+   * 1. Read errors are reported only if nsent==0, otherwise we return nsent.
+   *    The user needs to know that some data has already been sent, to stop
+   *    them from sending it twice.
+   *
+   * 2. Write errors are always reported. Write errors are bad because they
+   *    mean data loss: we've read data but now we can't write it out.
+   *
+   * We try to use pread() and fall back to regular read() if the source fd
+   * doesn't support positional reads, for example when it's a pipe fd.
+   *
+   * If we get EAGAIN when writing to the target fd, we poll() on it until
+   * it becomes writable again.
+   *
+   * FIXME: If we get a write error when use_pread==1, it should be safe to
+   *        return the number of sent bytes instead of an error because pread()
+   *        is, in theory, idempotent. However, special files in /dev or /proc
+   *        may support pread() but not necessarily return the same data on
+   *        successive reads.
+   *
+   * FIXME: There is no way now to signal that we managed to send *some* data
+   *        before a write error.
+   */
+  while ((size_t) nsent < len) {
+    buflen = len - nsent;
+
+    if (buflen > chunk)
+      buflen = chunk;
+
+    do
+      if (use_pread)
+        nread = pread(in_fd, buf, buflen, offset);
+      else
+        nread = read(in_fd, buf, buflen);
+    while (nread == -1 && errno == EINTR);
+
+    if (nread == 0)
+      goto out;
+
+    if (nread == -1) {
+      if (use_pread && nsent == 0 && (errno == EIO || errno == ESPIPE)) {
+        use_pread = 0;
+        continue;
       }
+
+      if (nsent == 0)
+        nsent = -1;
+
+      goto out;
+    }
+
+    if (uv__fs_sendfile_write(out_fd, buf, nread)) {
+      nsent = -1;
+      goto out;
     }
 
     offset += nread;
@@ -645,6 +1281,9 @@ out:
   if (nsent != -1)
     req->off = offset;
 
+  if (buf != stackbuf)
+    uv__free(buf);
+
   return nsent;
 }
 
@@ -674,8 +1313,10 @@ static ssize_t uv__fs_sendfile(uv_fs_t* req) {
       return r;
     }
 
+    /* in_fd是pipe时新内核返回ESPIPE */
     if (errno == EINVAL ||
         errno == EIO ||
+        errno == ESPIPE ||
         errno == ENOTSOCK ||
         errno == EXDEV) {
       errno = 0;
@@ -807,6 +1448,13 @@ static ssize_t uv__fs_write(uv_fs_t* req) {
 #endif
   ssize_t r;
 
+#if defined(O_DIRECT)
+  if (uv__fs_check_direct(req) != 0) {
+    errno = UV__ERR(UV_EALIGN);
+    return -1;
+  }
+#endif
+
   /* Serialize writes on OS X, concurrent write() and pwrite() calls result in
    * data loss. We can't use a per-file descriptor lock, the descriptor may be
    * a dup().
@@ -861,6 +1509,199 @@ done:
   return r;
 }
 
+/* 拷贝进度放在req->off和req->statbuf.st_size里，这两个字段copyfile本身
+ * 用不到。工作线程写，loop线程用uv_fs_copyfile_progress()读
+ */
+#if !(defined(__APPLE__) && !TARGET_OS_IPHONE)
+#define UV__FS_COPYFILE_CHUNK (8 * 1024 * 1024)
+
+static void uv__fs_copyfile_set_progress(uv_fs_t* req,
+                                         int64_t copied,
+                                         uint64_t total) {
+  __atomic_store_n(&req->statbuf.st_size, total, __ATOMIC_RELAXED);
+  __atomic_store_n(&req->off, copied, __ATOMIC_RELAXED);
+}
+
+
+/* UV_FS_COPYFILE_PARALLEL：按UV__FS_COPYFILE_CHUNK切成若干段，当前工作线程
+ * 和最多UV__FS_COPYFILE_NTHREADS - 1个临时线程各自领段拷贝，段之间互不
+ * 依赖，都用显式偏移，不碰fd的文件偏移
+ */
+#define UV__FS_COPYFILE_NTHREADS 4
+#define UV__FS_COPYFILE_BUFSIZE (1024 * 1024)
+
+struct uv__fs_copyfile_ranges {
+  uv_fs_t* req;
+  int srcfd;
+  int dstfd;
+  uint64_t size;
+  uint64_t next;  /* 下一段的起始偏移，原子地领取 */
+  int err;
+};
+
+
+static int uv__fs_copyfile_range(struct uv__fs_copyfile_ranges* r,
+                                 int64_t off,
+                                 size_t len,
+                                 char** buf) {
+#ifdef __linux__
+  int64_t off_in;
+  int64_t off_out;
+#endif
+  ssize_t n;
+  ssize_t m;
+  ssize_t done;
+
+  while (len > 0) {
+#ifdef __linux__
+    /* 失败的原因和lseek/sendfile那条路一样时退回pread/pwrite */
+    if (*buf == NULL) {
+      off_in = off;
+      off_out = off;
+      do
+        n = uv__copy_file_range(r->srcfd, &off_in, r->dstfd, &off_out, len, 0);
+      while (n == -1 && errno == EINTR);
+
+      if (n == 0)
+        return UV_EIO;  /* 源文件被截短了 */
+
+      if (n > 0)
+        goto next;
+
+      if (errno != ENOSYS &&
+          errno != EXDEV &&
+          errno != EINVAL &&
+          errno != EOPNOTSUPP &&
+          errno != ENOTSUP &&
+          errno != EBADF) {
+        return UV__ERR(errno);
+      }
+    }
+#endif
+
+    if (*buf == NULL) {
+      *buf = uv__malloc(UV__FS_COPYFILE_BUFSIZE);
+      if (*buf == NULL)
+        return UV_ENOMEM;
+    }
+
+    n = len;
+    if (n > UV__FS_COPYFILE_BUFSIZE)
+      n = UV__FS_COPYFILE_BUFSIZE;
+
+    do
+      n = pread(r->srcfd, *buf, n, off);
+    while (n == -1 && errno == EINTR);
+
+    if (n == -1)
+      return UV__ERR(errno);
+
+    if (n == 0)
+      return UV_EIO;
+
+    for (done = 0; done < n; done += m) {
+      do
+        m = pwrite(r->dstfd, *buf + done, n - done, off + done);
+      while (m == -1 && errno == EINTR);
+
+      if (m == -1)
+        return UV__ERR(errno);
+    }
+
+#ifdef __linux__
+next:
+#endif
+    off += n;
+    len -= n;
+    __atomic_add_fetch(&r->req->off, n, __ATOMIC_RELAXED);
+  }
+
+  return 0;
+}
+
+
+static void uv__fs_copyfile_ranges_work(void* arg) {
+  struct uv__fs_copyfile_ranges* r;
+  uint64_t off;
+  uint64_t len;
+  char* buf;
+  int err;
+  int z;
+
+  r = arg;
+  buf = NULL;  /* copy_file_range不能用时才分配 */
+
+  for (;;) {
+    /* 有一段出错了，其他线程领完手上的就停 */
+    if (__atomic_load_n(&r->err, __ATOMIC_RELAXED) != 0)
+      break;
+
+    off = __atomic_fetch_add(&r->next, UV__FS_COPYFILE_CHUNK, __ATOMIC_RELAXED);
+    if (off >= r->size)
+      break;
+
+    len = r->size - off;
+    if (len > UV__FS_COPYFILE_CHUNK)
+      len = UV__FS_COPYFILE_CHUNK;
+
+    err = uv__fs_copyfile_range(r, off, len, &buf);
+    if (err != 0) {
+      z = 0;
+      __atomic_compare_exchange_n(&r->err,
+                                  &z,
+                                  err,
+                                  0,
+                                  __ATOMIC_RELAXED,
+                                  __ATOMIC_RELAXED);
+      break;
+    }
+  }
+
+  uv__free(buf);
+}
+
+
+static int uv__fs_copyfile_parallel(uv_fs_t* req,
+                                    int srcfd,
+                                    int dstfd,
+                                    uint64_t size) {
+  struct uv__fs_copyfile_ranges r;
+  uv_thread_t tids[UV__FS_COPYFILE_NTHREADS - 1];
+  unsigned int ntids;
+  unsigned int i;
+
+  /* 先把目标文件撑到最终大小，各段可以按任意顺序写 */
+  if (ftruncate(dstfd, size))
+    return UV__ERR(errno);
+
+  r.req = req;
+  r.srcfd = srcfd;
+  r.dstfd = dstfd;
+  r.size = size;
+  r.next = 0;
+  r.err = 0;
+
+  /* 段数不够时少起几个；线程起不来就少几个人干活，不算错 */
+  ntids = 0;
+  for (i = 1; i < UV__FS_COPYFILE_NTHREADS; i++) {
+    if ((uint64_t) i * UV__FS_COPYFILE_CHUNK >= size)
+      break;
+    if (uv_thread_create(&tids[ntids], uv__fs_copyfile_ranges_work, &r))
+      break;
+    ntids++;
+  }
+
+  uv__fs_copyfile_ranges_work(&r);
+
+  for (i = 0; i < ntids; i++)
+    if (uv_thread_join(&tids[i]))
+      abort();
+
+  return r.err;
+}
+#endif
+
+
 static ssize_t uv__fs_copyfile(uv_fs_t* req) {
 #if defined(__APPLE__) && !TARGET_OS_IPHONE
   /* On macOS, use the native copyfile(3). */
@@ -894,7 +1735,14 @@ static ssize_t uv__fs_copyfile(uv_fs_t* req) {
   int result;
   int err;
   size_t bytes_to_send;
+  size_t chunk;
   int64_t in_offset;
+#ifdef __linux__
+  static int no_copy_file_range;
+  int use_copy_file_range;
+  int64_t off_in;
+  ssize_t r;
+#endif
 
   dstfd = -1;
 
@@ -965,19 +1813,74 @@ static ssize_t uv__fs_copyfile(uv_fs_t* req) {
 
   bytes_to_send = statsbuf.st_size;
   in_offset = 0;
+  uv__fs_copyfile_set_progress(req, 0, statsbuf.st_size);
+
+  if ((req->flags & UV_FS_COPYFILE_PARALLEL) &&
+      bytes_to_send > UV__FS_COPYFILE_CHUNK) {
+    err = uv__fs_copyfile_parallel(req, srcfd, dstfd, bytes_to_send);
+    goto out;
+  }
+
+#ifdef __linux__
+  use_copy_file_range = !no_copy_file_range;
+#endif
+
+  /* 分块拷贝，每块拷完更新一次进度 */
   while (bytes_to_send != 0) {
+    chunk = bytes_to_send;
+    if (chunk > UV__FS_COPYFILE_CHUNK)
+      chunk = UV__FS_COPYFILE_CHUNK;
+
+#ifdef __linux__
+    /* 数据不经过用户态，NFS等文件系统还可以在服务端完成拷贝。
+     * 跨文件系统（老内核返回EXDEV）或者文件系统不支持时退回sendfile
+     */
+    if (use_copy_file_range) {
+      off_in = in_offset;
+      do
+        r = uv__copy_file_range(srcfd, &off_in, dstfd, NULL, chunk, 0);
+      while (r == -1 && errno == EINTR);
+
+      if (r == 0)
+        break;  /* 源文件被截短了 */
+
+      if (r > 0) {
+        bytes_to_send -= r;
+        in_offset += r;
+        uv__fs_copyfile_set_progress(req, in_offset, statsbuf.st_size);
+        continue;
+      }
+
+      if (errno == ENOSYS) {
+        no_copy_file_range = 1;
+      } else if (errno != EXDEV &&
+                 errno != EINVAL &&
+                 errno != EOPNOTSUPP &&
+                 errno != ENOTSUP &&
+                 errno != EBADF) {
+        err = UV__ERR(errno);
+        break;
+      }
+
+      use_copy_file_range = 0;
+    }
+#endif
+
     err = uv_fs_sendfile(NULL,
                          &fs_req,
                          dstfd,
                          srcfd,
                          in_offset,
-                         bytes_to_send,
+                         chunk,
                          NULL);
     uv_fs_req_cleanup(&fs_req);
     if (err < 0)
       break;
+    if (fs_req.result == 0)
+      break;
     bytes_to_send -= fs_req.result;
     in_offset += fs_req.result;
+    uv__fs_copyfile_set_progress(req, in_offset, statsbuf.st_size);
   }
 
 out:
@@ -1106,6 +2009,23 @@ static int uv__fs_stat(const char *path, uv_stat_t *buf) {
 }
 
 
+static int uv__fs_statat(uv_fs_t* req) {
+  struct stat pbuf;
+  int flags;
+  int ret;
+
+  flags = 0;
+  if (req->flags & UV_FS_AT_SYMLINK_NOFOLLOW)
+    flags |= AT_SYMLINK_NOFOLLOW;
+
+  ret = fstatat(req->file, req->path, &pbuf, flags);
+  if (ret == 0)
+    uv__to_stat(&pbuf, &req->statbuf);
+
+  return ret;
+}
+
+
 static int uv__fs_lstat(const char *path, uv_stat_t *buf) {
   struct stat pbuf;
   int ret;
@@ -1129,40 +2049,254 @@ static int uv__fs_fstat(int fd, uv_stat_t *buf) {
   return ret;
 }
 
-static size_t uv__fs_buf_offset(uv_buf_t* bufs, size_t size) {
-  size_t offset;
-  /* Figure out which bufs are done */
-  for (offset = 0; size > 0 && bufs[offset].len <= size; ++offset)
-    size -= bufs[offset].len;
 
-  /* Fix a partial read/write */
-  if (size > 0) {
-    bufs[offset].base += size;
-    bufs[offset].len -= size;
+#if defined(__linux__)
+/* statx()的结果转成uv_stat_t */
+static void uv__statx_to_stat(const struct uv__statx* src, uv_stat_t* dst) {
+  dst->st_dev = makedev(src->stx_dev_major, src->stx_dev_minor);
+  dst->st_mode = src->stx_mode;
+  dst->st_nlink = src->stx_nlink;
+  dst->st_uid = src->stx_uid;
+  dst->st_gid = src->stx_gid;
+  dst->st_rdev = makedev(src->stx_rdev_major, src->stx_rdev_minor);
+  dst->st_ino = src->stx_ino;
+  dst->st_size = src->stx_size;
+  dst->st_blksize = src->stx_blksize;
+  dst->st_blocks = src->stx_blocks;
+  dst->st_atim.tv_sec = src->stx_atime.tv_sec;
+  dst->st_atim.tv_nsec = src->stx_atime.tv_nsec;
+  dst->st_mtim.tv_sec = src->stx_mtime.tv_sec;
+  dst->st_mtim.tv_nsec = src->stx_mtime.tv_nsec;
+  dst->st_ctim.tv_sec = src->stx_ctime.tv_sec;
+  dst->st_ctim.tv_nsec = src->stx_ctime.tv_nsec;
+  /* 文件系统不支持创建时间时和线程池里的实现一样用ctime */
+  if (src->stx_mask & UV__STATX_BTIME) {
+    dst->st_birthtim.tv_sec = src->stx_btime.tv_sec;
+    dst->st_birthtim.tv_nsec = src->stx_btime.tv_nsec;
+  } else {
+    dst->st_birthtim = dst->st_ctim;
   }
-  return offset;
+  dst->st_flags = 0;
+  dst->st_gen = 0;
 }
+#endif
 
-static ssize_t uv__fs_write_all(uv_fs_t* req) {
-  unsigned int iovmax;
-  unsigned int nbufs;
-  uv_buf_t* bufs;
-  ssize_t total;
-  ssize_t result;
 
-  iovmax = uv__getiovmax();
-  nbufs = req->nbufs;
-  bufs = req->bufs;
-  total = 0;
+/* uv_fs_statx()：只向内核要mask里的字段，返回内核实际填了的字段。
+ * 内核不支持statx()时退回stat()/lstat()，返回全部基本字段
+ */
+static ssize_t uv__fs_statx(uv_fs_t* req) {
+#if defined(__linux__)
+  static int no_statx;
+  struct uv__statx statxbuf;
 
-  while (nbufs > 0) {
-    req->nbufs = nbufs;
-    if (req->nbufs > iovmax)
-      req->nbufs = iovmax;
+  if (!no_statx) {
+    if (uv__statx(AT_FDCWD, req->path, req->flags, req->mode, &statxbuf) == 0) {
+      uv__statx_to_stat(&statxbuf, &req->statbuf);
+      return statxbuf.stx_mask & UV_FS_STATX_ALL;
+    }
 
-    do
-      result = uv__fs_write(req);
-    while (result < 0 && errno == EINTR);
+    if (errno != ENOSYS)
+      return -1;
+
+    no_statx = 1;
+  }
+#endif
+
+  if (req->flags & UV_FS_STATX_NOFOLLOW) {
+    if (uv__fs_lstat(req->path, &req->statbuf))
+      return -1;
+  } else {
+    if (uv__fs_stat(req->path, &req->statbuf))
+      return -1;
+  }
+
+  return UV_FS_STATX_BASIC_STATS;
+}
+
+
+/* uv_fs_walk()的内部状态，挂在顶层请求的req->ptr上，只在loop线程里访问 */
+#define UV__FS_WALK_BATCH 256
+#define UV__FS_WALK_CONCURRENCY 4
+
+struct uv__fs_walk {
+  uv_fs_t* req;
+  uv_fs_walk_cb walk_cb;
+  unsigned int flags;
+  unsigned int concurrency;
+  unsigned int active;   /* 正在线程池里读的目录数 */
+  void* pending[2];      /* 还没开始读的目录 */
+  size_t total;
+  int err;
+};
+
+/* 一个待读的目录。内嵌的uv_fs_t只用来走uv__fs_work()，
+ * req.path是目录路径，req.ptr是跨批次保持打开的DIR*
+ */
+struct uv__fs_walk_dir {
+  uv_fs_t req;
+  struct uv__fs_walk* walk;
+  uv_fs_walk_entry_t* entries;
+  uv_stat_t* stats;
+  size_t nentries;
+  int eof;
+  int is_root;
+  void* queue[2];
+};
+
+
+static uv_dirent_type_t uv__fs_mode_to_dirent_type(mode_t mode) {
+  if (S_ISREG(mode))
+    return UV_DIRENT_FILE;
+  if (S_ISDIR(mode))
+    return UV_DIRENT_DIR;
+  if (S_ISLNK(mode))
+    return UV_DIRENT_LINK;
+  if (S_ISFIFO(mode))
+    return UV_DIRENT_FIFO;
+  if (S_ISSOCK(mode))
+    return UV_DIRENT_SOCKET;
+  if (S_ISCHR(mode))
+    return UV_DIRENT_CHAR;
+  if (S_ISBLK(mode))
+    return UV_DIRENT_BLOCK;
+  return UV_DIRENT_UNKNOWN;
+}
+
+
+static char* uv__fs_walk_join(const char* dir, const char* name) {
+  size_t dir_len;
+  size_t name_len;
+  char* path;
+
+  dir_len = strlen(dir);
+  name_len = strlen(name);
+
+  /* 根路径可能本来就带着结尾的'/' */
+  if (dir_len > 0 && dir[dir_len - 1] == '/')
+    dir_len--;
+
+  path = uv__malloc(dir_len + name_len + 2);
+  if (path == NULL)
+    return NULL;
+
+  memcpy(path, dir, dir_len);
+  path[dir_len] = '/';
+  memcpy(path + dir_len + 1, name, name_len + 1);
+  return path;
+}
+
+
+/* 在线程池里跑：从目录的当前位置读出最多UV__FS_WALK_BATCH个目录项。
+ * 出错时已经读出来的项保留在d->nentries里，由loop线程先交给用户
+ */
+static ssize_t uv__fs_walk_read(uv_fs_t* req) {
+  struct uv__fs_walk_dir* d;
+  uv_fs_walk_entry_t* e;
+  struct dirent* res;
+  uv_stat_t statbuf;
+  uv_stat_t* sp;
+  unsigned int flags;
+
+  d = container_of(req, struct uv__fs_walk_dir, req);
+  flags = d->walk->flags;
+  d->nentries = 0;
+
+  if (req->ptr == NULL) {
+    req->ptr = opendir(req->path);
+    if (req->ptr == NULL)
+      return -1;
+  }
+
+  if (d->entries == NULL) {
+    d->entries = uv__malloc(UV__FS_WALK_BATCH * sizeof(*d->entries));
+    if (d->entries == NULL)
+      goto nomem;
+  }
+
+  if ((flags & UV_FS_WALK_STAT) && d->stats == NULL) {
+    d->stats = uv__malloc(UV__FS_WALK_BATCH * sizeof(*d->stats));
+    if (d->stats == NULL)
+      goto nomem;
+  }
+
+  while (d->nentries < UV__FS_WALK_BATCH) {
+    errno = 0;
+    res = readdir(req->ptr);
+
+    if (res == NULL) {
+      if (errno != 0)
+        return -1;
+      d->eof = 1;
+      break;
+    }
+
+    if (strcmp(res->d_name, ".") == 0 || strcmp(res->d_name, "..") == 0)
+      continue;
+
+    e = &d->entries[d->nentries];
+    e->path = uv__fs_walk_join(req->path, res->d_name);
+    if (e->path == NULL)
+      goto nomem;
+
+    e->type = uv__fs_get_dirent_type(res);
+    e->statbuf = NULL;
+
+    /* 有些文件系统不填d_type，这时只能lstat()一下才知道要不要往下走 */
+    if ((flags & UV_FS_WALK_STAT) || e->type == UV_DIRENT_UNKNOWN) {
+      sp = (flags & UV_FS_WALK_STAT) ? &d->stats[d->nentries] : &statbuf;
+      if (uv__fs_lstat(e->path, sp) == 0) {
+        if (e->type == UV_DIRENT_UNKNOWN)
+          e->type = uv__fs_mode_to_dirent_type(sp->st_mode);
+        if (flags & UV_FS_WALK_STAT)
+          e->statbuf = sp;
+      }
+    }
+
+    d->nentries++;
+  }
+
+  return d->nentries;
+
+nomem:
+  errno = ENOMEM;
+  return -1;
+}
+
+static size_t uv__fs_buf_offset(uv_buf_t* bufs, size_t size) {
+  size_t offset;
+  /* Figure out which bufs are done */
+  for (offset = 0; size > 0 && bufs[offset].len <= size; ++offset)
+    size -= bufs[offset].len;
+
+  /* Fix a partial read/write */
+  if (size > 0) {
+    bufs[offset].base += size;
+    bufs[offset].len -= size;
+  }
+  return offset;
+}
+
+static ssize_t uv__fs_write_all(uv_fs_t* req) {
+  unsigned int iovmax;
+  unsigned int nbufs;
+  uv_buf_t* bufs;
+  ssize_t total;
+  ssize_t result;
+
+  iovmax = uv__getiovmax();
+  nbufs = req->nbufs;
+  bufs = req->bufs;
+  total = 0;
+
+  while (nbufs > 0) {
+    req->nbufs = nbufs;
+    if (req->nbufs > iovmax)
+      req->nbufs = iovmax;
+
+    do
+      result = uv__fs_write(req);
+    while (result < 0 && errno == EINTR);
 
     if (result <= 0) {
       if (total == 0)
@@ -1180,7 +2314,7 @@ static ssize_t uv__fs_write_all(uv_fs_t* req) {
   }
 
   if (bufs != req->bufsml)
-    uv__free(bufs);
+    uv__free_tag(bufs);
 
   req->bufs = NULL;
   req->nbufs = 0;
@@ -1211,6 +2345,7 @@ static void uv__fs_work(struct uv__work* w) {
     X(CHMOD, chmod(req->path, req->mode));
     X(CHOWN, chown(req->path, req->uid, req->gid));
     X(CLOSE, close(req->file));
+    X(CLOSEDIR, uv__fs_closedir(req));
     X(COPYFILE, uv__fs_copyfile(req));
     X(FCHMOD, fchmod(req->file, req->mode));
     X(FCHOWN, fchown(req->file, req->uid, req->gid));
@@ -1219,23 +2354,38 @@ static void uv__fs_work(struct uv__work* w) {
     X(FSTAT, uv__fs_fstat(req->file, &req->statbuf));
     X(FSYNC, uv__fs_fsync(req));
     X(FTRUNCATE, ftruncate(req->file, req->off));
+    X(FALLOCATE, uv__fs_fallocate(req));
+    X(FADVISE, uv__fs_fadvise(req));
+    X(READAHEAD, uv__fs_readahead(req));
     X(FUTIME, uv__fs_futime(req));
     X(LSTAT, uv__fs_lstat(req->path, &req->statbuf));
     X(LINK, link(req->path, req->new_path));
     X(MKDIR, mkdir(req->path, req->mode));
     X(MKDTEMP, uv__fs_mkdtemp(req));
+    X(MMAP, uv__fs_mmap(req));
+    X(MUNMAP, munmap(req->ptr, req->bufsml[0].len));
     X(OPEN, uv__fs_open(req));
+    X(OPENAT, uv__fs_open(req));
+    X(OPENDIR, uv__fs_opendir(req));
     X(READ, uv__fs_read(req));
+    X(READDIR, uv__fs_readdir(req));
     X(SCANDIR, uv__fs_scandir(req));
     X(READLINK, uv__fs_readlink(req));
     X(REALPATH, uv__fs_realpath(req));
     X(RENAME, rename(req->path, req->new_path));
+    X(RENAMEAT, renameat(req->file, req->path, req->flags, req->new_path));
     X(RMDIR, rmdir(req->path));
     X(SENDFILE, uv__fs_sendfile(req));
     X(STAT, uv__fs_stat(req->path, &req->statbuf));
+    X(STATAT, uv__fs_statat(req));
+    X(STATX, uv__fs_statx(req));
     X(SYMLINK, symlink(req->path, req->new_path));
     X(UNLINK, unlink(req->path));
+    X(UNLINKAT, unlinkat(req->file,
+                         req->path,
+                         req->flags & UV_FS_AT_REMOVEDIR ? AT_REMOVEDIR : 0));
     X(UTIME, uv__fs_utime(req));
+    X(WALK, uv__fs_walk_read(req));
     X(WRITE, uv__fs_write_all(req));
     default: abort();
     }
@@ -1249,9 +2399,14 @@ static void uv__fs_work(struct uv__work* w) {
 
   if (r == 0 && (req->fs_type == UV_FS_STAT ||
                  req->fs_type == UV_FS_FSTAT ||
-                 req->fs_type == UV_FS_LSTAT)) {
+                 req->fs_type == UV_FS_LSTAT ||
+                 req->fs_type == UV_FS_STATAT)) {
     req->ptr = &req->statbuf;
   }
+
+  /* statx返回的是字段的mask，可能是0 */
+  if (r >= 0 && req->fs_type == UV_FS_STATX)
+    req->ptr = &req->statbuf;
 }
 
 
@@ -1261,13 +2416,449 @@ static void uv__fs_done(struct uv__work* w, int status) {
   req = container_of(w, uv_fs_t, work_req);
   uv__req_unregister(req->loop, req);
 
-  if (status == UV_ECANCELED) {
+  /* 被取消或者过了截止时间，都没有执行过 */
+  if (status == UV_ECANCELED || status == UV_ETIMEDOUT) {
     assert(req->result == 0);
+    req->result = status;
+  }
+
+#if defined(__linux__)
+  /* 缓存命中的请求也走这里，store发现已经有了会直接返回 */
+  uv__fs_cache_store(req);
+#endif
+
+  req->cb(req);
+}
+
+
+static void uv__fs_walk_done(struct uv__work* w, int status);
+
+
+static struct uv__fs_walk_dir* uv__fs_walk_dir_new(struct uv__fs_walk* walk,
+                                                   char* path) {
+  struct uv__fs_walk_dir* d;
+
+  d = uv__calloc(1, sizeof(*d));
+  if (d == NULL)
+    return NULL;
+
+  UV_REQ_INIT(&d->req, UV_FS);
+  d->req.fs_type = UV_FS_WALK;
+  d->req.loop = walk->req->loop;
+  d->req.path = path;
+  d->walk = walk;
+  QUEUE_INSERT_TAIL(&walk->pending, &d->queue);
+  return d;
+}
+
+
+static void uv__fs_walk_dir_free(struct uv__fs_walk_dir* d) {
+  if (d->req.ptr != NULL)
+    closedir(d->req.ptr);
+
+  uv__free((char*) d->req.path);
+  uv__free(d->entries);
+  uv__free(d->stats);
+  uv__free(d);
+}
+
+
+static void uv__fs_walk_submit(struct uv__fs_walk_dir* d) {
+  d->walk->active++;
+  uv__work_submit(d->req.loop,
+                  &d->req.work_req,
+                  UV__WORK_SLOW_IO,
+                  uv__fs_work,
+                  uv__fs_walk_done);
+}
+
+
+/* 按并发上限把排队的目录派到线程池，全部走完就结束顶层请求 */
+static void uv__fs_walk_next(struct uv__fs_walk* walk) {
+  struct uv__fs_walk_dir* d;
+  uv_fs_t* req;
+  QUEUE* q;
+
+  while (walk->active < walk->concurrency && !QUEUE_EMPTY(&walk->pending)) {
+    q = QUEUE_HEAD(&walk->pending);
+    QUEUE_REMOVE(q);
+    d = QUEUE_DATA(q, struct uv__fs_walk_dir, queue);
+    uv__fs_walk_submit(d);
+  }
+
+  if (walk->active != 0)
+    return;
+
+  req = walk->req;
+  req->result = walk->err != 0 ? walk->err : (ssize_t) walk->total;
+  req->ptr = NULL;
+  uv__free(walk);
+
+  uv__req_unregister(req->loop, req);
+  req->cb(req);
+}
+
+
+static void uv__fs_walk_done(struct uv__work* w, int status) {
+  struct uv__fs_walk_dir* d;
+  struct uv__fs_walk* walk;
+  uv_fs_walk_entry_t dir_entry;
+  uv_fs_walk_entry_t* e;
+  size_t i;
+  int err;
+
+  d = container_of(w, struct uv__fs_walk_dir, req.work_req);
+  walk = d->walk;
+  walk->active--;
+
+  err = 0;
+  if (status == UV_ECANCELED)
+    err = UV_ECANCELED;
+  else if (d->req.result < 0)
+    err = d->req.result;
+
+  if (d->nentries > 0) {
+    walk->total += d->nentries;
+    walk->walk_cb(walk->req, 0, d->entries, d->nentries);
+
+    /* 子目录的路径直接交给新的目录任务，其余的释放掉 */
+    for (i = 0; i < d->nentries; i++) {
+      e = &d->entries[i];
+      if (e->type != UV_DIRENT_DIR ||
+          uv__fs_walk_dir_new(walk, (char*) e->path) == NULL) {
+        uv__free((char*) e->path);
+      }
+    }
+
+    d->nentries = 0;
+  }
+
+  if (err != 0) {
+    if (d->is_root && d->req.ptr == NULL) {
+      /* 根目录都打不开，整个请求失败 */
+      walk->err = err;
+    } else {
+      dir_entry.path = d->req.path;
+      dir_entry.type = UV_DIRENT_DIR;
+      dir_entry.statbuf = NULL;
+      walk->walk_cb(walk->req, err, &dir_entry, 1);
+    }
+  }
+
+  /* 没读完的目录先占回自己的名额，免得同时打开的DIR*越来越多 */
+  if (err == 0 && !d->eof)
+    uv__fs_walk_submit(d);
+  else
+    uv__fs_walk_dir_free(d);
+
+  uv__fs_walk_next(walk);
+}
+
+
+/* uv_fs_batch()和uv_fs_batch_submit()之间收集到的请求，通过work_req.wq串起来，
+ * 提交后在同一个工作线程里依次执行，只经过一次wq_async
+ */
+struct uv__fs_batch {
+  void* queue[2];
+  unsigned int count;
+};
+
+
+static int uv__fs_post_batch(uv_loop_t* loop, uv_fs_t* req) {
+  struct uv__fs_batch* batch;
+
+  if (loop->fs_batch == NULL)
+    return UV_ENOSYS;
+
+  batch = ((uv_fs_t*) loop->fs_batch)->ptr;
+  QUEUE_INSERT_TAIL(&batch->queue, &req->work_req.wq);
+  batch->count++;
+
+  /* 单个请求不在线程池里，不能单独取消 */
+  req->work_req.pool = NULL;
+  req->work_req.wait_time = 0;
+  req->work_req.run_time = 0;
+  return 0;
+}
+
+
+static void uv__fs_batch_work(struct uv__work* w) {
+  struct uv__fs_batch* batch;
+  uv_fs_t* req;
+  QUEUE* q;
+
+  req = container_of(w, uv_fs_t, work_req);
+  batch = req->ptr;
+
+  QUEUE_FOREACH(q, &batch->queue)
+    uv__fs_work(QUEUE_DATA(q, struct uv__work, wq));
+}
+
+
+static void uv__fs_batch_done(struct uv__work* w, int status) {
+  struct uv__fs_batch* batch;
+  uv_fs_t* req;
+  uv_fs_t* sub;
+  QUEUE* q;
+
+  req = container_of(w, uv_fs_t, work_req);
+  batch = req->ptr;
+
+  /* 回调里可能重用或者释放请求，先摘下来再调用 */
+  while (!QUEUE_EMPTY(&batch->queue)) {
+    q = QUEUE_HEAD(&batch->queue);
+    QUEUE_REMOVE(q);
+    sub = container_of(q, uv_fs_t, work_req.wq);
+    uv__fs_done(&sub->work_req, status);
+  }
+
+  if (status == UV_ECANCELED)
     req->result = UV_ECANCELED;
+  else
+    req->result = batch->count;
+  req->ptr = NULL;
+  uv__free(batch);
+
+  uv__req_unregister(req->loop, req);
+  req->cb(req);
+}
+
+
+/* loop开启了io_uring时，能在ring上做的请求直接提交过去，不经过线程池 */
+static int uv__fs_post_ring(uv_loop_t* loop, uv_fs_t* req) {
+#if defined(__linux__)
+  int err;
+
+  if (!(loop->flags & UV_LOOP_IO_URING))
+    return UV_ENOSYS;
+
+  /* 写不完时要在req->bufs上原地接着写，只处理bufs放在bufsml里的情况 */
+  if (req->fs_type == UV_FS_WRITE && req->bufs != req->bufsml)
+    return UV_ENOSYS;
+
+  if (req->fs_type == UV_FS_STAT ||
+      req->fs_type == UV_FS_LSTAT ||
+      req->fs_type == UV_FS_FSTAT ||
+      req->fs_type == UV_FS_STATX) {
+    req->ptr = uv__malloc(sizeof(struct uv__statx));
+    if (req->ptr == NULL)
+      return UV_ENOMEM;
+  }
+
+  err = uv__iou_fs_submit(loop, req);
+  if (err) {
+    uv__free(req->ptr);
+    req->ptr = NULL;
+    return err;
+  }
+
+  /* uv_cancel()靠pool判断请求是不是在线程池里 */
+  req->work_req.pool = NULL;
+  req->work_req.wait_time = 0;
+  req->work_req.run_time = 0;
+  return 0;
+#else
+  return UV_ENOSYS;
+#endif
+}
+
+
+/* UV_LOOP_FS_SYNC_COALESCE：同一个fd上同时最多只有一个fsync在执行。执行期间
+ * 新来的请求先排在waiters里，等它完成后合并成一次sync，全部跟着这一次完成。
+ * 不能搭正在执行的那一次，因为它可能在这些请求的数据写下去之前就开始了
+ */
+struct uv__fs_sync_group {
+  uv_os_fd_t file;
+  uv_fs_cb cb;          /* 正在执行的那个请求原来的回调 */
+  void* riders[2];      /* 跟着正在执行的sync完成的请求 */
+  void* waiters[2];     /* 等下一次sync的请求 */
+  void* queue[2];
+};
+
+
+static void uv__fs_sync_done(uv_fs_t* req);
+
+
+static struct uv__fs_sync_group* uv__fs_sync_group_find(uv_loop_t* loop,
+                                                        uv_os_fd_t file) {
+  struct uv__fs_sync_group* g;
+  QUEUE* q;
+
+  QUEUE_FOREACH(q, &loop->fs_sync_groups) {
+    g = QUEUE_DATA(q, struct uv__fs_sync_group, queue);
+    if (g->file == file)
+      return g;
+  }
+
+  return NULL;
+}
+
+
+/* 返回0表示请求排队了，不用再提交 */
+static int uv__fs_sync_coalesce(uv_loop_t* loop, uv_fs_t* req) {
+  struct uv__fs_sync_group* g;
+
+  g = uv__fs_sync_group_find(loop, req->file);
+  if (g != NULL) {
+    uv__req_register(loop, req);
+    req->work_req.pool = NULL;
+    req->work_req.wait_time = 0;
+    req->work_req.run_time = 0;
+    QUEUE_INSERT_TAIL(&g->waiters, &req->work_req.wq);
+    return 0;
+  }
+
+  /* 内存不够时不合并，照常提交 */
+  g = uv__malloc(sizeof(*g));
+  if (g == NULL)
+    return UV_ENOMEM;
+
+  g->file = req->file;
+  g->cb = req->cb;
+  QUEUE_INIT(&g->riders);
+  QUEUE_INIT(&g->waiters);
+  QUEUE_INSERT_TAIL(&loop->fs_sync_groups, &g->queue);
+  req->cb = uv__fs_sync_done;
+  return UV_ENOSYS;
+}
+
+
+static void uv__fs_sync_done(uv_fs_t* req) {
+  struct uv__fs_sync_group* g;
+  uv_fs_t* leader;
+  uv_fs_t* sub;
+  uv_loop_t* loop;
+  uv_fs_cb cb;
+  ssize_t result;
+  QUEUE riders;
+  QUEUE* q;
+
+  loop = req->loop;
+  result = req->result;
+  g = uv__fs_sync_group_find(loop, req->file);
+  assert(g != NULL);
+
+  cb = g->cb;
+  QUEUE_MOVE(&g->riders, &riders);
+
+  /* 回调之前先把下一次sync发出去，回调里再来的请求排到它后面。有人要fsync
+   * 就用fsync，它也覆盖了fdatasync
+   */
+  if (QUEUE_EMPTY(&g->waiters)) {
+    QUEUE_REMOVE(&g->queue);
+    uv__free(g);
+  } else {
+    QUEUE_MOVE(&g->waiters, &g->riders);
+    leader = NULL;
+    QUEUE_FOREACH(q, &g->riders) {
+      sub = container_of(q, uv_fs_t, work_req.wq);
+      if (sub->fs_type == UV_FS_FSYNC) {
+        leader = sub;
+        break;
+      }
+    }
+    if (leader == NULL)
+      leader = container_of(QUEUE_HEAD(&g->riders), uv_fs_t, work_req.wq);
+
+    QUEUE_REMOVE(&leader->work_req.wq);
+    g->cb = leader->cb;
+    leader->cb = uv__fs_sync_done;
+    if (uv__fs_post_ring(loop, leader) != 0)
+      uv__work_submit(loop,
+                      &leader->work_req,
+                      UV__WORK_FAST_IO,
+                      uv__fs_work,
+                      uv__fs_done);
   }
 
+  req->cb = cb;
+  cb(req);
+
+  while (!QUEUE_EMPTY(&riders)) {
+    q = QUEUE_HEAD(&riders);
+    QUEUE_REMOVE(q);
+    sub = container_of(q, uv_fs_t, work_req.wq);
+    sub->result = result;
+    uv__req_unregister(loop, sub);
+    sub->cb(sub);
+  }
+}
+
+
+#if defined(__linux__)
+/* ring上的请求完成了，res是系统调用的返回值或者负的errno */
+void uv__fs_iou_done(uv_fs_t* req, int res) {
+  size_t n;
+
+#if defined(O_DIRECT)
+  /* 和线程池里的路径一样，把O_DIRECT没对齐的EINVAL换成UV_EALIGN */
+  if (res == UV_EINVAL &&
+      (req->fs_type == UV_FS_READ || req->fs_type == UV_FS_WRITE) &&
+      req->bufs != NULL &&
+      uv__fs_check_direct(req) != 0) {
+    res = UV_EALIGN;
+  }
+#endif
+
+  switch (req->fs_type) {
+  case UV_FS_WRITE:
+    /* 和uv__fs_write_all()一样，没写完的部分接着写。再提交不上时就按
+     * 已经写了的字节数返回
+     */
+    if (res > 0) {
+      req->result += res;
+      if (req->off >= 0)
+        req->off += res;
+      n = uv__fs_buf_offset(req->bufs, res);
+      req->bufs += n;
+      req->nbufs -= n;
+      if (req->nbufs > 0 && uv__iou_fs_submit(req->loop, req) == 0)
+        return;
+    } else if (req->result == 0) {
+      req->result = res;
+    }
+    req->bufs = NULL;
+    req->nbufs = 0;
+    break;
+
+  case UV_FS_READ:
+    if (req->bufs != req->bufsml)
+      uv__free_tag(req->bufs);
+    req->bufs = NULL;
+    req->nbufs = 0;
+    req->result = res;
+    break;
+
+  case UV_FS_STAT:
+  case UV_FS_LSTAT:
+  case UV_FS_FSTAT:
+    if (res == 0)
+      uv__statx_to_stat(req->ptr, &req->statbuf);
+    uv__free(req->ptr);
+    req->ptr = res == 0 ? &req->statbuf : NULL;
+    req->result = res;
+    break;
+
+  case UV_FS_STATX:
+    if (res == 0) {
+      uv__statx_to_stat(req->ptr, &req->statbuf);
+      res = ((struct uv__statx*) req->ptr)->stx_mask & UV_FS_STATX_ALL;
+    }
+    uv__free(req->ptr);
+    req->ptr = res >= 0 ? &req->statbuf : NULL;
+    req->result = res;
+    break;
+
+  default:
+    req->result = res;
+    break;
+  }
+
+  uv__fs_cache_store(req);
+  uv__req_unregister(req->loop, req);
   req->cb(req);
 }
+#endif
 
 
 int uv_fs_access(uv_loop_t* loop,
@@ -1311,6 +2902,19 @@ int uv_fs_chown(uv_loop_t* loop,
 int uv_fs_close(uv_loop_t* loop, uv_fs_t* req, uv_os_fd_t file, uv_fs_cb cb) {
   INIT(CLOSE);
   req->file = file;
+#if defined(__linux__)
+  if (loop != NULL)
+    uv__iou_forget_file(loop, file);
+  /* UV_LOOP_FD_CACHE缓存着的fd放回缓存，不用关 */
+  if (loop != NULL && uv__fs_cache_release(loop, file)) {
+    req->result = 0;
+    if (cb == NULL)
+      return 0;
+    uv__req_register(loop, req);
+    uv__work_complete(loop, &req->work_req, uv__fs_done);
+    return 0;
+  }
+#endif
   POST;
 }
 
@@ -1335,55 +2939,175 @@ int uv_fs_fchown(uv_loop_t* loop,
                  uv_fs_cb cb) {
   INIT(FCHOWN);
   req->file = file;
-  req->uid = uid;
-  req->gid = gid;
+  req->uid = uid;
+  req->gid = gid;
+  POST;
+}
+
+
+int uv_fs_lchown(uv_loop_t* loop,
+                 uv_fs_t* req,
+                 const char* path,
+                 uv_uid_t uid,
+                 uv_gid_t gid,
+                 uv_fs_cb cb) {
+  INIT(LCHOWN);
+  PATH;
+  req->uid = uid;
+  req->gid = gid;
+  POST;
+}
+
+
+int uv_fs_fdatasync(uv_loop_t* loop, uv_fs_t* req, uv_os_fd_t file, uv_fs_cb cb) {
+  INIT(FDATASYNC);
+  req->file = file;
+  if (cb != NULL &&
+      (loop->flags & UV_LOOP_FS_COALESCE_SYNC) &&
+      uv__fs_sync_coalesce(loop, req) == 0) {
+    return 0;
+  }
+  POST;
+}
+
+
+int uv_fs_fstat(uv_loop_t* loop, uv_fs_t* req, uv_os_fd_t file, uv_fs_cb cb) {
+  INIT(FSTAT);
+  req->file = file;
+#if defined(__linux__)
+  if (cb != NULL && uv__fs_cache_lookup(loop, req)) {
+    uv__req_register(loop, req);
+    uv__work_complete(loop, &req->work_req, uv__fs_done);
+    return 0;
+  }
+#endif
+  POST;
+}
+
+
+int uv_fs_fsync(uv_loop_t* loop, uv_fs_t* req, uv_os_fd_t file, uv_fs_cb cb) {
+  INIT(FSYNC);
+  req->file = file;
+  if (cb != NULL &&
+      (loop->flags & UV_LOOP_FS_COALESCE_SYNC) &&
+      uv__fs_sync_coalesce(loop, req) == 0) {
+    return 0;
+  }
+  POST;
+}
+
+
+int uv_fs_ftruncate(uv_loop_t* loop,
+                    uv_fs_t* req,
+                    uv_os_fd_t file,
+                    int64_t off,
+                    uv_fs_cb cb) {
+  INIT(FTRUNCATE);
+  req->file = file;
+  req->off = off;
+  POST;
+}
+
+
+int uv_fs_fallocate(uv_loop_t* loop,
+                    uv_fs_t* req,
+                    uv_os_fd_t file,
+                    int mode,
+                    int64_t offset,
+                    int64_t len,
+                    uv_fs_cb cb) {
+  INIT(FALLOCATE);
+
+  if (mode & ~(UV_FS_FALLOCATE_KEEP_SIZE | UV_FS_FALLOCATE_PUNCH_HOLE))
+    return UV_EINVAL;
+
+  if (offset < 0 || len <= 0)
+    return UV_EINVAL;
+
+  req->file = file;
+  req->flags = mode;
+  req->off = offset;
+  req->bufsml[0].len = len;
+  POST;
+}
+
+
+int uv_fs_mmap(uv_loop_t* loop,
+               uv_fs_t* req,
+               uv_os_fd_t file,
+               int64_t offset,
+               size_t len,
+               int flags,
+               uv_fs_fadvise_advice advice,
+               uv_fs_cb cb) {
+  INIT(MMAP);
+
+  if (flags & ~(UV_FS_MMAP_WRITE | UV_FS_MMAP_POPULATE))
+    return UV_EINVAL;
+
+  /* 偏移必须按页对齐 */
+  if (offset < 0 || offset % getpagesize() != 0)
+    return UV_EINVAL;
+
+  req->file = file;
+  req->off = offset;
+  req->flags = flags;
+  req->mode = advice;
+  req->bufsml[0].len = len;
   POST;
 }
 
 
-int uv_fs_lchown(uv_loop_t* loop,
+int uv_fs_munmap(uv_loop_t* loop,
                  uv_fs_t* req,
-                 const char* path,
-                 uv_uid_t uid,
-                 uv_gid_t gid,
+                 void* addr,
+                 size_t len,
                  uv_fs_cb cb) {
-  INIT(LCHOWN);
-  PATH;
-  req->uid = uid;
-  req->gid = gid;
-  POST;
-}
+  INIT(MUNMAP);
 
+  if (addr == NULL || len == 0)
+    return UV_EINVAL;
 
-int uv_fs_fdatasync(uv_loop_t* loop, uv_fs_t* req, uv_os_fd_t file, uv_fs_cb cb) {
-  INIT(FDATASYNC);
-  req->file = file;
+  req->ptr = addr;
+  req->bufsml[0].len = len;
   POST;
 }
 
 
-int uv_fs_fstat(uv_loop_t* loop, uv_fs_t* req, uv_os_fd_t file, uv_fs_cb cb) {
-  INIT(FSTAT);
-  req->file = file;
-  POST;
-}
+int uv_fs_fadvise(uv_loop_t* loop,
+                  uv_fs_t* req,
+                  uv_os_fd_t file,
+                  int64_t offset,
+                  int64_t len,
+                  uv_fs_fadvise_advice advice,
+                  uv_fs_cb cb) {
+  INIT(FADVISE);
 
+  if (offset < 0 || len < 0)
+    return UV_EINVAL;
 
-int uv_fs_fsync(uv_loop_t* loop, uv_fs_t* req, uv_os_fd_t file, uv_fs_cb cb) {
-  INIT(FSYNC);
   req->file = file;
+  req->flags = advice;
+  req->off = offset;
+  req->bufsml[0].len = len;
   POST;
 }
 
 
-int uv_fs_ftruncate(uv_loop_t* loop,
+int uv_fs_readahead(uv_loop_t* loop,
                     uv_fs_t* req,
                     uv_os_fd_t file,
-                    int64_t off,
+                    int64_t offset,
+                    size_t len,
                     uv_fs_cb cb) {
-  INIT(FTRUNCATE);
+  INIT(READAHEAD);
+
+  if (offset < 0)
+    return UV_EINVAL;
+
   req->file = file;
-  req->off = off;
+  req->off = offset;
+  req->bufsml[0].len = len;
   POST;
 }
 
@@ -1449,7 +3173,8 @@ int uv_fs_mkdtemp(uv_loop_t* loop,
                   const char* tpl,
                   uv_fs_cb cb) {
   INIT(MKDTEMP);
-  req->path = uv__strdup(tpl);
+  /* 同步调用可能来自任意线程，不能用loop的内存池 */
+  req->path = uv__fs_path_copy(cb != NULL ? loop : NULL, req, tpl, NULL);
   if (req->path == NULL)
     return UV_ENOMEM;
   POST;
@@ -1466,6 +3191,13 @@ int uv_fs_open(uv_loop_t* loop,
   PATH;
   req->flags = flags;
   req->mode = mode;
+#if defined(__linux__)
+  if (cb != NULL && uv__fs_cache_lookup(loop, req)) {
+    uv__req_register(loop, req);
+    uv__work_complete(loop, &req->work_req, uv__fs_done);
+    return 0;
+  }
+#endif
   POST0;
 }
 
@@ -1486,7 +3218,7 @@ int uv_fs_read(uv_loop_t* loop, uv_fs_t* req,
   req->nbufs = nbufs;
   req->bufs = req->bufsml;
   if (nbufs > ARRAY_SIZE(req->bufsml))
-    req->bufs = uv__malloc(nbufs * sizeof(*bufs));
+    req->bufs = uv__malloc_tag(UV_MEM_FS_BUFS, nbufs * sizeof(*bufs));
 
   if (req->bufs == NULL)
     return UV_ENOMEM;
@@ -1494,6 +3226,17 @@ int uv_fs_read(uv_loop_t* loop, uv_fs_t* req,
   memcpy(req->bufs, bufs, nbufs * sizeof(*bufs));
 
   req->off = off;
+  req->flags = 0;
+
+#if defined(__linux__)
+  /* 回调还是要在下一轮循环里调用 */
+  if (cb != NULL && loop->fs_batch == NULL && uv__fs_read_nowait(req) == 0) {
+    uv__req_register(loop, req);
+    uv__work_complete(loop, &req->work_req, uv__fs_done);
+    return 0;
+  }
+#endif
+
   POST;
 }
 
@@ -1510,6 +3253,155 @@ int uv_fs_scandir(uv_loop_t* loop,
 }
 
 
+int uv_fs_openat(uv_loop_t* loop,
+                 uv_fs_t* req,
+                 uv_os_fd_t dir,
+                 const char* path,
+                 int flags,
+                 int mode,
+                 uv_fs_cb cb) {
+  INIT(OPENAT);
+  PATH;
+  req->file = dir;
+  req->flags = flags;
+  req->mode = mode;
+  POST;
+}
+
+
+int uv_fs_opendir(uv_loop_t* loop,
+                  uv_fs_t* req,
+                  const char* path,
+                  uv_fs_cb cb) {
+  INIT(OPENDIR);
+  PATH;
+  POST;
+}
+
+
+int uv_fs_readdir(uv_loop_t* loop,
+                  uv_fs_t* req,
+                  uv_dir_t* dir,
+                  uv_fs_cb cb) {
+  INIT(READDIR);
+
+  if (dir == NULL || dir->dir == NULL || dir->dirents == NULL)
+    return UV_EINVAL;
+
+  req->ptr = dir;
+  POST;
+}
+
+
+int uv_fs_closedir(uv_loop_t* loop,
+                   uv_fs_t* req,
+                   uv_dir_t* dir,
+                   uv_fs_cb cb) {
+  INIT(CLOSEDIR);
+
+  if (dir == NULL)
+    return UV_EINVAL;
+
+  req->ptr = dir;
+  POST;
+}
+
+
+int uv_fs_batch(uv_loop_t* loop, uv_fs_t* req, uv_fs_cb cb) {
+  struct uv__fs_batch* batch;
+
+  INIT(BATCH);
+
+  if (cb == NULL)
+    return UV_EINVAL;
+
+  if (loop->fs_batch != NULL)
+    return UV_EBUSY;
+
+  batch = uv__malloc(sizeof(*batch));
+  if (batch == NULL)
+    return UV_ENOMEM;
+
+  QUEUE_INIT(&batch->queue);
+  batch->count = 0;
+  req->ptr = batch;
+  loop->fs_batch = req;
+  return 0;
+}
+
+
+int uv_fs_batch_submit(uv_loop_t* loop, uv_fs_t* req) {
+  if (req == NULL || loop->fs_batch != req)
+    return UV_EINVAL;
+
+  loop->fs_batch = NULL;
+  uv__req_register(loop, req);
+  uv__work_submit(loop,
+                  &req->work_req,
+                  UV__WORK_FAST_IO,
+                  uv__fs_batch_work,
+                  uv__fs_batch_done);
+  return 0;
+}
+
+
+int uv_fs_walk(uv_loop_t* loop,
+               uv_fs_t* req,
+               const char* path,
+               unsigned int flags,
+               unsigned int concurrency,
+               uv_fs_walk_cb walk_cb,
+               uv_fs_cb cb) {
+  struct uv__fs_walk* walk;
+  struct uv__fs_walk_dir* d;
+  char* root;
+
+  INIT(WALK);
+
+  /* 只支持异步：结果是分批回调出来的 */
+  if (path == NULL || walk_cb == NULL || cb == NULL)
+    return UV_EINVAL;
+
+  if (flags & ~UV_FS_WALK_STAT)
+    return UV_EINVAL;
+
+  PATH;
+
+  walk = uv__calloc(1, sizeof(*walk));
+  root = uv__strdup(path);
+  if (walk == NULL || root == NULL)
+    goto nomem;
+
+  walk->req = req;
+  walk->walk_cb = walk_cb;
+  walk->flags = flags;
+  walk->concurrency = concurrency != 0 ? concurrency : UV__FS_WALK_CONCURRENCY;
+  QUEUE_INIT(&walk->pending);
+
+  d = uv__fs_walk_dir_new(walk, root);
+  if (d == NULL)
+    goto nomem;
+  d->is_root = 1;
+
+  /* 顶层请求自己不进线程池，uv_cancel()对它返回UV_EBUSY */
+  req->ptr = walk;
+  req->work_req.pool = NULL;
+  req->work_req.wait_time = 0;
+  req->work_req.run_time = 0;
+  uv__req_register(loop, req);
+  uv__fs_walk_next(walk);
+  return 0;
+
+nomem:
+  uv__free(root);
+  uv__free(walk);
+  if (req->path != req->pathsml)
+    uv__loop_free(loop, (char*) req->path);
+  req->path = NULL;
+  return UV_ENOMEM;
+}
+
+
 int uv_fs_readlink(uv_loop_t* loop,
                    uv_fs_t* req,
                    const char* path,
@@ -1526,6 +3418,13 @@ int uv_fs_realpath(uv_loop_t* loop,
                   uv_fs_cb cb) {
   INIT(REALPATH);
   PATH;
+#if defined(__linux__)
+  if (cb != NULL && uv__fs_cache_lookup(loop, req)) {
+    uv__req_register(loop, req);
+    uv__work_complete(loop, &req->work_req, uv__fs_done);
+    return 0;
+  }
+#endif
   POST;
 }
 
@@ -1541,6 +3440,21 @@ int uv_fs_rename(uv_loop_t* loop,
 }
 
 
+int uv_fs_renameat(uv_loop_t* loop,
+                   uv_fs_t* req,
+                   uv_os_fd_t dir,
+                   const char* path,
+                   uv_os_fd_t new_dir,
+                   const char* new_path,
+                   uv_fs_cb cb) {
+  INIT(RENAMEAT);
+  PATH2;
+  req->file = dir;
+  req->flags = new_dir; /* 跟sendfile一样借用flags放第二个fd */
+  POST;
+}
+
+
 int uv_fs_rmdir(uv_loop_t* loop, uv_fs_t* req, const char* path, uv_fs_cb cb) {
   INIT(RMDIR);
   PATH;
@@ -1567,6 +3481,49 @@ int uv_fs_sendfile(uv_loop_t* loop,
 int uv_fs_stat(uv_loop_t* loop, uv_fs_t* req, const char* path, uv_fs_cb cb) {
   INIT(STAT);
   PATH;
+#if defined(__linux__)
+  /* 打开了UV_LOOP_FS_CACHE时先查缓存，命中了不进线程池，回调在下一轮循环里 */
+  if (cb != NULL && uv__fs_cache_lookup(loop, req)) {
+    uv__req_register(loop, req);
+    uv__work_complete(loop, &req->work_req, uv__fs_done);
+    return 0;
+  }
+#endif
+  POST;
+}
+
+
+int uv_fs_statat(uv_loop_t* loop,
+                 uv_fs_t* req,
+                 uv_os_fd_t dir,
+                 const char* path,
+                 int flags,
+                 uv_fs_cb cb) {
+  if (flags & ~UV_FS_AT_SYMLINK_NOFOLLOW)
+    return UV_EINVAL;
+
+  INIT(STATAT);
+  PATH;
+  req->file = dir;
+  req->flags = flags;
+  POST;
+}
+
+
+int uv_fs_statx(uv_loop_t* loop,
+                uv_fs_t* req,
+                const char* path,
+                unsigned int mask,
+                int flags,
+                uv_fs_cb cb) {
+  INIT(STATX);
+
+  if (flags & ~(UV_FS_STATX_NOFOLLOW | UV_FS_STATX_DONT_SYNC))
+    return UV_EINVAL;
+
+  PATH;
+  req->mode = mask & UV_FS_STATX_ALL;
+  req->flags = flags;
   POST;
 }
 
@@ -1591,6 +3548,23 @@ int uv_fs_unlink(uv_loop_t* loop, uv_fs_t* req, const char* path, uv_fs_cb cb) {
 }
 
 
+int uv_fs_unlinkat(uv_loop_t* loop,
+                   uv_fs_t* req,
+                   uv_os_fd_t dir,
+                   const char* path,
+                   int flags,
+                   uv_fs_cb cb) {
+  if (flags & ~UV_FS_AT_REMOVEDIR)
+    return UV_EINVAL;
+
+  INIT(UNLINKAT);
+  PATH;
+  req->file = dir;
+  req->flags = flags;
+  POST;
+}
+
+
 int uv_fs_utime(uv_loop_t* loop,
                 uv_fs_t* req,
                 const char* path,
@@ -1634,7 +3608,7 @@ int uv_fs_write(uv_loop_t* loop,
   req->nbufs = nbufs;
   req->bufs = req->bufsml;
   if (nbufs > ARRAY_SIZE(req->bufsml))
-    req->bufs = uv__malloc(nbufs * sizeof(*bufs));
+    req->bufs = uv__malloc_tag(UV_MEM_FS_BUFS, nbufs * sizeof(*bufs));
 
   if (req->bufs == NULL)
     return UV_ENOMEM;
@@ -1642,10 +3616,157 @@ int uv_fs_write(uv_loop_t* loop,
   memcpy(req->bufs, bufs, nbufs * sizeof(*bufs));
 
   req->off = off;
+  req->flags = 0;
+  POST;
+}
+
+
+/* uv_fs_read_fixed()和uv_fs_write_fixed()共用的部分。buf在登记过的缓冲区里时
+ * req->flags是缓冲区的序号加1；loop没有登记缓冲区的话就是普通的读写
+ */
+static int uv__fs_fixed_init(uv_loop_t* loop,
+                             uv_fs_t* req,
+                             uv_os_fd_t file,
+                             const uv_buf_t* buf,
+                             unsigned int index,
+                             int64_t off) {
+#if defined(__linux__)
+  int err;
+#endif
+
+  if (buf == NULL)
+    return UV_EINVAL;
+
+  req->file = file;
+  req->nbufs = 1;
+  req->bufs = req->bufsml;
+  req->bufsml[0] = *buf;
+  req->off = off;
+  req->flags = 0;
+
+#if defined(__linux__)
+  if (loop != NULL) {
+    err = uv__iou_fixed_buf(loop, buf, index);
+    if (err == 0)
+      req->flags = index + 1;
+    else if (err != UV_ENOENT)
+      return err;
+  }
+#endif
+
+  return 0;
+}
+
+
+int uv_fs_read_fixed(uv_loop_t* loop,
+                     uv_fs_t* req,
+                     uv_os_fd_t file,
+                     const uv_buf_t* buf,
+                     unsigned int index,
+                     int64_t off,
+                     uv_fs_cb cb) {
+  int err;
+
+  INIT(READ);
+  err = uv__fs_fixed_init(loop, req, file, buf, index, off);
+  if (err)
+    return err;
+  POST;
+}
+
+
+int uv_fs_write_fixed(uv_loop_t* loop,
+                      uv_fs_t* req,
+                      uv_os_fd_t file,
+                      const uv_buf_t* buf,
+                      unsigned int index,
+                      int64_t off,
+                      uv_fs_cb cb) {
+  int err;
+
+  INIT(WRITE);
+  err = uv__fs_fixed_init(loop, req, file, buf, index, off);
+  if (err)
+    return err;
   POST;
 }
 
 
+int uv_fs_register_buffers(uv_loop_t* loop,
+                           const uv_buf_t bufs[],
+                           unsigned int nbufs) {
+  if (loop == NULL || (bufs == NULL && nbufs != 0))
+    return UV_EINVAL;
+
+#if defined(__linux__)
+  return uv__iou_register_buffers(loop, bufs, nbufs);
+#else
+  return UV_ENOSYS;
+#endif
+}
+
+
+int uv_fs_register_files(uv_loop_t* loop,
+                         const uv_os_fd_t files[],
+                         unsigned int nfiles) {
+  if (loop == NULL || (files == NULL && nfiles != 0))
+    return UV_EINVAL;
+
+#if defined(__linux__)
+  return uv__iou_register_files(loop, files, nfiles);
+#else
+  return UV_ENOSYS;
+#endif
+}
+
+
+int uv_buf_aligned_alloc(uv_os_fd_t file, size_t len, uv_buf_t* buf) {
+  size_t mem_align;
+  size_t off_align;
+  struct stat s;
+  void* base;
+  int err;
+
+  if (buf == NULL || len == 0)
+    return UV_EINVAL;
+
+  mem_align = 0;
+  off_align = 0;
+  if (file >= 0)
+    uv__fs_dio_align(file, &mem_align, &off_align);
+
+  /* 查不到时按st_blksize对齐，多对齐一些总是安全的 */
+  if (off_align == 0) {
+    if (file >= 0 && fstat(file, &s) == 0 && s.st_blksize > 0)
+      off_align = s.st_blksize;
+    if (off_align == 0 || (off_align & (off_align - 1)) != 0)
+      off_align = 4096;
+  }
+
+  if (mem_align < off_align)
+    mem_align = off_align;
+  if (mem_align < sizeof(void*))
+    mem_align = sizeof(void*);
+
+  len = (len + off_align - 1) / off_align * off_align;
+
+  /* 没有走uv__malloc()，必须用uv_buf_aligned_free()释放 */
+  err = posix_memalign(&base, mem_align, len);
+  if (err != 0)
+    return UV__ERR(err);
+
+  *buf = uv_buf_init(base, len);
+  return 0;
+}
+
+
+void uv_buf_aligned_free(uv_buf_t* buf) {
+  free(buf->base);
+  buf->base = NULL;
+  buf->len = 0;
+}
+
+
 void uv_fs_req_cleanup(uv_fs_t* req) {
   if (req == NULL)
     return;
@@ -1655,8 +3776,11 @@ void uv_fs_req_cleanup(uv_fs_t* req) {
    * req->new_path pointing to user-owned memory.  UV_FS_MKDTEMP is the
    * exception to the rule, it always allocates memory.
    */
-  if (req->path != NULL && (req->cb != NULL || req->fs_type == UV_FS_MKDTEMP))
-    uv__free((void*) req->path);  /* Memory is shared with req->new_path. */
+  if (req->path != NULL &&
+      req->path != req->pathsml &&
+      (req->cb != NULL || req->fs_type == UV_FS_MKDTEMP))
+    /* Memory is shared with req->new_path. */
+    uv__loop_free(req->loop, (void*) req->path);
 
   req->path = NULL;
   req->new_path = NULL;
@@ -1664,12 +3788,22 @@ void uv_fs_req_cleanup(uv_fs_t* req) {
   if (req->fs_type == UV_FS_SCANDIR && req->ptr != NULL)
     uv__fs_scandir_cleanup(req);
 
+  if (req->fs_type == UV_FS_READDIR && req->ptr != NULL)
+    uv__fs_readdir_cleanup(req);
+
   if (req->bufs != req->bufsml)
-    uv__free(req->bufs);
+    uv__free_tag(req->bufs);
   req->bufs = NULL;
 
-  if (req->ptr != &req->statbuf)
+  /* opendir得到的uv_dir_t要留给用户，由uv_fs_closedir()释放；mmap的映射
+   * 由uv_fs_munmap()释放
+   */
+  if (req->fs_type != UV_FS_OPENDIR &&
+      req->fs_type != UV_FS_MMAP &&
+      req->fs_type != UV_FS_MUNMAP &&
+      req->ptr != &req->statbuf) {
     uv__free(req->ptr);
+  }
   req->ptr = NULL;
 }
 
@@ -1684,11 +3818,30 @@ int uv_fs_copyfile(uv_loop_t* loop,
 
   if (flags & ~(UV_FS_COPYFILE_EXCL |
                 UV_FS_COPYFILE_FICLONE |
-                UV_FS_COPYFILE_FICLONE_FORCE)) {
+                UV_FS_COPYFILE_FICLONE_FORCE |
+                UV_FS_COPYFILE_PARALLEL)) {
     return UV_EINVAL;
   }
 
   PATH2;
   req->flags = flags;
+  req->off = 0;
+  req->statbuf.st_size = 0;
   POST;
 }
+
+
+int uv_fs_copyfile_progress(const uv_fs_t* req,
+                            uint64_t* copied,
+                            uint64_t* total) {
+  if (req == NULL || req->fs_type != UV_FS_COPYFILE)
+    return UV_EINVAL;
+
+  if (copied != NULL)
+    *copied = __atomic_load_n(&req->off, __ATOMIC_RELAXED);
+
+  if (total != NULL)
+    *total = __atomic_load_n(&req->statbuf.st_size, __ATOMIC_RELAXED);
+
+  return 0;
+}
@@ -38,6 +38,11 @@ int uv__fsevents_close(uv_fs_event_t* handle) {
 void uv__fsevents_loop_delete(uv_loop_t* loop) {
 }
 
+
+int uv__fsevents_set_latency(uv_loop_t* loop, unsigned int ms) {
+  return UV_ENOSYS;
+}
+
 #else /* TARGET_OS_IPHONE */
 
 #include <dlfcn.h>
@@ -73,15 +78,17 @@ typedef struct uv__fsevents_event_s uv__fsevents_event_t;
 typedef struct uv__cf_loop_signal_s uv__cf_loop_signal_t;
 typedef struct uv__cf_loop_state_s uv__cf_loop_state_t;
 
+/* 信号不再带handle：CF线程只按loop上的handle列表重新计算要监听的路径，
+ * 关闭handle时也就不用等CF线程处理完。
+ */
 enum uv__cf_loop_signal_type_e {
-  kUVCFLoopSignalRegular,
-  kUVCFLoopSignalClosing
+  kUVCFLoopSignalRegular,  /* handle列表或者延迟变了，重新计算事件流 */
+  kUVCFLoopSignalStop      /* 结束CF线程 */
 };
 typedef enum uv__cf_loop_signal_type_e uv__cf_loop_signal_type_t;
 
 struct uv__cf_loop_signal_s {
   QUEUE member;
-  uv_fs_event_t* handle;
   uv__cf_loop_signal_type_t type;
 };
 
@@ -95,18 +102,21 @@ struct uv__cf_loop_state_s {
   CFRunLoopRef loop;
   CFRunLoopSourceRef signal_source;
   int fsevent_need_reschedule;
+  int fsevent_need_restart;  /* 根路径不变也要重建，比如改了延迟 */
   FSEventStreamRef fsevent_stream;
-  uv_sem_t fsevent_sem;
   uv_mutex_t fsevent_mutex;
   void* fsevent_handles[2];
   unsigned int fsevent_handle_count;
+  unsigned int fsevent_latency;  /* 毫秒 */
+  /* 当前事件流监听的根路径，只在CF线程里访问 */
+  char** fsevent_roots;
+  unsigned int fsevent_root_count;
 };
 
 /* Forward declarations */
 static void uv__cf_loop_cb(void* arg);
 static void* uv__cf_loop_runner(void* arg);
 static int uv__cf_loop_signal(uv_loop_t* loop,
-                              uv_fs_event_t* handle,
                               uv__cf_loop_signal_type_t type);
 
 /* Lazy-loaded by uv__fsevents_global_init(). */
@@ -134,6 +144,7 @@ static CFStringRef (*pCFStringCreateWithFileSystemRepresentation)(
     const char*);
 static CFStringEncoding (*pCFStringGetSystemEncoding)(void);
 static CFStringRef (*pkCFRunLoopDefaultMode);
+static const CFArrayCallBacks (*pkCFTypeArrayCallBacks);
 static FSEventStreamRef (*pFSEventStreamCreate)(CFAllocatorRef,
                                                 FSEventStreamCallback,
                                                 FSEventStreamContext*,
@@ -310,12 +321,18 @@ static void uv__fsevents_event_cb(ConstFSEventStreamRef streamRef,
 
 
 /* Runs in CF thread */
-static int uv__fsevents_create_stream(uv_loop_t* loop, CFArrayRef paths) {
+static int uv__fsevents_create_stream(uv_loop_t* loop,
+                                      char** roots,
+                                      unsigned int count,
+                                      unsigned int latency) {
   uv__cf_loop_state_t* state;
   FSEventStreamContext ctx;
   FSEventStreamRef ref;
-  CFAbsoluteTime latency;
   FSEventStreamCreateFlags flags;
+  CFStringRef* paths;
+  CFArrayRef cf_paths;
+  unsigned int i;
+  int err;
 
   /* Initialize context */
   ctx.version = 0;
@@ -324,7 +341,28 @@ static int uv__fsevents_create_stream(uv_loop_t* loop, CFArrayRef paths) {
   ctx.release = NULL;
   ctx.copyDescription = NULL;
 
-  latency = 0.05;
+  /* 数组用kCFTypeArrayCallBacks持有字符串，事件流创建以后数组和字符串都可以
+   * 释放，事件流自己会保留一份。
+   */
+  paths = uv__malloc(sizeof(*paths) * count);
+  if (paths == NULL)
+    return UV_ENOMEM;
+
+  cf_paths = NULL;
+  err = UV_ENOMEM;
+
+  for (i = 0; i < count; i++) {
+    paths[i] = pCFStringCreateWithFileSystemRepresentation(NULL, roots[i]);
+    if (paths[i] == NULL)
+      goto out;
+  }
+
+  cf_paths = pCFArrayCreate(NULL,
+                            (const void**) paths,
+                            count,
+                            pkCFTypeArrayCallBacks);
+  if (cf_paths == NULL)
+    goto out;
 
   /* Explanation of selected flags:
    * 1. NoDefer - without this flag, events that are happening continuously
@@ -349,9 +387,9 @@ static int uv__fsevents_create_stream(uv_loop_t* loop, CFArrayRef paths) {
   ref = pFSEventStreamCreate(NULL,
                              &uv__fsevents_event_cb,
                              &ctx,
-                             paths,
+                             cf_paths,
                              kFSEventStreamEventIdSinceNow,
-                             latency,
+                             (CFAbsoluteTime) latency / 1000,
                              flags);
   assert(ref != NULL);
 
@@ -362,11 +400,20 @@ static int uv__fsevents_create_stream(uv_loop_t* loop, CFArrayRef paths) {
   if (!pFSEventStreamStart(ref)) {
     pFSEventStreamInvalidate(ref);
     pFSEventStreamRelease(ref);
-    return UV_EMFILE;
+    err = UV_EMFILE;
+    goto out;
   }
 
   state->fsevent_stream = ref;
-  return 0;
+  err = 0;
+
+out:
+  if (cf_paths != NULL)
+    pCFRelease(cf_paths);
+  while (i != 0)
+    pCFRelease(paths[--i]);
+  uv__free(paths);
+  return err;
 }
 
 
@@ -389,92 +436,170 @@ static void uv__fsevents_destroy_stream(uv_loop_t* loop) {
 }
 
 
-/* Runs in CF thread, when there're new fsevent handles to add to stream */
-static void uv__fsevents_reschedule(uv_fs_event_t* handle,
-                                    uv__cf_loop_signal_type_t type) {
-  uv__cf_loop_state_t* state;
+/* 路径排序时'/'排在其他字符前面，一个目录下的路径就紧跟在它后面，
+ * 不会被"/a-b"这样的兄弟目录隔开。
+ */
+static unsigned uv__fsevents_path_rank(unsigned char c) {
+  if (c == '\0')
+    return 0;
+  if (c == '/')
+    return 1;
+  return c + 1;
+}
+
+
+static int uv__fsevents_path_cmp(const void* a, const void* b) {
+  const unsigned char* p;
+  const unsigned char* q;
+
+  p = *(const unsigned char* const*) a;
+  q = *(const unsigned char* const*) b;
+
+  while (*p == *q && *p != '\0') {
+    p++;
+    q++;
+  }
+
+  return (int) uv__fsevents_path_rank(*p) - (int) uv__fsevents_path_rank(*q);
+}
+
+
+/* |path|是|root|自己或者在它下面。FSEventStream总是递归监听的，
+ * uv__fsevents_event_cb再按每个handle的路径过滤，所以这样的路径不用单独
+ * 加进事件流。
+ */
+static int uv__fsevents_path_covers(const char* root, const char* path) {
+  size_t len;
+
+  len = strlen(root);
+  if (len == 1 && *root == '/')
+    return 1;
+
+  if (strncmp(root, path, len) != 0)
+    return 0;
+
+  return path[len] == '\0' || path[len] == '/';
+}
+
+
+static void uv__fsevents_free_roots(char** roots, unsigned int count) {
+  while (count != 0)
+    uv__free(roots[--count]);
+  uv__free(roots);
+}
+
+
+/* Runs in CF thread with fsevent_mutex held. 算出覆盖所有handle的最少的
+ * 根路径（排好序、复制过的），几千个handle监听同一个项目下的目录时只有
+ * 一个根。
+ */
+static int uv__fsevents_compute_roots(uv__cf_loop_state_t* state,
+                                      char*** roots,
+                                      unsigned int* count) {
+  uv_fs_event_t* curr;
+  char** paths;
   QUEUE* q;
+  unsigned int i;
+  unsigned int n;
+
+  *roots = NULL;
+  *count = 0;
+
+  if (state->fsevent_handle_count == 0)
+    return 0;
+
+  paths = uv__malloc(sizeof(*paths) * state->fsevent_handle_count);
+  if (paths == NULL)
+    return UV_ENOMEM;
+
+  n = 0;
+  QUEUE_FOREACH(q, &state->fsevent_handles) {
+    curr = QUEUE_DATA(q, uv_fs_event_t, cf_member);
+    assert(curr->realpath != NULL);
+    paths[n++] = curr->realpath;
+  }
+  assert(n == state->fsevent_handle_count);
+
+  qsort(paths, n, sizeof(*paths), uv__fsevents_path_cmp);
+
+  /* 排序以后只要和上一个根比较 */
+  for (i = 0, n = 0; i < state->fsevent_handle_count; i++)
+    if (n == 0 || !uv__fsevents_path_covers(paths[n - 1], paths[i]))
+      paths[n++] = paths[i];
+
+  /* handle关闭时不等CF线程，根路径要有自己的副本 */
+  for (i = 0; i < n; i++) {
+    paths[i] = uv__strdup(paths[i]);
+    if (paths[i] == NULL) {
+      uv__fsevents_free_roots(paths, i);
+      return UV_ENOMEM;
+    }
+  }
+
+  *roots = paths;
+  *count = n;
+  return 0;
+}
+
+
+/* Runs in CF thread, once per batch of signals. 只有覆盖的根路径变了（或者
+ * 改了延迟）才重建事件流，在已经监听的目录下面增删handle不会重建。
+ */
+static void uv__fsevents_reschedule(uv_loop_t* loop) {
+  uv__cf_loop_state_t* state;
   uv_fs_event_t* curr;
-  CFArrayRef cf_paths;
-  CFStringRef* paths;
+  unsigned int latency;
+  unsigned int count;
   unsigned int i;
+  char** roots;
+  QUEUE* q;
+  int restart;
   int err;
-  unsigned int path_count;
 
-  state = handle->loop->cf_state;
-  paths = NULL;
-  cf_paths = NULL;
-  err = 0;
-  /* NOTE: `i` is used in deallocation loop below */
-  i = 0;
+  state = loop->cf_state;
 
-  /* Optimization to prevent O(n^2) time spent when starting to watch
-   * many files simultaneously
-   */
   uv_mutex_lock(&state->fsevent_mutex);
   if (state->fsevent_need_reschedule == 0) {
     uv_mutex_unlock(&state->fsevent_mutex);
-    goto final;
+    return;
   }
   state->fsevent_need_reschedule = 0;
+  restart = state->fsevent_need_restart;
+  state->fsevent_need_restart = 0;
+  latency = state->fsevent_latency;
+  err = uv__fsevents_compute_roots(state, &roots, &count);
   uv_mutex_unlock(&state->fsevent_mutex);
 
-  /* Destroy previous FSEventStream */
-  uv__fsevents_destroy_stream(handle->loop);
-
-  /* Any failure below will be a memory failure */
-  err = UV_ENOMEM;
+  if (err == 0 && restart == 0 && count == state->fsevent_root_count) {
+    for (i = 0; i < count; i++)
+      if (strcmp(roots[i], state->fsevent_roots[i]) != 0)
+        break;
 
-  /* Create list of all watched paths */
-  uv_mutex_lock(&state->fsevent_mutex);
-  path_count = state->fsevent_handle_count;
-  if (path_count != 0) {
-    paths = uv__malloc(sizeof(*paths) * path_count);
-    if (paths == NULL) {
-      uv_mutex_unlock(&state->fsevent_mutex);
-      goto final;
+    if (i == count) {
+      uv__fsevents_free_roots(roots, count);
+      return;
     }
+  }
 
-    q = &state->fsevent_handles;
-    for (; i < path_count; i++) {
-      q = QUEUE_NEXT(q);
-      assert(q != &state->fsevent_handles);
-      curr = QUEUE_DATA(q, uv_fs_event_t, cf_member);
+  if (err == 0) {
+    /* Destroy previous FSEventStream */
+    uv__fsevents_destroy_stream(loop);
+    uv__fsevents_free_roots(state->fsevent_roots, state->fsevent_root_count);
+    state->fsevent_roots = NULL;
+    state->fsevent_root_count = 0;
 
-      assert(curr->realpath != NULL);
-      paths[i] =
-          pCFStringCreateWithFileSystemRepresentation(NULL, curr->realpath);
-      if (paths[i] == NULL) {
-        uv_mutex_unlock(&state->fsevent_mutex);
-        goto final;
-      }
-    }
-  }
-  uv_mutex_unlock(&state->fsevent_mutex);
-  err = 0;
+    if (count != 0)
+      err = uv__fsevents_create_stream(loop, roots, count, latency);
 
-  if (path_count != 0) {
-    /* Create new FSEventStream */
-    cf_paths = pCFArrayCreate(NULL, (const void**) paths, path_count, NULL);
-    if (cf_paths == NULL) {
-      err = UV_ENOMEM;
-      goto final;
+    if (err == 0) {
+      state->fsevent_roots = roots;
+      state->fsevent_root_count = count;
+    } else {
+      uv__fsevents_free_roots(roots, count);
     }
-    err = uv__fsevents_create_stream(handle->loop, cf_paths);
   }
 
-final:
-  /* Deallocate all paths in case of failure */
   if (err != 0) {
-    if (cf_paths == NULL) {
-      while (i != 0)
-        pCFRelease(paths[--i]);
-      uv__free(paths);
-    } else {
-      /* CFArray takes ownership of both strings and original C-array */
-      pCFRelease(cf_paths);
-    }
-
     /* Broadcast error to all handles */
     uv_mutex_lock(&state->fsevent_mutex);
     QUEUE_FOREACH(q, &state->fsevent_handles) {
@@ -483,15 +608,6 @@ final:
     }
     uv_mutex_unlock(&state->fsevent_mutex);
   }
-
-  /*
-   * Main thread will block until the removal of handle from the list,
-   * we must tell it when we're ready.
-   *
-   * NOTE: This is coupled with `uv_sem_wait()` in `uv__fsevents_close`
-   */
-  if (type == kUVCFLoopSignalClosing)
-    uv_sem_post(&state->fsevent_sem);
 }
 
 
@@ -547,6 +663,7 @@ static int uv__fsevents_global_init(void) {
   V(core_foundation_handle, CFStringCreateWithFileSystemRepresentation);
   V(core_foundation_handle, CFStringGetSystemEncoding);
   V(core_foundation_handle, kCFRunLoopDefaultMode);
+  V(core_foundation_handle, kCFTypeArrayCallBacks);
   V(core_services_handle, FSEventStreamCreate);
   V(core_services_handle, FSEventStreamFlushSync);
   V(core_services_handle, FSEventStreamInvalidate);
@@ -602,17 +719,17 @@ static int uv__fsevents_loop_init(uv_loop_t* loop) {
 
   QUEUE_INIT(&loop->cf_signals);
 
-  err = uv_sem_init(&state->fsevent_sem, 0);
-  if (err)
-    goto fail_fsevent_sem_init;
-
   err = uv_mutex_init(&state->fsevent_mutex);
   if (err)
     goto fail_fsevent_mutex_init;
 
   QUEUE_INIT(&state->fsevent_handles);
   state->fsevent_need_reschedule = 0;
+  state->fsevent_need_restart = 0;
   state->fsevent_handle_count = 0;
+  state->fsevent_latency = loop->cf_latency;
+  state->fsevent_roots = NULL;
+  state->fsevent_root_count = 0;
 
   memset(&ctx, 0, sizeof(ctx));
   ctx.info = loop;
@@ -657,9 +774,6 @@ fail_signal_source_create:
   uv_mutex_destroy(&state->fsevent_mutex);
 
 fail_fsevent_mutex_init:
-  uv_sem_destroy(&state->fsevent_sem);
-
-fail_fsevent_sem_init:
   uv_sem_destroy(&loop->cf_sem);
 
 fail_sem_init:
@@ -680,7 +794,7 @@ void uv__fsevents_loop_delete(uv_loop_t* loop) {
   if (loop->cf_state == NULL)
     return;
 
-  if (uv__cf_loop_signal(loop, NULL, kUVCFLoopSignalRegular) != 0)
+  if (uv__cf_loop_signal(loop, kUVCFLoopSignalStop) != 0)
     abort();
 
   uv_thread_join(&loop->cf_thread);
@@ -697,7 +811,7 @@ void uv__fsevents_loop_delete(uv_loop_t* loop) {
 
   /* Destroy state */
   state = loop->cf_state;
-  uv_sem_destroy(&state->fsevent_sem);
+  uv__fsevents_free_roots(state->fsevent_roots, state->fsevent_root_count);
   uv_mutex_destroy(&state->fsevent_mutex);
   pCFRelease(state->signal_source);
   uv__free(state);
@@ -736,9 +850,11 @@ static void uv__cf_loop_cb(void* arg) {
   QUEUE* item;
   QUEUE split_head;
   uv__cf_loop_signal_t* s;
+  int stop;
 
   loop = arg;
   state = loop->cf_state;
+  stop = 0;
 
   uv_mutex_lock(&loop->cf_mutex);
   QUEUE_MOVE(&loop->cf_signals, &split_head);
@@ -751,19 +867,22 @@ static void uv__cf_loop_cb(void* arg) {
     s = QUEUE_DATA(item, uv__cf_loop_signal_t, member);
 
     /* This was a termination signal */
-    if (s->handle == NULL)
-      pCFRunLoopStop(state->loop);
-    else
-      uv__fsevents_reschedule(s->handle, s->type);
+    if (s->type == kUVCFLoopSignalStop)
+      stop = 1;
 
     uv__free(s);
   }
+
+  /* 这一批里所有的增删合起来最多重建一次事件流 */
+  uv__fsevents_reschedule(loop);
+
+  if (stop)
+    pCFRunLoopStop(state->loop);
 }
 
 
 /* Runs in UV loop to notify CF thread */
 int uv__cf_loop_signal(uv_loop_t* loop,
-                       uv_fs_event_t* handle,
                        uv__cf_loop_signal_type_t type) {
   uv__cf_loop_signal_t* item;
   uv__cf_loop_state_t* state;
@@ -772,7 +891,6 @@ int uv__cf_loop_signal(uv_loop_t* loop,
   if (item == NULL)
     return UV_ENOMEM;
 
-  item->handle = handle;
   item->type = type;
 
   uv_mutex_lock(&loop->cf_mutex);
@@ -835,8 +953,7 @@ int uv__fsevents_init(uv_fs_event_t* handle) {
   uv_mutex_unlock(&state->fsevent_mutex);
 
   /* Reschedule FSEventStream */
-  assert(handle != NULL);
-  err = uv__cf_loop_signal(handle->loop, handle, kUVCFLoopSignalRegular);
+  err = uv__cf_loop_signal(handle->loop, kUVCFLoopSignalRegular);
   if (err)
     goto fail_loop_signal;
 
@@ -860,7 +977,6 @@ fail_cf_cb_malloc:
 
 /* Runs in UV loop to de-initialize handle */
 int uv__fsevents_close(uv_fs_event_t* handle) {
-  int err;
   uv__cf_loop_state_t* state;
 
   if (handle->cf_cb == NULL)
@@ -874,14 +990,11 @@ int uv__fsevents_close(uv_fs_event_t* handle) {
   state->fsevent_need_reschedule = 1;
   uv_mutex_unlock(&state->fsevent_mutex);
 
-  /* Reschedule FSEventStream */
-  assert(handle != NULL);
-  err = uv__cf_loop_signal(handle->loop, handle, kUVCFLoopSignalClosing);
-  if (err)
-    return UV__ERR(err);
-
-  /* Wait for deinitialization */
-  uv_sem_wait(&state->fsevent_sem);
+  /* Reschedule FSEventStream. 从列表里摘掉以后CF线程不会再碰这个handle，
+   * 不用等它重建完事件流。发信号失败也没关系：多出来的根路径上的事件会被
+   * 过滤掉，fsevent_need_reschedule留到下一次信号再处理。
+   */
+  (void) uv__cf_loop_signal(handle->loop, kUVCFLoopSignalRegular);
 
   uv_close((uv_handle_t*) handle->cf_cb, (uv_close_cb) uv__free);
   handle->cf_cb = NULL;
@@ -899,4 +1012,26 @@ int uv__fsevents_close(uv_fs_event_t* handle) {
   return 0;
 }
 
+
+/* Runs in UV loop. 延迟记在loop上，CF线程下次创建事件流时生效；已经有
+ * 事件流时让它重建一次。
+ */
+int uv__fsevents_set_latency(uv_loop_t* loop, unsigned int ms) {
+  uv__cf_loop_state_t* state;
+
+  loop->cf_latency = ms;
+
+  state = loop->cf_state;
+  if (state == NULL)
+    return 0;
+
+  uv_mutex_lock(&state->fsevent_mutex);
+  state->fsevent_latency = ms;
+  state->fsevent_need_restart = 1;
+  state->fsevent_need_reschedule = 1;
+  uv_mutex_unlock(&state->fsevent_mutex);
+
+  return uv__cf_loop_signal(loop, kUVCFLoopSignalRegular);
+}
+
 #endif /* TARGET_OS_IPHONE */
@@ -26,11 +26,13 @@
 #endif
 
 #include "uv.h"
+#include "uv/tree.h"
 #include "internal.h"
 #include "idna.h"
 
 #include <errno.h>
 #include <stddef.h> /* NULL */
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <net/if.h> /* if_indextoname() */
@@ -96,6 +98,485 @@ int uv__getaddrinfo_translate_error(int sys_err) {
 }
 
 
+/* 进程内所有loop共享的解析结果缓存，参见uv_getaddrinfo_cache_configure()。
+ * 按(hints, hostname, service)查找，命中的结果复制一份交给调用者，复制品
+ * 记在uv__gai_copies里，uv_freeaddrinfo()据此区分是不是libc分配的
+ */
+#define UV__GAI_ALIGN(n) (((n) + 7) & ~(size_t) 7)
+#define UV__GAI_DEFAULT_MAX 4096
+
+struct uv__gai_entry {
+  RB_ENTRY(uv__gai_entry) tree_entry;
+  QUEUE lru;
+  void* block;                /* uv__gai_dup()分配的，NULL表示负缓存 */
+  struct addrinfo* addrinfo;
+  int retcode;
+  int refreshing;             /* 已经有一个后台刷新在跑 */
+  uint64_t expires;           /* 毫秒，uv_hrtime()计 */
+  uv_getaddrinfo_t* leader;   /* 只用于uv__gai_flights，lru这时是等待队列 */
+  char key[1];                /* variable length */
+};
+
+struct uv__gai_copy {
+  RB_ENTRY(uv__gai_copy) tree_entry;
+};
+
+RB_HEAD(uv__gai_tree, uv__gai_entry);
+RB_HEAD(uv__gai_copy_tree, uv__gai_copy);
+RB_HEAD(uv__gai_flight_tree, uv__gai_entry);
+
+static uv_once_t uv__gai_once = UV_ONCE_INIT;
+static uv_mutex_t uv__gai_mutex;
+static struct uv__gai_tree uv__gai_entries = RB_INITIALIZER(&uv__gai_entries);
+static struct uv__gai_copy_tree uv__gai_copies =
+    RB_INITIALIZER(&uv__gai_copies);
+/* 正在解析的请求，key里带着loop，只合并同一个loop上的请求 */
+static struct uv__gai_flight_tree uv__gai_flights =
+    RB_INITIALIZER(&uv__gai_flights);
+static int uv__gai_coalesce;
+static QUEUE uv__gai_lru;
+static unsigned int uv__gai_count;
+static unsigned int uv__gai_ttl;
+static unsigned int uv__gai_negative_ttl;
+static unsigned int uv__gai_stale;
+static unsigned int uv__gai_max;
+/* 打开过缓存之后uv_freeaddrinfo()才需要查uv__gai_copies */
+static int uv__gai_used;
+
+
+static int uv__gai_entry_cmp(const struct uv__gai_entry* a,
+                             const struct uv__gai_entry* b) {
+  return strcmp(a->key, b->key);
+}
+
+
+static int uv__gai_copy_cmp(const struct uv__gai_copy* a,
+                            const struct uv__gai_copy* b) {
+  if ((uintptr_t) a < (uintptr_t) b) return -1;
+  if ((uintptr_t) a > (uintptr_t) b) return 1;
+  return 0;
+}
+
+
+RB_GENERATE_STATIC(uv__gai_tree, uv__gai_entry, tree_entry, uv__gai_entry_cmp)
+RB_GENERATE_STATIC(uv__gai_flight_tree,
+                   uv__gai_entry,
+                   tree_entry,
+                   uv__gai_entry_cmp)
+RB_GENERATE_STATIC(uv__gai_copy_tree,
+                   uv__gai_copy,
+                   tree_entry,
+                   uv__gai_copy_cmp)
+
+
+static void uv__gai_init_once(void) {
+  if (uv_mutex_init(&uv__gai_mutex))
+    abort();
+  QUEUE_INIT(&uv__gai_lru);
+}
+
+
+static uint64_t uv__gai_now(void) {
+  return uv_hrtime() / 1000000;
+}
+
+
+/* 把整个addrinfo链表连同地址和canonname复制到一块内存里，前面留header字节 */
+static void* uv__gai_dup(const struct addrinfo* src,
+                         size_t header,
+                         struct addrinfo** res) {
+  const struct addrinfo* p;
+  struct addrinfo* prev;
+  struct addrinfo* ai;
+  size_t size;
+  char* block;
+  char* q;
+
+  size = header;
+  for (p = src; p != NULL; p = p->ai_next) {
+    size += sizeof(*ai) + UV__GAI_ALIGN(p->ai_addrlen);
+    if (p->ai_canonname != NULL)
+      size += UV__GAI_ALIGN(strlen(p->ai_canonname) + 1);
+  }
+
+  block = uv__malloc(size);
+  if (block == NULL)
+    return NULL;
+
+  *res = NULL;
+  prev = NULL;
+  q = block + header;
+  for (p = src; p != NULL; p = p->ai_next) {
+    ai = (struct addrinfo*) q;
+    q += sizeof(*ai);
+    *ai = *p;
+    ai->ai_next = NULL;
+
+    ai->ai_addr = NULL;
+    if (p->ai_addr != NULL) {
+      ai->ai_addr = memcpy(q, p->ai_addr, p->ai_addrlen);
+      q += UV__GAI_ALIGN(p->ai_addrlen);
+    }
+
+    if (p->ai_canonname != NULL) {
+      ai->ai_canonname = strcpy(q, p->ai_canonname);
+      q += UV__GAI_ALIGN(strlen(p->ai_canonname) + 1);
+    }
+
+    if (prev == NULL)
+      *res = ai;
+    else
+      prev->ai_next = ai;
+    prev = ai;
+  }
+
+  return block;
+}
+
+
+/* 分配一个只填了key的缓存项，查找时当key用，存入时直接变成新的缓存项 */
+static struct uv__gai_entry* uv__gai_key(const void* scope,
+                                         const char* hostname,
+                                         const char* service,
+                                         const struct addrinfo* hints) {
+  struct uv__gai_entry* e;
+  char prefix[64];
+  size_t prefix_len;
+  size_t hostname_len;
+  size_t service_len;
+  char* key;
+
+  if (hints != NULL)
+    snprintf(prefix, sizeof(prefix), "%p/%d,%d,%d,%d:", scope,
+             hints->ai_flags, hints->ai_family,
+             hints->ai_socktype, hints->ai_protocol);
+  else
+    snprintf(prefix, sizeof(prefix), "%p/-:", scope);
+
+  prefix_len = strlen(prefix);
+  hostname_len = hostname ? strlen(hostname) : 0;
+  service_len = service ? strlen(service) : 0;
+
+  /* hostname和service之间用'\n'隔开，主机名里不会有这个字符 */
+  e = uv__malloc(sizeof(*e) + prefix_len + hostname_len + service_len + 1);
+  if (e == NULL)
+    return NULL;
+
+  key = e->key;
+  memcpy(key, prefix, prefix_len);
+  memcpy(key + prefix_len, hostname, hostname_len);
+  key[prefix_len + hostname_len] = '\n';
+  memcpy(key + prefix_len + hostname_len + 1, service, service_len);
+  key[prefix_len + hostname_len + 1 + service_len] = '\0';
+
+  return e;
+}
+
+
+static void uv__gai_entry_free(struct uv__gai_entry* e) {
+  RB_REMOVE(uv__gai_tree, &uv__gai_entries, e);
+  QUEUE_REMOVE(&e->lru);
+  uv__gai_count--;
+  uv__free(e->block);
+  uv__free(e);
+}
+
+
+/* 命中返回1，结果（复制品或者负缓存的错误码）填到req里。过期但还在stale
+ * 窗口里的也算命中，*refresh置1表示调用者要发起一次后台刷新
+ */
+static int uv__gai_cache_lookup(struct uv__gai_entry* key,
+                                uv_getaddrinfo_t* req,
+                                int* refresh) {
+  struct uv__gai_entry* e;
+  struct uv__gai_copy* copy;
+  uint64_t now;
+  int hit;
+
+  *refresh = 0;
+  hit = 0;
+  now = uv__gai_now();
+
+  uv_mutex_lock(&uv__gai_mutex);
+
+  e = RB_FIND(uv__gai_tree, &uv__gai_entries, key);
+  if (e == NULL)
+    goto out;
+
+  if (now >= e->expires) {
+    if (e->addrinfo == NULL || now >= e->expires + uv__gai_stale) {
+      uv__gai_entry_free(e);
+      goto out;
+    }
+
+    if (!e->refreshing) {
+      e->refreshing = 1;
+      *refresh = 1;
+    }
+  }
+
+  if (e->addrinfo != NULL) {
+    copy = uv__gai_dup(e->addrinfo, sizeof(*copy), &req->addrinfo);
+    if (copy == NULL) {
+      *refresh = 0;
+      e->refreshing = 0;
+      goto out;
+    }
+    RB_INSERT(uv__gai_copy_tree, &uv__gai_copies, copy);
+  }
+
+  req->retcode = e->retcode;
+  QUEUE_REMOVE(&e->lru);
+  QUEUE_INSERT_HEAD(&uv__gai_lru, &e->lru);
+  hit = 1;
+
+out:
+  uv_mutex_unlock(&uv__gai_mutex);
+  return hit;
+}
+
+
+/* 在线程池里getaddrinfo()之后调用。成功的结果和确定不存在的名字进缓存，
+ * 临时错误不缓存，只是让已有的项可以再次刷新
+ */
+static void uv__gai_cache_store(uv_getaddrinfo_t* req) {
+  struct uv__gai_entry* old;
+  struct uv__gai_entry* e;
+  unsigned int ttl;
+
+  if (!uv__gai_used)
+    return;
+
+  e = uv__gai_key(NULL, req->hostname, req->service, req->hints);
+  if (e == NULL)
+    return;
+
+  uv_mutex_lock(&uv__gai_mutex);
+
+  if (uv__gai_ttl == 0)
+    goto out;
+
+  old = RB_FIND(uv__gai_tree, &uv__gai_entries, e);
+
+  if (req->retcode == 0)
+    ttl = uv__gai_ttl;
+  else if (req->retcode == UV_EAI_NONAME || req->retcode == UV_EAI_NODATA)
+    ttl = uv__gai_negative_ttl;
+  else
+    ttl = 0;
+
+  if (ttl == 0) {
+    if (old != NULL)
+      old->refreshing = 0;
+    goto out;
+  }
+
+  e->block = NULL;
+  e->addrinfo = NULL;
+  if (req->retcode == 0) {
+    e->block = uv__gai_dup(req->addrinfo, 0, &e->addrinfo);
+    if (e->block == NULL)
+      goto out;
+  }
+
+  if (old != NULL)
+    uv__gai_entry_free(old);
+
+  e->retcode = req->retcode;
+  e->refreshing = 0;
+  e->expires = uv__gai_now() + ttl;
+  RB_INSERT(uv__gai_tree, &uv__gai_entries, e);
+  QUEUE_INSERT_HEAD(&uv__gai_lru, &e->lru);
+  uv__gai_count++;
+
+  /* 超过上限时淘汰最久没用过的 */
+  while (uv__gai_count > uv__gai_max)
+    uv__gai_entry_free(QUEUE_DATA(QUEUE_PREV(&uv__gai_lru),
+                                  struct uv__gai_entry,
+                                  lru));
+
+  e = NULL;
+
+out:
+  uv_mutex_unlock(&uv__gai_mutex);
+  uv__free(e);
+}
+
+
+static void uv__gai_cache_unmark(uv_getaddrinfo_t* req) {
+  struct uv__gai_entry* key;
+  struct uv__gai_entry* e;
+
+  key = uv__gai_key(NULL, req->hostname, req->service, req->hints);
+  if (key == NULL)
+    return;
+
+  uv_mutex_lock(&uv__gai_mutex);
+  e = RB_FIND(uv__gai_tree, &uv__gai_entries, key);
+  if (e != NULL)
+    e->refreshing = 0;
+  uv_mutex_unlock(&uv__gai_mutex);
+
+  uv__free(key);
+}
+
+
+int uv_getaddrinfo_cache_configure(unsigned int ttl,
+                                   unsigned int negative_ttl,
+                                   unsigned int stale,
+                                   unsigned int max_entries) {
+  uv_once(&uv__gai_once, uv__gai_init_once);
+  uv_mutex_lock(&uv__gai_mutex);
+
+  uv__gai_ttl = ttl;
+  uv__gai_negative_ttl = negative_ttl;
+  uv__gai_stale = stale;
+  uv__gai_max = max_entries ? max_entries : UV__GAI_DEFAULT_MAX;
+  if (ttl != 0)
+    uv__gai_used = 1;
+
+  /* 关闭时清空；已经交出去的复制品还是由uv_freeaddrinfo()释放 */
+  while (!QUEUE_EMPTY(&uv__gai_lru) &&
+         (ttl == 0 || uv__gai_count > uv__gai_max)) {
+    uv__gai_entry_free(QUEUE_DATA(QUEUE_PREV(&uv__gai_lru),
+                                  struct uv__gai_entry,
+                                  lru));
+  }
+
+  uv_mutex_unlock(&uv__gai_mutex);
+  return 0;
+}
+
+
+int uv_getaddrinfo_coalesce(int enable) {
+  uv_once(&uv__gai_once, uv__gai_init_once);
+  uv_mutex_lock(&uv__gai_mutex);
+  uv__gai_coalesce = enable != 0;
+  if (enable)
+    uv__gai_used = 1;
+  uv_mutex_unlock(&uv__gai_mutex);
+  return 0;
+}
+
+
+/* 同一个loop上已经有相同的请求在解析时排到它后面返回1，req不进线程池；
+ * 否则req成为leader，返回0由调用者提交
+ */
+static int uv__gai_flight_join(uv_getaddrinfo_t* req) {
+  struct uv__gai_entry* key;
+  struct uv__gai_entry* f;
+
+  key = uv__gai_key(req->loop, req->hostname, req->service, req->hints);
+  if (key == NULL)
+    return 0;
+
+  uv_mutex_lock(&uv__gai_mutex);
+
+  if (!uv__gai_coalesce) {
+    uv_mutex_unlock(&uv__gai_mutex);
+    uv__free(key);
+    return 0;
+  }
+
+  f = RB_FIND(uv__gai_flight_tree, &uv__gai_flights, key);
+  if (f != NULL) {
+    /* 等待中的请求不在线程池里，uv_cancel()返回UV_EBUSY */
+    req->work_req.loop = req->loop;
+    req->work_req.pool = NULL;
+    req->work_req.wait_time = 0;
+    req->work_req.run_time = 0;
+    QUEUE_INSERT_TAIL(&f->lru, &req->work_req.wq);
+    uv_mutex_unlock(&uv__gai_mutex);
+    uv__free(key);
+    return 1;
+  }
+
+  key->leader = req;
+  QUEUE_INIT(&key->lru);
+  RB_INSERT(uv__gai_flight_tree, &uv__gai_flights, key);
+  uv_mutex_unlock(&uv__gai_mutex);
+
+  return 0;
+}
+
+
+static void uv__getaddrinfo_work(struct uv__work* w);
+static void uv__getaddrinfo_done(struct uv__work* w, int status);
+
+
+/* leader解析完（在线程池里）或者被取消（在loop线程上）时调用。解析完了
+ * 每个等待的请求拿到一份结果的复制品；被取消了就让第一个等待的请求接替
+ */
+static void uv__gai_flight_finish(uv_getaddrinfo_t* req, int cancelled) {
+  struct uv__gai_entry* key;
+  struct uv__gai_entry* f;
+  struct uv__gai_copy* copy;
+  uv_getaddrinfo_t* waiter;
+  QUEUE waiters;
+  QUEUE* q;
+
+  if (!uv__gai_used)
+    return;
+
+  key = uv__gai_key(req->loop, req->hostname, req->service, req->hints);
+  if (key == NULL)
+    abort();  /* 等待的请求再也不会完成，没有别的办法 */
+
+  QUEUE_INIT(&waiters);
+  uv_mutex_lock(&uv__gai_mutex);
+
+  f = RB_FIND(uv__gai_flight_tree, &uv__gai_flights, key);
+  if (f == NULL || f->leader != req) {
+    uv_mutex_unlock(&uv__gai_mutex);
+    uv__free(key);
+    return;
+  }
+
+  if (cancelled && !QUEUE_EMPTY(&f->lru)) {
+    q = QUEUE_HEAD(&f->lru);
+    QUEUE_REMOVE(q);
+    waiter = QUEUE_DATA(q, uv_getaddrinfo_t, work_req.wq);
+    f->leader = waiter;
+    uv_mutex_unlock(&uv__gai_mutex);
+    uv__free(key);
+
+    uv__work_submit(waiter->loop,
+                    &waiter->work_req,
+                    UV__WORK_SLOW_IO,
+                    uv__getaddrinfo_work,
+                    uv__getaddrinfo_done);
+    return;
+  }
+
+  RB_REMOVE(uv__gai_flight_tree, &uv__gai_flights, f);
+  QUEUE_MOVE(&f->lru, &waiters);
+
+  QUEUE_FOREACH(q, &waiters) {
+    waiter = QUEUE_DATA(q, uv_getaddrinfo_t, work_req.wq);
+    waiter->retcode = req->retcode;
+    if (req->retcode == 0) {
+      copy = uv__gai_dup(req->addrinfo, sizeof(*copy), &waiter->addrinfo);
+      if (copy == NULL)
+        waiter->retcode = UV_EAI_MEMORY;
+      else
+        RB_INSERT(uv__gai_copy_tree, &uv__gai_copies, copy);
+    }
+  }
+
+  uv_mutex_unlock(&uv__gai_mutex);
+  uv__free(key);
+  uv__free(f);
+
+  /* 摘下来以后再完成，done回调可能马上在loop线程上重用这个请求 */
+  while (!QUEUE_EMPTY(&waiters)) {
+    q = QUEUE_HEAD(&waiters);
+    QUEUE_REMOVE(q);
+    waiter = QUEUE_DATA(q, uv_getaddrinfo_t, work_req.wq);
+    uv__work_complete(waiter->loop, &waiter->work_req, uv__getaddrinfo_done);
+  }
+}
+
+
 static void uv__getaddrinfo_work(struct uv__work* w) {
   uv_getaddrinfo_t* req;
   int err;
@@ -103,6 +584,8 @@ static void uv__getaddrinfo_work(struct uv__work* w) {
   req = container_of(w, uv_getaddrinfo_t, work_req);
   err = getaddrinfo(req->hostname, req->service, req->hints, &req->addrinfo);
   req->retcode = uv__getaddrinfo_translate_error(err);
+  uv__gai_cache_store(req);
+  uv__gai_flight_finish(req, 0);
 }
 
 
@@ -112,13 +595,17 @@ static void uv__getaddrinfo_done(struct uv__work* w, int status) {
   req = container_of(w, uv_getaddrinfo_t, work_req);
   uv__req_unregister(req->loop, req);
 
+  /* 被取消的leader要把等待的请求交给别人，这时还要用hostname等 */
+  if (status == UV_ECANCELED)
+    uv__gai_flight_finish(req, 1);
+
   /* See initialization in uv_getaddrinfo(). */
   if (req->hints)
-    uv__free(req->hints);
+    uv__loop_free(req->loop, req->hints);
   else if (req->service)
-    uv__free(req->service);
+    uv__loop_free(req->loop, req->service);
   else if (req->hostname)
-    uv__free(req->hostname);
+    uv__loop_free(req->loop, req->hostname);
   else
     assert(0);
 
@@ -136,44 +623,122 @@ static void uv__getaddrinfo_done(struct uv__work* w, int status) {
 }
 
 
-int uv_getaddrinfo(uv_loop_t* loop,
-                   uv_getaddrinfo_t* req,
-                   uv_getaddrinfo_cb cb,
-                   const char* hostname,
-                   const char* service,
-                   const struct addrinfo* hints) {
-  char hostname_ascii[256];
+void uv__getaddrinfo_track_copies(void) {
+  uv_once(&uv__gai_once, uv__gai_init_once);
+  uv_mutex_lock(&uv__gai_mutex);
+  uv__gai_used = 1;
+  uv_mutex_unlock(&uv__gai_mutex);
+}
+
+
+/* loop上的解析器查完了，按hints把地址展开成addrinfo链表，和getaddrinfo()一样
+ * 每个地址对应每种socktype一项。结果也进缓存，回调在下一轮循环里调用
+ */
+void uv__getaddrinfo_resolved(uv_getaddrinfo_t* req,
+                              int status,
+                              const struct sockaddr_storage* addrs,
+                              unsigned int naddrs,
+                              const char* canonname) {
+  static const int socktypes[][2] = {
+    { SOCK_STREAM, IPPROTO_TCP },
+    { SOCK_DGRAM, IPPROTO_UDP },
+    { SOCK_RAW, 0 }
+  };
+  const struct addrinfo* hints;
+  struct uv__gai_copy* copy;
+  struct addrinfo* list;
+  struct addrinfo* ai;
+  unsigned int nsocktypes;
+  unsigned int i;
+  unsigned int k;
+  unsigned int n;
+
+  hints = req->hints;
+  list = NULL;
+  n = 0;
+
+  /* 有服务的时候没有SOCK_RAW */
+  nsocktypes = req->service != NULL ? 2 : 3;
+
+  if (status == 0) {
+    list = uv__calloc(naddrs * nsocktypes, sizeof(*list));
+    if (list == NULL)
+      status = UV_EAI_MEMORY;
+  }
+
+  for (i = 0; status == 0 && i < naddrs; i++) {
+    for (k = 0; k < nsocktypes; k++) {
+      if (hints != NULL && hints->ai_socktype != 0 &&
+          hints->ai_socktype != socktypes[k][0])
+        continue;
+      if (hints != NULL && hints->ai_protocol != 0 &&
+          socktypes[k][1] != 0 && hints->ai_protocol != socktypes[k][1])
+        continue;
+
+      ai = &list[n];
+      ai->ai_flags = hints != NULL ? hints->ai_flags : 0;
+      ai->ai_family = addrs[i].ss_family;
+      ai->ai_socktype = socktypes[k][0];
+      ai->ai_protocol = socktypes[k][1];
+      if (hints != NULL && hints->ai_socktype != 0 && hints->ai_protocol != 0)
+        ai->ai_protocol = hints->ai_protocol;
+      ai->ai_addr = (struct sockaddr*) &addrs[i];
+      ai->ai_addrlen = addrs[i].ss_family == AF_INET ?
+                       sizeof(struct sockaddr_in) :
+                       sizeof(struct sockaddr_in6);
+      if (n > 0)
+        list[n - 1].ai_next = ai;
+      n++;
+    }
+  }
+
+  if (status == 0 && n == 0)
+    status = UV_EAI_SOCKTYPE;
+
+  if (status == 0) {
+    if (hints != NULL && (hints->ai_flags & AI_CANONNAME))
+      list[0].ai_canonname = (char*) canonname;
+
+    copy = uv__gai_dup(list, sizeof(*copy), &req->addrinfo);
+    if (copy == NULL) {
+      status = UV_EAI_MEMORY;
+    } else {
+      uv_mutex_lock(&uv__gai_mutex);
+      RB_INSERT(uv__gai_copy_tree, &uv__gai_copies, copy);
+      uv_mutex_unlock(&uv__gai_mutex);
+    }
+  }
+
+  uv__free(list);
+  req->retcode = status;
+
+  uv__gai_cache_store(req);
+  uv__gai_flight_finish(req, 0);
+  uv__work_complete(req->loop, &req->work_req, uv__getaddrinfo_done);
+}
+
+
+/* 填好req但不提交，hostname已经是IDNA转换后的 */
+/* in_loop_thread为0时调用方可能不在loop线程，参数不能放进loop的内存池 */
+static int uv__getaddrinfo_init(uv_loop_t* loop,
+                                uv_getaddrinfo_t* req,
+                                uv_getaddrinfo_cb cb,
+                                const char* hostname,
+                                const char* service,
+                                const struct addrinfo* hints,
+                                int in_loop_thread) {
   size_t hostname_len;
   size_t service_len;
   size_t hints_len;
   size_t len;
   char* buf;
-  long rc;
-
-  if (req == NULL || (hostname == NULL && service == NULL))
-    return UV_EINVAL;
-
-  /* FIXME(bnoordhuis) IDNA does not seem to work z/OS,
-   * probably because it uses EBCDIC rather than ASCII.
-   */
-#ifdef __MVS__
-  (void) &hostname_ascii;
-#else
-  if (hostname != NULL) {
-    rc = uv__idna_toascii(hostname,
-                          hostname + strlen(hostname),
-                          hostname_ascii,
-                          hostname_ascii + sizeof(hostname_ascii));
-    if (rc < 0)
-      return rc;
-    hostname = hostname_ascii;
-  }
-#endif
 
   hostname_len = hostname ? strlen(hostname) + 1 : 0;
   service_len = service ? strlen(service) + 1 : 0;
   hints_len = hints ? sizeof(*hints) : 0;
-  buf = uv__malloc(hostname_len + service_len + hints_len);
+  buf = uv__loop_malloc(in_loop_thread ? loop : NULL,
+                        UV_MEM_DNS,
+                        hostname_len + service_len + hints_len);
 
   if (buf == NULL)
     return UV_ENOMEM;
@@ -203,6 +768,123 @@ int uv_getaddrinfo(uv_loop_t* loop,
   if (hostname)
     req->hostname = memcpy(buf + len, hostname, hostname_len);
 
+  return 0;
+}
+
+
+static void uv__getaddrinfo_refresh_cb(uv_getaddrinfo_t* req,
+                                       int status,
+                                       struct addrinfo* res) {
+  uv_freeaddrinfo(res);
+  uv__free(req);
+}
+
+
+/* stale-while-revalidate：用一个内部请求在后台重新解析，结果在线程池里直接
+ * 写进缓存。内部请求也算在loop的活动请求里，loop会等它完成
+ */
+static void uv__getaddrinfo_refresh(uv_getaddrinfo_t* req) {
+  uv_getaddrinfo_t* r;
+
+  r = uv__malloc(sizeof(*r));
+  if (r != NULL &&
+      uv__getaddrinfo_init(req->loop,
+                           r,
+                           uv__getaddrinfo_refresh_cb,
+                           req->hostname,
+                           req->service,
+                           req->hints,
+                           req->cb != NULL) == 0) {
+    uv__work_submit(req->loop,
+                    &r->work_req,
+                    UV__WORK_SLOW_IO,
+                    uv__getaddrinfo_work,
+                    uv__getaddrinfo_done);
+    return;
+  }
+
+  /* 提交不了就让下一次查询再试 */
+  uv__free(r);
+  uv__gai_cache_unmark(req);
+}
+
+
+int uv_getaddrinfo(uv_loop_t* loop,
+                   uv_getaddrinfo_t* req,
+                   uv_getaddrinfo_cb cb,
+                   const char* hostname,
+                   const char* service,
+                   const struct addrinfo* hints) {
+  struct uv__gai_entry* key;
+  char hostname_ascii[256];
+  int refresh;
+  int hit;
+  long rc;
+
+  if (req == NULL || (hostname == NULL && service == NULL))
+    return UV_EINVAL;
+
+  /* FIXME(bnoordhuis) IDNA does not seem to work z/OS,
+   * probably because it uses EBCDIC rather than ASCII.
+   */
+#ifdef __MVS__
+  (void) &hostname_ascii;
+#else
+  if (hostname != NULL) {
+    rc = uv__idna_toascii(hostname,
+                          hostname + strlen(hostname),
+                          hostname_ascii,
+                          hostname_ascii + sizeof(hostname_ascii));
+    if (rc < 0)
+      return rc;
+    hostname = hostname_ascii;
+  }
+#endif
+
+  /* 同步调用可能来自任意线程 */
+  rc = uv__getaddrinfo_init(loop,
+                            req,
+                            cb,
+                            hostname,
+                            service,
+                            hints,
+                            cb != NULL);
+  if (rc)
+    return rc;
+
+  /* 缓存命中时不进线程池，异步的回调仍然在下一轮循环里调用 */
+  if (uv__gai_used && uv__gai_ttl != 0) {
+    key = uv__gai_key(NULL, req->hostname, req->service, req->hints);
+    hit = key != NULL && uv__gai_cache_lookup(key, req, &refresh);
+    uv__free(key);
+
+    if (hit) {
+      if (refresh)
+        uv__getaddrinfo_refresh(req);
+
+      if (cb) {
+        uv__work_complete(loop, &req->work_req, uv__getaddrinfo_done);
+        return 0;
+      }
+
+      uv__getaddrinfo_done(&req->work_req, 0);
+      return req->retcode;
+    }
+  }
+
+  if (cb && uv__gai_coalesce && uv__gai_flight_join(req))
+    return 0;
+
+  /* 配置了UV_LOOP_DNS_RESOLVER的loop自己发DNS查询，不支持的请求仍然进线程池 */
+  if (cb && loop->resolver != NULL) {
+    req->work_req.loop = loop;
+    req->work_req.pool = NULL;
+    req->work_req.wait_time = 0;
+    req->work_req.run_time = 0;
+    if (uv__resolver_getaddrinfo(req) == 0)
+      return 0;
+  }
+
   if (cb) {
     uv__work_submit(loop,
                     &req->work_req,
@@ -219,8 +901,28 @@ int uv_getaddrinfo(uv_loop_t* loop,
 
 
 void uv_freeaddrinfo(struct addrinfo* ai) {
-  if (ai)
-    freeaddrinfo(ai);
+  struct uv__gai_copy* copy;
+
+  if (ai == NULL)
+    return;
+
+  /* 缓存交出去的复制品是一整块内存，addrinfo紧跟在header后面 */
+  if (uv__gai_used) {
+    uv_mutex_lock(&uv__gai_mutex);
+    copy = RB_FIND(uv__gai_copy_tree,
+                   &uv__gai_copies,
+                   (struct uv__gai_copy*) ((char*) ai - sizeof(*copy)));
+    if (copy != NULL)
+      RB_REMOVE(uv__gai_copy_tree, &uv__gai_copies, copy);
+    uv_mutex_unlock(&uv__gai_mutex);
+
+    if (copy != NULL) {
+      uv__free(copy);
+      return;
+    }
+  }
+
+  freeaddrinfo(ai);
 }
 
 
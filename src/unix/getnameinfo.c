@@ -25,9 +25,202 @@
 #include <string.h>
 
 #include "uv.h"
+#include "uv/tree.h"
 #include "internal.h"
 
 
+/* 进程内所有loop共享的反向解析缓存，参见uv_getnameinfo_cache_configure()。
+ * 按(地址, 端口, flags)查找，只缓存成功的结果，满了淘汰最久没用到的
+ */
+#define UV__GNI_DEFAULT_MAX 4096
+
+struct uv__gni_key {
+  int family;
+  int flags;
+  unsigned int port;
+  unsigned int scope_id;
+  unsigned char addr[16];
+};
+
+struct uv__gni_entry {
+  RB_ENTRY(uv__gni_entry) tree_entry;
+  QUEUE lru;
+  struct uv__gni_key key;
+  uint64_t expires;           /* 毫秒，uv_hrtime()计 */
+  char* service;              /* 指向host后面 */
+  char host[1];               /* variable length */
+};
+
+/* uv_getnameinfo_batch()的一个批次，在一个工作线程里依次解析 */
+struct uv__gni_batch {
+  struct uv__work work_req;
+  unsigned int nreqs;
+  uv_getnameinfo_t* reqs[1];  /* variable length */
+};
+
+RB_HEAD(uv__gni_tree, uv__gni_entry);
+
+static uv_once_t uv__gni_once = UV_ONCE_INIT;
+static uv_mutex_t uv__gni_mutex;
+static struct uv__gni_tree uv__gni_entries = RB_INITIALIZER(&uv__gni_entries);
+static QUEUE uv__gni_lru;
+static unsigned int uv__gni_count;
+static unsigned int uv__gni_ttl;
+static unsigned int uv__gni_max;
+
+
+static int uv__gni_entry_cmp(const struct uv__gni_entry* a,
+                             const struct uv__gni_entry* b) {
+  return memcmp(&a->key, &b->key, sizeof(a->key));
+}
+
+
+RB_GENERATE_STATIC(uv__gni_tree, uv__gni_entry, tree_entry, uv__gni_entry_cmp)
+
+
+static void uv__gni_init_once(void) {
+  if (uv_mutex_init(&uv__gni_mutex))
+    abort();
+  QUEUE_INIT(&uv__gni_lru);
+}
+
+
+static uint64_t uv__gni_now(void) {
+  return uv_hrtime() / 1000000;
+}
+
+
+static void uv__gni_key(const uv_getnameinfo_t* req, struct uv__gni_key* key) {
+  const struct sockaddr_in6* a6;
+  const struct sockaddr_in* a4;
+
+  /* 整个结构体用memcmp比较，填充字节也要清零 */
+  memset(key, 0, sizeof(*key));
+  key->family = req->storage.ss_family;
+  key->flags = req->flags;
+
+  if (key->family == AF_INET) {
+    a4 = (const struct sockaddr_in*) &req->storage;
+    key->port = a4->sin_port;
+    memcpy(key->addr, &a4->sin_addr, sizeof(a4->sin_addr));
+  } else {
+    a6 = (const struct sockaddr_in6*) &req->storage;
+    key->port = a6->sin6_port;
+    key->scope_id = a6->sin6_scope_id;
+    memcpy(key->addr, &a6->sin6_addr, sizeof(a6->sin6_addr));
+  }
+}
+
+
+static void uv__gni_entry_free(struct uv__gni_entry* e) {
+  RB_REMOVE(uv__gni_tree, &uv__gni_entries, e);
+  QUEUE_REMOVE(&e->lru);
+  uv__gni_count--;
+  uv__free(e);
+}
+
+
+/* 命中返回1，host和service复制到req里 */
+static int uv__gni_cache_lookup(uv_getnameinfo_t* req) {
+  struct uv__gni_entry* e;
+  struct uv__gni_entry key;
+  int hit;
+
+  uv__gni_key(req, &key.key);
+  hit = 0;
+
+  uv_mutex_lock(&uv__gni_mutex);
+
+  e = RB_FIND(uv__gni_tree, &uv__gni_entries, &key);
+  if (e == NULL)
+    goto out;
+
+  if (uv__gni_now() >= e->expires) {
+    uv__gni_entry_free(e);
+    goto out;
+  }
+
+  /* 存进来的时候就是从这两个数组里来的，长度不会超 */
+  strcpy(req->host, e->host);
+  strcpy(req->service, e->service);
+  req->retcode = 0;
+  QUEUE_REMOVE(&e->lru);
+  QUEUE_INSERT_HEAD(&uv__gni_lru, &e->lru);
+  hit = 1;
+
+out:
+  uv_mutex_unlock(&uv__gni_mutex);
+  return hit;
+}
+
+
+/* 在线程池里getnameinfo()成功之后调用 */
+static void uv__gni_cache_store(uv_getnameinfo_t* req) {
+  struct uv__gni_entry* old;
+  struct uv__gni_entry* e;
+  size_t host_len;
+  size_t service_len;
+
+  if (uv__gni_ttl == 0 || req->retcode != 0)
+    return;
+
+  host_len = strlen(req->host) + 1;
+  service_len = strlen(req->service) + 1;
+  e = uv__malloc(sizeof(*e) + host_len + service_len);
+  if (e == NULL)
+    return;
+
+  uv__gni_key(req, &e->key);
+  memcpy(e->host, req->host, host_len);
+  e->service = e->host + host_len;
+  memcpy(e->service, req->service, service_len);
+
+  uv_mutex_lock(&uv__gni_mutex);
+
+  if (uv__gni_ttl == 0)
+    goto out;
+
+  old = RB_FIND(uv__gni_tree, &uv__gni_entries, e);
+  if (old != NULL)
+    uv__gni_entry_free(old);
+
+  e->expires = uv__gni_now() + uv__gni_ttl;
+  RB_INSERT(uv__gni_tree, &uv__gni_entries, e);
+  QUEUE_INSERT_HEAD(&uv__gni_lru, &e->lru);
+  uv__gni_count++;
+
+  while (uv__gni_count > uv__gni_max)
+    uv__gni_entry_free(QUEUE_DATA(QUEUE_PREV(&uv__gni_lru),
+                                  struct uv__gni_entry,
+                                  lru));
+
+  e = NULL;
+
+out:
+  uv_mutex_unlock(&uv__gni_mutex);
+  uv__free(e);
+}
+
+
+int uv_getnameinfo_cache_configure(unsigned int ttl, unsigned int max_entries) {
+  uv_once(&uv__gni_once, uv__gni_init_once);
+  uv_mutex_lock(&uv__gni_mutex);
+
+  uv__gni_ttl = ttl;
+  uv__gni_max = max_entries ? max_entries : UV__GNI_DEFAULT_MAX;
+
+  while (!QUEUE_EMPTY(&uv__gni_lru) &&
+         (ttl == 0 || uv__gni_count > uv__gni_max)) {
+    uv__gni_entry_free(QUEUE_DATA(QUEUE_PREV(&uv__gni_lru),
+                                  struct uv__gni_entry,
+                                  lru));
+  }
+
+  uv_mutex_unlock(&uv__gni_mutex);
+  return 0;
+}
+
+
 static void uv__getnameinfo_work(struct uv__work* w) {
   uv_getnameinfo_t* req;
   int err;
@@ -50,6 +243,7 @@ static void uv__getnameinfo_work(struct uv__work* w) {
                     sizeof(req->service),
                     req->flags);
   req->retcode = uv__getaddrinfo_translate_error(err);
+  uv__gni_cache_store(req);
 }
 
 static void uv__getnameinfo_done(struct uv__work* w, int status) {
@@ -73,16 +267,41 @@ static void uv__getnameinfo_done(struct uv__work* w, int status) {
     req->getnameinfo_cb(req, req->retcode, host, service);
 }
 
-/*
-* Entry point for getnameinfo
-* return 0 if a callback will be made
-* return error code if validation fails
-*/
-int uv_getnameinfo(uv_loop_t* loop,
-                   uv_getnameinfo_t* req,
-                   uv_getnameinfo_cb getnameinfo_cb,
-                   const struct sockaddr* addr,
-                   int flags) {
+
+static void uv__getnameinfo_batch_work(struct uv__work* w) {
+  struct uv__gni_batch* batch;
+  unsigned int i;
+
+  batch = container_of(w, struct uv__gni_batch, work_req);
+  for (i = 0; i < batch->nreqs; i++)
+    uv__getnameinfo_work(&batch->reqs[i]->work_req);
+}
+
+
+static void uv__getnameinfo_batch_done(struct uv__work* w, int status) {
+  struct uv__gni_batch* batch;
+  uv_getnameinfo_t* req;
+  unsigned int i;
+
+  batch = container_of(w, struct uv__gni_batch, work_req);
+
+  /* 每个请求的耗时都记成整个批次的，uv_req_work_time()才有意义 */
+  for (i = 0; i < batch->nreqs; i++) {
+    req = batch->reqs[i];
+    req->work_req.wait_time = w->wait_time;
+    req->work_req.run_time = w->run_time;
+    uv__getnameinfo_done(&req->work_req, status);
+  }
+
+  uv__free(batch);
+}
+
+
+static int uv__getnameinfo_init(uv_loop_t* loop,
+                                uv_getnameinfo_t* req,
+                                uv_getnameinfo_cb getnameinfo_cb,
+                                const struct sockaddr* addr,
+                                int flags) {
   if (req == NULL || addr == NULL)
     return UV_EINVAL;
 
@@ -106,6 +325,42 @@ int uv_getnameinfo(uv_loop_t* loop,
   req->loop = loop;
   req->retcode = 0;
 
+  return 0;
+}
+
+
+/* 缓存命中时直接完成，异步的回调仍然在下一轮循环里调用 */
+static int uv__getnameinfo_cached(uv_getnameinfo_t* req) {
+  if (uv__gni_ttl == 0 || !uv__gni_cache_lookup(req))
+    return 0;
+
+  if (req->getnameinfo_cb)
+    uv__work_complete(req->loop, &req->work_req, uv__getnameinfo_done);
+  else
+    uv__getnameinfo_done(&req->work_req, 0);
+
+  return 1;
+}
+
+/*
+* Entry point for getnameinfo
+* return 0 if a callback will be made
+* return error code if validation fails
+*/
+int uv_getnameinfo(uv_loop_t* loop,
+                   uv_getnameinfo_t* req,
+                   uv_getnameinfo_cb getnameinfo_cb,
+                   const struct sockaddr* addr,
+                   int flags) {
+  int err;
+
+  err = uv__getnameinfo_init(loop, req, getnameinfo_cb, addr, flags);
+  if (err)
+    return err;
+
+  if (uv__getnameinfo_cached(req))
+    return req->retcode;
+
   if (getnameinfo_cb) {
     uv__work_submit(loop,
                     &req->work_req,
@@ -119,3 +374,57 @@ int uv_getnameinfo(uv_loop_t* loop,
     return req->retcode;
   }
 }
+
+
+int uv_getnameinfo_batch(uv_loop_t* loop,
+                         uv_getnameinfo_t reqs[],
+                         const struct sockaddr* const addrs[],
+                         unsigned int nreqs,
+                         uv_getnameinfo_cb getnameinfo_cb,
+                         int flags) {
+  struct uv__gni_batch* batch;
+  unsigned int i;
+  int family;
+
+  if (reqs == NULL || addrs == NULL || nreqs == 0 || getnameinfo_cb == NULL)
+    return UV_EINVAL;
+
+  /* 先检查完再初始化，出错时没有请求被发起 */
+  for (i = 0; i < nreqs; i++) {
+    if (addrs[i] == NULL)
+      return UV_EINVAL;
+    family = addrs[i]->sa_family;
+    if (family != AF_INET && family != AF_INET6)
+      return UV_EINVAL;
+  }
+
+  batch = uv__malloc(sizeof(*batch) + (nreqs - 1) * sizeof(batch->reqs[0]));
+  if (batch == NULL)
+    return UV_ENOMEM;
+
+  batch->nreqs = 0;
+  for (i = 0; i < nreqs; i++) {
+    uv__getnameinfo_init(loop, &reqs[i], getnameinfo_cb, addrs[i], flags);
+
+    /* 批次里的请求不单独进线程池，uv_cancel()返回UV_EBUSY */
+    reqs[i].work_req.loop = loop;
+    reqs[i].work_req.pool = NULL;
+    reqs[i].work_req.wait_time = 0;
+    reqs[i].work_req.run_time = 0;
+
+    if (!uv__getnameinfo_cached(&reqs[i]))
+      batch->reqs[batch->nreqs++] = &reqs[i];
+  }
+
+  if (batch->nreqs == 0) {
+    uv__free(batch);
+    return 0;
+  }
+
+  uv__work_submit(loop,
+                  &batch->work_req,
+                  UV__WORK_SLOW_IO,
+                  uv__getnameinfo_batch_work,
+                  uv__getnameinfo_batch_done);
+  return 0;
+}
@@ -0,0 +1,604 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "uv.h"
+#include "internal.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+# include <net/if.h>
+# include <sys/socket.h>
+# include <linux/netlink.h>
+# include <linux/rtnetlink.h>
+#endif
+
+#if defined(__linux__)
+
+/* 一次recv最多读的字节数，netlink的dump消息不会超过32KB */
+#define UV__IFACE_BUF_SIZE 32768
+
+typedef struct {
+  int index;
+  unsigned int flags;
+  char name[IF_NAMESIZE];
+  char phys_addr[6];
+} uv__iface_link_t;
+
+typedef struct {
+  int index;
+  int family;
+  unsigned int prefixlen;
+  unsigned char addr[16];
+  char label[IF_NAMESIZE];  /* IPv4别名（比如"eth0:1"），没有时为空 */
+} uv__iface_addr_t;
+
+/* 内核推送的link和地址信息在用户态的副本，和getifaddrs()看到的一致 */
+typedef struct {
+  uv__iface_link_t* links;
+  unsigned int nlinks;
+  unsigned int links_cap;
+  uv__iface_addr_t* addrs;
+  unsigned int naddrs;
+  unsigned int addrs_cap;
+  unsigned int gen;
+  char buf[UV__IFACE_BUF_SIZE];
+} uv__iface_state_t;
+
+
+static uv__iface_link_t* uv__iface_link_find(uv__iface_state_t* st, int index) {
+  unsigned int i;
+
+  for (i = 0; i < st->nlinks; i++)
+    if (st->links[i].index == index)
+      return st->links + i;
+
+  return NULL;
+}
+
+
+static int uv__iface_addr_find(uv__iface_state_t* st,
+                               const uv__iface_addr_t* a) {
+  unsigned int len;
+  unsigned int i;
+
+  len = a->family == AF_INET6 ? 16 : 4;
+  for (i = 0; i < st->naddrs; i++)
+    if (st->addrs[i].index == a->index &&
+        st->addrs[i].family == a->family &&
+        memcmp(st->addrs[i].addr, a->addr, len) == 0)
+      return i;
+
+  return -1;
+}
+
+
+/* 数组满了就加倍，失败时返回UV_ENOMEM，原来的数组不变 */
+static int uv__iface_grow(void** base, unsigned int* cap, size_t size) {
+  unsigned int n;
+  void* p;
+
+  n = *cap == 0 ? 8 : *cap * 2;
+  p = uv__realloc(*base, n * size);
+  if (p == NULL)
+    return UV_ENOMEM;
+
+  *base = p;
+  *cap = n;
+  return 0;
+}
+
+
+/* 把回调要用的uv_interface_address_t填好，name直接指向副本里的字符串 */
+static void uv__iface_fill(uv_interface_address_t* out,
+                           const uv__iface_link_t* link,
+                           const uv__iface_addr_t* a) {
+  unsigned int bits;
+  unsigned int i;
+
+  memset(out, 0, sizeof(*out));
+  out->name = (char*) (a != NULL && a->label[0] != '\0' ? a->label : link->name);
+  memcpy(out->phys_addr, link->phys_addr, sizeof(out->phys_addr));
+  out->is_internal = !!(link->flags & IFF_LOOPBACK);
+
+  if (a == NULL)
+    return;
+
+  bits = a->prefixlen;
+  if (a->family == AF_INET6) {
+    out->address.address6.sin6_family = AF_INET6;
+    memcpy(&out->address.address6.sin6_addr, a->addr, 16);
+    /* 和getifaddrs()一样，链路本地地址带上接口编号 */
+    if (a->addr[0] == 0xfe && (a->addr[1] & 0xc0) == 0x80)
+      out->address.address6.sin6_scope_id = a->index;
+    out->netmask.netmask6.sin6_family = AF_INET6;
+    for (i = 0; i < 16 && bits > 0; i++, bits -= bits < 8 ? bits : 8)
+      out->netmask.netmask6.sin6_addr.s6_addr[i] =
+          (unsigned char) (0xff00 >> (bits < 8 ? bits : 8));
+  } else {
+    out->address.address4.sin_family = AF_INET;
+    memcpy(&out->address.address4.sin_addr, a->addr, 4);
+    out->netmask.netmask4.sin_family = AF_INET;
+    out->netmask.netmask4.sin_addr.s_addr =
+        bits == 0 ? 0 : htonl(~(uint32_t) 0 << (32 - bits));
+  }
+}
+
+
+/* 更新副本，notify不为0时把变化交给回调 */
+static int uv__iface_process(uv_iface_watch_t* handle,
+                             const struct nlmsghdr* nlh,
+                             int notify) {
+  uv_interface_address_t address;
+  uv__iface_link_t* link;
+  uv__iface_state_t* st;
+  uv__iface_addr_t a;
+  struct ifinfomsg* ifi;
+  struct ifaddrmsg* ifa;
+  struct rtattr* rta;
+  const void* local;
+  const void* addr;
+  unsigned int gen;
+  unsigned int len;
+  int event;
+  int err;
+  int i;
+
+  st = handle->state;
+
+  switch (nlh->nlmsg_type) {
+  case RTM_NEWLINK:
+  case RTM_DELLINK:
+    if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)))
+      return 0;
+
+    ifi = NLMSG_DATA(nlh);
+    link = uv__iface_link_find(st, ifi->ifi_index);
+    if (link == NULL) {
+      if (nlh->nlmsg_type == RTM_DELLINK)
+        return 0;
+      if (st->nlinks == st->links_cap) {
+        err = uv__iface_grow((void**) &st->links,
+                             &st->links_cap,
+                             sizeof(*st->links));
+        if (err)
+          return err;
+      }
+      link = st->links + st->nlinks++;
+      memset(link, 0, sizeof(*link));
+      link->index = ifi->ifi_index;
+    }
+    link->flags = ifi->ifi_flags;
+
+    len = IFLA_PAYLOAD(nlh);
+    for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+      if (rta->rta_type == IFLA_IFNAME) {
+        snprintf(link->name, sizeof(link->name), "%s", (char*) RTA_DATA(rta));
+      } else if (rta->rta_type == IFLA_ADDRESS &&
+                 RTA_PAYLOAD(rta) == sizeof(link->phys_addr)) {
+        memcpy(link->phys_addr, RTA_DATA(rta), sizeof(link->phys_addr));
+      }
+    }
+
+    gen = st->gen;
+    if (notify) {
+      uv__iface_fill(&address, link, NULL);
+      handle->cb(handle, UV_IFACE_LINK_CHANGED, &address, 0);
+    }
+
+    /* 回调里重新启动过handle的话副本已经重建了 */
+    if (nlh->nlmsg_type == RTM_DELLINK && st->gen == gen) {
+      link = uv__iface_link_find(st, ifi->ifi_index);
+      if (link != NULL)
+        *link = st->links[--st->nlinks];
+      /* 地址保持原来的顺序 */
+      len = 0;
+      for (i = 0; i < (int) st->naddrs; i++)
+        if (st->addrs[i].index != ifi->ifi_index)
+          st->addrs[len++] = st->addrs[i];
+      st->naddrs = len;
+    }
+    return 0;
+
+  case RTM_NEWADDR:
+  case RTM_DELADDR:
+    if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
+      return 0;
+
+    ifa = NLMSG_DATA(nlh);
+    if (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6)
+      return 0;
+
+    memset(&a, 0, sizeof(a));
+    a.index = ifa->ifa_index;
+    a.family = ifa->ifa_family;
+    a.prefixlen = ifa->ifa_prefixlen;
+
+    /* 点对点连接上IFA_ADDRESS是对端地址，本机地址在IFA_LOCAL里 */
+    local = NULL;
+    addr = NULL;
+    len = IFA_PAYLOAD(nlh);
+    for (rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+      if (rta->rta_type == IFA_LOCAL)
+        local = RTA_DATA(rta);
+      else if (rta->rta_type == IFA_ADDRESS)
+        addr = RTA_DATA(rta);
+      else if (rta->rta_type == IFA_LABEL)
+        snprintf(a.label, sizeof(a.label), "%s", (char*) RTA_DATA(rta));
+    }
+    if (local != NULL)
+      addr = local;
+    if (addr == NULL)
+      return 0;
+    memcpy(a.addr, addr, a.family == AF_INET6 ? 16 : 4);
+
+    i = uv__iface_addr_find(st, &a);
+    if (nlh->nlmsg_type == RTM_NEWADDR) {
+      event = UV_IFACE_ADDR_ADDED;
+      if (i == -1) {
+        if (st->naddrs == st->addrs_cap) {
+          err = uv__iface_grow((void**) &st->addrs,
+                               &st->addrs_cap,
+                               sizeof(*st->addrs));
+          if (err)
+            return err;
+        }
+        i = st->naddrs++;
+      }
+      st->addrs[i] = a;
+    } else {
+      event = UV_IFACE_ADDR_REMOVED;
+      if (i == -1)
+        return 0;
+      memmove(st->addrs + i,
+              st->addrs + i + 1,
+              (st->naddrs - i - 1) * sizeof(*st->addrs));
+      st->naddrs--;
+    }
+
+    link = uv__iface_link_find(st, a.index);
+    if (notify && link != NULL) {
+      uv__iface_fill(&address, link, &a);
+      handle->cb(handle, event, &address, 0);
+    }
+    return 0;
+  }
+
+  return 0;
+}
+
+
+/* 在单独的阻塞socket上dump所有link和地址，重建副本。通知用的socket在这之前
+ * 就已经开始接收了，期间的变化随后按顺序再应用一遍，结果不会错。
+ */
+static int uv__iface_dump(uv_iface_watch_t* handle) {
+  static const int types[] = { RTM_GETLINK, RTM_GETADDR };
+  struct {
+    struct nlmsghdr nlh;
+    struct rtgenmsg g;
+  } req;
+  struct nlmsghdr* nlh;
+  uv__iface_state_t* st;
+  ssize_t n;
+  size_t len;
+  int done;
+  int err;
+  int fd;
+  int i;
+
+  st = handle->state;
+  st->nlinks = 0;
+  st->naddrs = 0;
+
+  fd = uv__socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+  if (fd < 0)
+    return fd;
+
+  /* uv__socket()打开的是非阻塞socket */
+  err = uv__nonblock(fd, 0);
+  if (err)
+    goto out;
+
+  for (i = 0; i < (int) ARRAY_SIZE(types); i++) {
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = sizeof(req);
+    req.nlh.nlmsg_type = types[i];
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq = i + 1;
+    req.g.rtgen_family = AF_UNSPEC;
+
+    do
+      n = send(fd, &req, sizeof(req), 0);
+    while (n == -1 && errno == EINTR);
+    if (n == -1) {
+      err = UV__ERR(errno);
+      goto out;
+    }
+
+    for (done = 0; !done;) {
+      do
+        n = recv(fd, st->buf, sizeof(st->buf), 0);
+      while (n == -1 && errno == EINTR);
+      if (n == -1) {
+        err = UV__ERR(errno);
+        goto out;
+      }
+
+      len = n;
+      for (nlh = (struct nlmsghdr*) st->buf;
+           NLMSG_OK(nlh, len);
+           nlh = NLMSG_NEXT(nlh, len)) {
+        if (nlh->nlmsg_type == NLMSG_DONE) {
+          done = 1;
+          break;
+        }
+        if (nlh->nlmsg_type == NLMSG_ERROR) {
+          err = UV_EIO;
+          goto out;
+        }
+        err = uv__iface_process(handle, nlh, 0);
+        if (err)
+          goto out;
+      }
+    }
+  }
+
+  err = 0;
+
+out:
+  uv__close(fd);
+  return err;
+}
+
+
+static void uv__iface_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  uv_iface_watch_t* handle;
+  struct nlmsghdr* nlh;
+  uv__iface_state_t* st;
+  unsigned int gen;
+  ssize_t n;
+  size_t len;
+  int err;
+
+  handle = container_of(w, uv_iface_watch_t, io_watcher);
+  st = handle->state;
+  gen = st->gen;
+
+  for (;;) {
+    do
+      n = recv(w->fd, st->buf, sizeof(st->buf), 0);
+    while (n == -1 && errno == EINTR);
+
+    if (n == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return;
+
+      /* 消息太多，内核丢掉了一部分，只能重新dump */
+      if (errno != ENOBUFS) {
+        handle->cb(handle, 0, NULL, UV__ERR(errno));
+        return;
+      }
+
+      err = uv__iface_dump(handle);
+      handle->cb(handle, UV_IFACE_RESYNC, NULL, err);
+      if (err || !uv__is_active(handle) || st->gen != gen)
+        return;
+      continue;
+    }
+
+    len = n;
+    for (nlh = (struct nlmsghdr*) st->buf;
+         NLMSG_OK(nlh, len);
+         nlh = NLMSG_NEXT(nlh, len)) {
+      err = uv__iface_process(handle, nlh, 1);
+      if (err)
+        handle->cb(handle, 0, NULL, err);
+
+      /* 回调里停止或者重新启动了handle，缓冲区里剩下的消息不再有意义 */
+      if (!uv__is_active(handle) || st->gen != gen)
+        return;
+    }
+  }
+}
+
+
+int uv_iface_watch_init(uv_loop_t* loop, uv_iface_watch_t* handle) {
+  uv__handle_init(loop, (uv_handle_t*) handle, UV_IFACE_WATCH);
+  uv__io_init(&handle->io_watcher, uv__iface_io, -1);
+  handle->cb = NULL;
+  handle->state = NULL;
+  return 0;
+}
+
+
+int uv_iface_watch_start(uv_iface_watch_t* handle, uv_iface_watch_cb cb) {
+  struct sockaddr_nl sa;
+  uv__iface_state_t* st;
+  int err;
+  int fd;
+
+  if (uv__is_active(handle))
+    return UV_EBUSY;
+  if (cb == NULL)
+    return UV_EINVAL;
+
+  /* 副本在关闭handle时才释放，回调里停止以后uv__iface_io()还会看一眼gen */
+  if (handle->state == NULL) {
+    st = uv__calloc(1, sizeof(*st));
+    if (st == NULL)
+      return UV_ENOMEM;
+    handle->state = st;
+  }
+  st = handle->state;
+  st->gen++;
+
+  fd = uv__socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+  if (fd < 0)
+    return fd;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.nl_family = AF_NETLINK;
+  sa.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+  if (bind(fd, (struct sockaddr*) &sa, sizeof(sa))) {
+    err = UV__ERR(errno);
+    uv__close(fd);
+    return err;
+  }
+
+  handle->io_watcher.fd = fd;
+  err = uv__iface_dump(handle);
+  if (err) {
+    uv__close(fd);
+    handle->io_watcher.fd = -1;
+    return err;
+  }
+
+  handle->cb = cb;
+  uv__io_start(handle->loop, &handle->io_watcher, POLLIN);
+  uv__handle_start(handle);
+  return 0;
+}
+
+
+int uv_iface_watch_stop(uv_iface_watch_t* handle) {
+  if (!uv__is_active(handle))
+    return 0;
+
+  uv__io_close(handle->loop, &handle->io_watcher);
+  uv__close(handle->io_watcher.fd);
+  handle->io_watcher.fd = -1;
+  uv__handle_stop(handle);
+  return 0;
+}
+
+
+int uv_iface_watch_addresses(const uv_iface_watch_t* handle,
+                             uv_interface_address_t** addresses,
+                             int* count) {
+  uv_interface_address_t* out;
+  const uv__iface_link_t* link;
+  uv__iface_state_t* st;
+  unsigned int i;
+  int n;
+
+  *addresses = NULL;
+  *count = 0;
+
+  if (!uv__is_active(handle))
+    return UV_EINVAL;
+
+  st = handle->state;
+  if (st->naddrs == 0)
+    return 0;
+
+  out = uv__calloc(st->naddrs, sizeof(*out));
+  if (out == NULL)
+    return UV_ENOMEM;
+
+  /* 和uv_interface_addresses()一样只要UP而且RUNNING的接口 */
+  n = 0;
+  for (i = 0; i < st->naddrs; i++) {
+    link = uv__iface_link_find(st, st->addrs[i].index);
+    if (link == NULL)
+      continue;
+    if ((link->flags & (IFF_UP | IFF_RUNNING)) != (IFF_UP | IFF_RUNNING))
+      continue;
+
+    uv__iface_fill(out + n, link, st->addrs + i);
+    out[n].name = uv__strdup(out[n].name);
+    if (out[n].name == NULL) {
+      uv_free_interface_addresses(out, n);
+      return UV_ENOMEM;
+    }
+    n++;
+  }
+
+  if (n == 0) {
+    uv__free(out);
+    return 0;
+  }
+
+  *addresses = out;
+  *count = n;
+  return 0;
+}
+
+
+void uv__iface_watch_close(uv_iface_watch_t* handle) {
+  uv_iface_watch_stop(handle);
+}
+
+
+void uv__iface_watch_finish_close(uv_iface_watch_t* handle) {
+  uv__iface_state_t* st;
+
+  st = handle->state;
+  if (st != NULL) {
+    uv__free(st->links);
+    uv__free(st->addrs);
+    uv__free(st);
+  }
+  handle->state = NULL;
+}
+
+#else  /* !__linux__ */
+
+int uv_iface_watch_init(uv_loop_t* loop, uv_iface_watch_t* handle) {
+  uv__handle_init(loop, (uv_handle_t*) handle, UV_IFACE_WATCH);
+  uv__io_init(&handle->io_watcher, NULL, -1);
+  handle->cb = NULL;
+  handle->state = NULL;
+  return 0;
+}
+
+
+int uv_iface_watch_start(uv_iface_watch_t* handle, uv_iface_watch_cb cb) {
+  return UV_ENOSYS;
+}
+
+
+int uv_iface_watch_stop(uv_iface_watch_t* handle) {
+  return 0;
+}
+
+
+int uv_iface_watch_addresses(const uv_iface_watch_t* handle,
+                             uv_interface_address_t** addresses,
+                             int* count) {
+  *addresses = NULL;
+  *count = 0;
+  return UV_EINVAL;
+}
+
+
+void uv__iface_watch_close(uv_iface_watch_t* handle) {
+}
+
+
+void uv__iface_watch_finish_close(uv_iface_watch_t* handle) {
+}
+
+#endif  /* __linux__ */
@@ -56,6 +56,23 @@
 # include <AvailabilityMacros.h>
 #endif
 
+/* kqueue上用EVFILT_USER唤醒loop，不需要管道。ident只在EVFILT_USER里有意义，
+ * 和fd不冲突
+ */
+#if defined(UV_HAVE_KQUEUE)
+# include <sys/types.h>
+# include <sys/event.h>
+# if defined(EVFILT_USER) && defined(NOTE_TRIGGER)
+#  define UV__KQUEUE_EVFILT_USER 1
+#  define UV__KQUEUE_EVFILT_USER_IDENT 0
+# endif
+/* 纳秒定时器注册成EVFILT_TIMER，ident同样不是fd，见uv__hrtimer_arm() */
+# if defined(__APPLE__)
+#  define UV__KQUEUE_EVFILT_TIMER 1
+#  define UV__KQUEUE_EVFILT_TIMER_IDENT 0
+# endif
+#endif
+
 #if defined(__ANDROID__)
 int uv__pthread_sigmask(int how, const sigset_t* set, sigset_t* oset);
 # ifdef pthread_sigmask
@@ -113,6 +130,27 @@ int uv__pthread_sigmask(int how, const sigset_t* set, sigset_t* oset);
 # define UV__POLLPRI 0
 #endif
 
+/* 注册方式而不是事件：多个loop监听同一个fd时只唤醒其中一个（EPOLLEXCLUSIVE）。
+ * 这一位在uv__io_stop()之后仍然保留，其他平台上为0。
+ */
+#if defined(__linux__)
+# define UV__POLLEXCLUSIVE (1u << 28)
+#else
+# define UV__POLLEXCLUSIVE 0
+#endif
+
+/* 同样是注册方式：边缘触发（EPOLLET），就绪状态变化时只报告一次，使用者必须一直
+ * 读写到EAGAIN，否则剩下的数据不会再报告。在uv__io_stop()之后同样保留，其他平台
+ * 上为0。
+ */
+#if defined(__linux__)
+# define UV__POLLET (1u << 31)
+#else
+# define UV__POLLET 0
+#endif
+
+#define UV__POLLFLAGS (UV__POLLEXCLUSIVE | UV__POLLET)
+
 #if !defined(O_CLOEXEC) && defined(__FreeBSD__)
 /*
  * It may be that we are just missing `__POSIX_VISIBLE >= 200809`.
@@ -125,7 +163,15 @@ typedef struct uv__stream_queued_fds_s uv__stream_queued_fds_t;
 
 /* loop flags */
 enum {
-  UV_LOOP_BLOCK_SIGPROF = 1
+  UV_LOOP_BLOCK_SIGPROF = 1,
+  UV_LOOP_IO_URING = 2,
+  UV_LOOP_FS_COALESCE_SYNC = 4,
+  UV_LOOP_WATCHERS_SPARSE = 8,
+  UV_LOOP_STREAM_ET = 16,
+  UV_LOOP_EPOLL_CTL_SYNC = 32,
+  UV_LOOP_ASYNC_EVFILT_USER = 64,
+  UV_LOOP_CLOSE_NODEL = 128,  /* uv_close_many()：fd随后就关，不用EPOLL_CTL_DEL */
+  UV_LOOP_HUGEPAGES = 256
 };
 
 /* flags of excluding ifaddr */
@@ -184,21 +230,42 @@ int uv__socket(int domain, int type, int protocol);
 ssize_t uv__recvmsg(int fd, struct msghdr *msg, int flags);
 void uv__make_close_pending(uv_handle_t* handle);
 int uv__getiovmax(void);
+void uv__sockbuf_grow(uv_loop_t* loop,
+                      uv__sockbuf_tune_t* t,
+                      int fd,
+                      int optname);
+void uv__sockbuf_idle(uv_loop_t* loop, uv__sockbuf_tune_t* t, int fd);
 
 void uv__io_init(uv__io_t* w, uv__io_cb cb, int fd);
 void uv__io_start(uv_loop_t* loop, uv__io_t* w, unsigned int events);
 void uv__io_stop(uv_loop_t* loop, uv__io_t* w, unsigned int events);
 void uv__io_close(uv_loop_t* loop, uv__io_t* w);
+void uv__io_detach(uv_loop_t* loop, uv__io_t* w);
+void uv__io_attach(uv_loop_t* loop, uv__io_t* w);
 void uv__io_feed(uv_loop_t* loop, uv__io_t* w);
+void uv__io_rearm(uv_loop_t* loop, uv__io_t* w);
 int uv__io_active(const uv__io_t* w, unsigned int events);
 int uv__io_check_fd(uv_loop_t* loop, int fd);
 void uv__io_poll(uv_loop_t* loop, int timeout); /* in milliseconds or -1 */
+void uv__io_flush(uv_loop_t* loop);
 int uv__io_fork(uv_loop_t* loop);
+void uv__io_fork_rearm(uv_loop_t* loop);
 int uv__fd_exists(uv_loop_t* loop, int fd);
+int uv__io_sparse_enable(uv_loop_t* loop);
+int uv__io_hugepages_enable(uv_loop_t* loop);
+int uv__phase_histograms_enable(uv_loop_t* loop);
+int uv__lag_histogram_enable(uv_loop_t* loop);
 
 /* async */
+int uv__async_start(uv_loop_t* loop);
 void uv__async_stop(uv_loop_t* loop);
 int uv__async_fork(uv_loop_t* loop);
+void uv__async_init_lazy(uv_loop_t* loop,
+                         uv_async_t* handle,
+                         uv_async_cb async_cb);
+int uv__async_before_poll(uv_loop_t* loop);
+void uv__async_after_poll(uv_loop_t* loop);
+void uv__async_leave(uv_loop_t* loop);
 
 
 /* loop */
@@ -215,10 +282,67 @@ void uv__stream_destroy(uv_stream_t* stream);
 int uv__stream_try_select(uv_stream_t* stream, int* fd);
 #endif /* defined(__APPLE__) */
 void uv__server_io(uv_loop_t* loop, uv__io_t* w, unsigned int events);
+uv_stream_t* uv__server_multishot(uv__io_t* w);
+void uv__server_accepted(uv_stream_t* stream, int fd);
+int uv__server_take_fd(uv_stream_t* server);
+int uv__fd_incoming(int fd, int* cpu, unsigned int* napi_id);
+void uv__rusage_convert(const struct rusage* usage, uv_rusage_t* rusage);
+void uv__stream_io(uv_loop_t* loop, uv__io_t* w, unsigned int events);
+void uv__stream_recv(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
+void uv__stream_recv_fallback(uv_stream_t* stream);
 int uv__accept(int sockfd);
+
+/* UV_LOOP_RECV_RING：nbufs个size字节的缓冲区连在一起放在base上 */
+struct uv__recv_ring {
+  char* base;
+  size_t size;
+  unsigned int nbufs;
+  size_t mapped;  /* 不为0时base是大页映射，映射的长度 */
+};
+
+int uv__recv_ring_configure(uv_loop_t* loop, unsigned int nbufs, size_t size);
+void uv__recv_ring_delete(uv_loop_t* loop);
+int uv__emfile_configure(uv_loop_t* loop,
+                         unsigned int nfds,
+                         unsigned int backoff);
+void uv__emfile_delete(uv_loop_t* loop);
+void uv__stream_timeouts_delete(uv_loop_t* loop);
 int uv__dup2_cloexec(int oldfd, int newfd);
 int uv__open_cloexec(const char* path, int flags);
 
+/* 流和UDP handle的I/O统计（uv_io_stats()），读写系统调用返回之后调用，
+ * n是读到或写出的字节数，-1表示出错，这时errno还没有被改掉。
+ * 定义了UV_DISABLE_IO_STATS时展开为空
+ */
+#if defined(UV_DISABLE_IO_STATS)
+# define UV__IO_STATS_READ(h, n) do {} while (0)
+# define UV__IO_STATS_WRITE(h, n) do {} while (0)
+#else
+# define UV__IO_STATS_IS_EAGAIN()                                             \
+  (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+# define UV__IO_STATS_READ(h, n)                                              \
+  do {                                                                        \
+    (h)->io_stats.read_syscalls++;                                            \
+    if ((n) > 0)                                                              \
+      (h)->io_stats.bytes_read += (n);                                        \
+    else if ((n) < 0 && UV__IO_STATS_IS_EAGAIN())                             \
+      (h)->io_stats.read_eagain++;                                            \
+  }                                                                           \
+  while (0)
+# define UV__IO_STATS_WRITE(h, n)                                             \
+  do {                                                                        \
+    (h)->io_stats.write_syscalls++;                                           \
+    if ((n) > 0)                                                              \
+      (h)->io_stats.bytes_written += (n);                                     \
+    else if ((n) < 0 && UV__IO_STATS_IS_EAGAIN())                             \
+      (h)->io_stats.write_eagain++;                                           \
+  }                                                                           \
+  while (0)
+#endif
+
+/* tty */
+void uv__tty_write(uv_tty_t* tty);
+
 /* tcp */
 int uv_tcp_listen(uv_tcp_t* tcp, int backlog, uv_connection_cb cb);
 int uv__tcp_nodelay(int fd, int on);
@@ -232,9 +356,71 @@ void uv__signal_close(uv_signal_t* handle);
 void uv__signal_global_once_init(void);
 void uv__signal_loop_cleanup(uv_loop_t* loop);
 int uv__signal_loop_fork(uv_loop_t* loop);
+int uv__signalfd_enable(uv_loop_t* loop);
+
+/* arena */
+void* uv__loop_malloc(uv_loop_t* loop, unsigned int tag, size_t size);
+void uv__loop_free(uv_loop_t* loop, void* ptr);
+void* uv__malloc_tag(unsigned int tag, size_t size);
+void* uv__realloc_tag(unsigned int tag, void* ptr, size_t size);
+void* uv__huge_malloc_tag(unsigned int tag, size_t size);
+void* uv__huge_realloc_tag(unsigned int tag, void* ptr, size_t size);
+void uv__free_tag(void* ptr);
+
+int uv__arena_enable(uv_loop_t* loop);
+void uv__arena_delete(uv_loop_t* loop);
+
+/* udp */
+void uv__udp_io(uv_loop_t* loop, uv__io_t* w, unsigned int revents);
+
+/* ratelimit：handle的rate_limit字段，in管读（POLLIN），out管写（POLLOUT） */
+struct uv__rate_link {
+  uv_loop_t* loop;
+  uv_rate_limit_t* limit;
+  uv__io_t* w;
+  unsigned int events;
+  QUEUE member;                   /* 在limit->wait_queue上等令牌 */
+};
+
+struct uv__rate_limits {
+  struct uv__rate_link in;
+  struct uv__rate_link out;
+};
+
+size_t uv__rate_limit_avail(struct uv__rate_link* link);
+size_t uv__rate_limit_quota(struct uv__rate_link* link);
+void uv__rate_limit_consume(struct uv__rate_link* link, size_t n);
+void uv__rate_limit_cancel(struct uv__rate_link* link);
+int uv__rate_limits_set(uv_handle_t* handle,
+                        void** slot,
+                        uv__io_t* w,
+                        uv_rate_limit_t* in,
+                        uv_rate_limit_t* out);
+void uv__rate_limits_release(void** slot);
+void uv__rate_limits_delete(uv_loop_t* loop);
+
+/* poll */
+void uv__poll_io(uv_loop_t* loop, uv__io_t* w, unsigned int events);
+
+/* watchdog */
+void uv__watchdog_io(uv_loop_t* loop, uv__io_t* w);
+int uv__watchdog_fork(uv_loop_t* loop);
+
+/* 派发I/O watcher回调之前调用，看门狗没有启动时只多一次指针判断。
+ * 和uv__watchdog_leave()的callback__done配对的是io__start探针
+ */
+#define uv__watchdog_io_enter(loop, w)                                        \
+  do {                                                                        \
+    UV__PROBE3(io__start, (loop), (w)->fd, (void*) (w)->cb);                  \
+    uv__dispatch_enter((loop), UV__DISPATCH_IO, (w), (w)->cb);                \
+    if ((loop)->watchdog != NULL)                                             \
+      uv__watchdog_io((loop), (w));                                           \
+  }                                                                           \
+  while (0)
 
 /* platform specific */
 uint64_t uv__hrtime(uv_clocktype_t type);
+int uv__hrtime_use_tsc(int enable);
 int uv__kqueue_init(uv_loop_t* loop);
 int uv__platform_loop_init(uv_loop_t* loop);
 void uv__platform_loop_delete(uv_loop_t* loop);
@@ -244,12 +430,20 @@ void uv__platform_invalidate_fd(uv_loop_t* loop, int fd);
 void uv__async_close(uv_async_t* handle);
 void uv__fs_event_close(uv_fs_event_t* handle);
 void uv__pipe_close(uv_pipe_t* handle);
+void uv__pipe_probe_seqpacket(uv_pipe_t* handle, int fd);
 void uv__poll_close(uv_poll_t* handle);
 void uv__process_close(uv_process_t* handle);
 void uv__stream_close(uv_stream_t* handle);
+void uv__tty_close(uv_tty_t* handle);
 void uv__tcp_close(uv_tcp_t* handle);
 void uv__udp_close(uv_udp_t* handle);
 void uv__udp_finish_close(uv_udp_t* handle);
+void uv__xdp_close(uv_xdp_t* handle);
+void uv__xdp_finish_close(uv_xdp_t* handle);
+void uv__iface_watch_close(uv_iface_watch_t* handle);
+void uv__iface_watch_finish_close(uv_iface_watch_t* handle);
+void uv__shm_channel_close(uv_shm_channel_t* handle);
+void uv__shm_channel_finish_close(uv_shm_channel_t* handle);
 uv_handle_type uv__handle_type(int fd);
 FILE* uv__open_file(const char* path);
 int uv__getpwuid_r(uv_passwd_t* pwd);
@@ -276,6 +470,7 @@ int uv__make_pipe(int fds[2], int flags);
 int uv__fsevents_init(uv_fs_event_t* handle);
 int uv__fsevents_close(uv_fs_event_t* handle);
 void uv__fsevents_loop_delete(uv_loop_t* loop);
+int uv__fsevents_set_latency(uv_loop_t* loop, unsigned int ms);
 
 #endif /* defined(__APPLE__) */
 
@@ -285,6 +480,43 @@ UV_UNUSED(static void uv__update_time(uv_loop_t* loop)) {
   loop->time = uv__hrtime(UV_CLOCK_FAST) / 1000000;
 }
 
+/* 散列模式下loop->watchers是容量为nwatchers（2的次幂）的开放寻址表，
+ * 按fd线性探测，表里至少留一半空位，所以探测总能停在空位上
+ */
+UV_UNUSED(static unsigned int uv__io_hash(int fd)) {
+  unsigned int h;
+
+  h = (unsigned int) fd * 2654435761u;
+  return h ^ (h >> 16);
+}
+
+/* 取fd对应的watcher，没有注册时返回NULL */
+UV_UNUSED(static uv__io_t* uv__io_lookup(const uv_loop_t* loop, int fd)) {
+  uv__io_t* w;
+  unsigned int mask;
+  unsigned int i;
+
+  if (!(loop->flags & UV_LOOP_WATCHERS_SPARSE))
+    return (unsigned) fd < loop->nwatchers ? loop->watchers[fd] : NULL;
+
+  if (loop->nwatchers == 0)
+    return NULL;
+
+  mask = loop->nwatchers - 1;
+  for (i = uv__io_hash(fd) & mask;; i = (i + 1) & mask) {
+    w = loop->watchers[i];
+    if (w == NULL || w->fd == fd)
+      return w;
+  }
+}
+
+/* watchers最后两项记录着还没有分发完的事件：uv__io_poll()分发期间，或者
+ * UV_LOOP_POLL_BUDGET用完以后留到下一轮的那部分
+ */
+UV_UNUSED(static int uv__io_has_deferred(const uv_loop_t* loop)) {
+  return loop->watchers != NULL && loop->watchers[loop->nwatchers] != NULL;
+}
+
 UV_UNUSED(static char* uv__basename_r(const char* path)) {
   char* s;
 
@@ -295,8 +527,77 @@ UV_UNUSED(static char* uv__basename_r(const char* path)) {
   return s + 1;
 }
 
+/* loop上的DNS解析器，见resolver.c */
+int uv__resolver_configure(uv_loop_t* loop,
+                           const char* resolv_conf,
+                           const char* hosts);
+void uv__resolver_delete(uv_loop_t* loop);
+int uv__resolver_getaddrinfo(uv_getaddrinfo_t* req);
+void uv__getaddrinfo_track_copies(void);
+void uv__getaddrinfo_resolved(uv_getaddrinfo_t* req,
+                              int status,
+                              const struct sockaddr_storage* addrs,
+                              unsigned int naddrs,
+                              const char* canonname);
+
 #if defined(__linux__)
 int uv__inotify_fork(uv_loop_t* loop, void* old_watchers);
+
+/* stat/realpath和打开的fd的缓存，见linux-inotify.c */
+int uv__fs_cache_configure(uv_loop_t* loop, int ttl);
+int uv__fs_fd_cache_configure(uv_loop_t* loop, int max_fds);
+void uv__fs_cache_clear(uv_loop_t* loop);
+void uv__fs_cache_delete(uv_loop_t* loop);
+int uv__fs_cache_lookup(uv_loop_t* loop, uv_fs_t* req);
+void uv__fs_cache_store(uv_fs_t* req);
+int uv__fs_cache_release(uv_loop_t* loop, int fd);
+int uv__epoll_set_max_events(uv_loop_t* loop, int max_events);
+int uv__io_set_spin(uv_loop_t* loop, int usec);
+int uv__io_set_poll_budget(uv_loop_t* loop, int usec);
+
+/* 各阶段的硬件计数器，见linux-perf.c */
+int uv__perf_enable(uv_loop_t* loop);
+void uv__perf_phase(uv_loop_t* loop, int phase);
+int uv__perf_fork(uv_loop_t* loop);
+void uv__perf_delete(uv_loop_t* loop);
+void uv__perf_metrics(const uv_loop_t* loop, uv_metrics_t* metrics);
+
+/* io_uring */
+int uv__iou_enable(uv_loop_t* loop);
+void uv__iou_delete(uv_loop_t* loop);
+void uv__iou_invalidate_fd(uv_loop_t* loop, int fd);
+void uv__iou_poll(uv_loop_t* loop, int timeout);
+void uv__iou_flush(uv_loop_t* loop);
+int uv__iou_fs_submit(uv_loop_t* loop, uv_fs_t* req);
+void uv__fs_iou_done(uv_fs_t* req, int res);
+int uv__iou_recv_start(uv_loop_t* loop, uv_stream_t* stream);
+void uv__iou_recv_stop(uv_loop_t* loop, int fd);
+int uv__iou_recv_active(const uv_loop_t* loop, int fd);
+int uv__iou_register_buffers(uv_loop_t* loop,
+                             const uv_buf_t bufs[],
+                             unsigned int nbufs);
+int uv__iou_register_files(uv_loop_t* loop,
+                           const uv_os_fd_t files[],
+                           unsigned int nfiles);
+void uv__iou_forget_file(uv_loop_t* loop, int fd);
+/* buf在第index个登记的缓冲区里时返回0，loop没有登记缓冲区时返回UV_ENOENT */
+int uv__iou_fixed_buf(const uv_loop_t* loop,
+                      const uv_buf_t* buf,
+                      unsigned int index);
+
+/* epoll后端攒起来一起提交的epoll_ctl，err是返回的errno，-1表示没有提交 */
+#define UV__EPOLL_CTL_BATCH_MAX 256
+
+struct uv__epoll_ctl_op {
+  uv__io_t* w;
+  int op;
+  int err;
+};
+
+void uv__iou_epoll_ctl(uv_loop_t* loop,
+                       struct uv__epoll_ctl_op* ops,
+                       unsigned int n);
+void uv__iou_epoll_ctl_delete(uv_loop_t* loop);
 #endif
 
 typedef int (*uv__peersockfunc)(int, struct sockaddr*, socklen_t*);
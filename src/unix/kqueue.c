@@ -47,6 +47,12 @@
 
 static void uv__fs_event(uv_loop_t* loop, uv__io_t* w, unsigned int fflags);
 
+#if defined(UV__KQUEUE_EVFILT_TIMER)
+# define uv__kqueue_hrtimer_pending(loop) ((loop)->hrtimer_heap.nelts != 0)
+#else
+# define uv__kqueue_hrtimer_pending(loop) 0
+#endif
+
 
 int uv__kqueue_init(uv_loop_t* loop) {
   loop->backend_fd = kqueue();
@@ -70,6 +76,13 @@ int uv__io_fork(uv_loop_t* loop) {
   if (err)
     return err;
 
+#if defined(UV__KQUEUE_EVFILT_TIMER)
+  /* 新的kqueue上没有注册EVFILT_TIMER，按堆顶重新设置 */
+  loop->hrtimer_armed = 0;
+  if (loop->hrtimer_heap.nelts != 0)
+    uv__run_hrtimers(loop);
+#endif
+
 #if defined(__APPLE__)
   if (loop->cf_state != NULL) {
     /* We cannot start another CFRunloop and/or thread in the child
@@ -91,6 +104,63 @@ int uv__io_fork(uv_loop_t* loop) {
 }
 
 
+#if defined(UV__KQUEUE_EVFILT_TIMER)
+/* EVFILT_TIMER直接注册在loop的kqueue上，不需要额外的fd */
+int uv__hrtimer_init(uv_loop_t* loop) {
+  return 0;
+}
+
+
+/* 让EVFILT_TIMER在deadline（uv_hrtime()的刻度）到期，0表示关掉。
+ * EVFILT_TIMER的绝对时间用的是墙上时钟，这里换算成相对现在的纳秒数，
+ * 一次性触发；到期时uv__run_hrtimers()重新读时钟，没到的会再设置一次。
+ */
+void uv__hrtimer_arm(uv_loop_t* loop, uint64_t deadline) {
+  struct kevent ev;
+  uint64_t now;
+  int64_t delta;
+  int r;
+
+  if (deadline == loop->hrtimer_armed)
+    return;
+
+  if (deadline == 0) {
+    EV_SET(&ev,
+           UV__KQUEUE_EVFILT_TIMER_IDENT,
+           EVFILT_TIMER,
+           EV_DELETE,
+           0,
+           0,
+           0);
+  } else {
+    /* data为0时有的内核不会触发，最少等1纳秒 */
+    now = uv_hrtime();
+    delta = 1;
+    if (deadline > now)
+      delta = deadline - now > INT64_MAX ? INT64_MAX : deadline - now;
+
+    EV_SET(&ev,
+           UV__KQUEUE_EVFILT_TIMER_IDENT,
+           EVFILT_TIMER,
+           EV_ADD | EV_ONESHOT,
+           NOTE_NSECONDS,
+           delta,
+           0);
+  }
+
+  do
+    r = kevent(loop->backend_fd, &ev, 1, NULL, 0, NULL);
+  while (r == -1 && errno == EINTR);
+
+  /* 一次性的定时器已经触发过，删除时就找不到了 */
+  if (r == -1 && !(deadline == 0 && errno == ENOENT))
+    abort();
+
+  loop->hrtimer_armed = deadline;
+}
+#endif
+
+
 int uv__io_check_fd(uv_loop_t* loop, int fd) {
   struct kevent ev;
   int rc;
@@ -109,31 +179,16 @@ int uv__io_check_fd(uv_loop_t* loop, int fd) {
 }
 
 
-void uv__io_poll(uv_loop_t* loop, int timeout) {
-  struct kevent events[1024];
-  struct kevent* ev;
-  struct timespec spec;
+/* 把watcher队列里的变化写进events，写满了就先提交，返回还没提交的个数 */
+static unsigned int uv__kqueue_register(uv_loop_t* loop,
+                                        struct kevent* events,
+                                        unsigned int size) {
   unsigned int nevents;
-  unsigned int revents;
   QUEUE* q;
   uv__io_t* w;
-  sigset_t* pset;
-  sigset_t set;
-  uint64_t base;
-  uint64_t diff;
-  int have_signals;
   int filter;
   int fflags;
-  int count;
-  int nfds;
-  int fd;
   int op;
-  int i;
-
-  if (loop->nfds == 0) {
-    assert(QUEUE_EMPTY(&loop->watcher_queue));
-    return;
-  }
 
   nevents = 0;
 
@@ -145,7 +200,7 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
     w = QUEUE_DATA(q, uv__io_t, watcher_queue);
     assert(w->pevents != 0);
     assert(w->fd >= 0);
-    assert(w->fd < (int) loop->nwatchers);
+    assert(uv__io_lookup(loop, w->fd) == w);
 
     if ((w->events & POLLIN) == 0 && (w->pevents & POLLIN) != 0) {
       filter = EVFILT_READ;
@@ -161,7 +216,7 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
 
       EV_SET(events + nevents, w->fd, filter, op, fflags, 0, 0);
 
-      if (++nevents == ARRAY_SIZE(events)) {
+      if (++nevents == size) {
         if (kevent(loop->backend_fd, events, nevents, NULL, 0, NULL))
           abort();
         nevents = 0;
@@ -171,7 +226,7 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
     if ((w->events & POLLOUT) == 0 && (w->pevents & POLLOUT) != 0) {
       EV_SET(events + nevents, w->fd, EVFILT_WRITE, EV_ADD, 0, 0, 0);
 
-      if (++nevents == ARRAY_SIZE(events)) {
+      if (++nevents == size) {
         if (kevent(loop->backend_fd, events, nevents, NULL, 0, NULL))
           abort();
         nevents = 0;
@@ -181,7 +236,7 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
    if ((w->events & UV__POLLPRI) == 0 && (w->pevents & UV__POLLPRI) != 0) {
       EV_SET(events + nevents, w->fd, EV_OOBAND, EV_ADD, 0, 0, 0);
 
-      if (++nevents == ARRAY_SIZE(events)) {
+      if (++nevents == size) {
         if (kevent(loop->backend_fd, events, nevents, NULL, 0, NULL))
           abort();
         nevents = 0;
@@ -191,6 +246,53 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
     w->events = w->pevents;
   }
 
+  return nevents;
+}
+
+
+/* 只提交注册，不等待也不分发事件，见uv_embed_prepare() */
+void uv__io_flush(uv_loop_t* loop) {
+  struct kevent events[64];
+  unsigned int nevents;
+
+  nevents = uv__kqueue_register(loop, events, ARRAY_SIZE(events));
+  if (nevents != 0)
+    if (kevent(loop->backend_fd, events, nevents, NULL, 0, NULL))
+      abort();
+}
+
+
+void uv__io_poll(uv_loop_t* loop, int timeout) {
+  struct kevent events[1024];
+  struct kevent* ev;
+  struct timespec spec;
+  unsigned int nevents;
+  unsigned int revents;
+  uv__io_t* w;
+  sigset_t* pset;
+  sigset_t set;
+  uint64_t base;
+  uint64_t diff;
+  int have_signals;
+  int count;
+  int nfds;
+  int fd;
+  int i;
+
+  /* EVFILT_USER方式的异步唤醒和EVFILT_TIMER方式的纳秒定时器都不占fd，
+   * 但是仍然要等它们
+   */
+  if (loop->nfds == 0 &&
+      !(loop->flags & UV_LOOP_ASYNC_EVFILT_USER) &&
+      !uv__kqueue_hrtimer_pending(loop)) {
+    assert(QUEUE_EMPTY(&loop->watcher_queue));
+    /* 没有fd时也要按定时器的超时阻塞，见linux-core.c */
+    if (timeout == 0 || timeout == -1)
+      return;
+  }
+
+  nevents = uv__kqueue_register(loop, events, ARRAY_SIZE(events));
+
   pset = NULL;
   if (loop->flags & UV_LOOP_BLOCK_SIGPROF) {
     pset = &set;
@@ -254,11 +356,36 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
     loop->watchers[loop->nwatchers + 1] = (void*) (uintptr_t) nfds;
     for (i = 0; i < nfds; i++) {
       ev = events + i;
+
+#if defined(UV__KQUEUE_EVFILT_USER)
+      /* uv_async_send()触发的唤醒，ident不是fd */
+      if (ev->filter == EVFILT_USER) {
+        assert(ev->ident == UV__KQUEUE_EVFILT_USER_IDENT);
+        w = &loop->async_io_watcher;
+        uv__watchdog_io_enter(loop, w);
+        w->cb(loop, w, POLLIN);
+        uv__watchdog_leave(loop);
+        nevents++;
+        continue;
+      }
+#endif
+
+#if defined(UV__KQUEUE_EVFILT_TIMER)
+      /* 最早的纳秒定时器到期了，ident不是fd */
+      if (ev->filter == EVFILT_TIMER) {
+        assert(ev->ident == UV__KQUEUE_EVFILT_TIMER_IDENT);
+        loop->hrtimer_armed = 0;
+        uv__run_hrtimers(loop);
+        nevents++;
+        continue;
+      }
+#endif
+
       fd = ev->ident;
       /* Skip invalidated events, see uv__platform_invalidate_fd */
       if (fd == -1)
         continue;
-      w = loop->watchers[fd];
+      w = uv__io_lookup(loop, fd);
 
       if (w == NULL) {
         /* File descriptor that we've stopped watching, disarm it.
@@ -276,7 +403,9 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
       if (ev->filter == EVFILT_VNODE) {
         assert(w->events == POLLIN);
         assert(w->pevents == POLLIN);
+        uv__watchdog_io_enter(loop, w);
         w->cb(loop, w, ev->fflags); /* XXX always uv__fs_event() */
+        uv__watchdog_leave(loop);
         nevents++;
         continue;
       }
@@ -339,14 +468,20 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
        */
       if (w == &loop->signal_io_watcher)
         have_signals = 1;
-      else
+      else {
+        uv__watchdog_io_enter(loop, w);
         w->cb(loop, w, revents);
+        uv__watchdog_leave(loop);
+      }
 
       nevents++;
     }
 
-    if (have_signals != 0)
+    if (have_signals != 0) {
+      uv__watchdog_io_enter(loop, &loop->signal_io_watcher);
       loop->signal_io_watcher.cb(loop, &loop->signal_io_watcher, POLLIN);
+      uv__watchdog_leave(loop);
+    }
 
     loop->watchers[loop->nwatchers] = NULL;
     loop->watchers[loop->nwatchers + 1] = NULL;
@@ -386,17 +521,27 @@ void uv__platform_invalidate_fd(uv_loop_t* loop, int fd) {
   uintptr_t i;
   uintptr_t nfds;
 
-  assert(loop->watchers != NULL);
+  /* 还没有启动过任何watcher的loop连数组都还没有分配 */
+  if (!uv__io_has_deferred(loop))
+    return;
 
   events = (struct kevent*) loop->watchers[loop->nwatchers];
   nfds = (uintptr_t) loop->watchers[loop->nwatchers + 1];
-  if (events == NULL)
-    return;
 
   /* Invalidate events with same file descriptor */
-  for (i = 0; i < nfds; i++)
+  for (i = 0; i < nfds; i++) {
+#if defined(UV__KQUEUE_EVFILT_USER)
+    /* 异步唤醒的ident不是fd */
+    if (events[i].filter == EVFILT_USER)
+      continue;
+#endif
+#if defined(UV__KQUEUE_EVFILT_TIMER)
+    if (events[i].filter == EVFILT_TIMER)
+      continue;
+#endif
     if ((int) events[i].ident == fd)
       events[i].ident = -1;
+  }
 }
 
 
@@ -528,6 +673,11 @@ int uv_fs_event_stop(uv_fs_event_t* handle) {
 }
 
 
+int uv_fs_event_set_coalesce(uv_fs_event_t* handle, unsigned int window) {
+  return UV_ENOSYS;
+}
+
+
 void uv__fs_event_close(uv_fs_event_t* handle) {
   uv_fs_event_stop(handle);
 }
@@ -38,10 +38,15 @@
 #include <sys/param.h>
 #include <sys/prctl.h>
 #include <sys/sysinfo.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <time.h>
 
+#if defined(__x86_64__)
+# include <cpuid.h>
+#endif
+
 #define HAVE_IFADDRS_H 1
 
 #ifdef __UCLIBC__
@@ -74,10 +79,18 @@
 # define CLOCK_BOOTTIME 7
 #endif
 
+/* epoll_pwait事件数组的初始大小、自适应调整的下限和默认上限。连续
+ * UV__EPOLL_EVENTS_SHRINK次只用到不足四分之一时缩小一半，用满时扩大一倍。
+ */
+#define UV__EPOLL_EVENTS_INIT 1024
+#define UV__EPOLL_EVENTS_MIN 64
+#define UV__EPOLL_EVENTS_MAX 16384
+#define UV__EPOLL_EVENTS_SHRINK 64
+
+/* 一轮里要提交的epoll_ctl至少有这么多个时才走io_uring，少的时候逐个调用更便宜 */
+#define UV__EPOLL_CTL_BATCH_MIN 8
+
 static int read_models(unsigned int numcpus, uv_cpu_info_t* ci);
-static int read_times(FILE* statfile_fp,
-                      unsigned int numcpus,
-                      uv_cpu_info_t* ci);
 static void read_speeds(unsigned int numcpus, uv_cpu_info_t* ci);
 static unsigned long read_cpufreq(unsigned int cpunum);
 
@@ -114,19 +127,220 @@ int uv__platform_loop_init(uv_loop_t* loop) {
   loop->inotify_fd = -1;
   /*   */
   loop->inotify_watchers = NULL;
+  loop->fs_cache = NULL;
+  loop->fs_cache_count = 0;
+  loop->fs_cache_ttl = 0;
+  loop->fs_cache_fds = NULL;
+  loop->fs_cache_nfds = 0;
+  loop->fs_cache_max_fds = 0;
+  /* io_uring后端在uv_loop_configure(UV_LOOP_USE_IO_URING)时才会创建，成批提交
+   * epoll_ctl用的ring在第一次用到时才会创建
+   */
+  loop->iou = NULL;
+  loop->epoll_ctl_ring = NULL;
+  /* 纳秒定时器用的timerfd在第一次调用uv_timer_start_ns()时才会创建 */
+  loop->hrtimer_watcher.fd = -1;
+  loop->hrtimer_armed = 0;
+
+  if (fd == -1)
+    return UV__ERR(errno);
+
+  /* epoll_pwait使用的事件数组放在loop里面，大小在运行时根据负载调整 */
+  loop->epoll_events = uv__malloc(UV__EPOLL_EVENTS_INIT *
+                                  sizeof(struct epoll_event));
+  if (loop->epoll_events == NULL) {
+    uv__close(fd);
+    loop->backend_fd = -1;
+    return UV_ENOMEM;
+  }
+
+  loop->epoll_events_size = UV__EPOLL_EVENTS_INIT;
+  loop->epoll_events_max = UV__EPOLL_EVENTS_MAX;
+  loop->epoll_events_low = 0;
+
+  return 0;
+}
 
+
+/* timerfd可读说明最早的纳秒定时器到期了 */
+static void uv__hrtimer_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  uint64_t expirations;
+  ssize_t r;
+
+  assert(w == &loop->hrtimer_watcher);
+
+  do
+    r = read(w->fd, &expirations, sizeof(expirations));
+  while (r == -1 && errno == EINTR);
+
+  if (r == -1 && errno != EAGAIN)
+    abort();
+
+  /* 设置过一个绝对时间之后又重新设置了，timerfd上就没有数据，也没有关系 */
+  loop->hrtimer_armed = 0;
+  uv__run_hrtimers(loop);
+}
+
+
+/* 创建纳秒定时器用的timerfd，注册到loop上，但它不会让loop保持活跃 */
+int uv__hrtimer_init(uv_loop_t* loop) {
+  int fd;
+
+  if (loop->hrtimer_watcher.fd != -1)
+    return 0;
+
+  fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
   if (fd == -1)
     return UV__ERR(errno);
 
+  loop->hrtimer_armed = 0;
+  uv__io_init(&loop->hrtimer_watcher, uv__hrtimer_io, fd);
+  uv__io_start(loop, &loop->hrtimer_watcher, POLLIN);
+
+  return 0;
+}
+
+
+/* 让timerfd在deadline（uv__hrtime(UV_CLOCK_PRECISE)的刻度，也就是
+ * CLOCK_MONOTONIC）到期，0表示关掉。已经设置的就是这个时间时不做系统调用
+ */
+void uv__hrtimer_arm(uv_loop_t* loop, uint64_t deadline) {
+  struct itimerspec spec;
+
+  if (deadline == loop->hrtimer_armed)
+    return;
+
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = deadline / 1000000000;
+  spec.it_value.tv_nsec = deadline % 1000000000;
+
+  if (timerfd_settime(loop->hrtimer_watcher.fd, TFD_TIMER_ABSTIME, &spec, NULL))
+    abort();
+
+  loop->hrtimer_armed = deadline;
+}
+
+
+/* 调整事件数组的大小，失败时保持原来的数组不变 */
+static void uv__epoll_events_resize(uv_loop_t* loop, unsigned int size) {
+  void* events;
+
+  if (size < UV__EPOLL_EVENTS_MIN)
+    size = UV__EPOLL_EVENTS_MIN;
+  if (size > loop->epoll_events_max)
+    size = loop->epoll_events_max;
+
+  loop->epoll_events_low = 0;
+  if (size == loop->epoll_events_size)
+    return;
+
+  /* 还有事件没有分发完，watchers最后两项指向这个数组 */
+  if (uv__io_has_deferred(loop))
+    return;
+
+  events = uv__realloc(loop->epoll_events, size * sizeof(struct epoll_event));
+  if (events == NULL)
+    return;
+
+  loop->epoll_events = events;
+  loop->epoll_events_size = size;
+}
+
+
+int uv__io_set_spin(uv_loop_t* loop, int usec) {
+  if (usec < 0)
+    return UV_EINVAL;
+
+  loop->spin_budget = (uint64_t) usec * 1000;
+  return 0;
+}
+
+
+int uv__io_set_poll_budget(uv_loop_t* loop, int usec) {
+  if (usec < 0)
+    return UV_EINVAL;
+
+  loop->poll_budget = (uint64_t) usec * 1000;
+  return 0;
+}
+
+
+/* 以EPOLLEXCLUSIVE方式注册watcher，内核不支持时（4.5之前）退回普通注册方式 */
+static void uv__epoll_ctl_exclusive(uv_loop_t* loop,
+                                    uv__io_t* w,
+                                    struct epoll_event* e,
+                                    int registered) {
+  struct epoll_event dummy;
+
+  memset(&dummy, 0, sizeof(dummy));
+  if (registered)
+    epoll_ctl(loop->backend_fd, EPOLL_CTL_DEL, w->fd, &dummy);
+
+  if (epoll_ctl(loop->backend_fd, EPOLL_CTL_ADD, w->fd, e)) {
+    if (errno == EEXIST) {
+      /* 猜错了，该fd其实还注册在epoll上 */
+      epoll_ctl(loop->backend_fd, EPOLL_CTL_DEL, w->fd, &dummy);
+    } else if (errno == EINVAL) {
+      w->pevents &= ~UV__POLLEXCLUSIVE;
+      e->events = w->pevents;
+    } else {
+      abort();
+    }
+
+    if (epoll_ctl(loop->backend_fd, EPOLL_CTL_ADD, w->fd, e))
+      abort();
+  }
+
+  w->events = w->pevents;
+  w->kevents = w->pevents;
+  w->kdeferred = 0;
+}
+
+
+/* 只记录上限，数组可能正在被uv__io_poll使用，真正的调整在下一次epoll_pwait之前进行 */
+int uv__epoll_set_max_events(uv_loop_t* loop, int max_events) {
+  if (max_events < 1)
+    return UV_EINVAL;
+
+  loop->epoll_events_max = max_events;
   return 0;
 }
 
 /*    */
 int uv__io_fork(uv_loop_t* loop) {
+  unsigned int i;
   int err;
+  int use_iou;
+  unsigned int max_events;
   void* old_watchers;
+  int use_hrtimer;
+  int cache_ttl;
+  int cache_max_fds;
 
+  /* 缓存项挂着的watcher_list可能只为缓存存在，要在取old_watchers之前释放；
+   * 子进程里的缓存也不再可信
+   */
+  uv__fs_cache_delete(loop);
+  cache_ttl = loop->fs_cache_ttl;
+  cache_max_fds = loop->fs_cache_max_fds;
   old_watchers = loop->inotify_watchers;
+  max_events = loop->epoll_events_max;
+  /* 子进程继承的timerfd和父进程是同一个，也要重新创建 */
+  use_hrtimer = loop->hrtimer_watcher.fd != -1;
+
+  /* 新的epoll fd上什么都没有注册 */
+  for (i = 0; i < loop->nwatchers; i++)
+    if (loop->watchers[i] != NULL)
+      loop->watchers[i]->kevents = 0;
+
+  /* 留到下一轮的事件属于父进程的epoll，事件数组也要随loop一起重新分配 */
+  if (uv__io_has_deferred(loop)) {
+    loop->watchers[loop->nwatchers] = NULL;
+    loop->watchers[loop->nwatchers + 1] = NULL;
+  }
+
+  /* 子进程不能和父进程共用ring，需要重新创建一个 */
+  use_iou = loop->flags & UV_LOOP_IO_URING;
 
   uv__close(loop->backend_fd);
   loop->backend_fd = -1;
@@ -136,11 +350,46 @@ int uv__io_fork(uv_loop_t* loop) {
   if (err)
     return err;
 
+  uv__epoll_set_max_events(loop, max_events);
+  loop->fs_cache_ttl = cache_ttl;
+  loop->fs_cache_max_fds = cache_max_fds;
+
+  /* 重新创建失败时回退到epoll，uv_loop_fork()随后会重新注册所有watcher */
+  if (use_iou)
+    uv__iou_enable(loop);
+
+  if (use_hrtimer) {
+    err = uv__hrtimer_init(loop);
+    if (err)
+      return err;
+    uv__run_hrtimers(loop);
+  }
+
   return uv__inotify_fork(loop, old_watchers);
 }
 
 /*  删除loop  */
 void uv__platform_loop_delete(uv_loop_t* loop) {
+  /* 释放io_uring后端 */
+  if (loop->flags & UV_LOOP_IO_URING) {
+    uv__iou_delete(loop);
+    loop->flags &= ~UV_LOOP_IO_URING;
+  }
+  uv__iou_epoll_ctl_delete(loop);
+
+  uv__free(loop->epoll_events);
+  loop->epoll_events = NULL;
+  loop->epoll_events_size = 0;
+
+  if (loop->hrtimer_watcher.fd != -1) {
+    uv__io_stop(loop, &loop->hrtimer_watcher, POLLIN);
+    uv__close(loop->hrtimer_watcher.fd);
+    loop->hrtimer_watcher.fd = -1;
+    loop->hrtimer_armed = 0;
+  }
+
+  uv__fs_cache_delete(loop);
+
   /*    */
   if (loop->inotify_fd == -1) return;
   /*    */
@@ -156,16 +405,23 @@ void uv__platform_invalidate_fd(uv_loop_t* loop, int fd) {
   uintptr_t i;
   uintptr_t nfds;
 
-  assert(loop->watchers != NULL);
+  /* io_uring后端需要撤销挂在该fd上的poll请求 */
+  if (loop->flags & UV_LOOP_IO_URING) {
+    uv__iou_invalidate_fd(loop, fd);
+    return;
+  }
 
-  /* loop->watchers最后两项的特殊用途 */
-  events = (struct epoll_event*) loop->watchers[loop->nwatchers];
-  nfds = (uintptr_t) loop->watchers[loop->nwatchers + 1];
-  if (events != NULL)
+  /* loop->watchers最后两项的特殊用途。还没有启动过任何watcher的loop连数组
+   * 都还没有分配
+   */
+  if (uv__io_has_deferred(loop)) {
+    events = (struct epoll_event*) loop->watchers[loop->nwatchers];
+    nfds = (uintptr_t) loop->watchers[loop->nwatchers + 1];
     /* Invalidate events with same file descriptor */
     for (i = 0; i < nfds; i++)
       if (events[i].data.fd == fd)
         events[i].data.fd = -1;
+  }
 
   /* Remove the file descriptor from the epoll.
    * This avoids a problem where the same file description remains open
@@ -173,7 +429,7 @@ void uv__platform_invalidate_fd(uv_loop_t* loop, int fd) {
    *
    * We pass in a dummy epoll_event, to work around a bug in old kernels.
    */
-  if (loop->backend_fd >= 0) {
+  if (loop->backend_fd >= 0 && !(loop->flags & UV_LOOP_CLOSE_NODEL)) {
     /* Work around a bug in kernels 3.10 to 3.19 where passing a struct that
      * has the EPOLLWAKEUP flag set generates spurious audit syslog warnings.
      */
@@ -202,38 +458,87 @@ int uv__io_check_fd(uv_loop_t* loop, int fd) {
   return rc;
 }
 
-/* 处理io事件轮询 */
-void uv__io_poll(uv_loop_t* loop, int timeout) {
-  /* A bug in kernels < 2.6.37 makes timeouts larger than ~30 minutes
-   * effectively infinite on 32 bits architectures.  To avoid blocking
-   * indefinitely, we cap the timeout and poll again if necessary.
-   *
-   * Note that "30 minutes" is a simplification because it depends on
-   * the value of CONFIG_HZ.  The magic constant assumes CONFIG_HZ=1200,
-   * that being the largest value I have seen in the wild (and only once.)
-   */
-  static const int max_safe_timeout = 1789569;
-  struct epoll_event events[1024];
-  struct epoll_event* pe;
+/* 提交uv__io_poll()攒起来的epoll_ctl。一批里有足够多的操作时通过io_uring一次
+ * 提交，否则（或者io_uring不可用时）逐个调用epoll_ctl。
+ */
+static void uv__epoll_ctl_flush(uv_loop_t* loop,
+                                struct uv__epoll_ctl_op* ops,
+                                unsigned int n) {
   struct epoll_event e;
-  int real_timeout;
-  QUEUE* q;
+  unsigned int i;
   uv__io_t* w;
-  sigset_t sigset;
-  sigset_t* psigset;
-  uint64_t base;
-  int have_signals;
-  int nevents;
-  int count;
-  int nfds;
-  int fd;
+  int err;
   int op;
-  int i;
 
-  if (loop->nfds == 0) {
-    assert(QUEUE_EMPTY(&loop->watcher_queue));
-    return;
+  if (n >= UV__EPOLL_CTL_BATCH_MIN) {
+    uv__iou_epoll_ctl(loop, ops, n);
+  } else {
+    for (i = 0; i < n; i++)
+      ops[i].err = -1;
+  }
+
+  for (i = 0; i < n; i++) {
+    w = ops[i].w;
+    op = ops[i].op;
+    err = ops[i].err;
+
+    /* 初始化epoll要监听的事件为watcher的Pending event和绑定的fd */
+    memset(&e, 0, sizeof(e));
+    e.events = w->pevents;
+    e.data.fd = w->fd;
+
+    /* 没有提交，或者内核不认识IORING_OP_EPOLL_CTL（报EINVAL）。后一种情况同步
+     * 调用成功的话说明是io_uring的问题，以后都逐个调用
+     *
+     * 原型：int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+     * 细节参见：http://man7.org/linux/man-pages/man2/epoll_ctl.2.html
+     */
+    if (err == -1 || err == EINVAL) {
+      if (epoll_ctl(loop->backend_fd, op, w->fd, &e) == 0) {
+        if (err == EINVAL)
+          loop->flags |= UV_LOOP_EPOLL_CTL_SYNC;
+        err = 0;
+      } else {
+        err = errno;
+      }
+    }
+
+    if (err != 0) {
+      /* EEXIST：对一个已经注册的fd执行EPOLL_CTL_ADD操作（一个fd允许被绑定到多个watcher）
+       * ENOENT：该fd已经从epoll上删除了（比如停止期间收到事件被EPOLL_CTL_DEL，或者fork之后）
+       * 其他错误直接abort
+       */
+      if (err != EEXIST && err != ENOENT)
+        abort();
+
+      assert((err == EEXIST) == (op == EPOLL_CTL_ADD));
+      op = (op == EPOLL_CTL_ADD) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+      /* 用另一种op重新注册这个事件，如果还出错就直接abort */
+      if (epoll_ctl(loop->backend_fd, op, w->fd, &e))
+        abort();
+    }
+
+    /* 把该watcher的当前events更新为pevents */
+    w->events = w->pevents;
+    w->kevents = w->pevents;
+    w->kdeferred = 0;
   }
+}
+
+
+/* 把watcher队列里的变化注册到epoll上 */
+static void uv__epoll_register(uv_loop_t* loop) {
+  struct uv__epoll_ctl_op ops[UV__EPOLL_CTL_BATCH_MAX];
+  struct epoll_event e;
+  unsigned int nops;
+  QUEUE deferred;
+  QUEUE* q;
+  uv__io_t* w;
+  int op;
+
+  QUEUE_INIT(&deferred);
+  nops = 0;
   /* 如果该loop上的watcher队列不为空，则遍历队列 */
   while (!QUEUE_EMPTY(&loop->watcher_queue)) {
     /* 取出watcher队列头节点 */
@@ -251,43 +556,123 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
     /* 该watcher绑定的fd必须是有效的 */
     assert(w->fd >= 0);
     /* 这个在maybe_resize函数中保证 */
-    assert(w->fd < (int) loop->nwatchers);
-   
-    /* 初始化epoll要监听的事件为watcher的Pending event */
-    e.events = w->pevents;
-    /* 初始化epoll要监听的fd为watcher绑定的fd */
-    e.data.fd = w->fd;
+    assert(uv__io_lookup(loop, w->fd) == w);
+
+    /* w->events不为0说明watcher一直没有被完全停止过，此时w->kevents就是该fd在epoll
+     * 上的真实注册掩码。关注的事件只是减少了的话先不调用EPOLL_CTL_MOD，多出来的事件
+     * 在epoll_pwait之后过滤掉；如果下一轮开始时关注的事件仍然没有恢复，再真正修改。
+     * 像uv_read_stop()/uv_read_start()这样在一次循环内来回切换的情况就不需要任何
+     * 系统调用了。
+     */
+    if (w->events != 0 && w->kevents != 0) {
+      if (w->kevents == w->pevents) {
+        w->events = w->pevents;
+        w->kdeferred = 0;
+        continue;
+      }
+
+      if ((w->pevents & ~w->kevents) == 0 && w->kdeferred == 0) {
+        w->events = w->pevents;
+        w->kdeferred = 1;
+        QUEUE_INSERT_TAIL(&deferred, q);
+        continue;
+      }
+    }
 
-    /* 如果该watcher当前已经注册的events为0，即之前没有注册过event，则此次就是EPOLL_CTL_ADD，否则为EPOLL_CTL_MOD */
-    if (w->events == 0)
+    /* kevents为0表示之前没有注册过，此次就是EPOLL_CTL_ADD，否则为EPOLL_CTL_MOD。
+     * watcher被完全停止后epoll上的注册并不会立即删除，所以kevents只是一个提示，
+     * 猜错了就用另一种op重试。
+     */
+    if (w->kevents == 0)
       op = EPOLL_CTL_ADD;
     else
       op = EPOLL_CTL_MOD;
 
-    /* XXX Future optimization: do EPOLL_CTL_MOD lazily if we stop watching
-     * events, skip the syscall and squelch the events after epoll_wait().
-     * 
-     * 向epoll注册事件
-     * 原型：int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
-     * 细节参见：http://man7.org/linux/man-pages/man2/epoll_ctl.2.html 
+    /* EPOLLEXCLUSIVE不能和EPOLL_CTL_MOD一起使用，只能先删除再重新添加 */
+    if (w->pevents & UV__POLLEXCLUSIVE) {
+      e.events = w->pevents;
+      e.data.fd = w->fd;
+      uv__epoll_ctl_exclusive(loop, w, &e, op == EPOLL_CTL_MOD);
+      continue;
+    }
+
+    /* 先攒起来，攒满一批或者队列遍历完以后一起提交，一轮里接受了很多连接时
+     * 不用每个fd一次系统调用
      */
-    if (epoll_ctl(loop->backend_fd, op, w->fd, &e)) {
-      /* 如果发生错误，并且错误不是EEXIST，则发生异常错误，直接abort */
-      if (errno != EEXIST)
-        abort();
+    ops[nops].w = w;
+    ops[nops].op = op;
+    if (++nops == ARRAY_SIZE(ops)) {
+      uv__epoll_ctl_flush(loop, ops, nops);
+      nops = 0;
+    }
+  }
+
+  uv__epoll_ctl_flush(loop, ops, nops);
+
+  /* 被推迟的watcher放回队列，下一轮再检查 */
+  QUEUE_MOVE(&deferred, &loop->watcher_queue);
+}
+
+
+/* 只提交注册，不等待也不分发事件，见uv_embed_prepare() */
+void uv__io_flush(uv_loop_t* loop) {
+  if (loop->flags & UV_LOOP_IO_URING)
+    uv__iou_flush(loop);
+  else
+    uv__epoll_register(loop);
+}
+
+
+/* 处理io事件轮询 */
+void uv__io_poll(uv_loop_t* loop, int timeout) {
+  /* A bug in kernels < 2.6.37 makes timeouts larger than ~30 minutes
+   * effectively infinite on 32 bits architectures.  To avoid blocking
+   * indefinitely, we cap the timeout and poll again if necessary.
+   *
+   * Note that "30 minutes" is a simplification because it depends on
+   * the value of CONFIG_HZ.  The magic constant assumes CONFIG_HZ=1200,
+   * that being the largest value I have seen in the wild (and only once.)
+   */
+  static const int max_safe_timeout = 1789569;
+  struct epoll_event* events;
+  struct epoll_event* pe;
+  struct epoll_event e;
+  int real_timeout;
+  uv__io_t* w;
+  sigset_t sigset;
+  sigset_t* psigset;
+  uint64_t base;
+  uint64_t spin_deadline;
+  uint64_t idle_start;
+  uint64_t budget_start;
+  unsigned int size;
+  int have_signals;
+  int resumed;
+  int nevents;
+  int spin;
+  int count;
+  int nfds;
+  int fd;
+  int i;
 
-      /* 否则，就是EEXIST错误，表示对一个已经注册的fd执行EPOLL_CTL_ADD操作（一个fd允许被绑定到多个watcher） */
-      assert(op == EPOLL_CTL_ADD);
+  /* 使用io_uring后端 */
+  if (loop->flags & UV_LOOP_IO_URING) {
+    uv__iou_poll(loop, timeout);
+    return;
+  }
 
-      /* 重新用EPOLL_CTL_MOD来注册这个事件 */
-      if (epoll_ctl(loop->backend_fd, EPOLL_CTL_MOD, w->fd, &e)){
-            /* 如果还出错就直接abort */
-            abort();
-      } 
+  if (loop->nfds == 0) {
+    assert(QUEUE_EMPTY(&loop->watcher_queue));
+    /* 留到这一轮的事件对应的fd都已经关闭了 */
+    if (uv__io_has_deferred(loop)) {
+      loop->watchers[loop->nwatchers] = NULL;
+      loop->watchers[loop->nwatchers + 1] = NULL;
     }
-    /* 把该watcher的当前events更新为pevents */
-    w->events = w->pevents;
+    /* 信号管道和异步eventfd都是用到时才创建，只有定时器的loop也要在这里睡到超时 */
+    if (timeout == 0 || timeout == -1)
+      return;
   }
+  uv__epoll_register(loop);
 
   /* 至此watcher队列遍历完毕，所有的watcher对应的事件都已经被注册到epoll上 */
 
@@ -309,23 +694,62 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
   /* 保存超时时间（长度） */
   real_timeout = timeout;
 
+  /* UV_LOOP_SPIN：需要阻塞时，先在spin_budget时间内反复进行非阻塞的epoll_pwait */
+  spin = 0;
+  spin_deadline = 0;
+  if (timeout != 0 && loop->spin_budget != 0) {
+    spin = 1;
+    spin_deadline = uv__hrtime(UV_CLOCK_FAST) + loop->spin_budget;
+  }
+
   for (;;) {
     /* See the comment for max_safe_timeout for an explanation of why
      * this is necessary.  Executive summary: kernel bug workaround.
      */
     if (sizeof(int32_t) == sizeof(long) && timeout >= max_safe_timeout)
       timeout = max_safe_timeout;
+
+    /* 上限被uv_loop_configure(UV_LOOP_MAX_EVENTS)调小了 */
+    if (loop->epoll_events_size > loop->epoll_events_max)
+      uv__epoll_events_resize(loop, loop->epoll_events_max);
+
+    events = loop->epoll_events;
+    size = loop->epoll_events_size;
+
+    /* 上一轮用完UV_LOOP_POLL_BUDGET时留下的事件先分发，这一轮不再取新的事件。
+     * 留下的事件里已经关闭的fd被uv__platform_invalidate_fd()标记过了。
+     */
+    resumed = uv__io_has_deferred(loop);
+    if (resumed) {
+      events = (struct epoll_event*) loop->watchers[loop->nwatchers];
+      nfds = (uintptr_t) loop->watchers[loop->nwatchers + 1];
+      goto dispatch;
+    }
     
-    /* 在epoll fd上查询所有注册的事件,每次最多返回1024个事件，该系统调用最长会被阻塞timeout 
+    /* 在epoll fd上查询所有注册的事件,每次最多返回epoll_events_size个事件，该系统调用最长会被阻塞timeout 
     原型：int epoll_pwait(int epfd, struct epoll_event *events,int maxevents, int timeout, 
           const sigset_t *sigmask);
     细节参见: http://man7.org/linux/man-pages/man2/epoll_wait.2.html */
+    /* 只有会阻塞的时候才统计空闲时间，非阻塞轮询不值得多取两次时间 */
+    idle_start = 0;
+    if (timeout != 0 && !spin)
+      idle_start = uv__hrtime(UV_CLOCK_PRECISE);
+
     nfds = epoll_pwait(loop->backend_fd,
                        events,
-                       ARRAY_SIZE(events),
-                       timeout,
+                       size,
+                       spin ? 0 : timeout,
                        psigset);
 
+    if (idle_start != 0)
+      SAVE_ERRNO(loop->metrics.idle_time +=
+                     uv__hrtime(UV_CLOCK_PRECISE) - idle_start);
+
+    if (nfds != -1) {
+      loop->metrics.poll_count++;
+      loop->metrics.events += nfds;
+    }
+
     /* Update loop->time unconditionally. It's tempting to skip the update when
      * timeout == 0 (i.e. non-blocking poll) but there is no guarantee that the
      * operating system didn't reschedule our process while in the syscall.
@@ -343,6 +767,17 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
 
     /* 0表示没有就绪的fd */
     if (nfds == 0) {
+      /* 忙轮询期间没有事件，预算用完之前继续，超时的计算方式和阻塞时一样 */
+      if (spin && timeout != 0) {
+        if (uv__hrtime(UV_CLOCK_FAST) >= spin_deadline)
+          spin = 0;
+
+        if (timeout == -1)
+          continue;
+
+        goto update_timeout;
+      }
+
       /* 不能是阻塞模式 */
       assert(timeout != -1);
 
@@ -377,6 +812,11 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
 
     /* 能运行到这里，说明一定有就绪的fd事件 */
 
+dispatch:
+    budget_start = 0;
+    if (loop->poll_budget != 0)
+      budget_start = uv__hrtime(UV_CLOCK_PRECISE);
+
     /* 是否有信号 */
     have_signals = 0;
     /* 已处理的事件个数 */
@@ -400,11 +840,9 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
         continue;
 
       assert(fd >= 0);
-      /*  */
-      assert((unsigned) fd < loop->nwatchers);
-      
+
       /* 根据fd取出对应的watcher */
-      w = loop->watchers[fd];
+      w = uv__io_lookup(loop, fd);
       /* 如果该watcher为空指针 */
       if (w == NULL) {
         /* File descriptor that we've stopped watching, disarm it.
@@ -418,6 +856,19 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
         continue;
       }
 
+      /* 推迟修改的watcher上报了它已经不再关注的事件。水平触发下这个事件会一直上报，
+       * 所以这里不能再等了，立即把epoll上的注册改成当前关注的事件。
+       */
+      if ((pe->events & ~(w->pevents | POLLERR | POLLHUP)) != 0 &&
+          w->kevents != w->pevents &&
+          w->pevents != 0) {
+        e.events = w->pevents;
+        e.data.fd = fd;
+        if (epoll_ctl(loop->backend_fd, EPOLL_CTL_MOD, fd, &e) == 0)
+          w->kevents = w->pevents;
+        w->kdeferred = 0;
+      }
+
       /* Give users only events they're interested in. Prevents spurious
        * callbacks when previous callback invocation in this loop has stopped
        * the current watcher. Also, filters out events that users has not
@@ -462,38 +913,72 @@ void uv__io_poll(uv_loop_t* loop, int timeout) {
         if (w == &loop->signal_io_watcher)
           have_signals = 1;/* 如果该watcher是loop->signal_io_watcher，
                              标记有信号要处理，暂时不处理这个信号，等到所有fd处理完循环退出后再处理 */
-        else /* 不是信号的事件直接进行回调处理 */
+        else { /* 不是信号的事件直接进行回调处理 */
+          uv__watchdog_io_enter(loop, w);
           w->cb(loop, w, pe->events);
+          uv__watchdog_leave(loop);
+        }
         
         /* 已处理的事件计数 */
         nevents++;
+
+        /* 时间预算用完，剩下的事件留到下一轮，watchers最后两项指向它们，
+         * 这样期间关闭的fd仍然能被uv__platform_invalidate_fd()标记
+         */
+        if (budget_start != 0 &&
+            i + 1 < nfds &&
+            uv__hrtime(UV_CLOCK_PRECISE) - budget_start >= loop->poll_budget) {
+          loop->watchers[loop->nwatchers] = (void*) (events + i + 1);
+          loop->watchers[loop->nwatchers + 1] =
+              (void*) (uintptr_t) (nfds - i - 1);
+          break;
+        }
       }
     }
 
     /* 有信号要处理,就调用signal_io_watcher回调 */
-    if (have_signals != 0)
+    if (have_signals != 0) {
+      uv__watchdog_io_enter(loop, &loop->signal_io_watcher);
       loop->signal_io_watcher.cb(loop, &loop->signal_io_watcher, POLLIN);
+      uv__watchdog_leave(loop);
+    }
+
+    /* 还有事件留到下一轮，事件数组保持不变 */
+    if (i < nfds)
+      return;
 
     /* 清空，准备下一次轮询 */ 
     loop->watchers[loop->nwatchers] = NULL;
     loop->watchers[loop->nwatchers + 1] = NULL;
 
+    /* 分发的是上一轮留下的事件，和这一轮的负载无关 */
+    if (resumed)
+      return;
+
+    /* 事件数组不再被使用，根据这一批的装载情况调整大小 */
+    if ((unsigned int) nfds == size)
+      uv__epoll_events_resize(loop, size * 2);
+    else if ((unsigned int) nfds >= size / 4)
+      loop->epoll_events_low = 0;
+    else if (++loop->epoll_events_low >= UV__EPOLL_EVENTS_SHRINK)
+      uv__epoll_events_resize(loop, size / 2);
+
     /* 有信号为什么就需要退出？？？ */
     if (have_signals != 0)
       return;  /* Event loop should cycle now so don't poll again. */
 
     /* 已处理的事件不为0 */ 
     if (nevents != 0) {
-      /* 已处理的事件不为0，且本次epoll_pwait返回值nfds正好等于ARRAY_SIZE(events)，说明可能有更多
+      /* 已处理的事件不为0，且本次epoll_pwait返回值nfds正好等于size，说明可能有更多
       的就绪事件等待被处理，因此还需要再次轮询。但是为了避免一次性处理太多事件而导致整个事件循环被阻塞过长
       时间，这里用count来控制 */ 
-      if (nfds == ARRAY_SIZE(events) && --count != 0) {
+      if ((unsigned int) nfds == size && --count != 0) {
         /* 继续下一轮epoll_pwait，但是此次timeout为0，不阻塞，因此轮询会很快 */
         timeout = 0;
         continue;
       }
 
-      /* 如果nfds不等于（其实就是小于）ARRAY_SIZE(events)，那就说明此次轮询就绪的事件就这么多，没没要再
+      /* 如果nfds不等于（其实就是小于）size，那就说明此次轮询就绪的事件就这么多，没没要再
       轮询了，直接返回上层loop大循环 */ 
       return;
     }
@@ -524,11 +1009,198 @@ update_timeout:
 }
 
 
+#if defined(__x86_64__) || defined(__aarch64__)
+/* uv_hrtime_use_tsc()之后直接读CPU的计数器换算成纳秒：
+ *   ns = base_ns + ((tsc - base_tsc) * mult) >> 32
+ * 参数在打开时一次写好，之后只读。
+ */
+static struct {
+  uint64_t base_tsc;
+  uint64_t base_ns;
+  uint64_t mult;
+} uv__tsc;
+static int uv__tsc_enabled;
+
+/* 两个窗口各5ms，换算比例相差超过千分之一就认为计数器不稳定 */
+#define UV__TSC_CALIBRATE_NS (5 * 1000 * 1000)
+#define UV__TSC_MAX_SKEW_NS (50 * 1000)
+
+
+static uint64_t uv__tsc_read(void) {
+#if defined(__x86_64__)
+  uint32_t lo;
+  uint32_t hi;
+
+  /* lfence保证不会在前面的指令完成之前读计数器，和内核的rdtsc_ordered一样 */
+  __asm__ __volatile__ ("lfence; rdtsc" : "=a" (lo), "=d" (hi) :: "memory");
+  return ((uint64_t) hi << 32) | lo;
+#else
+  uint64_t v;
+
+  __asm__ __volatile__ ("isb; mrs %0, cntvct_el0" : "=r" (v) :: "memory");
+  return v;
+#endif
+}
+
+
+static uint64_t uv__tsc_to_ns(uint64_t tsc) {
+  uint64_t delta;
+
+  /* 刚校准完时别的CPU上读到的值可能比base_tsc略小 */
+  delta = tsc - uv__tsc.base_tsc;
+  if ((int64_t) delta < 0)
+    delta = 0;
+
+  return uv__tsc.base_ns +
+         (uint64_t) (((unsigned __int128) delta * uv__tsc.mult) >> 32);
+}
+
+
+/* 计数器必须是恒定频率的，而且内核没有因为不同步把它标记为不可用 */
+static int uv__tsc_supported(void) {
+#if defined(__x86_64__)
+  unsigned int eax;
+  unsigned int ebx;
+  unsigned int ecx;
+  unsigned int edx;
+  char buf[256];
+  size_t n;
+  FILE* fp;
+
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    return 0;
+  if (!(edx & (1u << 8)))  /* invariant TSC */
+    return 0;
+
+  fp = uv__open_file(
+      "/sys/devices/system/clocksource/clocksource0/available_clocksource");
+  if (fp == NULL)
+    return 0;
+  n = fread(buf, 1, sizeof(buf) - 1, fp);
+  fclose(fp);
+  buf[n] = '\0';
+
+  return strstr(buf, "tsc") != NULL;
+#else
+  /* ARMv8的通用定时器总是恒定频率，所有CPU共用 */
+  return 1;
+#endif
+}
+
+
+/* 取一对同时刻的计数器值和CLOCK_MONOTONIC，取最窄的那次读数，减少被抢占的影响 */
+static int uv__tsc_sample(uint64_t* tsc, uint64_t* ns) {
+  struct timespec t;
+  uint64_t before;
+  uint64_t after;
+  uint64_t best;
+  int i;
+
+  best = (uint64_t) -1;
+  for (i = 0; i < 8; i++) {
+    before = uv__tsc_read();
+    if (clock_gettime(CLOCK_MONOTONIC, &t))
+      return UV__ERR(errno);
+    after = uv__tsc_read();
+
+    if (after - before < best) {
+      best = after - before;
+      *tsc = before + (after - before) / 2;
+      *ns = t.tv_sec * (uint64_t) 1e9 + t.tv_nsec;
+    }
+  }
+
+  return 0;
+}
+
+
+static int uv__tsc_calibrate(void) {
+  struct timespec delay;
+  uint64_t tsc[4];
+  uint64_t ns[4];
+  uint64_t rate[2];
+  uint64_t skew;
+  int err;
+  int i;
+
+  delay.tv_sec = 0;
+  delay.tv_nsec = UV__TSC_CALIBRATE_NS;
+
+  for (i = 0; i < 3; i++) {
+    if (i > 0)
+      nanosleep(&delay, NULL);
+    err = uv__tsc_sample(tsc + i, ns + i);
+    if (err)
+      return err;
+  }
+
+  if (tsc[1] <= tsc[0] || tsc[2] <= tsc[1])
+    return UV_ENOTSUP;
+
+  /* 两个窗口里每微秒的计数 */
+  for (i = 0; i < 2; i++)
+    rate[i] = (tsc[i + 1] - tsc[i]) * 1000 / ((ns[i + 1] - ns[i]) / 1000 + 1);
+  if (rate[0] == 0 ||
+      (rate[0] > rate[1] ? rate[0] - rate[1] : rate[1] - rate[0]) >
+          rate[0] / 1000) {
+    return UV_ENOTSUP;
+  }
+
+  uv__tsc.mult = ((ns[2] - ns[0]) << 32) / (tsc[2] - tsc[0]);
+  uv__tsc.base_tsc = tsc[2];
+  uv__tsc.base_ns = ns[2];
+
+  /* 换算出来的时间要和CLOCK_MONOTONIC对得上 */
+  err = uv__tsc_sample(tsc + 3, ns + 3);
+  if (err)
+    return err;
+  skew = uv__tsc_to_ns(tsc[3]);
+  skew = skew > ns[3] ? skew - ns[3] : ns[3] - skew;
+  if (skew > UV__TSC_MAX_SKEW_NS)
+    return UV_ENOTSUP;
+
+  return 0;
+}
+
+
+int uv__hrtime_use_tsc(int enable) {
+  int err;
+
+  if (!enable) {
+    uv__tsc_enabled = 0;
+    return 0;
+  }
+
+  if (uv__tsc_enabled)
+    return 0;
+
+  if (!uv__tsc_supported())
+    return UV_ENOTSUP;
+
+  err = uv__tsc_calibrate();
+  if (err)
+    return err;
+
+  uv__tsc_enabled = 1;
+  return 0;
+}
+#else
+int uv__hrtime_use_tsc(int enable) {
+  return enable ? UV_ENOTSUP : 0;
+}
+#endif
+
+
 uint64_t uv__hrtime(uv_clocktype_t type) {
   static clock_t fast_clock_id = -1;
   struct timespec t;
   clock_t clock_id;
 
+#if defined(__x86_64__) || defined(__aarch64__)
+  if (uv__tsc_enabled)
+    return uv__tsc_to_ns(uv__tsc_read());
+#endif
+
   /* Prefer CLOCK_MONOTONIC_COARSE if available but only when it has
    * millisecond granularity or better.  CLOCK_MONOTONIC_COARSE is
    * serviced entirely from the vDSO, whereas CLOCK_MONOTONIC may
@@ -557,60 +1229,103 @@ uint64_t uv__hrtime(uv_clocktype_t type) {
 }
 
 
-int uv_resident_set_memory(size_t* rss) {
-  char buf[1024];
-  const char* s;
+/* /proc/self/statm一直开着，每次从头pread。/proc/self在open时就解析成了具体
+ * 的pid，fork以后子进程要重新打开，否则读到的是父进程的数据。
+ */
+static uv_once_t statm_once = UV_ONCE_INIT;
+static uv_mutex_t statm_mutex;
+static int statm_fd = -1;
+static pid_t statm_pid;
+
+
+static void statm_init(void) {
+  if (uv_mutex_init(&statm_mutex))
+    abort();
+}
+
+
+static int statm_open(void) {
+  pid_t pid;
+  int fd;
+
+  pid = getpid();
+  fd = ACCESS_ONCE(int, statm_fd);
+  if (fd != -1 && ACCESS_ONCE(pid_t, statm_pid) == pid)
+    return fd;
+
+  uv_once(&statm_once, statm_init);
+  uv_mutex_lock(&statm_mutex);
+
+  if (statm_fd == -1 || statm_pid != pid) {
+    fd = uv__open_cloexec("/proc/self/statm", O_RDONLY);
+    if (fd >= 0) {
+      if (statm_fd != -1)
+        uv__close(statm_fd);
+      statm_pid = pid;
+      ACCESS_ONCE(int, statm_fd) = fd;
+    }
+  }
+
+  fd = statm_fd;
+  if (statm_pid != pid)
+    fd = UV_EIO;
+  uv_mutex_unlock(&statm_mutex);
+
+  return fd;
+}
+
+
+int uv_get_memory_stats(uv_memory_stats_t* stats) {
+  unsigned long val[6];
+  uint64_t pagesize;
+  char buf[256];
+  char* end;
+  char* s;
   ssize_t n;
-  long val;
   int fd;
   int i;
 
-  do
-    fd = open("/proc/self/stat", O_RDONLY);
-  while (fd == -1 && errno == EINTR);
-
-  if (fd == -1)
-    return UV__ERR(errno);
+  fd = statm_open();
+  if (fd < 0)
+    return fd;
 
   do
-    n = read(fd, buf, sizeof(buf) - 1);
+    n = pread(fd, buf, sizeof(buf) - 1, 0);
   while (n == -1 && errno == EINTR);
 
-  uv__close(fd);
   if (n == -1)
     return UV__ERR(errno);
   buf[n] = '\0';
 
-  s = strchr(buf, ' ');
-  if (s == NULL)
-    goto err;
+  /* size resident shared text lib data dt，单位都是页 */
+  s = buf;
+  for (i = 0; i < 6; i++) {
+    val[i] = strtoul(s, &end, 10);
+    if (end == s)
+      return UV_EINVAL;
+    s = end;
+  }
 
-  s += 1;
-  if (*s != '(')
-    goto err;
+  pagesize = getpagesize();
+  stats->vsize = val[0] * pagesize;
+  stats->rss = val[1] * pagesize;
+  stats->shared = val[2] * pagesize;
+  stats->text = val[3] * pagesize;
+  stats->data = val[5] * pagesize;
+  return 0;
+}
 
-  s = strchr(s, ')');
-  if (s == NULL)
-    goto err;
 
-  for (i = 1; i <= 22; i++) {
-    s = strchr(s + 1, ' ');
-    if (s == NULL)
-      goto err;
-  }
+int uv_resident_set_memory(size_t* rss) {
+  uv_memory_stats_t stats;
+  int err;
 
-  errno = 0;
-  val = strtol(s, NULL, 10);
-  if (errno != 0)
-    goto err;
-  if (val < 0)
-    goto err;
+  err = uv_get_memory_stats(&stats);
+  if (err)
+    return err;
 
-  *rss = val * getpagesize();
+  *rss = stats.rss;
   return 0;
-
-err:
-  return UV_EINVAL;
 }
 
 
@@ -639,74 +1354,234 @@ int uv_uptime(double* uptime) {
 }
 
 
-static int uv__cpu_num(FILE* statfile_fp, unsigned int* numcpus) {
+/* uv_cpu_info()和uv_cpu_times()在进程内共用的缓存。/proc/stat一直开着，每次
+ * 从头pread；型号和频率只在CPU个数变化（比如热插拔）时重新读。
+ */
+static uv_once_t cpu_cache_once = UV_ONCE_INIT;
+static uv_mutex_t cpu_cache_mutex;
+static int cpu_stat_fd = -1;
+static char* cpu_stat_buf;
+static size_t cpu_stat_size;
+static uv_cpu_info_t* cpu_static;
+static unsigned int cpu_static_count;
+
+
+static void cpu_cache_init(void) {
+  if (uv_mutex_init(&cpu_cache_mutex))
+    abort();
+}
+
+
+/* 把整个/proc/stat读进cpu_stat_buf，一次读不完就把缓冲区加倍 */
+static int read_stat(void) {
+  ssize_t n;
+  char* buf;
+  int fd;
+
+  if (cpu_stat_fd == -1) {
+    fd = uv__open_cloexec("/proc/stat", O_RDONLY);
+    if (fd < 0)
+      return fd;
+    cpu_stat_fd = fd;
+  }
+
+  if (cpu_stat_buf == NULL) {
+    cpu_stat_buf = uv__malloc(16384);
+    if (cpu_stat_buf == NULL)
+      return UV_ENOMEM;
+    cpu_stat_size = 16384;
+  }
+
+  for (;;) {
+    do
+      n = pread(cpu_stat_fd, cpu_stat_buf, cpu_stat_size - 1, 0);
+    while (n == -1 && errno == EINTR);
+
+    if (n == -1)
+      return UV__ERR(errno);
+
+    if ((size_t) n < cpu_stat_size - 1)
+      break;
+
+    buf = uv__realloc(cpu_stat_buf, cpu_stat_size * 2);
+    if (buf == NULL)
+      return UV_ENOMEM;
+    cpu_stat_buf = buf;
+    cpu_stat_size *= 2;
+  }
+
+  cpu_stat_buf[n] = '\0';
+  return 0;
+}
+
+
+/* 解析cpu_stat_buf里的"cpu<num>"行，最多写max项，*count是实际的CPU个数 */
+static int parse_times(struct uv_cpu_times_s* times,
+                       unsigned int max,
+                       unsigned int* count) {
+  unsigned long clock_ticks;
+  unsigned long val[6];
   unsigned int num;
-  char buf[1024];
+  char* end;
+  char* p;
+  int i;
 
-  if (!fgets(buf, sizeof(buf), statfile_fp))
-    return UV_EIO;
+  clock_ticks = sysconf(_SC_CLK_TCK);
+  assert(clock_ticks != (unsigned long) -1);
+  assert(clock_ticks != 0);
 
+  /* 跳过第一行所有CPU的合计 */
+  p = strchr(cpu_stat_buf, '\n');
   num = 0;
-  while (fgets(buf, sizeof(buf), statfile_fp)) {
-    if (strncmp(buf, "cpu", 3))
-      break;
+
+  while (p != NULL && strncmp(p + 1, "cpu", 3) == 0) {
+    /* 跳过"cpu<num>"，后面是user, nice, system, idle, iowait, irq, softirq,
+     * steal, guest, guest_nice，只需要前四个和irq
+     */
+    p += 4;
+    strtoul(p, &p, 10);
+    for (i = 0; i < 6; i++) {
+      val[i] = strtoul(p, &end, 10);
+      if (end == p)
+        return UV_EIO;
+      p = end;
+    }
+
+    if (num < max) {
+      times[num].user = clock_ticks * val[0];
+      times[num].nice = clock_ticks * val[1];
+      times[num].sys  = clock_ticks * val[2];
+      times[num].idle = clock_ticks * val[3];
+      times[num].irq  = clock_ticks * val[5];
+    }
     num++;
+
+    p = strchr(p, '\n');
   }
 
   if (num == 0)
     return UV_EIO;
 
-  *numcpus = num;
+  *count = num;
+  return 0;
+}
+
+
+/* 重新读所有CPU的型号和频率 */
+static int refresh_models(unsigned int numcpus) {
+  uv_cpu_info_t* ci;
+  int err;
+
+  ci = uv__calloc(numcpus, sizeof(*ci));
+  if (ci == NULL)
+    return UV_ENOMEM;
+
+  err = read_models(numcpus, ci);
+  if (err) {
+    uv_free_cpu_info(ci, numcpus);
+    return err;
+  }
+
+  /* read_models() on x86 also reads the CPU speed from /proc/cpuinfo.
+   * We don't check for errors here. Worst case, the field is left zero.
+   */
+  if (ci[0].speed == 0)
+    read_speeds(numcpus, ci);
+
+  if (cpu_static != NULL)
+    uv_free_cpu_info(cpu_static, cpu_static_count);
+  cpu_static = ci;
+  cpu_static_count = numcpus;
+
+  return 0;
+}
+
+
+int uv_cpu_times(struct uv_cpu_times_s* times, int* count) {
+  unsigned int numcpus;
+  int err;
+
+  if (*count < 0 || (*count > 0 && times == NULL))
+    return UV_EINVAL;
+
+  uv_once(&cpu_cache_once, cpu_cache_init);
+  uv_mutex_lock(&cpu_cache_mutex);
+  err = read_stat();
+  if (err == 0)
+    err = parse_times(times, *count, &numcpus);
+  uv_mutex_unlock(&cpu_cache_mutex);
+
+  if (err)
+    return err;
+
+  if (numcpus > (unsigned int) *count) {
+    *count = numcpus;
+    return UV_ENOBUFS;
+  }
+
+  *count = numcpus;
   return 0;
 }
 
 
 int uv_cpu_info(uv_cpu_info_t** cpu_infos, int* count) {
+  struct uv_cpu_times_s* times;
   unsigned int numcpus;
+  unsigned int i;
   uv_cpu_info_t* ci;
   int err;
-  FILE* statfile_fp;
 
   *cpu_infos = NULL;
   *count = 0;
+  times = NULL;
+  ci = NULL;
 
-  statfile_fp = uv__open_file("/proc/stat");
-  if (statfile_fp == NULL)
-    return UV__ERR(errno);
+  uv_once(&cpu_cache_once, cpu_cache_init);
+  uv_mutex_lock(&cpu_cache_mutex);
 
-  err = uv__cpu_num(statfile_fp, &numcpus);
-  if (err < 0)
+  err = read_stat();
+  if (err == 0)
+    err = parse_times(NULL, 0, &numcpus);
+  if (err)
     goto out;
 
+  if (numcpus != cpu_static_count) {
+    err = refresh_models(numcpus);
+    if (err)
+      goto out;
+  }
+
   err = UV_ENOMEM;
+  times = uv__malloc(numcpus * sizeof(*times));
   ci = uv__calloc(numcpus, sizeof(*ci));
-  if (ci == NULL)
+  if (times == NULL || ci == NULL)
     goto out;
 
-  err = read_models(numcpus, ci);
-  if (err == 0)
-    err = read_times(statfile_fp, numcpus, ci);
-
-  if (err) {
-    uv_free_cpu_info(ci, numcpus);
+  err = parse_times(times, numcpus, &numcpus);
+  if (err)
     goto out;
-  }
 
-  /* read_models() on x86 also reads the CPU speed from /proc/cpuinfo.
-   * We don't check for errors here. Worst case, the field is left zero.
-   */
-  if (ci[0].speed == 0)
-    read_speeds(numcpus, ci);
+  for (i = 0; i < numcpus; i++) {
+    ci[i].model = uv__strdup(cpu_static[i].model);
+    if (ci[i].model == NULL) {
+      err = UV_ENOMEM;
+      goto out;
+    }
+    ci[i].speed = cpu_static[i].speed;
+    ci[i].cpu_times = times[i];
+  }
 
   *cpu_infos = ci;
   *count = numcpus;
+  ci = NULL;
   err = 0;
 
 out:
+  uv_mutex_unlock(&cpu_cache_mutex);
 
-  if (fclose(statfile_fp))
-    if (errno != EINTR && errno != EINPROGRESS)
-      abort();
+  if (ci != NULL)
+    uv_free_cpu_info(ci, numcpus);
+  uv__free(times);
 
   return err;
 }
@@ -818,77 +1693,6 @@ static int read_models(unsigned int numcpus, uv_cpu_info_t* ci) {
 }
 
 
-static int read_times(FILE* statfile_fp,
-                      unsigned int numcpus,
-                      uv_cpu_info_t* ci) {
-  unsigned long clock_ticks;
-  struct uv_cpu_times_s ts;
-  unsigned long user;
-  unsigned long nice;
-  unsigned long sys;
-  unsigned long idle;
-  unsigned long dummy;
-  unsigned long irq;
-  unsigned int num;
-  unsigned int len;
-  char buf[1024];
-
-  clock_ticks = sysconf(_SC_CLK_TCK);
-  assert(clock_ticks != (unsigned long) -1);
-  assert(clock_ticks != 0);
-
-  rewind(statfile_fp);
-
-  if (!fgets(buf, sizeof(buf), statfile_fp))
-    abort();
-
-  num = 0;
-
-  while (fgets(buf, sizeof(buf), statfile_fp)) {
-    if (num >= numcpus)
-      break;
-
-    if (strncmp(buf, "cpu", 3))
-      break;
-
-    /* skip "cpu<num> " marker */
-    {
-      unsigned int n;
-      int r = sscanf(buf, "cpu%u ", &n);
-      assert(r == 1);
-      (void) r;  /* silence build warning */
-      for (len = sizeof("cpu0"); n /= 10; len++);
-    }
-
-    /* Line contains user, nice, system, idle, iowait, irq, softirq, steal,
-     * guest, guest_nice but we're only interested in the first four + irq.
-     *
-     * Don't use %*s to skip fields or %ll to read straight into the uint64_t
-     * fields, they're not allowed in C89 mode.
-     */
-    if (6 != sscanf(buf + len,
-                    "%lu %lu %lu %lu %lu %lu",
-                    &user,
-                    &nice,
-                    &sys,
-                    &idle,
-                    &dummy,
-                    &irq))
-      abort();
-
-    ts.user = clock_ticks * user;
-    ts.nice = clock_ticks * nice;
-    ts.sys  = clock_ticks * sys;
-    ts.idle = clock_ticks * idle;
-    ts.irq  = clock_ticks * irq;
-    ci[num++].cpu_times = ts;
-  }
-  assert(num == numcpus);
-
-  return 0;
-}
-
-
 static unsigned long read_cpufreq(unsigned int cpunum) {
   unsigned long val;
   char buf[1024];
@@ -1039,3 +1843,43 @@ void uv__set_process_title(const char* title) {
   prctl(PR_SET_NAME, title);  /* Only copies first 16 characters. */
 #endif
 }
+
+
+/* 读/sys/devices/system/node/node<N>/cpulist（形如"0-3,8-11"），把NUMA节点
+ * node上的CPU在cpumask里置1
+ */
+int uv__numa_node_cpumask(int node, char* cpumask, size_t mask_size) {
+  char path[64];
+  char buf[1024];
+  unsigned long first;
+  unsigned long last;
+  char* p;
+  FILE* fp;
+
+  if (node < 0)
+    return UV_EINVAL;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+  fp = uv__open_file(path);
+  if (fp == NULL)
+    return UV__ERR(errno);
+
+  p = fgets(buf, sizeof(buf), fp);
+  fclose(fp);
+  if (p == NULL)
+    return UV_EIO;
+
+  memset(cpumask, 0, mask_size);
+  while (*p >= '0' && *p <= '9') {
+    first = strtoul(p, &p, 10);
+    last = first;
+    if (*p == '-')
+      last = strtoul(p + 1, &p, 10);
+    for (; first <= last && first < mask_size; first++)
+      cpumask[first] = 1;
+    if (*p == ',')
+      p++;
+  }
+
+  return 0;
+}
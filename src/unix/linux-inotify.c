@@ -30,11 +30,16 @@
 #include <errno.h>
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 struct watcher_list {
   RB_ENTRY(watcher_list) entry;
   QUEUE watchers;
+  QUEUE cache_entries;  /* 这个目录下被uv__fs_cache缓存的路径 */
+  QUEUE subs;           /* 递归监听时挂在这个目录上的struct uv__fs_event_sub */
   int iterating;
   char* path;
   int wd;
@@ -46,6 +51,85 @@ struct watcher_root {
 };
 #define CAST(p) ((struct watcher_root*)(p))
 
+#define UV__INOTIFY_EVENTS                                                    \
+  (UV__IN_ATTRIB | UV__IN_CREATE | UV__IN_MODIFY | UV__IN_DELETE |            \
+   UV__IN_DELETE_SELF | UV__IN_MOVE_SELF | UV__IN_MOVED_FROM |                \
+   UV__IN_MOVED_TO)
+
+/* UV_FS_EVENT_RECURSIVE时根目录下的每个子目录一项，同一个目录被几个handle
+ * 递归监听时共用一个watcher_list，每个handle各有一项
+ */
+struct uv__fs_event_sub {
+  QUEUE wl_queue;      /* watcher_list->subs */
+  QUEUE handle_queue;  /* handle->subwatches */
+  uv_fs_event_t* handle;
+  struct watcher_list* w;
+  char relpath[1];     /* 相对于handle->path，variable length */
+};
+
+/* uv_fs_event_set_coalesce()：窗口里同一路径的事件合并成一次回调 */
+struct uv__fs_event_pending {
+  RB_ENTRY(uv__fs_event_pending) tree_entry;
+  QUEUE queue;
+  int events;
+  char path[1];  /* variable length */
+};
+
+struct uv__fs_event_pending_root {
+  struct uv__fs_event_pending* rbh_root;
+};
+
+struct uv__fs_event_coalesce {
+  uv_timer_t timer;
+  uv_fs_event_t* handle;
+  unsigned int window;
+  struct uv__fs_event_pending_root tree;
+  QUEUE pending;  /* 按第一次出现的顺序回调 */
+};
+
+/* 最多缓存的路径数，满了以后新的结果不再缓存，等旧的过期 */
+#define UV__FS_CACHE_MAX 65536
+
+/* uv_fs_stat()/uv_fs_realpath()的结果和UV_LOOP_FD_CACHE打开的fd，按
+ * (type, flags, path)放在
+ * loop->fs_cache里，同时挂在父目录的watcher_list上，父目录的inotify事件
+ * 提到这个名字（或者父目录本身被删除、移走）时失效
+ */
+struct uv__fs_cache_entry {
+  RB_ENTRY(uv__fs_cache_entry) tree_entry;
+  QUEUE dir_queue;
+  struct watcher_list* dir;
+  uv_fs_type type;
+  int flags;         /* UV_FS_OPEN的打开标志，其他为0 */
+  int has_stat;      /* UV_FS_OPEN：statbuf是第一次fstat的结果 */
+  uint64_t expires;
+  uv_stat_t statbuf;
+  char* realpath;
+  QUEUE idle_fds;    /* UV_FS_OPEN：关闭后留着的fd */
+  QUEUE busy_fds;    /* UV_FS_OPEN：用户正在用的fd */
+  const char* name;  /* path的最后一个组件 */
+  const char* path;
+};
+
+struct uv__fs_cache_root {
+  struct uv__fs_cache_entry* rbh_root;
+};
+#define CACHE_CAST(p) ((struct uv__fs_cache_root*)(p))
+
+/* UV_LOOP_FD_CACHE打开的一个fd，按fd放在loop->fs_cache_fds里 */
+struct uv__fs_cache_fd {
+  RB_ENTRY(uv__fs_cache_fd) tree_entry;
+  QUEUE queue;        /* 挂在缓存项的idle_fds或者busy_fds上 */
+  struct uv__fs_cache_entry* entry;  /* 缓存项失效以后为NULL */
+  int fd;
+  int busy;
+};
+
+struct uv__fs_cache_fd_root {
+  struct uv__fs_cache_fd* rbh_root;
+};
+#define FD_CAST(p) ((struct uv__fs_cache_fd_root*)(p))
+
 
 static int compare_watchers(const struct watcher_list* a,
                             const struct watcher_list* b) {
@@ -58,6 +142,34 @@ static int compare_watchers(const struct watcher_list* a,
 RB_GENERATE_STATIC(watcher_root, watcher_list, entry, compare_watchers)
 
 
+static int compare_cache_entries(const struct uv__fs_cache_entry* a,
+                                 const struct uv__fs_cache_entry* b) {
+  if (a->type < b->type) return -1;
+  if (a->type > b->type) return 1;
+  if (a->flags < b->flags) return -1;
+  if (a->flags > b->flags) return 1;
+  return strcmp(a->path, b->path);
+}
+
+
+RB_GENERATE_STATIC(uv__fs_cache_root,
+                   uv__fs_cache_entry,
+                   tree_entry,
+                   compare_cache_entries)
+
+
+static int compare_pending(const struct uv__fs_event_pending* a,
+                           const struct uv__fs_event_pending* b) {
+  return strcmp(a->path, b->path);
+}
+
+
+RB_GENERATE_STATIC(uv__fs_event_pending_root,
+                   uv__fs_event_pending,
+                   tree_entry,
+                   compare_pending)
+
+
 static void uv__inotify_read(uv_loop_t* loop,
                              uv__io_t* w,
                              unsigned int revents);
@@ -65,6 +177,37 @@ static void uv__inotify_read(uv_loop_t* loop,
 static void maybe_free_watcher_list(struct watcher_list* w,
                                     uv_loop_t* loop);
 
+static void uv__fs_cache_invalidate(uv_loop_t* loop,
+                                    struct watcher_list* w,
+                                    const char* name);
+
+static struct watcher_list* new_watcher_list(uv_loop_t* loop,
+                                             int wd,
+                                             const char* path);
+
+static void uv__fs_event_emit(uv_fs_event_t* handle,
+                              const char* path,
+                              int events);
+
+static void uv__fs_event_update_tree(uv_fs_event_t* handle,
+                                     const char* relpath,
+                                     uint32_t mask);
+
+static void uv__fs_event_sub_dispatch(struct uv__fs_event_sub* s,
+                                      const struct uv__inotify_event* e,
+                                      int events);
+
+static void uv__fs_event_sub_free(uv_loop_t* loop,
+                                  struct uv__fs_event_sub* s);
+
+static void uv__fs_event_coalesce_drop(struct uv__fs_event_coalesce* c);
+
+static int uv__fs_event_add_subtree(uv_fs_event_t* handle,
+                                    const char* relpath);
+
+static void uv__fs_event_remove_subtree(uv_fs_event_t* handle,
+                                        const char* relpath);
+
 /* 新建inotify fd，http://man7.org/linux/man-pages/man7/inotify.7.html */
 static int new_inotify_fd(void) {
   int err;
@@ -130,6 +273,7 @@ int uv__inotify_fork(uv_loop_t* loop, void* old_watchers) {
   QUEUE queue;
   QUEUE* q;
   uv_fs_event_t* handle;
+  struct uv__fs_event_sub* sub;
   char* tmp_path;
 
   if (old_watchers != NULL) {
@@ -138,6 +282,19 @@ int uv__inotify_fork(uv_loop_t* loop, void* old_watchers) {
      */
     loop->inotify_watchers = old_watchers;
 
+    /* 递归监听的子目录在uv_fs_event_start()里重新扫描。这里先全部摘掉但不
+     * 释放watcher_list，否则下面RB_FOREACH_SAFE记下的下一个节点可能被释放
+     */
+    RB_FOREACH(watcher_list, watcher_root, CAST(&old_watchers)) {
+      while (!QUEUE_EMPTY(&watcher_list->subs)) {
+        q = QUEUE_HEAD(&watcher_list->subs);
+        sub = QUEUE_DATA(q, struct uv__fs_event_sub, wl_queue);
+        QUEUE_REMOVE(&sub->wl_queue);
+        QUEUE_REMOVE(&sub->handle_queue);
+        uv__free(sub);
+      }
+    }
+
     QUEUE_INIT(&tmp_watcher_list.watchers);
     /* Note that the queue we use is shared with the start and stop()
      * functions, making QUEUE_FOREACH unsafe to use. So we use the
@@ -175,7 +332,10 @@ int uv__inotify_fork(uv_loop_t* loop, void* old_watchers) {
         handle = QUEUE_DATA(q, uv_fs_event_t, watchers);
         tmp_path = handle->path;
         handle->path = NULL;
-        err = uv_fs_event_start(handle, handle->cb, tmp_path, 0);
+        err = uv_fs_event_start(handle,
+                                handle->cb,
+                                tmp_path,
+                                handle->event_flags);
         uv__free(tmp_path);
         if (err)
           return err;
@@ -194,7 +354,10 @@ static struct watcher_list* find_watcher(uv_loop_t* loop, int wd) {
 
 static void maybe_free_watcher_list(struct watcher_list* w, uv_loop_t* loop) {
   /* if the watcher_list->watchers is being iterated over, we can't free it. */
-  if ((!w->iterating) && QUEUE_EMPTY(&w->watchers)) {
+  if ((!w->iterating) &&
+      QUEUE_EMPTY(&w->watchers) &&
+      QUEUE_EMPTY(&w->subs) &&
+      QUEUE_EMPTY(&w->cache_entries)) {
     /* No watchers left for this path. Clean up. */
     RB_REMOVE(watcher_root, CAST(&loop->inotify_watchers), w);
     uv__inotify_rm_watch(loop->inotify_fd, w->wd);
@@ -207,6 +370,7 @@ static void uv__inotify_read(uv_loop_t* loop,
                              uv__io_t* dummy,
                              unsigned int events) {
   const struct uv__inotify_event* e;
+  struct uv__fs_event_sub* s;
   struct watcher_list* w;
   uv_fs_event_t* h;
   QUEUE queue;
@@ -243,6 +407,10 @@ static void uv__inotify_read(uv_loop_t* loop,
       if (e->mask & ~(UV__IN_ATTRIB|UV__IN_MODIFY))
         events |= UV_RENAME;
 
+      /* 事件队列溢出时丢了多少事件不知道，缓存全部作废 */
+      if (e->mask & UV__IN_Q_OVERFLOW)
+        uv__fs_cache_clear(loop);
+
        /*  */
       w = find_watcher(loop, e->wd);
       if (w == NULL)
@@ -266,6 +434,16 @@ static void uv__inotify_read(uv_loop_t* loop,
        * not to free watcher_list.
        */
       w->iterating = 1;
+      if (!QUEUE_EMPTY(&w->cache_entries))
+        uv__fs_cache_invalidate(loop, w, e->len ? (const char*) (e + 1) : NULL);
+
+      /* 子目录的watch被内核移除了（目录被删除），递归监听的项也跟着去掉 */
+      if (e->mask & UV__IN_IGNORED)
+        while (!QUEUE_EMPTY(&w->subs))
+          uv__fs_event_sub_free(loop, QUEUE_DATA(QUEUE_HEAD(&w->subs),
+                                                 struct uv__fs_event_sub,
+                                                 wl_queue));
+
       QUEUE_MOVE(&w->watchers, &queue);
       while (!QUEUE_EMPTY(&queue)) {
         q = QUEUE_HEAD(&queue);
@@ -274,7 +452,22 @@ static void uv__inotify_read(uv_loop_t* loop,
         QUEUE_REMOVE(q);
         QUEUE_INSERT_TAIL(&w->watchers, q);
 
-        h->cb(h, path, events, 0);
+        if ((h->event_flags & UV_FS_EVENT_RECURSIVE) && e->len)
+          uv__fs_event_update_tree(h, (const char*) (e + 1), e->mask);
+
+        uv__fs_event_emit(h, path, events);
+      }
+
+      /* 递归监听的子目录，回调的路径相对于handle监听的根目录 */
+      QUEUE_MOVE(&w->subs, &queue);
+      while (!QUEUE_EMPTY(&queue)) {
+        q = QUEUE_HEAD(&queue);
+        s = QUEUE_DATA(q, struct uv__fs_event_sub, wl_queue);
+
+        QUEUE_REMOVE(q);
+        QUEUE_INSERT_TAIL(&w->subs, q);
+
+        uv__fs_event_sub_dispatch(s, e, events);
       }
       /* done iterating, time to (maybe) free empty watcher_list */
       w->iterating = 0;
@@ -286,6 +479,9 @@ static void uv__inotify_read(uv_loop_t* loop,
 
 int uv_fs_event_init(uv_loop_t* loop, uv_fs_event_t* handle) {
   uv__handle_init(loop, (uv_handle_t*)handle, UV_FS_EVENT);
+  handle->event_flags = 0;
+  QUEUE_INIT(&handle->subwatches);
+  handle->coalesce = NULL;
   return 0;
 }
 
@@ -306,14 +502,7 @@ int uv_fs_event_start(uv_fs_event_t* handle,
   if (err)
     return err;
 
-  events = UV__IN_ATTRIB
-         | UV__IN_CREATE
-         | UV__IN_MODIFY
-         | UV__IN_DELETE
-         | UV__IN_DELETE_SELF
-         | UV__IN_MOVE_SELF
-         | UV__IN_MOVED_FROM
-         | UV__IN_MOVED_TO;
+  events = UV__INOTIFY_EVENTS;
 
   wd = uv__inotify_add_watch(handle->loop->inotify_fd, path, events);
   if (wd == -1)
@@ -323,22 +512,26 @@ int uv_fs_event_start(uv_fs_event_t* handle,
   if (w)
     goto no_insert;
 
-  w = uv__malloc(sizeof(*w) + strlen(path) + 1);
+  w = new_watcher_list(handle->loop, wd, path);
   if (w == NULL)
     return UV_ENOMEM;
 
-  w->wd = wd;
-  w->path = strcpy((char*)(w + 1), path);
-  QUEUE_INIT(&w->watchers);
-  w->iterating = 0;
-  RB_INSERT(watcher_root, CAST(&handle->loop->inotify_watchers), w);
-
 no_insert:
   uv__handle_start(handle);
   QUEUE_INSERT_TAIL(&w->watchers, &handle->watchers);
   handle->path = w->path;
   handle->cb = cb;
   handle->wd = wd;
+  handle->event_flags = flags;
+
+  /* 递归监听：给现有的每个子目录加watch，之后新建的在事件里补上 */
+  if (flags & UV_FS_EVENT_RECURSIVE) {
+    err = uv__fs_event_add_subtree(handle, "");
+    if (err) {
+      uv_fs_event_stop(handle);
+      return err;
+    }
+  }
 
   return 0;
 }
@@ -358,12 +551,828 @@ int uv_fs_event_stop(uv_fs_event_t* handle) {
   uv__handle_stop(handle);
   QUEUE_REMOVE(&handle->watchers);
 
+  while (!QUEUE_EMPTY(&handle->subwatches))
+    uv__fs_event_sub_free(handle->loop,
+                          QUEUE_DATA(QUEUE_HEAD(&handle->subwatches),
+                                     struct uv__fs_event_sub,
+                                     handle_queue));
+
   maybe_free_watcher_list(w, handle->loop);
 
+  /* 停止后还在窗口里的事件丢掉 */
+  if (handle->coalesce != NULL)
+    uv__fs_event_coalesce_drop(handle->coalesce);
+
   return 0;
 }
 
 
+static void uv__fs_event_coalesce_close_cb(uv_handle_t* timer) {
+  uv__free(container_of(timer, struct uv__fs_event_coalesce, timer));
+}
+
+
 void uv__fs_event_close(uv_fs_event_t* handle) {
+  struct uv__fs_event_coalesce* c;
+
   uv_fs_event_stop(handle);
+
+  c = handle->coalesce;
+  if (c != NULL) {
+    handle->coalesce = NULL;
+    c->handle = NULL;
+    uv_close((uv_handle_t*) &c->timer, uv__fs_event_coalesce_close_cb);
+  }
+}
+
+
+static void uv__fs_event_coalesce_drop(struct uv__fs_event_coalesce* c) {
+  struct uv__fs_event_pending* p;
+
+  uv_timer_stop(&c->timer);
+  while (!QUEUE_EMPTY(&c->pending)) {
+    p = QUEUE_DATA(QUEUE_HEAD(&c->pending), struct uv__fs_event_pending, queue);
+    QUEUE_REMOVE(&p->queue);
+    RB_REMOVE(uv__fs_event_pending_root, &c->tree, p);
+    uv__free(p);
+  }
+}
+
+
+static void uv__fs_event_coalesce_cb(uv_timer_t* timer) {
+  struct uv__fs_event_coalesce* c;
+  struct uv__fs_event_pending* p;
+
+  c = container_of(timer, struct uv__fs_event_coalesce, timer);
+
+  /* 回调里停掉handle会清空pending，所以每次都从头取 */
+  while (!QUEUE_EMPTY(&c->pending)) {
+    p = QUEUE_DATA(QUEUE_HEAD(&c->pending), struct uv__fs_event_pending, queue);
+    QUEUE_REMOVE(&p->queue);
+    RB_REMOVE(uv__fs_event_pending_root, &c->tree, p);
+    c->handle->cb(c->handle, p->path, p->events, 0);
+    uv__free(p);
+  }
+}
+
+
+int uv_fs_event_set_coalesce(uv_fs_event_t* handle, unsigned int window) {
+  struct uv__fs_event_coalesce* c;
+  int err;
+
+  c = handle->coalesce;
+  if (c == NULL) {
+    if (window == 0)
+      return 0;
+
+    c = uv__malloc(sizeof(*c));
+    if (c == NULL)
+      return UV_ENOMEM;
+
+    err = uv_timer_init(handle->loop, &c->timer);
+    if (err) {
+      uv__free(c);
+      return err;
+    }
+
+    c->timer.flags |= UV_HANDLE_INTERNAL;
+    uv__handle_unref(&c->timer);
+    c->handle = handle;
+    RB_INIT(&c->tree);
+    QUEUE_INIT(&c->pending);
+    handle->coalesce = c;
+  }
+
+  c->window = window;
+  return 0;
+}
+
+
+static void uv__fs_event_emit(uv_fs_event_t* handle,
+                              const char* path,
+                              int events) {
+  struct uv__fs_event_coalesce* c;
+  struct uv__fs_event_pending* p;
+  struct uv__fs_event_pending* key;
+  size_t len;
+
+  uv__handle_activity(handle);
+  c = handle->coalesce;
+  if (c == NULL || c->window == 0) {
+    handle->cb(handle, path, events, 0);
+    return;
+  }
+
+  /* 查找用的key和新节点共用一次分配，已经有了就释放掉 */
+  len = strlen(path);
+  key = uv__malloc(sizeof(*key) + len);
+  if (key == NULL) {
+    handle->cb(handle, path, events, 0);
+    return;
+  }
+  memcpy(key->path, path, len + 1);
+
+  p = RB_INSERT(uv__fs_event_pending_root, &c->tree, key);
+  if (p != NULL) {
+    p->events |= events;
+    uv__free(key);
+    return;
+  }
+
+  key->events = events;
+  QUEUE_INSERT_TAIL(&c->pending, &key->queue);
+
+  if (!uv__is_active(&c->timer))
+    if (uv_timer_start(&c->timer, uv__fs_event_coalesce_cb, c->window, 0))
+      abort();
+}
+
+
+/* handle->path和relpath拼成完整路径，relpath为空时就是handle->path */
+static char* uv__fs_event_join(const char* dir, const char* name) {
+  size_t dirlen;
+  size_t namelen;
+  char* path;
+
+  dirlen = strlen(dir);
+  namelen = strlen(name);
+  path = uv__malloc(dirlen + namelen + 2);
+  if (path == NULL)
+    return NULL;
+
+  memcpy(path, dir, dirlen);
+  if (dirlen != 0 && namelen != 0)
+    path[dirlen++] = '/';
+  memcpy(path + dirlen, name, namelen + 1);
+
+  return path;
+}
+
+
+static void uv__fs_event_sub_free(uv_loop_t* loop,
+                                  struct uv__fs_event_sub* s) {
+  QUEUE_REMOVE(&s->wl_queue);
+  QUEUE_REMOVE(&s->handle_queue);
+  maybe_free_watcher_list(s->w, loop);
+  uv__free(s);
+}
+
+
+static int uv__fs_event_add_subtree(uv_fs_event_t* handle,
+                                    const char* relpath) {
+  struct uv__fs_event_sub* s;
+  struct watcher_list* w;
+  struct dirent* dent;
+  struct stat st;
+  char* child;
+  char* path;
+  DIR* dir;
+  QUEUE* q;
+  size_t len;
+  int err;
+  int wd;
+
+  path = uv__fs_event_join(handle->path, relpath);
+  if (path == NULL)
+    return UV_ENOMEM;
+
+  /* 根目录在uv_fs_event_start()里已经加过watch了 */
+  if (relpath[0] != '\0') {
+    wd = uv__inotify_add_watch(handle->loop->inotify_fd,
+                               path,
+                               UV__INOTIFY_EVENTS |
+                               UV__IN_ONLYDIR |
+                               UV__IN_DONT_FOLLOW);
+    if (wd == -1) {
+      err = UV__ERR(errno);
+      goto skip;
+    }
+
+    w = find_watcher(handle->loop, wd);
+    if (w == NULL) {
+      w = new_watcher_list(handle->loop, wd, path);
+      if (w == NULL) {
+        uv__inotify_rm_watch(handle->loop->inotify_fd, wd);
+        err = UV_ENOMEM;
+        goto out;
+      }
+    }
+
+    /* 目录刚建好时扫描和IN_CREATE事件可能重复报告同一个目录 */
+    QUEUE_FOREACH(q, &w->subs) {
+      s = QUEUE_DATA(q, struct uv__fs_event_sub, wl_queue);
+      if (s->handle == handle) {
+        err = 0;
+        goto out;
+      }
+    }
+
+    len = strlen(relpath);
+    s = uv__malloc(sizeof(*s) + len);
+    if (s == NULL) {
+      maybe_free_watcher_list(w, handle->loop);
+      err = UV_ENOMEM;
+      goto out;
+    }
+
+    s->handle = handle;
+    s->w = w;
+    memcpy(s->relpath, relpath, len + 1);
+    QUEUE_INSERT_TAIL(&w->subs, &s->wl_queue);
+    QUEUE_INSERT_TAIL(&handle->subwatches, &s->handle_queue);
+  }
+
+  dir = opendir(path);
+  if (dir == NULL) {
+    err = UV__ERR(errno);
+    goto skip;
+  }
+
+  err = 0;
+  while (err == 0 && (dent = readdir(dir)) != NULL) {
+    if (strcmp(dent->d_name, ".") == 0 || strcmp(dent->d_name, "..") == 0)
+      continue;
+
+    child = uv__fs_event_join(relpath, dent->d_name);
+    if (child == NULL) {
+      err = UV_ENOMEM;
+      break;
+    }
+
+    if (dent->d_type == DT_DIR) {
+      err = uv__fs_event_add_subtree(handle, child);
+    } else if (dent->d_type == DT_UNKNOWN) {
+      /* 有的文件系统不填d_type，用lstat()判断，符号链接不跟进去 */
+      uv__free(path);
+      path = uv__fs_event_join(handle->path, child);
+      if (path == NULL)
+        err = UV_ENOMEM;
+      else if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode))
+        err = uv__fs_event_add_subtree(handle, child);
+    }
+
+    uv__free(child);
+  }
+
+  closedir(dir);
+  goto out;
+
+skip:
+  /* 扫描过程中目录被删掉、没有权限或者不是目录都不算错误 */
+  if (err == UV_ENOENT ||
+      err == UV_EACCES ||
+      err == UV_ENOTDIR ||
+      err == UV_ELOOP) {
+    err = 0;
+  }
+
+out:
+  uv__free(path);
+  return err;
+}
+
+
+/* relpath这个目录和它下面的子目录都不再属于这个handle的监听树 */
+static void uv__fs_event_remove_subtree(uv_fs_event_t* handle,
+                                        const char* relpath) {
+  struct uv__fs_event_sub* s;
+  QUEUE* q;
+  QUEUE* next;
+  size_t len;
+
+  len = strlen(relpath);
+  q = QUEUE_NEXT(&handle->subwatches);
+  while (q != &handle->subwatches) {
+    next = QUEUE_NEXT(q);
+    s = QUEUE_DATA(q, struct uv__fs_event_sub, handle_queue);
+    if (strncmp(s->relpath, relpath, len) == 0 &&
+        (s->relpath[len] == '\0' || s->relpath[len] == '/')) {
+      uv__fs_event_sub_free(handle->loop, s);
+    }
+    q = next;
+  }
+}
+
+
+/* 目录的创建、删除和移进移出要同步更新监听树 */
+static void uv__fs_event_update_tree(uv_fs_event_t* handle,
+                                     const char* relpath,
+                                     uint32_t mask) {
+  if (!(mask & UV__IN_ISDIR))
+    return;
+
+  if (mask & (UV__IN_DELETE | UV__IN_MOVED_FROM))
+    uv__fs_event_remove_subtree(handle, relpath);
+
+  /* 失败时只是少了这部分子目录的事件，不影响已经监听的部分 */
+  if (mask & (UV__IN_CREATE | UV__IN_MOVED_TO))
+    uv__fs_event_add_subtree(handle, relpath);
+}
+
+
+static void uv__fs_event_sub_dispatch(struct uv__fs_event_sub* s,
+                                      const struct uv__inotify_event* e,
+                                      int events) {
+  uv_fs_event_t* handle;
+  char* path;
+
+  handle = s->handle;
+  path = uv__fs_event_join(s->relpath, e->len ? (const char*) (e + 1) : "");
+  if (path == NULL)
+    return;
+
+  /* 更新监听树可能释放s，之后只用handle和path */
+  if (e->len)
+    uv__fs_event_update_tree(handle, path, e->mask);
+
+  uv__fs_event_emit(handle, path, events);
+  uv__free(path);
+}
+
+
+static struct watcher_list* new_watcher_list(uv_loop_t* loop,
+                                             int wd,
+                                             const char* path) {
+  struct watcher_list* w;
+
+  w = uv__malloc(sizeof(*w) + strlen(path) + 1);
+  if (w == NULL)
+    return NULL;
+
+  w->wd = wd;
+  w->path = strcpy((char*)(w + 1), path);
+  QUEUE_INIT(&w->watchers);
+  QUEUE_INIT(&w->cache_entries);
+  QUEUE_INIT(&w->subs);
+  w->iterating = 0;
+  RB_INSERT(watcher_root, CAST(&loop->inotify_watchers), w);
+
+  return w;
+}
+
+
+static int compare_cache_fds(const struct uv__fs_cache_fd* a,
+                             const struct uv__fs_cache_fd* b) {
+  if (a->fd < b->fd) return -1;
+  if (a->fd > b->fd) return 1;
+  return 0;
+}
+
+
+RB_GENERATE_STATIC(uv__fs_cache_fd_root,
+                   uv__fs_cache_fd,
+                   tree_entry,
+                   compare_cache_fds)
+
+
+static struct uv__fs_cache_fd* uv__fs_cache_fd_find(uv_loop_t* loop, int fd) {
+  struct uv__fs_cache_fd key;
+
+  key.fd = fd;
+  return RB_FIND(uv__fs_cache_fd_root, FD_CAST(&loop->fs_cache_fds), &key);
+}
+
+
+static void uv__fs_cache_fd_free(uv_loop_t* loop, struct uv__fs_cache_fd* f) {
+  RB_REMOVE(uv__fs_cache_fd_root, FD_CAST(&loop->fs_cache_fds), f);
+  loop->fs_cache_nfds--;
+  uv__free(f);
+}
+
+
+/* 只读、不创建不截断的打开才缓存 */
+static int uv__fs_cache_fd_cacheable(int flags) {
+  return (flags & O_ACCMODE) == O_RDONLY &&
+         (flags & (O_CREAT | O_TRUNC | O_EXCL)) == 0;
+}
+
+
+/* 只从树和目录队列里摘掉，watcher_list由调用者决定要不要释放。空闲的fd马上
+ * 关掉，用户手里的fd和缓存项脱钩，uv_fs_close()时真正关闭
+ */
+static void uv__fs_cache_remove(uv_loop_t* loop, struct uv__fs_cache_entry* e) {
+  struct uv__fs_cache_fd* f;
+  QUEUE* q;
+
+  while (!QUEUE_EMPTY(&e->idle_fds)) {
+    q = QUEUE_HEAD(&e->idle_fds);
+    QUEUE_REMOVE(q);
+    f = QUEUE_DATA(q, struct uv__fs_cache_fd, queue);
+    uv__close(f->fd);
+    uv__fs_cache_fd_free(loop, f);
+  }
+
+  while (!QUEUE_EMPTY(&e->busy_fds)) {
+    q = QUEUE_HEAD(&e->busy_fds);
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);
+    QUEUE_DATA(q, struct uv__fs_cache_fd, queue)->entry = NULL;
+  }
+
+  RB_REMOVE(uv__fs_cache_root, CACHE_CAST(&loop->fs_cache), e);
+  QUEUE_REMOVE(&e->dir_queue);
+  loop->fs_cache_count--;
+  uv__free(e->realpath);
+  uv__free(e);
+}
+
+
+/* name为NULL时（目录本身被删除、移走，或者watch失效）整个目录的缓存都失效 */
+static void uv__fs_cache_invalidate(uv_loop_t* loop,
+                                    struct watcher_list* w,
+                                    const char* name) {
+  struct uv__fs_cache_entry* e;
+  QUEUE* q;
+  QUEUE* next;
+
+  q = QUEUE_NEXT(&w->cache_entries);
+  while (q != &w->cache_entries) {
+    next = QUEUE_NEXT(q);
+    e = QUEUE_DATA(q, struct uv__fs_cache_entry, dir_queue);
+    if (name == NULL || strcmp(e->name, name) == 0)
+      uv__fs_cache_remove(loop, e);
+    q = next;
+  }
+}
+
+
+void uv__fs_cache_clear(uv_loop_t* loop) {
+  struct uv__fs_cache_entry* e;
+  struct watcher_list* w;
+
+  while ((e = RB_MIN(uv__fs_cache_root, CACHE_CAST(&loop->fs_cache))) != NULL) {
+    w = e->dir;
+    uv__fs_cache_remove(loop, e);
+    maybe_free_watcher_list(w, loop);
+  }
+}
+
+
+/* 清空缓存，用户手里还没关的fd也不再记着，之后uv_fs_close()照常关闭 */
+void uv__fs_cache_delete(uv_loop_t* loop) {
+  struct uv__fs_cache_fd* f;
+
+  uv__fs_cache_clear(loop);
+  while ((f = RB_MIN(uv__fs_cache_fd_root,
+                     FD_CAST(&loop->fs_cache_fds))) != NULL) {
+    uv__fs_cache_fd_free(loop, f);
+  }
+}
+
+
+/* 只去掉一种缓存：open为1时是打开的fd，否则是stat/realpath的结果 */
+static void uv__fs_cache_drop(uv_loop_t* loop, int open) {
+  struct uv__fs_cache_entry* e;
+  struct uv__fs_cache_entry* next;
+  struct watcher_list* w;
+
+  for (e = RB_MIN(uv__fs_cache_root, CACHE_CAST(&loop->fs_cache));
+       e != NULL;
+       e = next) {
+    next = RB_NEXT(uv__fs_cache_root, CACHE_CAST(&loop->fs_cache), e);
+    if ((e->type == UV_FS_OPEN) != open)
+      continue;
+    w = e->dir;
+    uv__fs_cache_remove(loop, e);
+    maybe_free_watcher_list(w, loop);
+  }
+}
+
+
+int uv__fs_cache_configure(uv_loop_t* loop, int ttl) {
+  int err;
+
+  if (ttl < 0)
+    return UV_EINVAL;
+
+  if (ttl == 0) {
+    uv__fs_cache_drop(loop, 0);
+    loop->fs_cache_ttl = 0;
+    return 0;
+  }
+
+  err = init_inotify(loop);
+  if (err)
+    return err;
+
+  loop->fs_cache_ttl = ttl;
+  return 0;
+}
+
+
+int uv__fs_fd_cache_configure(uv_loop_t* loop, int max_fds) {
+  int err;
+
+  if (max_fds < 0)
+    return UV_EINVAL;
+
+  if (max_fds == 0) {
+    uv__fs_cache_drop(loop, 1);
+    loop->fs_cache_max_fds = 0;
+    return 0;
+  }
+
+  err = init_inotify(loop);
+  if (err)
+    return err;
+
+  loop->fs_cache_max_fds = max_fds;
+  return 0;
+}
+
+
+/* 打开：取一个空闲的fd；fstat：这个fd第一次fstat的结果 */
+static int uv__fs_fd_cache_lookup(uv_loop_t* loop, uv_fs_t* req) {
+  struct uv__fs_cache_entry* e;
+  struct uv__fs_cache_entry key;
+  struct uv__fs_cache_fd* f;
+  QUEUE* q;
+
+  if (loop->fs_cache_max_fds == 0)
+    return 0;
+
+  if (req->fs_type == UV_FS_FSTAT) {
+    f = uv__fs_cache_fd_find(loop, req->file);
+    if (f == NULL || f->entry == NULL || !f->entry->has_stat)
+      return 0;
+
+    req->statbuf = f->entry->statbuf;
+    req->ptr = &req->statbuf;
+    req->result = 0;
+    return 1;
+  }
+
+  if (req->path[0] != '/' || !uv__fs_cache_fd_cacheable(req->flags))
+    return 0;
+
+  key.type = UV_FS_OPEN;
+  key.flags = req->flags;
+  key.path = req->path;
+  e = RB_FIND(uv__fs_cache_root, CACHE_CAST(&loop->fs_cache), &key);
+  if (e == NULL || QUEUE_EMPTY(&e->idle_fds))
+    return 0;
+
+  q = QUEUE_HEAD(&e->idle_fds);
+  QUEUE_REMOVE(q);
+  QUEUE_INSERT_TAIL(&e->busy_fds, q);
+  f = QUEUE_DATA(q, struct uv__fs_cache_fd, queue);
+  f->busy = 1;
+  req->result = f->fd;
+  return 1;
+}
+
+
+/* 命中时把结果填到req里返回1，没有或者已经过期返回0 */
+int uv__fs_cache_lookup(uv_loop_t* loop, uv_fs_t* req) {
+  struct uv__fs_cache_entry* e;
+  struct uv__fs_cache_entry key;
+  struct watcher_list* w;
+  char* realpath;
+
+  if (req->fs_type == UV_FS_OPEN || req->fs_type == UV_FS_FSTAT)
+    return uv__fs_fd_cache_lookup(loop, req);
+
+  if (loop->fs_cache_ttl == 0 || req->path[0] != '/')
+    return 0;
+
+  key.type = req->fs_type;
+  key.flags = 0;
+  key.path = req->path;
+  e = RB_FIND(uv__fs_cache_root, CACHE_CAST(&loop->fs_cache), &key);
+  if (e == NULL)
+    return 0;
+
+  if (loop->time >= e->expires) {
+    w = e->dir;
+    uv__fs_cache_remove(loop, e);
+    maybe_free_watcher_list(w, loop);
+    return 0;
+  }
+
+  if (req->fs_type == UV_FS_REALPATH) {
+    realpath = uv__strdup(e->realpath);
+    if (realpath == NULL)
+      return 0;
+    req->ptr = realpath;
+  } else {
+    req->statbuf = e->statbuf;
+    req->ptr = &req->statbuf;
+  }
+
+  req->result = 0;
+  return 1;
+}
+
+
+/* 缓存着的fd关闭时放回空闲队列，文件偏移回到开头，返回1表示不用真的关闭。
+ * 缓存项已经失效的fd从表里去掉，返回0
+ */
+int uv__fs_cache_release(uv_loop_t* loop, int fd) {
+  struct uv__fs_cache_entry* e;
+  struct uv__fs_cache_fd* f;
+
+  if (loop->fs_cache_nfds == 0)
+    return 0;
+
+  f = uv__fs_cache_fd_find(loop, fd);
+  if (f == NULL)
+    return 0;
+
+  e = f->entry;
+  if (e == NULL || !f->busy || lseek(fd, 0, SEEK_SET) == -1) {
+    QUEUE_REMOVE(&f->queue);
+    uv__fs_cache_fd_free(loop, f);
+    return 0;
+  }
+
+  QUEUE_REMOVE(&f->queue);
+  QUEUE_INSERT_TAIL(&e->idle_fds, &f->queue);
+  f->busy = 0;
+  return 1;
+}
+
+
+/* 新建一个缓存项，挂到父目录的inotify watch上 */
+static struct uv__fs_cache_entry* uv__fs_cache_entry_new(uv_fs_t* req) {
+  struct uv__fs_cache_entry* e;
+  struct watcher_list* w;
+  uv_loop_t* loop;
+  const char* name;
+  char* dir;
+  size_t dirlen;
+  size_t len;
+  int wd;
+
+  loop = req->loop;
+  if (req->path[0] != '/' || loop->fs_cache_count >= UV__FS_CACHE_MAX)
+    return NULL;
+
+  /* 最后一个组件是空的、"."或者".."时变化不会出现在父目录的事件里 */
+  name = strrchr(req->path, '/') + 1;
+  if (name[0] == '\0' ||
+      strcmp(name, ".") == 0 ||
+      strcmp(name, "..") == 0) {
+    return NULL;
+  }
+
+  if (init_inotify(loop))
+    return NULL;
+
+  len = strlen(req->path);
+  e = uv__malloc(sizeof(*e) + len + 1);
+  if (e == NULL)
+    return NULL;
+
+  memcpy(e + 1, req->path, len + 1);
+  e->path = (const char*) (e + 1);
+  e->name = e->path + (name - req->path);
+
+  /* 父目录；"/foo"的父目录是"/" */
+  dirlen = name - req->path - 1;
+  if (dirlen == 0)
+    dirlen = 1;
+
+  dir = uv__malloc(dirlen + 1);
+  if (dir == NULL)
+    goto fail;
+
+  memcpy(dir, req->path, dirlen);
+  dir[dirlen] = '\0';
+
+  wd = uv__inotify_add_watch(loop->inotify_fd, dir, UV__INOTIFY_EVENTS);
+  if (wd == -1)
+    goto fail;
+
+  w = find_watcher(loop, wd);
+  if (w == NULL) {
+    w = new_watcher_list(loop, wd, dir);
+    if (w == NULL) {
+      uv__inotify_rm_watch(loop->inotify_fd, wd);
+      goto fail;
+    }
+  }
+
+  uv__free(dir);
+
+  e->type = req->fs_type;
+  e->flags = req->fs_type == UV_FS_OPEN ? req->flags : 0;
+  e->has_stat = 0;
+  e->realpath = NULL;
+  QUEUE_INIT(&e->idle_fds);
+  QUEUE_INIT(&e->busy_fds);
+  /* 打开的fd不过期，只靠inotify失效 */
+  if (req->fs_type == UV_FS_OPEN)
+    e->expires = (uint64_t) -1;
+  else
+    e->expires = loop->time + loop->fs_cache_ttl;
+  e->dir = w;
+  QUEUE_INSERT_TAIL(&w->cache_entries, &e->dir_queue);
+  RB_INSERT(uv__fs_cache_root, CACHE_CAST(&loop->fs_cache), e);
+  loop->fs_cache_count++;
+  return e;
+
+fail:
+  uv__free(dir);
+  uv__free(e);
+  return NULL;
+}
+
+
+/* 异步打开成功的fd记到缓存项上，第一次fstat的结果也记下来 */
+static void uv__fs_fd_cache_store(uv_fs_t* req) {
+  struct uv__fs_cache_entry* e;
+  struct uv__fs_cache_entry key;
+  struct uv__fs_cache_fd* f;
+  uv_loop_t* loop;
+  int fd;
+
+  loop = req->loop;
+  if (loop->fs_cache_max_fds == 0 || req->result < 0)
+    return;
+
+  if (req->fs_type == UV_FS_FSTAT) {
+    f = uv__fs_cache_fd_find(loop, req->file);
+    if (f != NULL && f->entry != NULL && !f->entry->has_stat) {
+      f->entry->statbuf = req->statbuf;
+      f->entry->has_stat = 1;
+    }
+    return;
+  }
+
+  /* 命中缓存的请求也走这里 */
+  fd = req->result;
+  if (uv__fs_cache_fd_find(loop, fd) != NULL)
+    return;
+
+  if (req->path == NULL ||
+      !uv__fs_cache_fd_cacheable(req->flags) ||
+      loop->fs_cache_nfds >= (unsigned int) loop->fs_cache_max_fds) {
+    return;
+  }
+
+  f = uv__malloc(sizeof(*f));
+  if (f == NULL)
+    return;
+
+  key.type = UV_FS_OPEN;
+  key.flags = req->flags;
+  key.path = req->path;
+  e = RB_FIND(uv__fs_cache_root, CACHE_CAST(&loop->fs_cache), &key);
+  if (e == NULL)
+    e = uv__fs_cache_entry_new(req);
+  if (e == NULL) {
+    uv__free(f);
+    return;
+  }
+
+  f->entry = e;
+  f->fd = fd;
+  f->busy = 1;
+  QUEUE_INSERT_TAIL(&e->busy_fds, &f->queue);
+  RB_INSERT(uv__fs_cache_fd_root, FD_CAST(&loop->fs_cache_fds), f);
+  loop->fs_cache_nfds++;
+}
+
+
+/* 成功的uv_fs_stat()/uv_fs_realpath()结果放进缓存。已经有的不覆盖，这样
+ * 命中不会延长缓存时间。只缓存绝对路径，靠父目录上的inotify watch失效
+ */
+void uv__fs_cache_store(uv_fs_t* req) {
+  struct uv__fs_cache_entry* e;
+  struct uv__fs_cache_entry key;
+  struct watcher_list* w;
+  uv_loop_t* loop;
+
+  if (req->fs_type == UV_FS_OPEN || req->fs_type == UV_FS_FSTAT) {
+    uv__fs_fd_cache_store(req);
+    return;
+  }
+
+  loop = req->loop;
+  if (loop->fs_cache_ttl == 0 || req->result < 0 || req->path == NULL)
+    return;
+
+  if (req->fs_type != UV_FS_STAT && req->fs_type != UV_FS_REALPATH)
+    return;
+
+  key.type = req->fs_type;
+  key.flags = 0;
+  key.path = req->path;
+  if (RB_FIND(uv__fs_cache_root, CACHE_CAST(&loop->fs_cache), &key) != NULL)
+    return;
+
+  e = uv__fs_cache_entry_new(req);
+  if (e == NULL)
+    return;
+
+  if (req->fs_type == UV_FS_REALPATH) {
+    e->realpath = uv__strdup(req->ptr);
+    if (e->realpath == NULL) {
+      w = e->dir;
+      uv__fs_cache_remove(loop, e);
+      maybe_free_watcher_list(w, loop);
+    }
+  } else {
+    e->statbuf = req->statbuf;
+  }
 }
@@ -0,0 +1,1581 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* 基于io_uring的uv__io_poll后端。
+ *
+ * 每个watcher对应一个one-shot的IORING_OP_POLL_ADD请求，请求完成后在下一次
+ * 轮询前重新提交，语义上等价于epoll的水平触发。所有的注册、注销请求都先放
+ * 在提交队列（SQ）中，在等待事件时通过一次io_uring_enter统一提交，从而取代
+ * 原先逐个watcher调用epoll_ctl的做法。
+ *
+ * epoll fd依然保留：uv__io_check_fd()需要它，并且ring fd被注册到了epoll上，
+ * 这样嵌入模式下uv_backend_fd()仍然能在有完成事件时变为可读。
+ *
+ * 开启了io_uring的loop上，带回调的read、write、fsync、fdatasync、open、
+ * close和stat类请求也直接提交到同一个ring上，完成事件在轮询时一并处理，
+ * 不再经过线程池。
+ *
+ * uv_read_start_ring()的流用multishot的IORING_OP_RECV读：UV_LOOP_RECV_RING的
+ * 缓冲区登记成缓冲区环，内核收到数据时自己挑一个放进去，完成事件里带着
+ * 缓冲区的id，read_cb返回以后再还给环。和poll请求一样，mshot[fd]记着挂在fd上
+ * 的请求的id，撤销或者被替换掉的请求后来的完成事件都会被丢弃（缓冲区照样
+ * 归还）。fork之后的子进程里这些请求都没有了，要重新开始读。
+ *
+ * 监听的watcher不挂poll请求，而是挂一个multishot的IORING_OP_ACCEPT（5.19），
+ * 每来一个连接产生一个带着新fd的完成事件，不用再调用accept()。watcher停掉以后
+ * 请求在下一个完成事件时才撤销，这期间接受的连接排在服务端的队列里，不会丢。
+ * 新fd是普通的文件描述符：流的其他操作还要用系统调用，用不了直接描述符。
+ *
+ * uv_fs_register_buffers()和uv_fs_register_files()把缓冲区和fd登记给ring
+ * （IORING_REGISTER_BUFFERS/FILES），页面只在登记时锁定一次。uv_fs_read_fixed()
+ * 和uv_fs_write_fixed()的请求用READ_FIXED/WRITE_FIXED，落在登记过的fd上的读写
+ * 和fsync带着IOSQE_FIXED_FILE，内核不用每次都查fd表。fork之后要重新登记。
+ */
+
+#include "uv.h"
+#include "internal.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/epoll.h>
+#include <sys/mman.h>
+
+/* 提交队列和完成队列的大小，完成队列开大一些以减少溢出 */
+#define UV__IOU_SQ_ENTRIES 256
+#define UV__IOU_CQ_ENTRIES 4096
+
+/* epoll后端成批提交epoll_ctl用的ring，每批最多UV__EPOLL_CTL_BATCH_MAX个，
+ * 提交以后等全部完成才返回，完成队列不会溢出
+ */
+#define UV__IOU_CTL_SQ_ENTRIES UV__EPOLL_CTL_BATCH_MAX
+#define UV__IOU_CTL_CQ_ENTRIES (2 * UV__EPOLL_CTL_BATCH_MAX)
+
+/* user_data的低3位用来区分完成事件的种类 */
+#define UV__IOU_TAG_MASK    7
+#define UV__IOU_TAG_IGNORE  0
+#define UV__IOU_TAG_POLL    1
+#define UV__IOU_TAG_FS      2
+#define UV__IOU_TAG_RECV    3
+#define UV__IOU_TAG_ACCEPT  4
+
+/* UV_LOOP_RECV_RING的缓冲区环的组号，每个ring只有一个 */
+#define UV__IOU_BGID 0
+
+#define uv__iou_load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define uv__iou_store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+struct uv__iou {
+  uint32_t* sqhead;
+  uint32_t* sqtail;
+  uint32_t* sqflags;
+  uint32_t* sqarray;
+  uint32_t sqmask;
+  uint32_t sqentries;
+  struct uv__io_uring_sqe* sqes;
+  uint32_t* cqhead;
+  uint32_t* cqtail;
+  uint32_t cqmask;
+  struct uv__io_uring_cqe* cqes;
+  void* ring;
+  size_t ringlen;
+  size_t sqelen;
+  int ringfd;
+  /* armed[fd]为当前挂在该fd上的poll请求的id，0表示没有 */
+  uint32_t* armed;
+  unsigned int narmed;
+  uint32_t poll_id;
+  uint32_t features;
+  /* 提交了还没有完成的文件系统请求数 */
+  unsigned int nfsreqs;
+  /* 登记给内核的缓冲区环，NULL表示还没有登记；bufring_failed表示内核不支持，
+   * 不再尝试
+   */
+  struct uv__io_uring_buf* bufring;
+  size_t bufringlen;
+  uint16_t buftail;
+  int bufring_failed;
+  int recv_failed;
+  int accept_failed;
+  /* mshot[fd]是挂在fd上的multishot recv或者accept，nmshot是挂着的个数 */
+  struct uv__iou_mshot* mshot;
+  unsigned int nmshotslots;
+  unsigned int nmshot;
+  uint32_t mshot_id;
+  /* 登记的缓冲区，fixed_bufs[i]的序号就是buf_index；fixed_files[fd]是登记的
+   * 文件的序号加1，0表示没有登记
+   */
+  uv_buf_t* fixed_bufs;
+  unsigned int nfixed_bufs;
+  unsigned int* fixed_files;
+  unsigned int nfixed_files;
+};
+
+struct uv__iou_mshot {
+  uint32_t id;
+  uint32_t tag;
+  uv_stream_t* stream;
+  int cancelling;
+};
+
+
+static struct uv__iou* uv__iou_get(const uv_loop_t* loop) {
+  return (struct uv__iou*) loop->iou;
+}
+
+
+static int uv__iou_setup(struct uv__iou* iou,
+                         unsigned int sq_entries,
+                         unsigned int cq_entries) {
+  struct uv__io_uring_params params;
+  void* ring;
+  void* sqes;
+  size_t ringlen;
+  size_t cqlen;
+  size_t sqelen;
+  int ringfd;
+
+  memset(&params, 0, sizeof(params));
+  params.flags = UV__IORING_SETUP_CQSIZE;
+  params.cq_entries = cq_entries;
+
+  ringfd = uv__io_uring_setup(sq_entries, &params);
+  if (ringfd == -1)
+    return UV__ERR(errno);
+
+  /* 需要SINGLE_MMAP（5.4）、NODROP（5.5）以及EXT_ARG（5.11），
+   * 更老的内核直接回退到epoll。
+   */
+  if (!(params.features & UV__IORING_FEAT_SINGLE_MMAP) ||
+      !(params.features & UV__IORING_FEAT_NODROP) ||
+      !(params.features & UV__IORING_FEAT_EXT_ARG)) {
+    uv__close(ringfd);
+    return UV_ENOSYS;
+  }
+
+  ringlen = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  cqlen = params.cq_off.cqes +
+          params.cq_entries * sizeof(struct uv__io_uring_cqe);
+  if (cqlen > ringlen)
+    ringlen = cqlen;
+  sqelen = params.sq_entries * sizeof(struct uv__io_uring_sqe);
+
+  ring = mmap(NULL,
+              ringlen,
+              PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE,
+              ringfd,
+              UV__IORING_OFF_SQ_RING);
+  if (ring == MAP_FAILED)
+    goto fail;
+
+  sqes = mmap(NULL,
+              sqelen,
+              PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE,
+              ringfd,
+              UV__IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    munmap(ring, ringlen);
+    goto fail;
+  }
+
+  uv__cloexec(ringfd, 1);
+
+  iou->sqhead = (uint32_t*) ((char*) ring + params.sq_off.head);
+  iou->sqtail = (uint32_t*) ((char*) ring + params.sq_off.tail);
+  iou->sqflags = (uint32_t*) ((char*) ring + params.sq_off.flags);
+  iou->sqarray = (uint32_t*) ((char*) ring + params.sq_off.array);
+  iou->sqmask = *(uint32_t*) ((char*) ring + params.sq_off.ring_mask);
+  iou->sqentries = *(uint32_t*) ((char*) ring + params.sq_off.ring_entries);
+  iou->sqes = sqes;
+  iou->cqhead = (uint32_t*) ((char*) ring + params.cq_off.head);
+  iou->cqtail = (uint32_t*) ((char*) ring + params.cq_off.tail);
+  iou->cqmask = *(uint32_t*) ((char*) ring + params.cq_off.ring_mask);
+  iou->cqes = (struct uv__io_uring_cqe*) ((char*) ring + params.cq_off.cqes);
+  iou->ring = ring;
+  iou->ringlen = ringlen;
+  iou->sqelen = sqelen;
+  iou->ringfd = ringfd;
+  iou->features = params.features;
+
+  return 0;
+
+fail:
+  uv__close(ringfd);
+  return UV__ERR(errno);
+}
+
+
+/* 把已经放入SQ但还没有提交给内核的请求提交出去，不等待完成事件 */
+static int uv__iou_submit(struct uv__iou* iou) {
+  uint32_t pending;
+  int rc;
+
+  pending = *iou->sqtail - uv__iou_load_acquire(iou->sqhead);
+  if (pending == 0)
+    return 0;
+
+  do
+    rc = uv__io_uring_enter(iou->ringfd, pending, 0, 0, NULL, 0);
+  while (rc == -1 && errno == EINTR);
+
+  if (rc == -1)
+    return UV__ERR(errno);
+
+  return 0;
+}
+
+
+/* 从SQ中取一个空闲的sqe，SQ满了就先提交一次。返回NULL表示暂时拿不到。 */
+static struct uv__io_uring_sqe* uv__iou_get_sqe(struct uv__iou* iou) {
+  struct uv__io_uring_sqe* sqe;
+  uint32_t tail;
+  uint32_t slot;
+
+  tail = *iou->sqtail;
+  if (tail - uv__iou_load_acquire(iou->sqhead) >= iou->sqentries) {
+    if (uv__iou_submit(iou))
+      return NULL;
+    if (tail - uv__iou_load_acquire(iou->sqhead) >= iou->sqentries)
+      return NULL;
+  }
+
+  slot = tail & iou->sqmask;
+  sqe = &iou->sqes[slot];
+  memset(sqe, 0, sizeof(*sqe));
+  iou->sqarray[slot] = slot;
+
+  return sqe;
+}
+
+
+/* 发布一个已经填好的sqe，真正的提交发生在下一次io_uring_enter */
+static void uv__iou_push_sqe(struct uv__iou* iou) {
+  uv__iou_store_release(iou->sqtail, *iou->sqtail + 1);
+}
+
+
+static int uv__iou_maybe_resize(struct uv__iou* iou, unsigned int len) {
+  uint32_t* armed;
+  unsigned int narmed;
+
+  if (len <= iou->narmed)
+    return 0;
+
+  narmed = iou->narmed ? iou->narmed : 64;
+  while (narmed < len)
+    narmed *= 2;
+
+  armed = uv__realloc(iou->armed, narmed * sizeof(armed[0]));
+  if (armed == NULL)
+    return UV_ENOMEM;
+
+  memset(armed + iou->narmed, 0, (narmed - iou->narmed) * sizeof(armed[0]));
+  iou->armed = armed;
+  iou->narmed = narmed;
+
+  return 0;
+}
+
+
+static uint64_t uv__iou_poll_data(uint32_t id, int fd) {
+  return ((uint64_t) id << 32) |
+         ((uint64_t) (uint32_t) fd << 3) |
+         UV__IOU_TAG_POLL;
+}
+
+
+/* 撤销fd上的poll请求，只是放入SQ，并不立即提交 */
+static int uv__iou_disarm(struct uv__iou* iou, int fd) {
+  struct uv__io_uring_sqe* sqe;
+
+  if ((unsigned) fd >= iou->narmed || iou->armed[fd] == 0)
+    return 0;
+
+  sqe = uv__iou_get_sqe(iou);
+  if (sqe == NULL)
+    return UV_EBUSY;
+
+  sqe->opcode = UV__IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = uv__iou_poll_data(iou->armed[fd], fd);
+  sqe->user_data = UV__IOU_TAG_IGNORE;
+  uv__iou_push_sqe(iou);
+
+  /* 即使撤销请求失败（poll已经完成），对应的完成事件也会因为id不匹配被丢弃 */
+  iou->armed[fd] = 0;
+
+  return 0;
+}
+
+
+/* 为watcher提交一个新的one-shot poll请求 */
+static int uv__iou_arm(struct uv__iou* iou, uv__io_t* w) {
+  struct uv__io_uring_sqe* sqe;
+  uint32_t events;
+  int err;
+
+  err = uv__iou_maybe_resize(iou, w->fd + 1);
+  if (err)
+    return err;
+
+  /* 事件掩码发生了变化，先撤销旧的请求 */
+  err = uv__iou_disarm(iou, w->fd);
+  if (err)
+    return err;
+
+  sqe = uv__iou_get_sqe(iou);
+  if (sqe == NULL)
+    return UV_EBUSY;
+
+  /* id为0表示没有挂起的请求，所以要跳过0 */
+  if (++iou->poll_id == 0)
+    iou->poll_id = 1;
+
+  /* poll请求只有一个等待者，不需要EPOLLEXCLUSIVE；每次完成以后都要重新提交，
+   * 本来就只报告一次，EPOLLET也没有意义
+   */
+  events = w->pevents & ~UV__POLLFLAGS;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  events = (events << 16) | (events >> 16);
+#endif
+
+  sqe->opcode = UV__IORING_OP_POLL_ADD;
+  sqe->fd = w->fd;
+  sqe->poll32_events = events;
+  sqe->user_data = uv__iou_poll_data(iou->poll_id, w->fd);
+  uv__iou_push_sqe(iou);
+
+  iou->armed[w->fd] = iou->poll_id;
+  w->events = w->pevents;
+
+  return 0;
+}
+
+
+static void uv__iou_teardown(struct uv__iou* iou) {
+  munmap(iou->sqes, iou->sqelen);
+  munmap(iou->ring, iou->ringlen);
+  uv__close(iou->ringfd);
+  /* 关掉ring之后缓冲区环也就注销了 */
+  if (iou->bufring != NULL)
+    munmap(iou->bufring, iou->bufringlen);
+  uv__free(iou->armed);
+  uv__free(iou->mshot);
+  uv__free(iou->fixed_bufs);
+  uv__free(iou->fixed_files);
+  uv__free(iou);
+}
+
+
+int uv__iou_enable(uv_loop_t* loop) {
+  struct epoll_event e;
+  struct uv__iou* iou;
+  unsigned int i;
+  uv__io_t* w;
+  int err;
+
+  if (loop->flags & UV_LOOP_IO_URING)
+    return 0;
+
+  iou = uv__calloc(1, sizeof(*iou));
+  if (iou == NULL)
+    return UV_ENOMEM;
+
+  err = uv__iou_setup(iou, UV__IOU_SQ_ENTRIES, UV__IOU_CQ_ENTRIES);
+  if (err) {
+    uv__free(iou);
+    /* 内核不支持io_uring（或者被seccomp等禁用）时统一报告ENOSYS */
+    if (err == UV_EPERM || err == UV_EINVAL)
+      err = UV_ENOSYS;
+    return err;
+  }
+
+  /* 把ring fd注册到epoll上，有完成事件时uv_backend_fd()就会变为可读 */
+  memset(&e, 0, sizeof(e));
+  e.events = POLLIN;
+  e.data.fd = -1;
+  if (epoll_ctl(loop->backend_fd, EPOLL_CTL_ADD, iou->ringfd, &e)) {
+    err = UV__ERR(errno);
+    uv__iou_teardown(iou);
+    return err;
+  }
+
+  /* 留到下一轮的epoll事件不再分发，io_uring上重新提交的poll请求会再次报告 */
+  if (uv__io_has_deferred(loop)) {
+    loop->watchers[loop->nwatchers] = NULL;
+    loop->watchers[loop->nwatchers + 1] = NULL;
+  }
+
+  /* 已经注册到epoll上的watcher全部迁移到io_uring上，下次轮询时重新提交 */
+  for (i = 0; i < loop->nwatchers; i++) {
+    w = loop->watchers[i];
+    if (w == NULL)
+      continue;
+
+    if (w->kevents != 0) {
+      memset(&e, 0, sizeof(e));
+      epoll_ctl(loop->backend_fd, EPOLL_CTL_DEL, w->fd, &e);
+      w->kevents = 0;
+    }
+    w->events = 0;
+
+    if (w->pevents != 0 && QUEUE_EMPTY(&w->watcher_queue))
+      QUEUE_INSERT_TAIL(&loop->watcher_queue, &w->watcher_queue);
+  }
+
+  loop->iou = iou;
+  loop->flags |= UV_LOOP_IO_URING;
+
+  return 0;
+}
+
+
+void uv__iou_delete(uv_loop_t* loop) {
+  struct uv__iou* iou;
+
+  iou = uv__iou_get(loop);
+  if (iou == NULL)
+    return;
+
+  uv__iou_teardown(iou);
+  loop->iou = NULL;
+}
+
+
+static int uv__iou_mshot_disarm(struct uv__iou* iou, int fd);
+
+
+void uv__iou_invalidate_fd(uv_loop_t* loop, int fd) {
+  struct uv__iou* iou;
+  int n;
+
+  iou = uv__iou_get(loop);
+  assert(iou != NULL);
+
+  /* poll和multishot请求都持有文件的引用，不撤销的话socket在fd关闭后也不会
+   * 真正关闭，所以这里立即提交，效果上与epoll后端的EPOLL_CTL_DEL相同。
+   */
+  n = uv__iou_mshot_disarm(iou, fd);
+  if ((unsigned) fd < iou->narmed &&
+      iou->armed[fd] != 0 &&
+      uv__iou_disarm(iou, fd) == 0)
+    n++;
+
+  if (n != 0)
+    uv__iou_submit(iou);
+}
+
+
+/* 把第bid个缓冲区还给内核 */
+static void uv__iou_buf_recycle(struct uv__iou* iou,
+                                const struct uv__recv_ring* ring,
+                                unsigned int bid) {
+  struct uv__io_uring_buf* buf;
+
+  buf = &iou->bufring[iou->buftail & (ring->nbufs - 1)];
+  buf->addr = (uintptr_t) (ring->base + bid * ring->size);
+  buf->len = ring->size;
+  buf->bid = bid;
+  iou->buftail++;
+}
+
+
+/* 新的tail对内核可见，第一项的resv就是tail */
+static void uv__iou_buf_publish(struct uv__iou* iou) {
+  uv__iou_store_release(&iou->bufring[0].resv, iou->buftail);
+}
+
+
+/* 第一次用到的时候才把loop的接收缓冲区登记成缓冲区环（5.19） */
+static int uv__iou_bufring_setup(uv_loop_t* loop, struct uv__iou* iou) {
+  struct uv__io_uring_buf_reg reg;
+  struct uv__recv_ring* ring;
+  unsigned int i;
+  size_t len;
+  void* p;
+  int err;
+
+  ring = loop->recv_ring;
+  len = ring->nbufs * sizeof(struct uv__io_uring_buf);
+  p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return UV__ERR(errno);
+
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uintptr_t) p;
+  reg.ring_entries = ring->nbufs;
+  reg.bgid = UV__IOU_BGID;
+  if (uv__io_uring_register(iou->ringfd,
+                            UV__IORING_REGISTER_PBUF_RING,
+                            &reg,
+                            1)) {
+    err = UV__ERR(errno);
+    munmap(p, len);
+    if (err != UV_ENOMEM)
+      iou->bufring_failed = 1;
+    return err;
+  }
+
+  iou->bufring = p;
+  iou->bufringlen = len;
+  iou->buftail = 0;
+  for (i = 0; i < ring->nbufs; i++)
+    uv__iou_buf_recycle(iou, ring, i);
+  uv__iou_buf_publish(iou);
+
+  return 0;
+}
+
+
+static uint64_t uv__iou_mshot_data(uint32_t id, int fd, uint32_t tag) {
+  return ((uint64_t) id << 32) | ((uint64_t) (uint32_t) fd << 3) | tag;
+}
+
+
+static int uv__iou_mshot_reserve(struct uv__iou* iou, int fd) {
+  struct uv__iou_mshot* mshot;
+  unsigned int n;
+
+  if ((unsigned) fd < iou->nmshotslots)
+    return 0;
+
+  n = iou->nmshotslots ? iou->nmshotslots : 64;
+  while (n <= (unsigned) fd)
+    n *= 2;
+
+  mshot = uv__realloc(iou->mshot, n * sizeof(mshot[0]));
+  if (mshot == NULL)
+    return UV_ENOMEM;
+
+  memset(mshot + iou->nmshotslots, 0, (n - iou->nmshotslots) * sizeof(mshot[0]));
+  iou->mshot = mshot;
+  iou->nmshotslots = n;
+
+  return 0;
+}
+
+
+/* 发布一个填好了的multishot请求，记到mshot[fd]上 */
+static void uv__iou_mshot_push(struct uv__iou* iou,
+                               struct uv__io_uring_sqe* sqe,
+                               uv_stream_t* stream,
+                               uint32_t tag) {
+  if (++iou->mshot_id == 0)
+    iou->mshot_id = 1;
+
+  sqe->user_data = uv__iou_mshot_data(iou->mshot_id, sqe->fd, tag);
+  uv__iou_push_sqe(iou);
+
+  iou->mshot[sqe->fd].id = iou->mshot_id;
+  iou->mshot[sqe->fd].tag = tag;
+  iou->mshot[sqe->fd].stream = stream;
+  iou->mshot[sqe->fd].cancelling = 0;
+  iou->nmshot++;
+}
+
+
+/* 在fd上挂一个multishot recv，只是放入SQ */
+static int uv__iou_recv_arm(struct uv__iou* iou, int fd, uv_stream_t* stream) {
+  struct uv__io_uring_sqe* sqe;
+
+  sqe = uv__iou_get_sqe(iou);
+  if (sqe == NULL)
+    return UV_EBUSY;
+
+  sqe->opcode = UV__IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->flags = UV__IOSQE_BUFFER_SELECT;
+  sqe->ioprio = UV__IORING_RECV_MULTISHOT;
+  /* buf_group和buf_index是同一个字段 */
+  sqe->buf_index = UV__IOU_BGID;
+  uv__iou_mshot_push(iou, sqe, stream, UV__IOU_TAG_RECV);
+
+  return 0;
+}
+
+
+/* 放入一个撤销id号multishot请求的sqe，SQ满了返回0 */
+static int uv__iou_mshot_cancel(struct uv__iou* iou,
+                                int fd,
+                                uint32_t id,
+                                uint32_t tag) {
+  struct uv__io_uring_sqe* sqe;
+
+  sqe = uv__iou_get_sqe(iou);
+  if (sqe == NULL)
+    return 0;
+
+  sqe->opcode = UV__IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = uv__iou_mshot_data(id, fd, tag);
+  sqe->user_data = UV__IOU_TAG_IGNORE;
+  uv__iou_push_sqe(iou);
+
+  return 1;
+}
+
+
+/* 撤销fd上的multishot请求，只是放入SQ。返回放进去的sqe的个数 */
+static int uv__iou_mshot_disarm(struct uv__iou* iou, int fd) {
+  uint32_t tag;
+  uint32_t id;
+
+  if ((unsigned) fd >= iou->nmshotslots || iou->mshot[fd].id == 0)
+    return 0;
+
+  id = iou->mshot[fd].id;
+  tag = iou->mshot[fd].tag;
+  iou->mshot[fd].id = 0;
+  iou->mshot[fd].stream = NULL;
+  iou->nmshot--;
+
+  /* SQ满了撤销不了，请求后来的完成事件会因为id不匹配被丢弃，fd关闭时再撤销 */
+  return uv__iou_mshot_cancel(iou, fd, id, tag);
+}
+
+
+static int uv__iou_mshot_is(const struct uv__iou* iou, int fd, uint32_t tag) {
+  return (unsigned) fd < iou->nmshotslots &&
+         iou->mshot[fd].id != 0 &&
+         iou->mshot[fd].tag == tag;
+}
+
+
+int uv__iou_recv_start(uv_loop_t* loop, uv_stream_t* stream) {
+  struct uv__iou* iou;
+  int err;
+  int fd;
+
+  iou = uv__iou_get(loop);
+  if (iou == NULL || loop->recv_ring == NULL || iou->recv_failed)
+    return UV_ENOSYS;
+
+  if (iou->bufring == NULL) {
+    if (iou->bufring_failed)
+      return UV_ENOSYS;
+    err = uv__iou_bufring_setup(loop, iou);
+    if (err)
+      return err;
+  }
+
+  fd = uv__stream_fd(stream);
+  err = uv__iou_mshot_reserve(iou, fd);
+  if (err)
+    return err;
+
+  if (iou->mshot[fd].id != 0)
+    return 0;
+
+  return uv__iou_recv_arm(iou, fd, stream);
+}
+
+
+void uv__iou_recv_stop(uv_loop_t* loop, int fd) {
+  struct uv__iou* iou;
+
+  iou = uv__iou_get(loop);
+  if (uv__iou_mshot_is(iou, fd, UV__IOU_TAG_RECV) &&
+      uv__iou_mshot_disarm(iou, fd)) {
+    uv__iou_submit(iou);
+  }
+}
+
+
+int uv__iou_recv_active(const uv_loop_t* loop, int fd) {
+  return uv__iou_mshot_is(uv__iou_get(loop), fd, UV__IOU_TAG_RECV);
+}
+
+
+/* 一个recv的完成事件。缓冲区在read_cb返回以后归还；请求结束了但流还在读
+ * （比如缓冲区一时用完了）就重新挂上
+ */
+static void uv__iou_recv_done(uv_loop_t* loop,
+                              struct uv__iou* iou,
+                              uint64_t data,
+                              int res,
+                              uint32_t flags) {
+  struct uv__recv_ring* ring;
+  uv_stream_t* stream;
+  unsigned int bid;
+  uv_buf_t buf;
+  int fd;
+
+  ring = loop->recv_ring;
+  fd = (int) ((data >> 3) & 0x1FFFFFFF);
+  bid = flags >> UV__IORING_CQE_BUFFER_SHIFT;
+
+  if ((unsigned) fd >= iou->nmshotslots ||
+      iou->mshot[fd].id != (uint32_t) (data >> 32)) {
+    if (flags & UV__IORING_CQE_F_BUFFER) {
+      uv__iou_buf_recycle(iou, ring, bid);
+      uv__iou_buf_publish(iou);
+    }
+    return;
+  }
+
+  stream = iou->mshot[fd].stream;
+  if (!(flags & UV__IORING_CQE_F_MORE)) {
+    iou->mshot[fd].id = 0;
+    iou->mshot[fd].stream = NULL;
+    iou->nmshot--;
+  }
+
+  /* 缓冲区都在等着被处理，稍后重新挂上 */
+  if (res == -ENOBUFS)
+    goto rearm;
+
+  /* 内核不支持multishot（6.0之前），这个流和以后的流都改回按可读事件读 */
+  if (res == -EINVAL && !(flags & UV__IORING_CQE_F_BUFFER)) {
+    iou->recv_failed = 1;
+    uv__stream_recv_fallback(stream);
+    return;
+  }
+
+  if (res > 0) {
+    buf = uv_buf_init(ring->base + bid * ring->size, res);
+    uv__stream_recv(stream, res, &buf);
+    uv__iou_buf_recycle(iou, ring, bid);
+    uv__iou_buf_publish(iou);
+  } else {
+    buf = uv_buf_init(NULL, 0);
+    uv__stream_recv(stream, res == 0 ? UV_EOF : res, &buf);
+    return;
+  }
+
+rearm:
+  /* 回调里可能关闭了流，或者停下来又重新开始读 */
+  if ((stream->flags & UV_HANDLE_READING) &&
+      !uv__is_closing(stream) &&
+      iou->mshot[fd].id == 0)
+    uv__iou_recv_arm(iou, fd, stream);
+}
+
+
+/* 给监听的watcher挂一个multishot accept，代替poll请求 */
+static int uv__iou_accept_arm(struct uv__iou* iou,
+                              uv__io_t* w,
+                              uv_stream_t* stream) {
+  struct uv__io_uring_sqe* sqe;
+  int err;
+
+  err = uv__iou_mshot_reserve(iou, w->fd);
+  if (err)
+    return err;
+
+  /* watcher停了又重新开始，原来的请求还在的话接着用；已经在撤销了的话
+   * 等它最后一个完成事件再重新挂上
+   */
+  if (iou->mshot[w->fd].id != 0) {
+    w->events = w->pevents;
+    return 0;
+  }
+
+  err = uv__iou_maybe_resize(iou, w->fd + 1);
+  if (err)
+    return err;
+
+  err = uv__iou_disarm(iou, w->fd);
+  if (err)
+    return err;
+
+  sqe = uv__iou_get_sqe(iou);
+  if (sqe == NULL)
+    return UV_EBUSY;
+
+  sqe->opcode = UV__IORING_OP_ACCEPT;
+  sqe->fd = w->fd;
+  sqe->ioprio = UV__IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC | SOCK_NONBLOCK;
+  uv__iou_mshot_push(iou, sqe, stream, UV__IOU_TAG_ACCEPT);
+  w->events = w->pevents;
+
+  return 0;
+}
+
+
+/* 一个accept的完成事件。新连接交给服务端，出错的话按可读事件处理，由
+ * uv__server_io()去accept()拿到同样的错误；请求结束了就把watcher放回队列，
+ * 下次轮询前重新挂上
+ */
+static void uv__iou_accept_done(uv_loop_t* loop,
+                                struct uv__iou* iou,
+                                uint64_t data,
+                                int res,
+                                uint32_t flags) {
+  uv_stream_t* stream;
+  uv__io_t* w;
+  uint32_t id;
+  int fd;
+
+  fd = (int) ((data >> 3) & 0x1FFFFFFF);
+  id = (uint32_t) (data >> 32);
+
+  /* 服务端已经关闭了，连接也只能关掉 */
+  if ((unsigned) fd >= iou->nmshotslots || iou->mshot[fd].id != id) {
+    if (res >= 0)
+      uv__close(res);
+    return;
+  }
+
+  stream = iou->mshot[fd].stream;
+  if (!(flags & UV__IORING_CQE_F_MORE)) {
+    iou->mshot[fd].id = 0;
+    iou->mshot[fd].stream = NULL;
+    iou->nmshot--;
+  }
+
+  w = &stream->io_watcher;
+  if (res >= 0) {
+    uv__watchdog_io_enter(loop, w);
+    uv__server_accepted(stream, res);
+    uv__watchdog_leave(loop);
+  } else if (res == -EINVAL && !(flags & UV__IORING_CQE_F_MORE)) {
+    /* 内核不支持multishot accept，以后都改用poll请求 */
+    iou->accept_failed = 1;
+  } else if (res != -ECANCELED &&
+             uv__io_lookup(loop, fd) == w &&
+             stream->accepted_fd == -1) {
+    uv__watchdog_io_enter(loop, w);
+    w->cb(loop, w, POLLIN);
+    uv__watchdog_leave(loop);
+  }
+
+  if (flags & UV__IORING_CQE_F_MORE) {
+    /* 回调里关闭了服务端的话请求已经撤销了；watcher停掉了就撤销请求，
+     * 撤销生效前接受的连接照样交给服务端，由uv__server_accepted()排进队列
+     */
+    if (iou->mshot[fd].id == id &&
+        !iou->mshot[fd].cancelling &&
+        uv__io_lookup(loop, fd) != w) {
+      iou->mshot[fd].cancelling =
+          uv__iou_mshot_cancel(iou, fd, id, UV__IOU_TAG_ACCEPT);
+    }
+    return;
+  }
+
+  /* 回调里可能关闭了服务端，fd又被别的watcher用上，多重新挂一次也没有关系 */
+  w = uv__io_lookup(loop, fd);
+  if (w != NULL && iou->mshot[fd].id == 0) {
+    w->events = 0;
+    if (QUEUE_EMPTY(&w->watcher_queue))
+      QUEUE_INSERT_TAIL(&loop->watcher_queue, &w->watcher_queue);
+  }
+}
+
+
+/* 用一次io_uring_enter提交一批IORING_OP_EPOLL_CTL（5.6），等全部完成以后把
+ * 结果写回ops[i].err。ring在第一次用到时才创建，内核不支持的话以后都不再尝试；
+ * 没能提交的操作err保持为-1，由调用方逐个调用epoll_ctl。
+ */
+void uv__iou_epoll_ctl(uv_loop_t* loop,
+                       struct uv__epoll_ctl_op* ops,
+                       unsigned int n) {
+  struct epoll_event events[UV__EPOLL_CTL_BATCH_MAX];
+  struct uv__io_uring_sqe* sqe;
+  struct uv__io_uring_cqe* cqe;
+  struct uv__iou* iou;
+  unsigned int submitted;
+  unsigned int done;
+  unsigned int i;
+  uint32_t head;
+  uint32_t tail;
+  int err;
+  int rc;
+
+  assert(n <= UV__EPOLL_CTL_BATCH_MAX);
+
+  for (i = 0; i < n; i++)
+    ops[i].err = -1;
+
+  if (loop->flags & UV_LOOP_EPOLL_CTL_SYNC)
+    return;
+
+  iou = loop->epoll_ctl_ring;
+  if (iou == NULL) {
+    iou = uv__calloc(1, sizeof(*iou));
+    if (iou == NULL)
+      return;
+
+    err = uv__iou_setup(iou, UV__IOU_CTL_SQ_ENTRIES, UV__IOU_CTL_CQ_ENTRIES);
+    if (err) {
+      uv__free(iou);
+      if (err != UV_ENOMEM)
+        loop->flags |= UV_LOOP_EPOLL_CTL_SYNC;
+      return;
+    }
+
+    loop->epoll_ctl_ring = iou;
+  }
+
+  /* 事件在提交的时候就被内核拷走了，放在栈上就可以 */
+  for (i = 0; i < n; i++) {
+    sqe = uv__iou_get_sqe(iou);
+    assert(sqe != NULL);
+
+    memset(&events[i], 0, sizeof(events[i]));
+    events[i].events = ops[i].w->pevents;
+    events[i].data.fd = ops[i].w->fd;
+
+    sqe->opcode = UV__IORING_OP_EPOLL_CTL;
+    sqe->fd = loop->backend_fd;
+    sqe->len = ops[i].op;
+    sqe->off = ops[i].w->fd;
+    sqe->addr = (uint64_t) (uintptr_t) &events[i];
+    sqe->user_data = i;
+    uv__iou_push_sqe(iou);
+  }
+
+  do
+    rc = uv__io_uring_enter(iou->ringfd, n, n, UV__IORING_ENTER_GETEVENTS,
+                            NULL, 0);
+  while (rc == -1 && errno == EINTR);
+
+  /* 内核按顺序取sqe，没取走的收回来，对应的操作由调用方处理 */
+  submitted = rc == -1 ? 0 : rc;
+  head = uv__iou_load_acquire(iou->sqhead);
+  if (*iou->sqtail != head)
+    uv__iou_store_release(iou->sqtail, head);
+
+  /* 等待过程被信号打断时enter也会返回，这时还要接着等 */
+  done = 0;
+  for (;;) {
+    head = *iou->cqhead;
+    tail = uv__iou_load_acquire(iou->cqtail);
+    for (; head != tail; head++) {
+      cqe = &iou->cqes[head & iou->cqmask];
+      assert(cqe->user_data < n);
+      ops[cqe->user_data].err = -cqe->res;
+      done++;
+    }
+    uv__iou_store_release(iou->cqhead, head);
+
+    if (done >= submitted)
+      break;
+
+    do
+      rc = uv__io_uring_enter(iou->ringfd, 0, submitted - done,
+                              UV__IORING_ENTER_GETEVENTS, NULL, 0);
+    while (rc == -1 && errno == EINTR);
+
+    if (rc == -1)
+      abort();
+  }
+}
+
+
+void uv__iou_epoll_ctl_delete(uv_loop_t* loop) {
+  if (loop->epoll_ctl_ring == NULL)
+    return;
+
+  uv__iou_teardown(loop->epoll_ctl_ring);
+  loop->epoll_ctl_ring = NULL;
+}
+
+
+int uv__iou_register_buffers(uv_loop_t* loop,
+                             const uv_buf_t bufs[],
+                             unsigned int nbufs) {
+  struct uv__iou* iou;
+  uv_buf_t* copy;
+  int err;
+
+  if (!(loop->flags & UV_LOOP_IO_URING))
+    return UV_ENOSYS;
+
+  iou = uv__iou_get(loop);
+
+  copy = NULL;
+  if (nbufs > 0) {
+    copy = uv__malloc(nbufs * sizeof(*copy));
+    if (copy == NULL)
+      return UV_ENOMEM;
+    memcpy(copy, bufs, nbufs * sizeof(*copy));
+  }
+
+  /* 内核不允许重复登记，原来的要先取消 */
+  if (iou->fixed_bufs != NULL) {
+    uv__io_uring_register(iou->ringfd, UV__IORING_UNREGISTER_BUFFERS, NULL, 0);
+    uv__free(iou->fixed_bufs);
+    iou->fixed_bufs = NULL;
+    iou->nfixed_bufs = 0;
+  }
+
+  if (nbufs == 0)
+    return 0;
+
+  /* uv_buf_t和struct iovec的布局相同 */
+  if (uv__io_uring_register(iou->ringfd,
+                            UV__IORING_REGISTER_BUFFERS,
+                            copy,
+                            nbufs)) {
+    err = UV__ERR(errno);
+    uv__free(copy);
+    return err;
+  }
+
+  iou->fixed_bufs = copy;
+  iou->nfixed_bufs = nbufs;
+
+  return 0;
+}
+
+
+int uv__iou_register_files(uv_loop_t* loop,
+                           const uv_os_fd_t files[],
+                           unsigned int nfiles) {
+  struct uv__iou* iou;
+  unsigned int* map;
+  unsigned int n;
+  unsigned int i;
+  int err;
+
+  if (!(loop->flags & UV_LOOP_IO_URING))
+    return UV_ENOSYS;
+
+  iou = uv__iou_get(loop);
+
+  n = 0;
+  for (i = 0; i < nfiles; i++) {
+    if (files[i] < 0)
+      return UV_EINVAL;
+    if ((unsigned) files[i] >= n)
+      n = files[i] + 1;
+  }
+
+  /* 同一个fd不能登记两次 */
+  map = NULL;
+  if (nfiles > 0) {
+    map = uv__calloc(n, sizeof(*map));
+    if (map == NULL)
+      return UV_ENOMEM;
+
+    for (i = 0; i < nfiles; i++) {
+      if (map[files[i]] != 0) {
+        uv__free(map);
+        return UV_EINVAL;
+      }
+      map[files[i]] = i + 1;
+    }
+  }
+
+  if (iou->fixed_files != NULL) {
+    uv__io_uring_register(iou->ringfd, UV__IORING_UNREGISTER_FILES, NULL, 0);
+    uv__free(iou->fixed_files);
+    iou->fixed_files = NULL;
+    iou->nfixed_files = 0;
+  }
+
+  if (nfiles == 0)
+    return 0;
+
+  if (uv__io_uring_register(iou->ringfd,
+                            UV__IORING_REGISTER_FILES,
+                            (void*) files,
+                            nfiles)) {
+    err = UV__ERR(errno);
+    uv__free(map);
+    return err;
+  }
+
+  iou->fixed_files = map;
+  iou->nfixed_files = n;
+
+  return 0;
+}
+
+
+/* 登记过的fd要关闭了，把它的位置清空，fd号以后被重新用上时不会读写到
+ * 原来的文件
+ */
+void uv__iou_forget_file(uv_loop_t* loop, int fd) {
+  struct uv__io_uring_files_update up;
+  struct uv__iou* iou;
+  int32_t none;
+
+  if (!(loop->flags & UV_LOOP_IO_URING))
+    return;
+
+  iou = uv__iou_get(loop);
+  if ((unsigned) fd >= iou->nfixed_files || iou->fixed_files[fd] == 0)
+    return;
+
+  none = -1;
+  memset(&up, 0, sizeof(up));
+  up.offset = iou->fixed_files[fd] - 1;
+  up.fds = (uintptr_t) &none;
+  uv__io_uring_register(iou->ringfd, UV__IORING_REGISTER_FILES_UPDATE, &up, 1);
+  iou->fixed_files[fd] = 0;
+}
+
+
+int uv__iou_fixed_buf(const uv_loop_t* loop,
+                      const uv_buf_t* buf,
+                      unsigned int index) {
+  const struct uv__iou* iou;
+  const uv_buf_t* fixed;
+
+  if (!(loop->flags & UV_LOOP_IO_URING))
+    return UV_ENOENT;
+
+  iou = uv__iou_get(loop);
+  if (iou->fixed_bufs == NULL)
+    return UV_ENOENT;
+
+  if (index >= iou->nfixed_bufs)
+    return UV_EINVAL;
+
+  fixed = &iou->fixed_bufs[index];
+  if (buf->base < fixed->base ||
+      buf->len > fixed->len ||
+      (size_t) (buf->base - fixed->base) > fixed->len - buf->len) {
+    return UV_EINVAL;
+  }
+
+  return 0;
+}
+
+
+/* 登记了fd的话把sqe改成用固定文件 */
+static void uv__iou_fixed_file(const struct uv__iou* iou,
+                               struct uv__io_uring_sqe* sqe) {
+  unsigned int index;
+
+  if ((unsigned) sqe->fd >= iou->nfixed_files)
+    return;
+
+  index = iou->fixed_files[sqe->fd];
+  if (index == 0)
+    return;
+
+  sqe->fd = index - 1;
+  sqe->flags |= UV__IOSQE_FIXED_FILE;
+}
+
+
+/* 把一个文件系统请求放进SQ。不支持的请求类型或者SQ满了时返回错误，
+ * 由调用方交给线程池。
+ */
+int uv__iou_fs_submit(uv_loop_t* loop, uv_fs_t* req) {
+  struct uv__io_uring_sqe* sqe;
+  struct uv__iou* iou;
+  unsigned int iovmax;
+
+  if (!(loop->flags & UV_LOOP_IO_URING))
+    return UV_ENOSYS;
+
+  iou = uv__iou_get(loop);
+
+  switch (req->fs_type) {
+  case UV_FS_READ:
+  case UV_FS_WRITE:
+    if (req->off < 0 && !(iou->features & UV__IORING_FEAT_RW_CUR_POS))
+      return UV_ENOSYS;
+    break;
+  case UV_FS_CLOSE:
+  case UV_FS_FDATASYNC:
+  case UV_FS_FSTAT:
+  case UV_FS_FSYNC:
+  case UV_FS_LSTAT:
+  case UV_FS_OPEN:
+  case UV_FS_STAT:
+  case UV_FS_STATX:
+    break;
+  default:
+    return UV_ENOSYS;
+  }
+
+  /* user_data的低3位要用来放标记 */
+  assert(((uintptr_t) req & UV__IOU_TAG_MASK) == 0);
+
+  sqe = uv__iou_get_sqe(iou);
+  if (sqe == NULL)
+    return UV_EBUSY;
+
+  switch (req->fs_type) {
+  case UV_FS_READ:
+  case UV_FS_WRITE:
+    sqe->fd = req->file;
+    sqe->off = req->off < 0 ? (uint64_t) -1 : (uint64_t) req->off;
+    /* req->flags是uv_fs_read_fixed()/uv_fs_write_fixed()的缓冲区序号加1，
+     * 提交前缓冲区被取消登记了的话按普通的读写做
+     */
+    if (req->flags != 0 && (unsigned) req->flags <= iou->nfixed_bufs) {
+      sqe->opcode = req->fs_type == UV_FS_READ ?
+          UV__IORING_OP_READ_FIXED : UV__IORING_OP_WRITE_FIXED;
+      sqe->addr = (uintptr_t) req->bufs[0].base;
+      sqe->len = req->bufs[0].len;
+      sqe->buf_index = req->flags - 1;
+    } else {
+      iovmax = uv__getiovmax();
+      if (req->nbufs > iovmax)
+        req->nbufs = iovmax;
+      sqe->opcode = req->fs_type == UV_FS_READ ?
+          UV__IORING_OP_READV : UV__IORING_OP_WRITEV;
+      sqe->addr = (uintptr_t) req->bufs;
+      sqe->len = req->nbufs;
+    }
+    uv__iou_fixed_file(iou, sqe);
+    break;
+  case UV_FS_CLOSE:
+    sqe->opcode = UV__IORING_OP_CLOSE;
+    sqe->fd = req->file;
+    break;
+  case UV_FS_FDATASYNC:
+    sqe->opcode = UV__IORING_OP_FSYNC;
+    sqe->fd = req->file;
+    sqe->fsync_flags = UV__IORING_FSYNC_DATASYNC;
+    uv__iou_fixed_file(iou, sqe);
+    break;
+  case UV_FS_FSYNC:
+    sqe->opcode = UV__IORING_OP_FSYNC;
+    sqe->fd = req->file;
+    uv__iou_fixed_file(iou, sqe);
+    break;
+  case UV_FS_OPEN:
+    sqe->opcode = UV__IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t) req->path;
+    sqe->len = req->mode;
+    sqe->open_flags = req->flags | O_CLOEXEC;
+    break;
+  default:
+    /* stat类请求，调用方已经把struct uv__statx放在了req->ptr里 */
+    sqe->opcode = UV__IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t) req->path;
+    sqe->addr2 = (uintptr_t) req->ptr;
+    sqe->len = UV__STATX_BASIC_STATS | UV__STATX_BTIME;
+    if (req->fs_type == UV_FS_FSTAT) {
+      sqe->fd = req->file;
+      sqe->addr = (uintptr_t) "";
+      sqe->statx_flags = AT_EMPTY_PATH;
+    } else if (req->fs_type == UV_FS_LSTAT) {
+      sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+    } else if (req->fs_type == UV_FS_STATX) {
+      /* UV_FS_STATX_*的值就是内核的STATX_*和AT_*，直接传下去 */
+      sqe->len = req->mode;
+      sqe->statx_flags = req->flags;
+    }
+    break;
+  }
+
+  sqe->user_data = (uintptr_t) req | UV__IOU_TAG_FS;
+  uv__iou_push_sqe(iou);
+  iou->nfsreqs++;
+
+  return 0;
+}
+
+
+/* 给watcher队列里有变化的watcher准备poll请求 */
+static void uv__iou_arm_queue(uv_loop_t* loop, struct uv__iou* iou) {
+  uv_stream_t* stream;
+  uv__io_t* w;
+  QUEUE retry;
+  QUEUE* q;
+
+  QUEUE_INIT(&retry);
+  while (!QUEUE_EMPTY(&loop->watcher_queue)) {
+    q = QUEUE_HEAD(&loop->watcher_queue);
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);
+
+    w = QUEUE_DATA(q, uv__io_t, watcher_queue);
+    assert(w->pevents != 0);
+    assert(w->fd >= 0);
+    assert(uv__io_lookup(loop, w->fd) == w);
+
+    /* 已经以相同的事件掩码挂上了poll请求 */
+    if (w->events == w->pevents &&
+        (unsigned) w->fd < iou->narmed &&
+        iou->armed[w->fd] != 0) {
+      continue;
+    }
+
+    /* SQ暂时满了（比如CQ溢出），留到下一次轮询再提交 */
+    stream = iou->accept_failed ? NULL : uv__server_multishot(w);
+    if (stream != NULL) {
+      if (uv__iou_accept_arm(iou, w, stream))
+        QUEUE_INSERT_TAIL(&retry, q);
+    } else if (uv__iou_arm(iou, w)) {
+      QUEUE_INSERT_TAIL(&retry, q);
+    }
+  }
+  QUEUE_MOVE(&retry, &loop->watcher_queue);
+}
+
+
+/* 准备好poll请求并提交，不收取完成事件 */
+void uv__iou_flush(uv_loop_t* loop) {
+  struct uv__iou* iou;
+
+  iou = uv__iou_get(loop);
+  assert(iou != NULL);
+
+  uv__iou_arm_queue(loop, iou);
+  uv__iou_submit(iou);
+}
+
+
+void uv__iou_poll(uv_loop_t* loop, int timeout) {
+  struct uv__io_uring_getevents_arg arg;
+  struct uv__io_uring_cqe* cqe;
+  struct uv__iou* iou;
+  struct timespec ts;
+  unsigned int flags;
+  unsigned int pending;
+  int real_timeout;
+  uint32_t cqflags;
+  uint32_t head;
+  uint32_t tail;
+  uint64_t data;
+  uv__io_t* w;
+  sigset_t sigset;
+  sigset_t* psigset;
+  uint64_t base;
+  uint64_t spin_deadline;
+  uint64_t idle_start;
+  int have_signals;
+  int spin;
+  int wait;
+  int nevents;
+  int revents;
+  int res;
+  int fd;
+  int rc;
+
+  iou = uv__iou_get(loop);
+  assert(iou != NULL);
+
+  /* 还有文件系统请求或者multishot请求没完成时即使没有fd也要等完成事件 */
+  if (loop->nfds == 0 && iou->nfsreqs == 0 && iou->nmshot == 0) {
+    assert(QUEUE_EMPTY(&loop->watcher_queue));
+    /* 没有fd时也要按定时器的超时阻塞，见linux-core.c */
+    if (timeout == 0 || timeout == -1)
+      return;
+  }
+
+  psigset = NULL;
+  if (loop->flags & UV_LOOP_BLOCK_SIGPROF) {
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGPROF);
+    psigset = &sigset;
+  }
+
+  assert(timeout >= -1);
+  base = loop->time;
+  real_timeout = timeout;
+
+  /* UV_LOOP_SPIN，参见epoll后端 */
+  spin = 0;
+  spin_deadline = 0;
+  if (timeout != 0 && loop->spin_budget != 0) {
+    spin = 1;
+    spin_deadline = uv__hrtime(UV_CLOCK_FAST) + loop->spin_budget;
+  }
+
+  for (;;) {
+    /* 为watcher队列中的每个watcher准备poll请求，只写入SQ，不产生系统调用 */
+    uv__iou_arm_queue(loop, iou);
+
+    pending = *iou->sqtail - uv__iou_load_acquire(iou->sqhead);
+
+    wait = spin ? 0 : timeout;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask = (uint64_t) (uintptr_t) psigset;
+    arg.sigmask_sz = _NSIG / 8;
+    if (wait >= 0) {
+      ts.tv_sec = wait / 1000;
+      ts.tv_nsec = (wait % 1000) * 1000000;
+      arg.ts = (uint64_t) (uintptr_t) &ts;
+    }
+
+    /* 忙轮询时也要进入内核，poll请求的完成事件是在task work中产生的 */
+    flags = UV__IORING_ENTER_EXT_ARG;
+    if (wait != 0 ||
+        spin ||
+        (uv__iou_load_acquire(iou->sqflags) & UV__IORING_SQ_CQ_OVERFLOW)) {
+      flags |= UV__IORING_ENTER_GETEVENTS;
+    }
+
+    /* 非阻塞模式下，没有要提交的请求也没有溢出的完成事件时可以省掉这次系统调用 */
+    rc = 0;
+    idle_start = 0;
+    if (wait != 0)
+      idle_start = uv__hrtime(UV_CLOCK_PRECISE);
+
+    /* poll_count和epoll一样只统计真正进入内核的轮询 */
+    if (pending != 0 || (flags & UV__IORING_ENTER_GETEVENTS)) {
+      rc = uv__io_uring_enter(iou->ringfd,
+                              pending,
+                              wait != 0,
+                              flags,
+                              &arg,
+                              sizeof(arg));
+      loop->metrics.poll_count++;
+    }
+
+    if (idle_start != 0)
+      SAVE_ERRNO(loop->metrics.idle_time +=
+                     uv__hrtime(UV_CLOCK_PRECISE) - idle_start);
+
+    SAVE_ERRNO(uv__update_time(loop));
+
+    if (rc == -1) {
+      if (errno != EINTR && errno != ETIME && errno != EBUSY && errno != EAGAIN)
+        abort();
+
+      /* 被信号打断且完成队列为空时，处理方式与epoll_pwait返回EINTR相同 */
+      if (errno == EINTR &&
+          *iou->cqhead == uv__iou_load_acquire(iou->cqtail)) {
+        if (timeout == -1)
+          continue;
+
+        if (timeout == 0)
+          return;
+
+        goto update_timeout;
+      }
+    }
+
+    have_signals = 0;
+    nevents = 0;
+
+    head = *iou->cqhead;
+    tail = uv__iou_load_acquire(iou->cqtail);
+
+    while (head != tail) {
+      cqe = &iou->cqes[head & iou->cqmask];
+      data = cqe->user_data;
+      res = cqe->res;
+      cqflags = cqe->flags;
+
+      /* 先归还这个cqe，回调里面可能会提交新的请求 */
+      head++;
+      uv__iou_store_release(iou->cqhead, head);
+
+      if ((data & UV__IOU_TAG_MASK) == UV__IOU_TAG_FS) {
+        iou->nfsreqs--;
+        uv__fs_iou_done((uv_fs_t*) (uintptr_t) (data & ~UV__IOU_TAG_MASK), res);
+        nevents++;
+        goto next;
+      }
+
+      if ((data & UV__IOU_TAG_MASK) == UV__IOU_TAG_RECV) {
+        loop->metrics.events++;
+        uv__iou_recv_done(loop, iou, data, res, cqflags);
+        nevents++;
+        goto next;
+      }
+
+      if ((data & UV__IOU_TAG_MASK) == UV__IOU_TAG_ACCEPT) {
+        loop->metrics.events++;
+        uv__iou_accept_done(loop, iou, data, res, cqflags);
+        nevents++;
+        goto next;
+      }
+
+      if ((data & UV__IOU_TAG_MASK) != UV__IOU_TAG_POLL)
+        goto next;
+
+      fd = (int) ((data >> 3) & 0x1FFFFFFF);
+
+      /* 已经被撤销或者被新请求替换掉的poll请求，直接丢弃 */
+      if ((unsigned) fd >= iou->narmed ||
+          iou->armed[fd] != (uint32_t) (data >> 32)) {
+        goto next;
+      }
+
+      iou->armed[fd] = 0;
+      loop->metrics.events++;
+
+      w = uv__io_lookup(loop, fd);
+      if (w == NULL)
+        goto next;
+
+      /* one-shot请求已经被消耗，放回watcher队列，下次轮询前重新提交 */
+      w->events = 0;
+      if (QUEUE_EMPTY(&w->watcher_queue))
+        QUEUE_INSERT_TAIL(&loop->watcher_queue, &w->watcher_queue);
+
+      revents = res < 0 ? POLLERR : res;
+      revents &= w->pevents | POLLERR | POLLHUP;
+
+      /* 与epoll后端一样，只报告了POLLERR或POLLHUP时补上watcher关心的读写事件 */
+      if (revents == POLLERR || revents == POLLHUP)
+        revents |= w->pevents & (POLLIN | POLLOUT | UV__POLLRDHUP | UV__POLLPRI);
+
+      if (revents != 0) {
+        if (w == &loop->signal_io_watcher)
+          have_signals = 1;
+        else {
+          uv__watchdog_io_enter(loop, w);
+          w->cb(loop, w, revents);
+          uv__watchdog_leave(loop);
+        }
+
+        nevents++;
+      }
+
+next:
+      tail = uv__iou_load_acquire(iou->cqtail);
+    }
+
+    if (have_signals != 0) {
+      uv__watchdog_io_enter(loop, &loop->signal_io_watcher);
+      loop->signal_io_watcher.cb(loop, &loop->signal_io_watcher, POLLIN);
+      uv__watchdog_leave(loop);
+    }
+
+    if (have_signals != 0)
+      return;  /* Event loop should cycle now so don't poll again. */
+
+    if (nevents != 0)
+      return;
+
+    if (spin && uv__hrtime(UV_CLOCK_FAST) >= spin_deadline)
+      spin = 0;
+
+    if (timeout == 0)
+      return;
+
+    if (timeout == -1)
+      continue;
+
+update_timeout:
+    assert(timeout > 0);
+
+    real_timeout -= (loop->time - base);
+    if (real_timeout <= 0)
+      return;
+
+    timeout = real_timeout;
+  }
+}
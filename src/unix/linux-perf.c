@@ -0,0 +1,277 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* UV_LOOP_PERF_COUNTERS：uv_run()各阶段的硬件计数器。
+ *
+ * 三个计数器放在同一个perf事件组里，PERF_FORMAT_GROUP一次read()就能按打开的
+ * 顺序读出全部的值，每个阶段结束时只多一次系统调用。计数器只统计打开它的线程，
+ * 所以要在运行loop的线程里打开；fork之后子进程重新打开。
+ */
+
+#include "uv.h"
+#include "internal.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+#define UV__PERF_NCOUNTERS 3
+
+struct uv__perf {
+  /* 组长的fd，其他计数器跟着它一起读 */
+  int group_fd;
+  int fds[UV__PERF_NCOUNTERS];
+  /* 打开了的计数器在读出的数组里的下标，没打开的为-1 */
+  int index[UV__PERF_NCOUNTERS];
+  unsigned int nopen;
+  /* 上一次读出的值，下一个阶段从这里开始算 */
+  uint64_t last[UV__PERF_NCOUNTERS];
+  uv_perf_counters_t phases[UV_PHASE_MAX];
+};
+
+static const struct {
+  uint32_t type;
+  uint64_t config;
+  unsigned int flag;
+} uv__perf_events[UV__PERF_NCOUNTERS] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, UV_PERF_INSTRUCTIONS },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, UV_PERF_CACHE_MISSES },
+  { PERF_TYPE_SOFTWARE,
+    PERF_COUNT_SW_CONTEXT_SWITCHES,
+    UV_PERF_CONTEXT_SWITCHES },
+};
+
+
+static void uv__perf_close(struct uv__perf* perf) {
+  unsigned int i;
+
+  for (i = 0; i < UV__PERF_NCOUNTERS; i++) {
+    if (perf->fds[i] != -1)
+      uv__close(perf->fds[i]);
+    perf->fds[i] = -1;
+    perf->index[i] = -1;
+  }
+
+  perf->group_fd = -1;
+  perf->nopen = 0;
+}
+
+
+/* 读出整个组，values按打开的顺序排列 */
+static int uv__perf_read(struct uv__perf* perf, uint64_t* values) {
+  uint64_t buf[1 + UV__PERF_NCOUNTERS];
+  ssize_t n;
+  unsigned int i;
+
+  do
+    n = read(perf->group_fd, buf, sizeof(buf));
+  while (n == -1 && errno == EINTR);
+
+  if (n < (ssize_t) sizeof(buf[0]) || buf[0] != perf->nopen)
+    return -1;
+
+  for (i = 0; i < perf->nopen; i++)
+    values[i] = buf[1 + i];
+
+  return 0;
+}
+
+
+/* 为调用线程打开计数器，返回打开的个数；一个都打不开时返回第一个错误 */
+static int uv__perf_open(struct uv__perf* perf) {
+  struct perf_event_attr attr;
+  unsigned int i;
+  int err;
+  int fd;
+
+  err = 0;
+  perf->group_fd = -1;
+  perf->nopen = 0;
+
+  for (i = 0; i < UV__PERF_NCOUNTERS; i++) {
+    perf->fds[i] = -1;
+    perf->index[i] = -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = uv__perf_events[i].type;
+    attr.config = uv__perf_events[i].config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    /* perf_event_paranoid为2时普通用户只能统计用户态 */
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    fd = syscall(__NR_perf_event_open,
+                 &attr,
+                 0,
+                 -1,
+                 perf->group_fd,
+                 PERF_FLAG_FD_CLOEXEC);
+    if (fd == -1) {
+      if (err == 0)
+        err = UV__ERR(errno);
+      continue;
+    }
+
+    if (perf->group_fd == -1)
+      perf->group_fd = fd;
+    perf->fds[i] = fd;
+    perf->index[i] = perf->nopen++;
+  }
+
+  if (perf->nopen == 0)
+    return err;
+
+  if (uv__perf_read(perf, perf->last)) {
+    uv__perf_close(perf);
+    return UV_EIO;
+  }
+
+  return perf->nopen;
+}
+
+
+int uv__perf_enable(uv_loop_t* loop) {
+  struct uv__perf* perf;
+  unsigned int available;
+  unsigned int i;
+  int err;
+
+  if (loop->perf_counters != NULL)
+    return 0;
+
+  perf = uv__calloc(1, sizeof(*perf));
+  if (perf == NULL)
+    return UV_ENOMEM;
+
+  err = uv__perf_open(perf);
+  if (err < 0) {
+    uv__free(perf);
+    return err;
+  }
+
+  available = 0;
+  for (i = 0; i < UV__PERF_NCOUNTERS; i++)
+    if (perf->index[i] != -1)
+      available |= uv__perf_events[i].flag;
+
+  for (i = 0; i < UV_PHASE_MAX; i++)
+    perf->phases[i].available = available;
+
+  loop->perf_counters = perf;
+  return 0;
+}
+
+
+/* 读一次计数器，和上一次的差值记到phase上。phase为UV_PHASE_MAX时只更新起点 */
+void uv__perf_phase(uv_loop_t* loop, int phase) {
+  uv_perf_counters_t* counters;
+  struct uv__perf* perf;
+  uint64_t values[UV__PERF_NCOUNTERS];
+  uint64_t delta[UV__PERF_NCOUNTERS];
+  unsigned int i;
+
+  perf = loop->perf_counters;
+  if (perf->nopen == 0 || uv__perf_read(perf, values))
+    return;
+
+  for (i = 0; i < perf->nopen; i++) {
+    delta[i] = values[i] - perf->last[i];
+    perf->last[i] = values[i];
+  }
+
+  if (phase == UV_PHASE_MAX)
+    return;
+
+  counters = &perf->phases[phase];
+  counters->count++;
+  if (perf->index[0] != -1)
+    counters->instructions += delta[perf->index[0]];
+  if (perf->index[1] != -1)
+    counters->cache_misses += delta[perf->index[1]];
+  if (perf->index[2] != -1)
+    counters->context_switches += delta[perf->index[2]];
+}
+
+
+/* 打开时的线程id已经绑定在fd上了，子进程里要重新打开，累计的值保留 */
+int uv__perf_fork(uv_loop_t* loop) {
+  struct uv__perf* perf;
+
+  perf = loop->perf_counters;
+  if (perf == NULL)
+    return 0;
+
+  uv__perf_close(perf);
+  if (uv__perf_open(perf) < 0)
+    perf->nopen = 0;
+
+  return 0;
+}
+
+
+void uv__perf_delete(uv_loop_t* loop) {
+  struct uv__perf* perf;
+
+  perf = loop->perf_counters;
+  if (perf == NULL)
+    return;
+
+  uv__perf_close(perf);
+  uv__free(perf);
+  loop->perf_counters = NULL;
+}
+
+
+void uv__perf_metrics(const uv_loop_t* loop, uv_metrics_t* metrics) {
+  const struct uv__perf* perf;
+  unsigned int i;
+
+  perf = loop->perf_counters;
+  if (perf == NULL)
+    return;
+
+  for (i = 0; i < UV_PHASE_MAX; i++) {
+    metrics->instructions += perf->phases[i].instructions;
+    metrics->cache_misses += perf->phases[i].cache_misses;
+    metrics->context_switches += perf->phases[i].context_switches;
+  }
+}
+
+
+int uv_loop_perf_counters(const uv_loop_t* loop,
+                          uv_run_phase phase,
+                          uv_perf_counters_t* counters) {
+  const struct uv__perf* perf;
+
+  if ((unsigned int) phase >= UV_PHASE_MAX)
+    return UV_EINVAL;
+
+  perf = loop->perf_counters;
+  if (perf == NULL)
+    return UV_EINVAL;
+
+  memcpy(counters, &perf->phases[phase], sizeof(*counters));
+  return 0;
+}
@@ -167,6 +167,40 @@
 # endif
 #endif /* __NR_preadv */
 
+#ifndef __NR_preadv2
+# if defined(__x86_64__)
+#  define __NR_preadv2 327
+# elif defined(__i386__)
+#  define __NR_preadv2 378
+# elif defined(__arm__)
+#  define __NR_preadv2 (UV_SYSCALL_BASE + 392)
+# endif
+#endif /* __NR_preadv2 */
+
+#ifndef __NR_copy_file_range
+# if defined(__x86_64__)
+#  define __NR_copy_file_range 326
+# elif defined(__i386__)
+#  define __NR_copy_file_range 377
+# elif defined(__arm__)
+#  define __NR_copy_file_range (UV_SYSCALL_BASE + 391)
+# elif defined(__aarch64__)
+#  define __NR_copy_file_range 285
+# endif
+#endif /* __NR_copy_file_range */
+
+#ifndef __NR_statx
+# if defined(__x86_64__)
+#  define __NR_statx 332
+# elif defined(__i386__)
+#  define __NR_statx 383
+# elif defined(__arm__)
+#  define __NR_statx (UV_SYSCALL_BASE + 397)
+# elif defined(__aarch64__)
+#  define __NR_statx 291
+# endif
+#endif /* __NR_statx */
+
 #ifndef __NR_pwritev
 # if defined(__x86_64__)
 #  define __NR_pwritev 296
@@ -187,6 +221,48 @@
 # endif
 #endif /* __NR_pwritev */
 
+/* io_uring的系统调用号在所有架构上都是统一分配的（alpha除外） */
+#ifndef __NR_io_uring_setup
+# if defined(__alpha__)
+#  define __NR_io_uring_setup 535
+# else
+#  define __NR_io_uring_setup 425
+# endif
+#endif /* __NR_io_uring_setup */
+
+#ifndef __NR_io_uring_enter
+# if defined(__alpha__)
+#  define __NR_io_uring_enter 536
+# else
+#  define __NR_io_uring_enter 426
+# endif
+#endif /* __NR_io_uring_enter */
+
+#ifndef __NR_io_uring_register
+# if defined(__alpha__)
+#  define __NR_io_uring_register 537
+# else
+#  define __NR_io_uring_register 427
+# endif
+#endif /* __NR_io_uring_register */
+
+/* pidfd_open是5.3加的，同样是统一分配的调用号 */
+#ifndef __NR_pidfd_open
+# if defined(__alpha__)
+#  define __NR_pidfd_open 544
+# else
+#  define __NR_pidfd_open 434
+# endif
+#endif /* __NR_pidfd_open */
+
+#ifndef __NR_close_range
+# if defined(__alpha__)
+#  define __NR_close_range 546
+# else
+#  define __NR_close_range 436
+# endif
+#endif /* __NR_close_range */
+
 
 int uv__accept4(int fd, struct sockaddr* addr, socklen_t* addrlen, int flags) {
 #if defined(__i386__)
@@ -320,6 +396,58 @@ ssize_t uv__preadv(int fd, const struct iovec *iov, int iovcnt, int64_t offset)
 }
 
 
+ssize_t uv__preadv2(int fd,
+                    const struct iovec *iov,
+                    int iovcnt,
+                    int64_t offset,
+                    int flags) {
+#if defined(__NR_preadv2)
+  return syscall(__NR_preadv2,
+                 fd,
+                 iov,
+                 iovcnt,
+                 (long)offset,
+                 (long)(offset >> 32),
+                 flags);
+#else
+  return errno = ENOSYS, -1;
+#endif
+}
+
+
+int uv__statx(int dirfd,
+              const char* path,
+              int flags,
+              unsigned int mask,
+              struct uv__statx* statxbuf) {
+#if defined(__NR_statx)
+  return syscall(__NR_statx, dirfd, path, flags, mask, statxbuf);
+#else
+  return errno = ENOSYS, -1;
+#endif
+}
+
+
+ssize_t uv__copy_file_range(int fd_in,
+                            int64_t* off_in,
+                            int fd_out,
+                            int64_t* off_out,
+                            size_t len,
+                            unsigned int flags) {
+#if defined(__NR_copy_file_range)
+  return syscall(__NR_copy_file_range,
+                 fd_in,
+                 off_in,
+                 fd_out,
+                 off_out,
+                 len,
+                 flags);
+#else
+  return errno = ENOSYS, -1;
+#endif
+}
+
+
 ssize_t uv__pwritev(int fd, const struct iovec *iov, int iovcnt, int64_t offset) {
 #if defined(__NR_pwritev)
   return syscall(__NR_pwritev, fd, iov, iovcnt, (long)offset, (long)(offset >> 32));
@@ -336,3 +464,71 @@ int uv__dup3(int oldfd, int newfd, int flags) {
   return errno = ENOSYS, -1;
 #endif
 }
+
+
+int uv__io_uring_setup(unsigned int entries, struct uv__io_uring_params* p) {
+#if defined(__NR_io_uring_setup)
+  return syscall(__NR_io_uring_setup, entries, p);
+#else
+  return errno = ENOSYS, -1;
+#endif
+}
+
+
+int uv__io_uring_enter(int fd,
+                       unsigned int to_submit,
+                       unsigned int min_complete,
+                       unsigned int flags,
+                       const void* arg,
+                       size_t argsz) {
+#if defined(__NR_io_uring_enter)
+  return syscall(__NR_io_uring_enter,
+                 fd,
+                 to_submit,
+                 min_complete,
+                 flags,
+                 arg,
+                 argsz);
+#else
+  return errno = ENOSYS, -1;
+#endif
+}
+
+
+int uv__io_uring_register(int fd,
+                          unsigned int opcode,
+                          void* arg,
+                          unsigned int nargs) {
+#if defined(__NR_io_uring_register)
+  return syscall(__NR_io_uring_register, fd, opcode, arg, nargs);
+#else
+  return errno = ENOSYS, -1;
+#endif
+}
+
+
+int uv__pidfd_open(int pid, unsigned int flags) {
+#if defined(__NR_pidfd_open)
+  return syscall(__NR_pidfd_open, pid, flags);
+#else
+  return errno = ENOSYS, -1;
+#endif
+}
+
+
+int uv__close_range(unsigned int first, unsigned int last, unsigned int flags) {
+#if defined(__NR_close_range)
+  return syscall(__NR_close_range, first, last, flags);
+#else
+  return errno = ENOSYS, -1;
+#endif
+}
+
+
+int uv__futex(int* uaddr, int op, int val, const struct timespec* timeout) {
+#if defined(__NR_futex)
+  return syscall(__NR_futex, uaddr, op, val, timeout);
+#else
+  return errno = ENOSYS, -1;
+#endif
+}
@@ -53,6 +53,13 @@
 # define UV__O_NONBLOCK       0x800
 #endif
 
+/* close_range() flags */
+#define UV__CLOSE_RANGE_CLOEXEC 4
+
+/* futex() operations, FUTEX_PRIVATE_FLAG is set */
+#define UV__FUTEX_WAIT_PRIVATE 128
+#define UV__FUTEX_WAKE_PRIVATE 129
+
 #define UV__EFD_CLOEXEC       UV__O_CLOEXEC
 #define UV__EFD_NONBLOCK      UV__O_NONBLOCK
 
@@ -79,6 +86,11 @@
 #define UV__IN_DELETE         0x200
 #define UV__IN_DELETE_SELF    0x400
 #define UV__IN_MOVE_SELF      0x800
+#define UV__IN_Q_OVERFLOW     0x4000
+#define UV__IN_IGNORED        0x8000
+#define UV__IN_ONLYDIR        0x01000000
+#define UV__IN_DONT_FOLLOW    0x02000000
+#define UV__IN_ISDIR          0x40000000
 
 /* http://man7.org/linux/man-pages/man7/inotify.7.html */
 struct uv__inotify_event {
@@ -94,6 +106,199 @@ struct uv__mmsghdr {
   unsigned int msg_len;
 };
 
+/* io_uring，细节参见：https://kernel.dk/io_uring.pdf
+ * 这里只定义libuv用到的那部分，字段布局必须与<linux/io_uring.h>保持一致。
+ */
+#define UV__IORING_SETUP_CQSIZE       0x08u
+#define UV__IORING_FEAT_SINGLE_MMAP   0x01u
+#define UV__IORING_FEAT_NODROP        0x02u
+#define UV__IORING_FEAT_RW_CUR_POS    0x08u
+#define UV__IORING_FEAT_EXT_ARG       0x100u
+#define UV__IORING_ENTER_GETEVENTS    0x01u
+#define UV__IORING_ENTER_EXT_ARG      0x08u
+#define UV__IORING_SQ_NEED_WAKEUP     0x01u
+#define UV__IORING_SQ_CQ_OVERFLOW     0x02u
+#define UV__IORING_FSYNC_DATASYNC     0x01u
+#define UV__IOSQE_FIXED_FILE          0x01u
+#define UV__IOSQE_BUFFER_SELECT       0x20u
+#define UV__IORING_RECV_MULTISHOT     0x02u
+#define UV__IORING_ACCEPT_MULTISHOT   0x01u
+#define UV__IORING_CQE_F_BUFFER       0x01u
+#define UV__IORING_CQE_F_MORE         0x02u
+#define UV__IORING_CQE_BUFFER_SHIFT   16
+#define UV__IORING_REGISTER_BUFFERS   0
+#define UV__IORING_UNREGISTER_BUFFERS 1
+#define UV__IORING_REGISTER_FILES     2
+#define UV__IORING_UNREGISTER_FILES   3
+#define UV__IORING_REGISTER_FILES_UPDATE 6
+#define UV__IORING_REGISTER_PBUF_RING 22
+
+/* preadv2()的flags，数据不在page cache里时不阻塞，返回EAGAIN */
+#define UV__RWF_NOWAIT                0x08
+#define UV__IORING_OFF_SQ_RING        0x00000000ULL
+#define UV__IORING_OFF_CQ_RING        0x08000000ULL
+#define UV__IORING_OFF_SQES           0x10000000ULL
+
+enum {
+  UV__IORING_OP_NOP = 0,
+  UV__IORING_OP_READV = 1,
+  UV__IORING_OP_WRITEV = 2,
+  UV__IORING_OP_FSYNC = 3,
+  UV__IORING_OP_READ_FIXED = 4,
+  UV__IORING_OP_WRITE_FIXED = 5,
+  UV__IORING_OP_POLL_ADD = 6,
+  UV__IORING_OP_POLL_REMOVE = 7,
+  UV__IORING_OP_ACCEPT = 13,
+  UV__IORING_OP_ASYNC_CANCEL = 14,
+  UV__IORING_OP_OPENAT = 18,
+  UV__IORING_OP_CLOSE = 19,
+  UV__IORING_OP_STATX = 21,
+  UV__IORING_OP_RECV = 27,
+  UV__IORING_OP_EPOLL_CTL = 29
+};
+
+struct uv__io_sqring_offsets {
+  uint32_t head;
+  uint32_t tail;
+  uint32_t ring_mask;
+  uint32_t ring_entries;
+  uint32_t flags;
+  uint32_t dropped;
+  uint32_t array;
+  uint32_t reserved0;
+  uint64_t reserved1;
+};
+
+struct uv__io_cqring_offsets {
+  uint32_t head;
+  uint32_t tail;
+  uint32_t ring_mask;
+  uint32_t ring_entries;
+  uint32_t overflow;
+  uint32_t cqes;
+  uint64_t reserved0;
+  uint64_t reserved1;
+};
+
+struct uv__io_uring_params {
+  uint32_t sq_entries;
+  uint32_t cq_entries;
+  uint32_t flags;
+  uint32_t sq_thread_cpu;
+  uint32_t sq_thread_idle;
+  uint32_t features;
+  uint32_t reserved[4];
+  struct uv__io_sqring_offsets sq_off;  /* 40 bytes */
+  struct uv__io_cqring_offsets cq_off;  /* 40 bytes */
+};
+
+struct uv__io_uring_sqe {
+  uint8_t opcode;
+  uint8_t flags;
+  uint16_t ioprio;
+  int32_t fd;
+  union {
+    uint64_t off;
+    uint64_t addr2;
+  };
+  union {
+    uint64_t addr;
+  };
+  uint32_t len;
+  union {
+    uint32_t rw_flags;
+    uint32_t fsync_flags;
+    uint32_t open_flags;
+    uint32_t statx_flags;
+    uint32_t poll32_events;
+    uint32_t msg_flags;
+    uint32_t accept_flags;
+  };
+  uint64_t user_data;
+  union {
+    struct {
+      uint16_t buf_index;
+      uint16_t personality;
+      uint32_t file_index;
+    };
+    uint64_t pad[3];
+  };
+};
+
+struct uv__io_uring_cqe {
+  uint64_t user_data;
+  int32_t res;
+  uint32_t flags;
+};
+
+/* 登记给内核的缓冲区环（5.19），第一项的resv就是环的tail */
+struct uv__io_uring_buf {
+  uint64_t addr;
+  uint32_t len;
+  uint16_t bid;
+  uint16_t resv;
+};
+
+struct uv__io_uring_buf_reg {
+  uint64_t ring_addr;
+  uint32_t ring_entries;
+  uint16_t bgid;
+  uint16_t pad;
+  uint64_t resv[3];
+};
+
+struct uv__io_uring_files_update {
+  uint32_t offset;
+  uint32_t resv;
+  uint64_t fds;
+};
+
+/* struct statx，老的glibc里没有 */
+#define UV__STATX_BASIC_STATS 0x7ffu
+#define UV__STATX_BTIME       0x800u
+#define UV__STATX_DIOALIGN    0x2000u
+
+struct uv__statx_timestamp {
+  int64_t tv_sec;
+  uint32_t tv_nsec;
+  int32_t unused0;
+};
+
+struct uv__statx {
+  uint32_t stx_mask;
+  uint32_t stx_blksize;
+  uint64_t stx_attributes;
+  uint32_t stx_nlink;
+  uint32_t stx_uid;
+  uint32_t stx_gid;
+  uint16_t stx_mode;
+  uint16_t unused0;
+  uint64_t stx_ino;
+  uint64_t stx_size;
+  uint64_t stx_blocks;
+  uint64_t stx_attributes_mask;
+  struct uv__statx_timestamp stx_atime;
+  struct uv__statx_timestamp stx_btime;
+  struct uv__statx_timestamp stx_ctime;
+  struct uv__statx_timestamp stx_mtime;
+  uint32_t stx_rdev_major;
+  uint32_t stx_rdev_minor;
+  uint32_t stx_dev_major;
+  uint32_t stx_dev_minor;
+  uint64_t stx_mnt_id;
+  uint32_t stx_dio_mem_align;
+  uint32_t stx_dio_offset_align;
+  uint64_t unused1[12];
+};
+
+/* struct io_uring_getevents_arg，配合IORING_ENTER_EXT_ARG使用 */
+struct uv__io_uring_getevents_arg {
+  uint64_t sigmask;
+  uint32_t sigmask_sz;
+  uint32_t pad;
+  uint64_t ts;
+};
+
 int uv__accept4(int fd, struct sockaddr* addr, socklen_t* addrlen, int flags);
 int uv__eventfd(unsigned int count);
 int uv__eventfd2(unsigned int count, int flags);
@@ -112,7 +317,37 @@ int uv__sendmmsg(int fd,
                  unsigned int vlen,
                  unsigned int flags);
 ssize_t uv__preadv(int fd, const struct iovec *iov, int iovcnt, int64_t offset);
+ssize_t uv__preadv2(int fd,
+                    const struct iovec *iov,
+                    int iovcnt,
+                    int64_t offset,
+                    int flags);
 ssize_t uv__pwritev(int fd, const struct iovec *iov, int iovcnt, int64_t offset);
+int uv__statx(int dirfd,
+              const char* path,
+              int flags,
+              unsigned int mask,
+              struct uv__statx* statxbuf);
+ssize_t uv__copy_file_range(int fd_in,
+                            int64_t* off_in,
+                            int fd_out,
+                            int64_t* off_out,
+                            size_t len,
+                            unsigned int flags);
 int uv__dup3(int oldfd, int newfd, int flags);
+int uv__io_uring_setup(unsigned int entries, struct uv__io_uring_params* p);
+int uv__io_uring_enter(int fd,
+                       unsigned int to_submit,
+                       unsigned int min_complete,
+                       unsigned int flags,
+                       const void* arg,
+                       size_t argsz);
+int uv__io_uring_register(int fd,
+                          unsigned int opcode,
+                          void* arg,
+                          unsigned int nargs);
+int uv__pidfd_open(int pid, unsigned int flags);
+int uv__close_range(unsigned int first, unsigned int last, unsigned int flags);
+int uv__futex(int* uaddr, int op, int val, const struct timespec* timeout);
 
 #endif /* UV_LINUX_SYSCALL_H_ */
@@ -22,10 +22,17 @@
 #include "uv.h"
 #include "uv/tree.h"
 #include "internal.h"
-#include "heap-inl.h"
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sched.h>
+
+/* uv_run()每轮都会访问的字段集中在UV_LOOP_PRIVATE_FIELDS的开头，参见那里。
+ * 它们跟在公有字段后面，起点不在cache line边界上，第二条检查最后一个热字段
+ * （平台的热字段之后紧接着metrics）的末尾，整组不超过loop的前5个cache line
+ */
+STATIC_ASSERT(offsetof(uv_loop_t, async_pending) < 4 * UV_CACHELINE_SIZE);
+STATIC_ASSERT(offsetof(uv_loop_t, metrics) <= 5 * UV_CACHELINE_SIZE);
 
 /* 事件循环loop结构初始化 */
 int uv_loop_init(uv_loop_t* loop) {
@@ -39,10 +46,13 @@ int uv_loop_init(uv_loop_t* loop) {
   /* 恢复User data */
   loop->data = saved_data;
 
-  /* 初始化定时器堆结构 */
-  heap_init((struct heap*) &loop->timer_heap);
-  /* 初始化线程池（threadpool）工作队列 */
-  QUEUE_INIT(&loop->wq);
+  /* 初始化定时器堆结构，数组在第一次启动定时器时分配 */
+  loop->timer_heap.nodes = NULL;
+  loop->timer_heap.nelts = 0;
+  loop->timer_heap.size = 0;
+  /* 初始化线程池（threadpool）执行完的任务 */
+  loop->wq_done = NULL;
+  loop->wq_senders = 0;
   /*   */
   QUEUE_INIT(&loop->idle_handles);
   /*   */
@@ -68,6 +78,7 @@ int uv_loop_init(uv_loop_t* loop) {
   QUEUE_INIT(&loop->pending_queue);
   /*   */
   QUEUE_INIT(&loop->watcher_queue);
+  QUEUE_INIT(&loop->fork_queue);
 
   /*   */
   loop->closing_handles = NULL;
@@ -77,6 +88,24 @@ int uv_loop_init(uv_loop_t* loop) {
   loop->async_io_watcher.fd = -1;
   /*   */
   loop->async_wfd = -1;
+  loop->async_pending = NULL;
+  loop->async_busy = 0;
+  /* 默认用全局的线程池 */
+  loop->threadpool = NULL;
+  loop->work_class = NULL;
+  /* 提交的任务默认没有截止时间，参见uv_loop_set_work_deadline() */
+  loop->work_deadline = 0;
+  loop->work_timeouts = NULL;
+  loop->stream_timeouts = NULL;
+  loop->rate_limits = NULL;
+  /* 流每次可读事件默认最多读32次，不限字节数 */
+  loop->read_budget = 32;
+  loop->read_budget_bytes = 0;
+  loop->recv_ring = NULL;
+  loop->write_bufs_free = NULL;
+  loop->write_bufs_nfree = 0;
+  loop->fs_batch = NULL;
+  QUEUE_INIT(&loop->fs_sync_groups);
   /*   */
   loop->signal_pipefd[0] = -1;
   loop->signal_pipefd[1] = -1;
@@ -84,6 +113,7 @@ int uv_loop_init(uv_loop_t* loop) {
   loop->backend_fd = -1;
   /*   */
   loop->emfile_fd = -1;
+  loop->emfile = NULL;
   
   /*   */
   loop->timer_counter = 0;
@@ -97,7 +127,7 @@ int uv_loop_init(uv_loop_t* loop) {
 
   /* 信号全局一次初始化  */
   uv__signal_global_once_init();
-  /* 信号handle初始化 */
+  /* 信号handle初始化，信号管道在第一次启动时才创建，见uv_signal_init() */
   err = uv_signal_init(loop, &loop->child_watcher);
   if (err)
     goto fail_signal_init;
@@ -114,15 +144,11 @@ int uv_loop_init(uv_loop_t* loop) {
   if (err)
     goto fail_rwlock_init;
 
-  /*   */
-  err = uv_mutex_init(&loop->wq_mutex);
-  if (err)
-    goto fail_mutex_init;
-
-  /* 初始化一个异步事件，loop->wq_async句柄用于线程池的work queue的异步通知，异步事件的回调为uv__work_done */
-  err = uv_async_init(loop, &loop->wq_async, uv__work_done);
-  if (err)
-    goto fail_async_init;
+  /* 初始化一个异步事件，loop->wq_async句柄用于线程池的work queue的异步通知，异步事件的回调为uv__work_done。
+   * eventfd在第一次提交任务时才创建，这样大量只用来跑定时器或者网络的loop
+   * 初始化时只需要epoll fd
+   */
+  uv__async_init_lazy(loop, &loop->wq_async, uv__work_done);
 
   /*   */
   uv__handle_unref(&loop->wq_async);
@@ -130,12 +156,6 @@ int uv_loop_init(uv_loop_t* loop) {
 
   return 0;
 
-fail_async_init:
-  uv_mutex_destroy(&loop->wq_mutex);
-
-fail_mutex_init:
-  uv_rwlock_destroy(&loop->cloexec_lock);
-
 fail_rwlock_init:
   uv__signal_loop_cleanup(loop);
 
@@ -146,7 +166,16 @@ fail_signal_init:
 }
 
 
+/* uv_run()每轮最多从fork_queue里放回这么多个watcher重新注册 */
+#define UV__FORK_REARM_BATCH 1024
+
+
 int uv_loop_fork(uv_loop_t* loop) {
+  return uv_loop_fork_ex(loop, NULL, NULL);
+}
+
+
+int uv_loop_fork_ex(uv_loop_t* loop, uv_walk_cb cb, void* arg) {
   int err;
   unsigned int i;
   uv__io_t* w;
@@ -159,11 +188,35 @@ int uv_loop_fork(uv_loop_t* loop) {
   if (err)
     return err;
 
+  /* fork的时候可能有线程池线程正在往wq_done压栈，子进程里没有这个线程，
+   * 计数不会再减回去，uv_loop_close()会一直等下去
+   */
+  loop->wq_senders = 0;
+
   err = uv__signal_loop_fork(loop);
   if (err)
     return err;
 
-  /* Rearm all the watchers that aren't re-queued by the above. */
+  err = uv__watchdog_fork(loop);
+  if (err)
+    return err;
+
+#if defined(__linux__)
+  err = uv__perf_fork(loop);
+  if (err)
+    return err;
+#endif
+
+  /* 先让调用方关掉不需要的handle，关掉的watcher没有pevents，下面不会再排队 */
+  if (cb != NULL)
+    uv_walk(loop, cb, arg);
+
+  /* Rearm all the watchers that aren't re-queued by the above.
+   * 继承的watcher可能有很多，先放进fork_queue，由uv__io_fork_rearm()分批
+   * 放回watcher队列，每轮uv__io_poll()只注册一批。在fork_queue里的watcher
+   * 的watcher_queue节点不为空，uv__io_start()/uv__io_stop()照常修改pevents，
+   * 停掉的会被摘下来
+   */
   for (i = 0; i < loop->nwatchers; i++) {
     w = loop->watchers[i];
     if (w == NULL)
@@ -171,15 +224,35 @@ int uv_loop_fork(uv_loop_t* loop) {
 
     if (w->pevents != 0 && QUEUE_EMPTY(&w->watcher_queue)) {
       w->events = 0; /* Force re-registration in uv__io_poll. */
-      QUEUE_INSERT_TAIL(&loop->watcher_queue, &w->watcher_queue);
+      QUEUE_INSERT_TAIL(&loop->fork_queue, &w->watcher_queue);
     }
   }
 
   return 0;
 }
 
+
+/* uv__io_poll()之前调用，把fork_queue里的一批watcher放回watcher队列 */
+void uv__io_fork_rearm(uv_loop_t* loop) {
+  unsigned int n;
+  QUEUE* q;
+
+  for (n = 0; n < UV__FORK_REARM_BATCH; n++) {
+    if (QUEUE_EMPTY(&loop->fork_queue))
+      break;
+
+    q = QUEUE_HEAD(&loop->fork_queue);
+    QUEUE_REMOVE(q);
+    QUEUE_INSERT_TAIL(&loop->watcher_queue, q);
+  }
+}
+
 /*   */
 void uv__loop_close(uv_loop_t* loop) {
+  void* bufs;
+
+  /* 先停看门狗线程 */
+  uv_watchdog_stop(loop);
   /*   */
   uv__signal_loop_cleanup(loop);
   /*   */
@@ -192,6 +265,7 @@ void uv__loop_close(uv_loop_t* loop) {
     uv__close(loop->emfile_fd);
     loop->emfile_fd = -1;
   }
+  uv__emfile_delete(loop);
 
   /*   */
   if (loop->backend_fd != -1) {
@@ -199,16 +273,17 @@ void uv__loop_close(uv_loop_t* loop) {
     loop->backend_fd = -1;
   }
 
+  /* 线程池线程压完栈之后还要调uv_async_send()，等它们都离开之后loop的
+   * 内存才能释放
+   */
+  while (ACCESS_ONCE(unsigned int, loop->wq_senders) != 0)
+    sched_yield();
   /*   */
-  uv_mutex_lock(&loop->wq_mutex);
-  /*   */
-  assert(QUEUE_EMPTY(&loop->wq) && "thread pool work queue not empty!");
+  assert(loop->wq_done == NULL && "thread pool work queue not empty!");
   /*   */
   assert(!uv__has_active_reqs(loop));
-  /*   */
-  uv_mutex_unlock(&loop->wq_mutex);
-  /*   */
-  uv_mutex_destroy(&loop->wq_mutex);
+  /* 解除和线程池的绑定，之后线程池才能被销毁 */
+  uv_loop_set_threadpool(loop, NULL);
 
   /*
    * Note that all thread pool stuff is finished at this point and
@@ -222,13 +297,238 @@ void uv__loop_close(uv_loop_t* loop) {
   assert(loop->nfds == 0);
 #endif
 
-  uv__free(loop->watchers);
+  uv__free_tag(loop->watchers);
   loop->watchers = NULL;
   loop->nwatchers = 0;
+
+  uv__free(loop->phase_histograms);
+  loop->phase_histograms = NULL;
+  uv__free(loop->lag_histogram);
+  loop->lag_histogram = NULL;
+
+#if defined(__linux__)
+  uv__perf_delete(loop);
+#endif
+
+  uv__free(loop->timer_wheel);
+  loop->timer_wheel = NULL;
+
+  uv__free(loop->fs_poll_groups);
+  loop->fs_poll_groups = NULL;
+
+  uv__resolver_delete(loop);
+  uv__arena_delete(loop);
+  uv__work_timeouts_delete(loop);
+  uv__stream_timeouts_delete(loop);
+  uv__rate_limits_delete(loop);
+  uv__recv_ring_delete(loop);
+
+  uv__free(loop->timer_heap.nodes);
+  loop->timer_heap.nodes = NULL;
+  loop->timer_heap.size = 0;
+#if defined(UV__HRTIMER)
+  uv__free(loop->hrtimer_heap.nodes);
+  loop->hrtimer_heap.nodes = NULL;
+  loop->hrtimer_heap.size = 0;
+#endif
+
+  while (loop->write_bufs_free != NULL) {
+    bufs = loop->write_bufs_free;
+    loop->write_bufs_free = *(void**) bufs;
+    uv__free_tag(bufs);
+  }
+  loop->write_bufs_nfree = 0;
+}
+
+
+int uv_metrics_info(uv_loop_t* loop, uv_metrics_t* metrics) {
+  memcpy(metrics, &loop->metrics, sizeof(*metrics));
+#if defined(__linux__)
+  uv__perf_metrics(loop, metrics);
+#endif
+  return 0;
 }
 
 
+#if !defined(__linux__)
+int uv_loop_perf_counters(const uv_loop_t* loop,
+                          uv_run_phase phase,
+                          uv_perf_counters_t* counters) {
+  return UV_ENOSYS;
+}
+#endif
+
+
 int uv__loop_configure(uv_loop_t* loop, uv_loop_option option, va_list ap) {
+  /* 使用io_uring作为轮询后端，内核不支持时返回UV_ENOSYS，loop继续使用epoll */
+  if (option == UV_LOOP_USE_IO_URING) {
+#if defined(__linux__)
+    return uv__iou_enable(loop);
+#else
+    return UV_ENOSYS;
+#endif
+  }
+
+  /* 设置每次epoll_pwait最多返回的事件数，实际的批大小会在这个上限内自适应调整 */
+  if (option == UV_LOOP_MAX_EVENTS) {
+#if defined(__linux__)
+    return uv__epoll_set_max_events(loop, va_arg(ap, int));
+#else
+    return UV_ENOSYS;
+#endif
+  }
+
+  /* 阻塞在uv__io_poll之前先忙轮询一段时间（微秒），0表示关闭 */
+  if (option == UV_LOOP_SPIN) {
+#if defined(__linux__)
+    return uv__io_set_spin(loop, va_arg(ap, int));
+#else
+    return UV_ENOSYS;
+#endif
+  }
+
+  /* 每轮分发io事件的时间预算（微秒），用完后剩下的事件留到下一轮，0表示不限制 */
+  if (option == UV_LOOP_POLL_BUDGET) {
+#if defined(__linux__)
+    return uv__io_set_poll_budget(loop, va_arg(ap, int));
+#else
+    return UV_ENOSYS;
+#endif
+  }
+
+  /* 流的读以边缘触发方式注册，参见uv__read() */
+  if (option == UV_LOOP_EDGE_TRIGGERED) {
+#if defined(__linux__)
+    loop->flags |= UV_LOOP_STREAM_ET;
+    return 0;
+#else
+    return UV_ENOSYS;
+#endif
+  }
+
+  /* 统计uv_run()各阶段的硬件计数器，要在运行loop的线程里调用 */
+  if (option == UV_LOOP_PERF_COUNTERS) {
+#if defined(__linux__)
+    return uv__perf_enable(loop);
+#else
+    return UV_ENOSYS;
+#endif
+  }
+
+  /* 统计uv_run()各阶段的耗时直方图 */
+  if (option == UV_LOOP_PHASE_HISTOGRAMS)
+    return uv__phase_histograms_enable(loop);
+
+  /* loop延迟的样本同时记进直方图 */
+  if (option == UV_LOOP_LAG_HISTOGRAM)
+    return uv__lag_histogram_enable(loop);
+
+  /* 两个参数：缓冲区的个数和每个的大小，参见uv_read_start_ring() */
+  if (option == UV_LOOP_RECV_RING) {
+    unsigned int nbufs;
+    size_t size;
+
+    nbufs = va_arg(ap, unsigned int);
+    size = va_arg(ap, size_t);
+    return uv__recv_ring_configure(loop, nbufs, size);
+  }
+
+  /* accept()遇到EMFILE时用的备用fd个数和暂停监听的时间 */
+  if (option == UV_LOOP_EMFILE_RESERVE) {
+    unsigned int nfds;
+    unsigned int backoff;
+
+    nfds = va_arg(ap, unsigned int);
+    backoff = va_arg(ap, unsigned int);
+    return uv__emfile_configure(loop, nfds, backoff);
+  }
+
+  /* 定时器改用分层时间轮，启动/停止都是O(1)，loop已经有活动定时器时返回UV_EBUSY */
+  if (option == UV_LOOP_TIMER_WHEEL)
+    return uv__timer_wheel_enable(loop);
+
+  /* loop上所有流每次可读事件的读取预算：两个int参数，最多读几次（至少1次）
+   * 和最多读多少字节（0表示不限制），流自己设置过的不受影响
+   */
+  if (option == UV_LOOP_READ_BUDGET) {
+    int reads;
+    int bytes;
+
+    reads = va_arg(ap, int);
+    bytes = va_arg(ap, int);
+    if (reads <= 0 || bytes < 0)
+      return UV_EINVAL;
+
+    loop->read_budget = reads;
+    loop->read_budget_bytes = bytes;
+    return 0;
+  }
+
+  /* 同一个fd上的fsync/fdatasync合并执行，参见uv_fs_fsync() */
+  if (option == UV_LOOP_FS_SYNC_COALESCE) {
+    loop->flags |= UV_LOOP_FS_COALESCE_SYNC;
+    return 0;
+  }
+
+  /* uv_fs_poll_t按间隔共用定时器、成批stat */
+  if (option == UV_LOOP_FS_POLL_SHARED)
+    return uv__fs_poll_groups_enable(loop);
+
+  /* loop自己发DNS查询，两个const char*参数是resolv.conf和hosts的路径，
+   * NULL表示/etc下的默认文件
+   */
+  if (option == UV_LOOP_DNS_RESOLVER) {
+    const char* resolv_conf;
+    const char* hosts;
+
+    resolv_conf = va_arg(ap, const char*);
+    hosts = va_arg(ap, const char*);
+    return uv__resolver_configure(loop, resolv_conf, hosts);
+  }
+
+  /* loop上的信号handle改用signalfd接收，不再经过全局的锁和管道 */
+  if (option == UV_LOOP_SIGNALFD)
+    return uv__signalfd_enable(loop);
+
+  /* 异步请求复制的小块内存改从loop私有的内存池分配 */
+  if (option == UV_LOOP_ARENA)
+    return uv__arena_enable(loop);
+
+  /* watcher表改按fd散列，不再是以fd为下标的数组 */
+  if (option == UV_LOOP_SPARSE_WATCHERS)
+    return uv__io_sparse_enable(loop);
+
+  /* 大的watcher表和接收缓冲区环改用大页 */
+  if (option == UV_LOOP_USE_HUGEPAGES)
+    return uv__io_hugepages_enable(loop);
+
+  /* 打开/关闭loop上的stat/realpath缓存，int参数是缓存时间（毫秒），0表示关闭 */
+  if (option == UV_LOOP_FS_CACHE) {
+#if defined(__linux__)
+    return uv__fs_cache_configure(loop, va_arg(ap, int));
+#else
+    return UV_ENOSYS;
+#endif
+  }
+
+  /* 打开/关闭loop上打开的fd的缓存，int参数是最多缓存的fd个数，0表示关闭 */
+  if (option == UV_LOOP_FD_CACHE) {
+#if defined(__linux__)
+    return uv__fs_fd_cache_configure(loop, va_arg(ap, int));
+#else
+    return UV_ENOSYS;
+#endif
+  }
+
+  /* FSEventStream合并事件的延迟（毫秒），参数是unsigned int */
+  if (option == UV_LOOP_FSEVENTS_LATENCY) {
+#if defined(__APPLE__)
+    return uv__fsevents_set_latency(loop, va_arg(ap, unsigned int));
+#else
+    return UV_ENOSYS;
+#endif
+  }
+
   if (option != UV_LOOP_BLOCK_SIGNAL)
     return UV_ENOSYS;
 
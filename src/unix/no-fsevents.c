@@ -37,6 +37,10 @@ int uv_fs_event_stop(uv_fs_event_t* handle) {
   return UV_ENOSYS;
 }
 
+int uv_fs_event_set_coalesce(uv_fs_event_t* handle, unsigned int window) {
+  return UV_ENOSYS;
+}
+
 void uv__fs_event_close(uv_fs_event_t* handle) {
   UNREACHABLE();
 }
@@ -36,10 +36,45 @@ int uv_pipe_init(uv_loop_t* loop, uv_pipe_t* handle, int ipc) {
   handle->connect_req = NULL;
   handle->pipe_fname = NULL;
   handle->ipc = ipc;
+  memset(&handle->sockbuf_tune, 0, sizeof(handle->sockbuf_tune));
   return 0;
 }
 
 
+int uv_pipe_init_ex(uv_loop_t* loop, uv_pipe_t* handle, unsigned int flags) {
+  if (flags & ~(UV_PIPE_IPC | UV_PIPE_SEQPACKET))
+    return UV_EINVAL;
+
+  uv_pipe_init(loop, handle, (flags & UV_PIPE_IPC) != 0);
+  if (flags & UV_PIPE_SEQPACKET)
+    handle->flags |= UV_HANDLE_PIPE_SEQPACKET;
+
+  return 0;
+}
+
+
+/* 打开或者accept()进来的fd按它自己的socket类型来 */
+void uv__pipe_probe_seqpacket(uv_pipe_t* handle, int fd) {
+  socklen_t len;
+  int type;
+
+  len = sizeof(type);
+  if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0 &&
+      type == SOCK_SEQPACKET) {
+    handle->flags |= UV_HANDLE_PIPE_SEQPACKET;
+  } else {
+    handle->flags &= ~UV_HANDLE_PIPE_SEQPACKET;
+  }
+}
+
+
+static int uv__pipe_socket_type(uv_pipe_t* handle) {
+  if (handle->flags & UV_HANDLE_PIPE_SEQPACKET)
+    return SOCK_SEQPACKET;
+  return SOCK_STREAM;
+}
+
+
 int uv_pipe_bind(uv_pipe_t* handle, const char* name) {
   struct sockaddr_un saddr;
   const char* pipe_fname;
@@ -66,7 +101,7 @@ int uv_pipe_bind(uv_pipe_t* handle, const char* name) {
   /* We've got a copy, don't touch the original any more. */
   name = NULL;
 
-  err = uv__socket(AF_UNIX, SOCK_STREAM, 0);
+  err = uv__socket(AF_UNIX, uv__pipe_socket_type(handle), 0);
   if (err < 0)
     goto err_socket;
   sockfd = err;
@@ -162,6 +197,8 @@ int uv_pipe_open(uv_pipe_t* handle, uv_os_fd_t fd) {
     return err;
 #endif /* defined(__APPLE__) */
 
+  uv__pipe_probe_seqpacket(handle, fd);
+
   mode &= O_ACCMODE;
   if (mode != O_WRONLY)
     flags |= UV_HANDLE_READABLE;
@@ -192,7 +229,7 @@ void uv_pipe_connect(uv_connect_t* req,
   new_sock = (uv__stream_fd(handle) == -1);
 
   if (new_sock) {
-    err = uv__socket(AF_UNIX, SOCK_STREAM, 0);
+    err = uv__socket(AF_UNIX, uv__pipe_socket_type(handle), 0);
     if (err < 0)
       goto out;
     handle->io_watcher.fd = err;
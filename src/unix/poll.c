@@ -27,11 +27,12 @@
 #include <errno.h>
 
 
-static void uv__poll_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+void uv__poll_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
   uv_poll_t* handle;
   int pevents;
 
   handle = container_of(w, uv_poll_t, io_watcher);
+  uv__handle_activity(handle);
 
   /*
    * As documented in the kernel source fs/kernfs/file.c #780
@@ -113,12 +114,17 @@ int uv_poll_start(uv_poll_t* handle, int pevents, uv_poll_cb poll_cb) {
   int events;
 
   assert((pevents & ~(UV_READABLE | UV_WRITABLE | UV_DISCONNECT |
-                      UV_PRIORITIZED)) == 0);
+                      UV_PRIORITIZED | UV_EDGE_TRIGGERED)) == 0);
   assert(!uv__is_closing(handle));
 
+  if ((pevents & UV_EDGE_TRIGGERED) && UV__POLLET == 0)
+    return UV_ENOSYS;
+
   uv__poll_stop(handle);
+  /* 注册标志在停止之后仍然保留，按这一次的参数重新决定是不是边缘触发 */
+  handle->io_watcher.pevents &= ~UV__POLLET;
 
-  if (pevents == 0)
+  if ((pevents & ~UV_EDGE_TRIGGERED) == 0)
     return 0;
 
   events = 0;
@@ -130,6 +136,8 @@ int uv_poll_start(uv_poll_t* handle, int pevents, uv_poll_cb poll_cb) {
     events |= POLLOUT;
   if (pevents & UV_DISCONNECT)
     events |= UV__POLLRDHUP;
+  if (pevents & UV_EDGE_TRIGGERED)
+    events |= UV__POLLET;
 
   uv__io_start(handle->loop, &handle->io_watcher, events);
   uv__handle_start(handle);
@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -45,6 +46,21 @@ extern char **environ;
 # include <grp.h>
 #endif
 
+/* glibc 2.24起posix_spawn()用clone(CLONE_VM|CLONE_VFORK)实现，不复制页表，
+ * exec失败也会通过返回值报告，这时才用它代替fork()
+ */
+#if defined(__linux__) && defined(__GLIBC__)
+# if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 24)
+#  define UV__SPAWN_POSIX 1
+#  include <spawn.h>
+#  include <string.h>
+# endif
+/* 2.34起可以让子进程在exec之前关掉stdio以外的fd */
+# if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34)
+#  define UV__SPAWN_CLOSEFROM 1
+# endif
+#endif
+
 #if defined(__linux__)
 # define uv__cpu_set_t cpu_set_t
 #elif defined(__FreeBSD__)
@@ -53,12 +69,78 @@ extern char **environ;
 # include <pthread_np.h>
 # define uv__cpu_set_t cpuset_t
 #endif
+
+/* 回收子进程时用wait4()顺便拿到它自己的rusage */
+#if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__) ||       \
+    defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+# define UV__PROCESS_HAVE_WAIT4 1
+#endif
+
+#if defined(__linux__)
+/* 内核不支持pidfd_open()（5.3以前）时置1，以后都走SIGCHLD */
+static int no_pidfd;
+
+/* 内核不支持close_range(CLOSE_RANGE_CLOEXEC)（5.11以前）时置1 */
+static int no_close_range;
+#endif
+
+
+/* 收回退出的子进程，顺便拿到它的资源使用情况。还没有退出返回0 */
+static pid_t uv__process_reap(uv_process_t* process, int* status) {
+  pid_t pid;
+
+  do
+#if defined(UV__PROCESS_HAVE_WAIT4)
+    pid = wait4(process->pid, status, WNOHANG, &process->rusage);
+#else
+    pid = waitpid(process->pid, status, WNOHANG);
+#endif
+  while (pid == -1 && errno == EINTR);
+
+  return pid;
+}
+
+
+static void uv__process_exited(uv_process_t* process) {
+#if defined(UV__PROCESS_HAVE_WAIT4)
+  uv_rusage_t rusage;
+#endif
+  int exit_status;
+  int term_signal;
+
+  uv__handle_stop(process);
+
+  if (process->exit_cb == NULL && process->exit_ex_cb == NULL)
+    return;
+
+  exit_status = 0;
+  if (WIFEXITED(process->status))
+    exit_status = WEXITSTATUS(process->status);
+
+  term_signal = 0;
+  if (WIFSIGNALED(process->status))
+    term_signal = WTERMSIG(process->status);
+
+  uv__handle_activity(process);
+
+  if (process->exit_ex_cb == NULL) {
+    process->exit_cb(process, exit_status, term_signal);
+    return;
+  }
+
+#if defined(UV__PROCESS_HAVE_WAIT4)
+  uv__rusage_convert(&process->rusage, &rusage);
+  process->exit_ex_cb(process, exit_status, term_signal, &rusage);
+#else
+  process->exit_ex_cb(process, exit_status, term_signal, NULL);
+#endif
+}
+
+
 /* 回调 */
 static void uv__chld(uv_signal_t* handle, int signum) {
   uv_process_t* process;
   uv_loop_t* loop;
-  int exit_status;
-  int term_signal;
   int status;
   pid_t pid;
   QUEUE pending;
@@ -76,10 +158,7 @@ static void uv__chld(uv_signal_t* handle, int signum) {
     process = QUEUE_DATA(q, uv_process_t, queue);
     q = QUEUE_NEXT(q);
 
-    do
-      pid = waitpid(process->pid, &status, WNOHANG);
-    while (pid == -1 && errno == EINTR);
-
+    pid = uv__process_reap(process, &status);
     if (pid == 0)
       continue;
 
@@ -102,22 +181,95 @@ static void uv__chld(uv_signal_t* handle, int signum) {
 
     QUEUE_REMOVE(&process->queue);
     QUEUE_INIT(&process->queue);
-    uv__handle_stop(process);
+    uv__process_exited(process);
+  }
+  assert(QUEUE_EMPTY(&pending));
+}
 
-    if (process->exit_cb == NULL)
-      continue;
 
-    exit_status = 0;
-    if (WIFEXITED(process->status))
-      exit_status = WEXITSTATUS(process->status);
+/* pidfd可读说明这个子进程退出了，只需要收这一个，不用遍历process_handles */
+static void uv__process_pidfd_io(uv_loop_t* loop,
+                                 uv__io_t* w,
+                                 unsigned int events) {
+  uv_process_t* process;
+  int status;
+  pid_t pid;
 
-    term_signal = 0;
-    if (WIFSIGNALED(process->status))
-      term_signal = WTERMSIG(process->status);
+  process = container_of(w, uv_process_t, pidfd_watcher);
 
-    process->exit_cb(process, exit_status, term_signal);
+  pid = uv__process_reap(process, &status);
+
+  if (pid == 0)
+    return;
+
+  uv__io_close(loop, w);
+  uv__close(w->fd);
+  w->fd = -1;
+
+  /* 已经被别人用waitpid()收走了，和SIGCHLD的路径一样不回调 */
+  if (pid == -1) {
+    if (errno != ECHILD)
+      abort();
+    return;
   }
-  assert(QUEUE_EMPTY(&pending));
+
+  process->status = status;
+  uv__process_exited(process);
+}
+
+
+/* 子进程能用close_range()把继承的fd都设成CLOEXEC时，fork()不需要再和
+ * 线程池里打开fd的操作互斥。用一个空区间探测内核是否支持
+ */
+static int uv__process_cloexec_range(void) {
+#if defined(__linux__)
+  if (no_close_range)
+    return 0;
+
+  if (uv__close_range(~0U, ~0U, UV__CLOSE_RANGE_CLOEXEC) == 0)
+    return 1;
+
+  no_close_range = 1;
+#endif
+  return 0;
+}
+
+
+/* 有pidfd就不需要SIGCHLD处理函数 */
+static void uv__process_chld_start(uv_loop_t* loop) {
+#if defined(__linux__)
+  if (!no_pidfd)
+    return;
+#endif
+  uv_signal_start(&loop->child_watcher, uv__chld, SIGCHLD);
+}
+
+
+static void uv__process_watch(uv_loop_t* loop, uv_process_t* process) {
+#if defined(__linux__)
+  int fd;
+
+  if (!no_pidfd) {
+    fd = uv__pidfd_open(process->pid, 0);
+    if (fd != -1) {
+      process->pidfd_watcher.fd = fd;
+      uv__io_start(loop, &process->pidfd_watcher, POLLIN);
+      return;
+    }
+
+    if (errno == ENOSYS || errno == EINVAL || errno == EPERM)
+      no_pidfd = 1;
+
+    /* fork()之前没有装SIGCHLD处理函数，子进程可能已经退出了，
+     * 补发一个SIGCHLD让uv__chld()去检查
+     */
+    uv_signal_start(&loop->child_watcher, uv__chld, SIGCHLD);
+    QUEUE_INSERT_TAIL(&loop->process_handles, &process->queue);
+    kill(getpid(), SIGCHLD);
+    return;
+  }
+#endif
+  QUEUE_INSERT_TAIL(&loop->process_handles, &process->queue);
 }
 
 
@@ -190,12 +342,68 @@ skip:
 }
 
 
+/* 尽量把新建的stdio通道的缓冲区调到size字节，失败时保持原样 */
+static void uv__process_set_buffer_size(uv_stdio_container_t* container,
+                                        int fds[2],
+                                        unsigned int size) {
+  int value;
+  int i;
+
+  if (size == 0 || size > INT_MAX)
+    return;
+
+  value = size;
+  if (container->flags & UV_KERNEL_PIPE) {
+#if defined(F_SETPIPE_SZ)
+    /* 两端是同一个pipe */
+    fcntl(fds[0], F_SETPIPE_SZ, value);
+#endif
+    return;
+  }
+
+  for (i = 0; i < 2; i++) {
+    setsockopt(fds[i], SOL_SOCKET, SO_SNDBUF, &value, sizeof(value));
+    setsockopt(fds[i], SOL_SOCKET, SO_RCVBUF, &value, sizeof(value));
+  }
+}
+
+
+/* UV_KERNEL_PIPE：fds[0]是父进程这一端，fds[1]给子进程 */
+static int uv__process_init_kernel_pipe(uv_stdio_container_t* container,
+                                        int fds[2]) {
+  int pipefds[2];
+  int mask;
+  int err;
+
+  mask = container->flags & (UV_READABLE_PIPE | UV_WRITABLE_PIPE);
+  if (mask != UV_READABLE_PIPE && mask != UV_WRITABLE_PIPE)
+    return UV_EINVAL;
+
+  err = uv__make_pipe(pipefds, 0);
+  if (err)
+    return err;
+
+  if (mask == UV_READABLE_PIPE) {
+    fds[0] = pipefds[1];
+    fds[1] = pipefds[0];
+  } else {
+    fds[0] = pipefds[0];
+    fds[1] = pipefds[1];
+  }
+
+  return 0;
+}
+
+
 /*
  * Used for initializing stdio streams like options.stdin_stream. Returns
  * zero on success. See also the cleanup section in uv_spawn().
  */
-static int uv__process_init_stdio(uv_stdio_container_t* container, int fds[2]) {
+static int uv__process_init_stdio(uv_stdio_container_t* container,
+                                  int fds[2],
+                                  unsigned int buffer_size) {
   int mask;
+  int err;
   int fd;
 
   mask = UV_IGNORE | UV_CREATE_PIPE | UV_INHERIT_FD | UV_INHERIT_STREAM;
@@ -208,8 +416,15 @@ static int uv__process_init_stdio(uv_stdio_container_t* container, int fds[2]) {
     assert(container->data.stream != NULL);
     if (container->data.stream->type != UV_NAMED_PIPE)
       return UV_EINVAL;
+    else if (container->flags & UV_KERNEL_PIPE)
+      err = uv__process_init_kernel_pipe(container, fds);
     else
-      return uv__make_socketpair(fds, 0);
+      err = uv__make_socketpair(fds, 0);
+
+    if (err == 0)
+      uv__process_set_buffer_size(container, fds, buffer_size);
+
+    return err;
 
   case UV_INHERIT_FD:
   case UV_INHERIT_STREAM:
@@ -361,6 +576,14 @@ static void uv__process_child_init(const uv_process_options_t* options,
       uv__close(use_fd);
   }
 
+#if defined(__linux__)
+  /* 父进程里没带O_CLOEXEC打开的fd在这里统一补上，一次系统调用，
+   * 和父进程打开了多少fd无关。error_fd本来就是CLOEXEC的，不受影响
+   */
+  if (!no_close_range)
+    uv__close_range(stdio_count, ~0U, UV__CLOSE_RANGE_CLOEXEC);
+#endif
+
   if (options->cwd != NULL && chdir(options->cwd)) {
     uv__write_int(error_fd, UV__ERR(errno));
     _exit(127);
@@ -443,6 +666,223 @@ static void uv__process_child_init(const uv_process_options_t* options,
 #endif
 
 
+#if defined(UV__SPAWN_POSIX)
+/* 子进程里只需要posix_spawn的文件操作就能完成的情况：没有setuid/setgid和
+ * cpumask，stdio要么是/dev/null，要么是从编号不小于stdio_count的fd dup2
+ * 过来，要么本来就在原位而且没有FD_CLOEXEC。fork()那条路会顺手把0-2改成
+ * 阻塞的，继承过来的非阻塞fd也只能走那条路
+ */
+static int uv__spawn_posix_ok(const uv_process_options_t* options,
+                              int stdio_count,
+                              int (*pipes)[2]) {
+  int use_fd;
+  int flags;
+  int fd;
+
+  if (options->flags & (UV_PROCESS_SETUID | UV_PROCESS_SETGID))
+    return 0;
+
+  if (options->cpumask != NULL)
+    return 0;
+
+#if !defined(POSIX_SPAWN_SETSID)
+  if (options->flags & UV_PROCESS_DETACHED)
+    return 0;
+#endif
+
+#if !(__GLIBC__ > 2 || __GLIBC_MINOR__ >= 29)
+  if (options->cwd != NULL)
+    return 0;
+#endif
+
+  for (fd = 0; fd < stdio_count; fd++) {
+    use_fd = pipes[fd][1];
+    if (use_fd < 0)
+      continue;
+
+    if (use_fd < stdio_count && use_fd != fd)
+      return 0;
+
+    if (use_fd == fd) {
+      flags = fcntl(fd, F_GETFD);
+      if (flags == -1 || (flags & FD_CLOEXEC))
+        return 0;
+    }
+
+    if (fd <= 2) {
+      flags = fcntl(use_fd, F_GETFL);
+      if (flags == -1 || (flags & O_NONBLOCK))
+        return 0;
+    }
+  }
+
+  return 1;
+}
+
+
+/* execvp()按新环境里的PATH找程序，posix_spawnp()用的却是父进程的，
+ * 所以换了环境时自己按它的PATH找
+ */
+static int uv__spawn_find_path(const uv_process_options_t* options,
+                               char* buf,
+                               size_t size) {
+  const char* path;
+  const char* end;
+  size_t file_len;
+  size_t len;
+  char** env;
+
+  path = "/bin:/usr/bin";
+  for (env = options->env; *env != NULL; env++) {
+    if (strncmp(*env, "PATH=", 5) == 0) {
+      path = *env + 5;
+      break;
+    }
+  }
+
+  file_len = strlen(options->file);
+  for (; *path != '\0'; path = *end == '\0' ? end : end + 1) {
+    end = strchr(path, ':');
+    if (end == NULL)
+      end = path + strlen(path);
+
+    len = end - path;
+    if (len == 0) {
+      /* 空的一段表示当前目录 */
+      buf[0] = '.';
+      len = 1;
+    } else {
+      if (len + 1 + file_len + 1 > size)
+        continue;
+      memcpy(buf, path, len);
+    }
+
+    buf[len] = '/';
+    memcpy(buf + len + 1, options->file, file_len + 1);
+
+    if (access(buf, X_OK) == 0)
+      return 0;
+  }
+
+  return UV_ENOENT;
+}
+
+
+/* 返回exec的结果，和fork()那条路里子进程写回来的错误码一样 */
+static int uv__spawn_posix(const uv_process_options_t* options,
+                           int stdio_count,
+                           int (*pipes)[2],
+                           pid_t* pid) {
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  char path[4096];
+  sigset_t set;
+  short flags;
+  int use_fd;
+  int err;
+  int fd;
+  int i;
+
+  if (options->env != NULL && strchr(options->file, '/') == NULL) {
+    err = uv__spawn_find_path(options, path, sizeof(path));
+    if (err)
+      return err;
+  } else {
+    path[0] = '\0';
+  }
+
+  err = posix_spawn_file_actions_init(&actions);
+  if (err)
+    return UV__ERR(err);
+
+  err = posix_spawnattr_init(&attr);
+  if (err) {
+    posix_spawn_file_actions_destroy(&actions);
+    return UV__ERR(err);
+  }
+
+  for (fd = 0; err == 0 && fd < stdio_count; fd++) {
+    use_fd = pipes[fd][1];
+
+    if (use_fd < 0) {
+      if (fd < 3)
+        err = posix_spawn_file_actions_addopen(&actions,
+                                               fd,
+                                               "/dev/null",
+                                               fd == 0 ? O_RDONLY : O_RDWR,
+                                               0);
+    } else if (use_fd != fd) {
+      err = posix_spawn_file_actions_adddup2(&actions, use_fd, fd);
+    }
+  }
+
+#if defined(UV__SPAWN_CLOSEFROM)
+  /* 和fork()那条路里的close_range()一样，stdio以外的fd都不留给子进程。
+   * 要放在dup2之后
+   */
+  if (err == 0)
+    err = posix_spawn_file_actions_addclosefrom_np(&actions, stdio_count);
+#else
+  /* 原来的fd大多是O_CLOEXEC的，继承进来的不一定，和fork()那条路一样关掉；
+   * 同一个fd只能关一次
+   */
+  for (fd = 0; err == 0 && fd < stdio_count; fd++) {
+    use_fd = pipes[fd][1];
+    if (use_fd < stdio_count)
+      continue;
+
+    for (i = 0; i < fd; i++)
+      if (pipes[i][1] == use_fd)
+        break;
+
+    if (i == fd)
+      err = posix_spawn_file_actions_addclose(&actions, use_fd);
+  }
+#endif
+
+#if __GLIBC__ > 2 || __GLIBC_MINOR__ >= 29
+  if (err == 0 && options->cwd != NULL)
+    err = posix_spawn_file_actions_addchdir_np(&actions, options->cwd);
+#endif
+
+  /* 和uv__process_child_init()一样把前32个信号恢复默认并清空信号掩码 */
+  flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+#if defined(POSIX_SPAWN_SETSID)
+  if (options->flags & UV_PROCESS_DETACHED)
+    flags |= POSIX_SPAWN_SETSID;
+#endif
+
+  sigemptyset(&set);
+  for (i = 1; i < 32; i++)
+    if (i != SIGKILL && i != SIGSTOP)
+      sigaddset(&set, i);
+
+  if (err == 0)
+    err = posix_spawnattr_setflags(&attr, flags);
+  if (err == 0)
+    err = posix_spawnattr_setsigdefault(&attr, &set);
+  if (err == 0) {
+    sigemptyset(&set);
+    err = posix_spawnattr_setsigmask(&attr, &set);
+  }
+
+  if (err == 0) {
+    if (path[0] != '\0')
+      err = posix_spawn(pid, path, &actions, &attr, options->args,
+                        options->env);
+    else
+      err = posix_spawnp(pid, options->file, &actions, &attr, options->args,
+                         options->env != NULL ? options->env : environ);
+  }
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+
+  return UV__ERR(err);
+}
+#endif
+
+
 int uv_spawn(uv_loop_t* loop,
              uv_process_t* process,
              const uv_process_options_t* options) {
@@ -458,6 +898,7 @@ int uv_spawn(uv_loop_t* loop,
   pid_t pid;
   int err;
   int exec_errorno;
+  int cloexec_range;
   int i;
   int status;
 
@@ -480,6 +921,7 @@ int uv_spawn(uv_loop_t* loop,
 
   uv__handle_init(loop, (uv_handle_t*)process, UV_PROCESS);
   QUEUE_INIT(&process->queue);
+  uv__io_init(&process->pidfd_watcher, uv__process_pidfd_io, -1);
 
   stdio_count = options->stdio_count;
   if (stdio_count < 3)
@@ -499,11 +941,34 @@ int uv_spawn(uv_loop_t* loop,
   }
 
   for (i = 0; i < options->stdio_count; i++) {
-    err = uv__process_init_stdio(options->stdio + i, pipes[i]);
+    err = uv__process_init_stdio(options->stdio + i,
+                                 pipes[i],
+                                 options->stdio_buffer_size);
     if (err)
       goto error;
   }
 
+#if defined(UV__SPAWN_POSIX)
+  if (uv__spawn_posix_ok(options, stdio_count, pipes)) {
+    uv__process_chld_start(loop);
+
+    /* 和fork()一样要复制fd表，同样挡住其他线程打开新的fd；
+     * 子进程自己会关掉多余的fd时就不需要了
+     */
+    pid = 0;
+#if !defined(UV__SPAWN_CLOSEFROM)
+    uv_rwlock_wrlock(&loop->cloexec_lock);
+#endif
+    exec_errorno = uv__spawn_posix(options, stdio_count, pipes, &pid);
+#if !defined(UV__SPAWN_CLOSEFROM)
+    uv_rwlock_wrunlock(&loop->cloexec_lock);
+#endif
+
+    process->status = 0;
+    goto spawned;
+  }
+#endif
+
   /* This pipe is used by the parent to wait until
    * the child has called `execve()`. We need this
    * to avoid the following race condition:
@@ -529,15 +994,18 @@ int uv_spawn(uv_loop_t* loop,
     goto error;
 
   /*  */
-  uv_signal_start(&loop->child_watcher, uv__chld, SIGCHLD);
+  uv__process_chld_start(loop);
 
   /* Acquire write lock to prevent opening new fds in worker threads */
-  uv_rwlock_wrlock(&loop->cloexec_lock);
+  cloexec_range = uv__process_cloexec_range();
+  if (!cloexec_range)
+    uv_rwlock_wrlock(&loop->cloexec_lock);
   pid = fork();
 
   if (pid == -1) {
     err = UV__ERR(errno);
-    uv_rwlock_wrunlock(&loop->cloexec_lock);
+    if (!cloexec_range)
+      uv_rwlock_wrunlock(&loop->cloexec_lock);
     uv__close(signal_pipe[0]);
     uv__close(signal_pipe[1]);
     goto error;
@@ -549,7 +1017,8 @@ int uv_spawn(uv_loop_t* loop,
   }
 
   /* Release lock in parent process */
-  uv_rwlock_wrunlock(&loop->cloexec_lock);
+  if (!cloexec_range)
+    uv_rwlock_wrunlock(&loop->cloexec_lock);
   uv__close(signal_pipe[1]);
 
   process->status = 0;
@@ -575,6 +1044,9 @@ int uv_spawn(uv_loop_t* loop,
 
   uv__close_nocheckstdio(signal_pipe[0]);
 
+#if defined(UV__SPAWN_POSIX)
+spawned:
+#endif
   for (i = 0; i < options->stdio_count; i++) {
     err = uv__process_open_stream(options->stdio + i, pipes[i]);
     if (err == 0)
@@ -586,14 +1058,16 @@ int uv_spawn(uv_loop_t* loop,
     goto error;
   }
 
+  process->pid = pid;
+
   /* Only activate this handle if exec() happened successfully */
   if (exec_errorno == 0) {
-    QUEUE_INSERT_TAIL(&loop->process_handles, &process->queue);
+    uv__process_watch(loop, process);
     uv__handle_start(process);
   }
 
-  process->pid = pid;
   process->exit_cb = options->exit_cb;
+  process->exit_ex_cb = options->exit_ex_cb;
 
   if (pipes != pipes_storage)
     uv__free(pipes);
@@ -635,6 +1109,12 @@ int uv_kill(int pid, int signum) {
 
 
 void uv__process_close(uv_process_t* handle) {
+  if (handle->pidfd_watcher.fd != -1) {
+    uv__io_close(handle->loop, &handle->pidfd_watcher);
+    uv__close(handle->pidfd_watcher.fd);
+    handle->pidfd_watcher.fd = -1;
+  }
+
   QUEUE_REMOVE(&handle->queue);
   uv__handle_stop(handle);
   if (QUEUE_EMPTY(&handle->loop->process_handles))
@@ -0,0 +1,421 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* 令牌桶限速，参见uv_rate_limit_init()。
+ *
+ * 桶里的令牌按字节算，每次读写前看一眼还有没有令牌，读写之后按实际的字节数
+ * 扣掉，可以扣成负数（报文不能拆开，sendfile也不好截断），欠下的由后面的
+ * 补充慢慢还上。没有令牌的时候停掉handle的POLLIN或者POLLOUT，把它挂到桶的
+ * 等待队列上，不需要每个连接一个定时器：loop上只有一个内部定时器，在所有
+ * 有人等待的桶里最早攒够令牌的时间醒来，重新打开等待者的POLLIN或者POLLOUT，
+ * 之后的读写还是由原来的I/O回调完成。
+ *
+ * 为了不让被唤醒的handle每次只读写几个字节，至少攒够UV__RATE_LIMIT_SLICE分之
+ * 一秒的令牌（或者整个桶）才唤醒。
+ */
+
+#include "uv.h"
+#include "internal.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#define UV__RATE_LIMIT_SLICE 100
+
+/* loop->rate_limits */
+struct uv__rate_limit_loop {
+  uv_timer_t timer;
+  QUEUE active;                   /* 有等待者的uv_rate_limit_t */
+  uint64_t due;                   /* 定时器的到期时间，没有启动时为0 */
+};
+
+static void uv__rate_limit_timer_cb(uv_timer_t* timer);
+
+
+/* 有handle在等令牌的时候定时器要让loop活着，等待的handle自己的事件已经停掉了 */
+static void uv__rate_limit_activate(uv_rate_limit_t* rl) {
+  struct uv__rate_limit_loop* t;
+
+  t = rl->loop->rate_limits;
+  if (QUEUE_EMPTY(&t->active))
+    uv__handle_ref(&t->timer);
+  QUEUE_INSERT_TAIL(&t->active, &rl->active_queue);
+}
+
+
+static void uv__rate_limit_deactivate(uv_rate_limit_t* rl) {
+  struct uv__rate_limit_loop* t;
+
+  QUEUE_REMOVE(&rl->active_queue);
+  QUEUE_INIT(&rl->active_queue);
+
+  t = rl->loop->rate_limits;
+  if (QUEUE_EMPTY(&t->active))
+    uv__handle_unref(&t->timer);
+}
+
+
+static void uv__rate_limit_refill(uv_rate_limit_t* rl) {
+  uint64_t now;
+  double add;
+
+  now = uv__hrtime(UV_CLOCK_FAST);
+  if (rl->tokens >= (int64_t) rl->burst) {
+    rl->last = now;
+    return;
+  }
+
+  add = (double) (now - rl->last) * rl->rate / 1e9;
+  if (add < 1)
+    return;
+
+  if (add >= (double) ((int64_t) rl->burst - rl->tokens)) {
+    rl->tokens = rl->burst;
+    rl->last = now;
+    return;
+  }
+
+  /* 不满一个字节的零头留到下一次，last只前进整数个令牌对应的时间 */
+  rl->tokens += (int64_t) add;
+  rl->last += (uint64_t) ((double) (int64_t) add * 1e9 / rl->rate);
+}
+
+
+/* 至少攒到这么多令牌才唤醒等待者 */
+static int64_t uv__rate_limit_threshold(const uv_rate_limit_t* rl) {
+  uint64_t n;
+
+  n = rl->rate / UV__RATE_LIMIT_SLICE;
+  if (n == 0)
+    n = 1;
+  if (n > rl->burst)
+    n = rl->burst;
+
+  return (int64_t) n;
+}
+
+
+/* 还要多少毫秒才能攒够令牌 */
+static uint64_t uv__rate_limit_wait_ms(uv_rate_limit_t* rl) {
+  int64_t need;
+
+  uv__rate_limit_refill(rl);
+  need = uv__rate_limit_threshold(rl) - rl->tokens;
+  if (need <= 0)
+    return 0;
+
+  return ((uint64_t) need * 1000 + rl->rate - 1) / rl->rate;
+}
+
+
+static void uv__rate_limit_arm(uv_loop_t* loop, uint64_t timeout) {
+  struct uv__rate_limit_loop* t;
+
+  /* 定时器只会提前，不会推迟 */
+  t = loop->rate_limits;
+  if (t->due != 0 && t->due <= loop->time + timeout)
+    return;
+
+  t->due = loop->time + timeout;
+  uv_timer_start(&t->timer, uv__rate_limit_timer_cb, timeout, 0);
+}
+
+
+static void uv__rate_limit_wake(uv_rate_limit_t* rl) {
+  struct uv__rate_link* link;
+  QUEUE queue;
+  QUEUE* q;
+
+  uv__rate_limit_deactivate(rl);
+
+  /* 唤醒的handle里没抢到令牌的会重新排到队尾 */
+  QUEUE_MOVE(&rl->wait_queue, &queue);
+  while (!QUEUE_EMPTY(&queue)) {
+    q = QUEUE_HEAD(&queue);
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);
+
+    link = QUEUE_DATA(q, struct uv__rate_link, member);
+    uv__io_start(rl->loop, link->w, link->events);
+  }
+}
+
+
+static void uv__rate_limit_timer_cb(uv_timer_t* timer) {
+  struct uv__rate_limit_loop* t;
+  uv_rate_limit_t* rl;
+  uint64_t timeout;
+  uint64_t next;
+  QUEUE* q;
+  QUEUE* n;
+
+  t = container_of(timer, struct uv__rate_limit_loop, timer);
+  t->due = 0;
+  next = 0;
+
+  for (q = QUEUE_HEAD(&t->active); q != &t->active; q = n) {
+    n = QUEUE_NEXT(q);
+    rl = QUEUE_DATA(q, uv_rate_limit_t, active_queue);
+
+    timeout = uv__rate_limit_wait_ms(rl);
+    if (timeout == 0)
+      uv__rate_limit_wake(rl);
+    else if (next == 0 || timeout < next)
+      next = timeout;
+  }
+
+  if (next != 0)
+    uv__rate_limit_arm(timer->loop, next);
+}
+
+
+int uv_rate_limit_init(uv_loop_t* loop,
+                       uv_rate_limit_t* rl,
+                       uint64_t rate,
+                       uint64_t burst) {
+  if (rate == 0 || burst > INT64_MAX)
+    return UV_EINVAL;
+
+  rl->loop = loop;
+  rl->rate = rate;
+  rl->burst = burst != 0 ? burst : rate;
+  if (rl->burst > INT64_MAX)
+    rl->burst = INT64_MAX;
+  rl->nhandles = 0;
+  rl->tokens = rl->burst;
+  rl->last = uv__hrtime(UV_CLOCK_FAST);
+  QUEUE_INIT(&rl->wait_queue);
+  QUEUE_INIT(&rl->active_queue);
+  return 0;
+}
+
+
+int uv_rate_limit_set(uv_rate_limit_t* rl, uint64_t rate, uint64_t burst) {
+  if (rate == 0 || burst > INT64_MAX)
+    return UV_EINVAL;
+
+  /* 按旧的速率结算到现在，之后按新的速率补充 */
+  uv__rate_limit_refill(rl);
+  rl->rate = rate;
+  rl->burst = burst != 0 ? burst : rate;
+  if (rl->burst > INT64_MAX)
+    rl->burst = INT64_MAX;
+  if (rl->tokens > (int64_t) rl->burst)
+    rl->tokens = rl->burst;
+
+  if (!QUEUE_EMPTY(&rl->active_queue))
+    uv__rate_limit_arm(rl->loop, uv__rate_limit_wait_ms(rl));
+
+  return 0;
+}
+
+
+int uv_rate_limit_destroy(uv_rate_limit_t* rl) {
+  if (rl->nhandles != 0)
+    return UV_EBUSY;
+
+  assert(QUEUE_EMPTY(&rl->wait_queue));
+  assert(QUEUE_EMPTY(&rl->active_queue));
+  return 0;
+}
+
+
+/* 现在可以读写的字节数，不限速时返回SIZE_MAX */
+size_t uv__rate_limit_avail(struct uv__rate_link* link) {
+  uv_rate_limit_t* rl;
+
+  rl = link->limit;
+  if (rl == NULL)
+    return SIZE_MAX;
+
+  uv__rate_limit_refill(rl);
+  if (rl->tokens <= 0)
+    return 0;
+
+  return (uint64_t) rl->tokens > SIZE_MAX ? SIZE_MAX : (size_t) rl->tokens;
+}
+
+
+/* 同uv__rate_limit_avail()，没有令牌时还要停掉link的事件，排队等待补充 */
+size_t uv__rate_limit_quota(struct uv__rate_link* link) {
+  uv_rate_limit_t* rl;
+  size_t n;
+
+  n = uv__rate_limit_avail(link);
+  if (n != 0)
+    return n;
+
+  rl = link->limit;
+  uv__io_stop(rl->loop, link->w, link->events);
+  if (!QUEUE_EMPTY(&link->member))
+    return 0;
+
+  QUEUE_INSERT_TAIL(&rl->wait_queue, &link->member);
+  if (QUEUE_EMPTY(&rl->active_queue)) {
+    uv__rate_limit_activate(rl);
+    uv__rate_limit_arm(rl->loop, uv__rate_limit_wait_ms(rl));
+  }
+
+  return 0;
+}
+
+
+void uv__rate_limit_consume(struct uv__rate_link* link, size_t n) {
+  if (link->limit != NULL)
+    link->limit->tokens -= (int64_t) n;
+}
+
+
+/* 不再等待令牌（比如不读了），不重新打开事件 */
+void uv__rate_limit_cancel(struct uv__rate_link* link) {
+  uv_rate_limit_t* rl;
+
+  if (QUEUE_EMPTY(&link->member))
+    return;
+
+  QUEUE_REMOVE(&link->member);
+  QUEUE_INIT(&link->member);
+
+  rl = link->limit;
+  if (QUEUE_EMPTY(&rl->wait_queue))
+    uv__rate_limit_deactivate(rl);
+}
+
+
+/* 换掉link的限速器。原来在等令牌的话马上打开事件，由新的限速器重新判断 */
+static void uv__rate_link_set(struct uv__rate_link* link, uv_rate_limit_t* rl) {
+  int waiting;
+
+  if (link->limit == rl)
+    return;
+
+  waiting = !QUEUE_EMPTY(&link->member);
+  if (link->limit != NULL) {
+    uv__rate_limit_cancel(link);
+    link->limit->nhandles--;
+  }
+
+  link->limit = rl;
+  if (rl != NULL)
+    rl->nhandles++;
+
+  if (waiting)
+    uv__io_start(link->loop, link->w, link->events);
+}
+
+
+/* uv_stream_set_rate_limit()和uv_udp_set_rate_limit()共用，*slot是handle的
+ * rate_limit字段。两个都为NULL时释放
+ */
+int uv__rate_limits_set(uv_handle_t* handle,
+                        void** slot,
+                        uv__io_t* w,
+                        uv_rate_limit_t* in,
+                        uv_rate_limit_t* out) {
+  struct uv__rate_limit_loop* t;
+  struct uv__rate_limits* limits;
+  uv_loop_t* loop;
+
+  loop = handle->loop;
+  if ((in != NULL && in->loop != loop) || (out != NULL && out->loop != loop))
+    return UV_EINVAL;
+
+  limits = *slot;
+  if (in == NULL && out == NULL) {
+    if (limits != NULL) {
+      uv__rate_link_set(&limits->in, NULL);
+      uv__rate_link_set(&limits->out, NULL);
+      uv__free(limits);
+      *slot = NULL;
+    }
+    return 0;
+  }
+
+  if (loop->rate_limits == NULL) {
+    t = uv__malloc(sizeof(*t));
+    if (t == NULL)
+      return UV_ENOMEM;
+
+    uv_timer_init(loop, &t->timer);
+    t->timer.flags |= UV_HANDLE_INTERNAL;
+    uv__handle_unref(&t->timer);
+    QUEUE_INIT(&t->active);
+    t->due = 0;
+    loop->rate_limits = t;
+  }
+
+  if (limits == NULL) {
+    limits = uv__malloc(sizeof(*limits));
+    if (limits == NULL)
+      return UV_ENOMEM;
+
+    limits->in.loop = loop;
+    limits->in.limit = NULL;
+    limits->in.w = w;
+    limits->in.events = POLLIN;
+    QUEUE_INIT(&limits->in.member);
+    limits->out.loop = loop;
+    limits->out.limit = NULL;
+    limits->out.w = w;
+    limits->out.events = POLLOUT;
+    QUEUE_INIT(&limits->out.member);
+    *slot = limits;
+  }
+
+  uv__rate_link_set(&limits->in, in);
+  uv__rate_link_set(&limits->out, out);
+  return 0;
+}
+
+
+/* handle关闭时调用，不再打开事件 */
+void uv__rate_limits_release(void** slot) {
+  struct uv__rate_limits* limits;
+
+  limits = *slot;
+  if (limits == NULL)
+    return;
+
+  uv__rate_limit_cancel(&limits->in);
+  uv__rate_limit_cancel(&limits->out);
+  if (limits->in.limit != NULL)
+    limits->in.limit->nhandles--;
+  if (limits->out.limit != NULL)
+    limits->out.limit->nhandles--;
+  uv__free(limits);
+  *slot = NULL;
+}
+
+
+void uv__rate_limits_delete(uv_loop_t* loop) {
+  struct uv__rate_limit_loop* t;
+
+  t = loop->rate_limits;
+  if (t == NULL)
+    return;
+
+  /* handle都已经关闭，不会再有等待者 */
+  assert(QUEUE_EMPTY(&t->active));
+  uv_timer_stop(&t->timer);
+  QUEUE_REMOVE(&t->timer.handle_queue);
+  uv__free(t);
+  loop->rate_limits = NULL;
+}
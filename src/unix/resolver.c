@@ -0,0 +1,1133 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * loop上的DNS解析器，参见UV_LOOP_DNS_RESOLVER。
+ *
+ * 每个uv_getaddrinfo()请求是一个uv__dns_query，按resolv.conf的search/ndots
+ * 规则依次尝试候选名字；每个名字同时发出A和AAAA查询（hints指定了地址族时
+ * 只发一种），每次查询是一个uv__dns_probe，有自己的socket和超时定时器。
+ * 超时或者服务器出错时换下一个nameserver重发，UDP应答被截断时改用TCP。
+ * 被放弃的probe和query断开，关闭完自己的handle后释放。
+ */
+
+#include "uv.h"
+#include "internal.h"
+
+#include <strings.h> /* strcasecmp() */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+
+#define UV__DNS_MAX_NS 3
+#define UV__DNS_MAX_SEARCH 6
+#define UV__DNS_MAX_ADDRS 64
+#define UV__DNS_PACKET 512          /* 不用EDNS0，UDP应答最多512字节 */
+#define UV__DNS_TCP_PACKET 65535
+#define UV__DNS_NAME 256
+
+#define UV__DNS_T_A 1
+#define UV__DNS_T_CNAME 5
+#define UV__DNS_T_AAAA 28
+#define UV__DNS_C_IN 1
+
+/* probe的结果 */
+enum {
+  UV__DNS_IGNORE,                   /* 不是这个probe的应答，继续等 */
+  UV__DNS_OK,
+  UV__DNS_NODATA,
+  UV__DNS_NXDOMAIN,
+  UV__DNS_TRUNC,
+  UV__DNS_FAIL,
+  UV__DNS_NOMEM
+};
+
+struct uv__dns_host {
+  int family;
+  unsigned char addr[16];
+  char* name;
+  char* canon;                      /* 这一行的第一个名字 */
+};
+
+struct uv__resolver {
+  struct sockaddr_storage ns[UV__DNS_MAX_NS];
+  unsigned int nns;
+  char* search[UV__DNS_MAX_SEARCH];
+  unsigned int nsearch;
+  unsigned int ndots;
+  unsigned int timeout;             /* 毫秒 */
+  unsigned int attempts;
+  int use_vc;                       /* options use-vc：只用TCP */
+  struct uv__dns_host* hosts;
+  unsigned int nhosts;
+  unsigned int nqueries;            /* 进行中的查询，不为0时不能重新配置 */
+  unsigned int seed;
+};
+
+struct uv__dns_probe;
+
+struct uv__dns_query {
+  uv_getaddrinfo_t* req;
+  struct uv__resolver* r;
+  struct uv__dns_probe* probes[2];
+  int types[2];
+  int results[2];
+  unsigned int ntypes;
+  unsigned int pending;
+  unsigned int candidate;           /* 下一个要试的候选名字 */
+  unsigned short port;
+  unsigned int naddrs;
+  struct sockaddr_storage addrs[UV__DNS_MAX_ADDRS];
+  char name[UV__DNS_NAME];          /* 正在查的名字，没有结尾的点 */
+  char canon[UV__DNS_NAME];
+};
+
+struct uv__dns_probe {
+  struct uv__dns_query* q;          /* NULL表示已经放弃，只等handle关闭 */
+  unsigned int slot;
+  unsigned int attempt;
+  int tcp;
+  int closing;
+  unsigned short id;
+  union {
+    uv_handle_t handle;
+    uv_udp_t udp;
+    uv_tcp_t tcp;
+  } u;
+  uv_timer_t timer;
+  uv_udp_send_t send_req;
+  uv_connect_t connect_req;
+  uv_write_t write_req;
+  size_t qlen;
+  unsigned char query[2 + UV__DNS_PACKET];  /* TCP前面有两个字节的长度 */
+  unsigned char* reply;                     /* TCP应答，按需分配 */
+  size_t rlen;
+  unsigned char rbuf[UV__DNS_PACKET];
+};
+
+
+static struct uv__dns_probe* uv__dns_probe_start(struct uv__dns_query* q,
+                                                 unsigned int slot,
+                                                 unsigned int attempt,
+                                                 int tcp);
+static void uv__dns_query_next(struct uv__dns_query* q);
+
+
+static char* uv__dns_token(char** s) {
+  char* p;
+  char* t;
+
+  p = *s;
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    p++;
+
+  if (*p == '\0' || *p == '#' || *p == ';')
+    return NULL;
+
+  t = p;
+  while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+    p++;
+
+  if (*p != '\0')
+    *p++ = '\0';
+
+  *s = p;
+  return t;
+}
+
+
+/* "1.2.3.4"、"::1"，以及指定端口的"[1.2.3.4]:5353"和"[::1]:5353" */
+static int uv__dns_parse_ns(const char* s, struct sockaddr_storage* ss) {
+  char addr[64];
+  const char* end;
+  int port;
+  size_t len;
+
+  port = 53;
+  len = strlen(s);
+
+  if (*s == '[') {
+    end = strchr(s, ']');
+    if (end == NULL)
+      return UV_EINVAL;
+
+    len = end - s - 1;
+    s++;
+
+    if (end[1] == ':')
+      port = atoi(end + 2);
+    else if (end[1] != '\0')
+      return UV_EINVAL;
+
+    if (port <= 0 || port > 65535)
+      return UV_EINVAL;
+  }
+
+  if (len >= sizeof(addr))
+    return UV_EINVAL;
+
+  memcpy(addr, s, len);
+  addr[len] = '\0';
+
+  if (uv_ip4_addr(addr, port, (struct sockaddr_in*) ss) == 0)
+    return 0;
+
+  return uv_ip6_addr(addr, port, (struct sockaddr_in6*) ss);
+}
+
+
+static int uv__dns_option(const char* opt, const char* name) {
+  size_t len;
+
+  len = strlen(name);
+  if (strncmp(opt, name, len) != 0 || opt[len] != ':')
+    return -1;
+
+  return atoi(opt + len + 1);
+}
+
+
+static int uv__dns_load_resolv_conf(struct uv__resolver* r, const char* path) {
+  char line[1024];
+  char* s;
+  char* t;
+  FILE* fp;
+  int n;
+
+  fp = fopen(path != NULL ? path : "/etc/resolv.conf", "r");
+  if (fp == NULL) {
+    /* 和libc一样，没有resolv.conf就用默认配置 */
+    if (path == NULL && errno == ENOENT)
+      return 0;
+    return UV__ERR(errno);
+  }
+
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    s = line;
+    t = uv__dns_token(&s);
+    if (t == NULL)
+      continue;
+
+    if (strcmp(t, "nameserver") == 0) {
+      t = uv__dns_token(&s);
+      if (t != NULL &&
+          r->nns < UV__DNS_MAX_NS &&
+          uv__dns_parse_ns(t, &r->ns[r->nns]) == 0)
+        r->nns++;
+    } else if (strcmp(t, "domain") == 0 || strcmp(t, "search") == 0) {
+      /* 后出现的domain/search覆盖前面的 */
+      while (r->nsearch > 0)
+        uv__free(r->search[--r->nsearch]);
+
+      while ((t = uv__dns_token(&s)) != NULL) {
+        if (r->nsearch == UV__DNS_MAX_SEARCH)
+          break;
+        r->search[r->nsearch] = uv__strdup(t);
+        if (r->search[r->nsearch] == NULL)
+          break;
+        r->nsearch++;
+      }
+    } else if (strcmp(t, "options") == 0) {
+      while ((t = uv__dns_token(&s)) != NULL) {
+        if (strcmp(t, "use-vc") == 0)
+          r->use_vc = 1;
+        else if ((n = uv__dns_option(t, "ndots")) >= 0)
+          r->ndots = n > 15 ? 15 : n;
+        else if ((n = uv__dns_option(t, "timeout")) > 0)
+          r->timeout = (n > 30 ? 30 : n) * 1000;
+        else if ((n = uv__dns_option(t, "attempts")) > 0)
+          r->attempts = n > 5 ? 5 : n;
+      }
+    }
+  }
+
+  fclose(fp);
+  return 0;
+}
+
+
+static int uv__dns_load_hosts(struct uv__resolver* r, const char* path) {
+  struct uv__dns_host* hosts;
+  struct uv__dns_host* h;
+  unsigned char addr[16];
+  char line[1024];
+  char* canon;
+  char* s;
+  char* t;
+  FILE* fp;
+  int family;
+  int err;
+
+  fp = fopen(path != NULL ? path : "/etc/hosts", "r");
+  if (fp == NULL) {
+    if (path == NULL && errno == ENOENT)
+      return 0;
+    return UV__ERR(errno);
+  }
+
+  err = 0;
+  while (err == 0 && fgets(line, sizeof(line), fp) != NULL) {
+    s = line;
+    t = uv__dns_token(&s);
+    if (t == NULL)
+      continue;
+
+    if (uv_inet_pton(AF_INET, t, addr) == 0)
+      family = AF_INET;
+    else if (uv_inet_pton(AF_INET6, t, addr) == 0)
+      family = AF_INET6;
+    else
+      continue;
+
+    canon = NULL;
+    while ((t = uv__dns_token(&s)) != NULL) {
+      hosts = uv__realloc(r->hosts, (r->nhosts + 1) * sizeof(*hosts));
+      if (hosts == NULL) {
+        err = UV_ENOMEM;
+        break;
+      }
+      r->hosts = hosts;
+
+      h = &r->hosts[r->nhosts];
+      h->family = family;
+      memcpy(h->addr, addr, sizeof(addr));
+      h->name = uv__strdup(t);
+      h->canon = uv__strdup(canon != NULL ? canon : t);
+      if (h->name == NULL || h->canon == NULL) {
+        uv__free(h->name);
+        uv__free(h->canon);
+        err = UV_ENOMEM;
+        break;
+      }
+
+      if (canon == NULL)
+        canon = h->name;
+      r->nhosts++;
+    }
+  }
+
+  fclose(fp);
+  return err;
+}
+
+
+static void uv__dns_resolver_free(struct uv__resolver* r) {
+  unsigned int i;
+
+  if (r == NULL)
+    return;
+
+  for (i = 0; i < r->nsearch; i++)
+    uv__free(r->search[i]);
+
+  for (i = 0; i < r->nhosts; i++) {
+    uv__free(r->hosts[i].name);
+    uv__free(r->hosts[i].canon);
+  }
+
+  uv__free(r->hosts);
+  uv__free(r);
+}
+
+
+int uv__resolver_configure(uv_loop_t* loop,
+                           const char* resolv_conf,
+                           const char* hosts) {
+  struct uv__resolver* r;
+  struct uv__resolver* old;
+  int err;
+
+  old = loop->resolver;
+  if (old != NULL && old->nqueries != 0)
+    return UV_EBUSY;
+
+  r = uv__calloc(1, sizeof(*r));
+  if (r == NULL)
+    return UV_ENOMEM;
+
+  /* 和glibc的默认值一样 */
+  r->ndots = 1;
+  r->timeout = 5000;
+  r->attempts = 2;
+  r->seed = (unsigned int) (uv_hrtime() ^ (uint64_t) getpid());
+
+  err = uv__dns_load_resolv_conf(r, resolv_conf);
+  if (err == 0)
+    err = uv__dns_load_hosts(r, hosts);
+
+  if (err) {
+    uv__dns_resolver_free(r);
+    return err;
+  }
+
+  if (r->nns == 0) {
+    uv_ip4_addr("127.0.0.1", 53, (struct sockaddr_in*) &r->ns[0]);
+    r->nns = 1;
+  }
+
+  uv__dns_resolver_free(old);
+  loop->resolver = r;
+  uv__getaddrinfo_track_copies();
+
+  return 0;
+}
+
+
+void uv__resolver_delete(uv_loop_t* loop) {
+  uv__dns_resolver_free(loop->resolver);
+  loop->resolver = NULL;
+}
+
+
+static void uv__dns_add(struct uv__dns_query* q,
+                        int family,
+                        const unsigned char* addr) {
+  struct sockaddr_in6* a6;
+  struct sockaddr_in* a4;
+  unsigned int i;
+
+  for (i = 0; i < q->naddrs; i++) {
+    if (q->addrs[i].ss_family != family)
+      continue;
+
+    if (family == AF_INET) {
+      a4 = (struct sockaddr_in*) &q->addrs[i];
+      if (memcmp(&a4->sin_addr, addr, 4) == 0)
+        return;
+    } else {
+      a6 = (struct sockaddr_in6*) &q->addrs[i];
+      if (memcmp(&a6->sin6_addr, addr, 16) == 0)
+        return;
+    }
+  }
+
+  if (q->naddrs == UV__DNS_MAX_ADDRS)
+    return;
+
+  memset(&q->addrs[q->naddrs], 0, sizeof(q->addrs[0]));
+
+  if (family == AF_INET) {
+    a4 = (struct sockaddr_in*) &q->addrs[q->naddrs];
+    a4->sin_family = AF_INET;
+    a4->sin_port = htons(q->port);
+    memcpy(&a4->sin_addr, addr, 4);
+  } else {
+    a6 = (struct sockaddr_in6*) &q->addrs[q->naddrs];
+    a6->sin6_family = AF_INET6;
+    a6->sin6_port = htons(q->port);
+    memcpy(&a6->sin6_addr, addr, 16);
+  }
+
+  q->naddrs++;
+}
+
+
+/* 把off处的名字（可能有压缩指针）解成点分形式放进out，返回名字在原位置
+ * 之后的偏移，格式不对返回-1
+ */
+static int uv__dns_name(const unsigned char* buf,
+                        size_t len,
+                        size_t off,
+                        char* out) {
+  unsigned int hops;
+  size_t outlen;
+  size_t next;
+  size_t n;
+
+  next = 0;
+  outlen = 0;
+  hops = 0;
+
+  for (;;) {
+    if (off >= len)
+      return -1;
+
+    n = buf[off];
+
+    if ((n & 0xc0) == 0xc0) {
+      if (off + 1 >= len || ++hops > 32)
+        return -1;
+      if (next == 0)
+        next = off + 2;
+      off = ((n & 0x3f) << 8) | buf[off + 1];
+      continue;
+    }
+
+    if (n & 0xc0)
+      return -1;
+
+    if (n == 0)
+      break;
+
+    if (off + 1 + n > len || outlen + n + 1 >= UV__DNS_NAME)
+      return -1;
+
+    if (outlen > 0)
+      out[outlen++] = '.';
+    memcpy(out + outlen, buf + off + 1, n);
+    outlen += n;
+    off += 1 + n;
+  }
+
+  out[outlen] = '\0';
+  return next != 0 ? (int) next : (int) off + 1;
+}
+
+
+static int uv__dns_parse(struct uv__dns_probe* p,
+                         const unsigned char* buf,
+                         size_t len) {
+  struct uv__dns_query* q;
+  char name[UV__DNS_NAME];
+  unsigned int qdcount;
+  unsigned int ancount;
+  unsigned int type;
+  unsigned int cls;
+  unsigned int rdlen;
+  int found;
+  int off;
+
+  q = p->q;
+
+  if (len < 12)
+    return UV__DNS_IGNORE;
+
+  if (((buf[0] << 8) | buf[1]) != p->id || !(buf[2] & 0x80))
+    return UV__DNS_IGNORE;
+
+  qdcount = (buf[4] << 8) | buf[5];
+  ancount = (buf[6] << 8) | buf[7];
+
+  /* 问题部分必须是我们问的，不然可能是伪造的应答 */
+  if (qdcount != 1)
+    return UV__DNS_IGNORE;
+
+  off = uv__dns_name(buf, len, 12, name);
+  if (off < 0 || (size_t) off + 4 > len)
+    return UV__DNS_IGNORE;
+
+  if (strcasecmp(name, q->name) != 0 ||
+      (unsigned int) ((buf[off] << 8) | buf[off + 1]) != (unsigned int) q->types[p->slot])
+    return UV__DNS_IGNORE;
+  off += 4;
+
+  if ((buf[2] & 0x02) && !p->tcp)
+    return UV__DNS_TRUNC;
+
+  switch (buf[3] & 0x0f) {
+    case 0:
+      break;
+    case 3:
+      return UV__DNS_NXDOMAIN;
+    default:
+      return UV__DNS_FAIL;
+  }
+
+  found = 0;
+  while (ancount-- > 0) {
+    off = uv__dns_name(buf, len, off, name);
+    if (off < 0 || (size_t) off + 10 > len)
+      return UV__DNS_FAIL;
+
+    type = (buf[off] << 8) | buf[off + 1];
+    cls = (buf[off + 2] << 8) | buf[off + 3];
+    rdlen = (buf[off + 8] << 8) | buf[off + 9];
+    off += 10;
+
+    if ((size_t) off + rdlen > len)
+      return UV__DNS_FAIL;
+
+    if (cls == UV__DNS_C_IN) {
+      if (type == UV__DNS_T_A && rdlen == 4 &&
+          q->types[p->slot] == UV__DNS_T_A) {
+        uv__dns_add(q, AF_INET, buf + off);
+        found = 1;
+      } else if (type == UV__DNS_T_AAAA && rdlen == 16 &&
+                 q->types[p->slot] == UV__DNS_T_AAAA) {
+        uv__dns_add(q, AF_INET6, buf + off);
+        found = 1;
+      } else if (type == UV__DNS_T_CNAME) {
+        if (uv__dns_name(buf, len, off, name) > 0)
+          memcpy(q->canon, name, sizeof(name));
+      }
+    }
+
+    off += rdlen;
+  }
+
+  return found ? UV__DNS_OK : UV__DNS_NODATA;
+}
+
+
+/* 按RFC 1035编码问题，名字不合法返回-1 */
+static int uv__dns_encode(unsigned char* out,
+                          unsigned short id,
+                          const char* name,
+                          int type) {
+  const char* label;
+  const char* dot;
+  size_t off;
+  size_t n;
+
+  memset(out, 0, 12);
+  out[0] = id >> 8;
+  out[1] = id & 0xff;
+  out[2] = 0x01;                    /* RD */
+  out[5] = 1;                       /* QDCOUNT */
+  off = 12;
+
+  for (label = name; *label != '\0'; label = dot + 1) {
+    dot = strchr(label, '.');
+    if (dot == NULL)
+      dot = label + strlen(label);
+
+    n = dot - label;
+    if (n == 0 || n > 63 || off + 1 + n + 5 > 12 + 255 + 4)
+      return -1;
+
+    out[off++] = n;
+    memcpy(out + off, label, n);
+    off += n;
+
+    if (*dot == '\0')
+      break;
+  }
+
+  out[off++] = 0;
+  out[off++] = type >> 8;
+  out[off++] = type & 0xff;
+  out[off++] = 0;
+  out[off++] = UV__DNS_C_IN;
+
+  return (int) off;
+}
+
+
+static unsigned short uv__dns_id(struct uv__resolver* r) {
+  /* xorshift，只是让ID不好猜；源端口由内核随机分配 */
+  r->seed ^= r->seed << 13;
+  r->seed ^= r->seed >> 17;
+  r->seed ^= r->seed << 5;
+  return r->seed & 0xffff;
+}
+
+
+static void uv__dns_probe_close_cb(uv_handle_t* handle) {
+  struct uv__dns_probe* p;
+
+  p = handle->data;
+  if (--p->closing == 0) {
+    uv__free(p->reply);
+    uv__free(p);
+  }
+}
+
+
+static void uv__dns_probe_close(struct uv__dns_probe* p) {
+  p->q = NULL;
+  p->closing = 2;
+  uv_close((uv_handle_t*) &p->timer, uv__dns_probe_close_cb);
+  uv_close(&p->u.handle, uv__dns_probe_close_cb);
+}
+
+
+static void uv__dns_probe_finish(struct uv__dns_probe* p, int result) {
+  struct uv__dns_probe* next;
+  struct uv__dns_query* q;
+  unsigned int slot;
+
+  q = p->q;
+  slot = p->slot;
+  next = NULL;
+
+  /* 截断的应答用TCP重发给同一个服务器，超时和出错换下一个服务器 */
+  if (result == UV__DNS_TRUNC)
+    next = uv__dns_probe_start(q, slot, p->attempt, 1);
+  else if (result == UV__DNS_FAIL &&
+           p->attempt + 1 < q->r->attempts * q->r->nns)
+    next = uv__dns_probe_start(q, slot, p->attempt + 1, q->r->use_vc);
+
+  uv__dns_probe_close(p);
+  q->probes[slot] = next;
+  if (next != NULL)
+    return;
+
+  if (result == UV__DNS_TRUNC)
+    result = UV__DNS_NOMEM;
+
+  q->results[slot] = result;
+  if (--q->pending == 0)
+    uv__dns_query_next(q);
+}
+
+
+static void uv__dns_timer_cb(uv_timer_t* timer) {
+  struct uv__dns_probe* p;
+
+  p = container_of(timer, struct uv__dns_probe, timer);
+  if (p->q != NULL)
+    uv__dns_probe_finish(p, UV__DNS_FAIL);
+}
+
+
+static void uv__dns_udp_alloc_cb(uv_handle_t* handle,
+                                 size_t suggested_size,
+                                 uv_buf_t* buf) {
+  struct uv__dns_probe* p;
+
+  p = handle->data;
+  *buf = uv_buf_init((char*) p->rbuf, sizeof(p->rbuf));
+}
+
+
+static int uv__dns_same_addr(const struct sockaddr* a,
+                             const struct sockaddr_storage* b) {
+  const struct sockaddr_in6* a6;
+  const struct sockaddr_in6* b6;
+  const struct sockaddr_in* a4;
+  const struct sockaddr_in* b4;
+
+  if (a->sa_family != b->ss_family)
+    return 0;
+
+  if (a->sa_family == AF_INET) {
+    a4 = (const struct sockaddr_in*) a;
+    b4 = (const struct sockaddr_in*) b;
+    return a4->sin_port == b4->sin_port &&
+           a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+  }
+
+  a6 = (const struct sockaddr_in6*) a;
+  b6 = (const struct sockaddr_in6*) b;
+  return a6->sin6_port == b6->sin6_port &&
+         memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+}
+
+
+static void uv__dns_udp_recv_cb(uv_udp_t* handle,
+                                ssize_t nread,
+                                const uv_buf_t* buf,
+                                const struct sockaddr* addr,
+                                unsigned flags) {
+  struct uv__dns_probe* p;
+  struct uv__dns_query* q;
+  int result;
+
+  p = handle->data;
+  q = p->q;
+
+  if (q == NULL || (nread == 0 && addr == NULL))
+    return;
+
+  if (nread < 0) {
+    uv__dns_probe_finish(p, UV__DNS_FAIL);
+    return;
+  }
+
+  if (!uv__dns_same_addr(addr, &q->r->ns[p->attempt % q->r->nns]))
+    return;
+
+  result = uv__dns_parse(p, p->rbuf, nread);
+  if (result == UV__DNS_IGNORE)
+    return;
+
+  if ((flags & UV_UDP_PARTIAL) && result != UV__DNS_NXDOMAIN)
+    result = UV__DNS_TRUNC;
+
+  uv__dns_probe_finish(p, result);
+}
+
+
+static void uv__dns_udp_send_cb(uv_udp_send_t* req, int status) {
+  struct uv__dns_probe* p;
+
+  p = container_of(req, struct uv__dns_probe, send_req);
+  if (status < 0 && p->q != NULL)
+    uv__dns_probe_finish(p, UV__DNS_FAIL);
+}
+
+
+static void uv__dns_tcp_alloc_cb(uv_handle_t* handle,
+                                 size_t suggested_size,
+                                 uv_buf_t* buf) {
+  struct uv__dns_probe* p;
+
+  p = handle->data;
+  *buf = uv_buf_init((char*) p->reply + p->rlen,
+                     2 + UV__DNS_TCP_PACKET - p->rlen);
+}
+
+
+static void uv__dns_tcp_read_cb(uv_stream_t* stream,
+                                ssize_t nread,
+                                const uv_buf_t* buf) {
+  struct uv__dns_probe* p;
+  size_t len;
+  int result;
+
+  p = stream->data;
+  if (p->q == NULL || nread == 0)
+    return;
+
+  if (nread < 0) {
+    uv__dns_probe_finish(p, UV__DNS_FAIL);
+    return;
+  }
+
+  p->rlen += nread;
+  if (p->rlen < 2)
+    return;
+
+  len = (p->reply[0] << 8) | p->reply[1];
+  if (p->rlen < 2 + len)
+    return;
+
+  result = uv__dns_parse(p, p->reply + 2, len);
+  if (result == UV__DNS_IGNORE)
+    result = UV__DNS_FAIL;
+
+  uv__dns_probe_finish(p, result);
+}
+
+
+static void uv__dns_tcp_connect_cb(uv_connect_t* req, int status) {
+  struct uv__dns_probe* p;
+  uv_buf_t buf;
+
+  p = container_of(req, struct uv__dns_probe, connect_req);
+  if (p->q == NULL)
+    return;
+
+  buf = uv_buf_init((char*) p->query, p->qlen + 2);
+  if (status == 0)
+    status = uv_write(&p->write_req, (uv_stream_t*) &p->u.tcp, &buf, 1, NULL);
+  if (status == 0)
+    status = uv_read_start((uv_stream_t*) &p->u.tcp,
+                           uv__dns_tcp_alloc_cb,
+                           uv__dns_tcp_read_cb);
+
+  if (status < 0)
+    uv__dns_probe_finish(p, UV__DNS_FAIL);
+}
+
+
+static struct uv__dns_probe* uv__dns_probe_start(struct uv__dns_query* q,
+                                                 unsigned int slot,
+                                                 unsigned int attempt,
+                                                 int tcp) {
+  const struct sockaddr* ns;
+  struct uv__dns_probe* p;
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  int len;
+  int err;
+
+  p = uv__calloc(1, sizeof(*p));
+  if (p == NULL)
+    return NULL;
+
+  if (tcp) {
+    p->reply = uv__malloc(2 + UV__DNS_TCP_PACKET);
+    if (p->reply == NULL) {
+      uv__free(p);
+      return NULL;
+    }
+  }
+
+  loop = q->req->loop;
+  ns = (const struct sockaddr*) &q->r->ns[attempt % q->r->nns];
+  p->q = q;
+  p->slot = slot;
+  p->attempt = attempt;
+  p->tcp = tcp;
+  p->id = uv__dns_id(q->r);
+
+  /* 候选名字在uv__dns_query_next()里已经检查过，这里不会失败 */
+  len = uv__dns_encode(p->query + 2, p->id, q->name, q->types[slot]);
+  p->qlen = len;
+  p->query[0] = len >> 8;
+  p->query[1] = len & 0xff;
+
+  uv_timer_init(loop, &p->timer);
+  p->timer.flags |= UV_HANDLE_INTERNAL;
+  p->timer.data = p;
+
+  if (tcp) {
+    err = uv_tcp_init(loop, &p->u.tcp);
+    if (err == 0)
+      err = uv_tcp_connect(&p->connect_req,
+                           &p->u.tcp,
+                           ns,
+                           uv__dns_tcp_connect_cb);
+  } else {
+    err = uv_udp_init(loop, &p->u.udp);
+    buf = uv_buf_init((char*) p->query + 2, p->qlen);
+    if (err == 0)
+      err = uv_udp_send(&p->send_req,
+                        &p->u.udp,
+                        &buf,
+                        1,
+                        ns,
+                        uv__dns_udp_send_cb);
+    if (err == 0)
+      err = uv_udp_recv_start(&p->u.udp,
+                              uv__dns_udp_alloc_cb,
+                              uv__dns_udp_recv_cb);
+  }
+
+  /* uv_tcp_init()/uv_udp_init()失败时handle还没初始化，只能在这里释放 */
+  if (p->u.handle.type == UV_UNKNOWN_HANDLE) {
+    p->closing = 1;
+    uv_close((uv_handle_t*) &p->timer, uv__dns_probe_close_cb);
+    return NULL;
+  }
+
+  p->u.handle.flags |= UV_HANDLE_INTERNAL;
+  p->u.handle.data = p;
+
+  /* 发送失败当成超时处理，结果总是在回调里交给query */
+  uv_timer_start(&p->timer,
+                 uv__dns_timer_cb,
+                 err == 0 ? q->r->timeout : 0,
+                 0);
+
+  return p;
+}
+
+
+/* 第i个候选名字：以点结尾的是绝对名字；点数不少于ndots的先试名字本身，
+ * 否则先试加上search里的后缀
+ */
+static int uv__dns_candidate(struct uv__dns_query* q, unsigned int i) {
+  unsigned char packet[UV__DNS_PACKET];
+  struct uv__resolver* r;
+  const char* host;
+  const char* suffix;
+  unsigned int dots;
+  size_t len;
+  size_t n;
+
+  r = q->r;
+  host = q->req->hostname;
+  len = strlen(host);
+  suffix = NULL;
+
+  if (len > 0 && host[len - 1] == '.') {
+    if (i > 0)
+      return UV_ENOENT;
+    len--;
+  } else {
+    if (i > r->nsearch)
+      return UV_ENOENT;
+
+    for (dots = 0, n = 0; n < len; n++)
+      dots += host[n] == '.';
+
+    if (dots >= r->ndots) {
+      if (i > 0)
+        suffix = r->search[i - 1];
+    } else if (i < r->nsearch) {
+      suffix = r->search[i];
+    }
+  }
+
+  n = len;
+  if (suffix != NULL)
+    n += 1 + strlen(suffix);
+
+  if (len == 0 || n >= sizeof(q->name))
+    return UV_EINVAL;
+
+  memcpy(q->name, host, len);
+  q->name[len] = '\0';
+  if (suffix != NULL) {
+    q->name[len] = '.';
+    strcpy(q->name + len + 1, suffix);
+  }
+
+  if (uv__dns_encode(packet, 0, q->name, 0) < 0)
+    return UV_EINVAL;
+
+  return 0;
+}
+
+
+static void uv__dns_query_done(struct uv__dns_query* q, int status) {
+  const char* canon;
+
+  canon = NULL;
+  if (status == 0)
+    canon = q->canon[0] != '\0' ? q->canon : q->name;
+
+  q->r->nqueries--;
+  uv__getaddrinfo_resolved(q->req, status, q->addrs, q->naddrs, canon);
+  uv__free(q);
+}
+
+
+/* 当前候选名字的probe都结束了：有地址就完成，名字不存在就试下一个，
+ * 服务器没有回答就不再往下试了
+ */
+static void uv__dns_query_next(struct uv__dns_query* q) {
+  unsigned int i;
+  int err;
+
+  if (q->naddrs > 0) {
+    uv__dns_query_done(q, 0);
+    return;
+  }
+
+  for (i = 0; i < q->ntypes && q->candidate > 0; i++) {
+    if (q->results[i] == UV__DNS_NOMEM) {
+      uv__dns_query_done(q, UV_EAI_MEMORY);
+      return;
+    }
+    if (q->results[i] == UV__DNS_FAIL) {
+      uv__dns_query_done(q, UV_EAI_AGAIN);
+      return;
+    }
+  }
+
+  for (;;) {
+    err = uv__dns_candidate(q, q->candidate);
+    if (err == UV_ENOENT) {
+      uv__dns_query_done(q, UV_EAI_NONAME);
+      return;
+    }
+
+    q->candidate++;
+    if (err == 0)
+      break;
+  }
+
+  q->canon[0] = '\0';
+  q->pending = 0;
+
+  /* probe的结果总是在回调里交回来，这里不会重入 */
+  for (i = 0; i < q->ntypes; i++) {
+    q->results[i] = UV__DNS_NOMEM;
+    q->probes[i] = uv__dns_probe_start(q, i, 0, q->r->use_vc);
+    if (q->probes[i] != NULL)
+      q->pending++;
+  }
+
+  if (q->pending == 0)
+    uv__dns_query_done(q, UV_EAI_MEMORY);
+}
+
+
+static int uv__dns_lookup_hosts(struct uv__dns_query* q) {
+  struct uv__dns_host* h;
+  const char* host;
+  const char* canon;
+  unsigned int i;
+  unsigned int t;
+  size_t len;
+
+  host = q->req->hostname;
+  len = strlen(host);
+  if (len > 0 && host[len - 1] == '.')
+    len--;
+
+  canon = NULL;
+  for (i = 0; i < q->r->nhosts; i++) {
+    h = &q->r->hosts[i];
+    if (strncasecmp(h->name, host, len) != 0 || h->name[len] != '\0')
+      continue;
+
+    for (t = 0; t < q->ntypes; t++)
+      if (q->types[t] == (h->family == AF_INET ? UV__DNS_T_A : UV__DNS_T_AAAA))
+        break;
+
+    if (t == q->ntypes)
+      continue;
+
+    uv__dns_add(q, h->family, h->addr);
+    if (canon == NULL)
+      canon = h->canon;
+  }
+
+  if (canon == NULL)
+    return 0;
+
+  uv__getaddrinfo_resolved(q->req, 0, q->addrs, q->naddrs, canon);
+  return 1;
+}
+
+
+int uv__resolver_getaddrinfo(uv_getaddrinfo_t* req) {
+  const struct addrinfo* hints;
+  struct uv__dns_query* q;
+  unsigned char addr[16];
+  unsigned long port;
+  char* end;
+  int family;
+
+  if (req->loop->resolver == NULL || req->hostname == NULL)
+    return UV_ENOSYS;
+
+  /* 数字地址、服务名和解析器不支持的flags交给getaddrinfo() */
+  hints = req->hints;
+  family = hints != NULL ? hints->ai_family : AF_UNSPEC;
+  if (family != AF_UNSPEC && family != AF_INET && family != AF_INET6)
+    return UV_ENOSYS;
+
+  if (hints != NULL &&
+      (hints->ai_flags & ~(AI_CANONNAME | AI_ADDRCONFIG | AI_NUMERICSERV)))
+    return UV_ENOSYS;
+
+  if (uv_inet_pton(AF_INET, req->hostname, addr) == 0 ||
+      uv_inet_pton(AF_INET6, req->hostname, addr) == 0)
+    return UV_ENOSYS;
+
+  port = 0;
+  if (req->service != NULL) {
+    port = strtoul(req->service, &end, 10);
+    if (*req->service == '\0' || *end != '\0' || port > 65535)
+      return UV_ENOSYS;
+  }
+
+  q = uv__calloc(1, sizeof(*q));
+  if (q == NULL)
+    return UV_ENOSYS;
+
+  q->req = req;
+  q->r = req->loop->resolver;
+  q->port = port;
+
+  if (family != AF_INET6)
+    q->types[q->ntypes++] = UV__DNS_T_A;
+  if (family != AF_INET)
+    q->types[q->ntypes++] = UV__DNS_T_AAAA;
+
+  if (uv__dns_lookup_hosts(q)) {
+    uv__free(q);
+    return 0;
+  }
+
+  q->r->nqueries++;
+  uv__dns_query_next(q);
+
+  return 0;
+}
@@ -0,0 +1,609 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "uv.h"
+#include "internal.h"
+#include "atomic-ops.h"
+
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct uv__runtime;
+
+/* 投递给某个loop的一次回调 */
+struct uv__runtime_msg {
+  uv_mpsc_node_t node;
+  uv_runtime_cb cb;
+  void* arg;
+};
+
+struct uv__runtime_loop {
+  uv_mpsc_queue_t mailbox;
+  uv_loop_t loop;
+  uv_async_t async;
+  uv_thread_t tid;
+  struct uv__runtime* r;
+  unsigned int id;
+  int senders;  /* 正在往mailbox里投递的线程个数 */
+  QUEUE listeners;
+};
+
+/* uv_runtime_listen()在一个loop上的监听套接字 */
+struct uv__runtime_listener {
+  uv_tcp_t tcp;
+  QUEUE queue;
+  uv_connection_cb cb;
+  unsigned int set;
+  int injecting;  /* 正在交付别的loop转过来的连接，不再转发 */
+};
+
+/* 转给另一个loop的新连接 */
+struct uv__runtime_handoff {
+  unsigned int set;
+  int fd;
+};
+
+/* 在loop线程里执行、调用方等待结果的请求 */
+struct uv__runtime_call {
+  uv_sem_t sem;
+  struct sockaddr_storage addr;
+  int backlog;
+  uv_connection_cb cb;
+  void* data;
+  unsigned int set;
+  int err;
+};
+
+struct uv__runtime {
+  unsigned int nloops;
+  unsigned int nsets;
+  unsigned int flags;
+  int stopping;
+  uv_key_t self;  /* 每个线程自己的struct uv__runtime_loop */
+  struct uv__runtime_loop* loops;
+};
+
+
+static void uv__runtime_mailbox_cb(uv_async_t* handle) {
+  struct uv__runtime_loop* l;
+  struct uv__runtime_msg* msg;
+  uv_mpsc_node_t* node;
+
+  l = container_of(handle, struct uv__runtime_loop, async);
+  while ((node = uv_mpsc_queue_pop(&l->mailbox)) != NULL) {
+    msg = container_of(node, struct uv__runtime_msg, node);
+    msg->cb(&l->loop, msg->arg);
+    uv__free(msg);
+  }
+}
+
+
+static int uv__runtime_send(struct uv__runtime_loop* l,
+                            uv_runtime_cb cb,
+                            void* arg) {
+  struct uv__runtime_msg* msg;
+
+  msg = uv__malloc(sizeof(*msg));
+  if (msg == NULL)
+    return UV_ENOMEM;
+
+  msg->cb = cb;
+  msg->arg = arg;
+  uv_mpsc_queue_push(&l->mailbox, &msg->node);
+  return uv_async_send(&l->async);
+}
+
+
+/* 和uv_runtime_destroy()配合：先登记再检查stopping，destroy先设置stopping
+ * 再等所有登记过的线程离开，所以不会有回调投递到已经停止的loop上
+ */
+static int uv__runtime_post(struct uv__runtime* r,
+                            unsigned int id,
+                            uv_runtime_cb cb,
+                            void* arg) {
+  struct uv__runtime_loop* l;
+  int err;
+
+  l = r->loops + id;
+  fetch_addi(&l->senders, 1);
+  if (ACCESS_ONCE(int, r->stopping)) {
+    fetch_addi(&l->senders, -1);
+    return UV_EINVAL;
+  }
+
+  err = uv__runtime_send(l, cb, arg);
+  fetch_addi(&l->senders, -1);
+  return err;
+}
+
+
+static void uv__runtime_thread(void* arg) {
+  struct uv__runtime_loop* l;
+
+  l = arg;
+  uv_key_set(&l->r->self, l);
+  uv_run(&l->loop, UV_RUN_DEFAULT);
+}
+
+
+static void uv__runtime_listener_close_cb(uv_handle_t* handle) {
+  uv__free(container_of(handle, struct uv__runtime_listener, tcp));
+}
+
+
+static void uv__runtime_close_walk_cb(uv_handle_t* handle, void* arg) {
+  if (!uv_is_closing(handle))
+    uv_close(handle, NULL);
+}
+
+
+/* 在loop线程里关闭运行时的handle，loop随后退出 */
+static void uv__runtime_stop_cb(uv_loop_t* loop, void* arg) {
+  struct uv__runtime_loop* l;
+  struct uv__runtime_listener* lis;
+  QUEUE* q;
+
+  l = container_of(loop, struct uv__runtime_loop, loop);
+  while (!QUEUE_EMPTY(&l->listeners)) {
+    q = QUEUE_HEAD(&l->listeners);
+    QUEUE_REMOVE(q);
+    lis = QUEUE_DATA(q, struct uv__runtime_listener, queue);
+    uv_close((uv_handle_t*) &lis->tcp, uv__runtime_listener_close_cb);
+  }
+
+  uv_walk(loop, uv__runtime_close_walk_cb, NULL);
+}
+
+
+/* 新连接应该由哪个loop处理。网卡队列的NAPI ID和处理软中断的CPU取模映射到
+ * loop上，同一个队列的连接都落在同一个loop里，配合UV_RUNTIME_PIN_CPUS时
+ * 数据包从收到到处理都在一个CPU上。拿不到的时候留在当前loop。
+ */
+static unsigned int uv__runtime_route(struct uv__runtime_loop* l, int fd) {
+  struct uv__runtime* r;
+  unsigned int napi_id;
+  int cpu;
+
+  r = l->r;
+  if (uv__fd_incoming(fd, &cpu, &napi_id))
+    return l->id;
+
+  if ((r->flags & UV_RUNTIME_ROUTE_NAPI) && napi_id != 0)
+    return napi_id % r->nloops;
+
+  if ((r->flags & UV_RUNTIME_ROUTE_CPU) && cpu >= 0)
+    return (unsigned int) cpu % r->nloops;
+
+  return l->id;
+}
+
+
+/* 在目标loop里把转过来的连接交给同一组的监听套接字 */
+static void uv__runtime_handoff_cb(uv_loop_t* loop, void* arg) {
+  struct uv__runtime_handoff* h;
+  struct uv__runtime_listener* lis;
+  struct uv__runtime_loop* l;
+  QUEUE* q;
+
+  l = container_of(loop, struct uv__runtime_loop, loop);
+  h = arg;
+
+  QUEUE_FOREACH(q, &l->listeners) {
+    lis = QUEUE_DATA(q, struct uv__runtime_listener, queue);
+    if (lis->set != h->set)
+      continue;
+
+    lis->injecting++;
+    uv__server_accepted((uv_stream_t*) &lis->tcp, h->fd);
+    lis->injecting--;
+    uv__free(h);
+    return;
+  }
+
+  /* 这一组已经停止监听 */
+  uv__close(h->fd);
+  uv__free(h);
+}
+
+
+/* 设置了UV_RUNTIME_ROUTE_*时监听套接字的连接回调：不属于这个loop的连接
+ * 转给对应的loop，剩下的交给用户的回调
+ */
+static void uv__runtime_connection_cb(uv_stream_t* server, int status) {
+  struct uv__runtime_listener* lis;
+  struct uv__runtime_handoff* h;
+  struct uv__runtime_loop* l;
+  unsigned int id;
+
+  lis = container_of(server, struct uv__runtime_listener, tcp);
+  l = container_of(server->loop, struct uv__runtime_loop, loop);
+
+  while (status == 0 && lis->injecting == 0 && server->accepted_fd != -1) {
+    id = uv__runtime_route(l, server->accepted_fd);
+    if (id == l->id)
+      break;
+
+    h = uv__malloc(sizeof(*h));
+    if (h == NULL)
+      break;
+
+    h->set = lis->set;
+    h->fd = server->accepted_fd;
+    if (uv__runtime_post(l->r, id, uv__runtime_handoff_cb, h)) {
+      uv__free(h);
+      break;
+    }
+
+    uv__server_take_fd(server);
+  }
+
+  if (status != 0 || server->accepted_fd != -1)
+    lis->cb(server, status);
+}
+
+
+static void uv__runtime_listen_cb(uv_loop_t* loop, void* arg) {
+  struct uv__runtime_listener* lis;
+  struct uv__runtime_call* call;
+  struct uv__runtime_loop* l;
+  uv_connection_cb cb;
+  int namelen;
+  int err;
+
+  l = container_of(loop, struct uv__runtime_loop, loop);
+  call = arg;
+
+  lis = uv__malloc(sizeof(*lis));
+  if (lis == NULL) {
+    call->err = UV_ENOMEM;
+    uv_sem_post(&call->sem);
+    return;
+  }
+
+  err = uv_tcp_init(loop, &lis->tcp);
+  if (err) {
+    uv__free(lis);
+    call->err = err;
+    uv_sem_post(&call->sem);
+    return;
+  }
+
+  cb = call->cb;
+  if (l->r->flags & (UV_RUNTIME_ROUTE_CPU | UV_RUNTIME_ROUTE_NAPI))
+    cb = uv__runtime_connection_cb;
+
+  lis->tcp.data = call->data;
+  lis->cb = call->cb;
+  lis->set = call->set;
+  lis->injecting = 0;
+  err = uv_tcp_bind(&lis->tcp,
+                    (const struct sockaddr*) &call->addr,
+                    UV_TCP_REUSEPORT);
+  if (err == 0)
+    err = uv_listen((uv_stream_t*) &lis->tcp, call->backlog, cb);
+
+  /* 端口为0时后面的loop绑定到同一个端口 */
+  if (err == 0) {
+    namelen = sizeof(call->addr);
+    err = uv_tcp_getsockname(&lis->tcp,
+                             (struct sockaddr*) &call->addr,
+                             &namelen);
+  }
+
+  if (err == 0)
+    QUEUE_INSERT_TAIL(&l->listeners, &lis->queue);
+  else
+    uv_close((uv_handle_t*) &lis->tcp, uv__runtime_listener_close_cb);
+
+  call->err = err;
+  uv_sem_post(&call->sem);
+}
+
+
+static void uv__runtime_unlisten_cb(uv_loop_t* loop, void* arg) {
+  struct uv__runtime_listener* lis;
+  struct uv__runtime_call* call;
+  struct uv__runtime_loop* l;
+  QUEUE* q;
+
+  l = container_of(loop, struct uv__runtime_loop, loop);
+  call = arg;
+
+  q = QUEUE_HEAD(&l->listeners);
+  while (q != &l->listeners) {
+    lis = QUEUE_DATA(q, struct uv__runtime_listener, queue);
+    q = QUEUE_NEXT(q);
+    if (lis->set != call->set)
+      continue;
+
+    QUEUE_REMOVE(&lis->queue);
+    uv_close((uv_handle_t*) &lis->tcp, uv__runtime_listener_close_cb);
+  }
+
+  uv_sem_post(&call->sem);
+}
+
+
+/* 停掉前n个loop的线程并关闭全部loop */
+static void uv__runtime_shutdown(struct uv__runtime* r, unsigned int n) {
+  struct uv__runtime_loop* l;
+  unsigned int i;
+
+  for (i = 0; i < n; i++) {
+    l = r->loops + i;
+    if (uv__runtime_send(l, uv__runtime_stop_cb, NULL))
+      abort();
+  }
+
+  for (i = 0; i < n; i++)
+    uv_thread_join(&r->loops[i].tid);
+
+  /* 没有启动线程的loop在这里关闭 */
+  for (i = n; i < r->nloops; i++) {
+    l = r->loops + i;
+    uv__runtime_stop_cb(&l->loop, NULL);
+    uv_run(&l->loop, UV_RUN_DEFAULT);
+  }
+
+  for (i = 0; i < r->nloops; i++) {
+    l = r->loops + i;
+    /* 线程退出前投递的回调都已经执行完 */
+    assert(uv_mpsc_queue_pop(&l->mailbox) == NULL);
+    if (uv_loop_close(&l->loop))
+      abort();
+  }
+
+  uv_key_delete(&r->self);
+  uv__free(r->loops);
+  uv__free(r);
+}
+
+
+int uv_runtime_init(uv_runtime_t* rt, unsigned int nloops, unsigned int flags) {
+  uv_thread_options_t options;
+  struct uv__runtime_loop* l;
+  struct uv__runtime* r;
+  uv_cpu_info_t* cpus;
+  char* cpumask;
+  unsigned int i;
+  int mask_size;
+  int ncpus;
+  int err;
+
+  if (flags & ~(UV_RUNTIME_PIN_CPUS |
+                UV_RUNTIME_ROUTE_CPU |
+                UV_RUNTIME_ROUTE_NAPI))
+    return UV_EINVAL;
+
+  err = uv_cpu_info(&cpus, &ncpus);
+  if (err)
+    return err;
+  uv_free_cpu_info(cpus, ncpus);
+  if (ncpus <= 0)
+    ncpus = 1;
+
+  if (nloops == 0)
+    nloops = ncpus;
+
+  mask_size = 0;
+  if (flags & UV_RUNTIME_PIN_CPUS) {
+    mask_size = uv_cpumask_size();
+    if (mask_size < 0)
+      return mask_size;
+  }
+
+  r = uv__calloc(1, sizeof(*r));
+  if (r == NULL)
+    return UV_ENOMEM;
+
+  r->flags = flags;
+
+  r->loops = uv__calloc(nloops, sizeof(r->loops[0]));
+  cpumask = mask_size > 0 ? uv__malloc(mask_size) : NULL;
+  if (r->loops == NULL || (mask_size > 0 && cpumask == NULL)) {
+    err = UV_ENOMEM;
+    goto error;
+  }
+
+  err = uv_key_create(&r->self);
+  if (err)
+    goto error;
+
+  for (i = 0; i < nloops; i++) {
+    l = r->loops + i;
+    err = uv_loop_init(&l->loop);
+    if (err == 0) {
+      err = uv_async_init(&l->loop, &l->async, uv__runtime_mailbox_cb);
+      if (err)
+        uv_loop_close(&l->loop);
+    }
+
+    if (err) {
+      r->nloops = i;
+      uv__runtime_shutdown(r, 0);
+      uv__free(cpumask);
+      return err;
+    }
+
+    uv_mpsc_queue_init(&l->mailbox);
+    QUEUE_INIT(&l->listeners);
+    l->r = r;
+    l->id = i;
+  }
+  r->nloops = nloops;
+
+  memset(&options, 0, sizeof(options));
+  for (i = 0; i < nloops; i++) {
+    l = r->loops + i;
+    if (cpumask != NULL) {
+      memset(cpumask, 0, mask_size);
+      cpumask[i % ncpus] = 1;
+      options.flags = UV_THREAD_HAS_CPUMASK;
+      options.cpumask = cpumask;
+      options.cpumask_size = mask_size;
+    }
+
+    err = uv_thread_create_ex(&l->tid, &options, uv__runtime_thread, l);
+    if (err) {
+      uv__runtime_shutdown(r, i);
+      uv__free(cpumask);
+      return err;
+    }
+  }
+
+  uv__free(cpumask);
+  rt->nloops = nloops;
+  rt->impl = r;
+  return 0;
+
+error:
+  uv__free(cpumask);
+  uv__free(r->loops);
+  uv__free(r);
+  return err;
+}
+
+
+uv_loop_t* uv_runtime_loop(uv_runtime_t* rt, unsigned int id) {
+  struct uv__runtime* r;
+
+  r = rt->impl;
+  if (r == NULL || id >= r->nloops)
+    return NULL;
+
+  return &r->loops[id].loop;
+}
+
+
+int uv_runtime_id(const uv_runtime_t* rt) {
+  struct uv__runtime_loop* l;
+  struct uv__runtime* r;
+
+  r = rt->impl;
+  if (r == NULL)
+    return UV_EINVAL;
+
+  l = uv_key_get(&r->self);
+  if (l == NULL)
+    return UV_EINVAL;
+
+  return l->id;
+}
+
+
+int uv_runtime_post(uv_runtime_t* rt,
+                    unsigned int id,
+                    uv_runtime_cb cb,
+                    void* arg) {
+  struct uv__runtime* r;
+
+  r = rt->impl;
+  if (r == NULL || id >= r->nloops || cb == NULL)
+    return UV_EINVAL;
+
+  return uv__runtime_post(r, id, cb, arg);
+}
+
+
+/* 在第i个loop的线程里执行cb并等它完成 */
+static void uv__runtime_call(struct uv__runtime* r,
+                             unsigned int i,
+                             uv_runtime_cb cb,
+                             struct uv__runtime_call* call) {
+  if (uv__runtime_send(r->loops + i, cb, call))
+    abort();
+  uv_sem_wait(&call->sem);
+}
+
+
+int uv_runtime_listen(uv_runtime_t* rt,
+                      const struct sockaddr* addr,
+                      int backlog,
+                      uv_connection_cb cb,
+                      void* data) {
+  struct uv__runtime_call call;
+  struct uv__runtime* r;
+  unsigned int i;
+  size_t addrlen;
+  int err;
+
+  r = rt->impl;
+  if (r == NULL || r->stopping || cb == NULL)
+    return UV_EINVAL;
+
+  if (addr->sa_family == AF_INET)
+    addrlen = sizeof(struct sockaddr_in);
+  else if (addr->sa_family == AF_INET6)
+    addrlen = sizeof(struct sockaddr_in6);
+  else
+    return UV_EINVAL;
+
+  if (uv_runtime_id(rt) >= 0)
+    return UV_EINVAL;
+
+  err = uv_sem_init(&call.sem, 0);
+  if (err)
+    return err;
+
+  memset(&call.addr, 0, sizeof(call.addr));
+  memcpy(&call.addr, addr, addrlen);
+  call.backlog = backlog;
+  call.cb = cb;
+  call.data = data;
+  call.set = ++r->nsets;
+
+  for (i = 0; i < r->nloops; i++) {
+    uv__runtime_call(r, i, uv__runtime_listen_cb, &call);
+    err = call.err;
+    if (err)
+      break;
+  }
+
+  if (err)
+    while (i-- > 0)
+      uv__runtime_call(r, i, uv__runtime_unlisten_cb, &call);
+
+  uv_sem_destroy(&call.sem);
+  return err;
+}
+
+
+int uv_runtime_destroy(uv_runtime_t* rt) {
+  struct uv__runtime* r;
+  unsigned int i;
+
+  r = rt->impl;
+  if (r == NULL || uv_runtime_id(rt) >= 0)
+    return UV_EINVAL;
+
+  /* cmpxchgi()是完整的内存屏障，之后读到的senders为0就不会再有新的投递 */
+  cmpxchgi(&r->stopping, 0, 1);
+  for (i = 0; i < r->nloops; i++)
+    while (ACCESS_ONCE(int, r->loops[i].senders) != 0)
+      sched_yield();
+
+  uv__runtime_shutdown(r, r->nloops);
+  rt->impl = NULL;
+  return 0;
+}
@@ -0,0 +1,603 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "internal.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#if defined(__linux__)
+# include <sys/syscall.h>
+#endif
+
+/* 建立通道时第一条消息的头，后面跟着共享内存的fd */
+#define UV__SHM_MAGIC 0x75767368  /* "uvsh" */
+#define UV__SHM_MIN_SIZE 4096
+#define UV__SHM_MAX_SIZE (1u << 30)
+/* 记录的长度字段，这个值表示跳到环的开头 */
+#define UV__SHM_WRAP 0xffffffffu
+/* 叫醒对端的字节：有数据了，或者腾出空间了 */
+#define UV__SHM_WAKE_READ 'r'
+#define UV__SHM_WAKE_WRITE 'w'
+
+#if defined(MSG_NOSIGNAL)
+# define UV__SHM_SEND_FLAGS MSG_NOSIGNAL
+#else
+# define UV__SHM_SEND_FLAGS 0
+#endif
+
+/* 环的头，生产者和消费者写的字段放在不同的cache line上。环的大小是2的幂，
+ * head和tail是一直往上加的字节位置，不回绕
+ */
+typedef struct {
+  uint64_t tail;             /* 生产者写 */
+  uint64_t size;
+  char pad0[48];
+  uint64_t head;             /* 消费者写 */
+  char pad1[56];
+  int reader_waiting;        /* 消费者睡之前置1，生产者看到就叫醒它 */
+  int writer_waiting;        /* 生产者发现环满了置1，消费者看到就叫醒它 */
+  char pad2[56];
+} uv__shm_ring_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t reserved;
+  uint64_t size;
+} uv__shm_hello_t;
+
+#define UV__SHM_RING_DATA(r) ((char*) (r) + sizeof(uv__shm_ring_t))
+
+
+static void uv__shm_channel_io(uv_loop_t* loop, uv__io_t* w, unsigned int events);
+
+
+static size_t uv__shm_map_size(uint64_t size) {
+  return 2 * (sizeof(uv__shm_ring_t) + (size_t) size);
+}
+
+
+/* 只有对端睡着（或者在等空间）时才走系统调用。socket缓冲区满了说明对端
+ * 已经有没读的叫醒字节，不用再发
+ */
+static int uv__shm_channel_wake(uv_shm_channel_t* handle, char c) {
+  ssize_t n;
+
+  do
+    n = send(handle->io_watcher.fd, &c, 1, UV__SHM_SEND_FLAGS);
+  while (n == -1 && errno == EINTR);
+
+  if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+    return UV__ERR(errno);
+
+  return 0;
+}
+
+
+static int uv__shm_memfd(size_t size) {
+  int fd;
+
+#if defined(__linux__) && defined(__NR_memfd_create)
+  /* MFD_CLOEXEC */
+  fd = syscall(__NR_memfd_create, "libuv-shm", 1);
+  if (fd == -1)
+    return UV__ERR(errno);
+#elif defined(__linux__)
+  return UV_ENOSYS;
+#else
+  char name[64];
+  static unsigned int counter;
+
+  snprintf(name, sizeof(name), "/uv-shm-%d-%u", (int) getpid(), counter++);
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd == -1)
+    return UV__ERR(errno);
+  shm_unlink(name);
+  uv__cloexec(fd, 1);
+#endif
+
+  if (ftruncate(fd, size)) {
+    uv__close(fd);
+    return UV__ERR(errno);
+  }
+
+  return fd;
+}
+
+
+static int uv__shm_channel_map(uv_shm_channel_t* handle,
+                               int memfd,
+                               uint64_t size,
+                               int creator) {
+  uv__shm_ring_t* rings[2];
+  size_t map_size;
+  void* map;
+
+  map_size = uv__shm_map_size(size);
+  map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+  if (map == MAP_FAILED)
+    return UV__ERR(errno);
+
+  rings[0] = map;
+  rings[1] = (uv__shm_ring_t*) ((char*) map + map_size / 2);
+
+  /* 创建的一端往0号环写、从1号环读，对端反过来 */
+  handle->map = map;
+  handle->map_size = map_size;
+  handle->tx = rings[creator ? 0 : 1];
+  handle->rx = rings[creator ? 1 : 0];
+  return 0;
+}
+
+
+int uv_shm_channel_init(uv_loop_t* loop, uv_shm_channel_t* handle) {
+  uv__handle_init(loop, (uv_handle_t*) handle, UV_SHM_CHANNEL);
+  uv__io_init(&handle->io_watcher, uv__shm_channel_io, -1);
+  handle->recv_cb = NULL;
+  handle->writable_cb = NULL;
+  handle->map = NULL;
+  handle->map_size = 0;
+  handle->tx = NULL;
+  handle->rx = NULL;
+  handle->want_writable = 0;
+  return 0;
+}
+
+
+int uv_shm_channel_create(uv_shm_channel_t* handle,
+                          size_t size,
+                          uv_pipe_t* peer) {
+  uv__shm_ring_t* ring;
+  uv__shm_hello_t hello;
+  struct msghdr msg;
+  struct cmsghdr* cmsg;
+  struct iovec iov;
+  union {
+    char data[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr alias;
+  } scratch;
+  uint64_t ring_size;
+  ssize_t n;
+  int fds[2];
+  int memfd;
+  int err;
+  int i;
+
+  if (handle->map != NULL || size > UV__SHM_MAX_SIZE)
+    return UV_EINVAL;
+
+  if (peer->type != UV_NAMED_PIPE || peer->ipc || uv__stream_fd(peer) != -1)
+    return UV_EINVAL;
+
+  ring_size = UV__SHM_MIN_SIZE;
+  while (ring_size < size)
+    ring_size <<= 1;
+
+  memfd = uv__shm_memfd(uv__shm_map_size(ring_size));
+  if (memfd < 0)
+    return memfd;
+
+  err = uv__shm_channel_map(handle, memfd, ring_size, 1);
+  if (err)
+    goto fail_map;
+
+  /* 两个环一开始都是空的，读的一端算是睡着的，第一条消息会叫醒它 */
+  for (i = 0; i < 2; i++) {
+    ring = i == 0 ? handle->tx : handle->rx;
+    memset(ring, 0, sizeof(*ring));
+    ring->size = ring_size;
+    ring->reader_waiting = 1;
+  }
+
+  err = uv__make_socketpair(fds, 0);
+  if (err)
+    goto fail_socketpair;
+
+  /* 共享内存的fd先放进socket里，对端拿到另一头的fd以后一次recvmsg()取出 */
+  memset(&hello, 0, sizeof(hello));
+  hello.magic = UV__SHM_MAGIC;
+  hello.size = ring_size;
+  iov.iov_base = &hello;
+  iov.iov_len = sizeof(hello);
+
+  memset(&scratch, 0, sizeof(scratch));
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = &scratch.alias;
+  msg.msg_controllen = CMSG_SPACE(sizeof(memfd));
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(memfd));
+  memcpy(CMSG_DATA(cmsg), &memfd, sizeof(memfd));
+
+  do
+    n = sendmsg(fds[0], &msg, 0);
+  while (n == -1 && errno == EINTR);
+
+  if (n != (ssize_t) sizeof(hello)) {
+    err = n == -1 ? UV__ERR(errno) : UV_EIO;
+    goto fail_send;
+  }
+
+  err = uv__nonblock(fds[0], 1);
+  if (err)
+    goto fail_send;
+
+  err = uv_pipe_open(peer, fds[1]);
+  if (err)
+    goto fail_send;
+
+  uv__close(memfd);
+  handle->io_watcher.fd = fds[0];
+  return 0;
+
+fail_send:
+  uv__close(fds[0]);
+  uv__close(fds[1]);
+
+fail_socketpair:
+  munmap(handle->map, handle->map_size);
+  handle->map = NULL;
+
+fail_map:
+  uv__close(memfd);
+  return err;
+}
+
+
+int uv_shm_channel_open(uv_shm_channel_t* handle, uv_pipe_t* peer) {
+  uv__shm_hello_t hello;
+  struct msghdr msg;
+  struct cmsghdr* cmsg;
+  struct iovec iov;
+  union {
+    char data[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr alias;
+  } scratch;
+  ssize_t n;
+  int memfd;
+  int err;
+  int fd;
+
+  if (handle->map != NULL)
+    return UV_EINVAL;
+
+  if (peer->type != UV_NAMED_PIPE || uv__stream_fd(peer) == -1)
+    return UV_EINVAL;
+
+  /* pipe由用户关掉，这里留一份自己的 */
+  do
+    fd = fcntl(uv__stream_fd(peer), F_DUPFD_CLOEXEC, 0);
+  while (fd == -1 && errno == EINTR);
+
+  if (fd == -1)
+    return UV__ERR(errno);
+
+  iov.iov_base = &hello;
+  iov.iov_len = sizeof(hello);
+  memset(&scratch, 0, sizeof(scratch));
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = &scratch.alias;
+  msg.msg_controllen = sizeof(scratch);
+
+  do
+    n = recvmsg(fd, &msg, 0);
+  while (n == -1 && errno == EINTR);
+
+  if (n == -1) {
+    err = UV__ERR(errno);
+    goto fail;
+  }
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if (n != (ssize_t) sizeof(hello) ||
+      hello.magic != UV__SHM_MAGIC ||
+      hello.size < UV__SHM_MIN_SIZE ||
+      hello.size > UV__SHM_MAX_SIZE ||
+      (hello.size & (hello.size - 1)) != 0 ||
+      cmsg == NULL ||
+      cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(memfd))) {
+    err = UV_EPROTO;
+    goto fail;
+  }
+
+  memcpy(&memfd, CMSG_DATA(cmsg), sizeof(memfd));
+  uv__cloexec(memfd, 1);
+
+  err = uv__shm_channel_map(handle, memfd, hello.size, 0);
+  uv__close(memfd);
+  if (err)
+    goto fail;
+
+  err = uv__nonblock(fd, 1);
+  if (err) {
+    munmap(handle->map, handle->map_size);
+    handle->map = NULL;
+    goto fail;
+  }
+
+  handle->io_watcher.fd = fd;
+  return 0;
+
+fail:
+  uv__close(fd);
+  return err;
+}
+
+
+int uv_shm_channel_start(uv_shm_channel_t* handle,
+                         uv_shm_channel_cb cb,
+                         uv_shm_channel_writable_cb writable_cb) {
+  if (cb == NULL || handle->map == NULL || uv__is_closing(handle))
+    return UV_EINVAL;
+
+  handle->recv_cb = cb;
+  handle->writable_cb = writable_cb;
+
+  if (uv__is_active(handle))
+    return 0;
+
+  uv__io_start(handle->loop, &handle->io_watcher, POLLIN);
+  uv__handle_start(handle);
+
+  /* 停下的时候可能还有没读的消息，对端以为我们醒着不会再叫 */
+  uv__io_feed(handle->loop, &handle->io_watcher);
+  return 0;
+}
+
+
+int uv_shm_channel_stop(uv_shm_channel_t* handle) {
+  if (!uv__is_active(handle))
+    return 0;
+
+  uv__io_stop(handle->loop, &handle->io_watcher, POLLIN);
+  uv__handle_stop(handle);
+  return 0;
+}
+
+
+int uv_shm_channel_try_send(uv_shm_channel_t* handle,
+                            const uv_buf_t bufs[],
+                            unsigned int nbufs) {
+  uv__shm_ring_t* ring;
+  uint64_t head;
+  uint64_t tail;
+  uint64_t need;
+  uint64_t size;
+  uint64_t off;
+  uint32_t len;
+  size_t total;
+  size_t rec;
+  char* data;
+  unsigned int i;
+
+  ring = handle->tx;
+  if (ring == NULL || uv__is_closing(handle))
+    return UV_EINVAL;
+
+  total = uv__count_bufs(bufs, nbufs);
+  size = ring->size;
+  if (total > size / 2 - 8)
+    return UV_EMSGSIZE;
+
+  /* 4字节长度加数据，按8字节对齐 */
+  rec = (4 + total + 7) & ~(size_t) 7;
+  tail = ring->tail;
+  off = tail & (size - 1);
+  need = rec;
+  if (size - off < rec)
+    need += size - off;
+
+  head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  if (size - (tail - head) < need) {
+    /* 让消费者读完以后叫醒我们，然后再看一眼，免得消费者刚好错过 */
+    __atomic_store_n(&ring->writer_waiting, 1, __ATOMIC_SEQ_CST);
+    head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+    if (size - (tail - head) < need) {
+      handle->want_writable = 1;
+      return UV_EAGAIN;
+    }
+    __atomic_store_n(&ring->writer_waiting, 0, __ATOMIC_RELAXED);
+  }
+
+  data = UV__SHM_RING_DATA(ring);
+  if (size - off < rec) {
+    /* 末尾放不下，标一下跳回开头。记录8字节对齐，至少放得下长度字段 */
+    len = UV__SHM_WRAP;
+    memcpy(data + off, &len, sizeof(len));
+    tail += size - off;
+    off = 0;
+  }
+
+  len = (uint32_t) total;
+  memcpy(data + off, &len, sizeof(len));
+  off += sizeof(len);
+  for (i = 0; i < nbufs; i++) {
+    memcpy(data + off, bufs[i].base, bufs[i].len);
+    off += bufs[i].len;
+  }
+
+  __atomic_store_n(&ring->tail, tail + rec, __ATOMIC_SEQ_CST);
+
+  /* 和消费者睡之前的检查配对：它要么看到了新的tail，要么我们看到它睡了 */
+  if (__atomic_load_n(&ring->reader_waiting, __ATOMIC_SEQ_CST) &&
+      __atomic_exchange_n(&ring->reader_waiting, 0, __ATOMIC_SEQ_CST)) {
+    return uv__shm_channel_wake(handle, UV__SHM_WAKE_READ);
+  }
+
+  return 0;
+}
+
+
+/* 读完环里的消息。返回以后要么环空了、消费者标成了睡着，要么回调里把
+ * handle停下或者关掉了
+ */
+static void uv__shm_channel_drain(uv_shm_channel_t* handle) {
+  uv__shm_ring_t* ring;
+  uv_buf_t buf;
+  uint64_t head;
+  uint64_t tail;
+  uint64_t size;
+  uint64_t off;
+  uint32_t len;
+  char* data;
+
+  ring = handle->rx;
+  size = ring->size;
+  data = UV__SHM_RING_DATA(ring);
+  head = ring->head;
+
+  for (;;) {
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+      off = head & (size - 1);
+      memcpy(&len, data + off, sizeof(len));
+      if (len == UV__SHM_WRAP) {
+        head += size - off;
+        continue;
+      }
+
+      buf = uv_buf_init(data + off + sizeof(len), len);
+      handle->recv_cb(handle, &buf, 0);
+
+      /* 回调结束以后这段内存才还给生产者 */
+      head += (4 + (uint64_t) len + 7) & ~(uint64_t) 7;
+      __atomic_store_n(&ring->head, head, __ATOMIC_SEQ_CST);
+
+      if (__atomic_load_n(&ring->writer_waiting, __ATOMIC_SEQ_CST) &&
+          __atomic_exchange_n(&ring->writer_waiting, 0, __ATOMIC_SEQ_CST)) {
+        uv__shm_channel_wake(handle, UV__SHM_WAKE_WRITE);
+      }
+
+      if (!uv__is_active(handle) || uv__is_closing(handle))
+        return;
+    }
+
+    __atomic_store_n(&ring->head, head, __ATOMIC_SEQ_CST);
+
+    /* 先标成睡着再看一眼tail，和生产者那边的检查配对 */
+    __atomic_store_n(&ring->reader_waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == head)
+      return;
+
+    __atomic_store_n(&ring->reader_waiting, 0, __ATOMIC_SEQ_CST);
+  }
+}
+
+
+static void uv__shm_channel_io(uv_loop_t* loop,
+                               uv__io_t* w,
+                               unsigned int events) {
+  uv_shm_channel_t* handle;
+  char buf[64];
+  ssize_t n;
+  ssize_t i;
+  int writable;
+  int err;
+
+  handle = container_of(w, uv_shm_channel_t, io_watcher);
+  writable = 0;
+  err = 0;
+
+  /* uv_shm_channel_stop()之前uv__io_feed()过的 */
+  if (!uv__is_active(handle))
+    return;
+
+  /* 叫醒的字节读完就行，消息都在环里 */
+  for (;;) {
+    do
+      n = read(w->fd, buf, sizeof(buf));
+    while (n == -1 && errno == EINTR);
+
+    /* 对端关掉之前放进环里的消息先交出去 */
+    if (n == 0) {
+      err = UV_EOF;
+      break;
+    }
+
+    if (n == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        err = UV__ERR(errno);
+      break;
+    }
+
+    for (i = 0; i < n; i++)
+      if (buf[i] == UV__SHM_WAKE_WRITE)
+        writable = 1;
+
+    if (n < (ssize_t) sizeof(buf))
+      break;
+  }
+
+  uv__shm_channel_drain(handle);
+
+  if (!uv__is_active(handle) || uv__is_closing(handle))
+    return;
+
+  if (err) {
+    uv_shm_channel_stop(handle);
+    handle->recv_cb(handle, NULL, err);
+    return;
+  }
+
+  if (writable && handle->want_writable) {
+    handle->want_writable = 0;
+    if (handle->writable_cb != NULL)
+      handle->writable_cb(handle);
+  }
+}
+
+
+void uv__shm_channel_close(uv_shm_channel_t* handle) {
+  uv_shm_channel_stop(handle);
+
+  if (handle->io_watcher.fd != -1) {
+    uv__io_close(handle->loop, &handle->io_watcher);
+    uv__close(handle->io_watcher.fd);
+    handle->io_watcher.fd = -1;
+  }
+}
+
+
+void uv__shm_channel_finish_close(uv_shm_channel_t* handle) {
+  if (handle->map != NULL)
+    munmap(handle->map, handle->map_size);
+
+  handle->map = NULL;
+  handle->tx = NULL;
+  handle->rx = NULL;
+}
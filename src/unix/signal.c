@@ -28,6 +28,10 @@
 #include <string.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+# include <sys/signalfd.h>
+#endif
+
 #ifndef SA_RESTART
 # define SA_RESTART 0
 #endif
@@ -42,6 +46,23 @@ typedef struct {
 
 RB_HEAD(uv__signal_tree_s, uv_signal_s);
 
+#if defined(__linux__)
+/* UV_LOOP_SIGNALFD：每个loop一个signalfd，关注的信号在loop线程里屏蔽掉，
+ * 由epoll直接通知，不经过全局的锁、红黑树和管道
+ */
+struct uv__signalfd {
+  int fd;
+  uv__io_t io_watcher;
+  sigset_t mask;     /* signalfd关注的信号 */
+  sigset_t blocked;  /* 原来没有屏蔽、由这里屏蔽的信号，停止时恢复 */
+  unsigned int nhandles[_NSIG];
+  QUEUE handles[_NSIG];
+};
+
+static int uv__signalfd_start(uv_signal_t* handle, int signum);
+static void uv__signalfd_stop(uv_signal_t* handle);
+#endif
+
 
 static int uv__signal_unlock(void);
 static int uv__signal_start(uv_signal_t* handle,
@@ -319,6 +340,10 @@ static int uv__signal_loop_once_init(uv_loop_t* loop) {
 
 
 int uv__signal_loop_fork(uv_loop_t* loop) {
+  /* 还没有启动过信号handle，管道也还没有创建 */
+  if (loop->signal_pipefd[0] == -1)
+    return 0;
+
   uv__io_stop(loop, &loop->signal_io_watcher, POLLIN);
   uv__close(loop->signal_pipefd[0]);
   uv__close(loop->signal_pipefd[1]);
@@ -344,6 +369,18 @@ void uv__signal_loop_cleanup(uv_loop_t* loop) {
       uv__signal_stop((uv_signal_t*) handle);
   }
 
+#if defined(__linux__)
+  if (loop->signalfd != NULL) {
+    struct uv__signalfd* sfd;
+
+    sfd = loop->signalfd;
+    uv__io_close(loop, &sfd->io_watcher);
+    uv__close(sfd->fd);
+    uv__free(sfd);
+    loop->signalfd = NULL;
+  }
+#endif
+
   if (loop->signal_pipefd[0] != -1) {
     uv__close(loop->signal_pipefd[0]);
     loop->signal_pipefd[0] = -1;
@@ -355,15 +392,10 @@ void uv__signal_loop_cleanup(uv_loop_t* loop) {
   }
 }
 
-/* 信号初始化 */
+/* 信号初始化。loop的信号管道留到第一次uv_signal_start()时才创建，
+ * 只初始化不启动的handle（比如loop->child_watcher）不占fd
+ */
 int uv_signal_init(uv_loop_t* loop, uv_signal_t* handle) {
-  int err;
-
-  /* 信号初始化 */
-  err = uv__signal_loop_once_init(loop);
-  if (err)
-    return err;
-
   /* 信号handle初始化 */
   uv__handle_init(loop, (uv_handle_t*) handle, UV_SIGNAL);
   handle->signum = 0;
@@ -434,6 +466,26 @@ static int uv__signal_start(uv_signal_t* handle,
     uv__signal_stop(handle);
   }
 
+#if defined(__linux__)
+  if (handle->loop->signalfd != NULL) {
+    err = uv__signalfd_start(handle, signum);
+    if (err)
+      return err;
+
+    handle->signum = signum;
+    if (oneshot)
+      handle->flags |= UV_SIGNAL_ONE_SHOT;
+
+    handle->signal_cb = signal_cb;
+    uv__handle_start(handle);
+    return 0;
+  }
+#endif
+
+  err = uv__signal_loop_once_init(handle->loop);
+  if (err)
+    return err;
+
   uv__signal_block_and_lock(&saved_sigmask);
 
   /* If at this point there are no active signal watchers for this signum (in
@@ -513,6 +565,7 @@ static void uv__signal_event(uv_loop_t* loop,
 
       if (msg->signum == handle->signum) {
         assert(!(handle->flags & UV_HANDLE_CLOSING));
+        uv__handle_activity(handle);
         handle->signal_cb(handle, handle->signum);
       }
 
@@ -593,6 +646,15 @@ static void uv__signal_stop(uv_signal_t* handle) {
   if (handle->signum == 0)
     return;
 
+#if defined(__linux__)
+  if (handle->loop->signalfd != NULL) {
+    uv__signalfd_stop(handle);
+    handle->signum = 0;
+    uv__handle_stop(handle);
+    return;
+  }
+#endif
+
   uv__signal_block_and_lock(&saved_sigmask);
 
   removed_handle = RB_REMOVE(uv__signal_tree_s, &uv__signal_tree, handle);
@@ -619,3 +681,172 @@ static void uv__signal_stop(uv_signal_t* handle) {
   handle->signum = 0;
   uv__handle_stop(handle);
 }
+
+
+#if defined(__linux__)
+static void uv__signalfd_dispatch(struct uv__signalfd* sfd, int signum) {
+  uv_signal_t* handle;
+  QUEUE queue;
+  QUEUE* q;
+
+  /* 回调里可能启动、停止或者关闭这个信号上的handle */
+  QUEUE_MOVE(&sfd->handles[signum], &queue);
+  while (!QUEUE_EMPTY(&queue)) {
+    q = QUEUE_HEAD(&queue);
+    QUEUE_REMOVE(q);
+    QUEUE_INSERT_TAIL(&sfd->handles[signum], q);
+
+    handle = QUEUE_DATA(q, uv_signal_t, signalfd_queue);
+    assert(!(handle->flags & UV_HANDLE_CLOSING));
+    uv__handle_activity(handle);
+    handle->signal_cb(handle, signum);
+
+    if ((handle->flags & UV_SIGNAL_ONE_SHOT) && handle->signum == signum)
+      uv__signal_stop(handle);
+  }
+}
+
+
+static void uv__signalfd_event(uv_loop_t* loop,
+                               uv__io_t* w,
+                               unsigned int events) {
+  struct signalfd_siginfo info[16];
+  struct uv__signalfd* sfd;
+  ssize_t r;
+  size_t i;
+
+  sfd = container_of(w, struct uv__signalfd, io_watcher);
+
+  /* 普通信号在signalfd里会合并，一次最多读出每个信号一个 */
+  do {
+    r = read(sfd->fd, info, sizeof(info));
+
+    if (r == -1 && errno == EINTR)
+      continue;
+
+    if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+
+    if (r == -1)
+      abort();
+
+    for (i = 0; i < r / sizeof(info[0]); i++)
+      if (info[i].ssi_signo < _NSIG)
+        uv__signalfd_dispatch(sfd, info[i].ssi_signo);
+  } while (r == sizeof(info));
+}
+
+
+int uv__signalfd_enable(uv_loop_t* loop) {
+  struct uv__signalfd* sfd;
+  uv_handle_t* handle;
+  QUEUE* q;
+  int i;
+
+  if (loop->signalfd != NULL)
+    return 0;
+
+  /* 已经启动的handle用的是全局的信号处理函数，不能中途换 */
+  QUEUE_FOREACH(q, &loop->handle_queue) {
+    handle = QUEUE_DATA(q, uv_handle_t, handle_queue);
+    if (handle->type == UV_SIGNAL && ((uv_signal_t*) handle)->signum != 0)
+      return UV_EBUSY;
+  }
+
+  sfd = uv__malloc(sizeof(*sfd));
+  if (sfd == NULL)
+    return UV_ENOMEM;
+
+  sigemptyset(&sfd->mask);
+  sigemptyset(&sfd->blocked);
+
+  sfd->fd = signalfd(-1, &sfd->mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (sfd->fd == -1) {
+    uv__free(sfd);
+    return UV__ERR(errno);
+  }
+
+  for (i = 0; i < _NSIG; i++) {
+    sfd->nhandles[i] = 0;
+    QUEUE_INIT(&sfd->handles[i]);
+  }
+
+  uv__io_init(&sfd->io_watcher, uv__signalfd_event, sfd->fd);
+  uv__io_start(loop, &sfd->io_watcher, POLLIN);
+  loop->signalfd = sfd;
+
+  return 0;
+}
+
+
+static int uv__signalfd_start(uv_signal_t* handle, int signum) {
+  struct uv__signalfd* sfd;
+  sigset_t saved;
+  sigset_t set;
+  int err;
+
+  sfd = handle->loop->signalfd;
+
+  /* signalfd不会报告SIGKILL和SIGSTOP，和sigaction()一样当作无效的信号 */
+  if (signum < 1 || signum >= _NSIG || signum == SIGKILL || signum == SIGSTOP)
+    return UV_EINVAL;
+
+  if (sfd->nhandles[signum] == 0) {
+    /* 先屏蔽再加进signalfd，中间到达的信号会留着等signalfd读 */
+    sigemptyset(&set);
+    if (sigaddset(&set, signum))
+      return UV_EINVAL;
+
+    if (pthread_sigmask(SIG_BLOCK, &set, &saved))
+      abort();
+
+    sigaddset(&sfd->mask, signum);
+    if (signalfd(sfd->fd, &sfd->mask, 0) == -1) {
+      err = UV__ERR(errno);
+      sigdelset(&sfd->mask, signum);
+      if (!sigismember(&saved, signum))
+        pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+      return err;
+    }
+
+    if (!sigismember(&saved, signum))
+      sigaddset(&sfd->blocked, signum);
+  }
+
+  sfd->nhandles[signum]++;
+  QUEUE_INSERT_TAIL(&sfd->handles[signum], &handle->signalfd_queue);
+
+  return 0;
+}
+
+
+static void uv__signalfd_stop(uv_signal_t* handle) {
+  struct uv__signalfd* sfd;
+  sigset_t set;
+  int signum;
+
+  sfd = handle->loop->signalfd;
+  signum = handle->signum;
+
+  QUEUE_REMOVE(&handle->signalfd_queue);
+  if (--sfd->nhandles[signum] != 0)
+    return;
+
+  sigdelset(&sfd->mask, signum);
+  if (signalfd(sfd->fd, &sfd->mask, 0) == -1)
+    abort();
+
+  /* 没有handle了就和原来一样恢复默认的处理方式 */
+  if (sigismember(&sfd->blocked, signum)) {
+    sigdelset(&sfd->blocked, signum);
+    sigemptyset(&set);
+    sigaddset(&set, signum);
+    if (pthread_sigmask(SIG_UNBLOCK, &set, NULL))
+      abort();
+  }
+}
+#else
+int uv__signalfd_enable(uv_loop_t* loop) {
+  return UV_ENOSYS;
+}
+#endif
@@ -19,35 +19,70 @@
 #include "internal.h"  /* ACCESS_ONCE, UV_UNUSED */
 #include "atomic-ops.h"
 
-#define UV_SPINLOCK_INITIALIZER { 0 }
+#include <sched.h>  /* sched_yield() */
 
-typedef struct {
-  int lock;
-} uv_spinlock_t;
+/* uv_spinlock_t是一个ticket lock：加锁时从next取一个号，等到owner轮到自己，
+ * 解锁时owner加一，所以等待者按先来后到的顺序拿到锁。等待时只读owner，
+ * 退避的长度按前面还有几个人(ticket - owner)来算，减少对这个cache line的
+ * 争抢。不是下一个的等待者每轮先让出CPU，只有排在最前面的那个自旋；它退避
+ * 到上限以后也每轮让出CPU，否则CPU比线程少时持锁的线程可能得不到运行的机会。
+ * uv__spinlock_lock()会调用sched_yield()，不能在信号处理函数里使用；
+ * uv__spinlock_trylock()和uv__spinlock_unlock()不调用任何库函数，在信号
+ * 处理函数里也可以使用，tty.c的uv_tty_reset_mode()只用这两个。
+ */
+#define UV__SPINLOCK_MAX_BACKOFF 64
 
-UV_UNUSED(static void uv_spinlock_init(uv_spinlock_t* spinlock));
-UV_UNUSED(static void uv_spinlock_lock(uv_spinlock_t* spinlock));
-UV_UNUSED(static void uv_spinlock_unlock(uv_spinlock_t* spinlock));
-UV_UNUSED(static int uv_spinlock_trylock(uv_spinlock_t* spinlock));
+UV_UNUSED(static void uv__spinlock_init(uv_spinlock_t* spinlock));
+UV_UNUSED(static void uv__spinlock_lock(uv_spinlock_t* spinlock));
+UV_UNUSED(static void uv__spinlock_unlock(uv_spinlock_t* spinlock));
+UV_UNUSED(static int uv__spinlock_trylock(uv_spinlock_t* spinlock));
 
-UV_UNUSED(static void uv_spinlock_init(uv_spinlock_t* spinlock)) {
-  ACCESS_ONCE(int, spinlock->lock) = 0;
+UV_UNUSED(static void uv__spinlock_init(uv_spinlock_t* spinlock)) {
+  ACCESS_ONCE(int, spinlock->next) = 0;
+  ACCESS_ONCE(int, spinlock->owner) = 0;
 }
 
-UV_UNUSED(static void uv_spinlock_lock(uv_spinlock_t* spinlock)) {
-  while (!uv_spinlock_trylock(spinlock)) cpu_relax();
+UV_UNUSED(static void uv__spinlock_lock(uv_spinlock_t* spinlock)) {
+  unsigned int distance;
+  unsigned int backoff;
+  unsigned int spins;
+  unsigned int i;
+  int owner;
+  int ticket;
+
+  ticket = fetch_addi(&spinlock->next, 1);
+  backoff = 1;
+
+  while ((owner = ACCESS_ONCE(int, spinlock->owner)) != ticket) {
+    distance = (unsigned int) ticket - (unsigned int) owner;
+    if (distance > 1) {
+      sched_yield();
+      spins = distance < UV__SPINLOCK_MAX_BACKOFF ? distance
+                                                  : UV__SPINLOCK_MAX_BACKOFF;
+    } else {
+      spins = backoff;
+      if (backoff < UV__SPINLOCK_MAX_BACKOFF)
+        backoff <<= 1;
+      else
+        sched_yield();
+    }
+    for (i = 0; i < spins; i++)
+      cpu_relax();
+  }
 }
 
-UV_UNUSED(static void uv_spinlock_unlock(uv_spinlock_t* spinlock)) {
-  ACCESS_ONCE(int, spinlock->lock) = 0;
+UV_UNUSED(static void uv__spinlock_unlock(uv_spinlock_t* spinlock)) {
+  fetch_addi(&spinlock->owner, 1);
 }
 
-UV_UNUSED(static int uv_spinlock_trylock(uv_spinlock_t* spinlock)) {
-  /* TODO(bnoordhuis) Maybe change to a ticket lock to guarantee fair queueing.
-   * Not really critical until we have locks that are (frequently) contended
-   * for by several threads.
-   */
-  return 0 == cmpxchgi(&spinlock->lock, 0, 1);
+UV_UNUSED(static int uv__spinlock_trylock(uv_spinlock_t* spinlock)) {
+  int owner;
+
+  /* 只有没人持有也没人排队(next == owner)的时候才取号 */
+  owner = ACCESS_ONCE(int, spinlock->owner);
+  return owner == cmpxchgi(&spinlock->next,
+                           owner,
+                           (int) ((unsigned int) owner + 1));
 }
 
 #endif  /* UV_SPINLOCK_H_ */
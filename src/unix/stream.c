@@ -29,12 +29,30 @@
 #include <errno.h>
 
 #include <sys/types.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <limits.h> /* IOV_MAX */
 
+#if defined(__linux__)
+# include <netinet/in.h>
+# include <sys/sendfile.h>
+# include <linux/errqueue.h>
+/* 老的头文件里没有这几个常量 */
+# ifndef MSG_ZEROCOPY
+#  define MSG_ZEROCOPY 0x4000000
+# endif
+# ifndef SO_ZEROCOPY
+#  define SO_ZEROCOPY 60
+# endif
+# ifndef SO_EE_ORIGIN_ZEROCOPY
+#  define SO_EE_ORIGIN_ZEROCOPY 5
+# endif
+#endif
+
 #if defined(__APPLE__)
 # include <sys/event.h>
 # include <sys/time.h>
@@ -42,21 +60,35 @@
 
 /* Forward declaration */
 typedef struct uv__stream_select_s uv__stream_select_t;
+typedef struct uv__select_loop_s uv__select_loop_t;
 
-struct uv__stream_select_s {
-  uv_stream_t* stream;
+/* 一个loop上所有kqueue不支持的fd共用一个select()线程。线程把一轮里就绪的
+ * stream都挂上事件，只发一次uv_async_send()，loop在一次回调里把它们处理完
+ */
+struct uv__select_loop_s {
+  uv_loop_t* loop;
   uv_thread_t thread;
-  uv_sem_t close_sem;
-  uv_sem_t async_sem;
+  uv_mutex_t mutex;
   uv_async_t async;
-  int events;
+  QUEUE streams;
+  unsigned int nstreams;
+  int stop;
   int fake_fd;
   int int_fd;
-  int fd;
   fd_set* sread;
-  size_t sread_sz;
   fd_set* swrite;
-  size_t swrite_sz;
+  size_t fdset_sz;
+};
+
+struct uv__stream_select_s {
+  uv__select_loop_t* sl;
+  uv_stream_t* stream;
+  QUEUE member;
+  int events;
+  int watched;
+  int fake_fd;
+  int peer_fd;
+  int fd;
 };
 # define WRITE_RETRY_ON_ERROR(send_handle) \
     (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS || \
@@ -66,12 +98,92 @@ struct uv__stream_select_s {
     (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
 #endif /* defined(__APPLE__) */
 
+/* uv__write()一次writev()最多拼多少个缓冲区 */
+#define UV__WRITE_GATHER_MAX 128
+/* loop缓存的写缓冲区数组的大小和最多缓存的个数 */
+#define UV__WRITE_BUFS_MAX 16
+#define UV__WRITE_BUFS_FREE_MAX 64
+/* 一条消息里最多带多少个fd，和Linux的SCM_MAX_FD一样 */
+#define UV__SEND_HANDLES_MAX 253
+/* uv_stream_splice()没法用pipe时中转缓冲区的大小 */
+#define UV__SPLICE_BUF_SIZE 65536
+/* uv_read_start_batch()一次回调最多攒多少次读 */
+#define UV__READ_BATCH_MAX 64
+/* uv_stream_set_write_batch_cb()一次回调最多交出多少个请求 */
+#define UV__WRITE_BATCH_MAX 64
+/* SOCK_SEQPACKET的pipe一次sendmmsg()最多发多少条消息 */
+#define UV__WRITE_MMSG_MAX 32
+
+/* UV_HANDLE_PIPE_SEQPACKET和tcp的标志共用一位 */
+#define UV__STREAM_SEQPACKET(s)                                               \
+  ((s)->type == UV_NAMED_PIPE && ((s)->flags & UV_HANDLE_PIPE_SEQPACKET) != 0)
+
 static void uv__stream_connect(uv_stream_t*);
 static void uv__write(uv_stream_t* stream);
 static void uv__read(uv_stream_t* stream);
-static void uv__stream_io(uv_loop_t* loop, uv__io_t* w, unsigned int events);
 static void uv__write_callbacks(uv_stream_t* stream);
 static size_t uv__write_req_size(uv_write_t* req);
+static void uv__stream_watermarks(uv_stream_t* stream);
+static int uv__stream_queue_fd(uv_stream_t* stream, int fd);
+static void uv__splice_run(uv_splice_t* req);
+static void uv__splice_cancel(uv_stream_t* stream);
+
+/* uv_stream_set_admission()的状态，挂在服务端上。clients是uv_accept()过还没
+ * 关闭的连接，timer在因为延迟暂停时负责恢复
+ */
+struct uv__admission {
+  uv_timer_t timer;
+  uv_stream_t* server;
+  uv_admission_cb cb;
+  unsigned int max_connections;
+  unsigned int nconnections;
+  uint64_t max_lag;
+  QUEUE clients;
+  int paused;
+};
+
+/* uv_stream_set_timeouts()：loop上每种超时长度一组，组里的流按到期时间
+ * 排成链表。读写时把流挪到表尾，不用调整堆
+ */
+struct uv__stream_timeout_bucket {
+  QUEUE member;
+  QUEUE entries;
+  uint64_t timeout;
+  unsigned int refs;
+};
+
+struct uv__stream_timeout_entry {
+  QUEUE member;  /* 没有在计时的时候是空的 */
+  struct uv__stream_timeout_bucket* bucket;  /* 为NULL时不检查 */
+  uint64_t due;
+  uv_stream_t* stream;
+  int which;
+};
+
+struct uv__stream_timeouts {
+  struct uv__stream_timeout_entry entries[3];
+  uv_stream_timeout_cb cb;
+};
+
+/* loop->stream_timeouts，timer在所有表头里最早的到期时间触发 */
+struct uv__stream_timeout_loop {
+  uv_timer_t timer;
+  QUEUE buckets;
+  uint64_t due;  /* timer的到期时间，0表示没有启动 */
+  int running;
+};
+
+/* UV_LOOP_EMFILE_RESERVE：备用fd池和因为EMFILE暂停监听的服务端 */
+#define UV__EMFILE_MAX_RESERVE 64
+struct uv__emfile {
+  uv_timer_t timer;
+  unsigned int size;
+  unsigned int nfds;     /* 打开着的备用fd */
+  unsigned int backoff;  /* 毫秒，0表示accept()之后马上关掉 */
+  QUEUE paused;
+  int fds[UV__EMFILE_MAX_RESERVE];
+};
+static void uv__splice_destroy(uv_stream_t* stream);
 
 
 void uv__stream_init(uv_loop_t* loop,
@@ -82,6 +194,12 @@ void uv__stream_init(uv_loop_t* loop,
   uv__handle_init(loop, (uv_handle_t*)stream, type);
   stream->read_cb = NULL;
   stream->alloc_cb = NULL;
+  stream->read_iov_cb = NULL;
+  stream->alloc_iov_cb = NULL;
+  stream->read_batch_cb = NULL;
+  stream->read_batch = NULL;
+  stream->read_budget = 0;
+  stream->read_budget_bytes = 0;
   stream->close_cb = NULL;
   stream->connection_cb = NULL;
   stream->connect_req = NULL;
@@ -89,11 +207,34 @@ void uv__stream_init(uv_loop_t* loop,
   stream->accepted_fd = -1;
   stream->queued_fds = NULL;
   stream->delayed_error = 0;
+  stream->read_hint = 0;
+  stream->read_hint_min = 0;
+  stream->read_hint_max = 0;
+  stream->read_hint_small = 0;
+  stream->buf_pool = NULL;
+  stream->read_iobuf_cb = NULL;
   QUEUE_INIT(&stream->write_queue);
   QUEUE_INIT(&stream->write_completed_queue);
+  QUEUE_INIT(&stream->zerocopy_queue);
+  stream->zerocopy_next = 0;
+  stream->splice_src = NULL;
+  stream->splice_dst = NULL;
+  stream->write_low_watermark = 0;
+  stream->write_high_watermark = 0;
+  stream->write_watermark_cb = NULL;
+  stream->write_batch_cb = NULL;
+  stream->write_above_high = 0;
+  stream->accept_burst = 1;
+  stream->admission = NULL;
+  stream->admitted = NULL;
+  QUEUE_INIT(&stream->admitted_member);
+  QUEUE_INIT(&stream->emfile_member);
+  memset(&stream->io_stats, 0, sizeof(stream->io_stats));
+  stream->timeouts = NULL;
+  stream->rate_limit = NULL;
   stream->write_queue_size = 0;
 
-  if (loop->emfile_fd == -1) {
+  if (loop->emfile_fd == -1 && loop->emfile == NULL) {
     err = uv__open_cloexec("/dev/null", O_RDONLY);
     if (err < 0)
         /* In the rare case that "/dev/null" isn't mounted open "/"
@@ -112,6 +253,28 @@ void uv__stream_init(uv_loop_t* loop,
 }
 
 
+/* 流在用io_uring的multishot recv读，这时POLLIN不在watcher上 */
+static int uv__stream_recv_armed(const uv_stream_t* stream) {
+#if defined(__linux__)
+  if (stream->loop->flags & UV_LOOP_IO_URING)
+    return uv__iou_recv_active(stream->loop, uv__stream_fd(stream));
+#endif
+  return 0;
+}
+
+
+/* 读（out为0）或者写在等限速器的令牌，POLLIN/POLLOUT是停着的，但流还是活动的 */
+static int uv__stream_rate_waiting(const uv_stream_t* stream, int out) {
+  const struct uv__rate_limits* limits;
+
+  limits = stream->rate_limit;
+  if (limits == NULL)
+    return 0;
+
+  return !QUEUE_EMPTY(out ? &limits->out.member : &limits->in.member);
+}
+
+
 static void uv__stream_osx_interrupt_select(uv_stream_t* stream) {
 #if defined(__APPLE__)
   /* Notify select() thread about state change */
@@ -127,10 +290,11 @@ static void uv__stream_osx_interrupt_select(uv_stream_t* stream) {
    * emit read event on other side
    */
   do
-    r = write(s->fake_fd, "x", 1);
+    r = write(s->sl->fake_fd, "x", 1);
   while (r == -1 && errno == EINTR);
 
-  assert(r == 1);
+  /* 缓冲区满了说明线程还没来得及清空，已经会被唤醒 */
+  assert(r == 1 || (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)));
 #else  /* !defined(__APPLE__) */
   /* No-op on any other platform */
 #endif  /* !defined(__APPLE__) */
@@ -138,43 +302,83 @@ static void uv__stream_osx_interrupt_select(uv_stream_t* stream) {
 
 
 #if defined(__APPLE__)
+/* 按线程里当前最大的fd准备fd_set，需要时加大。调用时持有sl->mutex */
+static int uv__select_loop_fdsets(uv__select_loop_t* sl, int max_fd) {
+  fd_set* sets;
+  size_t sz;
+
+  sz = ROUND_UP(max_fd + 1, sizeof(uint32_t) * NBBY) / NBBY;
+  if (sz > sl->fdset_sz) {
+    sets = uv__realloc(sl->sread, 2 * sz);
+    if (sets == NULL)
+      return UV_ENOMEM;
+    sl->sread = sets;
+    sl->swrite = (fd_set*) ((char*) sets + sz);
+    sl->fdset_sz = sz;
+  }
+
+  memset(sl->sread, 0, sl->fdset_sz);
+  memset(sl->swrite, 0, sl->fdset_sz);
+  return 0;
+}
+
+
 static void uv__stream_osx_select(void* arg) {
-  uv_stream_t* stream;
+  uv__select_loop_t* sl;
   uv__stream_select_t* s;
+  uv_stream_t* stream;
   char buf[1024];
+  QUEUE* q;
   int events;
-  int fd;
+  int notify;
   int r;
   int max_fd;
 
-  stream = arg;
-  s = stream->select;
-  fd = s->fd;
+  sl = arg;
 
-  if (fd > s->int_fd)
-    max_fd = fd;
-  else
-    max_fd = s->int_fd;
+  for (;;) {
+    uv_mutex_lock(&sl->mutex);
 
-  while (1) {
-    /* Terminate on semaphore */
-    if (uv_sem_trywait(&s->close_sem) == 0)
+    /* Terminate on request */
+    if (sl->stop) {
+      uv_mutex_unlock(&sl->mutex);
       break;
+    }
+
+    max_fd = sl->int_fd;
+    QUEUE_FOREACH(q, &sl->streams) {
+      s = QUEUE_DATA(q, uv__stream_select_t, member);
+      if (s->fd > max_fd)
+        max_fd = s->fd;
+    }
+
+    if (uv__select_loop_fdsets(sl, max_fd))
+      abort();
 
-    /* Watch fd using select(2) */
-    memset(s->sread, 0, s->sread_sz);
-    memset(s->swrite, 0, s->swrite_sz);
+    /* Watch fds using select(2). 已经报过事件、loop还没处理的stream不在
+     * 这里面，发出去的总是间隔不长的独立批次
+     */
+    QUEUE_FOREACH(q, &sl->streams) {
+      s = QUEUE_DATA(q, uv__stream_select_t, member);
+      stream = s->stream;
+      s->watched = 0;
+      if (uv__io_active(&stream->io_watcher, POLLIN)) {
+        FD_SET(s->fd, sl->sread);
+        s->watched = 1;
+      }
+      if (uv__io_active(&stream->io_watcher, POLLOUT)) {
+        FD_SET(s->fd, sl->swrite);
+        s->watched = 1;
+      }
+    }
+    FD_SET(sl->int_fd, sl->sread);
 
-    if (uv__io_active(&stream->io_watcher, POLLIN))
-      FD_SET(fd, s->sread);
-    if (uv__io_active(&stream->io_watcher, POLLOUT))
-      FD_SET(fd, s->swrite);
-    FD_SET(s->int_fd, s->sread);
+    uv_mutex_unlock(&sl->mutex);
 
     /* Wait indefinitely for fd events */
-    r = select(max_fd + 1, s->sread, s->swrite, NULL, NULL);
+    r = select(max_fd + 1, sl->sread, sl->swrite, NULL, NULL);
     if (r == -1) {
-      if (errno == EINTR)
+      if (errno == EINTR || errno == EBADF)
         continue;
 
       /* XXX: Possible?! */
@@ -186,9 +390,9 @@ static void uv__stream_osx_select(void* arg) {
       continue;
 
     /* Empty socketpair's buffer in case of interruption */
-    if (FD_ISSET(s->int_fd, s->sread))
+    if (FD_ISSET(sl->int_fd, sl->sread))
       while (1) {
-        r = read(s->int_fd, buf, sizeof(buf));
+        r = read(sl->int_fd, buf, sizeof(buf));
 
         if (r == sizeof(buf))
           continue;
@@ -205,64 +409,210 @@ static void uv__stream_osx_select(void* arg) {
         abort();
       }
 
-    /* Handle events */
-    events = 0;
-    if (FD_ISSET(fd, s->sread))
-      events |= POLLIN;
-    if (FD_ISSET(fd, s->swrite))
-      events |= POLLOUT;
-
-    assert(events != 0 || FD_ISSET(s->int_fd, s->sread));
-    if (events != 0) {
-      ACCESS_ONCE(int, s->events) = events;
+    /* Handle events. select()期间新加进来的stream的fd不在这一轮里 */
+    notify = 0;
+    uv_mutex_lock(&sl->mutex);
+    QUEUE_FOREACH(q, &sl->streams) {
+      s = QUEUE_DATA(q, uv__stream_select_t, member);
+      if (!s->watched)
+        continue;
 
-      uv_async_send(&s->async);
-      uv_sem_wait(&s->async_sem);
+      events = 0;
+      if (FD_ISSET(s->fd, sl->sread))
+        events |= POLLIN;
+      if (FD_ISSET(s->fd, sl->swrite))
+        events |= POLLOUT;
 
-      /* Should be processed at this stage */
-      assert((s->events == 0) || (stream->flags & UV_HANDLE_CLOSING));
+      s->watched = 0;
+      if (events != 0) {
+        s->events |= events;
+        notify = 1;
+      }
     }
+    uv_mutex_unlock(&sl->mutex);
+
+    if (notify)
+      uv_async_send(&sl->async);
   }
 }
 
 
 static void uv__stream_osx_select_cb(uv_async_t* handle) {
+  uv__select_loop_t* sl;
   uv__stream_select_t* s;
   uv_stream_t* stream;
+  QUEUE ready;
+  QUEUE* q;
+  QUEUE* n;
   int events;
 
-  s = container_of(handle, uv__stream_select_t, async);
-  stream = s->stream;
+  sl = container_of(handle, uv__select_loop_t, async);
+
+  /* 把这一批就绪的stream摘下来。处理完以前线程不会再select它们 */
+  QUEUE_INIT(&ready);
+  uv_mutex_lock(&sl->mutex);
+  q = QUEUE_HEAD(&sl->streams);
+  while (q != &sl->streams) {
+    n = QUEUE_NEXT(q);
+    s = QUEUE_DATA(q, uv__stream_select_t, member);
+    if (s->events != 0) {
+      QUEUE_REMOVE(q);
+      QUEUE_INSERT_TAIL(&ready, q);
+    }
+    q = n;
+  }
+  uv_mutex_unlock(&sl->mutex);
+
+  while (!QUEUE_EMPTY(&ready)) {
+    q = QUEUE_HEAD(&ready);
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);
 
-  /* Get and reset stream's events */
-  events = s->events;
-  ACCESS_ONCE(int, s->events) = 0;
+    s = QUEUE_DATA(q, uv__stream_select_t, member);
+    stream = s->stream;
 
-  assert(events != 0);
-  assert(events == (events & (POLLIN | POLLOUT)));
+    /* Get and reset stream's events */
+    uv_mutex_lock(&sl->mutex);
+    events = s->events;
+    s->events = 0;
+    uv_mutex_unlock(&sl->mutex);
 
-  /* Invoke callback on event-loop */
-  if ((events & POLLIN) && uv__io_active(&stream->io_watcher, POLLIN))
-    uv__stream_io(stream->loop, &stream->io_watcher, POLLIN);
+    assert(events != 0);
+    assert(events == (events & (POLLIN | POLLOUT)));
 
-  if ((events & POLLOUT) && uv__io_active(&stream->io_watcher, POLLOUT))
-    uv__stream_io(stream->loop, &stream->io_watcher, POLLOUT);
+    /* Invoke callback on event-loop */
+    if ((events & POLLIN) && uv__io_active(&stream->io_watcher, POLLIN))
+      uv__stream_io(stream->loop, &stream->io_watcher, POLLIN);
 
-  if (stream->flags & UV_HANDLE_CLOSING)
-    return;
+    if (stream->select == s &&
+        (events & POLLOUT) &&
+        uv__io_active(&stream->io_watcher, POLLOUT)) {
+      uv__stream_io(stream->loop, &stream->io_watcher, POLLOUT);
+    }
 
-  /* NOTE: It is important to do it here, otherwise `select()` might be called
-   * before the actual `uv__read()`, leading to the blocking syscall
-   */
-  uv_sem_post(&s->async_sem);
+    /* 回调里关掉的stream已经摘掉了，s也释放了。没关的放回去。
+     * NOTE: It is important to do it here, otherwise `select()` might be
+     * called before the actual `uv__read()`
+     */
+    if (stream->select != s)
+      continue;
+
+    uv_mutex_lock(&sl->mutex);
+    QUEUE_INSERT_TAIL(&sl->streams, q);
+    uv_mutex_unlock(&sl->mutex);
+    uv__stream_osx_interrupt_select(stream);
+  }
 }
 
 
 static void uv__stream_osx_cb_close(uv_handle_t* async) {
-  uv__stream_select_t* s;
+  uv__select_loop_t* sl;
 
-  s = container_of(async, uv__stream_select_t, async);
-  uv__free(s);
+  sl = container_of(async, uv__select_loop_t, async);
+  uv__free(sl->sread);
+  uv__free(sl);
+}
+
+
+/* 取loop共用的select线程，第一次用的时候才创建 */
+static int uv__select_loop_get(uv_loop_t* loop, uv__select_loop_t** out) {
+  uv__select_loop_t* sl;
+  int fds[2];
+  int err;
+
+  sl = loop->select_state;
+  if (sl != NULL) {
+    *out = sl;
+    return 0;
+  }
+
+  /* Create fds to interrupt the select() loop */
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+    return UV__ERR(errno);
+
+  err = uv__nonblock(fds[0], 1);
+  if (err == 0)
+    err = uv__nonblock(fds[1], 1);
+  if (err)
+    goto failed_malloc;
+
+  sl = uv__malloc(sizeof(*sl));
+  if (sl == NULL) {
+    err = UV_ENOMEM;
+    goto failed_malloc;
+  }
+
+  sl->loop = loop;
+  QUEUE_INIT(&sl->streams);
+  sl->nstreams = 0;
+  sl->stop = 0;
+  sl->fake_fd = fds[0];
+  sl->int_fd = fds[1];
+  sl->sread = NULL;
+  sl->swrite = NULL;
+  sl->fdset_sz = 0;
+
+  err = uv_mutex_init(&sl->mutex);
+  if (err)
+    goto failed_mutex_init;
+
+  err = uv_async_init(loop, &sl->async, uv__stream_osx_select_cb);
+  if (err)
+    goto failed_async_init;
+
+  sl->async.flags |= UV_HANDLE_INTERNAL;
+  uv__handle_unref(&sl->async);
+
+  err = uv_thread_create(&sl->thread, uv__stream_osx_select, sl);
+  if (err)
+    goto failed_thread_create;
+
+  loop->select_state = sl;
+  *out = sl;
+  return 0;
+
+failed_thread_create:
+  uv_mutex_destroy(&sl->mutex);
+  uv__close(fds[0]);
+  uv__close(fds[1]);
+  uv_close((uv_handle_t*) &sl->async, uv__stream_osx_cb_close);
+  return err;
+
+failed_async_init:
+  uv_mutex_destroy(&sl->mutex);
+
+failed_mutex_init:
+  uv__free(sl);
+
+failed_malloc:
+  uv__close(fds[0]);
+  uv__close(fds[1]);
+
+  return err;
+}
+
+
+/* 最后一个stream关掉时停掉线程，async在下一轮loop里释放 */
+static void uv__select_loop_release(uv__select_loop_t* sl) {
+  int r;
+
+  if (--sl->nstreams > 0)
+    return;
+
+  uv_mutex_lock(&sl->mutex);
+  sl->stop = 1;
+  uv_mutex_unlock(&sl->mutex);
+
+  do
+    r = write(sl->fake_fd, "x", 1);
+  while (r == -1 && errno == EINTR);
+
+  uv_thread_join(&sl->thread);
+  uv_mutex_destroy(&sl->mutex);
+  uv__close(sl->fake_fd);
+  uv__close(sl->int_fd);
+  sl->loop->select_state = NULL;
+  uv_close((uv_handle_t*) &sl->async, uv__stream_osx_cb_close);
 }
 
 
@@ -275,15 +625,12 @@ int uv__stream_try_select(uv_stream_t* stream, int* fd) {
   struct kevent filter[1];
   struct kevent events[1];
   struct timespec timeout;
+  uv__select_loop_t* sl;
   uv__stream_select_t* s;
   int fds[2];
   int err;
   int ret;
   int kq;
-  int old_fd;
-  int max_fd;
-  size_t sread_sz;
-  size_t swrite_sz;
 
   kq = kqueue();
   if (kq == -1) {
@@ -312,78 +659,41 @@ int uv__stream_try_select(uv_stream_t* stream, int* fd) {
   /* At this point we definitely know that this fd won't work with kqueue */
 
   /*
-   * Create fds for io watcher and to interrupt the select() loop.
-   * NOTE: do it ahead of malloc below to allocate enough space for fd_sets
+   * Create fds for io watcher. 另一端只是占着，不让fake_fd读到EOF
    */
   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
     return UV__ERR(errno);
 
-  max_fd = *fd;
-  if (fds[1] > max_fd)
-    max_fd = fds[1];
-
-  sread_sz = ROUND_UP(max_fd + 1, sizeof(uint32_t) * NBBY) / NBBY;
-  swrite_sz = sread_sz;
-
-  s = uv__malloc(sizeof(*s) + sread_sz + swrite_sz);
+  s = uv__malloc(sizeof(*s));
   if (s == NULL) {
     err = UV_ENOMEM;
     goto failed_malloc;
   }
 
-  s->events = 0;
-  s->fd = *fd;
-  s->sread = (fd_set*) ((char*) s + sizeof(*s));
-  s->sread_sz = sread_sz;
-  s->swrite = (fd_set*) ((char*) s->sread + sread_sz);
-  s->swrite_sz = swrite_sz;
-
-  err = uv_async_init(stream->loop, &s->async, uv__stream_osx_select_cb);
+  err = uv__select_loop_get(stream->loop, &sl);
   if (err)
-    goto failed_async_init;
-
-  s->async.flags |= UV_HANDLE_INTERNAL;
-  uv__handle_unref(&s->async);
-
-  err = uv_sem_init(&s->close_sem, 0);
-  if (err != 0)
-    goto failed_close_sem_init;
-
-  err = uv_sem_init(&s->async_sem, 0);
-  if (err != 0)
-    goto failed_async_sem_init;
+    goto failed_select_loop;
 
+  s->sl = sl;
+  s->stream = stream;
+  s->events = 0;
+  s->watched = 0;
   s->fake_fd = fds[0];
-  s->int_fd = fds[1];
+  s->peer_fd = fds[1];
+  s->fd = *fd;
+
+  sl->nstreams++;
+  uv_mutex_lock(&sl->mutex);
+  QUEUE_INSERT_TAIL(&sl->streams, &s->member);
+  uv_mutex_unlock(&sl->mutex);
 
-  old_fd = *fd;
-  s->stream = stream;
   stream->select = s;
   *fd = s->fake_fd;
-
-  err = uv_thread_create(&s->thread, uv__stream_osx_select, stream);
-  if (err != 0)
-    goto failed_thread_create;
+  uv__stream_osx_interrupt_select(stream);
 
   return 0;
 
-failed_thread_create:
-  s->stream = NULL;
-  stream->select = NULL;
-  *fd = old_fd;
-
-  uv_sem_destroy(&s->async_sem);
-
-failed_async_sem_init:
-  uv_sem_destroy(&s->close_sem);
-
-failed_close_sem_init:
-  uv__close(fds[0]);
-  uv__close(fds[1]);
-  uv_close((uv_handle_t*) &s->async, uv__stream_osx_cb_close);
-  return err;
-
-failed_async_init:
+failed_select_loop:
   uv__free(s);
 
 failed_malloc:
@@ -447,6 +757,94 @@ void uv__stream_flush_write_queue(uv_stream_t* stream, int error) {
 }
 
 
+/* 句柄关掉时还没等到完成通知的零拷贝请求。数据已经交给了内核，但没法确认
+ * 内核什么时候放手，所以报UV_ECANCELED
+ */
+static void uv__stream_flush_zerocopy_queue(uv_stream_t* stream) {
+  uv_write_t* req;
+  QUEUE* q;
+
+  while (!QUEUE_EMPTY(&stream->zerocopy_queue)) {
+    q = QUEUE_HEAD(&stream->zerocopy_queue);
+    QUEUE_REMOVE(q);
+
+    req = QUEUE_DATA(q, uv_write_t, queue);
+    req->error = UV_ECANCELED;
+
+    QUEUE_INSERT_TAIL(&stream->write_completed_queue, &req->queue);
+  }
+}
+
+
+#if defined(__linux__)
+/* 从错误队列里取MSG_ZEROCOPY的完成通知。每条通知说明序号在[ee_info, ee_data]
+ * 之间的发送内核已经用完了。TCP按顺序确认数据，通知也是按顺序来的，
+ * 所以只要记住最大的ee_data，把序号不超过它的请求都挪去回调
+ */
+static void uv__stream_zerocopy_done(uv_stream_t* stream) {
+  struct sock_extended_err* serr;
+  struct cmsghdr* cmsg;
+  struct msghdr msg;
+  uv_write_t* req;
+  unsigned int done;
+  int found;
+  QUEUE* q;
+  union {
+    char data[CMSG_SPACE(sizeof(struct sock_extended_err) +
+                         sizeof(struct sockaddr_in6))];
+    struct cmsghdr alias;
+  } scratch;
+
+  found = 0;
+  done = 0;
+
+  for (;;) {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = &scratch.alias;
+    msg.msg_controllen = sizeof(scratch);
+
+    if (recvmsg(uv__stream_fd(stream), &msg, MSG_ERRQUEUE) == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg);
+         cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+        continue;
+
+      serr = (struct sock_extended_err*) CMSG_DATA(cmsg);
+      if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+
+      if (!found || (int) (serr->ee_data - done) > 0)
+        done = serr->ee_data;
+      found = 1;
+    }
+  }
+
+  if (!found)
+    return;
+
+  while (!QUEUE_EMPTY(&stream->zerocopy_queue)) {
+    q = QUEUE_HEAD(&stream->zerocopy_queue);
+    req = QUEUE_DATA(q, uv_write_t, queue);
+    if ((int) (done - req->zerocopy_seq) < 0)
+      break;
+
+    QUEUE_REMOVE(q);
+    QUEUE_INSERT_TAIL(&stream->write_completed_queue, &req->queue);
+  }
+
+  if (QUEUE_EMPTY(&stream->zerocopy_queue))
+    uv__io_stop(stream->loop, &stream->io_watcher, UV__POLLPRI);
+}
+#endif
+
+
 void uv__stream_destroy(uv_stream_t* stream) {
   assert(!uv__io_active(&stream->io_watcher, POLLIN | POLLOUT));
   assert(stream->flags & UV_HANDLE_CLOSED);
@@ -457,8 +855,10 @@ void uv__stream_destroy(uv_stream_t* stream) {
     stream->connect_req = NULL;
   }
 
+  uv__stream_flush_zerocopy_queue(stream);
   uv__stream_flush_write_queue(stream, UV_ECANCELED);
   uv__write_callbacks(stream);
+  uv__splice_destroy(stream);
 
   if (stream->shutdown_req) {
     /* The ECANCELED error code is a lie, the shutdown(2) syscall is a
@@ -475,53 +875,702 @@ void uv__stream_destroy(uv_stream_t* stream) {
 }
 
 
-/* Implements a best effort approach to mitigating accept() EMFILE errors.
- * We have a spare file descriptor stashed away that we close to get below
- * the EMFILE limit. Next, we accept all pending connections and close them
- * immediately to signal the clients that we're overloaded - and we are, but
- * we still keep on trucking.
- *
- * There is one caveat: it's not reliable in a multi-threaded environment.
- * The file descriptor limit is per process. Our party trick fails if another
- * thread opens a file or creates a socket in the time window between us
- * calling close() and accept().
- */
-static int uv__emfile_trick(uv_loop_t* loop, int accept_fd) {
-  int err;
-  int emfile_fd;
+static int uv__emfile_open(void) {
+  int fd;
 
-  if (loop->emfile_fd == -1)
-    return UV_EMFILE;
+  fd = uv__open_cloexec("/dev/null", O_RDONLY);
+  if (fd < 0)
+    fd = uv__open_cloexec("/", O_RDONLY);
 
-  uv__close(loop->emfile_fd);
-  loop->emfile_fd = -1;
+  return fd;
+}
 
-  do {
-    err = uv__accept(accept_fd);
-    if (err >= 0)
-      uv__close(err);
-  } while (err >= 0 || err == UV_EINTR);
 
-  emfile_fd = uv__open_cloexec("/", O_RDONLY);
-  if (emfile_fd >= 0)
-    loop->emfile_fd = emfile_fd;
+/* 补齐备用fd，全部打开了返回1 */
+static int uv__emfile_refill(struct uv__emfile* e) {
+  int fd;
 
-  return err;
+  while (e->nfds < e->size) {
+    fd = uv__emfile_open();
+    if (fd < 0)
+      return 0;
+    e->fds[e->nfds++] = fd;
+  }
+
+  return 1;
 }
 
 
-#if defined(UV_HAVE_KQUEUE)
-# define UV_DEC_BACKLOG(w) w->rcount--;
-#else
-# define UV_DEC_BACKLOG(w) /* no-op */
-#endif /* defined(UV_HAVE_KQUEUE) */
+static void uv__emfile_release(struct uv__emfile* e) {
+  while (e->nfds > 0)
+    uv__close(e->fds[--e->nfds]);
+}
 
 
-void uv__server_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+static void uv__emfile_timer_cb(uv_timer_t* timer) {
+  struct uv__emfile* e;
+  struct uv__admission* a;
+  uv_stream_t* server;
+  QUEUE* q;
+
+  e = container_of(timer, struct uv__emfile, timer);
+
+  /* 备用fd打不全说明fd还是不够，恢复监听也只会再碰到EMFILE */
+  if (!uv__emfile_refill(e)) {
+    uv__emfile_release(e);
+    uv_timer_start(&e->timer, uv__emfile_timer_cb, e->backoff, 0);
+    return;
+  }
+
+  while (!QUEUE_EMPTY(&e->paused)) {
+    q = QUEUE_HEAD(&e->paused);
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);
+    server = QUEUE_DATA(q, uv_stream_t, emfile_member);
+    a = server->admission;
+    if (server->accepted_fd == -1 && (a == NULL || !a->paused))
+      uv__io_start(server->loop, &server->io_watcher, POLLIN);
+  }
+}
+
+
+int uv__emfile_configure(uv_loop_t* loop,
+                         unsigned int nfds,
+                         unsigned int backoff) {
+  struct uv__emfile* e;
+  int err;
+
+  if (nfds > UV__EMFILE_MAX_RESERVE)
+    return UV_EINVAL;
+
+  e = loop->emfile;
+  if (e == NULL) {
+    e = uv__malloc(sizeof(*e));
+    if (e == NULL)
+      return UV_ENOMEM;
+
+    err = uv_timer_init(loop, &e->timer);
+    if (err) {
+      uv__free(e);
+      return err;
+    }
+
+    e->timer.flags |= UV_HANDLE_INTERNAL;
+    uv__handle_unref(&e->timer);
+    e->nfds = 0;
+    QUEUE_INIT(&e->paused);
+    loop->emfile = e;
+
+    /* 原来的一个备用fd并进池子里 */
+    if (loop->emfile_fd != -1) {
+      e->fds[e->nfds++] = loop->emfile_fd;
+      loop->emfile_fd = -1;
+    }
+  }
+
+  while (e->nfds > nfds)
+    uv__close(e->fds[--e->nfds]);
+
+  e->size = nfds;
+  e->backoff = backoff;
+  uv__emfile_refill(e);
+
+  return 0;
+}
+
+
+void uv__emfile_delete(uv_loop_t* loop) {
+  struct uv__emfile* e;
+
+  e = loop->emfile;
+  if (e == NULL)
+    return;
+
+  uv_timer_stop(&e->timer);
+  QUEUE_REMOVE(&e->timer.handle_queue);
+  uv__emfile_release(e);
+  uv__free(e);
+  loop->emfile = NULL;
+}
+
+
+/* 打开了暂停监听时把备用fd都还给进程，停掉服务端的watcher，到时间由
+ * uv__emfile_timer_cb()恢复。返回1表示已经暂停
+ */
+static int uv__emfile_backoff(uv_loop_t* loop, uv_stream_t* server) {
+  struct uv__emfile* e;
+
+  e = loop->emfile;
+  if (e == NULL || e->backoff == 0)
+    return 0;
+
+  uv__emfile_release(e);
+  uv__io_stop(loop, &server->io_watcher, POLLIN);
+  if (QUEUE_EMPTY(&server->emfile_member))
+    QUEUE_INSERT_TAIL(&e->paused, &server->emfile_member);
+  if (!uv__is_active(&e->timer))
+    uv_timer_start(&e->timer, uv__emfile_timer_cb, e->backoff, 0);
+
+  return 1;
+}
+
+
+/* Implements a best effort approach to mitigating accept() EMFILE errors.
+ * We have a spare file descriptor stashed away that we close to get below
+ * the EMFILE limit. Next, we accept all pending connections and close them
+ * immediately to signal the clients that we're overloaded - and we are, but
+ * we still keep on trucking.
+ *
+ * There is one caveat: it's not reliable in a multi-threaded environment.
+ * The file descriptor limit is per process. Our party trick fails if another
+ * thread opens a file or creates a socket in the time window between us
+ * calling close() and accept().
+ */
+static int uv__emfile_trick(uv_loop_t* loop, int accept_fd) {
+  struct uv__emfile* e;
+  int err;
+  int emfile_fd;
+
+  /* 备用fd池一次全部关掉，给别的线程抢fd多留一点余量 */
+  e = loop->emfile;
+  if (e != NULL) {
+    if (e->nfds == 0 && !uv__emfile_refill(e))
+      return UV_EMFILE;
+
+    uv__emfile_release(e);
+    do {
+      err = uv__accept(accept_fd);
+      if (err >= 0)
+        uv__close(err);
+    } while (err >= 0 || err == UV_EINTR);
+
+    uv__emfile_refill(e);
+    return err;
+  }
+
+  if (loop->emfile_fd == -1)
+    return UV_EMFILE;
+
+  uv__close(loop->emfile_fd);
+  loop->emfile_fd = -1;
+
+  do {
+    err = uv__accept(accept_fd);
+    if (err >= 0)
+      uv__close(err);
+  } while (err >= 0 || err == UV_EINTR);
+
+  emfile_fd = uv__open_cloexec("/", O_RDONLY);
+  if (emfile_fd >= 0)
+    loop->emfile_fd = emfile_fd;
+
+  return err;
+}
+
+
+#if defined(UV_HAVE_KQUEUE)
+# define UV_DEC_BACKLOG(w) w->rcount--;
+#else
+# define UV_DEC_BACKLOG(w) /* no-op */
+#endif /* defined(UV_HAVE_KQUEUE) */
+
+
+/* 已经accept()了、还没被uv_accept()取走的连接数 */
+static unsigned int uv__server_pending(uv_stream_t* stream) {
+  uv__stream_queued_fds_t* queued_fds;
+  unsigned int n;
+
+  n = stream->accepted_fd != -1;
+  queued_fds = stream->queued_fds;
+  if (queued_fds != NULL)
+    n += queued_fds->offset;
+
+  return n;
+}
+
+
+/* 已接受的连接加上还没取走的连接是否到了max_connections */
+static int uv__admission_full(uv_stream_t* server) {
+  struct uv__admission* a;
+
+  a = server->admission;
+  return a->max_connections != 0 &&
+         a->nconnections + uv__server_pending(server) >= a->max_connections;
+}
+
+
+static void uv__admission_resume(struct uv__admission* a) {
+  uv_stream_t* server;
+
+  server = a->server;
+  a->paused = 0;
+  uv_timer_stop(&a->timer);
+
+  /* 用户还没取走的连接由uv_accept()负责重新打开watcher，因为EMFILE暂停的
+   * 等uv__emfile_timer_cb()
+   */
+  if (uv__stream_fd(server) != -1 &&
+      server->accepted_fd == -1 &&
+      QUEUE_EMPTY(&server->emfile_member))
+    uv__io_start(server->loop, &server->io_watcher, POLLIN);
+
+  if (a->cb != NULL)
+    a->cb(server, 0);
+}
+
+
+static void uv__admission_timer_cb(uv_timer_t* timer) {
+  uv__admission_resume(container_of(timer, struct uv__admission, timer));
+}
+
+
+/* 连接数或者延迟超过限制时停掉监听的watcher，返回1 */
+static int uv__admission_check(uv_stream_t* stream) {
+  struct uv__admission* a;
+  uint64_t lag;
+
+  a = stream->admission;
+  if (a == NULL)
+    return 0;
+
+  lag = 0;
+  if (!uv__admission_full(stream)) {
+    if (a->max_lag == 0)
+      return 0;
+
+    /* loop->time在轮询返回时更新过，差值就是这一批回调已经占用的时间 */
+    lag = uv__hrtime(UV_CLOCK_FAST) / 1000000 - stream->loop->time;
+    if (lag < a->max_lag)
+      return 0;
+  }
+
+  uv__io_stop(stream->loop, &stream->io_watcher, POLLIN);
+  a->paused = 1;
+  if (lag != 0)
+    uv_timer_start(&a->timer, uv__admission_timer_cb, a->max_lag, 0);
+
+  if (a->cb != NULL)
+    a->cb(stream, 1);
+
+  return 1;
+}
+
+
+static void uv__admission_accepted(uv_stream_t* server, uv_stream_t* client) {
+  struct uv__admission* a;
+
+  a = server->admission;
+  client->admitted = a;
+  QUEUE_INSERT_TAIL(&a->clients, &client->admitted_member);
+  a->nconnections++;
+}
+
+
+/* 连接关闭，因为连接数暂停的服务端降到限制以下就恢复 */
+static void uv__admission_release(uv_stream_t* client) {
+  struct uv__admission* a;
+
+  a = client->admitted;
+  client->admitted = NULL;
+  QUEUE_REMOVE(&client->admitted_member);
+  QUEUE_INIT(&client->admitted_member);
+  a->nconnections--;
+
+  if (a->paused &&
+      !uv__is_active(&a->timer) &&
+      !uv__admission_full(a->server)) {
+    uv__admission_resume(a);
+  }
+}
+
+
+static void uv__admission_close_cb(uv_handle_t* timer) {
+  uv__free(container_of(timer, struct uv__admission, timer));
+}
+
+
+static void uv__admission_delete(uv_stream_t* server) {
+  struct uv__admission* a;
+  uv_stream_t* client;
+  QUEUE* q;
+
+  a = server->admission;
+  server->admission = NULL;
+
+  while (!QUEUE_EMPTY(&a->clients)) {
+    q = QUEUE_HEAD(&a->clients);
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);
+    client = QUEUE_DATA(q, uv_stream_t, admitted_member);
+    client->admitted = NULL;
+  }
+
+  uv_close((uv_handle_t*) &a->timer, uv__admission_close_cb);
+}
+
+
+static void uv__stream_timeout_bucket_put(struct uv__stream_timeout_loop* t,
+                                          struct uv__stream_timeout_bucket* b) {
+  /* 定时器回调里只减引用，回调结束时统一释放，遍历的组就不会被释放掉 */
+  if (--b->refs == 0 && !t->running) {
+    QUEUE_REMOVE(&b->member);
+    uv__free(b);
+  }
+}
+
+
+static struct uv__stream_timeout_bucket* uv__stream_timeout_bucket_get(
+    struct uv__stream_timeout_loop* t,
+    uint64_t timeout) {
+  struct uv__stream_timeout_bucket* b;
+  QUEUE* q;
+
+  QUEUE_FOREACH(q, &t->buckets) {
+    b = QUEUE_DATA(q, struct uv__stream_timeout_bucket, member);
+    if (b->timeout == timeout) {
+      b->refs++;
+      return b;
+    }
+  }
+
+  b = uv__malloc(sizeof(*b));
+  if (b == NULL)
+    return NULL;
+
+  QUEUE_INIT(&b->entries);
+  b->timeout = timeout;
+  b->refs = 1;
+  QUEUE_INSERT_TAIL(&t->buckets, &b->member);
+  return b;
+}
+
+
+static void uv__stream_timeouts_cb(uv_timer_t* timer);
+
+
+/* 所有组的表头里最早的到期时间启动定时器 */
+static void uv__stream_timeouts_rearm(uv_loop_t* loop,
+                                      struct uv__stream_timeout_loop* t) {
+  struct uv__stream_timeout_bucket* b;
+  struct uv__stream_timeout_entry* e;
+  uint64_t due;
+  QUEUE* q;
+
+  due = 0;
+  QUEUE_FOREACH(q, &t->buckets) {
+    b = QUEUE_DATA(q, struct uv__stream_timeout_bucket, member);
+    if (QUEUE_EMPTY(&b->entries))
+      continue;
+
+    e = QUEUE_DATA(QUEUE_HEAD(&b->entries),
+                   struct uv__stream_timeout_entry,
+                   member);
+    if (due == 0 || e->due < due)
+      due = e->due;
+  }
+
+  t->due = due;
+  if (due == 0) {
+    uv_timer_stop(&t->timer);
+    return;
+  }
+
+  uv_timer_start(&t->timer,
+                 uv__stream_timeouts_cb,
+                 due > loop->time ? due - loop->time : 0,
+                 0);
+}
+
+
+/* 从现在起重新计时。定时器只会提前，不会推迟，晚到期的等它醒来再算 */
+static void uv__stream_timeout_arm(uv_loop_t* loop,
+                                   struct uv__stream_timeout_entry* e) {
+  struct uv__stream_timeout_loop* t;
+
+  QUEUE_REMOVE(&e->member);
+  e->due = loop->time + e->bucket->timeout;
+  QUEUE_INSERT_TAIL(&e->bucket->entries, &e->member);
+
+  t = loop->stream_timeouts;
+  if (t->running || (t->due != 0 && t->due <= e->due))
+    return;
+
+  t->due = e->due;
+  uv_timer_start(&t->timer, uv__stream_timeouts_cb, e->bucket->timeout, 0);
+}
+
+
+static void uv__stream_timeout_disarm(struct uv__stream_timeout_entry* e) {
+  QUEUE_REMOVE(&e->member);
+  QUEUE_INIT(&e->member);
+}
+
+
+/* 读到或者写出了数据：idle重新计时，which正在计时的话也重新计时 */
+static void uv__stream_timeouts_touch(uv_stream_t* stream, int which) {
+  struct uv__stream_timeouts* st;
+  struct uv__stream_timeout_entry* e;
+
+  st = stream->timeouts;
+  e = &st->entries[UV_STREAM_TIMEOUT_IDLE];
+  if (e->bucket != NULL)
+    uv__stream_timeout_arm(stream->loop, e);
+
+  e = &st->entries[which];
+  if (e->bucket != NULL && !QUEUE_EMPTY(&e->member))
+    uv__stream_timeout_arm(stream->loop, e);
+}
+
+
+/* 开始读或者写开始排队时从现在起计时，已经在计时的不动 */
+static void uv__stream_timeouts_start(uv_stream_t* stream, int which) {
+  struct uv__stream_timeout_entry* e;
+
+  e = &((struct uv__stream_timeouts*) stream->timeouts)->entries[which];
+  if (e->bucket != NULL && QUEUE_EMPTY(&e->member))
+    uv__stream_timeout_arm(stream->loop, e);
+}
+
+
+static void uv__stream_timeouts_stop(uv_stream_t* stream, int which) {
+  uv__stream_timeout_disarm(
+      &((struct uv__stream_timeouts*) stream->timeouts)->entries[which]);
+}
+
+
+static void uv__stream_timeouts_cb(uv_timer_t* timer) {
+  struct uv__stream_timeout_bucket* b;
+  struct uv__stream_timeout_entry* e;
+  struct uv__stream_timeout_loop* t;
+  struct uv__stream_timeouts* st;
   uv_stream_t* stream;
+  uv_loop_t* loop;
+  QUEUE* q;
+  QUEUE* next;
+
+  t = container_of(timer, struct uv__stream_timeout_loop, timer);
+  loop = timer->loop;
+  t->running = 1;
+
+  QUEUE_FOREACH(q, &t->buckets) {
+    b = QUEUE_DATA(q, struct uv__stream_timeout_bucket, member);
+
+    while (!QUEUE_EMPTY(&b->entries)) {
+      e = QUEUE_DATA(QUEUE_HEAD(&b->entries),
+                     struct uv__stream_timeout_entry,
+                     member);
+      if (e->due > loop->time)
+        break;
+
+      uv__stream_timeout_disarm(e);
+      stream = e->stream;
+
+      /* 读写状态变了但没有经过停止计时的路径，比如EOF、写队列出错清空 */
+      if (e->which == UV_STREAM_TIMEOUT_READ &&
+          !(stream->flags & UV_HANDLE_READING))
+        continue;
+      if (e->which == UV_STREAM_TIMEOUT_WRITE &&
+          QUEUE_EMPTY(&stream->write_queue))
+        continue;
+
+      /* 回调里关闭流会释放e */
+      st = stream->timeouts;
+      st->cb(stream, e->which);
+    }
+  }
+
+  t->running = 0;
+
+  for (q = QUEUE_HEAD(&t->buckets); q != &t->buckets; q = next) {
+    next = QUEUE_NEXT(q);
+    b = QUEUE_DATA(q, struct uv__stream_timeout_bucket, member);
+    if (b->refs == 0) {
+      QUEUE_REMOVE(&b->member);
+      uv__free(b);
+    }
+  }
+
+  uv__stream_timeouts_rearm(loop, t);
+}
+
+
+static void uv__stream_timeouts_release(uv_stream_t* stream) {
+  struct uv__stream_timeout_loop* t;
+  struct uv__stream_timeouts* st;
+  struct uv__stream_timeout_entry* e;
+  int i;
+
+  t = stream->loop->stream_timeouts;
+  st = stream->timeouts;
+  stream->timeouts = NULL;
+
+  for (i = 0; i < (int) ARRAY_SIZE(st->entries); i++) {
+    e = &st->entries[i];
+    if (e->bucket == NULL)
+      continue;
+    uv__stream_timeout_disarm(e);
+    uv__stream_timeout_bucket_put(t, e->bucket);
+  }
+
+  uv__free(st);
+}
+
+
+int uv_stream_set_timeouts(uv_stream_t* handle,
+                           uint64_t idle,
+                           uint64_t read,
+                           uint64_t write,
+                           uv_stream_timeout_cb cb) {
+  struct uv__stream_timeout_bucket* buckets[3];
+  struct uv__stream_timeout_entry* e;
+  struct uv__stream_timeout_loop* t;
+  struct uv__stream_timeouts* st;
+  uv_loop_t* loop;
+  uint64_t timeouts[3];
+  int i;
+
+  if (uv__is_closing(handle))
+    return UV_EINVAL;
+
+  if (idle == 0 && read == 0 && write == 0) {
+    if (handle->timeouts != NULL)
+      uv__stream_timeouts_release(handle);
+    return 0;
+  }
+
+  if (cb == NULL)
+    return UV_EINVAL;
+
+  loop = handle->loop;
+  t = loop->stream_timeouts;
+  if (t == NULL) {
+    t = uv__malloc(sizeof(*t));
+    if (t == NULL)
+      return UV_ENOMEM;
+
+    uv_timer_init(loop, &t->timer);
+    t->timer.flags |= UV_HANDLE_INTERNAL;
+    uv__handle_unref(&t->timer);
+    QUEUE_INIT(&t->buckets);
+    t->due = 0;
+    t->running = 0;
+    loop->stream_timeouts = t;
+  }
+
+  st = handle->timeouts;
+  if (st == NULL) {
+    st = uv__malloc(sizeof(*st));
+    if (st == NULL)
+      return UV_ENOMEM;
+
+    for (i = 0; i < (int) ARRAY_SIZE(st->entries); i++) {
+      e = &st->entries[i];
+      QUEUE_INIT(&e->member);
+      e->bucket = NULL;
+      e->due = 0;
+      e->stream = handle;
+      e->which = i;
+    }
+  }
+
+  /* 先拿到所有的组，分配失败时什么都不改 */
+  timeouts[UV_STREAM_TIMEOUT_IDLE] = idle;
+  timeouts[UV_STREAM_TIMEOUT_READ] = read;
+  timeouts[UV_STREAM_TIMEOUT_WRITE] = write;
+  for (i = 0; i < 3; i++) {
+    buckets[i] = NULL;
+    if (timeouts[i] == 0)
+      continue;
+
+    buckets[i] = uv__stream_timeout_bucket_get(t, timeouts[i]);
+    if (buckets[i] == NULL) {
+      while (i-- > 0)
+        if (buckets[i] != NULL)
+          uv__stream_timeout_bucket_put(t, buckets[i]);
+      if (st != handle->timeouts)
+        uv__free(st);
+      return UV_ENOMEM;
+    }
+  }
+
+  for (i = 0; i < 3; i++) {
+    e = &st->entries[i];
+    uv__stream_timeout_disarm(e);
+    if (e->bucket != NULL)
+      uv__stream_timeout_bucket_put(t, e->bucket);
+    e->bucket = buckets[i];
+  }
+
+  st->cb = cb;
+  handle->timeouts = st;
+
+  /* 新的超时从现在起算 */
+  e = &st->entries[UV_STREAM_TIMEOUT_IDLE];
+  if (e->bucket != NULL)
+    uv__stream_timeout_arm(loop, e);
+  if (handle->flags & UV_HANDLE_READING)
+    uv__stream_timeouts_start(handle, UV_STREAM_TIMEOUT_READ);
+  if (!QUEUE_EMPTY(&handle->write_queue))
+    uv__stream_timeouts_start(handle, UV_STREAM_TIMEOUT_WRITE);
+
+  return 0;
+}
+
+
+void uv__stream_timeouts_delete(uv_loop_t* loop) {
+  struct uv__stream_timeout_loop* t;
+  QUEUE* q;
+
+  t = loop->stream_timeouts;
+  if (t == NULL)
+    return;
+
+  /* 流都已经关闭，组的引用都已经放掉 */
+  while (!QUEUE_EMPTY(&t->buckets)) {
+    q = QUEUE_HEAD(&t->buckets);
+    QUEUE_REMOVE(q);
+    uv__free(QUEUE_DATA(q, struct uv__stream_timeout_bucket, member));
+  }
+
+  uv_timer_stop(&t->timer);
+  QUEUE_REMOVE(&t->timer.handle_queue);
+  uv__free(t);
+  loop->stream_timeouts = NULL;
+}
+
+
+int uv_stream_set_rate_limit(uv_stream_t* handle,
+                             uv_rate_limit_t* read,
+                             uv_rate_limit_t* write) {
+  struct uv__rate_limits* limits;
+
+  if (uv__is_closing(handle))
+    return UV_EINVAL;
+
+  /* multishot recv不经过uv__read()，限不住 */
+  limits = handle->rate_limit;
+  if (read != NULL &&
+      (limits == NULL || limits->in.limit == NULL) &&
+      (handle->flags & UV_HANDLE_READING) &&
+      (handle->loop->flags & UV_LOOP_IO_URING))
+    return UV_EBUSY;
+
+  return uv__rate_limits_set((uv_handle_t*) handle,
+                             &handle->rate_limit,
+                             &handle->io_watcher,
+                             read,
+                             write);
+}
+
+
+void uv__server_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  uv_stream_t* stream;
+  unsigned int pending;
+  unsigned int n;
   int err;
 
   stream = container_of(w, uv_stream_t, io_watcher);
+  uv__handle_activity(stream);
   assert(events & POLLIN);
   assert(stream->accepted_fd == -1);
   assert(!(stream->flags & UV_HANDLE_CLOSING));
@@ -539,27 +1588,71 @@ void uv__server_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
       return;
 #endif /* defined(UV_HAVE_KQUEUE) */
 
+    if (uv__admission_check(stream))
+      return;
+
     err = uv__accept(uv__stream_fd(stream));
     if (err < 0) {
       if (err == UV_EAGAIN || err == UV__ERR(EWOULDBLOCK))
         return;  /* Not an error. */
 
-      if (err == UV_ECONNABORTED)
-        continue;  /* Ignore. Nothing we can do about that. */
+      if (err == UV_ECONNABORTED)
+        continue;  /* Ignore. Nothing we can do about that. */
+
+      if (err == UV_EMFILE || err == UV_ENFILE) {
+        if (uv__emfile_backoff(loop, stream)) {
+          stream->connection_cb(stream, err);
+          return;
+        }
+
+        err = uv__emfile_trick(loop, uv__stream_fd(stream));
+        if (err == UV_EAGAIN || err == UV__ERR(EWOULDBLOCK))
+          break;
+      }
+
+      stream->connection_cb(stream, err);
+      continue;
+    }
+
+    UV_DEC_BACKLOG(w)
+    stream->accepted_fd = err;
+
+    /* 一次多接几个连接排在queued_fds里，connection_cb里uv_accept()可以
+     * 连着取。出错的话留到下一轮循环按原来的方式处理
+     */
+    for (n = 1; n < stream->accept_burst; n++) {
+#if defined(UV_HAVE_KQUEUE)
+      if (w->rcount <= 0)
+        break;
+#endif /* defined(UV_HAVE_KQUEUE) */
+
+      if (stream->admission != NULL && uv__admission_full(stream))
+        break;
+
+      err = uv__accept(uv__stream_fd(stream));
+      if (err < 0)
+        break;
 
-      if (err == UV_EMFILE || err == UV_ENFILE) {
-        err = uv__emfile_trick(loop, uv__stream_fd(stream));
-        if (err == UV_EAGAIN || err == UV__ERR(EWOULDBLOCK))
-          break;
+      if (uv__stream_queue_fd(stream, err)) {
+        uv__close(err);
+        break;
       }
 
-      stream->connection_cb(stream, err);
-      continue;
+      UV_DEC_BACKLOG(w)
     }
 
-    UV_DEC_BACKLOG(w)
-    stream->accepted_fd = err;
-    stream->connection_cb(stream, 0);
+    /* 用户每次回调只uv_accept()一个的话，剩下的接着回调，直到取完或者
+     * 用户不再取为止
+     */
+    do {
+      pending = uv__server_pending(stream);
+      stream->connection_cb(stream, 0);
+    } while (uv__stream_fd(stream) != -1 &&
+             stream->accepted_fd != -1 &&
+             uv__server_pending(stream) < pending);
+
+    if (uv__stream_fd(stream) == -1)
+      return;  /* connection_cb closed the server. */
 
     if (stream->accepted_fd != -1) {
       /* The user hasn't yet accepted called uv_accept() */
@@ -580,6 +1673,109 @@ void uv__server_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
 #undef UV_DEC_BACKLOG
 
 
+/* io_uring后端用multishot accept代替watcher的poll请求时，watcher对应的服务端。
+ * UV_HANDLE_TCP_SINGLE_ACCEPT的socket和别的进程共用，multishot会把连接都抢过来，
+ * 还是按可读事件一个一个地接受
+ */
+uv_stream_t* uv__server_multishot(uv__io_t* w) {
+  uv_stream_t* stream;
+
+  if (w->cb != uv__server_io || (w->pevents & ~UV__POLLFLAGS) != POLLIN)
+    return NULL;
+
+  stream = container_of(w, uv_stream_t, io_watcher);
+  if (stream->type == UV_TCP && (stream->flags & UV_HANDLE_TCP_SINGLE_ACCEPT))
+    return NULL;
+
+  return stream;
+}
+
+
+/* multishot accept接受了一个连接。用户还没取走上一个的话排进队列，等uv_accept()
+ * 取；否则和uv__server_io()一样回调，直到取完或者用户不再取为止
+ */
+void uv__server_accepted(uv_stream_t* stream, int fd) {
+  unsigned int pending;
+
+  uv__handle_activity(stream);
+
+  if (stream->accepted_fd != -1) {
+    if (uv__stream_queue_fd(stream, fd))
+      uv__close(fd);
+    return;
+  }
+
+  stream->accepted_fd = fd;
+  do {
+    pending = uv__server_pending(stream);
+    stream->connection_cb(stream, 0);
+  } while (uv__stream_fd(stream) != -1 &&
+           stream->accepted_fd != -1 &&
+           uv__server_pending(stream) < pending);
+
+  if (uv__stream_fd(stream) == -1)
+    return;  /* connection_cb closed the server. */
+
+  if (stream->accepted_fd != -1) {
+    uv__io_stop(stream->loop, &stream->io_watcher, POLLIN);
+    return;
+  }
+
+  /* 接受以后才检查，已经在路上的连接会超出max_connections几个 */
+  uv__admission_check(stream);
+}
+
+
+/* accepted_fd已经被取走：队列里的下一个连接补上来，队列空了并且没有出错时
+ * 重新开始监听
+ */
+static void uv__server_advance(uv_stream_t* server, int err) {
+  /* Process queued fds */
+  if (server->queued_fds != NULL) {
+    uv__stream_queued_fds_t* queued_fds;
+
+    queued_fds = server->queued_fds;
+
+    /* Read first */
+    server->accepted_fd = queued_fds->fds[0];
+
+    /* All read, free */
+    assert(queued_fds->offset > 0);
+    if (--queued_fds->offset == 0) {
+      uv__free(queued_fds);
+      server->queued_fds = NULL;
+    } else {
+      /* Shift rest */
+      memmove(queued_fds->fds,
+              queued_fds->fds + 1,
+              queued_fds->offset * sizeof(*queued_fds->fds));
+    }
+  } else {
+    server->accepted_fd = -1;
+    if (err == 0 &&
+        QUEUE_EMPTY(&server->emfile_member) &&
+        (server->admission == NULL ||
+         !((struct uv__admission*) server->admission)->paused)) {
+      uv__io_start(server->loop, &server->io_watcher, POLLIN);
+    }
+  }
+}
+
+
+/* 把accepted_fd交给别处处理（比如转给另一个loop），效果和uv_accept()取走
+ * 一个连接一样
+ */
+int uv__server_take_fd(uv_stream_t* server) {
+  int fd;
+
+  fd = server->accepted_fd;
+  if (fd != -1)
+    uv__server_advance(server, 0);
+
+  return fd;
+}
+
+
 int uv_accept(uv_stream_t* server, uv_stream_t* client) {
   int err;
 
@@ -590,6 +1786,8 @@ int uv_accept(uv_stream_t* server, uv_stream_t* client) {
 
   switch (client->type) {
     case UV_NAMED_PIPE:
+      uv__pipe_probe_seqpacket((uv_pipe_t*) client, server->accepted_fd);
+      /* fall through */
     case UV_TCP:
       err = uv__stream_open(client,
                             server->accepted_fd,
@@ -599,6 +1797,8 @@ int uv_accept(uv_stream_t* server, uv_stream_t* client) {
         uv__close(server->accepted_fd);
         goto done;
       }
+      if (server->admission != NULL)
+        uv__admission_accepted(server, client);
       break;
 
     case UV_UDP:
@@ -616,32 +1816,75 @@ int uv_accept(uv_stream_t* server, uv_stream_t* client) {
   client->flags |= UV_HANDLE_BOUND;
 
 done:
-  /* Process queued fds */
-  if (server->queued_fds != NULL) {
-    uv__stream_queued_fds_t* queued_fds;
+  uv__server_advance(server, err);
+  return err;
+}
 
-    queued_fds = server->queued_fds;
 
-    /* Read first */
-    server->accepted_fd = queued_fds->fds[0];
+/* 每次可读事件最多accept()多少个连接，默认1个。大于1时多出来的连接排在
+ * 服务端的队列里，connection_cb里循环uv_accept()直到UV_EAGAIN就能一次取完
+ */
+int uv_stream_set_accept_burst(uv_stream_t* server, unsigned int burst) {
+  if (burst == 0)
+    return UV_EINVAL;
 
-    /* All read, free */
-    assert(queued_fds->offset > 0);
-    if (--queued_fds->offset == 0) {
-      uv__free(queued_fds);
-      server->queued_fds = NULL;
-    } else {
-      /* Shift rest */
-      memmove(queued_fds->fds,
-              queued_fds->fds + 1,
-              queued_fds->offset * sizeof(*queued_fds->fds));
+  server->accept_burst = burst;
+  return 0;
+}
+
+
+int uv_stream_set_admission(uv_stream_t* server,
+                            unsigned int max_connections,
+                            uint64_t max_lag,
+                            uv_admission_cb cb) {
+  struct uv__admission* a;
+  int err;
+
+  if (server->type != UV_TCP && server->type != UV_NAMED_PIPE)
+    return UV_EINVAL;
+
+  if (uv__is_closing(server))
+    return UV_EINVAL;
+
+  a = server->admission;
+  if (max_connections == 0 && max_lag == 0) {
+    if (a != NULL) {
+      if (a->paused)
+        uv__admission_resume(a);
+      uv__admission_delete(server);
     }
-  } else {
-    server->accepted_fd = -1;
-    if (err == 0)
-      uv__io_start(server->loop, &server->io_watcher, POLLIN);
+    return 0;
   }
-  return err;
+
+  if (a == NULL) {
+    a = uv__malloc(sizeof(*a));
+    if (a == NULL)
+      return UV_ENOMEM;
+
+    err = uv_timer_init(server->loop, &a->timer);
+    if (err) {
+      uv__free(a);
+      return err;
+    }
+
+    a->timer.flags |= UV_HANDLE_INTERNAL;
+    uv__handle_unref(&a->timer);
+    a->server = server;
+    a->nconnections = 0;
+    a->paused = 0;
+    QUEUE_INIT(&a->clients);
+    server->admission = a;
+  }
+
+  a->max_connections = max_connections;
+  a->max_lag = max_lag;
+  a->cb = cb;
+
+  /* 限制变了，先恢复，下一次可读事件时按新的限制重新判断 */
+  if (a->paused)
+    uv__admission_resume(a);
+
+  return 0;
 }
 
 
@@ -672,95 +1915,357 @@ static void uv__drain(uv_stream_t* stream) {
   uv_shutdown_t* req;
   int err;
 
-  assert(QUEUE_EMPTY(&stream->write_queue));
-  uv__io_stop(stream->loop, &stream->io_watcher, POLLOUT);
-  uv__stream_osx_interrupt_select(stream);
+  assert(QUEUE_EMPTY(&stream->write_queue));
+  uv__io_stop(stream->loop, &stream->io_watcher, POLLOUT);
+  uv__stream_osx_interrupt_select(stream);
+
+  /* Shutdown? */
+  if ((stream->flags & UV_HANDLE_SHUTTING) &&
+      !(stream->flags & UV_HANDLE_CLOSING) &&
+      !(stream->flags & UV_HANDLE_SHUT)) {
+    assert(stream->shutdown_req);
+
+    req = stream->shutdown_req;
+    stream->shutdown_req = NULL;
+    stream->flags &= ~UV_HANDLE_SHUTTING;
+    uv__req_unregister(stream->loop, req);
+
+    err = 0;
+    if (shutdown(uv__stream_fd(stream), SHUT_WR))
+      err = UV__ERR(errno);
+
+    if (err == 0)
+      stream->flags |= UV_HANDLE_SHUT;
+
+    if (req->cb != NULL)
+      req->cb(req, err);
+  }
+}
+
+
+static size_t uv__write_req_size(uv_write_t* req) {
+  size_t size;
+
+  assert(req->bufs != NULL);
+  size = uv__count_bufs(req->bufs + req->write_index,
+                        req->nbufs - req->write_index);
+  assert(req->handle->write_queue_size >= size);
+
+  return size;
+}
+
+
+/* 超过bufsml、不超过UV__WRITE_BUFS_MAX个缓冲区的数组都按UV__WRITE_BUFS_MAX
+ * 分配，用完挂到loop的空闲链表上，常见的6到12个iovec的写就不用每次malloc
+ */
+static uv_buf_t* uv__write_bufs_alloc(uv_loop_t* loop, unsigned int nbufs) {
+  void* bufs;
+
+  if (nbufs > UV__WRITE_BUFS_MAX)
+    return uv__malloc_tag(UV_MEM_STREAM_WRITE, nbufs * sizeof(uv_buf_t));
+
+  bufs = loop->write_bufs_free;
+  if (bufs == NULL)
+    return uv__malloc_tag(UV_MEM_STREAM_WRITE,
+                          UV__WRITE_BUFS_MAX * sizeof(uv_buf_t));
+
+  loop->write_bufs_free = *(void**) bufs;
+  loop->write_bufs_nfree--;
+  return bufs;
+}
+
+
+static void uv__write_bufs_free(uv_loop_t* loop,
+                                uv_buf_t* bufs,
+                                unsigned int nbufs) {
+  if (bufs == NULL)
+    return;
+
+  if (nbufs > UV__WRITE_BUFS_MAX ||
+      loop->write_bufs_nfree >= UV__WRITE_BUFS_FREE_MAX) {
+    uv__free_tag(bufs);
+    return;
+  }
+
+  *(void**) bufs = loop->write_bufs_free;
+  loop->write_bufs_free = bufs;
+  loop->write_bufs_nfree++;
+}
+
+
+static void uv__write_send_handles_free(uv_write_t* req) {
+  if (req->send_handles != &req->send_handle)
+    uv__free(req->send_handles);
+  req->send_handles = NULL;
+  req->nsend_handles = 0;
+}
+
+
+/* 请求没能立即写完，开始在写队列里等待，第一次调用时记下时间 */
+static void uv__write_req_queued(uv_write_t* req) {
+#if !defined(UV_DISABLE_IO_STATS)
+  if (req->queued_time == 0)
+    req->queued_time = uv__hrtime(UV_CLOCK_PRECISE);
+#endif
+}
+
+
+static void uv__write_req_finish(uv_write_t* req) {
+  uv_stream_t* stream = req->handle;
+
+  /* Pop the req off tcp->write_queue. */
+  QUEUE_REMOVE(&req->queue);
+  if (stream->timeouts != NULL && QUEUE_EMPTY(&stream->write_queue))
+    uv__stream_timeouts_stop(stream, UV_STREAM_TIMEOUT_WRITE);
+
+#if !defined(UV_DISABLE_IO_STATS)
+  if (req->queued_time != 0) {
+    stream->io_stats.write_queued++;
+    stream->io_stats.write_queue_time +=
+        uv__hrtime(UV_CLOCK_PRECISE) - req->queued_time;
+    req->queued_time = 0;
+  }
+#endif
+
+  /* Only free when there was no error. On error, we touch up write_queue_size
+   * right before making the callback. The reason we don't do that right away
+   * is that a write_queue_size > 0 is our only way to signal to the user that
+   * they should stop writing - which they should if we got an error. Something
+   * to revisit in future revisions of the libuv API.
+   */
+  if (req->error == 0) {
+    if (req->bufs != req->bufsml)
+      uv__write_bufs_free(stream->loop, req->bufs, req->nbufs);
+    req->bufs = NULL;
+  }
+
+#if defined(__linux__)
+  /* 零拷贝发出去的页内核还在用，要等错误队列里的完成通知。前面还有没完成
+   * 的零拷贝请求时普通请求也跟着排队，保证回调的顺序和写的顺序一致
+   */
+  if (req->error == 0 &&
+      (req->zerocopy == 2 || !QUEUE_EMPTY(&stream->zerocopy_queue))) {
+    req->zerocopy_seq = stream->zerocopy_next - 1;
+    QUEUE_INSERT_TAIL(&stream->zerocopy_queue, &req->queue);
+    uv__io_start(stream->loop, &stream->io_watcher, UV__POLLPRI);
+    return;
+  }
+#endif
+
+  /* Add it to the write_completed_queue where it will have its
+   * callback called in the near future.
+   */
+  QUEUE_INSERT_TAIL(&stream->write_completed_queue, &req->queue);
+  uv__io_feed(stream->loop, &stream->io_watcher);
+}
+
+
+static int uv__handle_fd(uv_handle_t* handle) {
+  switch (handle->type) {
+    case UV_NAMED_PIPE:
+    case UV_TCP:
+      return ((uv_stream_t*) handle)->io_watcher.fd;
+
+    case UV_UDP:
+      return ((uv_udp_t*) handle)->io_watcher.fd;
+
+    default:
+      return -1;
+  }
+}
+
+/* 发送sendfile请求里剩下的部分，返回写出去的字节数或者错误码。
+ * 文件提前结束时返回UV_EOF
+ */
+static ssize_t uv__write_sendfile(uv_stream_t* stream, uv_write_t* req) {
+  char buf[8192];
+  ssize_t nread;
+  ssize_t n;
+  size_t len;
+
+  len = req->bufs[0].len;
+
+#if defined(__linux__)
+  {
+    off_t off;
+
+    off = req->sendfile_off;
+    do
+      n = sendfile(uv__stream_fd(stream), req->sendfile_fd, &off, len);
+    while (n == -1 && errno == EINTR);
+
+    if (n == 0)
+      return UV_EOF;
+
+    if (n != -1) {
+      req->sendfile_off = off;
+      return n;
+    }
+
+    if (errno != EINVAL &&
+        errno != EIO &&
+        errno != ENOSYS &&
+        errno != ENOTSOCK &&
+        errno != EXDEV)
+      return UV__ERR(errno);
+  }
+#endif
+
+  /* 其他平台或者文件不支持sendfile()时用pread()+write()，一次只搬一块。
+   * pread()不会移动文件位置，没写出去的部分下次重新读就行
+   */
+  if (len > sizeof(buf))
+    len = sizeof(buf);
+
+  do
+    nread = pread(req->sendfile_fd, buf, len, req->sendfile_off);
+  while (nread == -1 && errno == EINTR);
+
+  if (nread == -1)
+    return UV__ERR(errno);
+
+  if (nread == 0)
+    return UV_EOF;
+
+  do
+    n = write(uv__stream_fd(stream), buf, nread);
+  while (n == -1 && errno == EINTR);
+
+  if (n == -1)
+    return UV__ERR(errno);
+
+  req->sendfile_off += n;
+  return n;
+}
 
-  /* Shutdown? */
-  if ((stream->flags & UV_HANDLE_SHUTTING) &&
-      !(stream->flags & UV_HANDLE_CLOSING) &&
-      !(stream->flags & UV_HANDLE_SHUT)) {
-    assert(stream->shutdown_req);
 
-    req = stream->shutdown_req;
-    stream->shutdown_req = NULL;
-    stream->flags &= ~UV_HANDLE_SHUTTING;
-    uv__req_unregister(stream->loop, req);
+/* 从队头开始把不带send_handle的请求的缓冲区复制到iov里，最多iovmax个，
+ * 这样一次writev()就能写出多个请求
+ */
+static int uv__write_gather(uv_stream_t* stream,
+                            struct iovec* iov,
+                            int iovmax) {
+  uv_write_t* req;
+  unsigned int i;
+  int iovcnt;
+  QUEUE* q;
 
-    err = 0;
-    if (shutdown(uv__stream_fd(stream), SHUT_WR))
-      err = UV__ERR(errno);
+  iovcnt = 0;
+  QUEUE_FOREACH(q, &stream->write_queue) {
+    req = QUEUE_DATA(q, uv_write_t, queue);
+    if (req->nsend_handles > 0 || req->zerocopy || req->sendfile_fd != -1)
+      break;
 
-    if (err == 0)
-      stream->flags |= UV_HANDLE_SHUT;
+    for (i = req->write_index; i < req->nbufs && iovcnt < iovmax; i++) {
+      iov[iovcnt].iov_base = req->bufs[i].base;
+      iov[iovcnt].iov_len = req->bufs[i].len;
+      iovcnt++;
+    }
 
-    if (req->cb != NULL)
-      req->cb(req, err);
+    if (iovcnt == iovmax)
+      break;
   }
+
+  return iovcnt;
 }
 
 
-static size_t uv__write_req_size(uv_write_t* req) {
-  size_t size;
+#if defined(__linux__)
+/* SOCK_SEQPACKET的pipe上每个写请求是一条消息，不能拼进同一个writev()。
+ * 排着好几个请求时用一次sendmmsg()发出去，返回发完的请求数；只有一个
+ * 能发的请求时返回0，由调用方照常写
+ */
+static int uv__write_mmsg(uv_stream_t* stream) {
+  struct uv__mmsghdr h[UV__WRITE_MMSG_MAX];
+  uv_write_t* req;
+  QUEUE* q;
+  unsigned int iovmax;
+  unsigned int n;
+  int npkts;
+  int i;
 
-  assert(req->bufs != NULL);
-  size = uv__count_bufs(req->bufs + req->write_index,
-                        req->nbufs - req->write_index);
-  assert(req->handle->write_queue_size >= size);
+  iovmax = uv__getiovmax();
+  n = 0;
+  QUEUE_FOREACH(q, &stream->write_queue) {
+    if (n == ARRAY_SIZE(h))
+      break;
 
-  return size;
-}
+    req = QUEUE_DATA(q, uv_write_t, queue);
+    if (req->nsend_handles > 0 ||
+        req->zerocopy ||
+        req->sendfile_fd != -1 ||
+        req->write_index != 0 ||
+        req->nbufs > iovmax) {
+      break;
+    }
 
+    memset(&h[n], 0, sizeof(h[n]));
+    h[n].msg_hdr.msg_iov = (struct iovec*) req->bufs;
+    h[n].msg_hdr.msg_iovlen = req->nbufs;
+    n++;
+  }
 
-static void uv__write_req_finish(uv_write_t* req) {
-  uv_stream_t* stream = req->handle;
+  if (n < 2)
+    return 0;
 
-  /* Pop the req off tcp->write_queue. */
-  QUEUE_REMOVE(&req->queue);
+  do
+    npkts = uv__sendmmsg(uv__stream_fd(stream), h, n, 0);
+  while (npkts == -1 && errno == EINTR);
 
-  /* Only free when there was no error. On error, we touch up write_queue_size
-   * right before making the callback. The reason we don't do that right away
-   * is that a write_queue_size > 0 is our only way to signal to the user that
-   * they should stop writing - which they should if we got an error. Something
-   * to revisit in future revisions of the libuv API.
-   */
-  if (req->error == 0) {
-    if (req->bufs != req->bufsml)
-      uv__free(req->bufs);
-    req->bufs = NULL;
+  if (npkts == -1)
+    return UV__ERR(errno);
+
+  /* 发出去的消息都是完整的 */
+  for (i = 0; i < npkts; i++) {
+    q = QUEUE_HEAD(&stream->write_queue);
+    req = QUEUE_DATA(q, uv_write_t, queue);
+    stream->write_queue_size -= uv__write_req_size(req);
+    req->write_index = req->nbufs;
+    uv__write_req_finish(req);
   }
 
-  /* Add it to the write_completed_queue where it will have its
-   * callback called in the near future.
-   */
-  QUEUE_INSERT_TAIL(&stream->write_completed_queue, &req->queue);
-  uv__io_feed(stream->loop, &stream->io_watcher);
+  return npkts;
 }
+#endif
 
 
-static int uv__handle_fd(uv_handle_t* handle) {
-  switch (handle->type) {
-    case UV_NAMED_PIPE:
-    case UV_TCP:
-      return ((uv_stream_t*) handle)->io_watcher.fd;
+/* 限速时这一次只写quota字节：复制到dst里再截断，请求的缓冲区不动 */
+static int uv__write_quota(struct iovec* dst,
+                           const struct iovec* src,
+                           int iovcnt,
+                           size_t quota) {
+  int i;
 
-    case UV_UDP:
-      return ((uv_udp_t*) handle)->io_watcher.fd;
+  if (iovcnt > UV__WRITE_GATHER_MAX)
+    iovcnt = UV__WRITE_GATHER_MAX;
 
-    default:
-      return -1;
+  for (i = 0; i < iovcnt && quota > 0; i++) {
+    dst[i] = src[i];
+    if (dst[i].iov_len > quota)
+      dst[i].iov_len = quota;
+    quota -= dst[i].iov_len;
   }
+
+  return i;
 }
 
+
 static void uv__write(uv_stream_t* stream) {
+  struct iovec gather[UV__WRITE_GATHER_MAX];
   struct iovec* iov;
+  struct uv__rate_limits* limits;
   QUEUE* q;
   uv_write_t* req;
+  size_t quota;
   int iovmax;
   int iovcnt;
+  int count;
   ssize_t n;
   int err;
 
+  /* 和uv__read()一样，一次最多连续写32轮，避免饿死其他流 */
+  count = 32;
+
 start:
 
   assert(uv__stream_fd(stream) >= 0);
@@ -768,10 +2273,84 @@ start:
   if (QUEUE_EMPTY(&stream->write_queue))
     return;
 
+  /* 没有令牌时停掉POLLOUT，等限速器补充以后再写 */
+  limits = stream->rate_limit;
+  quota = SIZE_MAX;
+  if (limits != NULL) {
+    quota = uv__rate_limit_quota(&limits->out);
+    if (quota == 0)
+      return;
+  }
+
   q = QUEUE_HEAD(&stream->write_queue);
   req = QUEUE_DATA(q, uv_write_t, queue);
   assert(req->handle == stream);
 
+  if (req->sendfile_fd != -1) {
+    n = uv__write_sendfile(stream, req);
+    UV__IO_STATS_WRITE(stream, n);
+    if (n > 0 && limits != NULL)
+      uv__rate_limit_consume(&limits->out, n);
+    if (n > 0 && stream->timeouts != NULL)
+      uv__stream_timeouts_touch(stream, UV_STREAM_TIMEOUT_WRITE);
+
+    if (n < 0) {
+      if (n != UV_EAGAIN && n != UV__ERR(EWOULDBLOCK) && n != UV_ENOBUFS) {
+        err = n;
+        goto error;
+      }
+    } else {
+      req->bufs[0].len -= n;
+      stream->write_queue_size -= n;
+
+      if (req->bufs[0].len == 0) {
+        req->write_index = 1;
+        uv__write_req_finish(req);
+        if (!QUEUE_EMPTY(&stream->write_queue)) {
+          if (--count > 0)
+            goto start;
+          uv__io_rearm(stream->loop, &stream->io_watcher);
+        }
+        return;
+      }
+    }
+
+    if (stream->flags & UV_HANDLE_BLOCKING_WRITES)
+      goto start;
+
+    goto pending;
+  }
+
+#if defined(__linux__)
+  if (UV__STREAM_SEQPACKET(stream) &&
+      limits == NULL &&
+      QUEUE_NEXT(q) != &stream->write_queue) {
+    n = uv__write_mmsg(stream);
+
+    if (n > 0) {
+      if (!QUEUE_EMPTY(&stream->write_queue)) {
+        if (--count > 0)
+          goto start;
+        uv__io_rearm(stream->loop, &stream->io_watcher);
+      }
+      return;
+    }
+
+    if (n == UV_EAGAIN || n == UV__ERR(EWOULDBLOCK) || n == UV_ENOBUFS) {
+      if (stream->flags & UV_HANDLE_BLOCKING_WRITES)
+        goto start;
+      n = -1;
+      goto pending;
+    }
+
+    /* 内核没有sendmmsg()的话下面逐个写 */
+    if (n < 0 && n != UV_ENOSYS) {
+      err = n;
+      goto error;
+    }
+  }
+#endif
+
   /*
    * Cast to iovec. We had to have our own uv_buf_t instead of iovec
    * because Windows's WSABUF is not an iovec.
@@ -786,50 +2365,73 @@ start:
   if (iovcnt > iovmax)
     iovcnt = iovmax;
 
+  /* 后面还排着请求（比如uv_stream_uncork()之后）就拼到同一个writev()里 */
+  if (req->nsend_handles == 0 &&
+      !req->zerocopy &&
+      !UV__STREAM_SEQPACKET(stream) &&
+      iovcnt < iovmax &&
+      iovcnt < UV__WRITE_GATHER_MAX &&
+      QUEUE_NEXT(q) != &stream->write_queue) {
+    iovcnt = uv__write_gather(stream,
+                              gather,
+                              iovmax < UV__WRITE_GATHER_MAX ? iovmax
+                                                            : UV__WRITE_GATHER_MAX);
+    iov = gather;
+  }
+
+  /* 按消息写的流不能截断，欠下的令牌以后再还 */
+  if (quota != SIZE_MAX && !UV__STREAM_SEQPACKET(stream)) {
+    iovcnt = uv__write_quota(gather, iov, iovcnt, quota);
+    iov = gather;
+  }
+
   /*
    * Now do the actual writev. Note that we've been updating the pointers
    * inside the iov each time we write. So there is no need to offset it.
    */
 
-  if (req->send_handle) {
+  if (req->nsend_handles > 0) {
     int fd_to_send;
     struct msghdr msg;
     struct cmsghdr *cmsg;
+    unsigned int i;
     union {
-      char data[64];
+      char data[CMSG_SPACE(UV__SEND_HANDLES_MAX * sizeof(int))];
       struct cmsghdr alias;
     } scratch;
 
-    if (uv__is_closing(req->send_handle)) {
-      err = UV_EBADF;
-      goto error;
-    }
-
-    fd_to_send = uv__handle_fd((uv_handle_t*) req->send_handle);
-
     memset(&scratch, 0, sizeof(scratch));
 
-    assert(fd_to_send >= 0);
-
     msg.msg_name = NULL;
     msg.msg_namelen = 0;
     msg.msg_iov = iov;
     msg.msg_iovlen = iovcnt;
     msg.msg_flags = 0;
 
+    /* 所有handle的fd放在同一个SCM_RIGHTS里，对端一次recvmsg()全部收到 */
     msg.msg_control = &scratch.alias;
-    msg.msg_controllen = CMSG_SPACE(sizeof(fd_to_send));
+    msg.msg_controllen = CMSG_SPACE(req->nsend_handles * sizeof(fd_to_send));
 
     cmsg = CMSG_FIRSTHDR(&msg);
     cmsg->cmsg_level = SOL_SOCKET;
     cmsg->cmsg_type = SCM_RIGHTS;
-    cmsg->cmsg_len = CMSG_LEN(sizeof(fd_to_send));
+    cmsg->cmsg_len = CMSG_LEN(req->nsend_handles * sizeof(fd_to_send));
 
-    /* silence aliasing warning */
-    {
-      void* pv = CMSG_DATA(cmsg);
-      int* pi = pv;
-      *pi = fd_to_send;
+    for (i = 0; i < req->nsend_handles; i++) {
+      if (uv__is_closing(req->send_handles[i])) {
+        err = UV_EBADF;
+        goto error;
+      }
+
+      fd_to_send = uv__handle_fd((uv_handle_t*) req->send_handles[i]);
+      assert(fd_to_send >= 0);
+
+      /* silence aliasing warning */
+      {
+        void* pv = CMSG_DATA(cmsg);
+        int* pi = pv;
+        pi[i] = fd_to_send;
+      }
     }
 
     do {
@@ -846,6 +2448,49 @@ start:
 #else
     while (n == -1 && errno == EINTR);
 #endif
+
+    /* fd跟着第一段数据过去了，没写完的部分不能再带一遍 */
+    if (n >= 0)
+      uv__write_send_handles_free(req);
+#if defined(__linux__)
+  } else if (req->zerocopy && stream->type == UV_NAMED_PIPE) {
+    /* 页挂进pipe就算写完了，不用等通知 */
+    do
+      n = vmsplice(uv__stream_fd(stream),
+                   iov,
+                   iovcnt,
+                   SPLICE_F_GIFT | SPLICE_F_NONBLOCK);
+    while (n == -1 && errno == EINTR);
+
+    if (n == -1 && (errno == ENOSYS || errno == EINVAL || errno == EBADF)) {
+      /* 对端换成了不支持的fd，以后都走普通的写 */
+      req->zerocopy = 0;
+      do
+        n = writev(uv__stream_fd(stream), iov, iovcnt);
+      while (n == -1 && errno == EINTR);
+    }
+  } else if (req->zerocopy) {
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    do
+      n = sendmsg(uv__stream_fd(stream), &msg, MSG_ZEROCOPY);
+    while (n == -1 && errno == EINTR);
+
+    if (n > 0) {
+      /* 内核给每次写出了数据的MSG_ZEROCOPY发送分配一个递增的序号 */
+      stream->zerocopy_next++;
+      req->zerocopy = 2;
+    } else if (n == -1 && errno == ENOBUFS) {
+      /* 钉住的页超过了optmem_max的限制，这一次先退回普通的拷贝 */
+      do
+        n = writev(uv__stream_fd(stream), iov, iovcnt);
+      while (n == -1 && errno == EINTR);
+    }
+#endif
   } else {
     do {
       if (iovcnt == 1) {
@@ -867,11 +2512,26 @@ start:
 #endif
   }
 
+  UV__PROBE4(write, stream, req, iovcnt, n);
+  UV__IO_STATS_WRITE(stream, n);
+  if (n > 0 && limits != NULL)
+    uv__rate_limit_consume(&limits->out, n);
+  if (n > 0 && stream->timeouts != NULL)
+    uv__stream_timeouts_touch(stream, UV_STREAM_TIMEOUT_WRITE);
+
   if (n < 0) {
     if (!WRITE_RETRY_ON_ERROR(req->send_handle)) {
       err = UV__ERR(errno);
       goto error;
-    } else if (stream->flags & UV_HANDLE_BLOCKING_WRITES) {
+    }
+
+    if (stream->type == UV_NAMED_PIPE)
+      uv__sockbuf_grow(stream->loop,
+                       &((uv_pipe_t*) stream)->sockbuf_tune,
+                       uv__stream_fd(stream),
+                       SO_SNDBUF);
+
+    if (stream->flags & UV_HANDLE_BLOCKING_WRITES) {
       /* If this is a blocking stream, try again. */
       goto start;
     }
@@ -913,11 +2573,23 @@ start:
         stream->write_queue_size -= len;
 
         if (req->write_index == req->nbufs) {
-          /* Then we're done! */
-          assert(n == 0);
           uv__write_req_finish(req);
-          /* TODO: start trying to write the next request. */
-          return;
+
+          /* 拼进来的数据都写完了，还有请求的话接着写 */
+          if (n == 0) {
+            /* 边缘触发时写满32轮就停下的话还没写到EAGAIN，要重新注册 */
+            if (!QUEUE_EMPTY(&stream->write_queue)) {
+              if (--count > 0)
+                goto start;
+              uv__io_rearm(stream->loop, &stream->io_watcher);
+            }
+            return;
+          }
+
+          /* 剩下的n个字节属于下一个请求 */
+          assert(!QUEUE_EMPTY(&stream->write_queue));
+          q = QUEUE_HEAD(&stream->write_queue);
+          req = QUEUE_DATA(q, uv_write_t, queue);
         }
       }
     }
@@ -926,8 +2598,21 @@ start:
   /* Either we've counted n down to zero or we've got EAGAIN. */
   assert(n == 0 || n == -1);
 
+pending:
   /* Only non-blocking streams should use the write_watcher. */
   assert(!(stream->flags & UV_HANDLE_BLOCKING_WRITES));
+  uv__write_req_queued(req);
+  if (stream->timeouts != NULL)
+    uv__stream_timeouts_start(stream, UV_STREAM_TIMEOUT_WRITE);
+
+  /* 边缘触发时只写出了一部分（n不是-1）并不说明内核缓冲区已经满了，比如iov被
+   * iovmax截断，要接着写到EAGAIN才能等下一次POLLOUT
+   */
+  if (n >= 0 && (stream->io_watcher.pevents & UV__POLLET)) {
+    if (--count > 0)
+      goto start;
+    uv__io_rearm(stream->loop, &stream->io_watcher);
+  }
 
   /* We're not done. */
   uv__io_start(stream->loop, &stream->io_watcher, POLLOUT);
@@ -941,13 +2626,19 @@ error:
   req->error = err;
   uv__write_req_finish(req);
   uv__io_stop(stream->loop, &stream->io_watcher, POLLOUT);
-  if (!uv__io_active(&stream->io_watcher, POLLIN))
+  if (!uv__io_active(&stream->io_watcher, POLLIN) &&
+      !uv__stream_recv_armed(stream) &&
+      !uv__stream_rate_waiting(stream, 0))
     uv__handle_stop(stream);
   uv__stream_osx_interrupt_select(stream);
 }
 
 
 static void uv__write_callbacks(uv_stream_t* stream) {
+  uv_write_t* batch[UV__WRITE_BATCH_MAX];
+  int status[UV__WRITE_BATCH_MAX];
+  unsigned int nbatch;
+  uv_write_batch_cb batch_cb;
   uv_write_t* req;
   QUEUE* q;
   QUEUE pq;
@@ -956,6 +2647,9 @@ static void uv__write_callbacks(uv_stream_t* stream) {
     return;
 
   QUEUE_MOVE(&stream->write_completed_queue, &pq);
+  /* 回调里可能改掉，这一批按开始时的设置交出去 */
+  batch_cb = stream->write_batch_cb;
+  nbatch = 0;
 
   while (!QUEUE_EMPTY(&pq)) {
     /* Pop a req off write_completed_queue. */
@@ -967,14 +2661,36 @@ static void uv__write_callbacks(uv_stream_t* stream) {
     if (req->bufs != NULL) {
       stream->write_queue_size -= uv__write_req_size(req);
       if (req->bufs != req->bufsml)
-        uv__free(req->bufs);
+        uv__write_bufs_free(stream->loop, req->bufs, req->nbufs);
       req->bufs = NULL;
     }
 
+    if (req->shared != NULL) {
+      uv_shared_buf_unref(req->shared);
+      req->shared = NULL;
+    }
+
+    uv__iobuf_drop(req->iobuf_owners, req->iobuf_nowners);
+    req->iobuf_owners = NULL;
+
+    if (req->send_handles != NULL)
+      uv__write_send_handles_free(req);
+
     /* NOTE: call callback AFTER freeing the request data. */
-    if (req->cb)
+    if (req->cb) {
       req->cb(req, req->error);
+    } else if (batch_cb != NULL) {
+      batch[nbatch] = req;
+      status[nbatch] = req->error;
+      if (++nbatch == ARRAY_SIZE(batch)) {
+        batch_cb(stream, batch, status, nbatch);
+        nbatch = 0;
+      }
+    }
   }
+
+  if (nbatch != 0)
+    batch_cb(stream, batch, status, nbatch);
 }
 
 
@@ -1021,13 +2737,95 @@ uv_handle_type uv__handle_type(int fd) {
 }
 
 
-static void uv__stream_eof(uv_stream_t* stream, const uv_buf_t* buf) {
+/* 调用用户的读回调，iov模式下把所有缓冲区都交给read_iov_cb */
+/* uv_read_start_batch()：uv__read()期间读到的缓冲区先放在这里 */
+struct uv__read_batch {
+  uv_buf_t bufs[UV__READ_BATCH_MAX];
+  unsigned int nbufs;
+  size_t total;
+};
+
+
+static void uv__read_batch_flush(uv_stream_t* stream,
+                                 struct uv__read_batch* batch,
+                                 uv_read_batch_cb cb) {
+  unsigned int nbufs;
+  size_t total;
+
+  nbufs = batch->nbufs;
+  total = batch->total;
+  if (nbufs == 0)
+    return;
+
+  batch->nbufs = 0;
+  batch->total = 0;
+  cb(stream, total, batch->bufs, nbufs);
+}
+
+
+/* 数据和EAGAIN时没用上的缓冲区攒起来，出错时先交出攒着的再报错。不在
+ * uv__read_batch()里面时（比如POLLHUP补报的EOF）直接回调
+ */
+static void uv__read_batch_add(uv_stream_t* stream,
+                               ssize_t nread,
+                               const uv_buf_t* buf) {
+  struct uv__read_batch* batch;
+  struct uv__read_batch one;
+  uv_read_batch_cb cb;
+  uv_buf_t b;
+
+  /* 回调里可能uv_read_stop()，先记下来 */
+  cb = stream->read_batch_cb;
+  batch = stream->read_batch;
+  if (batch == NULL) {
+    one.nbufs = 0;
+    one.total = 0;
+    batch = &one;
+  }
+
+  b = *buf;
+  b.len = 0;
+
+  if (nread < 0) {
+    uv__read_batch_flush(stream, batch, cb);
+    cb(stream, nread, &b, b.base != NULL);
+    return;
+  }
+
+  if (b.base != NULL) {
+    b.len = nread;
+    batch->bufs[batch->nbufs++] = b;
+    batch->total += nread;
+  }
+
+  if (batch == &one || batch->nbufs == ARRAY_SIZE(batch->bufs))
+    uv__read_batch_flush(stream, batch, cb);
+}
+
+
+static void uv__read_done(uv_stream_t* stream,
+                          ssize_t nread,
+                          const uv_buf_t* bufs,
+                          unsigned int nbufs) {
+  if (stream->read_iov_cb != NULL)
+    stream->read_iov_cb(stream, nread, bufs, nbufs);
+  else if (stream->read_batch_cb != NULL)
+    uv__read_batch_add(stream, nread, bufs);
+  else
+    stream->read_cb(stream, nread, bufs);
+}
+
+
+static void uv__stream_eof(uv_stream_t* stream,
+                           const uv_buf_t* bufs,
+                           unsigned int nbufs) {
   stream->flags |= UV_HANDLE_READ_EOF;
   uv__io_stop(stream->loop, &stream->io_watcher, POLLIN);
-  if (!uv__io_active(&stream->io_watcher, POLLOUT))
+  if (!uv__io_active(&stream->io_watcher, POLLOUT) &&
+      !uv__stream_rate_waiting(stream, 1))
     uv__handle_stop(stream);
   uv__stream_osx_interrupt_select(stream);
-  stream->read_cb(stream, UV_EOF, buf);
+  uv__read_done(stream, UV_EOF, bufs, nbufs);
   stream->flags &= ~UV_HANDLE_READING;
 }
 
@@ -1071,8 +2869,10 @@ static int uv__stream_queue_fd(uv_stream_t* stream, int fd) {
 }
 
 
-#define UV__CMSG_FD_COUNT 64
+#define UV__CMSG_FD_COUNT UV__SEND_HANDLES_MAX
 #define UV__CMSG_FD_SIZE (UV__CMSG_FD_COUNT * sizeof(int))
+/* alloc_iov_cb一次最多能给出的缓冲区个数 */
+#define UV__READ_IOV_MAX 16
 
 
 static int uv__stream_recv_cmsg(uv_stream_t* stream, struct msghdr* msg) {
@@ -1125,64 +2925,202 @@ static int uv__stream_recv_cmsg(uv_stream_t* stream, struct msghdr* msg) {
 }
 
 
+/* 每次成功读完之后调整下一次的suggested_size。读满了说明数据比缓冲区多，
+ * 用FIONREAD看看内核里还积压了多少，一次长到位；连续两次不到一半才缩小，
+ * 避免大小在两档之间来回跳
+ */
+static void uv__read_hint_update(uv_stream_t* stream,
+                                 size_t nread,
+                                 size_t buflen) {
+  size_t hint;
+  int pending;
+
+  hint = stream->read_hint;
+
+  if (nread >= buflen) {
+    stream->read_hint_small = 0;
+    hint *= 2;
+    if (ioctl(uv__stream_fd(stream), FIONREAD, &pending) == 0 &&
+        (size_t) pending > hint)
+      hint = pending;
+    if (hint > stream->read_hint_max)
+      hint = stream->read_hint_max;
+  } else if (nread < hint / 2) {
+    if (++stream->read_hint_small < 2)
+      return;
+    stream->read_hint_small = 0;
+    hint /= 2;
+    if (hint < stream->read_hint_min)
+      hint = stream->read_hint_min;
+  } else {
+    stream->read_hint_small = 0;
+  }
+
+  stream->read_hint = hint;
+}
+
+
 #ifdef __clang__
 # pragma clang diagnostic push
 # pragma clang diagnostic ignored "-Wgnu-folding-constant"
 # pragma clang diagnostic ignored "-Wvla-extension"
 #endif
 
+/* UV_LOOP_EDGE_TRIGGERED：TCP和非ipc的管道读的时候以边缘触发方式注册，uv__read()
+ * 没读空就停下的时候自己重新注册。tty按行返回，ipc管道在带fd的消息处截断，读到的
+ * 比缓冲区少也不说明读空了，仍然用水平触发。
+ */
+static unsigned int uv__stream_pollet(const uv_stream_t* stream) {
+  if (!(stream->loop->flags & UV_LOOP_STREAM_ET))
+    return 0;
+
+  if (stream->type == UV_TCP)
+    return UV__POLLET;
+
+  if (stream->type == UV_NAMED_PIPE && !((const uv_pipe_t*) stream)->ipc)
+    return UV__POLLET;
+
+  return 0;
+}
+
+
+/* 边缘触发的流读到的数据比缓冲区少时调用：数据和FIN（或者RST）一起到达的话，
+ * 读完数据以后不会再报告一次，所以用MSG_PEEK看一眼后面还有没有东西，返回1表示
+ * 要接着读。这样不用为了读到EAGAIN再分配一次缓冲区，也不会多一次nread为0的
+ * read_cb。普通管道不是socket，读到的比缓冲区少就是读空了，写端关闭会报POLLHUP。
+ */
+static int uv__read_more(uv_stream_t* stream) {
+  ssize_t n;
+  char c;
+
+  do
+    n = recv(uv__stream_fd(stream), &c, 1, MSG_PEEK);
+  while (n == -1 && errno == EINTR);
+
+  if (n == -1)
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTSOCK)
+      return 0;
+
+  return 1;
+}
+
+
 static void uv__read(uv_stream_t* stream) {
-  uv_buf_t buf;
+  uv_buf_t bufs[UV__READ_IOV_MAX];
+  struct uv__rate_limits* limits;
+  unsigned int nbufs;
+  unsigned int i;
+  size_t buflen;
+  size_t quota;
+  size_t budget;
+  size_t total;
   ssize_t nread;
   struct msghdr msg;
   char cmsg_space[CMSG_SPACE(UV__CMSG_FD_SIZE)];
   int count;
   int err;
   int is_ipc;
+  int seqpacket;
+  int et;
 
   stream->flags &= ~UV_HANDLE_READ_PARTIAL;
 
   /* Prevent loop starvation when the data comes in as fast as (or faster than)
-   * we can read it. XXX Need to rearm fd if we switch to edge-triggered I/O.
+   * we can read it.
+   *
+   * 预算由流自己设置，没有设置时用loop的。用完之后剩下的数据留到下一轮，
+   * 水平触发的epoll会再报告一次，边缘触发的要调用uv__io_rearm()重新注册
    */
-  count = 32;
+  if (stream->read_budget != 0) {
+    count = stream->read_budget;
+    budget = stream->read_budget_bytes;
+  } else {
+    count = stream->loop->read_budget;
+    budget = stream->loop->read_budget_bytes;
+  }
+  total = 0;
 
   is_ipc = stream->type == UV_NAMED_PIPE && ((uv_pipe_t*) stream)->ipc;
+  seqpacket = UV__STREAM_SEQPACKET(stream);
+  et = (stream->io_watcher.pevents & UV__POLLET) != 0;
+  limits = stream->rate_limit;
 
   /* XXX: Maybe instead of having UV_HANDLE_READING we just test if
    * tcp->read_cb is NULL or not?
    */
-  while (stream->read_cb
+  while ((stream->read_cb || stream->read_iov_cb || stream->read_batch_cb)
       && (stream->flags & UV_HANDLE_READING)
       && (count-- > 0)) {
-    assert(stream->alloc_cb != NULL);
+    /* 没有令牌时停掉POLLIN，数据留在内核里等限速器补充 */
+    quota = SIZE_MAX;
+    if (limits != NULL) {
+      quota = uv__rate_limit_quota(&limits->in);
+      if (quota == 0)
+        return;
+    }
+
+    bufs[0] = uv_buf_init(NULL, 0);
+    nbufs = 1;
+    /* iov模式下alloc_iov_cb可以给出多个缓冲区，进来时nbufs是数组的长度 */
+    if (stream->alloc_iov_cb != NULL) {
+      nbufs = ARRAY_SIZE(bufs);
+      stream->alloc_iov_cb((uv_handle_t*) stream,
+                           stream->read_hint != 0 ? stream->read_hint
+                                                  : 64 * 1024,
+                           bufs,
+                           &nbufs);
+      assert(nbufs <= ARRAY_SIZE(bufs));
+    } else {
+      assert(stream->alloc_cb != NULL);
+      stream->alloc_cb((uv_handle_t*)stream,
+                       stream->read_hint != 0 ? stream->read_hint : 64 * 1024,
+                       bufs);
+    }
 
-    buf = uv_buf_init(NULL, 0);
-    stream->alloc_cb((uv_handle_t*)stream, 64 * 1024, &buf);
-    if (buf.base == NULL || buf.len == 0) {
+    buflen = 0;
+    for (i = 0; i < nbufs; i++)
+      buflen += bufs[i].len;
+
+    /* 最多读quota字节，按消息读的不能截断 */
+    if (quota < buflen && !seqpacket && buflen != 0) {
+      for (i = 0; i < nbufs && quota > bufs[i].len; i++)
+        quota -= bufs[i].len;
+      bufs[i].len = quota;
+      nbufs = i + 1;
+      buflen = 0;
+      for (i = 0; i < nbufs; i++)
+        buflen += bufs[i].len;
+    }
+
+    if (nbufs == 0 || bufs[0].base == NULL || buflen == 0) {
       /* User indicates it can't or won't handle the read. */
-      stream->read_cb(stream, UV_ENOBUFS, &buf);
+      uv__read_done(stream, UV_ENOBUFS, bufs, nbufs);
+      if (et && (stream->flags & UV_HANDLE_READING))
+        uv__io_rearm(stream->loop, &stream->io_watcher);
       return;
     }
 
-    assert(buf.base != NULL);
+    assert(bufs[0].base != NULL);
     assert(uv__stream_fd(stream) >= 0);
 
-    if (!is_ipc) {
+    if (!is_ipc && !seqpacket) {
       do {
-        nread = read(uv__stream_fd(stream), buf.base, buf.len);
+        if (nbufs == 1)
+          nread = read(uv__stream_fd(stream), bufs[0].base, bufs[0].len);
+        else
+          nread = readv(uv__stream_fd(stream), (struct iovec*) bufs, nbufs);
       }
       while (nread < 0 && errno == EINTR);
     } else {
-      /* ipc uses recvmsg */
+      /* ipc uses recvmsg, SOCK_SEQPACKET需要它报告消息有没有被截断 */
       msg.msg_flags = 0;
-      msg.msg_iov = (struct iovec*) &buf;
-      msg.msg_iovlen = 1;
+      msg.msg_iov = (struct iovec*) bufs;
+      msg.msg_iovlen = nbufs;
       msg.msg_name = NULL;
       msg.msg_namelen = 0;
       /* Set up to receive a descriptor even if one isn't in the message */
-      msg.msg_controllen = sizeof(cmsg_space);
-      msg.msg_control = cmsg_space;
+      msg.msg_controllen = is_ipc ? sizeof(cmsg_space) : 0;
+      msg.msg_control = is_ipc ? cmsg_space : NULL;
 
       do {
         nread = uv__recvmsg(uv__stream_fd(stream), &msg, 0);
@@ -1190,6 +3128,13 @@ static void uv__read(uv_stream_t* stream) {
       while (nread < 0 && errno == EINTR);
     }
 
+    UV__PROBE3(read, stream, nbufs, nread);
+    UV__IO_STATS_READ(stream, nread);
+    if (nread > 0 && limits != NULL)
+      uv__rate_limit_consume(&limits->in, nread);
+    if (nread > 0 && stream->timeouts != NULL)
+      uv__stream_timeouts_touch(stream, UV_STREAM_TIMEOUT_READ);
+
     if (nread < 0) {
       /* Error */
       if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -1198,35 +3143,37 @@ static void uv__read(uv_stream_t* stream) {
           uv__io_start(stream->loop, &stream->io_watcher, POLLIN);
           uv__stream_osx_interrupt_select(stream);
         }
-        stream->read_cb(stream, 0, &buf);
+        uv__read_done(stream, 0, bufs, nbufs);
 #if defined(__CYGWIN__) || defined(__MSYS__)
       } else if (errno == ECONNRESET && stream->type == UV_NAMED_PIPE) {
-        uv__stream_eof(stream, &buf);
+        uv__stream_eof(stream, bufs, nbufs);
         return;
 #endif
       } else {
         /* Error. User should call uv_close(). */
-        stream->read_cb(stream, UV__ERR(errno), &buf);
+        uv__read_done(stream, UV__ERR(errno), bufs, nbufs);
         if (stream->flags & UV_HANDLE_READING) {
           stream->flags &= ~UV_HANDLE_READING;
           uv__io_stop(stream->loop, &stream->io_watcher, POLLIN);
-          if (!uv__io_active(&stream->io_watcher, POLLOUT))
+          if (!uv__io_active(&stream->io_watcher, POLLOUT) &&
+              !uv__stream_rate_waiting(stream, 1))
             uv__handle_stop(stream);
           uv__stream_osx_interrupt_select(stream);
         }
       }
       return;
     } else if (nread == 0) {
-      uv__stream_eof(stream, &buf);
+      uv__stream_eof(stream, bufs, nbufs);
       return;
     } else {
       /* Successful read */
-      ssize_t buflen = buf.len;
+      if (stream->read_hint != 0)
+        uv__read_hint_update(stream, nread, buflen);
 
       if (is_ipc) {
         err = uv__stream_recv_cmsg(stream, &msg);
         if (err != 0) {
-          stream->read_cb(stream, err, &buf);
+          uv__read_done(stream, err, bufs, nbufs);
           return;
         }
       }
@@ -1246,7 +3193,7 @@ static void uv__read(uv_stream_t* stream) {
           nread = uv__recvmsg(uv__stream_fd(stream), &msg, 0);
           err = uv__stream_recv_cmsg(stream, &msg);
           if (err != 0) {
-            stream->read_cb(stream, err, &buf);
+            uv__read_done(stream, err, bufs, nbufs);
             msg.msg_iov = old;
             return;
           }
@@ -1254,15 +3201,51 @@ static void uv__read(uv_stream_t* stream) {
         msg.msg_iov = old;
       }
 #endif
-      stream->read_cb(stream, nread, &buf);
+      /* 消息的剩余部分已经被内核丢掉了，接着读下一条 */
+      if (seqpacket && (msg.msg_flags & MSG_TRUNC)) {
+        uv__read_done(stream, UV_EMSGSIZE, bufs, nbufs);
+        continue;
+      }
+
+      uv__read_done(stream, nread, bufs, nbufs);
 
-      /* Return if we didn't fill the buffer, there is no more data to read. */
-      if (nread < buflen) {
+      /* Return if we didn't fill the buffer, there is no more data to read.
+       * 按消息读的时候每次都读不满，一直读到EAGAIN或者用完预算
+       */
+      if ((size_t) nread < buflen && !seqpacket) {
         stream->flags |= UV_HANDLE_READ_PARTIAL;
-        return;
+        if (!et ||
+            !(stream->flags & UV_HANDLE_READING) ||
+            !uv__read_more(stream)) {
+          return;
+        }
       }
+
+      /* 这一轮读够了字节数，把机会让给其他流 */
+      total += nread;
+      if (budget != 0 && total >= budget)
+        break;
     }
   }
+
+  /* 用完了预算还没读空 */
+  if (et && (stream->flags & UV_HANDLE_READING))
+    uv__io_rearm(stream->loop, &stream->io_watcher);
+}
+
+
+/* 和uv__read()一样读，读到的缓冲区最后一起交给read_batch_cb */
+static void uv__read_batch(uv_stream_t* stream) {
+  struct uv__read_batch batch;
+  uv_read_batch_cb cb;
+
+  cb = stream->read_batch_cb;
+  batch.nbufs = 0;
+  batch.total = 0;
+  stream->read_batch = &batch;
+  uv__read(stream);
+  stream->read_batch = NULL;
+  uv__read_batch_flush(stream, &batch, cb);
 }
 
 
@@ -1272,6 +3255,7 @@ static void uv__read(uv_stream_t* stream) {
 
 #undef UV__CMSG_FD_COUNT
 #undef UV__CMSG_FD_SIZE
+#undef UV__READ_IOV_MAX
 
 
 int uv_shutdown(uv_shutdown_t* req, uv_stream_t* stream, uv_shutdown_cb cb) {
@@ -1286,6 +3270,9 @@ int uv_shutdown(uv_shutdown_t* req, uv_stream_t* stream, uv_shutdown_cb cb) {
     return UV_ENOTCONN;
   }
 
+  if (stream->splice_dst != NULL)
+    return UV_EBUSY;
+
   assert(uv__stream_fd(stream) >= 0);
 
   /* Initialize request */
@@ -1302,10 +3289,11 @@ int uv_shutdown(uv_shutdown_t* req, uv_stream_t* stream, uv_shutdown_cb cb) {
 }
 
 
-static void uv__stream_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+void uv__stream_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
   uv_stream_t* stream;
 
   stream = container_of(w, uv_stream_t, io_watcher);
+  uv__handle_activity(stream);
 
   assert(stream->type == UV_TCP ||
          stream->type == UV_NAMED_PIPE ||
@@ -1319,9 +3307,36 @@ static void uv__stream_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
 
   assert(uv__stream_fd(stream) >= 0);
 
+  if (stream->type == UV_NAMED_PIPE)
+    uv__sockbuf_idle(loop,
+                     &((uv_pipe_t*) stream)->sockbuf_tune,
+                     uv__stream_fd(stream));
+
+#if defined(__linux__)
+  /* 错误队列里有零拷贝的完成通知时epoll会报POLLERR */
+  if ((events & POLLERR) && !QUEUE_EMPTY(&stream->zerocopy_queue))
+    uv__stream_zerocopy_done(stream);
+#endif
+
+  if (stream->splice_src != NULL && (events & (POLLIN | POLLERR | POLLHUP))) {
+    uv__splice_run(stream->splice_src);
+    if (uv__stream_fd(stream) == -1)
+      return;  /* splice cb closed stream. */
+  }
+
+  if (stream->splice_dst != NULL && (events & (POLLOUT | POLLERR | POLLHUP))) {
+    uv__splice_run(stream->splice_dst);
+    if (uv__stream_fd(stream) == -1)
+      return;  /* splice cb closed stream. */
+  }
+
   /* Ignore POLLHUP here. Even if it's set, there may still be data to read. */
-  if (events & (POLLIN | POLLERR | POLLHUP))
-    uv__read(stream);
+  if (events & (POLLIN | POLLERR | POLLHUP)) {
+    if (stream->read_batch_cb != NULL)
+      uv__read_batch(stream);
+    else
+      uv__read(stream);
+  }
 
   if (uv__stream_fd(stream) == -1)
     return;  /* read_cb closed stream. */
@@ -1337,7 +3352,7 @@ static void uv__stream_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
       (stream->flags & UV_HANDLE_READ_PARTIAL) &&
       !(stream->flags & UV_HANDLE_READ_EOF)) {
     uv_buf_t buf = { NULL, 0 };
-    uv__stream_eof(stream, &buf);
+    uv__stream_eof(stream, &buf, 1);
   }
 
   if (uv__stream_fd(stream) == -1)
@@ -1346,9 +3361,10 @@ static void uv__stream_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
   if (events & (POLLOUT | POLLERR | POLLHUP)) {
     uv__write(stream);
     uv__write_callbacks(stream);
+    uv__stream_watermarks(stream);
 
-    /* Write queue drained. */
-    if (QUEUE_EMPTY(&stream->write_queue))
+    /* Write queue drained. 转发中的dst还要靠POLLOUT，不能停 */
+    if (QUEUE_EMPTY(&stream->write_queue) && stream->splice_dst == NULL)
       uv__drain(stream);
   }
 }
@@ -1407,13 +3423,16 @@ static void uv__stream_connect(uv_stream_t* stream) {
   }
 }
 
-
-int uv_write2(uv_write_t* req,
-              uv_stream_t* stream,
-              const uv_buf_t bufs[],
-              unsigned int nbufs,
-              uv_stream_t* send_handle,
-              uv_write_cb cb) {
+
+static int uv__write2(uv_write_t* req,
+                      uv_stream_t* stream,
+                      const uv_buf_t bufs[],
+                      unsigned int nbufs,
+                      uv_stream_t** send_handles,
+                      unsigned int nsend_handles,
+                      uv_write_cb cb) {
+  uv_stream_t** handles;
+  unsigned int i;
   int empty_queue;
 
   assert(nbufs > 0);
@@ -1428,18 +3447,25 @@ int uv_write2(uv_write_t* req,
   if (!(stream->flags & UV_HANDLE_WRITABLE))
     return -EPIPE;
 
-  if (send_handle) {
+  if (stream->splice_dst != NULL)
+    return UV_EBUSY;
+
+  if (nsend_handles > 0) {
     if (stream->type != UV_NAMED_PIPE || !((uv_pipe_t*)stream)->ipc)
       return UV_EINVAL;
 
+    if (nsend_handles > UV__SEND_HANDLES_MAX)
+      return UV_EINVAL;
+
     /* XXX We abuse uv_write2() to send over UDP handles to child processes.
      * Don't call uv__stream_fd() on those handles, it's a macro that on OS X
      * evaluates to a function that operates on a uv_stream_t with a couple of
      * OS X specific fields. On other Unices it does (handle)->io_watcher.fd,
      * which works but only by accident.
      */
-    if (uv__handle_fd((uv_handle_t*) send_handle) < 0)
-      return UV_EBADF;
+    for (i = 0; i < nsend_handles; i++)
+      if (uv__handle_fd((uv_handle_t*) send_handles[i]) < 0)
+        return UV_EBADF;
 
 #if defined(__CYGWIN__) || defined(__MSYS__)
     /* Cygwin recvmsg always sets msg_controllen to zero, so we cannot send it.
@@ -1456,20 +3482,40 @@ int uv_write2(uv_write_t* req,
    */
   empty_queue = (stream->write_queue_size == 0);
 
+  /* 只有一个handle时不用另外分配 */
+  handles = NULL;
+  if (nsend_handles == 1) {
+    handles = &req->send_handle;
+  } else if (nsend_handles > 1) {
+    handles = uv__malloc(nsend_handles * sizeof(*handles));
+    if (handles == NULL)
+      return UV_ENOMEM;
+    memcpy(handles, send_handles, nsend_handles * sizeof(*handles));
+  }
+
   /* Initialize the req */
   uv__req_init(stream->loop, req, UV_WRITE);
   req->cb = cb;
   req->handle = stream;
   req->error = 0;
-  req->send_handle = send_handle;
+  req->send_handle = nsend_handles > 0 ? send_handles[0] : NULL;
+  req->send_handles = handles;
+  req->nsend_handles = nsend_handles;
+  req->zerocopy_seq = 0;
+  req->queued_time = 0;
+  req->iobuf_owners = NULL;
+  req->iobuf_nowners = 0;
   QUEUE_INIT(&req->queue);
 
   req->bufs = req->bufsml;
   if (nbufs > ARRAY_SIZE(req->bufsml))
-    req->bufs = uv__malloc(nbufs * sizeof(bufs[0]));
+    req->bufs = uv__write_bufs_alloc(stream->loop, nbufs);
 
-  if (req->bufs == NULL)
+  if (req->bufs == NULL) {
+    if (handles != &req->send_handle)
+      uv__free(handles);
     return UV_ENOMEM;
+  }
 
   memcpy(req->bufs, bufs, nbufs * sizeof(bufs[0]));
   req->nbufs = nbufs;
@@ -1485,11 +3531,19 @@ int uv_write2(uv_write_t* req,
    */
   if (stream->connect_req) {
     /* Still connecting, do nothing. */
+    uv__write_req_queued(req);
+  }
+  else if (stream->flags & UV_HANDLE_CORKED) {
+    /* 等uv_stream_uncork()时一起写，缓冲的tty自己决定什么时候写 */
+    uv__write_req_queued(req);
+    if (stream->type == UV_TTY)
+      uv__tty_write((uv_tty_t*) stream);
   }
   else if (empty_queue) {
     uv__write(stream);
   }
   else {
+    uv__write_req_queued(req);
     /*
      * blocking streams should never have anything in the queue.
      * if this assert fires then somehow the blocking stream isn't being
@@ -1504,6 +3558,48 @@ int uv_write2(uv_write_t* req,
 }
 
 
+int uv_write2(uv_write_t* req,
+              uv_stream_t* stream,
+              const uv_buf_t bufs[],
+              unsigned int nbufs,
+              uv_stream_t* send_handle,
+              uv_write_cb cb) {
+  return uv_write2_handles(req,
+                           stream,
+                           bufs,
+                           nbufs,
+                           &send_handle,
+                           send_handle != NULL,
+                           cb);
+}
+
+
+int uv_write2_handles(uv_write_t* req,
+                      uv_stream_t* stream,
+                      const uv_buf_t bufs[],
+                      unsigned int nbufs,
+                      uv_stream_t* send_handles[],
+                      unsigned int nsend_handles,
+                      uv_write_cb cb) {
+  int err;
+
+  req->zerocopy = 0;
+  req->sendfile_fd = -1;
+  req->shared = NULL;
+  err = uv__write2(req,
+                   stream,
+                   bufs,
+                   nbufs,
+                   send_handles,
+                   nsend_handles,
+                   cb);
+  if (err == 0)
+    uv__stream_watermarks(stream);
+
+  return err;
+}
+
+
 /* The buffers to be written must remain valid until the callback is called.
  * This is not required for the uv_buf_t array.
  */
@@ -1516,6 +3612,263 @@ int uv_write(uv_write_t* req,
 }
 
 
+int uv_write_zerocopy(uv_write_t* req,
+                      uv_stream_t* handle,
+                      const uv_buf_t bufs[],
+                      unsigned int nbufs,
+                      uv_write_cb cb) {
+  int zerocopy;
+  int err;
+#if defined(__linux__)
+  struct stat s;
+  int on;
+#endif
+
+  zerocopy = 0;
+
+#if defined(__linux__)
+  /* SO_ZEROCOPY要4.14以上的内核，设置失败就当普通写 */
+  if (handle->type == UV_TCP && uv__stream_fd(handle) >= 0) {
+    if (!(handle->flags & UV_HANDLE_ZEROCOPY)) {
+      on = 1;
+      if (setsockopt(uv__stream_fd(handle),
+                     SOL_SOCKET,
+                     SO_ZEROCOPY,
+                     &on,
+                     sizeof(on)) == 0)
+        handle->flags |= UV_HANDLE_ZEROCOPY;
+    }
+
+    zerocopy = (handle->flags & UV_HANDLE_ZEROCOPY) != 0;
+  }
+
+  /* 只有pipe(2)能vmsplice()，socketpair不行 */
+  if (handle->type == UV_NAMED_PIPE &&
+      !((uv_pipe_t*) handle)->ipc &&
+      uv__stream_fd(handle) >= 0 &&
+      fstat(uv__stream_fd(handle), &s) == 0 &&
+      S_ISFIFO(s.st_mode)) {
+    zerocopy = 1;
+  }
+#endif
+
+  req->zerocopy = zerocopy;
+  req->sendfile_fd = -1;
+  req->shared = NULL;
+  err = uv__write2(req, handle, bufs, nbufs, NULL, 0, cb);
+  if (err == 0)
+    uv__stream_watermarks(handle);
+
+  return err;
+}
+
+
+/* 把文件fd从offset开始的length字节写到流里，和uv_write()的请求一起排队。
+ * 在loop线程里等流可写时用非阻塞的sendfile()发送，不占线程池
+ */
+int uv_stream_sendfile(uv_write_t* req,
+                       uv_stream_t* handle,
+                       uv_os_fd_t fd,
+                       int64_t offset,
+                       size_t length,
+                       uv_write_cb cb) {
+  uv_buf_t buf;
+  int err;
+
+  if (fd < 0 || offset < 0 || length == 0)
+    return UV_EINVAL;
+
+  /* 只用len记还剩多少字节没发，write_queue_size的记账和普通请求一样 */
+  buf.base = NULL;
+  buf.len = length;
+
+  req->zerocopy = 0;
+  req->sendfile_fd = fd;
+  req->sendfile_off = offset;
+  req->shared = NULL;
+  err = uv__write2(req, handle, &buf, 1, NULL, 0, cb);
+  if (err == 0)
+    uv__stream_watermarks(handle);
+
+  return err;
+}
+
+
+int uv_write_shared(uv_write_t* req,
+                    uv_stream_t* handle,
+                    uv_shared_buf_t* buf,
+                    uv_write_cb cb) {
+  uv_buf_t b;
+  int err;
+
+  b.base = buf->base;
+  b.len = buf->len;
+
+  req->zerocopy = 0;
+  req->sendfile_fd = -1;
+  req->shared = buf;
+  uv_shared_buf_ref(buf);
+
+  err = uv__write2(req, handle, &b, 1, NULL, 0, cb);
+  if (err != 0) {
+    req->shared = NULL;
+    uv_shared_buf_unref(buf);
+    return err;
+  }
+
+  uv__stream_watermarks(handle);
+  return 0;
+}
+
+
+/* uv_write_broadcast()一次分配出所有的写请求，最后一个完成时一起释放 */
+typedef struct {
+  unsigned int pending;
+  uv_write_t reqs[1];
+} uv__write_broadcast_t;
+
+
+static void uv__write_broadcast_cb(uv_write_t* req, int status) {
+  uv__write_broadcast_t* b;
+
+  b = req->data;
+  assert(b->pending > 0);
+  if (--b->pending == 0)
+    uv__free(b);
+}
+
+
+int uv_write_broadcast(uv_stream_t* streams[],
+                       unsigned int nstreams,
+                       uv_shared_buf_t* buf) {
+  uv__write_broadcast_t* b;
+  uv_write_t* req;
+  unsigned int i;
+
+  if (nstreams == 0)
+    return 0;
+
+  b = uv__malloc(sizeof(*b) + (nstreams - 1) * sizeof(b->reqs[0]));
+  if (b == NULL)
+    return UV_ENOMEM;
+
+  /* 写请求的回调都是延迟调用的，排队的过程中pending不会减到0 */
+  b->pending = 0;
+  for (i = 0; i < nstreams; i++) {
+    req = &b->reqs[b->pending];
+    req->data = b;
+    if (uv_write_shared(req, streams[i], buf, uv__write_broadcast_cb) == 0)
+      b->pending++;
+  }
+
+  if (b->pending == 0) {
+    uv__free(b);
+    return 0;
+  }
+
+  return b->pending;
+}
+
+
+int uv_write_iobuf(uv_write_t* req,
+                   uv_stream_t* handle,
+                   const uv_iobuf_t* iob,
+                   uv_write_cb cb) {
+  uv_shared_buf_t** owners;
+  unsigned int nowners;
+  int err;
+
+  if (iob->nbufs == 0)
+    return UV_EINVAL;
+
+  err = uv__iobuf_hold(iob, &owners, &nowners);
+  if (err != 0)
+    return err;
+
+  req->zerocopy = 0;
+  req->sendfile_fd = -1;
+  req->shared = NULL;
+
+  err = uv__write2(req, handle, iob->bufs, iob->nbufs, NULL, 0, cb);
+  if (err != 0) {
+    uv__iobuf_drop(owners, nowners);
+    return err;
+  }
+
+  /* 写请求的回调是延迟调用的，uv__write_callbacks()里放掉引用 */
+  req->iobuf_owners = owners;
+  req->iobuf_nowners = nowners;
+  uv__stream_watermarks(handle);
+  return 0;
+}
+
+
+/* uv_write_nocb()没写完的部分，请求和数据在一次分配里 */
+typedef struct {
+  uv_write_t req;
+  char data[1];
+} uv__write_nocb_t;
+
+
+static void uv__write_nocb_cb(uv_write_t* req, int status) {
+  uv__free(container_of(req, uv__write_nocb_t, req));
+}
+
+
+int uv_write_nocb(uv_stream_t* stream,
+                  const uv_buf_t bufs[],
+                  unsigned int nbufs) {
+  uv__write_nocb_t* w;
+  uv_buf_t buf;
+  size_t written;
+  size_t size;
+  size_t len;
+  unsigned int i;
+  char* p;
+  int err;
+
+  err = uv_try_write(stream, bufs, nbufs);
+  if (err < 0 && err != UV_EAGAIN)
+    return err;
+
+  written = err > 0 ? (size_t) err : 0;
+  size = uv__count_bufs(bufs, nbufs);
+  if (written == size)
+    return 0;
+
+  w = uv__malloc(sizeof(*w) + size - written);
+  if (w == NULL)
+    return UV_ENOMEM;
+
+  /* 跳过已经写出去的部分 */
+  p = w->data;
+  for (i = 0; i < nbufs; i++) {
+    len = bufs[i].len;
+    if (written >= len) {
+      written -= len;
+      continue;
+    }
+
+    memcpy(p, bufs[i].base + written, len - written);
+    p += len - written;
+    written = 0;
+  }
+
+  buf = uv_buf_init(w->data, p - w->data);
+  err = uv_write(&w->req, stream, &buf, 1, uv__write_nocb_cb);
+  if (err != 0)
+    uv__free(w);
+
+  return err;
+}
+
+
+int uv_stream_set_write_batch_cb(uv_stream_t* handle, uv_write_batch_cb cb) {
+  handle->write_batch_cb = cb;
+  return 0;
+}
+
+
 void uv_try_write_cb(uv_write_t* req, int status) {
   /* Should not be called */
   abort();
@@ -1535,73 +3888,319 @@ int uv_try_write(uv_stream_t* stream,
   if (stream->connect_req != NULL || stream->write_queue_size != 0)
     return UV_EAGAIN;
 
-  has_pollout = uv__io_active(&stream->io_watcher, POLLOUT);
+  has_pollout = uv__io_active(&stream->io_watcher, POLLOUT);
+
+  /* 不走uv_write()，没写完的部分马上要减掉，不应该触发水位回调 */
+  req.zerocopy = 0;
+  req.sendfile_fd = -1;
+  req.shared = NULL;
+  r = uv__write2(&req, stream, bufs, nbufs, NULL, 0, uv_try_write_cb);
+  if (r != 0)
+    return r;
+
+  /* Remove not written bytes from write queue size */
+  written = uv__count_bufs(bufs, nbufs);
+  if (req.bufs != NULL)
+    req_size = uv__write_req_size(&req);
+  else
+    req_size = 0;
+  written -= req_size;
+  stream->write_queue_size -= req_size;
+
+  /* Unqueue request, regardless of immediateness */
+  QUEUE_REMOVE(&req.queue);
+  uv__req_unregister(stream->loop, &req);
+  if (req.bufs != req.bufsml)
+    uv__write_bufs_free(stream->loop, req.bufs, req.nbufs);
+  req.bufs = NULL;
+
+  /* Do not poll for writable, if we wasn't before calling this */
+  if (!has_pollout) {
+    uv__io_stop(stream->loop, &stream->io_watcher, POLLOUT);
+    uv__stream_osx_interrupt_select(stream);
+  }
+
+  if (written == 0 && req_size != 0)
+    return UV_EAGAIN;
+  else
+    return written;
+}
+
+
+/* 普通模式的alloc_cb/read_cb和iov模式的alloc_iov_cb/read_iov_cb只有一组
+ * 不为NULL，批量模式由uv_read_start_batch()在之后设置read_batch_cb
+ */
+static int uv__read_start(uv_stream_t* stream,
+                          uv_alloc_cb alloc_cb,
+                          uv_read_cb read_cb,
+                          uv_alloc_iov_cb alloc_iov_cb,
+                          uv_read_iov_cb read_iov_cb) {
+  assert(stream->type == UV_TCP || stream->type == UV_NAMED_PIPE ||
+      stream->type == UV_TTY);
+
+  if (stream->flags & UV_HANDLE_CLOSING)
+    return UV_EINVAL;
+
+  if (!(stream->flags & UV_HANDLE_READABLE))
+    return -ENOTCONN;
+
+  if (stream->splice_src != NULL)
+    return UV_EBUSY;
+
+  /* The UV_HANDLE_READING flag is irrelevant of the state of the tcp - it just
+   * expresses the desired state of the user.
+   */
+  stream->flags |= UV_HANDLE_READING;
+  if (stream->timeouts != NULL)
+    uv__stream_timeouts_start(stream, UV_STREAM_TIMEOUT_READ);
+
+  /* TODO: try to do the read inline? */
+  /* TODO: keep track of tcp state. If we've gotten a EOF then we should
+   * not start the IO watcher.
+   */
+  assert(uv__stream_fd(stream) >= 0);
+  assert(alloc_cb || alloc_iov_cb);
+
+  stream->read_cb = read_cb;
+  stream->alloc_cb = alloc_cb;
+  stream->read_iov_cb = read_iov_cb;
+  stream->alloc_iov_cb = alloc_iov_cb;
+  stream->read_batch_cb = NULL;
+
+#if defined(__linux__)
+  /* 之前用uv_read_start_ring()在读 */
+  if (stream->loop->flags & UV_LOOP_IO_URING)
+    uv__iou_recv_stop(stream->loop, uv__stream_fd(stream));
+#endif
+
+  uv__io_start(stream->loop,
+               &stream->io_watcher,
+               POLLIN | uv__stream_pollet(stream));
+  uv__handle_start(stream);
+  uv__stream_osx_interrupt_select(stream);
+
+  return 0;
+}
+
+
+int uv_read_start(uv_stream_t* stream,
+                  uv_alloc_cb alloc_cb,
+                  uv_read_cb read_cb) {
+  return uv__read_start(stream, alloc_cb, read_cb, NULL, NULL);
+}
+
+
+/* 和uv_read_start()一样，只是缓冲区从pool里取 */
+int uv_read_start_pooled(uv_stream_t* stream,
+                         uv_buf_pool_t* pool,
+                         uv_read_cb read_cb) {
+  if (pool == NULL)
+    return UV_EINVAL;
+
+  stream->buf_pool = pool;
+  return uv_read_start(stream, uv__buf_pool_alloc, read_cb);
+}
+
+
+static void uv__read_iobuf_cb(uv_stream_t* stream,
+                              ssize_t nread,
+                              const uv_buf_t* buf) {
+  uv_shared_buf_t* owner;
+
+  owner = uv__iobuf_owner(buf);
+  stream->read_iobuf_cb(stream, nread, buf, owner);
+  if (owner != NULL)
+    uv_shared_buf_unref(owner);
+}
+
+
+int uv_read_start_iobuf(uv_stream_t* stream,
+                        uv_buf_pool_t* pool,
+                        uv_read_iobuf_cb read_cb) {
+  if (pool == NULL || read_cb == NULL)
+    return UV_EINVAL;
+
+  /* 缓冲区开头要放下uv_shared_buf_t的头部 */
+  if (pool->buf_size <= uv__iobuf_chunk_size())
+    return UV_EINVAL;
+
+  stream->buf_pool = pool;
+  stream->read_iobuf_cb = read_cb;
+  return uv_read_start(stream, uv__iobuf_alloc, uv__read_iobuf_cb);
+}
+
+
+/* 和uv_read_start()一样，只是alloc_iov_cb可以给出多个缓冲区，用readv()
+ * 一次读进去，比如先读定长的消息头，剩下的直接读到消息体里
+ */
+int uv_read_start_iov(uv_stream_t* stream,
+                      uv_alloc_iov_cb alloc_iov_cb,
+                      uv_read_iov_cb read_iov_cb) {
+  if (alloc_iov_cb == NULL || read_iov_cb == NULL)
+    return UV_EINVAL;
+
+  return uv__read_start(stream, NULL, NULL, alloc_iov_cb, read_iov_cb);
+}
+
+
+/* 和uv_read_start()一样，只是一次可读事件里读到的数据一起回调 */
+int uv_read_start_batch(uv_stream_t* stream,
+                        uv_alloc_cb alloc_cb,
+                        uv_read_batch_cb read_batch_cb) {
+  int err;
+
+  if (alloc_cb == NULL || read_batch_cb == NULL)
+    return UV_EINVAL;
+
+  err = uv__read_start(stream, alloc_cb, NULL, NULL, NULL);
+  if (err == 0)
+    stream->read_batch_cb = read_batch_cb;
+
+  return err;
+}
+
+
+int uv__recv_ring_configure(uv_loop_t* loop, unsigned int nbufs, size_t size) {
+  struct uv__recv_ring* ring;
+
+  /* 缓冲区环的长度必须是2的幂，缓冲区的id只有16位 */
+  if (nbufs == 0 || nbufs > 32768 || (nbufs & (nbufs - 1)) != 0)
+    return UV_EINVAL;
+
+  if (size == 0 || size > UINT32_MAX || size > SIZE_MAX / nbufs)
+    return UV_EINVAL;
+
+  if (loop->recv_ring != NULL)
+    return UV_EBUSY;
+
+  ring = uv__malloc(sizeof(*ring));
+  if (ring == NULL)
+    return UV_ENOMEM;
+
+  ring->base = NULL;
+  ring->mapped = 0;
+  if ((loop->flags & UV_LOOP_HUGEPAGES) && nbufs * size >= UV__HUGEPAGE_SIZE) {
+    ring->mapped = nbufs * size;
+    ring->base = uv__hugepage_map(&ring->mapped);
+    if (ring->base == NULL)
+      ring->mapped = 0;
+  }
+
+  if (ring->base == NULL)
+    ring->base = uv__malloc(nbufs * size);
+
+  if (ring->base == NULL) {
+    uv__free(ring);
+    return UV_ENOMEM;
+  }
+
+  ring->size = size;
+  ring->nbufs = nbufs;
+  loop->recv_ring = ring;
+
+  return 0;
+}
+
 
-  r = uv_write(&req, stream, bufs, nbufs, uv_try_write_cb);
-  if (r != 0)
-    return r;
+/* io_uring的缓冲区环在uv__platform_loop_delete()里已经随着ring一起注销了 */
+void uv__recv_ring_delete(uv_loop_t* loop) {
+  struct uv__recv_ring* ring;
 
-  /* Remove not written bytes from write queue size */
-  written = uv__count_bufs(bufs, nbufs);
-  if (req.bufs != NULL)
-    req_size = uv__write_req_size(&req);
+  ring = loop->recv_ring;
+  if (ring == NULL)
+    return;
+
+  if (ring->mapped != 0)
+    uv__hugepage_unmap(ring->base, ring->mapped);
   else
-    req_size = 0;
-  written -= req_size;
-  stream->write_queue_size -= req_size;
+    uv__free(ring->base);
+  uv__free(ring);
+  loop->recv_ring = NULL;
+}
 
-  /* Unqueue request, regardless of immediateness */
-  QUEUE_REMOVE(&req.queue);
-  uv__req_unregister(stream->loop, &req);
-  if (req.bufs != req.bufsml)
-    uv__free(req.bufs);
-  req.bufs = NULL;
 
-  /* Do not poll for writable, if we wasn't before calling this */
-  if (!has_pollout) {
-    uv__io_stop(stream->loop, &stream->io_watcher, POLLOUT);
-    uv__stream_osx_interrupt_select(stream);
-  }
+/* 不走io_uring时所有流都读进第一个缓冲区，read_cb返回以后就可以重用 */
+static void uv__recv_ring_alloc(uv_handle_t* handle,
+                                size_t suggested_size,
+                                uv_buf_t* buf) {
+  struct uv__recv_ring* ring;
 
-  if (written == 0 && req_size != 0)
-    return UV_EAGAIN;
-  else
-    return written;
+  ring = handle->loop->recv_ring;
+  *buf = uv_buf_init(ring->base, ring->size);
 }
 
 
-int uv_read_start(uv_stream_t* stream,
-                  uv_alloc_cb alloc_cb,
-                  uv_read_cb read_cb) {
-  assert(stream->type == UV_TCP || stream->type == UV_NAMED_PIPE ||
-      stream->type == UV_TTY);
+int uv_read_start_ring(uv_stream_t* stream, uv_read_cb read_cb) {
+  int is_ipc;
+  int err;
 
-  if (stream->flags & UV_HANDLE_CLOSING)
+  if (stream->loop->recv_ring == NULL || read_cb == NULL)
     return UV_EINVAL;
 
-  if (!(stream->flags & UV_HANDLE_READABLE))
-    return -ENOTCONN;
+#if defined(__linux__)
+  /* multishot recv只用于普通的字节流，要传fd或者按消息读的还是按可读事件读 */
+  is_ipc = stream->type == UV_NAMED_PIPE && ((uv_pipe_t*) stream)->ipc;
+  if ((stream->loop->flags & UV_LOOP_IO_URING) &&
+      stream->type != UV_TTY &&
+      !is_ipc &&
+      !UV__STREAM_SEQPACKET(stream) &&
+      !(stream->flags & UV_HANDLE_CLOSING) &&
+      (stream->flags & UV_HANDLE_READABLE) &&
+      stream->splice_src == NULL &&
+      (stream->rate_limit == NULL ||
+       ((struct uv__rate_limits*) stream->rate_limit)->in.limit == NULL)) {
+    err = uv__iou_recv_start(stream->loop, stream);
+    if (err == 0) {
+      uv__io_stop(stream->loop, &stream->io_watcher, POLLIN);
+      stream->flags |= UV_HANDLE_READING;
+      stream->read_cb = read_cb;
+      stream->alloc_cb = uv__recv_ring_alloc;
+      stream->read_iov_cb = NULL;
+      stream->alloc_iov_cb = NULL;
+      stream->read_batch_cb = NULL;
+      uv__handle_start(stream);
+      return 0;
+    }
+  }
+#else
+  (void) is_ipc;
+  (void) err;
+#endif
 
-  /* The UV_HANDLE_READING flag is irrelevant of the state of the tcp - it just
-   * expresses the desired state of the user.
-   */
-  stream->flags |= UV_HANDLE_READING;
+  return uv__read_start(stream, uv__recv_ring_alloc, read_cb, NULL, NULL);
+}
 
-  /* TODO: try to do the read inline? */
-  /* TODO: keep track of tcp state. If we've gotten a EOF then we should
-   * not start the IO watcher.
-   */
-  assert(uv__stream_fd(stream) >= 0);
-  assert(alloc_cb);
 
-  stream->read_cb = read_cb;
-  stream->alloc_cb = alloc_cb;
+/* io_uring上的multishot recv完成了一次。nread为UV_EOF或者错误码的时候，内核
+ * 已经不再为这个流接收
+ */
+void uv__stream_recv(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  UV__IO_STATS_READ(stream, nread > 0 ? nread : 0);
+  if (nread > 0 && stream->timeouts != NULL)
+    uv__stream_timeouts_touch(stream, UV_STREAM_TIMEOUT_READ);
 
-  uv__io_start(stream->loop, &stream->io_watcher, POLLIN);
-  uv__handle_start(stream);
-  uv__stream_osx_interrupt_select(stream);
+  if (nread == UV_EOF) {
+    uv__stream_eof(stream, buf, 1);
+    return;
+  }
 
-  return 0;
+  uv__read_done(stream, nread, buf, 1);
+
+  /* Error. User should call uv_close(). */
+  if (nread < 0 && (stream->flags & UV_HANDLE_READING)) {
+    stream->flags &= ~UV_HANDLE_READING;
+    if (!uv__io_active(&stream->io_watcher, POLLOUT))
+      uv__handle_stop(stream);
+  }
+}
+
+
+/* 内核不支持multishot recv，改回按可读事件读 */
+void uv__stream_recv_fallback(uv_stream_t* stream) {
+  if (stream->flags & UV_HANDLE_READING)
+    uv__io_start(stream->loop,
+                 &stream->io_watcher,
+                 POLLIN | uv__stream_pollet(stream));
 }
 
 
@@ -1610,13 +4209,27 @@ int uv_read_stop(uv_stream_t* stream) {
     return 0;
 
   stream->flags &= ~UV_HANDLE_READING;
+  if (stream->timeouts != NULL)
+    uv__stream_timeouts_stop(stream, UV_STREAM_TIMEOUT_READ);
+  if (stream->rate_limit != NULL)
+    uv__rate_limit_cancel(&((struct uv__rate_limits*) stream->rate_limit)->in);
   uv__io_stop(stream->loop, &stream->io_watcher, POLLIN);
-  if (!uv__io_active(&stream->io_watcher, POLLOUT))
+#if defined(__linux__)
+  if (stream->loop->flags & UV_LOOP_IO_URING)
+    uv__iou_recv_stop(stream->loop, uv__stream_fd(stream));
+#endif
+  /* 不读的时候回到水平触发，splice这样的路径并不保证读写到EAGAIN */
+  stream->io_watcher.pevents &= ~UV__POLLET;
+  if (!uv__io_active(&stream->io_watcher, POLLOUT) &&
+      !uv__stream_rate_waiting(stream, 1))
     uv__handle_stop(stream);
   uv__stream_osx_interrupt_select(stream);
 
   stream->read_cb = NULL;
   stream->alloc_cb = NULL;
+  stream->read_iov_cb = NULL;
+  stream->alloc_iov_cb = NULL;
+  stream->read_batch_cb = NULL;
   return 0;
 }
 
@@ -1659,20 +4272,34 @@ void uv__stream_close(uv_stream_t* handle) {
 
     s = handle->select;
 
-    uv_sem_post(&s->close_sem);
-    uv_sem_post(&s->async_sem);
-    uv__stream_osx_interrupt_select(handle);
-    uv_thread_join(&s->thread);
-    uv_sem_destroy(&s->close_sem);
-    uv_sem_destroy(&s->async_sem);
-    uv__close(s->fake_fd);
-    uv__close(s->int_fd);
-    uv_close((uv_handle_t*) &s->async, uv__stream_osx_cb_close);
+    /* 线程只在持有mutex时碰这个链表，摘掉以后就不会再给它报事件。
+     * fake_fd是io watcher的fd，下面跟着watcher一起关
+     */
+    uv_mutex_lock(&s->sl->mutex);
+    QUEUE_REMOVE(&s->member);
+    uv_mutex_unlock(&s->sl->mutex);
 
+    uv__stream_osx_interrupt_select(handle);
     handle->select = NULL;
+    uv__close(s->peer_fd);
+    uv__select_loop_release(s->sl);
+    uv__free(s);
   }
 #endif /* defined(__APPLE__) */
 
+  if (handle->admission != NULL)
+    uv__admission_delete(handle);
+  if (handle->admitted != NULL)
+    uv__admission_release(handle);
+  if (!QUEUE_EMPTY(&handle->emfile_member)) {
+    QUEUE_REMOVE(&handle->emfile_member);
+    QUEUE_INIT(&handle->emfile_member);
+  }
+  if (handle->timeouts != NULL)
+    uv__stream_timeouts_release(handle);
+  uv__rate_limits_release(&handle->rate_limit);
+
+  uv__splice_cancel(handle);
   uv__io_close(handle->loop, &handle->io_watcher);
   uv_read_stop(handle);
   uv__handle_stop(handle);
@@ -1703,6 +4330,474 @@ void uv__stream_close(uv_stream_t* handle) {
 }
 
 
+int uv_stream_set_read_size_hint(uv_stream_t* handle,
+                                 size_t min_size,
+                                 size_t max_size) {
+  if (min_size > max_size)
+    return UV_EINVAL;
+
+  handle->read_hint = min_size;
+  handle->read_hint_min = min_size;
+  handle->read_hint_max = max_size;
+  handle->read_hint_small = 0;
+  return 0;
+}
+
+
+int uv_stream_set_read_budget(uv_stream_t* handle,
+                              unsigned int reads,
+                              size_t bytes) {
+  if (reads == 0 && bytes != 0)
+    return UV_EINVAL;
+
+  handle->read_budget = reads;
+  handle->read_budget_bytes = bytes;
+  return 0;
+}
+
+
+/* cork之后uv_write()的请求只放进写队列，uncork时用尽量少的writev()一起
+ * 写出去，比如分开写的响应头和响应体只要一次系统调用
+ */
+/* write_queue_size越过高水位或者回落到低水位时通知用户 */
+static void uv__stream_watermarks(uv_stream_t* stream) {
+  if (stream->write_watermark_cb == NULL || uv__is_closing(stream))
+    return;
+
+  if (!stream->write_above_high) {
+    if (stream->write_queue_size > stream->write_high_watermark) {
+      stream->write_above_high = 1;
+      stream->write_watermark_cb(stream, 1);
+    }
+  } else if (stream->write_queue_size <= stream->write_low_watermark) {
+    stream->write_above_high = 0;
+    stream->write_watermark_cb(stream, 0);
+  }
+}
+
+
+int uv_stream_set_write_watermarks(uv_stream_t* handle,
+                                   size_t low,
+                                   size_t high,
+                                   uv_watermark_cb cb) {
+  if (cb != NULL && low > high)
+    return UV_EINVAL;
+
+  handle->write_low_watermark = low;
+  handle->write_high_watermark = high;
+  handle->write_watermark_cb = cb;
+  /* 下一次写的时候按当前的队列长度重新判断 */
+  handle->write_above_high = 0;
+
+  return 0;
+}
+
+
+int uv_stream_cork(uv_stream_t* handle) {
+  handle->flags |= UV_HANDLE_CORKED;
+  return 0;
+}
+
+
+int uv_stream_uncork(uv_stream_t* handle) {
+  if (!(handle->flags & UV_HANDLE_CORKED))
+    return 0;
+
+  handle->flags &= ~UV_HANDLE_CORKED;
+
+  /* 还在连接或者已经在等可写事件时，交给uv__stream_io()去写 */
+  if (handle->connect_req != NULL ||
+      QUEUE_EMPTY(&handle->write_queue) ||
+      uv__io_active(&handle->io_watcher, POLLOUT))
+    return 0;
+
+  uv__write(handle);
+  uv__stream_watermarks(handle);
+  return 0;
+}
+
+
+/* 流上还没有回调的写请求个数，它们计在所属loop的active_reqs里 */
+static unsigned int uv__stream_nreqs(uv_stream_t* handle) {
+  unsigned int n;
+  QUEUE* q;
+
+  n = 0;
+  QUEUE_FOREACH(q, &handle->write_queue)
+    n++;
+  QUEUE_FOREACH(q, &handle->write_completed_queue)
+    n++;
+
+  return n;
+}
+
+
+int uv_stream_detach(uv_stream_t* handle) {
+  uv_loop_t* loop;
+
+  if (handle->type != UV_TCP && handle->type != UV_NAMED_PIPE)
+    return UV_EINVAL;
+
+  loop = handle->loop;
+  /* 监听的流设置了connection_cb */
+  if (loop == NULL ||
+      uv__is_closing(handle) ||
+      handle->connection_cb != NULL ||
+      (handle->flags & UV_HANDLE_INTERNAL))
+    return UV_EINVAL;
+
+  if (handle->connect_req != NULL ||
+      handle->shutdown_req != NULL ||
+      handle->splice_src != NULL ||
+      handle->splice_dst != NULL ||
+      handle->queued_fds != NULL ||
+      handle->accepted_fd != -1 ||
+      handle->timeouts != NULL ||
+      handle->rate_limit != NULL ||
+      !QUEUE_EMPTY(&handle->zerocopy_queue))
+    return UV_EBUSY;
+
+  /* 读进loop的缓冲区环的流：multishot recv挂在原来loop的io_uring上，
+   * 新loop也不一定有缓冲区环
+   */
+  if (uv__stream_recv_armed(handle) || handle->alloc_cb == uv__recv_ring_alloc)
+    return UV_EBUSY;
+
+#if defined(__APPLE__)
+  if (handle->select != NULL)
+    return UV_ENOTSUP;
+#endif
+
+  /* 已经写完、等着回调的请求到新loop上再回调 */
+  if (uv__stream_fd(handle) != -1)
+    uv__io_detach(loop, &handle->io_watcher);
+
+  loop->active_reqs.count -= uv__stream_nreqs(handle);
+  if ((handle->flags & UV_HANDLE_ACTIVE) && (handle->flags & UV_HANDLE_REF))
+    uv__active_handle_rm(handle);
+
+  QUEUE_REMOVE(&handle->handle_queue);
+  QUEUE_INIT(&handle->handle_queue);
+  handle->loop = NULL;
+  return 0;
+}
+
+
+int uv_stream_attach(uv_loop_t* loop, uv_stream_t* handle) {
+  if (handle->type != UV_TCP && handle->type != UV_NAMED_PIPE)
+    return UV_EINVAL;
+
+  if (handle->loop != NULL)
+    return UV_EINVAL;
+
+  handle->loop = loop;
+  QUEUE_INSERT_TAIL(&loop->handle_queue, &handle->handle_queue);
+  if ((handle->flags & UV_HANDLE_ACTIVE) && (handle->flags & UV_HANDLE_REF))
+    uv__active_handle_add(handle);
+  loop->active_reqs.count += uv__stream_nreqs(handle);
+
+  if (uv__stream_fd(handle) != -1) {
+    uv__io_attach(loop, &handle->io_watcher);
+    if (!QUEUE_EMPTY(&handle->write_completed_queue))
+      uv__io_feed(loop, &handle->io_watcher);
+  }
+
+  return 0;
+}
+
+/* 停掉转发占用的两个watcher，解除和两个流的关联 */
+static void uv__splice_detach(uv_splice_t* req) {
+  uv__io_stop(req->src->loop, &req->src->io_watcher, POLLIN);
+  uv__stream_osx_interrupt_select(req->src);
+  uv__io_stop(req->dst->loop, &req->dst->io_watcher, POLLOUT);
+  uv__stream_osx_interrupt_select(req->dst);
+  req->src->splice_src = NULL;
+  req->dst->splice_dst = NULL;
+
+  if (req->pipefd[0] != -1) {
+    uv__close(req->pipefd[0]);
+    uv__close(req->pipefd[1]);
+    req->pipefd[0] = -1;
+    req->pipefd[1] = -1;
+  }
+
+  uv__free(req->buf);
+  req->buf = NULL;
+}
+
+
+static void uv__splice_finish(uv_splice_t* req, int status) {
+  uv__splice_detach(req);
+  uv__req_unregister(req->src->loop, req);
+  if (req->cb != NULL)
+    req->cb(req, status);
+}
+
+
+/* 流关闭时先把转发停下来，cb留到uv__stream_destroy()里调 */
+static void uv__splice_cancel(uv_stream_t* stream) {
+  uv_splice_t* req;
+
+  if (stream->splice_src != NULL) {
+    req = stream->splice_src;
+    uv__splice_detach(req);
+    stream->splice_src = req;
+  }
+
+  if (stream->splice_dst != NULL) {
+    req = stream->splice_dst;
+    uv__splice_detach(req);
+    stream->splice_dst = req;
+  }
+}
+
+
+static void uv__splice_destroy(uv_stream_t* stream) {
+  uv_splice_t* req;
+
+  if (stream->splice_src != NULL) {
+    req = stream->splice_src;
+    stream->splice_src = NULL;
+    uv__req_unregister(req->src->loop, req);
+    if (req->cb != NULL)
+      req->cb(req, UV_ECANCELED);
+  }
+
+  if (stream->splice_dst != NULL) {
+    req = stream->splice_dst;
+    stream->splice_dst = NULL;
+    uv__req_unregister(req->src->loop, req);
+    if (req->cb != NULL)
+      req->cb(req, UV_ECANCELED);
+  }
+}
+
+
+/* 中转区还能装多少字节 */
+static size_t uv__splice_space(uv_splice_t* req) {
+  if (req->pipefd[0] != -1)
+    return req->buf_size - req->pending;
+  return req->buf_size - req->offset - req->pending;
+}
+
+
+static ssize_t uv__splice_read(uv_splice_t* req) {
+  ssize_t n;
+  int fd;
+
+  fd = uv__stream_fd(req->src);
+
+#if defined(__linux__)
+  if (req->pipefd[0] != -1) {
+    do
+      n = splice(fd,
+                 NULL,
+                 req->pipefd[1],
+                 NULL,
+                 uv__splice_space(req),
+                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    while (n == -1 && errno == EINTR);
+
+    /* src不支持splice()（比如某些tty），中转区还是空的就换成缓冲区 */
+    if (n == -1 && errno == EINVAL && req->pending == 0) {
+      req->buf = uv__malloc(UV__SPLICE_BUF_SIZE);
+      if (req->buf == NULL)
+        return UV_ENOMEM;
+      uv__close(req->pipefd[0]);
+      uv__close(req->pipefd[1]);
+      req->pipefd[0] = -1;
+      req->pipefd[1] = -1;
+      req->buf_size = UV__SPLICE_BUF_SIZE;
+      req->offset = 0;
+    } else {
+      return n == -1 ? UV__ERR(errno) : n;
+    }
+  }
+#endif
+
+  do
+    n = read(fd,
+             req->buf + req->offset + req->pending,
+             uv__splice_space(req));
+  while (n == -1 && errno == EINTR);
+
+  return n == -1 ? UV__ERR(errno) : n;
+}
+
+
+static ssize_t uv__splice_write(uv_splice_t* req) {
+  ssize_t n;
+  int fd;
+
+  fd = uv__stream_fd(req->dst);
+
+#if defined(__linux__)
+  if (req->pipefd[0] != -1) {
+    do
+      n = splice(req->pipefd[0],
+                 NULL,
+                 fd,
+                 NULL,
+                 req->pending,
+                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    while (n == -1 && errno == EINTR);
+
+    return n == -1 ? UV__ERR(errno) : n;
+  }
+#endif
+
+  do
+    n = write(fd, req->buf + req->offset, req->pending);
+  while (n == -1 && errno == EINTR);
+
+  return n == -1 ? UV__ERR(errno) : n;
+}
+
+
+/* 读写交替着搬数据，直到两边都搬不动。中转区满了就不再听src的可读事件，
+ * 等dst写出去腾出空间再听，这样dst慢的时候src的数据留在内核里，由TCP
+ * 的流量控制压住对端
+ */
+static void uv__splice_run(uv_splice_t* req) {
+  ssize_t n;
+  int readable;
+  int writable;
+  int count;
+
+  readable = 1;
+  writable = 1;
+
+  /* 和uv__read()一样，一次最多搬32轮 */
+  for (count = 32; count > 0; count--) {
+    if (readable && !req->eof && uv__splice_space(req) > 0) {
+      n = uv__splice_read(req);
+      if (n > 0) {
+        req->pending += n;
+      } else if (n == 0) {
+        req->eof = 1;
+      } else if (n == UV_EAGAIN || n == UV__ERR(EWOULDBLOCK)) {
+        readable = 0;
+      } else {
+        uv__splice_finish(req, n);
+        return;
+      }
+    }
+
+    if (writable && req->pending > 0) {
+      n = uv__splice_write(req);
+      if (n >= 0) {
+        req->pending -= n;
+        req->offset += n;
+        req->nbytes += n;
+        if (req->pending == 0)
+          req->offset = 0;
+      } else if (n == UV_EAGAIN ||
+                 n == UV__ERR(EWOULDBLOCK) ||
+                 n == UV_ENOBUFS) {
+        writable = 0;
+      } else {
+        uv__splice_finish(req, n);
+        return;
+      }
+    }
+
+    if (req->eof && req->pending == 0) {
+      uv__splice_finish(req, 0);
+      return;
+    }
+
+    if ((!readable || req->eof || uv__splice_space(req) == 0) &&
+        (!writable || req->pending == 0))
+      break;
+  }
+
+  if (!req->eof && uv__splice_space(req) > 0)
+    uv__io_start(req->src->loop, &req->src->io_watcher, POLLIN);
+  else
+    uv__io_stop(req->src->loop, &req->src->io_watcher, POLLIN);
+  uv__stream_osx_interrupt_select(req->src);
+
+  if (req->pending > 0)
+    uv__io_start(req->dst->loop, &req->dst->io_watcher, POLLOUT);
+  else
+    uv__io_stop(req->dst->loop, &req->dst->io_watcher, POLLOUT);
+  uv__stream_osx_interrupt_select(req->dst);
+}
+
+
+int uv_stream_splice(uv_splice_t* req,
+                     uv_stream_t* src,
+                     uv_stream_t* dst,
+                     uv_splice_cb cb) {
+#if defined(__linux__)
+  int size;
+#endif
+
+  if (src == dst || src->loop != dst->loop)
+    return UV_EINVAL;
+
+  if (uv__is_closing(src) || uv__is_closing(dst))
+    return UV_EINVAL;
+
+  if (!(src->flags & UV_HANDLE_READABLE))
+    return UV_ENOTCONN;
+
+  if (!(dst->flags & UV_HANDLE_WRITABLE))
+    return UV_EPIPE;
+
+  /* src的数据已经有人在读，或者dst上还有没写完的数据，转发进来会乱序 */
+  if ((src->flags & UV_HANDLE_READING) ||
+      (dst->flags & UV_HANDLE_SHUTTING) ||
+      src->connect_req != NULL ||
+      dst->connect_req != NULL ||
+      src->splice_src != NULL ||
+      dst->splice_dst != NULL ||
+      dst->write_queue_size != 0 ||
+      !QUEUE_EMPTY(&dst->write_queue))
+    return UV_EBUSY;
+
+  req->pipefd[0] = -1;
+  req->pipefd[1] = -1;
+  req->buf = NULL;
+  req->buf_size = 0;
+
+#if defined(__linux__)
+  if (uv__make_pipe(req->pipefd, UV__F_NONBLOCK) == 0) {
+    size = fcntl(req->pipefd[0], F_GETPIPE_SZ);
+    req->buf_size = size > 0 ? (size_t) size : UV__SPLICE_BUF_SIZE;
+  } else {
+    req->pipefd[0] = -1;
+    req->pipefd[1] = -1;
+  }
+#endif
+
+  if (req->pipefd[0] == -1) {
+    req->buf = uv__malloc(UV__SPLICE_BUF_SIZE);
+    if (req->buf == NULL)
+      return UV_ENOMEM;
+    req->buf_size = UV__SPLICE_BUF_SIZE;
+  }
+
+  uv__req_init(src->loop, req, UV_SPLICE);
+  req->src = src;
+  req->dst = dst;
+  req->cb = cb;
+  req->nbytes = 0;
+  req->offset = 0;
+  req->pending = 0;
+  req->eof = 0;
+  src->splice_src = req;
+  dst->splice_dst = req;
+
+  /* 等src可读了由uv__stream_io()去搬 */
+  uv__io_start(src->loop, &src->io_watcher, POLLIN);
+  uv__stream_osx_interrupt_select(src);
+
+  return 0;
+}
+
+
+
 int uv_stream_set_blocking(uv_stream_t* handle, int blocking) {
   /* Don't need to check the file descriptor, uv__nonblock()
    * will fail with EBADF if it's not valid.
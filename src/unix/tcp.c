@@ -26,6 +26,16 @@
 #include <unistd.h>
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+
+#if defined(__linux__)
+# ifndef SOL_TLS
+#  define SOL_TLS 282
+# endif
+# ifndef TCP_ULP
+#  define TCP_ULP 31
+# endif
+#endif
 
 /* 创建一个tcp socket */
 static int new_socket(uv_tcp_t* handle, int domain, unsigned long flags) {
@@ -165,6 +175,20 @@ int uv__tcp_bind(uv_tcp_t* tcp,
   if (setsockopt(tcp->io_watcher.fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)))
     return UV__ERR(errno);
 
+  if (flags & UV_TCP_REUSEPORT) {
+#ifdef SO_REUSEPORT
+    if (setsockopt(tcp->io_watcher.fd,
+                   SOL_SOCKET,
+                   SO_REUSEPORT,
+                   &on,
+                   sizeof(on))) {
+      return UV__ERR(errno);
+    }
+#else
+    return UV_ENOTSUP;
+#endif
+  }
+
 #ifndef __OpenBSD__
 #ifdef IPV6_V6ONLY
   if (addr->sa_family == AF_INET6) {
@@ -221,6 +245,21 @@ int uv__tcp_connect(uv_connect_t* req,
   if (err)
     return err;
 
+#ifdef TCP_FASTOPEN_CONNECT
+  /* 内核有cookie的时候connect()直接返回，SYN推迟到第一次write()才发出，
+   * 在connect_cb之前排好的写请求会跟着SYN一起出去。设置失败（内核太老）
+   * 就当普通connect处理
+   */
+  if (handle->flags & UV_HANDLE_TCP_FASTOPEN) {
+    int on = 1;
+    setsockopt(uv__stream_fd(handle),
+               IPPROTO_TCP,
+               TCP_FASTOPEN_CONNECT,
+               &on,
+               sizeof(on));
+  }
+#endif
+
   handle->delayed_error = 0;
 
   do {
@@ -261,6 +300,301 @@ int uv__tcp_connect(uv_connect_t* req,
 }
 
 
+/* 没有指定间隔时两次连接尝试之间等待的毫秒数，RFC 8305建议250ms */
+#define UV__HE_DEFAULT_DELAY 250
+
+typedef struct uv__he_s uv__he_t;
+
+typedef struct {
+  uv_tcp_t tcp;
+  uv_connect_t req;
+  int active;  /* 连接还没有结果 */
+} uv__he_attempt_t;
+
+/* uv_tcp_connect_host()的内部状态。所有内部handle都关掉之后才释放 */
+struct uv__he_s {
+  uv_connect_host_t* req;
+  uv_getaddrinfo_t getaddrinfo_req;
+  uv_timer_t timer;
+  struct addrinfo* res;
+  struct addrinfo** addrs;
+  uv__he_attempt_t* attempts;
+  unsigned int naddrs;
+  unsigned int next;      /* 下一个要尝试的地址 */
+  unsigned int running;   /* 还在连接中的尝试个数 */
+  unsigned int nhandles;  /* 还没关掉的内部handle个数 */
+  unsigned int delay;
+  int error;              /* 最近一次失败的错误码 */
+};
+
+
+static void uv__he_start_next(uv__he_t* he);
+
+
+static void uv__he_close_cb(uv_handle_t* handle) {
+  uv__he_t* he;
+
+  he = handle->data;
+  if (--he->nhandles > 0)
+    return;
+
+  uv__free(he->addrs);
+  uv__free(he->attempts);
+  uv__free(he);
+}
+
+
+static void uv__he_finish(uv__he_t* he, int status) {
+  uv_connect_host_t* req;
+  unsigned int i;
+
+  /* 取消还在连接中的尝试，它们的connect_cb会收到UV_ECANCELED */
+  for (i = 0; i < he->next; i++) {
+    if (he->attempts[i].active) {
+      he->attempts[i].active = 0;
+      he->running--;
+      uv_close((uv_handle_t*) &he->attempts[i].tcp, uv__he_close_cb);
+    }
+  }
+  assert(he->running == 0);
+
+  uv_close((uv_handle_t*) &he->timer, uv__he_close_cb);
+
+  if (he->res != NULL) {
+    uv_freeaddrinfo(he->res);
+    he->res = NULL;
+  }
+
+  req = he->req;
+  req->he = NULL;
+  uv__req_unregister(req->handle->loop, req);
+  if (req->cb)
+    req->cb(req, status);
+}
+
+
+static void uv__he_win(uv__he_t* he, uv__he_attempt_t* a) {
+  uv_tcp_t* handle;
+  int err;
+  int fd;
+
+  uv_timer_stop(&he->timer);
+
+  /* 把socket从内部handle上摘下来交给用户的handle */
+  fd = uv__stream_fd(&a->tcp);
+  uv__io_close(a->tcp.loop, &a->tcp.io_watcher);
+  a->tcp.io_watcher.fd = -1;
+  uv_close((uv_handle_t*) &a->tcp, uv__he_close_cb);
+
+  handle = he->req->handle;
+  if (uv__is_closing(handle))
+    err = UV_ECANCELED;
+  else
+    err = uv__stream_open((uv_stream_t*) handle,
+                          fd,
+                          UV_HANDLE_READABLE | UV_HANDLE_WRITABLE);
+  if (err)
+    uv__close(fd);
+
+  uv__he_finish(he, err);
+}
+
+
+static void uv__he_connect_cb(uv_connect_t* req, int status) {
+  uv__he_attempt_t* a;
+  uv__he_t* he;
+
+  a = container_of(req, uv__he_attempt_t, req);
+  he = a->tcp.data;
+
+  /* 已经取消掉的尝试 */
+  if (!a->active)
+    return;
+
+  a->active = 0;
+  he->running--;
+
+  if (status == 0) {
+    uv__he_win(he, a);
+    return;
+  }
+
+  /* 失败了就不用等定时器，马上尝试下一个地址 */
+  he->error = status;
+  uv_close((uv_handle_t*) &a->tcp, uv__he_close_cb);
+  uv_timer_stop(&he->timer);
+  uv__he_start_next(he);
+}
+
+
+static void uv__he_timer_cb(uv_timer_t* timer) {
+  uv__he_start_next(timer->data);
+}
+
+
+static void uv__he_start_next(uv__he_t* he) {
+  uv__he_attempt_t* a;
+  struct addrinfo* ai;
+  uv_loop_t* loop;
+  int err;
+
+  loop = he->timer.loop;
+
+  while (he->next < he->naddrs) {
+    a = &he->attempts[he->next];
+    ai = he->addrs[he->next];
+    he->next++;
+
+    err = uv_tcp_init(loop, &a->tcp);
+    if (err) {
+      he->error = err;
+      continue;
+    }
+
+    a->tcp.flags |= UV_HANDLE_INTERNAL;
+    a->tcp.data = he;
+    he->nhandles++;
+
+    err = uv_tcp_connect(&a->req, &a->tcp, ai->ai_addr, uv__he_connect_cb);
+    if (err) {
+      he->error = err;
+      uv_close((uv_handle_t*) &a->tcp, uv__he_close_cb);
+      continue;
+    }
+
+    a->active = 1;
+    he->running++;
+
+    if (he->next < he->naddrs)
+      uv_timer_start(&he->timer, uv__he_timer_cb, he->delay, 0);
+
+    return;
+  }
+
+  /* 地址用完了，还在连接中的尝试就等它们的结果 */
+  if (he->running == 0)
+    uv__he_finish(he, he->error);
+}
+
+
+static void uv__he_getaddrinfo_cb(uv_getaddrinfo_t* req,
+                                  int status,
+                                  struct addrinfo* res) {
+  struct addrinfo* first[2];
+  struct addrinfo* ai;
+  uv__he_t* he;
+  unsigned int n;
+  int family;
+  int i;
+
+  he = container_of(req, uv__he_t, getaddrinfo_req);
+
+  if (status < 0) {
+    uv__he_finish(he, status);
+    return;
+  }
+
+  he->res = res;
+
+  n = 0;
+  for (ai = res; ai != NULL; ai = ai->ai_next)
+    if (ai->ai_family == AF_INET || ai->ai_family == AF_INET6)
+      n++;
+
+  if (n == 0) {
+    uv__he_finish(he, UV_EAI_ADDRFAMILY);
+    return;
+  }
+
+  he->addrs = uv__malloc(n * sizeof(*he->addrs));
+  he->attempts = uv__calloc(n, sizeof(*he->attempts));
+  if (he->addrs == NULL || he->attempts == NULL) {
+    uv__he_finish(he, UV_ENOMEM);
+    return;
+  }
+
+  /* 以第一个结果的地址族开头，两个地址族交替排列（RFC 8305 4节），
+   * 各自保持getaddrinfo()给出的顺序
+   */
+  for (ai = res; ai->ai_family != AF_INET && ai->ai_family != AF_INET6;)
+    ai = ai->ai_next;
+  family = ai->ai_family;
+  first[0] = res;
+  first[1] = res;
+
+  for (he->naddrs = 0; he->naddrs < n; family ^= AF_INET ^ AF_INET6) {
+    i = (family == AF_INET6);
+    for (ai = first[i]; ai != NULL && ai->ai_family != family;)
+      ai = ai->ai_next;
+    if (ai == NULL)
+      continue;
+    he->addrs[he->naddrs++] = ai;
+    first[i] = ai->ai_next;
+  }
+
+  uv__he_start_next(he);
+}
+
+
+int uv_tcp_connect_host(uv_connect_host_t* req,
+                        uv_tcp_t* handle,
+                        const char* node,
+                        const char* service,
+                        unsigned int delay,
+                        uv_connect_host_cb cb) {
+  struct addrinfo hints;
+  uv__he_t* he;
+  int err;
+
+  if (node == NULL || handle->type != UV_TCP)
+    return UV_EINVAL;
+
+  if (handle->connect_req != NULL)
+    return UV_EALREADY;
+
+  /* 连上的socket要交给handle，handle不能已经有socket了 */
+  if (uv__stream_fd(handle) != -1)
+    return UV_EBUSY;
+
+  he = uv__calloc(1, sizeof(*he));
+  if (he == NULL)
+    return UV_ENOMEM;
+
+  uv_timer_init(handle->loop, &he->timer);
+  he->timer.flags |= UV_HANDLE_INTERNAL;
+  he->timer.data = he;
+  he->nhandles = 1;
+  he->delay = delay ? delay : UV__HE_DEFAULT_DELAY;
+  he->error = UV_ECONNREFUSED;
+  he->req = req;
+
+  uv__req_init(handle->loop, req, UV_CONNECT_HOST);
+  req->cb = cb;
+  req->handle = handle;
+  req->he = he;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+
+  err = uv_getaddrinfo(handle->loop,
+                       &he->getaddrinfo_req,
+                       uv__he_getaddrinfo_cb,
+                       node,
+                       service,
+                       &hints);
+  if (err) {
+    uv__req_unregister(handle->loop, req);
+    req->he = NULL;
+    uv_close((uv_handle_t*) &he->timer, uv__he_close_cb);
+    return err;
+  }
+
+  return 0;
+}
+
+
 int uv_tcp_open(uv_tcp_t* handle, uv_os_sock_t sock) {
   int err;
 
@@ -339,9 +673,11 @@ int uv_tcp_listen(uv_tcp_t* tcp, int backlog, uv_connection_cb cb) {
   tcp->connection_cb = cb;
   tcp->flags |= UV_HANDLE_BOUND;
 
-  /* Start listening for connections. */
+  /* Start listening for connections. The listen socket may be shared with
+   * other loops (passed over IPC or dup'ed), only wake up one of them.
+   */
   tcp->io_watcher.cb = uv__server_io;
-  uv__io_start(tcp->loop, &tcp->io_watcher, POLLIN);
+  uv__io_start(tcp->loop, &tcp->io_watcher, POLLIN | UV__POLLEXCLUSIVE);
 
   return 0;
 }
@@ -394,6 +730,93 @@ int uv_tcp_nodelay(uv_tcp_t* handle, int on) {
 }
 
 
+/* 设置SO_BUSY_POLL，读socket时在没有数据的情况下先在驱动层忙轮询usec微秒，
+ * 通常和UV_LOOP_SPIN一起使用
+ */
+int uv_tcp_busy_poll(uv_tcp_t* handle, int usec) {
+  if (usec < 0)
+    return UV_EINVAL;
+
+  if (uv__stream_fd(handle) == -1)
+    return UV_EBADF;
+
+#ifdef SO_BUSY_POLL
+  if (setsockopt(uv__stream_fd(handle),
+                 SOL_SOCKET,
+                 SO_BUSY_POLL,
+                 &usec,
+                 sizeof(usec))) {
+    return UV__ERR(errno);
+  }
+
+  return 0;
+#else
+  return UV_ENOTSUP;
+#endif
+}
+
+
+/* 设置TCP_NOTSENT_LOWAT，内核里还没发出去的数据少于bytes时socket才算可写，
+ * 这样POLLOUT反映的是积压的未发送数据而不是发送缓冲区的空闲空间，数据
+ * 留在用户态的写队列里，可以晚一点再决定发什么
+ */
+int uv_tcp_notsent_lowat(uv_tcp_t* handle, unsigned int bytes) {
+  int val;
+
+  if (bytes > INT_MAX)
+    return UV_EINVAL;
+
+  if (uv__stream_fd(handle) == -1)
+    return UV_EBADF;
+
+#ifdef TCP_NOTSENT_LOWAT
+  val = bytes;
+  if (setsockopt(uv__stream_fd(handle),
+                 IPPROTO_TCP,
+                 TCP_NOTSENT_LOWAT,
+                 &val,
+                 sizeof(val))) {
+    return UV__ERR(errno);
+  }
+
+  return 0;
+#else
+  (void) val;
+  return UV_ENOTSUP;
+#endif
+}
+
+
+/* 设置TCP_DEFER_ACCEPT，握手完成后等客户端发来数据（最多secs秒）才让
+ * accept()返回，空连接不会占用connection_cb。要在uv_listen()之前调用
+ */
+int uv_tcp_defer_accept(uv_tcp_t* handle, unsigned int secs) {
+  int val;
+
+  if (secs > INT_MAX)
+    return UV_EINVAL;
+
+  if (uv__stream_fd(handle) == -1)
+    return UV_EBADF;
+
+#ifdef TCP_DEFER_ACCEPT
+  val = secs;
+  if (setsockopt(uv__stream_fd(handle),
+                 IPPROTO_TCP,
+                 TCP_DEFER_ACCEPT,
+                 &val,
+                 sizeof(val))) {
+    return UV__ERR(errno);
+  }
+
+  return 0;
+#else
+  (void) val;
+  return UV_ENOTSUP;
+#endif
+}
+
+
 int uv_tcp_keepalive(uv_tcp_t* handle, int on, unsigned int delay) {
   int err;
 
@@ -416,6 +839,66 @@ int uv_tcp_keepalive(uv_tcp_t* handle, int on, unsigned int delay) {
 }
 
 
+/* 读取内核里的连接状态，调用方可以据此挑选慢的对端或者调整每批写入的
+ * 大小。单位在这里换算好，平台之间保持一致
+ */
+int uv_tcp_get_info(const uv_tcp_t* handle, uv_tcp_info_t* info) {
+#if defined(__linux__) && defined(TCP_INFO)
+  struct tcp_info ti;
+#elif defined(__APPLE__) && defined(TCP_CONNECTION_INFO)
+  struct tcp_connection_info ti;
+#endif
+  socklen_t len;
+
+  if (info == NULL)
+    return UV_EINVAL;
+
+  if (uv__stream_fd(handle) == -1)
+    return UV_EBADF;
+
+  memset(info, 0, sizeof(*info));
+
+#if defined(__linux__) && defined(TCP_INFO)
+  len = sizeof(ti);
+  memset(&ti, 0, sizeof(ti));
+  if (getsockopt(uv__stream_fd(handle), IPPROTO_TCP, TCP_INFO, &ti, &len))
+    return UV__ERR(errno);
+
+  info->rtt = ti.tcpi_rtt;
+  info->rttvar = ti.tcpi_rttvar;
+  info->snd_cwnd = ti.tcpi_snd_cwnd * ti.tcpi_snd_mss;  /* 内核给的是报文数 */
+  info->snd_mss = ti.tcpi_snd_mss;
+  info->unacked = ti.tcpi_unacked * ti.tcpi_snd_mss;
+  info->total_retrans = ti.tcpi_total_retrans;
+
+  return 0;
+#elif defined(__APPLE__) && defined(TCP_CONNECTION_INFO)
+  len = sizeof(ti);
+  memset(&ti, 0, sizeof(ti));
+  if (getsockopt(uv__stream_fd(handle),
+                 IPPROTO_TCP,
+                 TCP_CONNECTION_INFO,
+                 &ti,
+                 &len)) {
+    return UV__ERR(errno);
+  }
+
+  /* darwin给的是毫秒 */
+  info->rtt = ti.tcpi_srtt * 1000;
+  info->rttvar = ti.tcpi_rttvar * 1000;
+  info->snd_cwnd = ti.tcpi_snd_cwnd;
+  info->snd_mss = ti.tcpi_maxseg;
+  info->unacked = ti.tcpi_snd_sbbytes;  /* 没有未确认字节数，用发送缓冲区的量 */
+  info->total_retrans = ti.tcpi_txretransmitpackets;
+
+  return 0;
+#else
+  (void) len;
+  return UV_ENOTSUP;
+#endif
+}
+
+
 int uv_tcp_simultaneous_accepts(uv_tcp_t* handle, int enable) {
   if (enable)
     handle->flags &= ~UV_HANDLE_TCP_SINGLE_ACCEPT;
@@ -428,3 +911,123 @@ int uv_tcp_simultaneous_accepts(uv_tcp_t* handle, int enable) {
 void uv__tcp_close(uv_tcp_t* handle) {
   uv__stream_close((uv_stream_t*)handle);
 }
+
+
+/* 见uv.h。uv_shutdown()承诺写完排队的数据再发FIN，和丢弃数据的RST互相矛盾 */
+int uv_tcp_close_reset(uv_tcp_t* handle, uv_close_cb close_cb) {
+  struct linger l;
+  int fd;
+
+  if (handle->flags & UV_HANDLE_SHUTTING)
+    return UV_EINVAL;
+
+  fd = uv__stream_fd(handle);
+  if (fd != -1) {
+    l.l_onoff = 1;
+    l.l_linger = 0;
+    if (setsockopt(fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l))) {
+      /* SunOS在对端已经关闭连接时返回EINVAL，这时本来就不会进入TIME_WAIT */
+      if (errno != EINVAL)
+        return UV__ERR(errno);
+    }
+  }
+
+  uv_close((uv_handle_t*) handle, close_cb);
+  return 0;
+}
+
+
+/* 设置TCP_FASTOPEN，qlen是还没完成三次握手就带着数据的连接的队列长度，
+ * 客户端第二次连上来时SYN里的数据就会随accept()一起到达。要在uv_listen()
+ * 之前调用
+ */
+int uv_tcp_fastopen(uv_tcp_t* handle, unsigned int qlen) {
+  int val;
+
+  if (qlen > INT_MAX)
+    return UV_EINVAL;
+
+  if (uv__stream_fd(handle) == -1)
+    return UV_EBADF;
+
+#ifdef TCP_FASTOPEN
+  val = qlen;
+  if (setsockopt(uv__stream_fd(handle),
+                 IPPROTO_TCP,
+                 TCP_FASTOPEN,
+                 &val,
+                 sizeof(val))) {
+    return UV__ERR(errno);
+  }
+
+  return 0;
+#else
+  (void) val;
+  return UV_ENOTSUP;
+#endif
+}
+
+
+/* 握手完成以后把密钥交给内核（TCP_ULP "tls"），之后uv_write()、
+ * uv_stream_sendfile()和splice写进去的都是明文，由内核加密成TLS记录。
+ * 第一次调用时挂上tls ULP，内核没有tls模块时返回UV_ENOENT
+ */
+int uv_tcp_ktls(uv_tcp_t* handle,
+                uv_tcp_ktls_dir dir,
+                const void* crypto_info,
+                size_t len) {
+#if defined(__linux__)
+  int optname;
+
+  if (crypto_info == NULL || len == 0)
+    return UV_EINVAL;
+
+  if (dir == UV_TCP_KTLS_TX)
+    optname = 1;  /* TLS_TX */
+  else if (dir == UV_TCP_KTLS_RX)
+    optname = 2;  /* TLS_RX */
+  else
+    return UV_EINVAL;
+
+  if (uv__stream_fd(handle) == -1)
+    return UV_EBADF;
+
+  /* 写队列里的握手数据还没发出去，装上发送密钥以后会被当成明文加密 */
+  if (dir == UV_TCP_KTLS_TX && handle->write_queue_size != 0)
+    return UV_EBUSY;
+
+  /* 收发两个方向分别设置，第二次挂ULP返回EEXIST */
+  if (setsockopt(uv__stream_fd(handle), IPPROTO_TCP, TCP_ULP, "tls", 4) &&
+      errno != EEXIST) {
+    return UV__ERR(errno);
+  }
+
+  if (setsockopt(uv__stream_fd(handle), SOL_TLS, optname, crypto_info, len))
+    return UV__ERR(errno);
+
+  return 0;
+#else
+  (void) handle;
+  (void) dir;
+  (void) crypto_info;
+  (void) len;
+  return UV_ENOTSUP;
+#endif
+}
+
+
+/* 客户端打开TFO，之后的uv_tcp_connect()会带上TCP_FASTOPEN_CONNECT */
+int uv_tcp_fastopen_connect(uv_tcp_t* handle, int enable) {
+#ifdef TCP_FASTOPEN_CONNECT
+  if (enable)
+    handle->flags |= UV_HANDLE_TCP_FASTOPEN;
+  else
+    handle->flags &= ~UV_HANDLE_TCP_FASTOPEN;
+
+  return 0;
+#else
+  (void) handle;
+  (void) enable;
+  return UV_ENOTSUP;
+#endif
+}
@@ -21,6 +21,8 @@
 
 #include "uv.h"
 #include "internal.h"
+#include "spinlock.h"
+#include "atomic-ops.h"
 
 #include <pthread.h>
 #include <assert.h>
@@ -183,24 +185,73 @@ static size_t thread_stack_size(void) {
 
 
 int uv_thread_create(uv_thread_t *tid, void (*entry)(void *arg), void *arg) {
+  uv_thread_options_t params;
+  params.flags = UV_THREAD_NO_FLAGS;
+  return uv_thread_create_ex(tid, &params, entry, arg);
+}
+
+
+int uv_thread_create_ex(uv_thread_t* tid,
+                        const uv_thread_options_t* params,
+                        void (*entry)(void *arg),
+                        void *arg) {
   int err;
+  size_t pagesize;
   size_t stack_size;
   pthread_attr_t* attr;
   pthread_attr_t attr_storage;
+#if (defined(__linux__) && defined(__GLIBC__)) || defined(__FreeBSD__)
+  uv__cpu_set_t cpuset;
+  int cpumasksize;
+  int i;
+#endif
 
   attr = NULL;
   stack_size = thread_stack_size();
 
-  if (stack_size > 0) {
+  if (params->flags & UV_THREAD_HAS_STACK_SIZE) {
+    pagesize = (size_t) getpagesize();
+    /* Round up to the nearest page boundary. */
+    stack_size = (params->stack_size + pagesize - 1) &~ (pagesize - 1);
+    if (stack_size < (size_t) PTHREAD_STACK_MIN)
+      stack_size = PTHREAD_STACK_MIN;
+  }
+
+  if (stack_size > 0 || (params->flags & UV_THREAD_HAS_CPUMASK)) {
     attr = &attr_storage;
 
     if (pthread_attr_init(attr))
       abort();
 
-    if (pthread_attr_setstacksize(attr, stack_size))
+    if (stack_size > 0 && pthread_attr_setstacksize(attr, stack_size))
       abort();
   }
 
+  /* 在属性里设置亲和性，线程一开始就跑在指定的CPU上，不用创建之后再迁移 */
+  if (params->flags & UV_THREAD_HAS_CPUMASK) {
+#if (defined(__linux__) && defined(__GLIBC__)) || defined(__FreeBSD__)
+    cpumasksize = uv_cpumask_size();
+    if (params->cpumask_size < (size_t) cpumasksize) {
+      pthread_attr_destroy(attr);
+      return UV_EINVAL;
+    }
+
+    CPU_ZERO(&cpuset);
+    for (i = 0; i < cpumasksize; i++)
+      if (params->cpumask[i])
+        CPU_SET(i, &cpuset);
+
+    err = pthread_attr_setaffinity_np(attr, sizeof(cpuset), &cpuset);
+    if (err) {
+      pthread_attr_destroy(attr);
+      return UV__ERR(err);
+    }
+#else
+    pthread_attr_destroy(attr);
+    return UV_ENOTSUP;
+#endif
+  }
+
   err = pthread_create(tid, attr, (void*(*)(void*)) entry, arg);
 
   if (attr != NULL)
@@ -300,17 +351,14 @@ int uv_thread_equal(const uv_thread_t* t1, const uv_thread_t* t2) {
 }
 
 
-int uv_mutex_init(uv_mutex_t* mutex) {
-#if defined(NDEBUG) || !defined(PTHREAD_MUTEX_ERRORCHECK)
-  return UV__ERR(pthread_mutex_init(mutex, NULL));
-#else
+static int uv__mutex_init_type(uv_mutex_t* mutex, int type) {
   pthread_mutexattr_t attr;
   int err;
 
   if (pthread_mutexattr_init(&attr))
     abort();
 
-  if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK))
+  if (pthread_mutexattr_settype(&attr, type))
     abort();
 
   err = pthread_mutex_init(mutex, &attr);
@@ -319,26 +367,26 @@ int uv_mutex_init(uv_mutex_t* mutex) {
     abort();
 
   return UV__ERR(err);
-#endif
 }
 
 
-int uv_mutex_init_recursive(uv_mutex_t* mutex) {
-  pthread_mutexattr_t attr;
-  int err;
-
-  if (pthread_mutexattr_init(&attr))
-    abort();
-
-  if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE))
-    abort();
-
-  err = pthread_mutex_init(mutex, &attr);
+int uv_mutex_init(uv_mutex_t* mutex) {
+#if defined(NDEBUG) || !defined(PTHREAD_MUTEX_ERRORCHECK)
+# if defined(PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP)
+  /* glibc的adaptive mutex在有竞争时先在用户态自旋一会儿再睡到futex上，
+   * libuv里的临界区都很短，这样能省掉大部分系统调用 */
+  return uv__mutex_init_type(mutex, PTHREAD_MUTEX_ADAPTIVE_NP);
+# else
+  return UV__ERR(pthread_mutex_init(mutex, NULL));
+# endif
+#else
+  return uv__mutex_init_type(mutex, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+}
 
-  if (pthread_mutexattr_destroy(&attr))
-    abort();
 
-  return UV__ERR(err);
+int uv_mutex_init_recursive(uv_mutex_t* mutex) {
+  return uv__mutex_init_type(mutex, PTHREAD_MUTEX_RECURSIVE);
 }
 
 
@@ -374,6 +422,29 @@ void uv_mutex_unlock(uv_mutex_t* mutex) {
 }
 
 
+void uv_spinlock_init(uv_spinlock_t* spinlock) {
+  uv__spinlock_init(spinlock);
+}
+
+
+void uv_spinlock_lock(uv_spinlock_t* spinlock) {
+  uv__spinlock_lock(spinlock);
+}
+
+
+int uv_spinlock_trylock(uv_spinlock_t* spinlock) {
+  if (uv__spinlock_trylock(spinlock))
+    return 0;
+
+  return UV_EBUSY;
+}
+
+
+void uv_spinlock_unlock(uv_spinlock_t* spinlock) {
+  uv__spinlock_unlock(spinlock);
+}
+
+
 int uv_rwlock_init(uv_rwlock_t* rwlock) {
   return UV__ERR(pthread_rwlock_init(rwlock, NULL));
 }
@@ -436,6 +507,163 @@ void uv_rwlock_wrunlock(uv_rwlock_t* rwlock) {
     abort();
 }
 
+
+/* BRAVO风格的读偏向锁。rbias为1时读者不碰rwlock，只在当前CPU对应的槽里加
+ * 一个计数；写者拿到rwlock的写锁之后清掉rbias，再等所有槽变回0。撤销偏向
+ * 花了多久，之后UV__BRLOCK_INHIBIT倍的时间里读者都走rwlock，写得频繁的时候
+ * 不会每次都扫一遍所有的槽。持有rwlock读锁的读者看到时间到了再打开偏向
+ */
+#define UV__BRLOCK_INHIBIT 9
+#define UV__BRLOCK_MAX_SLOTS 256
+
+struct uv__brlock_slot {
+  int readers;
+  char pad[UV_CACHELINE_SIZE - sizeof(int)];
+};
+
+
+/* 槽的下标。读者在加锁和解锁之间换了CPU也没关系，解锁用的是加锁时的槽 */
+static unsigned int uv__brlock_cpu(void) {
+  pthread_t self;
+#if defined(__linux__)
+  int cpu;
+
+  cpu = sched_getcpu();
+  if (cpu >= 0)
+    return cpu;
+#endif
+
+  self = pthread_self();
+  return (unsigned int) (((uintptr_t) self >> 12) * 2654435761u) >> 16;
+}
+
+
+int uv_brlock_init(uv_brlock_t* lock) {
+  unsigned int nslots;
+  long ncpus;
+  int err;
+
+  ncpus = sysconf(_SC_NPROCESSORS_CONF);
+  for (nslots = 1; nslots < ncpus && nslots < UV__BRLOCK_MAX_SLOTS; nslots *= 2);
+
+  lock->slots = uv__calloc(nslots, sizeof(struct uv__brlock_slot));
+  if (lock->slots == NULL)
+    return UV_ENOMEM;
+
+  err = uv_rwlock_init(&lock->rwlock);
+  if (err) {
+    uv__free(lock->slots);
+    lock->slots = NULL;
+    return err;
+  }
+
+  lock->rbias = 1;
+  lock->mask = nslots - 1;
+  lock->inhibit_until = 0;
+  return 0;
+}
+
+
+void uv_brlock_destroy(uv_brlock_t* lock) {
+  uv_rwlock_destroy(&lock->rwlock);
+  uv__free(lock->slots);
+  lock->slots = NULL;
+}
+
+
+/* 返回0表示拿的是rwlock的读锁，否则是槽的下标加1 */
+int uv_brlock_rdlock(uv_brlock_t* lock) {
+  struct uv__brlock_slot* slot;
+  unsigned int i;
+
+  if (ACCESS_ONCE(int, lock->rbias)) {
+    i = uv__brlock_cpu() & lock->mask;
+    slot = (struct uv__brlock_slot*) lock->slots + i;
+    /* fetch_addi是完整的内存屏障，和写者清掉rbias之后再读槽配对 */
+    fetch_addi(&slot->readers, 1);
+    if (ACCESS_ONCE(int, lock->rbias))
+      return i + 1;
+    fetch_addi(&slot->readers, -1);
+  }
+
+  uv_rwlock_rdlock(&lock->rwlock);
+  /* 持有读锁时没有写者，inhibit_until不会变 */
+  if (ACCESS_ONCE(int, lock->rbias) == 0 &&
+      uv_hrtime() >= lock->inhibit_until)
+    ACCESS_ONCE(int, lock->rbias) = 1;
+
+  return 0;
+}
+
+
+void uv_brlock_rdunlock(uv_brlock_t* lock, int token) {
+  struct uv__brlock_slot* slot;
+
+  if (token == 0) {
+    uv_rwlock_rdunlock(&lock->rwlock);
+    return;
+  }
+
+  slot = (struct uv__brlock_slot*) lock->slots + (token - 1);
+  fetch_addi(&slot->readers, -1);
+}
+
+
+/* 持有写锁时撤销偏向。wait为0时有读者还在槽里就恢复偏向并返回UV_EBUSY */
+static int uv__brlock_revoke(uv_brlock_t* lock, int wait) {
+  struct uv__brlock_slot* slots;
+  uint64_t start;
+  uint64_t now;
+  unsigned int i;
+
+  if (lock->rbias == 0)
+    return 0;
+
+  start = uv_hrtime();
+  cmpxchgi(&lock->rbias, 1, 0);
+
+  slots = lock->slots;
+  for (i = 0; i <= lock->mask; i++) {
+    while (ACCESS_ONCE(int, slots[i].readers) != 0) {
+      if (!wait) {
+        ACCESS_ONCE(int, lock->rbias) = 1;
+        return UV_EBUSY;
+      }
+      cpu_relax();
+    }
+  }
+
+  now = uv_hrtime();
+  lock->inhibit_until = now + (now - start) * UV__BRLOCK_INHIBIT;
+  return 0;
+}
+
+
+void uv_brlock_wrlock(uv_brlock_t* lock) {
+  uv_rwlock_wrlock(&lock->rwlock);
+  uv__brlock_revoke(lock, 1);
+}
+
+
+int uv_brlock_trywrlock(uv_brlock_t* lock) {
+  int err;
+
+  err = uv_rwlock_trywrlock(&lock->rwlock);
+  if (err)
+    return err;
+
+  err = uv__brlock_revoke(lock, 0);
+  if (err)
+    uv_rwlock_wrunlock(&lock->rwlock);
+
+  return err;
+}
+
+
+void uv_brlock_wrunlock(uv_brlock_t* lock) {
+  uv_rwlock_wrunlock(&lock->rwlock);
+}
+
 /* 用来保证callback在全局只初始化执行一次 */
 void uv_once(uv_once_t* guard, void (*callback)(void)) {
   /* 
@@ -509,7 +737,122 @@ int uv_sem_trywait(uv_sem_t* sem) {
   return UV_EINVAL;  /* Satisfy the compiler. */
 }
 
-#else /* !(defined(__APPLE__) && defined(__MACH__)) */
+#elif defined(__linux__)
+
+/* Linux上信号量直接用futex实现，放在uv_sem_t自己的存储里，不需要额外分配。
+ * value是当前计数，waiters是已经或者马上要睡到futex上的线程数。没有竞争时
+ * post和wait都只是一次原子操作；post只有在有人等待时才进内核。
+ */
+typedef struct uv__futex_sem_s {
+  int value;
+  int waiters;
+  int spins;
+} uv__futex_sem_t;
+
+STATIC_ASSERT(sizeof(uv_sem_t) >= sizeof(uv__futex_sem_t));
+
+/* 睡眠之前最多自旋的次数 */
+#define UV__SEM_MAX_SPINS 1000
+
+
+static int uv__sem_add(int* ptr, int n) {
+  int val;
+
+  do
+    val = *(volatile int*) ptr;
+  while (cmpxchgi(ptr, val, val + n) != val);
+
+  return val + n;
+}
+
+
+int uv_sem_init(uv_sem_t* sem_, unsigned int value) {
+  uv__futex_sem_t* sem;
+
+  if (value > INT_MAX)
+    return UV_EINVAL;
+
+  sem = (uv__futex_sem_t*) sem_;
+  sem->value = value;
+  sem->waiters = 0;
+  sem->spins = 0;
+
+  return 0;
+}
+
+
+void uv_sem_destroy(uv_sem_t* sem) {
+  /* 没有任何需要释放的资源 */
+}
+
+
+void uv_sem_post(uv_sem_t* sem_) {
+  uv__futex_sem_t* sem;
+
+  sem = (uv__futex_sem_t*) sem_;
+
+  /* cmpxchgi()是完整的内存屏障：要么这里看到了等待者，要么等待者在睡眠之前
+   * 能看到新的计数 */
+  uv__sem_add(&sem->value, 1);
+
+  if (*(volatile int*) &sem->waiters > 0)
+    if (uv__futex(&sem->value, UV__FUTEX_WAKE_PRIVATE, 1, NULL) == -1)
+      abort();
+}
+
+
+int uv_sem_trywait(uv_sem_t* sem_) {
+  uv__futex_sem_t* sem;
+  int val;
+
+  sem = (uv__futex_sem_t*) sem_;
+
+  for (;;) {
+    val = *(volatile int*) &sem->value;
+    if (val == 0)
+      return UV_EAGAIN;
+    if (cmpxchgi(&sem->value, val, val - 1) == val)
+      return 0;
+  }
+}
+
+
+void uv_sem_wait(uv_sem_t* sem_) {
+  uv__futex_sem_t* sem;
+  int spins;
+  int max;
+
+  sem = (uv__futex_sem_t*) sem_;
+
+  /* 自适应自旋：spins是最近几次自旋成功时用掉的平均次数，睡眠之前最多自旋
+   * 它的两倍。自旋失败时逐渐减少，等待总是很久的信号量几乎不自旋。
+   * spins的更新不需要是原子的，它只是一个估计值。
+   */
+  max = sem->spins * 2 + 10;
+  if (max > UV__SEM_MAX_SPINS)
+    max = UV__SEM_MAX_SPINS;
+
+  for (spins = 0; spins < max; spins++) {
+    if (uv_sem_trywait(sem_) == 0) {
+      sem->spins += (spins - sem->spins) / 8;
+      return;
+    }
+    cpu_relax();
+  }
+
+  sem->spins -= sem->spins / 8;
+
+  uv__sem_add(&sem->waiters, 1);
+
+  while (uv_sem_trywait(sem_) != 0)
+    if (uv__futex(&sem->value, UV__FUTEX_WAIT_PRIVATE, 0, NULL) == -1)
+      if (errno != EAGAIN && errno != EINTR)
+        abort();
+
+  uv__sem_add(&sem->waiters, -1);
+}
+
+#else /* !(defined(__APPLE__) && defined(__MACH__)) && !defined(__linux__) */
 
 #ifdef __GLIBC__
 
@@ -196,6 +196,7 @@ skip:
 
   uv__stream_open((uv_stream_t*) tty, fd, flags);
   tty->mode = UV_TTY_MODE_NORMAL;
+  tty->write_buffer = NULL;
 
   return 0;
 }
@@ -226,18 +227,21 @@ int uv_tty_set_mode(uv_tty_t* tty, uv_tty_mode_t mode) {
   if (tty->mode == (int) mode)
     return 0;
 
+  /* 缓冲着的输出按原来的模式写 */
+  uv_tty_flush(tty);
+
   fd = uv__stream_fd(tty);
   if (tty->mode == UV_TTY_MODE_NORMAL && mode != UV_TTY_MODE_NORMAL) {
     if (tcgetattr(fd, &tty->orig_termios))
       return UV__ERR(errno);
 
     /* This is used for uv_tty_reset_mode() */
-    uv_spinlock_lock(&termios_spinlock);
+    uv__spinlock_lock(&termios_spinlock);
     if (orig_termios_fd == -1) {
       orig_termios = tty->orig_termios;
       orig_termios_fd = fd;
     }
-    uv_spinlock_unlock(&termios_spinlock);
+    uv__spinlock_unlock(&termios_spinlock);
   }
 
   tmp = tty->orig_termios;
@@ -283,6 +287,123 @@ int uv_tty_get_winsize(uv_tty_t* tty, int* width, int* height) {
   return 0;
 }
 
+/* uv_tty_set_buffering()的状态，定时器在handle关闭以后才能释放 */
+struct uv__tty_buffer {
+  uv_timer_t timer;
+  uv_tty_t* tty;
+  size_t size;
+  unsigned int timeout;
+};
+
+
+static void uv__tty_buffer_close_cb(uv_handle_t* handle) {
+  uv__free(container_of((uv_timer_t*) handle, struct uv__tty_buffer, timer));
+}
+
+
+static void uv__tty_buffer_flush(uv_tty_t* tty) {
+  struct uv__tty_buffer* b;
+
+  b = tty->write_buffer;
+  uv_timer_stop(&b->timer);
+  uv_stream_uncork((uv_stream_t*) tty);
+  tty->flags |= UV_HANDLE_CORKED;
+}
+
+
+static void uv__tty_buffer_timer_cb(uv_timer_t* timer) {
+  struct uv__tty_buffer* b;
+
+  b = container_of(timer, struct uv__tty_buffer, timer);
+  uv__tty_buffer_flush(b->tty);
+}
+
+
+/* uv_write()把请求排进了队列，攒够了就写，否则从第一个请求开始计时 */
+void uv__tty_write(uv_tty_t* tty) {
+  struct uv__tty_buffer* b;
+
+  b = tty->write_buffer;
+  if (b == NULL)
+    return;
+
+  if (tty->write_queue_size >= b->size)
+    uv__tty_buffer_flush(tty);
+  else if (!uv__is_active(&b->timer))
+    uv_timer_start(&b->timer, uv__tty_buffer_timer_cb, b->timeout, 0);
+}
+
+
+int uv_tty_set_buffering(uv_tty_t* tty, size_t size, unsigned int timeout) {
+  struct uv__tty_buffer* b;
+  int err;
+
+  b = tty->write_buffer;
+
+  if (size == 0) {
+    if (b == NULL)
+      return 0;
+
+    uv__tty_buffer_flush(tty);
+    tty->flags &= ~UV_HANDLE_CORKED;
+    tty->write_buffer = NULL;
+    uv_close((uv_handle_t*) &b->timer, uv__tty_buffer_close_cb);
+    return 0;
+  }
+
+  if (!(tty->flags & UV_HANDLE_WRITABLE))
+    return UV_EINVAL;
+
+  if (b == NULL) {
+    /* 用户自己cork着的时候不能再拿来做缓冲 */
+    if (tty->flags & UV_HANDLE_CORKED)
+      return UV_EBUSY;
+
+    b = uv__malloc(sizeof(*b));
+    if (b == NULL)
+      return UV_ENOMEM;
+
+    err = uv_timer_init(tty->loop, &b->timer);
+    if (err) {
+      uv__free(b);
+      return err;
+    }
+
+    /* 排着的写请求会让loop继续运行，定时器本身不用 */
+    b->timer.flags |= UV_HANDLE_INTERNAL;
+    uv__handle_unref(&b->timer);
+    b->tty = tty;
+    tty->write_buffer = b;
+    tty->flags |= UV_HANDLE_CORKED;
+  }
+
+  b->size = size;
+  b->timeout = timeout;
+
+  /* 门槛降低以后，已经攒着的可能已经够了 */
+  if (!QUEUE_EMPTY(&tty->write_queue))
+    uv__tty_write(tty);
+
+  return 0;
+}
+
+
+int uv_tty_flush(uv_tty_t* tty) {
+  if (tty->write_buffer == NULL)
+    return 0;
+
+  uv__tty_buffer_flush(tty);
+  return 0;
+}
+
+
+/* 关闭前把攒着的数据尽量写出去，写不完的跟其他排队的请求一样取消 */
+void uv__tty_close(uv_tty_t* handle) {
+  uv_tty_set_buffering(handle, 0, 0);
+  uv__stream_close((uv_stream_t*) handle);
+}
+
+
 
 uv_handle_type uv_guess_handle(uv_os_fd_t file) {
   struct sockaddr sa;
@@ -352,7 +473,7 @@ int uv_tty_reset_mode(void) {
   int err;
 
   saved_errno = errno;
-  if (!uv_spinlock_trylock(&termios_spinlock))
+  if (!uv__spinlock_trylock(&termios_spinlock))
     return UV_EBUSY;  /* In uv_tty_set_mode(). */
 
   err = 0;
@@ -360,7 +481,7 @@ int uv_tty_reset_mode(void) {
     if (tcsetattr(orig_termios_fd, TCSANOW, &orig_termios))
       err = UV__ERR(errno);
 
-  uv_spinlock_unlock(&termios_spinlock);
+  uv__spinlock_unlock(&termios_spinlock);
   errno = saved_errno;
 
   return err;
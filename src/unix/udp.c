@@ -27,9 +27,33 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/uio.h>  /* writev */
 #if defined(__MVS__)
 #include <xti.h>
 #endif
+#if defined(__linux__)
+#include <netinet/udp.h>  /* UDP_SEGMENT, UDP_GRO */
+#include <linux/filter.h>  /* SO_ATTACH_REUSEPORT_CBPF */
+#include <linux/errqueue.h>
+/* 老的头文件里没有这几个常量 */
+# ifndef MSG_ZEROCOPY
+#  define MSG_ZEROCOPY 0x4000000
+# endif
+# ifndef SO_ZEROCOPY
+#  define SO_ZEROCOPY 60
+# endif
+# ifndef SO_EE_ORIGIN_ZEROCOPY
+#  define SO_EE_ORIGIN_ZEROCOPY 5
+# endif
+# ifndef SO_TXTIME
+#  define SO_TXTIME 61
+#  define SCM_TXTIME SO_TXTIME
+# endif
+#endif
+
+#ifndef MSG_ZEROCOPY
+# define MSG_ZEROCOPY 0
+#endif
 
 #if defined(IPV6_JOIN_GROUP) && !defined(IPV6_ADD_MEMBERSHIP)
 # define IPV6_ADD_MEMBERSHIP IPV6_JOIN_GROUP
@@ -41,15 +65,28 @@
 
 
 static void uv__udp_run_completed(uv_udp_t* handle);
-static void uv__udp_io(uv_loop_t* loop, uv__io_t* w, unsigned int revents);
+static void uv__udp_watermarks(uv_udp_t* handle);
 static void uv__udp_recvmsg(uv_udp_t* handle);
 static void uv__udp_sendmsg(uv_udp_t* handle);
 static int uv__udp_maybe_deferred_bind(uv_udp_t* handle,
                                        int domain,
                                        unsigned int flags);
 
+/* 发送时附带的控制信息：GSO的段大小、发送时间和源地址 */
+typedef union {
+  char buf[128];
+  struct cmsghdr align;
+} uv__udp_send_ctl_t;
+
+/* 接收时的控制信息：GRO的段大小、时间戳、目的地址和TOS */
+typedef union {
+  char buf[256];
+  struct cmsghdr align;
+} uv__udp_recv_ctl_t;
+
 
 void uv__udp_close(uv_udp_t* handle) {
+  uv__rate_limits_release(&handle->rate_limit);
   uv__io_close(handle->loop, &handle->io_watcher);
   uv__handle_stop(handle);
 
@@ -67,6 +104,16 @@ void uv__udp_finish_close(uv_udp_t* handle) {
   assert(!uv__io_active(&handle->io_watcher, POLLIN | POLLOUT));
   assert(handle->io_watcher.fd == -1);
 
+  /* 零拷贝的报文已经交给了内核，但等不到完成通知了，同流的做法报UV_ECANCELED */
+  while (!QUEUE_EMPTY(&handle->zerocopy_queue)) {
+    q = QUEUE_HEAD(&handle->zerocopy_queue);
+    QUEUE_REMOVE(q);
+
+    req = QUEUE_DATA(q, uv_udp_send_t, queue);
+    req->status = UV_ECANCELED;
+    QUEUE_INSERT_TAIL(&handle->write_completed_queue, &req->queue);
+  }
+
   while (!QUEUE_EMPTY(&handle->write_queue)) {
     q = QUEUE_HEAD(&handle->write_queue);
     QUEUE_REMOVE(q);
@@ -88,6 +135,18 @@ void uv__udp_finish_close(uv_udp_t* handle) {
 }
 
 
+/* 在收报文：POLLIN打开着，或者在等限速器的令牌 */
+static int uv__udp_receiving(const uv_udp_t* handle) {
+  const struct uv__rate_limits* limits;
+
+  if (uv__io_active(&handle->io_watcher, POLLIN))
+    return 1;
+
+  limits = handle->rate_limit;
+  return limits != NULL && !QUEUE_EMPTY(&limits->in.member);
+}
+
+
 static void uv__udp_run_completed(uv_udp_t* handle) {
   uv_udp_send_t* req;
   QUEUE* q;
@@ -102,13 +161,19 @@ static void uv__udp_run_completed(uv_udp_t* handle) {
     req = QUEUE_DATA(q, uv_udp_send_t, queue);
     uv__req_unregister(handle->loop, req);
 
-    handle->send_queue_size -= uv__count_bufs(req->bufs, req->nbufs);
-    handle->send_queue_count--;
+    /* 被丢弃的请求在丢弃时就已经不计入队列了 */
+    if (!req->dropped) {
+      handle->send_queue_size -= uv__count_bufs(req->bufs, req->nbufs);
+      handle->send_queue_count--;
+    }
 
     if (req->bufs != req->bufsml)
-      uv__free(req->bufs);
+      uv__loop_free(handle->loop, req->bufs);
     req->bufs = NULL;
 
+    uv__iobuf_drop(req->iobuf_owners, req->iobuf_nowners);
+    req->iobuf_owners = NULL;
+
     if (req->send_cb == NULL)
       continue;
 
@@ -124,23 +189,96 @@ static void uv__udp_run_completed(uv_udp_t* handle) {
   if (QUEUE_EMPTY(&handle->write_queue)) {
     /* Pending queue and completion queue empty, stop watcher. */
     uv__io_stop(handle->loop, &handle->io_watcher, POLLOUT);
-    if (!uv__io_active(&handle->io_watcher, POLLIN))
+    if (!uv__udp_receiving(handle) &&
+        QUEUE_EMPTY(&handle->zerocopy_queue))
       uv__handle_stop(handle);
   }
 
   handle->flags &= ~UV_HANDLE_UDP_PROCESSING;
+  uv__udp_watermarks(handle);
+}
+
+
+#if defined(__linux__)
+/* 从错误队列里取MSG_ZEROCOPY的完成通知，每条说明序号在[ee_info, ee_data]
+ * 之间的发送内核已经用完了。UDP的每个报文单独释放，通知不一定按顺序，
+ * 所以按区间挑出对应的请求，参见stream.c
+ */
+static void uv__udp_zerocopy_done(uv_udp_t* handle) {
+  struct sock_extended_err* serr;
+  struct cmsghdr* cmsg;
+  struct msghdr msg;
+  uv_udp_send_t* req;
+  QUEUE* q;
+  QUEUE* next;
+  union {
+    char data[CMSG_SPACE(sizeof(struct sock_extended_err) +
+                         sizeof(struct sockaddr_in6))];
+    struct cmsghdr alias;
+  } scratch;
+
+  for (;;) {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = &scratch.alias;
+    msg.msg_controllen = sizeof(scratch);
+
+    if (recvmsg(handle->io_watcher.fd, &msg, MSG_ERRQUEUE) == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg);
+         cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+        continue;
+
+      serr = (struct sock_extended_err*) CMSG_DATA(cmsg);
+      if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+
+      for (q = QUEUE_HEAD(&handle->zerocopy_queue);
+           q != &handle->zerocopy_queue;
+           q = next) {
+        next = QUEUE_NEXT(q);
+        req = QUEUE_DATA(q, uv_udp_send_t, queue);
+        if (req->zerocopy_seq - serr->ee_info >
+            serr->ee_data - serr->ee_info)
+          continue;
+
+        QUEUE_REMOVE(q);
+        QUEUE_INSERT_TAIL(&handle->write_completed_queue, &req->queue);
+      }
+    }
+  }
+
+  if (QUEUE_EMPTY(&handle->zerocopy_queue))
+    uv__io_stop(handle->loop, &handle->io_watcher, UV__POLLPRI);
 }
+#endif
 
 
-static void uv__udp_io(uv_loop_t* loop, uv__io_t* w, unsigned int revents) {
+void uv__udp_io(uv_loop_t* loop, uv__io_t* w, unsigned int revents) {
   uv_udp_t* handle;
 
   handle = container_of(w, uv_udp_t, io_watcher);
   assert(handle->type == UV_UDP);
+  uv__handle_activity(handle);
+  uv__sockbuf_idle(loop, &handle->sockbuf_tune, handle->io_watcher.fd);
 
   if (revents & POLLIN)
     uv__udp_recvmsg(handle);
 
+#if defined(__linux__)
+  if ((revents & POLLERR) && !QUEUE_EMPTY(&handle->zerocopy_queue)) {
+    uv__udp_zerocopy_done(handle);
+    if (!(revents & POLLOUT))
+      uv__udp_run_completed(handle);
+  }
+#endif
+
   if (revents & POLLOUT) {
     uv__udp_sendmsg(handle);
     uv__udp_run_completed(handle);
@@ -148,9 +286,250 @@ static void uv__udp_io(uv_loop_t* loop, uv__io_t* w, unsigned int revents) {
 }
 
 
+/* 打开了GRO或者uv_udp_recv_start_ex()要了接收信息时，让内核把控制信息
+ * 放进ctl
+ */
+static void uv__udp_recv_ctl(uv_udp_t* handle,
+                             struct msghdr* h,
+                             uv__udp_recv_ctl_t* ctl) {
+  if ((handle->flags & UV_HANDLE_UDP_GRO) ||
+      handle->recv_info_flags != 0 ||
+      handle->sockbuf_tune.max_size != 0) {
+    h->msg_control = ctl->buf;
+    h->msg_controllen = sizeof(ctl->buf);
+  } else {
+    h->msg_control = NULL;
+    h->msg_controllen = 0;
+  }
+}
+
+
+/* 取出收到的控制信息填进info，返回要交给recv_cb的flags */
+static unsigned int uv__udp_recv_cmsg(uv_udp_t* handle,
+                                      struct msghdr* h,
+                                      uv_udp_recv_info_t* info) {
+  struct cmsghdr* cm;
+  unsigned int flags;
+
+  memset(info, 0, sizeof(*info));
+  info->tos = -1;
+
+  flags = 0;
+  if (h->msg_flags & MSG_TRUNC)
+    flags |= UV_UDP_PARTIAL;
+
+  handle->gro_segment_size = 0;
+  if (h->msg_controllen == 0)
+    return flags;
+
+  for (cm = CMSG_FIRSTHDR(h); cm != NULL; cm = CMSG_NXTHDR(h, cm)) {
+#ifdef UDP_GRO
+    if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+      int size;
+      memcpy(&size, CMSG_DATA(cm), sizeof(size));
+      handle->gro_segment_size = size;
+      info->gro_segment_size = size;
+      flags |= UV_UDP_GRO;
+    }
+#endif
+#ifdef SCM_TIMESTAMPNS
+    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS) {
+      struct timespec ts;
+      memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+      info->timestamp.tv_sec = ts.tv_sec;
+      info->timestamp.tv_nsec = ts.tv_nsec;
+    }
+#endif
+#ifdef IP_PKTINFO
+    if (cm->cmsg_level == IPPROTO_IP && cm->cmsg_type == IP_PKTINFO) {
+      struct sockaddr_in* sin;
+      struct in_pktinfo pi;
+      memcpy(&pi, CMSG_DATA(cm), sizeof(pi));
+      sin = (struct sockaddr_in*) &info->local;
+      sin->sin_family = AF_INET;
+      sin->sin_addr = pi.ipi_addr;
+      info->ifindex = pi.ipi_ifindex;
+    }
+#endif
+#if defined(IPV6_RECVPKTINFO) && defined(IPV6_PKTINFO)
+    if (cm->cmsg_level == IPPROTO_IPV6 && cm->cmsg_type == IPV6_PKTINFO) {
+      struct sockaddr_in6* sin6;
+      struct in6_pktinfo pi6;
+      memcpy(&pi6, CMSG_DATA(cm), sizeof(pi6));
+      sin6 = (struct sockaddr_in6*) &info->local;
+      sin6->sin6_family = AF_INET6;
+      sin6->sin6_addr = pi6.ipi6_addr;
+      info->ifindex = pi6.ipi6_ifindex;
+    }
+#endif
+#ifdef IP_RECVTOS
+    /* IPv4的TOS只有一个字节 */
+    if (cm->cmsg_level == IPPROTO_IP && cm->cmsg_type == IP_TOS)
+      info->tos = *(unsigned char*) CMSG_DATA(cm);
+#endif
+#ifdef IPV6_RECVTCLASS
+    if (cm->cmsg_level == IPPROTO_IPV6 && cm->cmsg_type == IPV6_TCLASS) {
+      int tclass;
+      memcpy(&tclass, CMSG_DATA(cm), sizeof(tclass));
+      info->tos = tclass;
+    }
+#endif
+#ifdef SO_RXQ_OVFL
+    /* 累计的丢包数，变了说明SO_RCVBUF不够用 */
+    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_RXQ_OVFL) {
+      uint32_t drops;
+      memcpy(&drops, CMSG_DATA(cm), sizeof(drops));
+      if (drops != handle->sockbuf_tune.drops) {
+        handle->sockbuf_tune.drops = drops;
+        uv__sockbuf_grow(handle->loop,
+                         &handle->sockbuf_tune,
+                         handle->io_watcher.fd,
+                         SO_RCVBUF);
+      }
+    }
+#endif
+  }
+
+  return flags;
+}
+
+
+/* uv_udp_recv_start_ex()时的recv_cb，把接收路径上准备好的info转给用户的
+ * 回调。出错、没有数据这类回调没有info，给一个空的
+ */
+static void uv__udp_recv_ex(uv_udp_t* handle,
+                            ssize_t nread,
+                            const uv_buf_t* buf,
+                            const struct sockaddr* addr,
+                            unsigned flags) {
+  uv_udp_recv_info_t info;
+  const uv_udp_recv_info_t* p;
+
+  p = handle->recv_info;
+  if (p == NULL) {
+    memset(&info, 0, sizeof(info));
+    info.addr = addr;
+    info.tos = -1;
+    p = &info;
+  }
+
+  handle->recv_ex_cb(handle, nread, buf, p, flags);
+}
+
+
+#if defined(__linux__)
+/* 一次recvmmsg()最多收的报文个数 */
+#define UV__MMSG_MAXWIDTH 20
+/* 每个槽位的大小，放得下最大的UDP报文 */
+#define UV__UDP_DGRAM_MAXSIZE (64 * 1024)
+
+/* 把alloc_cb给的一大块buf切成UV__UDP_DGRAM_MAXSIZE大小的槽位，一次
+ * recvmmsg()收满，每个报文带着UV_UDP_MMSG_CHUNK交给recv_cb，最后再用
+ * nread == 0回调一次把整块buf交还给调用方。返回收到的报文个数，出错或者
+ * 没有数据时返回-1；buf放不下两个槽位或者内核不支持recvmmsg()时什么都
+ * 不做，返回UV_ENOSYS，由调用方改用recvmsg()
+ */
+static ssize_t uv__udp_recvmmsg(uv_udp_t* handle, uv_buf_t* buf) {
+  struct sockaddr_storage peers[UV__MMSG_MAXWIDTH];
+  uv__udp_recv_ctl_t ctl[UV__MMSG_MAXWIDTH];
+  struct uv__mmsghdr msgs[UV__MMSG_MAXWIDTH];
+  struct iovec iov[UV__MMSG_MAXWIDTH];
+  const struct sockaddr* addr;
+  uv_udp_recv_info_t info;
+  uv_udp_recv_cb recv_cb;
+  uv_buf_t chunk;
+  size_t chunks;
+  size_t k;
+  int flags;
+  int nread;
+
+  chunks = buf->len / UV__UDP_DGRAM_MAXSIZE;
+  if (chunks > ARRAY_SIZE(msgs))
+    chunks = ARRAY_SIZE(msgs);
+
+  if (chunks < 2)
+    return UV_ENOSYS;
+
+  memset(msgs, 0, chunks * sizeof(msgs[0]));
+  for (k = 0; k < chunks; k++) {
+    iov[k].iov_base = buf->base + k * UV__UDP_DGRAM_MAXSIZE;
+    iov[k].iov_len = UV__UDP_DGRAM_MAXSIZE;
+    msgs[k].msg_hdr.msg_iov = iov + k;
+    msgs[k].msg_hdr.msg_iovlen = 1;
+    msgs[k].msg_hdr.msg_name = peers + k;
+    msgs[k].msg_hdr.msg_namelen = sizeof(peers[0]);
+    uv__udp_recv_ctl(handle, &msgs[k].msg_hdr, ctl + k);
+  }
+
+  do
+    nread = uv__recvmmsg(handle->io_watcher.fd, msgs, chunks, 0, NULL);
+  while (nread == -1 && errno == EINTR);
+
+#if !defined(UV_DISABLE_IO_STATS)
+  if (nread != -1 || errno != ENOSYS) {
+    ssize_t bytes;
+
+    bytes = nread;
+    if (nread > 0)
+      for (bytes = 0, k = 0; k < (size_t) nread; k++)
+        bytes += msgs[k].msg_len;
+    UV__IO_STATS_READ(handle, bytes);
+  }
+#endif
+
+  if (nread == -1) {
+    if (errno == ENOSYS) {
+      handle->flags &= ~UV_HANDLE_UDP_RECVMMSG;
+      return UV_ENOSYS;
+    }
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      handle->recv_cb(handle, 0, buf, NULL, 0);
+    else
+      handle->recv_cb(handle, UV__ERR(errno), buf, NULL, 0);
+
+    return -1;
+  }
+
+  /* recv_cb里可能会uv_udp_recv_stop()或者uv_close()，剩下的报文就丢掉，
+   * 但整块buf总要交还回去
+   */
+  recv_cb = handle->recv_cb;
+
+  for (k = 0;
+       k < (size_t) nread &&
+       handle->io_watcher.fd != -1 &&
+       handle->recv_cb != NULL;
+       k++) {
+    flags = UV_UDP_MMSG_CHUNK |
+            uv__udp_recv_cmsg(handle, &msgs[k].msg_hdr, &info);
+
+    if (msgs[k].msg_hdr.msg_namelen == 0)
+      addr = NULL;
+    else
+      addr = (const struct sockaddr*) &peers[k];
+
+    chunk = uv_buf_init(iov[k].iov_base, iov[k].iov_len);
+    info.addr = addr;
+    handle->recv_info = &info;
+    handle->recv_cb(handle, msgs[k].msg_len, &chunk, addr, flags);
+    handle->recv_info = NULL;
+  }
+
+  recv_cb(handle, 0, buf, NULL, 0);
+
+  return nread;
+}
+#endif
+
+
 static void uv__udp_recvmsg(uv_udp_t* handle) {
   struct sockaddr_storage peer;
+  struct uv__rate_limits* limits;
+  uv__udp_recv_ctl_t ctl;
+  uv_udp_recv_info_t info;
   struct msghdr h;
+  size_t suggested_size;
   ssize_t nread;
   uv_buf_t buf;
   int flags;
@@ -159,6 +538,12 @@ static void uv__udp_recvmsg(uv_udp_t* handle) {
   assert(handle->recv_cb != NULL);
   assert(handle->alloc_cb != NULL);
 
+  suggested_size = 64 * 1024;
+#if defined(__linux__)
+  if (handle->flags & UV_HANDLE_UDP_RECVMMSG)
+    suggested_size = UV__MMSG_MAXWIDTH * UV__UDP_DGRAM_MAXSIZE;
+#endif
+
   /* Prevent loop starvation when the data comes in as fast as (or faster than)
    * we can read it. XXX Need to rearm fd if we switch to edge-triggered I/O.
    */
@@ -166,25 +551,50 @@ static void uv__udp_recvmsg(uv_udp_t* handle) {
 
   memset(&h, 0, sizeof(h));
   h.msg_name = &peer;
+  limits = handle->rate_limit;
+  if (limits != NULL && limits->in.limit == NULL)
+    limits = NULL;
 
   do {
+    /* 没有令牌时停掉POLLIN，报文留在socket的接收缓冲区里 */
+    if (limits != NULL && uv__rate_limit_quota(&limits->in) == 0)
+      return;
+
     buf = uv_buf_init(NULL, 0);
-    handle->alloc_cb((uv_handle_t*) handle, 64 * 1024, &buf);
+    handle->alloc_cb((uv_handle_t*) handle, suggested_size, &buf);
     if (buf.base == NULL || buf.len == 0) {
       handle->recv_cb(handle, UV_ENOBUFS, &buf, NULL, 0);
       return;
     }
     assert(buf.base != NULL);
 
+#if defined(__linux__)
+    /* 一次收一批报文没法按字节扣令牌 */
+    if ((handle->flags & UV_HANDLE_UDP_RECVMMSG) && limits == NULL) {
+      nread = uv__udp_recvmmsg(handle, &buf);
+      if (nread != UV_ENOSYS) {
+        /* 一批报文按个数计入count */
+        if (nread > 0)
+          count -= nread - 1;
+        continue;
+      }
+    }
+#endif
+
     h.msg_namelen = sizeof(peer);
     h.msg_iov = (void*) &buf;
     h.msg_iovlen = 1;
+    uv__udp_recv_ctl(handle, &h, &ctl);
 
     do {
       nread = recvmsg(handle->io_watcher.fd, &h, 0);
     }
     while (nread == -1 && errno == EINTR);
 
+    UV__IO_STATS_READ(handle, nread);
+    if (nread > 0 && limits != NULL)
+      uv__rate_limit_consume(&limits->in, nread);
+
     if (nread == -1) {
       if (errno == EAGAIN || errno == EWOULDBLOCK)
         handle->recv_cb(handle, 0, &buf, NULL, 0);
@@ -198,11 +608,11 @@ static void uv__udp_recvmsg(uv_udp_t* handle) {
       else
         addr = (const struct sockaddr*) &peer;
 
-      flags = 0;
-      if (h.msg_flags & MSG_TRUNC)
-        flags |= UV_UDP_PARTIAL;
-
+      flags = uv__udp_recv_cmsg(handle, &h, &info);
+      info.addr = addr;
+      handle->recv_info = &info;
       handle->recv_cb(handle, nread, &buf, addr, flags);
+      handle->recv_info = NULL;
     }
   }
   /* recv_cb callback may decide to pause or close the handle */
@@ -213,38 +623,271 @@ static void uv__udp_recvmsg(uv_udp_t* handle) {
 }
 
 
+/* 报文已经交给内核（或者出错了），从写队列移到write_completed_queue，
+ * 等待过的请求计入uv_io_stats()的write_queue_time
+ */
+static void uv__udp_send_dequeue(uv_udp_t* handle, uv_udp_send_t* req) {
+  QUEUE_REMOVE(&req->queue);
+
+  /* 零拷贝发出去的报文内核还在用，要等错误队列里的完成通知。内核给每次
+   * 成功的MSG_ZEROCOPY发送分配一个递增的序号
+   */
+  if (req->zerocopy && req->status >= 0) {
+    req->zerocopy_seq = handle->zerocopy_next++;
+    QUEUE_INSERT_TAIL(&handle->zerocopy_queue, &req->queue);
+    uv__io_start(handle->loop, &handle->io_watcher, UV__POLLPRI);
+  } else {
+    QUEUE_INSERT_TAIL(&handle->write_completed_queue, &req->queue);
+  }
+
+#if !defined(UV_DISABLE_IO_STATS)
+  if (req->queued_time != 0) {
+    handle->io_stats.write_queued++;
+    handle->io_stats.write_queue_time +=
+        uv__hrtime(UV_CLOCK_PRECISE) - req->queued_time;
+  }
+#endif
+}
+
+
+/* 按请求填好msghdr。uv_udp_send_gso()发出的请求带上UDP_SEGMENT，内核会把
+ * 这一个大buf按段大小切成多个报文发出去
+ */
+static void uv__udp_prep_msg(uv_udp_send_t* req,
+                             struct msghdr* h,
+                             uv__udp_send_ctl_t* ctl) {
+  struct cmsghdr* cm;
+  size_t len;
+
+  memset(h, 0, sizeof(*h));
+  if (req->addr.ss_family != AF_UNSPEC) {
+    h->msg_name = &req->addr;
+    h->msg_namelen = req->addr.ss_family == AF_INET6 ?
+      sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+  }
+  h->msg_iov = (struct iovec*) req->bufs;
+  h->msg_iovlen = req->nbufs;
+
+  if (req->gso_size == 0 &&
+      req->txtime == 0 &&
+      req->src.sin6_family == AF_UNSPEC)
+    return;
+
+  memset(ctl, 0, sizeof(*ctl));
+  h->msg_control = ctl->buf;
+  h->msg_controllen = sizeof(ctl->buf);
+  cm = CMSG_FIRSTHDR(h);
+  len = 0;
+
+#ifdef UDP_SEGMENT
+  if (req->gso_size != 0) {
+    uint16_t size;
+    size = req->gso_size;
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(size));
+    memcpy(CMSG_DATA(cm), &size, sizeof(size));
+    len += CMSG_SPACE(sizeof(size));
+    cm = CMSG_NXTHDR(h, cm);
+  }
+#endif
+
+#if defined(__linux__)
+  if (req->txtime != 0) {
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_TXTIME;
+    cm->cmsg_len = CMSG_LEN(sizeof(req->txtime));
+    memcpy(CMSG_DATA(cm), &req->txtime, sizeof(req->txtime));
+    len += CMSG_SPACE(sizeof(req->txtime));
+    cm = CMSG_NXTHDR(h, cm);
+  }
+#endif
+
+  /* uv_udp_send_from()指定的源地址，IPv4用ipi_spec_dst，IPv6把
+   * sin6_scope_id当作出口网卡
+   */
+#ifdef IP_PKTINFO
+  if (req->src.sin6_family == AF_INET) {
+    struct in_pktinfo pi;
+    memset(&pi, 0, sizeof(pi));
+    pi.ipi_spec_dst = ((struct sockaddr_in*) &req->src)->sin_addr;
+    cm->cmsg_level = IPPROTO_IP;
+    cm->cmsg_type = IP_PKTINFO;
+    cm->cmsg_len = CMSG_LEN(sizeof(pi));
+    memcpy(CMSG_DATA(cm), &pi, sizeof(pi));
+    len += CMSG_SPACE(sizeof(pi));
+  }
+#endif
+#if defined(IPV6_RECVPKTINFO) && defined(IPV6_PKTINFO)
+  if (req->src.sin6_family == AF_INET6) {
+    struct in6_pktinfo pi6;
+    memset(&pi6, 0, sizeof(pi6));
+    pi6.ipi6_addr = req->src.sin6_addr;
+    pi6.ipi6_ifindex = req->src.sin6_scope_id;
+    cm->cmsg_level = IPPROTO_IPV6;
+    cm->cmsg_type = IPV6_PKTINFO;
+    cm->cmsg_len = CMSG_LEN(sizeof(pi6));
+    memcpy(CMSG_DATA(cm), &pi6, sizeof(pi6));
+    len += CMSG_SPACE(sizeof(pi6));
+  }
+#endif
+
+  h->msg_controllen = len;
+  if (len == 0)
+    h->msg_control = NULL;
+}
+
+
+#if defined(__linux__)
+/* 一次sendmmsg()把写队列前面最多UV__MMSG_MAXWIDTH个请求发出去，发完的
+ * 请求移到write_completed_queue，直到写队列空了或者socket写不动。内核不
+ * 支持sendmmsg()时返回UV_ENOSYS，由调用方改回逐个sendmsg()
+ */
+static int uv__udp_sendmmsg(uv_udp_t* handle) {
+  uv__udp_send_ctl_t ctl[UV__MMSG_MAXWIDTH];
+  struct uv__mmsghdr h[UV__MMSG_MAXWIDTH];
+  uv_udp_send_t* req;
+  QUEUE* q;
+  unsigned int pkts;
+  ssize_t bytes;
+  int zerocopy;
+  int npkts;
+  int i;
+
+  while (!QUEUE_EMPTY(&handle->write_queue)) {
+    /* flags对整批报文生效，一批里只放零拷贝或者只放普通的请求 */
+    q = QUEUE_HEAD(&handle->write_queue);
+    zerocopy = QUEUE_DATA(q, uv_udp_send_t, queue)->zerocopy;
+
+    pkts = 0;
+    QUEUE_FOREACH(q, &handle->write_queue) {
+      if (pkts == ARRAY_SIZE(h))
+        break;
+
+      req = QUEUE_DATA(q, uv_udp_send_t, queue);
+      if (req->zerocopy != zerocopy)
+        break;
+
+      uv__udp_prep_msg(req, &h[pkts].msg_hdr, &ctl[pkts]);
+      h[pkts].msg_len = 0;
+      pkts++;
+    }
+
+    do {
+      npkts = uv__sendmmsg(handle->io_watcher.fd,
+                           h,
+                           pkts,
+                           zerocopy ? MSG_ZEROCOPY : 0);
+    } while (npkts == -1 && errno == EINTR);
+
+    if (npkts == -1) {
+      if (errno == ENOSYS)
+        return UV_ENOSYS;
+
+      UV__IO_STATS_WRITE(handle, -1);
+
+      /* 钉住的页超过了optmem_max的限制，这个请求先退回普通的拷贝 */
+      if (errno == ENOBUFS && zerocopy) {
+        q = QUEUE_HEAD(&handle->write_queue);
+        QUEUE_DATA(q, uv_udp_send_t, queue)->zerocopy = 0;
+        continue;
+      }
+
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+        uv__sockbuf_grow(handle->loop,
+                         &handle->sockbuf_tune,
+                         handle->io_watcher.fd,
+                         SO_SNDBUF);
+        return 0;
+      }
+
+      /* 只有第一个报文出错时sendmmsg()才返回-1，把它单独结束掉，
+       * 后面的请求接着发
+       */
+      q = QUEUE_HEAD(&handle->write_queue);
+      req = QUEUE_DATA(q, uv_udp_send_t, queue);
+      req->status = UV__ERR(errno);
+      uv__udp_send_dequeue(handle, req);
+      uv__io_feed(handle->loop, &handle->io_watcher);
+      continue;
+    }
+
+    bytes = 0;
+    for (i = 0; i < npkts; i++) {
+      q = QUEUE_HEAD(&handle->write_queue);
+      req = QUEUE_DATA(q, uv_udp_send_t, queue);
+      req->status = h[i].msg_len;
+      bytes += h[i].msg_len;
+      uv__udp_send_dequeue(handle, req);
+    }
+    UV__IO_STATS_WRITE(handle, bytes);
+
+    uv__io_feed(handle->loop, &handle->io_watcher);
+  }
+
+  return 0;
+}
+#endif
+
+
 static void uv__udp_sendmsg(uv_udp_t* handle) {
+  struct uv__rate_limits* limits;
+  uv__udp_send_ctl_t ctl;
   uv_udp_send_t* req;
   QUEUE* q;
   struct msghdr h;
   ssize_t size;
+#if defined(__linux__)
+  static int no_sendmmsg;
+#endif
+
+  limits = handle->rate_limit;
+  if (limits != NULL && limits->out.limit == NULL)
+    limits = NULL;
+
+#if defined(__linux__)
+  /* 限速时逐个发，每个报文发之前看一眼令牌 */
+  if (!no_sendmmsg && limits == NULL) {
+    if (uv__udp_sendmmsg(handle) != UV_ENOSYS)
+      return;
+    no_sendmmsg = 1;
+  }
+#endif
 
   while (!QUEUE_EMPTY(&handle->write_queue)) {
+    if (limits != NULL && uv__rate_limit_quota(&limits->out) == 0)
+      return;
+
     q = QUEUE_HEAD(&handle->write_queue);
     assert(q != NULL);
 
     req = QUEUE_DATA(q, uv_udp_send_t, queue);
     assert(req != NULL);
 
-    memset(&h, 0, sizeof h);
-    if (req->addr.ss_family == AF_UNSPEC) {
-      h.msg_name = NULL;
-      h.msg_namelen = 0;
-    } else {
-      h.msg_name = &req->addr;
-      h.msg_namelen = req->addr.ss_family == AF_INET6 ?
-        sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
-    }
-    h.msg_iov = (struct iovec*) req->bufs;
-    h.msg_iovlen = req->nbufs;
+    uv__udp_prep_msg(req, &h, &ctl);
 
     do {
-      size = sendmsg(handle->io_watcher.fd, &h, 0);
+      size = sendmsg(handle->io_watcher.fd,
+                     &h,
+                     req->zerocopy ? MSG_ZEROCOPY : 0);
     } while (size == -1 && errno == EINTR);
 
+    UV__IO_STATS_WRITE(handle, size);
+    if (size > 0 && limits != NULL)
+      uv__rate_limit_consume(&limits->out, size);
+
     if (size == -1) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+      if (errno == ENOBUFS && req->zerocopy) {
+        req->zerocopy = 0;
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+        uv__sockbuf_grow(handle->loop,
+                         &handle->sockbuf_tune,
+                         handle->io_watcher.fd,
+                         SO_SNDBUF);
         break;
+      }
     }
 
     req->status = (size == -1 ? UV__ERR(errno) : size);
@@ -254,8 +897,7 @@ static void uv__udp_sendmsg(uv_udp_t* handle) {
      * why we don't handle partial writes. Just pop the request
      * off the write queue and onto the completed queue, done.
      */
-    QUEUE_REMOVE(&req->queue);
-    QUEUE_INSERT_TAIL(&handle->write_completed_queue, &req->queue);
+    uv__udp_send_dequeue(handle, req);
     uv__io_feed(handle->loop, &handle->io_watcher);
   }
 }
@@ -268,6 +910,7 @@ static void uv__udp_sendmsg(uv_udp_t* handle) {
  * are different from the BSDs: it _shares_ the port rather than steal it
  * from the current listener.  While useful, it's not something we can emulate
  * on other platforms so we don't enable it.
+ * 要Linux的端口共享语义就显式地用UV_UDP_REUSEPORT。
  */
 static int uv__set_reuse(int fd) {
   int yes;
@@ -295,7 +938,7 @@ int uv__udp_bind(uv_udp_t* handle,
   int fd;
 
   /* Check for bad flags. */
-  if (flags & ~(UV_UDP_IPV6ONLY | UV_UDP_REUSEADDR))
+  if (flags & ~(UV_UDP_IPV6ONLY | UV_UDP_REUSEADDR | UV_UDP_REUSEPORT))
     return UV_EINVAL;
 
   /* Cannot set IPv6-only mode on non-IPv6 socket. */
@@ -317,6 +960,17 @@ int uv__udp_bind(uv_udp_t* handle,
       return err;
   }
 
+  /* 和UV_UDP_REUSEADDR不同，Linux上这里要的就是端口共享的语义 */
+  if (flags & UV_UDP_REUSEPORT) {
+#ifdef SO_REUSEPORT
+    yes = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)))
+      return UV__ERR(errno);
+#else
+    return UV_ENOTSUP;
+#endif
+  }
+
   if (flags & UV_UDP_IPV6ONLY) {
 #ifdef IPV6_V6ONLY
     yes = 1;
@@ -432,6 +1086,149 @@ int uv__udp_disconnect(uv_udp_t* handle) {
 }
 
 
+/* 丢弃一个请求，它不再计入发送队列，下一轮循环里以UV_ENOBUFS完成 */
+static void uv__udp_send_drop(uv_udp_t* handle, uv_udp_send_t* req) {
+  if (req->bufs != req->bufsml)
+    uv__loop_free(handle->loop, req->bufs);
+  req->bufs = req->bufsml;
+  req->nbufs = 0;
+  req->dropped = 1;
+  req->status = UV_ENOBUFS;
+  QUEUE_INSERT_TAIL(&handle->write_completed_queue, &req->queue);
+  uv__io_feed(handle->loop, &handle->io_watcher);
+}
+
+
+/* 按uv_udp_set_send_queue_limit()的限制给size字节的新请求腾地方，放不下时
+ * 返回UV_ENOBUFS
+ */
+static int uv__udp_send_admit(uv_udp_t* handle, size_t size) {
+  uv_udp_send_t* req;
+  QUEUE* q;
+
+  for (;;) {
+    if ((handle->send_queue_max_count == 0 ||
+         handle->send_queue_count < handle->send_queue_max_count) &&
+        (handle->send_queue_max_size == 0 ||
+         handle->send_queue_size + size <= handle->send_queue_max_size)) {
+      return 0;
+    }
+
+    /* 写队列里的请求都还没有发出去，已经完成的只能等回调 */
+    if (handle->send_queue_policy != UV_UDP_QUEUE_DROP_OLDEST ||
+        QUEUE_EMPTY(&handle->write_queue)) {
+      return UV_ENOBUFS;
+    }
+
+    q = QUEUE_HEAD(&handle->write_queue);
+    QUEUE_REMOVE(q);
+    req = QUEUE_DATA(q, uv_udp_send_t, queue);
+    handle->send_queue_size -= uv__count_bufs(req->bufs, req->nbufs);
+    handle->send_queue_count--;
+    uv__udp_send_drop(handle, req);
+  }
+}
+
+
+/* 把请求放进写队列，不立即发送 */
+static int uv__udp_send_queue(uv_udp_send_t* req,
+                              uv_udp_t* handle,
+                              const uv_buf_t bufs[],
+                              unsigned int nbufs,
+                              const struct sockaddr* addr,
+                              unsigned int addrlen,
+                              uv_udp_send_cb send_cb) {
+  int err;
+
+  assert(nbufs > 0);
+
+  err = uv__udp_send_admit(handle, uv__count_bufs(bufs, nbufs));
+  if (err != 0 && handle->send_queue_policy == UV_UDP_QUEUE_FAIL)
+    return err;
+
+  uv__req_init(handle->loop, req, UV_UDP_SEND);
+  assert(addrlen <= sizeof(req->addr));
+  if (addr == NULL)
+    req->addr.ss_family = AF_UNSPEC;
+  else
+    memcpy(&req->addr, addr, addrlen);
+  req->send_cb = send_cb;
+  req->handle = handle;
+  req->nbufs = nbufs;
+  req->gso_size = 0;
+  req->src.sin6_family = AF_UNSPEC;
+  req->queued_time = 0;
+  req->dropped = 0;
+  req->zerocopy = 0;
+  req->txtime = 0;
+  req->iobuf_owners = NULL;
+  req->iobuf_nowners = 0;
+
+  /* 放不下的新请求不用拷贝bufs */
+  if (err != 0) {
+    uv__handle_start(handle);
+    uv__udp_send_drop(handle, req);
+    return 0;
+  }
+
+  req->bufs = req->bufsml;
+  if (nbufs > ARRAY_SIZE(req->bufsml))
+    req->bufs = uv__loop_malloc(handle->loop,
+                                UV_MEM_UDP_SEND,
+                                nbufs * sizeof(bufs[0]));
+
+  if (req->bufs == NULL) {
+    uv__req_unregister(handle->loop, req);
+    return UV_ENOMEM;
+  }
+
+  memcpy(req->bufs, bufs, nbufs * sizeof(bufs[0]));
+  handle->send_queue_size += uv__count_bufs(req->bufs, req->nbufs);
+  handle->send_queue_count++;
+  QUEUE_INSERT_TAIL(&handle->write_queue, &req->queue);
+  uv__handle_start(handle);
+
+  return 0;
+}
+
+
+static void uv__udp_send_flush(uv_udp_t* handle, int empty_queue) {
+  if (empty_queue && !(handle->flags & UV_HANDLE_UDP_PROCESSING)) {
+    uv__udp_sendmsg(handle);
+
+    /* `uv__udp_sendmsg` may not be able to do non-blocking write straight
+     * away. In such cases the `io_watcher` has to be queued for asynchronous
+     * write.
+     */
+    if (!QUEUE_EMPTY(&handle->write_queue))
+      uv__io_start(handle->loop, &handle->io_watcher, POLLOUT);
+  } else {
+    uv__io_start(handle->loop, &handle->io_watcher, POLLOUT);
+  }
+
+#if !defined(UV_DISABLE_IO_STATS)
+  /* 没发出去的新请求都在队尾，之前排队的已经记过时间了 */
+  if (!QUEUE_EMPTY(&handle->write_queue)) {
+    uv_udp_send_t* req;
+    uint64_t now;
+    QUEUE* q;
+
+    now = 0;
+    for (q = QUEUE_PREV(&handle->write_queue);
+         q != &handle->write_queue;
+         q = QUEUE_PREV(q)) {
+      req = QUEUE_DATA(q, uv_udp_send_t, queue);
+      if (req->queued_time != 0)
+        break;
+      if (now == 0)
+        now = uv__hrtime(UV_CLOCK_PRECISE);
+      req->queued_time = now;
+    }
+  }
+#endif
+}
+
+
 int uv__udp_send(uv_udp_send_t* req,
                  uv_udp_t* handle,
                  const uv_buf_t bufs[],
@@ -439,10 +1236,120 @@ int uv__udp_send(uv_udp_send_t* req,
                  const struct sockaddr* addr,
                  unsigned int addrlen,
                  uv_udp_send_cb send_cb) {
+  return uv__udp_send_ex(req,
+                         handle,
+                         bufs,
+                         nbufs,
+                         addr,
+                         addrlen,
+                         0,
+                         NULL,
+                         0,
+                         0,
+                         send_cb);
+}
+
+
+/* 已连接的handle发普通报文时直接writev()，不带地址也不拷贝bufs。
+ * socket写不动时返回UV_EAGAIN，由调用方改走写队列；发出去了（或者出错了）
+ * 就把req直接放进write_completed_queue，回调仍然在下一轮循环里调用。
+ */
+static int uv__udp_send_connected(uv_udp_send_t* req,
+                                  uv_udp_t* handle,
+                                  const uv_buf_t bufs[],
+                                  unsigned int nbufs,
+                                  uv_udp_send_cb send_cb) {
+  ssize_t size;
+
+  do {
+    size = writev(handle->io_watcher.fd, (const struct iovec*) bufs, nbufs);
+  } while (size == -1 && errno == EINTR);
+
+  UV__IO_STATS_WRITE(handle, size);
+
+  if (size == -1)
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+      return UV_EAGAIN;
+
+  uv__req_init(handle->loop, req, UV_UDP_SEND);
+  req->addr.ss_family = AF_UNSPEC;
+  req->send_cb = send_cb;
+  req->handle = handle;
+  req->nbufs = 0;
+  req->bufs = req->bufsml;
+  req->gso_size = 0;
+  req->src.sin6_family = AF_UNSPEC;
+  req->dropped = 0;
+  req->zerocopy = 0;
+  req->txtime = 0;
+  req->iobuf_owners = NULL;
+  req->iobuf_nowners = 0;
+  req->status = (size == -1 ? UV__ERR(errno) : size);
+
+  handle->send_queue_count++;
+  QUEUE_INSERT_TAIL(&handle->write_completed_queue, &req->queue);
+  uv__handle_start(handle);
+  uv__io_feed(handle->loop, &handle->io_watcher);
+
+  return 0;
+}
+
+
+/* 平台能不能指定这个源地址 */
+static int uv__udp_check_src(const struct sockaddr* src) {
+  switch (src->sa_family) {
+  case AF_INET:
+#ifdef IP_PKTINFO
+    return 0;
+#else
+    return UV_ENOTSUP;
+#endif
+  case AF_INET6:
+#if defined(IPV6_RECVPKTINFO) && defined(IPV6_PKTINFO)
+    return 0;
+#else
+    return UV_ENOTSUP;
+#endif
+  default:
+    return UV_EINVAL;
+  }
+}
+
+
+/* gso_size不为0时内核把bufs按gso_size切成多个报文，最后一个可以短一些；
+ * src不为NULL时用它作为源地址
+ */
+int uv__udp_send_ex(uv_udp_send_t* req,
+                    uv_udp_t* handle,
+                    const uv_buf_t bufs[],
+                    unsigned int nbufs,
+                    const struct sockaddr* addr,
+                    unsigned int addrlen,
+                    unsigned int gso_size,
+                    const struct sockaddr* src,
+                    int zerocopy,
+                    uint64_t txtime,
+                    uv_udp_send_cb send_cb) {
   int err;
   int empty_queue;
+#if defined(__linux__)
+  int on;
+#endif
 
-  assert(nbufs > 0);
+#ifndef UDP_SEGMENT
+  if (gso_size != 0)
+    return UV_ENOTSUP;
+#endif
+
+  if (src != NULL) {
+    err = uv__udp_check_src(src);
+    if (err)
+      return err;
+  }
+
+  /* 没有打开SO_TXTIME时内核拒绝SCM_TXTIME，在排队之前就报错 */
+  if (txtime != 0 && !(handle->flags & UV_HANDLE_UDP_TXTIME))
+    return UV_EINVAL;
 
   if (addr) {
     err = uv__udp_maybe_deferred_bind(handle, addr->sa_family, 0);
@@ -450,51 +1357,105 @@ int uv__udp_send(uv_udp_send_t* req,
       return err;
   }
 
+  /* SO_ZEROCOPY要4.14以上的内核，设置失败就当普通发送。没有数据的报文内核
+   * 不分配序号，也不会有完成通知
+   */
+#if defined(__linux__)
+  if (zerocopy && !(handle->flags & UV_HANDLE_ZEROCOPY)) {
+    on = 1;
+    if (setsockopt(handle->io_watcher.fd,
+                   SOL_SOCKET,
+                   SO_ZEROCOPY,
+                   &on,
+                   sizeof(on)) == 0)
+      handle->flags |= UV_HANDLE_ZEROCOPY;
+  }
+  zerocopy = zerocopy &&
+             (handle->flags & UV_HANDLE_ZEROCOPY) &&
+             uv__count_bufs(bufs, nbufs) != 0;
+#else
+  zerocopy = 0;
+#endif
+
   /* It's legal for send_queue_count > 0 even when the write_queue is empty;
    * it means there are error-state requests in the write_completed_queue that
    * will touch up send_queue_size/count later.
    */
   empty_queue = (handle->send_queue_count == 0);
 
-  uv__req_init(handle->loop, req, UV_UDP_SEND);
-  assert(addrlen <= sizeof(req->addr));
-  if (addr == NULL)
-    req->addr.ss_family = AF_UNSPEC;
-  else
-    memcpy(&req->addr, addr, addrlen);
-  req->send_cb = send_cb;
-  req->handle = handle;
-  req->nbufs = nbufs;
+  if (addr == NULL &&
+      !zerocopy &&
+      txtime == 0 &&
+      empty_queue &&
+      gso_size == 0 &&
+      src == NULL &&
+      nbufs <= (unsigned int) uv__getiovmax() &&
+      !(handle->flags & UV_HANDLE_UDP_PROCESSING)) {
+    if (uv__udp_send_connected(req, handle, bufs, nbufs, send_cb) == 0)
+      return 0;
+  }
 
-  req->bufs = req->bufsml;
-  if (nbufs > ARRAY_SIZE(req->bufsml))
-    req->bufs = uv__malloc(nbufs * sizeof(bufs[0]));
+  err = uv__udp_send_queue(req, handle, bufs, nbufs, addr, addrlen, send_cb);
+  if (err)
+    return err;
 
-  if (req->bufs == NULL) {
-    uv__req_unregister(handle->loop, req);
-    return UV_ENOMEM;
-  }
+  /* 被丢弃的请求已经在完成队列里了 */
+  if (!req->dropped)
+    req->zerocopy = zerocopy;
+  req->gso_size = gso_size;
+  req->txtime = txtime;
+  if (src != NULL)
+    memcpy(&req->src,
+           src,
+           src->sa_family == AF_INET6 ?
+             sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+  uv__udp_send_flush(handle, empty_queue);
+  uv__udp_watermarks(handle);
+  return 0;
+}
 
-  memcpy(req->bufs, bufs, nbufs * sizeof(bufs[0]));
-  handle->send_queue_size += uv__count_bufs(req->bufs, req->nbufs);
-  handle->send_queue_count++;
-  QUEUE_INSERT_TAIL(&handle->write_queue, &req->queue);
-  uv__handle_start(handle);
 
-  if (empty_queue && !(handle->flags & UV_HANDLE_UDP_PROCESSING)) {
-    uv__udp_sendmsg(handle);
+/* 每个bufs[i]是一个报文，全部排进写队列之后才发送，Linux上一次sendmmsg()
+ * 就能发出去一批。返回排进队列的报文个数
+ */
+int uv__udp_send_batch(uv_udp_send_t reqs[],
+                       uv_udp_t* handle,
+                       const uv_buf_t bufs[],
+                       unsigned int count,
+                       const struct sockaddr* addr,
+                       unsigned int addrlen,
+                       uv_udp_send_cb send_cb) {
+  unsigned int i;
+  int empty_queue;
+  int err;
 
-    /* `uv__udp_sendmsg` may not be able to do non-blocking write straight
-     * away. In such cases the `io_watcher` has to be queued for asynchronous
-     * write.
-     */
-    if (!QUEUE_EMPTY(&handle->write_queue))
-      uv__io_start(handle->loop, &handle->io_watcher, POLLOUT);
-  } else {
-    uv__io_start(handle->loop, &handle->io_watcher, POLLOUT);
+  if (addr) {
+    err = uv__udp_maybe_deferred_bind(handle, addr->sa_family, 0);
+    if (err)
+      return err;
   }
 
-  return 0;
+  empty_queue = (handle->send_queue_count == 0);
+
+  err = 0;
+  for (i = 0; i < count; i++) {
+    err = uv__udp_send_queue(&reqs[i],
+                             handle,
+                             &bufs[i],
+                             1,
+                             addr,
+                             addrlen,
+                             send_cb);
+    if (err)
+      break;
+  }
+
+  if (i == 0)
+    return err;
+
+  uv__udp_send_flush(handle, empty_queue);
+  uv__udp_watermarks(handle);
+  return i;
 }
 
 
@@ -503,6 +1464,7 @@ int uv__udp_try_send(uv_udp_t* handle,
                      unsigned int nbufs,
                      const struct sockaddr* addr,
                      unsigned int addrlen) {
+  struct uv__rate_limits* limits;
   int err;
   struct msghdr h;
   ssize_t size;
@@ -513,6 +1475,10 @@ int uv__udp_try_send(uv_udp_t* handle,
   if (handle->send_queue_count != 0)
     return UV_EAGAIN;
 
+  limits = handle->rate_limit;
+  if (limits != NULL && uv__rate_limit_avail(&limits->out) == 0)
+    return UV_EAGAIN;
+
   if (addr) {
     err = uv__udp_maybe_deferred_bind(handle, addr->sa_family, 0);
     if (err)
@@ -531,6 +1497,8 @@ int uv__udp_try_send(uv_udp_t* handle,
     size = sendmsg(handle->io_watcher.fd, &h, 0);
   } while (size == -1 && errno == EINTR);
 
+  UV__IO_STATS_WRITE(handle, size);
+
   if (size == -1) {
     if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
       return UV_EAGAIN;
@@ -538,10 +1506,96 @@ int uv__udp_try_send(uv_udp_t* handle,
       return UV__ERR(errno);
   }
 
+  if (limits != NULL)
+    uv__rate_limit_consume(&limits->out, size);
+
   return size;
 }
 
 
+/* 每个报文一个buf（bufs[i]），Linux上一次sendmmsg()最多发UV__MMSG_MAXWIDTH
+ * 个，其它平台逐个uv__udp_try_send()。返回发出去的报文个数。
+ */
+int uv__udp_try_send_batch(uv_udp_t* handle,
+                           const uv_buf_t bufs[],
+                           unsigned int count,
+                           const struct sockaddr* addr,
+                           unsigned int addrlen) {
+  unsigned int i;
+  int err;
+#if defined(__linux__)
+  struct uv__mmsghdr h[UV__MMSG_MAXWIDTH];
+  int npkts;
+#endif
+
+  assert(count > 0);
+
+  /* already sending a message */
+  if (handle->send_queue_count != 0)
+    return UV_EAGAIN;
+
+  if (addr) {
+    err = uv__udp_maybe_deferred_bind(handle, addr->sa_family, 0);
+    if (err)
+      return err;
+  } else {
+    assert(handle->flags & UV_HANDLE_UDP_CONNECTED);
+  }
+
+#if defined(__linux__)
+  /* 限速时逐个uv__udp_try_send() */
+  if (handle->rate_limit != NULL &&
+      ((struct uv__rate_limits*) handle->rate_limit)->out.limit != NULL)
+    goto fallback;
+
+  if (count > ARRAY_SIZE(h))
+    count = ARRAY_SIZE(h);
+
+  memset(h, 0, count * sizeof(h[0]));
+  for (i = 0; i < count; i++) {
+    h[i].msg_hdr.msg_name = (struct sockaddr*) addr;
+    h[i].msg_hdr.msg_namelen = addrlen;
+    h[i].msg_hdr.msg_iov = (struct iovec*) &bufs[i];
+    h[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  do {
+    npkts = uv__sendmmsg(handle->io_watcher.fd, h, count, 0);
+  } while (npkts == -1 && errno == EINTR);
+
+  if (npkts != -1) {
+#if !defined(UV_DISABLE_IO_STATS)
+    ssize_t bytes;
+
+    for (bytes = 0, i = 0; i < (unsigned int) npkts; i++)
+      bytes += h[i].msg_len;
+    UV__IO_STATS_WRITE(handle, bytes);
+#endif
+    return npkts;
+  }
+
+  if (errno != ENOSYS)
+    UV__IO_STATS_WRITE(handle, -1);
+
+  if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+    return UV_EAGAIN;
+
+  if (errno != ENOSYS)
+    return UV__ERR(errno);
+
+fallback:
+#endif
+
+  for (i = 0; i < count; i++) {
+    err = uv__udp_try_send(handle, &bufs[i], 1, addr, addrlen);
+    if (err < 0)
+      return i > 0 ? (int) i : err;
+  }
+
+  return i;
+}
+
+
 static int uv__udp_set_membership4(uv_udp_t* handle,
                                    const struct sockaddr_in* multicast_addr,
                                    const char* interface_addr,
@@ -642,7 +1696,7 @@ int uv_udp_init_ex(uv_loop_t* loop, uv_udp_t* handle, unsigned int flags) {
   if (domain != AF_INET && domain != AF_INET6 && domain != AF_UNSPEC)
     return UV_EINVAL;
 
-  if (flags & ~0xFF)
+  if (flags & ~0xFF & ~UV_UDP_RECVMMSG)
     return UV_EINVAL;
 
   if (domain != AF_UNSPEC) {
@@ -656,17 +1710,105 @@ int uv_udp_init_ex(uv_loop_t* loop, uv_udp_t* handle, unsigned int flags) {
 
   uv__handle_init(loop, (uv_handle_t*)handle, UV_UDP);
   handle->alloc_cb = NULL;
+  handle->buf_pool = NULL;
   handle->recv_cb = NULL;
   handle->send_queue_size = 0;
   handle->send_queue_count = 0;
   uv__io_init(&handle->io_watcher, uv__udp_io, fd);
   QUEUE_INIT(&handle->write_queue);
   QUEUE_INIT(&handle->write_completed_queue);
+  QUEUE_INIT(&handle->zerocopy_queue);
+  handle->zerocopy_next = 0;
+
+  handle->gro_segment_size = 0;
+  handle->recv_ex_cb = NULL;
+  handle->recv_info = NULL;
+  handle->recv_info_flags = 0;
+  memset(&handle->io_stats, 0, sizeof(handle->io_stats));
+  handle->send_queue_max_size = 0;
+  handle->send_queue_max_count = 0;
+  handle->send_queue_policy = UV_UDP_QUEUE_FAIL;
+  handle->send_low_watermark = 0;
+  handle->send_high_watermark = 0;
+  handle->send_watermark_cb = NULL;
+  handle->send_above_high = 0;
+  memset(&handle->sockbuf_tune, 0, sizeof(handle->sockbuf_tune));
+  handle->rate_limit = NULL;
+  handle->recv_iobuf_cb = NULL;
+  handle->recv_iobuf_owner = NULL;
+
+  if (flags & UV_UDP_RECVMMSG)
+    handle->flags |= UV_HANDLE_UDP_RECVMMSG;
+
+  return 0;
+}
+
+
+int uv_udp_set_send_queue_limit(uv_udp_t* handle,
+                                size_t max_size,
+                                size_t max_count,
+                                uv_udp_queue_policy policy) {
+  if (policy != UV_UDP_QUEUE_FAIL &&
+      policy != UV_UDP_QUEUE_DROP_NEWEST &&
+      policy != UV_UDP_QUEUE_DROP_OLDEST) {
+    return UV_EINVAL;
+  }
+
+  handle->send_queue_max_size = max_size;
+  handle->send_queue_max_count = max_count;
+  handle->send_queue_policy = policy;
+  return 0;
+}
+
+
+/* send_queue_size越过高水位或者回落到低水位时通知用户 */
+static void uv__udp_watermarks(uv_udp_t* handle) {
+  if (handle->send_watermark_cb == NULL || uv__is_closing(handle))
+    return;
+
+  if (!handle->send_above_high) {
+    if (handle->send_queue_size > handle->send_high_watermark) {
+      handle->send_above_high = 1;
+      handle->send_watermark_cb(handle, 1);
+    }
+  } else if (handle->send_queue_size <= handle->send_low_watermark) {
+    handle->send_above_high = 0;
+    handle->send_watermark_cb(handle, 0);
+  }
+}
+
+
+int uv_udp_set_send_watermarks(uv_udp_t* handle,
+                               size_t low,
+                               size_t high,
+                               uv_udp_watermark_cb cb) {
+  if (cb != NULL && low > high)
+    return UV_EINVAL;
+
+  handle->send_low_watermark = low;
+  handle->send_high_watermark = high;
+  handle->send_watermark_cb = cb;
+  /* 下一次发送的时候按当前的队列长度重新判断 */
+  handle->send_above_high = 0;
 
   return 0;
 }
 
 
+int uv_udp_set_rate_limit(uv_udp_t* handle,
+                          uv_rate_limit_t* recv,
+                          uv_rate_limit_t* send) {
+  if (uv__is_closing(handle))
+    return UV_EINVAL;
+
+  return uv__rate_limits_set((uv_handle_t*) handle,
+                             &handle->rate_limit,
+                             &handle->io_watcher,
+                             recv,
+                             send);
+}
+
+
 int uv_udp_init(uv_loop_t* loop, uv_udp_t* handle) {
   return uv_udp_init_ex(loop, handle, AF_UNSPEC);
 }
@@ -778,6 +1920,154 @@ int uv_udp_set_broadcast(uv_udp_t* handle, int on) {
 }
 
 
+/* 设置SO_BUSY_POLL，参见uv_tcp_busy_poll() */
+int uv_udp_set_busy_poll(uv_udp_t* handle, int usec) {
+  if (usec < 0)
+    return UV_EINVAL;
+
+#ifdef SO_BUSY_POLL
+  if (setsockopt(handle->io_watcher.fd,
+                 SOL_SOCKET,
+                 SO_BUSY_POLL,
+                 &usec,
+                 sizeof(usec))) {
+    return UV__ERR(errno);
+  }
+
+  return 0;
+#else
+  return UV_ENOTSUP;
+#endif
+}
+
+
+/* 打开UDP_GRO，内核可以把同一条流上连续到达的报文合并成一个大报文交给
+ * recv_cb，flags里带UV_UDP_GRO，段大小用uv_udp_get_gro_segment_size()取
+ */
+int uv_udp_set_gro(uv_udp_t* handle, int on) {
+  if (handle->io_watcher.fd == -1)
+    return UV_EBADF;
+
+#ifdef UDP_GRO
+  on = !!on;
+  if (setsockopt(handle->io_watcher.fd, SOL_UDP, UDP_GRO, &on, sizeof(on)))
+    return UV__ERR(errno);
+
+  if (on)
+    handle->flags |= UV_HANDLE_UDP_GRO;
+  else
+    handle->flags &= ~UV_HANDLE_UDP_GRO;
+
+  return 0;
+#else
+  return UV_ENOTSUP;
+#endif
+}
+
+
+/* 打开SO_TXTIME，时钟和uv_hrtime()一样用CLOCK_MONOTONIC。错过了发送时间的
+ * 报文内核直接丢弃，不报告错误
+ */
+int uv_udp_set_txtime(uv_udp_t* handle, int on) {
+#if defined(__linux__)
+  struct {
+    int32_t clockid;
+    uint32_t flags;
+  } txtime;  /* struct sock_txtime */
+
+  if (handle->io_watcher.fd == -1)
+    return UV_EBADF;
+
+  /* 内核没有关闭SO_TXTIME的办法，不再带SCM_TXTIME就行了 */
+  if (!on) {
+    handle->flags &= ~UV_HANDLE_UDP_TXTIME;
+    return 0;
+  }
+
+  txtime.clockid = CLOCK_MONOTONIC;
+  txtime.flags = 0;
+  if (setsockopt(handle->io_watcher.fd,
+                 SOL_SOCKET,
+                 SO_TXTIME,
+                 &txtime,
+                 sizeof(txtime))) {
+    return UV__ERR(errno);
+  }
+
+  handle->flags |= UV_HANDLE_UDP_TXTIME;
+  return 0;
+#else
+  return UV_ENOTSUP;
+#endif
+}
+
+
+unsigned int uv_udp_get_gro_segment_size(const uv_udp_t* handle) {
+  return handle->gro_segment_size;
+}
+
+
+/* 设置SO_INCOMING_CPU。同一个UV_UDP_REUSEPORT组里的socket各自设成一个
+ * CPU，内核就优先把在那个CPU上收到的报文交给对应的socket
+ */
+int uv_udp_set_incoming_cpu(uv_udp_t* handle, int cpu) {
+  if (cpu < 0)
+    return UV_EINVAL;
+
+  if (handle->io_watcher.fd == -1)
+    return UV_EBADF;
+
+#ifdef SO_INCOMING_CPU
+  if (setsockopt(handle->io_watcher.fd,
+                 SOL_SOCKET,
+                 SO_INCOMING_CPU,
+                 &cpu,
+                 sizeof(cpu))) {
+    return UV__ERR(errno);
+  }
+
+  return 0;
+#else
+  return UV_ENOTSUP;
+#endif
+}
+
+
+/* 给UV_UDP_REUSEPORT组挂一个经典BPF程序，返回收到报文的CPU号作为组里
+ * socket的下标：组里第i个绑定的socket收第i个CPU上的报文，下标越界时内核
+ * 退回按哈希分配。对组里任意一个socket调用一次就行
+ */
+int uv_udp_reuseport_steer_cpu(uv_udp_t* handle) {
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+  struct sock_filter code[] = {
+    { BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+    { BPF_RET | BPF_A, 0, 0, 0 }
+  };
+  struct sock_fprog prog;
+
+  if (handle->io_watcher.fd == -1)
+    return UV_EBADF;
+
+  prog.len = ARRAY_SIZE(code);
+  prog.filter = code;
+  if (setsockopt(handle->io_watcher.fd,
+                 SOL_SOCKET,
+                 SO_ATTACH_REUSEPORT_CBPF,
+                 &prog,
+                 sizeof(prog))) {
+    return UV__ERR(errno);
+  }
+
+  return 0;
+#else
+  if (handle->io_watcher.fd == -1)
+    return UV_EBADF;
+
+  return UV_ENOTSUP;
+#endif
+}
+
+
 int uv_udp_set_ttl(uv_udp_t* handle, int ttl) {
   if (ttl < 1 || ttl > 255)
     return UV_EINVAL;
@@ -934,7 +2224,7 @@ int uv__udp_recv_start(uv_udp_t* handle,
   if (alloc_cb == NULL || recv_cb == NULL)
     return UV_EINVAL;
 
-  if (uv__io_active(&handle->io_watcher, POLLIN))
+  if (uv__udp_receiving(handle))
     return UV_EALREADY;  /* FIXME(bnoordhuis) Should be UV_EBUSY. */
 
   err = uv__udp_maybe_deferred_bind(handle, AF_INET, 0);
@@ -951,7 +2241,99 @@ int uv__udp_recv_start(uv_udp_t* handle,
 }
 
 
+/* 按info_flags打开接收信息相关的socket选项 */
+static int uv__udp_recv_info_opts(uv_udp_t* handle, unsigned int info_flags) {
+  int fd;
+  int on;
+
+  fd = handle->io_watcher.fd;
+  on = 1;
+
+  if (info_flags & UV_UDP_RECV_TIMESTAMP) {
+#ifdef SO_TIMESTAMPNS
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)))
+      return UV__ERR(errno);
+#else
+    return UV_ENOTSUP;
+#endif
+  }
+
+  if (info_flags & UV_UDP_RECV_PKTINFO) {
+    if (handle->flags & UV_HANDLE_IPV6) {
+#if defined(IPV6_RECVPKTINFO) && defined(IPV6_PKTINFO)
+      if (setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &on, sizeof(on)))
+        return UV__ERR(errno);
+#else
+      return UV_ENOTSUP;
+#endif
+    }
+    /* 双栈socket上收到的IPv4报文走IPv4的选项，IPv6 socket上失败了无所谓 */
+#ifdef IP_PKTINFO
+    if (setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on)) &&
+        !(handle->flags & UV_HANDLE_IPV6)) {
+      return UV__ERR(errno);
+    }
+#else
+    if (!(handle->flags & UV_HANDLE_IPV6))
+      return UV_ENOTSUP;
+#endif
+  }
+
+  if (info_flags & UV_UDP_RECV_TOS) {
+    if (handle->flags & UV_HANDLE_IPV6) {
+#ifdef IPV6_RECVTCLASS
+      if (setsockopt(fd, IPPROTO_IPV6, IPV6_RECVTCLASS, &on, sizeof(on)))
+        return UV__ERR(errno);
+#else
+      return UV_ENOTSUP;
+#endif
+    }
+#ifdef IP_RECVTOS
+    if (setsockopt(fd, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on)) &&
+        !(handle->flags & UV_HANDLE_IPV6)) {
+      return UV__ERR(errno);
+    }
+#else
+    if (!(handle->flags & UV_HANDLE_IPV6))
+      return UV_ENOTSUP;
+#endif
+  }
+
+  return 0;
+}
+
+
+int uv__udp_recv_start_ex(uv_udp_t* handle,
+                          uv_alloc_cb alloc_cb,
+                          uv_udp_recv_ex_cb recv_cb,
+                          unsigned int info_flags) {
+  int err;
+
+  if (uv__udp_receiving(handle))
+    return UV_EALREADY;
+
+  err = uv__udp_maybe_deferred_bind(handle, AF_INET, 0);
+  if (err)
+    return err;
+
+  err = uv__udp_recv_info_opts(handle, info_flags);
+  if (err)
+    return err;
+
+  err = uv__udp_recv_start(handle, alloc_cb, uv__udp_recv_ex);
+  if (err)
+    return err;
+
+  handle->recv_ex_cb = recv_cb;
+  handle->recv_info_flags |= info_flags;
+
+  return 0;
+}
+
+
 int uv__udp_recv_stop(uv_udp_t* handle) {
+  if (handle->rate_limit != NULL)
+    uv__rate_limit_cancel(&((struct uv__rate_limits*) handle->rate_limit)->in);
   uv__io_stop(handle->loop, &handle->io_watcher, POLLIN);
 
   if (!uv__io_active(&handle->io_watcher, POLLOUT))
@@ -959,6 +2341,7 @@ int uv__udp_recv_stop(uv_udp_t* handle) {
 
   handle->alloc_cb = NULL;
   handle->recv_cb = NULL;
+  handle->recv_ex_cb = NULL;
 
   return 0;
 }
@@ -0,0 +1,275 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "internal.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+/* 看门狗线程每隔threshold/4检查一次loop->watchdog->seq，最小1毫秒。
+ * 一个回调从第一次被看到到报告至少经过threshold，所以报告时回调实际已经执行了
+ * threshold到threshold + 2 * period之间。
+ */
+#define UV__WATCHDOG_MIN_PERIOD 1000000
+
+
+static void uv__watchdog_run(void* arg) {
+  struct uv__watchdog* wd;
+  uv_watchdog_info_t info;
+  uint64_t threshold;
+  uint64_t period;
+  uint64_t first;
+  uint64_t now;
+  unsigned int seq;
+  unsigned int last;
+  int reported;
+
+  wd = arg;
+  threshold = wd->threshold * 1000000;
+  period = threshold / 4;
+  if (period < UV__WATCHDOG_MIN_PERIOD)
+    period = UV__WATCHDOG_MIN_PERIOD;
+
+  first = 0;
+  last = 0;
+  reported = 0;
+
+  uv_mutex_lock(&wd->mutex);
+  while (wd->stop == 0) {
+    uv_cond_timedwait(&wd->cond, &wd->mutex, period);
+    if (wd->stop != 0)
+      break;
+
+    /* 偶数，loop不在回调里 */
+    seq = wd->seq;
+    uv__watchdog_rmb();
+    if ((seq & 1) == 0) {
+      last = seq;
+      continue;
+    }
+
+    /* 第一次看到这个回调，开始计时 */
+    now = uv_hrtime();
+    if (seq != last) {
+      last = seq;
+      first = now;
+      reported = 0;
+      continue;
+    }
+
+    /* 同一个回调只报告一次 */
+    if (reported != 0 || now - first < threshold)
+      continue;
+
+    info.type = wd->type;
+    info.handle = wd->handle;
+    info.cb = wd->cb;
+    info.elapsed = now - first;
+
+    /* 读字段的时候回调刚好返回了，这次的快照可能已经不对，不报告 */
+    uv__watchdog_rmb();
+    if (seq != wd->seq)
+      continue;
+
+    reported = 1;
+    uv_mutex_unlock(&wd->mutex);
+    wd->watchdog_cb(wd->loop, &info);
+    uv_mutex_lock(&wd->mutex);
+  }
+  uv_mutex_unlock(&wd->mutex);
+}
+
+
+/* 找出I/O watcher属于哪个handle。只认识libuv自己的watcher回调，其余的报告
+ * 为UV_UNKNOWN_HANDLE。只比较指针，信号处理函数里也可以调用
+ */
+static uv_handle_type uv__watchdog_io_handle(const uv_loop_t* loop,
+                                             uv__io_t* w,
+                                             void** phandle) {
+  uv_handle_type type;
+  void* handle;
+
+  type = UV_UNKNOWN_HANDLE;
+  handle = NULL;
+
+  if (w->cb == uv__stream_io || w->cb == uv__server_io) {
+    handle = container_of(w, uv_stream_t, io_watcher);
+    type = ((uv_stream_t*) handle)->type;
+  } else if (w->cb == uv__udp_io) {
+    handle = container_of(w, uv_udp_t, io_watcher);
+    type = UV_UDP;
+  } else if (w->cb == uv__poll_io) {
+    handle = container_of(w, uv_poll_t, io_watcher);
+    type = UV_POLL;
+  } else if (w == &loop->signal_io_watcher) {
+    type = UV_SIGNAL;
+  } else if (w == &loop->async_io_watcher) {
+    type = UV_ASYNC;
+  }
+#if defined(__linux__)
+  else if (w == &loop->inotify_read_watcher) {
+    type = UV_FS_EVENT;
+  } else if (w == &loop->hrtimer_watcher) {
+    type = UV_TIMER;
+  }
+#endif
+
+  *phandle = handle;
+  return type;
+}
+
+
+/* 派发I/O watcher回调前记录它属于哪个handle。async的watcher只是派发各个
+ * uv_async_t的回调，由它们自己记录
+ */
+void uv__watchdog_io(uv_loop_t* loop, uv__io_t* w) {
+  uv_handle_type type;
+  void* handle;
+
+  if (w == &loop->async_io_watcher)
+    return;
+
+  type = uv__watchdog_io_handle(loop, w, &handle);
+  uv__watchdog_note(loop, type, handle, w->cb);
+}
+
+
+int uv_loop_dispatch_info(const uv_loop_t* loop, uv_dispatch_info_t* info) {
+  unsigned int seq;
+  void* handle;
+  void* cb;
+  int type;
+
+  seq = loop->dispatch.seq;
+  if (seq & 1)
+    return UV_EAGAIN;
+
+  if (loop->dispatch.depth == 0)
+    return UV_ENOENT;
+
+  type = loop->dispatch.type;
+  handle = loop->dispatch.handle;
+  cb = loop->dispatch.cb;
+  if (seq != loop->dispatch.seq)
+    return UV_EAGAIN;
+
+  if (type == UV__DISPATCH_IO) {
+    info->type = uv__watchdog_io_handle(loop, handle, &info->handle);
+  } else {
+    info->type = (uv_handle_type) type;
+    info->handle = handle;
+  }
+  info->cb = cb;
+
+  return 0;
+}
+
+
+int uv_watchdog_start(uv_loop_t* loop, uv_watchdog_cb cb, uint64_t threshold) {
+  struct uv__watchdog* wd;
+  int err;
+
+  if (cb == NULL || threshold == 0)
+    return UV_EINVAL;
+
+  if (loop->watchdog != NULL)
+    return UV_EBUSY;
+
+  wd = uv__calloc(1, sizeof(*wd));
+  if (wd == NULL)
+    return UV_ENOMEM;
+
+  wd->loop = loop;
+  wd->watchdog_cb = cb;
+  wd->threshold = threshold;
+
+  err = uv_mutex_init(&wd->mutex);
+  if (err)
+    goto fail_mutex_init;
+
+  err = uv_cond_init(&wd->cond);
+  if (err)
+    goto fail_cond_init;
+
+  err = uv_thread_create(&wd->thread, uv__watchdog_run, wd);
+  if (err)
+    goto fail_thread_create;
+
+  loop->watchdog = wd;
+  return 0;
+
+fail_thread_create:
+  uv_cond_destroy(&wd->cond);
+
+fail_cond_init:
+  uv_mutex_destroy(&wd->mutex);
+
+fail_mutex_init:
+  uv__free(wd);
+  return err;
+}
+
+
+int uv_watchdog_stop(uv_loop_t* loop) {
+  struct uv__watchdog* wd;
+
+  wd = loop->watchdog;
+  if (wd == NULL)
+    return 0;
+
+  /* 先摘掉，回调里调用uv_watchdog_stop()时，uv__watchdog_leave()看到的是NULL */
+  loop->watchdog = NULL;
+
+  uv_mutex_lock(&wd->mutex);
+  wd->stop = 1;
+  uv_cond_signal(&wd->cond);
+  uv_mutex_unlock(&wd->mutex);
+
+  if (uv_thread_join(&wd->thread))
+    abort();
+
+  uv_cond_destroy(&wd->cond);
+  uv_mutex_destroy(&wd->mutex);
+  uv__free(wd);
+  return 0;
+}
+
+
+/* 子进程里只剩loop线程，看门狗线程没有了，它可能还持有mutex，所以不去销毁，
+ * 直接释放旧的并按原来的参数重新启动一个
+ */
+int uv__watchdog_fork(uv_loop_t* loop) {
+  struct uv__watchdog* wd;
+  uv_watchdog_cb cb;
+  uint64_t threshold;
+
+  wd = loop->watchdog;
+  if (wd == NULL)
+    return 0;
+
+  cb = wd->watchdog_cb;
+  threshold = wd->threshold;
+  loop->watchdog = NULL;
+  uv__free(wd);
+
+  return uv_watchdog_start(loop, cb, threshold);
+}
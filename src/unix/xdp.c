@@ -0,0 +1,370 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "internal.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+# include <net/if.h>
+# include <sys/mman.h>
+# include <linux/if_xdp.h>
+#endif
+
+#ifndef AF_XDP
+# define AF_XDP 44
+#endif
+
+#ifndef SOL_XDP
+# define SOL_XDP 283
+#endif
+
+/* UMEM切成UV__XDP_NUM_FRAMES个UV__XDP_FRAME_SIZE大小的帧，开始时全部放进
+ * fill ring，收到一帧、回调返回后再放回去
+ */
+#define UV__XDP_FRAME_SIZE 4096
+#define UV__XDP_NUM_FRAMES 2048
+#define UV__XDP_RING_SIZE UV__XDP_NUM_FRAMES
+
+#if defined(__linux__) && defined(XDP_MMAP_OFFSETS)
+
+/* 和内核共享的单生产者单消费者环 */
+typedef struct {
+  uint32_t* producer;
+  uint32_t* consumer;
+  void* ring;
+  void* map;
+  size_t map_size;
+} uv__xsk_ring_t;
+
+typedef struct {
+  char* umem;
+  size_t umem_size;
+  uv__xsk_ring_t fill;
+  uv__xsk_ring_t comp;
+  uv__xsk_ring_t rx;
+} uv__xsk_t;
+
+
+static int uv__xsk_ring_map(int fd,
+                            uv__xsk_ring_t* r,
+                            const struct xdp_ring_offset* off,
+                            size_t entry_size,
+                            off_t pgoff) {
+  char* map;
+
+  r->map_size = off->desc + UV__XDP_RING_SIZE * entry_size;
+  map = mmap(NULL,
+             r->map_size,
+             PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE,
+             fd,
+             pgoff);
+  if (map == MAP_FAILED)
+    return UV__ERR(errno);
+
+  r->map = map;
+  r->producer = (uint32_t*) (map + off->producer);
+  r->consumer = (uint32_t*) (map + off->consumer);
+  r->ring = map + off->desc;
+  return 0;
+}
+
+
+static void uv__xsk_ring_unmap(uv__xsk_ring_t* r) {
+  if (r->map != NULL)
+    munmap(r->map, r->map_size);
+  r->map = NULL;
+}
+
+
+static void uv__xsk_free(uv__xsk_t* xsk) {
+  uv__xsk_ring_unmap(&xsk->rx);
+  uv__xsk_ring_unmap(&xsk->comp);
+  uv__xsk_ring_unmap(&xsk->fill);
+  if (xsk->umem != NULL)
+    munmap(xsk->umem, xsk->umem_size);
+  uv__free(xsk);
+}
+
+
+/* 注册UMEM，建好fill/completion/rx三个环并映射进来，再把所有帧交给内核 */
+static int uv__xsk_setup(int fd, uv__xsk_t* xsk) {
+  struct xdp_umem_reg mr;
+  struct xdp_mmap_offsets off;
+  socklen_t optlen;
+  uint64_t* fill;
+  unsigned int size;
+  unsigned int i;
+  int err;
+
+  xsk->umem_size = UV__XDP_NUM_FRAMES * UV__XDP_FRAME_SIZE;
+  xsk->umem = mmap(NULL,
+                   xsk->umem_size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1,
+                   0);
+  if (xsk->umem == MAP_FAILED) {
+    xsk->umem = NULL;
+    return UV__ERR(errno);
+  }
+
+  memset(&mr, 0, sizeof(mr));
+  mr.addr = (uintptr_t) xsk->umem;
+  mr.len = xsk->umem_size;
+  mr.chunk_size = UV__XDP_FRAME_SIZE;
+  mr.headroom = 0;
+  if (setsockopt(fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)))
+    return UV__ERR(errno);
+
+  /* 只收不发，但内核要求UMEM的completion ring也得有 */
+  size = UV__XDP_RING_SIZE;
+  if (setsockopt(fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size)) ||
+      setsockopt(fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof(size)) ||
+      setsockopt(fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size)))
+    return UV__ERR(errno);
+
+  /* 老内核的xdp_ring_offset里没有flags，optlen会短一些，反正用不到 */
+  memset(&off, 0, sizeof(off));
+  optlen = sizeof(off);
+  if (getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen))
+    return UV__ERR(errno);
+
+  err = uv__xsk_ring_map(fd,
+                         &xsk->fill,
+                         &off.fr,
+                         sizeof(uint64_t),
+                         XDP_UMEM_PGOFF_FILL_RING);
+  if (err == 0)
+    err = uv__xsk_ring_map(fd,
+                           &xsk->comp,
+                           &off.cr,
+                           sizeof(uint64_t),
+                           XDP_UMEM_PGOFF_COMPLETION_RING);
+  if (err == 0)
+    err = uv__xsk_ring_map(fd,
+                           &xsk->rx,
+                           &off.rx,
+                           sizeof(struct xdp_desc),
+                           XDP_PGOFF_RX_RING);
+  if (err)
+    return err;
+
+  fill = xsk->fill.ring;
+  for (i = 0; i < UV__XDP_NUM_FRAMES; i++)
+    fill[i] = (uint64_t) i * UV__XDP_FRAME_SIZE;
+  __atomic_store_n(xsk->fill.producer, UV__XDP_NUM_FRAMES, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+
+static void uv__xdp_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  struct xdp_desc* desc;
+  uint64_t* fill;
+  uv_xdp_t* handle;
+  uv__xsk_t* xsk;
+  uv_buf_t frame;
+  uint32_t cons;
+  uint32_t prod;
+  uint32_t fprod;
+  uint64_t addr;
+  int count;
+
+  handle = container_of(w, uv_xdp_t, io_watcher);
+  assert(handle->type == UV_XDP);
+  xsk = handle->xsk;
+
+  desc = xsk->rx.ring;
+  fill = xsk->fill.ring;
+  cons = *xsk->rx.consumer;
+  prod = __atomic_load_n(xsk->rx.producer, __ATOMIC_ACQUIRE);
+  fprod = *xsk->fill.producer;
+
+  /* 和uv__udp_recvmsg()一样，一次最多处理32帧，免得饿死别的handle */
+  count = 32;
+
+  /* 回调里可能调用uv_xdp_recv_stop()或者uv_close() */
+  while (cons != prod &&
+         count-- > 0 &&
+         handle->recv_cb != NULL &&
+         handle->io_watcher.fd != -1) {
+    addr = desc[cons & (UV__XDP_RING_SIZE - 1)].addr;
+    frame = uv_buf_init(xsk->umem + addr,
+                        desc[cons & (UV__XDP_RING_SIZE - 1)].len);
+    handle->recv_cb(handle, &frame);
+
+    /* 对齐模式下addr里还带着帧内偏移，还给内核之前去掉 */
+    fill[fprod & (UV__XDP_RING_SIZE - 1)] =
+        addr - addr % UV__XDP_FRAME_SIZE;
+    fprod++;
+    cons++;
+  }
+
+  __atomic_store_n(xsk->rx.consumer, cons, __ATOMIC_RELEASE);
+  __atomic_store_n(xsk->fill.producer, fprod, __ATOMIC_RELEASE);
+}
+
+
+int uv_xdp_bind(uv_xdp_t* handle,
+                const char* ifname,
+                unsigned int queue_id,
+                unsigned int flags) {
+  struct sockaddr_xdp sxdp;
+  uv__xsk_t* xsk;
+  unsigned int ifindex;
+  int err;
+  int fd;
+
+  if (ifname == NULL)
+    return UV_EINVAL;
+
+  if (flags & ~(UV_XDP_ZEROCOPY | UV_XDP_COPY))
+    return UV_EINVAL;
+
+  if ((flags & UV_XDP_ZEROCOPY) && (flags & UV_XDP_COPY))
+    return UV_EINVAL;
+
+  if (handle->io_watcher.fd != -1)
+    return UV_EALREADY;
+
+  ifindex = if_nametoindex(ifname);
+  if (ifindex == 0)
+    return UV_ENODEV;
+
+  xsk = uv__calloc(1, sizeof(*xsk));
+  if (xsk == NULL)
+    return UV_ENOMEM;
+
+  fd = uv__socket(AF_XDP, SOCK_RAW, 0);
+  if (fd < 0) {
+    uv__free(xsk);
+    return fd;
+  }
+
+  err = uv__xsk_setup(fd, xsk);
+  if (err)
+    goto out;
+
+  memset(&sxdp, 0, sizeof(sxdp));
+  sxdp.sxdp_family = AF_XDP;
+  sxdp.sxdp_ifindex = ifindex;
+  sxdp.sxdp_queue_id = queue_id;
+  if (flags & UV_XDP_ZEROCOPY)
+    sxdp.sxdp_flags |= XDP_ZEROCOPY;
+  if (flags & UV_XDP_COPY)
+    sxdp.sxdp_flags |= XDP_COPY;
+
+  if (bind(fd, (struct sockaddr*) &sxdp, sizeof(sxdp))) {
+    err = UV__ERR(errno);
+    goto out;
+  }
+
+  handle->xsk = xsk;
+  handle->io_watcher.fd = fd;
+  return 0;
+
+out:
+  uv__close(fd);
+  uv__xsk_free(xsk);
+  return err;
+}
+
+#else  /* !defined(__linux__) || !defined(XDP_MMAP_OFFSETS) */
+
+static void uv__xsk_free(void* xsk) {
+  assert(xsk == NULL);
+}
+
+
+static void uv__xdp_io(uv_loop_t* loop, uv__io_t* w, unsigned int events) {
+  assert(0);
+}
+
+
+int uv_xdp_bind(uv_xdp_t* handle,
+                const char* ifname,
+                unsigned int queue_id,
+                unsigned int flags) {
+  return UV_ENOTSUP;
+}
+
+#endif
+
+
+int uv_xdp_init(uv_loop_t* loop, uv_xdp_t* handle) {
+  uv__handle_init(loop, (uv_handle_t*) handle, UV_XDP);
+  uv__io_init(&handle->io_watcher, uv__xdp_io, -1);
+  handle->recv_cb = NULL;
+  handle->xsk = NULL;
+  return 0;
+}
+
+
+int uv_xdp_recv_start(uv_xdp_t* handle, uv_xdp_recv_cb recv_cb) {
+  if (recv_cb == NULL)
+    return UV_EINVAL;
+
+  if (handle->io_watcher.fd == -1)
+    return UV_EBADF;
+
+  if (uv__io_active(&handle->io_watcher, POLLIN))
+    return UV_EALREADY;
+
+  handle->recv_cb = recv_cb;
+  uv__io_start(handle->loop, &handle->io_watcher, POLLIN);
+  uv__handle_start(handle);
+
+  return 0;
+}
+
+
+int uv_xdp_recv_stop(uv_xdp_t* handle) {
+  uv__io_stop(handle->loop, &handle->io_watcher, POLLIN);
+  uv__handle_stop(handle);
+  handle->recv_cb = NULL;
+  return 0;
+}
+
+
+void uv__xdp_close(uv_xdp_t* handle) {
+  uv__io_close(handle->loop, &handle->io_watcher);
+  uv__handle_stop(handle);
+  handle->recv_cb = NULL;
+
+  if (handle->io_watcher.fd != -1) {
+    uv__close(handle->io_watcher.fd);
+    handle->io_watcher.fd = -1;
+  }
+}
+
+
+/* 关闭时可能还在回调里用着UMEM，所以等到这里再解除映射 */
+void uv__xdp_finish_close(uv_xdp_t* handle) {
+  if (handle->xsk != NULL)
+    uv__xsk_free(handle->xsk);
+  handle->xsk = NULL;
+}
@@ -24,6 +24,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h> /* INT_MAX */
 #include <stdarg.h>
 #include <stddef.h> /* NULL */
 #include <stdio.h> /* FILE, printf */
@@ -150,6 +151,519 @@ uv_buf_t uv_buf_init(char* base, size_t len) {
 }
 
 
+/* 空闲的缓冲区用开头的一个指针串成单链表 */
+/* UV_BUF_POOL_HUGEPAGES的一块映射，整块按缓冲区大小切开。记录放在映射外面，
+ * 2的幂大小的缓冲区正好切满
+ */
+struct uv__buf_pool_slab {
+  struct uv__buf_pool_slab* next;
+  char* base;
+  size_t size;
+};
+
+
+int uv_buf_pool_init(uv_buf_pool_t* pool,
+                     size_t buf_size,
+                     unsigned int max_free) {
+  return uv_buf_pool_init_ex(pool, buf_size, max_free, 0);
+}
+
+
+int uv_buf_pool_init_ex(uv_buf_pool_t* pool,
+                        size_t buf_size,
+                        unsigned int max_free,
+                        unsigned int flags) {
+  if (buf_size < sizeof(void*) || (flags & ~UV_BUF_POOL_HUGEPAGES))
+    return UV_EINVAL;
+
+#ifdef _WIN32
+  if (flags & UV_BUF_POOL_HUGEPAGES)
+    return UV_ENOTSUP;
+#endif
+
+  pool->buf_size = buf_size;
+  pool->max_free = max_free;
+  pool->nfree = 0;
+  pool->nused = 0;
+  pool->free_list = NULL;
+  pool->flags = flags;
+  pool->slabs = NULL;
+  return 0;
+}
+
+
+int uv_buf_pool_destroy(uv_buf_pool_t* pool) {
+  struct uv__buf_pool_slab* slab;
+  void* next;
+
+  if (pool->nused != 0)
+    return UV_EBUSY;
+
+  if (pool->flags & UV_BUF_POOL_HUGEPAGES) {
+#ifndef _WIN32
+    while (pool->slabs != NULL) {
+      slab = pool->slabs;
+      pool->slabs = slab->next;
+      uv__hugepage_unmap(slab->base, slab->size);
+      uv__free(slab);
+    }
+#endif
+    pool->free_list = NULL;
+  }
+
+  while (pool->free_list != NULL) {
+    next = *(void**) pool->free_list;
+    uv__free(pool->free_list);
+    pool->free_list = next;
+  }
+
+  pool->nfree = 0;
+  return 0;
+}
+
+
+/* 映射一块新的大页，切成缓冲区全部挂到空闲链表上 */
+static int uv__buf_pool_grow(uv_buf_pool_t* pool) {
+#ifdef _WIN32
+  return UV_ENOTSUP;
+#else
+  struct uv__buf_pool_slab* slab;
+  char* base;
+  char* end;
+
+  slab = uv__malloc(sizeof(*slab));
+  if (slab == NULL)
+    return UV_ENOMEM;
+
+  slab->size = pool->buf_size;
+  slab->base = uv__hugepage_map(&slab->size);
+  if (slab->base == NULL) {
+    uv__free(slab);
+    return UV_ENOMEM;
+  }
+
+  slab->next = pool->slabs;
+  pool->slabs = slab;
+
+  end = slab->base + slab->size;
+  for (base = slab->base;
+       (size_t) (end - base) >= pool->buf_size;
+       base += pool->buf_size) {
+    *(void**) base = pool->free_list;
+    pool->free_list = base;
+    pool->nfree++;
+  }
+
+  return 0;
+#endif
+}
+
+
+/* 优先从空闲链表里取，链表空了才去分配。分配失败返回的buf长度为0 */
+uv_buf_t uv_buf_pool_get(uv_buf_pool_t* pool) {
+  char* base;
+
+  if (pool->free_list == NULL && (pool->flags & UV_BUF_POOL_HUGEPAGES))
+    if (uv__buf_pool_grow(pool))
+      return uv_buf_init(NULL, 0);
+
+  base = pool->free_list;
+  if (base != NULL) {
+    pool->free_list = *(void**) base;
+    pool->nfree--;
+  } else {
+    base = uv__malloc(pool->buf_size);
+    if (base == NULL)
+      return uv_buf_init(NULL, 0);
+  }
+
+  pool->nused++;
+  return uv_buf_init(base, pool->buf_size);
+}
+
+
+void uv_buf_pool_release(uv_buf_pool_t* pool, char* base) {
+  if (base == NULL)
+    return;
+
+  assert(pool->nused > 0);
+  pool->nused--;
+
+  if (pool->nfree >= pool->max_free &&
+      !(pool->flags & UV_BUF_POOL_HUGEPAGES)) {
+    uv__free(base);
+    return;
+  }
+
+  *(void**) base = pool->free_list;
+  pool->free_list = base;
+  pool->nfree++;
+}
+
+
+void uv_shared_buf_init(uv_shared_buf_t* buf,
+                        char* base,
+                        size_t len,
+                        uv_shared_buf_free_cb free_cb) {
+  buf->base = base;
+  buf->len = len;
+  buf->refcount = 1;
+  buf->free_cb = free_cb;
+}
+
+
+void uv_shared_buf_ref(uv_shared_buf_t* buf) {
+  assert(buf->refcount > 0);
+  buf->refcount++;
+}
+
+
+void uv_shared_buf_unref(uv_shared_buf_t* buf) {
+  assert(buf->refcount > 0);
+  if (--buf->refcount == 0 && buf->free_cb != NULL)
+    buf->free_cb(buf);
+}
+
+
+void uv_iobuf_init(uv_iobuf_t* iob) {
+  iob->bufs = iob->bufsml;
+  iob->owners = iob->ownersml;
+  iob->nbufs = 0;
+  iob->len = 0;
+  iob->capacity = ARRAY_SIZE(iob->bufsml);
+}
+
+
+/* bufs和owners放在同一块内存里 */
+static int uv__iobuf_grow(uv_iobuf_t* iob) {
+  unsigned int capacity;
+  uv_shared_buf_t** owners;
+  uv_buf_t* bufs;
+
+  capacity = iob->capacity * 2;
+  bufs = uv__malloc(capacity * (sizeof(*bufs) + sizeof(*owners)));
+  if (bufs == NULL)
+    return UV_ENOMEM;
+
+  owners = (uv_shared_buf_t**) (bufs + capacity);
+  memcpy(bufs, iob->bufs, iob->nbufs * sizeof(*bufs));
+  memcpy(owners, iob->owners, iob->nbufs * sizeof(*owners));
+
+  if (iob->bufs != iob->bufsml)
+    uv__free(iob->bufs);
+
+  iob->bufs = bufs;
+  iob->owners = owners;
+  iob->capacity = capacity;
+  return 0;
+}
+
+
+int uv_iobuf_append(uv_iobuf_t* iob,
+                    uv_shared_buf_t* owner,
+                    char* base,
+                    size_t len) {
+  uv_buf_t* last;
+  int err;
+
+  if (len == 0)
+    return 0;
+
+  if (owner != NULL &&
+      (base < owner->base || len > owner->len ||
+       (size_t) (base - owner->base) > owner->len - len)) {
+    return UV_EINVAL;
+  }
+
+  if (iob->nbufs > 0) {
+    last = &iob->bufs[iob->nbufs - 1];
+    if (iob->owners[iob->nbufs - 1] == owner &&
+        last->base + last->len == base) {
+      last->len += len;
+      iob->len += len;
+      return 0;
+    }
+  }
+
+  if (iob->nbufs == iob->capacity) {
+    err = uv__iobuf_grow(iob);
+    if (err != 0)
+      return err;
+  }
+
+  if (owner != NULL)
+    uv_shared_buf_ref(owner);
+
+  iob->bufs[iob->nbufs] = uv_buf_init(base, len);
+  iob->owners[iob->nbufs] = owner;
+  iob->nbufs++;
+  iob->len += len;
+  return 0;
+}
+
+
+int uv_iobuf_append_iobuf(uv_iobuf_t* dst,
+                          const uv_iobuf_t* src,
+                          size_t offset,
+                          size_t len) {
+  unsigned int i;
+  size_t n;
+  int err;
+
+  if (dst == src || offset > src->len || len > src->len - offset)
+    return UV_EINVAL;
+
+  for (i = 0; i < src->nbufs && len > 0; i++) {
+    if (offset >= src->bufs[i].len) {
+      offset -= src->bufs[i].len;
+      continue;
+    }
+
+    n = src->bufs[i].len - offset;
+    if (n > len)
+      n = len;
+
+    err = uv_iobuf_append(dst, src->owners[i], src->bufs[i].base + offset, n);
+    if (err != 0)
+      return err;
+
+    offset = 0;
+    len -= n;
+  }
+
+  return 0;
+}
+
+
+void uv_iobuf_consume(uv_iobuf_t* iob, size_t n) {
+  unsigned int i;
+
+  if (n >= iob->len) {
+    uv_iobuf_reset(iob);
+    return;
+  }
+
+  for (i = 0; n >= iob->bufs[i].len; i++) {
+    n -= iob->bufs[i].len;
+    iob->len -= iob->bufs[i].len;
+    if (iob->owners[i] != NULL)
+      uv_shared_buf_unref(iob->owners[i]);
+  }
+
+  iob->bufs[i].base += n;
+  iob->bufs[i].len -= n;
+  iob->len -= n;
+
+  iob->nbufs -= i;
+  memmove(iob->bufs, iob->bufs + i, iob->nbufs * sizeof(iob->bufs[0]));
+  memmove(iob->owners, iob->owners + i, iob->nbufs * sizeof(iob->owners[0]));
+}
+
+
+size_t uv_iobuf_copyout(const uv_iobuf_t* iob,
+                        size_t offset,
+                        char* dst,
+                        size_t len) {
+  unsigned int i;
+  size_t total;
+  size_t n;
+
+  total = 0;
+  for (i = 0; i < iob->nbufs && total < len; i++) {
+    if (offset >= iob->bufs[i].len) {
+      offset -= iob->bufs[i].len;
+      continue;
+    }
+
+    n = iob->bufs[i].len - offset;
+    if (n > len - total)
+      n = len - total;
+
+    memcpy(dst + total, iob->bufs[i].base + offset, n);
+    total += n;
+    offset = 0;
+  }
+
+  return total;
+}
+
+
+void uv_iobuf_reset(uv_iobuf_t* iob) {
+  unsigned int i;
+
+  for (i = 0; i < iob->nbufs; i++)
+    if (iob->owners[i] != NULL)
+      uv_shared_buf_unref(iob->owners[i]);
+
+  if (iob->bufs != iob->bufsml)
+    uv__free(iob->bufs);
+
+  uv_iobuf_init(iob);
+}
+
+
+/* 写请求和UDP发送请求在完成之前对链里的每个owner持有一个引用，相邻的同一个
+ * owner只算一次。没有owner时*owners为NULL
+ */
+int uv__iobuf_hold(const uv_iobuf_t* iob,
+                   uv_shared_buf_t*** owners,
+                   unsigned int* nowners) {
+  uv_shared_buf_t** v;
+  unsigned int i;
+  unsigned int n;
+
+  *owners = NULL;
+  *nowners = 0;
+
+  n = 0;
+  for (i = 0; i < iob->nbufs; i++)
+    if (iob->owners[i] != NULL &&
+        (i == 0 || iob->owners[i] != iob->owners[i - 1]))
+      n++;
+
+  if (n == 0)
+    return 0;
+
+  v = uv__malloc(n * sizeof(*v));
+  if (v == NULL)
+    return UV_ENOMEM;
+
+  n = 0;
+  for (i = 0; i < iob->nbufs; i++) {
+    if (iob->owners[i] != NULL &&
+        (i == 0 || iob->owners[i] != iob->owners[i - 1])) {
+      uv_shared_buf_ref(iob->owners[i]);
+      v[n++] = iob->owners[i];
+    }
+  }
+
+  *owners = v;
+  *nowners = n;
+  return 0;
+}
+
+
+void uv__iobuf_drop(uv_shared_buf_t** owners, unsigned int nowners) {
+  unsigned int i;
+
+  if (owners == NULL)
+    return;
+
+  for (i = 0; i < nowners; i++)
+    uv_shared_buf_unref(owners[i]);
+
+  uv__free(owners);
+}
+
+
+/* uv_read_start_iobuf()和uv_udp_recv_start_iobuf()的缓冲区开头放着这个头部 */
+typedef union {
+  struct {
+    uv_shared_buf_t shared;
+    uv_buf_pool_t* pool;
+  } c;
+  double align0;
+  long long align1;
+  void* align2;
+} uv__iobuf_chunk_t;
+
+
+static void uv__iobuf_chunk_free(uv_shared_buf_t* shared) {
+  uv__iobuf_chunk_t* chunk;
+
+  chunk = container_of(shared, uv__iobuf_chunk_t, c.shared);
+  uv_buf_pool_release(chunk->c.pool, (char*) chunk);
+}
+
+
+size_t uv__iobuf_chunk_size(void) {
+  return sizeof(uv__iobuf_chunk_t);
+}
+
+
+/* buf是uv__iobuf_alloc()给出的缓冲区时找到它的owner */
+uv_shared_buf_t* uv__iobuf_owner(const uv_buf_t* buf) {
+  uv__iobuf_chunk_t* chunk;
+
+  if (buf->base == NULL)
+    return NULL;
+
+  chunk = (uv__iobuf_chunk_t*) (buf->base - sizeof(*chunk));
+  return &chunk->c.shared;
+}
+
+
+void uv__iobuf_alloc(uv_handle_t* handle,
+                     size_t suggested_size,
+                     uv_buf_t* buf) {
+  uv__iobuf_chunk_t* chunk;
+  uv_buf_pool_t* pool;
+  uv_buf_t b;
+
+  if (handle->type == UV_UDP)
+    pool = ((uv_udp_t*) handle)->buf_pool;
+  else
+    pool = ((uv_stream_t*) handle)->buf_pool;
+
+  chunk = NULL;
+  b = uv_buf_pool_get(pool);
+  if (b.base != NULL) {
+    chunk = (uv__iobuf_chunk_t*) b.base;
+    chunk->c.pool = pool;
+    uv_shared_buf_init(&chunk->c.shared,
+                       b.base + sizeof(*chunk),
+                       b.len - sizeof(*chunk),
+                       uv__iobuf_chunk_free);
+    b = uv_buf_init(chunk->c.shared.base, chunk->c.shared.len);
+  }
+
+  /* recvmmsg()交给recv_cb的是整块缓冲区里的一段，从这里找owner */
+  if (handle->type == UV_UDP)
+    ((uv_udp_t*) handle)->recv_iobuf_owner =
+        chunk != NULL ? &chunk->c.shared : NULL;
+
+  *buf = b;
+}
+
+
+/* libuv在回调返回以后放掉自己的引用。recvmmsg()的报文共用一个owner，
+ * 等最后交还整块缓冲区的那一次回调（没有UV_UDP_MMSG_CHUNK）再放
+ */
+static void uv__udp_recv_iobuf(uv_udp_t* handle,
+                               ssize_t nread,
+                               const uv_buf_t* buf,
+                               const struct sockaddr* addr,
+                               unsigned flags) {
+  uv_shared_buf_t* owner;
+
+  owner = handle->recv_iobuf_owner;
+  if (!(flags & UV_UDP_MMSG_CHUNK))
+    handle->recv_iobuf_owner = NULL;
+
+  handle->recv_iobuf_cb(handle, nread, buf, owner, addr, flags);
+
+  if (owner != NULL && !(flags & UV_UDP_MMSG_CHUNK))
+    uv_shared_buf_unref(owner);
+}
+
+
+/* uv_read_start_pooled()和uv_udp_recv_start_pooled()用的alloc_cb，
+ * 不管suggested_size，总是给出池里的一个缓冲区
+ */
+void uv__buf_pool_alloc(uv_handle_t* handle,
+                        size_t suggested_size,
+                        uv_buf_t* buf) {
+  uv_buf_pool_t* pool;
+
+  if (handle->type == UV_UDP)
+    pool = ((uv_udp_t*) handle)->buf_pool;
+  else
+    pool = ((uv_stream_t*) handle)->buf_pool;
+
+  *buf = uv_buf_pool_get(pool);
+}
+
+
 static const char* uv__unknown_err_code(int err) {
   char buf[32];
   char* copy;
@@ -402,6 +916,179 @@ int uv_udp_send(uv_udp_send_t* req,
 }
 
 
+int uv_udp_send_iobuf(uv_udp_send_t* req,
+                      uv_udp_t* handle,
+                      const uv_iobuf_t* iob,
+                      const struct sockaddr* addr,
+                      uv_udp_send_cb send_cb) {
+  uv_shared_buf_t** owners;
+  unsigned int nowners;
+  int addrlen;
+  int err;
+
+  if (iob->nbufs == 0)
+    return UV_EINVAL;
+
+  addrlen = uv__udp_check_before_send(handle, addr);
+  if (addrlen < 0)
+    return addrlen;
+
+  err = uv__iobuf_hold(iob, &owners, &nowners);
+  if (err != 0)
+    return err;
+
+  err = uv__udp_send(req, handle, iob->bufs, iob->nbufs, addr, addrlen, send_cb);
+  if (err != 0) {
+    uv__iobuf_drop(owners, nowners);
+    return err;
+  }
+
+  /* 回调总是在之后的uv__udp_run_completed()里，那时放掉引用 */
+  req->iobuf_owners = owners;
+  req->iobuf_nowners = nowners;
+  return 0;
+}
+
+
+int uv_udp_send_gso(uv_udp_send_t* req,
+                    uv_udp_t* handle,
+                    const uv_buf_t bufs[],
+                    unsigned int nbufs,
+                    const struct sockaddr* addr,
+                    unsigned int segment_size,
+                    uv_udp_send_cb send_cb) {
+  int addrlen;
+
+  if (segment_size == 0 || segment_size > 65535)
+    return UV_EINVAL;
+
+  addrlen = uv__udp_check_before_send(handle, addr);
+  if (addrlen < 0)
+    return addrlen;
+
+  return uv__udp_send_ex(req,
+                         handle,
+                         bufs,
+                         nbufs,
+                         addr,
+                         addrlen,
+                         segment_size,
+                         NULL,
+                         0,
+                         0,
+                         send_cb);
+}
+
+
+int uv_udp_send_txtime(uv_udp_send_t* req,
+                       uv_udp_t* handle,
+                       const uv_buf_t bufs[],
+                       unsigned int nbufs,
+                       const struct sockaddr* addr,
+                       uint64_t txtime,
+                       uv_udp_send_cb send_cb) {
+  int addrlen;
+
+  if (txtime == 0)
+    return UV_EINVAL;
+
+  addrlen = uv__udp_check_before_send(handle, addr);
+  if (addrlen < 0)
+    return addrlen;
+
+  return uv__udp_send_ex(req,
+                         handle,
+                         bufs,
+                         nbufs,
+                         addr,
+                         addrlen,
+                         0,
+                         NULL,
+                         0,
+                         txtime,
+                         send_cb);
+}
+
+
+int uv_udp_send_zerocopy(uv_udp_send_t* req,
+                         uv_udp_t* handle,
+                         const uv_buf_t bufs[],
+                         unsigned int nbufs,
+                         const struct sockaddr* addr,
+                         unsigned int segment_size,
+                         uv_udp_send_cb send_cb) {
+  int addrlen;
+
+  if (segment_size > 65535)
+    return UV_EINVAL;
+
+  addrlen = uv__udp_check_before_send(handle, addr);
+  if (addrlen < 0)
+    return addrlen;
+
+  return uv__udp_send_ex(req,
+                         handle,
+                         bufs,
+                         nbufs,
+                         addr,
+                         addrlen,
+                         segment_size,
+                         NULL,
+                         1,
+                         0,
+                         send_cb);
+}
+
+
+int uv_udp_send_from(uv_udp_send_t* req,
+                     uv_udp_t* handle,
+                     const uv_buf_t bufs[],
+                     unsigned int nbufs,
+                     const struct sockaddr* addr,
+                     const struct sockaddr* src,
+                     uv_udp_send_cb send_cb) {
+  int addrlen;
+
+  if (src == NULL)
+    return UV_EINVAL;
+
+  addrlen = uv__udp_check_before_send(handle, addr);
+  if (addrlen < 0)
+    return addrlen;
+
+  return uv__udp_send_ex(req,
+                         handle,
+                         bufs,
+                         nbufs,
+                         addr,
+                         addrlen,
+                         0,
+                         src,
+                         0,
+                         0,
+                         send_cb);
+}
+
+
+int uv_udp_send_batch(uv_udp_send_t reqs[],
+                      uv_udp_t* handle,
+                      const uv_buf_t bufs[],
+                      unsigned int count,
+                      const struct sockaddr* addr,
+                      uv_udp_send_cb send_cb) {
+  int addrlen;
+
+  if (count == 0 || count > INT_MAX)
+    return UV_EINVAL;
+
+  addrlen = uv__udp_check_before_send(handle, addr);
+  if (addrlen < 0)
+    return addrlen;
+
+  return uv__udp_send_batch(reqs, handle, bufs, count, addr, addrlen, send_cb);
+}
+
+
 int uv_udp_try_send(uv_udp_t* handle,
                     const uv_buf_t bufs[],
                     unsigned int nbufs,
@@ -416,6 +1103,23 @@ int uv_udp_try_send(uv_udp_t* handle,
 }
 
 
+int uv_udp_try_send_batch(uv_udp_t* handle,
+                          const uv_buf_t bufs[],
+                          unsigned int count,
+                          const struct sockaddr* addr) {
+  int addrlen;
+
+  if (count == 0 || count > INT_MAX)
+    return UV_EINVAL;
+
+  addrlen = uv__udp_check_before_send(handle, addr);
+  if (addrlen < 0)
+    return addrlen;
+
+  return uv__udp_try_send_batch(handle, bufs, count, addr, addrlen);
+}
+
+
 int uv_udp_recv_start(uv_udp_t* handle,
                       uv_alloc_cb alloc_cb,
                       uv_udp_recv_cb recv_cb) {
@@ -426,6 +1130,49 @@ int uv_udp_recv_start(uv_udp_t* handle,
 }
 
 
+int uv_udp_recv_start_pooled(uv_udp_t* handle,
+                             uv_buf_pool_t* pool,
+                             uv_udp_recv_cb recv_cb) {
+  if (handle->type != UV_UDP || pool == NULL || recv_cb == NULL)
+    return UV_EINVAL;
+
+  handle->buf_pool = pool;
+  return uv__udp_recv_start(handle, uv__buf_pool_alloc, recv_cb);
+}
+
+
+int uv_udp_recv_start_iobuf(uv_udp_t* handle,
+                            uv_buf_pool_t* pool,
+                            uv_udp_recv_iobuf_cb recv_cb) {
+  if (handle->type != UV_UDP || pool == NULL || recv_cb == NULL)
+    return UV_EINVAL;
+
+  if (pool->buf_size <= uv__iobuf_chunk_size())
+    return UV_EINVAL;
+
+  handle->buf_pool = pool;
+  handle->recv_iobuf_cb = recv_cb;
+  return uv__udp_recv_start(handle, uv__iobuf_alloc, uv__udp_recv_iobuf);
+}
+
+
+int uv_udp_recv_start_ex(uv_udp_t* handle,
+                         uv_alloc_cb alloc_cb,
+                         uv_udp_recv_ex_cb recv_cb,
+                         unsigned int info_flags) {
+  if (handle->type != UV_UDP || alloc_cb == NULL || recv_cb == NULL)
+    return UV_EINVAL;
+
+  if (info_flags & ~(UV_UDP_RECV_TIMESTAMP |
+                     UV_UDP_RECV_PKTINFO |
+                     UV_UDP_RECV_TOS)) {
+    return UV_EINVAL;
+  }
+
+  return uv__udp_recv_start_ex(handle, alloc_cb, recv_cb, info_flags);
+}
+
+
 int uv_udp_recv_stop(uv_udp_t* handle) {
   if (handle->type != UV_UDP)
     return UV_EINVAL;
@@ -453,6 +1200,51 @@ void uv_walk(uv_loop_t* loop, uv_walk_cb walk_cb, void* arg) {
 }
 
 
+void uv_loop_dump_handles(uv_loop_t* loop, uv_handle_info_cb cb, void* arg) {
+  uv_handle_info_t info;
+  QUEUE* q;
+  uv_handle_t* h;
+
+  memset(&info, 0, sizeof(info));
+
+  /* cb里uv_close()的handle要等uv__finish_close()才从handle_queue里摘掉，
+   * 所以可以直接遍历，不用像uv_walk()那样先搬到一个临时队列里
+   */
+  QUEUE_FOREACH(q, &loop->handle_queue) {
+    h = QUEUE_DATA(q, uv_handle_t, handle_queue);
+
+    if (h->flags & UV_HANDLE_INTERNAL)
+      continue;
+
+    info.handle = h;
+    info.type = h->type;
+    info.flags = h->flags;
+    if (uv_fileno(h, &info.fd) != 0)
+      info.fd = (uv_os_fd_t) -1;
+    info.active = uv__is_active(h);
+    info.ref = uv__has_ref(h);
+    info.closing = uv__is_closing(h);
+    info.idle_time = loop->time - h->activity_time;
+
+    switch (h->type) {
+    case UV_TCP:
+    case UV_NAMED_PIPE:
+    case UV_TTY:
+      info.write_queue_size = ((uv_stream_t*) h)->write_queue_size;
+      break;
+    case UV_UDP:
+      info.write_queue_size = ((uv_udp_t*) h)->send_queue_size;
+      break;
+    default:
+      info.write_queue_size = 0;
+      break;
+    }
+
+    cb(&info, arg);
+  }
+}
+
+
 static void uv__print_handles(uv_loop_t* loop, int only_active, void* stream) {
   const char* type;
   QUEUE* q;
@@ -583,6 +1375,38 @@ static unsigned int* uv__get_nbufs(uv_fs_t* req) {
 # define uv__fs_scandir_free free
 #endif
 
+/* scandir()的结果算在UV_MEM_FS_SCANDIR里，每一项按它的名字长度计算。
+ * 目前只有unix上统计，参见src/unix/fs.c。
+ */
+static long uv__fs_scandir_dent_size(uv__dirent_t* dent) {
+  return (long) (offsetof(uv__dirent_t, d_name) + strlen(dent->d_name) + 1);
+}
+
+
+void uv__fs_scandir_account(uv__dirent_t** dents, int n) {
+  int i;
+
+  uv__mem_account(UV_MEM_FS_SCANDIR, (long) (n * sizeof(*dents)), 1);
+  for (i = 0; i < n; i++)
+    uv__mem_account(UV_MEM_FS_SCANDIR, uv__fs_scandir_dent_size(dents[i]), 1);
+}
+
+
+static void uv__fs_scandir_free_dent(uv__dirent_t* dent) {
+#ifndef _WIN32
+  uv__mem_account(UV_MEM_FS_SCANDIR, -uv__fs_scandir_dent_size(dent), -1);
+#endif
+  uv__fs_scandir_free(dent);
+}
+
+
+static void uv__fs_scandir_free_dents(uv__dirent_t** dents, int n) {
+#ifndef _WIN32
+  uv__mem_account(UV_MEM_FS_SCANDIR, -(long) (n * sizeof(*dents)), -1);
+#endif
+  uv__fs_scandir_free(dents);
+}
+
 void uv__fs_scandir_cleanup(uv_fs_t* req) {
   uv__dirent_t** dents;
 
@@ -592,9 +1416,9 @@ void uv__fs_scandir_cleanup(uv_fs_t* req) {
   if (*nbufs > 0 && *nbufs != (unsigned int) req->result)
     (*nbufs)--;
   for (; *nbufs < (unsigned int) req->result; (*nbufs)++)
-    uv__fs_scandir_free(dents[*nbufs]);
+    uv__fs_scandir_free_dent(dents[*nbufs]);
 
-  uv__fs_scandir_free(req->ptr);
+  uv__fs_scandir_free_dents(req->ptr, req->result);
   req->ptr = NULL;
 }
 
@@ -619,11 +1443,11 @@ int uv_fs_scandir_next(uv_fs_t* req, uv_dirent_t* ent) {
 
   /* Free previous entity */
   if (*nbufs > 0)
-    uv__fs_scandir_free(dents[*nbufs - 1]);
+    uv__fs_scandir_free_dent(dents[*nbufs - 1]);
 
   /* End was already reached */
   if (*nbufs == (unsigned int) req->result) {
-    uv__fs_scandir_free(dents);
+    uv__fs_scandir_free_dents(dents, req->result);
     req->ptr = NULL;
     return UV_EOF;
   }
@@ -631,37 +1455,69 @@ int uv_fs_scandir_next(uv_fs_t* req, uv_dirent_t* ent) {
   dent = dents[(*nbufs)++];
 
   ent->name = dent->d_name;
+  ent->type = uv__fs_get_dirent_type(dent);
+
+  return 0;
+}
+
+
+uv_dirent_type_t uv__fs_get_dirent_type(uv__dirent_t* dent) {
+  uv_dirent_type_t type;
+
 #ifdef HAVE_DIRENT_TYPES
   switch (dent->d_type) {
     case UV__DT_DIR:
-      ent->type = UV_DIRENT_DIR;
+      type = UV_DIRENT_DIR;
       break;
     case UV__DT_FILE:
-      ent->type = UV_DIRENT_FILE;
+      type = UV_DIRENT_FILE;
       break;
     case UV__DT_LINK:
-      ent->type = UV_DIRENT_LINK;
+      type = UV_DIRENT_LINK;
       break;
     case UV__DT_FIFO:
-      ent->type = UV_DIRENT_FIFO;
+      type = UV_DIRENT_FIFO;
       break;
     case UV__DT_SOCKET:
-      ent->type = UV_DIRENT_SOCKET;
+      type = UV_DIRENT_SOCKET;
       break;
     case UV__DT_CHAR:
-      ent->type = UV_DIRENT_CHAR;
+      type = UV_DIRENT_CHAR;
       break;
     case UV__DT_BLOCK:
-      ent->type = UV_DIRENT_BLOCK;
+      type = UV_DIRENT_BLOCK;
       break;
     default:
-      ent->type = UV_DIRENT_UNKNOWN;
+      type = UV_DIRENT_UNKNOWN;
   }
 #else
-  ent->type = UV_DIRENT_UNKNOWN;
+  type = UV_DIRENT_UNKNOWN;
 #endif
 
-  return 0;
+  return type;
+}
+
+
+/* 释放uv_fs_readdir()读出来的目录项名字，uv_dir_t本身归uv_fs_closedir()管 */
+void uv__fs_readdir_cleanup(uv_fs_t* req) {
+  uv_dir_t* dir;
+  uv_dirent_t* dirents;
+  ssize_t i;
+
+  if (req->ptr == NULL)
+    return;
+
+  dir = req->ptr;
+  dirents = dir->dirents;
+  req->ptr = NULL;
+
+  if (dirents == NULL)
+    return;
+
+  for (i = 0; i < req->result; ++i) {
+    uv__free((char*) dirents[i].name);
+    dirents[i].name = NULL;
+  }
 }
 
 
@@ -740,6 +1596,35 @@ int uv_loop_close(uv_loop_t* loop) {
 }
 
 
+/* 纳秒耗时映射到直方图桶：0-7各占一个桶，之后每个2的幂区间分成8个子桶 */
+static unsigned int uv__histogram_bucket(uint64_t ns) {
+  unsigned int msb;
+
+  if (ns < 8)
+    return (unsigned int) ns;
+
+  if (ns >> 36)
+    return UV_PHASE_HISTOGRAM_BUCKETS - 1;
+
+#if defined(__GNUC__)
+  msb = 63 - __builtin_clzll(ns);
+#else
+  for (msb = 3; ns >> (msb + 1); msb++);
+#endif
+  return (msb - 2) * 8 + ((ns >> (msb - 3)) & 7);
+}
+
+
+/* 往直方图里加一个样本，线程安全由调用方保证 */
+void uv__histogram_add(uv_phase_histogram_t* hist, uint64_t ns) {
+  hist->count++;
+  hist->sum += ns;
+  if (ns > hist->max)
+    hist->max = ns;
+  hist->buckets[uv__histogram_bucket(ns)]++;
+}
+
+
 void uv_loop_delete(uv_loop_t* loop) {
   uv_loop_t* default_loop;
   int err;
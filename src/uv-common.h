@@ -67,6 +67,10 @@ enum {
   UV_HANDLE_SHUT                        = 0x00000200,
   UV_HANDLE_READ_PARTIAL                = 0x00000400,
   UV_HANDLE_READ_EOF                    = 0x00000800,
+  /* uv_stream_cork()之后uv_write()只排队不写 */
+  UV_HANDLE_CORKED                      = 0x40000000,
+  /* 已经在socket上打开了SO_ZEROCOPY，UDP handle也用 */
+  UV_HANDLE_ZEROCOPY                    = 0x80000000,
 
   /* Used by streams and UDP handles. */
   UV_HANDLE_READING                     = 0x00001000,
@@ -84,6 +88,8 @@ enum {
   UV_HANDLE_IPV6                        = 0x00400000,
 
   /* Only used by uv_tcp_t handles. */
+  /* uv_tcp_fastopen_connect()打开了TFO，connect时设置TCP_FASTOPEN_CONNECT */
+  UV_HANDLE_TCP_FASTOPEN                = 0x00800000,
   UV_HANDLE_TCP_NODELAY                 = 0x01000000,
   UV_HANDLE_TCP_KEEPALIVE               = 0x02000000,
   UV_HANDLE_TCP_SINGLE_ACCEPT           = 0x04000000,
@@ -94,10 +100,14 @@ enum {
   /* Only used by uv_udp_t handles. */
   UV_HANDLE_UDP_PROCESSING              = 0x01000000,
   UV_HANDLE_UDP_CONNECTED               = 0x02000000,
+  UV_HANDLE_UDP_RECVMMSG                = 0x04000000,
+  UV_HANDLE_UDP_GRO                     = 0x08000000,
+  UV_HANDLE_UDP_TXTIME                  = 0x10000000,
 
   /* Only used by uv_pipe_t handles. */
   UV_HANDLE_NON_OVERLAPPED_PIPE         = 0x01000000,
   UV_HANDLE_PIPESERVER                  = 0x02000000,
+  UV_HANDLE_PIPE_SEQPACKET              = 0x04000000,
 
   /* Only used by uv_tty_t handles. */
   UV_HANDLE_TTY_READABLE                = 0x01000000,
@@ -110,7 +120,13 @@ enum {
   UV_SIGNAL_ONE_SHOT                    = 0x02000000,
 
   /* Only used by uv_poll_t handles. */
-  UV_HANDLE_POLL_SLOW                   = 0x01000000
+  UV_HANDLE_POLL_SLOW                   = 0x01000000,
+
+  /* Only used by uv_timer_t handles. */
+  UV_HANDLE_TIMER_NS                    = 0x01000000,
+
+  /* Only used by uv_prepare_t, uv_check_t and uv_idle_t handles. */
+  UV_HANDLE_ONE_SHOT                    = 0x01000000
 };
 
 int uv__loop_configure(uv_loop_t* loop, uv_loop_option option, va_list ap);
@@ -149,25 +165,57 @@ int uv__udp_send(uv_udp_send_t* req,
                  unsigned int addrlen,
                  uv_udp_send_cb send_cb);
 
+int uv__udp_send_ex(uv_udp_send_t* req,
+                    uv_udp_t* handle,
+                    const uv_buf_t bufs[],
+                    unsigned int nbufs,
+                    const struct sockaddr* addr,
+                    unsigned int addrlen,
+                    unsigned int gso_size,
+                    const struct sockaddr* src,
+                    int zerocopy,
+                    uint64_t txtime,
+                    uv_udp_send_cb send_cb);
+
+int uv__udp_send_batch(uv_udp_send_t reqs[],
+                       uv_udp_t* handle,
+                       const uv_buf_t bufs[],
+                       unsigned int count,
+                       const struct sockaddr* addr,
+                       unsigned int addrlen,
+                       uv_udp_send_cb send_cb);
+
 int uv__udp_try_send(uv_udp_t* handle,
                      const uv_buf_t bufs[],
                      unsigned int nbufs,
                      const struct sockaddr* addr,
                      unsigned int addrlen);
 
+int uv__udp_try_send_batch(uv_udp_t* handle,
+                           const uv_buf_t bufs[],
+                           unsigned int count,
+                           const struct sockaddr* addr,
+                           unsigned int addrlen);
+
 int uv__udp_recv_start(uv_udp_t* handle, uv_alloc_cb alloccb,
                        uv_udp_recv_cb recv_cb);
 
+int uv__udp_recv_start_ex(uv_udp_t* handle,
+                          uv_alloc_cb alloc_cb,
+                          uv_udp_recv_ex_cb recv_cb,
+                          unsigned int info_flags);
+
 int uv__udp_recv_stop(uv_udp_t* handle);
 
 void uv__fs_poll_close(uv_fs_poll_t* handle);
 
 int uv__getaddrinfo_translate_error(int sys_err);    /* EAI_* error. */
 
+/* 和uv_work_kind一一对应 */
 enum uv__work_kind {
-  UV__WORK_CPU,
-  UV__WORK_FAST_IO,
-  UV__WORK_SLOW_IO
+  UV__WORK_CPU = UV_WORK_KIND_CPU,
+  UV__WORK_FAST_IO = UV_WORK_KIND_FAST_IO,
+  UV__WORK_SLOW_IO = UV_WORK_KIND_SLOW_IO
 };
 
 void uv__work_submit(uv_loop_t* loop,
@@ -175,18 +223,194 @@ void uv__work_submit(uv_loop_t* loop,
                      enum uv__work_kind kind,
                      void (*work)(struct uv__work *w),
                      void (*done)(struct uv__work *w, int status));
+/* 同uv__work_submit()，但是带上uv_loop_set_work_deadline()设置的截止时间和
+ * uv_loop_set_work_timeout()设置的超时，done回调要能处理UV_ETIMEDOUT
+ */
+void uv__work_submit_deadline(uv_loop_t* loop,
+                              struct uv__work *w,
+                              enum uv__work_kind kind,
+                              void (*work)(struct uv__work *w),
+                              void (*done)(struct uv__work *w, int status));
 
 void uv__work_done(uv_async_t* handle);
+void uv__work_timeouts_delete(uv_loop_t* loop);
+
+void uv__work_complete(uv_loop_t* loop,
+                       struct uv__work* w,
+                       void (*done)(struct uv__work* w, int status));
+
+void uv__histogram_add(uv_phase_histogram_t* hist, uint64_t ns);
+
+void uv__buf_pool_alloc(uv_handle_t* handle,
+                        size_t suggested_size,
+                        uv_buf_t* buf);
 
 size_t uv__count_bufs(const uv_buf_t bufs[], unsigned int nbufs);
 
+/* uv_iobuf_t */
+void uv__iobuf_alloc(uv_handle_t* handle,
+                     size_t suggested_size,
+                     uv_buf_t* buf);
+size_t uv__iobuf_chunk_size(void);
+uv_shared_buf_t* uv__iobuf_owner(const uv_buf_t* buf);
+int uv__iobuf_hold(const uv_iobuf_t* iob,
+                   uv_shared_buf_t*** owners,
+                   unsigned int* nowners);
+void uv__iobuf_drop(uv_shared_buf_t** owners, unsigned int nowners);
+
 int uv__socket_sockopt(uv_handle_t* handle, int optname, int* value);
 
 void uv__fs_scandir_cleanup(uv_fs_t* req);
+void uv__fs_scandir_account(uv__dirent_t** dents, int n);
+void uv__fs_readdir_cleanup(uv_fs_t* req);
+uv_dirent_type_t uv__fs_get_dirent_type(uv__dirent_t* dent);
 
 int uv__next_timeout(const uv_loop_t* loop);
+uint64_t uv__next_timer_due(const uv_loop_t* loop);
 void uv__run_timers(uv_loop_t* loop);
 void uv__timer_close(uv_timer_t* handle);
+int uv__timer_wheel_enable(uv_loop_t* loop);
+int uv__fs_poll_groups_enable(uv_loop_t* loop);
+/* 纳秒定时器，超时时间按uv_hrtime()计，放在单独的hrtimer_heap里，由内核
+ * 定时器唤醒loop：Linux上是loop的timerfd，macOS上是kqueue的EVFILT_TIMER
+ */
+#if defined(__linux__) || defined(__APPLE__)
+# define UV__HRTIMER 1
+void uv__run_hrtimers(uv_loop_t* loop);
+int uv__hrtimer_init(uv_loop_t* loop);
+void uv__hrtimer_arm(uv_loop_t* loop, uint64_t deadline);
+#endif
+#if defined(__linux__)
+/* NUMA节点上的CPU，格式同uv_thread_setaffinity()的cpumask */
+int uv__numa_node_cpumask(int node, char* cpumask, size_t mask_size);
+#endif
+
+/* USDT静态探针，provider为libuv，SystemTap、bpftrace和DTrace都能挂上去，例如
+ * bpftrace -e 'usdt:./libuv.so:libuv:poll__start { ... }'。编译时定义
+ * UV_USDT_PROBES才会生成，需要<sys/sdt.h>（Linux上由systemtap-sdt-dev提供）；
+ * 探针本身只是一条nop，没有挂tracer时没有开销。不定义时宏展开为空
+ */
+#if defined(UV_USDT_PROBES)
+# include <sys/sdt.h>
+# define UV__PROBE1(name, a1)                                                 \
+  DTRACE_PROBE1(libuv, name, a1)
+# define UV__PROBE2(name, a1, a2)                                             \
+  DTRACE_PROBE2(libuv, name, a1, a2)
+# define UV__PROBE3(name, a1, a2, a3)                                         \
+  DTRACE_PROBE3(libuv, name, a1, a2, a3)
+# define UV__PROBE4(name, a1, a2, a3, a4)                                     \
+  DTRACE_PROBE4(libuv, name, a1, a2, a3, a4)
+#else
+# define UV__PROBE1(name, a1) do {} while (0)
+# define UV__PROBE2(name, a1, a2) do {} while (0)
+# define UV__PROBE3(name, a1, a2, a3) do {} while (0)
+# define UV__PROBE4(name, a1, a2, a3, a4) do {} while (0)
+#endif
+
+/* 看门狗，loop->watchdog指向它。前四个字段由loop线程在派发回调前后写，看门狗
+ * 线程只读：seq为奇数表示loop正在执行回调，seq在两次检查之间没有变化就说明
+ * 还是同一个回调。写法同seqlock：loop线程在seq变为偶数之后才改其他字段，改完
+ * 再把seq变为奇数，看门狗线程读seq、读字段、再读一次seq，两次相同才用这份快照。
+ * depth是记下当前回调时的嵌套层数，0表示没有记，只有loop线程访问。
+ */
+struct uv__watchdog {
+  volatile unsigned int seq;
+  volatile uv_handle_type type;
+  void* volatile handle;
+  void* volatile cb;
+  int depth;
+  uv_loop_t* loop;
+  uv_watchdog_cb watchdog_cb;
+  uint64_t threshold;
+  uv_thread_t thread;
+  uv_mutex_t mutex;
+  uv_cond_t cond;
+  int stop;
+};
+
+/* 看门狗的seq和其他字段之间的读写顺序，x86上只是编译器屏障 */
+#if defined(__ATOMIC_RELEASE)
+# define uv__watchdog_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+# define uv__watchdog_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#elif defined(_MSC_VER)
+# define uv__watchdog_wmb() MemoryBarrier()
+# define uv__watchdog_rmb() MemoryBarrier()
+#else
+# define uv__watchdog_wmb() __sync_synchronize()
+# define uv__watchdog_rmb() __sync_synchronize()
+#endif
+
+/* I/O watcher的回调先只记下watcher，读的时候再找它属于哪个handle */
+#define UV__DISPATCH_IO -1
+
+/* 记下loop正在派发的回调，给uv_loop_dispatch_info()用。同一个线程上的信号
+ * 处理函数随时可能打断这里，所以字段都是volatile，写之前seq先变成奇数，写完
+ * 再变回偶数。depth是嵌套的层数
+ */
+#define uv__dispatch_enter(loop, t, h, c)                                     \
+  do {                                                                        \
+    (loop)->dispatch.seq++;                                                   \
+    (loop)->dispatch.type = (int) (t);                                        \
+    (loop)->dispatch.handle = (void*) (h);                                    \
+    (loop)->dispatch.cb = (void*) (c);                                        \
+    (loop)->dispatch.depth++;                                                 \
+    (loop)->dispatch.seq++;                                                   \
+  }                                                                           \
+  while (0)
+
+/* 看门狗启动时记录即将执行的回调，seq变为一个新的奇数。回调里可能再派发回调
+ * （比如在回调里uv_run()），只记最外层的那个，否则内层返回时seq变成偶数，
+ * 外层剩下的时间就看不到了
+ */
+#define uv__watchdog_note(loop, t, h, c)                                      \
+  do {                                                                        \
+    struct uv__watchdog* wd_;                                                 \
+    wd_ = (loop)->watchdog;                                                   \
+    if (wd_ != NULL && wd_->depth == 0) {                                     \
+      wd_->depth = (loop)->dispatch.depth;                                    \
+      uv__watchdog_wmb();                                                     \
+      wd_->type = (t);                                                        \
+      wd_->handle = (h);                                                      \
+      wd_->cb = (void*) (c);                                                  \
+      uv__watchdog_wmb();                                                     \
+      wd_->seq = (wd_->seq + 2) | 1;                                          \
+    }                                                                         \
+  }                                                                           \
+  while (0)
+
+/* 所有回调都由这两个宏包着派发，callback__start/callback__done探针也放在
+ * 这里
+ */
+#define uv__watchdog_enter(loop, t, h, c)                                     \
+  do {                                                                        \
+    UV__PROBE4(callback__start, (loop), (int) (t), (h), (void*) (c));         \
+    uv__dispatch_enter((loop), (t), (h), (c));                                \
+    uv__watchdog_note((loop), (t), (h), (c));                                 \
+  }                                                                           \
+  while (0)
+
+/* 内部的回调只是再派发用户的回调，看门狗不记它，记里面的 */
+#define uv__watchdog_enter_internal(loop, t, h, c)                            \
+  do {                                                                        \
+    UV__PROBE4(callback__start, (loop), (int) (t), (h), (void*) (c));         \
+    uv__dispatch_enter((loop), (t), (h), (c));                                \
+  }                                                                           \
+  while (0)
+
+/* 记下的那个回调返回，seq变为偶数。回调里才启动的看门狗seq还是偶数，保持不变 */
+#define uv__watchdog_leave(loop)                                              \
+  do {                                                                        \
+    struct uv__watchdog* wd_;                                                 \
+    wd_ = (loop)->watchdog;                                                   \
+    if (wd_ != NULL && wd_->depth == (loop)->dispatch.depth) {                \
+      wd_->depth = 0;                                                         \
+      uv__watchdog_wmb();                                                     \
+      wd_->seq = (wd_->seq + 1) & ~1u;                                        \
+    }                                                                         \
+    (loop)->dispatch.depth--;                                                 \
+    UV__PROBE1(callback__done, (loop));                                       \
+  }                                                                           \
+  while (0)
 
 #define uv__has_active_reqs(loop)                                             \
   ((loop)->active_reqs.count > 0)
@@ -273,11 +497,18 @@ void uv__timer_close(uv_timer_t* handle);
     (h)->loop = (loop_);                                                      \
     (h)->type = (type_);                                                      \
     (h)->flags = UV_HANDLE_REF;  /* Ref the loop when active. */              \
+    (h)->activity_time = (loop_)->time;                                       \
     QUEUE_INSERT_TAIL(&(loop_)->handle_queue, &(h)->handle_queue);            \
     uv__handle_platform_init(h);                                              \
   }                                                                           \
   while (0)
 
+/* handle有事件要处理或者回调要执行，记下loop的时间，uv_loop_dump_handles()
+ * 用它算出handle空闲了多久。用的是缓存的loop->time，不读时钟
+ */
+#define uv__handle_activity(h)                                                \
+  ((h)->activity_time = (h)->loop->time)
+
 /* Note: uses an open-coded version of SET_REQ_SUCCESS() because of
  * a circular dependency between src/uv-common.h and src/win/internal.h.
  */
@@ -310,6 +541,11 @@ char *uv__strndup(const char* s, size_t n);
 void* uv__malloc(size_t size);
 void uv__free(void* ptr);
 void* uv__realloc(void* ptr, size_t size);
+void uv__mem_account(unsigned int tag, long bytes, int count);
+/* 大页映射按2MB取整，小于这个大小的不值得单独映射 */
+#define UV__HUGEPAGE_SIZE ((size_t) 2 << 20)
+void* uv__hugepage_map(size_t* size);
+void uv__hugepage_unmap(void* p, size_t size);
 
 /* Loop watcher prototypes */
 void uv__idle_close(uv_idle_t* handle);
@@ -0,0 +1,500 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "task.h"
+#include "uv.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Run every benchmark for this many ms */
+#define TIME 2000
+
+#define FILE_NAME "fs_io_bench_file"
+#define COPY_NAME "fs_io_bench_copy"
+#define DIR_NAME "fs_io_bench_dir"
+#define FILE_SIZE (32 * 1024 * 1024)
+#define MAX_DEPTH 64
+#define MAX_SAMPLES (4 * 1024 * 1024)
+#define SENDFILE_CHUNK (1024 * 1024)
+#define SCANDIR_FILES 10000
+
+/* Every request is timed individually; the samples are sorted at the end to
+ * get exact percentiles.  The file is small enough to stay in the page cache,
+ * so this measures the cost of getting a request through libuv rather than
+ * the disk.
+ */
+struct io_req {
+  uv_fs_t req;
+  uv_buf_t buf;
+  uint64_t start;
+};
+
+static struct io_req io_reqs[MAX_DEPTH];
+static uint64_t* samples;
+static size_t nsamples;
+static uint64_t nbytes;
+static uint64_t deadline;
+static int64_t next_offset;
+static int do_write;
+static int do_random;
+static size_t block_size;
+static uv_os_fd_t file;
+
+
+static void samples_init(void) {
+  samples = malloc(MAX_SAMPLES * sizeof(*samples));
+  ASSERT(samples != NULL);
+  nsamples = 0;
+  nbytes = 0;
+}
+
+
+static void samples_add(uint64_t start, ssize_t result) {
+  ASSERT(result >= 0);
+  nbytes += result;
+  if (nsamples < MAX_SAMPLES)
+    samples[nsamples++] = uv_hrtime() - start;
+}
+
+
+static int compare_samples(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+  return x < y ? -1 : x > y;
+}
+
+
+static double percentile(double p) {
+  size_t i;
+
+  i = (size_t) (nsamples * p / 100.0);
+  if (i >= nsamples)
+    i = nsamples - 1;
+
+  return samples[i] / 1e3;
+}
+
+
+/* nbytes counts bytes, or directory entries for scandir. */
+static void report(const char* name, uint64_t elapsed, int entries) {
+  const char* unit;
+  double volume;
+  double seconds;
+
+  ASSERT(nsamples > 0);
+  qsort(samples, nsamples, sizeof(*samples), compare_samples);
+  seconds = elapsed / 1e9;
+  if (entries) {
+    unit = "entries/s";
+    volume = nbytes / seconds;
+  } else {
+    unit = "MB/s";
+    volume = nbytes / seconds / (1024 * 1024);
+  }
+
+  fprintf(stderr,
+          "%s: %.0f ops/s, %.1f %s, "
+          "p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+          name,
+          nsamples / seconds,
+          volume,
+          unit,
+          percentile(50),
+          percentile(99),
+          percentile(99.9),
+          samples[nsamples - 1] / 1e3);
+  fflush(stderr);
+
+  benchmark_report("ops", nsamples / seconds, "ops/s");
+  benchmark_report("throughput", volume, unit);
+  benchmark_report("p50", percentile(50), "us");
+  benchmark_report("p99", percentile(99), "us");
+  benchmark_report("p99.9", percentile(99.9), "us");
+
+  free(samples);
+  samples = NULL;
+}
+
+
+static uv_os_fd_t open_file(const char* path, int flags) {
+  uv_os_fd_t fd;
+  uv_fs_t req;
+
+  ASSERT(uv_fs_open(NULL, &req, path, flags, 0644, NULL) >= 0);
+  fd = (uv_os_fd_t) req.result;
+  uv_fs_req_cleanup(&req);
+  return fd;
+}
+
+
+static void create_file(const char* path, size_t size) {
+  uv_fs_t req;
+  uv_buf_t buf;
+  uv_os_fd_t fd;
+  char* data;
+  size_t off;
+  int r;
+
+  data = malloc(SENDFILE_CHUNK);
+  ASSERT(data != NULL);
+  memset(data, 'x', SENDFILE_CHUNK);
+  buf = uv_buf_init(data, SENDFILE_CHUNK);
+
+  fd = open_file(path, O_RDWR | O_CREAT | O_TRUNC);
+
+  for (off = 0; off < size; off += SENDFILE_CHUNK) {
+    r = uv_fs_write(NULL, &req, fd, &buf, 1, off, NULL);
+    ASSERT(r == SENDFILE_CHUNK);
+    uv_fs_req_cleanup(&req);
+  }
+
+  ASSERT(0 == uv_fs_close(NULL, &req, fd, NULL));
+  uv_fs_req_cleanup(&req);
+  free(data);
+}
+
+
+static void remove_file(const char* path) {
+  uv_fs_t req;
+
+  uv_fs_unlink(NULL, &req, path, NULL);
+  uv_fs_req_cleanup(&req);
+}
+
+
+static int64_t pick_offset(void) {
+  int64_t offset;
+  int64_t nblocks;
+
+  nblocks = FILE_SIZE / block_size;
+  if (do_random)
+    return (int64_t) ((((uint64_t) rand() << 16) ^ rand()) % nblocks) *
+           block_size;
+
+  offset = next_offset;
+  next_offset += block_size;
+  if (next_offset + (int64_t) block_size > FILE_SIZE)
+    next_offset = 0;
+
+  return offset;
+}
+
+
+static void rw_cb(uv_fs_t* req);
+
+
+static void rw_submit(struct io_req* ioreq) {
+  int64_t offset;
+
+  offset = pick_offset();
+  ioreq->start = uv_hrtime();
+  if (do_write)
+    ASSERT(0 == uv_fs_write(uv_default_loop(),
+                            &ioreq->req,
+                            file,
+                            &ioreq->buf,
+                            1,
+                            offset,
+                            rw_cb));
+  else
+    ASSERT(0 == uv_fs_read(uv_default_loop(),
+                           &ioreq->req,
+                           file,
+                           &ioreq->buf,
+                           1,
+                           offset,
+                           rw_cb));
+}
+
+
+static void rw_cb(uv_fs_t* req) {
+  struct io_req* ioreq;
+
+  ioreq = container_of(req, struct io_req, req);
+  ASSERT(req->result == (ssize_t) block_size);
+  samples_add(ioreq->start, req->result);
+  uv_fs_req_cleanup(req);
+
+  if (uv_hrtime() < deadline)
+    rw_submit(ioreq);
+}
+
+
+static int fs_rw(const char* name,
+                 int write,
+                 int random,
+                 size_t bs,
+                 unsigned int depth) {
+  uv_fs_t req;
+  uint64_t start;
+  unsigned int i;
+
+  ASSERT(depth <= MAX_DEPTH);
+  do_write = write;
+  do_random = random;
+  block_size = bs;
+  next_offset = 0;
+  srand(1);
+
+  create_file(FILE_NAME, FILE_SIZE);
+  file = open_file(FILE_NAME, O_RDWR);
+
+  for (i = 0; i < depth; i++) {
+    io_reqs[i].buf = uv_buf_init(malloc(bs), bs);
+    ASSERT(io_reqs[i].buf.base != NULL);
+    memset(io_reqs[i].buf.base, 'y', bs);
+  }
+
+  samples_init();
+  start = uv_hrtime();
+  deadline = start + TIME * (uint64_t) 1e6;
+  for (i = 0; i < depth; i++)
+    rw_submit(&io_reqs[i]);
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  report(name, uv_hrtime() - start, 0);
+
+  for (i = 0; i < depth; i++)
+    free(io_reqs[i].buf.base);
+
+  ASSERT(0 == uv_fs_close(NULL, &req, file, NULL));
+  uv_fs_req_cleanup(&req);
+  remove_file(FILE_NAME);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static uv_os_fd_t sendfile_out;
+static int64_t sendfile_offset;
+
+
+static void sendfile_cb(uv_fs_t* req) {
+  struct io_req* ioreq;
+
+  ioreq = container_of(req, struct io_req, req);
+  samples_add(ioreq->start, req->result);
+  uv_fs_req_cleanup(req);
+
+  if (uv_hrtime() >= deadline)
+    return;
+
+  sendfile_offset += SENDFILE_CHUNK;
+  if (sendfile_offset >= FILE_SIZE)
+    sendfile_offset = 0;
+
+  ioreq->start = uv_hrtime();
+  ASSERT(0 == uv_fs_sendfile(uv_default_loop(),
+                             req,
+                             sendfile_out,
+                             file,
+                             sendfile_offset,
+                             SENDFILE_CHUNK,
+                             sendfile_cb));
+}
+
+
+/* Pages go from the source straight into the page cache of a second file;
+ * latency is per SENDFILE_CHUNK.
+ */
+BENCHMARK_IMPL(fs_sendfile) {
+  uv_fs_t req;
+  uint64_t start;
+
+  create_file(FILE_NAME, FILE_SIZE);
+  file = open_file(FILE_NAME, O_RDONLY);
+  sendfile_out = open_file(COPY_NAME, O_WRONLY | O_CREAT | O_TRUNC);
+
+  samples_init();
+  sendfile_offset = 0;
+  start = uv_hrtime();
+  deadline = start + TIME * (uint64_t) 1e6;
+  io_reqs[0].start = start;
+  ASSERT(0 == uv_fs_sendfile(uv_default_loop(),
+                             &io_reqs[0].req,
+                             sendfile_out,
+                             file,
+                             0,
+                             SENDFILE_CHUNK,
+                             sendfile_cb));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  report("fs_sendfile", uv_hrtime() - start, 0);
+
+  ASSERT(0 == uv_fs_close(NULL, &req, sendfile_out, NULL));
+  uv_fs_req_cleanup(&req);
+  ASSERT(0 == uv_fs_close(NULL, &req, file, NULL));
+  uv_fs_req_cleanup(&req);
+  remove_file(COPY_NAME);
+  remove_file(FILE_NAME);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void copyfile_cb(uv_fs_t* req) {
+  struct io_req* ioreq;
+
+  ioreq = container_of(req, struct io_req, req);
+  ASSERT(req->result == 0);
+  samples_add(ioreq->start, FILE_SIZE);
+  uv_fs_req_cleanup(req);
+
+  if (uv_hrtime() >= deadline)
+    return;
+
+  ioreq->start = uv_hrtime();
+  ASSERT(0 == uv_fs_copyfile(uv_default_loop(),
+                             req,
+                             FILE_NAME,
+                             COPY_NAME,
+                             0,
+                             copyfile_cb));
+}
+
+
+BENCHMARK_IMPL(fs_copyfile) {
+  uint64_t start;
+
+  create_file(FILE_NAME, FILE_SIZE);
+
+  samples_init();
+  start = uv_hrtime();
+  deadline = start + TIME * (uint64_t) 1e6;
+  io_reqs[0].start = start;
+  ASSERT(0 == uv_fs_copyfile(uv_default_loop(),
+                             &io_reqs[0].req,
+                             FILE_NAME,
+                             COPY_NAME,
+                             0,
+                             copyfile_cb));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  report("fs_copyfile", uv_hrtime() - start, 0);
+
+  remove_file(COPY_NAME);
+  remove_file(FILE_NAME);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void scandir_cb(uv_fs_t* req) {
+  struct io_req* ioreq;
+
+  ioreq = container_of(req, struct io_req, req);
+  ASSERT(req->result == SCANDIR_FILES);
+  samples_add(ioreq->start, req->result);
+  uv_fs_req_cleanup(req);
+
+  if (uv_hrtime() >= deadline)
+    return;
+
+  ioreq->start = uv_hrtime();
+  ASSERT(0 == uv_fs_scandir(uv_default_loop(), req, DIR_NAME, 0, scandir_cb));
+}
+
+
+BENCHMARK_IMPL(fs_scandir) {
+  char path[64];
+  uv_fs_t req;
+  uv_os_fd_t fd;
+  uint64_t start;
+  int i;
+
+  uv_fs_mkdir(NULL, &req, DIR_NAME, 0755, NULL);
+  uv_fs_req_cleanup(&req);
+  for (i = 0; i < SCANDIR_FILES; i++) {
+    snprintf(path, sizeof(path), "%s/file_%05d", DIR_NAME, i);
+    fd = open_file(path, O_WRONLY | O_CREAT);
+    uv_fs_close(NULL, &req, fd, NULL);
+    uv_fs_req_cleanup(&req);
+  }
+
+  samples_init();
+  start = uv_hrtime();
+  deadline = start + TIME * (uint64_t) 1e6;
+  io_reqs[0].start = start;
+  ASSERT(0 == uv_fs_scandir(uv_default_loop(),
+                            &io_reqs[0].req,
+                            DIR_NAME,
+                            0,
+                            scandir_cb));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  report("fs_scandir", uv_hrtime() - start, 1);
+
+  for (i = 0; i < SCANDIR_FILES; i++) {
+    snprintf(path, sizeof(path), "%s/file_%05d", DIR_NAME, i);
+    remove_file(path);
+  }
+  uv_fs_rmdir(NULL, &req, DIR_NAME, NULL);
+  uv_fs_req_cleanup(&req);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+BENCHMARK_IMPL(fs_read_seq_4k_qd1) {
+  return fs_rw("fs_read_seq_4k_qd1", 0, 0, 4096, 1);
+}
+
+
+BENCHMARK_IMPL(fs_read_seq_64k_qd1) {
+  return fs_rw("fs_read_seq_64k_qd1", 0, 0, 65536, 1);
+}
+
+
+BENCHMARK_IMPL(fs_read_seq_1m_qd4) {
+  return fs_rw("fs_read_seq_1m_qd4", 0, 0, 1024 * 1024, 4);
+}
+
+
+BENCHMARK_IMPL(fs_read_rand_4k_qd1) {
+  return fs_rw("fs_read_rand_4k_qd1", 0, 1, 4096, 1);
+}
+
+
+BENCHMARK_IMPL(fs_read_rand_4k_qd32) {
+  return fs_rw("fs_read_rand_4k_qd32", 0, 1, 4096, 32);
+}
+
+
+BENCHMARK_IMPL(fs_write_seq_4k_qd1) {
+  return fs_rw("fs_write_seq_4k_qd1", 1, 0, 4096, 1);
+}
+
+
+BENCHMARK_IMPL(fs_write_seq_64k_qd4) {
+  return fs_rw("fs_write_seq_64k_qd4", 1, 0, 65536, 4);
+}
+
+
+BENCHMARK_IMPL(fs_write_rand_4k_qd32) {
+  return fs_rw("fs_write_rand_4k_qd32", 1, 1, 4096, 32);
+}
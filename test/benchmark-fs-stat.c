@@ -28,6 +28,7 @@
 #define NUM_SYNC_REQS         (10 * 1e5)
 #define NUM_ASYNC_REQS        (1 * (int) 1e5)
 #define MAX_CONCURRENT_REQS   32
+#define BATCH_SIZE            1000
 
 #define sync_stat(req, path)                                                  \
   do {                                                                        \
@@ -121,6 +122,41 @@ static void async_bench(const char* path) {
 }
 
 
+static void batch_stat_cb(uv_fs_t* fs_req) {
+  uv_fs_req_cleanup(fs_req);
+}
+
+
+/* 和async_bench一样的stat次数，每BATCH_SIZE个放进一个uv_fs_batch() */
+static void batch_bench(const char* path) {
+  static uv_fs_t reqs[BATCH_SIZE];
+  uv_fs_t batch_req;
+  uint64_t before;
+  uint64_t after;
+  int count;
+  int i;
+
+  before = uv_hrtime();
+
+  for (count = 0; count < NUM_ASYNC_REQS; count += BATCH_SIZE) {
+    ASSERT(0 == uv_fs_batch(uv_default_loop(), &batch_req, batch_stat_cb));
+    for (i = 0; i < BATCH_SIZE; i++)
+      uv_fs_stat(uv_default_loop(), reqs + i, path, batch_stat_cb);
+    ASSERT(0 == uv_fs_batch_submit(uv_default_loop(), &batch_req));
+    uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+  }
+
+  after = uv_hrtime();
+
+  printf("%s stats (batches of %d): %.2fs (%s/s)\n",
+         fmt(1.0 * NUM_ASYNC_REQS),
+         BATCH_SIZE,
+         (after - before) / 1e9,
+         fmt((1.0 * NUM_ASYNC_REQS) / ((after - before) / 1e9)));
+  fflush(stdout);
+}
+
+
 /* This benchmark aims to measure the overhead of doing I/O syscalls from
  * the thread pool. The stat() syscall was chosen because its results are
  * easy for the operating system to cache, taking the actual I/O overhead
@@ -131,6 +167,7 @@ BENCHMARK_IMPL(fs_stat) {
   warmup(path);
   sync_bench(path);
   async_bench(path);
+  batch_bench(path);
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
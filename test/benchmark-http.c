@@ -0,0 +1,443 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Run the benchmark for this many ms */
+#define TIME 5000
+
+#define NUM_CLIENTS 100
+/* Every CLOSE_EVERY'th client sends one request per connection, shuts down
+ * its side and reconnects once the server has closed; the others keep the
+ * connection alive.
+ */
+#define CLOSE_EVERY 4
+
+/* An HTTP-like server: every request ("...\r\n\r\n") gets a small response
+ * made of more iovecs than fit in uv_write_t's bufsml, the way a server
+ * that keeps status line, headers and body in separate buffers writes it.
+ * The server runs on the main thread and the clients on a second one, so
+ * the server's read and write syscalls can be counted on its own thread.
+ */
+static const char request_str[] = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+static const char* response_parts[] = {
+  "HTTP/1.1 200 OK\r\n",
+  "Server: libuv\r\n",
+  "Content-Type: text/plain\r\n",
+  "Content-Length: 13\r\n",
+  "\r\n",
+  "Hello, world!"
+};
+
+#define NUM_PARTS ARRAY_SIZE(response_parts)
+
+typedef struct {
+  uv_tcp_t handle;
+  uv_shutdown_t shutdown_req;
+  /* How much of "\r\n\r\n" has been seen. */
+  int state;
+} server_conn_t;
+
+typedef struct {
+  uv_tcp_t handle;
+  uv_connect_t connect_req;
+  uv_shutdown_t shutdown_req;
+  size_t received;
+  int keepalive;
+} client_t;
+
+static uv_loop_t* server_loop;
+static uv_tcp_t server;
+static uv_async_t stop_async;
+static uv_buf_t response_bufs[NUM_PARTS];
+static size_t response_len;
+static int use_try_write;
+static uint64_t responses;
+static uint64_t try_write_partial;
+
+static uv_loop_t client_loop;
+static client_t clients[NUM_CLIENTS];
+static struct sockaddr_in addr;
+static uint64_t client_responses;
+static int clients_stopped;
+
+static char slab[65536];
+
+
+/* syscr and syscw of the calling thread: read(2)/readv(2) and write(2)/
+ * writev(2) style calls, which is what uv__read() and uv__write() use.
+ * Returns -1 where the kernel does not provide them.
+ */
+static int read_syscalls(uint64_t* reads, uint64_t* writes) {
+  char line[128];
+  unsigned long long value;
+  FILE* f;
+  int found;
+
+  f = fopen("/proc/thread-self/io", "r");
+  if (f == NULL)
+    return -1;
+
+  found = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (sscanf(line, "syscr: %llu", &value) == 1) {
+      *reads = value;
+      found++;
+    } else if (sscanf(line, "syscw: %llu", &value) == 1) {
+      *writes = value;
+      found++;
+    }
+  }
+
+  fclose(f);
+  return found == 2 ? 0 : -1;
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  *buf = uv_buf_init(slab, sizeof(slab));
+}
+
+
+static void server_close_cb(uv_handle_t* handle) {
+  free(handle->data);
+}
+
+
+static void server_write_cb(uv_write_t* req, int status) {
+  /* Clients that go away at the end of the run may reset the connection. */
+  free(req);
+}
+
+
+static void server_respond(server_conn_t* conn) {
+  uv_buf_t bufs[NUM_PARTS];
+  uv_write_t* req;
+  unsigned int n;
+  unsigned int i;
+  int r;
+
+  responses++;
+  memcpy(bufs, response_bufs, sizeof(bufs));
+  n = NUM_PARTS;
+
+  if (use_try_write) {
+    r = uv_try_write((uv_stream_t*) &conn->handle, bufs, n);
+    if (r == (int) response_len)
+      return;
+
+    ASSERT(r >= 0 || r == UV_EAGAIN);
+    try_write_partial++;
+
+    /* Queue whatever the kernel did not take. */
+    for (i = 0; r > 0; i++) {
+      if ((size_t) r < bufs[i].len) {
+        bufs[i].base += r;
+        bufs[i].len -= r;
+        break;
+      }
+      r -= bufs[i].len;
+    }
+    memmove(bufs, bufs + i, (n - i) * sizeof(bufs[0]));
+    n -= i;
+  }
+
+  req = malloc(sizeof(*req));
+  ASSERT(req != NULL);
+  ASSERT(0 == uv_write(req,
+                       (uv_stream_t*) &conn->handle,
+                       bufs,
+                       n,
+                       server_write_cb));
+}
+
+
+static void server_shutdown_cb(uv_shutdown_t* req, int status) {
+  if (!uv_is_closing((uv_handle_t*) req->handle))
+    uv_close((uv_handle_t*) req->handle, server_close_cb);
+}
+
+
+static void server_read_cb(uv_stream_t* stream,
+                           ssize_t nread,
+                           const uv_buf_t* buf) {
+  static const char terminator[] = "\r\n\r\n";
+  server_conn_t* conn;
+  ssize_t i;
+
+  conn = stream->data;
+
+  if (nread == UV_EOF) {
+    /* The client is done; answer with a FIN once our writes are out. */
+    ASSERT(0 == uv_shutdown(&conn->shutdown_req,
+                            stream,
+                            server_shutdown_cb));
+    return;
+  }
+
+  if (nread < 0) {
+    uv_close((uv_handle_t*) stream, server_close_cb);
+    return;
+  }
+
+  for (i = 0; i < nread; i++) {
+    if (buf->base[i] == terminator[conn->state])
+      conn->state++;
+    else
+      conn->state = buf->base[i] == '\r';
+
+    if (conn->state == 4) {
+      conn->state = 0;
+      server_respond(conn);
+    }
+  }
+}
+
+
+static void connection_cb(uv_stream_t* listener, int status) {
+  server_conn_t* conn;
+
+  ASSERT(status == 0);
+  conn = calloc(1, sizeof(*conn));
+  ASSERT(conn != NULL);
+  ASSERT(0 == uv_tcp_init(server_loop, &conn->handle));
+  conn->handle.data = conn;
+  ASSERT(0 == uv_accept(listener, (uv_stream_t*) &conn->handle));
+  ASSERT(0 == uv_tcp_nodelay(&conn->handle, 1));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &conn->handle,
+                            alloc_cb,
+                            server_read_cb));
+}
+
+
+static void server_walk_cb(uv_handle_t* handle, void* arg) {
+  if (uv_is_closing(handle))
+    return;
+
+  if (handle->type == UV_TCP && handle != (uv_handle_t*) &server)
+    uv_close(handle, server_close_cb);
+  else
+    uv_close(handle, NULL);
+}
+
+
+static void stop_async_cb(uv_async_t* handle) {
+  uv_walk(server_loop, server_walk_cb, NULL);
+}
+
+
+static void client_connect(client_t* client);
+
+
+static void client_close_cb(uv_handle_t* handle) {
+  client_t* client;
+
+  client = handle->data;
+  if (!clients_stopped)
+    client_connect(client);
+}
+
+
+static void client_send(client_t* client) {
+  uv_buf_t buf;
+
+  /* The socket has nothing queued, so this never comes up short. */
+  buf = uv_buf_init((char*) request_str, sizeof(request_str) - 1);
+  ASSERT(sizeof(request_str) - 1 ==
+         uv_try_write((uv_stream_t*) &client->handle, &buf, 1));
+  client->received = 0;
+}
+
+
+static void client_shutdown_cb(uv_shutdown_t* req, int status) {
+  ASSERT(status == 0 || status == UV_ECANCELED);
+}
+
+
+static void client_read_cb(uv_stream_t* stream,
+                           ssize_t nread,
+                           const uv_buf_t* buf) {
+  client_t* client;
+
+  client = stream->data;
+
+  if (nread < 0) {
+    /* Non-keepalive clients see the server's FIN after each response. */
+    if (!uv_is_closing((uv_handle_t*) stream))
+      uv_close((uv_handle_t*) stream, client_close_cb);
+    return;
+  }
+
+  client->received += nread;
+  ASSERT(client->received <= response_len);
+  if (client->received < response_len)
+    return;
+
+  client_responses++;
+  if (client->keepalive && !clients_stopped)
+    client_send(client);
+}
+
+
+static void client_connect_cb(uv_connect_t* req, int status) {
+  client_t* client;
+
+  client = req->handle->data;
+  if (status == UV_ECANCELED)
+    return;
+
+  ASSERT(status == 0);
+  ASSERT(0 == uv_read_start(req->handle, alloc_cb, client_read_cb));
+  client_send(client);
+
+  if (!client->keepalive)
+    ASSERT(0 == uv_shutdown(&client->shutdown_req,
+                            req->handle,
+                            client_shutdown_cb));
+}
+
+
+static void client_connect(client_t* client) {
+  ASSERT(0 == uv_tcp_init(&client_loop, &client->handle));
+  client->handle.data = client;
+  ASSERT(0 == uv_tcp_nodelay(&client->handle, 1));
+  ASSERT(0 == uv_tcp_connect(&client->connect_req,
+                             &client->handle,
+                             (const struct sockaddr*) &addr,
+                             client_connect_cb));
+}
+
+
+static void client_timer_cb(uv_timer_t* handle) {
+  int i;
+
+  clients_stopped = 1;
+  for (i = 0; i < NUM_CLIENTS; i++)
+    if (!uv_is_closing((uv_handle_t*) &clients[i].handle))
+      uv_close((uv_handle_t*) &clients[i].handle, NULL);
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+static void client_thread(void* arg) {
+  uv_timer_t timer;
+  int i;
+
+  ASSERT(0 == uv_loop_init(&client_loop));
+  for (i = 0; i < NUM_CLIENTS; i++) {
+    clients[i].keepalive = i % CLOSE_EVERY != 0;
+    client_connect(&clients[i]);
+  }
+
+  ASSERT(0 == uv_timer_init(&client_loop, &timer));
+  ASSERT(0 == uv_timer_start(&timer, client_timer_cb, TIME, 0));
+
+  ASSERT(0 == uv_run(&client_loop, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_close(&client_loop));
+
+  ASSERT(0 == uv_async_send(&stop_async));
+}
+
+
+static int http_bench(const char* name, int try_write) {
+  uv_thread_t thread;
+  uint64_t reads_before;
+  uint64_t writes_before;
+  uint64_t reads_after;
+  uint64_t writes_after;
+  int have_syscalls;
+  unsigned int i;
+
+  server_loop = uv_default_loop();
+  use_try_write = try_write;
+  responses = 0;
+  try_write_partial = 0;
+  client_responses = 0;
+  clients_stopped = 0;
+
+  response_len = 0;
+  for (i = 0; i < NUM_PARTS; i++) {
+    response_bufs[i] = uv_buf_init((char*) response_parts[i],
+                                   strlen(response_parts[i]));
+    response_len += response_bufs[i].len;
+  }
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(server_loop, &server));
+  ASSERT(0 == uv_tcp_bind(&server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &server, 511, connection_cb));
+  ASSERT(0 == uv_async_init(server_loop, &stop_async, stop_async_cb));
+
+  have_syscalls = read_syscalls(&reads_before, &writes_before) == 0;
+  ASSERT(0 == uv_thread_create(&thread, client_thread, NULL));
+  ASSERT(0 == uv_run(server_loop, UV_RUN_DEFAULT));
+  if (have_syscalls)
+    have_syscalls = read_syscalls(&reads_after, &writes_after) == 0;
+  ASSERT(0 == uv_thread_join(&thread));
+
+  ASSERT(responses > 0);
+  ASSERT(client_responses <= responses);
+
+  fprintf(stderr,
+          "%s: %.0f responses/s",
+          name,
+          responses / (TIME / 1e3));
+  if (have_syscalls) {
+    fprintf(stderr,
+            ", %.2f write and %.2f read syscalls per response",
+            (double) (writes_after - writes_before) / responses,
+            (double) (reads_after - reads_before) / responses);
+  }
+  if (try_write)
+    fprintf(stderr,
+            ", %.2f%% short uv_try_write()",
+            100.0 * try_write_partial / responses);
+  fprintf(stderr, "\n");
+  fflush(stderr);
+
+  benchmark_report("responses", responses / (TIME / 1e3), "responses/s");
+  if (have_syscalls) {
+    benchmark_report("write_syscalls",
+                     (double) (writes_after - writes_before) / responses,
+                     "syscalls");
+    benchmark_report("read_syscalls",
+                     (double) (reads_after - reads_before) / responses,
+                     "syscalls");
+  }
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+BENCHMARK_IMPL(http_write) {
+  return http_bench("http_write", 0);
+}
+
+
+BENCHMARK_IMPL(http_try_write) {
+  return http_bench("http_try_write", 1);
+}
@@ -0,0 +1,333 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* 空闲连接的内存和循环开销。benchmark-sizes只打印结构体大小，这里建立N个
+ * 两端都在uv_read_start()的空闲连接（TCP或者unix域socket，两端都在本进程），
+ * 然后报告：
+ *
+ *   - 每个连接端的RSS增量（handle本身加上loop里的watcher等，不含内核的
+ *     socket内存），可以和benchmark-sizes的sizeof(uv_tcp_t)对照；
+ *   - 连接全部空闲时一次uv_run(UV_RUN_NOWAIT)的耗时；
+ *   - 空闲一秒内uv_run()的迭代（唤醒）次数，理想情况是只有结束用的定时器
+ *     那一次。
+ *
+ * 每个连接占两个fd，N受RLIMIT_NOFILE限制，超过的规模会被截到上限。
+ */
+
+#include "task.h"
+#include "uv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+# include <sys/resource.h>
+#endif
+
+#define WINDOW 128
+#define BACKLOG 511
+#define PORT_CONNS 20000 /* 每个监听端口的连接数，留出本地端口余量 */
+#define MAX_LISTENERS 64
+#define ITERATIONS 1000
+#define IDLE_MS 1000
+
+typedef union {
+  uv_handle_t handle;
+  uv_stream_t stream;
+  uv_tcp_t tcp;
+  uv_pipe_t pipe;
+} conn_t;
+
+static const unsigned int conn_counts[] = {
+  1000, 10 * 1000, 100 * 1000, 1000 * 1000
+};
+
+static conn_t listeners[MAX_LISTENERS];
+static unsigned int nlisteners;
+static struct sockaddr_in listen_addrs[MAX_LISTENERS];
+static uv_connect_t connect_reqs[WINDOW];
+static conn_t* clients;
+static conn_t* servers;
+static unsigned int nconns;
+static unsigned int nstarted;
+static unsigned int nconnected;
+static unsigned int naccepted;
+static int is_pipe;
+static char slab[65536];
+
+static void connect_cb(uv_connect_t* req, int status);
+
+
+static void alloc_cb(uv_handle_t* handle,
+                     size_t suggested_size,
+                     uv_buf_t* buf) {
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void read_cb(uv_stream_t* handle, ssize_t nread, const uv_buf_t* buf) {
+  /* 连接一直空闲，不应该有数据或者EOF */
+  ASSERT(nread == 0);
+}
+
+
+static void maybe_done(uv_loop_t* loop) {
+  if (nconnected == nconns && naccepted == nconns)
+    uv_stop(loop);
+}
+
+
+static void connect_next(uv_connect_t* req) {
+  conn_t* c;
+
+  c = clients + nstarted;
+  if (is_pipe) {
+    ASSERT(0 == uv_pipe_init(uv_default_loop(), &c->pipe, 0));
+    uv_pipe_connect(req, &c->pipe, TEST_PIPENAME, connect_cb);
+  } else {
+    ASSERT(0 == uv_tcp_init(uv_default_loop(), &c->tcp));
+    ASSERT(0 == uv_tcp_connect(req,
+                               &c->tcp,
+                               (const struct sockaddr*)
+                                   &listen_addrs[nstarted % nlisteners],
+                               connect_cb));
+  }
+  nstarted++;
+}
+
+
+static void connect_cb(uv_connect_t* req, int status) {
+  ASSERT(status == 0);
+  ASSERT(0 == uv_read_start(req->handle, alloc_cb, read_cb));
+  nconnected++;
+
+  if (nstarted < nconns)
+    connect_next(req);
+
+  maybe_done(req->handle->loop);
+}
+
+
+static void connection_cb(uv_stream_t* server, int status) {
+  conn_t* c;
+
+  ASSERT(status == 0);
+  ASSERT(naccepted < nconns);
+
+  c = servers + naccepted;
+  if (is_pipe)
+    ASSERT(0 == uv_pipe_init(server->loop, &c->pipe, 0));
+  else
+    ASSERT(0 == uv_tcp_init(server->loop, &c->tcp));
+
+  ASSERT(0 == uv_accept(server, &c->stream));
+  ASSERT(0 == uv_read_start(&c->stream, alloc_cb, read_cb));
+  naccepted++;
+
+  maybe_done(server->loop);
+}
+
+
+static void stop_cb(uv_timer_t* handle) {
+  uv_stop(handle->loop);
+}
+
+
+static void listen_all(uv_loop_t* loop, unsigned int round) {
+  unsigned int i;
+
+  if (is_pipe) {
+    nlisteners = 1;
+    remove(TEST_PIPENAME);
+    ASSERT(0 == uv_pipe_init(loop, &listeners[0].pipe, 0));
+    ASSERT(0 == uv_pipe_bind(&listeners[0].pipe, TEST_PIPENAME));
+    ASSERT(0 == uv_listen(&listeners[0].stream, BACKLOG, connection_cb));
+    return;
+  }
+
+  /* 每一轮换一组端口，上一轮关闭的连接还在TIME_WAIT里 */
+  nlisteners = (nconns + PORT_CONNS - 1) / PORT_CONNS;
+  ASSERT(nlisteners <= MAX_LISTENERS);
+  for (i = 0; i < nlisteners; i++) {
+    ASSERT(0 == uv_ip4_addr("127.0.0.1",
+                            TEST_PORT + round * MAX_LISTENERS + i,
+                            &listen_addrs[i]));
+    ASSERT(0 == uv_tcp_init(loop, &listeners[i].tcp));
+    ASSERT(0 == uv_tcp_bind(&listeners[i].tcp,
+                            (const struct sockaddr*) &listen_addrs[i],
+                            0));
+    ASSERT(0 == uv_listen(&listeners[i].stream, BACKLOG, connection_cb));
+  }
+}
+
+
+/* 两端都在本进程，每个连接两个fd，再给监听socket和loop自己留一些 */
+static unsigned int max_conns(void) {
+#ifndef _WIN32
+  struct rlimit lim;
+
+  if (getrlimit(RLIMIT_NOFILE, &lim) == 0) {
+    if (lim.rlim_cur < lim.rlim_max) {
+      lim.rlim_cur = lim.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &lim);
+      getrlimit(RLIMIT_NOFILE, &lim);
+    }
+    if (lim.rlim_cur != RLIM_INFINITY && lim.rlim_cur < 2 * 1000 * 1000 + 256)
+      return (unsigned int) (lim.rlim_cur - 256) / 2;
+  }
+#endif
+
+  return 1000 * 1000;
+}
+
+
+static void idle_run(unsigned int round, unsigned int count) {
+  uv_metrics_t before_metrics;
+  uv_metrics_t after_metrics;
+  uv_timer_t timer;
+  uv_loop_t* loop;
+  size_t rss_before;
+  size_t rss_after;
+  uint64_t before;
+  uint64_t setup_ns;
+  uint64_t iter_ns;
+  uint64_t idle_ns;
+  double per_conn;
+  double wakeups;
+  char metric[64];
+  unsigned int i;
+
+  loop = uv_default_loop();
+  nconns = count;
+  nstarted = 0;
+  nconnected = 0;
+  naccepted = 0;
+
+  ASSERT(0 == uv_run(loop, UV_RUN_NOWAIT));
+  ASSERT(0 == uv_resident_set_memory(&rss_before));
+
+  clients = calloc(nconns, sizeof(clients[0]));
+  ASSERT(clients != NULL);
+  servers = calloc(nconns, sizeof(servers[0]));
+  ASSERT(servers != NULL);
+
+  before = uv_hrtime();
+  listen_all(loop, round);
+  for (i = 0; i < WINDOW && nstarted < nconns; i++)
+    connect_next(connect_reqs + i);
+  uv_run(loop, UV_RUN_DEFAULT);
+  setup_ns = uv_hrtime() - before;
+  ASSERT(nconnected == nconns);
+  ASSERT(naccepted == nconns);
+
+  ASSERT(0 == uv_resident_set_memory(&rss_after));
+  per_conn = rss_after > rss_before ?
+      (double) (rss_after - rss_before) / (2.0 * nconns) : 0;
+
+  before = uv_hrtime();
+  for (i = 0; i < ITERATIONS; i++)
+    uv_run(loop, UV_RUN_NOWAIT);
+  iter_ns = (uv_hrtime() - before) / ITERATIONS;
+
+  ASSERT(0 == uv_timer_init(loop, &timer));
+  ASSERT(0 == uv_timer_start(&timer, stop_cb, IDLE_MS, 0));
+  ASSERT(0 == uv_metrics_info(loop, &before_metrics));
+  before = uv_hrtime();
+  uv_run(loop, UV_RUN_DEFAULT);
+  idle_ns = uv_hrtime() - before;
+  ASSERT(0 == uv_metrics_info(loop, &after_metrics));
+  wakeups = (after_metrics.loop_count - before_metrics.loop_count) /
+            (idle_ns / 1e9);
+
+  close_loop(loop);
+  free(clients);
+  free(servers);
+  clients = NULL;
+  servers = NULL;
+
+  fprintf(stderr,
+          "%s, %u connections: %.0f connections/s, %.0f bytes/end, "
+          "%.1f us/iteration, %.1f wakeups/s\n",
+          is_pipe ? "pipe" : "tcp",
+          count,
+          count / (setup_ns / 1e9),
+          per_conn,
+          iter_ns / 1e3,
+          wakeups);
+  fflush(stderr);
+
+  snprintf(metric, sizeof(metric), "rss_%u", count);
+  benchmark_report(metric, per_conn, "bytes");
+  snprintf(metric, sizeof(metric), "iteration_%u", count);
+  benchmark_report(metric, iter_ns / 1e3, "us");
+  snprintf(metric, sizeof(metric), "wakeups_%u", count);
+  benchmark_report(metric, wakeups, "wakeups");
+}
+
+
+static int idle_conns(int pipe) {
+  unsigned int limit;
+  unsigned int count;
+  unsigned int i;
+
+  is_pipe = pipe;
+  limit = max_conns();
+
+  fprintf(stderr,
+          "%s: %u bytes per handle\n",
+          pipe ? "uv_pipe_t" : "uv_tcp_t",
+          pipe ? (unsigned int) sizeof(uv_pipe_t)
+               : (unsigned int) sizeof(uv_tcp_t));
+  fflush(stderr);
+
+  for (i = 0; i < ARRAY_SIZE(conn_counts); i++) {
+    count = conn_counts[i];
+    if (count > limit) {
+      fprintf(stderr,
+              "%u connections need %u fds, limited to %u connections\n",
+              count,
+              2 * count,
+              limit);
+      fflush(stderr);
+      count = limit;
+    }
+
+    idle_run(i, count);
+
+    if (count < conn_counts[i])
+      break;
+  }
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+BENCHMARK_IMPL(idle_conns_tcp) {
+  return idle_conns(0);
+}
+
+
+BENCHMARK_IMPL(idle_conns_pipe) {
+  return idle_conns(1);
+}
@@ -20,10 +20,21 @@
  */
 
 BENCHMARK_DECLARE (sizes)
+BENCHMARK_DECLARE (idle_conns_tcp)
+BENCHMARK_DECLARE (idle_conns_pipe)
 BENCHMARK_DECLARE (loop_count)
 BENCHMARK_DECLARE (loop_count_timed)
 BENCHMARK_DECLARE (ping_pongs)
+BENCHMARK_DECLARE (ping_latency_tcp_1)
+BENCHMARK_DECLARE (ping_latency_tcp_100)
+BENCHMARK_DECLARE (ping_latency_tcp_1_16k)
+BENCHMARK_DECLARE (ping_latency_pipe_1)
+BENCHMARK_DECLARE (ping_latency_pipe_100)
+BENCHMARK_DECLARE (ping_latency_udp_1)
+BENCHMARK_DECLARE (ping_latency_udp_100)
 BENCHMARK_DECLARE (tcp_write_batch)
+BENCHMARK_DECLARE (http_write)
+BENCHMARK_DECLARE (http_try_write)
 BENCHMARK_DECLARE (tcp4_pound_100)
 BENCHMARK_DECLARE (tcp4_pound_1000)
 BENCHMARK_DECLARE (pipe_pound_100)
@@ -36,6 +47,7 @@ BENCHMARK_DECLARE (pipe_pump1_client)
 BENCHMARK_DECLARE (tcp_multi_accept2)
 BENCHMARK_DECLARE (tcp_multi_accept4)
 BENCHMARK_DECLARE (tcp_multi_accept8)
+BENCHMARK_DECLARE (multi_loop_scaling)
 
 /* Run until X packets have been sent/received. */
 BENCHMARK_DECLARE (udp_pummel_1v1)
@@ -61,8 +73,30 @@ BENCHMARK_DECLARE (udp_timed_pummel_100v100)
 BENCHMARK_DECLARE (udp_timed_pummel_100v1000)
 BENCHMARK_DECLARE (udp_timed_pummel_1000v1000)
 
+/* Packets per second and CPU per packet by payload size. */
+BENCHMARK_DECLARE (udp_send_single)
+BENCHMARK_DECLARE (udp_send_single_connected)
+BENCHMARK_DECLARE (udp_send_mmsg)
+BENCHMARK_DECLARE (udp_send_mmsg_connected)
+BENCHMARK_DECLARE (udp_send_gso)
+BENCHMARK_DECLARE (udp_send_gso_connected)
+BENCHMARK_DECLARE (udp_recv_single)
+BENCHMARK_DECLARE (udp_recv_mmsg)
+BENCHMARK_DECLARE (udp_recv_gro)
+
 BENCHMARK_DECLARE (getaddrinfo)
 BENCHMARK_DECLARE (fs_stat)
+BENCHMARK_DECLARE (fs_read_seq_4k_qd1)
+BENCHMARK_DECLARE (fs_read_seq_64k_qd1)
+BENCHMARK_DECLARE (fs_read_seq_1m_qd4)
+BENCHMARK_DECLARE (fs_read_rand_4k_qd1)
+BENCHMARK_DECLARE (fs_read_rand_4k_qd32)
+BENCHMARK_DECLARE (fs_write_seq_4k_qd1)
+BENCHMARK_DECLARE (fs_write_seq_64k_qd4)
+BENCHMARK_DECLARE (fs_write_rand_4k_qd32)
+BENCHMARK_DECLARE (fs_sendfile)
+BENCHMARK_DECLARE (fs_copyfile)
+BENCHMARK_DECLARE (fs_scandir)
 BENCHMARK_DECLARE (async1)
 BENCHMARK_DECLARE (async2)
 BENCHMARK_DECLARE (async4)
@@ -72,27 +106,70 @@ BENCHMARK_DECLARE (async_pummel_2)
 BENCHMARK_DECLARE (async_pummel_4)
 BENCHMARK_DECLARE (async_pummel_8)
 BENCHMARK_DECLARE (spawn)
+BENCHMARK_DECLARE (spawn_fork)
+BENCHMARK_DECLARE (spawn_rss)
+BENCHMARK_DECLARE (spawn_fork_rss)
 BENCHMARK_DECLARE (thread_create)
 BENCHMARK_DECLARE (million_async)
 BENCHMARK_DECLARE (million_timers)
+BENCHMARK_DECLARE (million_timers_wheel)
+BENCHMARK_DECLARE (timer_churn)
+BENCHMARK_DECLARE (timer_churn_wheel)
+BENCHMARK_DECLARE (queue_work_4)
+BENCHMARK_DECLARE (queue_work_64)
+BENCHMARK_DECLARE (queue_work_batch_4)
+BENCHMARK_DECLARE (queue_work_pingpong)
+BENCHMARK_DECLARE (queue_work_pingpong_spin)
+BENCHMARK_DECLARE (queue_work_wait_1)
+BENCHMARK_DECLARE (queue_work_wait_64)
+BENCHMARK_DECLARE (queue_work_mixed)
+BENCHMARK_DECLARE (queue_work_loops_4)
+BENCHMARK_DECLARE (queue_work_loops_16)
 HELPER_DECLARE    (tcp4_blackhole_server)
 HELPER_DECLARE    (tcp_pump_server)
 HELPER_DECLARE    (pipe_pump_server)
 HELPER_DECLARE    (tcp4_echo_server)
 HELPER_DECLARE    (pipe_echo_server)
+HELPER_DECLARE    (udp4_latency_echo_server)
 HELPER_DECLARE    (dns_server)
 
 TASK_LIST_START
   BENCHMARK_ENTRY  (sizes)
+  BENCHMARK_ENTRY  (idle_conns_tcp)
+  BENCHMARK_ENTRY  (idle_conns_pipe)
   BENCHMARK_ENTRY  (loop_count)
   BENCHMARK_ENTRY  (loop_count_timed)
 
   BENCHMARK_ENTRY  (ping_pongs)
   BENCHMARK_HELPER (ping_pongs, tcp4_echo_server)
 
+  BENCHMARK_ENTRY  (ping_latency_tcp_1)
+  BENCHMARK_HELPER (ping_latency_tcp_1, tcp4_echo_server)
+
+  BENCHMARK_ENTRY  (ping_latency_tcp_100)
+  BENCHMARK_HELPER (ping_latency_tcp_100, tcp4_echo_server)
+
+  BENCHMARK_ENTRY  (ping_latency_tcp_1_16k)
+  BENCHMARK_HELPER (ping_latency_tcp_1_16k, tcp4_echo_server)
+
+  BENCHMARK_ENTRY  (ping_latency_pipe_1)
+  BENCHMARK_HELPER (ping_latency_pipe_1, pipe_echo_server)
+
+  BENCHMARK_ENTRY  (ping_latency_pipe_100)
+  BENCHMARK_HELPER (ping_latency_pipe_100, pipe_echo_server)
+
+  BENCHMARK_ENTRY  (ping_latency_udp_1)
+  BENCHMARK_HELPER (ping_latency_udp_1, udp4_latency_echo_server)
+
+  BENCHMARK_ENTRY  (ping_latency_udp_100)
+  BENCHMARK_HELPER (ping_latency_udp_100, udp4_latency_echo_server)
+
   BENCHMARK_ENTRY  (tcp_write_batch)
   BENCHMARK_HELPER (tcp_write_batch, tcp4_blackhole_server)
 
+  BENCHMARK_ENTRY  (http_write)
+  BENCHMARK_ENTRY  (http_try_write)
+
   BENCHMARK_ENTRY  (tcp_pump100_client)
   BENCHMARK_HELPER (tcp_pump100_client, tcp_pump_server)
 
@@ -121,6 +198,8 @@ TASK_LIST_START
   BENCHMARK_ENTRY  (tcp_multi_accept4)
   BENCHMARK_ENTRY  (tcp_multi_accept8)
 
+  BENCHMARK_ENTRY  (multi_loop_scaling)
+
   BENCHMARK_ENTRY  (udp_pummel_1v1)
   BENCHMARK_ENTRY  (udp_pummel_1v10)
   BENCHMARK_ENTRY  (udp_pummel_1v100)
@@ -143,9 +222,30 @@ TASK_LIST_START
   BENCHMARK_ENTRY  (udp_timed_pummel_100v1000)
   BENCHMARK_ENTRY  (udp_timed_pummel_1000v1000)
 
+  BENCHMARK_ENTRY  (udp_send_single)
+  BENCHMARK_ENTRY  (udp_send_single_connected)
+  BENCHMARK_ENTRY  (udp_send_mmsg)
+  BENCHMARK_ENTRY  (udp_send_mmsg_connected)
+  BENCHMARK_ENTRY  (udp_send_gso)
+  BENCHMARK_ENTRY  (udp_send_gso_connected)
+  BENCHMARK_ENTRY  (udp_recv_single)
+  BENCHMARK_ENTRY  (udp_recv_mmsg)
+  BENCHMARK_ENTRY  (udp_recv_gro)
+
   BENCHMARK_ENTRY  (getaddrinfo)
 
   BENCHMARK_ENTRY  (fs_stat)
+  BENCHMARK_ENTRY  (fs_read_seq_4k_qd1)
+  BENCHMARK_ENTRY  (fs_read_seq_64k_qd1)
+  BENCHMARK_ENTRY  (fs_read_seq_1m_qd4)
+  BENCHMARK_ENTRY  (fs_read_rand_4k_qd1)
+  BENCHMARK_ENTRY  (fs_read_rand_4k_qd32)
+  BENCHMARK_ENTRY  (fs_write_seq_4k_qd1)
+  BENCHMARK_ENTRY  (fs_write_seq_64k_qd4)
+  BENCHMARK_ENTRY  (fs_write_rand_4k_qd32)
+  BENCHMARK_ENTRY  (fs_sendfile)
+  BENCHMARK_ENTRY  (fs_copyfile)
+  BENCHMARK_ENTRY  (fs_scandir)
 
   BENCHMARK_ENTRY  (async1)
   BENCHMARK_ENTRY  (async2)
@@ -157,7 +257,23 @@ TASK_LIST_START
   BENCHMARK_ENTRY  (async_pummel_8)
 
   BENCHMARK_ENTRY  (spawn)
+  BENCHMARK_ENTRY  (spawn_fork)
+  BENCHMARK_ENTRY  (spawn_rss)
+  BENCHMARK_ENTRY  (spawn_fork_rss)
   BENCHMARK_ENTRY  (thread_create)
   BENCHMARK_ENTRY  (million_async)
   BENCHMARK_ENTRY  (million_timers)
+  BENCHMARK_ENTRY  (million_timers_wheel)
+  BENCHMARK_ENTRY  (timer_churn)
+  BENCHMARK_ENTRY  (timer_churn_wheel)
+  BENCHMARK_ENTRY  (queue_work_4)
+  BENCHMARK_ENTRY  (queue_work_64)
+  BENCHMARK_ENTRY  (queue_work_batch_4)
+  BENCHMARK_ENTRY  (queue_work_pingpong)
+  BENCHMARK_ENTRY  (queue_work_pingpong_spin)
+  BENCHMARK_ENTRY  (queue_work_wait_1)
+  BENCHMARK_ENTRY  (queue_work_wait_64)
+  BENCHMARK_ENTRY  (queue_work_mixed)
+  BENCHMARK_ENTRY  (queue_work_loops_4)
+  BENCHMARK_ENTRY  (queue_work_loops_16)
 TASK_LIST_END
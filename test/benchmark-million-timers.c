@@ -38,7 +38,7 @@ static void close_cb(uv_handle_t* handle) {
 }
 
 
-BENCHMARK_IMPL(million_timers) {
+static int million_timers(int wheel) {
   uv_timer_t* timers;
   uv_loop_t* loop;
   uint64_t before_all;
@@ -54,6 +54,9 @@ BENCHMARK_IMPL(million_timers) {
   loop = uv_default_loop();
   timeout = 0;
 
+  if (wheel)
+    ASSERT(0 == uv_loop_configure(loop, UV_LOOP_TIMER_WHEEL));
+
   before_all = uv_hrtime();
   for (i = 0; i < NUM_TIMERS; i++) {
     if (i % 1000 == 0) timeout++;
@@ -84,3 +87,13 @@ BENCHMARK_IMPL(million_timers) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+BENCHMARK_IMPL(million_timers) {
+  return million_timers(0);
+}
+
+
+BENCHMARK_IMPL(million_timers_wheel) {
+  return million_timers(1);
+}
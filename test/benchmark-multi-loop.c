@@ -0,0 +1,374 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "task.h"
+#include "uv.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Run every step for this many ms */
+#define TIME 2000
+
+#define MAX_LOOPS 64
+#define NUM_TIMERS 1024
+#define NUM_WORK 4
+
+enum {
+  OP_ECHO,
+  OP_ASYNC,
+  OP_WORK,
+  OP_TIMER,
+  OP_SIGNAL,
+  NUM_OPS
+};
+
+static const char* op_names[NUM_OPS] = {
+  "echo", "async", "work", "timer", "signal"
+};
+
+/* Every loop runs all of the workloads at once, on its own thread.  The
+ * async and timer workloads are purely per-loop; the echo workload goes
+ * through the kernel; work and signal go through the process-wide
+ * threadpool and signal tree, which is where global locks would show up.
+ */
+struct loop_ctx {
+  uv_loop_t loop;
+  uv_thread_t thread;
+  uv_tcp_t server;
+  uv_tcp_t client;
+  uv_tcp_t peer;
+  uv_connect_t connect_req;
+  uv_async_t async_handle;
+  uv_timer_t timers[NUM_TIMERS];
+  uv_timer_t stop_timer;
+  uv_signal_t signal_handle;
+  uv_work_t work_reqs[NUM_WORK];
+  char scratch[64];
+  int connected;
+  int accepted;
+  int stopped;
+  uint64_t start_time;
+  uint64_t elapsed;
+  uint64_t ops[NUM_OPS];
+};
+
+static uv_barrier_t start_barrier;
+
+
+static struct loop_ctx* container(const uv_handle_t* handle) {
+  return (struct loop_ctx*) handle->loop->data;
+}
+
+
+static void echo_alloc_cb(uv_handle_t* handle,
+                          size_t suggested_size,
+                          uv_buf_t* buf) {
+  struct loop_ctx* ctx = container(handle);
+  *buf = uv_buf_init(ctx->scratch, sizeof(ctx->scratch));
+}
+
+
+/* The reply always fits in an empty socket buffer, so there is no need for
+ * write requests.
+ */
+static void echo_send(uv_stream_t* stream) {
+  uv_buf_t buf;
+
+  buf = uv_buf_init("x", 1);
+  ASSERT(1 == uv_try_write(stream, &buf, 1));
+}
+
+
+static void peer_read_cb(uv_stream_t* stream,
+                         ssize_t nread,
+                         const uv_buf_t* buf) {
+  if (nread <= 0)
+    return;
+
+  ASSERT(nread == 1);
+  echo_send(stream);
+}
+
+
+static void client_read_cb(uv_stream_t* stream,
+                           ssize_t nread,
+                           const uv_buf_t* buf) {
+  struct loop_ctx* ctx = container((uv_handle_t*) stream);
+
+  if (nread <= 0 || ctx->stopped)
+    return;
+
+  ASSERT(nread == 1);
+  ctx->ops[OP_ECHO]++;
+  echo_send(stream);
+}
+
+
+static void connection_cb(uv_stream_t* server, int status) {
+  struct loop_ctx* ctx = container((uv_handle_t*) server);
+
+  ASSERT(status == 0);
+  ASSERT(0 == uv_tcp_init(&ctx->loop, &ctx->peer));
+  ASSERT(0 == uv_accept(server, (uv_stream_t*) &ctx->peer));
+  ASSERT(0 == uv_tcp_nodelay(&ctx->peer, 1));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &ctx->peer,
+                            echo_alloc_cb,
+                            peer_read_cb));
+  ctx->accepted = 1;
+}
+
+
+static void connect_cb(uv_connect_t* req, int status) {
+  struct loop_ctx* ctx = container((uv_handle_t*) req->handle);
+
+  ASSERT(status == 0);
+  ASSERT(0 == uv_tcp_nodelay(&ctx->client, 1));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &ctx->client,
+                            echo_alloc_cb,
+                            client_read_cb));
+  ctx->connected = 1;
+}
+
+
+static void async_cb(uv_async_t* handle) {
+  struct loop_ctx* ctx = container((uv_handle_t*) handle);
+
+  if (ctx->stopped)
+    return;
+
+  ctx->ops[OP_ASYNC]++;
+  ASSERT(0 == uv_async_send(handle));
+}
+
+
+static void work_cb(uv_work_t* req) {
+  req->data = req;
+}
+
+
+static void after_work_cb(uv_work_t* req, int status) {
+  struct loop_ctx* ctx = (struct loop_ctx*) req->loop->data;
+
+  ASSERT(status == 0);
+  if (ctx->stopped)
+    return;
+
+  ctx->ops[OP_WORK]++;
+  ASSERT(0 == uv_queue_work(&ctx->loop, req, work_cb, after_work_cb));
+}
+
+
+static void signal_cb(uv_signal_t* handle, int signum) {
+  ASSERT(0 && "should not be called");
+}
+
+
+static void timer_cb(uv_timer_t* handle) {
+  struct loop_ctx* ctx = container((uv_handle_t*) handle);
+
+  if (ctx->stopped)
+    return;
+
+  /* A zero timeout would be due again in the same uv__run_timers() pass. */
+  ctx->ops[OP_TIMER]++;
+  ASSERT(0 == uv_timer_start(handle, timer_cb, 1, 0));
+
+  /* Starting and stopping a watcher takes the process-wide signal lock. */
+  ASSERT(0 == uv_signal_start(&ctx->signal_handle, signal_cb, SIGUSR2));
+  ASSERT(0 == uv_signal_stop(&ctx->signal_handle));
+  ctx->ops[OP_SIGNAL]++;
+}
+
+
+static void stop_timer_cb(uv_timer_t* handle) {
+  struct loop_ctx* ctx = container((uv_handle_t*) handle);
+  int i;
+
+  ctx->elapsed = uv_hrtime() - ctx->start_time;
+  ctx->stopped = 1;
+
+  uv_close((uv_handle_t*) &ctx->server, NULL);
+  uv_close((uv_handle_t*) &ctx->client, NULL);
+  uv_close((uv_handle_t*) &ctx->peer, NULL);
+  uv_close((uv_handle_t*) &ctx->async_handle, NULL);
+  uv_close((uv_handle_t*) &ctx->signal_handle, NULL);
+  for (i = 0; i < NUM_TIMERS; i++)
+    uv_close((uv_handle_t*) &ctx->timers[i], NULL);
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+static void loop_thread(void* arg) {
+  struct loop_ctx* ctx = arg;
+  struct sockaddr_storage addr;
+  int addrlen;
+  int i;
+
+  ASSERT(0 == uv_loop_init(&ctx->loop));
+  ctx->loop.data = ctx;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", 0, (struct sockaddr_in*) &addr));
+  ASSERT(0 == uv_tcp_init(&ctx->loop, &ctx->server));
+  ASSERT(0 == uv_tcp_bind(&ctx->server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &ctx->server, 1, connection_cb));
+  addrlen = sizeof(addr);
+  ASSERT(0 == uv_tcp_getsockname(&ctx->server,
+                                 (struct sockaddr*) &addr,
+                                 &addrlen));
+
+  ASSERT(0 == uv_tcp_init(&ctx->loop, &ctx->client));
+  ASSERT(0 == uv_tcp_connect(&ctx->connect_req,
+                             &ctx->client,
+                             (const struct sockaddr*) &addr,
+                             connect_cb));
+  while (!ctx->connected || !ctx->accepted)
+    uv_run(&ctx->loop, UV_RUN_ONCE);
+
+  ASSERT(0 == uv_async_init(&ctx->loop, &ctx->async_handle, async_cb));
+  ASSERT(0 == uv_signal_init(&ctx->loop, &ctx->signal_handle));
+  for (i = 0; i < NUM_TIMERS; i++)
+    ASSERT(0 == uv_timer_init(&ctx->loop, &ctx->timers[i]));
+  ASSERT(0 == uv_timer_init(&ctx->loop, &ctx->stop_timer));
+
+  /* Setup is done, all loops start the workloads at the same time. */
+  uv_barrier_wait(&start_barrier);
+
+  uv_update_time(&ctx->loop);
+  ctx->start_time = uv_hrtime();
+  ASSERT(0 == uv_timer_start(&ctx->stop_timer, stop_timer_cb, TIME, 0));
+
+  echo_send((uv_stream_t*) &ctx->client);
+  ASSERT(0 == uv_async_send(&ctx->async_handle));
+  for (i = 0; i < NUM_WORK; i++)
+    ASSERT(0 == uv_queue_work(&ctx->loop,
+                              &ctx->work_reqs[i],
+                              work_cb,
+                              after_work_cb));
+  for (i = 0; i < NUM_TIMERS; i++)
+    ASSERT(0 == uv_timer_start(&ctx->timers[i], timer_cb, 1, 0));
+
+  ASSERT(0 == uv_run(&ctx->loop, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_close(&ctx->loop));
+}
+
+
+/* Returns the total rate and fills rates[] with the rate of each workload,
+ * both in operations per second summed over all loops.
+ */
+static double run_loops(unsigned int nloops, double* rates) {
+  struct loop_ctx* ctxs;
+  double total;
+  unsigned int i;
+  int op;
+
+  ctxs = calloc(nloops, sizeof(*ctxs));
+  ASSERT(ctxs != NULL);
+  ASSERT(0 == uv_barrier_init(&start_barrier, nloops));
+
+  for (i = 0; i < nloops; i++)
+    ASSERT(0 == uv_thread_create(&ctxs[i].thread, loop_thread, &ctxs[i]));
+  for (i = 0; i < nloops; i++)
+    ASSERT(0 == uv_thread_join(&ctxs[i].thread));
+
+  uv_barrier_destroy(&start_barrier);
+
+  total = 0;
+  for (op = 0; op < NUM_OPS; op++) {
+    rates[op] = 0;
+    for (i = 0; i < nloops; i++)
+      rates[op] += ctxs[i].ops[op] * 1e9 / ctxs[i].elapsed;
+    total += rates[op];
+  }
+
+  free(ctxs);
+  return total;
+}
+
+
+static void report(unsigned int nloops,
+                   double total,
+                   const double* rates,
+                   double base_total,
+                   const double* base_rates) {
+  char metric[32];
+  int op;
+
+  snprintf(metric, sizeof(metric), "ops_%u", nloops);
+  benchmark_report(metric, total, "ops/s");
+  snprintf(metric, sizeof(metric), "efficiency_%u", nloops);
+  benchmark_report(metric, 100.0 * total / (nloops * base_total), "%");
+
+  /* Efficiency is the per-loop rate relative to a single loop; 100% means
+   * perfectly linear scaling.
+   */
+  fprintf(stderr,
+          "multi_loop_scaling: %2u loops: %.0f ops/s (%.0f%%)",
+          nloops,
+          total,
+          100.0 * total / (nloops * base_total));
+  for (op = 0; op < NUM_OPS; op++) {
+    if (base_rates[op] > 0)
+      fprintf(stderr,
+              ", %s %.0f%%",
+              op_names[op],
+              100.0 * rates[op] / (nloops * base_rates[op]));
+  }
+  fprintf(stderr, "\n");
+  fflush(stderr);
+}
+
+
+BENCHMARK_IMPL(multi_loop_scaling) {
+  uv_cpu_info_t* cpus;
+  double base_rates[NUM_OPS];
+  double rates[NUM_OPS];
+  double base_total;
+  double total;
+  unsigned int max_loops;
+  unsigned int nloops;
+  int ncpus;
+
+  ASSERT(0 == uv_cpu_info(&cpus, &ncpus));
+  uv_free_cpu_info(cpus, ncpus);
+
+  /* Always do at least two steps so there is something to compare. */
+  max_loops = ncpus < 2 ? 2 : ncpus;
+  if (max_loops > MAX_LOOPS)
+    max_loops = MAX_LOOPS;
+
+  base_total = run_loops(1, base_rates);
+  report(1, base_total, base_rates, base_total, base_rates);
+
+  for (nloops = 2; nloops <= max_loops; nloops *= 2) {
+    total = run_loops(nloops, rates);
+    report(nloops, total, rates, base_total, base_rates);
+
+    if (nloops < max_loops && nloops * 2 > max_loops) {
+      total = run_loops(max_loops, rates);
+      report(max_loops, total, rates, base_total, base_rates);
+    }
+  }
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
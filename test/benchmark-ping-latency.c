@@ -0,0 +1,431 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Run the benchmark for this many ms */
+#define TIME 5000
+
+/* Log-linear (HDR style) histogram: every power of two is split into
+ * HIST_SUB linear buckets, so a recorded value is off by less than 1/128.
+ */
+#define HIST_SUB_BITS 7
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_SIZE ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef enum {
+  LATENCY_TCP,
+  LATENCY_PIPE,
+  LATENCY_UDP
+} latency_type_t;
+
+typedef struct {
+  union {
+    uv_handle_t handle;
+    uv_stream_t stream;
+    uv_tcp_t tcp;
+    uv_pipe_t pipe;
+    uv_udp_t udp;
+  } h;
+  uv_connect_t connect_req;
+  uv_shutdown_t shutdown_req;
+  int connected;
+  size_t received;
+  uint64_t sent_at;
+} pinger_t;
+
+
+static uv_loop_t* loop;
+static uv_timer_t timer_handle;
+static latency_type_t type;
+static pinger_t* pingers;
+static int npingers;
+static char* payload;
+static size_t payload_size;
+static char slab[65536];
+static struct sockaddr_in server_addr;
+static uint64_t hist[HIST_SIZE];
+static uint64_t hist_count;
+static uint64_t hist_max;
+static int closed_pingers;
+static int stopped;
+
+
+static unsigned int hist_index(uint64_t value) {
+  unsigned int shift;
+
+  if (value < HIST_SUB)
+    return (unsigned int) value;
+
+  shift = 0;
+  while ((value >> shift) >= 2 * HIST_SUB)
+    shift++;
+
+  return (shift + 1) * HIST_SUB + (unsigned int) ((value >> shift) - HIST_SUB);
+}
+
+
+/* Upper bound of the values that land in the bucket. */
+static uint64_t hist_value(unsigned int index) {
+  unsigned int shift;
+
+  if (index < HIST_SUB)
+    return index;
+
+  shift = index / HIST_SUB - 1;
+  return (((uint64_t) (index % HIST_SUB + HIST_SUB + 1)) << shift) - 1;
+}
+
+
+static void hist_record(uint64_t value) {
+  hist[hist_index(value)]++;
+  hist_count++;
+  if (value > hist_max)
+    hist_max = value;
+}
+
+
+static uint64_t hist_percentile(double percentile) {
+  uint64_t target;
+  uint64_t seen;
+  unsigned int i;
+
+  target = (uint64_t) (hist_count * percentile / 100.0 + 0.5);
+  if (target == 0)
+    target = 1;
+
+  seen = 0;
+  for (i = 0; i < HIST_SIZE; i++) {
+    seen += hist[i];
+    if (seen >= target)
+      break;
+  }
+
+  /* The bucket bound can overshoot the largest value actually seen. */
+  if (i == HIST_SIZE || hist_value(i) > hist_max)
+    return hist_max;
+
+  return hist_value(i);
+}
+
+
+static void pinger_close_cb(uv_handle_t* handle) {
+  closed_pingers++;
+}
+
+
+static void pinger_write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0 || status == UV_ECANCELED);
+  free(req);
+}
+
+
+static void pinger_send_cb(uv_udp_send_t* req, int status) {
+  ASSERT(status == 0 || status == UV_ECANCELED);
+  free(req);
+}
+
+
+static void pinger_write_ping(pinger_t* pinger) {
+  uv_udp_send_t* send_req;
+  uv_write_t* req;
+  uv_buf_t buf;
+
+  buf = uv_buf_init(payload, payload_size);
+  pinger->received = 0;
+  pinger->sent_at = uv_hrtime();
+
+  if (type == LATENCY_UDP) {
+    send_req = malloc(sizeof(*send_req));
+    ASSERT(send_req != NULL);
+    if (uv_udp_send(send_req,
+                    &pinger->h.udp,
+                    &buf,
+                    1,
+                    (const struct sockaddr*) &server_addr,
+                    pinger_send_cb)) {
+      FATAL("uv_udp_send failed");
+    }
+    return;
+  }
+
+  req = malloc(sizeof(*req));
+  ASSERT(req != NULL);
+  if (uv_write(req, &pinger->h.stream, &buf, 1, pinger_write_cb))
+    FATAL("uv_write failed");
+}
+
+
+static void pinger_pong(pinger_t* pinger, size_t nread) {
+  pinger->received += nread;
+  ASSERT(pinger->received <= payload_size);
+  if (pinger->received < payload_size)
+    return;
+
+  hist_record(uv_hrtime() - pinger->sent_at);
+  if (!stopped)
+    pinger_write_ping(pinger);
+}
+
+
+static void buf_alloc(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  *buf = uv_buf_init(slab, sizeof(slab));
+}
+
+
+static void pinger_read_cb(uv_stream_t* stream,
+                           ssize_t nread,
+                           const uv_buf_t* buf) {
+  if (nread == UV_EOF) {
+    ASSERT(stopped);
+    uv_close((uv_handle_t*) stream, pinger_close_cb);
+    return;
+  }
+
+  if (nread < 0)
+    FATAL("unexpected read error");
+
+  pinger_pong(stream->data, nread);
+}
+
+
+static void pinger_recv_cb(uv_udp_t* handle,
+                           ssize_t nread,
+                           const uv_buf_t* buf,
+                           const struct sockaddr* addr,
+                           unsigned flags) {
+  if (nread == 0 && addr == NULL)
+    return;
+
+  ASSERT(nread == (ssize_t) payload_size);
+  pinger_pong(handle->data, nread);
+}
+
+
+static void pinger_connect_cb(uv_connect_t* req, int status) {
+  if (status == UV_ECANCELED)
+    return;
+
+  ASSERT(status == 0);
+  ((pinger_t*) req->handle->data)->connected = 1;
+
+  if (uv_read_start(req->handle, buf_alloc, pinger_read_cb))
+    FATAL("uv_read_start failed");
+
+  pinger_write_ping(req->handle->data);
+}
+
+
+static void pinger_new(pinger_t* pinger) {
+  switch (type) {
+  case LATENCY_TCP:
+    ASSERT(0 == uv_tcp_init(loop, &pinger->h.tcp));
+    ASSERT(0 == uv_tcp_nodelay(&pinger->h.tcp, 1));
+    ASSERT(0 == uv_tcp_connect(&pinger->connect_req,
+                               &pinger->h.tcp,
+                               (const struct sockaddr*) &server_addr,
+                               pinger_connect_cb));
+    break;
+
+  case LATENCY_PIPE:
+    ASSERT(0 == uv_pipe_init(loop, &pinger->h.pipe, 0));
+    uv_pipe_connect(&pinger->connect_req,
+                    &pinger->h.pipe,
+                    TEST_PIPENAME,
+                    pinger_connect_cb);
+    break;
+
+  case LATENCY_UDP:
+    ASSERT(0 == uv_udp_init(loop, &pinger->h.udp));
+    break;
+  }
+
+  pinger->h.handle.data = pinger;
+
+  if (type == LATENCY_UDP) {
+    pinger_write_ping(pinger);
+    ASSERT(0 == uv_udp_recv_start(&pinger->h.udp, buf_alloc, pinger_recv_cb));
+  }
+}
+
+
+static void pinger_shutdown_cb(uv_shutdown_t* req, int status) {
+  ASSERT(status == 0);
+}
+
+
+/* Stream pingers shut down and drain their last pong so the echo server sees
+ * a clean EOF instead of a reset.  In-flight UDP pings are simply dropped.
+ */
+static void timer_cb(uv_timer_t* handle) {
+  pinger_t* pinger;
+  int i;
+
+  stopped = 1;
+  for (i = 0; i < npingers; i++) {
+    pinger = &pingers[i];
+    if (type != LATENCY_UDP && pinger->connected)
+      ASSERT(0 == uv_shutdown(&pinger->shutdown_req,
+                              &pinger->h.stream,
+                              pinger_shutdown_cb));
+    else
+      uv_close(&pinger->h.handle, pinger_close_cb);
+  }
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+static int ping_latency(const char* name,
+                        latency_type_t t,
+                        int concurrency,
+                        size_t size) {
+  size_t i;
+  int n;
+
+  loop = uv_default_loop();
+  type = t;
+  npingers = concurrency;
+  payload_size = size;
+  memset(hist, 0, sizeof(hist));
+  hist_count = 0;
+  hist_max = 0;
+  closed_pingers = 0;
+  stopped = 0;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &server_addr));
+
+  payload = malloc(payload_size);
+  ASSERT(payload != NULL);
+  for (i = 0; i < payload_size; i++)
+    payload[i] = 'a' + i % 26;
+
+  pingers = calloc(npingers, sizeof(*pingers));
+  ASSERT(pingers != NULL);
+  for (n = 0; n < npingers; n++)
+    pinger_new(&pingers[n]);
+
+  ASSERT(0 == uv_timer_init(loop, &timer_handle));
+  ASSERT(0 == uv_timer_start(&timer_handle, timer_cb, TIME, 0));
+
+  uv_run(loop, UV_RUN_DEFAULT);
+
+  ASSERT(closed_pingers == npingers);
+  ASSERT(hist_count > 0);
+
+  fprintf(stderr,
+          "%s: %llu roundtrips/s, "
+          "p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+          name,
+          (unsigned long long) (hist_count * 1000 / TIME),
+          hist_percentile(50) / 1e3,
+          hist_percentile(99) / 1e3,
+          hist_percentile(99.9) / 1e3,
+          hist_max / 1e3);
+  fflush(stderr);
+
+  benchmark_report("roundtrips", hist_count * 1000.0 / TIME, "roundtrips/s");
+  benchmark_report("p50", hist_percentile(50) / 1e3, "us");
+  benchmark_report("p99", hist_percentile(99) / 1e3, "us");
+  benchmark_report("p99.9", hist_percentile(99.9) / 1e3, "us");
+  benchmark_report("max", hist_max / 1e3, "us");
+
+  free(pingers);
+  free(payload);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void udp_echo_recv_cb(uv_udp_t* handle,
+                             ssize_t nread,
+                             const uv_buf_t* buf,
+                             const struct sockaddr* addr,
+                             unsigned flags) {
+  uv_buf_t sndbuf;
+
+  if (nread <= 0 || addr == NULL)
+    return;
+
+  /* Replies that do not fit in the socket buffer are dropped, like on the
+   * wire; the pinger only ever has one datagram in flight.
+   */
+  sndbuf = uv_buf_init(buf->base, nread);
+  uv_udp_try_send(handle, &sndbuf, 1, addr);
+}
+
+
+/* udp4_echo_server never binds its socket, so it cannot be pinged. */
+HELPER_IMPL(udp4_latency_echo_server) {
+  static uv_udp_t server;
+  struct sockaddr_in addr;
+
+  loop = uv_default_loop();
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_udp_init(loop, &server));
+  ASSERT(0 == uv_udp_bind(&server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_udp_recv_start(&server, buf_alloc, udp_echo_recv_cb));
+
+  notify_parent_process();
+  uv_run(loop, UV_RUN_DEFAULT);
+  return 0;
+}
+
+
+BENCHMARK_IMPL(ping_latency_tcp_1) {
+  return ping_latency("ping_latency_tcp_1", LATENCY_TCP, 1, 64);
+}
+
+
+BENCHMARK_IMPL(ping_latency_tcp_100) {
+  return ping_latency("ping_latency_tcp_100", LATENCY_TCP, 100, 64);
+}
+
+
+BENCHMARK_IMPL(ping_latency_tcp_1_16k) {
+  return ping_latency("ping_latency_tcp_1_16k", LATENCY_TCP, 1, 16 * 1024);
+}
+
+
+BENCHMARK_IMPL(ping_latency_pipe_1) {
+  return ping_latency("ping_latency_pipe_1", LATENCY_PIPE, 1, 64);
+}
+
+
+BENCHMARK_IMPL(ping_latency_pipe_100) {
+  return ping_latency("ping_latency_pipe_100", LATENCY_PIPE, 100, 64);
+}
+
+
+BENCHMARK_IMPL(ping_latency_udp_1) {
+  return ping_latency("ping_latency_udp_1", LATENCY_UDP, 1, 64);
+}
+
+
+BENCHMARK_IMPL(ping_latency_udp_100) {
+  return ping_latency("ping_latency_udp_100", LATENCY_UDP, 100, 64);
+}
@@ -82,6 +82,9 @@ static void pinger_close_cb(uv_handle_t* handle) {
   pinger = (pinger_t*)handle->data;
   fprintf(stderr, "ping_pongs: %d roundtrips/s\n", (1000 * pinger->pongs) / TIME);
   fflush(stderr);
+  benchmark_report("roundtrips",
+                   (1000.0 * pinger->pongs) / TIME,
+                   "roundtrips/s");
 
   free(pinger);
 
@@ -0,0 +1,579 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "task.h"
+#include "uv.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_WORK 1000000
+#define NUM_INFLIGHT 4096
+
+/* The mixed and multi-loop runs are timed rather than counted. */
+#define TIME 2000
+#define MIXED_INFLIGHT 16
+#define MIXED_SPIN_NS 20000
+#define LOOPS_INFLIGHT 64
+
+static uv_work_t reqs[NUM_INFLIGHT];
+static unsigned int submitted;
+static unsigned int completed;
+static uv_threadpool_t* work_pool;
+
+
+static void work_cb(uv_work_t* req) {
+  /* As short as a CPU task gets. */
+  req->data = req;
+}
+
+
+static void after_work_cb(uv_work_t* req, int status) {
+  ASSERT(status == 0);
+  completed++;
+
+  if (submitted < NUM_WORK) {
+    submitted++;
+    ASSERT(0 == uv_queue_work_pool(req->loop,
+                                   work_pool,
+                                   req,
+                                   work_cb,
+                                   after_work_cb));
+  }
+}
+
+
+static int queue_work(unsigned int nthreads) {
+  uv_threadpool_t pool;
+  uv_loop_t* loop;
+  uint64_t start;
+  uint64_t elapsed;
+  int i;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_threadpool_init(&pool, "bench", nthreads));
+  work_pool = &pool;
+  submitted = 0;
+  completed = 0;
+
+  start = uv_hrtime();
+  for (i = 0; i < NUM_INFLIGHT; i++) {
+    submitted++;
+    ASSERT(0 == uv_queue_work_pool(loop,
+                                   &pool,
+                                   reqs + i,
+                                   work_cb,
+                                   after_work_cb));
+  }
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  elapsed = uv_hrtime() - start;
+  ASSERT(completed == NUM_WORK);
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+
+  fprintf(stderr,
+          "queue_work_%u: %.2f seconds (%s/sec)\n",
+          nthreads,
+          elapsed / 1e9,
+          fmt(NUM_WORK / (elapsed / 1e9)));
+  fflush(stderr);
+  benchmark_report("work", NUM_WORK / (elapsed / 1e9), "work/s");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void batch_after_work_cb(uv_work_t* req, int status) {
+  ASSERT(status == 0);
+  completed++;
+
+  /* Refill the whole array once the last request of a round is done. */
+  if (completed == submitted && submitted < NUM_WORK) {
+    submitted += NUM_INFLIGHT;
+    ASSERT(0 == uv_queue_work_batch(req->loop,
+                                    reqs,
+                                    NUM_INFLIGHT,
+                                    work_cb,
+                                    batch_after_work_cb));
+  }
+}
+
+
+static int queue_work_batch(unsigned int nthreads) {
+  uv_threadpool_t pool;
+  uv_loop_t* loop;
+  uint64_t start;
+  uint64_t elapsed;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_threadpool_init(&pool, "bench", nthreads));
+  ASSERT(0 == uv_loop_set_threadpool(loop, &pool));
+  submitted = NUM_INFLIGHT;
+  completed = 0;
+
+  start = uv_hrtime();
+  ASSERT(0 == uv_queue_work_batch(loop,
+                                  reqs,
+                                  NUM_INFLIGHT,
+                                  work_cb,
+                                  batch_after_work_cb));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  elapsed = uv_hrtime() - start;
+  ASSERT(completed == submitted);
+  ASSERT(0 == uv_loop_set_threadpool(loop, NULL));
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+
+  fprintf(stderr,
+          "queue_work_batch_%u: %.2f seconds (%s/sec)\n",
+          nthreads,
+          elapsed / 1e9,
+          fmt(completed / (elapsed / 1e9)));
+  fflush(stderr);
+  benchmark_report("work", completed / (elapsed / 1e9), "work/s");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void pingpong_after_work_cb(uv_work_t* req, int status) {
+  ASSERT(status == 0);
+  completed++;
+
+  /* Only one request in flight, so every round trip hits an idle worker. */
+  if (completed < NUM_WORK / 10)
+    ASSERT(0 == uv_queue_work(req->loop,
+                              req,
+                              work_cb,
+                              pingpong_after_work_cb));
+}
+
+
+static int queue_work_pingpong(unsigned int spin_us) {
+  uv_threadpool_t pool;
+  uv_loop_t* loop;
+  uint64_t start;
+  uint64_t elapsed;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_threadpool_init(&pool, "bench", 4));
+  ASSERT(0 == uv_threadpool_set_spin(&pool, spin_us, 1));
+  ASSERT(0 == uv_loop_set_threadpool(loop, &pool));
+  completed = 0;
+
+  start = uv_hrtime();
+  ASSERT(0 == uv_queue_work(loop, reqs, work_cb, pingpong_after_work_cb));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  elapsed = uv_hrtime() - start;
+  ASSERT(completed == NUM_WORK / 10);
+  ASSERT(0 == uv_loop_set_threadpool(loop, NULL));
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+
+  fprintf(stderr,
+          "queue_work_pingpong%s: %.2f seconds (%s/sec)\n",
+          spin_us ? "_spin" : "",
+          elapsed / 1e9,
+          fmt(completed / (elapsed / 1e9)));
+  fflush(stderr);
+  benchmark_report("work", completed / (elapsed / 1e9), "work/s");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void print_histogram(const char* name,
+                            const char* what,
+                            const uv_phase_histogram_t* hist) {
+  fprintf(stderr,
+          "%s: %s p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+          name,
+          what,
+          uv_phase_histogram_percentile(hist, 50) / 1e3,
+          uv_phase_histogram_percentile(hist, 99) / 1e3,
+          uv_phase_histogram_percentile(hist, 99.9) / 1e3,
+          hist->max / 1e3);
+}
+
+
+static void wait_after_work_cb(uv_work_t* req, int status) {
+  ASSERT(status == 0);
+  completed++;
+
+  if (submitted < NUM_WORK / 10) {
+    submitted++;
+    ASSERT(0 == uv_queue_work(req->loop, req, work_cb, wait_after_work_cb));
+  }
+}
+
+
+/* Time from submission until a worker picks the request up, as recorded by
+ * the pool itself.  With one request in flight this is the wakeup latency,
+ * with more it is dominated by the queue depth.
+ */
+static int queue_work_wait(unsigned int inflight) {
+  uv_phase_histogram_t wait_time;
+  uv_phase_histogram_t run_time;
+  uv_threadpool_t pool;
+  uv_loop_t* loop;
+  char name[32];
+  unsigned int i;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_threadpool_init(&pool, "bench", 4));
+  ASSERT(0 == uv_threadpool_enable_histograms(&pool, 1));
+  ASSERT(0 == uv_loop_set_threadpool(loop, &pool));
+  submitted = 0;
+  completed = 0;
+
+  for (i = 0; i < inflight; i++) {
+    submitted++;
+    ASSERT(0 == uv_queue_work(loop, reqs + i, work_cb, wait_after_work_cb));
+  }
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(completed == submitted);
+  ASSERT(0 == uv_threadpool_histogram(&pool,
+                                      UV_WORK_KIND_CPU,
+                                      &wait_time,
+                                      &run_time));
+  ASSERT(wait_time.count == completed);
+  ASSERT(0 == uv_loop_set_threadpool(loop, NULL));
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+
+  snprintf(name, sizeof(name), "queue_work_wait_%u", inflight);
+  print_histogram(name, "wait", &wait_time);
+  print_histogram(name, "run", &run_time);
+  fflush(stderr);
+  benchmark_report("wait_p50",
+                   uv_phase_histogram_percentile(&wait_time, 50) / 1e3,
+                   "us");
+  benchmark_report("wait_p99",
+                   uv_phase_histogram_percentile(&wait_time, 99) / 1e3,
+                   "us");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+struct mixed_req {
+  union {
+    uv_req_t req;
+    uv_work_t work;
+    uv_fs_t fs;
+    uv_getaddrinfo_t getaddrinfo;
+  } u;
+};
+
+static struct mixed_req mixed_reqs[UV_WORK_KIND_MAX][MIXED_INFLIGHT];
+static unsigned int mixed_done[UV_WORK_KIND_MAX];
+static int mixed_stopped;
+
+
+static void mixed_work_cb(uv_work_t* req) {
+  uint64_t start;
+
+  /* A short CPU-bound task, long enough to keep the workers busy. */
+  start = uv_hrtime();
+  while (uv_hrtime() - start < MIXED_SPIN_NS)
+    ;
+}
+
+
+static void mixed_submit(uv_loop_t* loop, struct mixed_req* mr);
+
+
+static void mixed_after_work_cb(uv_work_t* req, int status) {
+  ASSERT(status == 0);
+  mixed_done[UV_WORK_KIND_CPU]++;
+  if (!mixed_stopped)
+    mixed_submit(req->loop, (struct mixed_req*) req);
+}
+
+
+static void mixed_fs_cb(uv_fs_t* req) {
+  ASSERT(req->result == 0);
+  uv_fs_req_cleanup(req);
+  mixed_done[UV_WORK_KIND_FAST_IO]++;
+  if (!mixed_stopped)
+    mixed_submit(req->loop, (struct mixed_req*) req);
+}
+
+
+static void mixed_getaddrinfo_cb(uv_getaddrinfo_t* req,
+                                 int status,
+                                 struct addrinfo* res) {
+  ASSERT(status == 0);
+  uv_freeaddrinfo(res);
+  mixed_done[UV_WORK_KIND_SLOW_IO]++;
+  if (!mixed_stopped)
+    mixed_submit(req->loop, (struct mixed_req*) req);
+}
+
+
+/* The row of mixed_reqs a request lives in says what kind of work it does. */
+static void mixed_submit(uv_loop_t* loop, struct mixed_req* mr) {
+  size_t kind;
+
+  kind = (mr - &mixed_reqs[0][0]) / MIXED_INFLIGHT;
+
+  switch (kind) {
+  case UV_WORK_KIND_CPU:
+    ASSERT(0 == uv_queue_work(loop,
+                              &mr->u.work,
+                              mixed_work_cb,
+                              mixed_after_work_cb));
+    break;
+  case UV_WORK_KIND_FAST_IO:
+    ASSERT(0 == uv_fs_stat(loop, &mr->u.fs, ".", mixed_fs_cb));
+    break;
+  case UV_WORK_KIND_SLOW_IO:
+    ASSERT(0 == uv_getaddrinfo(loop,
+                               &mr->u.getaddrinfo,
+                               mixed_getaddrinfo_cb,
+                               "localhost",
+                               NULL,
+                               NULL));
+    break;
+  default:
+    ASSERT(0 && "bad work kind");
+  }
+}
+
+
+static void mixed_timer_cb(uv_timer_t* handle) {
+  mixed_stopped = 1;
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+/* CPU tasks, file system requests and DNS lookups competing for the same
+ * four workers.  The per-kind wait times show whether the slow I/O cap
+ * keeps resolver lookups from starving everything else.
+ */
+static int queue_work_mixed(void) {
+  static const char* names[UV_WORK_KIND_MAX] = { "cpu", "fs", "dns" };
+  uv_phase_histogram_t wait_time;
+  uv_threadpool_t pool;
+  uv_timer_t timer;
+  uv_loop_t* loop;
+  uint64_t start;
+  uint64_t elapsed;
+  char what[64];
+  int kind;
+  int i;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_threadpool_init(&pool, "bench", 4));
+  ASSERT(0 == uv_threadpool_enable_histograms(&pool, 1));
+  ASSERT(0 == uv_loop_set_threadpool(loop, &pool));
+  memset(mixed_done, 0, sizeof(mixed_done));
+  mixed_stopped = 0;
+
+  ASSERT(0 == uv_timer_init(loop, &timer));
+  ASSERT(0 == uv_timer_start(&timer, mixed_timer_cb, TIME, 0));
+
+  start = uv_hrtime();
+  for (kind = 0; kind < UV_WORK_KIND_MAX; kind++)
+    for (i = 0; i < MIXED_INFLIGHT; i++)
+      mixed_submit(loop, &mixed_reqs[kind][i]);
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  elapsed = uv_hrtime() - start;
+
+  for (kind = 0; kind < UV_WORK_KIND_MAX; kind++) {
+    ASSERT(mixed_done[kind] > 0);
+    ASSERT(0 == uv_threadpool_histogram(&pool, kind, &wait_time, NULL));
+    snprintf(what,
+             sizeof(what),
+             "%s %.0f/sec, wait",
+             names[kind],
+             mixed_done[kind] / (elapsed / 1e9));
+    print_histogram("queue_work_mixed", what, &wait_time);
+
+    snprintf(what, sizeof(what), "%s", names[kind]);
+    benchmark_report(what, mixed_done[kind] / (elapsed / 1e9), "work/s");
+    snprintf(what, sizeof(what), "%s_wait_p99", names[kind]);
+    benchmark_report(what,
+                     uv_phase_histogram_percentile(&wait_time, 99) / 1e3,
+                     "us");
+  }
+  fflush(stderr);
+
+  ASSERT(0 == uv_loop_set_threadpool(loop, NULL));
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+struct submit_loop {
+  uv_loop_t loop;
+  uv_thread_t thread;
+  uv_timer_t timer;
+  uv_work_t reqs[LOOPS_INFLIGHT];
+  int stopped;
+  unsigned int completed;
+};
+
+static uv_threadpool_t* loops_pool;
+static uv_barrier_t loops_barrier;
+
+
+static void loops_after_work_cb(uv_work_t* req, int status) {
+  struct submit_loop* sl;
+
+  ASSERT(status == 0);
+  sl = req->loop->data;
+  if (sl->stopped)
+    return;
+
+  sl->completed++;
+  ASSERT(0 == uv_queue_work(req->loop, req, work_cb, loops_after_work_cb));
+}
+
+
+static void loops_timer_cb(uv_timer_t* handle) {
+  struct submit_loop* sl;
+
+  sl = handle->loop->data;
+  sl->stopped = 1;
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+static void loops_thread(void* arg) {
+  struct submit_loop* sl;
+  int i;
+
+  sl = arg;
+  ASSERT(0 == uv_loop_init(&sl->loop));
+  sl->loop.data = sl;
+  ASSERT(0 == uv_loop_set_threadpool(&sl->loop, loops_pool));
+  ASSERT(0 == uv_timer_init(&sl->loop, &sl->timer));
+
+  uv_barrier_wait(&loops_barrier);
+
+  uv_update_time(&sl->loop);
+  ASSERT(0 == uv_timer_start(&sl->timer, loops_timer_cb, TIME, 0));
+  for (i = 0; i < LOOPS_INFLIGHT; i++)
+    ASSERT(0 == uv_queue_work(&sl->loop,
+                              sl->reqs + i,
+                              work_cb,
+                              loops_after_work_cb));
+
+  ASSERT(0 == uv_run(&sl->loop, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_set_threadpool(&sl->loop, NULL));
+  ASSERT(0 == uv_loop_close(&sl->loop));
+}
+
+
+/* Many loops hammering one shared pool, the way a multi-threaded server
+ * embedding one loop per thread does.
+ */
+static int queue_work_loops(unsigned int nloops) {
+  struct submit_loop* loops;
+  uv_threadpool_t pool;
+  unsigned int total;
+  unsigned int i;
+
+  ASSERT(0 == uv_threadpool_init(&pool, "bench", 4));
+  loops_pool = &pool;
+  ASSERT(0 == uv_barrier_init(&loops_barrier, nloops));
+
+  loops = calloc(nloops, sizeof(*loops));
+  ASSERT(loops != NULL);
+  for (i = 0; i < nloops; i++)
+    ASSERT(0 == uv_thread_create(&loops[i].thread, loops_thread, loops + i));
+
+  total = 0;
+  for (i = 0; i < nloops; i++) {
+    ASSERT(0 == uv_thread_join(&loops[i].thread));
+    total += loops[i].completed;
+  }
+
+  uv_barrier_destroy(&loops_barrier);
+  free(loops);
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+
+  fprintf(stderr,
+          "queue_work_loops_%u: %s/sec\n",
+          nloops,
+          fmt(total / (TIME / 1e3)));
+  fflush(stderr);
+  benchmark_report("work", total / (TIME / 1e3), "work/s");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+BENCHMARK_IMPL(queue_work_4) {
+  return queue_work(4);
+}
+
+
+BENCHMARK_IMPL(queue_work_64) {
+  return queue_work(64);
+}
+
+
+BENCHMARK_IMPL(queue_work_batch_4) {
+  return queue_work_batch(4);
+}
+
+
+BENCHMARK_IMPL(queue_work_pingpong) {
+  return queue_work_pingpong(0);
+}
+
+
+BENCHMARK_IMPL(queue_work_pingpong_spin) {
+  return queue_work_pingpong(50);
+}
+
+
+BENCHMARK_IMPL(queue_work_wait_1) {
+  return queue_work_wait(1);
+}
+
+
+BENCHMARK_IMPL(queue_work_wait_64) {
+  return queue_work_wait(64);
+}
+
+
+BENCHMARK_IMPL(queue_work_mixed) {
+  return queue_work_mixed();
+}
+
+
+BENCHMARK_IMPL(queue_work_loops_4) {
+  return queue_work_loops(4);
+}
+
+
+BENCHMARK_IMPL(queue_work_loops_16) {
+  return queue_work_loops(16);
+}
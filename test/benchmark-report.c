@@ -0,0 +1,630 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Machine-readable benchmark results.
+ *
+ *   run-benchmarks --format=csv|json [--repeat=N] [benchmark ...]
+ *   run-benchmarks --compare [--threshold=PCT] old.csv new.csv
+ *
+ * In report mode every benchmark process appends the metrics it passes to
+ * benchmark_report() to the file named by UV_BENCHMARK_METRICS, plus the
+ * wall time of the benchmark itself.  The driver runs each benchmark N times
+ * and prints mean, standard deviation and a 95% confidence interval per
+ * metric on stdout; the usual TAP output still goes to stderr.
+ *
+ * The compare mode reads two CSV files and runs Welch's t-test on every
+ * metric they have in common.  A metric regresses when the change is
+ * significant at the 95% level, larger than the threshold (2% by default)
+ * and in the wrong direction: rates ("/s") and percentages should go up,
+ * everything else should go down.  The exit code is 1 if anything
+ * regressed, so it can gate a CI job.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+# include <sys/utsname.h>
+# include <unistd.h>
+#endif
+
+#include "runner.h"
+#include "task.h"
+#include "uv.h"
+
+#define METRICS_ENV "UV_BENCHMARK_METRICS"
+#define MAX_REPEAT 100
+#define MAX_NAME 128
+
+typedef enum {
+  FORMAT_CSV,
+  FORMAT_JSON
+} report_format_t;
+
+typedef struct {
+  char benchmark[MAX_NAME];
+  char metric[MAX_NAME];
+  char unit[32];
+  unsigned int n;
+  double mean;
+  double stddev;
+  double ci95;
+  double* samples;
+} result_t;
+
+typedef struct {
+  result_t* items;
+  unsigned int count;
+  unsigned int capacity;
+} result_list_t;
+
+
+void benchmark_report(const char* metric, double value, const char* unit) {
+  const char* path;
+  FILE* f;
+
+  path = getenv(METRICS_ENV);
+  if (path == NULL || *path == '\0')
+    return;
+
+  f = fopen(path, "a");
+  if (f == NULL)
+    return;
+
+  fprintf(f, "%s\t%.17g\t%s\n", metric, value, unit);
+  fclose(f);
+}
+
+
+/* Two-sided 97.5% quantile of Student's t distribution. */
+static double t_quantile(double df) {
+  static const double table[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+  };
+  unsigned int i;
+
+  if (df < 1)
+    return table[0];
+
+  i = (unsigned int) df;
+  if (i <= ARRAY_SIZE(table))
+    return table[i - 1];
+
+  return 1.960;
+}
+
+
+static result_t* result_get(result_list_t* list,
+                            const char* benchmark,
+                            const char* metric,
+                            const char* unit) {
+  result_t* r;
+  unsigned int i;
+
+  for (i = 0; i < list->count; i++) {
+    r = &list->items[i];
+    if (strcmp(r->benchmark, benchmark) == 0 && strcmp(r->metric, metric) == 0)
+      return r;
+  }
+
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? 2 * list->capacity : 32;
+    list->items = realloc(list->items, list->capacity * sizeof(*list->items));
+    ASSERT(list->items != NULL);
+  }
+
+  r = &list->items[list->count++];
+  memset(r, 0, sizeof(*r));
+  snprintf(r->benchmark, sizeof(r->benchmark), "%s", benchmark);
+  snprintf(r->metric, sizeof(r->metric), "%s", metric);
+  snprintf(r->unit, sizeof(r->unit), "%s", unit);
+  return r;
+}
+
+
+static void result_list_free(result_list_t* list) {
+  unsigned int i;
+
+  for (i = 0; i < list->count; i++)
+    free(list->items[i].samples);
+  free(list->items);
+  memset(list, 0, sizeof(*list));
+}
+
+
+static void result_finish(result_t* r) {
+  double sum;
+  unsigned int i;
+
+  sum = 0;
+  for (i = 0; i < r->n; i++)
+    sum += r->samples[i];
+  r->mean = sum / r->n;
+
+  sum = 0;
+  for (i = 0; i < r->n; i++)
+    sum += (r->samples[i] - r->mean) * (r->samples[i] - r->mean);
+  r->stddev = r->n > 1 ? sqrt(sum / (r->n - 1)) : 0;
+  r->ci95 = r->n > 1 ? t_quantile(r->n - 1) * r->stddev / sqrt(r->n) : 0;
+}
+
+
+/* Folds the metrics one benchmark process wrote into the result list. */
+static void collect_metrics(result_list_t* list,
+                            const char* benchmark,
+                            const char* path) {
+  char line[512];
+  char metric[MAX_NAME];
+  char unit[32];
+  double value;
+  result_t* r;
+  FILE* f;
+
+  f = fopen(path, "r");
+  if (f == NULL)
+    return;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (3 != sscanf(line, "%127[^\t]\t%lf\t%31s", metric, &value, unit))
+      continue;
+
+    r = result_get(list, benchmark, metric, unit);
+    if (r->samples == NULL) {
+      r->samples = calloc(MAX_REPEAT, sizeof(*r->samples));
+      ASSERT(r->samples != NULL);
+    }
+    if (r->n < MAX_REPEAT)
+      r->samples[r->n++] = value;
+  }
+
+  fclose(f);
+}
+
+
+static void json_string(FILE* stream, const char* s) {
+  fputc('"', stream);
+  for (; *s != '\0'; s++) {
+    if (*s == '"' || *s == '\\')
+      fprintf(stream, "\\%c", *s);
+    else if ((unsigned char) *s < 0x20)
+      fprintf(stream, "\\u%04x", (unsigned char) *s);
+    else
+      fputc(*s, stream);
+  }
+  fputc('"', stream);
+}
+
+
+static const char* build_flags(void) {
+  static const char flags[] = ""
+#ifdef __OPTIMIZE__
+    " optimize"
+#endif
+#ifdef NDEBUG
+    " ndebug"
+#endif
+#if defined(__SANITIZE_ADDRESS__)
+    " asan"
+#elif defined(__has_feature)
+# if __has_feature(address_sanitizer)
+    " asan"
+# endif
+#endif
+#if defined(_DEBUG)
+    " debug"
+#endif
+    ;
+
+  return flags[0] == '\0' ? "none" : flags + 1;
+}
+
+
+static void print_environment(FILE* stream, report_format_t format) {
+  const char* keys[7];
+  char values[7][256];
+  uv_cpu_info_t* cpus;
+  int ncpus;
+  int i;
+#ifndef _WIN32
+  struct utsname u;
+#endif
+
+  keys[0] = "libuv";
+  snprintf(values[0], sizeof(values[0]), "%s", uv_version_string());
+
+  keys[1] = "kernel";
+  keys[2] = "machine";
+#ifndef _WIN32
+  if (uname(&u) == 0) {
+    snprintf(values[1], sizeof(values[1]), "%s %s", u.sysname, u.release);
+    snprintf(values[2], sizeof(values[2]), "%s", u.machine);
+  } else
+#endif
+  {
+    snprintf(values[1], sizeof(values[1]), "unknown");
+    snprintf(values[2], sizeof(values[2]), "unknown");
+  }
+
+  keys[3] = "cpu";
+  keys[4] = "ncpus";
+  if (uv_cpu_info(&cpus, &ncpus) == 0 && ncpus > 0) {
+    snprintf(values[3], sizeof(values[3]), "%s", cpus[0].model);
+    snprintf(values[4], sizeof(values[4]), "%d", ncpus);
+    uv_free_cpu_info(cpus, ncpus);
+  } else {
+    snprintf(values[3], sizeof(values[3]), "unknown");
+    snprintf(values[4], sizeof(values[4]), "0");
+  }
+
+  keys[5] = "compiler";
+  snprintf(values[5],
+           sizeof(values[5]),
+           "%s",
+#if defined(__clang__)
+           "clang " __clang_version__
+#elif defined(__GNUC__)
+           "gcc " __VERSION__
+#elif defined(_MSC_VER)
+           "msvc"
+#else
+           "unknown"
+#endif
+           );
+
+  keys[6] = "build";
+  snprintf(values[6], sizeof(values[6]), "%s", build_flags());
+
+  for (i = 0; i < 7; i++) {
+    if (format == FORMAT_CSV) {
+      fprintf(stream, "# %s: %s\n", keys[i], values[i]);
+    } else {
+      fprintf(stream, "%s    ", i == 0 ? "" : ",\n");
+      json_string(stream, keys[i]);
+      fprintf(stream, ": ");
+      json_string(stream, values[i]);
+    }
+  }
+}
+
+
+static void print_results(FILE* stream,
+                          const result_list_t* list,
+                          report_format_t format,
+                          unsigned int repeat) {
+  const result_t* r;
+  unsigned int i;
+  unsigned int j;
+
+  if (format == FORMAT_CSV) {
+    print_environment(stream, format);
+    fprintf(stream, "# repeat: %u\n", repeat);
+    fprintf(stream, "benchmark,metric,unit,n,mean,stddev,ci95\n");
+    for (i = 0; i < list->count; i++) {
+      r = &list->items[i];
+      fprintf(stream,
+              "%s,%s,%s,%u,%.6g,%.6g,%.6g\n",
+              r->benchmark,
+              r->metric,
+              r->unit,
+              r->n,
+              r->mean,
+              r->stddev,
+              r->ci95);
+    }
+    return;
+  }
+
+  fprintf(stream, "{\n  \"environment\": {\n");
+  print_environment(stream, format);
+  fprintf(stream, "\n  },\n  \"repeat\": %u,\n  \"results\": [", repeat);
+  for (i = 0; i < list->count; i++) {
+    r = &list->items[i];
+    fprintf(stream, "%s\n    {\"benchmark\": ", i == 0 ? "" : ",");
+    json_string(stream, r->benchmark);
+    fprintf(stream, ", \"metric\": ");
+    json_string(stream, r->metric);
+    fprintf(stream, ", \"unit\": ");
+    json_string(stream, r->unit);
+    fprintf(stream,
+            ", \"n\": %u, \"mean\": %.6g, \"stddev\": %.6g, \"ci95\": %.6g, "
+            "\"samples\": [",
+            r->n,
+            r->mean,
+            r->stddev,
+            r->ci95);
+    for (j = 0; j < r->n; j++)
+      fprintf(stream, "%s%.6g", j == 0 ? "" : ", ", r->samples[j]);
+    fprintf(stream, "]}");
+  }
+  fprintf(stream, "\n  ]\n}\n");
+}
+
+
+static int set_metrics_env(const char* path) {
+#ifdef _WIN32
+  return _putenv_s(METRICS_ENV, path);
+#else
+  return setenv(METRICS_ENV, path, 1);
+#endif
+}
+
+
+static int run_report(report_format_t format,
+                      unsigned int repeat,
+                      char** names,
+                      int nnames) {
+  result_list_t list;
+  task_entry_t* task;
+  char path[64];
+  unsigned int round;
+  int current;
+  int failed;
+  int i;
+
+  memset(&list, 0, sizeof(list));
+  snprintf(path, sizeof(path), "uv-benchmark-metrics.txt");
+  if (set_metrics_env(path))
+    FATAL("cannot set " METRICS_ENV);
+
+  current = 1;
+  failed = 0;
+  for (round = 0; round < repeat; round++) {
+    for (task = TASKS; task->main; task++) {
+      if (task->is_helper)
+        continue;
+
+      if (nnames > 0) {
+        for (i = 0; i < nnames; i++)
+          if (strcmp(names[i], task->task_name) == 0)
+            break;
+        if (i == nnames)
+          continue;
+      }
+
+      remove(path);
+      if (run_test(task->task_name, 1, current++) != TEST_OK) {
+        failed++;
+        continue;
+      }
+      collect_metrics(&list, task->task_name, path);
+    }
+  }
+  remove(path);
+
+  for (i = 0; i < (int) list.count; i++)
+    result_finish(&list.items[i]);
+
+  print_results(stdout, &list, format, repeat);
+  fflush(stdout);
+  result_list_free(&list);
+
+  return failed;
+}
+
+
+static int read_csv(const char* path, result_list_t* list) {
+  char line[1024];
+  char benchmark[MAX_NAME];
+  char metric[MAX_NAME];
+  char unit[32];
+  result_t* r;
+  unsigned int n;
+  double mean;
+  double stddev;
+  double ci95;
+  FILE* f;
+
+  f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (line[0] == '#' || strncmp(line, "benchmark,", 10) == 0)
+      continue;
+
+    if (7 != sscanf(line,
+                    "%127[^,],%127[^,],%31[^,],%u,%lf,%lf,%lf",
+                    benchmark,
+                    metric,
+                    unit,
+                    &n,
+                    &mean,
+                    &stddev,
+                    &ci95)) {
+      continue;
+    }
+
+    r = result_get(list, benchmark, metric, unit);
+    r->n = n;
+    r->mean = mean;
+    r->stddev = stddev;
+    r->ci95 = ci95;
+  }
+
+  fclose(f);
+  return 0;
+}
+
+
+static int higher_is_better(const char* unit) {
+  size_t len;
+
+  len = strlen(unit);
+  if (len >= 2 && strcmp(unit + len - 2, "/s") == 0)
+    return 1;
+
+  return strcmp(unit, "%") == 0;
+}
+
+
+/* Welch's t-test on the summary statistics of two result files. */
+static int significant(const result_t* a, const result_t* b) {
+  double va;
+  double vb;
+  double se;
+  double df;
+
+  if (a->n < 2 || b->n < 2)
+    return 0;
+
+  va = a->stddev * a->stddev / a->n;
+  vb = b->stddev * b->stddev / b->n;
+  se = sqrt(va + vb);
+  if (se == 0)
+    return a->mean != b->mean;
+
+  df = (va + vb) * (va + vb) /
+       (va * va / (a->n - 1) + vb * vb / (b->n - 1));
+  return fabs(b->mean - a->mean) / se > t_quantile(df);
+}
+
+
+static int run_compare(const char* old_path,
+                       const char* new_path,
+                       double threshold) {
+  result_list_t old_list;
+  result_list_t new_list;
+  const result_t* a;
+  const result_t* b;
+  const char* verdict;
+  double change;
+  int regressions;
+  unsigned int i;
+  unsigned int j;
+
+  memset(&old_list, 0, sizeof(old_list));
+  memset(&new_list, 0, sizeof(new_list));
+  if (read_csv(old_path, &old_list) || read_csv(new_path, &new_list)) {
+    result_list_free(&old_list);
+    result_list_free(&new_list);
+    return 2;
+  }
+
+  regressions = 0;
+  printf("%-32s %-20s %14s %14s %8s  %s\n",
+         "benchmark", "metric", "old", "new", "change", "verdict");
+
+  for (i = 0; i < new_list.count; i++) {
+    b = &new_list.items[i];
+    a = NULL;
+    for (j = 0; j < old_list.count; j++) {
+      if (strcmp(old_list.items[j].benchmark, b->benchmark) == 0 &&
+          strcmp(old_list.items[j].metric, b->metric) == 0) {
+        a = &old_list.items[j];
+        break;
+      }
+    }
+
+    if (a == NULL || a->mean == 0)
+      continue;
+
+    change = 100.0 * (b->mean - a->mean) / a->mean;
+    if (fabs(change) < threshold || !significant(a, b))
+      verdict = "same";
+    else if ((change > 0) == higher_is_better(b->unit))
+      verdict = "better";
+    else {
+      verdict = "REGRESSION";
+      regressions++;
+    }
+
+    printf("%-32s %-20s %14.6g %14.6g %+7.1f%%  %s\n",
+           b->benchmark,
+           b->metric,
+           a->mean,
+           b->mean,
+           change,
+           verdict);
+  }
+
+  fflush(stdout);
+  result_list_free(&old_list);
+  result_list_free(&new_list);
+
+  return regressions > 0;
+}
+
+
+int run_benchmarks_report(int argc, char** argv) {
+  report_format_t format;
+  unsigned int repeat;
+  double threshold;
+  int compare;
+  int i;
+
+  format = FORMAT_CSV;
+  repeat = 1;
+  threshold = 2.0;
+  compare = 0;
+
+  for (i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+    if (strcmp(argv[i], "--format=csv") == 0) {
+      format = FORMAT_CSV;
+    } else if (strcmp(argv[i], "--format=json") == 0) {
+      format = FORMAT_JSON;
+    } else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+      repeat = (unsigned int) atoi(argv[i] + 9);
+      if (repeat < 1 || repeat > MAX_REPEAT) {
+        fprintf(stderr, "--repeat must be between 1 and %d\n", MAX_REPEAT);
+        return EXIT_FAILURE;
+      }
+    } else if (strncmp(argv[i], "--threshold=", 12) == 0) {
+      threshold = atof(argv[i] + 12);
+    } else if (strcmp(argv[i], "--compare") == 0) {
+      compare = 1;
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (compare) {
+    if (argc - i != 2) {
+      fprintf(stderr, "--compare needs two result files\n");
+      return EXIT_FAILURE;
+    }
+    return run_compare(argv[i], argv[i + 1], threshold);
+  }
+
+  return run_report(format, repeat, argv + i, argc - i);
+}
+
+
+/* Runs the part of a benchmark in this process, recording how long the
+ * benchmark itself (not its helpers) took.
+ */
+int run_benchmark_part(const char* test, const char* part) {
+  uint64_t start;
+  int r;
+
+  start = uv_hrtime();
+  r = run_test_part(test, part);
+  if (r == TEST_OK && strcmp(test, part) == 0)
+    benchmark_report("wall_time", (uv_hrtime() - start) / 1e6, "ms");
+
+  return r;
+}
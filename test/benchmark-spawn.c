@@ -19,11 +19,21 @@
  * IN THE SOFTWARE.
  */
 
-/* This benchmark spawns itself 1000 times. */
+/* This benchmark spawns itself 1000 times.
+ *
+ * spawn_fork设置了和自己一样的uid/gid，逼uv_spawn()走fork()那条路；
+ * 带_rss的先占住并写满RSS_MB兆内存，fork()要复制的页表跟着变多，
+ * posix_spawn()不受影响。
+ */
 
 #include "task.h"
 #include "uv.h"
 
+#include <string.h>
+#ifndef _WIN32
+# include <unistd.h>
+#endif
+
 static uv_loop_t* loop;
 
 static int N = 1000;
@@ -42,6 +52,9 @@ static int output_used;
 
 static int process_open;
 static int pipe_open;
+static int force_fork;
+
+#define RSS_MB 1024
 
 
 static void spawn(void);
@@ -114,6 +127,14 @@ static void spawn(void) {
   options.args = args;
   options.exit_cb = exit_cb;
 
+#ifndef _WIN32
+  if (force_fork) {
+    options.flags = UV_PROCESS_SETUID | UV_PROCESS_SETGID;
+    options.uid = getuid();
+    options.gid = getgid();
+  }
+#endif
+
   uv_pipe_init(loop, &out, 0);
 
   options.stdio = stdio;
@@ -134,11 +155,20 @@ static void spawn(void) {
 }
 
 
-BENCHMARK_IMPL(spawn) {
+static int run_spawn(const char* name, int fork_only, size_t rss_mb) {
   int r;
   static int64_t start_time, end_time;
+  char* ballast;
 
   loop = uv_default_loop();
+  force_fork = fork_only;
+
+  ballast = NULL;
+  if (rss_mb > 0) {
+    ballast = malloc(rss_mb << 20);
+    ASSERT(ballast != NULL);
+    memset(ballast, 1, rss_mb << 20);
+  }
 
   r = uv_exepath(exepath, &exepath_size);
   ASSERT(r == 0);
@@ -155,10 +185,33 @@ BENCHMARK_IMPL(spawn) {
   uv_update_time(loop);
   end_time = uv_now(loop);
 
-  fprintf(stderr, "spawn: %.0f spawns/s\n",
+  fprintf(stderr, "%s: %.0f spawns/s\n",
+          name,
           (double) N / (double) (end_time - start_time) * 1000.0);
   fflush(stderr);
 
+  free(ballast);
+
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+BENCHMARK_IMPL(spawn) {
+  return run_spawn("spawn", 0, 0);
+}
+
+
+BENCHMARK_IMPL(spawn_fork) {
+  return run_spawn("spawn_fork", 1, 0);
+}
+
+
+BENCHMARK_IMPL(spawn_rss) {
+  return run_spawn("spawn_rss", 0, RSS_MB);
+}
+
+
+BENCHMARK_IMPL(spawn_fork_rss) {
+  return run_spawn("spawn_fork_rss", 1, RSS_MB);
+}
@@ -0,0 +1,256 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* 定时器反复重设的开销。million_timers只测一次性启动再全部到期，真实的
+ * 服务里定时器大多是超时保护：几乎从不到期，每收一个包就重设一次。
+ *
+ * 每个规模先启动一批长期存在的定时器（超时1ms到60s不等），然后：
+ *   1. 随机做CHURN_OPS次uv_timer_again/stop+start/直接重启，得出重设速率；
+ *   2. 再跑JITTER_MS毫秒，期间JITTER_TIMERS个1~20ms的短定时器不停到期重启，
+ *      idle回调每轮循环重设CHURN_PER_IDLE个后台定时器，统计短定时器实际
+ *      触发时间比应到时间晚了多少。
+ *
+ * 定时器后端由timer_churn()的参数选择，要比较新的后端就加一个参数值和
+ * 对应的BENCHMARK_IMPL。
+ */
+
+#include "task.h"
+#include "uv.h"
+
+#define CHURN_OPS (1000 * 1000)
+#define CHURN_PER_IDLE 1000
+#define JITTER_TIMERS 1000
+#define JITTER_MS 1000
+#define MAX_SAMPLES (1000 * 1000)
+
+typedef struct {
+  uv_timer_t handle;
+  uint64_t due;
+} jitter_timer_t;
+
+static const unsigned int heap_sizes[] = { 1000, 100 * 1000, 1000 * 1000 };
+
+static uv_timer_t* timers;
+static unsigned int ntimers;
+static uint32_t rng_state;
+static uint64_t* samples;
+static unsigned int nsamples;
+
+static void jitter_cb(uv_timer_t* handle);
+
+
+/* xorshift32，每次运行的操作序列相同，heap和wheel之间可以直接比较。 */
+static uint32_t rng(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+
+static void timer_cb(uv_timer_t* handle) {
+}
+
+
+static void churn_one(void) {
+  uv_timer_t* handle;
+  uint64_t timeout;
+
+  handle = timers + rng() % ntimers;
+  timeout = 1 + rng() % 60000;
+
+  switch (rng() % 3) {
+    case 0:
+      ASSERT(0 == uv_timer_again(handle));
+      break;
+    case 1:
+      ASSERT(0 == uv_timer_stop(handle));
+      ASSERT(0 == uv_timer_start(handle, timer_cb, timeout, timeout));
+      break;
+    default:
+      ASSERT(0 == uv_timer_start(handle, timer_cb, timeout, timeout));
+      break;
+  }
+}
+
+
+static void jitter_start(jitter_timer_t* t) {
+  uint64_t timeout;
+
+  timeout = 1 + rng() % 20;
+  t->due = uv_hrtime() + timeout * 1000000;
+  ASSERT(0 == uv_timer_start(&t->handle, jitter_cb, timeout, 0));
+}
+
+
+static void jitter_cb(uv_timer_t* handle) {
+  jitter_timer_t* t;
+  uint64_t now;
+
+  t = container_of(handle, jitter_timer_t, handle);
+  now = uv_hrtime();
+
+  /* loop->time用的是粗粒度时钟，会比uv_hrtime()早几毫秒到期，早到的算0 */
+  if (nsamples < MAX_SAMPLES)
+    samples[nsamples++] = now > t->due ? now - t->due : 0;
+
+  jitter_start(t);
+}
+
+
+static void idle_cb(uv_idle_t* handle) {
+  int i;
+
+  for (i = 0; i < CHURN_PER_IDLE; i++)
+    churn_one();
+}
+
+
+static void stop_cb(uv_timer_t* handle) {
+  uv_stop(handle->loop);
+}
+
+
+static int compare_samples(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+  return x < y ? -1 : x > y;
+}
+
+
+static void churn_run(int wheel, unsigned int size) {
+  jitter_timer_t* jitter;
+  uv_timer_t stop_handle;
+  uv_idle_t idle_handle;
+  uv_loop_t loop;
+  uint64_t before;
+  uint64_t start_ns;
+  uint64_t rearm_ns;
+  uint64_t sum;
+  double mean;
+  double p99;
+  double max;
+  char name[64];
+  unsigned int i;
+  uint64_t timeout;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  if (wheel)
+    ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_TIMER_WHEEL));
+
+  ntimers = size;
+  timers = malloc(ntimers * sizeof(timers[0]));
+  ASSERT(timers != NULL);
+  jitter = malloc(JITTER_TIMERS * sizeof(jitter[0]));
+  ASSERT(jitter != NULL);
+  rng_state = 2463534242u;
+  nsamples = 0;
+
+  before = uv_hrtime();
+  for (i = 0; i < ntimers; i++) {
+    timeout = 1 + rng() % 60000;
+    ASSERT(0 == uv_timer_init(&loop, timers + i));
+    ASSERT(0 == uv_timer_start(timers + i, timer_cb, timeout, timeout));
+  }
+  start_ns = uv_hrtime() - before;
+
+  before = uv_hrtime();
+  for (i = 0; i < CHURN_OPS; i++)
+    churn_one();
+  rearm_ns = uv_hrtime() - before;
+
+  uv_update_time(&loop);
+  for (i = 0; i < JITTER_TIMERS; i++) {
+    ASSERT(0 == uv_timer_init(&loop, &jitter[i].handle));
+    jitter_start(jitter + i);
+  }
+
+  ASSERT(0 == uv_idle_init(&loop, &idle_handle));
+  ASSERT(0 == uv_idle_start(&idle_handle, idle_cb));
+  ASSERT(0 == uv_timer_init(&loop, &stop_handle));
+  ASSERT(0 == uv_timer_start(&stop_handle, stop_cb, JITTER_MS, 0));
+
+  /* 后台定时器一直活着，靠stop_cb退出 */
+  ASSERT(0 != uv_run(&loop, UV_RUN_DEFAULT));
+
+  close_loop(&loop);
+  ASSERT(0 == uv_loop_close(&loop));
+
+  ASSERT(nsamples > 0);
+  qsort(samples, nsamples, sizeof(samples[0]), compare_samples);
+  sum = 0;
+  for (i = 0; i < nsamples; i++)
+    sum += samples[i];
+  mean = sum / 1e6 / nsamples;
+  p99 = samples[(uint64_t) nsamples * 99 / 100] / 1e6;
+  max = samples[nsamples - 1] / 1e6;
+
+  fprintf(stderr,
+          "%s, %u timers: %.0f starts/s, %.0f re-arms/s, "
+          "lateness mean %.3f ms, p99 %.3f ms, max %.3f ms\n",
+          wheel ? "wheel" : "heap",
+          size,
+          ntimers / (start_ns / 1e9),
+          CHURN_OPS / (rearm_ns / 1e9),
+          mean,
+          p99,
+          max);
+  fflush(stderr);
+
+  snprintf(name, sizeof(name), "start_%u", size);
+  benchmark_report(name, ntimers / (start_ns / 1e9), "ops/s");
+  snprintf(name, sizeof(name), "rearm_%u", size);
+  benchmark_report(name, CHURN_OPS / (rearm_ns / 1e9), "ops/s");
+  snprintf(name, sizeof(name), "lateness_mean_%u", size);
+  benchmark_report(name, mean, "ms");
+  snprintf(name, sizeof(name), "lateness_p99_%u", size);
+  benchmark_report(name, p99, "ms");
+
+  free(jitter);
+  free(timers);
+  timers = NULL;
+}
+
+
+static int timer_churn(int wheel) {
+  unsigned int i;
+
+  samples = malloc(MAX_SAMPLES * sizeof(samples[0]));
+  ASSERT(samples != NULL);
+
+  for (i = 0; i < ARRAY_SIZE(heap_sizes); i++)
+    churn_run(wheel, heap_sizes[i]);
+
+  free(samples);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+BENCHMARK_IMPL(timer_churn) {
+  return timer_churn(0);
+}
+
+
+BENCHMARK_IMPL(timer_churn_wheel) {
+  return timer_churn(1);
+}
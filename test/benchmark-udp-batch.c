@@ -0,0 +1,427 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* UDP批量收发。udp_pummel只用uv_udp_send()一个一个地发很小的报文，这里按
+ * 报文大小分别测每秒报文数和每个报文花的CPU时间：
+ *
+ *   udp_send_*  loop线程往一个不读的socket发送，内核收不下就丢，只算发送的
+ *               开销。single每个报文一次sendmsg()，mmsg用
+ *               uv_udp_try_send_batch()（sendmmsg()），gso用
+ *               uv_udp_send_gso()；_connected先uv_udp_connect()再不带地址发。
+ *   udp_recv_*  另一个线程尽量快地发，loop线程接收。single普通接收，mmsg用
+ *               UV_UDP_RECVMMSG，gro打开UDP_GRO（对面用GSO发）。
+ *
+ * CPU时间只算loop线程自己的，接收测试里不包括发送线程。
+ */
+
+#include "task.h"
+#include "uv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DURATION 1000 /* ms */
+#define BATCH 20
+#define GSO_MAX_SEGMENTS 64
+#define GSO_MAX_BYTES 65000
+
+typedef enum {
+  SEND_SINGLE,
+  SEND_MMSG,
+  SEND_GSO
+} send_mode_t;
+
+typedef enum {
+  RECV_SINK,
+  RECV_SINGLE,
+  RECV_MMSG,
+  RECV_GRO
+} recv_mode_t;
+
+typedef struct {
+  uv_loop_t* loop;
+  uv_udp_t handle;
+  uv_idle_t idle;
+  uv_async_t stop;
+  uv_udp_send_t req;
+  const struct sockaddr* addr;
+  send_mode_t mode;
+  unsigned int size;
+  unsigned int segments;
+  uv_buf_t bufs[BATCH];
+  int pending;
+  int error;
+  uint64_t packets;
+} sender_t;
+
+static const unsigned int payload_sizes[] = { 64, 512, 1400 };
+
+static char payload[GSO_MAX_BYTES];
+static char slab[BATCH * 64 * 1024];
+static struct sockaddr_in recv_addr;
+static uv_udp_t recv_handle;
+static uint64_t recv_packets;
+
+
+/* 当前线程用掉的CPU时间，单位纳秒 */
+static uint64_t cpu_time(void) {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec ts;
+
+  ASSERT(0 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts));
+  return ts.tv_sec * (uint64_t) 1e9 + ts.tv_nsec;
+#else
+  uv_rusage_t ru;
+
+  ASSERT(0 == uv_getrusage(&ru));
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * (uint64_t) 1e9 +
+         (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * (uint64_t) 1e3;
+#endif
+}
+
+
+static void send_cb(uv_udp_send_t* req, int status) {
+  sender_t* s;
+
+  s = container_of(req, sender_t, req);
+  s->pending = 0;
+
+  if (status == UV_ECANCELED)
+    return;
+
+  if (status != 0) {
+    s->error = status;
+    return;
+  }
+
+  s->packets += s->segments;
+}
+
+
+static void send_idle_cb(uv_idle_t* idle) {
+  sender_t* s;
+  uv_buf_t buf;
+  int i;
+  int r;
+
+  s = container_of(idle, sender_t, idle);
+  if (s->error != 0)
+    return;
+
+  switch (s->mode) {
+    case SEND_SINGLE:
+      for (i = 0; i < BATCH; i++) {
+        r = uv_udp_try_send(&s->handle, s->bufs, 1, s->addr);
+        if (r == UV_EAGAIN)
+          break;
+        ASSERT(r >= 0);
+        s->packets++;
+      }
+      break;
+
+    case SEND_MMSG:
+      r = uv_udp_try_send_batch(&s->handle, s->bufs, BATCH, s->addr);
+      if (r == UV_EAGAIN)
+        break;
+      ASSERT(r > 0);
+      s->packets += r;
+      break;
+
+    case SEND_GSO:
+      if (s->pending)
+        break;
+      buf = uv_buf_init(payload, s->size * s->segments);
+      r = uv_udp_send_gso(&s->req,
+                          &s->handle,
+                          &buf,
+                          1,
+                          s->addr,
+                          s->size,
+                          send_cb);
+      if (r != 0) {
+        s->error = r;
+        break;
+      }
+      s->pending = 1;
+      break;
+  }
+}
+
+
+static void sender_stop_cb(uv_async_t* handle) {
+  sender_t* s;
+
+  s = container_of(handle, sender_t, stop);
+  uv_close((uv_handle_t*) &s->idle, NULL);
+  uv_close((uv_handle_t*) &s->handle, NULL);
+  uv_close((uv_handle_t*) &s->stop, NULL);
+}
+
+
+static void sender_init(sender_t* s,
+                        uv_loop_t* loop,
+                        send_mode_t mode,
+                        unsigned int size,
+                        int connected) {
+  unsigned int i;
+
+  memset(s, 0, sizeof(*s));
+  s->loop = loop;
+  s->mode = mode;
+  s->size = size;
+  s->segments = 1;
+  s->addr = (const struct sockaddr*) &recv_addr;
+
+  if (mode == SEND_GSO) {
+    s->segments = GSO_MAX_BYTES / size;
+    if (s->segments > GSO_MAX_SEGMENTS)
+      s->segments = GSO_MAX_SEGMENTS;
+  }
+
+  for (i = 0; i < BATCH; i++)
+    s->bufs[i] = uv_buf_init(payload, size);
+
+  ASSERT(0 == uv_udp_init(loop, &s->handle));
+  if (connected) {
+    ASSERT(0 == uv_udp_connect(&s->handle, s->addr));
+    s->addr = NULL;
+  }
+
+  ASSERT(0 == uv_idle_init(loop, &s->idle));
+  ASSERT(0 == uv_idle_start(&s->idle, send_idle_cb));
+  ASSERT(0 == uv_async_init(loop, &s->stop, sender_stop_cb));
+}
+
+
+static void sender_thread(void* arg) {
+  sender_t* s;
+
+  s = arg;
+  ASSERT(0 == uv_run(s->loop, UV_RUN_DEFAULT));
+}
+
+
+static void alloc_cb(uv_handle_t* handle,
+                     size_t suggested_size,
+                     uv_buf_t* buf) {
+  ASSERT(suggested_size <= sizeof(slab));
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void recv_cb(uv_udp_t* handle,
+                    ssize_t nread,
+                    const uv_buf_t* buf,
+                    const struct sockaddr* addr,
+                    unsigned flags) {
+  unsigned int segment;
+
+  ASSERT(nread >= 0);
+  if (addr == NULL)
+    return;
+
+  if (flags & UV_UDP_GRO) {
+    segment = uv_udp_get_gro_segment_size(handle);
+    recv_packets += (nread + segment - 1) / segment;
+  } else {
+    recv_packets++;
+  }
+}
+
+
+static void timer_cb(uv_timer_t* handle) {
+  sender_t* s;
+
+  /* recv_handle等发送方关掉以后再关，否则发送方会收到ICMP端口不可达，
+   * 之后的发送返回UV_ECONNREFUSED
+   */
+  s = handle->data;
+  ASSERT(0 == uv_async_send(&s->stop));
+  ASSERT(0 == uv_udp_recv_stop(&recv_handle));
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+/* 返回0表示这台机器不支持要测的方式 */
+static int run_case(const char* name,
+                    send_mode_t send_mode,
+                    recv_mode_t recv_mode,
+                    int connected,
+                    unsigned int size) {
+  uv_loop_t sender_loop;
+  uv_thread_t tid;
+  uv_timer_t timer;
+  uv_loop_t* loop;
+  sender_t sender;
+  uint64_t packets;
+  uint64_t before;
+  uint64_t elapsed;
+  uint64_t cpu;
+  double pps;
+  double ns;
+  char metric[64];
+  int r;
+
+  loop = uv_default_loop();
+  recv_packets = 0;
+
+  r = uv_udp_init_ex(loop,
+                     &recv_handle,
+                     recv_mode == RECV_MMSG ? UV_UDP_RECVMMSG : 0);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_udp_bind(&recv_handle,
+                          (const struct sockaddr*) &recv_addr,
+                          0));
+
+  if (recv_mode == RECV_GRO) {
+    r = uv_udp_set_gro(&recv_handle, 1);
+    if (r != 0) {
+      uv_close((uv_handle_t*) &recv_handle, NULL);
+      ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+      return 0;
+    }
+  }
+
+  if (recv_mode != RECV_SINK)
+    ASSERT(0 == uv_udp_recv_start(&recv_handle, alloc_cb, recv_cb));
+
+  if (recv_mode == RECV_SINK) {
+    sender_init(&sender, loop, send_mode, size, connected);
+  } else {
+    ASSERT(0 == uv_loop_init(&sender_loop));
+    sender_init(&sender, &sender_loop, send_mode, size, connected);
+    ASSERT(0 == uv_thread_create(&tid, sender_thread, &sender));
+  }
+
+  ASSERT(0 == uv_timer_init(loop, &timer));
+  ASSERT(0 == uv_timer_start(&timer, timer_cb, DURATION, 0));
+  timer.data = &sender;
+
+  before = uv_hrtime();
+  cpu = cpu_time();
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  cpu = cpu_time() - cpu;
+  elapsed = uv_hrtime() - before;
+
+  if (recv_mode != RECV_SINK) {
+    ASSERT(0 == uv_thread_join(&tid));
+    ASSERT(0 == uv_loop_close(&sender_loop));
+  }
+
+  uv_close((uv_handle_t*) &recv_handle, NULL);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  if (sender.error == UV_ENOTSUP || sender.error == UV_EINVAL ||
+      sender.error == UV_EIO) {
+    return 0;
+  }
+  ASSERT(sender.error == 0);
+
+  packets = recv_mode == RECV_SINK ? sender.packets : recv_packets;
+  ASSERT(packets > 0);
+  pps = packets / (elapsed / 1e9);
+  ns = (double) cpu / packets;
+
+  fprintf(stderr,
+          "%s, %4u bytes: %9.0f packets/s, %6.0f ns CPU/packet, %7.1f MB/s\n",
+          name,
+          size,
+          pps,
+          ns,
+          pps * size / (1024 * 1024));
+  fflush(stderr);
+
+  snprintf(metric, sizeof(metric), "packets_%u", size);
+  benchmark_report(metric, pps, "packets/s");
+  snprintf(metric, sizeof(metric), "cpu_%u", size);
+  benchmark_report(metric, ns, "ns/packet");
+  return 1;
+}
+
+
+static int udp_batch(const char* name,
+                     send_mode_t send_mode,
+                     recv_mode_t recv_mode,
+                     int connected) {
+  unsigned int i;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &recv_addr));
+  memset(payload, 'x', sizeof(payload));
+
+  for (i = 0; i < ARRAY_SIZE(payload_sizes); i++) {
+    if (!run_case(name, send_mode, recv_mode, connected, payload_sizes[i])) {
+      fprintf(stderr, "%s: not supported on this system\n", name);
+      fflush(stderr);
+      break;
+    }
+  }
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+BENCHMARK_IMPL(udp_send_single) {
+  return udp_batch("udp_send_single", SEND_SINGLE, RECV_SINK, 0);
+}
+
+
+BENCHMARK_IMPL(udp_send_single_connected) {
+  return udp_batch("udp_send_single_connected", SEND_SINGLE, RECV_SINK, 1);
+}
+
+
+BENCHMARK_IMPL(udp_send_mmsg) {
+  return udp_batch("udp_send_mmsg", SEND_MMSG, RECV_SINK, 0);
+}
+
+
+BENCHMARK_IMPL(udp_send_mmsg_connected) {
+  return udp_batch("udp_send_mmsg_connected", SEND_MMSG, RECV_SINK, 1);
+}
+
+
+BENCHMARK_IMPL(udp_send_gso) {
+  return udp_batch("udp_send_gso", SEND_GSO, RECV_SINK, 0);
+}
+
+
+BENCHMARK_IMPL(udp_send_gso_connected) {
+  return udp_batch("udp_send_gso_connected", SEND_GSO, RECV_SINK, 1);
+}
+
+
+BENCHMARK_IMPL(udp_recv_single) {
+  return udp_batch("udp_recv_single", SEND_MMSG, RECV_SINGLE, 0);
+}
+
+
+BENCHMARK_IMPL(udp_recv_mmsg) {
+  return udp_batch("udp_recv_mmsg", SEND_MMSG, RECV_MMSG, 0);
+}
+
+
+BENCHMARK_IMPL(udp_recv_gro) {
+  return udp_batch("udp_recv_gro", SEND_GSO, RECV_GRO, 0);
+}
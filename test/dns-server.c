@@ -335,6 +335,7 @@ HELPER_IMPL(dns_server) {
   if (dns_start(TEST_PORT_2))
     return 1;
 
+  notify_parent_process();
   uv_run(loop, UV_RUN_DEFAULT);
   return 0;
 }
@@ -36,10 +36,16 @@ int main(int argc, char **argv) {
   if (platform_init(argc, argv))
     return EXIT_FAILURE;
 
+  /* --format, --repeat and --compare; see benchmark-report.c */
+  if (argc > 1 && strncmp(argv[1], "--", 2) == 0 &&
+      strcmp(argv[1], "--list") != 0) {
+    return run_benchmarks_report(argc, argv);
+  }
+
   switch (argc) {
   case 1: return run_tests(1);
   case 2: return maybe_run_test(argc, argv);
-  case 3: return run_test_part(argv[1], argv[2]);
+  case 3: return run_benchmark_part(argv[1], argv[2]);
   default:
     fprintf(stderr, "Too many arguments.\n");
     fflush(stderr);
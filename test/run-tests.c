@@ -52,6 +52,9 @@ int ipc_helper_bind_twice(void);
 int stdio_over_pipes_helper(void);
 int spawn_stdin_stdout(void);
 int spawn_tcp_server_helper(void);
+#ifndef _WIN32
+int process_pool_worker_helper(void);
+#endif
 
 static int maybe_run_test(int argc, char **argv);
 
@@ -115,6 +118,12 @@ static int maybe_run_test(int argc, char **argv) {
     return stdio_over_pipes_helper();
   }
 
+#ifndef _WIN32
+  if (strcmp(argv[1], "process_pool_worker") == 0) {
+    return process_pool_worker_helper();
+  }
+#endif
+
   if (strcmp(argv[1], "spawn_helper1") == 0) {
     notify_parent_process();
     return 1;
@@ -120,6 +120,13 @@ int run_test(const char* test,
  */
 int run_test_part(const char* test, const char* part);
 
+/*
+ * Machine-readable benchmark results, implemented in benchmark-report.c.
+ * run_benchmark_part() is run_test_part() plus wall time reporting.
+ */
+int run_benchmarks_report(int argc, char** argv);
+int run_benchmark_part(const char* test, const char* part);
+
 
 /*
  * Print tests in sorted order to `stream`. Used by `./run-tests --list`.
@@ -123,6 +123,11 @@ void uv_sleep(int msec);
 /* Format big numbers nicely. WARNING: leaks memory. */
 const char* fmt(double d);
 
+/* Record a benchmark result when run-benchmarks is in --format mode, a no-op
+ * otherwise. Units ending in "/s" and "%" are better when higher.
+ */
+void benchmark_report(const char* metric, double value, const char* unit);
+
 /* Reserved test exit codes. */
 enum test_status {
   TEST_OK = 0,
@@ -24,6 +24,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifndef _WIN32
+# include <poll.h>
+#endif
+
 static uv_thread_t thread;
 static uv_mutex_t mutex;
 
@@ -132,3 +136,198 @@ TEST_IMPL(async) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+static uv_async_t pending_handles[100];
+static int pending_order[100];
+static int pending_cb_called;
+
+
+static void pending_cb(uv_async_t* handle) {
+  pending_order[pending_cb_called++] = (int) (handle - pending_handles);
+
+  /* Closing a handle that is still queued must keep it from running. */
+  if (handle == pending_handles + 10)
+    uv_close((uv_handle_t*) (pending_handles + 20), NULL);
+}
+
+
+TEST_IMPL(async_pending) {
+  uv_loop_t loop;
+  int i;
+
+  ASSERT(0 == uv_loop_init(&loop));
+
+  for (i = 0; i < (int) ARRAY_SIZE(pending_handles); i++)
+    ASSERT(0 == uv_async_init(&loop, pending_handles + i, pending_cb));
+
+  /* Only the handles that were sent run, in the order they were sent, once
+   * per wakeup no matter how often they were sent.
+   */
+  ASSERT(0 == uv_async_send(pending_handles + 30));
+  ASSERT(0 == uv_async_send(pending_handles + 10));
+  ASSERT(0 == uv_async_send(pending_handles + 20));
+  ASSERT(0 == uv_async_send(pending_handles + 40));
+  ASSERT(0 == uv_async_send(pending_handles + 50));
+  ASSERT(0 == uv_async_send(pending_handles + 30));
+
+  /* Closing a pending handle takes it off the pending list. */
+  uv_close((uv_handle_t*) (pending_handles + 40), NULL);
+
+  ASSERT(0 != uv_run(&loop, UV_RUN_NOWAIT));
+  ASSERT(3 == pending_cb_called);
+  ASSERT(30 == pending_order[0]);
+  ASSERT(10 == pending_order[1]);
+  ASSERT(50 == pending_order[2]);
+
+  for (i = 0; i < (int) ARRAY_SIZE(pending_handles); i++)
+    if (i != 20 && i != 40)
+      uv_close((uv_handle_t*) (pending_handles + i), NULL);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(3 == pending_cb_called);
+  ASSERT(0 == uv_loop_close(&loop));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+#define DATA_THREADS 4
+#define DATA_MSGS 10000
+
+static uv_async_t data_handle;
+static uv_async_msg_t data_msgs[DATA_THREADS][DATA_MSGS];
+static int data_last[DATA_THREADS];
+static int data_received;
+static int data_batches;
+
+
+static void data_thread_cb(void* arg) {
+  uv_async_msg_t* msgs;
+  int i;
+
+  msgs = arg;
+  for (i = 0; i < DATA_MSGS; i++) {
+    msgs[i].data = (void*) (intptr_t) i;
+    ASSERT(0 == uv_async_send_data(&data_handle, msgs + i));
+  }
+}
+
+
+static void data_cb(uv_async_t* handle) {
+  uv_async_msg_t* msg;
+  int thread;
+  int seq;
+
+  ASSERT(handle == &data_handle);
+  data_batches++;
+
+  for (msg = uv_async_recv_data(handle); msg != NULL; msg = msg->next) {
+    thread = (int) ((msg - &data_msgs[0][0]) / DATA_MSGS);
+    seq = (int) (intptr_t) msg->data;
+    /* Messages from one thread arrive in the order that thread sent them. */
+    ASSERT(seq == data_last[thread]);
+    data_last[thread]++;
+    data_received++;
+  }
+
+  if (data_received == DATA_THREADS * DATA_MSGS)
+    uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+TEST_IMPL(async_send_data) {
+  uv_thread_t threads[DATA_THREADS];
+  uv_loop_t loop;
+  int i;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_async_init(&loop, &data_handle, data_cb));
+  ASSERT(NULL == uv_async_recv_data(&data_handle));
+
+  for (i = 0; i < DATA_THREADS; i++)
+    ASSERT(0 == uv_thread_create(threads + i, data_thread_cb, data_msgs[i]));
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  for (i = 0; i < DATA_THREADS; i++)
+    ASSERT(0 == uv_thread_join(threads + i));
+
+  ASSERT(DATA_THREADS * DATA_MSGS == data_received);
+  ASSERT(data_batches > 0);
+  ASSERT(data_batches <= data_received);
+
+  ASSERT(NULL == uv_async_recv_data(&data_handle));
+
+  ASSERT(0 == uv_loop_close(&loop));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static uv_async_t busy_handle;
+static uv_check_t busy_check;
+static int busy_cb_called;
+
+
+static void busy_cb(uv_async_t* handle) {
+  busy_cb_called++;
+}
+
+
+/* The loop is running callbacks, so these sends do not wake it up. */
+static void busy_timer_cb(uv_timer_t* handle) {
+  ASSERT(0 == uv_async_send(&busy_handle));
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+static void busy_check_cb(uv_check_t* handle) {
+  ASSERT(0 == uv_async_send(&busy_handle));
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+TEST_IMPL(async_send_busy) {
+  uv_timer_t timer;
+  uv_loop_t loop;
+#ifndef _WIN32
+  struct pollfd pfd;
+#endif
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_async_init(&loop, &busy_handle, busy_cb));
+
+  /* A send from a callback before the poll phase runs in the same iteration
+   * instead of letting the loop block.
+   */
+  ASSERT(0 == uv_timer_init(&loop, &timer));
+  ASSERT(0 == uv_timer_start(&timer, busy_timer_cb, 0, 0));
+  ASSERT(0 != uv_run(&loop, UV_RUN_ONCE));
+  ASSERT(1 == busy_cb_called);
+
+  /* A send left over when uv_run() returns makes the backend fd readable so
+   * that an embedder polling uv_backend_fd() notices it.
+   */
+  ASSERT(0 == uv_check_init(&loop, &busy_check));
+  ASSERT(0 == uv_check_start(&busy_check, busy_check_cb));
+  ASSERT(0 != uv_run(&loop, UV_RUN_NOWAIT));
+  ASSERT(1 == busy_cb_called);
+
+#ifndef _WIN32
+  pfd.fd = uv_backend_fd(&loop);
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  ASSERT(1 == poll(&pfd, 1, 1000));
+#endif
+
+  ASSERT(0 != uv_run(&loop, UV_RUN_NOWAIT));
+  ASSERT(2 == busy_cb_called);
+
+  uv_close((uv_handle_t*) &busy_handle, NULL);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_close(&loop));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -0,0 +1,157 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "uv.h"
+#include "task.h"
+
+#include <sched.h>
+#include <stdlib.h>
+
+#define NITEMS 100000
+#define NPRODUCERS 4
+#define NMESSAGES 10000
+
+struct message {
+  uv_mpsc_node_t node;
+  int producer;
+  int seq;
+};
+
+static uv_spsc_ring_t ring;
+static uv_mpsc_queue_t queue;
+static uv_async_t async;
+static struct message messages[NPRODUCERS][NMESSAGES];
+static int next_seq[NPRODUCERS];
+static int nreceived;
+static uv_thread_t threads[NPRODUCERS];
+
+
+static void ring_producer(void* arg) {
+  uintptr_t i;
+
+  for (i = 1; i <= NITEMS; i++)
+    while (uv_spsc_ring_push(&ring, (void*) i) == UV_EAGAIN)
+      sched_yield();
+}
+
+
+TEST_IMPL(atomic_queue_spsc) {
+  uv_thread_t thread;
+  uintptr_t expected;
+  void* item;
+  int i;
+
+  ASSERT(UV_EINVAL == uv_spsc_ring_init(&ring, 0));
+
+  /* 容量取整到4 */
+  ASSERT(0 == uv_spsc_ring_init(&ring, 3));
+  ASSERT(UV_EAGAIN == uv_spsc_ring_pop(&ring, &item));
+  for (i = 0; i < 4; i++)
+    ASSERT(0 == uv_spsc_ring_push(&ring, messages[0] + i));
+  ASSERT(UV_EAGAIN == uv_spsc_ring_push(&ring, messages[0] + 4));
+  for (i = 0; i < 4; i++) {
+    ASSERT(0 == uv_spsc_ring_pop(&ring, &item));
+    ASSERT(item == messages[0] + i);
+  }
+  ASSERT(UV_EAGAIN == uv_spsc_ring_pop(&ring, &item));
+  uv_spsc_ring_destroy(&ring);
+
+  /* 另一个线程生产，这里按顺序收到每一个 */
+  ASSERT(0 == uv_spsc_ring_init(&ring, 64));
+  ASSERT(0 == uv_thread_create(&thread, ring_producer, NULL));
+  for (expected = 1; expected <= NITEMS; expected++) {
+    while (uv_spsc_ring_pop(&ring, &item) == UV_EAGAIN)
+      sched_yield();
+    ASSERT((uintptr_t) item == expected);
+  }
+  ASSERT(0 == uv_thread_join(&thread));
+  ASSERT(UV_EAGAIN == uv_spsc_ring_pop(&ring, &item));
+  uv_spsc_ring_destroy(&ring);
+
+  return 0;
+}
+
+
+static void queue_producer(void* arg) {
+  struct message* m;
+  int producer;
+  int i;
+
+  producer = (int) (intptr_t) arg;
+  for (i = 0; i < NMESSAGES; i++) {
+    m = &messages[producer][i];
+    m->producer = producer;
+    m->seq = i;
+    uv_mpsc_queue_push(&queue, &m->node);
+    ASSERT(0 == uv_async_send(&async));
+  }
+}
+
+
+static void async_cb(uv_async_t* handle) {
+  uv_mpsc_node_t* node;
+  struct message* m;
+  int i;
+
+  while ((node = uv_mpsc_queue_pop(&queue)) != NULL) {
+    m = container_of(node, struct message, node);
+    /* 同一个生产者的消息保持顺序 */
+    ASSERT(m->seq == next_seq[m->producer]);
+    next_seq[m->producer]++;
+    nreceived++;
+  }
+
+  /* 等生产者最后一次uv_async_send()返回以后再关闭 */
+  if (nreceived == NPRODUCERS * NMESSAGES) {
+    for (i = 0; i < NPRODUCERS; i++)
+      ASSERT(0 == uv_thread_join(threads + i));
+    uv_close((uv_handle_t*) handle, NULL);
+  }
+}
+
+
+TEST_IMPL(atomic_queue_mpsc) {
+  struct message m;
+  int i;
+
+  uv_mpsc_queue_init(&queue);
+  ASSERT(NULL == uv_mpsc_queue_pop(&queue));
+  uv_mpsc_queue_push(&queue, &m.node);
+  ASSERT(&m.node == uv_mpsc_queue_pop(&queue));
+  ASSERT(NULL == uv_mpsc_queue_pop(&queue));
+
+  ASSERT(0 == uv_async_init(uv_default_loop(), &async, async_cb));
+  for (i = 0; i < NPRODUCERS; i++)
+    ASSERT(0 == uv_thread_create(threads + i,
+                                 queue_producer,
+                                 (void*) (intptr_t) i));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(nreceived == NPRODUCERS * NMESSAGES);
+  for (i = 0; i < NPRODUCERS; i++)
+    ASSERT(next_seq[i] == NMESSAGES);
+  ASSERT(NULL == uv_mpsc_queue_pop(&queue));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -0,0 +1,240 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+# include <sys/socket.h>
+# include <unistd.h>
+#endif
+
+static uv_buf_pool_t buf_pool;
+static uv_pipe_t pipe_handle;
+static uv_udp_t server;
+static uv_udp_t client;
+static uv_udp_send_t send_req;
+static char* first_base;
+static char chunk[2048];
+static int nreads;
+static int nrecvs;
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  if (buf->base != NULL) {
+    ASSERT(buf->len == buf_pool.buf_size);
+    /* Every buffer comes back, so the pool keeps handing out the same one. */
+    if (first_base == NULL)
+      first_base = buf->base;
+    ASSERT(buf->base == first_base);
+    ASSERT(buf_pool.nused == 1);
+  }
+
+  uv_buf_pool_release(&buf_pool, buf->base);
+
+  if (nread == UV_EOF) {
+    uv_close((uv_handle_t*) stream, NULL);
+    return;
+  }
+
+  ASSERT(nread >= 0);
+  if (nread > 0)
+    nreads++;
+}
+
+
+static void recv_cb(uv_udp_t* handle,
+                    ssize_t nread,
+                    const uv_buf_t* buf,
+                    const struct sockaddr* addr,
+                    unsigned int flags) {
+  ASSERT(nread >= 0);
+  ASSERT(buf->base == NULL || buf->len == buf_pool.buf_size);
+  uv_buf_pool_release(&buf_pool, buf->base);
+
+  if (nread == 0)
+    return;
+
+  ASSERT(nread == 4);
+  nrecvs++;
+  uv_close((uv_handle_t*) handle, NULL);
+  uv_close((uv_handle_t*) &client, NULL);
+}
+
+
+static void send_cb(uv_udp_send_t* req, int status) {
+  ASSERT(status == 0);
+}
+
+
+TEST_IMPL(buf_pool) {
+  uv_buf_t bufs[3];
+  int i;
+
+  ASSERT(UV_EINVAL == uv_buf_pool_init(&buf_pool, 1, 0));
+  ASSERT(0 == uv_buf_pool_init(&buf_pool, 1024, 2));
+
+  for (i = 0; i < 3; i++) {
+    bufs[i] = uv_buf_pool_get(&buf_pool);
+    ASSERT(bufs[i].base != NULL);
+    ASSERT(bufs[i].len == 1024);
+  }
+  ASSERT(buf_pool.nused == 3);
+  ASSERT(UV_EBUSY == uv_buf_pool_destroy(&buf_pool));
+
+  /* Only max_free buffers are kept around. */
+  for (i = 0; i < 3; i++)
+    uv_buf_pool_release(&buf_pool, bufs[i].base);
+  uv_buf_pool_release(&buf_pool, NULL);
+  ASSERT(buf_pool.nused == 0);
+  ASSERT(buf_pool.nfree == 2);
+
+  bufs[0] = uv_buf_pool_get(&buf_pool);
+  ASSERT(bufs[0].base == bufs[1].base);
+  ASSERT(buf_pool.nfree == 1);
+  uv_buf_pool_release(&buf_pool, bufs[0].base);
+
+  ASSERT(0 == uv_buf_pool_destroy(&buf_pool));
+  ASSERT(buf_pool.nfree == 0);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(buf_pool_hugepages) {
+#ifdef _WIN32
+  RETURN_SKIP("Test not implemented on Windows.");
+#else
+  uv_buf_t bufs[3];
+  unsigned int n;
+  int i;
+
+  ASSERT(UV_EINVAL == uv_buf_pool_init_ex(&buf_pool, 4096, 0, 2));
+  ASSERT(0 == uv_buf_pool_init_ex(&buf_pool,
+                                  65536,
+                                  0,
+                                  UV_BUF_POOL_HUGEPAGES));
+
+  /* 一次映射一个大页，整个切成缓冲区 */
+  bufs[0] = uv_buf_pool_get(&buf_pool);
+  ASSERT(bufs[0].base != NULL);
+  ASSERT(bufs[0].len == 65536);
+  n = buf_pool.nfree + 1;
+  ASSERT(n >= 32);
+  ASSERT(n % 32 == 0);
+
+  for (i = 1; i < 3; i++) {
+    bufs[i] = uv_buf_pool_get(&buf_pool);
+    ASSERT(bufs[i].base != NULL);
+    memset(bufs[i].base, i, bufs[i].len);
+  }
+  ASSERT(buf_pool.nused == 3);
+  ASSERT(buf_pool.nfree == n - 3);
+  ASSERT(UV_EBUSY == uv_buf_pool_destroy(&buf_pool));
+
+  /* 不能单独释放，max_free为0也全部留下 */
+  for (i = 0; i < 3; i++)
+    uv_buf_pool_release(&buf_pool, bufs[i].base);
+  ASSERT(buf_pool.nused == 0);
+  ASSERT(buf_pool.nfree == n);
+
+  ASSERT(0 == uv_buf_pool_destroy(&buf_pool));
+  ASSERT(buf_pool.nfree == 0);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#endif
+}
+
+
+TEST_IMPL(buf_pool_read) {
+#ifdef _WIN32
+  RETURN_SKIP("Test not implemented on Windows.");
+#else
+  uv_loop_t* loop;
+  int fds[2];
+  int i;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_buf_pool_init(&buf_pool, 4096, 4));
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &pipe_handle, 0));
+  ASSERT(0 == uv_pipe_open(&pipe_handle, fds[0]));
+  ASSERT(UV_EINVAL == uv_read_start_pooled((uv_stream_t*) &pipe_handle,
+                                           NULL,
+                                           read_cb));
+  ASSERT(0 == uv_read_start_pooled((uv_stream_t*) &pipe_handle,
+                                   &buf_pool,
+                                   read_cb));
+
+  /* Half a buffer at a time, so each write turns into a read of its own. */
+  memset(chunk, 'x', sizeof(chunk));
+  for (i = 0; i < 8; i++) {
+    ASSERT(sizeof(chunk) == write(fds[1], chunk, sizeof(chunk)));
+    uv_run(loop, UV_RUN_ONCE);
+  }
+  ASSERT(0 == close(fds[1]));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(nreads == 8);
+
+  ASSERT(buf_pool.nused == 0);
+  ASSERT(buf_pool.nfree == 1);
+  ASSERT(0 == uv_buf_pool_destroy(&buf_pool));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#endif
+}
+
+
+TEST_IMPL(buf_pool_udp_recv) {
+  struct sockaddr_in addr;
+  uv_loop_t* loop;
+  uv_buf_t buf;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_buf_pool_init(&buf_pool, 2048, 4));
+  ASSERT(0 == uv_udp_init(loop, &server));
+  ASSERT(0 == uv_udp_bind(&server, (const struct sockaddr*) &addr, 0));
+  ASSERT(UV_EINVAL == uv_udp_recv_start_pooled(&server, NULL, recv_cb));
+  ASSERT(0 == uv_udp_recv_start_pooled(&server, &buf_pool, recv_cb));
+
+  ASSERT(0 == uv_udp_init(loop, &client));
+  buf = uv_buf_init("PING", 4);
+  ASSERT(0 == uv_udp_send(&send_req,
+                          &client,
+                          &buf,
+                          1,
+                          (const struct sockaddr*) &addr,
+                          send_cb));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(nrecvs == 1);
+
+  ASSERT(buf_pool.nused == 0);
+  ASSERT(0 == uv_buf_pool_destroy(&buf_pool));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -0,0 +1,130 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(close_many) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define NPIPES 16
+
+static uv_pipe_t pipes[NPIPES];
+static uv_timer_t timer_handle;
+static uv_pipe_t reader;
+static int peers[NPIPES];
+static int close_cb_called;
+static int read_cb_called;
+static char slab[64];
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  *buf = uv_buf_init(slab, sizeof(slab));
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  /* 关掉的fd不应该再有任何读事件 */
+  ASSERT(0 && "read_cb should not be called");
+}
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void reader_read_cb(uv_stream_t* stream,
+                           ssize_t nread,
+                           const uv_buf_t* buf) {
+  if (nread == 0)
+    return;
+
+  ASSERT(nread == 4);
+  ASSERT(memcmp(buf->base, "PING", 4) == 0);
+  read_cb_called++;
+  uv_close((uv_handle_t*) stream, NULL);
+}
+
+
+TEST_IMPL(close_many) {
+  uv_handle_t* handles[NPIPES + 1];
+  uv_loop_t* loop;
+  int fds[2];
+  int i;
+
+  loop = uv_default_loop();
+
+  for (i = 0; i < NPIPES; i++) {
+    ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    ASSERT(0 == uv_pipe_init(loop, &pipes[i], 0));
+    ASSERT(0 == uv_pipe_open(&pipes[i], fds[0]));
+    ASSERT(0 == uv_read_start((uv_stream_t*) &pipes[i], alloc_cb, read_cb));
+    peers[i] = fds[1];
+    handles[i] = (uv_handle_t*) &pipes[i];
+  }
+
+  /* 非fd handle走普通的关闭流程 */
+  ASSERT(0 == uv_timer_init(loop, &timer_handle));
+  handles[NPIPES] = (uv_handle_t*) &timer_handle;
+
+  /* 先让epoll登记上这些fd */
+  uv_run(loop, UV_RUN_NOWAIT);
+
+  /* 对端已经写入数据，但关闭后不应该再投递 */
+  for (i = 0; i < NPIPES; i++)
+    ASSERT(1 == write(peers[i], "x", 1));
+
+  uv_close_many(handles, NPIPES + 1, close_cb);
+  /* 已经在关闭的handle会被跳过 */
+  uv_close_many(handles, NPIPES + 1, close_cb);
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(close_cb_called == NPIPES + 1);
+
+  for (i = 0; i < NPIPES; i++)
+    ASSERT(0 == close(peers[i]));
+
+  /* 新的fd会复用刚关掉的编号，epoll里不能留有旧的登记 */
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &reader, 0));
+  ASSERT(0 == uv_pipe_open(&reader, fds[0]));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &reader, alloc_cb, reader_read_cb));
+  ASSERT(4 == write(fds[1], "PING", 4));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(read_cb_called == 1);
+  ASSERT(0 == close(fds[1]));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
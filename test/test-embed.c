@@ -25,6 +25,12 @@
 #include <stdlib.h>
 #include <errno.h>
 
+#ifndef _WIN32
+# include <poll.h>
+# include <sys/socket.h>
+# include <unistd.h>
+#endif
+
 #ifndef HAVE_KQUEUE
 # if defined(__APPLE__) ||                                                    \
      defined(__DragonFly__) ||                                                \
@@ -170,3 +176,92 @@ TEST_IMPL(embed) {
   RETURN_SKIP("Not supported in the current platform.");
 #endif
 }
+
+
+#if !defined(_WIN32) && (defined(HAVE_KQUEUE) || defined(HAVE_EPOLL))
+static uv_pipe_t ready_pipe;
+static uv_timer_t ready_timer;
+static int ready_fds[2];
+static int ready_read_called;
+static int ready_timer_called;
+
+
+static void ready_alloc_cb(uv_handle_t* handle,
+                           size_t suggested_size,
+                           uv_buf_t* buf) {
+  static char slab[64];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void ready_read_cb(uv_stream_t* stream,
+                          ssize_t nread,
+                          const uv_buf_t* buf) {
+  if (nread == 0)
+    return;
+
+  ASSERT(nread == 1);
+  ASSERT(buf->base[0] == 'x');
+  ready_read_called++;
+  uv_close((uv_handle_t*) stream, NULL);
+  uv_close((uv_handle_t*) &ready_timer, NULL);
+}
+
+
+static void ready_timer_cb(uv_timer_t* timer) {
+  ready_timer_called++;
+  ASSERT(1 == write(ready_fds[1], "x", 1));
+}
+#endif
+
+
+TEST_IMPL(embed_ready) {
+#if !defined(_WIN32) && (defined(HAVE_KQUEUE) || defined(HAVE_EPOLL))
+  uv_embed_info_t info;
+  struct pollfd pfd;
+  uv_loop_t loop;
+  int iterations;
+  int r;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, ready_fds));
+
+  ASSERT(0 == uv_pipe_init(&loop, &ready_pipe, 0));
+  ASSERT(0 == uv_pipe_open(&ready_pipe, ready_fds[0]));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &ready_pipe,
+                            ready_alloc_cb,
+                            ready_read_cb));
+
+  ASSERT(0 == uv_timer_init(&loop, &ready_timer));
+  ASSERT(0 == uv_timer_start(&ready_timer, ready_timer_cb, 10, 0));
+
+  /* 宿主自己在backend fd上等待，没有辅助线程 */
+  iterations = 0;
+  while (uv_embed_prepare(&loop, &info)) {
+    ASSERT(info.fd == uv_backend_fd(&loop));
+    ASSERT(info.events == UV_READABLE);
+
+    pfd.fd = info.fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    do
+      r = poll(&pfd, 1, info.timeout);
+    while (r == -1 && errno == EINTR);
+    ASSERT(r >= 0);
+
+    uv_run_ready(&loop);
+    ASSERT(++iterations < 100);
+  }
+
+  ASSERT(ready_timer_called == 1);
+  ASSERT(ready_read_called == 1);
+
+  ASSERT(0 == close(ready_fds[1]));
+  ASSERT(0 == uv_loop_close(&loop));
+
+  return 0;
+#else
+  RETURN_SKIP("Not supported in the current platform.");
+#endif
+}
@@ -114,4 +114,94 @@ static void connect_cb(uv_connect_t* req, int status) {
   uv_close((uv_handle_t*) &client_handle, NULL);
 }
 
+
+static uv_tcp_t backoff_conn;
+static int backoff_first_fd;
+static unsigned backoff_emfile_called;
+static unsigned backoff_accepted;
+
+
+static void backoff_connection_cb(uv_stream_t* server, int status) {
+  if (status == UV_EMFILE) {
+    /* 监听暂停了，放出两个fd，备用fd补齐以后就能接受连接 */
+    backoff_emfile_called++;
+    ASSERT(1 == backoff_emfile_called);
+    close(backoff_first_fd++);
+    close(backoff_first_fd++);
+    return;
+  }
+
+  ASSERT(0 == status);
+  ASSERT(1 == backoff_emfile_called);
+  ASSERT(0 == uv_tcp_init(server->loop, &backoff_conn));
+  ASSERT(0 == uv_accept(server, (uv_stream_t*) &backoff_conn));
+  backoff_accepted++;
+
+  uv_close((uv_handle_t*) &backoff_conn, NULL);
+  uv_close((uv_handle_t*) &server_handle, NULL);
+  uv_close((uv_handle_t*) &client_handle, NULL);
+}
+
+
+static void backoff_connect_cb(uv_connect_t* req, int status) {
+  /* 连接在内核的backlog里等着，握手照样完成 */
+  ASSERT(0 == status);
+  connect_cb_called += 1;
+}
+
+
+TEST_IMPL(emfile_backoff) {
+  struct sockaddr_in addr;
+  struct rlimit limits;
+  uv_connect_t connect_req;
+  uv_loop_t* loop;
+
+  limits.rlim_cur = limits.rlim_max = maxfd + 1;
+  if (setrlimit(RLIMIT_NOFILE, &limits)) {
+    ASSERT(errno == EPERM);  /* Valgrind blocks the setrlimit() call. */
+    RETURN_SKIP("setrlimit(RLIMIT_NOFILE) failed, running under valgrind?");
+  }
+
+  loop = uv_default_loop();
+  ASSERT(UV_EINVAL == uv_loop_configure(loop,
+                                        UV_LOOP_EMFILE_RESERVE,
+                                        1000u,
+                                        50u));
+  ASSERT(0 == uv_loop_configure(loop, UV_LOOP_EMFILE_RESERVE, 2u, 50u));
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(loop, &server_handle));
+  ASSERT(0 == uv_tcp_init(loop, &client_handle));
+  ASSERT(0 == uv_tcp_bind(&server_handle, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &server_handle,
+                        8,
+                        backoff_connection_cb));
+
+  do
+    backoff_first_fd = dup(0);
+  while (backoff_first_fd == -1 && errno == EINTR);
+  ASSERT(backoff_first_fd > 0);
+
+  while (dup(0) != -1 || errno == EINTR);
+  ASSERT(errno == EMFILE);
+  close(maxfd);
+
+  ASSERT(0 == uv_tcp_connect(&connect_req,
+                             &client_handle,
+                             (const struct sockaddr*) &addr,
+                             backoff_connect_cb));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(1 == connect_cb_called);
+  ASSERT(1 == backoff_emfile_called);
+  ASSERT(1 == backoff_accepted);
+
+  while (backoff_first_fd < maxfd) {
+    close(backoff_first_fd);
+    backoff_first_fd += 1;
+  }
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
 #endif  /* !defined(_WIN32) */
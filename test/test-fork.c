@@ -217,6 +217,58 @@ TEST_IMPL(fork_socketpair_started) {
 }
 
 
+static uv_poll_t fork_drop_handle;
+
+
+static void fork_drop_walk_cb(uv_handle_t* handle, void* arg) {
+  /* The child only needs one of the two watchers. */
+  if (handle == (uv_handle_t*) &fork_drop_handle)
+    uv_close(handle, NULL);
+}
+
+
+TEST_IMPL(fork_drop_watchers) {
+  /* Watchers dropped by uv_loop_fork_ex() in the child never fire there,
+     the others are re-registered and still work. */
+  pid_t child_pid;
+  int keep_fds[2];
+  int drop_fds[2];
+  uv_poll_t keep_handle;
+
+  run_timer_loop_once();
+
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, keep_fds));
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, drop_fds));
+  ASSERT(0 == uv_poll_init(uv_default_loop(), &keep_handle, keep_fds[0]));
+  ASSERT(0 == uv_poll_init(uv_default_loop(), &fork_drop_handle, drop_fds[0]));
+  ASSERT(0 == uv_poll_start(&keep_handle, UV_READABLE, socket_cb));
+  ASSERT(0 == uv_poll_start(&fork_drop_handle, UV_READABLE, socket_cb));
+  ASSERT(1 == uv_run(uv_default_loop(), UV_RUN_NOWAIT));
+
+  child_pid = fork();
+  ASSERT(child_pid != -1);
+
+  if (child_pid != 0) {
+    /* parent */
+    ASSERT(3 == send(drop_fds[1], "hi\n", 3, 0));
+    ASSERT(3 == send(keep_fds[1], "hi\n", 3, 0));
+    assert_wait_child(child_pid);
+  } else {
+    /* child */
+    ASSERT(0 == uv_loop_fork_ex(uv_default_loop(), fork_drop_walk_cb, NULL));
+    ASSERT(uv_is_closing((uv_handle_t*) &fork_drop_handle));
+    socket_cb_read_fd = keep_fds[0];
+    socket_cb_read_size = 3;
+    ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+    ASSERT(1 == socket_cb_called);
+    ASSERT(0 == strcmp("hi\n", socket_cb_read_buf));
+  }
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
 static int fork_signal_cb_called;
 
 void fork_signal_to_child_cb(uv_signal_t* handle, int signum)
@@ -674,6 +726,38 @@ TEST_IMPL(fork_threadpool_queue_work_simple) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+/* 线程池线程压栈压到一半时fork：子进程继承了wq_senders != 0，
+ * uv_loop_fork()要把它清掉，否则关闭loop时会一直等
+ */
+TEST_IMPL(fork_threadpool_senders) {
+  pid_t child_pid;
+  uv_loop_t* loop;
+
+  loop = uv_default_loop();
+  assert_run_work(loop);
+
+  /* done回调跑完的时候线程池线程可能还没把计数减回去，等它离开再改 */
+  while (*(volatile unsigned int*) &loop->wq_senders != 0)
+    uv_sleep(1);
+
+  loop->wq_senders = 1;
+  child_pid = fork();
+  ASSERT(child_pid != -1);
+
+  if (child_pid != 0) {
+    loop->wq_senders = 0;
+    assert_wait_child(child_pid);
+  } else {
+    ASSERT(0 == uv_loop_fork(loop));
+    ASSERT(loop->wq_senders == 0);
+    assert_run_work(loop);
+  }
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
 #endif /* !__MVS__ */
 
 
@@ -23,6 +23,7 @@
 #include "task.h"
 
 #include <fcntl.h>
+#include <string.h>
 
 #if defined(__unix__) || defined(__POSIX__) || \
     defined(__APPLE__) || defined(_AIX) || defined(__MVS__)
@@ -189,3 +190,95 @@ TEST_IMPL(fs_copyfile) {
   unlink(dst); /* Cleanup */
   return 0;
 }
+
+
+static void large_copy_cb(uv_fs_t* req) {
+  uint64_t copied;
+  uint64_t total;
+
+  ASSERT(req->result == 0);
+  ASSERT(0 == uv_fs_copyfile_progress(req, &copied, &total));
+  ASSERT(total == 20 * 1024 * 1024);
+  ASSERT(copied == total);
+  handle_result(req);
+}
+
+
+TEST_IMPL(fs_copyfile_large) {
+  static char data[1024 * 1024];
+  const char src[] = "test_file_src";
+  uv_os_fd_t file;
+  uv_fs_t req;
+  uv_buf_t buf;
+  uint64_t copied;
+  uint64_t total;
+  int r;
+  int i;
+
+  unlink(src);
+  unlink(dst);
+  result_check_count = 0;
+
+  /* 比一次拷贝的块大，会分几块拷，进度也会更新几次 */
+  buf = uv_buf_init(data, sizeof(data));
+  r = uv_fs_open(NULL, &req, src, O_WRONLY | O_CREAT | O_TRUNC,
+                 S_IWUSR | S_IRUSR, NULL);
+  ASSERT(r == 0);
+  file = (uv_os_fd_t) req.result;
+  uv_fs_req_cleanup(&req);
+
+  for (i = 0; i < 20; i++) {
+    memset(data, 'a' + i, sizeof(data));
+    r = uv_fs_write(NULL, &req, file, &buf, 1, -1, NULL);
+    ASSERT(r == (int) sizeof(data));
+    uv_fs_req_cleanup(&req);
+  }
+
+  r = uv_fs_close(NULL, &req, file, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
+
+  /* 不是copyfile请求 */
+  ASSERT(UV_EINVAL == uv_fs_copyfile_progress(&req, &copied, &total));
+
+  r = uv_fs_copyfile(uv_default_loop(), &req, src, dst, 0, large_copy_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_fs_copyfile_progress(&req, &copied, &total));
+  ASSERT(copied <= total);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(result_check_count == 1);
+
+  /* 分段并行拷贝，每一兆内容不同，段放错了位置能发现 */
+  unlink(dst);
+  r = uv_fs_copyfile(uv_default_loop(),
+                     &req,
+                     src,
+                     dst,
+                     UV_FS_COPYFILE_PARALLEL,
+                     large_copy_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(result_check_count == 2);
+
+  r = uv_fs_open(NULL, &req, dst, O_RDONLY, 0, NULL);
+  ASSERT(r == 0);
+  file = (uv_os_fd_t) req.result;
+  uv_fs_req_cleanup(&req);
+
+  for (i = 0; i < 20; i++) {
+    r = uv_fs_read(NULL, &req, file, &buf, 1, -1, NULL);
+    ASSERT(r == (int) sizeof(data));
+    ASSERT(data[0] == 'a' + i);
+    ASSERT(data[sizeof(data) - 1] == 'a' + i);
+    uv_fs_req_cleanup(&req);
+  }
+
+  r = uv_fs_close(NULL, &req, file, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
+
+  unlink(src);
+  unlink(dst);
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -45,7 +45,7 @@
 static uv_fs_event_t fs_event;
 static const char file_prefix[] = "fsevent-";
 static const int fs_event_file_count = 16;
-#if defined(__APPLE__) || defined(_WIN32)
+#if defined(__APPLE__) || defined(_WIN32) || defined(__linux__)
 static const char file_prefix_in_subdir[] = "subdir";
 #endif
 static uv_timer_t timer;
@@ -217,7 +217,7 @@ static void fs_event_cb_dir_multi_file(uv_fs_event_t* handle,
   }
 }
 
-#if defined(__APPLE__) || defined(_WIN32)
+#if defined(__APPLE__) || defined(_WIN32) || defined(__linux__)
 static const char* fs_event_get_filename_in_subdir(int i) {
   snprintf(fs_event_filename,
            sizeof(fs_event_filename),
@@ -435,7 +435,7 @@ TEST_IMPL(fs_event_watch_dir) {
 }
 
 TEST_IMPL(fs_event_watch_dir_recursive) {
-#if defined(__APPLE__) || defined(_WIN32)
+#if defined(__APPLE__) || defined(_WIN32) || defined(__linux__)
   uv_loop_t* loop;
   int r;
 
@@ -1085,3 +1085,163 @@ TEST_IMPL(fs_event_watch_invalid_path) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+static int coalesce_dir_cb_called;
+static int coalesce_file_cb_called;
+
+
+static void fs_event_coalesce_touch(uv_timer_t* handle) {
+  int i;
+
+  /* 一个文件的创建和多次写入在同一个窗口里，合并成一次回调 */
+  create_file("watch_dir/subdir/file1");
+  for (i = 0; i < 5; i++)
+    touch_file("watch_dir/subdir/file1");
+}
+
+
+static void fs_event_coalesce_mkdir(uv_timer_t* handle) {
+  create_dir("watch_dir/subdir");
+}
+
+
+static void fs_event_cb_coalesce(uv_fs_event_t* handle,
+                                 const char* filename,
+                                 int events,
+                                 int status) {
+  ASSERT(handle == &fs_event);
+  ASSERT(status == 0);
+
+  if (strcmp(filename, "subdir") == 0) {
+    /* 启动之后才建的子目录也要被监听 */
+    ASSERT(events == UV_RENAME);
+    coalesce_dir_cb_called++;
+    ASSERT(0 == uv_timer_start(&timer, fs_event_coalesce_touch, 50, 0));
+    return;
+  }
+
+  ASSERT(strcmp(filename, "subdir/file1") == 0);
+  ASSERT(events == (UV_RENAME | UV_CHANGE));
+  coalesce_file_cb_called++;
+  uv_close((uv_handle_t*) &timer, close_cb);
+  uv_close((uv_handle_t*) handle, close_cb);
+}
+
+
+TEST_IMPL(fs_event_coalesce) {
+#if defined(__linux__)
+  uv_loop_t* loop;
+
+  loop = uv_default_loop();
+  remove("watch_dir/subdir/file1");
+  remove("watch_dir/subdir");
+  remove("watch_dir/");
+  create_dir("watch_dir");
+
+  ASSERT(0 == uv_fs_event_init(loop, &fs_event));
+  ASSERT(0 == uv_fs_event_set_coalesce(&fs_event, 30));
+  ASSERT(0 == uv_fs_event_start(&fs_event,
+                                fs_event_cb_coalesce,
+                                "watch_dir",
+                                UV_FS_EVENT_RECURSIVE));
+  ASSERT(0 == uv_timer_init(loop, &timer));
+  ASSERT(0 == uv_timer_start(&timer, fs_event_coalesce_mkdir, 50, 0));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(coalesce_dir_cb_called == 1);
+  ASSERT(coalesce_file_cb_called == 1);
+  ASSERT(close_cb_called == 2);
+
+  remove("watch_dir/subdir/file1");
+  remove("watch_dir/subdir");
+  remove("watch_dir/");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#else
+  RETURN_SKIP("Event coalescing is only implemented on linux.");
+#endif
+}
+
+
+#if defined(__APPLE__)
+static uv_fs_event_t fs_event_sub;
+static int latency_outer_cb_called;
+static int latency_inner_cb_called;
+
+
+static void fs_event_latency_create(uv_timer_t* handle) {
+  create_file("watch_dir/subdir/file1");
+}
+
+
+static void fs_event_cb_latency(uv_fs_event_t* handle,
+                                const char* filename,
+                                int events,
+                                int status) {
+  ASSERT(status == 0);
+
+  if (handle == &fs_event) {
+    if (filename == NULL || strcmp(filename, "subdir/file1") != 0)
+      return;
+    latency_outer_cb_called++;
+  } else {
+    ASSERT(handle == &fs_event_sub);
+    if (filename == NULL || strcmp(filename, "file1") != 0)
+      return;
+    latency_inner_cb_called++;
+  }
+
+  uv_close((uv_handle_t*) handle, close_cb);
+  if (latency_outer_cb_called == 1 && latency_inner_cb_called == 1)
+    uv_close((uv_handle_t*) &timer, close_cb);
+}
+#endif
+
+
+TEST_IMPL(fs_event_fsevents_latency) {
+#if defined(__APPLE__)
+  uv_loop_t* loop;
+
+  loop = uv_default_loop();
+  remove("watch_dir/subdir/file1");
+  remove("watch_dir/subdir");
+  remove("watch_dir/");
+  create_dir("watch_dir");
+  create_dir("watch_dir/subdir");
+
+  ASSERT(0 == uv_loop_configure(loop, UV_LOOP_FSEVENTS_LATENCY, 10u));
+
+  /* 第二个handle在第一个的监听范围里，共用同一个事件流的根路径 */
+  ASSERT(0 == uv_fs_event_init(loop, &fs_event));
+  ASSERT(0 == uv_fs_event_start(&fs_event,
+                                fs_event_cb_latency,
+                                "watch_dir",
+                                UV_FS_EVENT_RECURSIVE));
+  ASSERT(0 == uv_fs_event_init(loop, &fs_event_sub));
+  ASSERT(0 == uv_fs_event_start(&fs_event_sub,
+                                fs_event_cb_latency,
+                                "watch_dir/subdir",
+                                0));
+  ASSERT(0 == uv_timer_init(loop, &timer));
+  ASSERT(0 == uv_timer_start(&timer, fs_event_latency_create, 250, 0));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(latency_outer_cb_called == 1);
+  ASSERT(latency_inner_cb_called == 1);
+  ASSERT(close_cb_called == 3);
+
+  remove("watch_dir/subdir/file1");
+  remove("watch_dir/subdir");
+  remove("watch_dir/");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#else
+  ASSERT(UV_ENOSYS == uv_loop_configure(uv_default_loop(),
+                                        UV_LOOP_FSEVENTS_LATENCY,
+                                        10u));
+  RETURN_SKIP("FSEventStream latency is only implemented on macOS.");
+#endif
+}
@@ -0,0 +1,133 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+# include <unistd.h>
+#endif
+
+#define NLINES 1000
+
+static int close_cb_called;
+static int close_status;
+
+
+static void close_cb(uv_fs_log_t* log, int status) {
+  close_cb_called++;
+  close_status = status;
+}
+
+
+static uv_os_fd_t open_log(int flags) {
+  uv_os_fd_t file;
+  uv_fs_t req;
+  int r;
+
+  r = uv_fs_open(NULL, &req, "test_file", flags, S_IWUSR | S_IRUSR, NULL);
+  ASSERT(r == 0);
+  file = (uv_os_fd_t) req.result;
+  uv_fs_req_cleanup(&req);
+  return file;
+}
+
+
+static void close_file(uv_os_fd_t file) {
+  uv_fs_t req;
+
+  ASSERT(0 == uv_fs_close(NULL, &req, file, NULL));
+  uv_fs_req_cleanup(&req);
+}
+
+
+TEST_IMPL(fs_log) {
+  static char expected[NLINES * 16];
+  static char actual[NLINES * 16];
+  uv_fs_log_t log;
+  uv_os_fd_t file;
+  uv_buf_t buf;
+  uv_fs_t req;
+  size_t len;
+  char line[16];
+  int n;
+  int i;
+
+  unlink("test_file");
+  file = open_log(O_WRONLY | O_CREAT | O_TRUNC | O_APPEND);
+
+  ASSERT(UV_EINVAL == uv_fs_log_init(uv_default_loop(), &log, file, 0, 0));
+  ASSERT(UV_EINVAL == uv_fs_log_init(uv_default_loop(), &log, file, 64, 2));
+  ASSERT(0 == uv_fs_log_init(uv_default_loop(),
+                             &log,
+                             file,
+                             sizeof(expected),
+                             UV_FS_LOG_FDATASYNC));
+
+  /* 第一条马上开始写，其余的在它写完之前都攒进另一半缓冲区 */
+  len = 0;
+  for (i = 0; i < NLINES; i++) {
+    n = snprintf(line, sizeof(line), "line %d\n", i);
+    ASSERT(0 == uv_fs_log_append(&log, line, n));
+    memcpy(expected + len, line, n);
+    len += n;
+  }
+
+  uv_fs_log_close(&log, close_cb);
+  ASSERT(close_cb_called == 0);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(close_cb_called == 1);
+  ASSERT(close_status == 0);
+  ASSERT(log.nwrites == 2);
+  ASSERT(log.nbytes == len);
+  close_file(file);
+
+  file = open_log(O_RDONLY);
+  buf = uv_buf_init(actual, sizeof(actual));
+  ASSERT((ssize_t) len == uv_fs_read(NULL, &req, file, &buf, 1, 0, NULL));
+  uv_fs_req_cleanup(&req);
+  ASSERT(0 == memcmp(expected, actual, len));
+
+  /* 写失败的错误交给close_cb，之后的追加也返回它 */
+  close_cb_called = 0;
+  ASSERT(0 == uv_fs_log_init(uv_default_loop(), &log, file, 8, 0));
+  ASSERT(UV_E2BIG == uv_fs_log_append(&log, "123456789", 9));
+  ASSERT(0 == uv_fs_log_append(&log, "1234", 4));
+  ASSERT(0 == uv_fs_log_append(&log, "12345678", 8));
+  ASSERT(UV_ENOBUFS == uv_fs_log_append(&log, "1", 1));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_ONCE));
+  ASSERT(0 > uv_fs_log_append(&log, "1", 1));
+  uv_fs_log_close(&log, close_cb);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(close_cb_called == 1);
+  ASSERT(close_status < 0);
+  ASSERT(log.nwrites == 0);
+  close_file(file);
+
+  unlink("test_file");
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
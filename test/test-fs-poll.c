@@ -185,3 +185,85 @@ TEST_IMPL(fs_poll_getpath) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+#define SHARED_FILES 3
+
+static const char* shared_fixtures[SHARED_FILES] = {
+  "testfile0",
+  "testfile1",
+  "testfile2"
+};
+static uv_fs_poll_t shared_handles[SHARED_FILES + 1];
+static int shared_cb_called[SHARED_FILES + 1];
+
+
+static void write_fixture(const char* path, const char* data) {
+  FILE* fp;
+
+  ASSERT((fp = fopen(path, "w+")));
+  fputs(data, fp);
+  fclose(fp);
+}
+
+
+static void shared_timer_cb(uv_timer_t* handle) {
+  write_fixture(shared_fixtures[1], "changed");
+  timer_cb_called++;
+}
+
+
+static void shared_poll_cb(uv_fs_poll_t* handle,
+                           int status,
+                           const uv_stat_t* prev,
+                           const uv_stat_t* curr) {
+  int i;
+
+  ASSERT(status == 0);
+  ASSERT(prev->st_size == 1);
+  ASSERT(curr->st_size == 7);
+  shared_cb_called[handle - shared_handles]++;
+
+  for (i = 0; i < SHARED_FILES + 1; i++)
+    uv_close((uv_handle_t*) &shared_handles[i], close_cb);
+  uv_close((uv_handle_t*) &timer_handle, close_cb);
+}
+
+
+TEST_IMPL(fs_poll_shared) {
+  uv_loop_t shared_loop;
+  int i;
+
+  for (i = 0; i < SHARED_FILES; i++)
+    write_fixture(shared_fixtures[i], "*");
+
+  ASSERT(0 == uv_loop_init(&shared_loop));
+  ASSERT(0 == uv_loop_configure(&shared_loop, UV_LOOP_FS_POLL_SHARED));
+
+  /* 前三个共用一个50ms的定时器，最后一个单独一组 */
+  for (i = 0; i < SHARED_FILES + 1; i++) {
+    ASSERT(0 == uv_fs_poll_init(&shared_loop, &shared_handles[i]));
+    ASSERT(0 == uv_fs_poll_start(&shared_handles[i],
+                                 shared_poll_cb,
+                                 shared_fixtures[i % SHARED_FILES],
+                                 i < SHARED_FILES ? 50 : 70));
+  }
+
+  ASSERT(0 == uv_timer_init(&shared_loop, &timer_handle));
+  ASSERT(0 == uv_timer_start(&timer_handle, shared_timer_cb, 120, 0));
+  ASSERT(0 == uv_run(&shared_loop, UV_RUN_DEFAULT));
+
+  ASSERT(timer_cb_called == 1);
+  ASSERT(close_cb_called == SHARED_FILES + 2);
+  ASSERT(shared_cb_called[0] == 0);
+  ASSERT(shared_cb_called[1] == 1);
+  ASSERT(shared_cb_called[2] == 0);
+  ASSERT(shared_cb_called[3] == 0);
+
+  for (i = 0; i < SHARED_FILES; i++)
+    remove(shared_fixtures[i]);
+
+  ASSERT(0 == uv_loop_close(&shared_loop));
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
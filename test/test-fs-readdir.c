@@ -0,0 +1,530 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "uv.h"
+#include "task.h"
+
+#include <fcntl.h>
+#include <string.h>
+
+static uv_fs_t opendir_req;
+static uv_fs_t readdir_req;
+static uv_fs_t closedir_req;
+
+static uv_dirent_t dirents[1];
+
+static int empty_opendir_cb_count;
+static int empty_closedir_cb_count;
+static int non_empty_readdir_cb_count;
+static int non_empty_closedir_cb_count;
+static int non_existing_opendir_cb_count;
+static int file_opendir_cb_count;
+
+
+static void cleanup_test_files(void) {
+  uv_fs_t req;
+
+  uv_fs_unlink(NULL, &req, "test_dir/file1", NULL);
+  uv_fs_req_cleanup(&req);
+  uv_fs_unlink(NULL, &req, "test_dir/file2", NULL);
+  uv_fs_req_cleanup(&req);
+  uv_fs_rmdir(NULL, &req, "test_dir/test_subdir", NULL);
+  uv_fs_req_cleanup(&req);
+  uv_fs_rmdir(NULL, &req, "test_dir", NULL);
+  uv_fs_req_cleanup(&req);
+}
+
+
+static void touch_file(const char* name) {
+  uv_os_fd_t file;
+  uv_fs_t req;
+  int r;
+
+  r = uv_fs_open(NULL,
+                 &req,
+                 name,
+                 O_WRONLY | O_CREAT | O_TRUNC,
+                 S_IWUSR | S_IRUSR,
+                 NULL);
+  ASSERT(r >= 0);
+  file = (uv_os_fd_t) req.result;
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_close(NULL, &req, file, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
+}
+
+
+static void empty_closedir_cb(uv_fs_t* req) {
+  ASSERT(req == &closedir_req);
+  ASSERT(req->fs_type == UV_FS_CLOSEDIR);
+  ASSERT(req->result == 0);
+  ++empty_closedir_cb_count;
+  uv_fs_req_cleanup(req);
+}
+
+
+static void empty_readdir_cb(uv_fs_t* req) {
+  uv_dir_t* dir;
+
+  ASSERT(req == &readdir_req);
+  ASSERT(req->fs_type == UV_FS_READDIR);
+  ASSERT(req->result == 0);
+  dir = req->ptr;
+  uv_fs_req_cleanup(req);
+  ASSERT(0 == uv_fs_closedir(uv_default_loop(),
+                             &closedir_req,
+                             dir,
+                             empty_closedir_cb));
+}
+
+
+static void empty_opendir_cb(uv_fs_t* req) {
+  uv_dir_t* dir;
+
+  ASSERT(req == &opendir_req);
+  ASSERT(req->fs_type == UV_FS_OPENDIR);
+  ASSERT(req->result == 0);
+  ASSERT(req->ptr != NULL);
+  dir = req->ptr;
+  dir->dirents = dirents;
+  dir->nentries = ARRAY_SIZE(dirents);
+  ASSERT(0 == uv_fs_readdir(uv_default_loop(),
+                            &readdir_req,
+                            dir,
+                            empty_readdir_cb));
+  uv_fs_req_cleanup(req);
+  ++empty_opendir_cb_count;
+}
+
+
+TEST_IMPL(fs_readdir_empty_dir) {
+  uv_dir_t* dir;
+  int r;
+
+  cleanup_test_files();
+  ASSERT(0 == uv_fs_mkdir(NULL, &opendir_req, "test_dir", 0755, NULL));
+  uv_fs_req_cleanup(&opendir_req);
+
+  /* 同步调用 */
+  r = uv_fs_opendir(NULL, &opendir_req, "test_dir", NULL);
+  ASSERT(r == 0);
+  ASSERT(opendir_req.fs_type == UV_FS_OPENDIR);
+  ASSERT(opendir_req.ptr != NULL);
+  dir = opendir_req.ptr;
+  uv_fs_req_cleanup(&opendir_req);
+
+  dir->dirents = dirents;
+  dir->nentries = ARRAY_SIZE(dirents);
+  r = uv_fs_readdir(NULL, &readdir_req, dir, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&readdir_req);
+
+  r = uv_fs_closedir(NULL, &closedir_req, dir, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&closedir_req);
+
+  /* 异步调用 */
+  r = uv_fs_opendir(uv_default_loop(),
+                    &opendir_req,
+                    "test_dir",
+                    empty_opendir_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(empty_opendir_cb_count == 1);
+  ASSERT(empty_closedir_cb_count == 1);
+
+  cleanup_test_files();
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void non_existing_opendir_cb(uv_fs_t* req) {
+  ASSERT(req == &opendir_req);
+  ASSERT(req->result == UV_ENOENT);
+  ASSERT(req->ptr == NULL);
+  uv_fs_req_cleanup(req);
+  ++non_existing_opendir_cb_count;
+}
+
+
+TEST_IMPL(fs_readdir_non_existing_dir) {
+  int r;
+
+  cleanup_test_files();
+
+  r = uv_fs_opendir(NULL, &opendir_req, "test_dir", NULL);
+  ASSERT(r == UV_ENOENT);
+  ASSERT(opendir_req.ptr == NULL);
+  uv_fs_req_cleanup(&opendir_req);
+
+  r = uv_fs_opendir(uv_default_loop(),
+                    &opendir_req,
+                    "test_dir",
+                    non_existing_opendir_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(non_existing_opendir_cb_count == 1);
+
+  ASSERT(UV_EINVAL == uv_fs_readdir(NULL, &readdir_req, NULL, NULL));
+  ASSERT(UV_EINVAL == uv_fs_closedir(NULL, &closedir_req, NULL, NULL));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void file_opendir_cb(uv_fs_t* req) {
+  ASSERT(req == &opendir_req);
+  ASSERT(req->result == UV_ENOTDIR);
+  ASSERT(req->ptr == NULL);
+  uv_fs_req_cleanup(req);
+  ++file_opendir_cb_count;
+}
+
+
+TEST_IMPL(fs_readdir_file) {
+  const char* path;
+  int r;
+
+  path = "test_file";
+  touch_file(path);
+
+  r = uv_fs_opendir(NULL, &opendir_req, path, NULL);
+  ASSERT(r == UV_ENOTDIR);
+  uv_fs_req_cleanup(&opendir_req);
+
+  r = uv_fs_opendir(uv_default_loop(), &opendir_req, path, file_opendir_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(file_opendir_cb_count == 1);
+
+  uv_fs_unlink(NULL, &opendir_req, path, NULL);
+  uv_fs_req_cleanup(&opendir_req);
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static int seen_file1;
+static int seen_file2;
+static int seen_subdir;
+
+
+static void check_dirent(const uv_dirent_t* dent) {
+  if (strcmp(dent->name, "file1") == 0) {
+    ASSERT(dent->type == UV_DIRENT_FILE || dent->type == UV_DIRENT_UNKNOWN);
+    seen_file1++;
+  } else if (strcmp(dent->name, "file2") == 0) {
+    ASSERT(dent->type == UV_DIRENT_FILE || dent->type == UV_DIRENT_UNKNOWN);
+    seen_file2++;
+  } else if (strcmp(dent->name, "test_subdir") == 0) {
+    ASSERT(dent->type == UV_DIRENT_DIR || dent->type == UV_DIRENT_UNKNOWN);
+    seen_subdir++;
+  } else {
+    ASSERT(0 && "unexpected directory entry");
+  }
+}
+
+
+static void non_empty_closedir_cb(uv_fs_t* req) {
+  ASSERT(req == &closedir_req);
+  ASSERT(req->result == 0);
+  uv_fs_req_cleanup(req);
+  ++non_empty_closedir_cb_count;
+}
+
+
+static void non_empty_readdir_cb(uv_fs_t* req) {
+  uv_dir_t* dir;
+
+  ASSERT(req == &readdir_req);
+  ASSERT(req->fs_type == UV_FS_READDIR);
+  dir = req->ptr;
+
+  if (req->result == 0) {
+    uv_fs_req_cleanup(req);
+    ASSERT(non_empty_readdir_cb_count == 3);
+    ASSERT(0 == uv_fs_closedir(uv_default_loop(),
+                               &closedir_req,
+                               dir,
+                               non_empty_closedir_cb));
+    return;
+  }
+
+  /* 每次最多只拿到nentries个 */
+  ASSERT(req->result == 1);
+  ASSERT(dir->dirents == dirents);
+  check_dirent(&dirents[0]);
+  ++non_empty_readdir_cb_count;
+  uv_fs_req_cleanup(req);
+  ASSERT(dirents[0].name == NULL);
+
+  ASSERT(0 == uv_fs_readdir(uv_default_loop(),
+                            &readdir_req,
+                            dir,
+                            non_empty_readdir_cb));
+}
+
+
+static void non_empty_opendir_cb(uv_fs_t* req) {
+  uv_dir_t* dir;
+
+  ASSERT(req == &opendir_req);
+  ASSERT(req->result == 0);
+  dir = req->ptr;
+  dir->dirents = dirents;
+  dir->nentries = ARRAY_SIZE(dirents);
+  uv_fs_req_cleanup(req);
+
+  ASSERT(0 == uv_fs_readdir(uv_default_loop(),
+                            &readdir_req,
+                            dir,
+                            non_empty_readdir_cb));
+}
+
+
+TEST_IMPL(fs_readdir_non_empty_dir) {
+  uv_dirent_t entries[8];
+  uv_dir_t* dir;
+  int r;
+
+  cleanup_test_files();
+
+  ASSERT(0 == uv_fs_mkdir(NULL, &opendir_req, "test_dir", 0755, NULL));
+  uv_fs_req_cleanup(&opendir_req);
+  touch_file("test_dir/file1");
+  touch_file("test_dir/file2");
+  ASSERT(0 == uv_fs_mkdir(NULL, &opendir_req, "test_dir/test_subdir", 0755,
+                          NULL));
+  uv_fs_req_cleanup(&opendir_req);
+
+  /* 同步调用，一次全部读出来 */
+  r = uv_fs_opendir(NULL, &opendir_req, "test_dir", NULL);
+  ASSERT(r == 0);
+  dir = opendir_req.ptr;
+  uv_fs_req_cleanup(&opendir_req);
+
+  dir->dirents = entries;
+  dir->nentries = ARRAY_SIZE(entries);
+  r = uv_fs_readdir(NULL, &readdir_req, dir, NULL);
+  ASSERT(r == 3);
+  for (r = 0; r < 3; r++)
+    check_dirent(&entries[r]);
+  uv_fs_req_cleanup(&readdir_req);
+
+  r = uv_fs_readdir(NULL, &readdir_req, dir, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&readdir_req);
+
+  r = uv_fs_closedir(NULL, &closedir_req, dir, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&closedir_req);
+
+  ASSERT(seen_file1 == 1 && seen_file2 == 1 && seen_subdir == 1);
+
+  /* 异步调用，一次读一个 */
+  r = uv_fs_opendir(uv_default_loop(),
+                    &opendir_req,
+                    "test_dir",
+                    non_empty_opendir_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(non_empty_readdir_cb_count == 3);
+  ASSERT(non_empty_closedir_cb_count == 1);
+  ASSERT(seen_file1 == 2 && seen_file2 == 2 && seen_subdir == 2);
+
+  cleanup_test_files();
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+#define WALK_NFILES 300
+
+static uv_fs_t walk_req;
+static int walk_cb_count;
+static int walk_done_cb_count;
+static int walk_files;
+static int walk_dirs;
+static int walk_stats;
+static int walk_errors;
+
+
+static void walk_cleanup(void) {
+  char name[64];
+  uv_fs_t req;
+  int i;
+
+  for (i = 0; i < WALK_NFILES; i++) {
+    snprintf(name, sizeof(name), "walk_dir/f%d", i);
+    uv_fs_unlink(NULL, &req, name, NULL);
+    uv_fs_req_cleanup(&req);
+  }
+
+  uv_fs_unlink(NULL, &req, "walk_dir/sub/deep/c", NULL);
+  uv_fs_req_cleanup(&req);
+  uv_fs_rmdir(NULL, &req, "walk_dir/sub/deep", NULL);
+  uv_fs_req_cleanup(&req);
+  uv_fs_unlink(NULL, &req, "walk_dir/sub/b", NULL);
+  uv_fs_req_cleanup(&req);
+  uv_fs_rmdir(NULL, &req, "walk_dir/sub", NULL);
+  uv_fs_req_cleanup(&req);
+  uv_fs_rmdir(NULL, &req, "walk_dir", NULL);
+  uv_fs_req_cleanup(&req);
+}
+
+
+static void walk_cb(uv_fs_t* req,
+                    int status,
+                    const uv_fs_walk_entry_t* entries,
+                    size_t nentries) {
+  size_t i;
+
+  ASSERT(req == &walk_req);
+  ASSERT(nentries > 0);
+  walk_cb_count++;
+
+  if (status < 0) {
+    walk_errors++;
+    return;
+  }
+
+  for (i = 0; i < nentries; i++) {
+    ASSERT(strncmp(entries[i].path, "walk_dir/", 9) == 0);
+    if (entries[i].type == UV_DIRENT_DIR)
+      walk_dirs++;
+    else if (entries[i].type == UV_DIRENT_FILE)
+      walk_files++;
+    if (entries[i].statbuf != NULL) {
+      ASSERT((entries[i].type == UV_DIRENT_DIR) ==
+             S_ISDIR(entries[i].statbuf->st_mode));
+      walk_stats++;
+    }
+  }
+}
+
+
+static void walk_done_cb(uv_fs_t* req) {
+  ASSERT(req == &walk_req);
+  ASSERT(req->fs_type == UV_FS_WALK);
+  ASSERT(req->result == WALK_NFILES + 4);
+  walk_done_cb_count++;
+  uv_fs_req_cleanup(req);
+}
+
+
+static void walk_non_existing_cb(uv_fs_t* req) {
+  ASSERT(req == &walk_req);
+  ASSERT(req->result == UV_ENOENT);
+  walk_done_cb_count++;
+  uv_fs_req_cleanup(req);
+}
+
+
+TEST_IMPL(fs_walk) {
+  char name[64];
+  uv_fs_t req;
+  int r;
+  int i;
+
+  walk_cleanup();
+
+  ASSERT(0 == uv_fs_mkdir(NULL, &req, "walk_dir", 0755, NULL));
+  uv_fs_req_cleanup(&req);
+  ASSERT(0 == uv_fs_mkdir(NULL, &req, "walk_dir/sub", 0755, NULL));
+  uv_fs_req_cleanup(&req);
+  ASSERT(0 == uv_fs_mkdir(NULL, &req, "walk_dir/sub/deep", 0755, NULL));
+  uv_fs_req_cleanup(&req);
+  touch_file("walk_dir/sub/b");
+  touch_file("walk_dir/sub/deep/c");
+
+  /* 根目录的文件多于一批，会分几次回调 */
+  for (i = 0; i < WALK_NFILES; i++) {
+    snprintf(name, sizeof(name), "walk_dir/f%d", i);
+    touch_file(name);
+  }
+
+  r = uv_fs_walk(uv_default_loop(),
+                 &walk_req,
+                 "walk_dir",
+                 0,
+                 2,
+                 walk_cb,
+                 walk_done_cb);
+  ASSERT(r == 0);
+  ASSERT(UV_EBUSY == uv_cancel((uv_req_t*) &walk_req));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(walk_done_cb_count == 1);
+  ASSERT(walk_cb_count >= 4);
+  ASSERT(walk_files == WALK_NFILES + 2);
+  ASSERT(walk_dirs == 2);
+  ASSERT(walk_stats == 0);
+  ASSERT(walk_errors == 0);
+
+  walk_cb_count = 0;
+  walk_files = 0;
+  walk_dirs = 0;
+
+  /* 带结尾'/'的根路径，并且要stat信息 */
+  r = uv_fs_walk(uv_default_loop(),
+                 &walk_req,
+                 "walk_dir/",
+                 UV_FS_WALK_STAT,
+                 0,
+                 walk_cb,
+                 walk_done_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(walk_done_cb_count == 2);
+  ASSERT(walk_files == WALK_NFILES + 2);
+  ASSERT(walk_dirs == 2);
+  ASSERT(walk_stats == WALK_NFILES + 4);
+
+  r = uv_fs_walk(uv_default_loop(),
+                 &walk_req,
+                 "walk_dir",
+                 0,
+                 0,
+                 walk_cb,
+                 NULL);
+  ASSERT(r == UV_EINVAL);
+
+  walk_cleanup();
+
+  r = uv_fs_walk(uv_default_loop(),
+                 &walk_req,
+                 "walk_dir",
+                 0,
+                 0,
+                 walk_cb,
+                 walk_non_existing_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(walk_done_cb_count == 3);
+  ASSERT(walk_errors == 0);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
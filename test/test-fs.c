@@ -1163,6 +1163,55 @@ TEST_IMPL(fs_async_sendfile) {
 }
 
 
+TEST_IMPL(fs_sendfile_pipe) {
+#ifdef _WIN32
+  RETURN_SKIP("pipe fds are not supported on Windows");
+#else
+  char data[16384];
+  char check[sizeof(data)];
+  uv_os_fd_t file;
+  uv_fs_t req;
+  int fds[2];
+  size_t i;
+  int r;
+
+  /* Linux上in_fd是pipe时sendfile()返回EINVAL，走模拟的路径 */
+  unlink("test_file");
+
+  for (i = 0; i < sizeof(data); i++)
+    data[i] = 'a' + i % 26;
+
+  ASSERT(0 == pipe(fds));
+  ASSERT(sizeof(data) == write(fds[1], data, sizeof(data)));
+  ASSERT(0 == close(fds[1]));
+
+  r = uv_fs_open(NULL, &req, "test_file", O_RDWR | O_CREAT | O_TRUNC,
+      S_IWUSR | S_IRUSR, NULL);
+  ASSERT(r >= 0);
+  file = (uv_os_fd_t) req.result;
+  uv_fs_req_cleanup(&req);
+
+  /* 要的比pipe里有的多，读到EOF为止 */
+  r = uv_fs_sendfile(NULL, &req, file, fds[0], 0, 2 * sizeof(data), NULL);
+  ASSERT(r == (int) sizeof(data));
+  uv_fs_req_cleanup(&req);
+
+  ASSERT(sizeof(check) == pread(file, check, sizeof(check), 0));
+  ASSERT(0 == memcmp(data, check, sizeof(data)));
+
+  ASSERT(0 == close(fds[0]));
+  r = uv_fs_close(NULL, &req, file, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
+
+  unlink("test_file");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#endif
+}
+
+
 TEST_IMPL(fs_mkdtemp) {
   int r;
   const char* path_template = "test_dir_XXXXXX";
@@ -2640,212 +2689,944 @@ TEST_IMPL(fs_stat_missing_path) {
 }
 
 
-TEST_IMPL(fs_scandir_empty_dir) {
-  const char* path;
+static int batch_sub_cb_count;
+static int batch_cb_count;
+
+
+static void batch_sub_cb(uv_fs_t* req) {
+  ASSERT(batch_cb_count == 0);
+  ASSERT(req->data == (void*) (intptr_t) batch_sub_cb_count);
+  if (req->fs_type == UV_FS_STAT) {
+    ASSERT(req->result == 0);
+    ASSERT(req->statbuf.st_size == 5);
+  } else {
+    ASSERT(req->fs_type == UV_FS_LSTAT);
+    ASSERT(req->result == UV_ENOENT);
+  }
+  batch_sub_cb_count++;
+  uv_fs_req_cleanup(req);
+}
+
+
+static void batch_cb(uv_fs_t* req) {
+  ASSERT(req->fs_type == UV_FS_BATCH);
+  ASSERT(req->result == 9);
+  ASSERT(batch_sub_cb_count == 9);
+  batch_cb_count++;
+  uv_fs_req_cleanup(req);
+}
+
+
+TEST_IMPL(fs_batch) {
+  uv_fs_t reqs[9];
+  uv_fs_t batch_req;
+  uv_fs_t other_req;
   uv_fs_t req;
-  uv_dirent_t dent;
+  uv_os_fd_t file;
+  uv_buf_t iov;
   int r;
+  int i;
 
-  path = "./empty_dir/";
   loop = uv_default_loop();
+  unlink("test_file");
 
-  uv_fs_mkdir(NULL, &req, path, 0777, NULL);
+  r = uv_fs_open(NULL, &req, "test_file", O_WRONLY | O_CREAT | O_TRUNC,
+                 S_IWUSR | S_IRUSR, NULL);
+  ASSERT(r == 0);
+  file = (uv_os_fd_t) req.result;
   uv_fs_req_cleanup(&req);
 
-  /* Fill the req to ensure that required fields are cleaned up */
-  memset(&req, 0xdb, sizeof(req));
+  r = uv_fs_batch(loop, &batch_req, batch_cb);
+  ASSERT(r == 0);
+  ASSERT(UV_EBUSY == uv_fs_batch(loop, &other_req, batch_cb));
+  ASSERT(UV_EINVAL == uv_fs_batch_submit(loop, &other_req));
 
-  r = uv_fs_scandir(NULL, &req, path, 0, NULL);
+  /* 同步调用照常马上执行 */
+  iov = uv_buf_init("hello", 5);
+  r = uv_fs_write(NULL, &req, file, &iov, 1, -1, NULL);
+  ASSERT(r == 5);
+  uv_fs_req_cleanup(&req);
+  r = uv_fs_close(NULL, &req, file, NULL);
   ASSERT(r == 0);
-  ASSERT(req.result == 0);
-  ASSERT(req.ptr == NULL);
-  ASSERT(UV_EOF == uv_fs_scandir_next(&req, &dent));
   uv_fs_req_cleanup(&req);
 
-  r = uv_fs_scandir(loop, &scandir_req, path, 0, empty_scandir_cb);
-  ASSERT(r == 0);
+  for (i = 0; i < 8; i++) {
+    reqs[i].data = (void*) (intptr_t) i;
+    ASSERT(0 == uv_fs_stat(loop, &reqs[i], "test_file", batch_sub_cb));
+  }
+  reqs[8].data = (void*) (intptr_t) 8;
+  ASSERT(0 == uv_fs_lstat(loop, &reqs[8], "non_existent_file", batch_sub_cb));
 
-  ASSERT(scandir_cb_count == 0);
-  uv_run(loop, UV_RUN_DEFAULT);
-  ASSERT(scandir_cb_count == 1);
+  ASSERT(UV_EBUSY == uv_cancel((uv_req_t*) &reqs[0]));
+  ASSERT(batch_sub_cb_count == 0);
 
-  uv_fs_rmdir(NULL, &req, path, NULL);
-  uv_fs_req_cleanup(&req);
+  r = uv_fs_batch_submit(loop, &batch_req);
+  ASSERT(r == 0);
+  ASSERT(UV_EINVAL == uv_fs_batch_submit(loop, &batch_req));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(batch_sub_cb_count == 9);
+  ASSERT(batch_cb_count == 1);
+
+  unlink("test_file");
 
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
 
 
-TEST_IMPL(fs_scandir_non_existent_dir) {
-  const char* path;
+static int sync_order[5];
+static int sync_cb_count;
+
+
+static void coalesce_sync_cb(uv_fs_t* req) {
+  ASSERT(req->result == 0);
+  sync_order[sync_cb_count++] = (int) (intptr_t) req->data;
+  uv_fs_req_cleanup(req);
+}
+
+
+TEST_IMPL(fs_fsync_coalesce) {
+  uv_fs_t reqs[5];
   uv_fs_t req;
-  uv_dirent_t dent;
+  uv_loop_t sync_loop;
+  uv_os_fd_t file;
+  uv_buf_t iov;
   int r;
+  int i;
 
-  path = "./non_existent_dir/";
-  loop = uv_default_loop();
+  unlink("test_file");
+  ASSERT(0 == uv_loop_init(&sync_loop));
+  ASSERT(0 == uv_loop_configure(&sync_loop, UV_LOOP_FS_SYNC_COALESCE));
 
-  uv_fs_rmdir(NULL, &req, path, NULL);
+  r = uv_fs_open(NULL, &req, "test_file", O_WRONLY | O_CREAT | O_TRUNC,
+                 S_IWUSR | S_IRUSR, NULL);
+  ASSERT(r == 0);
+  file = (uv_os_fd_t) req.result;
   uv_fs_req_cleanup(&req);
 
-  /* Fill the req to ensure that required fields are cleaned up */
-  memset(&req, 0xdb, sizeof(req));
-
-  r = uv_fs_scandir(NULL, &req, path, 0, NULL);
-  ASSERT(r == UV_ENOENT);
-  ASSERT(req.result == UV_ENOENT);
-  ASSERT(req.ptr == NULL);
-  ASSERT(UV_ENOENT == uv_fs_scandir_next(&req, &dent));
+  iov = uv_buf_init("hello", 5);
+  r = uv_fs_write(NULL, &req, file, &iov, 1, -1, NULL);
+  ASSERT(r == 5);
   uv_fs_req_cleanup(&req);
 
-  r = uv_fs_scandir(loop, &scandir_req, path, 0, non_existent_scandir_cb);
-  ASSERT(r == 0);
+  for (i = 0; i < 5; i++)
+    reqs[i].data = (void*) (intptr_t) i;
+
+  /* 第一个直接执行，后面的排队合并成一次，其中有fsync就用fsync执行 */
+  ASSERT(0 == uv_fs_fsync(&sync_loop, &reqs[0], file, coalesce_sync_cb));
+  ASSERT(0 == uv_fs_fdatasync(&sync_loop, &reqs[1], file, coalesce_sync_cb));
+  ASSERT(0 == uv_fs_fdatasync(&sync_loop, &reqs[2], file, coalesce_sync_cb));
+  ASSERT(0 == uv_fs_fsync(&sync_loop, &reqs[3], file, coalesce_sync_cb));
+  ASSERT(0 == uv_fs_fdatasync(&sync_loop, &reqs[4], file, coalesce_sync_cb));
+  ASSERT(UV_EBUSY == uv_cancel((uv_req_t*) &reqs[2]));
+
+  ASSERT(0 == uv_run(&sync_loop, UV_RUN_DEFAULT));
+  ASSERT(sync_cb_count == 5);
+  ASSERT(sync_order[0] == 0);
+  ASSERT(sync_order[1] == 3);
+  ASSERT(sync_order[2] == 1);
+  ASSERT(sync_order[3] == 2);
+  ASSERT(sync_order[4] == 4);
 
-  ASSERT(scandir_cb_count == 0);
-  uv_run(loop, UV_RUN_DEFAULT);
-  ASSERT(scandir_cb_count == 1);
+  r = uv_fs_close(NULL, &req, file, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
+  unlink("test_file");
 
+  ASSERT(0 == uv_loop_close(&sync_loop));
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
 
-TEST_IMPL(fs_scandir_file) {
-  const char* path;
-  int r;
 
-  path = "test/fixtures/empty_file";
-  loop = uv_default_loop();
+static int mmap_cb_count;
+static int munmap_cb_count;
 
-  r = uv_fs_scandir(NULL, &scandir_req, path, 0, NULL);
-  ASSERT(r == UV_ENOTDIR);
-  uv_fs_req_cleanup(&scandir_req);
 
-  r = uv_fs_scandir(loop, &scandir_req, path, 0, file_scandir_cb);
-  ASSERT(r == 0);
+static void munmap_cb(uv_fs_t* req) {
+  ASSERT(req->fs_type == UV_FS_MUNMAP);
+  ASSERT(req->result == 0);
+  munmap_cb_count++;
+  uv_fs_req_cleanup(req);
+}
 
-  ASSERT(scandir_cb_count == 0);
-  uv_run(loop, UV_RUN_DEFAULT);
-  ASSERT(scandir_cb_count == 1);
 
-  MAKE_VALGRIND_HAPPY();
-  return 0;
+static void mmap_cb(uv_fs_t* req) {
+  static uv_fs_t munmap_req;
+  const char* p;
+
+  ASSERT(req->fs_type == UV_FS_MMAP);
+  ASSERT(req->result == 10000);
+  p = req->ptr;
+  ASSERT(p != NULL);
+  ASSERT(p[0] == 'a' && p[4999] == 'a' && p[9999] == 'a');
+  mmap_cb_count++;
+
+  ASSERT(0 == uv_fs_munmap(req->loop,
+                           &munmap_req,
+                           req->ptr,
+                           req->result,
+                           munmap_cb));
+  uv_fs_req_cleanup(req);
 }
 
 
-TEST_IMPL(fs_open_dir) {
-  const char* path;
+TEST_IMPL(fs_mmap) {
+  static char data[10000];
+  uv_fs_t mmap_req;
   uv_fs_t req;
-  int r;
   uv_os_fd_t file;
+  uv_buf_t iov;
+  char* p;
+  int r;
 
-  path = ".";
   loop = uv_default_loop();
+  unlink("test_file");
 
-  r = uv_fs_open(NULL, &req, path, O_RDONLY, 0, NULL);
+  r = uv_fs_open(NULL, &req, "test_file", O_RDWR | O_CREAT | O_TRUNC,
+                 S_IWUSR | S_IRUSR, NULL);
   ASSERT(r == 0);
-  ASSERT(req.result >= 0);
-  ASSERT(req.ptr == NULL);
-  file = (uv_os_fd_t)req.result;
+  file = (uv_os_fd_t) req.result;
   uv_fs_req_cleanup(&req);
 
-  r = uv_fs_close(NULL, &req, file, NULL);
-  ASSERT(r == 0);
+  memset(data, 'a', sizeof(data));
+  iov = uv_buf_init(data, sizeof(data));
+  r = uv_fs_write(NULL, &req, file, &iov, 1, -1, NULL);
+  ASSERT(r == (int) sizeof(data));
+  uv_fs_req_cleanup(&req);
 
-  r = uv_fs_open(loop, &req, path, O_RDONLY, 0, open_cb_simple);
+  ASSERT(UV_EINVAL == uv_fs_mmap(NULL, &req, file, 1, 0, 0,
+                                 UV_FS_FADV_NORMAL, NULL));
+  ASSERT(UV_EINVAL == uv_fs_mmap(NULL, &req, file, 0, 0, 0x80,
+                                 UV_FS_FADV_NORMAL, NULL));
+
+  /* 异步，页面在线程池里读进来 */
+  r = uv_fs_mmap(loop,
+                 &mmap_req,
+                 file,
+                 0,
+                 0,
+                 UV_FS_MMAP_POPULATE,
+                 UV_FS_FADV_SEQUENTIAL,
+                 mmap_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(mmap_cb_count == 1);
+  ASSERT(munmap_cb_count == 1);
+
+  /* 同步的可写映射，改动写回文件 */
+  r = uv_fs_mmap(NULL, &req, file, 0, 100, UV_FS_MMAP_WRITE,
+                 UV_FS_FADV_NORMAL, NULL);
+  ASSERT(r == 100);
+  p = req.ptr;
+  p[0] = 'b';
+  uv_fs_req_cleanup(&req);
+  r = uv_fs_munmap(NULL, &req, p, 100, NULL);
   ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
 
-  ASSERT(open_cb_count == 0);
-  uv_run(loop, UV_RUN_DEFAULT);
-  ASSERT(open_cb_count == 1);
+  iov = uv_buf_init(data, 1);
+  r = uv_fs_read(NULL, &req, file, &iov, 1, 0, NULL);
+  ASSERT(r == 1);
+  ASSERT(data[0] == 'b');
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_close(NULL, &req, file, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
+  unlink("test_file");
 
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
 
 
-TEST_IMPL(fs_file_open_append) {
-  int r;
-  uv_os_fd_t file;
+static int stat_cache_cb_count;
+static uint64_t stat_cache_run_ns;
+static int64_t stat_cache_size;
 
-  /* Setup. */
-  unlink("test_file");
 
-  loop = uv_default_loop();
+static void stat_cache_cb(uv_fs_t* req) {
+  uint64_t wait_ns;
 
-  r = uv_fs_open(NULL, &open_req1, "test_file", O_WRONLY | O_CREAT,
-      S_IWUSR | S_IRUSR, NULL);
-  ASSERT(r == 0);
-  ASSERT(open_req1.result >= 0);
-  file = (uv_os_fd_t)open_req1.result;
-  uv_fs_req_cleanup(&open_req1);
+  ASSERT(req->result == 0);
+  ASSERT(0 == uv_req_work_time((uv_req_t*) req, &wait_ns, &stat_cache_run_ns));
+  if (req->fs_type == UV_FS_STAT)
+    stat_cache_size = req->statbuf.st_size;
+  else
+    ASSERT(req->ptr != NULL);
+  stat_cache_cb_count++;
+  uv_fs_req_cleanup(req);
+}
 
-  iov = uv_buf_init(test_buf, sizeof(test_buf));
-  r = uv_fs_write(NULL, &write_req, file, &iov, 1, -1, NULL);
-  ASSERT(r >= 0);
-  ASSERT(write_req.result >= 0);
-  uv_fs_req_cleanup(&write_req);
 
-  r = uv_fs_close(NULL, &close_req, file, NULL);
-  ASSERT(r == 0);
-  ASSERT(close_req.result == 0);
-  uv_fs_req_cleanup(&close_req);
+static void stat_cache_timer_cb(uv_timer_t* handle) {
+  uv_close((uv_handle_t*) handle, NULL);
+}
 
-  r = uv_fs_open(NULL, &open_req1, "test_file", O_RDWR | O_APPEND, 0, NULL);
-  ASSERT(r >= 0);
-  ASSERT(open_req1.result >= 0);
-  file = (uv_os_fd_t)open_req1.result;
-  uv_fs_req_cleanup(&open_req1);
 
-  iov = uv_buf_init(test_buf, sizeof(test_buf));
-  r = uv_fs_write(NULL, &write_req, file, &iov, 1, -1, NULL);
-  ASSERT(r >= 0);
-  ASSERT(write_req.result >= 0);
-  uv_fs_req_cleanup(&write_req);
+TEST_IMPL(fs_stat_cache) {
+#ifndef __linux__
+  RETURN_SKIP("UV_LOOP_FS_CACHE is only supported on linux");
+#else
+  char path[PATHMAX];
+  uv_loop_t cache_loop;
+  uv_timer_t timer;
+  uv_fs_t req;
+  uv_os_fd_t file;
+  uv_buf_t iov;
+  size_t len;
+  int r;
 
-  r = uv_fs_close(NULL, &close_req, file, NULL);
-  ASSERT(r == 0);
-  ASSERT(close_req.result == 0);
-  uv_fs_req_cleanup(&close_req);
+  unlink("test_file");
+  len = sizeof(path);
+  ASSERT(0 == uv_cwd(path, &len));
+  ASSERT(len + sizeof("/test_file") <= sizeof(path));
+  strcat(path, "/test_file");
 
-  r = uv_fs_open(NULL, &open_req1, "test_file", O_RDONLY, S_IRUSR, NULL);
+  r = uv_fs_open(NULL, &req, "test_file", O_WRONLY | O_CREAT | O_TRUNC,
+                 S_IWUSR | S_IRUSR, NULL);
   ASSERT(r == 0);
-  ASSERT(open_req1.result >= 0);
-  file = (uv_os_fd_t)open_req1.result;
-  uv_fs_req_cleanup(&open_req1);
+  file = (uv_os_fd_t) req.result;
+  uv_fs_req_cleanup(&req);
 
-  iov = uv_buf_init(buf, sizeof(buf));
-  r = uv_fs_read(NULL, &read_req, file, &iov, 1, -1, NULL);
-  printf("read = %d\n", r);
-  ASSERT(r == 26);
-  ASSERT(read_req.result == 26);
-  ASSERT(memcmp(buf,
-                "test-buffer\n\0test-buffer\n\0",
-                sizeof("test-buffer\n\0test-buffer\n\0") - 1) == 0);
-  uv_fs_req_cleanup(&read_req);
+  iov = uv_buf_init("hello", 5);
+  r = uv_fs_write(NULL, &req, file, &iov, 1, -1, NULL);
+  ASSERT(r == 5);
+  uv_fs_req_cleanup(&req);
 
-  r = uv_fs_close(NULL, &close_req, file, NULL);
-  ASSERT(r == 0);
-  ASSERT(close_req.result == 0);
-  uv_fs_req_cleanup(&close_req);
+  ASSERT(0 == uv_loop_init(&cache_loop));
+  ASSERT(UV_EINVAL == uv_loop_configure(&cache_loop, UV_LOOP_FS_CACHE, -1));
+  ASSERT(0 == uv_loop_configure(&cache_loop, UV_LOOP_FS_CACHE, 60000));
+  /* 缓存命中的请求不进线程池，执行时间是0 */
+  ASSERT(0 == uv_threadpool_enable_histograms(NULL, 1));
+
+  ASSERT(0 == uv_fs_stat(&cache_loop, &req, path, stat_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(stat_cache_cb_count == 1);
+  ASSERT(stat_cache_size == 5);
+  ASSERT(stat_cache_run_ns > 0);
+
+  ASSERT(0 == uv_fs_stat(&cache_loop, &req, path, stat_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(stat_cache_cb_count == 2);
+  ASSERT(stat_cache_size == 5);
+  ASSERT(stat_cache_run_ns == 0);
+
+  ASSERT(0 == uv_fs_realpath(&cache_loop, &req, path, stat_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(stat_cache_run_ns > 0);
+  ASSERT(0 == uv_fs_realpath(&cache_loop, &req, path, stat_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(stat_cache_cb_count == 4);
+  ASSERT(stat_cache_run_ns == 0);
+
+  /* 写文件产生的inotify事件让缓存失效，要让loop轮询一次才能读到 */
+  r = uv_fs_write(NULL, &req, file, &iov, 1, -1, NULL);
+  ASSERT(r == 5);
+  uv_fs_req_cleanup(&req);
+  ASSERT(0 == uv_timer_init(&cache_loop, &timer));
+  ASSERT(0 == uv_timer_start(&timer, stat_cache_timer_cb, 10, 0));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
 
-  /* Cleanup */
+  ASSERT(0 == uv_fs_stat(&cache_loop, &req, path, stat_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(stat_cache_cb_count == 5);
+  ASSERT(stat_cache_size == 10);
+  ASSERT(stat_cache_run_ns > 0);
+
+  /* 关闭缓存后每次都进线程池 */
+  ASSERT(0 == uv_loop_configure(&cache_loop, UV_LOOP_FS_CACHE, 0));
+  ASSERT(0 == uv_fs_stat(&cache_loop, &req, path, stat_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(stat_cache_cb_count == 6);
+  ASSERT(stat_cache_run_ns > 0);
+
+  ASSERT(0 == uv_threadpool_enable_histograms(NULL, 0));
+
+  r = uv_fs_close(NULL, &req, file, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
   unlink("test_file");
 
+  ASSERT(0 == uv_loop_close(&cache_loop));
   MAKE_VALGRIND_HAPPY();
   return 0;
+#endif
 }
 
 
-TEST_IMPL(fs_rename_to_existing_file) {
-  int r;
+static uv_os_fd_t fd_cache_file;
+static uint64_t fd_cache_run_ns;
+static int64_t fd_cache_size;
+
+
+static void fd_cache_cb(uv_fs_t* req) {
+  uint64_t wait_ns;
+
+  ASSERT(req->result >= 0);
+  ASSERT(0 == uv_req_work_time((uv_req_t*) req, &wait_ns, &fd_cache_run_ns));
+  if (req->fs_type == UV_FS_OPEN)
+    fd_cache_file = (uv_os_fd_t) req->result;
+  if (req->fs_type == UV_FS_FSTAT)
+    fd_cache_size = req->statbuf.st_size;
+  uv_fs_req_cleanup(req);
+}
+
+
+TEST_IMPL(fs_fd_cache) {
+#ifndef __linux__
+  RETURN_SKIP("UV_LOOP_FD_CACHE is only supported on linux");
+#else
+  char path[PATHMAX];
+  char data[16];
+  uv_loop_t cache_loop;
+  uv_timer_t timer;
+  uv_os_fd_t cached;
+  uv_fs_t req;
   uv_os_fd_t file;
+  uv_buf_t iov;
+  size_t len;
+  int r;
 
-  /* Setup. */
   unlink("test_file");
-  unlink("test_file2");
+  len = sizeof(path);
+  ASSERT(0 == uv_cwd(path, &len));
+  ASSERT(len + sizeof("/test_file") <= sizeof(path));
+  strcat(path, "/test_file");
 
-  loop = uv_default_loop();
+  r = uv_fs_open(NULL, &req, "test_file", O_WRONLY | O_CREAT | O_TRUNC,
+                 S_IWUSR | S_IRUSR, NULL);
+  ASSERT(r == 0);
+  file = (uv_os_fd_t) req.result;
+  uv_fs_req_cleanup(&req);
+
+  iov = uv_buf_init("hello", 5);
+  r = uv_fs_write(NULL, &req, file, &iov, 1, -1, NULL);
+  ASSERT(r == 5);
+  uv_fs_req_cleanup(&req);
+
+  ASSERT(0 == uv_loop_init(&cache_loop));
+  ASSERT(UV_EINVAL == uv_loop_configure(&cache_loop, UV_LOOP_FD_CACHE, -1));
+  ASSERT(0 == uv_loop_configure(&cache_loop, UV_LOOP_FD_CACHE, 8));
+  ASSERT(0 == uv_threadpool_enable_histograms(NULL, 1));
+
+  ASSERT(0 == uv_fs_open(&cache_loop, &req, path, O_RDONLY, 0, fd_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(fd_cache_run_ns > 0);
+  cached = fd_cache_file;
+
+  ASSERT(0 == uv_fs_fstat(&cache_loop, &req, cached, fd_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(fd_cache_run_ns > 0);
+  ASSERT(fd_cache_size == 5);
+
+  /* 读一下，文件偏移不在开头了 */
+  iov = uv_buf_init(data, sizeof(data));
+  r = uv_fs_read(NULL, &req, cached, &iov, 1, -1, NULL);
+  ASSERT(r == 5);
+  uv_fs_req_cleanup(&req);
+
+  /* 关闭、再打开、fstat都不进线程池，拿回的是同一个fd */
+  ASSERT(0 == uv_fs_close(&cache_loop, &req, cached, fd_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(fd_cache_run_ns == 0);
+  ASSERT(-1 != fcntl(cached, F_GETFD));
+
+  ASSERT(0 == uv_fs_open(&cache_loop, &req, path, O_RDONLY, 0, fd_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(fd_cache_run_ns == 0);
+  ASSERT(fd_cache_file == cached);
+
+  ASSERT(0 == uv_fs_fstat(&cache_loop, &req, cached, fd_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(fd_cache_run_ns == 0);
+  ASSERT(fd_cache_size == 5);
+
+  r = uv_fs_read(NULL, &req, cached, &iov, 1, -1, NULL);
+  ASSERT(r == 5);
+  ASSERT(0 == memcmp(data, "hello", 5));
+  uv_fs_req_cleanup(&req);
+
+  /* 别的flags不共用 */
+  ASSERT(0 == uv_fs_open(&cache_loop,
+                         &req,
+                         path,
+                         O_RDONLY | O_NONBLOCK,
+                         0,
+                         fd_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(fd_cache_file != cached);
+  ASSERT(0 == uv_fs_close(&cache_loop, &req, fd_cache_file, fd_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+
+  /* 用着的时候文件变了，关闭时真的关掉 */
+  iov = uv_buf_init("hello", 5);
+  r = uv_fs_write(NULL, &req, file, &iov, 1, -1, NULL);
+  ASSERT(r == 5);
+  uv_fs_req_cleanup(&req);
+  ASSERT(0 == uv_timer_init(&cache_loop, &timer));
+  ASSERT(0 == uv_timer_start(&timer, stat_cache_timer_cb, 10, 0));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+
+  ASSERT(0 == uv_fs_close(&cache_loop, &req, cached, fd_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(fd_cache_run_ns > 0);
+
+  ASSERT(0 == uv_fs_open(&cache_loop, &req, path, O_RDONLY, 0, fd_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(fd_cache_run_ns > 0);
+  ASSERT(0 == uv_fs_fstat(&cache_loop, &req, fd_cache_file, fd_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+  ASSERT(fd_cache_size == 10);
+  ASSERT(0 == uv_fs_close(&cache_loop, &req, fd_cache_file, fd_cache_cb));
+  ASSERT(0 == uv_run(&cache_loop, UV_RUN_DEFAULT));
+
+  /* 关闭缓存时空闲的fd都关掉 */
+  cached = fd_cache_file;
+  ASSERT(0 == uv_loop_configure(&cache_loop, UV_LOOP_FD_CACHE, 0));
+  ASSERT(-1 == fcntl(cached, F_GETFD));
+
+  ASSERT(0 == uv_threadpool_enable_histograms(NULL, 0));
+
+  r = uv_fs_close(NULL, &req, file, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
+  unlink("test_file");
+
+  ASSERT(0 == uv_loop_close(&cache_loop));
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#endif
+}
+
+
+static void fs_at_cb(uv_fs_t* req) {
+  uv_os_fd_t file;
+
+  ASSERT(req->fs_type == UV_FS_OPENAT);
+  ASSERT(req->result >= 0);
+  file = (uv_os_fd_t) req->result;
+  uv_fs_req_cleanup(req);
+  ASSERT(0 == uv_fs_close(NULL, req, file, NULL));
+  uv_fs_req_cleanup(req);
+}
+
+
+TEST_IMPL(fs_at) {
+  uv_os_fd_t dir;
+  uv_fs_t req;
+  uv_os_fd_t file;
+  uv_buf_t iov;
+  int r;
+
+  loop = uv_default_loop();
+  unlink("test_dir/file");
+  unlink("test_dir/file2");
+  rmdir("test_dir/sub");
+  rmdir("test_dir");
+  ASSERT(0 == uv_fs_mkdir(NULL, &req, "test_dir", 0755, NULL));
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_open(NULL, &req, "test_dir", O_RDONLY | O_DIRECTORY, 0, NULL);
+  ASSERT(r >= 0);
+  dir = (uv_os_fd_t) req.result;
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_openat(NULL, &req, dir, "file", O_WRONLY | O_CREAT, 0644, NULL);
+  ASSERT(r >= 0);
+  file = (uv_os_fd_t) req.result;
+  uv_fs_req_cleanup(&req);
+  iov = uv_buf_init("hello", 5);
+  ASSERT(5 == uv_fs_write(NULL, &req, file, &iov, 1, -1, NULL));
+  uv_fs_req_cleanup(&req);
+  ASSERT(0 == uv_fs_close(NULL, &req, file, NULL));
+  uv_fs_req_cleanup(&req);
+
+  ASSERT(0 == uv_fs_openat(loop, &req, dir, "file", O_RDONLY, 0, fs_at_cb));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(0 == uv_fs_statat(NULL, &req, dir, "file", 0, NULL));
+  ASSERT(req.ptr == &req.statbuf);
+  ASSERT(req.statbuf.st_size == 5);
+  uv_fs_req_cleanup(&req);
+  ASSERT(UV_EINVAL == uv_fs_statat(NULL, &req, dir, "file", 0x100, NULL));
+
+  ASSERT(0 == uv_fs_renameat(NULL, &req, dir, "file", dir, "file2", NULL));
+  uv_fs_req_cleanup(&req);
+  r = uv_fs_statat(NULL, &req, dir, "file", 0, NULL);
+  ASSERT(r == UV_ENOENT);
+  uv_fs_req_cleanup(&req);
+
+  /* 不带REMOVEDIR删不了目录 */
+  ASSERT(0 == uv_fs_mkdir(NULL, &req, "test_dir/sub", 0755, NULL));
+  uv_fs_req_cleanup(&req);
+  r = uv_fs_unlinkat(NULL, &req, dir, "sub", 0, NULL);
+  ASSERT(r == UV_EISDIR || r == UV_EPERM);
+  uv_fs_req_cleanup(&req);
+  r = uv_fs_unlinkat(NULL, &req, dir, "sub", UV_FS_AT_REMOVEDIR, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
+
+  ASSERT(0 == uv_fs_unlinkat(NULL, &req, dir, "file2", 0, NULL));
+  uv_fs_req_cleanup(&req);
+  ASSERT(0 == uv_fs_close(NULL, &req, dir, NULL));
+  uv_fs_req_cleanup(&req);
+  rmdir("test_dir");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static int statx_cb_count;
+
+
+static void statx_cb(uv_fs_t* req) {
+  ASSERT(req->fs_type == UV_FS_STATX);
+  ASSERT(req->result >= 0);
+  ASSERT(req->result & UV_FS_STATX_SIZE);
+  ASSERT(req->ptr == &req->statbuf);
+  ASSERT(req->statbuf.st_size == 5);
+  statx_cb_count++;
+  uv_fs_req_cleanup(req);
+}
+
+
+TEST_IMPL(fs_statx) {
+  uv_fs_t req;
+  uv_os_fd_t file;
+  uv_buf_t iov;
+  int r;
+
+  loop = uv_default_loop();
+  unlink("test_file");
+  unlink("test_file_link");
+
+  r = uv_fs_open(NULL, &req, "test_file", O_WRONLY | O_CREAT | O_TRUNC,
+                 S_IWUSR | S_IRUSR, NULL);
+  ASSERT(r == 0);
+  file = (uv_os_fd_t) req.result;
+  uv_fs_req_cleanup(&req);
+
+  iov = uv_buf_init("hello", 5);
+  r = uv_fs_write(NULL, &req, file, &iov, 1, -1, NULL);
+  ASSERT(r == 5);
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_close(NULL, &req, file, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
+
+  /* 只要大小和修改时间 */
+  r = uv_fs_statx(NULL,
+                  &req,
+                  "test_file",
+                  UV_FS_STATX_SIZE | UV_FS_STATX_MTIME,
+                  UV_FS_STATX_DONT_SYNC,
+                  NULL);
+  ASSERT(r == req.result);
+  ASSERT(req.result & UV_FS_STATX_SIZE);
+  ASSERT(req.result & UV_FS_STATX_MTIME);
+  ASSERT(req.statbuf.st_size == 5);
+  ASSERT(req.statbuf.st_mtim.tv_sec != 0);
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_statx(loop,
+                  &req,
+                  "test_file",
+                  UV_FS_STATX_SIZE,
+                  0,
+                  statx_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(statx_cb_count == 1);
+
+  /* 不跟随符号链接 */
+  r = uv_fs_symlink(NULL, &req, "test_file", "test_file_link", 0, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_statx(NULL,
+                  &req,
+                  "test_file_link",
+                  UV_FS_STATX_TYPE,
+                  UV_FS_STATX_NOFOLLOW,
+                  NULL);
+  ASSERT(r == req.result);
+  ASSERT(req.result & UV_FS_STATX_TYPE);
+  ASSERT(S_ISLNK(req.statbuf.st_mode));
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_statx(NULL, &req, "test_file", UV_FS_STATX_SIZE, 0x1, NULL);
+  ASSERT(r == UV_EINVAL);
+
+  r = uv_fs_statx(NULL, &req, "non_existent_file", UV_FS_STATX_SIZE, 0, NULL);
+  ASSERT(r == UV_ENOENT);
+  uv_fs_req_cleanup(&req);
+
+  unlink("test_file");
+  unlink("test_file_link");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(fs_scandir_empty_dir) {
+  const char* path;
+  uv_fs_t req;
+  uv_dirent_t dent;
+  int r;
+
+  path = "./empty_dir/";
+  loop = uv_default_loop();
+
+  uv_fs_mkdir(NULL, &req, path, 0777, NULL);
+  uv_fs_req_cleanup(&req);
+
+  /* Fill the req to ensure that required fields are cleaned up */
+  memset(&req, 0xdb, sizeof(req));
+
+  r = uv_fs_scandir(NULL, &req, path, 0, NULL);
+  ASSERT(r == 0);
+  ASSERT(req.result == 0);
+  ASSERT(req.ptr == NULL);
+  ASSERT(UV_EOF == uv_fs_scandir_next(&req, &dent));
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_scandir(loop, &scandir_req, path, 0, empty_scandir_cb);
+  ASSERT(r == 0);
+
+  ASSERT(scandir_cb_count == 0);
+  uv_run(loop, UV_RUN_DEFAULT);
+  ASSERT(scandir_cb_count == 1);
+
+  uv_fs_rmdir(NULL, &req, path, NULL);
+  uv_fs_req_cleanup(&req);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(fs_scandir_non_existent_dir) {
+  const char* path;
+  uv_fs_t req;
+  uv_dirent_t dent;
+  int r;
+
+  path = "./non_existent_dir/";
+  loop = uv_default_loop();
+
+  uv_fs_rmdir(NULL, &req, path, NULL);
+  uv_fs_req_cleanup(&req);
+
+  /* Fill the req to ensure that required fields are cleaned up */
+  memset(&req, 0xdb, sizeof(req));
+
+  r = uv_fs_scandir(NULL, &req, path, 0, NULL);
+  ASSERT(r == UV_ENOENT);
+  ASSERT(req.result == UV_ENOENT);
+  ASSERT(req.ptr == NULL);
+  ASSERT(UV_ENOENT == uv_fs_scandir_next(&req, &dent));
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_scandir(loop, &scandir_req, path, 0, non_existent_scandir_cb);
+  ASSERT(r == 0);
+
+  ASSERT(scandir_cb_count == 0);
+  uv_run(loop, UV_RUN_DEFAULT);
+  ASSERT(scandir_cb_count == 1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+TEST_IMPL(fs_scandir_file) {
+  const char* path;
+  int r;
+
+  path = "test/fixtures/empty_file";
+  loop = uv_default_loop();
+
+  r = uv_fs_scandir(NULL, &scandir_req, path, 0, NULL);
+  ASSERT(r == UV_ENOTDIR);
+  uv_fs_req_cleanup(&scandir_req);
+
+  r = uv_fs_scandir(loop, &scandir_req, path, 0, file_scandir_cb);
+  ASSERT(r == 0);
+
+  ASSERT(scandir_cb_count == 0);
+  uv_run(loop, UV_RUN_DEFAULT);
+  ASSERT(scandir_cb_count == 1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(fs_open_dir) {
+  const char* path;
+  uv_fs_t req;
+  int r;
+  uv_os_fd_t file;
+
+  path = ".";
+  loop = uv_default_loop();
+
+  r = uv_fs_open(NULL, &req, path, O_RDONLY, 0, NULL);
+  ASSERT(r == 0);
+  ASSERT(req.result >= 0);
+  ASSERT(req.ptr == NULL);
+  file = (uv_os_fd_t)req.result;
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_close(NULL, &req, file, NULL);
+  ASSERT(r == 0);
+
+  r = uv_fs_open(loop, &req, path, O_RDONLY, 0, open_cb_simple);
+  ASSERT(r == 0);
+
+  ASSERT(open_cb_count == 0);
+  uv_run(loop, UV_RUN_DEFAULT);
+  ASSERT(open_cb_count == 1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(fs_file_open_append) {
+  int r;
+  uv_os_fd_t file;
+
+  /* Setup. */
+  unlink("test_file");
+
+  loop = uv_default_loop();
+
+  r = uv_fs_open(NULL, &open_req1, "test_file", O_WRONLY | O_CREAT,
+      S_IWUSR | S_IRUSR, NULL);
+  ASSERT(r == 0);
+  ASSERT(open_req1.result >= 0);
+  file = (uv_os_fd_t)open_req1.result;
+  uv_fs_req_cleanup(&open_req1);
+
+  iov = uv_buf_init(test_buf, sizeof(test_buf));
+  r = uv_fs_write(NULL, &write_req, file, &iov, 1, -1, NULL);
+  ASSERT(r >= 0);
+  ASSERT(write_req.result >= 0);
+  uv_fs_req_cleanup(&write_req);
+
+  r = uv_fs_close(NULL, &close_req, file, NULL);
+  ASSERT(r == 0);
+  ASSERT(close_req.result == 0);
+  uv_fs_req_cleanup(&close_req);
+
+  r = uv_fs_open(NULL, &open_req1, "test_file", O_RDWR | O_APPEND, 0, NULL);
+  ASSERT(r >= 0);
+  ASSERT(open_req1.result >= 0);
+  file = (uv_os_fd_t)open_req1.result;
+  uv_fs_req_cleanup(&open_req1);
+
+  iov = uv_buf_init(test_buf, sizeof(test_buf));
+  r = uv_fs_write(NULL, &write_req, file, &iov, 1, -1, NULL);
+  ASSERT(r >= 0);
+  ASSERT(write_req.result >= 0);
+  uv_fs_req_cleanup(&write_req);
+
+  r = uv_fs_close(NULL, &close_req, file, NULL);
+  ASSERT(r == 0);
+  ASSERT(close_req.result == 0);
+  uv_fs_req_cleanup(&close_req);
+
+  r = uv_fs_open(NULL, &open_req1, "test_file", O_RDONLY, S_IRUSR, NULL);
+  ASSERT(r == 0);
+  ASSERT(open_req1.result >= 0);
+  file = (uv_os_fd_t)open_req1.result;
+  uv_fs_req_cleanup(&open_req1);
+
+  iov = uv_buf_init(buf, sizeof(buf));
+  r = uv_fs_read(NULL, &read_req, file, &iov, 1, -1, NULL);
+  printf("read = %d\n", r);
+  ASSERT(r == 26);
+  ASSERT(read_req.result == 26);
+  ASSERT(memcmp(buf,
+                "test-buffer\n\0test-buffer\n\0",
+                sizeof("test-buffer\n\0test-buffer\n\0") - 1) == 0);
+  uv_fs_req_cleanup(&read_req);
+
+  r = uv_fs_close(NULL, &close_req, file, NULL);
+  ASSERT(r == 0);
+  ASSERT(close_req.result == 0);
+  uv_fs_req_cleanup(&close_req);
+
+  /* Cleanup */
+  unlink("test_file");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static char path_copy_long[200];
+static char path_copy_long2[200];
+static int path_copy_cb_count;
+
+
+static void path_copy_cb(uv_fs_t* req) {
+  ASSERT(req->result == UV_ENOENT);
+  ASSERT(req->path != path_copy_long);
+  if (req->fs_type == UV_FS_RENAME) {
+    ASSERT(0 == strcmp(req->path, path_copy_long));
+    ASSERT(0 == strcmp(req->new_path, path_copy_long2));
+  } else {
+    ASSERT(0 == strcmp(req->path, "no_such_file"));
+  }
+  uv_fs_req_cleanup(req);
+  path_copy_cb_count++;
+}
+
+
+/* 异步请求复制的路径：短的放在请求里，长的另外分配 */
+TEST_IMPL(fs_async_path_copy) {
+  uv_fs_t stat_req;
+  char path[200];
+
+  loop = uv_default_loop();
+
+  memset(path_copy_long, 'a', sizeof(path_copy_long) - 1);
+  memset(path_copy_long2, 'b', sizeof(path_copy_long2) - 1);
+  strcpy(path, "no_such_file");
+
+  ASSERT(0 == uv_fs_stat(loop, &stat_req, path, path_copy_cb));
+  /* 调用返回以后调用方的内存就可以改了 */
+  memset(path, 0, sizeof(path));
+
+  ASSERT(0 == uv_fs_rename(loop,
+                           &rename_req,
+                           path_copy_long,
+                           path_copy_long2,
+                           path_copy_cb));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(path_copy_cb_count == 2);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(fs_rename_to_existing_file) {
+  int r;
+  uv_os_fd_t file;
+
+  /* Setup. */
+  unlink("test_file");
+  unlink("test_file2");
+
+  loop = uv_default_loop();
 
   r = uv_fs_open(NULL, &open_req1, "test_file", O_WRONLY | O_CREAT,
       S_IWUSR | S_IRUSR, NULL);
@@ -3716,6 +4497,515 @@ TEST_IMPL(fs_null_req) {
   return 0;
 }
 
+
+static int nowait_cb_called;
+
+
+static void nowait_read_cb(uv_fs_t* req) {
+  ASSERT(req->fs_type == UV_FS_READ);
+  nowait_cb_called++;
+}
+
+
+TEST_IMPL(fs_read_nowait) {
+  uv_fs_t open_req;
+  uv_fs_t read_req;
+  uv_os_fd_t file;
+  char buf[64];
+  uv_buf_t iov;
+  int r;
+
+  loop = uv_default_loop();
+  unlink("test_file");
+
+  r = uv_fs_open(NULL,
+                 &open_req,
+                 "test_file",
+                 O_RDWR | O_CREAT | O_TRUNC,
+                 S_IWUSR | S_IRUSR,
+                 NULL);
+  ASSERT(r >= 0);
+  file = (uv_os_fd_t) open_req.result;
+  uv_fs_req_cleanup(&open_req);
+
+  iov = uv_buf_init("hello world", 11);
+  r = uv_fs_write(NULL, &read_req, file, &iov, 1, -1, NULL);
+  ASSERT(r == 11);
+  uv_fs_req_cleanup(&read_req);
+
+  /* 全部都在page cache里，可以直接在loop线程上读完 */
+  memset(buf, 0, sizeof(buf));
+  iov = uv_buf_init(buf, 5);
+  r = uv_fs_read(loop, &read_req, file, &iov, 1, 6, nowait_read_cb);
+  ASSERT(r == 0);
+  /* 回调不能在uv_fs_read()里面调用 */
+  ASSERT(nowait_cb_called == 0);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(nowait_cb_called == 1);
+  ASSERT(read_req.result == 5);
+  ASSERT(0 == memcmp(buf, "world", 5));
+  uv_fs_req_cleanup(&read_req);
+
+  /* 读到文件末尾，读到的比要的少 */
+  memset(buf, 0, sizeof(buf));
+  iov = uv_buf_init(buf, sizeof(buf));
+  r = uv_fs_read(loop, &read_req, file, &iov, 1, 0, nowait_read_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(nowait_cb_called == 2);
+  ASSERT(read_req.result == 11);
+  ASSERT(0 == memcmp(buf, "hello world", 11));
+  uv_fs_req_cleanup(&read_req);
+
+  /* 偏移已经超过了文件末尾 */
+  r = uv_fs_read(loop, &read_req, file, &iov, 1, 100, nowait_read_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(nowait_cb_called == 3);
+  ASSERT(read_req.result == 0);
+  uv_fs_req_cleanup(&read_req);
+
+  r = uv_fs_close(NULL, &read_req, file, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&read_req);
+  unlink("test_file");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static int direct_cb_called;
+
+
+static void direct_read_cb(uv_fs_t* req) {
+  ASSERT(req->fs_type == UV_FS_READ);
+  ASSERT(req->result == UV_EALIGN);
+  direct_cb_called++;
+}
+
+
+TEST_IMPL(fs_o_direct) {
+#if defined(__linux__)
+  uv_fs_t req;
+  uv_os_fd_t file;
+  uv_buf_t buf;
+  uv_buf_t iov;
+  int r;
+
+  loop = uv_default_loop();
+  unlink("test_file");
+
+  r = uv_fs_open(NULL,
+                 &req,
+                 "test_file",
+                 O_RDWR | O_CREAT | O_TRUNC | UV_FS_O_DIRECT,
+                 S_IWUSR | S_IRUSR,
+                 NULL);
+  uv_fs_req_cleanup(&req);
+  if (r == UV_EINVAL) {
+    unlink("test_file");
+    RETURN_SKIP("O_DIRECT is not supported by this file system");
+  }
+  ASSERT(r == 0);
+  file = (uv_os_fd_t) req.result;
+
+  ASSERT(UV_EINVAL == uv_buf_aligned_alloc(file, 0, &buf));
+  ASSERT(0 == uv_buf_aligned_alloc(file, 100, &buf));
+  ASSERT(buf.len >= 512);
+  ASSERT(buf.len % 512 == 0);
+  ASSERT((uintptr_t) buf.base % 512 == 0);
+  memset(buf.base, 'x', buf.len);
+
+  r = uv_fs_write(NULL, &req, file, &buf, 1, 0, NULL);
+  ASSERT(r == (int) buf.len);
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_read(NULL, &req, file, &buf, 1, 0, NULL);
+  ASSERT(r == (int) buf.len);
+  uv_fs_req_cleanup(&req);
+
+  /* 长度、地址、偏移没对齐 */
+  iov = uv_buf_init(buf.base, 100);
+  r = uv_fs_write(NULL, &req, file, &iov, 1, 0, NULL);
+  ASSERT(r == UV_EALIGN);
+  uv_fs_req_cleanup(&req);
+
+  iov = uv_buf_init(buf.base + 1, buf.len - 1);
+  r = uv_fs_read(NULL, &req, file, &iov, 1, 0, NULL);
+  ASSERT(r == UV_EALIGN);
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_read(NULL, &req, file, &buf, 1, 1, NULL);
+  ASSERT(r == UV_EALIGN);
+  uv_fs_req_cleanup(&req);
+
+  /* 异步请求不管走哪条路径都是同样的错误 */
+  r = uv_fs_read(loop, &req, file, &iov, 1, 0, direct_read_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(direct_cb_called == 1);
+  uv_fs_req_cleanup(&req);
+
+  ASSERT(0 == strcmp(uv_err_name(UV_EALIGN), "EALIGN"));
+
+  uv_buf_aligned_free(&buf);
+  ASSERT(buf.base == NULL);
+
+  r = uv_fs_close(NULL, &req, file, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
+  unlink("test_file");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#else
+  RETURN_SKIP("O_DIRECT alignment is only queried on Linux");
+#endif
+}
+
+
+static int hint_cb_called;
+
+
+static void hint_cb(uv_fs_t* req) {
+  ASSERT(req->fs_type == UV_FS_FADVISE || req->fs_type == UV_FS_READAHEAD);
+  ASSERT(req->result == 0 || req->result == UV_ENOSYS);
+  hint_cb_called++;
+  uv_fs_req_cleanup(req);
+}
+
+
+TEST_IMPL(fs_fallocate) {
+  uv_fs_t req;
+  uv_fs_t fadvise_req;
+  uv_fs_t readahead_req;
+  uv_os_fd_t file;
+  int r;
+
+  loop = uv_default_loop();
+  unlink("test_file");
+
+  r = uv_fs_open(NULL,
+                 &req,
+                 "test_file",
+                 O_RDWR | O_CREAT | O_TRUNC,
+                 S_IWUSR | S_IRUSR,
+                 NULL);
+  ASSERT(r == 0);
+  file = (uv_os_fd_t) req.result;
+  uv_fs_req_cleanup(&req);
+
+  r = uv_fs_fallocate(NULL, &req, file, 0, 0, 8192, NULL);
+#if defined(__APPLE__) || defined(__OpenBSD__)
+  if (r == UV_ENOSYS) {
+    uv_fs_req_cleanup(&req);
+    uv_fs_close(NULL, &req, file, NULL);
+    uv_fs_req_cleanup(&req);
+    unlink("test_file");
+    RETURN_SKIP("fallocate is not supported on this platform");
+  }
+#endif
+  ASSERT(r == 0);
+  ASSERT(req.fs_type == UV_FS_FALLOCATE);
+  uv_fs_req_cleanup(&req);
+
+  ASSERT(0 == uv_fs_fstat(NULL, &req, file, NULL));
+  ASSERT(req.statbuf.st_size == 8192);
+  uv_fs_req_cleanup(&req);
+
+#if defined(__linux__)
+  /* 只分配空间，不改文件大小 */
+  r = uv_fs_fallocate(NULL,
+                      &req,
+                      file,
+                      UV_FS_FALLOCATE_KEEP_SIZE,
+                      8192,
+                      8192,
+                      NULL);
+  ASSERT(r == 0 || r == UV_ENOTSUP);
+  uv_fs_req_cleanup(&req);
+
+  ASSERT(0 == uv_fs_fstat(NULL, &req, file, NULL));
+  ASSERT(req.statbuf.st_size == 8192);
+  uv_fs_req_cleanup(&req);
+#endif
+
+  ASSERT(UV_EINVAL == uv_fs_fallocate(NULL, &req, file, 0x80, 0, 1, NULL));
+  ASSERT(UV_EINVAL == uv_fs_fallocate(NULL, &req, file, 0, 0, 0, NULL));
+  ASSERT(UV_EINVAL == uv_fs_fadvise(NULL, &req, file, -1, 0,
+                                    UV_FS_FADV_NORMAL, NULL));
+
+  r = uv_fs_fadvise(loop,
+                    &fadvise_req,
+                    file,
+                    0,
+                    0,
+                    UV_FS_FADV_SEQUENTIAL,
+                    hint_cb);
+  ASSERT(r == 0);
+  r = uv_fs_readahead(loop, &readahead_req, file, 0, 8192, hint_cb);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(hint_cb_called == 2);
+
+  r = uv_fs_close(NULL, &req, file, NULL);
+  ASSERT(r == 0);
+  uv_fs_req_cleanup(&req);
+  unlink("test_file");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+#ifdef __linux__
+static uv_fs_t iou_req;
+static uv_os_fd_t iou_file;
+static char iou_rbuf[16];
+static int iou_cb_called;
+
+
+static void iou_fs_cb(uv_fs_t* req) {
+  uv_buf_t bufs[2];
+
+  ASSERT(req == &iou_req);
+  iou_cb_called++;
+
+  switch (req->fs_type) {
+  case UV_FS_OPEN:
+    ASSERT(req->result >= 0);
+    iou_file = (uv_os_fd_t) req->result;
+    uv_fs_req_cleanup(req);
+    bufs[0] = uv_buf_init("hello ", 6);
+    bufs[1] = uv_buf_init("world", 5);
+    ASSERT(0 == uv_fs_write(req->loop, req, iou_file, bufs, 2, 0, iou_fs_cb));
+    /* 已经在ring上了，线程池取消不了 */
+    ASSERT(UV_EBUSY == uv_cancel((uv_req_t*) req));
+    break;
+
+  case UV_FS_WRITE:
+    ASSERT(req->result == 11);
+    uv_fs_req_cleanup(req);
+    ASSERT(0 == uv_fs_fsync(req->loop, req, iou_file, iou_fs_cb));
+    break;
+
+  case UV_FS_FSYNC:
+    ASSERT(req->result == 0);
+    uv_fs_req_cleanup(req);
+    ASSERT(0 == uv_fs_fdatasync(req->loop, req, iou_file, iou_fs_cb));
+    break;
+
+  case UV_FS_FDATASYNC:
+    ASSERT(req->result == 0);
+    uv_fs_req_cleanup(req);
+    bufs[0] = uv_buf_init(iou_rbuf, sizeof(iou_rbuf));
+    ASSERT(0 == uv_fs_read(req->loop, req, iou_file, bufs, 1, 0, iou_fs_cb));
+    break;
+
+  case UV_FS_READ:
+    ASSERT(req->result == 11);
+    ASSERT(0 == memcmp(iou_rbuf, "hello world", 11));
+    uv_fs_req_cleanup(req);
+    ASSERT(0 == uv_fs_fstat(req->loop, req, iou_file, iou_fs_cb));
+    break;
+
+  case UV_FS_FSTAT:
+    ASSERT(req->result == 0);
+    ASSERT(req->ptr == &req->statbuf);
+    ASSERT(req->statbuf.st_size == 11);
+    ASSERT(S_ISREG(req->statbuf.st_mode));
+    uv_fs_req_cleanup(req);
+    ASSERT(0 == uv_fs_lstat(req->loop, req, "test_file", iou_fs_cb));
+    break;
+
+  case UV_FS_LSTAT:
+    ASSERT(req->result == 0);
+    ASSERT(req->statbuf.st_size == 11);
+    uv_fs_req_cleanup(req);
+    ASSERT(0 == uv_fs_close(req->loop, req, iou_file, iou_fs_cb));
+    break;
+
+  case UV_FS_CLOSE:
+    ASSERT(req->result == 0);
+    uv_fs_req_cleanup(req);
+    ASSERT(0 == uv_fs_stat(req->loop, req, "no_such_file", iou_fs_cb));
+    break;
+
+  case UV_FS_STAT:
+    ASSERT(req->result == UV_ENOENT);
+    ASSERT(req->ptr == NULL);
+    uv_fs_req_cleanup(req);
+    break;
+
+  default:
+    ASSERT(0 && "unexpected fs request");
+  }
+}
+#endif
+
+
+TEST_IMPL(fs_io_uring) {
+#ifndef __linux__
+  RETURN_SKIP("io_uring is only available on Linux");
+#else
+  uv_loop_t iou_loop;
+  int r;
+
+  unlink("test_file");
+
+  ASSERT(0 == uv_loop_init(&iou_loop));
+  r = uv_loop_configure(&iou_loop, UV_LOOP_USE_IO_URING);
+  if (r == UV_ENOSYS) {
+    ASSERT(0 == uv_loop_close(&iou_loop));
+    RETURN_SKIP("io_uring not supported");
+  }
+  ASSERT(r == 0);
+
+  /* 没有任何fd，只有文件系统请求时也要等到它们完成 */
+  ASSERT(0 == uv_fs_open(&iou_loop,
+                         &iou_req,
+                         "test_file",
+                         O_RDWR | O_CREAT | O_TRUNC,
+                         S_IWUSR | S_IRUSR,
+                         iou_fs_cb));
+  ASSERT(0 == uv_run(&iou_loop, UV_RUN_DEFAULT));
+  ASSERT(iou_cb_called == 9);
+
+  ASSERT(0 == uv_loop_close(&iou_loop));
+  unlink("test_file");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#endif
+}
+
+
+#ifdef __linux__
+static char iou_fixed[64];
+static int iou_fixed_cb_called;
+
+
+static void iou_fixed_cb(uv_fs_t* req) {
+  uv_buf_t buf;
+
+  iou_fixed_cb_called++;
+
+  switch (req->fs_type) {
+  case UV_FS_WRITE:
+    ASSERT(req->result == 11);
+    uv_fs_req_cleanup(req);
+    buf = uv_buf_init(iou_fixed + 32, 32);
+    ASSERT(0 == uv_fs_read_fixed(req->loop,
+                                 req,
+                                 iou_file,
+                                 &buf,
+                                 0,
+                                 0,
+                                 iou_fixed_cb));
+    break;
+
+  case UV_FS_READ:
+    ASSERT(req->result == 11);
+    ASSERT(0 == memcmp(iou_fixed + 32, "hello world", 11));
+    uv_fs_req_cleanup(req);
+    break;
+
+  default:
+    ASSERT(0 && "unexpected fs request");
+  }
+}
+#endif
+
+
+TEST_IMPL(fs_io_uring_fixed) {
+#ifndef __linux__
+  RETURN_SKIP("io_uring is only available on Linux");
+#else
+  uv_loop_t iou_loop;
+  uv_buf_t buf;
+  int r;
+
+  unlink("test_file");
+
+  ASSERT(0 == uv_loop_init(&iou_loop));
+  buf = uv_buf_init(iou_fixed, sizeof(iou_fixed));
+  ASSERT(UV_ENOSYS == uv_fs_register_buffers(&iou_loop, &buf, 1));
+
+  r = uv_loop_configure(&iou_loop, UV_LOOP_USE_IO_URING);
+  if (r == UV_ENOSYS) {
+    ASSERT(0 == uv_loop_close(&iou_loop));
+    RETURN_SKIP("io_uring not supported");
+  }
+  ASSERT(r == 0);
+
+  r = uv_fs_open(NULL,
+                 &iou_req,
+                 "test_file",
+                 O_RDWR | O_CREAT | O_TRUNC,
+                 S_IWUSR | S_IRUSR,
+                 NULL);
+  ASSERT(r == 0);
+  iou_file = (uv_os_fd_t) iou_req.result;
+  uv_fs_req_cleanup(&iou_req);
+
+  /* 没有登记缓冲区时就是普通的读写 */
+  memcpy(iou_fixed, "hello world", 11);
+  buf = uv_buf_init(iou_fixed, 11);
+  ASSERT(11 == uv_fs_write_fixed(&iou_loop,
+                                 &iou_req,
+                                 iou_file,
+                                 &buf,
+                                 3,
+                                 0,
+                                 NULL));
+  uv_fs_req_cleanup(&iou_req);
+
+  buf = uv_buf_init(iou_fixed, sizeof(iou_fixed));
+  ASSERT(0 == uv_fs_register_buffers(&iou_loop, &buf, 1));
+  ASSERT(0 == uv_fs_register_files(&iou_loop, &iou_file, 1));
+
+  /* 缓冲区要落在登记的那一个里 */
+  buf = uv_buf_init(iou_fixed + 60, 8);
+  ASSERT(UV_EINVAL == uv_fs_read_fixed(&iou_loop,
+                                       &iou_req,
+                                       iou_file,
+                                       &buf,
+                                       0,
+                                       0,
+                                       iou_fixed_cb));
+  buf = uv_buf_init(iou_fixed, 11);
+  ASSERT(UV_EINVAL == uv_fs_read_fixed(&iou_loop,
+                                       &iou_req,
+                                       iou_file,
+                                       &buf,
+                                       1,
+                                       0,
+                                       iou_fixed_cb));
+
+  ASSERT(0 == uv_fs_write_fixed(&iou_loop,
+                                &iou_req,
+                                iou_file,
+                                &buf,
+                                0,
+                                0,
+                                iou_fixed_cb));
+  ASSERT(0 == uv_run(&iou_loop, UV_RUN_DEFAULT));
+  ASSERT(iou_fixed_cb_called == 2);
+
+  ASSERT(0 == uv_fs_close(&iou_loop, &iou_req, iou_file, NULL));
+  uv_fs_req_cleanup(&iou_req);
+  ASSERT(0 == uv_fs_register_files(&iou_loop, NULL, 0));
+  ASSERT(0 == uv_fs_register_buffers(&iou_loop, NULL, 0));
+
+  ASSERT(0 == uv_loop_close(&iou_loop));
+  unlink("test_file");
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#endif
+}
+
 #ifdef _WIN32
 TEST_IMPL(fs_exclusive_sharing_mode) {
   int r;
@@ -0,0 +1,294 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESOLV_CONF "resolv.conf.test"
+#define HOSTS_FILE "hosts.test"
+
+static uv_udp_t dns_handle;
+static unsigned char dns_buf[512];
+static int dns_queries;
+static int resolver_status;
+static struct addrinfo* resolver_res;
+
+
+static void write_file(const char* path, const char* content) {
+  FILE* fp;
+
+  fp = fopen(path, "w");
+  ASSERT(fp != NULL);
+  ASSERT(EOF != fputs(content, fp));
+  ASSERT(0 == fclose(fp));
+}
+
+
+static void dns_alloc_cb(uv_handle_t* handle,
+                         size_t suggested_size,
+                         uv_buf_t* buf) {
+  *buf = uv_buf_init((char*) dns_buf, sizeof(dns_buf));
+}
+
+
+/* 只认识host.test：A是10.0.0.1，AAAA是fd00::1，别的名字回答NXDOMAIN */
+static void dns_recv_cb(uv_udp_t* handle,
+                        ssize_t nread,
+                        const uv_buf_t* buf,
+                        const struct sockaddr* addr,
+                        unsigned flags) {
+  static const unsigned char a[] = { 10, 0, 0, 1 };
+  static const unsigned char aaaa[] = {
+    0xfd, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1
+  };
+  unsigned char rsp[sizeof(dns_buf) + 64];
+  char name[256];
+  uv_buf_t out;
+  size_t label;
+  size_t off;
+  size_t len;
+  int type;
+
+  if (nread <= 0)
+    return;
+
+  ASSERT(nread > 12 && (size_t) nread <= sizeof(dns_buf));
+  dns_queries++;
+
+  /* 每个标签都要在读到的报文和name里放得下 */
+  len = 0;
+  for (off = 12; dns_buf[off] != 0; off += label + 1) {
+    label = dns_buf[off];
+    ASSERT(label <= 63);
+    ASSERT(off + 1 + label < (size_t) nread);
+    ASSERT(len + 1 + label < sizeof(name));
+    if (len > 0)
+      name[len++] = '.';
+    memcpy(name + len, dns_buf + off + 1, label);
+    len += label;
+  }
+  name[len] = '\0';
+  ASSERT(off + 5 <= (size_t) nread);
+  type = (dns_buf[off + 1] << 8) | dns_buf[off + 2];
+  off += 5;
+
+  memcpy(rsp, dns_buf, off);
+  rsp[2] = 0x81;
+  rsp[3] = 0x80;
+
+  if (strcmp(name, "host.test") != 0) {
+    rsp[3] |= 3;
+  } else {
+    rsp[7] = 1;
+    rsp[off++] = 0xc0;
+    rsp[off++] = 12;
+    rsp[off++] = 0;
+    rsp[off++] = type;
+    rsp[off++] = 0;
+    rsp[off++] = 1;
+    memset(rsp + off, 0, 4);
+    off += 4;
+    rsp[off++] = 0;
+    if (type == 1) {
+      rsp[off++] = sizeof(a);
+      memcpy(rsp + off, a, sizeof(a));
+      off += sizeof(a);
+    } else {
+      rsp[off++] = sizeof(aaaa);
+      memcpy(rsp + off, aaaa, sizeof(aaaa));
+      off += sizeof(aaaa);
+    }
+  }
+
+  out = uv_buf_init((char*) rsp, off);
+  ASSERT((int) off == uv_udp_try_send(handle, &out, 1, addr));
+}
+
+
+static void resolver_cb(uv_getaddrinfo_t* req,
+                        int status,
+                        struct addrinfo* res) {
+  resolver_status = status;
+  resolver_res = res;
+}
+
+
+static void resolve(const char* node,
+                    const char* service,
+                    int family,
+                    int flags) {
+  struct addrinfo hints;
+  uv_getaddrinfo_t req;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = family;
+  hints.ai_flags = flags;
+
+  resolver_status = 1;
+  resolver_res = NULL;
+  ASSERT(0 == uv_getaddrinfo(uv_default_loop(),
+                             &req,
+                             resolver_cb,
+                             node,
+                             service,
+                             &hints));
+
+  /* 在loop里解析的请求不在线程池里 */
+  if (family != AF_INET || strcmp(node, "127.0.0.1") != 0)
+    ASSERT(UV_EBUSY == uv_cancel((uv_req_t*) &req));
+
+  while (resolver_status == 1)
+    uv_run(uv_default_loop(), UV_RUN_ONCE);
+}
+
+
+TEST_IMPL(getaddrinfo_resolver) {
+  struct sockaddr_in addr;
+  struct sockaddr_in* a4;
+  struct addrinfo* ai;
+  char ip[64];
+  int families;
+  int n;
+
+  write_file(RESOLV_CONF,
+             "# test\n"
+             "nameserver [127.0.0.1]:9123\n"
+             "search test\n"
+             "options ndots:1 timeout:2 attempts:1\n");
+  write_file(HOSTS_FILE,
+             "10.9.8.7\tfromhosts.test fh  # comment\n"
+             "::1 ip6-localhost\n");
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &dns_handle));
+  ASSERT(0 == uv_udp_bind(&dns_handle, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_udp_recv_start(&dns_handle, dns_alloc_cb, dns_recv_cb));
+
+  ASSERT(0 == uv_loop_configure(uv_default_loop(),
+                                UV_LOOP_DNS_RESOLVER,
+                                RESOLV_CONF,
+                                HOSTS_FILE));
+
+  /* 没有点的名字先加search后缀，A和AAAA一起查 */
+  resolve("host", "80", AF_UNSPEC, 0);
+  ASSERT(resolver_status == 0);
+  ASSERT(dns_queries == 2);
+  families = 0;
+  n = 0;
+  for (ai = resolver_res; ai != NULL; ai = ai->ai_next, n++) {
+    families |= ai->ai_family == AF_INET ? 1 : 2;
+    ASSERT(ai->ai_socktype == SOCK_STREAM || ai->ai_socktype == SOCK_DGRAM);
+    if (ai->ai_family == AF_INET) {
+      a4 = (struct sockaddr_in*) ai->ai_addr;
+      ASSERT(ntohs(a4->sin_port) == 80);
+      ASSERT(0 == uv_ip4_name(a4, ip, sizeof(ip)));
+      ASSERT(0 == strcmp(ip, "10.0.0.1"));
+    }
+  }
+  ASSERT(families == 3);
+  ASSERT(n == 4);
+  uv_freeaddrinfo(resolver_res);
+
+  resolve("host", NULL, AF_INET, AI_CANONNAME);
+  ASSERT(resolver_status == 0);
+  ASSERT(dns_queries == 3);
+  ASSERT(resolver_res->ai_family == AF_INET);
+  ASSERT(resolver_res->ai_canonname != NULL);
+  ASSERT(0 == strcmp(resolver_res->ai_canonname, "host.test"));
+  uv_freeaddrinfo(resolver_res);
+
+  /* missing.test和missing都不存在 */
+  resolve("missing", NULL, AF_UNSPEC, 0);
+  ASSERT(resolver_status == UV_EAI_NONAME);
+  ASSERT(resolver_res == NULL);
+  ASSERT(dns_queries == 7);
+
+  /* hosts文件里的名字不发查询，canonname是这一行的第一个名字 */
+  resolve("FH.", "443", AF_INET, AI_CANONNAME);
+  ASSERT(resolver_status == 0);
+  ASSERT(dns_queries == 7);
+  ASSERT(resolver_res->ai_next != NULL);
+  ASSERT(resolver_res->ai_next->ai_next == NULL);
+  ASSERT(0 == strcmp(resolver_res->ai_canonname, "fromhosts.test"));
+  a4 = (struct sockaddr_in*) resolver_res->ai_addr;
+  ASSERT(ntohs(a4->sin_port) == 443);
+  ASSERT(0 == uv_ip4_name(a4, ip, sizeof(ip)));
+  ASSERT(0 == strcmp(ip, "10.9.8.7"));
+  uv_freeaddrinfo(resolver_res);
+
+  /* 数字地址仍然交给getaddrinfo() */
+  resolve("127.0.0.1", NULL, AF_INET, 0);
+  ASSERT(resolver_status == 0);
+  ASSERT(dns_queries == 7);
+  uv_freeaddrinfo(resolver_res);
+
+  uv_close((uv_handle_t*) &dns_handle, NULL);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  /* 配置文件不存在 */
+  ASSERT(UV_ENOENT == uv_loop_configure(uv_default_loop(),
+                                        UV_LOOP_DNS_RESOLVER,
+                                        "no-such-resolv.conf",
+                                        HOSTS_FILE));
+
+  remove(RESOLV_CONF);
+  remove(HOSTS_FILE);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+/* TCP查询，应答来自test/dns-server.c，它对任何查询都回答echos.srv的A记录 */
+TEST_IMPL(getaddrinfo_resolver_tcp) {
+  struct sockaddr_in* a4;
+  char ip[64];
+
+  write_file(RESOLV_CONF,
+             "nameserver [127.0.0.1]:9124\n"
+             "options use-vc timeout:5\n");
+  write_file(HOSTS_FILE, "");
+
+  ASSERT(0 == uv_loop_configure(uv_default_loop(),
+                                UV_LOOP_DNS_RESOLVER,
+                                RESOLV_CONF,
+                                HOSTS_FILE));
+
+  resolve("echos.srv", NULL, AF_INET, 0);
+  ASSERT(resolver_status == 0);
+  ASSERT(resolver_res->ai_family == AF_INET);
+  a4 = (struct sockaddr_in*) resolver_res->ai_addr;
+  ASSERT(0 == uv_ip4_name(a4, ip, sizeof(ip)));
+  ASSERT(0 == strcmp(ip, "10.0.1.1"));
+  uv_freeaddrinfo(resolver_res);
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  remove(RESOLV_CONF);
+  remove(HOSTS_FILE);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
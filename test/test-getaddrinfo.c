@@ -22,6 +22,7 @@
 #include "uv.h"
 #include "task.h"
 #include <stdlib.h>
+#include <string.h>
 
 #define CONCURRENT_COUNT    10
 
@@ -189,3 +190,107 @@ TEST_IMPL(getaddrinfo_concurrent) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+static int cache_status;
+static uint64_t cache_run_ns;
+static struct sockaddr_storage cache_addr;
+
+
+static void getaddrinfo_cache_cb(uv_getaddrinfo_t* req,
+                                 int status,
+                                 struct addrinfo* res) {
+  uint64_t wait_ns;
+
+  cache_status = status;
+  ASSERT(0 == uv_req_work_time((uv_req_t*) req, &wait_ns, &cache_run_ns));
+  if (status == 0) {
+    ASSERT(res != NULL);
+    ASSERT(res->ai_addrlen <= sizeof(cache_addr));
+    memcpy(&cache_addr, res->ai_addr, res->ai_addrlen);
+  }
+  uv_freeaddrinfo(res);
+}
+
+
+static void getaddrinfo_cache_run(const char* node, const char* service) {
+  uv_getaddrinfo_t req;
+
+  ASSERT(0 == uv_getaddrinfo(uv_default_loop(),
+                             &req,
+                             getaddrinfo_cache_cb,
+                             node,
+                             service,
+                             NULL));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+}
+
+
+TEST_IMPL(getaddrinfo_cache) {
+  struct sockaddr_storage first;
+  uv_getaddrinfo_t req;
+
+  ASSERT(0 == uv_threadpool_enable_histograms(NULL, 1));
+  ASSERT(0 == uv_getaddrinfo_cache_configure(60000, 60000, 0, 0));
+
+  /* 第一次在线程池里解析，第二次直接从缓存返回 */
+  getaddrinfo_cache_run(name, NULL);
+  ASSERT(cache_status == 0);
+  ASSERT(cache_run_ns > 0);
+  first = cache_addr;
+
+  getaddrinfo_cache_run(name, NULL);
+  ASSERT(cache_status == 0);
+  ASSERT(cache_run_ns == 0);
+  ASSERT(0 == memcmp(&first, &cache_addr, sizeof(first)));
+
+  /* 命中的请求已经不在线程池里了，不能取消 */
+  ASSERT(0 == uv_getaddrinfo(uv_default_loop(),
+                             &req,
+                             getaddrinfo_cache_cb,
+                             name,
+                             NULL,
+                             NULL));
+  ASSERT(UV_EBUSY == uv_cancel((uv_req_t*) &req));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(cache_status == 0);
+
+  /* 同步调用也查缓存，结果同样用uv_freeaddrinfo()释放 */
+  ASSERT(0 == uv_getaddrinfo(uv_default_loop(), &req, NULL, name, NULL, NULL));
+  ASSERT(req.addrinfo != NULL);
+  uv_freeaddrinfo(req.addrinfo);
+
+  /* 不同的service是不同的缓存项 */
+  getaddrinfo_cache_run(name, "80");
+  ASSERT(cache_status == 0);
+  ASSERT(cache_run_ns > 0);
+
+  /* 名字不存在的结果也缓存；沙箱里没有DNS时得到的是临时错误，不缓存 */
+  getaddrinfo_cache_run("xyzzy.xyzzy.xyzzy.", NULL);
+  if (cache_status == UV_EAI_NONAME) {
+    getaddrinfo_cache_run("xyzzy.xyzzy.xyzzy.", NULL);
+    ASSERT(cache_status == UV_EAI_NONAME);
+    ASSERT(cache_run_ns == 0);
+  }
+
+  /* 过期以后stale窗口里仍然返回旧结果，同时在后台刷新 */
+  ASSERT(0 == uv_getaddrinfo_cache_configure(1, 0, 60000, 0));
+  getaddrinfo_cache_run(name, "81");
+  ASSERT(cache_status == 0);
+  ASSERT(cache_run_ns > 0);
+  uv_sleep(10);
+  getaddrinfo_cache_run(name, "81");
+  ASSERT(cache_status == 0);
+  ASSERT(cache_run_ns == 0);
+
+  /* 关闭后清空 */
+  ASSERT(0 == uv_getaddrinfo_cache_configure(0, 0, 0, 0));
+  getaddrinfo_cache_run(name, NULL);
+  ASSERT(cache_status == 0);
+  ASSERT(cache_run_ns > 0);
+
+  ASSERT(0 == uv_threadpool_enable_histograms(NULL, 0));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
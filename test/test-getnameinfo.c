@@ -99,3 +99,159 @@ TEST_IMPL(getnameinfo_basic_ip6) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+static int cache_cb_called;
+static uint64_t cache_run_ns;
+static char cache_host[256];
+
+
+static void getnameinfo_cache_cb(uv_getnameinfo_t* handle,
+                                 int status,
+                                 const char* hostname,
+                                 const char* service) {
+  uint64_t wait_ns;
+
+  ASSERT(status == 0);
+  ASSERT(hostname != NULL);
+  ASSERT(service != NULL);
+  ASSERT(0 == uv_req_work_time((uv_req_t*) handle, &wait_ns, &cache_run_ns));
+  snprintf(cache_host, sizeof(cache_host), "%s", hostname);
+  cache_cb_called++;
+}
+
+
+TEST_IMPL(getnameinfo_cache) {
+  char first[256];
+
+  ASSERT(0 == uv_threadpool_enable_histograms(NULL, 1));
+  ASSERT(0 == uv_getnameinfo_cache_configure(60000, 0));
+  ASSERT(0 == uv_ip4_addr(address_ip4, port, &addr4));
+
+  /* 第一次在线程池里解析，第二次直接从缓存返回 */
+  ASSERT(0 == uv_getnameinfo(uv_default_loop(),
+                             &req,
+                             getnameinfo_cache_cb,
+                             (const struct sockaddr*) &addr4,
+                             0));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(cache_cb_called == 1);
+  ASSERT(cache_run_ns > 0);
+  memcpy(first, cache_host, sizeof(first));
+
+  ASSERT(0 == uv_getnameinfo(uv_default_loop(),
+                             &req,
+                             getnameinfo_cache_cb,
+                             (const struct sockaddr*) &addr4,
+                             0));
+  ASSERT(UV_EBUSY == uv_cancel((uv_req_t*) &req));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(cache_cb_called == 2);
+  ASSERT(cache_run_ns == 0);
+  ASSERT(0 == strcmp(first, cache_host));
+
+  /* 同步调用也查缓存 */
+  ASSERT(0 == uv_getnameinfo(uv_default_loop(),
+                             &req,
+                             NULL,
+                             (const struct sockaddr*) &addr4,
+                             0));
+  ASSERT(0 == strcmp(first, req.host));
+
+  /* flags不同是不同的缓存项 */
+  ASSERT(0 == uv_getnameinfo(uv_default_loop(),
+                             &req,
+                             getnameinfo_cache_cb,
+                             (const struct sockaddr*) &addr4,
+                             NI_NUMERICHOST));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(cache_cb_called == 3);
+  ASSERT(cache_run_ns > 0);
+  ASSERT(0 == strcmp(cache_host, address_ip4));
+
+  /* 关闭后清空 */
+  ASSERT(0 == uv_getnameinfo_cache_configure(0, 0));
+  ASSERT(0 == uv_getnameinfo(uv_default_loop(),
+                             &req,
+                             getnameinfo_cache_cb,
+                             (const struct sockaddr*) &addr4,
+                             0));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(cache_cb_called == 4);
+  ASSERT(cache_run_ns > 0);
+
+  ASSERT(0 == uv_threadpool_enable_histograms(NULL, 0));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+#define BATCH_SIZE 8
+
+static uv_getnameinfo_t batch_reqs[BATCH_SIZE];
+static int batch_cb_called;
+
+
+static void getnameinfo_batch_cb(uv_getnameinfo_t* handle,
+                                 int status,
+                                 const char* hostname,
+                                 const char* service) {
+  char expected[16];
+
+  /* 按提交顺序回调 */
+  ASSERT(handle == &batch_reqs[batch_cb_called]);
+  ASSERT(status == 0);
+  ASSERT(0 == strcmp(hostname, address_ip4));
+  snprintf(expected, sizeof(expected), "%d", 9000 + batch_cb_called);
+  ASSERT(0 == strcmp(service, expected));
+  batch_cb_called++;
+}
+
+
+TEST_IMPL(getnameinfo_batch) {
+  struct sockaddr_in addrs[BATCH_SIZE];
+  const struct sockaddr* ptrs[BATCH_SIZE];
+  struct sockaddr_storage bad;
+  int i;
+
+  for (i = 0; i < BATCH_SIZE; i++) {
+    ASSERT(0 == uv_ip4_addr(address_ip4, 9000 + i, &addrs[i]));
+    ptrs[i] = (const struct sockaddr*) &addrs[i];
+  }
+
+  ASSERT(0 == uv_getnameinfo_batch(uv_default_loop(),
+                                   batch_reqs,
+                                   ptrs,
+                                   BATCH_SIZE,
+                                   getnameinfo_batch_cb,
+                                   NI_NUMERICHOST | NI_NUMERICSERV));
+
+  /* 批次里的请求不能单独取消 */
+  ASSERT(UV_EBUSY == uv_cancel((uv_req_t*) &batch_reqs[0]));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(batch_cb_called == BATCH_SIZE);
+
+  /* 有一个地址不对就一个都不发起 */
+  memset(&bad, 0, sizeof(bad));
+  bad.ss_family = AF_UNIX;
+  ptrs[BATCH_SIZE - 1] = (const struct sockaddr*) &bad;
+  ASSERT(UV_EINVAL == uv_getnameinfo_batch(uv_default_loop(),
+                                           batch_reqs,
+                                           ptrs,
+                                           BATCH_SIZE,
+                                           getnameinfo_batch_cb,
+                                           0));
+  ASSERT(UV_EINVAL == uv_getnameinfo_batch(uv_default_loop(),
+                                           batch_reqs,
+                                           ptrs,
+                                           0,
+                                           getnameinfo_batch_cb,
+                                           0));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(batch_cb_called == BATCH_SIZE);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -52,3 +52,46 @@ TEST_IMPL(hrtime) {
   }
   return 0;
 }
+
+
+TEST_IMPL(hrtime_tsc) {
+  uint64_t a, b, c, diff;
+  uv_loop_t loop;
+  int r;
+  int i;
+
+  r = uv_hrtime_use_tsc(1);
+  if (r == UV_ENOTSUP || r == UV_ENOSYS)
+    RETURN_SKIP("No usable invariant TSC on this machine.");
+  ASSERT(r == 0);
+  ASSERT(0 == uv_hrtime_use_tsc(1));
+
+  /* 换算出来的时间单调，速率和uv_sleep()对得上 */
+  for (i = 0; i < 10; i++) {
+    a = uv_hrtime();
+    uv_sleep(20);
+    b = uv_hrtime();
+    c = uv_hrtime();
+    ASSERT(c >= b);
+    diff = b - a;
+    ASSERT(diff > (uint64_t) 15 * NANOSEC / MILLISEC);
+    ASSERT(diff < (uint64_t) 80 * NANOSEC / MILLISEC);
+  }
+
+  /* loop的时间也跟着走 */
+  ASSERT(0 == uv_loop_init(&loop));
+  a = uv_now(&loop);
+  uv_sleep(20);
+  uv_update_time(&loop);
+  ASSERT(uv_now(&loop) - a >= 15);
+  ASSERT(0 == uv_loop_close(&loop));
+
+  /* 关掉以后和CLOCK_MONOTONIC之间没有跳变 */
+  a = uv_hrtime();
+  ASSERT(0 == uv_hrtime_use_tsc(0));
+  b = uv_hrtime();
+  diff = a > b ? a - b : b - a;
+  ASSERT(diff < (uint64_t) 5 * NANOSEC / MILLISEC);
+
+  return 0;
+}
@@ -22,6 +22,8 @@
 #include "uv.h"
 #include "task.h"
 
+#include <string.h>
+
 
 static uv_idle_t idle_handle;
 static uv_check_t check_handle;
@@ -97,3 +99,90 @@ TEST_IMPL(idle_starvation) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+static uv_prepare_t prepare_handles[4];
+static char prepare_order[16];
+static int prepare_order_len;
+
+
+static void prepare_order_cb(uv_prepare_t* handle) {
+  prepare_order[prepare_order_len++] = '0' + (handle - prepare_handles);
+}
+
+
+TEST_IMPL(loop_watcher_priority) {
+  uv_loop_t* loop;
+  int i;
+
+  loop = uv_default_loop();
+  for (i = 0; i < 4; i++)
+    ASSERT(0 == uv_prepare_init(loop, prepare_handles + i));
+
+  ASSERT(0 == uv_prepare_set_priority(prepare_handles + 1, 5));
+  ASSERT(0 == uv_prepare_set_priority(prepare_handles + 2, -3));
+  ASSERT(0 == uv_prepare_set_priority(prepare_handles + 3, 5));
+  for (i = 0; i < 4; i++)
+    ASSERT(0 == uv_prepare_start(prepare_handles + i, prepare_order_cb));
+
+  /* 同优先级的后启动的先运行 */
+  ASSERT(0 != uv_run(loop, UV_RUN_NOWAIT));
+  prepare_order[prepare_order_len] = '\0';
+  ASSERT(0 == strcmp(prepare_order, "2031"));
+
+  /* 启动着的句柄调整优先级后立即换位置，运行过以后顺序不变 */
+  ASSERT(0 == uv_prepare_set_priority(prepare_handles + 0, 10));
+  prepare_order_len = 0;
+  ASSERT(0 != uv_run(loop, UV_RUN_NOWAIT));
+  ASSERT(0 != uv_run(loop, UV_RUN_NOWAIT));
+  prepare_order[prepare_order_len] = '\0';
+  ASSERT(0 == strcmp(prepare_order, "23102310"));
+
+  for (i = 0; i < 4; i++)
+    uv_close((uv_handle_t*) (prepare_handles + i), NULL);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static int check_once_cb_called;
+
+
+static void check_once_cb(uv_check_t* handle) {
+  ASSERT(!uv_is_active((uv_handle_t*) handle));
+  check_once_cb_called++;
+
+  if (check_once_cb_called < 3)
+    ASSERT(0 == uv_check_start_once(handle, check_once_cb));
+}
+
+
+TEST_IMPL(check_start_once) {
+  uv_loop_t* loop;
+  int i;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_check_init(loop, &check_handle));
+  ASSERT(UV_EINVAL == uv_check_start_once(&check_handle, NULL));
+  ASSERT(0 == uv_check_start_once(&check_handle, check_once_cb));
+  /* 已经启动时什么都不做，仍然只运行一次 */
+  ASSERT(0 == uv_check_start(&check_handle, check_once_cb));
+
+  ASSERT(0 != uv_run(loop, UV_RUN_NOWAIT));
+  ASSERT(check_once_cb_called == 1);
+
+  /* 每轮只运行一次，不再重新启动以后loop就可以退出了 */
+  for (i = 0; i < 4; i++)
+    uv_run(loop, UV_RUN_NOWAIT);
+  ASSERT(check_once_cb_called == 3);
+  ASSERT(!uv_is_active((uv_handle_t*) &check_handle));
+  ASSERT(0 == uv_loop_alive(loop));
+
+  uv_close((uv_handle_t*) &check_handle, NULL);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -190,6 +190,42 @@ TEST_IMPL(idna_toascii) {
   return 0;
 }
 
+TEST_IMPL(idna_toascii_fast_path) {
+  char d[32];
+  long n;
+
+  /* 跨越 8 字节边界的纯 ASCII 名字，非 ASCII 字节出现在不同位置。 */
+  T("abcdefgh", "abcdefgh");
+  T("abcdefghi.example.com", "abcdefghi.example.com");
+  T("www.example.comü", "www.example.xn--com-joa");
+  T("www.example.com.ü", "www.example.com.xn--tda");
+  T("üwww.example.com", "xn--www-goa.example.com");
+  T("a.bücher.longer-ascii-label.com",
+    "a.xn--bcher-kva.longer-ascii-label.com");
+  T("a..b", "a..b");
+  F("www.example.com.\xC0\x80", UV_EINVAL);
+
+  /* |de| 截断：只写 |de| 之前的字节，放不下时不写结尾的 nul。 */
+  memset(d, 'x', sizeof(d));
+  n = uv__idna_toascii("www.example.com", "www.example.com" + 15, d, d + 8);
+  ASSERT(n == 8);
+  ASSERT(0 == memcmp(d, "www.exam", 8));
+  ASSERT(d[8] == 'x');
+
+  memset(d, 'x', sizeof(d));
+  n = uv__idna_toascii("www.example.com", "www.example.com" + 15, d, d + 16);
+  ASSERT(n == 16);
+  ASSERT(0 == memcmp(d, "www.example.com", 16));
+
+  memset(d, 'x', sizeof(d));
+  n = uv__idna_toascii("abc.ü", "abc.ü" + 6, d, d + 6);
+  ASSERT(n == 6);
+  ASSERT(0 == memcmp(d, "abc.xn", 6));
+  ASSERT(d[6] == 'x');
+
+  return 0;
+}
+
 #undef T
 
 #endif  /* __MVS__ */
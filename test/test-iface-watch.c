@@ -0,0 +1,227 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#define ALIAS_NAME "lo:77"
+#define ALIAS_ADDR "127.0.0.77"
+
+static uv_iface_watch_t watch_handle;
+static uv_timer_t timeout_handle;
+static int added_cb_called;
+static int removed_cb_called;
+static int alias_fd = -1;
+
+
+static int find_address(const uv_interface_address_t* addrs,
+                        int count,
+                        const uv_interface_address_t* a) {
+  int i;
+
+  for (i = 0; i < count; i++) {
+    if (addrs[i].address.address4.sin_family !=
+        a->address.address4.sin_family)
+      continue;
+    if (a->address.address4.sin_family == AF_INET6) {
+      if (memcmp(&addrs[i].address.address6.sin6_addr,
+                 &a->address.address6.sin6_addr,
+                 16) == 0)
+        return i;
+    } else if (addrs[i].address.address4.sin_addr.s_addr ==
+               a->address.address4.sin_addr.s_addr) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+
+static int is_alias(const uv_interface_address_t* a) {
+  struct sockaddr_in addr;
+
+  ASSERT(0 == uv_ip4_addr(ALIAS_ADDR, 0, &addr));
+  return a->address.address4.sin_family == AF_INET &&
+         a->address.address4.sin_addr.s_addr == addr.sin_addr.s_addr;
+}
+
+
+/* 用老式的ioctl给lo加一个别名地址，把别名down掉就删除了 */
+static int alias_set(int up) {
+  struct sockaddr_in* sin;
+  struct ifreq ifr;
+
+  memset(&ifr, 0, sizeof(ifr));
+  strcpy(ifr.ifr_name, ALIAS_NAME);
+
+  if (up) {
+    sin = (struct sockaddr_in*) &ifr.ifr_addr;
+    ASSERT(0 == uv_ip4_addr(ALIAS_ADDR, 0, sin));
+    if (ioctl(alias_fd, SIOCSIFADDR, &ifr))
+      return -errno;
+    return 0;
+  }
+
+  ASSERT(0 == ioctl(alias_fd, SIOCGIFFLAGS, &ifr));
+  ifr.ifr_flags &= ~IFF_UP;
+  ASSERT(0 == ioctl(alias_fd, SIOCSIFFLAGS, &ifr));
+  return 0;
+}
+
+
+static void timeout_cb(uv_timer_t* handle) {
+  ASSERT(0 && "timed out waiting for netlink events");
+}
+
+
+static void watch_cb(uv_iface_watch_t* handle,
+                     int event,
+                     const uv_interface_address_t* address,
+                     int status) {
+  uv_interface_address_t* addrs;
+  int count;
+
+  ASSERT(handle == &watch_handle);
+  ASSERT(status == 0);
+
+  if (event == UV_IFACE_LINK_CHANGED || !is_alias(address))
+    return;
+
+  ASSERT(0 == strcmp(address->name, ALIAS_NAME));
+  ASSERT(address->is_internal);
+  ASSERT(0 == uv_iface_watch_addresses(handle, &addrs, &count));
+
+  if (event == UV_IFACE_ADDR_ADDED) {
+    added_cb_called++;
+    ASSERT(find_address(addrs, count, address) >= 0);
+    ASSERT(0 == alias_set(0));
+  } else {
+    ASSERT(event == UV_IFACE_ADDR_REMOVED);
+    ASSERT(added_cb_called == 1);
+    removed_cb_called++;
+    ASSERT(find_address(addrs, count, address) == -1);
+    uv_close((uv_handle_t*) handle, NULL);
+    uv_close((uv_handle_t*) &timeout_handle, NULL);
+  }
+
+  uv_free_interface_addresses(addrs, count);
+}
+#endif
+
+
+/* 副本和getifaddrs()的结果一致 */
+TEST_IMPL(iface_watch_snapshot) {
+#ifdef __linux__
+  uv_interface_address_t* expected;
+  uv_interface_address_t* addrs;
+  uv_os_fd_t fd;
+  int nexpected;
+  int count;
+  int i;
+  int j;
+
+  ASSERT(0 == uv_iface_watch_init(uv_default_loop(), &watch_handle));
+  ASSERT(UV_EINVAL == uv_iface_watch_addresses(&watch_handle, &addrs, &count));
+  ASSERT(UV_EINVAL == uv_iface_watch_start(&watch_handle, NULL));
+  ASSERT(0 == uv_iface_watch_start(&watch_handle, watch_cb));
+  ASSERT(UV_EBUSY == uv_iface_watch_start(&watch_handle, watch_cb));
+  ASSERT(0 == uv_fileno((uv_handle_t*) &watch_handle, &fd));
+
+  ASSERT(0 == uv_interface_addresses(&expected, &nexpected));
+  ASSERT(0 == uv_iface_watch_addresses(&watch_handle, &addrs, &count));
+  ASSERT(count == nexpected);
+
+  for (i = 0; i < nexpected; i++) {
+    j = find_address(addrs, count, expected + i);
+    ASSERT(j >= 0);
+    ASSERT(0 == strcmp(addrs[j].name, expected[i].name));
+    ASSERT(addrs[j].is_internal == expected[i].is_internal);
+    if (expected[i].address.address4.sin_family == AF_INET6) {
+      ASSERT(0 == memcmp(&addrs[j].netmask.netmask6.sin6_addr,
+                         &expected[i].netmask.netmask6.sin6_addr,
+                         16));
+      ASSERT(addrs[j].address.address6.sin6_scope_id ==
+             expected[i].address.address6.sin6_scope_id);
+    } else {
+      ASSERT(addrs[j].netmask.netmask4.sin_addr.s_addr ==
+             expected[i].netmask.netmask4.sin_addr.s_addr);
+    }
+  }
+
+  uv_free_interface_addresses(expected, nexpected);
+  uv_free_interface_addresses(addrs, count);
+
+  ASSERT(0 == uv_iface_watch_stop(&watch_handle));
+  ASSERT(UV_EINVAL == uv_iface_watch_addresses(&watch_handle, &addrs, &count));
+  uv_close((uv_handle_t*) &watch_handle, NULL);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#else
+  RETURN_SKIP("Linux only test");
+#endif
+}
+
+
+TEST_IMPL(iface_watch_events) {
+#ifdef __linux__
+  int r;
+
+  alias_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT(alias_fd >= 0);
+
+  ASSERT(0 == uv_iface_watch_init(uv_default_loop(), &watch_handle));
+  ASSERT(0 == uv_iface_watch_start(&watch_handle, watch_cb));
+
+  r = alias_set(1);
+  if (r == -EPERM || r == -EACCES) {
+    uv_close((uv_handle_t*) &watch_handle, NULL);
+    ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+    ASSERT(0 == close(alias_fd));
+    RETURN_SKIP("Adding an address needs CAP_NET_ADMIN");
+  }
+  ASSERT(r == 0);
+
+  ASSERT(0 == uv_timer_init(uv_default_loop(), &timeout_handle));
+  ASSERT(0 == uv_timer_start(&timeout_handle, timeout_cb, 5000, 0));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(added_cb_called == 1);
+  ASSERT(removed_cb_called == 1);
+  ASSERT(0 == close(alias_fd));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#else
+  RETURN_SKIP("Linux only test");
+#endif
+}
@@ -0,0 +1,200 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+TEST_IMPL(io_stats_stream) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <sys/socket.h>
+
+/* 比socketpair的缓冲区大得多，写请求一定要在写队列里等 */
+#define DATA_SIZE (4 * 1024 * 1024)
+
+static uv_pipe_t writer;
+static uv_pipe_t reader;
+static uv_write_t write_req;
+static char* data;
+static size_t nread_total;
+static int write_cb_called;
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[65536];
+  *buf = uv_buf_init(slab, sizeof(slab));
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  write_cb_called++;
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  ASSERT(nread >= 0);
+  nread_total += nread;
+  if (nread_total == DATA_SIZE) {
+    uv_close((uv_handle_t*) &writer, NULL);
+    uv_close((uv_handle_t*) &reader, NULL);
+  }
+}
+
+
+TEST_IMPL(io_stats_stream) {
+  uv_io_stats_t stats;
+  uv_timer_t timer;
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  int fds[2];
+  int r;
+
+  loop = uv_default_loop();
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &writer, 0));
+  ASSERT(0 == uv_pipe_open(&writer, fds[0]));
+  ASSERT(0 == uv_pipe_init(loop, &reader, 0));
+  ASSERT(0 == uv_pipe_open(&reader, fds[1]));
+
+  r = uv_io_stats((uv_handle_t*) &writer, &stats);
+  if (r == UV_ENOSYS)
+    RETURN_SKIP("libuv was built with UV_DISABLE_IO_STATS.");
+  ASSERT(r == 0);
+  ASSERT(stats.bytes_written == 0);
+  ASSERT(stats.write_syscalls == 0);
+
+  /* 只支持流和UDP */
+  ASSERT(0 == uv_timer_init(loop, &timer));
+  ASSERT(UV_EINVAL == uv_io_stats((uv_handle_t*) &timer, &stats));
+  uv_close((uv_handle_t*) &timer, NULL);
+
+  data = calloc(1, DATA_SIZE);
+  ASSERT(data != NULL);
+  buf = uv_buf_init(data, DATA_SIZE);
+  ASSERT(0 == uv_write(&write_req, (uv_stream_t*) &writer, &buf, 1, write_cb));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &reader, alloc_cb, read_cb));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(write_cb_called == 1);
+  ASSERT(nread_total == DATA_SIZE);
+
+  ASSERT(0 == uv_io_stats((uv_handle_t*) &writer, &stats));
+  ASSERT(stats.bytes_written == DATA_SIZE);
+  /* 写不完的时候内核通常是只收下一部分，不一定会返回EAGAIN */
+  ASSERT(stats.write_syscalls >= 2);
+  ASSERT(stats.write_queued == 1);
+  ASSERT(stats.write_queue_time > 0);
+  ASSERT(stats.bytes_read == 0);
+  ASSERT(stats.read_syscalls == 0);
+
+  ASSERT(0 == uv_io_stats((uv_handle_t*) &reader, &stats));
+  ASSERT(stats.bytes_read == DATA_SIZE);
+  ASSERT(stats.read_syscalls >= DATA_SIZE / 65536);
+  ASSERT(stats.bytes_written == 0);
+  ASSERT(stats.write_queued == 0);
+
+  free(data);
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
+
+
+static uv_udp_t udp;
+static uv_udp_send_t send_req;
+static int recv_cb_called;
+
+
+static void udp_alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[65536];
+  *buf = uv_buf_init(slab, sizeof(slab));
+}
+
+
+static void udp_send_cb(uv_udp_send_t* req, int status) {
+  ASSERT(status == 0);
+}
+
+
+static void udp_recv_cb(uv_udp_t* handle,
+                        ssize_t nread,
+                        const uv_buf_t* buf,
+                        const struct sockaddr* addr,
+                        unsigned flags) {
+  if (nread == 0)
+    return;
+
+  ASSERT(nread == 4);
+  ASSERT(0 == memcmp(buf->base, "PING", 4));
+  recv_cb_called++;
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+TEST_IMPL(io_stats_udp) {
+  struct sockaddr_in addr;
+  uv_io_stats_t stats;
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  int r;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_udp_init(loop, &udp));
+
+  r = uv_io_stats((uv_handle_t*) &udp, &stats);
+  if (r == UV_ENOSYS)
+    RETURN_SKIP("libuv was built with UV_DISABLE_IO_STATS.");
+  ASSERT(r == 0);
+
+  ASSERT(0 == uv_udp_bind(&udp, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_udp_recv_start(&udp, udp_alloc_cb, udp_recv_cb));
+
+  buf = uv_buf_init("PING", 4);
+  ASSERT(0 == uv_udp_send(&send_req,
+                          &udp,
+                          &buf,
+                          1,
+                          (const struct sockaddr*) &addr,
+                          udp_send_cb));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(recv_cb_called == 1);
+
+  ASSERT(0 == uv_io_stats((uv_handle_t*) &udp, &stats));
+  ASSERT(stats.bytes_written == 4);
+  ASSERT(stats.write_syscalls >= 1);
+  ASSERT(stats.bytes_read == 4);
+  ASSERT(stats.read_syscalls >= 1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -0,0 +1,276 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+# include <sys/socket.h>
+# include <unistd.h>
+#endif
+
+static uv_buf_pool_t buf_pool;
+static uv_iobuf_t chain;
+static uv_pipe_t pipe_in;
+static uv_pipe_t pipe_out;
+static uv_write_t write_req;
+static uv_udp_t server;
+static uv_udp_t client;
+static uv_udp_send_t send_req;
+static int freed;
+static int write_cb_called;
+static int send_cb_called;
+static int nrecvs;
+
+
+static void free_cb(uv_shared_buf_t* buf) {
+  freed++;
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  /* The request dropped its references before the callback. */
+  ASSERT(buf_pool.nused == 0);
+  write_cb_called++;
+  uv_close((uv_handle_t*) req->handle, NULL);
+}
+
+
+static void read_cb(uv_stream_t* stream,
+                    ssize_t nread,
+                    const uv_buf_t* buf,
+                    uv_shared_buf_t* owner) {
+  if (nread == UV_EOF) {
+    uv_close((uv_handle_t*) stream, NULL);
+    ASSERT(0 == uv_write_iobuf(&write_req,
+                               (uv_stream_t*) &pipe_out,
+                               &chain,
+                               write_cb));
+    /* The write request holds its own references. */
+    uv_iobuf_reset(&chain);
+    ASSERT(buf_pool.nused > 0);
+    return;
+  }
+
+  ASSERT(nread >= 0);
+  ASSERT(owner != NULL);
+  ASSERT(buf->base >= owner->base);
+  ASSERT(buf->base + buf->len <= owner->base + owner->len);
+  ASSERT(0 == uv_iobuf_append(&chain, owner, buf->base, nread));
+}
+
+
+static void send_cb(uv_udp_send_t* req, int status) {
+  ASSERT(status == 0);
+  send_cb_called++;
+}
+
+
+static void recv_cb(uv_udp_t* handle,
+                    ssize_t nread,
+                    const uv_buf_t* buf,
+                    uv_shared_buf_t* owner,
+                    const struct sockaddr* addr,
+                    unsigned int flags) {
+  ASSERT(nread >= 0);
+  if (nread == 0)
+    return;
+
+  ASSERT(nread == 4);
+  ASSERT(owner != NULL);
+  ASSERT(0 == memcmp(buf->base, "NGPI", 4));
+  nrecvs++;
+  uv_close((uv_handle_t*) handle, NULL);
+  uv_close((uv_handle_t*) &client, NULL);
+}
+
+
+TEST_IMPL(iobuf) {
+  uv_shared_buf_t a;
+  uv_shared_buf_t b;
+  uv_iobuf_t slice;
+  char adata[] = "hello, ";
+  char bdata[] = "world";
+  char out[16];
+  int i;
+
+  uv_shared_buf_init(&a, adata, 7, free_cb);
+  uv_shared_buf_init(&b, bdata, 5, free_cb);
+  uv_iobuf_init(&chain);
+
+  /* Contiguous slices of the same owner merge into one entry. */
+  ASSERT(0 == uv_iobuf_append(&chain, &a, adata, 3));
+  ASSERT(0 == uv_iobuf_append(&chain, &a, adata + 3, 4));
+  ASSERT(0 == uv_iobuf_append(&chain, &b, bdata, 5));
+  ASSERT(chain.nbufs == 2);
+  ASSERT(chain.len == 12);
+  ASSERT(a.refcount == 2);
+  ASSERT(b.refcount == 2);
+  ASSERT(UV_EINVAL == uv_iobuf_append(&chain, &b, bdata + 3, 3));
+
+  ASSERT(12 == uv_iobuf_copyout(&chain, 0, out, sizeof(out)));
+  ASSERT(0 == memcmp(out, "hello, world", 12));
+  ASSERT(4 == uv_iobuf_copyout(&chain, 5, out, 4));
+  ASSERT(0 == memcmp(out, ", wo", 4));
+
+  /* A sub-range shares the owners instead of copying. */
+  uv_iobuf_init(&slice);
+  ASSERT(0 == uv_iobuf_append_iobuf(&slice, &chain, 4, 5));
+  ASSERT(slice.nbufs == 2);
+  ASSERT(a.refcount == 3);
+  ASSERT(b.refcount == 3);
+  ASSERT(UV_EINVAL == uv_iobuf_append_iobuf(&slice, &chain, 10, 3));
+
+  uv_iobuf_consume(&chain, 8);
+  ASSERT(chain.nbufs == 1);
+  ASSERT(chain.len == 4);
+  ASSERT(a.refcount == 2);
+  ASSERT(4 == uv_iobuf_copyout(&chain, 0, out, sizeof(out)));
+  ASSERT(0 == memcmp(out, "orld", 4));
+
+  /* Grow past the inline array. */
+  for (i = 0; i < 16; i++) {
+    if (i % 2)
+      ASSERT(0 == uv_iobuf_append(&slice, &a, adata, 1));
+    else
+      ASSERT(0 == uv_iobuf_append(&slice, &b, bdata, 1));
+  }
+  ASSERT(slice.nbufs == 18);
+  ASSERT(slice.len == 21);
+
+  uv_iobuf_reset(&chain);
+  uv_iobuf_reset(&slice);
+  ASSERT(chain.nbufs == 0);
+  ASSERT(a.refcount == 1);
+  ASSERT(b.refcount == 1);
+  ASSERT(freed == 0);
+
+  uv_shared_buf_unref(&a);
+  uv_shared_buf_unref(&b);
+  ASSERT(freed == 2);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(iobuf_read_write) {
+#ifdef _WIN32
+  RETURN_SKIP("Test not implemented on Windows.");
+#else
+  static const char* parts[] = { "zero-", "copy-", "relay" };
+  uv_loop_t* loop;
+  char out[32];
+  int in_fds[2];
+  int out_fds[2];
+  int i;
+
+  loop = uv_default_loop();
+  uv_iobuf_init(&chain);
+  ASSERT(0 == uv_buf_pool_init(&buf_pool, 4096, 4));
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, in_fds));
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, out_fds));
+  ASSERT(0 == uv_pipe_init(loop, &pipe_in, 0));
+  ASSERT(0 == uv_pipe_open(&pipe_in, in_fds[0]));
+  ASSERT(0 == uv_pipe_init(loop, &pipe_out, 0));
+  ASSERT(0 == uv_pipe_open(&pipe_out, out_fds[0]));
+  ASSERT(UV_EINVAL == uv_read_start_iobuf((uv_stream_t*) &pipe_in,
+                                          NULL,
+                                          read_cb));
+  ASSERT(0 == uv_read_start_iobuf((uv_stream_t*) &pipe_in,
+                                  &buf_pool,
+                                  read_cb));
+
+  /* Each write becomes its own read and its own pool buffer. */
+  for (i = 0; i < 3; i++) {
+    ASSERT(5 == write(in_fds[1], parts[i], 5));
+    uv_run(loop, UV_RUN_ONCE);
+  }
+  ASSERT(chain.len == 15);
+  ASSERT(0 == close(in_fds[1]));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(write_cb_called == 1);
+
+  ASSERT(15 == read(out_fds[1], out, sizeof(out)));
+  ASSERT(0 == memcmp(out, "zero-copy-relay", 15));
+  ASSERT(0 == close(out_fds[1]));
+
+  ASSERT(buf_pool.nused == 0);
+  ASSERT(0 == uv_buf_pool_destroy(&buf_pool));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#endif
+}
+
+
+TEST_IMPL(iobuf_udp) {
+  struct sockaddr_in addr;
+  uv_shared_buf_t msg;
+  uv_iobuf_t empty;
+  uv_loop_t* loop;
+  char data[] = "PING";
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_buf_pool_init(&buf_pool, 2048, 4));
+  ASSERT(0 == uv_udp_init(loop, &server));
+  ASSERT(0 == uv_udp_bind(&server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_udp_recv_start_iobuf(&server, &buf_pool, recv_cb));
+
+  /* Two slices of one owner, sent as a single datagram. */
+  uv_shared_buf_init(&msg, data, 4, free_cb);
+  uv_iobuf_init(&chain);
+  ASSERT(0 == uv_iobuf_append(&chain, &msg, data + 2, 2));
+  ASSERT(0 == uv_iobuf_append(&chain, &msg, data, 2));
+  ASSERT(chain.nbufs == 2);
+
+  ASSERT(0 == uv_udp_init(loop, &client));
+  uv_iobuf_init(&empty);
+  ASSERT(UV_EINVAL == uv_udp_send_iobuf(&send_req,
+                                        &client,
+                                        &empty,
+                                        (const struct sockaddr*) &addr,
+                                        send_cb));
+  ASSERT(0 == uv_udp_send_iobuf(&send_req,
+                                &client,
+                                &chain,
+                                (const struct sockaddr*) &addr,
+                                send_cb));
+  uv_iobuf_reset(&chain);
+  ASSERT(msg.refcount == 2);
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(send_cb_called == 1);
+  ASSERT(nrecvs == 1);
+  ASSERT(msg.refcount == 1);
+
+  ASSERT(buf_pool.nused == 0);
+  ASSERT(0 == uv_buf_pool_destroy(&buf_pool));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -44,3 +44,67 @@ TEST_IMPL(ip4_addr) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+TEST_IMPL(inet_batch) {
+  static const char* const src4[] = {
+    "0.0.0.0", "1.2.3.4", "255.255.255.255", "10.0.10.100",
+    "01.2.3.4", "1.2.3.", ".1.2.3", "1..2.3", "1.2.3.4.5", "", "1.2.3.4 "
+  };
+  static const char* const src6[] = {
+    "::", "::1", "fe80::1%lo", "::ffff:1.2.3.4", "1:2:3:4:5:6:7:8", ":::"
+  };
+  static const char* const out6[] = {
+    "::", "::1", "fe80::1", "::ffff:1.2.3.4", "1:2:3:4:5:6:7:8"
+  };
+  struct in6_addr addr6[ARRAY_SIZE(src6)];
+  struct in_addr addr4[ARRAY_SIZE(src4)];
+  unsigned char bytes[4];
+  char expected[16];
+  char names[ARRAY_SIZE(src6)][64];
+  int status[ARRAY_SIZE(src6) > ARRAY_SIZE(src4) ?
+             ARRAY_SIZE(src6) : ARRAY_SIZE(src4)];
+  unsigned int i;
+
+  ASSERT(4 == uv_inet_pton_batch(AF_INET, src4, addr4, status,
+                                 ARRAY_SIZE(src4)));
+  for (i = 0; i < ARRAY_SIZE(src4); i++)
+    ASSERT(status[i] == (i < 4 ? 0 : UV_EINVAL));
+  ASSERT(0 == uv_inet_ntop_batch(AF_INET, addr4, names[0], sizeof(names[0]),
+                                 4));
+  for (i = 0; i < 4; i++)
+    ASSERT(0 == strcmp(names[i], src4[i]));
+
+  ASSERT(5 == uv_inet_pton_batch(AF_INET6, src6, addr6, NULL,
+                                 ARRAY_SIZE(src6)));
+  ASSERT(0 == uv_inet_ntop_batch(AF_INET6, addr6, names[0], sizeof(names[0]),
+                                 5));
+  for (i = 0; i < 5; i++)
+    ASSERT(0 == strcmp(names[i], out6[i]));
+
+  ASSERT(UV_ENOSPC == uv_inet_ntop_batch(AF_INET, addr4, names[0], 15, 1));
+  ASSERT(UV_ENOSPC == uv_inet_ntop_batch(AF_INET6, addr6, names[0], 45, 1));
+  ASSERT(UV_EAFNOSUPPORT == uv_inet_pton_batch(42, src4, addr4, NULL, 1));
+
+  /* The formatter agrees with printf() for every octet value. */
+  for (i = 0; i < 256; i++) {
+    bytes[0] = i;
+    bytes[1] = 255 - i;
+    bytes[2] = i / 16;
+    bytes[3] = i % 100;
+    snprintf(expected, sizeof(expected), "%u.%u.%u.%u",
+             bytes[0], bytes[1], bytes[2], bytes[3]);
+    ASSERT(0 == uv_inet_ntop(AF_INET, bytes, names[0], sizeof(names[0])));
+    ASSERT(0 == strcmp(names[0], expected));
+    ASSERT(0 == uv_inet_pton(AF_INET, expected, bytes));
+    ASSERT(bytes[0] == i);
+  }
+
+  /* Exactly enough room for the terminating nul. */
+  ASSERT(0 == uv_inet_pton(AF_INET, "255.255.255.255", bytes));
+  ASSERT(UV_ENOSPC == uv_inet_ntop(AF_INET, bytes, names[0], 15));
+  ASSERT(0 == uv_inet_ntop(AF_INET, bytes, names[0], 16));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -25,6 +25,10 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifndef _WIN32
+# include <sys/socket.h>
+#endif
+
 /* See test-ipc.c */
 void spawn_helper(uv_pipe_t* channel,
                   uv_process_t* process,
@@ -431,3 +435,108 @@ void ipc_send_recv_helper_threadproc(void* arg) {
   r = uv_loop_close(&loop);
   ASSERT(r == 0);
 }
+
+
+#ifndef _WIN32
+#define BATCH_HANDLES 200
+
+static uv_pipe_t batch_channels[2];
+static uv_tcp_t batch_send[BATCH_HANDLES];
+static uv_tcp_t batch_recv[BATCH_HANDLES];
+static uv_write_t batch_write_req;
+static int batch_read_cb_called;
+static int batch_write_cb_called;
+
+
+static void batch_write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  ASSERT(req->send_handle == (uv_stream_t*) &batch_send[0]);
+  batch_write_cb_called++;
+}
+
+
+/* 一次读就收到了所有的handle */
+static void batch_read_cb(uv_stream_t* handle,
+                          ssize_t nread,
+                          const uv_buf_t* buf) {
+  uv_pipe_t* pipe;
+  int i;
+
+  ASSERT(nread == 1);
+  batch_read_cb_called++;
+
+  pipe = (uv_pipe_t*) handle;
+  ASSERT(BATCH_HANDLES == uv_pipe_pending_count(pipe));
+
+  for (i = 0; i < BATCH_HANDLES; i++) {
+    ASSERT(UV_TCP == uv_pipe_pending_type(pipe));
+    ASSERT(0 == uv_tcp_init(handle->loop, &batch_recv[i]));
+    ASSERT(0 == uv_accept(handle, (uv_stream_t*) &batch_recv[i]));
+    uv_close((uv_handle_t*) &batch_recv[i], NULL);
+  }
+  ASSERT(0 == uv_pipe_pending_count(pipe));
+
+  uv_close((uv_handle_t*) &batch_channels[0], NULL);
+  uv_close((uv_handle_t*) &batch_channels[1], NULL);
+}
+
+
+TEST_IMPL(ipc_send_recv_batch) {
+  uv_stream_t* handles[BATCH_HANDLES + 60];
+  struct sockaddr_in addr;
+  uv_buf_t buf;
+  int fds[2];
+  int i;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", 0, &addr));
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+  for (i = 0; i < 2; i++) {
+    ASSERT(0 == uv_pipe_init(uv_default_loop(), &batch_channels[i], 1));
+    ASSERT(0 == uv_pipe_open(&batch_channels[i], fds[i]));
+  }
+
+  for (i = 0; i < BATCH_HANDLES; i++) {
+    ASSERT(0 == uv_tcp_init(uv_default_loop(), &batch_send[i]));
+    ASSERT(0 == uv_tcp_bind(&batch_send[i],
+                            (const struct sockaddr*) &addr,
+                            0));
+    handles[i] = (uv_stream_t*) &batch_send[i];
+  }
+
+  buf = uv_buf_init("x", 1);
+
+  /* 超过一条消息能带的个数 */
+  for (i = BATCH_HANDLES; i < (int) ARRAY_SIZE(handles); i++)
+    handles[i] = handles[0];
+  ASSERT(UV_EINVAL == uv_write2_handles(&batch_write_req,
+                                        (uv_stream_t*) &batch_channels[0],
+                                        &buf,
+                                        1,
+                                        handles,
+                                        ARRAY_SIZE(handles),
+                                        batch_write_cb));
+
+  ASSERT(0 == uv_write2_handles(&batch_write_req,
+                                (uv_stream_t*) &batch_channels[0],
+                                &buf,
+                                1,
+                                handles,
+                                BATCH_HANDLES,
+                                batch_write_cb));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &batch_channels[1],
+                            alloc_cb,
+                            batch_read_cb));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(batch_write_cb_called == 1);
+  ASSERT(batch_read_cb_called == 1);
+
+  for (i = 0; i < BATCH_HANDLES; i++)
+    uv_close((uv_handle_t*) &batch_send[i], NULL);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+#endif  /* !_WIN32 */
@@ -22,22 +22,56 @@
 #include "uv.h"
 
 TEST_DECLARE   (platform_output)
+TEST_DECLARE   (platform_cpu_times)
+TEST_DECLARE   (platform_memory_stats)
 TEST_DECLARE   (callback_order)
 TEST_DECLARE   (close_order)
+TEST_DECLARE   (close_many)
 TEST_DECLARE   (run_once)
 TEST_DECLARE   (run_nowait)
 TEST_DECLARE   (loop_alive)
 TEST_DECLARE   (loop_close)
+TEST_DECLARE   (loop_init_lazy)
 TEST_DECLARE   (loop_instant_close)
 TEST_DECLARE   (loop_stop)
 TEST_DECLARE   (loop_update_time)
 TEST_DECLARE   (loop_backend_timeout)
 TEST_DECLARE   (loop_configure)
+TEST_DECLARE   (loop_configure_io_uring)
+TEST_DECLARE   (loop_configure_io_uring_accept)
+TEST_DECLARE   (loop_configure_max_events)
+TEST_DECLARE   (loop_configure_spin)
+TEST_DECLARE   (loop_configure_arena)
+TEST_DECLARE   (loop_configure_sparse_watchers)
+TEST_DECLARE   (loop_configure_poll_budget)
+TEST_DECLARE   (loop_configure_edge_triggered)
+TEST_DECLARE   (loop_configure_perf_counters)
+TEST_DECLARE   (loop_configure_recv_ring)
+TEST_DECLARE   (loop_configure_hugepages)
+TEST_DECLARE   (metrics_info)
+TEST_DECLARE   (metrics_io)
+TEST_DECLARE   (metrics_poll_count_iouring)
+TEST_DECLARE   (metrics_phase_histogram)
+TEST_DECLARE   (metrics_phase_percentile)
+TEST_DECLARE   (metrics_loop_lag)
+TEST_DECLARE   (metrics_mem_stats)
+TEST_DECLARE   (watchdog_timer)
+TEST_DECLARE   (watchdog_io)
+TEST_DECLARE   (watchdog_work)
+TEST_DECLARE   (watchdog_nested)
+TEST_DECLARE   (loop_dispatch_info)
 TEST_DECLARE   (default_loop_close)
 TEST_DECLARE   (barrier_1)
 TEST_DECLARE   (barrier_2)
 TEST_DECLARE   (barrier_3)
 TEST_DECLARE   (buf_large)
+TEST_DECLARE   (buf_pool)
+TEST_DECLARE   (buf_pool_hugepages)
+TEST_DECLARE   (buf_pool_read)
+TEST_DECLARE   (buf_pool_udp_recv)
+TEST_DECLARE   (iobuf)
+TEST_DECLARE   (iobuf_read_write)
+TEST_DECLARE   (iobuf_udp)
 TEST_DECLARE   (barrier_serial_thread)
 TEST_DECLARE   (barrier_serial_thread_single)
 TEST_DECLARE   (condvar_1)
@@ -48,6 +82,7 @@ TEST_DECLARE   (condvar_5)
 TEST_DECLARE   (semaphore_1)
 TEST_DECLARE   (semaphore_2)
 TEST_DECLARE   (semaphore_3)
+TEST_DECLARE   (semaphore_4)
 TEST_DECLARE   (tty)
 #ifdef _WIN32
 TEST_DECLARE   (tty_raw)
@@ -57,6 +92,7 @@ TEST_DECLARE   (tty_raw_cancel)
 #endif
 TEST_DECLARE   (tty_file)
 TEST_DECLARE   (tty_pty)
+TEST_DECLARE   (tty_buffered_write)
 TEST_DECLARE   (stdio_over_pipes)
 TEST_DECLARE   (ip6_pton)
 #ifndef _WIN32
@@ -75,6 +111,8 @@ TEST_DECLARE   (ipc_send_recv_tcp_inprocess)
 TEST_DECLARE   (ipc_tcp_connection)
 #ifndef _WIN32
 TEST_DECLARE   (ipc_closed_handle)
+TEST_DECLARE   (ipc_send_recv_batch)
+TEST_DECLARE   (shm_channel)
 #endif
 TEST_DECLARE   (tcp_alloc_cb_fail)
 TEST_DECLARE   (tcp_ping_pong)
@@ -92,7 +130,22 @@ TEST_DECLARE   (tcp_writealot)
 TEST_DECLARE   (tcp_write_fail)
 TEST_DECLARE   (tcp_try_write)
 TEST_DECLARE   (tcp_write_queue_order)
+TEST_DECLARE   (tcp_write_zerocopy)
+TEST_DECLARE   (tcp_notsent_lowat)
+TEST_DECLARE   (tcp_accept_burst)
+TEST_DECLARE   (tcp_accept_burst_one_by_one)
+TEST_DECLARE   (tcp_admission_max_connections)
+TEST_DECLARE   (tcp_admission_lag)
+TEST_DECLARE   (tcp_defer_accept)
+TEST_DECLARE   (tcp_fastopen)
+TEST_DECLARE   (tcp_ktls)
+TEST_DECLARE   (tcp_get_info)
+TEST_DECLARE   (tcp_connect_host)
+TEST_DECLARE   (tcp_connect_host_error)
+TEST_DECLARE   (tcp_connect_host_close)
 TEST_DECLARE   (tcp_open)
+TEST_DECLARE   (tcp_migrate)
+TEST_DECLARE   (tcp_migrate_recv_ring)
 TEST_DECLARE   (tcp_open_twice)
 TEST_DECLARE   (tcp_open_bound)
 TEST_DECLARE   (tcp_open_connected)
@@ -106,11 +159,14 @@ TEST_DECLARE   (tcp_bind_error_inval)
 TEST_DECLARE   (tcp_bind_localhost_ok)
 TEST_DECLARE   (tcp_bind_invalid_flags)
 TEST_DECLARE   (tcp_bind_writable_flags)
+TEST_DECLARE   (tcp_reuseport)
 TEST_DECLARE   (tcp_listen_without_bind)
 TEST_DECLARE   (tcp_connect_error_fault)
 TEST_DECLARE   (tcp_connect_timeout)
 TEST_DECLARE   (tcp_close_while_connecting)
 TEST_DECLARE   (tcp_close)
+TEST_DECLARE   (tcp_close_reset_client)
+TEST_DECLARE   (tcp_close_reset_after_shutdown)
 TEST_DECLARE   (tcp_create_early)
 TEST_DECLARE   (tcp_create_early_bad_bind)
 TEST_DECLARE   (tcp_create_early_bad_domain)
@@ -132,6 +188,7 @@ TEST_DECLARE   (tcp_write_ready)
 TEST_DECLARE   (udp_alloc_cb_fail)
 TEST_DECLARE   (udp_bind)
 TEST_DECLARE   (udp_bind_reuseaddr)
+TEST_DECLARE   (udp_bind_reuseport)
 TEST_DECLARE   (udp_connect)
 TEST_DECLARE   (udp_create_early)
 TEST_DECLARE   (udp_create_early_bad_bind)
@@ -139,8 +196,17 @@ TEST_DECLARE   (udp_create_early_bad_domain)
 TEST_DECLARE   (udp_send_and_recv)
 TEST_DECLARE   (udp_send_hang_loop)
 TEST_DECLARE   (udp_send_immediate)
+TEST_DECLARE   (udp_send_queue_limit)
+TEST_DECLARE   (udp_send_watermarks)
+TEST_DECLARE   (udp_send_txtime)
+TEST_DECLARE   (udp_send_zerocopy)
 TEST_DECLARE   (udp_send_unreachable)
 TEST_DECLARE   (udp_multicast_join)
+TEST_DECLARE   (udp_mmsg)
+TEST_DECLARE   (udp_send_batch)
+TEST_DECLARE   (udp_gso)
+TEST_DECLARE   (udp_gro)
+TEST_DECLARE   (udp_recv_info)
 TEST_DECLARE   (udp_multicast_join6)
 TEST_DECLARE   (udp_multicast_ttl)
 TEST_DECLARE   (udp_multicast_interface)
@@ -156,6 +222,9 @@ TEST_DECLARE   (udp_open_twice)
 TEST_DECLARE   (udp_open_bound)
 TEST_DECLARE   (udp_open_connect)
 TEST_DECLARE   (udp_try_send)
+TEST_DECLARE   (udp_try_send_batch)
+TEST_DECLARE   (xdp_bind)
+TEST_DECLARE   (xdp_bind_no_device)
 TEST_DECLARE   (pipe_bind_error_addrinuse)
 TEST_DECLARE   (pipe_bind_error_addrnotavail)
 TEST_DECLARE   (pipe_bind_error_inval)
@@ -174,7 +243,10 @@ TEST_DECLARE   (pipe_getsockname)
 TEST_DECLARE   (pipe_getsockname_abstract)
 TEST_DECLARE   (pipe_getsockname_blocking)
 TEST_DECLARE   (pipe_pending_instances)
+TEST_DECLARE   (pipe_pool)
 TEST_DECLARE   (pipe_sendmsg)
+TEST_DECLARE   (pipe_seqpacket)
+TEST_DECLARE   (pipe_read_stop_pending_write)
 TEST_DECLARE   (pipe_server_close)
 TEST_DECLARE   (connection_fail)
 TEST_DECLARE   (connection_fail_doesnt_auto_close)
@@ -197,13 +269,23 @@ TEST_DECLARE   (timer_run_once)
 TEST_DECLARE   (timer_from_check)
 TEST_DECLARE   (timer_null_callback)
 TEST_DECLARE   (timer_early_check)
+TEST_DECLARE   (timer_wheel)
+TEST_DECLARE   (timer_start_ex)
+TEST_DECLARE   (timer_heap_order)
+TEST_DECLARE   (timer_start_ns)
+TEST_DECLARE   (timer_start_ns_only)
 TEST_DECLARE   (idle_starvation)
 TEST_DECLARE   (loop_handles)
+TEST_DECLARE   (loop_dump_handles)
 TEST_DECLARE   (get_loadavg)
 TEST_DECLARE   (walk_handles)
 TEST_DECLARE   (watcher_cross_stop)
 TEST_DECLARE   (ref)
 TEST_DECLARE   (idle_ref)
+TEST_DECLARE   (iface_watch_snapshot)
+TEST_DECLARE   (iface_watch_events)
+TEST_DECLARE   (loop_watcher_priority)
+TEST_DECLARE   (check_start_once)
 TEST_DECLARE   (async_ref)
 TEST_DECLARE   (prepare_ref)
 TEST_DECLARE   (check_ref)
@@ -228,18 +310,51 @@ TEST_DECLARE   (pipe_ref4)
 TEST_DECLARE   (pipe_close_stdout_read_stdin)
 #endif
 TEST_DECLARE   (pipe_set_non_blocking)
+TEST_DECLARE   (pipe_read_size_hint)
+TEST_DECLARE   (pipe_read_budget)
+TEST_DECLARE   (stream_cork)
+TEST_DECLARE   (io_stats_stream)
+TEST_DECLARE   (io_stats_udp)
+TEST_DECLARE   (stream_sendfile)
+TEST_DECLARE   (stream_splice)
+TEST_DECLARE   (stream_splice_close)
+TEST_DECLARE   (stream_write_watermarks)
+TEST_DECLARE   (stream_timeouts_read)
+TEST_DECLARE   (stream_timeouts_write)
+TEST_DECLARE   (stream_write_bufs)
+TEST_DECLARE   (stream_write_batch)
+TEST_DECLARE   (write_broadcast)
+TEST_DECLARE   (read_iov)
+TEST_DECLARE   (read_batch)
+TEST_DECLARE   (rate_limit_stream)
+TEST_DECLARE   (rate_limit_read)
+TEST_DECLARE   (rate_limit_udp)
 TEST_DECLARE   (pipe_set_chmod)
 TEST_DECLARE   (process_ref)
 TEST_DECLARE   (process_priority)
 TEST_DECLARE   (has_ref)
 TEST_DECLARE   (active)
 TEST_DECLARE   (embed)
+TEST_DECLARE   (embed_ready)
 TEST_DECLARE   (async)
 TEST_DECLARE   (async_null_cb)
+TEST_DECLARE   (atomic_queue_spsc)
+TEST_DECLARE   (atomic_queue_mpsc)
+TEST_DECLARE   (async_pending)
+TEST_DECLARE   (async_send_data)
+TEST_DECLARE   (async_send_busy)
 TEST_DECLARE   (eintr_handling)
 TEST_DECLARE   (get_currentexe)
 TEST_DECLARE   (process_title)
 TEST_DECLARE   (process_title_threadsafe)
+#ifndef _WIN32
+TEST_DECLARE   (process_pool_basic)
+TEST_DECLARE   (process_pool_respawn)
+TEST_DECLARE   (process_pool_spawn_fail)
+#endif
+TEST_DECLARE   (runtime_post)
+TEST_DECLARE   (runtime_listen)
+TEST_DECLARE   (runtime_listen_route)
 TEST_DECLARE   (cwd_and_chdir)
 TEST_DECLARE   (get_memory)
 TEST_DECLARE   (get_passwd)
@@ -247,27 +362,39 @@ TEST_DECLARE   (handle_fileno)
 TEST_DECLARE   (homedir)
 TEST_DECLARE   (tmpdir)
 TEST_DECLARE   (hrtime)
+TEST_DECLARE   (hrtime_tsc)
 TEST_DECLARE   (getaddrinfo_fail)
 TEST_DECLARE   (getaddrinfo_fail_sync)
 TEST_DECLARE   (getaddrinfo_basic)
 TEST_DECLARE   (getaddrinfo_basic_sync)
 TEST_DECLARE   (getaddrinfo_concurrent)
+TEST_DECLARE   (getaddrinfo_cache)
+TEST_DECLARE   (getaddrinfo_resolver)
+TEST_DECLARE   (getaddrinfo_resolver_tcp)
 TEST_DECLARE   (gethostname)
 TEST_DECLARE   (getnameinfo_basic_ip4)
 TEST_DECLARE   (getnameinfo_basic_ip4_sync)
 TEST_DECLARE   (getnameinfo_basic_ip6)
+TEST_DECLARE   (getnameinfo_cache)
+TEST_DECLARE   (getnameinfo_batch)
 TEST_DECLARE   (getsockname_tcp)
 TEST_DECLARE   (getsockname_udp)
 TEST_DECLARE   (fail_always)
 TEST_DECLARE   (pass_always)
 TEST_DECLARE   (socket_buffer_size)
+TEST_DECLARE   (socket_buffer_autotune)
 TEST_DECLARE   (spawn_fails)
 #ifndef _WIN32
 TEST_DECLARE   (spawn_fails_check_for_waitpid_cleanup)
+TEST_DECLARE   (spawn_env_path)
+TEST_DECLARE   (spawn_many_exit)
 #endif
 TEST_DECLARE   (spawn_exit_code)
+TEST_DECLARE   (spawn_exit_rusage)
 TEST_DECLARE   (spawn_stdout)
 TEST_DECLARE   (spawn_stdin)
+TEST_DECLARE   (spawn_stdin_kernel_pipe)
+TEST_DECLARE   (spawn_stdio_buffer_size)
 TEST_DECLARE   (spawn_stdio_greater_than_3)
 TEST_DECLARE   (spawn_ignored_stdio)
 TEST_DECLARE   (spawn_and_kill)
@@ -291,6 +418,7 @@ TEST_DECLARE   (spawn_quoted_path)
 TEST_DECLARE   (spawn_tcp_server)
 TEST_DECLARE   (fs_poll)
 TEST_DECLARE   (fs_poll_getpath)
+TEST_DECLARE   (fs_poll_shared)
 TEST_DECLARE   (kill)
 TEST_DECLARE   (kill_invalid_signum)
 TEST_DECLARE   (fs_file_noent)
@@ -301,11 +429,13 @@ TEST_DECLARE   (fs_file_sync)
 TEST_DECLARE   (fs_file_write_null_buffer)
 TEST_DECLARE   (fs_async_dir)
 TEST_DECLARE   (fs_async_sendfile)
+TEST_DECLARE   (fs_sendfile_pipe)
 TEST_DECLARE   (fs_mkdtemp)
 TEST_DECLARE   (fs_fstat)
 TEST_DECLARE   (fs_access)
 TEST_DECLARE   (fs_chmod)
 TEST_DECLARE   (fs_copyfile)
+TEST_DECLARE   (fs_copyfile_large)
 TEST_DECLARE   (fs_unlink_readonly)
 #ifdef _WIN32
 TEST_DECLARE   (fs_unlink_archive_readonly)
@@ -326,9 +456,19 @@ TEST_DECLARE   (fs_futime)
 TEST_DECLARE   (fs_futime_ex)
 TEST_DECLARE   (fs_file_open_append)
 TEST_DECLARE   (fs_stat_missing_path)
+TEST_DECLARE   (fs_statx)
+TEST_DECLARE   (fs_batch)
+TEST_DECLARE   (fs_fsync_coalesce)
+TEST_DECLARE   (fs_mmap)
+TEST_DECLARE   (fs_stat_cache)
+TEST_DECLARE   (fs_fd_cache)
+TEST_DECLARE   (fs_at)
+TEST_DECLARE   (fs_log)
 TEST_DECLARE   (fs_read_file_eof)
 TEST_DECLARE   (fs_event_watch_dir)
 TEST_DECLARE   (fs_event_watch_dir_recursive)
+TEST_DECLARE   (fs_event_coalesce)
+TEST_DECLARE   (fs_event_fsevents_latency)
 #ifdef _WIN32
 TEST_DECLARE   (fs_event_watch_dir_short_path)
 #endif
@@ -351,8 +491,14 @@ TEST_DECLARE   (fs_event_getpath)
 TEST_DECLARE   (fs_scandir_empty_dir)
 TEST_DECLARE   (fs_scandir_non_existent_dir)
 TEST_DECLARE   (fs_scandir_file)
+TEST_DECLARE   (fs_readdir_empty_dir)
+TEST_DECLARE   (fs_readdir_file)
+TEST_DECLARE   (fs_readdir_non_empty_dir)
+TEST_DECLARE   (fs_readdir_non_existing_dir)
+TEST_DECLARE   (fs_walk)
 TEST_DECLARE   (fs_open_dir)
 TEST_DECLARE   (fs_rename_to_existing_file)
+TEST_DECLARE   (fs_async_path_copy)
 TEST_DECLARE   (fs_write_multiple_bufs)
 TEST_DECLARE   (fs_read_write_null_arguments)
 #ifdef _WIN32
@@ -364,6 +510,11 @@ TEST_DECLARE   (fs_partial_read)
 TEST_DECLARE   (fs_partial_write)
 TEST_DECLARE   (fs_file_pos_after_op_with_offset)
 TEST_DECLARE   (fs_null_req)
+TEST_DECLARE   (fs_read_nowait)
+TEST_DECLARE   (fs_o_direct)
+TEST_DECLARE   (fs_fallocate)
+TEST_DECLARE   (fs_io_uring)
+TEST_DECLARE   (fs_io_uring_fixed)
 TEST_DECLARE   (fs_read_dir)
 #ifdef _WIN32
 TEST_DECLARE   (fs_exclusive_sharing_mode)
@@ -371,9 +522,20 @@ TEST_DECLARE   (fs_open_readonly_acl)
 TEST_DECLARE   (fs_fchmod_archive_readonly)
 #endif
 TEST_DECLARE   (threadpool_queue_work_simple)
+TEST_DECLARE   (threadpool_pool)
+TEST_DECLARE   (threadpool_resize)
+TEST_DECLARE   (threadpool_on_demand)
+TEST_DECLARE   (threadpool_work_class)
+TEST_DECLARE   (threadpool_work_deadline)
+TEST_DECLARE   (threadpool_work_timeout)
+TEST_DECLARE   (threadpool_queue_work_batch)
+TEST_DECLARE   (threadpool_affinity)
+TEST_DECLARE   (threadpool_stats)
+TEST_DECLARE   (threadpool_spin)
 TEST_DECLARE   (threadpool_queue_work_einval)
 TEST_DECLARE   (threadpool_multiple_event_loops)
 TEST_DECLARE   (threadpool_cancel_getaddrinfo)
+TEST_DECLARE   (threadpool_cancel_getaddrinfo_coalesce)
 TEST_DECLARE   (threadpool_cancel_getnameinfo)
 TEST_DECLARE   (threadpool_cancel_work)
 TEST_DECLARE   (threadpool_cancel_fs)
@@ -382,11 +544,14 @@ TEST_DECLARE   (thread_local_storage)
 TEST_DECLARE   (thread_stack_size)
 TEST_DECLARE   (thread_mutex)
 TEST_DECLARE   (thread_mutex_recursive)
+TEST_DECLARE   (thread_spinlock)
 TEST_DECLARE   (thread_rwlock)
 TEST_DECLARE   (thread_rwlock_trylock)
+TEST_DECLARE   (thread_brlock)
 TEST_DECLARE   (thread_create)
 TEST_DECLARE   (thread_equal)
 TEST_DECLARE   (thread_affinity)
+TEST_DECLARE   (thread_create_ex_affinity)
 TEST_DECLARE   (dlerror)
 #if (defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))) && \
     !defined(__sun)
@@ -396,6 +561,8 @@ TEST_DECLARE   (poll_duplex)
 TEST_DECLARE   (poll_unidirectional)
 TEST_DECLARE   (poll_close)
 TEST_DECLARE   (poll_bad_fdtype)
+TEST_DECLARE   (poll_edge_triggered)
+TEST_DECLARE   (poll_batch_register)
 #ifdef __linux__
 TEST_DECLARE   (poll_nested_epoll)
 #endif
@@ -404,6 +571,7 @@ TEST_DECLARE   (poll_nested_kqueue)
 #endif
 
 TEST_DECLARE   (ip4_addr)
+TEST_DECLARE   (inet_batch)
 TEST_DECLARE   (ip6_addr_link_local)
 
 TEST_DECLARE   (poll_close_doesnt_corrupt_stack)
@@ -422,13 +590,18 @@ TEST_DECLARE   (ipc_listen_after_bind_twice)
 TEST_DECLARE   (win32_signum_number)
 #else
 TEST_DECLARE   (emfile)
+TEST_DECLARE   (emfile_backoff)
 TEST_DECLARE   (close_fd)
 TEST_DECLARE   (spawn_fs_open)
+#if defined(__linux__)
+TEST_DECLARE   (spawn_no_cloexec_fd)
+#endif
 TEST_DECLARE   (spawn_setuid_setgid)
 TEST_DECLARE   (we_get_signal)
 TEST_DECLARE   (we_get_signals)
 TEST_DECLARE   (we_get_signal_one_shot)
 TEST_DECLARE   (we_get_signals_mixed)
+TEST_DECLARE   (we_get_signals_signalfd)
 TEST_DECLARE   (signal_multiple_loops)
 TEST_DECLARE   (closed_fd_events)
 #endif
@@ -437,6 +610,7 @@ TEST_DECLARE   (osx_select)
 TEST_DECLARE   (osx_select_many_fds)
 #endif
 HELPER_DECLARE (tcp4_echo_server)
+HELPER_DECLARE (dns_server)
 HELPER_DECLARE (tcp6_echo_server)
 HELPER_DECLARE (udp4_echo_server)
 HELPER_DECLARE (pipe_echo_server)
@@ -451,6 +625,7 @@ TEST_DECLARE   (getters_setters)
 TEST_DECLARE  (fork_timer)
 TEST_DECLARE  (fork_socketpair)
 TEST_DECLARE  (fork_socketpair_started)
+TEST_DECLARE  (fork_drop_watchers)
 TEST_DECLARE  (fork_signal_to_child)
 TEST_DECLARE  (fork_signal_to_child_closed)
 TEST_DECLARE  (fork_fs_events_child)
@@ -458,33 +633,69 @@ TEST_DECLARE  (fork_fs_events_child_dir)
 TEST_DECLARE  (fork_fs_events_file_parent_child)
 #ifndef __MVS__
 TEST_DECLARE  (fork_threadpool_queue_work_simple)
+TEST_DECLARE  (fork_threadpool_senders)
 #endif
 #endif
 
 TEST_DECLARE  (idna_toascii)
+TEST_DECLARE  (idna_toascii_fast_path)
 TEST_DECLARE  (utf8_decode1)
 
 TASK_LIST_START
   TEST_ENTRY_CUSTOM (platform_output, 0, 1, 5000)
+  TEST_ENTRY  (platform_cpu_times)
+  TEST_ENTRY  (platform_memory_stats)
 
 #if 0
   TEST_ENTRY  (callback_order)
 #endif
   TEST_ENTRY  (close_order)
+  TEST_ENTRY  (close_many)
   TEST_ENTRY  (run_once)
   TEST_ENTRY  (run_nowait)
   TEST_ENTRY  (loop_alive)
   TEST_ENTRY  (loop_close)
+  TEST_ENTRY  (loop_init_lazy)
   TEST_ENTRY  (loop_instant_close)
   TEST_ENTRY  (loop_stop)
   TEST_ENTRY  (loop_update_time)
   TEST_ENTRY  (loop_backend_timeout)
   TEST_ENTRY  (loop_configure)
+  TEST_ENTRY  (loop_configure_io_uring)
+  TEST_ENTRY  (loop_configure_io_uring_accept)
+  TEST_ENTRY  (loop_configure_max_events)
+  TEST_ENTRY  (loop_configure_spin)
+  TEST_ENTRY  (loop_configure_arena)
+  TEST_ENTRY  (loop_configure_sparse_watchers)
+  TEST_ENTRY  (loop_configure_poll_budget)
+  TEST_ENTRY  (loop_configure_edge_triggered)
+  TEST_ENTRY  (loop_configure_perf_counters)
+  TEST_ENTRY  (loop_configure_recv_ring)
+  TEST_ENTRY  (loop_configure_hugepages)
+  TEST_ENTRY  (metrics_info)
+  TEST_ENTRY  (metrics_io)
+  TEST_ENTRY  (metrics_poll_count_iouring)
+  TEST_ENTRY  (metrics_phase_histogram)
+  TEST_ENTRY  (metrics_phase_percentile)
+  TEST_ENTRY  (metrics_loop_lag)
+  TEST_ENTRY  (metrics_mem_stats)
+  TEST_ENTRY  (watchdog_timer)
+  TEST_ENTRY  (watchdog_io)
+  TEST_ENTRY  (watchdog_work)
+  TEST_ENTRY  (watchdog_nested)
+  TEST_ENTRY  (loop_dispatch_info)
   TEST_ENTRY  (default_loop_close)
   TEST_ENTRY  (barrier_1)
   TEST_ENTRY  (barrier_2)
   TEST_ENTRY  (barrier_3)
   TEST_ENTRY  (buf_large)
+  TEST_ENTRY  (buf_pool)
+  TEST_ENTRY  (buf_pool_hugepages)
+  TEST_ENTRY  (buf_pool_read)
+  TEST_ENTRY  (buf_pool_udp_recv)
+  TEST_ENTRY  (iobuf)
+  TEST_ENTRY  (iobuf_read_write)
+  TEST_ENTRY  (iobuf_udp)
   TEST_ENTRY  (barrier_serial_thread)
   TEST_ENTRY  (barrier_serial_thread_single)
   TEST_ENTRY  (condvar_1)
@@ -495,6 +706,7 @@ TASK_LIST_START
   TEST_ENTRY  (semaphore_1)
   TEST_ENTRY  (semaphore_2)
   TEST_ENTRY  (semaphore_3)
+  TEST_ENTRY  (semaphore_4)
 
   TEST_ENTRY  (pipe_connect_bad_name)
   TEST_ENTRY  (pipe_connect_to_file)
@@ -508,6 +720,25 @@ TASK_LIST_START
   TEST_ENTRY  (pipe_close_stdout_read_stdin)
 #endif
   TEST_ENTRY  (pipe_set_non_blocking)
+  TEST_ENTRY  (pipe_read_size_hint)
+  TEST_ENTRY  (pipe_read_budget)
+  TEST_ENTRY  (stream_cork)
+  TEST_ENTRY  (io_stats_stream)
+  TEST_ENTRY  (io_stats_udp)
+  TEST_ENTRY  (stream_sendfile)
+  TEST_ENTRY  (stream_splice)
+  TEST_ENTRY  (stream_splice_close)
+  TEST_ENTRY  (stream_write_watermarks)
+  TEST_ENTRY  (stream_timeouts_read)
+  TEST_ENTRY  (stream_timeouts_write)
+  TEST_ENTRY  (stream_write_bufs)
+  TEST_ENTRY  (stream_write_batch)
+  TEST_ENTRY  (write_broadcast)
+  TEST_ENTRY  (read_iov)
+  TEST_ENTRY  (read_batch)
+  TEST_ENTRY  (rate_limit_stream)
+  TEST_ENTRY  (rate_limit_read)
+  TEST_ENTRY  (rate_limit_udp)
   TEST_ENTRY  (pipe_set_chmod)
   TEST_ENTRY  (tty)
 #ifdef _WIN32
@@ -518,6 +749,7 @@ TASK_LIST_START
 #endif
   TEST_ENTRY  (tty_file)
   TEST_ENTRY  (tty_pty)
+  TEST_ENTRY  (tty_buffered_write)
   TEST_ENTRY  (stdio_over_pipes)
   TEST_ENTRY  (ip6_pton)
 #ifndef _WIN32
@@ -536,6 +768,8 @@ TASK_LIST_START
   TEST_ENTRY  (ipc_tcp_connection)
 #ifndef _WIN32
   TEST_ENTRY  (ipc_closed_handle)
+  TEST_ENTRY  (ipc_send_recv_batch)
+  TEST_ENTRY  (shm_channel)
 #endif
 
   TEST_ENTRY  (tcp_alloc_cb_fail)
@@ -578,8 +812,23 @@ TASK_LIST_START
   TEST_ENTRY  (tcp_try_write)
 
   TEST_ENTRY  (tcp_write_queue_order)
+  TEST_ENTRY  (tcp_write_zerocopy)
+  TEST_ENTRY  (tcp_notsent_lowat)
+  TEST_ENTRY  (tcp_accept_burst)
+  TEST_ENTRY  (tcp_accept_burst_one_by_one)
+  TEST_ENTRY  (tcp_admission_max_connections)
+  TEST_ENTRY  (tcp_admission_lag)
+  TEST_ENTRY  (tcp_defer_accept)
+  TEST_ENTRY  (tcp_fastopen)
+  TEST_ENTRY  (tcp_ktls)
+  TEST_ENTRY  (tcp_get_info)
+  TEST_ENTRY  (tcp_connect_host)
+  TEST_ENTRY  (tcp_connect_host_error)
+  TEST_ENTRY  (tcp_connect_host_close)
 
   TEST_ENTRY  (tcp_open)
+  TEST_ENTRY  (tcp_migrate)
+  TEST_ENTRY  (tcp_migrate_recv_ring)
   TEST_HELPER (tcp_open, tcp4_echo_server)
   TEST_ENTRY  (tcp_open_twice)
   TEST_ENTRY  (tcp_open_bound)
@@ -600,11 +849,14 @@ TASK_LIST_START
   TEST_ENTRY  (tcp_bind_localhost_ok)
   TEST_ENTRY  (tcp_bind_invalid_flags)
   TEST_ENTRY  (tcp_bind_writable_flags)
+  TEST_ENTRY  (tcp_reuseport)
   TEST_ENTRY  (tcp_listen_without_bind)
   TEST_ENTRY  (tcp_connect_error_fault)
   TEST_ENTRY  (tcp_connect_timeout)
   TEST_ENTRY  (tcp_close_while_connecting)
   TEST_ENTRY  (tcp_close)
+  TEST_ENTRY  (tcp_close_reset_client)
+  TEST_ENTRY  (tcp_close_reset_after_shutdown)
   TEST_ENTRY  (tcp_create_early)
   TEST_ENTRY  (tcp_create_early_bad_bind)
   TEST_ENTRY  (tcp_create_early_bad_domain)
@@ -629,6 +881,7 @@ TASK_LIST_START
   TEST_ENTRY  (udp_alloc_cb_fail)
   TEST_ENTRY  (udp_bind)
   TEST_ENTRY  (udp_bind_reuseaddr)
+  TEST_ENTRY  (udp_bind_reuseport)
   TEST_ENTRY  (udp_connect)
   TEST_ENTRY  (udp_create_early)
   TEST_ENTRY  (udp_create_early_bad_bind)
@@ -636,6 +889,10 @@ TASK_LIST_START
   TEST_ENTRY  (udp_send_and_recv)
   TEST_ENTRY  (udp_send_hang_loop)
   TEST_ENTRY  (udp_send_immediate)
+  TEST_ENTRY  (udp_send_queue_limit)
+  TEST_ENTRY  (udp_send_watermarks)
+  TEST_ENTRY  (udp_send_txtime)
+  TEST_ENTRY  (udp_send_zerocopy)
   TEST_ENTRY  (udp_send_unreachable)
   TEST_ENTRY  (udp_dgram_too_big)
   TEST_ENTRY  (udp_dual_stack)
@@ -646,9 +903,18 @@ TASK_LIST_START
   TEST_ENTRY  (udp_multicast_interface)
   TEST_ENTRY  (udp_multicast_interface6)
   TEST_ENTRY  (udp_multicast_join)
+  TEST_ENTRY  (udp_mmsg)
+  TEST_ENTRY  (udp_send_batch)
+  TEST_ENTRY  (udp_gso)
+  TEST_ENTRY  (udp_gro)
+  TEST_ENTRY  (udp_recv_info)
   TEST_ENTRY  (udp_multicast_join6)
   TEST_ENTRY  (udp_multicast_ttl)
   TEST_ENTRY  (udp_try_send)
+  TEST_ENTRY  (udp_try_send_batch)
+
+  TEST_ENTRY  (xdp_bind)
+  TEST_ENTRY  (xdp_bind_no_device)
 
   TEST_ENTRY  (udp_open)
   TEST_HELPER (udp_open, udp4_echo_server)
@@ -669,7 +935,10 @@ TASK_LIST_START
   TEST_ENTRY  (pipe_getsockname_abstract)
   TEST_ENTRY  (pipe_getsockname_blocking)
   TEST_ENTRY  (pipe_pending_instances)
+  TEST_ENTRY  (pipe_pool)
   TEST_ENTRY  (pipe_sendmsg)
+  TEST_ENTRY  (pipe_seqpacket)
+  TEST_ENTRY  (pipe_read_stop_pending_write)
 
   TEST_ENTRY  (connection_fail)
   TEST_ENTRY  (connection_fail_doesnt_auto_close)
@@ -704,11 +973,20 @@ TASK_LIST_START
   TEST_ENTRY  (timer_from_check)
   TEST_ENTRY  (timer_null_callback)
   TEST_ENTRY  (timer_early_check)
+  TEST_ENTRY  (timer_wheel)
+  TEST_ENTRY  (timer_start_ex)
+  TEST_ENTRY  (timer_heap_order)
+  TEST_ENTRY  (timer_start_ns)
+  TEST_ENTRY  (timer_start_ns_only)
 
   TEST_ENTRY  (idle_starvation)
 
   TEST_ENTRY  (ref)
   TEST_ENTRY  (idle_ref)
+  TEST_ENTRY  (iface_watch_snapshot)
+  TEST_ENTRY  (iface_watch_events)
+  TEST_ENTRY  (loop_watcher_priority)
+  TEST_ENTRY  (check_start_once)
   TEST_ENTRY  (fs_poll_ref)
   TEST_ENTRY  (async_ref)
   TEST_ENTRY  (prepare_ref)
@@ -739,6 +1017,7 @@ TASK_LIST_START
   TEST_ENTRY  (has_ref)
 
   TEST_ENTRY  (loop_handles)
+  TEST_ENTRY  (loop_dump_handles)
   TEST_ENTRY  (walk_handles)
 
   TEST_ENTRY  (watcher_cross_stop)
@@ -746,15 +1025,29 @@ TASK_LIST_START
   TEST_ENTRY  (active)
 
   TEST_ENTRY  (embed)
+  TEST_ENTRY  (embed_ready)
 
   TEST_ENTRY  (async)
   TEST_ENTRY  (async_null_cb)
+  TEST_ENTRY  (atomic_queue_spsc)
+  TEST_ENTRY  (atomic_queue_mpsc)
+  TEST_ENTRY  (async_pending)
+  TEST_ENTRY  (async_send_data)
+  TEST_ENTRY  (async_send_busy)
   TEST_ENTRY  (eintr_handling)
 
   TEST_ENTRY  (get_currentexe)
 
   TEST_ENTRY  (process_title)
   TEST_ENTRY  (process_title_threadsafe)
+#ifndef _WIN32
+  TEST_ENTRY  (process_pool_basic)
+  TEST_ENTRY  (process_pool_respawn)
+  TEST_ENTRY  (process_pool_spawn_fail)
+#endif
+  TEST_ENTRY  (runtime_post)
+  TEST_ENTRY  (runtime_listen)
+  TEST_ENTRY  (runtime_listen_route)
 
   TEST_ENTRY  (cwd_and_chdir)
 
@@ -771,6 +1064,7 @@ TASK_LIST_START
   TEST_ENTRY  (tmpdir)
 
   TEST_ENTRY  (hrtime)
+  TEST_ENTRY  (hrtime_tsc)
 
   TEST_ENTRY_CUSTOM (getaddrinfo_fail, 0, 0, 10000)
   TEST_ENTRY_CUSTOM (getaddrinfo_fail_sync, 0, 0, 10000)
@@ -778,12 +1072,18 @@ TASK_LIST_START
   TEST_ENTRY  (getaddrinfo_basic)
   TEST_ENTRY  (getaddrinfo_basic_sync)
   TEST_ENTRY  (getaddrinfo_concurrent)
+  TEST_ENTRY_CUSTOM (getaddrinfo_cache, 0, 0, 10000)
+  TEST_ENTRY  (getaddrinfo_resolver)
+  TEST_ENTRY  (getaddrinfo_resolver_tcp)
+  TEST_HELPER (getaddrinfo_resolver_tcp, dns_server)
 
   TEST_ENTRY  (gethostname)
 
   TEST_ENTRY  (getnameinfo_basic_ip4)
   TEST_ENTRY  (getnameinfo_basic_ip4_sync)
   TEST_ENTRY  (getnameinfo_basic_ip6)
+  TEST_ENTRY  (getnameinfo_cache)
+  TEST_ENTRY  (getnameinfo_batch)
 
   TEST_ENTRY  (getsockname_tcp)
   TEST_ENTRY  (getsockname_udp)
@@ -792,6 +1092,8 @@ TASK_LIST_START
   TEST_ENTRY  (poll_unidirectional)
   TEST_ENTRY  (poll_close)
   TEST_ENTRY  (poll_bad_fdtype)
+  TEST_ENTRY  (poll_edge_triggered)
+  TEST_ENTRY  (poll_batch_register)
 #if (defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))) && \
     !defined(__sun)
   TEST_ENTRY  (poll_oob)
@@ -805,14 +1107,20 @@ TASK_LIST_START
 #endif
 
   TEST_ENTRY  (socket_buffer_size)
+  TEST_ENTRY  (socket_buffer_autotune)
 
   TEST_ENTRY  (spawn_fails)
 #ifndef _WIN32
   TEST_ENTRY  (spawn_fails_check_for_waitpid_cleanup)
+  TEST_ENTRY  (spawn_env_path)
+  TEST_ENTRY  (spawn_many_exit)
 #endif
   TEST_ENTRY  (spawn_exit_code)
+  TEST_ENTRY  (spawn_exit_rusage)
   TEST_ENTRY  (spawn_stdout)
   TEST_ENTRY  (spawn_stdin)
+  TEST_ENTRY  (spawn_stdin_kernel_pipe)
+  TEST_ENTRY  (spawn_stdio_buffer_size)
   TEST_ENTRY  (spawn_stdio_greater_than_3)
   TEST_ENTRY  (spawn_ignored_stdio)
   TEST_ENTRY  (spawn_and_kill)
@@ -836,6 +1144,7 @@ TASK_LIST_START
   TEST_ENTRY  (spawn_tcp_server)
   TEST_ENTRY  (fs_poll)
   TEST_ENTRY  (fs_poll_getpath)
+  TEST_ENTRY  (fs_poll_shared)
   TEST_ENTRY  (kill)
   TEST_ENTRY  (kill_invalid_signum)
 
@@ -855,13 +1164,18 @@ TASK_LIST_START
   TEST_ENTRY  (win32_signum_number)
 #else
   TEST_ENTRY  (emfile)
+  TEST_ENTRY  (emfile_backoff)
   TEST_ENTRY  (close_fd)
   TEST_ENTRY  (spawn_fs_open)
+#if defined(__linux__)
+  TEST_ENTRY  (spawn_no_cloexec_fd)
+#endif
   TEST_ENTRY  (spawn_setuid_setgid)
   TEST_ENTRY  (we_get_signal)
   TEST_ENTRY  (we_get_signals)
   TEST_ENTRY  (we_get_signal_one_shot)
   TEST_ENTRY  (we_get_signals_mixed)
+  TEST_ENTRY  (we_get_signals_signalfd)
   TEST_ENTRY  (signal_multiple_loops)
   TEST_ENTRY  (closed_fd_events)
 #endif
@@ -879,11 +1193,13 @@ TASK_LIST_START
   TEST_ENTRY  (fs_file_write_null_buffer)
   TEST_ENTRY  (fs_async_dir)
   TEST_ENTRY  (fs_async_sendfile)
+  TEST_ENTRY  (fs_sendfile_pipe)
   TEST_ENTRY  (fs_mkdtemp)
   TEST_ENTRY  (fs_fstat)
   TEST_ENTRY  (fs_access)
   TEST_ENTRY  (fs_chmod)
   TEST_ENTRY  (fs_copyfile)
+  TEST_ENTRY  (fs_copyfile_large)
   TEST_ENTRY  (fs_unlink_readonly)
 #ifdef _WIN32
   TEST_ENTRY  (fs_unlink_archive_readonly)
@@ -902,10 +1218,20 @@ TASK_LIST_START
   TEST_ENTRY  (fs_non_symlink_reparse_point)
 #endif
   TEST_ENTRY  (fs_stat_missing_path)
+  TEST_ENTRY  (fs_statx)
+  TEST_ENTRY  (fs_batch)
+  TEST_ENTRY  (fs_fsync_coalesce)
+  TEST_ENTRY  (fs_mmap)
+  TEST_ENTRY  (fs_stat_cache)
+  TEST_ENTRY  (fs_fd_cache)
+  TEST_ENTRY  (fs_at)
+  TEST_ENTRY  (fs_log)
   TEST_ENTRY  (fs_read_file_eof)
   TEST_ENTRY  (fs_file_open_append)
   TEST_ENTRY  (fs_event_watch_dir)
   TEST_ENTRY  (fs_event_watch_dir_recursive)
+  TEST_ENTRY  (fs_event_coalesce)
+  TEST_ENTRY  (fs_event_fsevents_latency)
 #ifdef _WIN32
   TEST_ENTRY  (fs_event_watch_dir_short_path)
 #endif
@@ -928,8 +1254,14 @@ TASK_LIST_START
   TEST_ENTRY  (fs_scandir_empty_dir)
   TEST_ENTRY  (fs_scandir_non_existent_dir)
   TEST_ENTRY  (fs_scandir_file)
+  TEST_ENTRY  (fs_readdir_empty_dir)
+  TEST_ENTRY  (fs_readdir_file)
+  TEST_ENTRY  (fs_readdir_non_empty_dir)
+  TEST_ENTRY  (fs_readdir_non_existing_dir)
+  TEST_ENTRY  (fs_walk)
   TEST_ENTRY  (fs_open_dir)
   TEST_ENTRY  (fs_rename_to_existing_file)
+  TEST_ENTRY  (fs_async_path_copy)
   TEST_ENTRY  (fs_write_multiple_bufs)
   TEST_ENTRY  (fs_write_alotof_bufs)
   TEST_ENTRY  (fs_write_alotof_bufs_with_offset)
@@ -941,6 +1273,11 @@ TASK_LIST_START
 #endif
   TEST_ENTRY  (fs_file_pos_after_op_with_offset)
   TEST_ENTRY  (fs_null_req)
+  TEST_ENTRY  (fs_read_nowait)
+  TEST_ENTRY  (fs_o_direct)
+  TEST_ENTRY  (fs_fallocate)
+  TEST_ENTRY  (fs_io_uring)
+  TEST_ENTRY  (fs_io_uring_fixed)
   TEST_ENTRY  (fs_read_dir)
 #ifdef _WIN32
   TEST_ENTRY  (fs_exclusive_sharing_mode)
@@ -948,9 +1285,20 @@ TASK_LIST_START
   TEST_ENTRY  (fs_fchmod_archive_readonly)
 #endif
   TEST_ENTRY  (threadpool_queue_work_simple)
+  TEST_ENTRY  (threadpool_pool)
+  TEST_ENTRY  (threadpool_resize)
+  TEST_ENTRY  (threadpool_on_demand)
+  TEST_ENTRY  (threadpool_work_class)
+  TEST_ENTRY  (threadpool_work_deadline)
+  TEST_ENTRY  (threadpool_work_timeout)
+  TEST_ENTRY  (threadpool_queue_work_batch)
+  TEST_ENTRY  (threadpool_affinity)
+  TEST_ENTRY  (threadpool_stats)
+  TEST_ENTRY  (threadpool_spin)
   TEST_ENTRY  (threadpool_queue_work_einval)
   TEST_ENTRY  (threadpool_multiple_event_loops)
   TEST_ENTRY  (threadpool_cancel_getaddrinfo)
+  TEST_ENTRY  (threadpool_cancel_getaddrinfo_coalesce)
   TEST_ENTRY  (threadpool_cancel_getnameinfo)
   TEST_ENTRY  (threadpool_cancel_work)
   TEST_ENTRY  (threadpool_cancel_fs)
@@ -959,13 +1307,17 @@ TASK_LIST_START
   TEST_ENTRY  (thread_stack_size)
   TEST_ENTRY  (thread_mutex)
   TEST_ENTRY  (thread_mutex_recursive)
+  TEST_ENTRY  (thread_spinlock)
   TEST_ENTRY  (thread_rwlock)
   TEST_ENTRY  (thread_rwlock_trylock)
+  TEST_ENTRY  (thread_brlock)
   TEST_ENTRY  (thread_create)
   TEST_ENTRY  (thread_equal)
   TEST_ENTRY  (thread_affinity)
+  TEST_ENTRY  (thread_create_ex_affinity)
   TEST_ENTRY  (dlerror)
   TEST_ENTRY  (ip4_addr)
+  TEST_ENTRY  (inet_batch)
   TEST_ENTRY  (ip6_addr_link_local)
 
   TEST_ENTRY  (queue_foreach_delete)
@@ -978,6 +1330,7 @@ TASK_LIST_START
   TEST_ENTRY  (fork_timer)
   TEST_ENTRY  (fork_socketpair)
   TEST_ENTRY  (fork_socketpair_started)
+  TEST_ENTRY  (fork_drop_watchers)
   TEST_ENTRY  (fork_signal_to_child)
   TEST_ENTRY  (fork_signal_to_child_closed)
   TEST_ENTRY  (fork_fs_events_child)
@@ -985,6 +1338,7 @@ TASK_LIST_START
   TEST_ENTRY  (fork_fs_events_file_parent_child)
 #ifndef __MVS__
   TEST_ENTRY  (fork_threadpool_queue_work_simple)
+  TEST_ENTRY  (fork_threadpool_senders)
 #endif
 #endif
 
@@ -993,6 +1347,7 @@ TASK_LIST_START
 /* Doesn't work on z/OS because that platform uses EBCDIC, not ASCII. */
 #ifndef __MVS__
   TEST_ENTRY  (idna_toascii)
+  TEST_ENTRY  (idna_toascii_fast_path)
 #endif
 
 #if 0
@@ -22,6 +22,11 @@
 #include "uv.h"
 #include "task.h"
 
+#ifndef _WIN32
+# include <signal.h>
+# include <unistd.h>
+#endif
+
 static uv_timer_t timer_handle;
 
 static void timer_cb(uv_timer_t* handle) {
@@ -73,3 +78,72 @@ TEST_IMPL(loop_instant_close) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+#ifndef _WIN32
+static int loop_lazy_work_cb_called;
+
+static void loop_lazy_work_cb(uv_work_t* req) {
+}
+
+static void loop_lazy_after_work_cb(uv_work_t* req, int status) {
+  ASSERT(status == 0);
+  loop_lazy_work_cb_called++;
+}
+
+static void loop_lazy_signal_cb(uv_signal_t* handle, int signum) {
+  ASSERT(0 && "unexpected signal");
+}
+#endif
+
+
+TEST_IMPL(loop_init_lazy) {
+#ifdef _WIN32
+  RETURN_SKIP("Test not implemented on Windows.");
+#else
+  static uv_loop_t loops[32];
+  uv_signal_t signal;
+  uv_work_t req;
+  unsigned int i;
+  int first;
+  int fd;
+
+  /* 第一个loop还会创建进程共用的信号锁管道 */
+  ASSERT(0 == uv_loop_init(&loops[0]));
+  first = dup(2);
+  ASSERT(first >= 0);
+  close(first);
+
+  /* 只有epoll（kqueue）fd是一开始就要的，信号管道和线程池的eventfd都在
+   * 第一次用到时才创建
+   */
+  for (i = 1; i < ARRAY_SIZE(loops); i++)
+    ASSERT(0 == uv_loop_init(&loops[i]));
+
+  fd = dup(2);
+  ASSERT(fd >= 0);
+  close(fd);
+  ASSERT(fd <= first + (int) ARRAY_SIZE(loops) - 1);
+
+  ASSERT(0 == uv_signal_init(&loops[0], &signal));
+  ASSERT(0 == uv_signal_start(&signal, loop_lazy_signal_cb, SIGUSR2));
+  uv_close((uv_handle_t*) &signal, NULL);
+
+  ASSERT(0 == uv_queue_work(&loops[0],
+                            &req,
+                            loop_lazy_work_cb,
+                            loop_lazy_after_work_cb));
+  ASSERT(0 == uv_run(&loops[0], UV_RUN_DEFAULT));
+  ASSERT(loop_lazy_work_cb_called == 1);
+
+  for (i = 0; i < ARRAY_SIZE(loops); i++)
+    ASSERT(0 == uv_loop_close(&loops[i]));
+
+  fd = dup(2);
+  ASSERT(fd < first);
+  close(fd);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#endif
+}
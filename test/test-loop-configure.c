@@ -16,6 +16,15 @@
 #include "uv.h"
 #include "task.h"
 
+#include <string.h>
+
+#ifdef __linux__
+# include <sys/socket.h>
+# include <unistd.h>
+# include <fcntl.h>
+# include <sys/resource.h>
+#endif
+
 static void timer_cb(uv_timer_t* handle) {
   uv_close((uv_handle_t*) handle, NULL);
 }
@@ -36,3 +45,942 @@ TEST_IMPL(loop_configure) {
   ASSERT(0 == uv_loop_close(&loop));
   return 0;
 }
+
+
+static uv_tcp_t iou_server;
+static uv_tcp_t iou_conn;
+static uv_tcp_t iou_client;
+static uv_connect_t iou_connect_req;
+static uv_write_t iou_write_req;
+static char iou_buf[64];
+static int iou_read_cb_called;
+
+
+static void iou_alloc_cb(uv_handle_t* handle,
+                         size_t suggested_size,
+                         uv_buf_t* buf) {
+  buf->base = iou_buf;
+  buf->len = sizeof(iou_buf);
+}
+
+
+static void iou_read_cb(uv_stream_t* stream,
+                        ssize_t nread,
+                        const uv_buf_t* buf) {
+  if (nread == 0)
+    return;
+
+  if (nread > 0) {
+    ASSERT(nread == 4);
+    ASSERT(0 == memcmp(buf->base, "PING", 4));
+    iou_read_cb_called++;
+  } else {
+    ASSERT(nread == UV_EOF);
+  }
+
+  uv_close((uv_handle_t*) stream, NULL);
+  uv_close((uv_handle_t*) &iou_server, NULL);
+}
+
+
+static void iou_connection_cb(uv_stream_t* server, int status) {
+  ASSERT(status == 0);
+  ASSERT(0 == uv_tcp_init(server->loop, &iou_conn));
+  ASSERT(0 == uv_accept(server, (uv_stream_t*) &iou_conn));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &iou_conn,
+                            iou_alloc_cb,
+                            iou_read_cb));
+}
+
+
+static void iou_write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  uv_close((uv_handle_t*) req->handle, NULL);
+}
+
+
+static void iou_connect_cb(uv_connect_t* req, int status) {
+  uv_buf_t buf;
+
+  ASSERT(status == 0);
+  buf = uv_buf_init("PING", 4);
+  ASSERT(0 == uv_write(&iou_write_req, req->handle, &buf, 1, iou_write_cb));
+}
+
+
+TEST_IMPL(loop_configure_io_uring) {
+  struct sockaddr_in addr;
+  uv_timer_t timer_handle;
+  uv_loop_t loop;
+  int r;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  r = uv_loop_configure(&loop, UV_LOOP_USE_IO_URING);
+  if (r == UV_ENOSYS) {
+    ASSERT(0 == uv_loop_close(&loop));
+    RETURN_SKIP("io_uring not supported");
+  }
+  ASSERT(r == 0);
+  /* Enabling it twice is a no-op. */
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_USE_IO_URING));
+
+  ASSERT(0 == uv_timer_init(&loop, &timer_handle));
+  ASSERT(0 == uv_timer_start(&timer_handle, timer_cb, 10, 0));
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(&loop, &iou_server));
+  ASSERT(0 == uv_tcp_bind(&iou_server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &iou_server, 128, iou_connection_cb));
+
+  ASSERT(0 == uv_tcp_init(&loop, &iou_client));
+  ASSERT(0 == uv_tcp_connect(&iou_connect_req,
+                             &iou_client,
+                             (const struct sockaddr*) &addr,
+                             iou_connect_cb));
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(1 == iou_read_cb_called);
+
+  /* Closing the server must cancel its poll request and release the port. */
+  ASSERT(0 == uv_tcp_init(&loop, &iou_server));
+  ASSERT(0 == uv_tcp_bind(&iou_server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &iou_server, 128, iou_connection_cb));
+  uv_close((uv_handle_t*) &iou_server, NULL);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+}
+
+
+#ifdef __linux__
+static uv_poll_t max_events_handles[8];
+static int max_events_fds[ARRAY_SIZE(max_events_handles)][2];
+static int max_events_cb_called;
+
+
+static void max_events_poll_cb(uv_poll_t* handle, int status, int events) {
+  char c;
+
+  ASSERT(status == 0);
+  ASSERT(events == UV_READABLE);
+  ASSERT(1 == read(handle->io_watcher.fd, &c, 1));
+  max_events_cb_called++;
+  uv_close((uv_handle_t*) handle, NULL);
+}
+#endif
+
+
+TEST_IMPL(loop_configure_max_events) {
+#ifdef __linux__
+  uv_loop_t loop;
+  size_t i;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(UV_EINVAL == uv_loop_configure(&loop, UV_LOOP_MAX_EVENTS, 0));
+  /* One event per epoll_pwait() call, the loop has to poll several times. */
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_MAX_EVENTS, 1));
+
+  for (i = 0; i < ARRAY_SIZE(max_events_handles); i++) {
+    ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, max_events_fds[i]));
+    ASSERT(1 == write(max_events_fds[i][1], "x", 1));
+    ASSERT(0 == uv_poll_init(&loop,
+                             &max_events_handles[i],
+                             max_events_fds[i][0]));
+    ASSERT(0 == uv_poll_start(&max_events_handles[i],
+                              UV_READABLE,
+                              max_events_poll_cb));
+  }
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(ARRAY_SIZE(max_events_handles) == max_events_cb_called);
+
+  for (i = 0; i < ARRAY_SIZE(max_events_handles); i++) {
+    ASSERT(0 == close(max_events_fds[i][0]));
+    ASSERT(0 == close(max_events_fds[i][1]));
+  }
+
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+#else
+  RETURN_SKIP("UV_LOOP_MAX_EVENTS is only supported on Linux.");
+#endif
+}
+
+
+static uv_timer_t spin_timer_handle;
+static uint64_t spin_timer_start;
+static int spin_timer_cb_called;
+
+
+static void spin_timer_cb(uv_timer_t* handle) {
+  ASSERT(uv_now(handle->loop) - spin_timer_start >= 20);
+  spin_timer_cb_called++;
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+TEST_IMPL(loop_configure_spin) {
+  struct sockaddr_in addr;
+  uv_tcp_t tcp_handle;
+  uv_loop_t loop;
+  int r;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  r = uv_loop_configure(&loop, UV_LOOP_SPIN, 5000);
+  if (r == UV_ENOSYS) {
+    ASSERT(0 == uv_loop_close(&loop));
+    RETURN_SKIP("UV_LOOP_SPIN is not supported on this platform.");
+  }
+  ASSERT(r == 0);
+  ASSERT(UV_EINVAL == uv_loop_configure(&loop, UV_LOOP_SPIN, -1));
+
+  ASSERT(0 == uv_tcp_init(&loop, &tcp_handle));
+  ASSERT(UV_EBADF == uv_tcp_busy_poll(&tcp_handle, 50));
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_bind(&tcp_handle, (const struct sockaddr*) &addr, 0));
+  ASSERT(UV_EINVAL == uv_tcp_busy_poll(&tcp_handle, -1));
+  r = uv_tcp_busy_poll(&tcp_handle, 50);
+  ASSERT(r == 0 || r == UV_ENOTSUP || r == UV_EPERM);
+  ASSERT(0 == uv_listen((uv_stream_t*) &tcp_handle, 1, NULL));
+
+  /* The timer outlasts the spin budget several times over; it must fire on
+   * time, and the loop must not exit before it does.
+   */
+  ASSERT(0 == uv_timer_init(&loop, &spin_timer_handle));
+  spin_timer_start = uv_now(&loop);
+  ASSERT(0 == uv_timer_start(&spin_timer_handle, spin_timer_cb, 20, 0));
+  while (spin_timer_cb_called == 0)
+    ASSERT(0 != uv_run(&loop, UV_RUN_ONCE));
+
+  uv_close((uv_handle_t*) &tcp_handle, NULL);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(1 == spin_timer_cb_called);
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+}
+
+
+#define ARENA_NREQS 64
+
+static uv_fs_t arena_fs_reqs[ARENA_NREQS];
+static uv_getaddrinfo_t arena_gai_req;
+static uv_udp_send_t arena_send_req;
+static int arena_fs_cb_called;
+static int arena_gai_cb_called;
+static int arena_send_cb_called;
+
+
+static void arena_fs_cb(uv_fs_t* req) {
+  ASSERT(req->result == UV_ENOENT || req->result == UV_ENAMETOOLONG);
+  uv_fs_req_cleanup(req);
+  arena_fs_cb_called++;
+}
+
+
+static void arena_gai_cb(uv_getaddrinfo_t* req,
+                         int status,
+                         struct addrinfo* res) {
+  uv_freeaddrinfo(res);
+  arena_gai_cb_called++;
+}
+
+
+static void arena_send_cb(uv_udp_send_t* req, int status) {
+  ASSERT(status == 0);
+  uv_close((uv_handle_t*) req->handle, NULL);
+  arena_send_cb_called++;
+}
+
+
+TEST_IMPL(loop_configure_arena) {
+  struct sockaddr_in addr;
+  uv_udp_t udp_handle;
+  uv_buf_t bufs[8];
+  char path[8192];
+  uv_loop_t loop;
+  int i;
+
+  ASSERT(0 == uv_loop_init(&loop));
+
+  /* 打开内存池之前分配的路径之后也能正确释放 */
+  ASSERT(0 == uv_fs_stat(&loop, arena_fs_reqs, "no_such_file", arena_fs_cb));
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_ARENA));
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_ARENA));
+
+  /* 各个级别的路径，最后几个比最大一级还大 */
+  for (i = 1; i < ARENA_NREQS; i++) {
+    memset(path, 'a', i * 100);
+    memcpy(path, "no_such_dir/", 12);
+    path[i * 100] = '\0';
+    ASSERT(0 == uv_fs_stat(&loop, arena_fs_reqs + i, path, arena_fs_cb));
+  }
+
+  ASSERT(0 == uv_getaddrinfo(&loop,
+                             &arena_gai_req,
+                             arena_gai_cb,
+                             "localhost",
+                             "80",
+                             NULL));
+
+  /* 超过bufsml的缓冲区数组 */
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_udp_init(&loop, &udp_handle));
+  for (i = 0; i < (int) ARRAY_SIZE(bufs); i++)
+    bufs[i] = uv_buf_init("x", 1);
+  ASSERT(0 == uv_udp_send(&arena_send_req,
+                          &udp_handle,
+                          bufs,
+                          ARRAY_SIZE(bufs),
+                          (const struct sockaddr*) &addr,
+                          arena_send_cb));
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(arena_fs_cb_called == ARENA_NREQS);
+  ASSERT(arena_gai_cb_called == 1);
+  ASSERT(arena_send_cb_called == 1);
+
+  /* 释放的块被重新使用 */
+  arena_fs_cb_called = 0;
+  for (i = 0; i < ARENA_NREQS; i++)
+    ASSERT(0 == uv_fs_stat(&loop,
+                           arena_fs_reqs + i,
+                           "no_such_file",
+                           arena_fs_cb));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(arena_fs_cb_called == ARENA_NREQS);
+
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+}
+
+
+#ifdef __linux__
+#define SPARSE_NFDS 64
+#define SPARSE_BASE_FD 1000
+
+static uv_poll_t sparse_handles[SPARSE_NFDS];
+static int sparse_fds[SPARSE_NFDS][2];
+static int sparse_cb_called;
+
+
+static void sparse_poll_cb(uv_poll_t* handle, int status, int events) {
+  char c;
+  int n;
+
+  ASSERT(status == 0);
+  ASSERT(events == UV_READABLE);
+  n = handle - sparse_handles;
+  ASSERT(1 == read(sparse_fds[n][0], &c, 1));
+  ASSERT(c == (char) n);
+  sparse_cb_called++;
+
+  /* 关掉一个会让同一探测链上后面的项往前挪 */
+  uv_close((uv_handle_t*) handle, NULL);
+  if (n % 3 == 0 && n + 1 < SPARSE_NFDS &&
+      !uv_is_closing((uv_handle_t*) &sparse_handles[n + 1])) {
+    ASSERT(1 == read(sparse_fds[n + 1][0], &c, 1));
+    sparse_cb_called++;
+    uv_close((uv_handle_t*) &sparse_handles[n + 1], NULL);
+  }
+}
+#endif
+
+
+TEST_IMPL(loop_configure_sparse_watchers) {
+#ifdef __linux__
+  uv_mem_stats_t before;
+  uv_mem_stats_t after;
+  struct rlimit lim;
+  uv_loop_t loop;
+  int fd;
+  int i;
+  char c;
+
+  ASSERT(0 == getrlimit(RLIMIT_NOFILE, &lim));
+  if (lim.rlim_cur < SPARSE_BASE_FD + 8 * SPARSE_NFDS)
+    RETURN_SKIP("RLIMIT_NOFILE too low");
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_SPARSE_WATCHERS));
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_SPARSE_WATCHERS));
+
+  ASSERT(0 == uv_mem_stats(UV_MEM_WATCHERS, &before));
+
+  /* 编号很大而且不连续的fd */
+  for (i = 0; i < SPARSE_NFDS; i++) {
+    ASSERT(0 == pipe(sparse_fds[i]));
+    fd = fcntl(sparse_fds[i][0], F_DUPFD, SPARSE_BASE_FD + 7 * i);
+    ASSERT(fd >= SPARSE_BASE_FD + 7 * i);
+    ASSERT(0 == close(sparse_fds[i][0]));
+    sparse_fds[i][0] = fd;
+    ASSERT(0 == uv_poll_init(&loop, sparse_handles + i, fd));
+    ASSERT(0 == uv_poll_start(sparse_handles + i, UV_READABLE, sparse_poll_cb));
+  }
+
+  /* 表的大小只和fd的数目有关 */
+  ASSERT(0 == uv_mem_stats(UV_MEM_WATCHERS, &after));
+  ASSERT(after.bytes - before.bytes < SPARSE_BASE_FD * sizeof(void*));
+
+  for (i = 0; i < SPARSE_NFDS; i++) {
+    c = (char) i;
+    ASSERT(1 == write(sparse_fds[i][1], &c, 1));
+  }
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(sparse_cb_called == SPARSE_NFDS);
+
+  for (i = 0; i < SPARSE_NFDS; i++) {
+    ASSERT(0 == close(sparse_fds[i][0]));
+    ASSERT(0 == close(sparse_fds[i][1]));
+  }
+
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+#else
+  RETURN_SKIP("Linux only test");
+#endif
+}
+
+
+#ifdef __linux__
+#define BUDGET_NFDS 4
+
+static uv_poll_t budget_handles[BUDGET_NFDS];
+static int budget_fds[BUDGET_NFDS][2];
+static int budget_called[BUDGET_NFDS];
+static int budget_cb_called;
+static int budget_closed = -1;
+
+
+static void budget_poll_cb(uv_poll_t* handle, int status, int events) {
+  uint64_t start;
+  int n;
+  int i;
+
+  n = handle - budget_handles;
+  ASSERT(status == 0);
+  ASSERT(n != budget_closed);
+  budget_called[n]++;
+  budget_cb_called++;
+  uv_close((uv_handle_t*) handle, NULL);
+
+  /* 关掉一个还没有分发到的watcher，留下来的事件里它要被跳过 */
+  if (budget_closed == -1) {
+    for (i = 0; i < BUDGET_NFDS; i++)
+      if (budget_called[i] == 0)
+        break;
+    ASSERT(i < BUDGET_NFDS);
+    budget_closed = i;
+    uv_close((uv_handle_t*) &budget_handles[i], NULL);
+  }
+
+  /* 每个回调都超过预算 */
+  start = uv_hrtime();
+  while (uv_hrtime() - start < 2 * 1000 * 1000);
+}
+#endif
+
+
+TEST_IMPL(loop_configure_poll_budget) {
+#ifdef __linux__
+  uv_loop_t loop;
+  int last;
+  int i;
+  int r;
+  char c;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  r = uv_loop_configure(&loop, UV_LOOP_POLL_BUDGET, 1000);
+  if (r == UV_ENOSYS) {
+    ASSERT(0 == uv_loop_close(&loop));
+    RETURN_SKIP("UV_LOOP_POLL_BUDGET is not supported on this platform.");
+  }
+  ASSERT(r == 0);
+  ASSERT(UV_EINVAL == uv_loop_configure(&loop, UV_LOOP_POLL_BUDGET, -1));
+
+  for (i = 0; i < BUDGET_NFDS; i++) {
+    ASSERT(0 == pipe(budget_fds[i]));
+    ASSERT(0 == uv_poll_init(&loop, budget_handles + i, budget_fds[i][0]));
+    ASSERT(0 == uv_poll_start(budget_handles + i, UV_READABLE, budget_poll_cb));
+    c = (char) i;
+    ASSERT(1 == write(budget_fds[i][1], &c, 1));
+  }
+
+  /* 所有fd都已经可读，但是每轮只来得及分发一个，剩下的不需要再等待 */
+  ASSERT(0 != uv_run(&loop, UV_RUN_NOWAIT));
+  ASSERT(budget_cb_called == 1);
+  ASSERT(0 == uv_backend_timeout(&loop));
+
+  while (budget_cb_called < BUDGET_NFDS - 1) {
+    last = budget_cb_called;
+    uv_run(&loop, UV_RUN_NOWAIT);
+    ASSERT(budget_cb_called - last <= 1);
+  }
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(budget_cb_called == BUDGET_NFDS - 1);
+  ASSERT(budget_called[budget_closed] == 0);
+
+  for (i = 0; i < BUDGET_NFDS; i++) {
+    ASSERT(0 == close(budget_fds[i][0]));
+    ASSERT(0 == close(budget_fds[i][1]));
+  }
+
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+#else
+  RETURN_SKIP("Linux only test");
+#endif
+}
+
+
+#ifdef __linux__
+#define ET_SIZE (1024 * 1024)
+
+static uv_pipe_t et_pipes[2];
+static uv_write_t et_write_req;
+static uv_shutdown_t et_shutdown_req;
+static char et_buf[4096];
+static size_t et_nread;
+static int et_read_cb_called;
+static int et_eof;
+
+
+static void et_alloc_cb(uv_handle_t* handle,
+                        size_t suggested_size,
+                        uv_buf_t* buf) {
+  *buf = uv_buf_init(et_buf, sizeof(et_buf));
+}
+
+
+static void et_read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  ssize_t i;
+
+  if (nread == UV_EOF) {
+    et_eof++;
+    uv_close((uv_handle_t*) stream, NULL);
+    return;
+  }
+
+  ASSERT(nread > 0);
+  for (i = 0; i < nread; i++)
+    ASSERT(buf->base[i] == (char) ((et_nread + i) % 251));
+  et_nread += nread;
+  et_read_cb_called++;
+}
+
+
+static void et_write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+}
+
+
+static void et_shutdown_cb(uv_shutdown_t* req, int status) {
+  ASSERT(status == 0);
+  uv_close((uv_handle_t*) req->handle, NULL);
+}
+#endif
+
+
+TEST_IMPL(loop_configure_edge_triggered) {
+#ifdef __linux__
+  uv_loop_t loop;
+  uv_buf_t buf;
+  char* data;
+  int fds[2];
+  int r;
+  int i;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  r = uv_loop_configure(&loop, UV_LOOP_EDGE_TRIGGERED);
+  if (r == UV_ENOSYS) {
+    ASSERT(0 == uv_loop_close(&loop));
+    RETURN_SKIP("UV_LOOP_EDGE_TRIGGERED is not supported on this platform.");
+  }
+  ASSERT(r == 0);
+
+  /* 每轮只读一次，没读空的流要靠重新注册才能在下一轮接着读 */
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_READ_BUDGET, 1, 0));
+
+  data = malloc(ET_SIZE);
+  ASSERT(data != NULL);
+  for (i = 0; i < ET_SIZE; i++)
+    data[i] = (char) (i % 251);
+
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  for (i = 0; i < 2; i++) {
+    ASSERT(0 == uv_pipe_init(&loop, et_pipes + i, 0));
+    ASSERT(0 == uv_pipe_open(et_pipes + i, fds[i]));
+  }
+
+  /* 写端一直写到EAGAIN才等POLLOUT，最后的数据和EOF一起到达读端 */
+  buf = uv_buf_init(data, ET_SIZE);
+  ASSERT(0 == uv_write(&et_write_req,
+                       (uv_stream_t*) &et_pipes[0],
+                       &buf,
+                       1,
+                       et_write_cb));
+  ASSERT(0 == uv_shutdown(&et_shutdown_req,
+                          (uv_stream_t*) &et_pipes[0],
+                          et_shutdown_cb));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &et_pipes[1],
+                            et_alloc_cb,
+                            et_read_cb));
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(et_nread == ET_SIZE);
+  ASSERT(et_read_cb_called >= ET_SIZE / (int) sizeof(et_buf));
+  ASSERT(et_eof == 1);
+
+  free(data);
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+#else
+  RETURN_SKIP("Linux only test");
+#endif
+}
+
+
+static uv_timer_t perf_timer_handle;
+static int perf_timer_cb_called;
+
+
+static void perf_timer_cb(uv_timer_t* handle) {
+  if (++perf_timer_cb_called == 3)
+    uv_timer_stop(handle);
+}
+
+
+TEST_IMPL(loop_configure_perf_counters) {
+  uv_perf_counters_t counters;
+  uv_perf_counters_t total;
+  uv_metrics_t metrics;
+  uv_loop_t loop;
+  int phase;
+  int r;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(UV_EINVAL == uv_loop_perf_counters(&loop, UV_PHASE_TIMERS, &counters));
+
+  /* perf_event_paranoid或者容器的seccomp可能不让打开计数器 */
+  r = uv_loop_configure(&loop, UV_LOOP_PERF_COUNTERS);
+  if (r != 0) {
+    ASSERT(0 == uv_loop_close(&loop));
+    RETURN_SKIP("perf_event_open() is not available.");
+  }
+
+  ASSERT(0 == uv_timer_init(&loop, &perf_timer_handle));
+  ASSERT(0 == uv_timer_start(&perf_timer_handle, perf_timer_cb, 1, 1));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(perf_timer_cb_called == 3);
+
+  ASSERT(UV_EINVAL == uv_loop_perf_counters(&loop, UV_PHASE_MAX, &counters));
+
+  memset(&total, 0, sizeof(total));
+  for (phase = 0; phase < UV_PHASE_MAX; phase++) {
+    ASSERT(0 == uv_loop_perf_counters(&loop, phase, &counters));
+    ASSERT(counters.available != 0);
+    ASSERT(counters.count > 0);
+    total.instructions += counters.instructions;
+    total.cache_misses += counters.cache_misses;
+    total.context_switches += counters.context_switches;
+  }
+
+  ASSERT(0 == uv_loop_perf_counters(&loop, UV_PHASE_TIMERS, &counters));
+  if (counters.available & UV_PERF_INSTRUCTIONS)
+    ASSERT(counters.instructions > 0);
+
+  ASSERT(0 == uv_metrics_info(&loop, &metrics));
+  ASSERT(metrics.instructions == total.instructions);
+  ASSERT(metrics.cache_misses == total.cache_misses);
+  ASSERT(metrics.context_switches == total.context_switches);
+
+  uv_close((uv_handle_t*) &perf_timer_handle, NULL);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+}
+
+
+static uv_tcp_t ring_server;
+static uv_tcp_t ring_conn;
+static uv_tcp_t ring_client;
+static uv_connect_t ring_connect_req;
+static uv_write_t ring_write_reqs[4];
+static uv_shutdown_t ring_shutdown_req;
+static char ring_data[100];
+static size_t ring_nread;
+static int ring_eof;
+
+
+static void ring_read_cb(uv_stream_t* stream,
+                         ssize_t nread,
+                         const uv_buf_t* buf) {
+  if (nread < 0) {
+    ASSERT(nread == UV_EOF);
+    ring_eof++;
+    uv_close((uv_handle_t*) stream, NULL);
+    uv_close((uv_handle_t*) &ring_server, NULL);
+    return;
+  }
+
+  /* 缓冲区只有16字节，一次最多读到16字节 */
+  ASSERT(nread <= 16);
+  ASSERT(buf->len >= (size_t) nread);
+  ASSERT(ring_nread + nread <= sizeof(ring_data));
+  ASSERT(0 == memcmp(buf->base, ring_data + ring_nread, nread));
+  ring_nread += nread;
+}
+
+
+static void ring_connection_cb(uv_stream_t* server, int status) {
+  ASSERT(status == 0);
+  ASSERT(0 == uv_tcp_init(server->loop, &ring_conn));
+  ASSERT(0 == uv_accept(server, (uv_stream_t*) &ring_conn));
+  ASSERT(0 == uv_read_start_ring((uv_stream_t*) &ring_conn, ring_read_cb));
+}
+
+
+static void ring_shutdown_cb(uv_shutdown_t* req, int status) {
+  ASSERT(status == 0);
+  uv_close((uv_handle_t*) req->handle, NULL);
+}
+
+
+static void ring_connect_cb(uv_connect_t* req, int status) {
+  unsigned int i;
+  uv_buf_t buf;
+
+  ASSERT(status == 0);
+  for (i = 0; i < ARRAY_SIZE(ring_write_reqs); i++) {
+    buf = uv_buf_init(ring_data + i * 25, 25);
+    ASSERT(0 == uv_write(&ring_write_reqs[i], req->handle, &buf, 1, NULL));
+  }
+  ASSERT(0 == uv_shutdown(&ring_shutdown_req, req->handle, ring_shutdown_cb));
+}
+
+
+static void ring_run(int use_io_uring) {
+  struct sockaddr_in addr;
+  uv_loop_t loop;
+
+  ring_nread = 0;
+  ring_eof = 0;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  if (use_io_uring)
+    ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_USE_IO_URING));
+  ASSERT(UV_EINVAL == uv_loop_configure(&loop, UV_LOOP_RECV_RING, 3u, (size_t) 16));
+  ASSERT(UV_EINVAL == uv_loop_configure(&loop, UV_LOOP_RECV_RING, 4u, (size_t) 0));
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_RECV_RING, 4u, (size_t) 16));
+  ASSERT(UV_EBUSY == uv_loop_configure(&loop, UV_LOOP_RECV_RING, 4u, (size_t) 16));
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(&loop, &ring_server));
+  ASSERT(0 == uv_tcp_bind(&ring_server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &ring_server, 128, ring_connection_cb));
+
+  ASSERT(0 == uv_tcp_init(&loop, &ring_client));
+  ASSERT(0 == uv_tcp_connect(&ring_connect_req,
+                             &ring_client,
+                             (const struct sockaddr*) &addr,
+                             ring_connect_cb));
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(ring_nread == sizeof(ring_data));
+  ASSERT(ring_eof == 1);
+  ASSERT(0 == uv_loop_close(&loop));
+}
+
+
+TEST_IMPL(loop_configure_recv_ring) {
+  uv_loop_t loop;
+  unsigned int i;
+  int r;
+
+  for (i = 0; i < sizeof(ring_data); i++)
+    ring_data[i] = 'a' + i % 26;
+
+  /* 没有设置UV_LOOP_RECV_RING的loop不能用 */
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_tcp_init(&loop, &ring_conn));
+  ASSERT(UV_EINVAL == uv_read_start_ring((uv_stream_t*) &ring_conn,
+                                         ring_read_cb));
+  uv_close((uv_handle_t*) &ring_conn, NULL);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+
+  /* 按可读事件读 */
+  ring_run(0);
+
+  r = uv_loop_configure(&loop, UV_LOOP_USE_IO_URING);
+  ASSERT(0 == uv_loop_close(&loop));
+  if (r == UV_ENOSYS)
+    RETURN_SKIP("io_uring not supported");
+  ASSERT(r == 0);
+
+  /* multishot recv，内核不支持时退回按可读事件读 */
+  ring_run(1);
+
+  return 0;
+}
+
+
+static uv_tcp_t accept_server;
+static uv_tcp_t accept_conns[5];
+static uv_tcp_t accept_clients[ARRAY_SIZE(accept_conns)];
+static uv_connect_t accept_connect_reqs[ARRAY_SIZE(accept_conns)];
+static uv_timer_t accept_timer;
+static unsigned int accept_naccepted;
+static int accept_connection_cb_called;
+static int accept_connect_cb_called;
+
+
+static int accept_one(uv_stream_t* server) {
+  uv_tcp_t* conn;
+  int r;
+
+  ASSERT(accept_naccepted < ARRAY_SIZE(accept_conns));
+  conn = &accept_conns[accept_naccepted];
+  ASSERT(0 == uv_tcp_init(server->loop, conn));
+  r = uv_accept(server, (uv_stream_t*) conn);
+  uv_close((uv_handle_t*) conn, NULL);
+  if (r == 0)
+    accept_naccepted++;
+
+  if (accept_naccepted == ARRAY_SIZE(accept_conns))
+    uv_close((uv_handle_t*) server, NULL);
+
+  return r;
+}
+
+
+/* 第一个连接过一会儿才取，这期间到达的连接要么排在队列里，要么留在backlog里 */
+static void accept_timer_cb(uv_timer_t* handle) {
+  while (accept_naccepted < ARRAY_SIZE(accept_conns) &&
+         0 == accept_one((uv_stream_t*) &accept_server));
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+static void accept_connection_cb(uv_stream_t* server, int status) {
+  ASSERT(status == 0);
+  if (accept_connection_cb_called++ == 0)
+    ASSERT(0 == uv_timer_start(&accept_timer, accept_timer_cb, 50, 0));
+  else
+    ASSERT(0 == accept_one(server));
+}
+
+
+static void accept_connect_cb(uv_connect_t* req, int status) {
+  ASSERT(status == 0);
+  accept_connect_cb_called++;
+  uv_close((uv_handle_t*) req->handle, NULL);
+}
+
+
+TEST_IMPL(loop_configure_io_uring_accept) {
+  struct sockaddr_in addr;
+  uv_loop_t loop;
+  unsigned int i;
+  int r;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  r = uv_loop_configure(&loop, UV_LOOP_USE_IO_URING);
+  if (r == UV_ENOSYS) {
+    ASSERT(0 == uv_loop_close(&loop));
+    RETURN_SKIP("io_uring not supported");
+  }
+  ASSERT(r == 0);
+
+  ASSERT(0 == uv_timer_init(&loop, &accept_timer));
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(&loop, &accept_server));
+  ASSERT(0 == uv_tcp_bind(&accept_server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &accept_server,
+                        128,
+                        accept_connection_cb));
+
+  for (i = 0; i < ARRAY_SIZE(accept_clients); i++) {
+    ASSERT(0 == uv_tcp_init(&loop, &accept_clients[i]));
+    ASSERT(0 == uv_tcp_connect(&accept_connect_reqs[i],
+                               &accept_clients[i],
+                               (const struct sockaddr*) &addr,
+                               accept_connect_cb));
+  }
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(accept_naccepted == ARRAY_SIZE(accept_conns));
+  ASSERT(accept_connect_cb_called == ARRAY_SIZE(accept_clients));
+  ASSERT(accept_connection_cb_called >= 1);
+
+  /* 关闭服务端要撤销accept请求，端口能马上再用 */
+  ASSERT(0 == uv_tcp_init(&loop, &accept_server));
+  ASSERT(0 == uv_tcp_bind(&accept_server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &accept_server,
+                        128,
+                        accept_connection_cb));
+  uv_close((uv_handle_t*) &accept_server, NULL);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+}
+
+
+#ifdef __linux__
+static int hugepages_fds[2];
+static int hugepages_cb_called;
+
+
+static void hugepages_poll_cb(uv_poll_t* handle, int status, int events) {
+  char c;
+
+  ASSERT(status == 0);
+  ASSERT(1 == read(hugepages_fds[0], &c, 1));
+  hugepages_cb_called++;
+  uv_close((uv_handle_t*) handle, NULL);
+}
+#endif
+
+
+TEST_IMPL(loop_configure_hugepages) {
+#ifdef __linux__
+  uv_mem_stats_t before;
+  uv_mem_stats_t after;
+  uv_poll_t handle;
+  uv_loop_t loop;
+  char c;
+
+  ASSERT(0 == uv_mem_stats(UV_MEM_WATCHERS, &before));
+  ASSERT(0 == uv_loop_init(&loop));
+
+  /* 已经有watcher表时打开，表太小，留在原来的地方 */
+  ASSERT(0 == pipe(hugepages_fds));
+  ASSERT(0 == uv_poll_init(&loop, &handle, hugepages_fds[0]));
+  ASSERT(0 == uv_poll_start(&handle, UV_READABLE, hugepages_poll_cb));
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_USE_HUGEPAGES));
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_USE_HUGEPAGES));
+
+  /* 4MB的接收缓冲区环用大页映射，uv_loop_close()时解除 */
+  ASSERT(0 == uv_loop_configure(&loop,
+                                UV_LOOP_RECV_RING,
+                                4u,
+                                (size_t) 1 << 20));
+
+  c = 'x';
+  ASSERT(1 == write(hugepages_fds[1], &c, 1));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(hugepages_cb_called == 1);
+
+  ASSERT(0 == uv_loop_close(&loop));
+  ASSERT(0 == close(hugepages_fds[0]));
+  ASSERT(0 == close(hugepages_fds[1]));
+
+  ASSERT(0 == uv_mem_stats(UV_MEM_WATCHERS, &after));
+  ASSERT(after.bytes == before.bytes);
+  return 0;
+#else
+  RETURN_SKIP("Linux only test");
+#endif
+}
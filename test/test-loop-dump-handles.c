@@ -0,0 +1,126 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+static uv_timer_t timer;
+static uv_tcp_t tcp;
+static uv_check_t check;
+static uv_handle_info_t timer_info;
+static uv_handle_info_t tcp_info;
+static uv_handle_info_t check_info;
+static int dump_cb_called;
+
+
+static void timer_cb(uv_timer_t* handle) {
+  uv_timer_stop(handle);
+}
+
+
+static void check_cb(uv_check_t* handle) {
+}
+
+
+static void dump_cb(const uv_handle_info_t* info, void* arg) {
+  ASSERT(arg == (void*) &dump_cb_called);
+  dump_cb_called++;
+
+  if (info->handle == (uv_handle_t*) &timer)
+    timer_info = *info;
+  else if (info->handle == (uv_handle_t*) &tcp)
+    tcp_info = *info;
+  else if (info->handle == (uv_handle_t*) &check)
+    check_info = *info;
+  else
+    ASSERT(0 && "unexpected handle");
+}
+
+
+static void dump(uv_loop_t* loop) {
+  dump_cb_called = 0;
+  memset(&timer_info, 0, sizeof(timer_info));
+  memset(&tcp_info, 0, sizeof(tcp_info));
+  memset(&check_info, 0, sizeof(check_info));
+  uv_loop_dump_handles(loop, dump_cb, &dump_cb_called);
+}
+
+
+TEST_IMPL(loop_dump_handles) {
+  struct sockaddr_in addr;
+  uv_loop_t* loop;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+
+  ASSERT(0 == uv_tcp_init(loop, &tcp));
+  ASSERT(0 == uv_tcp_bind(&tcp, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_timer_init(loop, &timer));
+  ASSERT(0 == uv_timer_start(&timer, timer_cb, 10, 0));
+  ASSERT(0 == uv_check_init(loop, &check));
+  ASSERT(0 == uv_check_start(&check, check_cb));
+  uv_unref((uv_handle_t*) &check);
+
+  dump(loop);
+  ASSERT(dump_cb_called == 3);
+  ASSERT(timer_info.type == UV_TIMER);
+  ASSERT(timer_info.active == 1);
+  ASSERT(timer_info.ref == 1);
+  ASSERT(timer_info.fd == (uv_os_fd_t) -1);
+  ASSERT(check_info.type == UV_CHECK);
+  ASSERT(check_info.active == 1);
+  ASSERT(check_info.ref == 0);
+  ASSERT(tcp_info.type == UV_TCP);
+  ASSERT(tcp_info.active == 0);
+  ASSERT(tcp_info.fd != (uv_os_fd_t) -1);
+  ASSERT(tcp_info.write_queue_size == 0);
+
+  /* 定时器执行一次之后loop退出，再空闲50毫秒 */
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  uv_sleep(50);
+  uv_update_time(loop);
+
+  dump(loop);
+  ASSERT(dump_cb_called == 3);
+  ASSERT(timer_info.active == 0);
+  ASSERT(timer_info.idle_time >= 50);
+  /* check在定时器之后运行，tcp从初始化起就没有过事件 */
+  ASSERT(check_info.idle_time <= timer_info.idle_time);
+  ASSERT(tcp_info.idle_time >= timer_info.idle_time + 10);
+
+  uv_close((uv_handle_t*) &timer, NULL);
+  dump(loop);
+  ASSERT(dump_cb_called == 3);
+  ASSERT(timer_info.closing == 1);
+  ASSERT(tcp_info.closing == 0);
+
+  uv_close((uv_handle_t*) &tcp, NULL);
+  uv_close((uv_handle_t*) &check, NULL);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  dump(loop);
+  ASSERT(dump_cb_called == 0);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -0,0 +1,386 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+# include <sys/socket.h>
+# include <unistd.h>
+#endif
+
+static uv_timer_t timer_handle;
+static int timer_cb_called;
+
+
+static void timer_cb(uv_timer_t* handle) {
+  timer_cb_called++;
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+TEST_IMPL(metrics_info) {
+  uv_metrics_t metrics;
+  uv_loop_t loop;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_metrics_info(&loop, &metrics));
+  ASSERT(0 == metrics.loop_count);
+  ASSERT(0 == metrics.closing_count);
+
+  ASSERT(0 == uv_timer_init(&loop, &timer_handle));
+  ASSERT(0 == uv_timer_start(&timer_handle, timer_cb, 20, 0));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(1 == timer_cb_called);
+
+  ASSERT(0 == uv_metrics_info(&loop, &metrics));
+  ASSERT(metrics.loop_count > 0);
+  ASSERT(1 == metrics.closing_count);
+
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+}
+
+
+#ifndef _WIN32
+static uv_pipe_t pipe_handle;
+static uv_write_t write_req;
+static int write_cb_called;
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  write_cb_called++;
+  uv_close((uv_handle_t*) req->handle, NULL);
+}
+#endif
+
+
+TEST_IMPL(metrics_io) {
+#ifdef _WIN32
+  RETURN_SKIP("Test not implemented on Windows.");
+#else
+  uv_metrics_t metrics;
+  uv_loop_t loop;
+  uv_buf_t buf;
+  int fds[2];
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(&loop, &pipe_handle, 0));
+  ASSERT(0 == uv_pipe_open(&pipe_handle, fds[0]));
+
+  /* The write completes synchronously, its callback is deferred to the
+   * pending queue.
+   */
+  buf = uv_buf_init("PING", 4);
+  ASSERT(0 == uv_write(&write_req, (uv_stream_t*) &pipe_handle, &buf, 1,
+                       write_cb));
+
+  /* Block in the poller for a bit so there is idle time to account for. */
+  ASSERT(0 == uv_timer_init(&loop, &timer_handle));
+  ASSERT(0 == uv_timer_start(&timer_handle, timer_cb, 20, 0));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(1 == write_cb_called);
+  ASSERT(1 == timer_cb_called);
+
+  ASSERT(0 == uv_metrics_info(&loop, &metrics));
+  ASSERT(metrics.pending_count >= 1);
+  ASSERT(2 == metrics.closing_count);
+#ifdef __linux__
+  ASSERT(metrics.poll_count > 0);
+  ASSERT(metrics.idle_time >= 10 * 1000 * 1000);
+#endif
+
+  ASSERT(0 == close(fds[1]));
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+#endif
+}
+
+
+#ifdef __linux__
+static void idle_cb(uv_idle_t* handle) {
+}
+
+
+static void poll_count_alloc_cb(uv_handle_t* handle,
+                                size_t size,
+                                uv_buf_t* buf) {
+  static char slab[64];
+  *buf = uv_buf_init(slab, sizeof(slab));
+}
+
+
+static void poll_count_read_cb(uv_stream_t* stream,
+                               ssize_t nread,
+                               const uv_buf_t* buf) {
+  FATAL("poll_count_read_cb should not be called");
+}
+#endif
+
+
+TEST_IMPL(metrics_poll_count_iouring) {
+#ifndef __linux__
+  RETURN_SKIP("io_uring is Linux-only.");
+#else
+  uv_metrics_t metrics;
+  uv_idle_t idle_handle;
+  uint64_t poll_count;
+  uv_loop_t loop;
+  int fds[2];
+  int i;
+  int r;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  r = uv_loop_configure(&loop, UV_LOOP_USE_IO_URING);
+  if (r == UV_ENOSYS) {
+    ASSERT(0 == uv_loop_close(&loop));
+    RETURN_SKIP("io_uring not supported");
+  }
+  ASSERT(r == 0);
+
+  /* A watched fd keeps the loop polling, the idle handle makes every
+   * uv_run() poll with a zero timeout.
+   */
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(&loop, &pipe_handle, 0));
+  ASSERT(0 == uv_pipe_open(&pipe_handle, fds[0]));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &pipe_handle,
+                            poll_count_alloc_cb,
+                            poll_count_read_cb));
+  ASSERT(0 == uv_idle_init(&loop, &idle_handle));
+  ASSERT(0 == uv_idle_start(&idle_handle, idle_cb));
+
+  /* The first run submits the poll request for the fd. */
+  uv_run(&loop, UV_RUN_NOWAIT);
+  ASSERT(0 == uv_metrics_info(&loop, &metrics));
+  ASSERT(metrics.poll_count > 0);
+  poll_count = metrics.poll_count;
+
+  /* Nothing to submit and nothing to wait for, so the kernel is not entered
+   * and, like with epoll, that is not counted as a poll.
+   */
+  for (i = 0; i < 10; i++)
+    uv_run(&loop, UV_RUN_NOWAIT);
+  ASSERT(0 == uv_metrics_info(&loop, &metrics));
+  ASSERT(metrics.poll_count == poll_count);
+
+  uv_close((uv_handle_t*) &pipe_handle, NULL);
+  uv_close((uv_handle_t*) &idle_handle, NULL);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(0 == close(fds[1]));
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+#endif
+}
+
+
+static void slow_timer_cb(uv_timer_t* handle) {
+  timer_cb_called++;
+  /* A callback that hogs the loop, it should show up in the timers phase. */
+#ifdef _WIN32
+  Sleep(20);
+#else
+  usleep(20 * 1000);
+#endif
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+TEST_IMPL(metrics_phase_histogram) {
+  uv_phase_histogram_t hist;
+  uv_loop_t loop;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(UV_EINVAL == uv_phase_histogram(&loop, UV_PHASE_TIMERS, &hist));
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_PHASE_HISTOGRAMS));
+  ASSERT(UV_EINVAL == uv_phase_histogram(&loop, UV_PHASE_MAX, &hist));
+
+  ASSERT(0 == uv_timer_init(&loop, &timer_handle));
+  ASSERT(0 == uv_timer_start(&timer_handle, slow_timer_cb, 50, 0));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(1 == timer_cb_called);
+
+  ASSERT(0 == uv_phase_histogram(&loop, UV_PHASE_TIMERS, &hist));
+  ASSERT(hist.count > 0);
+  ASSERT(hist.max >= 20 * 1000 * 1000);
+  ASSERT(hist.sum >= hist.max);
+  ASSERT(uv_phase_histogram_percentile(&hist, 100) == hist.max);
+
+  /* The 50 ms spent blocked in the poller is not callback dispatch time. */
+  ASSERT(0 == uv_phase_histogram(&loop, UV_PHASE_POLL, &hist));
+  ASSERT(hist.count > 0);
+  ASSERT(hist.max < 40 * 1000 * 1000);
+
+  ASSERT(0 == uv_phase_histogram(&loop, UV_PHASE_CLOSING, &hist));
+  ASSERT(hist.count > 0);
+
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+}
+
+
+TEST_IMPL(metrics_phase_percentile) {
+  uv_phase_histogram_t hist;
+
+  memset(&hist, 0, sizeof(hist));
+  ASSERT(0 == uv_phase_histogram_percentile(&hist, 99));
+
+  /* 99 samples of 100 ns, they land in [96, 104). */
+  hist.count = 99;
+  hist.sum = 99 * 100;
+  hist.max = 100;
+  hist.buckets[36] = 99;
+  ASSERT(100 == uv_phase_histogram_percentile(&hist, 50));
+
+  /* One sample of 10 us, it lands in [9216, 10240). */
+  hist.count++;
+  hist.sum += 10000;
+  hist.max = 10000;
+  hist.buckets[89]++;
+  ASSERT(103 == uv_phase_histogram_percentile(&hist, 0));
+  ASSERT(103 == uv_phase_histogram_percentile(&hist, 50));
+  ASSERT(103 == uv_phase_histogram_percentile(&hist, 99));
+  ASSERT(10000 == uv_phase_histogram_percentile(&hist, 99.5));
+  ASSERT(10000 == uv_phase_histogram_percentile(&hist, 100));
+
+  return 0;
+}
+
+
+static uv_timer_t lag_timer;
+static int lag_timer_cb_called;
+
+
+static void lag_timer_cb(uv_timer_t* handle) {
+  /* 第二次回调阻塞30毫秒，下一次到期的时间已经过了 */
+  if (++lag_timer_cb_called == 2)
+    uv_sleep(30);
+  if (lag_timer_cb_called == 4)
+    uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+TEST_IMPL(metrics_loop_lag) {
+  uv_phase_histogram_t hist;
+  uv_metrics_t metrics;
+  uv_loop_t loop;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(UV_EINVAL == uv_loop_lag_histogram(&loop, &hist));
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_LAG_HISTOGRAM));
+
+  ASSERT(0 == uv_metrics_info(&loop, &metrics));
+  ASSERT(metrics.lag_count == 0);
+  ASSERT(metrics.lag_max == 0);
+
+  ASSERT(0 == uv_timer_init(&loop, &lag_timer));
+  ASSERT(0 == uv_timer_start(&lag_timer, lag_timer_cb, 5, 5));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(lag_timer_cb_called == 4);
+
+  ASSERT(0 == uv_metrics_info(&loop, &metrics));
+  ASSERT(metrics.lag_count >= 4);
+  ASSERT(metrics.lag_max >= 20 * 1000000);
+  ASSERT(metrics.lag_min <= metrics.lag_max);
+  ASSERT(metrics.lag_sum >= metrics.lag_max);
+  ASSERT(metrics.lag_sum / metrics.lag_count >= metrics.lag_min);
+
+  ASSERT(0 == uv_loop_lag_histogram(&loop, &hist));
+  ASSERT(hist.count == metrics.lag_count);
+  ASSERT(hist.sum == metrics.lag_sum);
+  ASSERT(hist.max == metrics.lag_max);
+  ASSERT(uv_phase_histogram_percentile(&hist, 100) == metrics.lag_max);
+
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+}
+
+
+static uv_mem_stats_t mem_before;
+static int mem_cb_called;
+
+
+static void mem_stat_cb(uv_fs_t* req) {
+  uv_mem_stats_t stats;
+
+  /* 回调里路径还没有释放 */
+  ASSERT(0 == uv_mem_stats(UV_MEM_FS_PATH, &stats));
+  ASSERT(stats.count == mem_before.count + 1);
+  ASSERT(stats.bytes == mem_before.bytes + strlen(req->path) + 1);
+  uv_fs_req_cleanup(req);
+  mem_cb_called++;
+}
+
+
+static void mem_scandir_cb(uv_fs_t* req) {
+  uv_mem_stats_t stats;
+  uv_dirent_t dent;
+
+  ASSERT(req->result > 0);
+  ASSERT(0 == uv_mem_stats(UV_MEM_FS_SCANDIR, &stats));
+  ASSERT(stats.count == mem_before.count + req->result + 1);
+  ASSERT(stats.bytes > mem_before.bytes);
+
+  while (uv_fs_scandir_next(req, &dent) != UV_EOF);
+
+  ASSERT(0 == uv_mem_stats(UV_MEM_FS_SCANDIR, &stats));
+  ASSERT(stats.count == mem_before.count);
+  ASSERT(stats.bytes == mem_before.bytes);
+  uv_fs_req_cleanup(req);
+  mem_cb_called++;
+}
+
+
+TEST_IMPL(metrics_mem_stats) {
+  uv_mem_stats_t stats;
+  uv_fs_t req;
+  char path[200];
+
+  ASSERT(UV_EINVAL == uv_mem_stats(UV_MEM_TAG_MAX, &stats));
+
+  /* 放不进请求里的路径另外分配 */
+  memset(path, 'a', sizeof(path) - 1);
+  path[sizeof(path) - 1] = '\0';
+  ASSERT(0 == uv_mem_stats(UV_MEM_FS_PATH, &mem_before));
+  ASSERT(0 == uv_fs_stat(uv_default_loop(), &req, path, mem_stat_cb));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(0 == uv_mem_stats(UV_MEM_FS_PATH, &stats));
+  ASSERT(stats.count == mem_before.count);
+  ASSERT(stats.bytes == mem_before.bytes);
+  ASSERT(stats.total == mem_before.total + 1);
+
+  ASSERT(0 == uv_mem_stats(UV_MEM_FS_SCANDIR, &mem_before));
+  ASSERT(0 == uv_fs_scandir(uv_default_loop(), &req, ".", 0, mem_scandir_cb));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(mem_cb_called == 2);
+
+  /* loop上有fd的时候就有watcher数组 */
+  ASSERT(0 == uv_mem_stats(UV_MEM_WATCHERS, &stats));
+  ASSERT(stats.count > 0);
+  ASSERT(stats.bytes > 0);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -180,3 +180,113 @@ TEST_IMPL(thread_rwlock_trylock) {
 
   return 0;
 }
+
+
+#define NSPINNERS 4
+#define NSPINS 10000
+
+static uv_spinlock_t spinlock = UV_SPINLOCK_INITIALIZER;
+static int spin_counter;
+
+
+static void spinlock_thread(void* arg) {
+  int i;
+
+  for (i = 0; i < NSPINS; i++) {
+    uv_spinlock_lock(&spinlock);
+    spin_counter++;
+    uv_spinlock_unlock(&spinlock);
+  }
+}
+
+
+TEST_IMPL(thread_spinlock) {
+  uv_thread_t threads[NSPINNERS];
+  uv_spinlock_t lock;
+  int i;
+
+  uv_spinlock_init(&lock);
+  ASSERT(0 == uv_spinlock_trylock(&lock));
+  ASSERT(UV_EBUSY == uv_spinlock_trylock(&lock));
+  uv_spinlock_unlock(&lock);
+  uv_spinlock_lock(&lock);
+  ASSERT(UV_EBUSY == uv_spinlock_trylock(&lock));
+  uv_spinlock_unlock(&lock);
+  ASSERT(0 == uv_spinlock_trylock(&lock));
+  uv_spinlock_unlock(&lock);
+
+  for (i = 0; i < NSPINNERS; i++)
+    ASSERT(0 == uv_thread_create(threads + i, spinlock_thread, NULL));
+
+  for (i = 0; i < NSPINNERS; i++)
+    ASSERT(0 == uv_thread_join(threads + i));
+
+  ASSERT(spin_counter == NSPINNERS * NSPINS);
+  ASSERT(0 == uv_spinlock_trylock(&spinlock));
+  uv_spinlock_unlock(&spinlock);
+
+  return 0;
+}
+
+
+#define NREADERS 4
+#define NREADS 100000
+
+static uv_brlock_t brlock;
+static int br_values[2];
+static int br_stop;
+
+
+static void brlock_reader(void* arg) {
+  int token;
+  int i;
+
+  for (i = 0; i < NREADS; i++) {
+    token = uv_brlock_rdlock(&brlock);
+    ASSERT(br_values[0] == br_values[1]);
+    uv_brlock_rdunlock(&brlock, token);
+  }
+}
+
+
+static void brlock_writer(void* arg) {
+  while (!*(volatile int*) &br_stop) {
+    uv_brlock_wrlock(&brlock);
+    br_values[0]++;
+    br_values[1]++;
+    uv_brlock_wrunlock(&brlock);
+  }
+}
+
+
+TEST_IMPL(thread_brlock) {
+  uv_thread_t threads[NREADERS + 1];
+  int token;
+  int i;
+
+  ASSERT(0 == uv_brlock_init(&brlock));
+
+  /* A fresh lock is biased, so readers stay off the rwlock and a writer
+   * can't get in while one of them is inside.
+   */
+  token = uv_brlock_rdlock(&brlock);
+  ASSERT(token != 0);
+  ASSERT(UV_EBUSY == uv_brlock_trywrlock(&brlock));
+  uv_brlock_rdunlock(&brlock, token);
+  ASSERT(0 == uv_brlock_trywrlock(&brlock));
+  uv_brlock_wrunlock(&brlock);
+
+  for (i = 0; i < NREADERS; i++)
+    ASSERT(0 == uv_thread_create(threads + i, brlock_reader, NULL));
+  ASSERT(0 == uv_thread_create(threads + NREADERS, brlock_writer, NULL));
+
+  for (i = 0; i < NREADERS; i++)
+    ASSERT(0 == uv_thread_join(threads + i));
+  br_stop = 1;
+  ASSERT(0 == uv_thread_join(threads + NREADERS));
+
+  ASSERT(br_values[0] == br_values[1]);
+  uv_brlock_destroy(&brlock);
+
+  return 0;
+}
@@ -0,0 +1,185 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NWARM 2
+#define MAX_CONNS 16
+
+static uv_pipe_t server;
+static uv_pipe_t* conns[MAX_CONNS];
+static int nconns;
+static uv_pipe_pool_t pool;
+static uv_pipe_pool_req_t reqs[3];
+static uv_write_t write_req;
+static uv_pipe_t* first_pipe;
+static int acquire_cb_called;
+static int cancel_cb_called;
+static int pool_close_cb_called;
+
+
+static void close_free_cb(uv_handle_t* handle) {
+  free(handle);
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[64];
+  *buf = uv_buf_init(slab, sizeof(slab));
+}
+
+
+static void server_read_cb(uv_stream_t* stream,
+                           ssize_t nread,
+                           const uv_buf_t* buf) {
+  int i;
+
+  if (nread >= 0)
+    return;
+
+  for (i = 0; i < nconns; i++)
+    if (conns[i] == (uv_pipe_t*) stream)
+      conns[i] = NULL;
+  uv_close((uv_handle_t*) stream, close_free_cb);
+}
+
+
+static void connection_cb(uv_stream_t* handle, int status) {
+  uv_pipe_t* conn;
+
+  ASSERT(status == 0);
+  ASSERT(nconns < MAX_CONNS);
+
+  conn = malloc(sizeof(*conn));
+  ASSERT(conn != NULL);
+  ASSERT(0 == uv_pipe_init(handle->loop, conn, 0));
+  ASSERT(0 == uv_accept(handle, (uv_stream_t*) conn));
+  ASSERT(0 == uv_read_start((uv_stream_t*) conn, alloc_cb, server_read_cb));
+  /* 空闲连接不让loop保持运行，服务端这一头也一样 */
+  uv_unref((uv_handle_t*) conn);
+  conns[nconns++] = conn;
+}
+
+
+static void pool_close_cb(uv_pipe_pool_t* p) {
+  int i;
+
+  ASSERT(p == &pool);
+  pool_close_cb_called++;
+
+  for (i = 0; i < nconns; i++)
+    if (conns[i] != NULL)
+      uv_close((uv_handle_t*) conns[i], close_free_cb);
+  uv_close((uv_handle_t*) &server, NULL);
+}
+
+
+static void cancel_cb(uv_pipe_pool_req_t* req, int status, uv_pipe_t* pipe) {
+  ASSERT(req == &reqs[2]);
+  ASSERT(status == UV_ECANCELED);
+  ASSERT(pipe == NULL);
+  cancel_cb_called++;
+}
+
+
+static void second_cb(uv_pipe_pool_req_t* req, int status, uv_pipe_t* pipe) {
+  ASSERT(req == &reqs[1]);
+  ASSERT(status == 0);
+  acquire_cb_called++;
+
+  /* 刚还回去的连接最先被用到 */
+  ASSERT(pipe == first_pipe);
+  uv_pipe_pool_release(pipe, 0);
+
+  /* 有空闲连接也不会在uv_pipe_pool_acquire()里回调 */
+  ASSERT(0 == uv_pipe_pool_acquire(&pool, &reqs[2], cancel_cb));
+  uv_pipe_pool_close(&pool, pool_close_cb);
+  ASSERT(cancel_cb_called == 1);
+  ASSERT(UV_EINVAL == uv_pipe_pool_acquire(&pool, &reqs[2], cancel_cb));
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+
+  /* 有请求在等，还回去的连接即使超过了nwarm个也不会被关掉 */
+  ASSERT(0 == uv_pipe_pool_acquire(&pool, &reqs[1], second_cb));
+  uv_pipe_pool_release(first_pipe, 1);
+}
+
+
+static void first_cb(uv_pipe_pool_req_t* req, int status, uv_pipe_t* pipe) {
+  uv_buf_t buf;
+
+  ASSERT(req == &reqs[0]);
+  ASSERT(req->pool == &pool);
+  ASSERT(status == 0);
+  acquire_cb_called++;
+
+  first_pipe = pipe;
+  buf = uv_buf_init("x", 1);
+  ASSERT(0 == uv_write(&write_req, (uv_stream_t*) pipe, &buf, 1, write_cb));
+}
+
+
+TEST_IMPL(pipe_pool) {
+  uv_loop_t* loop;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_pipe_init(loop, &server, 0));
+  ASSERT(0 == uv_pipe_bind(&server, TEST_PIPENAME));
+  ASSERT(0 == uv_listen((uv_stream_t*) &server, 16, connection_cb));
+
+  ASSERT(UV_EINVAL == uv_pipe_pool_init(loop, &pool, NULL, NWARM));
+  ASSERT(0 == uv_pipe_pool_init(loop, &pool, TEST_PIPENAME, NWARM));
+  ASSERT(pool.nwarm == NWARM);
+
+  while (nconns < NWARM)
+    uv_run(loop, UV_RUN_ONCE);
+
+  /* 没有人要连接的时候，连好的空闲连接不会让loop一直运行 */
+  uv_unref((uv_handle_t*) &server);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(nconns == NWARM);
+
+  /* 对端关掉一个空闲连接，连接池会发现并补上 */
+  uv_ref((uv_handle_t*) &server);
+  uv_close((uv_handle_t*) conns[0], close_free_cb);
+  conns[0] = NULL;
+  while (nconns == NWARM)
+    uv_run(loop, UV_RUN_ONCE);
+  ASSERT(nconns == NWARM + 1);
+  uv_unref((uv_handle_t*) &server);
+
+  ASSERT(0 == uv_pipe_pool_acquire(&pool, &reqs[0], first_cb));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(acquire_cb_called == 2);
+  ASSERT(cancel_cb_called == 1);
+  ASSERT(pool_close_cb_called == 1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -0,0 +1,119 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(pipe_read_budget) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static uv_pipe_t pipes[2];
+static int fds[2][2];
+static char storage[1024];
+static int nreads[2];
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  buf->base = storage;
+  buf->len = sizeof(storage);
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  ASSERT(nread >= 0);
+  if (nread > 0)
+    nreads[(uv_pipe_t*) stream - pipes]++;
+}
+
+
+/* Runs one loop iteration and returns how often each pipe was read. */
+static void run_once(int* a, int* b) {
+  nreads[0] = 0;
+  nreads[1] = 0;
+  uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+  *a = nreads[0];
+  *b = nreads[1];
+}
+
+
+TEST_IMPL(pipe_read_budget) {
+  char data[16 * 1024];
+  uv_loop_t* loop;
+  int a;
+  int b;
+  int i;
+
+  loop = uv_default_loop();
+  memset(data, 'x', sizeof(data));
+
+  for (i = 0; i < 2; i++) {
+    ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds[i]));
+    ASSERT(sizeof(data) == write(fds[i][1], data, sizeof(data)));
+    ASSERT(0 == uv_pipe_init(loop, pipes + i, 0));
+    ASSERT(0 == uv_pipe_open(pipes + i, fds[i][0]));
+    ASSERT(0 == uv_read_start((uv_stream_t*) (pipes + i), alloc_cb, read_cb));
+  }
+
+  ASSERT(UV_EINVAL == uv_stream_set_read_budget((uv_stream_t*) pipes, 0, 1));
+  ASSERT(UV_EINVAL == uv_loop_configure(loop, UV_LOOP_READ_BUDGET, 0, 0));
+
+  /* A stream budget overrides the loop default of 32 reads. */
+  ASSERT(0 == uv_stream_set_read_budget((uv_stream_t*) pipes, 1, 0));
+  run_once(&a, &b);
+  ASSERT(a == 1);
+  ASSERT(b == 16);
+
+  /* Back to the loop budget, which is now two reads. */
+  ASSERT(sizeof(data) == write(fds[1][1], data, sizeof(data)));
+  ASSERT(0 == uv_stream_set_read_budget((uv_stream_t*) pipes, 0, 0));
+  ASSERT(0 == uv_loop_configure(loop, UV_LOOP_READ_BUDGET, 2, 0));
+  run_once(&a, &b);
+  ASSERT(a == 2);
+  ASSERT(b == 2);
+
+  /* A byte budget stops once it has been used up. */
+  ASSERT(0 == uv_stream_set_read_budget((uv_stream_t*) pipes,
+                                        32,
+                                        3 * sizeof(storage)));
+  run_once(&a, &b);
+  ASSERT(a == 3);
+  ASSERT(b == 2);
+
+  for (i = 0; i < 2; i++) {
+    uv_close((uv_handle_t*) (pipes + i), NULL);
+    ASSERT(0 == close(fds[i][1]));
+  }
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
@@ -0,0 +1,120 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(pipe_read_size_hint) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define BULK_SIZE 10000
+#define SMALL_SIZE 100
+#define SMALL_READS 10
+
+static uv_pipe_t pipe_handle;
+static int fds[2];
+static char storage[64 * 1024];
+static size_t suggested[64];
+static unsigned int nalloc;
+static size_t nreceived;
+static unsigned int nsmall;
+
+
+static void write_all(size_t len) {
+  ssize_t n;
+
+  memset(storage, 'x', len);
+  n = write(fds[1], storage, len);
+  ASSERT(n == (ssize_t) len);
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  ASSERT(size <= sizeof(storage));
+  ASSERT(nalloc < ARRAY_SIZE(suggested));
+  suggested[nalloc++] = size;
+  /* Hand out exactly what was asked for so the hint sees full reads. */
+  buf->base = storage;
+  buf->len = size;
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  ASSERT(nread >= 0);
+  if (nread == 0)
+    return;
+
+  nreceived += nread;
+  if (nreceived < BULK_SIZE)
+    return;
+
+  if (nreceived > BULK_SIZE)
+    nsmall++;
+
+  if (nsmall < SMALL_READS)
+    write_all(SMALL_SIZE);
+  else
+    uv_close((uv_handle_t*) stream, NULL);
+}
+
+
+TEST_IMPL(pipe_read_size_hint) {
+  uv_loop_t* loop;
+
+  loop = uv_default_loop();
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &pipe_handle, 0));
+  ASSERT(0 == uv_pipe_open(&pipe_handle, fds[0]));
+  ASSERT(UV_EINVAL == uv_stream_set_read_size_hint((uv_stream_t*) &pipe_handle,
+                                                   4096,
+                                                   256));
+  ASSERT(0 == uv_stream_set_read_size_hint((uv_stream_t*) &pipe_handle,
+                                           256,
+                                           32 * 1024));
+
+  write_all(BULK_SIZE);
+  ASSERT(0 == uv_read_start((uv_stream_t*) &pipe_handle, alloc_cb, read_cb));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(nsmall == SMALL_READS);
+
+  /* Starts small, jumps to what the kernel has buffered after a full read,
+   * then shrinks back towards the minimum once only small reads arrive.
+   */
+  ASSERT(suggested[0] == 256);
+  ASSERT(suggested[1] >= BULK_SIZE - 256);
+  ASSERT(suggested[nalloc - 1] < suggested[1]);
+  ASSERT(suggested[nalloc - 1] >= 256);
+
+  ASSERT(0 == close(fds[1]));
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
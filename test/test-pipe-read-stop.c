@@ -0,0 +1,131 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+
+#ifndef _WIN32
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define WRITE_SIZE (8 * 1024 * 1024)
+
+static uv_pipe_t pipe_handle;
+static uv_timer_t timer_handle;
+static uv_write_t write_req;
+static int fds[2];
+static char* write_buf;
+static char read_buf[16];
+static int read_cb_called;
+static int write_cb_called;
+
+
+static uint64_t cpu_usage_ms(void) {
+  uv_rusage_t ru;
+
+  ASSERT(0 == uv_getrusage(&ru));
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000 +
+         (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000;
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  buf->base = read_buf;
+  buf->len = sizeof(read_buf);
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  if (nread == 0)
+    return;
+
+  ASSERT(nread == 1);
+  read_cb_called++;
+
+  /* The write is still pending so the watcher keeps its POLLOUT interest.
+   * Stop reading and make the fd readable again: the readable event must
+   * neither be reported nor make the event loop spin.
+   */
+  ASSERT(0 == uv_read_stop(stream));
+  ASSERT(1 == write(fds[1], "y", 1));
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == UV_ECANCELED);
+  write_cb_called++;
+}
+
+
+static void timer_cb(uv_timer_t* handle) {
+  uv_close((uv_handle_t*) &pipe_handle, NULL);
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+TEST_IMPL(pipe_read_stop_pending_write) {
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  uint64_t cpu;
+
+  loop = uv_default_loop();
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &pipe_handle, 0));
+  ASSERT(0 == uv_pipe_open(&pipe_handle, fds[0]));
+
+  write_buf = malloc(WRITE_SIZE);
+  ASSERT(write_buf != NULL);
+  memset(write_buf, 'x', WRITE_SIZE);
+  buf = uv_buf_init(write_buf, WRITE_SIZE);
+  ASSERT(0 == uv_write(&write_req, (uv_stream_t*) &pipe_handle, &buf, 1,
+                       write_cb));
+  ASSERT(0 != uv_stream_get_write_queue_size((uv_stream_t*) &pipe_handle));
+
+  ASSERT(0 == uv_read_start((uv_stream_t*) &pipe_handle, alloc_cb, read_cb));
+  ASSERT(1 == write(fds[1], "x", 1));
+
+  ASSERT(0 == uv_timer_init(loop, &timer_handle));
+  ASSERT(0 == uv_timer_start(&timer_handle, timer_cb, 200, 0));
+
+  cpu = cpu_usage_ms();
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(cpu_usage_ms() - cpu < 100);
+
+  ASSERT(1 == read_cb_called);
+  ASSERT(1 == write_cb_called);
+  ASSERT(0 == close(fds[1]));
+  free(write_buf);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#else  /* !_WIN32 */
+
+TEST_IMPL(pipe_read_stop_pending_write) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#endif  /* _WIN32 */
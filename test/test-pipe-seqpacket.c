@@ -0,0 +1,153 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(pipe_seqpacket) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NMSGS 6
+#define BIG_SIZE (100 * 1024)
+
+static uv_pipe_t server;
+static uv_pipe_t client;
+static uv_pipe_t conn;
+static uv_connect_t connect_req;
+static uv_write_t write_reqs[NMSGS];
+static char* big;
+static char storage[64 * 1024];
+static size_t sizes[NMSGS] = { 1, 10, 100, BIG_SIZE, 1000, 10000 };
+static int nmsgs;
+static int write_cb_called;
+static int emsgsize_called;
+static int eof_called;
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  *buf = uv_buf_init(storage, sizeof(storage));
+}
+
+
+/* 每次read_cb是一条完整的消息，比缓冲区大的那条被丢掉 */
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  ASSERT(stream == (uv_stream_t*) &conn);
+
+  if (nread == UV_EOF) {
+    ASSERT(nmsgs == NMSGS);
+    eof_called++;
+    uv_close((uv_handle_t*) &conn, close_cb);
+    uv_close((uv_handle_t*) &server, close_cb);
+    return;
+  }
+
+  ASSERT(nmsgs < NMSGS);
+  if (sizes[nmsgs] > sizeof(storage)) {
+    ASSERT(nread == UV_EMSGSIZE);
+    emsgsize_called++;
+  } else {
+    ASSERT(nread == (ssize_t) sizes[nmsgs]);
+    ASSERT(0 == memcmp(buf->base, big + nmsgs, nread));
+  }
+  nmsgs++;
+}
+
+
+static void connection_cb(uv_stream_t* handle, int status) {
+  ASSERT(status == 0);
+
+  /* accept()出来的pipe不用另外设置 */
+  ASSERT(0 == uv_pipe_init(handle->loop, &conn, 0));
+  ASSERT(0 == uv_accept(handle, (uv_stream_t*) &conn));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &conn, alloc_cb, read_cb));
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  if (++write_cb_called == NMSGS)
+    uv_close((uv_handle_t*) &client, close_cb);
+}
+
+
+static void connect_cb(uv_connect_t* req, int status) {
+  ASSERT(status == 0);
+}
+
+
+TEST_IMPL(pipe_seqpacket) {
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  int i;
+
+  loop = uv_default_loop();
+  big = malloc(BIG_SIZE + NMSGS);
+  ASSERT(big != NULL);
+  for (i = 0; i < BIG_SIZE + NMSGS; i++)
+    big[i] = 'a' + i % 26;
+
+  ASSERT(UV_EINVAL == uv_pipe_init_ex(loop, &server, 4));
+
+  ASSERT(0 == uv_pipe_init_ex(loop, &server, UV_PIPE_SEQPACKET));
+  ASSERT(0 == uv_pipe_bind(&server, TEST_PIPENAME));
+  ASSERT(0 == uv_listen((uv_stream_t*) &server, 1, connection_cb));
+
+  ASSERT(0 == uv_pipe_init_ex(loop, &client, UV_PIPE_SEQPACKET));
+  uv_pipe_connect(&connect_req, &client, TEST_PIPENAME, connect_cb);
+
+  /* 连接建立之前排队的消息一次发出去，到对端仍然是一条一条的 */
+  for (i = 0; i < NMSGS; i++) {
+    buf = uv_buf_init(big + i, sizes[i]);
+    ASSERT(0 == uv_write(write_reqs + i,
+                         (uv_stream_t*) &client,
+                         &buf,
+                         1,
+                         write_cb));
+  }
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(write_cb_called == NMSGS);
+  ASSERT(nmsgs == NMSGS);
+  ASSERT(emsgsize_called == 1);
+  ASSERT(eof_called == 1);
+  ASSERT(close_cb_called == 3);
+
+  free(big);
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
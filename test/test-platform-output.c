@@ -23,6 +23,11 @@
 #include "task.h"
 #include <string.h>
 
+#ifndef _WIN32
+# include <sys/wait.h>
+# include <unistd.h>
+#endif
+
 
 TEST_IMPL(platform_output) {
   char buffer[512];
@@ -156,3 +161,107 @@ TEST_IMPL(platform_output) {
 
   return 0;
 }
+
+
+TEST_IMPL(platform_cpu_times) {
+  struct uv_cpu_times_s* times;
+  uv_cpu_info_t* cpus;
+  int ncpus;
+  int count;
+  int err;
+  int i;
+
+  err = uv_cpu_info(&cpus, &ncpus);
+#if defined(__CYGWIN__) || defined(__MSYS__)
+  ASSERT(err == UV_ENOSYS);
+  RETURN_SKIP("uv_cpu_info() is not supported on this platform.");
+#endif
+  ASSERT(err == 0);
+
+  /* 先查询需要多少项 */
+  count = 0;
+  ASSERT(UV_ENOBUFS == uv_cpu_times(NULL, &count));
+  ASSERT(count == ncpus);
+  ASSERT(UV_EINVAL == uv_cpu_times(NULL, &count));
+
+  times = malloc(count * sizeof(*times));
+  ASSERT(times != NULL);
+  ASSERT(0 == uv_cpu_times(times, &count));
+  ASSERT(count == ncpus);
+
+  /* 计数只增不减，缓存的型号和第一次读到的一样 */
+  for (i = 0; i < ncpus; i++) {
+    ASSERT(times[i].user >= cpus[i].cpu_times.user);
+    ASSERT(times[i].sys >= cpus[i].cpu_times.sys);
+    ASSERT(times[i].idle >= cpus[i].cpu_times.idle);
+  }
+  uv_free_cpu_info(cpus, ncpus);
+
+  ASSERT(0 == uv_cpu_info(&cpus, &ncpus));
+  ASSERT(count == ncpus);
+  for (i = 0; i < ncpus; i++) {
+    ASSERT(cpus[i].model != NULL);
+    ASSERT(cpus[i].cpu_times.user >= times[i].user);
+    ASSERT(cpus[i].cpu_times.idle >= times[i].idle);
+  }
+  uv_free_cpu_info(cpus, ncpus);
+  free(times);
+
+  return 0;
+}
+
+
+#if !defined(_WIN32)
+/* 返回rss增长的字节数 */
+static uint64_t touch_memory(size_t size) {
+  uv_memory_stats_t before;
+  uv_memory_stats_t after;
+  char* p;
+  size_t i;
+
+  ASSERT(0 == uv_get_memory_stats(&before));
+  p = malloc(size);
+  ASSERT(p != NULL);
+  for (i = 0; i < size; i += 4096)
+    p[i] = 1;
+  ASSERT(0 == uv_get_memory_stats(&after));
+  free(p);
+
+  return after.rss > before.rss ? after.rss - before.rss : 0;
+}
+#endif
+
+
+TEST_IMPL(platform_memory_stats) {
+#if defined(__CYGWIN__) || defined(__MSYS__) || defined(_WIN32)
+  RETURN_SKIP("uv_resident_set_memory() is not supported on this platform.");
+#else
+  uv_memory_stats_t stats;
+  size_t rss;
+  pid_t pid;
+  int status;
+
+  ASSERT(0 == uv_get_memory_stats(&stats));
+  ASSERT(0 == uv_resident_set_memory(&rss));
+  ASSERT(stats.rss > 0);
+  ASSERT(rss > 0);
+#if defined(__linux__)
+  ASSERT(stats.vsize >= stats.rss);
+  ASSERT(stats.text > 0);
+#endif
+
+  ASSERT(touch_memory(32 << 20) >= (16 << 20));
+
+  /* 子进程读到的是自己的数据 */
+  pid = fork();
+  ASSERT(pid != -1);
+  if (pid == 0)
+    _exit(touch_memory(32 << 20) >= (16 << 20) ? 0 : 1);
+
+  ASSERT(pid == waitpid(pid, &status, 0));
+  ASSERT(WIFEXITED(status));
+  ASSERT(WEXITSTATUS(status) == 0);
+
+  return 0;
+#endif
+}
@@ -668,3 +668,129 @@ TEST_IMPL(poll_nested_kqueue) {
   return 0;
 }
 #endif  /* UV_HAVE_KQUEUE */
+
+
+static int et_cb_called;
+
+static void et_poll_cb(uv_poll_t* handle, int status, int events) {
+  ASSERT(status == 0);
+  ASSERT(events == UV_READABLE);
+  et_cb_called++;
+}
+
+
+TEST_IMPL(poll_edge_triggered) {
+#ifndef _WIN32
+  uv_poll_t poll_handle;
+  int fds[2];
+  int r;
+  int i;
+  char buf[2];
+
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_poll_init(uv_default_loop(), &poll_handle, fds[0]));
+  r = uv_poll_start(&poll_handle,
+                    UV_READABLE | UV_EDGE_TRIGGERED,
+                    et_poll_cb);
+  if (r == UV_ENOSYS) {
+    uv_close((uv_handle_t*) &poll_handle, NULL);
+    ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+    ASSERT(0 == close(fds[0]));
+    ASSERT(0 == close(fds[1]));
+    RETURN_SKIP("UV_EDGE_TRIGGERED is not supported on this platform.");
+  }
+  ASSERT(r == 0);
+
+  /* 数据一直没有读走，但是只报告一次 */
+  ASSERT(1 == write(fds[1], "a", 1));
+  for (i = 0; i < 4; i++)
+    ASSERT(0 != uv_run(uv_default_loop(), UV_RUN_NOWAIT));
+  ASSERT(et_cb_called == 1);
+
+  /* 新数据到达又报告一次 */
+  ASSERT(1 == write(fds[1], "b", 1));
+  for (i = 0; i < 4; i++)
+    ASSERT(0 != uv_run(uv_default_loop(), UV_RUN_NOWAIT));
+  ASSERT(et_cb_called == 2);
+
+  /* 重新调用uv_poll_start()时还没读走的数据会再报告一次，即使是在同一轮里
+   * 停止又启动
+   */
+  ASSERT(0 == uv_poll_stop(&poll_handle));
+  ASSERT(0 == uv_poll_start(&poll_handle,
+                            UV_READABLE | UV_EDGE_TRIGGERED,
+                            et_poll_cb));
+  for (i = 0; i < 4; i++)
+    ASSERT(0 != uv_run(uv_default_loop(), UV_RUN_NOWAIT));
+  ASSERT(et_cb_called == 3);
+
+  /* 换回水平触发以后每一轮都报告 */
+  ASSERT(0 == uv_poll_start(&poll_handle, UV_READABLE, et_poll_cb));
+  for (i = 0; i < 4; i++)
+    ASSERT(0 != uv_run(uv_default_loop(), UV_RUN_NOWAIT));
+  ASSERT(et_cb_called == 7);
+
+  ASSERT(2 == read(fds[0], buf, sizeof(buf)));
+  uv_close((uv_handle_t*) &poll_handle, NULL);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(0 == close(fds[0]));
+  ASSERT(0 == close(fds[1]));
+#endif
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+#ifndef _WIN32
+#define BATCH_NFDS 300
+
+static uv_poll_t batch_handles[BATCH_NFDS];
+static int batch_fds[BATCH_NFDS][2];
+static int batch_cb_called;
+
+
+static void batch_poll_cb(uv_poll_t* handle, int status, int events) {
+  ASSERT(status == 0);
+  ASSERT(events == UV_READABLE);
+  ASSERT(0 == uv_poll_stop(handle));
+  batch_cb_called++;
+}
+#endif
+
+
+/* 一轮里注册很多fd，epoll后端会成批提交 */
+TEST_IMPL(poll_batch_register) {
+#ifndef _WIN32
+  int round;
+  int i;
+
+  for (i = 0; i < BATCH_NFDS; i++) {
+    ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, batch_fds[i]));
+    ASSERT(1 == write(batch_fds[i][1], "x", 1));
+    ASSERT(0 == uv_poll_init(uv_default_loop(),
+                             batch_handles + i,
+                             batch_fds[i][0]));
+  }
+
+  /* 第二轮时fd已经从epoll上删除了，按提示用EPOLL_CTL_MOD会失败，要退回ADD */
+  for (round = 1; round <= 2; round++) {
+    for (i = 0; i < BATCH_NFDS; i++)
+      ASSERT(0 == uv_poll_start(batch_handles + i,
+                                UV_READABLE,
+                                batch_poll_cb));
+    ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+    ASSERT(batch_cb_called == round * BATCH_NFDS);
+  }
+
+  for (i = 0; i < BATCH_NFDS; i++) {
+    uv_close((uv_handle_t*) (batch_handles + i), NULL);
+    ASSERT(0 == close(batch_fds[i][0]));
+    ASSERT(0 == close(batch_fds[i][1]));
+  }
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+#endif
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
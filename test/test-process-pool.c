@@ -0,0 +1,280 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+
+#define NJOBS 20
+#define BIG_SIZE (100 * 1024)
+
+static uv_process_pool_t pool;
+static uv_process_options_t options;
+static char exepath[1024];
+static char* args[3];
+static uv_process_job_t jobs[NJOBS + 1];
+static char payloads[NJOBS][16];
+static char* big;
+static int job_cb_called;
+static int close_cb_called;
+static int statuses[NJOBS + 1];
+static char pids[NJOBS + 1][16];
+
+
+static void init_options(void) {
+  size_t exepath_size;
+
+  exepath_size = sizeof(exepath);
+  ASSERT(0 == uv_exepath(exepath, &exepath_size));
+  exepath[exepath_size] = '\0';
+  args[0] = exepath;
+  args[1] = "process_pool_worker";
+  args[2] = NULL;
+  memset(&options, 0, sizeof(options));
+  options.file = exepath;
+  options.args = args;
+}
+
+
+static void read_all(char* buf, size_t len) {
+  ssize_t n;
+
+  while (len > 0) {
+    n = read(0, buf, len);
+    if (n <= 0)
+      exit(n == 0 ? 0 : 1);
+    buf += n;
+    len -= n;
+  }
+}
+
+
+static void write_all(const char* buf, size_t len) {
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(0, buf, len);
+    ASSERT(n > 0);
+    buf += n;
+    len -= n;
+  }
+}
+
+
+/* 进程池里的子进程：把任务转成大写，前面加上自己的pid；"exit"直接退出 */
+int process_pool_worker_helper(void) {
+  unsigned char header[4];
+  char prefix[16];
+  size_t prefix_len;
+  size_t len;
+  size_t i;
+  char* buf;
+
+  notify_parent_process();
+  prefix_len = snprintf(prefix, sizeof(prefix), "%d:", (int) getpid());
+
+  for (;;) {
+    read_all((char*) header, sizeof(header));
+    len = ((size_t) header[0] << 24) | (header[1] << 16) |
+          (header[2] << 8) | header[3];
+
+    buf = malloc(prefix_len + len);
+    ASSERT(buf != NULL);
+    memcpy(buf, prefix, prefix_len);
+    read_all(buf + prefix_len, len);
+
+    if (len == 4 && memcmp(buf + prefix_len, "exit", 4) == 0) {
+      free(buf);
+      return 0;
+    }
+
+    for (i = prefix_len; i < prefix_len + len; i++)
+      buf[i] = toupper((unsigned char) buf[i]);
+
+    len += prefix_len;
+    header[0] = (unsigned char) (len >> 24);
+    header[1] = (unsigned char) (len >> 16);
+    header[2] = (unsigned char) (len >> 8);
+    header[3] = (unsigned char) len;
+    write_all((char*) header, sizeof(header));
+    write_all(buf, len);
+    free(buf);
+  }
+}
+
+
+static void pool_close_cb(uv_process_pool_t* p) {
+  ASSERT(p == &pool);
+  close_cb_called++;
+}
+
+
+/* 记下应答里的pid，检查其余部分是大写的任务 */
+static void job_cb(uv_process_job_t* job, int status, const uv_buf_t* result) {
+  const char* expected;
+  const char* colon;
+  size_t len;
+  size_t i;
+  int n;
+
+  n = job - jobs;
+  ASSERT(n >= 0 && n <= NJOBS);
+  ASSERT(job->pool == &pool);
+  statuses[n] = status;
+  job_cb_called++;
+
+  if (status != 0) {
+    ASSERT(result == NULL);
+    return;
+  }
+
+  colon = memchr(result->base, ':', result->len);
+  ASSERT(colon != NULL);
+  ASSERT((size_t) (colon - result->base) < sizeof(pids[n]));
+  memcpy(pids[n], result->base, colon - result->base);
+
+  expected = n == NJOBS ? big : payloads[n];
+  len = n == NJOBS ? BIG_SIZE : strlen(payloads[n]);
+  ASSERT(result->len == (size_t) (colon - result->base) + 1 + len);
+  for (i = 0; i < len; i++)
+    ASSERT(colon[1 + i] == toupper((unsigned char) expected[i]));
+}
+
+
+static void submit(int n, const char* payload) {
+  uv_buf_t buf;
+
+  snprintf(payloads[n], sizeof(payloads[n]), "%s", payload);
+  buf = uv_buf_init(payloads[n], strlen(payloads[n]));
+  ASSERT(0 == uv_process_pool_submit(&pool, jobs + n, &buf, 1, job_cb));
+}
+
+
+TEST_IMPL(process_pool_basic) {
+  char name[16];
+  uv_buf_t buf;
+  int npids;
+  int i;
+  int j;
+
+  init_options();
+  ASSERT(0 == uv_process_pool_init(uv_default_loop(), &pool, &options, 2));
+  ASSERT(pool.nworkers == 2);
+
+  for (i = 0; i < NJOBS; i++) {
+    snprintf(name, sizeof(name), "job %d", i);
+    submit(i, name);
+  }
+
+  /* 应答比读缓冲区大，直接读进结果里 */
+  big = malloc(BIG_SIZE);
+  ASSERT(big != NULL);
+  for (i = 0; i < BIG_SIZE; i++)
+    big[i] = 'a' + i % 26;
+  buf = uv_buf_init(big, BIG_SIZE);
+  ASSERT(0 == uv_process_pool_submit(&pool, jobs + NJOBS, &buf, 1, job_cb));
+
+  /* 任务做完以后空闲的子进程不会让loop继续运行 */
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(job_cb_called == NJOBS + 1);
+
+  /* 所有任务都由那两个子进程完成 */
+  npids = 0;
+  for (i = 0; i <= NJOBS; i++) {
+    ASSERT(statuses[i] == 0);
+    for (j = 0; j < i; j++)
+      if (strcmp(pids[i], pids[j]) == 0)
+        break;
+    if (j == i)
+      npids++;
+  }
+  ASSERT(npids >= 1 && npids <= 2);
+
+  uv_process_pool_close(&pool, pool_close_cb);
+  ASSERT(UV_EINVAL == uv_process_pool_submit(&pool, jobs, &buf, 1, job_cb));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(close_cb_called == 1);
+
+  free(big);
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(process_pool_respawn) {
+  init_options();
+  ASSERT(0 == uv_process_pool_init(uv_default_loop(), &pool, &options, 1));
+
+  /* 第二个任务让子进程退出，第三个由补上来的新子进程完成 */
+  submit(0, "first");
+  submit(1, "exit");
+  submit(2, "third");
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(job_cb_called == 3);
+  ASSERT(statuses[0] == 0);
+  ASSERT(statuses[1] == UV_EPIPE);
+  ASSERT(statuses[2] == 0);
+  ASSERT(strcmp(pids[0], pids[2]) != 0);
+
+  /* 关闭时正在执行和还在排队的任务都被取消 */
+  submit(3, "fourth");
+  submit(4, "fifth");
+  uv_process_pool_close(&pool, pool_close_cb);
+  ASSERT(job_cb_called == 4);
+  ASSERT(statuses[4] == UV_ECANCELED);
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(job_cb_called == 5);
+  ASSERT(statuses[3] == UV_ECANCELED);
+  ASSERT(close_cb_called == 1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(process_pool_spawn_fail) {
+  init_options();
+  options.file = "./no-such-program";
+  args[0] = "./no-such-program";
+
+  ASSERT(UV_ENOENT ==
+         uv_process_pool_init(uv_default_loop(), &pool, &options, 4));
+
+  /* 失败时已经初始化的handle在后台关闭 */
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  init_options();
+  ASSERT(UV_EINVAL ==
+         uv_process_pool_init(uv_default_loop(), &pool, &options, 0));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+#endif  /* !_WIN32 */
@@ -0,0 +1,287 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(rate_limit_stream) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+TEST_IMPL(rate_limit_read) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+TEST_IMPL(rate_limit_udp) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* 64KB/s，桶里16KB：48KB至少要(48 - 16) / 64 = 0.5秒 */
+#define RATE (64 * 1024)
+#define BURST (16 * 1024)
+#define TOTAL (48 * 1024)
+
+static uv_rate_limit_t limit;
+static uv_pipe_t writers[2];
+static uv_pipe_t readers[2];
+static uv_write_t write_reqs[2];
+static char payload[TOTAL];
+static char slab[8192];
+static size_t nread_total;
+static int write_cb_called;
+static int close_cb_called;
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  *buf = uv_buf_init(slab, sizeof(slab));
+}
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+/* 都写完并且都读到了才关闭 */
+static void maybe_close(void) {
+  int i;
+
+  if (write_cb_called < 2 || nread_total < TOTAL)
+    return;
+
+  /* 还挂在流上 */
+  ASSERT(limit.nhandles == 2);
+  ASSERT(UV_EBUSY == uv_rate_limit_destroy(&limit));
+
+  for (i = 0; i < 2; i++) {
+    uv_close((uv_handle_t*) &writers[i], close_cb);
+    uv_close((uv_handle_t*) &readers[i], close_cb);
+  }
+  ASSERT(limit.nhandles == 0);
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  ASSERT(nread >= 0);
+  nread_total += nread;
+  maybe_close();
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  write_cb_called++;
+  maybe_close();
+}
+
+
+TEST_IMPL(rate_limit_stream) {
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  uint64_t start;
+  uint64_t elapsed;
+  int fds[2];
+  int i;
+
+  loop = uv_default_loop();
+  ASSERT(UV_EINVAL == uv_rate_limit_init(loop, &limit, 0, BURST));
+  ASSERT(0 == uv_rate_limit_init(loop, &limit, RATE, BURST));
+  memset(payload, 'x', sizeof(payload));
+
+  /* 两个流共享同一个限速器，各写一半 */
+  for (i = 0; i < 2; i++) {
+    ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    ASSERT(0 == uv_pipe_init(loop, &writers[i], 0));
+    ASSERT(0 == uv_pipe_open(&writers[i], fds[0]));
+    ASSERT(0 == uv_pipe_init(loop, &readers[i], 0));
+    ASSERT(0 == uv_pipe_open(&readers[i], fds[1]));
+    ASSERT(0 == uv_stream_set_rate_limit((uv_stream_t*) &writers[i],
+                                         NULL,
+                                         &limit));
+    ASSERT(0 == uv_read_start((uv_stream_t*) &readers[i], alloc_cb, read_cb));
+  }
+  ASSERT(limit.nhandles == 2);
+
+  start = uv_hrtime();
+  for (i = 0; i < 2; i++) {
+    buf = uv_buf_init(payload + i * (TOTAL / 2), TOTAL / 2);
+    ASSERT(0 == uv_write(&write_reqs[i],
+                         (uv_stream_t*) &writers[i],
+                         &buf,
+                         1,
+                         write_cb));
+  }
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  elapsed = (uv_hrtime() - start) / 1000000;
+
+  ASSERT(write_cb_called == 2);
+  ASSERT(close_cb_called == 4);
+  ASSERT(nread_total == TOTAL);
+  ASSERT(elapsed >= 400);
+  ASSERT(0 == uv_rate_limit_destroy(&limit));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void limited_read_cb(uv_stream_t* stream,
+                            ssize_t nread,
+                            const uv_buf_t* buf) {
+  ASSERT(nread >= 0);
+  nread_total += nread;
+  if (nread_total == TOTAL)
+    uv_close((uv_handle_t*) stream, close_cb);
+}
+
+
+TEST_IMPL(rate_limit_read) {
+  uv_loop_t* loop;
+  uint64_t start;
+  uint64_t elapsed;
+  int fds[2];
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_rate_limit_init(loop, &limit, RATE, BURST));
+  memset(payload, 'x', sizeof(payload));
+
+  /* 数据一次全写进socket，读的一侧按速率取走 */
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(TOTAL == write(fds[1], payload, TOTAL));
+
+  ASSERT(0 == uv_pipe_init(loop, &readers[0], 0));
+  ASSERT(0 == uv_pipe_open(&readers[0], fds[0]));
+  ASSERT(0 == uv_stream_set_rate_limit((uv_stream_t*) &readers[0],
+                                       &limit,
+                                       NULL));
+
+  start = uv_hrtime();
+  ASSERT(0 == uv_read_start((uv_stream_t*) &readers[0],
+                            alloc_cb,
+                            limited_read_cb));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  elapsed = (uv_hrtime() - start) / 1000000;
+
+  ASSERT(nread_total == TOTAL);
+  ASSERT(close_cb_called == 1);
+  ASSERT(elapsed >= 400);
+  ASSERT(0 == uv_rate_limit_destroy(&limit));
+  ASSERT(0 == close(fds[1]));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+/* 32KB/s，桶里4KB：报文在还有令牌时就能发，最后一个可以欠着，8个2KB的报文
+ * 至少要(16 - 4 - 2) / 32 = 0.31秒
+ */
+#define UDP_NSEND 8
+#define UDP_SIZE 2048
+
+static uv_udp_t udp_server;
+static uv_udp_t udp_client;
+static uv_udp_send_t send_reqs[UDP_NSEND];
+static int send_cb_called;
+static int recv_cb_called;
+
+
+static void udp_alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  *buf = uv_buf_init(slab, sizeof(slab));
+}
+
+
+static void udp_recv_cb(uv_udp_t* handle,
+                        ssize_t nread,
+                        const uv_buf_t* buf,
+                        const struct sockaddr* addr,
+                        unsigned int flags) {
+  ASSERT(nread >= 0);
+  if (nread == 0)
+    return;
+
+  ASSERT(nread == UDP_SIZE);
+  if (++recv_cb_called == UDP_NSEND) {
+    uv_close((uv_handle_t*) &udp_server, close_cb);
+    uv_close((uv_handle_t*) &udp_client, close_cb);
+  }
+}
+
+
+static void udp_send_cb(uv_udp_send_t* req, int status) {
+  ASSERT(status == 0);
+  send_cb_called++;
+}
+
+
+TEST_IMPL(rate_limit_udp) {
+  struct sockaddr_in addr;
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  uint64_t start;
+  uint64_t elapsed;
+  int i;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_rate_limit_init(loop, &limit, 32 * 1024, 4096));
+  memset(payload, 'x', sizeof(payload));
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_udp_init(loop, &udp_server));
+  ASSERT(0 == uv_udp_bind(&udp_server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_udp_recv_start(&udp_server, udp_alloc_cb, udp_recv_cb));
+
+  ASSERT(0 == uv_udp_init(loop, &udp_client));
+  ASSERT(0 == uv_udp_set_rate_limit(&udp_client, NULL, &limit));
+
+  start = uv_hrtime();
+  buf = uv_buf_init(payload, UDP_SIZE);
+  for (i = 0; i < UDP_NSEND; i++)
+    ASSERT(0 == uv_udp_send(&send_reqs[i],
+                            &udp_client,
+                            &buf,
+                            1,
+                            (const struct sockaddr*) &addr,
+                            udp_send_cb));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  elapsed = (uv_hrtime() - start) / 1000000;
+
+  ASSERT(send_cb_called == UDP_NSEND);
+  ASSERT(recv_cb_called == UDP_NSEND);
+  ASSERT(close_cb_called == 2);
+  ASSERT(elapsed >= 250);
+  ASSERT(0 == uv_rate_limit_destroy(&limit));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
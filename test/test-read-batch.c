@@ -0,0 +1,114 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(read_batch) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CHUNK_SIZE 4096
+#define NCHUNKS 10
+
+static uv_pipe_t pipe_handle;
+static char slabs[NCHUNKS + 1][CHUNK_SIZE];
+static char message[NCHUNKS * CHUNK_SIZE];
+static int nalloc;
+static int batch_cb_called;
+static int eof_seen;
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  /* 一批里的缓冲区同时有效，每次给一个新的 */
+  ASSERT(nalloc < (int) ARRAY_SIZE(slabs));
+  *buf = uv_buf_init(slabs[nalloc++], CHUNK_SIZE);
+}
+
+
+static void read_batch_cb(uv_stream_t* stream,
+                          ssize_t nread,
+                          const uv_buf_t bufs[],
+                          unsigned int nbufs) {
+  unsigned int i;
+
+  if (nread == UV_EOF) {
+    /* 数据已经在前一次回调里交出来了 */
+    ASSERT(batch_cb_called == 1);
+    ASSERT(nbufs == 1);
+    ASSERT(bufs[0].len == 0);
+    eof_seen = 1;
+    uv_close((uv_handle_t*) stream, NULL);
+    return;
+  }
+
+  /* 同一个可读事件里的NCHUNKS次读只回调一次 */
+  ASSERT(nread == sizeof(message));
+  ASSERT(nbufs == NCHUNKS);
+  for (i = 0; i < nbufs; i++) {
+    ASSERT(bufs[i].base == slabs[i]);
+    ASSERT(bufs[i].len == CHUNK_SIZE);
+    ASSERT(0 == memcmp(bufs[i].base, message + i * CHUNK_SIZE, CHUNK_SIZE));
+  }
+  batch_cb_called++;
+}
+
+
+TEST_IMPL(read_batch) {
+  uv_loop_t* loop;
+  int fds[2];
+  size_t i;
+
+  for (i = 0; i < sizeof(message); i++)
+    message[i] = (char) i;
+
+  loop = uv_default_loop();
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &pipe_handle, 0));
+  ASSERT(0 == uv_pipe_open(&pipe_handle, fds[0]));
+  ASSERT(UV_EINVAL == uv_read_start_batch((uv_stream_t*) &pipe_handle,
+                                          alloc_cb,
+                                          NULL));
+
+  ASSERT(sizeof(message) == write(fds[1], message, sizeof(message)));
+  ASSERT(0 == close(fds[1]));
+
+  ASSERT(0 == uv_read_start_batch((uv_stream_t*) &pipe_handle,
+                                  alloc_cb,
+                                  read_batch_cb));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(batch_cb_called == 1);
+  ASSERT(eof_seen == 1);
+  ASSERT(nalloc == NCHUNKS + 1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
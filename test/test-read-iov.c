@@ -0,0 +1,116 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(read_iov) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define BODY_SIZE 1000
+
+static uv_pipe_t pipe_handle;
+static char header[4];
+static char body[BODY_SIZE];
+static char message[sizeof(header) + BODY_SIZE];
+static int nalloc;
+static int nmessages;
+static int eof_seen;
+
+
+static void alloc_iov_cb(uv_handle_t* handle,
+                         size_t suggested_size,
+                         uv_buf_t* bufs,
+                         unsigned int* nbufs) {
+  ASSERT(*nbufs >= 2);
+  bufs[0] = uv_buf_init(header, sizeof(header));
+  bufs[1] = uv_buf_init(body, sizeof(body));
+  *nbufs = 2;
+  nalloc++;
+}
+
+
+static void read_iov_cb(uv_stream_t* stream,
+                        ssize_t nread,
+                        const uv_buf_t bufs[],
+                        unsigned int nbufs) {
+  ASSERT(nbufs == 2);
+  ASSERT(bufs[0].base == header);
+  ASSERT(bufs[1].base == body);
+
+  if (nread == UV_EOF) {
+    eof_seen = 1;
+    uv_close((uv_handle_t*) stream, NULL);
+    return;
+  }
+
+  ASSERT(nread >= 0);
+  if (nread == 0)
+    return;
+
+  /* The header and the body come out of a single readv(). */
+  ASSERT(nread == sizeof(message));
+  ASSERT(0 == memcmp(header, message, sizeof(header)));
+  ASSERT(0 == memcmp(body, message + sizeof(header), sizeof(body)));
+  nmessages++;
+}
+
+
+TEST_IMPL(read_iov) {
+  uv_loop_t* loop;
+  int fds[2];
+  size_t i;
+
+  for (i = 0; i < sizeof(message); i++)
+    message[i] = (char) i;
+
+  loop = uv_default_loop();
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &pipe_handle, 0));
+  ASSERT(0 == uv_pipe_open(&pipe_handle, fds[0]));
+  ASSERT(UV_EINVAL == uv_read_start_iov((uv_stream_t*) &pipe_handle,
+                                        NULL,
+                                        read_iov_cb));
+  ASSERT(0 == uv_read_start_iov((uv_stream_t*) &pipe_handle,
+                                alloc_iov_cb,
+                                read_iov_cb));
+
+  ASSERT(sizeof(message) == write(fds[1], message, sizeof(message)));
+  ASSERT(0 == close(fds[1]));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(nmessages == 1);
+  ASSERT(eof_seen == 1);
+  ASSERT(nalloc >= 2);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
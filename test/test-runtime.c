@@ -0,0 +1,273 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "uv.h"
+#include "task.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NLOOPS 4
+#define NHOPS 100
+#define NORDERED 1000
+#define NCONNS 8
+
+static uv_runtime_t runtime;
+static uv_sem_t done_sem;
+static int hops;
+static int ordered_next;
+static int ordered_ok;
+static int ids_ok[NLOOPS];
+
+
+static void id_cb(uv_loop_t* loop, void* arg) {
+  int id;
+
+  id = (int) (intptr_t) arg;
+  if (uv_runtime_id(&runtime) == id && uv_runtime_loop(&runtime, id) == loop)
+    ids_ok[id] = 1;
+  uv_sem_post(&done_sem);
+}
+
+
+/* 在各个loop之间轮流传递，每次只有一个loop在修改hops */
+static void hop_cb(uv_loop_t* loop, void* arg) {
+  int id;
+
+  id = uv_runtime_id(&runtime);
+  ASSERT(id >= 0 && id < NLOOPS);
+  if (++hops == NHOPS) {
+    uv_sem_post(&done_sem);
+    return;
+  }
+
+  ASSERT(0 == uv_runtime_post(&runtime, (id + 1) % NLOOPS, hop_cb, NULL));
+}
+
+
+static void ordered_cb(uv_loop_t* loop, void* arg) {
+  if ((int) (intptr_t) arg != ordered_next)
+    ordered_ok = 0;
+  if (++ordered_next == NORDERED)
+    uv_sem_post(&done_sem);
+}
+
+
+TEST_IMPL(runtime_post) {
+  int i;
+
+  ASSERT(0 == uv_sem_init(&done_sem, 0));
+  ASSERT(0 == uv_runtime_init(&runtime, NLOOPS, 0));
+  ASSERT(runtime.nloops == NLOOPS);
+
+  ASSERT(UV_EINVAL == uv_runtime_id(&runtime));
+  ASSERT(NULL == uv_runtime_loop(&runtime, NLOOPS));
+  ASSERT(UV_EINVAL == uv_runtime_post(&runtime, NLOOPS, id_cb, NULL));
+
+  for (i = 0; i < NLOOPS; i++)
+    ASSERT(0 == uv_runtime_post(&runtime, i, id_cb, (void*) (intptr_t) i));
+  for (i = 0; i < NLOOPS; i++)
+    uv_sem_wait(&done_sem);
+  for (i = 0; i < NLOOPS; i++)
+    ASSERT(ids_ok[i] == 1);
+
+  ASSERT(0 == uv_runtime_post(&runtime, 0, hop_cb, NULL));
+  uv_sem_wait(&done_sem);
+  ASSERT(hops == NHOPS);
+
+  /* 同一个发送方投递的回调按顺序执行 */
+  ordered_ok = 1;
+  for (i = 0; i < NORDERED; i++)
+    ASSERT(0 == uv_runtime_post(&runtime,
+                                1,
+                                ordered_cb,
+                                (void*) (intptr_t) i));
+  uv_sem_wait(&done_sem);
+  ASSERT(ordered_ok == 1);
+
+  ASSERT(0 == uv_runtime_destroy(&runtime));
+  ASSERT(UV_EINVAL == uv_runtime_post(&runtime, 0, id_cb, NULL));
+  ASSERT(UV_EINVAL == uv_runtime_destroy(&runtime));
+
+  uv_sem_destroy(&done_sem);
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static uv_tcp_t clients[NCONNS];
+static uv_connect_t connect_reqs[NCONNS];
+static int connect_cb_called;
+
+
+static void free_close_cb(uv_handle_t* handle) {
+  free(handle);
+}
+
+
+static void server_connection_cb(uv_stream_t* server, int status) {
+  uv_tcp_t* conn;
+
+  ASSERT(status == 0);
+  ASSERT(server->data == &runtime);
+  ASSERT(uv_runtime_id(&runtime) >= 0);
+
+  conn = malloc(sizeof(*conn));
+  ASSERT(conn != NULL);
+  ASSERT(0 == uv_tcp_init(server->loop, conn));
+  ASSERT(0 == uv_accept(server, (uv_stream_t*) conn));
+  uv_close((uv_handle_t*) conn, free_close_cb);
+  uv_sem_post(&done_sem);
+}
+
+
+static void client_connect_cb(uv_connect_t* req, int status) {
+  ASSERT(status == 0);
+  connect_cb_called++;
+  uv_close((uv_handle_t*) req->handle, NULL);
+}
+
+
+TEST_IMPL(runtime_listen) {
+  struct sockaddr_in addr;
+  uv_tcp_t blocker;
+  int i;
+
+  ASSERT(0 == uv_sem_init(&done_sem, 0));
+  ASSERT(0 == uv_runtime_init(&runtime, 2, UV_RUNTIME_PIN_CPUS));
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_runtime_listen(&runtime,
+                                (const struct sockaddr*) &addr,
+                                128,
+                                server_connection_cb,
+                                &runtime));
+
+  for (i = 0; i < NCONNS; i++) {
+    ASSERT(0 == uv_tcp_init(uv_default_loop(), clients + i));
+    ASSERT(0 == uv_tcp_connect(connect_reqs + i,
+                               clients + i,
+                               (const struct sockaddr*) &addr,
+                               client_connect_cb));
+  }
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(connect_cb_called == NCONNS);
+  for (i = 0; i < NCONNS; i++)
+    uv_sem_wait(&done_sem);
+
+  /* 端口已经被一个没有SO_REUSEPORT的套接字占用 */
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT_2, &addr));
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &blocker));
+  ASSERT(0 == uv_tcp_bind(&blocker, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &blocker, 1, NULL));
+  ASSERT(UV_EADDRINUSE == uv_runtime_listen(&runtime,
+                                            (const struct sockaddr*) &addr,
+                                            128,
+                                            server_connection_cb,
+                                            &runtime));
+  uv_close((uv_handle_t*) &blocker, NULL);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(0 == uv_runtime_destroy(&runtime));
+  uv_sem_destroy(&done_sem);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void routed_connection_cb(uv_stream_t* server, int status) {
+  unsigned int napi_id;
+  uv_tcp_t* conn;
+  int cpu;
+  int err;
+
+  ASSERT(status == 0);
+  ASSERT(server->data == &runtime);
+
+  conn = malloc(sizeof(*conn));
+  ASSERT(conn != NULL);
+  ASSERT(0 == uv_tcp_init(server->loop, conn));
+  ASSERT(0 == uv_accept(server, (uv_stream_t*) conn));
+
+  err = uv_socket_incoming((uv_handle_t*) conn, &cpu, &napi_id);
+#ifdef __linux__
+  ASSERT(err == 0);
+  ASSERT(cpu >= -1);
+  /* 回环接口没有NAPI ID，按CPU转发 */
+  if (napi_id == 0 && cpu >= 0)
+    ASSERT(uv_runtime_id(&runtime) == cpu % NLOOPS);
+#else
+  ASSERT(err == 0 || err == UV_ENOTSUP);
+#endif
+
+  uv_close((uv_handle_t*) conn, free_close_cb);
+  uv_sem_post(&done_sem);
+}
+
+
+TEST_IMPL(runtime_listen_route) {
+  struct sockaddr_in addr;
+  int cpu;
+  int i;
+
+  ASSERT(0 == uv_sem_init(&done_sem, 0));
+  ASSERT(UV_EINVAL == uv_runtime_init(&runtime, NLOOPS, 8));
+  ASSERT(0 == uv_runtime_init(&runtime,
+                              NLOOPS,
+                              UV_RUNTIME_ROUTE_CPU | UV_RUNTIME_ROUTE_NAPI));
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_runtime_listen(&runtime,
+                                (const struct sockaddr*) &addr,
+                                128,
+                                routed_connection_cb,
+                                &runtime));
+
+  connect_cb_called = 0;
+  for (i = 0; i < NCONNS; i++) {
+    ASSERT(0 == uv_tcp_init(uv_default_loop(), clients + i));
+    ASSERT(0 == uv_tcp_connect(connect_reqs + i,
+                               clients + i,
+                               (const struct sockaddr*) &addr,
+                               client_connect_cb));
+  }
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(connect_cb_called == NCONNS);
+  for (i = 0; i < NCONNS; i++)
+    uv_sem_wait(&done_sem);
+
+  /* 只能查询TCP和UDP，两个输出都为NULL是参数错误 */
+  ASSERT(UV_EINVAL == uv_socket_incoming((uv_handle_t*) &clients[0],
+                                         NULL,
+                                         NULL));
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), clients));
+  ASSERT(UV_EBADF == uv_socket_incoming((uv_handle_t*) clients, &cpu, NULL));
+  uv_close((uv_handle_t*) clients, NULL);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(0 == uv_runtime_destroy(&runtime));
+  uv_sem_destroy(&done_sem);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -109,3 +109,50 @@ TEST_IMPL(semaphore_3) {
 
   return 0;
 }
+
+
+#define NTHREADS 4
+#define NPOSTS 10000
+
+static uv_sem_t sem_4;
+
+
+static void poster(void* arg) {
+  int i;
+
+  for (i = 0; i < NPOSTS; i++)
+    uv_sem_post(&sem_4);
+}
+
+
+static void waiter(void* arg) {
+  int i;
+
+  for (i = 0; i < NPOSTS; i++)
+    uv_sem_wait(&sem_4);
+}
+
+
+/* 多个线程同时post和wait，计数不能丢 */
+TEST_IMPL(semaphore_4) {
+  uv_thread_t threads[2 * NTHREADS];
+  int i;
+
+  ASSERT(0 == uv_sem_init(&sem_4, 0));
+
+  for (i = 0; i < NTHREADS; i++) {
+    ASSERT(0 == uv_thread_create(threads + 2 * i, waiter, NULL));
+    ASSERT(0 == uv_thread_create(threads + 2 * i + 1, poster, NULL));
+  }
+
+  for (i = 0; i < 2 * NTHREADS; i++)
+    ASSERT(0 == uv_thread_join(threads + i));
+
+  ASSERT(UV_EAGAIN == uv_sem_trywait(&sem_4));
+  uv_sem_post(&sem_4);
+  ASSERT(0 == uv_sem_trywait(&sem_4));
+
+  uv_sem_destroy(&sem_4);
+
+  return 0;
+}
@@ -0,0 +1,230 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+
+#define NPINGS 10
+#define BIG_SIZE 1000
+
+static uv_pipe_t ipc_send;
+static uv_pipe_t ipc_recv;
+static uv_pipe_t peer;
+static uv_pipe_t accepted;
+static uv_write_t write_req;
+static uv_shm_channel_t chan_a;
+static uv_shm_channel_t chan_b;
+static char big[BIG_SIZE];
+static int pings;
+static int pongs;
+static int bigs_sent;
+static int bigs_received;
+static int writable_cb_called;
+static int eof_cb_called;
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void send_str(uv_shm_channel_t* handle, const char* prefix, int n) {
+  char msg[32];
+  uv_buf_t buf;
+
+  snprintf(msg, sizeof(msg), "%s %d", prefix, n);
+  buf = uv_buf_init(msg, strlen(msg));
+  ASSERT(0 == uv_shm_channel_try_send(handle, &buf, 1));
+}
+
+
+/* 环满为止一直发，两段拼成一条消息 */
+static void fill(void) {
+  uv_buf_t bufs[2];
+  int r;
+
+  bufs[0] = uv_buf_init(big, BIG_SIZE / 2);
+  bufs[1] = uv_buf_init(big + BIG_SIZE / 2, BIG_SIZE - BIG_SIZE / 2);
+  for (;;) {
+    r = uv_shm_channel_try_send(&chan_a, bufs, 2);
+    if (r == UV_EAGAIN)
+      break;
+    ASSERT(r == 0);
+    bigs_sent++;
+  }
+}
+
+
+static void a_writable_cb(uv_shm_channel_t* handle) {
+  ASSERT(handle == &chan_a);
+  writable_cb_called++;
+  uv_close((uv_handle_t*) handle, close_cb);
+}
+
+
+static void a_recv_cb(uv_shm_channel_t* handle,
+                      const uv_buf_t* msg,
+                      int status) {
+  char expected[32];
+
+  ASSERT(handle == &chan_a);
+  ASSERT(status == 0);
+  snprintf(expected, sizeof(expected), "pong %d", pongs);
+  ASSERT(msg->len == strlen(expected));
+  ASSERT(0 == memcmp(msg->base, expected, msg->len));
+
+  if (++pongs == NPINGS)
+    fill();
+}
+
+
+static void b_recv_cb(uv_shm_channel_t* handle,
+                      const uv_buf_t* msg,
+                      int status) {
+  char expected[32];
+
+  ASSERT(handle == &chan_b);
+
+  if (status == UV_EOF) {
+    ASSERT(msg == NULL);
+    eof_cb_called++;
+    uv_close((uv_handle_t*) handle, close_cb);
+    return;
+  }
+
+  ASSERT(status == 0);
+
+  if (pings < NPINGS) {
+    snprintf(expected, sizeof(expected), "ping %d", pings);
+    ASSERT(msg->len == strlen(expected));
+    ASSERT(0 == memcmp(msg->base, expected, msg->len));
+    send_str(&chan_b, "pong", pings++);
+    return;
+  }
+
+  ASSERT(msg->len == BIG_SIZE);
+  ASSERT(0 == memcmp(msg->base, big, BIG_SIZE));
+  bigs_received++;
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  uv_close((uv_handle_t*) &peer, close_cb);
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[64];
+  *buf = uv_buf_init(slab, sizeof(slab));
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  int i;
+
+  if (nread <= 0)
+    return;
+
+  ASSERT(1 == uv_pipe_pending_count(&ipc_recv));
+  ASSERT(UV_NAMED_PIPE == uv_pipe_pending_type(&ipc_recv));
+  ASSERT(0 == uv_pipe_init(stream->loop, &accepted, 0));
+  ASSERT(0 == uv_accept(stream, (uv_stream_t*) &accepted));
+
+  ASSERT(0 == uv_shm_channel_init(stream->loop, &chan_b));
+  ASSERT(0 == uv_shm_channel_open(&chan_b, &accepted));
+  ASSERT(UV_EINVAL == uv_shm_channel_open(&chan_b, &accepted));
+
+  /* 通道建好以后IPC pipe和传过来的pipe都不需要了 */
+  uv_close((uv_handle_t*) &accepted, close_cb);
+  uv_close((uv_handle_t*) &ipc_send, close_cb);
+  uv_close((uv_handle_t*) &ipc_recv, close_cb);
+
+  /* 对端还没开始读的时候发出去的消息也能收到 */
+  for (i = 0; i < NPINGS; i++)
+    send_str(&chan_a, "ping", i);
+
+  ASSERT(0 == uv_shm_channel_start(&chan_a, a_recv_cb, a_writable_cb));
+  ASSERT(0 == uv_shm_channel_start(&chan_b, b_recv_cb, NULL));
+}
+
+
+TEST_IMPL(shm_channel) {
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  int fds[2];
+  int i;
+
+  loop = uv_default_loop();
+  for (i = 0; i < BIG_SIZE; i++)
+    big[i] = 'a' + i % 26;
+
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &ipc_send, 1));
+  ASSERT(0 == uv_pipe_open(&ipc_send, fds[0]));
+  ASSERT(0 == uv_pipe_init(loop, &ipc_recv, 1));
+  ASSERT(0 == uv_pipe_open(&ipc_recv, fds[1]));
+
+  ASSERT(0 == uv_shm_channel_init(loop, &chan_a));
+  ASSERT(UV_EINVAL == uv_shm_channel_start(&chan_a, a_recv_cb, NULL));
+  buf = uv_buf_init(big, 1);
+  ASSERT(UV_EINVAL == uv_shm_channel_try_send(&chan_a, &buf, 1));
+
+  /* peer必须是普通的、还没打开的pipe */
+  ASSERT(UV_EINVAL == uv_shm_channel_create(&chan_a, 4096, &ipc_send));
+  ASSERT(0 == uv_pipe_init(loop, &peer, 0));
+  ASSERT(0 == uv_shm_channel_create(&chan_a, 1000, &peer));
+  ASSERT(UV_EINVAL == uv_shm_channel_create(&chan_a, 4096, &peer));
+
+  /* 环向上取整到4KB，一条消息最多是环的一半 */
+  buf = uv_buf_init(big, 4096 / 2 - 8 + 1);
+  ASSERT(UV_EMSGSIZE == uv_shm_channel_try_send(&chan_a, &buf, 1));
+
+  buf = uv_buf_init("x", 1);
+  ASSERT(0 == uv_write2(&write_req,
+                        (uv_stream_t*) &ipc_send,
+                        &buf,
+                        1,
+                        (uv_stream_t*) &peer,
+                        write_cb));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &ipc_recv, alloc_cb, read_cb));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(pings == NPINGS);
+  ASSERT(pongs == NPINGS);
+  ASSERT(bigs_sent > 0);
+  ASSERT(bigs_received == bigs_sent);
+  ASSERT(writable_cb_called == 1);
+  ASSERT(eof_cb_called == 1);
+  ASSERT(close_cb_called == 6);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+#endif  /* !_WIN32 */
@@ -326,4 +326,62 @@ TEST_IMPL(we_get_signals_mixed) {
   return 0;
 }
 
+
+TEST_IMPL(we_get_signals_signalfd) {
+#if defined(__linux__)
+  struct signal_ctx sc[3];
+  struct timer_ctx tc[2];
+  struct sigaction sa;
+  uv_signal_t busy;
+  sigset_t mask;
+  uv_loop_t* loop;
+
+  loop = uv_default_loop();
+
+  /* 已经有启动的信号handle时不能切换 */
+  ASSERT(0 == uv_signal_init(loop, &busy));
+  ASSERT(0 == uv_signal_start(&busy, signal_cb, SIGUSR1));
+  ASSERT(UV_EBUSY == uv_loop_configure(loop, UV_LOOP_SIGNALFD));
+  uv_close((uv_handle_t*) &busy, NULL);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_configure(loop, UV_LOOP_SIGNALFD));
+
+  ASSERT(0 == uv_signal_init(loop, &busy));
+  ASSERT(UV_EINVAL == uv_signal_start(&busy, signal_cb, SIGKILL));
+  uv_close((uv_handle_t*) &busy, NULL);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  start_watcher(loop, SIGUSR1, sc + 0, 0);
+  start_watcher(loop, SIGUSR1, sc + 1, 0);
+  start_watcher(loop, SIGCHLD, sc + 2, 1);
+
+  /* 没有安装信号处理函数，信号在loop线程里被屏蔽 */
+  ASSERT(0 == sigaction(SIGUSR1, NULL, &sa));
+  ASSERT(sa.sa_handler == SIG_DFL);
+  ASSERT(0 == pthread_sigmask(SIG_BLOCK, NULL, &mask));
+  ASSERT(sigismember(&mask, SIGUSR1));
+  ASSERT(sigismember(&mask, SIGCHLD));
+
+  start_timer(loop, SIGUSR1, tc + 0);
+  start_timer(loop, SIGCHLD, tc + 1);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(sc[0].ncalls == NSIGNALS);
+  ASSERT(sc[1].ncalls == NSIGNALS);
+  ASSERT(sc[2].ncalls == 1);
+  ASSERT(tc[0].ncalls == NSIGNALS);
+  ASSERT(tc[1].ncalls == NSIGNALS);
+
+  /* handle都关闭以后恢复原来的信号掩码 */
+  ASSERT(0 == pthread_sigmask(SIG_BLOCK, NULL, &mask));
+  ASSERT(!sigismember(&mask, SIGUSR1));
+  ASSERT(!sigismember(&mask, SIGCHLD));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#else
+  RETURN_SKIP("signalfd is only available on Linux");
+#endif
+}
+
 #endif /* _WIN32 */
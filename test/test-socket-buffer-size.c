@@ -75,3 +75,106 @@ TEST_IMPL(socket_buffer_size) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+#if defined(__linux__)
+static uv_udp_t sender;
+static uv_buf_t recv_slab;
+static int buffer_before;
+static int drained;
+
+
+static void autotune_alloc_cb(uv_handle_t* handle,
+                              size_t suggested_size,
+                              uv_buf_t* buf) {
+  static char slab[2048];
+  *buf = uv_buf_init(slab, sizeof(slab));
+}
+
+
+static void autotune_recv_cb(uv_udp_t* handle,
+                             ssize_t nread,
+                             const uv_buf_t* buf,
+                             const struct sockaddr* addr,
+                             unsigned flags) {
+  struct sockaddr_in dst;
+  int value;
+  int r;
+
+  ASSERT(nread >= 0);
+
+  /* 收空了再发一个报文，它带着之前的丢包数 */
+  if (nread == 0) {
+    if (addr == NULL && !drained) {
+      drained = 1;
+      ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &dst));
+      r = uv_udp_try_send(&sender,
+                          &recv_slab,
+                          1,
+                          (const struct sockaddr*) &dst);
+      ASSERT(r == (int) recv_slab.len);
+    }
+    return;
+  }
+
+  if (!drained)
+    return;
+
+  value = 0;
+  ASSERT(0 == uv_recv_buffer_size((uv_handle_t*) handle, &value));
+  ASSERT(value > buffer_before);
+
+  uv_close((uv_handle_t*) handle, close_cb);
+  uv_close((uv_handle_t*) &sender, close_cb);
+}
+#endif
+
+
+TEST_IMPL(socket_buffer_autotune) {
+#if defined(__linux__)
+  static char payload[1024];
+  struct sockaddr_in addr;
+  int i;
+  int r;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &tcp));
+  ASSERT(UV_ENOTSUP == uv_socket_buffer_autotune((uv_handle_t*) &tcp,
+                                                 4096,
+                                                 65536));
+  uv_close((uv_handle_t*) &tcp, close_cb);
+
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &udp));
+  ASSERT(UV_EBADF == uv_socket_buffer_autotune((uv_handle_t*) &udp,
+                                               4096,
+                                               65536));
+  ASSERT(0 == uv_udp_bind(&udp, (const struct sockaddr*) &addr, 0));
+  ASSERT(UV_EINVAL == uv_socket_buffer_autotune((uv_handle_t*) &udp,
+                                                65536,
+                                                4096));
+  ASSERT(0 == uv_socket_buffer_autotune((uv_handle_t*) &udp, 4096, 65536));
+
+  buffer_before = 0;
+  ASSERT(0 == uv_recv_buffer_size((uv_handle_t*) &udp, &buffer_before));
+
+  /* 不读，把接收缓冲区灌满，让内核丢包 */
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &sender));
+  recv_slab = uv_buf_init(payload, sizeof(payload));
+  for (i = 0; i < 64; i++) {
+    r = uv_udp_try_send(&sender, &recv_slab, 1, (const struct sockaddr*) &addr);
+    ASSERT(r == sizeof(payload));
+  }
+
+  ASSERT(0 == uv_udp_recv_start(&udp, autotune_alloc_cb, autotune_recv_cb));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(drained == 1);
+  ASSERT(close_cb_called == 3);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#else
+  RETURN_SKIP("SO_RXQ_OVFL is Linux only");
+#endif
+}
@@ -36,8 +36,13 @@
 # include <wchar.h>
 #else
 # include <unistd.h>
+# include <sys/stat.h>
 # include <sys/wait.h>
 # include <sched.h>
+# include <signal.h>
+# if defined(__linux__)
+#  include <sys/syscall.h>
+# endif
 # if defined(__FreeBSD__)
 #  include <sys/param.h>
 #  include <sys/cpuset.h>
@@ -169,6 +174,8 @@ static void init_process_options(char* test, uv_exit_cb exit_cb) {
   options.file = exepath;
   options.args = args;
   options.exit_cb = exit_cb;
+  options.exit_ex_cb = NULL;
+  options.stdio_buffer_size = 0;
   options.flags = 0;
 }
 
@@ -229,6 +236,82 @@ TEST_IMPL(spawn_fails_check_for_waitpid_cleanup) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+/* 只给了文件名时按options.env里的PATH找，而不是父进程的PATH */
+TEST_IMPL(spawn_env_path) {
+  char path_env[sizeof(exepath) + 32];
+  char* env[2];
+  char* slash;
+  int r;
+
+  init_process_options("spawn_helper1", exit_cb);
+  slash = strrchr(exepath, '/');
+  ASSERT(slash != NULL);
+
+  *slash = '\0';
+  snprintf(path_env, sizeof(path_env), "PATH=/nonexistent::%s", exepath);
+  *slash = '/';
+
+  env[0] = path_env;
+  env[1] = NULL;
+  options.env = env;
+  options.file = slash + 1;
+
+  r = uv_spawn(uv_default_loop(), &process, &options);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(exit_cb_called == 1);
+  ASSERT(close_cb_called == 1);
+
+  env[0] = "PATH=/nonexistent";
+  r = uv_spawn(uv_default_loop(), &process, &options);
+  ASSERT(r == UV_ENOENT);
+  uv_close((uv_handle_t*) &process, NULL);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+/* 同时跑很多子进程，每个退出都要各自回调一次 */
+TEST_IMPL(spawn_many_exit) {
+  uv_process_t processes[32];
+  struct sigaction sa;
+  int pidfd_ok;
+  int fd;
+  int i;
+
+  pidfd_ok = 0;
+#if defined(__linux__) && defined(SYS_pidfd_open)
+  fd = syscall(SYS_pidfd_open, getpid(), 0);
+  if (fd != -1) {
+    pidfd_ok = 1;
+    close(fd);
+  }
+#else
+  (void) fd;
+#endif
+
+  init_process_options("spawn_helper1", exit_cb);
+
+  for (i = 0; i < (int) ARRAY_SIZE(processes); i++)
+    ASSERT(0 == uv_spawn(uv_default_loop(), processes + i, &options));
+
+  /* 用pidfd的时候不会装SIGCHLD处理函数 */
+  if (pidfd_ok) {
+    ASSERT(0 == sigaction(SIGCHLD, NULL, &sa));
+    ASSERT(sa.sa_handler == SIG_DFL);
+  }
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(exit_cb_called == ARRAY_SIZE(processes));
+  ASSERT(close_cb_called == ARRAY_SIZE(processes));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
 #endif
 
 
@@ -251,6 +334,39 @@ TEST_IMPL(spawn_exit_code) {
 }
 
 
+static void exit_ex_cb(uv_process_t* process,
+                       int64_t exit_status,
+                       int term_signal,
+                       const uv_rusage_t* rusage) {
+  exit_cb_called++;
+  ASSERT(exit_status == 1);
+  ASSERT(term_signal == 0);
+#if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__)
+  /* 子进程自己的数字，至少有一些常驻内存和缺页 */
+  ASSERT(rusage != NULL);
+  ASSERT(rusage->ru_maxrss > 0);
+  ASSERT(rusage->ru_minflt > 0);
+  ASSERT(rusage->ru_utime.tv_sec >= 0 && rusage->ru_utime.tv_usec >= 0);
+#endif
+  uv_close((uv_handle_t*) process, close_cb);
+}
+
+
+TEST_IMPL(spawn_exit_rusage) {
+  init_process_options("spawn_helper1", fail_cb);
+  options.exit_ex_cb = exit_ex_cb;
+
+  ASSERT(0 == uv_spawn(uv_default_loop(), &process, &options));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(exit_cb_called == 1);
+  ASSERT(close_cb_called == 1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
 TEST_IMPL(spawn_stdout) {
   int r;
   uv_pipe_t out;
@@ -595,6 +711,117 @@ TEST_IMPL(spawn_stdin) {
 }
 
 
+TEST_IMPL(spawn_stdin_kernel_pipe) {
+#ifndef _WIN32
+  int r;
+  uv_pipe_t out;
+  uv_pipe_t in;
+  uv_write_t write_req;
+  uv_process_t failed;
+  uv_buf_t buf;
+  uv_stdio_container_t stdio[2];
+  struct stat s;
+  uv_os_fd_t fd;
+  char buffer[] = "hello-from-spawn_stdin_kernel_pipe";
+
+  init_process_options("spawn_helper3", exit_cb);
+
+  uv_pipe_init(uv_default_loop(), &out, 0);
+  uv_pipe_init(uv_default_loop(), &in, 0);
+  options.stdio = stdio;
+  options.stdio[0].flags = UV_CREATE_PIPE | UV_KERNEL_PIPE |
+                           UV_READABLE_PIPE | UV_WRITABLE_PIPE;
+  options.stdio[0].data.stream = (uv_stream_t*)&in;
+  options.stdio[1].flags = UV_CREATE_PIPE | UV_WRITABLE_PIPE;
+  options.stdio[1].data.stream = (uv_stream_t*)&out;
+  options.stdio_count = 2;
+
+  /* pipe(2)是单向的 */
+  ASSERT(UV_EINVAL == uv_spawn(uv_default_loop(), &failed, &options));
+  uv_close((uv_handle_t*) &failed, NULL);
+
+  options.stdio[0].flags = UV_CREATE_PIPE | UV_KERNEL_PIPE | UV_READABLE_PIPE;
+  r = uv_spawn(uv_default_loop(), &process, &options);
+  ASSERT(r == 0);
+
+  ASSERT(0 == uv_fileno((uv_handle_t*) &in, &fd));
+  ASSERT(0 == fstat(fd, &s));
+  ASSERT(S_ISFIFO(s.st_mode));
+  ASSERT(uv_is_writable((uv_stream_t*) &in));
+  ASSERT(!uv_is_readable((uv_stream_t*) &in));
+
+  buf.base = buffer;
+  buf.len = sizeof(buffer);
+  r = uv_write_zerocopy(&write_req, (uv_stream_t*)&in, &buf, 1, write_cb);
+  ASSERT(r == 0);
+
+  r = uv_read_start((uv_stream_t*) &out, on_alloc, on_read);
+  ASSERT(r == 0);
+
+  r = uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+  ASSERT(r == 0);
+
+  ASSERT(exit_cb_called == 1);
+  ASSERT(close_cb_called == 3); /* Once for process twice for the pipe. */
+  ASSERT(strcmp(buffer, output) == 0);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#else
+  RETURN_SKIP("Unix only test");
+#endif
+}
+
+
+TEST_IMPL(spawn_stdio_buffer_size) {
+#ifndef _WIN32
+  uv_stdio_container_t stdio[2];
+  uv_pipe_t out;
+  uv_pipe_t in;
+  uv_os_fd_t fd;
+  socklen_t len;
+  int size;
+
+  init_process_options("spawn_helper1", exit_cb);
+  options.stdio_buffer_size = 1 << 20;
+
+  ASSERT(0 == uv_pipe_init(uv_default_loop(), &in, 0));
+  ASSERT(0 == uv_pipe_init(uv_default_loop(), &out, 0));
+  options.stdio = stdio;
+  options.stdio[0].flags = UV_CREATE_PIPE | UV_KERNEL_PIPE | UV_READABLE_PIPE;
+  options.stdio[0].data.stream = (uv_stream_t*) &in;
+  options.stdio[1].flags = UV_CREATE_PIPE | UV_WRITABLE_PIPE;
+  options.stdio[1].data.stream = (uv_stream_t*) &out;
+  options.stdio_count = 2;
+
+  ASSERT(0 == uv_spawn(uv_default_loop(), &process, &options));
+
+#if defined(F_GETPIPE_SZ)
+  /* pipe-max-size默认就是1MB */
+  ASSERT(0 == uv_fileno((uv_handle_t*) &in, &fd));
+  ASSERT(fcntl(fd, F_GETPIPE_SZ) >= 1 << 20);
+#endif
+
+  /* socketpair那一端调的是SO_SNDBUF/SO_RCVBUF，内核会按rmem_max截断 */
+  ASSERT(0 == uv_fileno((uv_handle_t*) &out, &fd));
+  len = sizeof(size);
+  ASSERT(0 == getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &len));
+  ASSERT(size > 0);
+
+  uv_close((uv_handle_t*) &in, close_cb);
+  uv_close((uv_handle_t*) &out, close_cb);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(exit_cb_called == 1);
+  ASSERT(close_cb_called == 3);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#else
+  RETURN_SKIP("Unix only test");
+#endif
+}
+
+
 TEST_IMPL(spawn_stdio_greater_than_3) {
   int r;
   uv_pipe_t pipe;
@@ -1659,6 +1886,66 @@ TEST_IMPL(spawn_fs_open) {
 #endif  /* !_WIN32 */
 
 
+#if defined(__linux__)
+static void spawn_no_cloexec(int fd, unsigned int flags) {
+  uv_pipe_t in;
+  uv_write_t write_req;
+  uv_buf_t buf;
+  uv_stdio_container_t stdio[1];
+
+  /* uv_exepath()会改写exepath_size */
+  exepath_size = sizeof(exepath);
+  init_process_options("spawn_helper8", exit_cb);
+  options.flags = flags;
+  options.uid = getuid();
+  options.gid = getgid();
+
+  ASSERT(0 == uv_pipe_init(uv_default_loop(), &in, 0));
+
+  options.stdio = stdio;
+  options.stdio[0].flags = UV_CREATE_PIPE | UV_READABLE_PIPE;
+  options.stdio[0].data.stream = (uv_stream_t*) &in;
+  options.stdio_count = 1;
+
+  ASSERT(0 == uv_spawn(uv_default_loop(), &process, &options));
+
+  buf = uv_buf_init((char*) &fd, sizeof(fd));
+  ASSERT(0 == uv_write(&write_req, (uv_stream_t*) &in, &buf, 1, write_cb));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+}
+
+
+/* 没带O_CLOEXEC的fd也不会留给子进程，posix_spawn()和fork()两条路都一样 */
+TEST_IMPL(spawn_no_cloexec_fd) {
+  int fd;
+
+#if defined(SYS_close_range)
+  if (syscall(SYS_close_range, ~0U, ~0U, 4 /* CLOSE_RANGE_CLOEXEC */))
+#endif
+    RETURN_SKIP("close_range(CLOSE_RANGE_CLOEXEC) not supported");
+
+  fd = open("/dev/null", O_RDWR);
+  ASSERT(fd > 2);
+  ASSERT(0 == (fcntl(fd, F_GETFD) & FD_CLOEXEC));
+
+  spawn_no_cloexec(fd, 0);
+  ASSERT(exit_cb_called == 1);
+  ASSERT(close_cb_called == 2);
+
+  /* 设置uid/gid时一定走fork() */
+  spawn_no_cloexec(fd, UV_PROCESS_SETUID | UV_PROCESS_SETGID);
+  ASSERT(exit_cb_called == 2);
+  ASSERT(close_cb_called == 4);
+
+  ASSERT(0 == close(fd));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+#endif
+
+
 #ifndef _WIN32
 TEST_IMPL(closed_fd_events) {
   uv_stdio_container_t stdio[3];
@@ -0,0 +1,100 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(stream_cork) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static uv_pipe_t pipe_handle;
+static uv_write_t write_reqs[3];
+static int write_cb_called;
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  /* Completions keep the order of the writes. */
+  ASSERT(req == write_reqs + write_cb_called);
+  write_cb_called++;
+}
+
+
+TEST_IMPL(stream_cork) {
+  static const char* parts[] = { "HTTP/1.1 200 OK\r\n", "\r\n", "body" };
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  char data[64];
+  ssize_t n;
+  int fds[2];
+  int i;
+
+  loop = uv_default_loop();
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &pipe_handle, 0));
+  ASSERT(0 == uv_pipe_open(&pipe_handle, fds[0]));
+
+  /* Nothing reaches the socket while the stream is corked. */
+  ASSERT(0 == uv_stream_cork((uv_stream_t*) &pipe_handle));
+  for (i = 0; i < 3; i++) {
+    buf = uv_buf_init((char*) parts[i], strlen(parts[i]));
+    ASSERT(0 == uv_write(write_reqs + i,
+                         (uv_stream_t*) &pipe_handle,
+                         &buf,
+                         1,
+                         write_cb));
+  }
+  ASSERT(UV_EAGAIN == uv_try_write((uv_stream_t*) &pipe_handle, &buf, 1));
+  n = recv(fds[1], data, sizeof(data), MSG_DONTWAIT);
+  ASSERT(n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK));
+  uv_run(loop, UV_RUN_NOWAIT);
+  ASSERT(write_cb_called == 0);
+
+  /* Uncorking writes all three requests with a single writev(). */
+  ASSERT(0 == uv_stream_uncork((uv_stream_t*) &pipe_handle));
+  ASSERT(pipe_handle.write_queue_size == 0);
+  n = recv(fds[1], data, sizeof(data), MSG_DONTWAIT);
+  ASSERT(n == (ssize_t) strlen("HTTP/1.1 200 OK\r\n\r\nbody"));
+  ASSERT(0 == memcmp(data, "HTTP/1.1 200 OK\r\n\r\nbody", n));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(write_cb_called == 3);
+  ASSERT(0 == uv_stream_uncork((uv_stream_t*) &pipe_handle));
+
+  uv_close((uv_handle_t*) &pipe_handle, NULL);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(0 == close(fds[1]));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
@@ -0,0 +1,178 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(stream_sendfile) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define FILE_NAME "stream_sendfile_file"
+#define FILE_SIZE (1024 * 1024)
+#define FILE_OFFSET 100
+
+static uv_pipe_t writer;
+static uv_pipe_t reader;
+static uv_write_t write_reqs[4];
+static char* data;
+static char* expected;
+static size_t expected_size;
+static size_t nread_total;
+static int write_cb_called;
+static int short_cb_called;
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  /* Sendfile requests keep their place in the write queue. */
+  ASSERT(req == write_reqs + write_cb_called);
+  write_cb_called++;
+}
+
+
+static void short_cb(uv_write_t* req, int status) {
+  /* The file ends before the requested length. */
+  ASSERT(status == UV_EOF);
+  ASSERT(write_cb_called == 3);
+  short_cb_called++;
+  uv_close((uv_handle_t*) &writer, close_cb);
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[65536];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  if (nread == UV_EOF) {
+    uv_close((uv_handle_t*) stream, close_cb);
+    return;
+  }
+
+  ASSERT(nread >= 0);
+  ASSERT(nread_total + nread <= expected_size);
+  ASSERT(0 == memcmp(buf->base, expected + nread_total, nread));
+  nread_total += nread;
+}
+
+
+TEST_IMPL(stream_sendfile) {
+  static char head[] = "head:";
+  static char tail[] = ":tail";
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  size_t len;
+  size_t i;
+  int fds[2];
+  int fd;
+
+  data = malloc(FILE_SIZE);
+  ASSERT(data != NULL);
+  for (i = 0; i < FILE_SIZE; i++)
+    data[i] = (char) (i * 13 + (i >> 9));
+
+  unlink(FILE_NAME);
+  fd = open(FILE_NAME, O_RDWR | O_CREAT, 0644);
+  ASSERT(fd >= 0);
+  ASSERT(FILE_SIZE == write(fd, data, FILE_SIZE));
+
+  /* The short request still sends the last 10 bytes of the file. */
+  len = FILE_SIZE - FILE_OFFSET;
+  expected_size = sizeof(head) - 1 + len + sizeof(tail) - 1 + 10;
+  expected = malloc(expected_size);
+  ASSERT(expected != NULL);
+  memcpy(expected, head, sizeof(head) - 1);
+  memcpy(expected + sizeof(head) - 1, data + FILE_OFFSET, len);
+  memcpy(expected + sizeof(head) - 1 + len, tail, sizeof(tail) - 1);
+  memcpy(expected + expected_size - 10, data + FILE_SIZE - 10, 10);
+
+  loop = uv_default_loop();
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &writer, 0));
+  ASSERT(0 == uv_pipe_open(&writer, fds[0]));
+  ASSERT(0 == uv_pipe_init(loop, &reader, 0));
+  ASSERT(0 == uv_pipe_open(&reader, fds[1]));
+
+  ASSERT(UV_EINVAL == uv_stream_sendfile(write_reqs + 0,
+                                         (uv_stream_t*) &writer,
+                                         fd,
+                                         0,
+                                         0,
+                                         write_cb));
+
+  buf = uv_buf_init(head, sizeof(head) - 1);
+  ASSERT(0 == uv_write(write_reqs + 0, (uv_stream_t*) &writer, &buf, 1,
+                       write_cb));
+  ASSERT(0 == uv_stream_sendfile(write_reqs + 1,
+                                 (uv_stream_t*) &writer,
+                                 fd,
+                                 FILE_OFFSET,
+                                 len,
+                                 write_cb));
+  ASSERT(writer.write_queue_size > 0);
+  buf = uv_buf_init(tail, sizeof(tail) - 1);
+  ASSERT(0 == uv_write(write_reqs + 2, (uv_stream_t*) &writer, &buf, 1,
+                       write_cb));
+  ASSERT(0 == uv_stream_sendfile(write_reqs + 3,
+                                 (uv_stream_t*) &writer,
+                                 fd,
+                                 FILE_SIZE - 10,
+                                 20,
+                                 short_cb));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &reader, alloc_cb, read_cb));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(write_cb_called == 3);
+  ASSERT(short_cb_called == 1);
+  ASSERT(close_cb_called == 2);
+  ASSERT(nread_total == expected_size);
+
+  ASSERT(0 == close(fd));
+  unlink(FILE_NAME);
+  free(expected);
+  free(data);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
@@ -0,0 +1,203 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(stream_splice) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+TEST_IMPL(stream_splice_close) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#define DATA_SIZE (1024 * 1024)
+
+/* writer -> src ==splice==> dst -> reader */
+static uv_pipe_t writer;
+static uv_pipe_t src;
+static uv_pipe_t dst;
+static uv_pipe_t reader;
+static uv_write_t write_req;
+static uv_shutdown_t shutdown_reqs[2];
+static uv_splice_t splice_req;
+static char* data;
+static size_t nread_total;
+static int splice_cb_called;
+static int reader_eof;
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void open_pair(uv_loop_t* loop, uv_pipe_t* a, uv_pipe_t* b) {
+  int fds[2];
+
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, a, 0));
+  ASSERT(0 == uv_pipe_open(a, fds[0]));
+  ASSERT(0 == uv_pipe_init(loop, b, 0));
+  ASSERT(0 == uv_pipe_open(b, fds[1]));
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[65536];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  if (nread == UV_EOF) {
+    reader_eof = 1;
+    uv_close((uv_handle_t*) stream, close_cb);
+    return;
+  }
+
+  ASSERT(nread >= 0);
+  ASSERT(nread_total + nread <= DATA_SIZE);
+  ASSERT(0 == memcmp(buf->base, data + nread_total, nread));
+  nread_total += nread;
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+}
+
+
+static void shutdown_cb(uv_shutdown_t* req, int status) {
+  ASSERT(status == 0);
+  uv_close((uv_handle_t*) req->handle, close_cb);
+}
+
+
+static void splice_cb(uv_splice_t* req, int status) {
+  ASSERT(status == 0);
+  ASSERT(req->nbytes == DATA_SIZE);
+  splice_cb_called++;
+
+  /* Pass the EOF on to the reader. */
+  ASSERT(0 == uv_shutdown(shutdown_reqs + 1, (uv_stream_t*) &dst, shutdown_cb));
+  uv_close((uv_handle_t*) &src, close_cb);
+}
+
+
+TEST_IMPL(stream_splice) {
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  size_t i;
+
+  data = malloc(DATA_SIZE);
+  ASSERT(data != NULL);
+  for (i = 0; i < DATA_SIZE; i++)
+    data[i] = (char) (i * 7 + (i >> 10));
+
+  loop = uv_default_loop();
+  open_pair(loop, &writer, &src);
+  open_pair(loop, &dst, &reader);
+
+  ASSERT(0 == uv_stream_splice(&splice_req,
+                               (uv_stream_t*) &src,
+                               (uv_stream_t*) &dst,
+                               splice_cb));
+  ASSERT(UV_EBUSY == uv_stream_splice(&splice_req,
+                                      (uv_stream_t*) &src,
+                                      (uv_stream_t*) &writer,
+                                      splice_cb));
+  ASSERT(UV_EBUSY == uv_read_start((uv_stream_t*) &src, alloc_cb, read_cb));
+  buf = uv_buf_init(data, 1);
+  ASSERT(UV_EBUSY == uv_write(&write_req, (uv_stream_t*) &dst, &buf, 1,
+                              write_cb));
+
+  /* More than the socket buffers hold, so both directions block. */
+  buf = uv_buf_init(data, DATA_SIZE);
+  ASSERT(0 == uv_write(&write_req, (uv_stream_t*) &writer, &buf, 1, write_cb));
+  ASSERT(0 == uv_shutdown(shutdown_reqs + 0,
+                          (uv_stream_t*) &writer,
+                          shutdown_cb));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &reader, alloc_cb, read_cb));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(splice_cb_called == 1);
+  ASSERT(reader_eof == 1);
+  ASSERT(nread_total == DATA_SIZE);
+  ASSERT(close_cb_called == 4);
+
+  free(data);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void splice_close_cb(uv_splice_t* req, int status) {
+  ASSERT(status == UV_ECANCELED);
+  splice_cb_called++;
+}
+
+
+TEST_IMPL(stream_splice_close) {
+  uv_loop_t* loop;
+
+  loop = uv_default_loop();
+  open_pair(loop, &writer, &src);
+  open_pair(loop, &dst, &reader);
+
+  ASSERT(0 == uv_stream_splice(&splice_req,
+                               (uv_stream_t*) &src,
+                               (uv_stream_t*) &dst,
+                               splice_close_cb));
+  uv_close((uv_handle_t*) &dst, close_cb);
+  ASSERT(splice_cb_called == 0);
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(splice_cb_called == 1);
+  ASSERT(close_cb_called == 1);
+
+  /* Both ends are free again. */
+  ASSERT(0 == uv_read_start((uv_stream_t*) &src, alloc_cb, read_cb));
+
+  uv_close((uv_handle_t*) &writer, close_cb);
+  uv_close((uv_handle_t*) &src, close_cb);
+  uv_close((uv_handle_t*) &reader, close_cb);
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(close_cb_called == 4);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
@@ -0,0 +1,202 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(stream_timeouts_read) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+TEST_IMPL(stream_timeouts_write) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <string.h>
+#include <sys/socket.h>
+
+#define NPINGS 5
+#define PING_INTERVAL 20
+#define READ_TIMEOUT 60
+#define CHUNK_SIZE 65536
+
+static uv_pipe_t writer;
+static uv_pipe_t reader;
+static uv_timer_t ping_timer;
+static uv_write_t write_reqs[64];
+static char chunk[CHUNK_SIZE];
+static uint64_t start_time;
+static int pings;
+static int nread_calls;
+static int timeout_cb_called;
+static int write_cb_called;
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[65536];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  ASSERT(nread >= 0);
+  if (nread > 0)
+    nread_calls++;
+}
+
+
+static void ping_cb(uv_timer_t* timer) {
+  uv_buf_t buf;
+
+  buf = uv_buf_init("x", 1);
+  ASSERT(1 == uv_try_write((uv_stream_t*) &writer, &buf, 1));
+
+  if (++pings == NPINGS)
+    uv_timer_stop(timer);
+}
+
+
+static void read_timeout_cb(uv_stream_t* handle, int which) {
+  ASSERT(handle == (uv_stream_t*) &reader);
+  ASSERT(which == UV_STREAM_TIMEOUT_READ);
+  ASSERT(pings == NPINGS);
+  ASSERT(nread_calls == NPINGS);
+
+  /* 每次读到数据都重新计时，最后一次之后才超时 */
+  ASSERT(uv_now(handle->loop) - start_time >=
+         (NPINGS - 1) * PING_INTERVAL + READ_TIMEOUT);
+  timeout_cb_called++;
+
+  uv_close((uv_handle_t*) &reader, close_cb);
+  uv_close((uv_handle_t*) &writer, close_cb);
+  uv_close((uv_handle_t*) &ping_timer, close_cb);
+}
+
+
+TEST_IMPL(stream_timeouts_read) {
+  uv_loop_t* loop;
+  int fds[2];
+
+  loop = uv_default_loop();
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &writer, 0));
+  ASSERT(0 == uv_pipe_open(&writer, fds[0]));
+  ASSERT(0 == uv_pipe_init(loop, &reader, 0));
+  ASSERT(0 == uv_pipe_open(&reader, fds[1]));
+
+  ASSERT(UV_EINVAL == uv_stream_set_timeouts((uv_stream_t*) &reader,
+                                             0,
+                                             READ_TIMEOUT,
+                                             0,
+                                             NULL));
+  ASSERT(0 == uv_stream_set_timeouts((uv_stream_t*) &reader,
+                                     0,
+                                     READ_TIMEOUT,
+                                     0,
+                                     read_timeout_cb));
+  /* 没有设置超时的流上取消也没关系 */
+  ASSERT(0 == uv_stream_set_timeouts((uv_stream_t*) &writer, 0, 0, 0, NULL));
+
+  start_time = uv_now(loop);
+  ASSERT(0 == uv_read_start((uv_stream_t*) &reader, alloc_cb, read_cb));
+  ASSERT(0 == uv_timer_init(loop, &ping_timer));
+  ASSERT(0 == uv_timer_start(&ping_timer,
+                             ping_cb,
+                             PING_INTERVAL,
+                             PING_INTERVAL));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(timeout_cb_called == 1);
+  ASSERT(close_cb_called == 3);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0 || status == UV_ECANCELED);
+  write_cb_called++;
+}
+
+
+static void write_timeout_cb(uv_stream_t* handle, int which) {
+  ASSERT(handle == (uv_stream_t*) &writer);
+  ASSERT(which == UV_STREAM_TIMEOUT_WRITE);
+  ASSERT(writer.write_queue_size > 0);
+  timeout_cb_called++;
+
+  uv_close((uv_handle_t*) &reader, close_cb);
+  uv_close((uv_handle_t*) &writer, close_cb);
+}
+
+
+TEST_IMPL(stream_timeouts_write) {
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  int fds[2];
+  int i;
+
+  loop = uv_default_loop();
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &writer, 0));
+  ASSERT(0 == uv_pipe_open(&writer, fds[0]));
+  ASSERT(0 == uv_pipe_init(loop, &reader, 0));
+  ASSERT(0 == uv_pipe_open(&reader, fds[1]));
+
+  /* 写的超时比空闲的短，对端不读，写不出去先超时 */
+  ASSERT(0 == uv_stream_set_timeouts((uv_stream_t*) &writer,
+                                     10 * READ_TIMEOUT,
+                                     0,
+                                     READ_TIMEOUT,
+                                     write_timeout_cb));
+
+  memset(chunk, 'x', sizeof(chunk));
+  buf = uv_buf_init(chunk, sizeof(chunk));
+  for (i = 0; i < (int) ARRAY_SIZE(write_reqs); i++)
+    ASSERT(0 == uv_write(write_reqs + i,
+                         (uv_stream_t*) &writer,
+                         &buf,
+                         1,
+                         write_cb));
+  ASSERT(writer.write_queue_size > 0);
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(timeout_cb_called == 1);
+  ASSERT(write_cb_called > 0);
+  ASSERT(close_cb_called == 2);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
@@ -0,0 +1,165 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(stream_write_watermarks) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <string.h>
+#include <sys/socket.h>
+
+#define CHUNK_SIZE 8192
+#define NCHUNKS 64
+#define LOW_WATERMARK (16 * 1024)
+#define HIGH_WATERMARK (64 * 1024)
+
+static uv_pipe_t writer;
+static uv_pipe_t reader;
+static uv_write_t write_reqs[NCHUNKS];
+static char chunk[CHUNK_SIZE];
+static size_t nread_total;
+static int above_cb_called;
+static int below_cb_called;
+static int write_cb_called;
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void watermark_cb(uv_stream_t* handle, int above) {
+  ASSERT(handle == (uv_stream_t*) &writer);
+
+  if (above) {
+    ASSERT(above_cb_called == below_cb_called);
+    ASSERT(writer.write_queue_size > HIGH_WATERMARK);
+    above_cb_called++;
+  } else {
+    ASSERT(above_cb_called == below_cb_called + 1);
+    ASSERT(writer.write_queue_size <= LOW_WATERMARK);
+    below_cb_called++;
+  }
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  write_cb_called++;
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[65536];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  ASSERT(nread >= 0);
+  nread_total += nread;
+
+  if (nread_total == CHUNK_SIZE * NCHUNKS) {
+    uv_close((uv_handle_t*) &writer, close_cb);
+    uv_close((uv_handle_t*) &reader, close_cb);
+  }
+}
+
+
+TEST_IMPL(stream_write_watermarks) {
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  int fds[2];
+  int i;
+
+  loop = uv_default_loop();
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &writer, 0));
+  ASSERT(0 == uv_pipe_open(&writer, fds[0]));
+  ASSERT(0 == uv_pipe_init(loop, &reader, 0));
+  ASSERT(0 == uv_pipe_open(&reader, fds[1]));
+
+  ASSERT(UV_EINVAL == uv_stream_set_write_watermarks((uv_stream_t*) &writer,
+                                                     2,
+                                                     1,
+                                                     watermark_cb));
+  ASSERT(0 == uv_stream_set_write_watermarks((uv_stream_t*) &writer,
+                                             LOW_WATERMARK,
+                                             HIGH_WATERMARK,
+                                             watermark_cb));
+
+  /* Nobody reads yet, so the queue grows past the high watermark. */
+  memset(chunk, 'x', sizeof(chunk));
+  buf = uv_buf_init(chunk, sizeof(chunk));
+  for (i = 0; i < NCHUNKS; i++)
+    ASSERT(0 == uv_write(write_reqs + i,
+                         (uv_stream_t*) &writer,
+                         &buf,
+                         1,
+                         write_cb));
+  ASSERT(above_cb_called == 1);
+  ASSERT(below_cb_called == 0);
+
+  ASSERT(0 == uv_read_start((uv_stream_t*) &reader, alloc_cb, read_cb));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(above_cb_called == 1);
+  ASSERT(below_cb_called == 1);
+  ASSERT(write_cb_called == NCHUNKS);
+  ASSERT(close_cb_called == 2);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
+
+
+TEST_IMPL(tcp_notsent_lowat) {
+  struct sockaddr_in addr;
+  uv_tcp_t handle;
+  int r;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &handle));
+
+  /* No socket yet. */
+  ASSERT(UV_EBADF == uv_tcp_notsent_lowat(&handle, 16384));
+
+  ASSERT(0 == uv_tcp_bind(&handle, (const struct sockaddr*) &addr, 0));
+  r = uv_tcp_notsent_lowat(&handle, 16384);
+  ASSERT(r == 0 || r == UV_ENOTSUP);
+
+  uv_close((uv_handle_t*) &handle, NULL);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -0,0 +1,135 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(stream_write_batch) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <string.h>
+#include <sys/socket.h>
+
+#define NREQS 8
+#define NOCB_SIZE (256 * 1024)
+
+static uv_pipe_t writer;
+static uv_pipe_t reader;
+static uv_write_t write_reqs[NREQS];
+static uv_write_t cb_req;
+static char nocb_data[NOCB_SIZE];
+static size_t nread_total;
+static int batch_cb_called;
+static int nbatched;
+static int write_cb_called;
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[65536];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  ASSERT(nread >= 0);
+  ASSERT(NULL == memchr(buf->base, 'z', nread));
+  nread_total += nread;
+
+  if (nread_total == NREQS + 1 + NOCB_SIZE) {
+    uv_close((uv_handle_t*) &writer, NULL);
+    uv_close((uv_handle_t*) &reader, NULL);
+  }
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(req == &cb_req);
+  ASSERT(status == 0);
+  write_cb_called++;
+}
+
+
+static void write_batch_cb(uv_stream_t* stream,
+                           uv_write_t* reqs[],
+                           const int status[],
+                           unsigned int nreqs) {
+  unsigned int i;
+
+  ASSERT(stream == (uv_stream_t*) &writer);
+  for (i = 0; i < nreqs; i++) {
+    ASSERT(reqs[i] == &write_reqs[nbatched + i]);
+    ASSERT(status[i] == 0);
+  }
+  nbatched += nreqs;
+  batch_cb_called++;
+}
+
+
+TEST_IMPL(stream_write_batch) {
+  uv_loop_t* loop;
+  uv_buf_t buf;
+  int fds[2];
+  int i;
+
+  loop = uv_default_loop();
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(loop, &writer, 0));
+  ASSERT(0 == uv_pipe_open(&writer, fds[0]));
+  ASSERT(0 == uv_pipe_init(loop, &reader, 0));
+  ASSERT(0 == uv_pipe_open(&reader, fds[1]));
+  ASSERT(0 == uv_stream_set_write_batch_cb((uv_stream_t*) &writer,
+                                           write_batch_cb));
+
+  /* 没有回调的请求一起交给write_batch_cb，有回调的照常回调 */
+  buf = uv_buf_init("x", 1);
+  for (i = 0; i < NREQS; i++)
+    ASSERT(0 == uv_write(write_reqs + i,
+                         (uv_stream_t*) &writer,
+                         &buf,
+                         1,
+                         NULL));
+  ASSERT(0 == uv_write(&cb_req, (uv_stream_t*) &writer, &buf, 1, write_cb));
+
+  /* 写不完的部分复制走了，调用返回后改掉数据也没关系 */
+  memset(nocb_data, 'y', sizeof(nocb_data));
+  buf = uv_buf_init(nocb_data, sizeof(nocb_data));
+  ASSERT(0 == uv_write_nocb((uv_stream_t*) &writer, &buf, 1));
+  memset(nocb_data, 'z', sizeof(nocb_data));
+
+  ASSERT(0 == uv_read_start((uv_stream_t*) &reader, alloc_cb, read_cb));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(batch_cb_called == 1);
+  ASSERT(nbatched == NREQS);
+  ASSERT(write_cb_called == 1);
+  ASSERT(nread_total == NREQS + 1 + NOCB_SIZE);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
@@ -0,0 +1,166 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#define NCLIENTS 5
+
+static uv_tcp_t server;
+static uv_tcp_t clients[NCLIENTS];
+static uv_tcp_t accepted[NCLIENTS];
+static uv_connect_t connect_reqs[NCLIENTS];
+static int naccepted;
+static int connect_cb_called;
+static int connection_cb_called;
+static int close_cb_called;
+static int accept_all;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void maybe_done(void) {
+  int i;
+
+  if (naccepted < NCLIENTS || connect_cb_called < NCLIENTS)
+    return;
+
+  for (i = 0; i < NCLIENTS; i++) {
+    uv_close((uv_handle_t*) &clients[i], close_cb);
+    uv_close((uv_handle_t*) &accepted[i], close_cb);
+  }
+  uv_close((uv_handle_t*) &server, close_cb);
+}
+
+
+static int accept_one(uv_stream_t* server) {
+  int r;
+
+  ASSERT(naccepted < NCLIENTS);
+  ASSERT(0 == uv_tcp_init(server->loop, &accepted[naccepted]));
+  r = uv_accept(server, (uv_stream_t*) &accepted[naccepted]);
+  if (r != 0) {
+    uv_close((uv_handle_t*) &accepted[naccepted], NULL);
+    return r;
+  }
+
+  naccepted++;
+  return 0;
+}
+
+
+static void connection_cb(uv_stream_t* server, int status) {
+  ASSERT(status == 0);
+  connection_cb_called++;
+
+  if (accept_all) {
+    while (naccepted < NCLIENTS && accept_one(server) == 0);
+  } else {
+    ASSERT(0 == accept_one(server));
+  }
+
+  maybe_done();
+}
+
+
+static void connect_cb(uv_connect_t* req, int status) {
+  ASSERT(status == 0);
+  connect_cb_called++;
+  maybe_done();
+}
+
+
+static void run_burst(int all) {
+  struct sockaddr_in addr;
+  uv_loop_t* loop;
+  int i;
+
+  accept_all = all;
+  naccepted = 0;
+  connect_cb_called = 0;
+  connection_cb_called = 0;
+  close_cb_called = 0;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(loop, &server));
+  ASSERT(0 == uv_tcp_bind(&server, (const struct sockaddr*) &addr, 0));
+  ASSERT(UV_EINVAL == uv_stream_set_accept_burst((uv_stream_t*) &server, 0));
+  ASSERT(0 == uv_stream_set_accept_burst((uv_stream_t*) &server, 8));
+  ASSERT(0 == uv_listen((uv_stream_t*) &server, 16, connection_cb));
+
+  for (i = 0; i < NCLIENTS; i++) {
+    ASSERT(0 == uv_tcp_init(loop, &clients[i]));
+    ASSERT(0 == uv_tcp_connect(&connect_reqs[i],
+                               &clients[i],
+                               (const struct sockaddr*) &addr,
+                               connect_cb));
+  }
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(naccepted == NCLIENTS);
+  ASSERT(connect_cb_called == NCLIENTS);
+  ASSERT(close_cb_called == 2 * NCLIENTS + 1);
+}
+
+
+TEST_IMPL(tcp_accept_burst) {
+  run_burst(1);
+  ASSERT(connection_cb_called <= NCLIENTS);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(tcp_accept_burst_one_by_one) {
+  /* One uv_accept() per callback still drains the whole burst. */
+  run_burst(0);
+  ASSERT(connection_cb_called == NCLIENTS);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(tcp_defer_accept) {
+  struct sockaddr_in addr;
+  uv_tcp_t handle;
+  int r;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &handle));
+  ASSERT(UV_EBADF == uv_tcp_defer_accept(&handle, 1));
+
+  ASSERT(0 == uv_tcp_bind(&handle, (const struct sockaddr*) &addr, 0));
+  r = uv_tcp_defer_accept(&handle, 1);
+  ASSERT(r == 0 || r == UV_ENOTSUP);
+
+  uv_close((uv_handle_t*) &handle, NULL);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
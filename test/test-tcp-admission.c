@@ -0,0 +1,169 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#define NCLIENTS 3
+
+static uv_tcp_t server;
+static uv_tcp_t clients[NCLIENTS];
+static uv_tcp_t accepted[NCLIENTS];
+static uv_connect_t connect_reqs[NCLIENTS];
+static uv_timer_t release_timer;
+static int naccepted;
+static int nclosed;
+static int connect_cb_called;
+static int close_cb_called;
+static int paused_cb_called;
+static int resumed_cb_called;
+static int lag_mode;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void maybe_done(void) {
+  int i;
+
+  if (naccepted < NCLIENTS || connect_cb_called < NCLIENTS)
+    return;
+
+  for (i = 0; i < NCLIENTS; i++) {
+    uv_close((uv_handle_t*) &clients[i], close_cb);
+    if (i >= nclosed)
+      uv_close((uv_handle_t*) &accepted[i], close_cb);
+  }
+  uv_close((uv_handle_t*) &server, close_cb);
+}
+
+
+static void connection_cb(uv_stream_t* server, int status) {
+  ASSERT(status == 0);
+  ASSERT(naccepted < NCLIENTS);
+  ASSERT(0 == uv_tcp_init(server->loop, &accepted[naccepted]));
+  ASSERT(0 == uv_accept(server, (uv_stream_t*) &accepted[naccepted]));
+  naccepted++;
+
+  /* 模拟处理得很慢的一轮，后面的连接要等到延迟降下来才接受 */
+  if (lag_mode)
+    uv_sleep(20);
+
+  maybe_done();
+}
+
+
+static void connect_cb(uv_connect_t* req, int status) {
+  ASSERT(status == 0);
+  connect_cb_called++;
+  maybe_done();
+}
+
+
+static void release_cb(uv_timer_t* handle) {
+  /* 关掉一个连接，服务端降到上限以下自动恢复 */
+  ASSERT(resumed_cb_called == 0);
+  uv_close((uv_handle_t*) &accepted[0], close_cb);
+  nclosed++;
+  ASSERT(resumed_cb_called == 1);
+  uv_close((uv_handle_t*) handle, close_cb);
+}
+
+
+static void admission_cb(uv_stream_t* handle, int paused) {
+  ASSERT(handle == (uv_stream_t*) &server);
+
+  if (!paused) {
+    resumed_cb_called++;
+    return;
+  }
+
+  paused_cb_called++;
+  if (lag_mode)
+    return;
+
+  ASSERT(naccepted == NCLIENTS - 1);
+  ASSERT(0 == uv_timer_init(handle->loop, &release_timer));
+  ASSERT(0 == uv_timer_start(&release_timer, release_cb, 10, 0));
+}
+
+
+static void run_admission(unsigned int max_connections, uint64_t max_lag) {
+  struct sockaddr_in addr;
+  uv_loop_t* loop;
+  uv_udp_t udp;
+  int i;
+
+  lag_mode = max_lag != 0;
+  loop = uv_default_loop();
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+
+  /* 只支持流 */
+  ASSERT(0 == uv_udp_init(loop, &udp));
+  ASSERT(UV_EINVAL == uv_stream_set_admission((uv_stream_t*) &udp, 1, 0, NULL));
+  uv_close((uv_handle_t*) &udp, NULL);
+
+  ASSERT(0 == uv_tcp_init(loop, &server));
+  ASSERT(0 == uv_tcp_bind(&server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_stream_set_admission((uv_stream_t*) &server,
+                                      max_connections,
+                                      max_lag,
+                                      admission_cb));
+  ASSERT(0 == uv_listen((uv_stream_t*) &server, 16, connection_cb));
+
+  for (i = 0; i < NCLIENTS; i++) {
+    ASSERT(0 == uv_tcp_init(loop, &clients[i]));
+    ASSERT(0 == uv_tcp_connect(&connect_reqs[i],
+                               &clients[i],
+                               (const struct sockaddr*) &addr,
+                               connect_cb));
+  }
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(naccepted == NCLIENTS);
+  ASSERT(connect_cb_called == NCLIENTS);
+}
+
+
+TEST_IMPL(tcp_admission_max_connections) {
+  run_admission(NCLIENTS - 1, 0);
+  ASSERT(paused_cb_called == 1);
+  ASSERT(resumed_cb_called == 1);
+  ASSERT(nclosed == 1);
+  ASSERT(close_cb_called == 2 * NCLIENTS + 2);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(tcp_admission_lag) {
+  run_admission(0, 5);
+  /* 每接受一个连接之后都落后了20毫秒，至少要等前两次恢复 */
+  ASSERT(paused_cb_called >= NCLIENTS - 1);
+  ASSERT(resumed_cb_called >= NCLIENTS - 1);
+  ASSERT(close_cb_called == 2 * NCLIENTS + 1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -0,0 +1,200 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+static uv_tcp_t tcp_server;
+static uv_tcp_t tcp_accepted;
+static uv_tcp_t tcp_client;
+static uv_connect_t connect_req;
+static uv_shutdown_t shutdown_req;
+static uv_write_t ping_req;
+static uv_write_t write_req;
+
+static int do_shutdown;
+static int connect_cb_called;
+static int write_cb_called;
+static int read_cb_called;
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[1024];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void server_read_cb(uv_stream_t* stream,
+                           ssize_t nread,
+                           const uv_buf_t* buf) {
+  if (nread >= 0)
+    return;
+
+  /* 对端发的是RST而不是FIN，shutdown以后才是正常的EOF */
+  ASSERT(nread == (do_shutdown ? UV_EOF : UV_ECONNRESET));
+  read_cb_called++;
+  uv_close((uv_handle_t*) stream, close_cb);
+  uv_close((uv_handle_t*) &tcp_server, close_cb);
+}
+
+
+static void ping_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+}
+
+
+static void connection_cb(uv_stream_t* server, int status) {
+  uv_buf_t buf;
+
+  ASSERT(status == 0);
+  ASSERT(0 == uv_tcp_init(server->loop, &tcp_accepted));
+  ASSERT(0 == uv_accept(server, (uv_stream_t*) &tcp_accepted));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &tcp_accepted,
+                            alloc_cb,
+                            server_read_cb));
+
+  buf = uv_buf_init("PING", 4);
+  ASSERT(0 == uv_write(&ping_req,
+                       (uv_stream_t*) &tcp_accepted,
+                       &buf,
+                       1,
+                       ping_cb));
+}
+
+
+static void shutdown_cb(uv_shutdown_t* req, int status) {
+  uv_close((uv_handle_t*) req->handle, close_cb);
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0 || status == UV_ECANCELED);
+  write_cb_called++;
+}
+
+
+/* 收到服务端的数据时服务端一定已经accept了，这时再关闭 */
+static void client_read_cb(uv_stream_t* stream,
+                           ssize_t nread,
+                           const uv_buf_t* buf) {
+  uv_buf_t wbuf;
+
+  if (nread == 0)
+    return;
+
+  ASSERT(nread == 4);
+  uv_read_stop(stream);
+
+  if (do_shutdown) {
+    wbuf = uv_buf_init("PONG", 4);
+    ASSERT(0 == uv_write(&write_req, stream, &wbuf, 1, write_cb));
+    ASSERT(0 == uv_shutdown(&shutdown_req, stream, shutdown_cb));
+    ASSERT(UV_EINVAL == uv_tcp_close_reset((uv_tcp_t*) stream, close_cb));
+    return;
+  }
+
+  /* 服务端这时没有数据可读，第一次read()就会拿到ECONNRESET。带着数据的话
+   * 读到数据以后同时看到POLLHUP，会被当成EOF
+   */
+  ASSERT(0 == uv_tcp_close_reset((uv_tcp_t*) stream, close_cb));
+}
+
+
+static void connect_cb(uv_connect_t* req, int status) {
+  ASSERT(status == 0);
+  connect_cb_called++;
+  ASSERT(0 == uv_read_start(req->handle, alloc_cb, client_read_cb));
+}
+
+
+static void start_server(uv_loop_t* loop) {
+  struct sockaddr_in addr;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(loop, &tcp_server));
+  ASSERT(0 == uv_tcp_bind(&tcp_server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &tcp_server, 128, connection_cb));
+}
+
+
+static void do_connect(uv_loop_t* loop) {
+  struct sockaddr_in addr;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(loop, &tcp_client));
+  ASSERT(0 == uv_tcp_connect(&connect_req,
+                             &tcp_client,
+                             (const struct sockaddr*) &addr,
+                             connect_cb));
+}
+
+
+/* 用RST关闭客户端，服务端读到UV_ECONNRESET */
+TEST_IMPL(tcp_close_reset_client) {
+  uv_loop_t* loop;
+
+  loop = uv_default_loop();
+  do_shutdown = 0;
+
+  start_server(loop);
+  do_connect(loop);
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(connect_cb_called == 1);
+  ASSERT(write_cb_called == 0);
+  ASSERT(read_cb_called == 1);
+  ASSERT(close_cb_called == 3);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+/* uv_shutdown()之后不能再用RST关闭 */
+TEST_IMPL(tcp_close_reset_after_shutdown) {
+  uv_loop_t* loop;
+
+  loop = uv_default_loop();
+  do_shutdown = 1;
+
+  start_server(loop);
+  do_connect(loop);
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(connect_cb_called == 1);
+  ASSERT(write_cb_called == 1);
+  ASSERT(read_cb_called == 1);
+  ASSERT(close_cb_called == 3);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -0,0 +1,159 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <stdio.h>
+
+static uv_tcp_t server;
+static uv_tcp_t client;
+static uv_tcp_t incoming;
+static uv_connect_host_t connect_req;
+static char service[16];
+static int connection_cb_called;
+static int connect_cb_called;
+static int close_cb_called;
+static int expected_status;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void connection_cb(uv_stream_t* server, int status) {
+  ASSERT(status == 0);
+  connection_cb_called++;
+  ASSERT(0 == uv_tcp_init(server->loop, &incoming));
+  ASSERT(0 == uv_accept(server, (uv_stream_t*) &incoming));
+  uv_close((uv_handle_t*) &incoming, close_cb);
+  uv_close((uv_handle_t*) server, close_cb);
+}
+
+
+static void connect_cb(uv_connect_host_t* req, int status) {
+  struct sockaddr_storage peer;
+  int namelen;
+
+  ASSERT(req == &connect_req);
+  ASSERT(req->handle == &client);
+  ASSERT(status == expected_status);
+  connect_cb_called++;
+
+  if (status == UV_ECANCELED)
+    return;
+
+  namelen = sizeof(peer);
+  if (status == 0) {
+    ASSERT(0 == uv_tcp_getpeername(&client,
+                                   (struct sockaddr*) &peer,
+                                   &namelen));
+    ASSERT(peer.ss_family == AF_INET);
+    ASSERT(TEST_PORT == ntohs(((struct sockaddr_in*) &peer)->sin_port));
+  }
+
+  uv_close((uv_handle_t*) &client, close_cb);
+}
+
+
+static void start_server(void) {
+  struct sockaddr_in addr;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &server));
+  ASSERT(0 == uv_tcp_bind(&server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &server, 128, connection_cb));
+}
+
+
+TEST_IMPL(tcp_connect_host) {
+  snprintf(service, sizeof(service), "%d", TEST_PORT);
+  start_server();
+
+  /* localhost可能先解析出::1，那边连不上之后再换到127.0.0.1 */
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &client));
+  ASSERT(0 == uv_tcp_connect_host(&connect_req,
+                                  &client,
+                                  "localhost",
+                                  service,
+                                  50,
+                                  connect_cb));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(connect_cb_called == 1);
+  ASSERT(connection_cb_called == 1);
+  ASSERT(close_cb_called == 3);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(tcp_connect_host_error) {
+  snprintf(service, sizeof(service), "%d", TEST_PORT);
+  expected_status = UV_ECONNREFUSED;
+
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &client));
+  ASSERT(UV_EINVAL == uv_tcp_connect_host(&connect_req,
+                                          &client,
+                                          NULL,
+                                          service,
+                                          0,
+                                          connect_cb));
+  ASSERT(0 == uv_tcp_connect_host(&connect_req,
+                                  &client,
+                                  "127.0.0.1",
+                                  service,
+                                  0,
+                                  connect_cb));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(connect_cb_called == 1);
+  ASSERT(close_cb_called == 1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(tcp_connect_host_close) {
+  snprintf(service, sizeof(service), "%d", TEST_PORT);
+  expected_status = UV_ECANCELED;
+  start_server();
+
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &client));
+  ASSERT(0 == uv_tcp_connect_host(&connect_req,
+                                  &client,
+                                  "127.0.0.1",
+                                  service,
+                                  0,
+                                  connect_cb));
+  uv_close((uv_handle_t*) &client, close_cb);
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(connect_cb_called == 1);
+  ASSERT(connection_cb_called == 1);
+  ASSERT(close_cb_called == 3);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -0,0 +1,157 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+#define ROUNDS 2
+
+static uv_tcp_t server;
+static uv_tcp_t client;
+static uv_tcp_t incoming;
+static uv_connect_t connect_req;
+static uv_write_t write_req;
+static char read_buf[64];
+static size_t nread_total;
+static int connect_cb_called;
+static int write_cb_called;
+static int close_cb_called;
+static int rounds;
+
+
+static void start_client(void);
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+
+  if (handle != (uv_handle_t*) &client)
+    return;
+
+  if (++rounds < ROUNDS)
+    start_client();
+  else
+    uv_close((uv_handle_t*) &server, close_cb);
+}
+
+
+static void alloc_cb(uv_handle_t* handle,
+                     size_t suggested_size,
+                     uv_buf_t* buf) {
+  buf->base = read_buf + nread_total;
+  buf->len = sizeof(read_buf) - nread_total;
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  if (nread <= 0) {
+    ASSERT(nread == UV_EOF);
+    return;
+  }
+
+  nread_total += nread;
+  if (nread_total < 4)
+    return;
+
+  ASSERT(nread_total == 4);
+  ASSERT(0 == memcmp(read_buf, "PING", 4));
+  nread_total = 0;
+  uv_close((uv_handle_t*) stream, close_cb);
+  uv_close((uv_handle_t*) &client, close_cb);
+}
+
+
+static void connection_cb(uv_stream_t* server, int status) {
+  ASSERT(status == 0);
+  ASSERT(0 == uv_tcp_init(server->loop, &incoming));
+  ASSERT(0 == uv_accept(server, (uv_stream_t*) &incoming));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &incoming, alloc_cb, read_cb));
+}
+
+
+static void connect_cb(uv_connect_t* req, int status) {
+  ASSERT(req == &connect_req);
+  ASSERT(status == 0);
+  connect_cb_called++;
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(req == &write_req);
+  ASSERT(status == 0);
+  write_cb_called++;
+}
+
+
+static void start_client(void) {
+  struct sockaddr_in addr;
+  uv_buf_t buf;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &client));
+  ASSERT(0 == uv_tcp_fastopen_connect(&client, 1));
+  ASSERT(0 == uv_tcp_connect(&connect_req,
+                             &client,
+                             (const struct sockaddr*) &addr,
+                             connect_cb));
+
+  /* 在connect_cb之前排队，有cookie的时候会跟着SYN一起发出去 */
+  buf = uv_buf_init("PING", 4);
+  ASSERT(0 == uv_write(&write_req, (uv_stream_t*) &client, &buf, 1, write_cb));
+}
+
+
+TEST_IMPL(tcp_fastopen) {
+#ifndef __linux__
+  RETURN_SKIP("TCP Fast Open is only tested on linux");
+#else
+  struct sockaddr_in addr;
+  int r;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &server));
+  ASSERT(UV_EBADF == uv_tcp_fastopen(&server, 16));
+
+  ASSERT(0 == uv_tcp_bind(&server, (const struct sockaddr*) &addr, 0));
+  r = uv_tcp_fastopen(&server, 16);
+  if (r == UV_ENOTSUP || r == UV_ENOPROTOOPT) {
+    uv_close((uv_handle_t*) &server, NULL);
+    uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+    RETURN_SKIP("TCP_FASTOPEN is not supported");
+  }
+  ASSERT(r == 0);
+  ASSERT(0 == uv_listen((uv_stream_t*) &server, 128, connection_cb));
+
+  /* 第一轮拿到cookie，第二轮数据跟着SYN走；两轮在应用层看起来一样 */
+  start_client();
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(rounds == ROUNDS);
+  ASSERT(connect_cb_called == ROUNDS);
+  ASSERT(write_cb_called == ROUNDS);
+  ASSERT(close_cb_called == 2 * ROUNDS + 1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#endif
+}
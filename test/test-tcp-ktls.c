@@ -0,0 +1,172 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/tls.h>
+
+/* 5字节的记录头，8字节的显式nonce，5字节的"hello"，16字节的tag */
+#define RECORD_SIZE (5 + 8 + 5 + 16)
+
+static uv_tcp_t server;
+static uv_tcp_t client;
+static uv_tcp_t incoming;
+static uv_connect_t connect_req;
+static uv_write_t write_req;
+static unsigned char read_buf[64];
+static size_t nread_total;
+static int unsupported;
+static int write_cb_called;
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void close_all(void) {
+  uv_close((uv_handle_t*) &incoming, close_cb);
+  uv_close((uv_handle_t*) &client, close_cb);
+  uv_close((uv_handle_t*) &server, close_cb);
+}
+
+
+static void alloc_cb(uv_handle_t* handle,
+                     size_t suggested_size,
+                     uv_buf_t* buf) {
+  buf->base = (char*) read_buf + nread_total;
+  buf->len = sizeof(read_buf) - nread_total;
+}
+
+
+/* 对端没有装接收密钥，读到的是加密以后的TLS记录 */
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  if (nread == UV_EOF) {
+    ASSERT(unsupported);
+    uv_close((uv_handle_t*) stream, close_cb);
+    return;
+  }
+
+  ASSERT(nread >= 0);
+
+  nread_total += nread;
+  if (nread_total < RECORD_SIZE)
+    return;
+
+  ASSERT(nread_total == RECORD_SIZE);
+  ASSERT(read_buf[0] == 23);  /* application_data */
+  ASSERT(read_buf[1] == 3 && read_buf[2] == 3);
+  ASSERT(read_buf[3] == 0 && read_buf[4] == RECORD_SIZE - 5);
+  ASSERT(0 != memcmp(read_buf + 13, "hello", 5));
+  close_all();
+}
+
+
+static void connection_cb(uv_stream_t* server, int status) {
+  ASSERT(status == 0);
+  ASSERT(0 == uv_tcp_init(server->loop, &incoming));
+  ASSERT(0 == uv_accept(server, (uv_stream_t*) &incoming));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &incoming, alloc_cb, read_cb));
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  write_cb_called++;
+}
+
+
+static void connect_cb(uv_connect_t* req, int status) {
+  struct tls12_crypto_info_aes_gcm_128 info;
+  uv_buf_t buf;
+  int r;
+
+  ASSERT(status == 0);
+
+  memset(&info, 0, sizeof(info));
+  info.info.version = TLS_1_2_VERSION;
+  info.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+  memset(info.key, 1, sizeof(info.key));
+  memset(info.iv, 2, sizeof(info.iv));
+  memset(info.salt, 3, sizeof(info.salt));
+
+  r = uv_tcp_ktls(&client, UV_TCP_KTLS_TX, &info, sizeof(info));
+  if (r == UV_ENOENT || r == UV_ENOPROTOOPT || r == UV_ENOTSUP) {
+    unsupported = 1;
+    /* 已经accept()进来的连接读到EOF时关掉 */
+    uv_close((uv_handle_t*) &client, close_cb);
+    uv_close((uv_handle_t*) &server, close_cb);
+    return;
+  }
+  ASSERT(r == 0);
+
+  buf = uv_buf_init("hello", 5);
+  ASSERT(0 == uv_write(&write_req, (uv_stream_t*) &client, &buf, 1, write_cb));
+}
+
+
+TEST_IMPL(tcp_ktls) {
+  struct tls12_crypto_info_aes_gcm_128 info;
+  struct sockaddr_in addr;
+
+  memset(&info, 0, sizeof(info));
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &client));
+  ASSERT(UV_EBADF ==
+         uv_tcp_ktls(&client, UV_TCP_KTLS_TX, &info, sizeof(info)));
+  ASSERT(UV_EINVAL ==
+         uv_tcp_ktls(&client, (uv_tcp_ktls_dir) 3, &info, sizeof(info)));
+  ASSERT(UV_EINVAL == uv_tcp_ktls(&client, UV_TCP_KTLS_RX, NULL, 0));
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &server));
+  ASSERT(0 == uv_tcp_bind(&server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &server, 128, connection_cb));
+  ASSERT(0 == uv_tcp_connect(&connect_req,
+                             &client,
+                             (const struct sockaddr*) &addr,
+                             connect_cb));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  if (unsupported) {
+    MAKE_VALGRIND_HAPPY();
+    RETURN_SKIP("kernel TLS is not available");
+  }
+
+  ASSERT(write_cb_called == 1);
+  ASSERT(close_cb_called == 3);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#else
+
+TEST_IMPL(tcp_ktls) {
+  RETURN_SKIP("kernel TLS is only available on linux");
+}
+
+#endif  /* __linux__ */
@@ -0,0 +1,276 @@
+/* Copyright libuv project contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "uv.h"
+#include "task.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BIG_SIZE (4 * 1024 * 1024)
+
+static uv_loop_t loop_a;
+static uv_loop_t loop_b;
+static uv_tcp_t server;
+static uv_tcp_t conn;
+static uv_tcp_t client;
+static uv_connect_t connect_req;
+static uv_write_t ping_req;
+static uv_write_t pong_req;
+static uv_write_t big_req;
+static char* big;
+static char conn_buf[64];
+static char client_buf[65536];
+static size_t client_nread;
+static int conn_got_ping;
+static int conn_got_pong;
+static int big_write_cb_called;
+static int ring_connected;
+
+
+static void conn_alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  *buf = uv_buf_init(conn_buf, sizeof(conn_buf));
+}
+
+
+static void client_alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  *buf = uv_buf_init(client_buf, sizeof(client_buf));
+}
+
+
+static void conn_read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  ASSERT(nread == 4);
+  if (memcmp(buf->base, "ping", 4) == 0) {
+    ASSERT(stream->loop == &loop_a);
+    conn_got_ping = 1;
+  } else {
+    ASSERT(0 == memcmp(buf->base, "pong", 4));
+    ASSERT(stream->loop == &loop_b);
+    conn_got_pong = 1;
+  }
+}
+
+
+static void big_write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  ASSERT(req->handle->loop == &loop_b);
+  big_write_cb_called++;
+}
+
+
+static void pong_write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+}
+
+
+/* 全部收到以后回一个pong，检查转移之后还在读 */
+static void client_read_cb(uv_stream_t* stream,
+                           ssize_t nread,
+                           const uv_buf_t* buf) {
+  uv_buf_t pong;
+
+  ASSERT(nread > 0);
+  client_nread += nread;
+  ASSERT(client_nread <= BIG_SIZE);
+  if (client_nread < BIG_SIZE)
+    return;
+
+  pong = uv_buf_init("pong", 4);
+  ASSERT(0 == uv_write(&pong_req, stream, &pong, 1, pong_write_cb));
+}
+
+
+static void connection_cb(uv_stream_t* s, int status) {
+  ASSERT(status == 0);
+  ASSERT(0 == uv_tcp_init(&loop_a, &conn));
+  ASSERT(0 == uv_accept(s, (uv_stream_t*) &conn));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &conn, conn_alloc_cb, conn_read_cb));
+}
+
+
+static void ping_write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+}
+
+
+static void connect_cb(uv_connect_t* req, int status) {
+  uv_buf_t ping;
+
+  ASSERT(status == 0);
+  ping = uv_buf_init("ping", 4);
+  ASSERT(0 == uv_write(&ping_req, req->handle, &ping, 1, ping_write_cb));
+}
+
+
+TEST_IMPL(tcp_migrate) {
+  struct sockaddr_in addr;
+  uv_buf_t buf;
+
+  ASSERT(0 == uv_loop_init(&loop_a));
+  ASSERT(0 == uv_loop_init(&loop_b));
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(&loop_a, &server));
+  ASSERT(0 == uv_tcp_bind(&server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &server, 1, connection_cb));
+  ASSERT(UV_EINVAL == uv_stream_detach((uv_stream_t*) &server));
+
+  /* 客户端在默认loop上，三个loop轮流跑 */
+  ASSERT(0 == uv_tcp_init(uv_default_loop(), &client));
+  ASSERT(0 == uv_tcp_connect(&connect_req,
+                             &client,
+                             (const struct sockaddr*) &addr,
+                             connect_cb));
+  while (!conn_got_ping) {
+    uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+    uv_run(&loop_a, UV_RUN_NOWAIT);
+  }
+
+  /* 客户端还没开始读，大块数据写不完，留在写队列里 */
+  big = malloc(BIG_SIZE);
+  ASSERT(big != NULL);
+  memset(big, 'x', BIG_SIZE);
+  buf = uv_buf_init(big, BIG_SIZE);
+  ASSERT(0 == uv_write(&big_req, (uv_stream_t*) &conn, &buf, 1, big_write_cb));
+  ASSERT(conn.write_queue_size > 0);
+
+  ASSERT(0 == uv_stream_detach((uv_stream_t*) &conn));
+  ASSERT(UV_EINVAL == uv_stream_detach((uv_stream_t*) &conn));
+  ASSERT(conn.loop == NULL);
+
+  /* 原来的loop上只剩下监听的套接字 */
+  uv_close((uv_handle_t*) &server, NULL);
+  ASSERT(0 == uv_run(&loop_a, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_close(&loop_a));
+
+  ASSERT(0 == uv_stream_attach(&loop_b, (uv_stream_t*) &conn));
+  ASSERT(UV_EINVAL == uv_stream_attach(&loop_b, (uv_stream_t*) &conn));
+  ASSERT(uv_loop_alive(&loop_b));
+
+  ASSERT(0 == uv_read_start((uv_stream_t*) &client,
+                            client_alloc_cb,
+                            client_read_cb));
+  while (!conn_got_pong) {
+    uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+    uv_run(&loop_b, UV_RUN_NOWAIT);
+  }
+  ASSERT(big_write_cb_called == 1);
+  ASSERT(client_nread == BIG_SIZE);
+
+  uv_close((uv_handle_t*) &conn, NULL);
+  uv_close((uv_handle_t*) &client, NULL);
+  ASSERT(0 == uv_run(&loop_b, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_close(&loop_b));
+  free(big);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void ring_connection_cb(uv_stream_t* s, int status) {
+  ASSERT(status == 0);
+  ASSERT(0 == uv_tcp_init(&loop_a, &conn));
+  ASSERT(0 == uv_accept(s, (uv_stream_t*) &conn));
+}
+
+
+static void ring_connect_cb(uv_connect_t* req, int status) {
+  ASSERT(status == 0);
+  ring_connected = 1;
+}
+
+
+static void ring_read_cb(uv_stream_t* stream,
+                         ssize_t nread,
+                         const uv_buf_t* buf) {
+  ASSERT(0 && "ring_read_cb should not be called");
+}
+
+
+/* 用loop的缓冲区环读的流不能摘下来，停止读以后可以 */
+static void ring_detach(int use_io_uring) {
+  struct sockaddr_in addr;
+  int r;
+
+  ASSERT(0 == uv_loop_init(&loop_a));
+  ASSERT(0 == uv_loop_init(&loop_b));
+  if (use_io_uring)
+    ASSERT(0 == uv_loop_configure(&loop_a, UV_LOOP_USE_IO_URING));
+  ASSERT(0 == uv_loop_configure(&loop_a, UV_LOOP_RECV_RING, 4u, (size_t) 64));
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_tcp_init(&loop_a, &server));
+  ASSERT(0 == uv_tcp_bind(&server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &server, 1, ring_connection_cb));
+  ASSERT(0 == uv_tcp_init(&loop_a, &client));
+  ASSERT(0 == uv_tcp_connect(&connect_req,
+                             &client,
+                             (const struct sockaddr*) &addr,
+                             ring_connect_cb));
+  while (conn.loop == NULL || !ring_connected)
+    uv_run(&loop_a, UV_RUN_ONCE);
+
+  ASSERT(0 == uv_read_start_ring((uv_stream_t*) &conn, ring_read_cb));
+  ASSERT(UV_EBUSY == uv_stream_detach((uv_stream_t*) &conn));
+  uv_run(&loop_a, UV_RUN_NOWAIT);
+  ASSERT(UV_EBUSY == uv_stream_detach((uv_stream_t*) &conn));
+  ASSERT(conn.loop == &loop_a);
+
+  /* io_uring上的recv要等取消的完成事件回来 */
+  ASSERT(0 == uv_read_stop((uv_stream_t*) &conn));
+  while ((r = uv_stream_detach((uv_stream_t*) &conn)) == UV_EBUSY)
+    uv_run(&loop_a, UV_RUN_NOWAIT);
+  ASSERT(r == 0);
+  ASSERT(0 == uv_stream_attach(&loop_b, (uv_stream_t*) &conn));
+
+  uv_close((uv_handle_t*) &conn, NULL);
+  uv_close((uv_handle_t*) &client, NULL);
+  uv_close((uv_handle_t*) &server, NULL);
+  ASSERT(0 == uv_run(&loop_b, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_run(&loop_a, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_close(&loop_b));
+  ASSERT(0 == uv_loop_close(&loop_a));
+  memset(&conn, 0, sizeof(conn));
+  ring_connected = 0;
+}
+
+
+TEST_IMPL(tcp_migrate_recv_ring) {
+  uv_loop_t loop;
+  int r;
+
+  ring_detach(0);
+
+  ASSERT(0 == uv_loop_init(&loop));
+  r = uv_loop_configure(&loop, UV_LOOP_USE_IO_URING);
+  ASSERT(0 == uv_loop_close(&loop));
+  if (r == UV_ENOSYS)
+    RETURN_SKIP("io_uring not supported");
+  ASSERT(r == 0);
+
+  ring_detach(1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
@@ -0,0 +1,111 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+static uv_tcp_t servers[2];
+static uv_tcp_t conn;
+static uv_tcp_t client;
+static uv_connect_t connect_req;
+static int connection_cb_called;
+static int connect_cb_called;
+
+
+static void close_servers(void) {
+  uv_close((uv_handle_t*) &servers[0], NULL);
+  uv_close((uv_handle_t*) &servers[1], NULL);
+}
+
+
+static void connection_cb(uv_stream_t* server, int status) {
+  ASSERT(status == 0);
+  ASSERT(server == (uv_stream_t*) &servers[0] ||
+         server == (uv_stream_t*) &servers[1]);
+  ASSERT(0 == uv_tcp_init(server->loop, &conn));
+  ASSERT(0 == uv_accept(server, (uv_stream_t*) &conn));
+  connection_cb_called++;
+  uv_close((uv_handle_t*) &conn, NULL);
+  close_servers();
+}
+
+
+static void connect_cb(uv_connect_t* req, int status) {
+  ASSERT(status == 0);
+  connect_cb_called++;
+  uv_close((uv_handle_t*) req->handle, NULL);
+}
+
+
+TEST_IMPL(tcp_reuseport) {
+#if defined(_WIN32)
+  RETURN_SKIP("SO_REUSEPORT is not supported on Windows.");
+#else
+  struct sockaddr_in addr;
+  uv_tcp_t other;
+  uv_loop_t* loop;
+  int r;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+
+  ASSERT(0 == uv_tcp_init(loop, &servers[0]));
+  r = uv_tcp_bind(&servers[0],
+                  (const struct sockaddr*) &addr,
+                  UV_TCP_REUSEPORT);
+  if (r == UV_ENOTSUP) {
+    uv_close((uv_handle_t*) &servers[0], NULL);
+    uv_run(loop, UV_RUN_DEFAULT);
+    MAKE_VALGRIND_HAPPY();
+    RETURN_SKIP("SO_REUSEPORT is not supported on this platform.");
+  }
+  ASSERT(r == 0);
+  ASSERT(0 == uv_listen((uv_stream_t*) &servers[0], 128, connection_cb));
+
+  /* A second listener on the same address is fine with SO_REUSEPORT... */
+  ASSERT(0 == uv_tcp_init(loop, &servers[1]));
+  ASSERT(0 == uv_tcp_bind(&servers[1],
+                          (const struct sockaddr*) &addr,
+                          UV_TCP_REUSEPORT));
+  ASSERT(0 == uv_listen((uv_stream_t*) &servers[1], 128, connection_cb));
+
+  /* ...but not without it. */
+  ASSERT(0 == uv_tcp_init(loop, &other));
+  r = uv_tcp_bind(&other, (const struct sockaddr*) &addr, 0);
+  if (r == 0)
+    r = uv_listen((uv_stream_t*) &other, 128, connection_cb);
+  ASSERT(r == UV_EADDRINUSE);
+  uv_close((uv_handle_t*) &other, NULL);
+
+  ASSERT(0 == uv_tcp_init(loop, &client));
+  ASSERT(0 == uv_tcp_connect(&connect_req,
+                             &client,
+                             (const struct sockaddr*) &addr,
+                             connect_cb));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(1 == connection_cb_called);
+  ASSERT(1 == connect_cb_called);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#endif
+}
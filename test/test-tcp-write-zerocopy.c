@@ -0,0 +1,153 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BIG_SIZE (4 * 1024 * 1024)
+
+static uv_tcp_t server;
+static uv_tcp_t client;
+static uv_tcp_t incoming;
+static uv_connect_t connect_req;
+static uv_write_t write_reqs[3];
+static char* big;
+static char small[] = "tail";
+static size_t total_size;
+static size_t nread_total;
+static int write_cb_called;
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void maybe_done(void) {
+  if (write_cb_called == 3 && nread_total == total_size) {
+    uv_close((uv_handle_t*) &client, close_cb);
+    uv_close((uv_handle_t*) &incoming, close_cb);
+    uv_close((uv_handle_t*) &server, close_cb);
+  }
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  /* Zero-copy completions keep the order of the writes. */
+  ASSERT(req == write_reqs + write_cb_called);
+  write_cb_called++;
+  maybe_done();
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[65536];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  ssize_t i;
+  size_t off;
+
+  ASSERT(nread >= 0);
+
+  for (i = 0; i < nread; i++) {
+    off = nread_total + i;
+    if (off < BIG_SIZE)
+      ASSERT(buf->base[i] == big[off]);
+    else if (off < BIG_SIZE + sizeof(small) - 1)
+      ASSERT(buf->base[i] == small[off - BIG_SIZE]);
+    else
+      ASSERT(buf->base[i] == big[off - BIG_SIZE - sizeof(small) + 1]);
+  }
+
+  nread_total += nread;
+  ASSERT(nread_total <= total_size);
+  maybe_done();
+}
+
+
+static void connection_cb(uv_stream_t* tcp, int status) {
+  ASSERT(status == 0);
+  ASSERT(0 == uv_tcp_init(tcp->loop, &incoming));
+  ASSERT(0 == uv_accept(tcp, (uv_stream_t*) &incoming));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &incoming, alloc_cb, read_cb));
+}
+
+
+static void connect_cb(uv_connect_t* req, int status) {
+  uv_stream_t* stream;
+  uv_buf_t buf;
+
+  ASSERT(status == 0);
+  stream = req->handle;
+
+  buf = uv_buf_init(big, BIG_SIZE);
+  ASSERT(0 == uv_write_zerocopy(write_reqs + 0, stream, &buf, 1, write_cb));
+  buf = uv_buf_init(small, sizeof(small) - 1);
+  ASSERT(0 == uv_write(write_reqs + 1, stream, &buf, 1, write_cb));
+  buf = uv_buf_init(big, BIG_SIZE);
+  ASSERT(0 == uv_write_zerocopy(write_reqs + 2, stream, &buf, 1, write_cb));
+}
+
+
+TEST_IMPL(tcp_write_zerocopy) {
+  struct sockaddr_in addr;
+  uv_loop_t* loop;
+  size_t i;
+
+  big = malloc(BIG_SIZE);
+  ASSERT(big != NULL);
+  for (i = 0; i < BIG_SIZE; i++)
+    big[i] = (char) (i * 31 + (i >> 12));
+  total_size = 2 * BIG_SIZE + sizeof(small) - 1;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+
+  ASSERT(0 == uv_tcp_init(loop, &server));
+  ASSERT(0 == uv_tcp_bind(&server, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_listen((uv_stream_t*) &server, 1, connection_cb));
+
+  ASSERT(0 == uv_tcp_init(loop, &client));
+  ASSERT(0 == uv_tcp_connect(&connect_req,
+                             &client,
+                             (const struct sockaddr*) &addr,
+                             connect_cb));
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(write_cb_called == 3);
+  ASSERT(nread_total == total_size);
+  ASSERT(close_cb_called == 3);
+
+  free(big);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
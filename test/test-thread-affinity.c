@@ -104,8 +104,72 @@ TEST_IMPL(thread_affinity) {
   return 0;
 }
 
+
+
+static void check_create_ex_affinity(void* arg) {
+  uv_thread_t tid;
+  char* cpumask;
+  int cpumasksize;
+  int i;
+
+  cpumasksize = uv_cpumask_size();
+  cpumask = calloc(cpumasksize, 1);
+  ASSERT(cpumask != NULL);
+
+  tid = uv_thread_self();
+  ASSERT(0 == uv_thread_getaffinity(&tid, cpumask, cpumasksize));
+  /* Only CPU 0, right from the start. */
+  ASSERT(cpumask[0] == 1);
+  for (i = 1; i < cpumasksize; i++)
+    ASSERT(cpumask[i] == 0);
+
+  free(cpumask);
+  *(int*) arg = 1;
+}
+
+
+TEST_IMPL(thread_create_ex_affinity) {
+  uv_thread_options_t options;
+  uv_thread_t tid;
+  int cpumasksize;
+  char* cpumask;
+  int called;
+
+  cpumasksize = uv_cpumask_size();
+  ASSERT(cpumasksize > 0);
+  cpumask = calloc(cpumasksize, 1);
+  ASSERT(cpumask != NULL);
+  cpumask[0] = 1;
+
+  options.flags = UV_THREAD_HAS_CPUMASK | UV_THREAD_HAS_STACK_SIZE;
+  options.stack_size = 1024 * 1024;
+  options.cpumask = cpumask;
+  options.cpumask_size = cpumasksize - 1;
+  ASSERT(UV_EINVAL == uv_thread_create_ex(&tid,
+                                          &options,
+                                          check_create_ex_affinity,
+                                          &called));
+
+  called = 0;
+  options.cpumask_size = cpumasksize;
+  ASSERT(0 == uv_thread_create_ex(&tid,
+                                  &options,
+                                  check_create_ex_affinity,
+                                  &called));
+  ASSERT(0 == uv_thread_join(&tid));
+  ASSERT(called == 1);
+
+  free(cpumask);
+  return 0;
+}
+
 #else
 
+TEST_IMPL(thread_create_ex_affinity) {
+  RETURN_SKIP(NO_CPU_AFFINITY);
+}
+
+
 TEST_IMPL(thread_affinity) {
   int cpumasksize;
   cpumasksize = uv_cpumask_size();
@@ -43,9 +43,11 @@ static unsigned done2_cb_called;
 static unsigned timer_cb_called;
 static uv_work_t pause_reqs[4];
 static uv_sem_t pause_sems[ARRAY_SIZE(pause_reqs)];
+static uv_sem_t started_sem;
 
 
 static void work_cb(uv_work_t* req) {
+  uv_sem_post(&started_sem);
   uv_sem_wait(pause_sems + (req - pause_reqs));
 }
 
@@ -67,10 +69,19 @@ static void saturate_threadpool(void) {
   putenv(buf);
 
   loop = uv_default_loop();
+  ASSERT(0 == uv_sem_init(&started_sem, 0));
   for (i = 0; i < ARRAY_SIZE(pause_reqs); i += 1) {
     ASSERT(0 == uv_sem_init(pause_sems + i, 0));
     ASSERT(0 == uv_queue_work(loop, pause_reqs + i, work_cb, done_cb));
   }
+
+  /* Wait until every thread is blocked. The threadpool does not start
+   * requests in submission order, so otherwise a request queued after
+   * this could start before a pause request and could not be cancelled.
+   */
+  for (i = 0; i < ARRAY_SIZE(pause_reqs); i += 1)
+    uv_sem_wait(&started_sem);
+  uv_sem_destroy(&started_sem);
 }
 
 
@@ -176,6 +187,71 @@ TEST_IMPL(threadpool_cancel_getaddrinfo) {
 }
 
 
+static unsigned coalesce_ok_called;
+static unsigned coalesce_pool_runs;
+
+
+static void coalesce_cb(uv_getaddrinfo_t* req,
+                        int status,
+                        struct addrinfo* res) {
+  uint64_t wait_ns;
+  uint64_t run_ns;
+
+  if (req->data != NULL) {
+    ASSERT(status == UV_EAI_CANCELED);
+    ASSERT(res == NULL);
+    return;
+  }
+
+  ASSERT(status == 0);
+  ASSERT(res != NULL);
+  ASSERT(0 == uv_req_work_time((uv_req_t*) req, &wait_ns, &run_ns));
+  if (run_ns > 0)
+    coalesce_pool_runs++;
+  coalesce_ok_called++;
+  uv_freeaddrinfo(res);
+}
+
+
+TEST_IMPL(threadpool_cancel_getaddrinfo_coalesce) {
+  uv_getaddrinfo_t reqs[8];
+  uv_loop_t* loop;
+  size_t i;
+
+  loop = uv_default_loop();
+  saturate_threadpool();
+  ASSERT(0 == uv_threadpool_enable_histograms(NULL, 1));
+  ASSERT(0 == uv_getaddrinfo_coalesce(1));
+
+  /* 线程池占满了，第一个请求排着队，后面相同的请求都等它 */
+  for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+    reqs[i].data = i == 0 ? &reqs[i] : NULL;
+    ASSERT(0 == uv_getaddrinfo(loop,
+                               reqs + i,
+                               coalesce_cb,
+                               "localhost",
+                               NULL,
+                               NULL));
+  }
+
+  /* 等待中的请求不在线程池里；取消leader后由下一个请求接替 */
+  for (i = 1; i < ARRAY_SIZE(reqs); i++)
+    ASSERT(UV_EBUSY == uv_cancel((uv_req_t*) (reqs + i)));
+  ASSERT(0 == uv_cancel((uv_req_t*) (reqs + 0)));
+
+  unblock_threadpool();
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(coalesce_ok_called == ARRAY_SIZE(reqs) - 1);
+  ASSERT(coalesce_pool_runs == 1);
+
+  ASSERT(0 == uv_getaddrinfo_coalesce(0));
+  ASSERT(0 == uv_threadpool_enable_histograms(NULL, 0));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
 TEST_IMPL(threadpool_cancel_getnameinfo) {
   uv_getnameinfo_t reqs[4];
   struct sockaddr_in addr4;
@@ -21,6 +21,8 @@
 
 #include "uv.h"
 #include "task.h"
+#include <stdlib.h>
+#include <string.h>
 
 static int work_cb_count;
 static int after_work_cb_count;
@@ -74,3 +76,831 @@ TEST_IMPL(threadpool_queue_work_einval) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+#define BLOCKERS 128
+
+static uv_sem_t blocker_sem;
+static uv_work_t blockers[BLOCKERS];
+static int blocker_done_count;
+static uv_threadpool_t pool;
+static uv_work_t pool_req;
+static uv_fs_t pool_fs_req;
+static int pool_done;
+
+
+static void blocker_cb(uv_work_t* req) {
+  uv_sem_wait(&blocker_sem);
+}
+
+
+static void blocker_done_cb(uv_work_t* req, int status) {
+  ASSERT(status == 0);
+  blocker_done_count++;
+}
+
+
+static void pool_work_cb(uv_work_t* req) {
+  ASSERT(req == &pool_req);
+}
+
+
+static void pool_after_work_cb(uv_work_t* req, int status) {
+  int i;
+
+  ASSERT(status == 0);
+  ASSERT(req == &pool_req);
+  /* Finished even though every default pool thread is still blocked. */
+  ASSERT(blocker_done_count == 0);
+  pool_done++;
+
+  for (i = 0; i < BLOCKERS; i++)
+    uv_sem_post(&blocker_sem);
+}
+
+
+static void pool_fs_cb(uv_fs_t* req) {
+  ASSERT(req == &pool_fs_req);
+  ASSERT(req->result == 0);
+  ASSERT(blocker_done_count == 0);
+  uv_fs_req_cleanup(req);
+  pool_done++;
+
+  ASSERT(0 == uv_queue_work_pool(req->loop,
+                                 &pool,
+                                 &pool_req,
+                                 pool_work_cb,
+                                 pool_after_work_cb));
+}
+
+
+TEST_IMPL(threadpool_pool) {
+  uv_loop_t loop;
+  int i;
+
+  ASSERT(UV_EINVAL == uv_threadpool_init(&pool, "bad", 0));
+  ASSERT(0 == uv_threadpool_init(&pool, "tenant", 2));
+  ASSERT(0 == strcmp(pool.name, "tenant"));
+  ASSERT(2 == pool.nthreads);
+  ASSERT(0 == uv_sem_init(&blocker_sem, 0));
+
+  /* Tie up the default pool, then run work on the custom one. */
+  for (i = 0; i < BLOCKERS; i++)
+    ASSERT(0 == uv_queue_work(uv_default_loop(),
+                              blockers + i,
+                              blocker_cb,
+                              blocker_done_cb));
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_loop_set_threadpool(&loop, &pool));
+  ASSERT(UV_EBUSY == uv_threadpool_destroy(&pool));
+
+  /* A loop bound to the pool runs its fs requests there. */
+  ASSERT(0 == uv_fs_stat(&loop, &pool_fs_req, ".", pool_fs_cb));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(2 == pool_done);
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(BLOCKERS == blocker_done_count);
+
+  ASSERT(0 == uv_loop_close(&loop));
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+  uv_sem_destroy(&blocker_sem);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static uv_barrier_t resize_barrier;
+static uv_sem_t resize_sem;
+static uv_work_t resize_reqs[4];
+static int resize_done;
+
+
+static void barrier_work_cb(uv_work_t* req) {
+  /* Only returns once four workers are inside at the same time. */
+  uv_barrier_wait(&resize_barrier);
+}
+
+
+static void sem_work_cb(uv_work_t* req) {
+  uv_sem_wait(&resize_sem);
+}
+
+
+static void resize_after_work_cb(uv_work_t* req, int status) {
+  ASSERT(status == 0);
+  resize_done++;
+}
+
+
+static void wait_for_nthreads(uv_threadpool_t* p, unsigned int n) {
+  int i;
+
+  for (i = 0; i < 500; i++) {
+    if (*(volatile unsigned int*) &p->nthreads == n)
+      return;
+    uv_sleep(10);
+  }
+
+  ASSERT(0 && "thread count did not settle");
+}
+
+
+TEST_IMPL(threadpool_resize) {
+  uv_loop_t loop;
+  int i;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_threadpool_init(&pool, NULL, 1));
+  ASSERT(NULL == pool.name);
+  ASSERT(UV_EINVAL == uv_threadpool_resize(&pool, 0));
+  ASSERT(UV_EINVAL == uv_threadpool_set_elastic(&pool, 3, 2, 0, 0));
+
+  /* Growing starts the threads right away. */
+  ASSERT(0 == uv_threadpool_resize(&pool, 4));
+  ASSERT(4 == pool.nthreads);
+  ASSERT(0 == uv_barrier_init(&resize_barrier, 4));
+  for (i = 0; i < 4; i++)
+    ASSERT(0 == uv_queue_work_pool(&loop,
+                                   &pool,
+                                   resize_reqs + i,
+                                   barrier_work_cb,
+                                   resize_after_work_cb));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(4 == resize_done);
+  uv_barrier_destroy(&resize_barrier);
+
+  /* Shrinking retires the idle threads. */
+  ASSERT(0 == uv_threadpool_resize(&pool, 1));
+  wait_for_nthreads(&pool, 1);
+
+  /* Elastic mode: a queue that stays backed up while every thread is busy
+   * gets another thread, which goes away again once it has been idle.
+   */
+  ASSERT(0 == uv_sem_init(&resize_sem, 0));
+  ASSERT(0 == uv_threadpool_set_elastic(&pool, 1, 2, 10, 50));
+  for (i = 0; i < 3; i++) {
+    ASSERT(0 == uv_queue_work_pool(&loop,
+                                   &pool,
+                                   resize_reqs + i,
+                                   sem_work_cb,
+                                   resize_after_work_cb));
+    uv_sleep(20);
+  }
+  wait_for_nthreads(&pool, 2);
+
+  for (i = 0; i < 3; i++)
+    uv_sem_post(&resize_sem);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(7 == resize_done);
+  wait_for_nthreads(&pool, 1);
+  uv_sem_destroy(&resize_sem);
+
+  ASSERT(0 == uv_loop_close(&loop));
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void on_demand_work_cb(uv_work_t* req) {
+}
+
+
+TEST_IMPL(threadpool_on_demand) {
+  uv_threadpool_stats_t stats;
+  uv_loop_t loop;
+  int i;
+
+  if (getenv("UV_THREADPOOL_SIZE") != NULL)
+    RETURN_SKIP("Needs the default thread pool size.");
+
+  /* The default pool starts without threads and adds them as work backs up. */
+  ASSERT(0 == uv_threadpool_stats(NULL, &stats));
+  ASSERT(0 == stats.nthreads);
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_queue_work(&loop,
+                            resize_reqs,
+                            on_demand_work_cb,
+                            resize_after_work_cb));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_threadpool_stats(NULL, &stats));
+  ASSERT(1 == stats.nthreads);
+
+  /* Four requests that wait for each other need all four threads. */
+  ASSERT(0 == uv_barrier_init(&resize_barrier, 4));
+  for (i = 0; i < 4; i++)
+    ASSERT(0 == uv_queue_work(&loop,
+                              resize_reqs + i,
+                              barrier_work_cb,
+                              resize_after_work_cb));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(5 == resize_done);
+  uv_barrier_destroy(&resize_barrier);
+
+  ASSERT(0 == uv_threadpool_stats(NULL, &stats));
+  ASSERT(4 == stats.nthreads);
+
+  ASSERT(0 == uv_loop_close(&loop));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static uv_work_class_t high_class;
+static uv_work_class_t low_class;
+static uv_work_t class_reqs[8];
+static uv_mutex_t class_mutex;
+static int class_order[8];
+static int class_norder;
+static int class_running;
+static int class_max_running;
+static int class_done;
+
+
+static void class_work_cb(uv_work_t* req) {
+  uv_mutex_lock(&class_mutex);
+  ASSERT(class_norder < (int) ARRAY_SIZE(class_order));
+  class_order[class_norder++] = (int) (req - class_reqs);
+  if (++class_running > class_max_running)
+    class_max_running = class_running;
+  uv_mutex_unlock(&class_mutex);
+
+  uv_sleep(10);
+
+  uv_mutex_lock(&class_mutex);
+  class_running--;
+  uv_mutex_unlock(&class_mutex);
+}
+
+
+static void class_after_work_cb(uv_work_t* req, int status) {
+  ASSERT(status == 0);
+  class_done++;
+}
+
+
+TEST_IMPL(threadpool_work_class) {
+  uv_loop_t loop;
+  int i;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_mutex_init(&class_mutex));
+  ASSERT(0 == uv_sem_init(&resize_sem, 0));
+  ASSERT(0 == uv_threadpool_init(&pool, NULL, 1));
+  ASSERT(0 == uv_work_class_init(&pool, &low_class, UV_WORK_PRIORITY_LOW, 0));
+  ASSERT(0 == uv_work_class_init(&pool, &high_class, UV_WORK_PRIORITY_HIGH, 0));
+  ASSERT(0 == uv_loop_set_threadpool(&loop, &pool));
+
+  /* Keep the only thread busy while the queue fills up. */
+  ASSERT(0 == uv_queue_work(&loop, &resize_reqs[0], sem_work_cb, NULL));
+
+  /* High priority work overtakes low priority work queued before it by the
+   * same loop: odd requests are high priority, even ones low.
+   */
+  for (i = 0; i < 8; i++)
+    ASSERT(0 == uv_queue_work_class(&loop,
+                                    i % 2 ? &high_class : &low_class,
+                                    class_reqs + i,
+                                    class_work_cb,
+                                    class_after_work_cb));
+
+  ASSERT(UV_EBUSY == uv_work_class_destroy(&low_class));
+  uv_sem_post(&resize_sem);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(8 == class_done);
+  for (i = 0; i < 4; i++) {
+    ASSERT(class_order[i] == 2 * i + 1);
+    ASSERT(class_order[i + 4] == 2 * i);
+  }
+
+  ASSERT(UV_EBUSY == uv_threadpool_destroy(&pool));
+  ASSERT(0 == uv_work_class_destroy(&low_class));
+  ASSERT(0 == uv_work_class_destroy(&high_class));
+
+  /* A class limited to one running item never runs two at once, even with
+   * idle threads around.
+   */
+  ASSERT(0 == uv_threadpool_resize(&pool, 4));
+  ASSERT(0 == uv_work_class_init(&pool, &low_class, 0, 1));
+  ASSERT(0 == uv_loop_set_work_class(&loop, &low_class));
+  memset(class_order, 0, sizeof(class_order));
+  class_norder = 0;
+  class_max_running = 0;
+  for (i = 0; i < 4; i++)
+    ASSERT(0 == uv_queue_work(&loop,
+                              class_reqs + i,
+                              class_work_cb,
+                              class_after_work_cb));
+  ASSERT(0 == uv_loop_set_work_class(&loop, NULL));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(12 == class_done);
+  ASSERT(4 == class_norder);
+  ASSERT(1 == class_max_running);
+  ASSERT(0 == uv_work_class_destroy(&low_class));
+
+  ASSERT(0 == uv_loop_set_threadpool(&loop, NULL));
+  ASSERT(0 == uv_loop_close(&loop));
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+  uv_sem_destroy(&resize_sem);
+  uv_mutex_destroy(&class_mutex);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static uv_work_t deadline_reqs[4];
+static uv_fs_t deadline_fs_req;
+static int deadline_order[4];
+static int deadline_norder;
+static int deadline_done;
+static int deadline_timedout;
+static uv_sem_t deadline_started;
+
+
+static void deadline_block_cb(uv_work_t* req) {
+  uv_sem_post(&deadline_started);
+  uv_sem_wait(&resize_sem);
+}
+
+
+static void deadline_work_cb(uv_work_t* req) {
+  /* 只有一个线程，不用加锁 */
+  deadline_order[deadline_norder++] = (int) (req - deadline_reqs);
+}
+
+
+static void deadline_after_work_cb(uv_work_t* req, int status) {
+  if (status == UV_ETIMEDOUT)
+    deadline_timedout++;
+  else
+    ASSERT(status == 0);
+  deadline_done++;
+}
+
+
+static void deadline_fs_cb(uv_fs_t* req) {
+  ASSERT(req->result == UV_ETIMEDOUT);
+  deadline_timedout++;
+  uv_fs_req_cleanup(req);
+}
+
+
+TEST_IMPL(threadpool_work_deadline) {
+  uv_loop_t loop;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_sem_init(&resize_sem, 0));
+  ASSERT(0 == uv_sem_init(&deadline_started, 0));
+  ASSERT(0 == uv_threadpool_init(&pool, NULL, 1));
+  ASSERT(0 == uv_loop_set_threadpool(&loop, &pool));
+
+  /* 唯一的线程先被占住，下面的任务都在排队。要等它真的开始执行，否则带
+   * 截止时间的任务会排到它前面
+   */
+  ASSERT(0 == uv_queue_work(&loop, &resize_reqs[0], deadline_block_cb, NULL));
+  uv_sem_wait(&deadline_started);
+
+  /* 截止时间早的先执行，没有截止时间的最后 */
+  ASSERT(0 == uv_queue_work(&loop,
+                            deadline_reqs + 0,
+                            deadline_work_cb,
+                            deadline_after_work_cb));
+  ASSERT(0 == uv_loop_set_work_deadline(&loop, 10000));
+  ASSERT(0 == uv_queue_work(&loop,
+                            deadline_reqs + 1,
+                            deadline_work_cb,
+                            deadline_after_work_cb));
+  ASSERT(0 == uv_loop_set_work_deadline(&loop, 5000));
+  ASSERT(0 == uv_queue_work(&loop,
+                            deadline_reqs + 2,
+                            deadline_work_cb,
+                            deadline_after_work_cb));
+
+  /* 线程空出来之前就过期了，不会执行 */
+  ASSERT(0 == uv_loop_set_work_deadline(&loop, 1));
+  ASSERT(0 == uv_queue_work(&loop,
+                            deadline_reqs + 3,
+                            deadline_work_cb,
+                            deadline_after_work_cb));
+  ASSERT(0 == uv_fs_stat(&loop, &deadline_fs_req, ".", deadline_fs_cb));
+  ASSERT(0 == uv_loop_set_work_deadline(&loop, 0));
+
+  uv_sleep(20);
+  uv_sem_post(&resize_sem);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+
+  ASSERT(4 == deadline_done);
+  ASSERT(2 == deadline_timedout);
+  ASSERT(3 == deadline_norder);
+  ASSERT(2 == deadline_order[0]);
+  ASSERT(1 == deadline_order[1]);
+  ASSERT(0 == deadline_order[2]);
+
+  ASSERT(0 == uv_loop_set_threadpool(&loop, NULL));
+  ASSERT(0 == uv_loop_close(&loop));
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+  uv_sem_destroy(&deadline_started);
+  uv_sem_destroy(&resize_sem);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static uv_work_t timeout_reqs[2];
+static uv_sem_t timeout_started;
+static uv_sem_t timeout_release;
+static int timeout_timedout;
+static int timeout_done;
+
+
+static void timeout_stuck_cb(uv_work_t* req) {
+  uv_sem_post(&timeout_started);
+  uv_sem_wait(&timeout_release);
+}
+
+
+static void timeout_work_cb(uv_work_t* req) {
+}
+
+
+static void timeout_after_work_cb(uv_work_t* req, int status) {
+  ASSERT(0 == status);
+  timeout_done++;
+}
+
+
+static void timeout_stuck_after_cb(uv_work_t* req, int status) {
+  uv_threadpool_stats_t stats;
+
+  ASSERT(status == UV_ETIMEDOUT);
+  timeout_timedout++;
+
+  /* 卡住的线程被隔离了，补上的线程接着执行新的任务 */
+  ASSERT(0 == uv_threadpool_stats(&pool, &stats));
+  ASSERT(1 == stats.quarantined);
+  ASSERT(1 == stats.nthreads);
+
+  ASSERT(0 == uv_loop_set_work_timeout(req->loop, 0));
+  ASSERT(0 == uv_queue_work(req->loop,
+                            timeout_reqs + 1,
+                            timeout_work_cb,
+                            timeout_after_work_cb));
+}
+
+
+TEST_IMPL(threadpool_work_timeout) {
+  uv_threadpool_stats_t stats;
+  uv_loop_t loop;
+  int i;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_sem_init(&timeout_started, 0));
+  ASSERT(0 == uv_sem_init(&timeout_release, 0));
+  ASSERT(0 == uv_threadpool_init(&pool, NULL, 1));
+  ASSERT(0 == uv_loop_set_threadpool(&loop, &pool));
+
+  /* 已经开始执行的任务到了超时也直接结束 */
+  ASSERT(0 == uv_loop_set_work_timeout(&loop, 50));
+  ASSERT(0 == uv_queue_work(&loop,
+                            timeout_reqs + 0,
+                            timeout_stuck_cb,
+                            timeout_stuck_after_cb));
+  uv_sem_wait(&timeout_started);
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(1 == timeout_timedout);
+  ASSERT(1 == timeout_done);
+
+  /* 隔离的线程还没返回，线程池不能销毁 */
+  ASSERT(0 == uv_loop_set_threadpool(&loop, NULL));
+  ASSERT(0 == uv_loop_close(&loop));
+  ASSERT(UV_EBUSY == uv_threadpool_destroy(&pool));
+
+  uv_sem_post(&timeout_release);
+  for (i = 0; i < 1000; i++) {
+    ASSERT(0 == uv_threadpool_stats(&pool, &stats));
+    if (stats.quarantined == 0)
+      break;
+    uv_sleep(1);
+  }
+  ASSERT(0 == stats.quarantined);
+
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+  uv_sem_destroy(&timeout_release);
+  uv_sem_destroy(&timeout_started);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static uv_work_t batch_reqs[64];
+static int batch_work_count;
+static int batch_done_count;
+
+
+static void batch_work_cb(uv_work_t* req) {
+  uv_mutex_lock(&class_mutex);
+  batch_work_count++;
+  uv_mutex_unlock(&class_mutex);
+}
+
+
+static void batch_after_work_cb(uv_work_t* req, int status) {
+  ASSERT(status == 0);
+  ASSERT(req->loop == uv_default_loop());
+  /* Requests of one batch start in array order on a single thread. */
+  ASSERT(req == batch_reqs + batch_done_count);
+  batch_done_count++;
+}
+
+
+TEST_IMPL(threadpool_queue_work_batch) {
+  uv_loop_t* loop;
+
+  loop = uv_default_loop();
+  ASSERT(0 == uv_mutex_init(&class_mutex));
+  ASSERT(0 == uv_threadpool_init(&pool, NULL, 1));
+  ASSERT(0 == uv_loop_set_threadpool(loop, &pool));
+
+  ASSERT(UV_EINVAL == uv_queue_work_batch(loop,
+                                          batch_reqs,
+                                          ARRAY_SIZE(batch_reqs),
+                                          NULL,
+                                          batch_after_work_cb));
+  ASSERT(0 == uv_queue_work_batch(loop,
+                                  batch_reqs,
+                                  0,
+                                  batch_work_cb,
+                                  batch_after_work_cb));
+  ASSERT(0 == uv_queue_work_batch(loop,
+                                  batch_reqs,
+                                  ARRAY_SIZE(batch_reqs),
+                                  batch_work_cb,
+                                  batch_after_work_cb));
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+  ASSERT(ARRAY_SIZE(batch_reqs) == batch_work_count);
+  ASSERT(ARRAY_SIZE(batch_reqs) == batch_done_count);
+
+  ASSERT(0 == uv_loop_set_threadpool(loop, NULL));
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+  uv_mutex_destroy(&class_mutex);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+#ifndef NO_CPU_AFFINITY
+
+static char* affinity_masks;
+static int affinity_ok;
+
+
+static void affinity_work_cb(uv_work_t* req) {
+  uv_thread_t tid;
+  char* cpumask;
+  int cpumasksize;
+  int i;
+
+  cpumasksize = uv_cpumask_size();
+  cpumask = malloc(cpumasksize);
+  ASSERT(cpumask != NULL);
+
+  tid = uv_thread_self();
+  ASSERT(0 == uv_thread_getaffinity(&tid, cpumask, cpumasksize));
+  for (i = 0; i < cpumasksize; i++)
+    ASSERT(!cpumask[i] == !affinity_masks[i]);
+
+  free(cpumask);
+  uv_mutex_lock(&class_mutex);
+  affinity_ok++;
+  uv_mutex_unlock(&class_mutex);
+}
+
+#endif
+
+
+TEST_IMPL(threadpool_affinity) {
+#if defined(NO_CPU_AFFINITY)
+  RETURN_SKIP(NO_CPU_AFFINITY);
+#else
+  uv_loop_t loop;
+  int cpumasksize;
+  int i;
+
+  cpumasksize = uv_cpumask_size();
+  ASSERT(cpumasksize > 0);
+  affinity_masks = calloc(cpumasksize, 1);
+  ASSERT(affinity_masks != NULL);
+  affinity_masks[0] = 1;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_mutex_init(&class_mutex));
+  ASSERT(0 == uv_threadpool_init(&pool, NULL, 2));
+  ASSERT(0 == uv_loop_set_threadpool(&loop, &pool));
+  ASSERT(UV_EINVAL == uv_threadpool_set_affinity(&pool,
+                                                 affinity_masks,
+                                                 cpumasksize - 1,
+                                                 1));
+
+  /* Pins the existing threads and the ones started afterwards. */
+  ASSERT(0 == uv_threadpool_set_affinity(&pool,
+                                         affinity_masks,
+                                         cpumasksize,
+                                         1));
+  ASSERT(0 == uv_threadpool_resize(&pool, 4));
+  ASSERT(0 == uv_barrier_init(&resize_barrier, 4));
+  for (i = 0; i < 4; i++)
+    ASSERT(0 == uv_queue_work(&loop, class_reqs + i, barrier_work_cb, NULL));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  uv_barrier_destroy(&resize_barrier);
+
+  for (i = 0; i < 4; i++)
+    ASSERT(0 == uv_queue_work(&loop, class_reqs + i, affinity_work_cb, NULL));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(4 == affinity_ok);
+
+#if defined(__linux__)
+  /* Node 0 exists on every NUMA-aware kernel; the rest do not have sysfs. */
+  i = uv_threadpool_set_numa_node(&pool, 0);
+  ASSERT(i == 0 || i == UV_ENOENT);
+  ASSERT(UV_EINVAL == uv_threadpool_set_numa_node(&pool, -1));
+#else
+  ASSERT(UV_ENOTSUP == uv_threadpool_set_numa_node(&pool, 0));
+#endif
+
+  ASSERT(0 == uv_threadpool_set_affinity(&pool, NULL, 0, 0));
+  ASSERT(0 == uv_loop_set_threadpool(&loop, NULL));
+  ASSERT(0 == uv_loop_close(&loop));
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+  uv_mutex_destroy(&class_mutex);
+  free(affinity_masks);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#endif
+}
+
+
+static int stats_done;
+
+
+static void stats_after_work_cb(uv_work_t* req, int status) {
+  uint64_t wait_ns;
+  uint64_t run_ns;
+
+  ASSERT(status == 0);
+  ASSERT(0 == uv_req_work_time((uv_req_t*) req, &wait_ns, &run_ns));
+  ASSERT(run_ns > 0);
+  /* The first request blocks the only thread while the others queue up. */
+  if (req == resize_reqs)
+    ASSERT(run_ns >= 10 * 1000 * 1000);
+  else
+    ASSERT(wait_ns >= 10 * 1000 * 1000);
+  stats_done++;
+}
+
+
+static void stats_fs_cb(uv_fs_t* req) {
+  uint64_t wait_ns;
+  uint64_t run_ns;
+
+  ASSERT(req->result == 0);
+  ASSERT(0 == uv_req_work_time((uv_req_t*) req, &wait_ns, &run_ns));
+  ASSERT(wait_ns > 0);
+  uv_fs_req_cleanup(req);
+  stats_done++;
+}
+
+
+TEST_IMPL(threadpool_stats) {
+  uv_phase_histogram_t wait_time;
+  uv_phase_histogram_t run_time;
+  uv_threadpool_stats_t stats;
+  uv_loop_t loop;
+  int i;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_sem_init(&resize_sem, 0));
+  ASSERT(0 == uv_threadpool_init(&pool, NULL, 1));
+  ASSERT(0 == uv_loop_set_threadpool(&loop, &pool));
+  ASSERT(UV_EINVAL == uv_threadpool_histogram(&pool,
+                                              UV_WORK_KIND_CPU,
+                                              &wait_time,
+                                              &run_time));
+  ASSERT(0 == uv_threadpool_enable_histograms(&pool, 1));
+  ASSERT(UV_EINVAL == uv_threadpool_histogram(&pool,
+                                              UV_WORK_KIND_MAX,
+                                              &wait_time,
+                                              &run_time));
+
+  for (i = 0; i < 4; i++)
+    ASSERT(0 == uv_queue_work(&loop, resize_reqs + i, sem_work_cb,
+                              stats_after_work_cb));
+  ASSERT(0 == uv_fs_stat(&loop, &pool_fs_req, ".", stats_fs_cb));
+
+  for (i = 0; i < 500; i++) {
+    ASSERT(0 == uv_threadpool_stats(&pool, &stats));
+    if (stats.queued == 4)
+      break;
+    uv_sleep(10);
+  }
+  ASSERT(stats.nthreads == 1);
+  ASSERT(stats.busy_threads == 1);
+  ASSERT(stats.queued == 4);
+  ASSERT(stats.queued_by_kind[UV_WORK_KIND_CPU] == 3);
+  ASSERT(stats.queued_by_kind[UV_WORK_KIND_FAST_IO] == 1);
+  ASSERT(stats.queued_by_kind[UV_WORK_KIND_SLOW_IO] == 0);
+
+  uv_sleep(20);
+  for (i = 0; i < 4; i++)
+    uv_sem_post(&resize_sem);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(5 == stats_done);
+
+  ASSERT(0 == uv_threadpool_stats(&pool, &stats));
+  ASSERT(stats.queued == 0);
+  ASSERT(0 == uv_threadpool_histogram(&pool,
+                                      UV_WORK_KIND_CPU,
+                                      &wait_time,
+                                      &run_time));
+  ASSERT(wait_time.count == 4);
+  ASSERT(run_time.count == 4);
+  ASSERT(run_time.max >= 20 * 1000 * 1000);
+  ASSERT(uv_phase_histogram_percentile(&wait_time, 50) > 0);
+  ASSERT(0 == uv_threadpool_histogram(&pool,
+                                      UV_WORK_KIND_FAST_IO,
+                                      NULL,
+                                      &run_time));
+  ASSERT(run_time.count == 1);
+  ASSERT(0 == uv_threadpool_histogram(&pool,
+                                      UV_WORK_KIND_SLOW_IO,
+                                      &wait_time,
+                                      NULL));
+  ASSERT(wait_time.count == 0);
+
+  ASSERT(0 == uv_threadpool_enable_histograms(&pool, 0));
+  ASSERT(UV_EINVAL == uv_threadpool_histogram(&pool,
+                                              UV_WORK_KIND_CPU,
+                                              &wait_time,
+                                              &run_time));
+
+  ASSERT(0 == uv_loop_set_threadpool(&loop, NULL));
+  ASSERT(0 == uv_loop_close(&loop));
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+  uv_sem_destroy(&resize_sem);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static void spin_after_work_cb(uv_work_t* req, int status) {
+  ASSERT(status == 0);
+  resize_done++;
+
+  /* One request at a time, so each one finds the worker spinning. */
+  if (resize_done < 100)
+    ASSERT(0 == uv_queue_work(req->loop, req, sem_work_cb, spin_after_work_cb));
+  uv_sem_post(&resize_sem);
+}
+
+
+TEST_IMPL(threadpool_spin) {
+  uv_loop_t loop;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_sem_init(&resize_sem, 1));
+  ASSERT(0 == uv_threadpool_init(&pool, NULL, 2));
+  ASSERT(0 == uv_loop_set_threadpool(&loop, &pool));
+  ASSERT(UV_EINVAL == uv_threadpool_set_spin(&pool, 100, 0));
+  ASSERT(0 == uv_threadpool_set_spin(&pool, 100, 1));
+
+  ASSERT(0 == uv_queue_work(&loop, resize_reqs, sem_work_cb,
+                            spin_after_work_cb));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(100 == resize_done);
+
+  /* Spinning threads still notice that the pool shrinks or goes away. */
+  ASSERT(0 == uv_threadpool_resize(&pool, 1));
+  wait_for_nthreads(&pool, 1);
+  ASSERT(0 == uv_threadpool_set_spin(&pool, 0, 0));
+
+  ASSERT(0 == uv_threadpool_set_spin(&pool, 1000 * 1000, 1));
+  ASSERT(0 == uv_loop_set_threadpool(&loop, NULL));
+  ASSERT(0 == uv_loop_close(&loop));
+  ASSERT(0 == uv_threadpool_destroy(&pool));
+  uv_sem_destroy(&resize_sem);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
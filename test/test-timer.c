@@ -328,3 +328,310 @@ TEST_IMPL(timer_early_check) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+static int wheel_order[8];
+static int wheel_order_len;
+static int wheel_repeat_cb_called;
+
+
+static void wheel_cb(uv_timer_t* handle) {
+  int id;
+
+  id = (int) (intptr_t) handle->data;
+  /* Never fires before its due time. */
+  ASSERT(uv_now(handle->loop) >= handle->timeout);
+  ASSERT(wheel_order_len < (int) ARRAY_SIZE(wheel_order));
+  wheel_order[wheel_order_len++] = id;
+}
+
+
+static void wheel_repeat_cb(uv_timer_t* handle) {
+  if (++wheel_repeat_cb_called == 3)
+    ASSERT(0 == uv_timer_stop(handle));
+}
+
+
+TEST_IMPL(timer_wheel) {
+  uv_timer_t timers[6];
+  uv_timer_t repeat_timer;
+  uv_timer_t busy_timer;
+  uv_loop_t loop;
+  int i;
+
+  /* Can't switch once the heap holds timers. */
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_timer_init(&loop, &busy_timer));
+  ASSERT(0 == uv_timer_start(&busy_timer, never_cb, 1000, 0));
+  ASSERT(UV_EBUSY == uv_loop_configure(&loop, UV_LOOP_TIMER_WHEEL));
+  ASSERT(0 == uv_timer_stop(&busy_timer));
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_TIMER_WHEEL));
+  ASSERT(0 == uv_loop_configure(&loop, UV_LOOP_TIMER_WHEEL));
+
+  for (i = 0; i < (int) ARRAY_SIZE(timers); i++) {
+    ASSERT(0 == uv_timer_init(&loop, timers + i));
+    timers[i].data = (void*) (intptr_t) i;
+  }
+
+  /* 300 ms sits in the second level and has to be cascaded down, the two
+   * timers with the same timeout must fire in start order.
+   */
+  ASSERT(0 == uv_timer_start(timers + 0, wheel_cb, 300, 0));
+  ASSERT(0 == uv_timer_start(timers + 1, wheel_cb, 20, 0));
+  ASSERT(0 == uv_timer_start(timers + 2, wheel_cb, 0, 0));
+  ASSERT(0 == uv_timer_start(timers + 3, wheel_cb, 20, 0));
+  ASSERT(0 == uv_timer_start(timers + 4, wheel_cb, 10, 0));
+  /* Beyond the reach of the wheel, stopped before it fires. */
+  ASSERT(0 == uv_timer_start(timers + 5, wheel_cb, (uint64_t) -1, 0));
+  ASSERT(0 == uv_timer_stop(timers + 5));
+  /* Restarting moves the timer. */
+  ASSERT(0 == uv_timer_start(timers + 1, wheel_cb, 30, 0));
+
+  ASSERT(0 == uv_timer_init(&loop, &repeat_timer));
+  ASSERT(0 == uv_timer_start(&repeat_timer, wheel_repeat_cb, 5, 5));
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+
+  ASSERT(5 == wheel_order_len);
+  ASSERT(2 == wheel_order[0]);
+  ASSERT(4 == wheel_order[1]);
+  ASSERT(3 == wheel_order[2]);
+  ASSERT(1 == wheel_order[3]);
+  ASSERT(0 == wheel_order[4]);
+  ASSERT(3 == wheel_repeat_cb_called);
+
+  for (i = 0; i < (int) ARRAY_SIZE(timers); i++)
+    uv_close((uv_handle_t*) (timers + i), NULL);
+  uv_close((uv_handle_t*) &repeat_timer, NULL);
+  uv_close((uv_handle_t*) &busy_timer, NULL);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_close(&loop));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static uint64_t slack_fired[20];
+static int slack_cb_called;
+
+
+static void slack_cb(uv_timer_t* handle) {
+  slack_fired[slack_cb_called++] = handle->timeout;
+  ASSERT(handle->timeout % 256 == 0);
+  ASSERT(uv_now(handle->loop) >= handle->timeout);
+}
+
+
+TEST_IMPL(timer_start_ex) {
+  uv_timer_t timers[20];
+  uv_timer_t handle;
+  uv_loop_t loop;
+  uint64_t start;
+  int groups;
+  int i;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_timer_init(&loop, &handle));
+  ASSERT(UV_EINVAL == uv_timer_start_ex(&handle, NULL, 1, 0, 10));
+
+  /* Deadlines 1-20 ms out with 256 ms of slack all fall in a window of 20 ms
+   * that is aligned to 256 ms, so there are at most two distinct expiries.
+   */
+  start = uv_now(&loop);
+  for (i = 0; i < (int) ARRAY_SIZE(timers); i++) {
+    ASSERT(0 == uv_timer_init(&loop, timers + i));
+    ASSERT(0 == uv_timer_start_ex(timers + i, slack_cb, i + 1, 0, 256));
+    ASSERT(timers[i].timeout >= start + i + 1);
+    ASSERT(timers[i].timeout <= start + i + 1 + 256);
+  }
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(20 == slack_cb_called);
+
+  groups = 1;
+  for (i = 1; i < slack_cb_called; i++) {
+    ASSERT(slack_fired[i] >= slack_fired[i - 1]);
+    if (slack_fired[i] != slack_fired[i - 1])
+      groups++;
+  }
+  ASSERT(groups <= 2);
+
+  /* Without slack the deadline is exact. */
+  start = uv_now(&loop);
+  ASSERT(0 == uv_timer_start_ex(&handle, never_cb, 1000, 0, 0));
+  ASSERT(handle.timeout == start + 1000);
+  ASSERT(0 == uv_timer_stop(&handle));
+
+  for (i = 0; i < (int) ARRAY_SIZE(timers); i++)
+    uv_close((uv_handle_t*) (timers + i), NULL);
+  uv_close((uv_handle_t*) &handle, NULL);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_close(&loop));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static uint64_t heap_last_timeout;
+static uint64_t heap_last_start_id;
+static int heap_cb_called;
+
+
+static void heap_order_cb(uv_timer_t* handle) {
+  /* Due time never goes backwards, ties fire in start order. */
+  ASSERT(handle->timeout >= heap_last_timeout);
+  if (handle->timeout == heap_last_timeout)
+    ASSERT(handle->start_id > heap_last_start_id);
+  heap_last_timeout = handle->timeout;
+  heap_last_start_id = handle->start_id;
+  heap_cb_called++;
+}
+
+
+TEST_IMPL(timer_heap_order) {
+  uv_timer_t timers[500];
+  uv_loop_t loop;
+  unsigned int seed;
+  int i;
+
+  ASSERT(0 == uv_loop_init(&loop));
+
+  seed = 42;
+  for (i = 0; i < (int) ARRAY_SIZE(timers); i++) {
+    seed = seed * 1103515245 + 12345;
+    ASSERT(0 == uv_timer_init(&loop, timers + i));
+    ASSERT(0 == uv_timer_start(timers + i, heap_order_cb, (seed >> 16) % 30, 0));
+  }
+
+  /* Remove from the middle, the end and the top of the heap, re-arm some. */
+  for (i = 0; i < (int) ARRAY_SIZE(timers); i += 3)
+    ASSERT(0 == uv_timer_stop(timers + i));
+  for (i = 0; i < (int) ARRAY_SIZE(timers); i += 6)
+    ASSERT(0 == uv_timer_start(timers + i, heap_order_cb, i % 20, 0));
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(heap_cb_called == 500 - 167 + 84);
+
+  for (i = 0; i < (int) ARRAY_SIZE(timers); i++)
+    uv_close((uv_handle_t*) (timers + i), NULL);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_close(&loop));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+#define NS_TIMEOUT 500000
+#define NS_REPEAT 250000
+#define NS_EXPIRIES 40
+
+static uint64_t ns_due;
+static uint64_t ns_last;
+static int ns_cb_called;
+
+
+static void ns_cb(uv_timer_t* handle) {
+  /* Never early. The repeat is already armed one period after the previous
+   * deadline, or right away when the loop has fallen a whole period behind.
+   */
+  ns_last = uv_hrtime();
+  ASSERT(ns_last >= ns_due);
+#if defined(__linux__) || defined(__APPLE__)
+  ASSERT(handle->timeout >= ns_due + NS_REPEAT);
+  ASSERT(handle->timeout == ns_due + NS_REPEAT || handle->timeout < ns_last);
+  ns_due = handle->timeout;
+#else
+  ns_due += NS_REPEAT;
+#endif
+  if (++ns_cb_called == NS_EXPIRIES)
+    uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+TEST_IMPL(timer_start_ns) {
+  uv_timer_t handle;
+  uv_timer_t guard_handle;
+  uv_loop_t loop;
+  uint64_t start;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_timer_init(&loop, &handle));
+  ASSERT(0 == uv_timer_init(&loop, &guard_handle));
+  ASSERT(UV_EINVAL == uv_timer_start_ns(&handle, NULL, 1, 0));
+
+  /* A millisecond timer further out must not hold up the nanosecond one,
+   * and fails the test if the nanosecond timer never gets there.
+   */
+  ASSERT(0 == uv_timer_start(&guard_handle, never_cb, 10000, 0));
+  uv_unref((uv_handle_t*) &guard_handle);
+
+  start = uv_hrtime();
+  ASSERT(0 == uv_timer_start_ns(&handle, ns_cb, NS_TIMEOUT, NS_REPEAT));
+  ASSERT(NS_REPEAT == uv_timer_get_repeat(&handle));
+  ns_due = start + NS_TIMEOUT;
+#if defined(__linux__) || defined(__APPLE__)
+  /* The deadline is kept in nanoseconds, not rounded to loop->time. */
+  ASSERT(handle.timeout >= start + NS_TIMEOUT);
+  ASSERT(handle.timeout <= uv_hrtime() + NS_TIMEOUT);
+  ns_due = handle.timeout;
+#endif
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(NS_EXPIRIES == ns_cb_called);
+  ASSERT(ns_last >= start + NS_TIMEOUT + (NS_EXPIRIES - 1) * NS_REPEAT);
+
+#if defined(__linux__) || defined(__APPLE__)
+  /* Rounded up to milliseconds every expiry would take at least 1 ms, 40 ms
+   * in total. Late expiries catch up because the repeat is relative to the
+   * deadline, so scheduler latency only delays the last one: about 10 ms
+   * nominal, leaving a wide margin below the rounded equivalent.
+   */
+  ASSERT(ns_last - start < (uint64_t) NS_EXPIRIES * 1000000 * 3 / 4);
+#endif
+
+  uv_close((uv_handle_t*) &guard_handle, NULL);
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(0 == uv_loop_close(&loop));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+static int ns_only_cb_called;
+
+
+static void ns_only_cb(uv_timer_t* handle) {
+  if (++ns_only_cb_called == 5)
+    uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+TEST_IMPL(timer_start_ns_only) {
+  uv_metrics_t metrics;
+  uv_timer_t handle;
+  uv_loop_t loop;
+  uint64_t start;
+
+  /* With nothing but a nanosecond timer on the loop, uv_run() has to sleep
+   * until the kernel timer fires instead of spinning on a zero timeout.
+   */
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_timer_init(&loop, &handle));
+
+  start = uv_hrtime();
+  ASSERT(0 == uv_timer_start_ns(&handle, ns_only_cb, 2000000, 2000000));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(5 == ns_only_cb_called);
+  ASSERT(uv_hrtime() - start >= 10000000);
+
+  ASSERT(0 == uv_metrics_info(&loop, &metrics));
+  ASSERT(metrics.loop_count < 50);
+
+  ASSERT(0 == uv_loop_close(&loop));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
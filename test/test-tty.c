@@ -445,3 +445,105 @@ TEST_IMPL(tty_pty) {
 #endif
   return 0;
 }
+
+
+static int tty_buffered_write_cb_called;
+
+static void tty_buffered_write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  tty_buffered_write_cb_called++;
+}
+
+
+static ssize_t tty_buffered_read(int fd, char* buf, size_t len) {
+  ssize_t n;
+
+  do
+    n = read(fd, buf, len);
+  while (n == -1 && errno == EINTR);
+
+  return n;
+}
+
+
+TEST_IMPL(tty_buffered_write) {
+#if defined(__APPLE__)                            || \
+    defined(__DragonFly__)                        || \
+    defined(__FreeBSD__)                          || \
+    defined(__FreeBSD_kernel__)                   || \
+    (defined(__linux__) && !defined(__ANDROID__)) || \
+    defined(__NetBSD__)                           || \
+    defined(__OpenBSD__)
+  int master_fd, slave_fd, r;
+  struct winsize w;
+  uv_write_t reqs[5];
+  uv_loop_t loop;
+  uv_tty_t tty;
+  uv_buf_t buf;
+  char data[32];
+  char out[64];
+
+  ASSERT(0 == uv_loop_init(&loop));
+
+  memset(&w, 0, sizeof(w));
+  r = openpty(&master_fd, &slave_fd, NULL, NULL, &w);
+  if (r != 0)
+    RETURN_SKIP("No pty available, skipping.");
+
+  ASSERT(0 == fcntl(master_fd, F_SETFL, O_NONBLOCK));
+  ASSERT(0 == uv_tty_init(&loop, &tty, slave_fd, 0));
+  ASSERT(0 == uv_tty_set_buffering(&tty, sizeof(data) + 1, 20));
+
+  /* 没攒够也没到时间，什么都没写 */
+  buf = uv_buf_init("ab", 2);
+  ASSERT(0 == uv_write(&reqs[0], (uv_stream_t*) &tty, &buf, 1,
+                       tty_buffered_write_cb));
+  ASSERT(0 == uv_write(&reqs[1], (uv_stream_t*) &tty, &buf, 1,
+                       tty_buffered_write_cb));
+  ASSERT(-1 == tty_buffered_read(master_fd, out, sizeof(out)));
+  ASSERT(errno == EAGAIN);
+  ASSERT(tty.write_queue_size == 4);
+
+  /* 定时器到了一起写出去 */
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(tty_buffered_write_cb_called == 2);
+  ASSERT(4 == tty_buffered_read(master_fd, out, sizeof(out)));
+  ASSERT(0 == memcmp(out, "abab", 4));
+
+  /* 攒够了马上写 */
+  memset(data, 'x', sizeof(data));
+  buf = uv_buf_init(data, sizeof(data));
+  ASSERT(0 == uv_write(&reqs[2], (uv_stream_t*) &tty, &buf, 1,
+                       tty_buffered_write_cb));
+  ASSERT(-1 == tty_buffered_read(master_fd, out, sizeof(out)));
+  buf = uv_buf_init("y", 1);
+  ASSERT(0 == uv_write(&reqs[3], (uv_stream_t*) &tty, &buf, 1,
+                       tty_buffered_write_cb));
+  ASSERT(sizeof(data) + 1 == tty_buffered_read(master_fd, out, sizeof(out)));
+  ASSERT(out[sizeof(data)] == 'y');
+
+  /* 关闭的时候攒着的也写出去 */
+  buf = uv_buf_init("z", 1);
+  ASSERT(0 == uv_write(&reqs[4], (uv_stream_t*) &tty, &buf, 1,
+                       tty_buffered_write_cb));
+  ASSERT(0 == uv_tty_flush(&tty));
+  ASSERT(1 == tty_buffered_read(master_fd, out, sizeof(out)));
+  ASSERT(out[0] == 'z');
+
+  buf = uv_buf_init("w", 1);
+  ASSERT(0 == uv_write(&reqs[0], (uv_stream_t*) &tty, &buf, 1,
+                       tty_buffered_write_cb));
+  ASSERT(0 == close(slave_fd));
+  uv_close((uv_handle_t*) &tty, NULL);
+  ASSERT(1 == tty_buffered_read(master_fd, out, sizeof(out)));
+  ASSERT(out[0] == 'w');
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(tty_buffered_write_cb_called == 6);
+  ASSERT(0 == close(master_fd));
+  ASSERT(0 == uv_loop_close(&loop));
+
+  MAKE_VALGRIND_HAPPY();
+#endif
+  return 0;
+}
@@ -0,0 +1,175 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+#define SEGMENT_SIZE 100
+#define PAYLOAD_SIZE (3 * SEGMENT_SIZE + 50)
+
+static uv_udp_t recver;
+static uv_udp_t sender;
+static uv_udp_send_t send_req;
+static char payload[PAYLOAD_SIZE];
+static size_t nread_total;
+static int recv_cb_called;
+static int send_cb_called;
+static int close_cb_called;
+static int gro;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void alloc_cb(uv_handle_t* handle,
+                     size_t suggested_size,
+                     uv_buf_t* buf) {
+  static char slab[64 * 1024];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void recv_cb(uv_udp_t* handle,
+                    ssize_t nread,
+                    const uv_buf_t* buf,
+                    const struct sockaddr* addr,
+                    unsigned flags) {
+  ASSERT(nread >= 0);
+  if (nread == 0)
+    return;
+
+  ASSERT(addr != NULL);
+  ASSERT(0 == memcmp(buf->base, payload + nread_total, nread));
+
+  if (flags & UV_UDP_GRO) {
+    /* 合并报文，段大小就是发送端的segment_size */
+    ASSERT(gro);
+    ASSERT(SEGMENT_SIZE == uv_udp_get_gro_segment_size(handle));
+  } else {
+    ASSERT(0 == uv_udp_get_gro_segment_size(handle));
+    ASSERT(nread == (nread_total + SEGMENT_SIZE <= PAYLOAD_SIZE ?
+                     SEGMENT_SIZE : PAYLOAD_SIZE % SEGMENT_SIZE));
+  }
+
+  recv_cb_called++;
+  nread_total += nread;
+  if (nread_total == PAYLOAD_SIZE) {
+    uv_close((uv_handle_t*) handle, close_cb);
+    uv_close((uv_handle_t*) &sender, close_cb);
+  }
+}
+
+
+static void send_cb(uv_udp_send_t* req, int status) {
+  ASSERT(req == &send_req);
+  ASSERT(status == 0);
+  send_cb_called++;
+}
+
+
+static int run_test(void) {
+  struct sockaddr_in addr;
+  uv_buf_t buf;
+  size_t i;
+  int r;
+
+  for (i = 0; i < sizeof(payload); i++)
+    payload[i] = 'a' + i % 26;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &recver));
+  ASSERT(UV_EBADF == uv_udp_set_gro(&recver, 1));
+  ASSERT(0 == uv_udp_bind(&recver, (const struct sockaddr*) &addr, 0));
+  if (gro) {
+    r = uv_udp_set_gro(&recver, 1);
+    if (r == UV_ENOTSUP || r == UV_ENOPROTOOPT)
+      return r;
+    ASSERT(r == 0);
+  }
+  ASSERT(0 == uv_udp_recv_start(&recver, alloc_cb, recv_cb));
+
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &sender));
+  buf = uv_buf_init(payload, sizeof(payload));
+  ASSERT(UV_EINVAL == uv_udp_send_gso(&send_req,
+                                      &sender,
+                                      &buf,
+                                      1,
+                                      (const struct sockaddr*) &addr,
+                                      0,
+                                      send_cb));
+  r = uv_udp_send_gso(&send_req,
+                      &sender,
+                      &buf,
+                      1,
+                      (const struct sockaddr*) &addr,
+                      SEGMENT_SIZE,
+                      send_cb);
+  if (r == UV_ENOTSUP)
+    return r;
+  ASSERT(r == 0);
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(send_cb_called == 1);
+  ASSERT(nread_total == PAYLOAD_SIZE);
+  ASSERT(close_cb_called == 2);
+  if (!gro)
+    ASSERT(recv_cb_called == 4);
+
+  return 0;
+}
+
+
+static void close_all(void) {
+  if (!uv_is_closing((uv_handle_t*) &recver))
+    uv_close((uv_handle_t*) &recver, NULL);
+  if (sender.type == UV_UDP && !uv_is_closing((uv_handle_t*) &sender))
+    uv_close((uv_handle_t*) &sender, NULL);
+  uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+}
+
+
+TEST_IMPL(udp_gso) {
+  if (run_test() != 0) {
+    close_all();
+    RETURN_SKIP("UDP_SEGMENT is not supported");
+  }
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(udp_gro) {
+  gro = 1;
+  if (run_test() != 0) {
+    close_all();
+    RETURN_SKIP("UDP_SEGMENT or UDP_GRO is not supported");
+  }
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
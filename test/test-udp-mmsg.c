@@ -0,0 +1,197 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_SENDS 8
+
+static uv_udp_t recver;
+static uv_udp_t sender;
+static int alloc_cb_called;
+static int recv_cb_called;
+static int free_cb_called;
+static int close_cb_called;
+static int send_cb_called;
+static uv_udp_send_t send_reqs[NUM_SENDS];
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void alloc_cb(uv_handle_t* handle,
+                     size_t suggested_size,
+                     uv_buf_t* buf) {
+  alloc_cb_called++;
+  buf->base = malloc(suggested_size);
+  ASSERT(buf->base != NULL);
+  buf->len = suggested_size;
+}
+
+
+static void recv_cb(uv_udp_t* handle,
+                    ssize_t nread,
+                    const uv_buf_t* buf,
+                    const struct sockaddr* addr,
+                    unsigned flags) {
+  ASSERT(nread >= 0);
+
+  if (nread == 0) {
+    /* 整块buf交还回来了，切出来的槽位不能单独释放 */
+    ASSERT(addr == NULL);
+    ASSERT(!(flags & UV_UDP_MMSG_CHUNK));
+    free_cb_called++;
+    free(buf->base);
+    return;
+  }
+
+  ASSERT(addr != NULL);
+  ASSERT(nread == 4);
+  ASSERT(0 == memcmp(buf->base, "PING", 4));
+#if defined(__linux__)
+  ASSERT(flags & UV_UDP_MMSG_CHUNK);
+#else
+  free(buf->base);
+  free_cb_called++;
+#endif
+
+  if (++recv_cb_called == NUM_SENDS) {
+    uv_close((uv_handle_t*) handle, close_cb);
+    uv_close((uv_handle_t*) &sender, close_cb);
+  }
+}
+
+
+static void send_cb(uv_udp_send_t* req, int status) {
+  ASSERT(req == &send_reqs[send_cb_called]);
+  ASSERT(status == 0);
+  send_cb_called++;
+}
+
+
+static void plain_alloc_cb(uv_handle_t* handle,
+                           size_t suggested_size,
+                           uv_buf_t* buf) {
+  static char slab[64];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void plain_recv_cb(uv_udp_t* handle,
+                          ssize_t nread,
+                          const uv_buf_t* buf,
+                          const struct sockaddr* addr,
+                          unsigned flags) {
+  ASSERT(nread >= 0);
+  if (nread == 0)
+    return;
+
+  ASSERT(nread == 4);
+  ASSERT(0 == memcmp(buf->base, "PING", 4));
+
+  if (++recv_cb_called == NUM_SENDS) {
+    uv_close((uv_handle_t*) handle, close_cb);
+    uv_close((uv_handle_t*) &sender, close_cb);
+  }
+}
+
+
+TEST_IMPL(udp_mmsg) {
+  struct sockaddr_in addr;
+  uv_buf_t buf;
+  int i;
+
+  ASSERT(UV_EINVAL == uv_udp_init_ex(uv_default_loop(), &recver, 512));
+  ASSERT(0 == uv_udp_init_ex(uv_default_loop(),
+                             &recver,
+                             AF_UNSPEC | UV_UDP_RECVMMSG));
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_udp_bind(&recver, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_udp_recv_start(&recver, alloc_cb, recv_cb));
+
+  /* 先把报文都发出去，接收端一次recvmmsg()就能收一批 */
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &sender));
+  buf = uv_buf_init("PING", 4);
+  for (i = 0; i < NUM_SENDS; i++)
+    ASSERT(4 == uv_udp_try_send(&sender,
+                                &buf,
+                                1,
+                                (const struct sockaddr*) &addr));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(recv_cb_called == NUM_SENDS);
+  ASSERT(close_cb_called == 2);
+  ASSERT(free_cb_called == alloc_cb_called);
+#if defined(__linux__)
+  ASSERT(alloc_cb_called < NUM_SENDS);
+#endif
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(udp_send_batch) {
+  struct sockaddr_in addr;
+  uv_buf_t bufs[NUM_SENDS];
+  int i;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &recver));
+  ASSERT(0 == uv_udp_bind(&recver, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_udp_recv_start(&recver, plain_alloc_cb, plain_recv_cb));
+
+  for (i = 0; i < NUM_SENDS; i++)
+    bufs[i] = uv_buf_init("PING", 4);
+
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &sender));
+  ASSERT(UV_EINVAL == uv_udp_send_batch(send_reqs,
+                                        &sender,
+                                        bufs,
+                                        0,
+                                        (const struct sockaddr*) &addr,
+                                        send_cb));
+  ASSERT(NUM_SENDS == uv_udp_send_batch(send_reqs,
+                                        &sender,
+                                        bufs,
+                                        NUM_SENDS,
+                                        (const struct sockaddr*) &addr,
+                                        send_cb));
+  ASSERT(sender.send_queue_count == NUM_SENDS);
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(send_cb_called == NUM_SENDS);
+  ASSERT(recv_cb_called == NUM_SENDS);
+  ASSERT(close_cb_called == 2);
+  ASSERT(sender.send_queue_count == 0);
+  ASSERT(sender.send_queue_size == 0);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
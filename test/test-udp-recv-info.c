@@ -0,0 +1,170 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+static uv_udp_t server;
+static uv_udp_t client;
+static uv_udp_send_t send_req;
+static uv_udp_send_t reply_req;
+static int server_recv_cb_called;
+static int client_recv_cb_called;
+static int send_cb_called;
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void alloc_cb(uv_handle_t* handle,
+                     size_t suggested_size,
+                     uv_buf_t* buf) {
+  static char slab[64];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void send_cb(uv_udp_send_t* req, int status) {
+  ASSERT(status == 0);
+  send_cb_called++;
+}
+
+
+static void client_recv_cb(uv_udp_t* handle,
+                           ssize_t nread,
+                           const uv_buf_t* buf,
+                           const struct sockaddr* addr,
+                           unsigned flags) {
+  ASSERT(nread >= 0);
+  if (nread == 0)
+    return;
+
+  ASSERT(nread == 4);
+  ASSERT(0 == memcmp(buf->base, "PONG", 4));
+  ASSERT(addr != NULL);
+  ASSERT(addr->sa_family == AF_INET);
+  ASSERT(((const struct sockaddr_in*) addr)->sin_addr.s_addr ==
+         htonl(0x7f000001));
+  client_recv_cb_called++;
+
+  uv_close((uv_handle_t*) &server, close_cb);
+  uv_close((uv_handle_t*) &client, close_cb);
+}
+
+
+static void server_recv_cb(uv_udp_t* handle,
+                           ssize_t nread,
+                           const uv_buf_t* buf,
+                           const uv_udp_recv_info_t* info,
+                           unsigned flags) {
+  const struct sockaddr_in* local;
+  uv_buf_t reply;
+
+  ASSERT(info != NULL);
+  ASSERT(nread >= 0);
+  if (nread == 0) {
+    ASSERT(info->addr == NULL);
+    return;
+  }
+
+  ASSERT(nread == 4);
+  ASSERT(0 == memcmp(buf->base, "PING", 4));
+  ASSERT(info->addr != NULL);
+  server_recv_cb_called++;
+
+  local = (const struct sockaddr_in*) &info->local;
+  ASSERT(local->sin_family == AF_INET);
+  ASSERT(local->sin_addr.s_addr == htonl(0x7f000001));
+  ASSERT(info->ifindex > 0);
+  ASSERT(info->timestamp.tv_sec > 0);
+  ASSERT(info->tos == 0);
+
+  /* 从报文的目的地址回复 */
+  reply = uv_buf_init("PONG", 4);
+  ASSERT(0 == uv_udp_send_from(&reply_req,
+                               handle,
+                               &reply,
+                               1,
+                               info->addr,
+                               (const struct sockaddr*) &info->local,
+                               send_cb));
+}
+
+
+TEST_IMPL(udp_recv_info) {
+#ifndef __linux__
+  RETURN_SKIP("Receive timestamps and IP_RECVTOS are only tested on linux");
+#else
+  struct sockaddr_in addr;
+  struct sockaddr_in any;
+  uv_buf_t buf;
+
+  ASSERT(0 == uv_ip4_addr("0.0.0.0", TEST_PORT, &any));
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &server));
+  ASSERT(0 == uv_udp_bind(&server, (const struct sockaddr*) &any, 0));
+  ASSERT(UV_EINVAL == uv_udp_recv_start_ex(&server,
+                                           alloc_cb,
+                                           server_recv_cb,
+                                           0x100));
+  ASSERT(0 == uv_udp_recv_start_ex(&server,
+                                   alloc_cb,
+                                   server_recv_cb,
+                                   UV_UDP_RECV_TIMESTAMP |
+                                   UV_UDP_RECV_PKTINFO |
+                                   UV_UDP_RECV_TOS));
+
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &client));
+  ASSERT(0 == uv_udp_recv_start(&client, alloc_cb, client_recv_cb));
+
+  buf = uv_buf_init("PING", 4);
+  ASSERT(UV_EINVAL == uv_udp_send_from(&send_req,
+                                       &client,
+                                       &buf,
+                                       1,
+                                       (const struct sockaddr*) &addr,
+                                       NULL,
+                                       send_cb));
+  ASSERT(0 == uv_udp_send(&send_req,
+                          &client,
+                          &buf,
+                          1,
+                          (const struct sockaddr*) &addr,
+                          send_cb));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(server_recv_cb_called == 1);
+  ASSERT(client_recv_cb_called == 1);
+  ASSERT(send_cb_called == 2);
+  ASSERT(close_cb_called == 2);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+#endif
+}
@@ -0,0 +1,158 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+#define NREQS 3
+
+static uv_udp_t handle;
+static uv_udp_send_t reqs[NREQS];
+static int send_status[NREQS];
+static int send_cb_called;
+static int watermark_above;
+static int watermark_below;
+
+
+static void send_cb(uv_udp_send_t* req, int status) {
+  send_status[req - reqs] = status;
+  send_cb_called++;
+}
+
+
+static void watermark_cb(uv_udp_t* h, int above) {
+  ASSERT(h == &handle);
+  if (above) {
+    ASSERT(h->send_queue_size > 8);
+    watermark_above++;
+  } else {
+    ASSERT(h->send_queue_size == 0);
+    watermark_below++;
+  }
+}
+
+
+/* 第一个请求立即发出去，回调之前仍然占着队列；第二个排在写队列里，
+ * 第三个就超过了两个请求的限制
+ */
+static int send_three(uv_udp_queue_policy policy) {
+  struct sockaddr_in addr;
+  uv_buf_t buf;
+  int r;
+  int i;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &handle));
+  ASSERT(0 == uv_udp_set_send_queue_limit(&handle, 0, 2, policy));
+
+  memset(send_status, 0, sizeof(send_status));
+  send_cb_called = 0;
+  buf = uv_buf_init("PING", 4);
+
+  for (i = 0; i < 2; i++)
+    ASSERT(0 == uv_udp_send(&reqs[i],
+                            &handle,
+                            &buf,
+                            1,
+                            (const struct sockaddr*) &addr,
+                            send_cb));
+  ASSERT(handle.send_queue_count == 2);
+
+  r = uv_udp_send(&reqs[2],
+                  &handle,
+                  &buf,
+                  1,
+                  (const struct sockaddr*) &addr,
+                  send_cb);
+  ASSERT(handle.send_queue_count <= 2);
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(handle.send_queue_count == 0);
+  ASSERT(handle.send_queue_size == 0);
+
+  uv_close((uv_handle_t*) &handle, NULL);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  return r;
+}
+
+
+TEST_IMPL(udp_send_queue_limit) {
+  ASSERT(UV_EINVAL == uv_udp_set_send_queue_limit(&handle, 0, 0, 42));
+
+  ASSERT(UV_ENOBUFS == send_three(UV_UDP_QUEUE_FAIL));
+  ASSERT(send_cb_called == 2);
+  ASSERT(send_status[0] == 0);
+  ASSERT(send_status[1] == 0);
+
+  ASSERT(0 == send_three(UV_UDP_QUEUE_DROP_NEWEST));
+  ASSERT(send_cb_called == 3);
+  ASSERT(send_status[0] == 0);
+  ASSERT(send_status[1] == 0);
+  ASSERT(send_status[2] == UV_ENOBUFS);
+
+  ASSERT(0 == send_three(UV_UDP_QUEUE_DROP_OLDEST));
+  ASSERT(send_cb_called == 3);
+  ASSERT(send_status[0] == 0);
+  ASSERT(send_status[1] == UV_ENOBUFS);
+  ASSERT(send_status[2] == 0);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(udp_send_watermarks) {
+  struct sockaddr_in addr;
+  uv_buf_t buf;
+  int i;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &handle));
+  ASSERT(UV_EINVAL == uv_udp_set_send_watermarks(&handle, 9, 8, watermark_cb));
+  ASSERT(0 == uv_udp_set_send_watermarks(&handle, 0, 8, watermark_cb));
+
+  buf = uv_buf_init("PING", 4);
+  for (i = 0; i < NREQS; i++)
+    ASSERT(0 == uv_udp_send(&reqs[i],
+                            &handle,
+                            &buf,
+                            1,
+                            (const struct sockaddr*) &addr,
+                            send_cb));
+
+  /* 第三个请求让队列变成12字节 */
+  ASSERT(watermark_above == 1);
+  ASSERT(watermark_below == 0);
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(send_cb_called == NREQS);
+  ASSERT(watermark_above == 1);
+  ASSERT(watermark_below == 1);
+
+  uv_close((uv_handle_t*) &handle, NULL);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
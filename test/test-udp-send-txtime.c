@@ -0,0 +1,135 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+#define NREQS 3
+
+static uv_udp_t recver;
+static uv_udp_t sender;
+static uv_udp_send_t send_reqs[NREQS];
+static int recv_cb_called;
+static int send_cb_called;
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void alloc_cb(uv_handle_t* handle,
+                     size_t suggested_size,
+                     uv_buf_t* buf) {
+  static char slab[64];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void recv_cb(uv_udp_t* handle,
+                    ssize_t nread,
+                    const uv_buf_t* buf,
+                    const struct sockaddr* addr,
+                    unsigned flags) {
+  ASSERT(nread >= 0);
+  if (nread == 0)
+    return;
+
+  ASSERT(nread == 4);
+  ASSERT(0 == memcmp(buf->base, "PING", 4));
+  if (++recv_cb_called == NREQS) {
+    uv_close((uv_handle_t*) handle, close_cb);
+    uv_close((uv_handle_t*) &sender, close_cb);
+  }
+}
+
+
+static void send_cb(uv_udp_send_t* req, int status) {
+  ASSERT(status == 0);
+  send_cb_called++;
+}
+
+
+TEST_IMPL(udp_send_txtime) {
+  struct sockaddr_in addr;
+  uint64_t now;
+  uv_buf_t buf;
+  int r;
+  int i;
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+  ASSERT(0 == uv_udp_init(uv_default_loop(), &recver));
+  ASSERT(0 == uv_udp_bind(&recver, (const struct sockaddr*) &addr, 0));
+  ASSERT(0 == uv_udp_recv_start(&recver, alloc_cb, recv_cb));
+
+  ASSERT(0 == uv_udp_init_ex(uv_default_loop(), &sender, AF_INET));
+  buf = uv_buf_init("PING", 4);
+  now = uv_hrtime();
+
+  /* 没有打开SO_TXTIME */
+  ASSERT(UV_EINVAL == uv_udp_send_txtime(&send_reqs[0],
+                                         &sender,
+                                         &buf,
+                                         1,
+                                         (const struct sockaddr*) &addr,
+                                         now,
+                                         send_cb));
+
+  r = uv_udp_set_txtime(&sender, 1);
+  if (r == UV_ENOTSUP || r == UV_ENOPROTOOPT || r == UV_EINVAL) {
+    uv_close((uv_handle_t*) &recver, NULL);
+    uv_close((uv_handle_t*) &sender, NULL);
+    uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+    RETURN_SKIP("SO_TXTIME is not supported");
+  }
+  ASSERT(r == 0);
+
+  ASSERT(UV_EINVAL == uv_udp_send_txtime(&send_reqs[0],
+                                         &sender,
+                                         &buf,
+                                         1,
+                                         (const struct sockaddr*) &addr,
+                                         0,
+                                         send_cb));
+
+  /* 回环网卡上没有fq，报文会立即发出 */
+  for (i = 0; i < NREQS; i++)
+    ASSERT(0 == uv_udp_send_txtime(&send_reqs[i],
+                                   &sender,
+                                   &buf,
+                                   1,
+                                   (const struct sockaddr*) &addr,
+                                   now + i * 1000000,
+                                   send_cb));
+
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  ASSERT(send_cb_called == NREQS);
+  ASSERT(recv_cb_called == NREQS);
+  ASSERT(close_cb_called == 2);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
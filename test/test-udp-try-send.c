@@ -119,3 +119,97 @@ TEST_IMPL(udp_try_send) {
   MAKE_VALGRIND_HAPPY();
   return 0;
 }
+
+
+static int batch_recv_cb_called;
+static int batch_send_cb_called;
+
+
+static void batch_send_cb(uv_udp_send_t* req, int status) {
+  ASSERT(status == 0);
+  ASSERT(req->handle == &client);
+  batch_send_cb_called++;
+}
+
+
+static void batch_recv_cb(uv_udp_t* handle,
+                          ssize_t nread,
+                          const uv_buf_t* rcvbuf,
+                          const struct sockaddr* addr,
+                          unsigned flags) {
+  if (nread == 0) {
+    ASSERT(addr == NULL);
+    return;
+  }
+
+  ASSERT(nread == 3);
+  ASSERT(addr != NULL);
+  ASSERT(memcmp("ABC", rcvbuf->base, nread) == 0);
+
+  if (++batch_recv_cb_called == 4) {
+    uv_close((uv_handle_t*) handle, close_cb);
+    uv_close((uv_handle_t*) &client, close_cb);
+  }
+}
+
+
+TEST_IMPL(udp_try_send_batch) {
+  struct sockaddr_in addr;
+  uv_udp_send_t req;
+  uv_buf_t bufs[5];
+  int r;
+
+  ASSERT(0 == uv_ip4_addr("0.0.0.0", TEST_PORT, &addr));
+
+  r = uv_udp_init(uv_default_loop(), &server);
+  ASSERT(r == 0);
+
+  r = uv_udp_bind(&server, (const struct sockaddr*) &addr, 0);
+  ASSERT(r == 0);
+
+  r = uv_udp_recv_start(&server, alloc_cb, batch_recv_cb);
+  ASSERT(r == 0);
+
+  ASSERT(0 == uv_ip4_addr("127.0.0.1", TEST_PORT, &addr));
+
+  r = uv_udp_init(uv_default_loop(), &client);
+  ASSERT(r == 0);
+
+  bufs[0] = uv_buf_init("ABC", 3);
+  bufs[1] = uv_buf_init("ABC", 3);
+  bufs[2] = uv_buf_init("ABC", 3);
+
+  r = uv_udp_try_send_batch(&client, bufs, 0, (const struct sockaddr*) &addr);
+  ASSERT(r == UV_EINVAL);
+
+  r = uv_udp_try_send_batch(&client, bufs, 2, (const struct sockaddr*) &addr);
+  ASSERT(r == 2);
+
+  r = uv_udp_connect(&client, (const struct sockaddr*) &addr);
+  ASSERT(r == 0);
+
+  r = uv_udp_try_send_batch(&client, bufs, 1, NULL);
+  ASSERT(r == 1);
+
+  /* 已连接的handle直接发出去，不管bufs有几个 */
+  bufs[0] = uv_buf_init("A", 1);
+  bufs[1] = uv_buf_init("", 0);
+  bufs[2] = uv_buf_init("B", 1);
+  bufs[3] = uv_buf_init("", 0);
+  bufs[4] = uv_buf_init("C", 1);
+  r = uv_udp_send(&req, &client, bufs, 5, NULL, batch_send_cb);
+  ASSERT(r == 0);
+  ASSERT(client.send_queue_size == 0);
+
+  uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+
+  ASSERT(close_cb_called == 2);
+  ASSERT(batch_recv_cb_called == 4);
+  ASSERT(batch_send_cb_called == 1);
+
+  ASSERT(client.send_queue_size == 0);
+  ASSERT(server.send_queue_size == 0);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
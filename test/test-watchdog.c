@@ -0,0 +1,335 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+# include <signal.h>
+# include <sys/socket.h>
+# include <sys/time.h>
+# include <unistd.h>
+#endif
+
+static uv_watchdog_info_t last_info;
+static int watchdog_cb_called;
+static uv_timer_t timer_handle;
+static int timer_cb_called;
+
+
+static void block_for(int ms) {
+#ifdef _WIN32
+  Sleep(ms);
+#else
+  usleep(ms * 1000);
+#endif
+}
+
+
+static void watchdog_cb(uv_loop_t* loop, const uv_watchdog_info_t* info) {
+  /* Runs on the watchdog thread, the loop thread is still blocked. */
+  memcpy(&last_info, info, sizeof(last_info));
+  watchdog_cb_called++;
+}
+
+
+static void fast_timer_cb(uv_timer_t* handle) {
+  if (++timer_cb_called == 10)
+    uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+static void slow_timer_cb(uv_timer_t* handle) {
+  timer_cb_called++;
+  block_for(200);
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+TEST_IMPL(watchdog_timer) {
+  uv_loop_t loop;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_watchdog_stop(&loop));
+  ASSERT(UV_EINVAL == uv_watchdog_start(&loop, NULL, 50));
+  ASSERT(UV_EINVAL == uv_watchdog_start(&loop, watchdog_cb, 0));
+  ASSERT(0 == uv_watchdog_start(&loop, watchdog_cb, 50));
+  ASSERT(UV_EBUSY == uv_watchdog_start(&loop, watchdog_cb, 50));
+
+  /* Callbacks that return quickly are not reported. */
+  ASSERT(0 == uv_timer_init(&loop, &timer_handle));
+  ASSERT(0 == uv_timer_start(&timer_handle, fast_timer_cb, 1, 1));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(10 == timer_cb_called);
+  ASSERT(0 == watchdog_cb_called);
+
+  timer_cb_called = 0;
+  ASSERT(0 == uv_timer_init(&loop, &timer_handle));
+  ASSERT(0 == uv_timer_start(&timer_handle, slow_timer_cb, 1, 0));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(1 == timer_cb_called);
+
+  /* Joins the watchdog thread, its writes are visible after this. */
+  ASSERT(0 == uv_watchdog_stop(&loop));
+  ASSERT(1 == watchdog_cb_called);
+  ASSERT(last_info.type == UV_TIMER);
+  ASSERT(last_info.handle == &timer_handle);
+  ASSERT(last_info.cb == (void*) slow_timer_cb);
+  ASSERT(last_info.elapsed >= 50 * 1000 * 1000);
+
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+}
+
+
+#ifndef _WIN32
+static uv_pipe_t pipe_handle;
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[64];
+  *buf = uv_buf_init(slab, sizeof(slab));
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+  ASSERT(nread == 4);
+  block_for(200);
+  uv_close((uv_handle_t*) stream, NULL);
+}
+#endif
+
+
+TEST_IMPL(watchdog_io) {
+#ifdef _WIN32
+  RETURN_SKIP("Test not implemented on Windows.");
+#else
+  uv_loop_t loop;
+  int fds[2];
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_watchdog_start(&loop, watchdog_cb, 50));
+
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(&loop, &pipe_handle, 0));
+  ASSERT(0 == uv_pipe_open(&pipe_handle, fds[0]));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &pipe_handle, alloc_cb, read_cb));
+  ASSERT(4 == write(fds[1], "PING", 4));
+
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+
+  /* The loop is closed with the watchdog still running. */
+  ASSERT(0 == uv_loop_close(&loop));
+  ASSERT(1 == watchdog_cb_called);
+  ASSERT(last_info.type == UV_NAMED_PIPE);
+  ASSERT(last_info.handle == &pipe_handle);
+  ASSERT(last_info.cb != NULL);
+  ASSERT(last_info.elapsed >= 50 * 1000 * 1000);
+
+  ASSERT(0 == close(fds[1]));
+  return 0;
+#endif
+}
+
+
+static uv_work_t work_req;
+static int after_work_cb_called;
+
+
+static void work_cb(uv_work_t* req) {
+}
+
+
+static void after_work_cb(uv_work_t* req, int status) {
+  ASSERT(status == 0);
+  after_work_cb_called++;
+  block_for(200);
+}
+
+
+TEST_IMPL(watchdog_work) {
+  uv_loop_t loop;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_watchdog_start(&loop, watchdog_cb, 50));
+  ASSERT(0 == uv_queue_work(&loop, &work_req, work_cb, after_work_cb));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(1 == after_work_cb_called);
+
+  ASSERT(0 == uv_watchdog_stop(&loop));
+  ASSERT(1 == watchdog_cb_called);
+  ASSERT(last_info.type == UV_UNKNOWN_HANDLE);
+  ASSERT(last_info.handle == NULL);
+  ASSERT(last_info.cb != NULL);
+
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+}
+
+
+static uv_timer_t inner_timer_handle;
+static int inner_timer_cb_called;
+
+
+static void inner_timer_cb(uv_timer_t* handle) {
+  inner_timer_cb_called++;
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+static void outer_timer_cb(uv_timer_t* handle) {
+  /* The inner callback returns before the outer one starts blocking. */
+  ASSERT(0 == uv_timer_init(handle->loop, &inner_timer_handle));
+  ASSERT(0 == uv_timer_start(&inner_timer_handle, inner_timer_cb, 0, 0));
+  uv_run(handle->loop, UV_RUN_NOWAIT);
+  ASSERT(1 == inner_timer_cb_called);
+
+  timer_cb_called++;
+  block_for(200);
+  uv_close((uv_handle_t*) handle, NULL);
+}
+
+
+TEST_IMPL(watchdog_nested) {
+  uv_loop_t loop;
+
+  ASSERT(0 == uv_loop_init(&loop));
+  ASSERT(0 == uv_watchdog_start(&loop, watchdog_cb, 50));
+  ASSERT(0 == uv_timer_init(&loop, &timer_handle));
+  ASSERT(0 == uv_timer_start(&timer_handle, outer_timer_cb, 1, 0));
+  ASSERT(0 == uv_run(&loop, UV_RUN_DEFAULT));
+  ASSERT(1 == timer_cb_called);
+
+  ASSERT(0 == uv_watchdog_stop(&loop));
+  ASSERT(1 == watchdog_cb_called);
+  ASSERT(last_info.type == UV_TIMER);
+  ASSERT(last_info.handle == &timer_handle);
+  ASSERT(last_info.cb == (void*) outer_timer_cb);
+
+  ASSERT(0 == uv_loop_close(&loop));
+  return 0;
+}
+
+
+#ifndef _WIN32
+static uv_loop_t dispatch_loop;
+static volatile int prof_samples;
+static volatile int prof_hits;
+
+
+static void prof_handler(int signum) {
+  uv_dispatch_info_t info;
+  uv_loop_t* loop;
+
+  prof_samples++;
+  loop = uv_loop_running();
+  if (loop == &dispatch_loop &&
+      0 == uv_loop_dispatch_info(loop, &info) &&
+      info.type == UV_TIMER &&
+      info.handle == &timer_handle)
+    prof_hits++;
+}
+
+
+static void dispatch_read_cb(uv_stream_t* stream,
+                             ssize_t nread,
+                             const uv_buf_t* buf) {
+  uv_dispatch_info_t info;
+
+  ASSERT(nread == 4);
+  ASSERT(uv_loop_running() == &dispatch_loop);
+  ASSERT(0 == uv_loop_dispatch_info(&dispatch_loop, &info));
+  ASSERT(info.type == UV_NAMED_PIPE);
+  ASSERT(info.handle == &pipe_handle);
+  ASSERT(info.cb != NULL);
+  uv_close((uv_handle_t*) stream, NULL);
+}
+
+
+static void dispatch_timer_cb(uv_timer_t* handle) {
+  uv_dispatch_info_t info;
+  uint64_t deadline;
+
+  ASSERT(uv_loop_running() == &dispatch_loop);
+  ASSERT(0 == uv_loop_dispatch_info(&dispatch_loop, &info));
+  ASSERT(info.type == UV_TIMER);
+  ASSERT(info.handle == handle);
+  ASSERT(info.cb == (void*) dispatch_timer_cb);
+
+  /* Burn CPU until the profiling timer has fired a few times. */
+  deadline = uv_hrtime() + 2000 * 1000 * 1000ull;
+  while (prof_samples < 5 && uv_hrtime() < deadline);
+
+  timer_cb_called++;
+  uv_close((uv_handle_t*) handle, NULL);
+}
+#endif
+
+
+TEST_IMPL(loop_dispatch_info) {
+#ifdef _WIN32
+  RETURN_SKIP("Test not implemented on Windows.");
+#else
+  struct itimerval it;
+  uv_dispatch_info_t info;
+  int fds[2];
+
+  ASSERT(0 == uv_loop_init(&dispatch_loop));
+  ASSERT(NULL == uv_loop_running());
+  ASSERT(UV_ENOENT == uv_loop_dispatch_info(&dispatch_loop, &info));
+
+  ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT(0 == uv_pipe_init(&dispatch_loop, &pipe_handle, 0));
+  ASSERT(0 == uv_pipe_open(&pipe_handle, fds[0]));
+  ASSERT(0 == uv_read_start((uv_stream_t*) &pipe_handle,
+                            alloc_cb,
+                            dispatch_read_cb));
+  ASSERT(4 == write(fds[1], "PING", 4));
+  ASSERT(0 == uv_run(&dispatch_loop, UV_RUN_DEFAULT));
+  ASSERT(0 == close(fds[1]));
+
+  /* A SIGPROF handler sees the timer callback that is burning CPU. */
+  ASSERT(SIG_ERR != signal(SIGPROF, prof_handler));
+  memset(&it, 0, sizeof(it));
+  it.it_interval.tv_usec = 1000;
+  it.it_value.tv_usec = 1000;
+  ASSERT(0 == setitimer(ITIMER_PROF, &it, NULL));
+
+  ASSERT(0 == uv_timer_init(&dispatch_loop, &timer_handle));
+  ASSERT(0 == uv_timer_start(&timer_handle, dispatch_timer_cb, 1, 0));
+  ASSERT(0 == uv_run(&dispatch_loop, UV_RUN_DEFAULT));
+
+  memset(&it, 0, sizeof(it));
+  ASSERT(0 == setitimer(ITIMER_PROF, &it, NULL));
+  ASSERT(SIG_ERR != signal(SIGPROF, SIG_DFL));
+
+  ASSERT(1 == timer_cb_called);
+  ASSERT(prof_samples >= 5);
+  ASSERT(prof_hits > 0);
+  ASSERT(NULL == uv_loop_running());
+  ASSERT(UV_ENOENT == uv_loop_dispatch_info(&dispatch_loop, &info));
+
+  ASSERT(0 == uv_loop_close(&dispatch_loop));
+  return 0;
+#endif
+}
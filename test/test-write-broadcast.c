@@ -0,0 +1,154 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "uv.h"
+#include "task.h"
+
+#ifdef _WIN32
+
+TEST_IMPL(write_broadcast) {
+  RETURN_SKIP("Test not implemented on Windows.");
+}
+
+#else  /* !_WIN32 */
+
+#include <string.h>
+#include <sys/socket.h>
+
+#define NPAIRS 8
+
+static uv_pipe_t writers[NPAIRS];
+static uv_pipe_t readers[NPAIRS];
+static uv_write_t shared_req;
+static uv_shared_buf_t shared;
+static char payload[] = "broadcast payload";
+static char received[NPAIRS][64];
+static size_t nread[NPAIRS];
+static int free_cb_called;
+static int write_cb_called;
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void free_cb(uv_shared_buf_t* buf) {
+  int i;
+
+  ASSERT(buf == &shared);
+  ASSERT(buf->refcount == 0);
+  /* Every write has completed by now. */
+  ASSERT(write_cb_called == 1);
+  free_cb_called++;
+
+  for (i = 0; i < NPAIRS; i++)
+    if (!uv_is_closing((uv_handle_t*) &writers[i]))
+      uv_close((uv_handle_t*) &writers[i], close_cb);
+}
+
+
+static void write_cb(uv_write_t* req, int status) {
+  ASSERT(status == 0);
+  ASSERT(req == &shared_req);
+  write_cb_called++;
+}
+
+
+static void alloc_cb(uv_handle_t* handle, size_t size, uv_buf_t* buf) {
+  static char slab[1024];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+
+static void read_cb(uv_stream_t* stream, ssize_t n, const uv_buf_t* buf) {
+  size_t i;
+
+  if (n == UV_EOF) {
+    uv_close((uv_handle_t*) stream, close_cb);
+    return;
+  }
+
+  ASSERT(n >= 0);
+  i = (uv_pipe_t*) stream - readers;
+  ASSERT(i < NPAIRS);
+  ASSERT(nread[i] + n <= sizeof(received[i]));
+  memcpy(received[i] + nread[i], buf->base, n);
+  nread[i] += n;
+}
+
+
+TEST_IMPL(write_broadcast) {
+  uv_stream_t* streams[NPAIRS];
+  uv_loop_t* loop;
+  int fds[2];
+  int i;
+
+  loop = uv_default_loop();
+  for (i = 0; i < NPAIRS; i++) {
+    ASSERT(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    ASSERT(0 == uv_pipe_init(loop, &writers[i], 0));
+    ASSERT(0 == uv_pipe_open(&writers[i], fds[0]));
+    ASSERT(0 == uv_pipe_init(loop, &readers[i], 0));
+    ASSERT(0 == uv_pipe_open(&readers[i], fds[1]));
+    ASSERT(0 == uv_read_start((uv_stream_t*) &readers[i], alloc_cb, read_cb));
+    streams[i] = (uv_stream_t*) &writers[i];
+  }
+
+  uv_shared_buf_init(&shared, payload, sizeof(payload) - 1, free_cb);
+  ASSERT(shared.refcount == 1);
+
+  /* A closing stream is skipped. */
+  uv_close((uv_handle_t*) &writers[NPAIRS - 1], close_cb);
+  ASSERT(0 == uv_write_broadcast(streams, 0, &shared));
+  ASSERT(NPAIRS - 1 == uv_write_broadcast(streams, NPAIRS, &shared));
+  ASSERT(shared.refcount == NPAIRS);
+
+  ASSERT(0 == uv_write_shared(&shared_req, streams[0], &shared, write_cb));
+  ASSERT(shared.refcount == NPAIRS + 1);
+
+  /* Drop our own reference; the library keeps the rest alive. */
+  uv_shared_buf_unref(&shared);
+  ASSERT(free_cb_called == 0);
+
+  ASSERT(0 == uv_run(loop, UV_RUN_DEFAULT));
+
+  ASSERT(free_cb_called == 1);
+  ASSERT(write_cb_called == 1);
+  ASSERT(close_cb_called == 2 * NPAIRS);
+  ASSERT(nread[0] == 2 * (sizeof(payload) - 1));
+  ASSERT(0 == memcmp(received[0], payload, sizeof(payload) - 1));
+  ASSERT(0 == memcmp(received[0] + sizeof(payload) - 1,
+                     payload,
+                     sizeof(payload) - 1));
+  for (i = 1; i < NPAIRS - 1; i++) {
+    ASSERT(nread[i] == sizeof(payload) - 1);
+    ASSERT(0 == memcmp(received[i], payload, sizeof(payload) - 1));
+  }
+  ASSERT(nread[NPAIRS - 1] == 0);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+#endif  /* !_WIN32 */
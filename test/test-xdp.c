@@ -0,0 +1,102 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "uv.h"
+#include "task.h"
+
+#include <string.h>
+
+static int close_cb_called;
+
+
+static void close_cb(uv_handle_t* handle) {
+  close_cb_called++;
+}
+
+
+static void recv_cb(uv_xdp_t* handle, const uv_buf_t* frame) {
+  ASSERT(0 && "no XDP program redirects frames to this socket");
+}
+
+
+TEST_IMPL(xdp_bind) {
+  uv_os_fd_t fd;
+  uv_xdp_t handle;
+  int r;
+
+  ASSERT(0 == uv_xdp_init(uv_default_loop(), &handle));
+  ASSERT(UV_EBADF == uv_fileno((uv_handle_t*) &handle, &fd));
+  ASSERT(UV_EBADF == uv_xdp_recv_start(&handle, recv_cb));
+  ASSERT(UV_EINVAL == uv_xdp_bind(&handle, NULL, 0, 0));
+  ASSERT(UV_EINVAL ==
+         uv_xdp_bind(&handle, "lo", 0, UV_XDP_ZEROCOPY | UV_XDP_COPY));
+
+  r = uv_xdp_bind(&handle, "lo", 0, UV_XDP_COPY);
+#ifdef __linux__
+  /* 没有权限或者内核没开CONFIG_XDP_SOCKETS时跳过 */
+  if (r == UV_EPERM || r == UV_EAFNOSUPPORT || r == UV_ENOTSUP) {
+    uv_close((uv_handle_t*) &handle, NULL);
+    uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+    MAKE_VALGRIND_HAPPY();
+    RETURN_SKIP("AF_XDP sockets are not available");
+  }
+  ASSERT(r == 0);
+  ASSERT(UV_EALREADY == uv_xdp_bind(&handle, "lo", 0, UV_XDP_COPY));
+
+  ASSERT(0 == uv_fileno((uv_handle_t*) &handle, &fd));
+  ASSERT(fd >= 0);
+
+  ASSERT(0 == uv_xdp_recv_start(&handle, recv_cb));
+  ASSERT(UV_EALREADY == uv_xdp_recv_start(&handle, recv_cb));
+  ASSERT(uv_is_active((uv_handle_t*) &handle));
+  uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+  ASSERT(0 == uv_xdp_recv_stop(&handle));
+  ASSERT(!uv_is_active((uv_handle_t*) &handle));
+#else
+  ASSERT(r == UV_ENOTSUP);
+#endif
+
+  uv_close((uv_handle_t*) &handle, close_cb);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+  ASSERT(close_cb_called == 1);
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
+
+
+TEST_IMPL(xdp_bind_no_device) {
+  uv_xdp_t handle;
+
+  ASSERT(0 == uv_xdp_init(uv_default_loop(), &handle));
+#ifdef __linux__
+  ASSERT(UV_ENODEV == uv_xdp_bind(&handle, "uv-no-such-if", 0, 0));
+#else
+  ASSERT(UV_ENOTSUP == uv_xdp_bind(&handle, "uv-no-such-if", 0, 0));
+#endif
+
+  uv_close((uv_handle_t*) &handle, NULL);
+  ASSERT(0 == uv_run(uv_default_loop(), UV_RUN_DEFAULT));
+
+  MAKE_VALGRIND_HAPPY();
+  return 0;
+}
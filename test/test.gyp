@@ -6,6 +6,7 @@
       'dependencies': [ '../uv.gyp:libuv' ],
       'sources': [
         'blackhole-server.c',
+        'dns-server.c',
         'echo-server.c',
         'run-tests.c',
         'runner.c',
@@ -14,10 +15,12 @@
         'task.h',
         'test-active.c',
         'test-async.c',
+        'test-atomic-queue.c',
         'test-async-null-cb.c',
         'test-callback-stack.c',
         'test-callback-order.c',
         'test-close-fd.c',
+        'test-close-many.c',
         'test-close-order.c',
         'test-connect-unspecified.c',
         'test-connection-fail.c',
@@ -34,6 +37,8 @@
         'test-fs.c',
         'test-fs-copyfile.c',
         'test-fs-event.c',
+        'test-fs-log.c',
+        'test-fs-readdir.c',
         'test-getters-setters.c',
         'test-get-currentexe.c',
         'test-get-memory.c',
@@ -46,7 +51,10 @@
         'test-homedir.c',
         'test-hrtime.c',
         'test-idle.c',
+        'test-iface-watch.c',
         'test-idna.c',
+        'test-io-stats.c',
+        'test-iobuf.c',
         'test-ip6-addr.c',
         'test-ipc-heavy-traffic-deadlock-bug.c',
         'test-ipc-send-recv.c',
@@ -58,8 +66,13 @@
         'test-loop-stop.c',
         'test-loop-time.c',
         'test-loop-configure.c',
+        'test-loop-dump-handles.c',
+        'test-metrics.c',
         'test-walk-handles.c',
+        'test-watchdog.c',
         'test-watcher-cross-stop.c',
+        'test-write-broadcast.c',
+        'test-xdp.c',
         'test-multiple-listen.c',
         'test-osx-select.c',
         'test-pass-always.c',
@@ -70,7 +83,12 @@
         'test-pipe-connect-prepare.c',
         'test-pipe-getsockname.c',
         'test-pipe-pending-instances.c',
+        'test-pipe-pool.c',
+        'test-pipe-read-budget.c',
+        'test-pipe-read-size-hint.c',
+        'test-pipe-read-stop.c',
         'test-pipe-sendmsg.c',
+        'test-pipe-seqpacket.c',
         'test-pipe-server-close.c',
         'test-pipe-close-stdout-read-stdin.c',
         'test-pipe-set-non-blocking.c',
@@ -82,13 +100,19 @@
         'test-poll-closesocket.c',
         'test-poll-oob.c',
         'test-process-priority.c',
+        'test-process-pool.c',
         'test-process-title.c',
         'test-process-title-threadsafe.c',
         'test-queue-foreach-delete.c',
+        'test-rate-limit.c',
+        'test-read-batch.c',
+        'test-read-iov.c',
         'test-ref.c',
         'test-run-nowait.c',
         'test-run-once.c',
+        'test-runtime.c',
         'test-semaphore.c',
+        'test-shm-channel.c',
         'test-shutdown-close.c',
         'test-shutdown-eof.c',
         'test-shutdown-twice.c',
@@ -98,17 +122,32 @@
         'test-spawn.c',
         'test-fs-poll.c',
         'test-stdio-over-pipes.c',
+        'test-stream-cork.c',
+        'test-stream-sendfile.c',
+        'test-stream-splice.c',
+        'test-stream-timeouts.c',
+        'test-stream-watermarks.c',
+        'test-stream-write-batch.c',
+        'test-stream-write-bufs.c',
+        'test-tcp-accept-burst.c',
+        'test-tcp-admission.c',
         'test-tcp-alloc-cb-fail.c',
         'test-tcp-bind-error.c',
         'test-tcp-bind6-error.c',
         'test-tcp-close.c',
+        'test-tcp-close-reset.c',
         'test-tcp-close-accept.c',
         'test-tcp-close-while-connecting.c',
         'test-tcp-create-socket-early.c',
         'test-tcp-connect-error-after-write.c',
         'test-tcp-shutdown-after-write.c',
+        'test-tcp-fastopen.c',
+        'test-tcp-ktls.c',
         'test-tcp-flags.c',
+        'test-tcp-get-info.c',
+        'test-tcp-migrate.c',
         'test-tcp-connect-error.c',
+        'test-tcp-connect-host.c',
         'test-tcp-connect-timeout.c',
         'test-tcp-connect6-error.c',
         'test-tcp-open.c',
@@ -120,7 +159,9 @@
         'test-tcp-unexpected-read.c',
         'test-tcp-oob.c',
         'test-tcp-read-stop.c',
+        'test-tcp-reuseport.c',
         'test-tcp-write-queue-order.c',
+        'test-tcp-write-zerocopy.c',
         'test-threadpool.c',
         'test-threadpool-cancel.c',
         'test-thread-equal.c',
@@ -130,6 +171,7 @@
         'test-thread-affinity.c',
         'test-barrier.c',
         'test-buf.c',
+        'test-buf-pool.c',
         'test-condvar.c',
         'test-timer-again.c',
         'test-timer-from-check.c',
@@ -140,19 +182,25 @@
         'test-udp-connect.c',
         'test-udp-create-socket-early.c',
         'test-udp-dgram-too-big.c',
+        'test-udp-gso.c',
         'test-udp-ipv6.c',
         'test-udp-open.c',
+        'test-udp-recv-info.c',
         'test-udp-options.c',
         'test-udp-send-and-recv.c',
         'test-udp-send-hang-loop.c',
         'test-udp-send-immediate.c',
+        'test-udp-send-queue-limit.c',
+        'test-udp-send-txtime.c',
         'test-udp-send-unreachable.c',
+        'test-udp-send-zerocopy.c',
         'test-udp-multicast-join.c',
         'test-udp-multicast-join6.c',
         'test-dlerror.c',
         'test-udp-multicast-ttl.c',
         'test-ip4-addr.c',
         'test-ip6-addr.c',
+        'test-udp-mmsg.c',
         'test-udp-multicast-interface.c',
         'test-udp-multicast-interface6.c',
         'test-udp-try-send.c',
@@ -219,20 +267,29 @@
       'sources': [
         'benchmark-async.c',
         'benchmark-async-pummel.c',
+        'benchmark-fs-io.c',
         'benchmark-fs-stat.c',
         'benchmark-getaddrinfo.c',
+        'benchmark-http.c',
+        'benchmark-idle-conns.c',
         'benchmark-list.h',
         'benchmark-loop-count.c',
         'benchmark-million-async.c',
         'benchmark-million-timers.c',
         'benchmark-multi-accept.c',
+        'benchmark-multi-loop.c',
+        'benchmark-ping-latency.c',
         'benchmark-ping-pongs.c',
         'benchmark-pound.c',
         'benchmark-pump.c',
+        'benchmark-queue-work.c',
+        'benchmark-report.c',
         'benchmark-sizes.c',
         'benchmark-spawn.c',
         'benchmark-thread.c',
+        'benchmark-timer-churn.c',
         'benchmark-tcp-write-batch.c',
+        'benchmark-udp-batch.c',
         'benchmark-udp-pummel.c',
         'dns-server.c',
         'echo-server.c',
@@ -65,15 +65,19 @@
         'common.gypi',
         'include/uv.h',
         'include/uv/tree.h',
+        'include/uv/coro.h',
+        'include/uv/cxx.h',
         'include/uv/errno.h',
         'include/uv/threadpool.h',
         'include/uv/version.h',
+        'src/fs-log.c',
         'src/fs-poll.c',
-        'src/heap-inl.h',
         'src/idna.c',
         'src/idna.h',
         'src/inet.c',
         'src/loop-watcher.c',
+        'src/pipe-pool.c',
+        'src/process-pool.c',
         'src/queue.h',
         'src/threadpool.c',
         'src/timer.c',
@@ -150,18 +154,25 @@
             'include/uv/darwin.h',
             'include/uv/bsd.h',
             'include/uv/aix.h',
+            'src/unix/arena.c',
             'src/unix/async.c',
             'src/unix/atomic-ops.h',
+            'src/unix/atomic-queue.c',
             'src/unix/core.c',
             'src/unix/dl.c',
             'src/unix/fs.c',
             'src/unix/getaddrinfo.c',
             'src/unix/getnameinfo.c',
+            'src/unix/iface-watch.c',
             'src/unix/internal.h',
             'src/unix/loop.c',
             'src/unix/pipe.c',
             'src/unix/poll.c',
             'src/unix/process.c',
+            'src/unix/ratelimit.c',
+            'src/unix/resolver.c',
+            'src/unix/runtime.c',
+            'src/unix/shm-channel.c',
             'src/unix/signal.c',
             'src/unix/spinlock.h',
             'src/unix/stream.c',
@@ -169,6 +180,8 @@
             'src/unix/thread.c',
             'src/unix/tty.c',
             'src/unix/udp.c',
+            'src/unix/watchdog.c',
+            'src/unix/xdp.c',
           ],
           'link_settings': {
             'libraries': [ '-lm' ],
@@ -233,6 +246,8 @@
           'sources': [
             'src/unix/linux-core.c',
             'src/unix/linux-inotify.c',
+            'src/unix/linux-iouring.c',
+            'src/unix/linux-perf.c',
             'src/unix/linux-syscalls.c',
             'src/unix/linux-syscalls.h',
             'src/unix/procfs-exepath.c',
@@ -247,6 +262,8 @@
           'sources': [
             'src/unix/linux-core.c',
             'src/unix/linux-inotify.c',
+            'src/unix/linux-iouring.c',
+            'src/unix/linux-perf.c',
             'src/unix/linux-syscalls.c',
             'src/unix/linux-syscalls.h',
             'src/unix/pthread-fixes.c',